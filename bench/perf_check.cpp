@@ -0,0 +1,255 @@
+// Holds a benchmark's results against the baseline recorded on the same GPU and fails on a
+// regression. Reads the "summary" of a --benchmark JSON or of sph_bench --summary, looks up
+// baselines/<gpu>/<scenario>.txt for its renderer, prints a comparison table and exits 1
+// if any median or 99th percentile grew past its tolerance. Without a baseline for the GPU
+// it exits 77, which CTest counts as skipped; --update writes one from the results.
+//
+//   perf_check --results results.json --baselines DIR [--tolerance 0.10]
+//              [--p99-tolerance 0.25] [--min-ms 0.05] [--update]
+//
+// Baseline lines are "median p99 name", in milliseconds; '#' starts a comment.
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr int EXIT_REGRESSED = 1;
+constexpr int EXIT_USAGE = 2;
+constexpr int EXIT_NO_BASELINE = 77;
+
+struct Options {
+    std::string resultsPath;
+    std::string baselineDir;
+    double tolerance = 0.10;        // Median may grow this fraction
+    double p99Tolerance = 0.25;     // The tail is noisier
+    double minMs = 0.05;            // Smaller growth is timer noise, whatever the fraction
+    bool update = false;
+};
+
+struct Timing {
+    double median = 0.0;
+    double p99 = 0.0;
+};
+
+struct Results {
+    std::string scenario;
+    std::string renderer;
+    std::vector<std::pair<std::string, Timing>> metrics;   // File order
+};
+
+// The string value of "key": "...", unescaped; only what Benchmark and sph_bench write
+bool findString(const std::string& text, const std::string& key, std::string& value) {
+    size_t at = text.find("\"" + key + "\"");
+    if (at == std::string::npos) return false;
+    at = text.find('"', text.find(':', at) + 1);
+    if (at == std::string::npos) return false;
+    value.clear();
+    for (size_t i = at + 1; i < text.size() && text[i] != '"'; i++) {
+        if (text[i] == '\\' && i + 1 < text.size()) i++;
+        value += text[i];
+    }
+    return true;
+}
+
+double findNumber(const std::string& entry, const char* key) {
+    size_t at = entry.find(std::string("\"") + key + "\"");
+    if (at == std::string::npos) return -1.0;
+    return std::atof(entry.c_str() + entry.find(':', at) + 1);
+}
+
+bool readResults(const std::string& path, Results& results) {
+    std::ifstream file(path);
+    if (!file) {
+        std::cerr << "Could not read " << path << std::endl;
+        return false;
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    std::string text = buffer.str();
+
+    if (!findString(text, "scenario", results.scenario) || !findString(text, "renderer", results.renderer)) {
+        std::cerr << path << " has no scenario or renderer" << std::endl;
+        return false;
+    }
+
+    // Entries of the summary object: "name": { "mean": .., "median": .., "p99": .., "samples": .. }
+    size_t at = text.find("\"summary\"");
+    size_t end = at == std::string::npos ? std::string::npos : text.find("\n  }", at);
+    if (end == std::string::npos) {
+        std::cerr << path << " has no summary" << std::endl;
+        return false;
+    }
+    at = text.find('{', at) + 1;
+    while (true) {
+        size_t nameStart = text.find('"', at);
+        if (nameStart == std::string::npos || nameStart > end) break;
+        size_t nameEnd = text.find('"', nameStart + 1);
+        size_t entryEnd = text.find('}', nameEnd);
+        std::string entry = text.substr(nameEnd, entryEnd - nameEnd);
+        Timing timing;
+        timing.median = findNumber(entry, "median");
+        timing.p99 = findNumber(entry, "p99");
+        if (findNumber(entry, "samples") > 0.0) {
+            results.metrics.emplace_back(text.substr(nameStart + 1, nameEnd - nameStart - 1), timing);
+        }
+        at = entryEnd + 1;
+    }
+    return true;
+}
+
+// "NVIDIA GeForce RTX 3080/PCIe/SSE2" -> "NVIDIA_GeForce_RTX_3080": the name up to the
+// first slash, anything but letters and digits collapsed to underscores
+std::string gpuKey(const std::string& renderer) {
+    std::string key;
+    for (char c : renderer.substr(0, renderer.find('/'))) {
+        if (std::isalnum(static_cast<unsigned char>(c))) {
+            key += c;
+        } else if (!key.empty() && key.back() != '_') {
+            key += '_';
+        }
+    }
+    while (!key.empty() && key.back() == '_') key.pop_back();
+    return key.empty() ? "unknown" : key;
+}
+
+bool readBaseline(const std::string& path, std::map<std::string, Timing>& baseline) {
+    std::ifstream file(path);
+    if (!file) return false;
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        std::istringstream fields(line);
+        Timing timing;
+        std::string name;
+        if (!(fields >> timing.median >> timing.p99)) continue;
+        std::getline(fields >> std::ws, name);
+        if (!name.empty()) baseline[name] = timing;
+    }
+    return true;
+}
+
+bool writeBaseline(const std::string& path, const Results& results) {
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path());
+    std::ofstream file(path);
+    if (!file) {
+        std::cerr << "Could not write " << path << std::endl;
+        return false;
+    }
+    file << "# " << results.scenario << " on " << results.renderer << "\n";
+    file << "# median_ms p99_ms metric\n";
+    char line[64];
+    for (const auto& metric : results.metrics) {
+        std::snprintf(line, sizeof(line), "%.4f %.4f ", metric.second.median, metric.second.p99);
+        file << line << metric.first << "\n";
+    }
+    return static_cast<bool>(file);
+}
+
+// Growth past both the fraction and the absolute floor
+bool regressed(double baseline, double current, double tolerance, double minMs) {
+    return current > baseline * (1.0 + tolerance) && current - baseline > minMs;
+}
+
+double change(double baseline, double current) {
+    return baseline > 0.0 ? 100.0 * (current - baseline) / baseline : 0.0;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (std::strcmp(argv[i], "--results") == 0 && hasValue) {
+            options.resultsPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--baselines") == 0 && hasValue) {
+            options.baselineDir = argv[++i];
+        } else if (std::strcmp(argv[i], "--tolerance") == 0 && hasValue) {
+            options.tolerance = std::max(std::atof(argv[++i]), 0.0);
+        } else if (std::strcmp(argv[i], "--p99-tolerance") == 0 && hasValue) {
+            options.p99Tolerance = std::max(std::atof(argv[++i]), 0.0);
+        } else if (std::strcmp(argv[i], "--min-ms") == 0 && hasValue) {
+            options.minMs = std::max(std::atof(argv[++i]), 0.0);
+        } else if (std::strcmp(argv[i], "--update") == 0) {
+            options.update = true;
+        } else {
+            std::cout << "Usage: " << argv[0] << " --results results.json --baselines DIR [--tolerance F]"
+                      << " [--p99-tolerance F] [--min-ms MS] [--update]" << std::endl;
+            return std::strcmp(argv[i], "--help") == 0 ? 0 : EXIT_USAGE;
+        }
+    }
+    if (options.resultsPath.empty() || options.baselineDir.empty()) {
+        std::cerr << "perf_check needs --results and --baselines" << std::endl;
+        return EXIT_USAGE;
+    }
+
+    Results results;
+    if (!readResults(options.resultsPath, results)) return EXIT_USAGE;
+    std::string baselinePath = (std::filesystem::path(options.baselineDir) / gpuKey(results.renderer) /
+                                (results.scenario + ".txt")).string();
+
+    if (options.update) {
+        if (!writeBaseline(baselinePath, results)) return EXIT_USAGE;
+        std::cout << "Baseline for '" << results.scenario << "' on " << results.renderer << " written to "
+                  << baselinePath << std::endl;
+        return 0;
+    }
+
+    std::map<std::string, Timing> baseline;
+    if (!readBaseline(baselinePath, baseline)) {
+        std::cout << "No baseline for '" << results.scenario << "' on " << results.renderer << " (" << baselinePath
+                  << "); record one with --update" << std::endl;
+        return EXIT_NO_BASELINE;
+    }
+
+    std::printf("'%s' on %s against %s\n", results.scenario.c_str(), results.renderer.c_str(), baselinePath.c_str());
+    std::printf("tolerance: median +%.0f%%, p99 +%.0f%%, and over %.2f ms\n", 100.0 * options.tolerance,
+                100.0 * options.p99Tolerance, options.minMs);
+    std::printf("%-36s %9s %9s %8s %9s %9s %8s  %s\n", "metric", "base med", "median", "change", "base p99", "p99",
+                "change", "status");
+
+    int regressions = 0;
+    for (const auto& metric : results.metrics) {
+        const std::string& name = metric.first;
+        const Timing& current = metric.second;
+        auto found = baseline.find(name);
+        if (found == baseline.end()) {
+            std::printf("%-36s %9s %9.4f %8s %9s %9.4f %8s  new\n", name.c_str(), "-", current.median, "", "-",
+                        current.p99, "");
+            continue;
+        }
+        const Timing& base = found->second;
+        bool slower = regressed(base.median, current.median, options.tolerance, options.minMs) ||
+                      regressed(base.p99, current.p99, options.p99Tolerance, options.minMs);
+        regressions += slower ? 1 : 0;
+        std::printf("%-36s %9.4f %9.4f %+7.1f%% %9.4f %9.4f %+7.1f%%  %s\n", name.c_str(), base.median, current.median,
+                    change(base.median, current.median), base.p99, current.p99, change(base.p99, current.p99),
+                    slower ? "REGRESSED" : "ok");
+        baseline.erase(found);
+    }
+
+    // Left over: in the baseline but not measured, a pass that no longer runs or was renamed
+    for (const auto& missing : baseline) {
+        std::printf("%-36s %9.4f %9s %8s %9.4f %9s %8s  missing\n", missing.first.c_str(), missing.second.median, "-",
+                    "", missing.second.p99, "-", "");
+    }
+
+    if (regressions > 0) {
+        std::printf("%d metric%s regressed\n", regressions, regressions == 1 ? "" : "s");
+        return EXIT_REGRESSED;
+    }
+    std::printf("No regressions\n");
+    return 0;
+}
@@ -0,0 +1,293 @@
+// Scaling benchmark of the GL compute SPH: sweeps particle counts and grid cell sizes,
+// runs a fixed number of substeps of a dam break at each, and reports the GPU time of every
+// pass, the neighborhood size, the grid occupancy and a bandwidth estimate.
+//
+//   sph_bench [--counts 10000,100000,...] [--cell-scales 1,1.5,2] [--substeps N]
+//             [--warmup N] [--output results.csv] [--summary results.json]
+//
+// --summary writes the median and 99th percentile over the substeps of every configuration
+// in the summary layout of the --benchmark JSON, for perf_check to hold against a baseline.
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include "SPHComputeSystem.h"
+#include "ShaderCompiler.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace WaterSim;
+
+namespace {
+
+struct Options {
+    std::vector<uint32_t> counts = {10000, 50000, 100000, 250000, 500000, 1000000, 2000000};
+    std::vector<float> cellScales = {1.0f, 1.5f, 2.0f};   // Multiples of the kernel radius
+    int substeps = 20;
+    int warmup = 10;
+    std::string outputPath;
+    std::string summaryPath;
+};
+
+struct Result {
+    uint32_t particles = 0;
+    float cellSize = 0.0f;
+    glm::ivec3 grid{0};
+    float passMs[SPHPassProfile::PASS_SLOTS] = {};   // Per substep; negative if the pass never ran
+    float totalMs = 0.0f;
+    std::vector<double> passSamples[SPHPassProfile::PASS_SLOTS];   // Each substep's time
+    std::vector<double> totalSamples;
+    SPHGridOccupancy occupancy;
+    double bytesPerSubstep = 0.0;
+};
+
+const char* const PASS_LABELS[SPHPassProfile::PASS_SLOTS] = {
+    "", "step1", "step2", "step3", "step4", "step5", "step6", "lists", "pcisph", "sleep", "viscosity", "blocks", "adaptive", "levels", "band"
+};
+
+template <typename T>
+std::vector<T> parseList(const char* text) {
+    std::vector<T> values;
+    std::stringstream stream(text);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) values.push_back(static_cast<T>(std::atof(item.c_str())));
+    }
+    return values;
+}
+
+// Lower bound of the bytes a substep moves, from what each pass must read and write once:
+// step 1 reads and writes the 32-byte particle, step 2 scans the uint counts into starts,
+// step 3 copies every particle and reads the starts, step 5 reads the particle and writes a
+// pressure, step 6 reads and writes the particle. Neighbor reads are left out since the
+// caches absorb most of them, so (bytes / time) stays comparable across cell sizes
+double minimumSubstepBytes(uint32_t particles, uint32_t cells) {
+    double n = particles;
+    double c = cells;
+    return 64.0 * n + 8.0 * c + (64.0 * n + 4.0 * c) + 40.0 * n + 64.0 * n;
+}
+
+bool runConfiguration(const Options& options, uint32_t count, float cellScale, Result& result) {
+    // Box whose dam break (a quarter of x and z, from 25% to 50% of y) holds about count
+    // particles at the seeding spacing
+    float spacing = 2.0f * SPHConstants::PARTICLE_RADIUS;
+    float edge = std::cbrt(static_cast<float>(count)) * spacing;
+    glm::vec3 boxMin(-edge, 0.0f, -edge);
+    glm::vec3 boxMax(edge, 4.0f * edge, edge);
+
+    SPHComputeSystem system;
+    system.setCellSize(cellScale * SPHConstants::KERNEL_RADIUS);
+    system.setDeterministic(true);
+    if (!system.initialize(count, boxMin, boxMax)) {
+        std::cerr << "Could not initialize " << count << " particles" << std::endl;
+        return false;
+    }
+    system.setAdaptiveTimeStep(false);
+    system.setMaxSubsteps(1);
+
+    // One update(timeStep) is one substep
+    float stepTime = system.getTimeStep();
+    for (int i = 0; i < options.warmup; i++) {
+        system.update(stepTime);
+    }
+    glFinish();
+
+    // Taken per substep for the percentiles; the wait between them does not show in GPU time
+    SPHPassProfile profile;
+    system.setPassProfiling(true);
+    for (int i = 0; i < options.substeps; i++) {
+        system.update(stepTime);
+        SPHPassProfile substep = system.takePassProfile();
+        double total = 0.0;
+        for (int pass = 1; pass < SPHPassProfile::PASS_SLOTS; pass++) {
+            if (substep.passRuns[pass] == 0) continue;
+            result.passSamples[pass].push_back(substep.passMs[pass]);
+            total += substep.passMs[pass];
+            profile.passMs[pass] += substep.passMs[pass];
+            profile.passRuns[pass] += substep.passRuns[pass];
+        }
+        result.totalSamples.push_back(total);
+        profile.substeps += substep.substeps;
+    }
+    system.setPassProfiling(false);
+
+    result.particles = system.getParticleCount();
+    result.cellSize = system.getCellSize();
+    result.grid = system.getGridResolution();
+    result.occupancy = system.measureGridOccupancy();
+    for (int pass = 1; pass < SPHPassProfile::PASS_SLOTS; pass++) {
+        result.passMs[pass] = profile.passRuns[pass] > 0 ? profile.passMs[pass] / float(profile.substeps) : -1.0f;
+        result.totalMs += std::max(result.passMs[pass], 0.0f);
+    }
+    uint32_t cells = uint32_t(result.grid.x) * uint32_t(result.grid.y) * uint32_t(result.grid.z);
+    result.bytesPerSubstep = minimumSubstepBytes(result.particles, cells);
+    return true;
+}
+
+void printHeader() {
+    std::printf("%9s %6s %14s", "particles", "cell", "grid");
+    for (int pass = 1; pass <= 6; pass++) {
+        std::printf(" %7s", PASS_LABELS[pass]);
+    }
+    std::printf(" %8s %8s %6s %6s %5s %5s %6s\n", "total", "ms/M", "cand", "neigh", "max", "mean", "GB/s");
+}
+
+void printResult(const Result& result) {
+    char grid[32];
+    std::snprintf(grid, sizeof(grid), "%dx%dx%d", result.grid.x, result.grid.y, result.grid.z);
+    std::printf("%9u %6.4f %14s", result.particles, result.cellSize, grid);
+    for (int pass = 1; pass <= 6; pass++) {
+        if (result.passMs[pass] < 0.0f) {
+            std::printf(" %7s", "-");
+        } else {
+            std::printf(" %7.3f", result.passMs[pass]);
+        }
+    }
+    double perMillion = result.particles ? result.totalMs * 1.0e6 / result.particles : 0.0;
+    double bandwidth = result.totalMs > 0.0f ? result.bytesPerSubstep / (result.totalMs * 1.0e6) : 0.0;
+    std::printf(" %8.3f %8.3f %6.1f %6.1f %5u %5.1f %6.1f\n", result.totalMs, perMillion,
+                result.occupancy.candidatesPerParticle, result.occupancy.neighborsPerParticle,
+                result.occupancy.maxCellParticles, result.occupancy.meanCellParticles, bandwidth);
+    std::fflush(stdout);
+}
+
+bool writeCSV(const std::string& path, const std::vector<Result>& results) {
+    std::ofstream file(path);
+    if (!file) {
+        std::cerr << "Could not write " << path << std::endl;
+        return false;
+    }
+    file << "particles,cell_size,grid_x,grid_y,grid_z";
+    for (int pass = 1; pass < SPHPassProfile::PASS_SLOTS; pass++) {
+        file << "," << PASS_LABELS[pass] << "_ms";
+    }
+    file << ",total_ms,candidates_per_particle,neighbors_per_particle,occupied_cells,max_cell,mean_cell,min_bytes,gb_per_s\n";
+    for (const Result& result : results) {
+        file << result.particles << "," << result.cellSize << "," << result.grid.x << "," << result.grid.y << "," << result.grid.z;
+        for (int pass = 1; pass < SPHPassProfile::PASS_SLOTS; pass++) {
+            file << ",";
+            if (result.passMs[pass] >= 0.0f) file << result.passMs[pass];
+        }
+        double bandwidth = result.totalMs > 0.0f ? result.bytesPerSubstep / (result.totalMs * 1.0e6) : 0.0;
+        file << "," << result.totalMs << "," << result.occupancy.candidatesPerParticle << ","
+             << result.occupancy.neighborsPerParticle << "," << result.occupancy.occupiedCells << ","
+             << result.occupancy.maxCellParticles << "," << result.occupancy.meanCellParticles << ","
+             << static_cast<uint64_t>(result.bytesPerSubstep) << "," << bandwidth << "\n";
+    }
+    return true;
+}
+
+// Same layout as Benchmark's summary: mean, median and p99 of every column, one column per
+// pass and configuration
+void writeSummaryEntry(std::ofstream& file, const std::string& name, std::vector<double> values, bool& first) {
+    if (values.empty()) return;
+    std::sort(values.begin(), values.end());
+    double mean = 0.0;
+    for (double value : values) mean += value;
+    mean /= static_cast<double>(values.size());
+    size_t p99 = std::min(values.size() - 1, static_cast<size_t>(std::ceil(0.99 * values.size())) - 1);
+    file << (first ? "" : ",\n") << "    \"" << name << "\": { \"mean\": " << mean << ", \"median\": "
+         << values[values.size() / 2] << ", \"p99\": " << values[p99] << ", \"samples\": " << values.size() << " }";
+    first = false;
+}
+
+bool writeSummary(const std::string& path, const std::string& renderer, const std::vector<Result>& results) {
+    std::ofstream file(path);
+    if (!file) {
+        std::cerr << "Could not write " << path << std::endl;
+        return false;
+    }
+    std::string escaped;
+    for (char c : renderer) {
+        if (c == '"' || c == '\\') escaped += '\\';
+        escaped += c;
+    }
+    file << "{\n  \"scenario\": \"sph_bench\",\n  \"renderer\": \"" << escaped << "\",\n  \"summary\": {\n";
+    bool first = true;
+    for (const Result& result : results) {
+        char prefix[64];
+        std::snprintf(prefix, sizeof(prefix), "%u x%.2f ", result.particles, result.cellSize / SPHConstants::KERNEL_RADIUS);
+        writeSummaryEntry(file, std::string(prefix) + "total ms", result.totalSamples, first);
+        for (int pass = 1; pass < SPHPassProfile::PASS_SLOTS; pass++) {
+            writeSummaryEntry(file, std::string(prefix) + PASS_LABELS[pass] + " ms", result.passSamples[pass], first);
+        }
+    }
+    file << "\n  }\n}\n";
+    return static_cast<bool>(file);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (std::strcmp(argv[i], "--counts") == 0 && hasValue) {
+            options.counts = parseList<uint32_t>(argv[++i]);
+        } else if (std::strcmp(argv[i], "--cell-scales") == 0 && hasValue) {
+            options.cellScales = parseList<float>(argv[++i]);
+        } else if (std::strcmp(argv[i], "--substeps") == 0 && hasValue) {
+            options.substeps = std::max(std::atoi(argv[++i]), 1);
+        } else if (std::strcmp(argv[i], "--warmup") == 0 && hasValue) {
+            options.warmup = std::max(std::atoi(argv[++i]), 0);
+        } else if (std::strcmp(argv[i], "--output") == 0 && hasValue) {
+            options.outputPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--summary") == 0 && hasValue) {
+            options.summaryPath = argv[++i];
+        } else {
+            std::cout << "Usage: " << argv[0] << " [--counts N,N,...] [--cell-scales S,S,...] [--substeps N] [--warmup N]"
+                      << " [--output results.csv] [--summary results.json]" << std::endl;
+            return std::strcmp(argv[i], "--help") == 0 ? 0 : 1;
+        }
+    }
+
+    // Hidden 1x1 window: the compute passes need a context, not a swapchain
+    glfwInit();
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    GLFWwindow* window = glfwCreateWindow(1, 1, "SPH benchmark", NULL, NULL);
+    if (window == NULL) {
+        std::cout << "Failed to create hidden GLFW window" << std::endl;
+        glfwTerminate();
+        return -1;
+    }
+    glfwMakeContextCurrent(window);
+    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+        std::cout << "Failed to initialize GLAD" << std::endl;
+        glfwTerminate();
+        return -1;
+    }
+    std::string renderer = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+    std::cout << "Renderer: " << renderer << std::endl;
+    std::cout << options.substeps << " substeps per configuration after " << options.warmup
+              << " warm-up; times in ms per substep" << std::endl;
+    ShaderCompiler::instance().initialize();
+
+    std::vector<Result> results;
+    printHeader();
+    for (uint32_t count : options.counts) {
+        for (float cellScale : options.cellScales) {
+            Result result;
+            if (runConfiguration(options, count, cellScale, result)) {
+                printResult(result);
+                results.push_back(result);
+            }
+        }
+    }
+
+    bool written = options.outputPath.empty() || writeCSV(options.outputPath, results);
+    written = (options.summaryPath.empty() || writeSummary(options.summaryPath, renderer, results)) && written;
+
+    glfwDestroyWindow(window);
+    glfwTerminate();
+    return results.empty() || !written ? 1 : 0;
+}
@@ -0,0 +1,317 @@
+// Microbenchmarks of WaterSurface's CPU path: the batched wave kernel against its scalar
+// reference, ripple evaluation by active ripple count, the full update() by resolution and
+// thread count, mesh and index generation, and the foam update under heavy spawning.
+// Every case repeats until it has run for at least --min-time seconds and reports the
+// median repetition, per vertex where the work is per vertex.
+//
+//   surface_bench [--filter substring] [--min-time seconds] [--output results.csv]
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include "WaterSurface.h"
+#include "WaveKernel.h"
+#include "JobSystem.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct Measurement {
+    std::string name;
+    double medianMs = 0.0;
+    double nsPerItem = 0.0;     // 0 when the case has no per-item count
+    long long items = 0;
+    int threads = 0;
+    int repetitions = 0;
+};
+
+struct Options {
+    std::string filter;
+    double minTime = 0.25;
+    std::string outputPath;
+};
+
+volatile float g_sink = 0.0f;   // Keeps kernel results alive
+
+class Runner {
+public:
+    explicit Runner(const Options& options) : options_(options) {}
+
+    // fn runs one repetition; items is its vertex (or point) count
+    void run(const std::string& name, long long items, int threads, const std::function<void()>& fn) {
+        if (!options_.filter.empty() && name.find(options_.filter) == std::string::npos) return;
+
+        fn(); // Warm caches and lazily created state
+        std::vector<double> samples;
+        double elapsed = 0.0;
+        while (elapsed < options_.minTime || samples.size() < 5) {
+            auto start = std::chrono::steady_clock::now();
+            fn();
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            samples.push_back(ms);
+            elapsed += ms / 1000.0;
+        }
+        std::sort(samples.begin(), samples.end());
+
+        Measurement measurement;
+        measurement.name = name;
+        measurement.medianMs = samples[samples.size() / 2];
+        measurement.items = items;
+        measurement.nsPerItem = items > 0 ? measurement.medianMs * 1.0e6 / double(items) : 0.0;
+        measurement.threads = threads;
+        measurement.repetitions = static_cast<int>(samples.size());
+        results_.push_back(measurement);
+
+        std::printf("%-44s %3d %10.4f", name.c_str(), threads, measurement.medianMs);
+        if (items > 0) {
+            std::printf(" %10.2f", measurement.nsPerItem);
+        } else {
+            std::printf(" %10s", "-");
+        }
+        std::printf(" %7d\n", measurement.repetitions);
+        std::fflush(stdout);
+    }
+
+    bool writeCSV(const std::string& path) const {
+        std::ofstream file(path);
+        if (!file) {
+            std::cerr << "Could not write " << path << std::endl;
+            return false;
+        }
+        file << "name,threads,median_ms,items,ns_per_item,repetitions\n";
+        for (const Measurement& m : results_) {
+            file << m.name << "," << m.threads << "," << m.medianMs << "," << m.items << "," << m.nsPerItem << ","
+                 << m.repetitions << "\n";
+        }
+        return true;
+    }
+
+private:
+    const Options& options_;
+    std::vector<Measurement> results_;
+};
+
+// Thread counts for the scaling cases: 1, 2, 4, ... and every thread the pool has
+std::vector<int> threadCounts() {
+    int available = WaterSim::JobSystem::instance().getWorkerCount() + 1;
+    std::vector<int> counts;
+    for (int threads = 1; threads < available; threads *= 2) {
+        counts.push_back(threads);
+    }
+    counts.push_back(available);
+    return counts;
+}
+
+std::vector<WaterSurface::WaveParam> benchmarkWaves(int count) {
+    std::vector<WaterSurface::WaveParam> waves;
+    for (int i = 0; i < count; i++) {
+        float angle = 2.39996f * i; // Golden angle, so the directions never line up
+        WaterSurface::WaveParam wave;
+        wave.direction = glm::vec2(std::cos(angle), std::sin(angle));
+        wave.amplitude = 0.1f / (1.0f + 0.3f * i);
+        wave.wavelength = 4.0f / (1.0f + 0.25f * i);
+        wave.speed = 1.0f;
+        wave.steepness = 0.5f;
+        waves.push_back(wave);
+    }
+    return waves;
+}
+
+} // namespace
+
+// Friend of WaterSurface: reaches the private stages the public update() strings together
+class WaterSurfaceBenchmark {
+public:
+    static void generateMesh(WaterSurface& surface) { surface.generateMesh(); }
+    static void generateIndices(WaterSurface& surface) { surface.generateIndices(); }
+    static int rippleCount(const WaterSurface& surface) { return surface.ripples.count; }
+    static int maxRipples() { return WaterSurface::MAX_RIPPLES; }
+
+    // rippleHeight at every grid vertex
+    static float rippleGrid(const WaterSurface& surface) {
+        float halfSize = surface.size / 2.0f;
+        float step = surface.size / float(surface.resolution - 1);
+        float sum = 0.0f;
+        for (int z = 0; z < surface.resolution; z++) {
+            for (int x = 0; x < surface.resolution; x++) {
+                glm::vec2 gradient;
+                sum += surface.rippleHeight(-halfSize + x * step, -halfSize + z * step, gradient);
+            }
+        }
+        return sum;
+    }
+
+    static void setWaves(WaterSurface& surface, int count) {
+        surface.clearWaves();
+        for (const auto& wave : benchmarkWaves(count)) {
+            surface.addWave(wave);
+        }
+    }
+};
+
+namespace {
+
+void benchWaveKernel(Runner& runner) {
+    const int rowLength = 1024;
+    std::vector<float> out(rowLength * 8);
+    const char* isa = WaveKernel::isaName(WaveKernel::activeIsa());
+    for (int waveCount : {1, 4, 16}) {
+        WaveKernel::WaveSoA soa;
+        for (const auto& wave : benchmarkWaves(waveCount)) {
+            float k = 2.0f * 3.14159265f / wave.wavelength;
+            soa.add(wave.direction.x, wave.direction.y, k, wave.amplitude, wave.amplitude * wave.steepness * 2.0f,
+                    wave.speed * std::sqrt(9.8f * k) * 1.7f);
+        }
+        std::string suffix = "/waves:" + std::to_string(waveCount);
+        runner.run(std::string("gerstner/") + isa + suffix, rowLength, 1, [&]() {
+            WaveKernel::evaluateRow(soa, -5.0f, 10.0f / rowLength, 0.3f, rowLength, nullptr, out.data(), 8);
+            g_sink = out[rowLength * 4];
+        });
+        runner.run("gerstner/reference" + suffix, rowLength, 1, [&]() {
+            WaveKernel::evaluateRowReference(soa, -5.0f, 10.0f / rowLength, 0.3f, rowLength, nullptr, out.data(), 8);
+            g_sink = out[rowLength * 4];
+        });
+    }
+
+    // Single-point evaluation, as the sphere and picking use it
+    WaterSurface surface(64, 10.0f);
+    WaterSurfaceBenchmark::setWaves(surface, 16);
+    const int points = 4096;
+    runner.run("gerstner/sampleWaves/waves:16", points, 1, [&]() {
+        float sum = 0.0f;
+        for (int i = 0; i < points; i++) {
+            sum += surface.sampleWaves(-5.0f + 10.0f * i / points, 0.3f, 1.7f).position.y;
+        }
+        g_sink = sum;
+    });
+}
+
+void benchRipples(Runner& runner) {
+    // The ripple pool holds MAX_RIPPLES; past that the oldest slot is reused
+    const int resolution = 256;
+    std::vector<int> counts = {0, 8, 32, 64, WaterSurfaceBenchmark::maxRipples()};
+    for (int count : counts) {
+        WaterSurface surface(resolution, 10.0f);
+        std::mt19937 random(1234);
+        std::uniform_real_distribution<float> position(-4.5f, 4.5f);
+        for (int i = 0; i < count; i++) {
+            surface.addRipple(glm::vec3(position(random), 0.0f, position(random)), 1.0f);
+        }
+        std::string name = "rippleHeight/res:256/ripples:" + std::to_string(WaterSurfaceBenchmark::rippleCount(surface));
+        runner.run(name, (long long)resolution * resolution, 1, [&]() { g_sink = WaterSurfaceBenchmark::rippleGrid(surface); });
+    }
+}
+
+void benchUpdate(Runner& runner) {
+    WaterSim::JobSystem& jobs = WaterSim::JobSystem::instance();
+    for (int resolution : {64, 128, 256, 512, 1024}) {
+        WaterSurface surface(resolution, 10.0f);
+        surface.initialize();
+        WaterSurfaceBenchmark::setWaves(surface, 4);
+        std::mt19937 random(99);
+        std::uniform_real_distribution<float> position(-4.5f, 4.5f);
+        for (int i = 0; i < 32; i++) {
+            surface.addRipple(glm::vec3(position(random), 0.0f, position(random)), 1.0f);
+        }
+
+        for (int threads : threadCounts()) {
+            jobs.setParallelism(threads);
+            std::string name = "update/res:" + std::to_string(resolution);
+            runner.run(name, (long long)resolution * resolution, threads, [&]() { surface.update(1.0f / 600.0f); });
+        }
+        jobs.setParallelism(0);
+    }
+}
+
+void benchMesh(Runner& runner) {
+    for (int resolution : {64, 256, 1024}) {
+        WaterSurface surface(resolution, 10.0f);
+        long long vertices = (long long)resolution * resolution;
+        runner.run("generateMesh/res:" + std::to_string(resolution), vertices, 1,
+                   [&]() { WaterSurfaceBenchmark::generateMesh(surface); });
+        runner.run("generateIndices/res:" + std::to_string(resolution), vertices, 1,
+                   [&]() { WaterSurfaceBenchmark::generateIndices(surface); });
+    }
+}
+
+void benchFoam(Runner& runner) {
+    // Refills the whole pool every frame; the time includes the GPU update (glFinish)
+    WaterSurface surface(64, 10.0f);
+    surface.initialize();
+    const int bursts = 64;
+    const int perBurst = WaterSurface::FOAM_CAPACITY / bursts;
+    runner.run("updateFoam/spawn:" + std::to_string(WaterSurface::FOAM_CAPACITY), WaterSurface::FOAM_CAPACITY, 1, [&]() {
+        for (int i = 0; i < bursts; i++) {
+            float angle = 2.39996f * i;
+            surface.generateFoam(glm::vec3(3.0f * std::cos(angle), 0.0f, 3.0f * std::sin(angle)), 1.0f, perBurst);
+        }
+        surface.updateFoam(1.0f / 60.0f);
+        glFinish();
+    });
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (std::strcmp(argv[i], "--filter") == 0 && hasValue) {
+            options.filter = argv[++i];
+        } else if (std::strcmp(argv[i], "--min-time") == 0 && hasValue) {
+            options.minTime = std::max(std::atof(argv[++i]), 0.0);
+        } else if (std::strcmp(argv[i], "--output") == 0 && hasValue) {
+            options.outputPath = argv[++i];
+        } else {
+            std::cout << "Usage: " << argv[0] << " [--filter substring] [--min-time seconds] [--output results.csv]" << std::endl;
+            return std::strcmp(argv[i], "--help") == 0 ? 0 : 1;
+        }
+    }
+
+    // update() writes the mapped vertex ring and the foam runs on the GPU, so the surface
+    // needs a context; a hidden window is enough
+    glfwInit();
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    GLFWwindow* window = glfwCreateWindow(1, 1, "Surface benchmark", NULL, NULL);
+    if (window == NULL) {
+        std::cout << "Failed to create hidden GLFW window" << std::endl;
+        glfwTerminate();
+        return -1;
+    }
+    glfwMakeContextCurrent(window);
+    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+        std::cout << "Failed to initialize GLAD" << std::endl;
+        glfwTerminate();
+        return -1;
+    }
+    std::cout << "Wave kernel: " << WaveKernel::isaName(WaveKernel::activeIsa()) << ", "
+              << WaterSim::JobSystem::instance().getWorkerCount() + 1 << " threads" << std::endl;
+
+    Runner runner(options);
+    std::printf("%-44s %3s %10s %10s %7s\n", "case", "thr", "median ms", "ns/item", "reps");
+    benchWaveKernel(runner);
+    benchRipples(runner);
+    benchMesh(runner);
+    benchUpdate(runner);
+    benchFoam(runner);
+
+    bool written = options.outputPath.empty() || runner.writeCSV(options.outputPath);
+
+    glfwDestroyWindow(window);
+    glfwTerminate();
+    return written ? 0 : 1;
+}
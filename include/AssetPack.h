@@ -0,0 +1,79 @@
+#pragma once
+
+#include "MappedFile.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace WaterSim {
+
+// On-disk layout of an asset pack, written by tools/asset_pack.cpp at build time: the
+// header, the entries, the path strings, then every asset's bytes at a page-aligned offset
+namespace AssetPackFormat {
+
+constexpr char MAGIC[8] = { 'W', 'A', 'S', 'S', 'E', 'T', 'P', 'K' };
+constexpr uint32_t VERSION = 1;
+constexpr uint64_t ALIGNMENT = 4096;
+
+enum Kind : uint32_t {
+    RAW = 0,            // The file as it is (shader sources)
+    TEXTURE_RGBA8 = 1   // A decoded image, width * height RGBA8 texels, top row first
+};
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t entryCount;
+};
+
+struct Entry {
+    uint32_t pathOffset;    // From the start of the file; the path relative to the source root
+    uint32_t pathLength;
+    uint64_t dataOffset;
+    uint64_t dataSize;
+    uint32_t kind;
+    uint32_t width;
+    uint32_t height;
+    uint32_t reserved;
+};
+
+} // namespace AssetPackFormat
+
+// Shader sources and GPU-ready textures from one archive mapped at startup, so a cold start
+// opens one file instead of one per asset. Lookups return views into the mapping; nothing is
+// read or copied before it is used. With loose override on (development), a file on disk
+// under the same path wins over the packed copy, so edits and hot reload keep working.
+// Opened once before any asset is loaded; read-only afterwards, so any thread may look up.
+class AssetPack {
+public:
+    struct Texture {
+        const unsigned char* pixels = nullptr;  // RGBA8
+        int width = 0, height = 0;
+    };
+
+    static AssetPack& instance();
+
+    // False if the file is missing or not a pack of this version; assets then come from disk
+    bool open(const std::string& path);
+    bool isOpen() const { return file_.isOpen(); }
+
+    void setLooseOverride(bool enabled) { looseOverride_ = enabled; }
+    bool getLooseOverride() const { return looseOverride_; }
+
+    // The packed bytes of a file by its relative path ("shaders/water.vs"); empty if absent
+    std::string_view find(std::string_view path) const;
+
+    // A packed image decoded at build time; false if absent
+    bool findTexture(std::string_view path, Texture& texture) const;
+
+private:
+    const AssetPackFormat::Entry* findEntry(std::string_view path) const;
+
+    MappedFile file_;
+    std::unordered_map<std::string_view, const AssetPackFormat::Entry*> entries_;  // Keys point into the mapping
+    bool looseOverride_ = true;
+};
+
+} // namespace WaterSim
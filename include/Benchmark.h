@@ -0,0 +1,139 @@
+#pragma once
+
+#include "Config.h"
+#include "FrameGraph.h"
+#include "SimulationManager.h"
+#include <glm/glm.hpp>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class Camera;
+
+namespace WaterSim {
+
+// Scripted interactions of a benchmark scenario
+enum class BenchmarkAction {
+    RIPPLE,         // addRipple at position, of magnitude
+    SPLASH,         // createSplash at position, of magnitude
+    SPHERE_DROP,    // Sphere released at rest from position, under gravity
+    FLUID_STREAM    // addFluidStream from position along direction, magnitude particles per frame
+};
+
+// Fires on firstFrame and then every interval frames (0: once) through lastFrame (-1: to
+// the end). Each repeat moves position around a circle of radius spread by the golden
+// angle, so repeats land on different, but the same from run to run, spots
+struct BenchmarkEvent {
+    BenchmarkAction action = BenchmarkAction::RIPPLE;
+    int firstFrame = 0;
+    int interval = 0;
+    int lastFrame = -1;
+    glm::vec3 position{0.0f};
+    glm::vec3 direction{0.0f, -1.0f, 0.0f};
+    float magnitude = 0.0f;
+    float spread = 0.0f;
+};
+
+// A repeatable run: simulation, particle capacity, camera path and interactions, stepped
+// with a fixed dt. Frames count from the end of the warm-up, which is not recorded
+struct BenchmarkScenario {
+    std::string name;
+    std::string description;
+    SimulationType simulation = SimulationType::REGULAR_WATER;
+    int maxParticles = 0;               // SPH capacity; 0 keeps the configured one
+    bool rayTracing = false;
+    int warmupFrames = 60;
+    int frames = 600;
+    float frameTime = 1.0f / 60.0f;
+
+    // Camera orbit, starting on +z and turning counter-clockwise seen from above
+    glm::vec3 orbitCenter{0.0f, -1.0f, 0.0f};
+    float orbitDistance = 15.0f;
+    float orbitHeight = 6.0f;
+    float orbitDegreesPerFrame = 0.25f;
+
+    std::vector<BenchmarkEvent> events;
+};
+
+// Drives the interactive renderer through a scenario (--benchmark) and records every
+// frame: CPU time, wall time between frames, GPU time of each frame-graph pass, particle
+// count and memory. The GPU timings land a few frames late and are matched to their
+// frame by the graph's frame number. writeResults() saves a CSV of the frames and a JSON
+// file with the same frames and a summary.
+class Benchmark {
+public:
+    // Video memory in use: the resource manager's and frame graph's own, and what the
+    // driver reports free (-1 without NVX_gpu_memory_info)
+    struct MemorySample {
+        size_t residentBytes = 0;
+        size_t pooledBytes = 0;
+        int availableVideoKB = -1;
+    };
+
+    static const std::vector<BenchmarkScenario>& getScenarios();
+    static const BenchmarkScenario* findScenario(const std::string& name);
+
+    // frames > 0 overrides the scenario's count
+    explicit Benchmark(const BenchmarkScenario& scenario, int frames = 0);
+
+    const BenchmarkScenario& getScenario() const { return scenario_; }
+
+    // Before the systems read the config: deterministic SPH on the render thread, the
+    // scenario's particle capacity
+    void configure(Config& config) const;
+
+    // Scripted clock. The frame counts the warm-up too
+    int getFrame() const { return frame_; }
+    float getFrameTime() const { return scenario_.frameTime; }
+    float getTime() const { return static_cast<float>(frame_) * scenario_.frameTime; }
+    bool isRecording() const { return frame_ >= scenario_.warmupFrames; }
+    bool isFinished() const { return frame_ >= scenario_.warmupFrames + frameCount_; }
+
+    void poseCamera(Camera& camera) const;
+
+    // This frame's events with their positions resolved
+    std::vector<BenchmarkEvent> getDueEvents() const;
+
+    // Around one frame: beginFrame at the top of the loop, endFrame once its work is
+    // submitted (before the swap). endFrame advances the clock
+    void beginFrame();
+    void endFrame(uint64_t graphFrame, uint32_t particles, const MemorySample& memory);
+
+    // A frame graph's latest timings; ignored unless they are of a recorded frame
+    void recordPassTimings(uint64_t graphFrame, const std::vector<FrameGraph::PassTiming>& timings);
+
+    // basePath.csv and basePath.json; false if either cannot be written
+    bool writeResults(const std::string& basePath, const std::string& renderer) const;
+
+    static MemorySample sampleMemory(const FrameGraph& frameGraph);
+
+private:
+    struct FrameRecord {
+        int frame = 0;
+        uint64_t graphFrame = 0;
+        double cpuMs = 0.0;
+        double frameMs = 0.0;           // Since the previous frame's beginFrame
+        uint32_t particles = 0;
+        MemorySample memory;
+        std::vector<float> passMs;      // By index into passNames_; negative if not run
+        bool gpuResolved = false;
+    };
+
+    int passIndex(const std::string& name);
+    bool writeCSV(const std::string& path) const;
+    bool writeJSON(const std::string& path, const std::string& renderer) const;
+
+    BenchmarkScenario scenario_;
+    int frameCount_;
+    int frame_ = 0;
+    std::chrono::steady_clock::time_point frameStart_;
+    std::chrono::steady_clock::time_point previousFrameStart_;
+    bool hasPreviousFrame_ = false;
+
+    std::vector<FrameRecord> records_;
+    std::vector<std::string> passNames_;   // First-seen order
+};
+
+} // namespace WaterSim
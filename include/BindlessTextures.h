@@ -0,0 +1,52 @@
+#pragma once
+
+#include <glad/glad.h>
+
+namespace WaterSim {
+
+// Long-lived material textures of the water, sphere and glass shaders through
+// GL_ARB_bindless_texture. Each texture's handle is made resident once and written to the
+// std140 MaterialTextures block, so the programs built with BINDLESS_TEXTURES sample it
+// without a unit bound per draw. The planar reflection and refraction stay on units: they
+// come from the render target pool, which re-sets parameters on reuse, and a texture with
+// a handle is immutable.
+//
+// setTexture() is cheap to call every frame: the block is only rewritten when a slot's
+// texture changes, as the skybox does when its faces finish loading.
+class BindlessTextures {
+public:
+    // Member order of the MaterialTextures block
+    enum Slot {
+        SKYBOX,
+        CAUSTIC,
+        TILE,
+        WAVE_HEIGHT_MAP,
+        SPHERE,
+        SLOT_COUNT
+    };
+
+    static constexpr GLuint UNIFORM_BINDING = 4;    // 0-3 are SPH, wave, frame and phase blocks
+
+    BindlessTextures() = default;
+    ~BindlessTextures();
+
+    BindlessTextures(const BindlessTextures&) = delete;
+    BindlessTextures& operator=(const BindlessTextures&) = delete;
+
+    // Whether the driver exposes GL_ARB_bindless_texture; creates and binds the block
+    bool initialize();
+    bool isSupported() const { return supported_; }
+
+    void setTexture(Slot slot, GLuint texture);
+
+    // Makes every handle non-resident; the textures themselves belong to their owners
+    void release();
+
+private:
+    bool supported_ = false;
+    GLuint buffer_ = 0;
+    GLuint textures_[SLOT_COUNT] = {};
+    GLuint64 handles_[SLOT_COUNT] = {};     // std140: a sampler member takes 8 bytes
+};
+
+} // namespace WaterSim
@@ -41,6 +41,10 @@ public:
     glm::vec3 OrbitCenter;  // Center point for orbit mode
     float OrbitDistance;    // Distance from center in orbit mode
     
+    // Subpixel shift of the image for temporal anti-aliasing, in normalized device
+    // coordinates (2 / target size per pixel)
+    glm::vec2 ProjectionJitter{0.0f};
+    
     // Constructor with vectors
     Camera(glm::vec3 position = glm::vec3(0.0f, 0.0f, 3.0f),
            glm::vec3 up = glm::vec3(0.0f, 1.0f, 0.0f),
@@ -52,6 +56,12 @@ public:
     // Returns the view matrix calculated using Euler angles and the LookAt matrix
     glm::mat4 GetViewMatrix() const;
     
+    // Perspective projection of Zoom, shifted by ProjectionJitter unless unjittered
+    glm::mat4 GetProjectionMatrix(float aspect, float nearPlane, float farPlane, bool jittered = true) const;
+    
+    // ProjectionJitter of an offset in pixels of a target of the size
+    void SetJitter(const glm::vec2& pixels, const glm::vec2& targetSize);
+    
     // Processes input received from keyboard
     void ProcessKeyboard(CameraMovement direction, float deltaTime);
     
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include "GLResources.h"
+
+namespace WaterSim {
+
+// Clustered forward lighting of the dynamic lights (point and spot) on top of the fixed
+// key light. The main camera's frustum splits into GRID_X x GRID_Y tiles of
+// GRID_Z exponential depth slices; light_cluster.cs lists per froxel the lights whose
+// range reaches it, once per frame. Shaders linking clustered_lights.fs look their froxel up
+// from the world position through the camera the grid was built for, so the planar and
+// stereo passes share the grid. Points outside it walk every light.
+//
+// The lights, grid and lists stay bound at their fixed bindings; without lights the shaders
+// skip the lookup.
+class ClusteredLights {
+public:
+    static constexpr int MAX_LIGHTS = 256;
+    static constexpr int MAX_LIGHTS_PER_CLUSTER = 32;   // The nearest froxels drop the rest
+    static constexpr int GRID_X = 16;
+    static constexpr int GRID_Y = 9;
+    static constexpr int GRID_Z = 24;
+    static constexpr int CLUSTER_COUNT = GRID_X * GRID_Y * GRID_Z;
+
+    static constexpr GLuint PARAMETER_BINDING = 5;      // std140 ClusterParameters
+    static constexpr GLuint LIGHT_BINDING = 63;         // std430, see clustered_lights.fs
+    static constexpr GLuint CLUSTER_COUNT_BINDING = 64;
+    static constexpr GLuint CLUSTER_INDEX_BINDING = 65;
+
+    struct Light {
+        glm::vec3 position{0.0f};
+        float range = 5.0f;                 // Falls smoothly to nothing here
+        glm::vec3 color{1.0f};              // Times the intensity
+        float intensity = 1.0f;
+        glm::vec3 direction{0.0f, -1.0f, 0.0f};
+        float outerAngle = 180.0f;          // Spot cone half angle, degrees; 180 a point light
+        float innerAngle = 180.0f;          // Full intensity inside
+    };
+
+    ClusteredLights() = default;
+    ~ClusteredLights();
+
+    ClusteredLights(const ClusteredLights&) = delete;
+    ClusteredLights& operator=(const ClusteredLights&) = delete;
+
+    // Allocates and binds the buffers and submits light_cluster.cs
+    bool initialize();
+
+    // Past MAX_LIGHTS are ignored
+    void setLights(const std::vector<Light>& lights);
+    int getLightCount() const { return lightCount_; }
+
+    // Rebuilds the froxel lists for the main camera of this frame
+    void update(const glm::mat4& view, const glm::mat4& projection, float nearPlane, float farPlane);
+
+private:
+    // std430 light of clustered_lights.fs
+    struct GPULight {
+        glm::vec4 positionRange;
+        glm::vec4 colorCosInner;
+        glm::vec4 directionCosOuter;
+    };
+
+    // std140 ClusterParameters
+    struct Parameters {
+        glm::mat4 view;
+        glm::mat4 projection;
+        glm::mat4 inverseViewProjection;    // For the screen-space passes
+        glm::vec4 cameraPosition;
+        glm::vec4 depth;                    // Near, far, slices per log depth
+        glm::uvec4 grid;                    // Clusters per axis, light count
+    };
+
+    void bind() const;
+
+    GLShaderProgram cullProgram_;           // light_cluster.cs
+    GLuint parameterBuffer_ = 0;
+    GLuint lightBuffer_ = 0;
+    GLuint clusterCountBuffer_ = 0;
+    GLuint clusterIndexBuffer_ = 0;
+    int lightCount_ = 0;
+};
+
+} // namespace WaterSim
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "SimulationCommands.h"
+
+namespace WaterSim {
+
+// Session recording: every SimulationCommand the simulation applied, by the update (tick)
+// it went into and that update's dt, so a session can be run again update for update
+// (CommandReplay). With the deterministic SPH the replay reaches the same state bit for
+// bit; otherwise it follows the recorded interactions only.
+//
+// File layout: CommandRecordingHeader, then one record per tick that applied commands or
+// ran with another dt than the previous record's:
+//     varint  ticks since the previous record (0 for the first)
+//     uint8   1 if a float dt follows
+//     varint  command count, then per command a uint8 type (and a uint8 parameter for
+//             PARAMETER) and only the floats that type uses, as they were
+// Ticks without a record ran the previous record's dt and applied nothing.
+struct CommandRecordingHeader {
+    char magic[8];             // "WSCMDREC"
+    uint32_t version;
+    uint32_t simulationType;   // SimulationType the session ran
+    uint32_t deterministic;    // sph.deterministic at record time
+    uint32_t tickCount;        // Written on close
+};
+
+// Writer, fed through SimulationManager::setRecordingLog(getLog()). Render thread only.
+class CommandRecorder {
+public:
+    CommandRecorder() = default;
+    ~CommandRecorder();
+
+    CommandRecorder(const CommandRecorder&) = delete;
+    CommandRecorder& operator=(const CommandRecorder&) = delete;
+
+    bool open(const std::string& path, uint32_t simulationType, bool deterministic);
+    void close();
+    bool isOpen() const { return file_ != nullptr; }
+
+    // The commands applied since the last endTick, which the simulation appends to
+    std::vector<SimulationCommand>* getLog() { return &pending_; }
+
+    // After each update: the commands logged since the last one went into it
+    void endTick(float deltaTime);
+
+    uint32_t getSimulationType() const { return header_.simulationType; }
+    uint32_t getTickCount() const { return header_.tickCount; }
+    uint32_t getCommandCount() const { return commandCount_; }
+    uint64_t getBytesWritten() const { return bytesWritten_; }
+
+private:
+    std::FILE* file_ = nullptr;
+    std::string path_;
+    CommandRecordingHeader header_ = {};
+    std::vector<SimulationCommand> pending_;
+    std::vector<uint8_t> record_;
+    uint32_t lastRecordTick_ = 0;
+    float lastDeltaTime_ = 0.0f;
+    bool hasRecord_ = false;
+    uint32_t commandCount_ = 0;
+    uint64_t bytesWritten_ = 0;
+};
+
+// Reader: the whole recording decoded at open, then fed back one tick per update.
+class CommandReplay {
+public:
+    bool open(const std::string& path);
+    bool isOpen() const { return open_; }
+
+    uint32_t getSimulationType() const { return simulationType_; }
+    bool wasDeterministic() const { return deterministic_; }
+    uint32_t getTickCount() const { return tickCount_; }
+    uint32_t getCurrentTick() const { return currentTick_; }
+    bool isFinished() const { return currentTick_ >= tickCount_; }
+
+    // Before each update: pushes the next tick's commands into the queue and returns the
+    // dt to update with; 0 once finished
+    float nextTick(SimulationCommandQueue& queue);
+
+private:
+    struct Tick {
+        uint32_t index = 0;
+        float deltaTime = 0.0f;
+        uint32_t firstCommand = 0;
+        uint32_t commandCount = 0;
+    };
+
+    std::vector<Tick> ticks_;
+    std::vector<SimulationCommand> commands_;
+    bool open_ = false;
+    uint32_t simulationType_ = 0;
+    bool deterministic_ = false;
+    uint32_t tickCount_ = 0;
+    uint32_t currentTick_ = 0;
+    size_t nextRecord_ = 0;
+    float deltaTime_ = 0.0f;
+};
+
+} // namespace WaterSim
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+
+namespace WaterSim {
+
+// Per-GPU cache of autotuned compute shader parameters (workgroup sizes), plus the GPU
+// timing used to pick them. Entries are keyed by the GL vendor, renderer and version
+// strings, so one cache file serves every board and driver it has been run on.
+//
+// File format: one "device<TAB>kernel<TAB>value" line per entry. 2D local sizes are
+// packed as x | (y << 16).
+class ComputeAutotuner {
+public:
+    // Needs a current GL context (the device key comes from glGetString)
+    explicit ComputeAutotuner(const std::string& cachePath = "compute_autotune.cache");
+
+    // Cached value for this device, if any
+    bool lookup(const std::string& kernel, uint32_t& value) const;
+
+    // Record a winner and rewrite the cache (entries of other devices are kept)
+    void store(const std::string& kernel, uint32_t value);
+
+    // GPU milliseconds per call of dispatch, averaged over repetitions after one warm-up
+    // call. Bracketed by GL_TIMESTAMP queries; blocks until the result is available
+    float timeDispatch(const std::function<void()>& dispatch, int repetitions);
+
+    const std::string& getDeviceKey() const { return deviceKey_; }
+
+    static uint32_t packSize(int x, int y) { return uint32_t(x) | (uint32_t(y) << 16); }
+    static int sizeX(uint32_t packed) { return int(packed & 0xFFFFu); }
+    static int sizeY(uint32_t packed) { return int(packed >> 16); }
+
+private:
+    std::string cachePath_;
+    std::string deviceKey_;
+    std::map<std::string, uint32_t> entries_; // This device only
+
+    void readCache(std::map<std::string, std::map<std::string, uint32_t>>& devices) const;
+};
+
+} // namespace WaterSim
@@ -11,6 +11,13 @@ struct Config {
         unsigned int width = 1280;
         unsigned int height = 720;
         bool vsync = false;
+        bool depthPrepass = true;   // Opaque depth first, so the scene pass shades visible pixels only
+        bool bindlessTextures = true; // Static material textures as resident handles (BindlessTextures.h), where supported
+        bool variableRateShading = true; // Water and fluid shading at per-tile rates (ShadingRateImage.h)
+        float shadingRateContrast = 0.03f; // Largest luminance step of a tile shaded coarsely
+        bool temporalUpscale = true;    // Jittered scene resolved to the window (TemporalUpscaler.h)
+        float renderScale = 0.67f;      // Scene size of the window's while upscaling, 0.5 to 1
+        float temporalFeedback = 0.9f;  // History weight of a still pixel
         std::string title = "Water Simulation";
     } display;
     
@@ -23,6 +30,8 @@ struct Config {
         float sphereRadius = 0.5f;
         float maxRippleMagnitude = 0.5f;
         float rippleChargeRate = 0.5f;
+        float tickRate = 60.0f;         // Simulation ticks per second whatever the frame rate; 0 ticks once per frame
+        int maxTicksPerFrame = 4;       // Past it a slow frame drops time
     } physics;
     
     // Water settings
@@ -32,6 +41,44 @@ struct Config {
         float transparency = 0.9f;
         int surfaceResolution = 100;
         float surfaceSize = 10.0f;
+        bool gpuWaves = true;  // Gerstner waves evaluated in water.vs (no per-frame vertex upload)
+        
+        // FFT ocean (OceanFFT) in place of the Gerstner waves
+        bool oceanWaves = false;
+        int oceanResolution = 256;      // 256, 512 or 1024
+        float oceanPatchSize = 32.0f;   // Tile size in world units
+        bool oceanJonswap = false;      // JONSWAP instead of the Phillips spectrum
+        float oceanWindSpeed = 8.0f;
+        float oceanRmsHeight = 0.08f;
+        float oceanChoppiness = 1.2f;
+        
+        // Wave-equation heightfield (HeightfieldWaves) in place of the analytic ripples
+        bool heightfieldWaves = false;
+        int heightfieldResolution = 256;
+        
+        // GPU surface currents (FlowMap) that impulses stir and the foam and ripples follow
+        bool flowMap = true;
+        int flowMapResolution = 64;
+        
+        // Hybrid splashes (needs heightfieldWaves and GPU SPH): splashes throw SPH particles
+        // out of the heightfield, which absorbs them again below the exchange band
+        bool hybridSplashes = false;
+        int hybridSplashParticles = 400;    // Per unit splash magnitude
+        int hybridMaxParticles = 32768;
+        float hybridBandDepth = 0.15f;      // Absorption depth below the wave surface
+        
+        // Camera-centred LOD patches in place of the uniform grid while waves run on the GPU
+        bool lodMesh = true;
+        
+        // Packed vertices and cache-ordered 16-bit strips for the uniform grid
+        bool compactMesh = true;
+        
+        // CPU waves written on a worker thread, one frame ahead of the draw
+        bool asyncCpuWaves = true;
+        
+        // Hardware-tessellated patches instead, split to this on-screen edge length
+        bool tessellation = false;
+        float tessEdgePixels = 8.0f;
     } water;
     
     // Camera settings
@@ -53,7 +100,7 @@ struct Config {
     
     // SPH settings - Physically accurate water simulation for RTX
     struct SPH {
-        int maxParticles = 50000;  // Dense particle simulation
+        int maxParticles = 100000; // GPU buffer capacity (clamped to the device's storage block limits)
         
         // Calculated SPH parameters for realistic water behavior
         float particleRadius = 0.05f;  // Small particles for smooth water surface
@@ -63,12 +110,19 @@ struct Config {
         // Pressure calculation: cs² = K/ρ₀, where cs = 10 * vmax
         // For water: K ≈ 2200 MPa, but scaled for stability
         float gasConstant = 2000.0f;  // Tait equation stiffness
-        float gamma = 7.0f;  // Tait equation exponent for water
+        float gamma = 7.0f;  // Tait equation exponent for water (rounded, compiled into step 5)
+        bool useTaitEquation = false;  // Step 5 Tait state, B from the stiffness so the rest slope matches
         
         // Viscosity: μ = 0.001 Pa·s for water, scaled for particle simulation
         float viscosity = 0.05f;  // Kinematic viscosity for smooth flow
         
-        float surfaceTension = 0.0728f;  // Real water surface tension (N/m)
+        float surfaceTension = 0.0728f;  // Akinci cohesion coefficient, step 6 (real water: 0.0728 N/m; 0 disables)
+        
+        // Multiphase: a second fluid (light oil by default) layered over the water at reset
+        bool multiphase = false;
+        float secondPhaseRestDensity = 900.0f;
+        float secondPhaseViscosity = 0.2f;
+        float interfaceTension = 0.5f;   // Per phase; a water/oil pair uses the mean
         
         // Mass per particle: m = ρ₀ * V, where V = (4/3)πr³
         float particleMass = 0.000524f;  // Calculated: 1000 * (4/3) * π * (0.05)³
@@ -81,21 +135,259 @@ struct Config {
         float particleSpacing = 0.1f;  // 2 * particleRadius for close packing
         
         // GPU optimization
-        bool useGPUAcceleration = true;
-        bool useCUDA = true;
-        bool useOpenCL = true;
+        bool useGPUAcceleration = true;    // false runs SPH on the CPU backend (no GL compute needed)
+        bool useCUDA = false;              // Requests a CUDA backend; only the GL compute pipeline exists
+        bool asyncSimulation = false;      // Run SPH updates on a shared GL context overlapping rendering
+        bool useOpenCL = false;            // Requests an OpenCL backend; only the GL compute pipeline exists
         bool useDirectCompute = true;
         bool enableSurfaceReconstruction = true;
-        int workGroupSize = 256;
+        int workGroupSize = 0;             // Steps 5-6 / PCISPH local size (32, 64, 256); 0 autotunes per GPU
         int neighborLimit = 64;  // More neighbors for smooth interactions
+        bool useNeighborLists = false;     // Verlet lists reused across substeps (capped at neighborLimit)
+        bool useSoALayout = false;         // Structure-of-arrays neighbor streams for steps 4-6
+        bool halfPrecisionVelocity = false; // Pack SoA velocities to half precision
+        bool useSparseDomain = false;      // Step 4 over occupied cells only (indirect dispatch)
+        bool useHierarchicalGrid = false;  // Fine cells only inside occupied 4^3 blocks (large, sparse containers)
+        bool adaptiveResolution = false;   // Merge interior pairs far from the camera, split them at the surface
+        float adaptiveMergeDensityRatio = 1.0f; // Interior: density above this times the rest density
+        float adaptiveDetailDistance = 2.0f;    // Full resolution within this distance of the camera
+        bool narrowBand = false;           // Particles only in a band below the surface, over hydrostatic bulk columns
+        float narrowBandDepth = 3.0f;      // Band thickness in kernel radii
+        bool multirate = false;            // Per-particle power-of-two time steps, calm fluid updated less often
+        bool indexSort = false;            // Sort particle indices, gather the particles every few substeps (one buffer)
+        bool mortonCells = false;          // Cell buffers in Morton order within 4^3 bricks (neighbor walks touch fewer lines)
+        bool useTiledNeighborLoop = false; // Steps 5-6 stage neighbors in shared memory per cell
+        bool particleSleeping = false;     // Quiet cells skip steps 4-6 (needs the tiled loop)
+        bool useKernelTable = false;       // Steps 5-6 interpolate tabulated kernels (no sqrt/pow)
+        bool useSubgroups = true;          // Subgroup scan/reductions where GL_KHR_shader_subgroup is supported
+        bool deterministic = false;        // Bit-identical runs: stable sort, fixed dt, fixed readback latency
         
         // Additional SPH parameters
         float boundaryDamping = 0.5f;  // Energy loss at boundaries
         float velocityLimit = 20.0f;   // Maximum particle velocity (m/s)
         float pressureLimit = 50000.0f; // Maximum pressure (Pa)
+        
+        // Substep scheduling (timeStep is the adaptive lower bound, velocityLimit the clamp)
+        bool adaptiveTimeStep = true;
+        int maxSubstepsPerFrame = 20;
+        bool carrySubstepOverflow = false; // Otherwise time beyond the cap is dropped
+        
+        // Pressure solver (PCISPH iterates density error down and allows larger steps)
+        bool usePCISPH = false;
+        int pcisphMinIterations = 3;
+        int pcisphMaxIterations = 8;
+        float pcisphDensityErrorThreshold = 0.01f; // Relative density error at convergence
+        
+        // Implicit viscosity (CG solve after the pressure pass; lifts the viscous dt limit)
+        bool implicitViscosity = false;
+        int viscosityMaxIterations = 30;
+        float viscosityTolerance = 0.001f; // Relative residual at convergence
+        
+        // Fluid streams (spawned by the GPU emitter)
+        float streamSpeed = 2.0f;      // Initial stream velocity (m/s)
+        float streamRadius = 0.15f;    // Nozzle radius (m)
+        float streamRate = 4.0f;       // Particles per call when no rate is given
+        
+        // Screen-space fluid targets relative to the window (0.25-1, upsampled when shading)
+        float fluidRenderScale = 1.0f;
+        
+        // Spray, foam and bubble particles seeded from the fluid (SPHDiffuseParameters)
+        bool diffuseParticles = false;
+        
+        // Container walls and obstacles through a baked signed distance field in step 1
+        bool obstacleField = true;
+        
+        // The sphere pushes the particles and receives their force back (step 1 contacts)
+        bool sphereCoupling = true;
+        float sphereFriction = 0.5f;   // Share of the tangential slip removed per contact
+        
+        // Batched parameter sweep: stiffness x viscosity scenes side by side in one simulation,
+        // each scaling the compiled parameters by a factor spread over [min, max] (1 x 1 = off)
+        int batchStiffnessSteps = 1;
+        int batchViscositySteps = 1;
+        glm::vec2 batchStiffnessScale = glm::vec2(0.5f, 2.0f);
+        glm::vec2 batchViscosityScale = glm::vec2(0.5f, 2.0f);
     } sph;
     
+    // Compute shader workgroup autotuning (winners cached per GPU and driver)
+    struct Compute {
+        bool autotune = true;
+        std::string autotuneCachePath = "compute_autotune.cache";
+        int autotuneRepetitions = 8;
+    } compute;
+    
+    // Ray tracing and the raster caustics created on first use and released when idle
+    // (SubsystemRegistry.h); off creates them at startup and keeps them
+    struct Subsystems {
+        bool lazy = true;
+        int releaseFrames = 1800;       // Unused frames before a release, 0 never
+    } subsystems;
+    
+    // Texture and buffer fills on a thread with its own shared context (UploadQueue.h); off,
+    // or without the context, they run on the render thread
+    struct Uploads {
+        bool thread = true;
+        int stagingMB = 32;             // Persistently mapped staging ring; larger jobs bypass it
+    } uploads;
+    
+    // Shaders and textures from one mapped archive built with the executable (AssetPack.h)
+    struct Assets {
+        std::string pack = "assets.pak";    // Relative to the working directory; empty reads loose files only
+        bool looseOverride = true;          // Files on disk win over their packed copies
+    } assets;
+    
+    // The ImGui panels rebuilt only on input, watched changes and the refresh rate, their
+    // draw data replayed in between (UICache.h)
+    struct UI {
+        bool cache = true;
+        float refreshHz = 10.0f;        // Rebuilds for the live stats alone
+    } ui;
+    
+    // Frame pacing of the interactive loop (FramePacer.h)
+    struct Pacing {
+        int maxFramesInFlight = 2;      // Frames the CPU may queue ahead of the GPU (1-4)
+        float frameRateCap = 0.0f;      // Frames per second; 0 uncapped. Ignored by a benchmark
+        bool lateInputSampling = true;  // Poll input just before the simulation step, not after the swap
+    } pacing;
+    
+    // Frame-time governor shedding and restoring subsystem quality (FrameBudget.h); a
+    // benchmark runs without it
+    struct Budget {
+        bool enabled = false;
+        float targetMs = 16.6f;         // GPU milliseconds per frame to hold
+    } budget;
+    
+    // Floor caustics of the raster path splatted from the waves (RasterCaustics.h); the ray
+    // tracer has its own
+    struct Caustics {
+        bool raster = true;
+        int resolution = 256;           // Map texels per side
+        int interval = 1;               // Frames between redraws
+    } caustics;
+    
+    // Cascaded shadow maps of the fixed light (ShadowMapper.h)
+    struct Shadows {
+        bool enabled = true;
+        int resolution = 2048;          // Per cascade
+        float maxDistance = 40.0f;      // Of the view range that gets shadows
+        bool cacheStatic = true;        // Redraw the container only when its cascade moves
+    } shadows;
+    
+    // Light shafts scattered in the water, lit on a froxel grid (FroxelVolumetrics.h)
+    struct Volumetrics {
+        bool enabled = true;
+        float maxDistance = 40.0f;      // View depth the grid covers
+        float scattering = 0.04f;       // Per world unit
+        float absorption = 0.12f;
+        float anisotropy = 0.6f;        // Henyey-Greenstein g
+        float intensity = 1.0f;
+        float temporalBlend = 0.9f;     // History kept per frame
+    } volumetrics;
+    
+    // Clustered dynamic lights on top of the fixed key light (ClusteredLights.h)
+    struct Lighting {
+        int poolLights = 0;             // Spotlights on the pool floor aimed up, for showroom scenes
+        float poolLightIntensity = 6.0f;
+        float poolLightRange = 9.0f;
+        glm::vec3 poolLightColor = glm::vec3(0.75f, 0.9f, 1.0f);
+    } lighting;
+    
+    // Side-by-side stereo of a head-mounted display, both eyes in one pass (StereoRenderer.h)
+    struct Stereo {
+        bool enabled = false;           // --stereo; needs GL_OVR_multiview2
+        float eyeSeparation = 0.064f;
+        float convergence = 10.0f;      // Distance of zero parallax
+    } stereo;
+    
+    // In-memory rewind of the simulation (RewindTimeline.h)
+    struct Rewind {
+        bool enabled = false;
+        int keyframeInterval = 30;      // Frames between keyframes; a seek steps at most this many
+        int budgetMB = 256;             // GPU memory the keyframes may hold
+    } rewind;
+    
+    // Inactive simulations kept resident for an instant switch back (SimulationManager.h)
+    struct Standby {
+        bool enabled = true;
+        int budgetMB = 512;             // GPU memory the parked simulations may hold
+        int minFreeMB = 256;            // Less free video memory than this evicts them
+    } standby;
+    
+    // Recording of the rendered frames (FrameCapture.h)
+    struct Capture {
+        std::string outputPath;         // --capture BASE: record from the first frame to BASE.mp4 or BASE_N.png
+        bool hardwareEncode = true;     // --capture-png: skip NVENC, write the PNG sequence
+        int frameRate = 60;             // Of the video stream; every presented frame is one video frame
+    } capture;
+    
+    // Remote-render server: a hidden window streamed to one thin client (RemoteControl.h).
+    // Several sessions on one GPU are several processes on their own ports
+    struct Server {
+        int port = 0;                   // --serve PORT: UDP control port; 0 runs the interactive app
+        int controlPort = 0;            // --control PORT: the same commands into a visible session
+        bool eglContext = true;         // --serve-glx: keep the platform's default context API
+        std::string bindAddress = "127.0.0.1"; // --serve-bind ADDRESS: interface of the control socket
+        std::string token;              // --serve-token TOKEN: required in every datagram; empty generates one
+        float controllerTimeout = 30.0f; // Seconds of controller silence before another client may say hello
+    } server;
+    
     // Debug settings
+    // Headless run: simulation only, no visible window, UI or rendering
+    struct Headless {
+        bool enabled = false;      // --headless
+        int frames = 600;          // --frames N: updates to run (ignored when seconds > 0)
+        float seconds = 0.0f;      // --seconds S: wall-clock budget instead of a frame count
+        float frameTime = 1.0f / 60.0f; // --frame-time DT: simulated time per update
+        std::string restorePath;   // --restore FILE: warm-start from an SPH checkpoint
+        std::string checkpointPath; // --checkpoint FILE: save an SPH checkpoint at the end
+        std::string exportPath;    // --export FILE: stream particle frames to disk
+        int exportInterval = 1;    // --export-interval N: export every Nth update
+        std::string cachePath;     // --cache BASE: write a PLY geometry cache, BASE_particles_NNNNNN.ply
+        bool cacheSurface = false; // --cache-surface: the marching cubes surface instead, BASE_surface_NNNNNN.ply
+        int cacheInterval = 1;     // --cache-interval N: cache every Nth update
+        int kernelBenchmarkRepetitions = 0; // --benchmark-kernels N: analytic vs. table kernels at the end
+    } headless;
+    
+    // Scripted benchmark run of the interactive renderer (Benchmark.h)
+    struct Benchmark {
+        std::string scenario;      // --benchmark NAME: run it and exit
+        int frames = 0;            // --benchmark-frames N: recorded frames instead of the scenario's
+        std::string outputPath;    // --benchmark-output BASE: BASE.csv and BASE.json (default benchmark_NAME)
+        bool hiddenWindow = false; // --benchmark-hidden: render into a window never shown (CTest perf runs)
+    } benchmark;
+    
+    // Event trace (TraceRecorder.h), recorded all along and saved on demand
+    struct Trace {
+        bool enabled = true;       // --no-trace: record nothing
+        std::string outputPath;    // --trace FILE: save on exit (.json, or .pftrace for Perfetto)
+    } trace;
+    
+    // The trace around a frame spike, saved by itself (FlightRecorder.h)
+    struct SpikeTrace {
+        bool enabled = true;
+        float thresholdMs = 50.0f;
+        float contextSeconds = 3.0f;    // Before the spike
+        float afterSeconds = 1.0f;
+        float cooldownSeconds = 10.0f;
+        int maxTraces = 20;             // Per session
+        std::string directory = "traces";
+    } spikeTrace;
+    
+    // Session recording of the simulation commands, and replay of one (CommandRecording.h)
+    struct Recording {
+        std::string outputPath;    // --record FILE: write every tick's commands and dt
+        std::string replayPath;    // --replay FILE: run them again, with --headless or rendered
+    } recording;
+    
+    // Baked playback of a particle stream written by --export (SPHPlayback.h), for machines
+    // that show a scene without simulating it
+    struct Playback {
+        std::string path;          // --playback FILE: play it, skipping the menu
+        float speed = 1.0f;        // --playback-speed X: simulated seconds per second, negative backwards
+        bool loop = true;          // --playback-once: hold the last frame instead
+        int readAhead = 8;         // Compressed frames read ahead of the playhead
+    } playback;
+    
     struct Debug {
         bool showFPS = true;
         bool showWireframe = false;
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "Config.h"
+#include <chrono>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace WaterSim {
+
+// What a changed field takes to come into effect
+enum class ConfigApply {
+    LIVE,           // Read every frame (or pushed as a SimulationCommand); takes effect at once
+    SIMULATION,     // Read when the simulation initializes: reinitialized between frames
+    TARGETS,        // Sizes render targets: reallocated between frames
+    RESTART         // Window and context settings: logged, used at the next start
+};
+
+// Which kinds of change a reload applied; main acts on them before the next frame
+struct ConfigChanges {
+    std::vector<std::string> keys;          // Every field the reload changed
+    bool live = false;
+    bool simulation = false;
+    bool targets = false;
+    std::vector<std::string> restartKeys;
+
+    bool any() const { return !keys.empty(); }
+    bool has(const char* key) const;
+};
+
+// Config from a JSON file over the compiled-in defaults, and hot reload of it.
+//
+// The file is one object whose members mirror Config's sections, with vectors as arrays:
+//     { "preset": "desktop",
+//       "sph": { "maxParticles": 200000, "fluidRenderScale": 0.75 },
+//       "shadows": { "resolution": 4096 } }
+// "preset" names one of the shipped performance tiers, applied first; the file's members
+// override it, and the command line overrides both. Only fields something reads are
+// accepted; unknown keys and mistyped values are reported and skipped.
+//
+// poll() checks the file's modification time twice a second. A changed file is parsed
+// again, and only the fields whose value differs from the last load are written back, so
+// command-line overrides of fields the file does not touch survive a reload; a member
+// deleted from the file keeps its value until the next start. A file that
+// fails to parse leaves the config as it was.
+class ConfigFile {
+public:
+    struct Preset {
+        const char* name;
+        const char* description;
+        const char* json;
+    };
+    static const std::vector<Preset>& getPresets();
+    static const Preset* findPreset(const std::string& name);
+
+    // Startup: the preset (presetOverride, else the file's), then the file. An empty path
+    // with a preset applies the preset alone
+    bool load(const std::string& path, Config& config, const std::string& presetOverride = "");
+
+    // Once per frame; true when a reload changed fields, described in changes
+    bool poll(Config& config, ConfigChanges& changes);
+
+    const std::string& getPath() const { return path_; }
+    const std::string& getPreset() const { return preset_; }
+    int getReloads() const { return reloads_; }
+
+private:
+    struct Value {
+        enum class Kind { NUMBER, BOOL, STRING, ARRAY } kind = Kind::NUMBER;
+        double number = 0.0;
+        bool boolean = false;
+        std::string string;
+        std::vector<double> array;
+
+        bool operator==(const Value& other) const {
+            return kind == other.kind && number == other.number && boolean == other.boolean &&
+                   string == other.string && array == other.array;
+        }
+    };
+    using Values = std::map<std::string, Value>;  // Dotted key ("sph.maxParticles") to value
+
+    static bool parse(const std::string& text, Values& values, std::string& error);
+    bool gather(Values& values);  // Preset, then the file
+    static void apply(const Values& values, const Values* previous, Config& config, ConfigChanges& changes);
+
+    std::string path_;
+    std::string presetOverride_;
+    std::string preset_;
+    Values loaded_;
+    std::filesystem::file_time_type modified_{};
+    std::chrono::steady_clock::time_point lastCheck_{};
+    int reloads_ = 0;
+};
+
+} // namespace WaterSim
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <vector>
+
+namespace WaterSim {
+
+// The logical processors this process may run on, with the NUMA node and core class of
+// each, as the OS reports them (sysfs on Linux, GetLogicalProcessorInformationEx on Windows),
+// for placing the JobSystem's workers. Where neither is available, or the OS reports
+// nothing, every processor sits on one node in one class and nothing is pinned.
+struct CpuTopology {
+    struct Processor {
+        int id = 0;             // OS processor number, within its group on Windows
+        int group = 0;          // Windows processor group
+        int core = 0;           // Physical core, unique across packages
+        int thread = 0;         // SMT sibling on its core
+        int node = 0;           // NUMA node, numbered from 0
+        int coreClass = 0;      // 0 the fastest cores, 1 the next (efficiency cores), ...
+        float weight = 1.0f;    // Throughput relative to the fastest cores
+    };
+
+    std::vector<Processor> processors;
+    int nodeCount = 1;
+    int classCount = 1;
+
+    static CpuTopology detect();
+
+    // One node and one core class: placement gains nothing over the OS scheduler
+    bool isUniform() const { return nodeCount <= 1 && classCount <= 1; }
+
+    // Pins the calling thread to one processor; false where unsupported or refused
+    static bool pinCurrentThread(const Processor& processor);
+};
+
+} // namespace WaterSim
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <glad/glad.h>
+#include "MappedFile.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace WaterSim {
+
+// DirectDraw Surface files with the DX10 header extension: 2D textures and cubemaps of BC6H,
+// BC7, RGBA8 or RGBA16F texels, stored face by face with each face's levels largest first.
+// Both directions go through a mapping, so uploads read the blocks straight from the file's
+// pages and readbacks write straight into them.
+class DDSFile {
+public:
+    struct Description {
+        GLenum internalFormat = 0;
+        int width = 0, height = 0;
+        int levels = 1;
+        bool cubemap = false;
+        uint64_t userKey = 0;   // Caller's tag, kept in the header's reserved words
+    };
+
+    // Map an existing file; false for a missing file or a format outside the list above
+    bool open(const std::string& path);
+
+    // Create (or truncate) a file for the description and map it for filling with getLevel
+    bool create(const std::string& path, const Description& description);
+
+    const Description& getDescription() const { return description_; }
+    int getFaceCount() const { return description_.cubemap ? 6 : 1; }
+
+    // Texels of one face's level, levelSize bytes
+    void* getLevel(int face, int level) const;
+    size_t levelSize(int level) const;
+
+    // Immutable texture of the whole file, cube map or 2D; 0 if the format is unsupported
+    GLuint upload() const;
+
+    static bool isSupportedFormat(GLenum internalFormat);
+    static bool isBlockCompressed(GLenum internalFormat);
+
+private:
+    size_t faceSize() const;
+
+    MappedFile file_;
+    Description description_;
+};
+
+} // namespace WaterSim
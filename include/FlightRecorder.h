@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "JobSystem.h"
+
+namespace WaterSim {
+
+// Frame-spike flight recorder over the always-on TraceRecorder rings. Every frame it adds
+// the frame's counters to the trace; a frame longer than thresholdMs arms it, and
+// afterSeconds later (once the GPU slices of the spike and what followed have landed) the
+// window from contextSeconds before the spike on is saved on the job pool as
+// directory/spike_NNN_<ms>ms.json, with the spike frame marked. One save at a time; a
+// spike within cooldownSeconds of the last one, or past maxTraces, is only counted.
+// Render thread only.
+class FlightRecorder {
+public:
+    struct Settings {
+        bool enabled = true;
+        float thresholdMs = 50.0f;      // Frame time that counts as a spike
+        float contextSeconds = 3.0f;    // Of trace kept before the spike
+        float afterSeconds = 1.0f;      // And after it
+        float cooldownSeconds = 10.0f;  // Between saved spikes
+        int maxTraces = 20;             // Saved per session
+        std::string directory = "traces";
+    };
+
+    // Per frame, what the trace does not get from elsewhere
+    struct Counters {
+        int framePasses = 0;            // Executed frame-graph passes
+        int uploads = 0;                // UploadQueue jobs submitted this frame
+        double uploadKB = 0.0;
+        int shaderBuilds = 0;           // Programs finished this frame
+        double pacingWaitMs = 0.0;      // FramePacer: in-flight and cap waits
+    };
+
+    struct Stats {
+        int spikes = 0;                 // Frames over the threshold
+        int saved = 0;
+        float worstMs = 0.0f;
+        std::string lastPath;
+    };
+
+    FlightRecorder() = default;
+    ~FlightRecorder();
+
+    FlightRecorder(const FlightRecorder&) = delete;
+    FlightRecorder& operator=(const FlightRecorder&) = delete;
+
+    void setSettings(const Settings& settings) { settings_ = settings; }
+    const Settings& getSettings() const { return settings_; }
+
+    // At the start of every frame, with the time and counters of the one before
+    void recordFrame(float frameMs, const Counters& counters);
+
+    const Stats& getStats() const { return stats_; }
+    
+    // Waits for a save in flight; at shutdown, before the job pool goes away
+    void wait();
+
+private:
+    void save();
+
+    Settings settings_;
+    Stats stats_;
+    bool armed_ = false;
+    int64_t spikeNs_ = 0;               // Start of the spike frame
+    int64_t lastSaveNs_ = 0;
+    float spikeMs_ = 0.0f;
+    std::unique_ptr<JobSystem::TaskGroup> writer_;
+};
+
+} // namespace WaterSim
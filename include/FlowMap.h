@@ -0,0 +1,56 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+
+// Surface currents as a low-resolution velocity field over the water surface, stepped on
+// the GPU (flow_map.cs): each update advects the field through itself semi-Lagrangian
+// (trace back along the velocity, sample bilinearly), relaxes it toward the uniform base
+// current and splats the impulses queued since, so the cost is one small dispatch however
+// many there are. The walls stop the flow into them. water.vs scrolls its micro-detail
+// and drifts the ripples along it and foam_update.cs carries the foam with it.
+class FlowMap {
+public:
+    static constexpr int MAX_IMPULSES = 32;  // Per update; MAX_IMPULSES of flow_map.cs
+
+    FlowMap();
+    ~FlowMap();
+
+    // Grid of resolution^2 texels over a square surface of the given size; false if
+    // the kernel failed to compile
+    bool initialize(int resolution, float surfaceSize);
+
+    // Adds velocity (world units per second) under a raised-cosine brush of the given
+    // world radius around a surface point
+    void addImpulse(const glm::vec2& center, const glm::vec2& velocity, float radius);
+
+    // Uniform current the field relaxes toward, at relaxation per second
+    void setBaseVelocity(const glm::vec2& velocity) { baseVelocity_ = velocity; }
+    void setRelaxation(float relaxation) { relaxation_ = relaxation; }
+    float getRelaxation() const { return relaxation_; }
+
+    // Resets the field to the base current and drops pending impulses
+    void clear();
+
+    // One step of deltaTime (at most MAX_STEP_TIME), applying the queued impulses
+    void update(float deltaTime);
+
+    // RG16F world velocity xz, texel i centred at (i + 0.5) * size / resolution - size / 2
+    GLuint getVelocityTexture() const { return velocityTextures_[current_]; }
+    int getResolution() const { return resolution_; }
+    float getSurfaceSize() const { return surfaceSize_; }
+
+private:
+    int resolution_ = 0;
+    float surfaceSize_ = 1.0f;
+    glm::vec2 baseVelocity_{0.0f};
+    float relaxation_ = 2.0f;       // Per second; impulses fade over about half a second
+
+    std::vector<glm::vec4> impulses_;  // Two vec4s per impulse, as uImpulses
+
+    GLuint velocityTextures_[2] = {0, 0};  // Read and written, swapped every step
+    int current_ = 0;
+    GLuint sampler_ = 0;            // Bilinear, clamped, for the back-traced reads
+    GLuint program_ = 0;
+};
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+namespace WaterSim {
+
+class SPHComputeSystem;
+
+enum class FluidQueryType : uint32_t {
+    DENSITY = 0,    // At a point, over the kernel radius around it
+    BOX = 1,        // Particles inside an axis-aligned box
+    SPHERE = 2      // Particles within a radius of a point
+};
+
+// One spatial query, laid out as sph_spatial_query.cs reads it
+struct FluidQuery {
+    glm::vec3 min{0.0f};            // Box min, or the point
+    FluidQueryType type = FluidQueryType::DENSITY;
+    glm::vec3 max{0.0f};            // Box max
+    float radius = 0.0f;            // Sphere radius
+
+    static FluidQuery density(const glm::vec3& point) { return { point, FluidQueryType::DENSITY, point, 0.0f }; }
+    static FluidQuery box(const glm::vec3& min, const glm::vec3& max) { return { min, FluidQueryType::BOX, max, 0.0f }; }
+    static FluidQuery sphere(const glm::vec3& center, float radius) { return { center, FluidQueryType::SPHERE, center, radius }; }
+};
+
+// Its answer, as the shader writes it
+struct FluidQueryResult {
+    uint32_t count = 0;             // Particles inside (within the kernel radius for a point)
+    float mass = 0.0f;
+    float density = 0.0f;           // SPH density at a point, mass over volume for a region
+    float fill = 0.0f;              // Density over rest density, clamped to 1: how full it is
+    glm::vec3 velocity{0.0f};       // Mean of the fluid inside
+    float padding = 0.0f;
+};
+
+// Batched spatial queries over the SPH grid for gameplay and analysis (level sensors,
+// volume triggers): callers submit queries during the frame, one dispatch after the
+// simulation answers all of them from the sorted grid with a workgroup per query, and the
+// results come back through a fenced, persistently mapped readback ring as in WaterQueries.
+// Nothing waits: results trail by a frame or two, and a frame whose ring slot is still in
+// flight goes unanswered.
+//
+// A ticket is the range its queries took in the frame's batch; submitting the same queries
+// in the same order every frame reads the newest landed results with this frame's ticket.
+// Context thread only.
+class FluidQueries {
+public:
+    static constexpr uint32_t MAX_QUERIES = 256;    // Per frame, the rest are dropped
+    static constexpr uint32_t READBACK_FRAMES = 3;
+
+    struct Ticket {
+        uint32_t first = 0;
+        uint32_t count = 0;         // 0: nothing was queued
+    };
+
+    FluidQueries() = default;
+    ~FluidQueries();
+
+    FluidQueries(const FluidQueries&) = delete;
+    FluidQueries& operator=(const FluidQueries&) = delete;
+
+    bool initialize();
+
+    // Once per frame, before the callers submit: collects the batches that have landed
+    void beginFrame();
+
+    Ticket submit(const FluidQuery* queries, uint32_t count);
+    Ticket submit(const FluidQuery& query) { return submit(&query, 1); }
+
+    // After the simulation step: answers the frame's batch from the fluid's last substep
+    void dispatch(SPHComputeSystem& sph);
+
+    // The newest landed results for the ticket's range; false before any have landed, or
+    // when the landed batch was shorter
+    bool getResults(const Ticket& ticket, FluidQueryResult* results) const;
+    uint64_t getResultAge() const { return latestFrame_ ? frame_ - latestFrame_ : 0; }
+
+private:
+    struct Slot {
+        GLsync fence = nullptr;
+        uint32_t count = 0;
+        uint64_t frame = 0;
+    };
+
+    GLuint queryBuffer_ = 0;
+    GLuint resultBuffer_ = 0;           // Written by the dispatch, copied into the ring
+    GLuint readbackBuffer_ = 0;         // READBACK_FRAMES batches of MAX_QUERIES
+    const FluidQueryResult* readbackResults_ = nullptr;
+    Slot slots_[READBACK_FRAMES];
+    uint32_t writeIndex_ = 0;
+
+    std::vector<FluidQuery> queries_;   // This frame's batch
+    std::vector<FluidQueryResult> latest_;
+    uint64_t latestFrame_ = 0;
+    uint64_t frame_ = 0;
+};
+
+} // namespace WaterSim
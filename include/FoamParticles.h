@@ -0,0 +1,61 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+
+// Splash foam as particles that live on the GPU: bursts are queued on the CPU and spawned,
+// aged and compacted by foam_update.cs into the other of two fixed-capacity particle
+// buffers each update, which also counts the survivors into an indirect draw command, so
+// all the foam is one instanced billboard draw (foam.vs) whatever the particle count.
+class FoamParticles {
+public:
+    static constexpr int MAX_BURSTS = 32;  // Per update; MAX_BURSTS of foam_update.cs
+
+    FoamParticles();
+    ~FoamParticles();
+
+    // Room for capacity live particles; false if the kernel failed to compile
+    bool initialize(int capacity);
+
+    // count particles thrown out of a point, faster and larger with the intensity
+    void emit(const glm::vec3& position, float intensity, int count);
+
+    // Surface current (FlowMap) the particles drift with, over a square surface of the given
+    // size; 0 for still water
+    void setFlowMap(GLuint texture, float surfaceSize) { flowMap_ = texture; flowMapSize_ = surfaceSize; }
+
+    // Wave surface (WaveState) the particles land on and ride, height and velocity over a
+    // square of the given size; 0 for the flat plane y = 0 they fall through
+    void setWaveSurface(GLuint heightTexture, GLuint velocityTexture, float surfaceSize) {
+        waveHeight_ = heightTexture;
+        waveVelocity_ = velocityTexture;
+        waveSize_ = surfaceSize;
+    }
+
+    // Spawns the queued bursts and ages the live particles by deltaTime
+    void update(float deltaTime);
+
+    // One indirect, instanced draw of the live particles with the foam program
+    void render(GLuint program);
+
+    int getCapacity() const { return capacity_; }
+
+private:
+    int capacity_ = 0;
+    std::vector<glm::vec4> bursts_;  // Two vec4s per burst, as uBursts
+    int burstParticles_ = 0;         // Particles the queued bursts spawn
+    unsigned int seed_ = 1;
+    GLuint flowMap_ = 0;
+    float flowMapSize_ = 1.0f;
+    GLuint waveHeight_ = 0;
+    GLuint waveVelocity_ = 0;
+    float waveSize_ = 1.0f;
+
+    // Particles ping-pong between the two buffers; command i draws buffer i
+    GLuint particleBuffers_[2] = {0, 0};
+    GLuint commandBuffer_ = 0;
+    int current_ = 0;
+    GLuint vao_ = 0;                 // Attribute-less; foam.vs builds the quad from gl_VertexID
+    GLuint program_ = 0;
+};
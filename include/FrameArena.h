@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory_resource>
+#include <mutex>
+#include <vector>
+
+namespace WaterSim {
+
+// Linear allocator for transient CPU buffers, released all at once by reset(). Allocation
+// is one atomic bump, so parallelFor bands may share an arena; what does not fit goes to
+// the heap until the next reset, which grows the block to the high-water mark, so a
+// steady per-frame workload stops allocating after its first frames. Nothing is
+// destructed: arena memory is for trivially destructible data, or for pmr containers
+// that are gone before the reset.
+//
+// instance() is the main loop's frame arena, reset once per frame after the swap.
+// Subsystems whose work spans frames (the asynchronous surface writer) keep their own.
+class FrameArena {
+public:
+    struct Stats {
+        size_t capacity = 0;        // Bytes in the block
+        size_t peakBytes = 0;       // Largest reset-to-reset use, block and heap together
+        int heapAllocations = 0;    // Overflow allocations since startup
+    };
+
+    static FrameArena& instance();
+
+    explicit FrameArena(size_t initialBytes = size_t(64) << 10);
+    ~FrameArena();
+
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    void* allocate(size_t bytes, size_t alignment = alignof(std::max_align_t));
+
+    template <typename T>
+    T* allocate(size_t count) { return static_cast<T*>(allocate(count * sizeof(T), alignof(T))); }
+
+    // Releases everything allocated since the last reset; no allocation may be in flight
+    void reset();
+
+    // std::pmr adapter: deallocation is a no-op, the memory comes back at the reset
+    std::pmr::memory_resource* resource() { return &resource_; }
+
+    const Stats& getStats() const { return stats_; }
+
+private:
+    class Resource : public std::pmr::memory_resource {
+    public:
+        explicit Resource(FrameArena& arena) : arena_(arena) {}
+
+    private:
+        void* do_allocate(size_t bytes, size_t alignment) override { return arena_.allocate(bytes, alignment); }
+        void do_deallocate(void*, size_t, size_t) override {}
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+
+        FrameArena& arena_;
+    };
+
+    struct HeapBlock {
+        void* memory = nullptr;
+        size_t alignment = 0;
+    };
+
+    static constexpr size_t BLOCK_ALIGNMENT = 64;
+
+    void* allocateHeap(size_t bytes, size_t alignment);
+    void allocateBlock(size_t bytes);
+    void freeBlock();
+
+    char* block_ = nullptr;
+    size_t capacity_ = 0;
+    std::atomic<size_t> offset_{0};
+
+    std::mutex heapMutex_;
+    std::vector<HeapBlock> heapBlocks_;
+    size_t heapBytes_ = 0;
+
+    Resource resource_{*this};
+    Stats stats_;
+};
+
+} // namespace WaterSim
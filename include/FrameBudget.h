@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include "FrameGraph.h"
+
+namespace WaterSim {
+
+// Frame-time governor across the expensive subsystems. Each registers a knob: levels from
+// its full setting down to cheaper ones (skipping or amortizing work across frames, a lower
+// resolution, fewer iterations), the cost of each level relative to the first, and where its
+// GPU time shows up, frame-graph passes by name or a measurement of its own. The frame
+// graph's timestamps, a few frames behind, are the measured frame time; over the target by
+// more than the shed margin one knob steps down, the lowest priority first and among those
+// the largest predicted saving. Under it by the restore margin the highest-priority degraded
+// knob steps back up, if its predicted cost still fits the target. After a change the
+// controller waits out the cooldown, counting only frames timed after the change, so it
+// does not act on timings that predate it. Context thread only.
+class FrameBudget {
+public:
+    struct Settings {
+        bool enabled = false;
+        float targetMs = 16.6f;             // GPU milliseconds per frame
+        float shedMargin = 0.05f;           // Over the target by this fraction sheds
+        float restoreMargin = 0.2f;         // Under it by this fraction restores
+        int cooldownFrames = 10;            // Timed frames between changes
+    };
+
+    struct Knob {
+        std::string name;
+        std::vector<std::string> levels;    // Level 0 the full setting, each next one cheaper
+        std::vector<float> relativeCost;    // Of level 0, per level, non-increasing
+        int priority = 0;                   // Lower sheds first and is restored last
+        std::vector<std::string> passes;    // Frame-graph passes its time shows up in
+        std::function<float()> measure;     // Milliseconds outside the frame graph; may be null
+        std::function<void(int)> apply;     // Puts a level in place
+        std::function<bool()> active;       // Whether it costs anything now; null for always
+    };
+
+    struct KnobStatus {
+        std::string name;
+        std::string level;
+        bool active = false;
+        float measuredMs = 0.0f;            // Smoothed, at the current level
+        float fullMs = 0.0f;                // Its estimate at level 0
+    };
+
+    FrameBudget() = default;
+
+    FrameBudget(const FrameBudget&) = delete;
+    FrameBudget& operator=(const FrameBudget&) = delete;
+
+    // Disabling puts every knob back at level 0
+    void setSettings(const Settings& settings);
+    const Settings& getSettings() const { return settings_; }
+
+    void addKnob(Knob knob);
+
+    // Once per frame after FrameGraph::execute(), which reads the timings back; the graph
+    // must be timing while enabled
+    void update(const FrameGraph& graph);
+
+    float getFrameMs() const { return frameMs_; }   // Smoothed, 0 before the first sample
+    std::vector<KnobStatus> getStatus() const;
+
+private:
+    struct KnobState {
+        Knob knob;
+        int level = 0;
+        float measuredMs = 0.0f;
+        bool sampled = false;
+        bool active = false;
+    };
+
+    float fullCost(const KnobState& state) const;
+    bool shed();
+    bool restore();
+    void setLevel(KnobState& state, int level);
+    void resetLevels();
+
+    Settings settings_;
+    std::vector<KnobState> knobs_;
+
+    float frameMs_ = 0.0f;
+    bool sampled_ = false;
+    uint64_t lastTimedFrame_ = 0;
+    uint64_t changeFrame_ = 0;              // Graph frame of the last change; older timings are stale
+    int cooldown_ = 0;
+};
+
+} // namespace WaterSim
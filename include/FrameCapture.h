@@ -0,0 +1,104 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace WaterSim {
+
+// Records the post-processed frame, before the UI is drawn over it, without stalling the
+// render thread. capture() starts an asynchronous glReadPixels into one of a ring of
+// persistently mapped pixel-pack buffers and fences it; poll() hands slots whose fence has
+// signalled to a worker thread, which encodes straight from the mapped memory and gives the
+// slot back. The render thread never copies or waits on a pixel; frames that find the ring
+// busy are dropped and counted, as SPHFrameExporter does.
+//
+// The worker pipes the frames to ffmpeg's h264_nvenc encoder (BASE.mp4) when ffmpeg is on
+// the path and lists it, and otherwise writes a numbered PNG sequence (BASE_000000.png).
+// The frame size is fixed when recording starts; frames of another size are dropped.
+//
+// startStream() sends the frames to an RTP address instead (the --serve mode), encoded for
+// latency: no B-frames, a keyframe a second, h264_nvenc or else libx264. A stream has no
+// file fallback; without ffmpeg its frames are dropped.
+class FrameCapture {
+public:
+    enum class Encoder {
+        NONE,           // Not opened yet, or a stream without an encoder
+        NVENC,          // ffmpeg -c:v h264_nvenc
+        SOFTWARE_H264,  // ffmpeg -c:v libx264, streams only
+        PNG_SEQUENCE
+    };
+
+    FrameCapture() = default;
+    ~FrameCapture();
+
+    FrameCapture(const FrameCapture&) = delete;
+    FrameCapture& operator=(const FrameCapture&) = delete;
+
+    // hardwareEncode false goes straight to the PNG sequence
+    bool start(const std::string& basePath, int width, int height, int frameRate, bool hardwareEncode);
+    // url as ffmpeg takes it, rtp://HOST:PORT
+    bool startStream(const std::string& url, int width, int height, int frameRate);
+    void stop();
+    bool isRecording() const { return recording_; }
+    bool isStreaming() const { return recording_ && !streamUrl_.empty(); }
+
+    // Read the color buffer of the bound read framebuffer (GL thread, never blocks)
+    void capture(int width, int height);
+
+    // Hand finished readbacks to the worker (GL thread, never blocks)
+    void poll();
+
+    Encoder getEncoder() const { return encoder_; }
+    const char* getEncoderName() const;
+    uint32_t getWrittenFrames() const { return writtenFrames_; }
+    uint32_t getDroppedFrames() const { return droppedFrames_; }
+    const std::string& getBasePath() const { return basePath_; }
+
+private:
+    enum class SlotState { FREE, READING, ENCODING };
+
+    static constexpr int CAPTURE_SLOTS = 4;
+
+    // Pixel-pack ring, RGBA8 rows bottom-up as GL reads them
+    GLuint buffers_[CAPTURE_SLOTS] = {};
+    const uint8_t* pointers_[CAPTURE_SLOTS] = {};
+    GLsync fences_[CAPTURE_SLOTS] = {};
+    uint32_t frameIndices_[CAPTURE_SLOTS] = {};
+    SlotState states_[CAPTURE_SLOTS] = {};      // ENCODING is the worker's; guarded by mutex_
+    int nextSlot_ = 0;
+
+    bool recording_ = false;
+    std::string basePath_;
+    std::string streamUrl_;
+    int width_ = 0;
+    int height_ = 0;
+    int frameRate_ = 60;
+    bool hardwareEncode_ = true;
+    uint32_t capturedFrames_ = 0;
+    std::atomic<uint32_t> droppedFrames_{0};
+
+    // Worker thread
+    std::thread worker_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::deque<int> queue_;             // Slots in capture order
+    bool stopping_ = false;
+    std::atomic<Encoder> encoder_{Encoder::NONE};
+    std::FILE* pipe_ = nullptr;
+    std::atomic<uint32_t> writtenFrames_{0};
+
+    bool begin(int width, int height, int frameRate);
+    void workerLoop();
+    void openEncoder();
+    void closeEncoder();
+    bool encodeFrame(const uint8_t* pixels, uint32_t frameIndex);
+};
+
+} // namespace WaterSim
@@ -0,0 +1,208 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace WaterSim {
+
+// Size and format of a render target
+struct FrameGraphTextureDesc {
+    int width = 0;
+    int height = 0;
+    GLenum internalFormat = GL_RGBA16F;
+
+    bool isDepth() const;
+    bool operator==(const FrameGraphTextureDesc& other) const {
+        return width == other.width && height == other.height && internalFormat == other.internalFormat;
+    }
+};
+
+// How a pass touches a resource. Barriers come from the pairs of these across passes
+enum class FrameGraphAccess {
+    ATTACHMENT,   // The pass's framebuffer, color or depth by format; read: blending, depth test
+    SAMPLED,      // Texture fetch; reads only
+    IMAGE,        // imageLoad / imageStore, or a helper's compute pipeline storing to it
+    RENDERED      // Drawn by a helper into a framebuffer of its own; writes only
+};
+
+// Per-frame render graph. Passes are added in execution order and declare the resources
+// they read and write; compile() then
+//   - culls passes whose writes nothing reads, unless they have a side effect (the
+//     backbuffer, the UI),
+//   - gives each transient texture a physical one from a pool, sharing a texture between
+//     transients with the same description whose lifetimes do not overlap,
+//   - works out the glMemoryBarrier bits each pass needs for data written by image
+//     stores in an earlier pass (framebuffer writes need none),
+// and execute() runs the survivors, binding each its framebuffer of attachment writes.
+//
+// A transient's contents are undefined when its first writer starts: that pass clears it.
+// Pooled textures outlive the frame and go back to the RenderTargetPool after going unused
+// for a few frames, so targets of culled passes and of old window sizes do not stay here.
+class FrameGraph {
+public:
+    using Resource = int;
+    static constexpr Resource INVALID_RESOURCE = -1;
+
+    class Builder {
+    public:
+        Resource read(Resource resource, FrameGraphAccess access = FrameGraphAccess::SAMPLED);
+        Resource write(Resource resource, FrameGraphAccess access = FrameGraphAccess::ATTACHMENT);
+        void setSideEffect();
+
+    private:
+        friend class FrameGraph;
+        Builder(FrameGraph& graph, int pass) : graph_(graph), pass_(pass) {}
+        FrameGraph& graph_;
+        int pass_;
+    };
+
+    // What a pass sees while it executes
+    class PassResources {
+    public:
+        GLuint getTexture(Resource resource) const;
+        GLuint getFramebuffer() const { return framebuffer_; }
+
+    private:
+        friend class FrameGraph;
+        PassResources(const FrameGraph& graph, GLuint framebuffer) : graph_(graph), framebuffer_(framebuffer) {}
+        const FrameGraph& graph_;
+        GLuint framebuffer_;
+    };
+
+    using SetupFunction = std::function<void(Builder&)>;
+    using ExecuteFunction = std::function<void(const PassResources&)>;
+
+    struct Stats {
+        int passes = 0;
+        int culledPasses = 0;
+        int transientTextures = 0;   // Declared this frame by executed passes
+        int physicalTextures = 0;    // Backing them after aliasing
+        size_t pooledBytes = 0;      // Everything the pool holds, idle entries included
+    };
+
+    // GPU time of an executed pass, from the timestamps around it
+    struct PassTiming {
+        std::string name;
+        float milliseconds = 0.0f;
+    };
+
+    FrameGraph() = default;
+    ~FrameGraph();
+
+    FrameGraph(const FrameGraph&) = delete;
+    FrameGraph& operator=(const FrameGraph&) = delete;
+
+    // Allocated by the graph and valid during the frame only
+    Resource createTexture(const std::string& name, const FrameGraphTextureDesc& desc);
+
+    // Owned elsewhere; texture 0 is the default framebuffer
+    Resource importTexture(const std::string& name, GLuint texture, const FrameGraphTextureDesc& desc);
+
+    // setup runs now; execute runs from execute() unless the pass is culled
+    void addPass(const std::string& name, const SetupFunction& setup, ExecuteFunction execute);
+
+    void compile();
+    void execute();
+
+    // Drops this frame's passes and resources; the texture pool is kept
+    void reset();
+
+    const Stats& getStats() const { return stats_; }
+    bool isPassCulled(const std::string& name) const;
+
+    // Timestamp queries around every executed pass, read back once they land so the CPU
+    // never waits. readBackTimings() takes the oldest frame whose results are in (false if
+    // none), a few frames behind; getTimedFrame() says which frame the timings are of (the
+    // compile() count when it ran, 0 before any). execute() reads one frame back itself;
+    // after a glFinish, calling it until false collects the rest
+    void setTiming(bool enable);
+    bool isTiming() const { return timing_; }
+    bool readBackTimings();
+    const std::vector<PassTiming>& getPassTimings() const { return passTimings_; }
+    uint64_t getTimedFrame() const { return timedFrame_; }
+    uint64_t getFrame() const { return frame_; }
+
+private:
+    struct ResourceNode {
+        std::string name;
+        FrameGraphTextureDesc desc;
+        bool imported = false;
+        GLuint texture = 0;          // Imported texture, or the physical one after compile
+        int readers = 0;             // Live passes reading it, for culling
+        int firstPass = -1;          // Lifetime over executed passes
+        int lastPass = -1;
+        std::vector<int> writers;
+    };
+
+    struct Access {
+        Resource resource;
+        FrameGraphAccess access;
+    };
+
+    struct PassNode {
+        std::string name;
+        ExecuteFunction execute;
+        std::vector<Access> reads;
+        std::vector<Access> writes;
+        bool sideEffect = false;
+        bool culled = false;
+        int references = 0;
+        GLbitfield barriers = 0;
+        bool hasAttachments = false;
+        GLuint framebuffer = 0;
+        int viewportWidth = 0;
+        int viewportHeight = 0;
+    };
+
+    // One frame's timestamps: the start, then the end of each executed pass
+    struct TimerSlot {
+        std::vector<GLuint> queries;
+        std::vector<std::string> passNames;
+        uint64_t frame = 0;
+        bool pending = false;
+    };
+
+    struct PooledTexture {
+        FrameGraphTextureDesc desc;
+        GLuint texture = 0;
+        uint64_t lastUsedFrame = 0;
+        int busyUntilPass = -1;      // Last pass of the transient holding it this frame
+    };
+
+    void cullPasses();
+    void computeLifetimes();
+    void assignTextures();
+    void deriveBarriers();
+    void prepareFramebuffers();
+    void releaseIdleTextures();
+
+    GLuint createPooledTexture(const FrameGraphTextureDesc& desc);
+    GLuint getFramebuffer(const std::vector<GLuint>& colors, GLuint depth);
+
+    static size_t textureBytes(const FrameGraphTextureDesc& desc);
+
+    std::vector<ResourceNode> resources_;
+    std::vector<PassNode> passes_;
+    std::vector<PooledTexture> pool_;
+    std::map<std::vector<GLuint>, GLuint> framebuffers_;   // Depth, then colors -> FBO
+    uint64_t frame_ = 0;
+    bool compiled_ = false;
+    Stats stats_;
+
+    static constexpr int TIMER_FRAMES = 4;
+    TimerSlot timerSlots_[TIMER_FRAMES];
+    int timerSlot_ = 0;
+    bool timing_ = false;
+    std::vector<PassTiming> passTimings_;
+    uint64_t timedFrame_ = 0;
+
+    // Pool entries unused for this many frames are deleted
+    static constexpr uint64_t IDLE_FRAMES_BEFORE_RELEASE = 8;
+};
+
+} // namespace WaterSim
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+
+namespace WaterSim {
+
+// Frame pacing for the interactive loop. With the swap interval at 0 the driver lets the
+// CPU queue several frames ahead of the GPU, so input reaches the screen frames late. The
+// pacer fences every frame after its swap and, before the next begins, waits until no more
+// than maxFramesInFlight are still on the GPU; an optional cap then sleeps (and spins the
+// last bit) until the next frame's start.
+//
+// The latency reported is from markInputSampled() to the GPU passing the frame's swap, read
+// through a timestamp right after it: the closest to the display the GL can see without a
+// presentation extension.
+class FramePacer {
+public:
+    struct Stats {
+        double latencyMs = 0.0;         // Newest retired frame; 0 until one has
+        double averageLatencyMs = 0.0;  // Over the history
+        double maxLatencyMs = 0.0;
+        double gpuWaitMs = 0.0;         // This frame's wait for the frames in flight
+        double limiterWaitMs = 0.0;     // This frame's wait for the cap
+        int framesInFlight = 0;         // After the wait
+    };
+
+    FramePacer() = default;
+    ~FramePacer() = default;
+
+    FramePacer(const FramePacer&) = delete;
+    FramePacer& operator=(const FramePacer&) = delete;
+
+    // 1 to MAX_FRAMES_IN_FLIGHT; 1 waits for each frame to finish before the next starts
+    void setMaxFramesInFlight(int frames);
+    int getMaxFramesInFlight() const { return maxFramesInFlight_; }
+
+    // Frames per second; 0 (or less) removes the cap
+    void setFrameRateCap(float framesPerSecond);
+    float getFrameRateCap() const { return frameRateCap_; }
+
+    // Top of the loop: both waits, before anything the frame samples
+    void beginFrame();
+
+    // The moment this frame's input is read; the latency runs from here
+    void markInputSampled();
+
+    // Right after the swap: fences the frame
+    void endFrame();
+
+    const Stats& getStats() const { return stats_; }
+    const std::deque<float>& getLatencyHistory() const { return latencyHistory_; }
+
+    // Deletes the fences and queries; call while the context is still current
+    void shutdown();
+
+    static constexpr int MAX_FRAMES_IN_FLIGHT = 4;
+    static constexpr size_t HISTORY_FRAMES = 120;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct InFlight {
+        GLsync fence = nullptr;
+        GLuint query = 0;               // GL_TIMESTAMP after the swap
+        int64_t inputNs = -1;           // Steady clock; negative if input was not marked
+    };
+
+    static int64_t nowNs();
+    void retire(InFlight& frame);
+    void syncClocks();
+
+    int maxFramesInFlight_ = 2;
+    float frameRateCap_ = 0.0f;
+
+    std::deque<InFlight> inFlight_;
+    std::deque<GLuint> freeQueries_;
+    int64_t inputNs_ = -1;
+
+    // Scheduled start of the newest frame under the cap
+    Clock::time_point nextFrameStart_{};
+    bool limiterStarted_ = false;
+
+    // GPU timestamp minus nowNs(), measured every CLOCK_SYNC_FRAMES
+    int64_t gpuClockOffset_ = 0;
+    uint64_t frames_ = 0;
+    uint64_t clockSyncFrame_ = 0;
+    bool clockSynced_ = false;
+    static constexpr uint64_t CLOCK_SYNC_FRAMES = 120;
+
+    // Sleep stops this far before the frame's start and spins the rest, as sleeps overshoot
+    static constexpr auto SPIN_MARGIN = std::chrono::microseconds(1500);
+
+    Stats stats_;
+    std::deque<float> latencyHistory_;
+};
+
+} // namespace WaterSim
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include "GLResources.h"
+
+namespace WaterSim {
+
+class ShadowMapper;
+
+// Light scattered in the water toward the camera, on a view-aligned grid of froxels
+// (WIDTH x HEIGHT screen tiles by DEPTH slices spaced exponentially out to maxDistance).
+// froxel_inject.cs lights one jittered point per froxel inside the water volume from the
+// key light through the cascaded shadows (caustic_shadow.fs, linked in) and the raster
+// caustic map, and blends it with the previous frame's froxels reprojected to the same
+// world point; froxel_integrate.cs then marches each tile front to back once into the
+// scattering and transmittance up to every slice. The final pass applies it with one
+// 3D fetch per pixel, so the cost does not depend on the resolution. Context thread only.
+class FroxelVolumetrics {
+public:
+    static constexpr int WIDTH = 160;
+    static constexpr int HEIGHT = 90;
+    static constexpr int DEPTH = 64;
+    static constexpr float NEAR_DEPTH = 0.5f;   // View depth of the first slice
+
+    struct Settings {
+        bool enabled = true;
+        float maxDistance = 40.0f;      // View depth of the last slice
+        float scattering = 0.04f;       // Per world unit, of the water
+        float absorption = 0.12f;
+        float anisotropy = 0.6f;        // Henyey-Greenstein g: forward scattering shows the shafts
+        float intensity = 1.0f;
+        float temporalBlend = 0.9f;     // Share of the reprojected history kept per frame
+    };
+
+    // The camera (unjittered), the key light and the water it scatters in. The caustic
+    // map is RasterCaustics', 0 without one
+    struct Frame {
+        glm::mat4 view{1.0f};
+        glm::mat4 projection{1.0f};
+        glm::vec3 lightDirection{0.0f, -1.0f, 0.0f};   // Travel direction in air
+        glm::vec3 lightColor{1.0f};
+        glm::vec3 waterMin{0.0f};       // Box of the water, up to the water height
+        glm::vec3 waterMax{0.0f};
+        GLuint causticMap = 0;
+        float causticExtent = 10.0f;
+        float floorLevel = 0.0f;
+    };
+
+    FroxelVolumetrics() = default;
+    ~FroxelVolumetrics();
+
+    FroxelVolumetrics(const FroxelVolumetrics&) = delete;
+    FroxelVolumetrics& operator=(const FroxelVolumetrics&) = delete;
+
+    // Allocates the grids and submits the programs
+    void initialize();
+
+    // Another slice range drops the history
+    void setSettings(const Settings& settings);
+    const Settings& getSettings() const { return settings_; }
+
+    bool isReady() const { return injectProgram_.isValid() && integrateProgram_.isValid(); }
+
+    // Once per frame, after the shadows and caustics are drawn
+    void update(const Frame& frame, const ShadowMapper& shadows);
+
+    // Drops the history, for a camera cut
+    void resetHistory() { historyValid_ = false; }
+
+    // Scattered light in rgb and transmittance in alpha up to each slice's far side
+    GLuint getTexture() const { return integrated_.get(); }
+
+private:
+    Settings settings_;
+    GLShaderProgram injectProgram_;     // froxel_inject.cs with caustic_shadow.fs
+    GLShaderProgram integrateProgram_;  // froxel_integrate.cs
+    GLTexture scattering_[2];           // Lit froxels: in-scattering rgb, extinction; this and last frame's
+    GLTexture integrated_;
+    int current_ = 0;
+    bool historyValid_ = false;
+    unsigned int frameIndex_ = 0;
+    glm::mat4 previousViewProjection_{1.0f};
+    glm::mat4 previousView_{1.0f};
+};
+
+} // namespace WaterSim
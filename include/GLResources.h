@@ -2,32 +2,42 @@
 
 #include <glad/glad.h>
 #include <glm/glm.hpp>
+#include <cstdint>
 #include <stdexcept>
 #include <string>
+#include <unordered_map>
+#include "GPUMemoryTracker.h"
+#include "RenderTargetPool.h"
 
 namespace WaterSim {
 
-// RAII wrapper for OpenGL textures
+// RAII wrapper for OpenGL textures. The storage calls report to the GPUMemoryTracker
 class GLTexture {
 private:
     GLuint id = 0;
+    GLenum target = GL_TEXTURE_2D;
     bool owned = false;
+    bool pooled = false;    // From the RenderTargetPool, given back instead of deleted
 
 public:
     GLTexture() = default;
     
-    GLTexture(GLTexture&& other) noexcept : id(other.id), owned(other.owned) {
+    GLTexture(GLTexture&& other) noexcept : id(other.id), target(other.target), owned(other.owned), pooled(other.pooled) {
         other.id = 0;
         other.owned = false;
+        other.pooled = false;
     }
     
     GLTexture& operator=(GLTexture&& other) noexcept {
         if (this != &other) {
             cleanup();
             id = other.id;
+            target = other.target;
             owned = other.owned;
+            pooled = other.pooled;
             other.id = 0;
             other.owned = false;
+            other.pooled = false;
         }
         return *this;
     }
@@ -42,11 +52,73 @@ public:
         owned = true;
     }
     
+    // A texture object of the target at once, so the DSA calls below need no bind first.
+    // Storage is immutable: allocating again means creating a new name
+    void create(GLenum textureTarget) {
+        cleanup();
+        glCreateTextures(textureTarget, 1, &id);
+        target = textureTarget;
+        owned = true;
+    }
+    
+    void storage2D(GLsizei levels, GLenum internalFormat, GLsizei width, GLsizei height) const {
+        glTextureStorage2D(id, levels, internalFormat, width, height);
+        GPUMemoryTracker::instance().trackTexture(
+            id, GPUMemoryTracker::storageBytes(internalFormat, width, height, target == GL_TEXTURE_CUBE_MAP ? 6 : 1, levels));
+    }
+    
+    // A texture with this storage from the RenderTargetPool, reused from an earlier owner
+    // when one of the same size and format is free
+    void acquire(const RenderTargetDesc& desc) {
+        cleanup();
+        id = RenderTargetPool::instance().acquire(desc);
+        owned = true;
+        pooled = true;
+    }
+    
+    void storage3D(GLsizei levels, GLenum internalFormat, GLsizei width, GLsizei height, GLsizei depth) const {
+        glTextureStorage3D(id, levels, internalFormat, width, height, depth);
+        GPUMemoryTracker::instance().trackTexture(
+            id, GPUMemoryTracker::storageBytes(internalFormat, width, height, depth, levels, target == GL_TEXTURE_3D));
+    }
+    
+    void storage2DMultisample(GLsizei samples, GLenum internalFormat, GLsizei width, GLsizei height) const {
+        glTextureStorage2DMultisample(id, samples, internalFormat, width, height, GL_TRUE);
+        GPUMemoryTracker::instance().trackTexture(
+            id, GPUMemoryTracker::storageBytes(internalFormat, width, height) * size_t(samples));
+    }
+    
+    void subImage2D(GLint level, GLint x, GLint y, GLsizei width, GLsizei height,
+                    GLenum format, GLenum type, const void* pixels) const {
+        glTextureSubImage2D(id, level, x, y, width, height, format, type, pixels);
+    }
+    
+    void parameter(GLenum name, GLint value) const { glTextureParameteri(id, name, value); }
+    void parameter(GLenum name, GLfloat value) const { glTextureParameterf(id, name, value); }
+    
+    // Filters and wrap in one call, the common setup of a sampled target
+    void sampling(GLint minFilter, GLint magFilter, GLint wrap) const {
+        glTextureParameteri(id, GL_TEXTURE_MIN_FILTER, minFilter);
+        glTextureParameteri(id, GL_TEXTURE_MAG_FILTER, magFilter);
+        glTextureParameteri(id, GL_TEXTURE_WRAP_S, wrap);
+        glTextureParameteri(id, GL_TEXTURE_WRAP_T, wrap);
+        glTextureParameteri(id, GL_TEXTURE_WRAP_R, wrap);
+    }
+    
+    void generateMipmap() const { glGenerateTextureMipmap(id); }
+    void bindUnit(GLuint unit) const { glBindTextureUnit(unit, id); }
+    
     void cleanup() {
         if (owned && id != 0) {
-            glDeleteTextures(1, &id);
+            if (pooled) {
+                RenderTargetPool::instance().release(id);
+            } else {
+                GPUMemoryTracker::instance().untrackTexture(id);
+                glDeleteTextures(1, &id);
+            }
             id = 0;
             owned = false;
+            pooled = false;
         }
     }
     
@@ -63,19 +135,26 @@ public:
 class GLShaderProgram {
 private:
     GLuint id = 0;
+    
+    // Uniform locations by name, looked up from the driver once per program
+    mutable std::unordered_map<std::string, GLint> uniformLocations;
 
 public:
     GLShaderProgram() = default;
     
-    GLShaderProgram(GLShaderProgram&& other) noexcept : id(other.id) {
+    GLShaderProgram(GLShaderProgram&& other) noexcept
+        : id(other.id), uniformLocations(std::move(other.uniformLocations)) {
         other.id = 0;
+        other.uniformLocations.clear();
     }
     
     GLShaderProgram& operator=(GLShaderProgram&& other) noexcept {
         if (this != &other) {
             cleanup();
             id = other.id;
+            uniformLocations = std::move(other.uniformLocations);
             other.id = 0;
+            other.uniformLocations.clear();
         }
         return *this;
     }
@@ -103,6 +182,7 @@ public:
             glDeleteProgram(id);
             id = 0;
         }
+        uniformLocations.clear();
     }
     
     void use() const {
@@ -115,33 +195,55 @@ public:
     // Check if the shader program is valid
     bool isValid() const { return id != 0; }
     
+    // Cached glGetUniformLocation; -1 (set calls ignore it) is cached too. Valid until the
+    // program is relinked, which here only happens through setId
+    GLint uniformLocation(const std::string& name) const {
+        auto it = uniformLocations.find(name);
+        if (it == uniformLocations.end()) {
+            it = uniformLocations.emplace(name, glGetUniformLocation(id, name.c_str())).first;
+        }
+        return it->second;
+    }
+    
     // Uniform setters
     void setFloat(const std::string& name, float value) const {
-        glUniform1f(glGetUniformLocation(id, name.c_str()), value);
+        glUniform1f(uniformLocation(name), value);
     }
     
     void setInt(const std::string& name, int value) const {
-        glUniform1i(glGetUniformLocation(id, name.c_str()), value);
+        glUniform1i(uniformLocation(name), value);
+    }
+    
+    void setUint(const std::string& name, uint32_t value) const {
+        glUniform1ui(uniformLocation(name), value);
     }
     
     void setVec2(const std::string& name, const glm::vec2& value) const {
-        glUniform2fv(glGetUniformLocation(id, name.c_str()), 1, &value[0]);
+        glUniform2fv(uniformLocation(name), 1, &value[0]);
     }
     
     void setVec3(const std::string& name, const glm::vec3& value) const {
-        glUniform3fv(glGetUniformLocation(id, name.c_str()), 1, &value[0]);
+        glUniform3fv(uniformLocation(name), 1, &value[0]);
+    }
+    
+    void setVec4(const std::string& name, const glm::vec4& value) const {
+        glUniform4fv(uniformLocation(name), 1, &value[0]);
+    }
+    
+    void setVec3Array(const std::string& name, const glm::vec3* values, int count) const {
+        glUniform3fv(uniformLocation(name), count, &values[0][0]);
     }
     
     void setMat3(const std::string& name, const glm::mat3& value) const {
-        glUniformMatrix3fv(glGetUniformLocation(id, name.c_str()), 1, GL_FALSE, &value[0][0]);
+        glUniformMatrix3fv(uniformLocation(name), 1, GL_FALSE, &value[0][0]);
     }
     
     void setMat4(const std::string& name, const glm::mat4& value) const {
-        glUniformMatrix4fv(glGetUniformLocation(id, name.c_str()), 1, GL_FALSE, &value[0][0]);
+        glUniformMatrix4fv(uniformLocation(name), 1, GL_FALSE, &value[0][0]);
     }
     
     void setBool(const std::string& name, bool value) const {
-        glUniform1i(glGetUniformLocation(id, name.c_str()), value ? 1 : 0);
+        glUniform1i(uniformLocation(name), value ? 1 : 0);
     }
     
     // Delete copy constructor and assignment
@@ -156,7 +258,7 @@ private:
 
 public:
     GLVertexArray() {
-        glGenVertexArrays(1, &id);
+        glCreateVertexArrays(1, &id);
     }
     
     GLVertexArray(GLVertexArray&& other) noexcept : id(other.id) {
@@ -184,6 +286,26 @@ public:
         glBindVertexArray(0);
     }
     
+    // Vertex layout without binding the array: buffers go to binding points, attributes
+    // read from a binding at an offset
+    void vertexBuffer(GLuint binding, GLuint buffer, GLintptr offset, GLsizei stride) const {
+        glVertexArrayVertexBuffer(id, binding, buffer, offset, stride);
+    }
+    
+    void elementBuffer(GLuint buffer) const {
+        glVertexArrayElementBuffer(id, buffer);
+    }
+    
+    void attribute(GLuint index, GLuint binding, GLint size, GLenum type, GLboolean normalized, GLuint offset) const {
+        glEnableVertexArrayAttrib(id, index);
+        glVertexArrayAttribFormat(id, index, size, type, normalized, offset);
+        glVertexArrayAttribBinding(id, index, binding);
+    }
+    
+    void bindingDivisor(GLuint binding, GLuint divisor) const {
+        glVertexArrayBindingDivisor(id, binding, divisor);
+    }
+    
     void cleanup() {
         if (id != 0) {
             glDeleteVertexArrays(1, &id);
@@ -198,23 +320,56 @@ public:
     GLVertexArray& operator=(const GLVertexArray&) = delete;
 };
 
-// RAII wrapper for OpenGL buffers
+// The storage and delete calls for subsystems that keep raw names, reported to the
+// GPUMemoryTracker as the wrappers are
+inline void bufferStorage(GLuint buffer, GLsizeiptr bytes, const void* data, GLbitfield flags) {
+    glNamedBufferStorage(buffer, bytes, data, flags);
+    GPUMemoryTracker::instance().trackBuffer(buffer, size_t(bytes));
+}
+
+inline void deleteBuffers(GLsizei count, const GLuint* buffers) {
+    for (GLsizei i = 0; i < count; i++) GPUMemoryTracker::instance().untrackBuffer(buffers[i]);
+    glDeleteBuffers(count, buffers);
+}
+
+inline void textureStorage2D(GLuint texture, GLsizei levels, GLenum internalFormat, GLsizei width, GLsizei height) {
+    glTextureStorage2D(texture, levels, internalFormat, width, height);
+    GPUMemoryTracker::instance().trackTexture(texture, GPUMemoryTracker::storageBytes(internalFormat, width, height, 1, levels));
+}
+
+// A volume unless layered is set (2D arrays keep their layer count per level)
+inline void textureStorage3D(GLuint texture, GLsizei levels, GLenum internalFormat, GLsizei width, GLsizei height,
+                             GLsizei depth, bool layered = false) {
+    glTextureStorage3D(texture, levels, internalFormat, width, height, depth);
+    GPUMemoryTracker::instance().trackTexture(
+        texture, GPUMemoryTracker::storageBytes(internalFormat, width, height, depth, levels, !layered));
+}
+
+inline void deleteTextures(GLsizei count, const GLuint* textures) {
+    for (GLsizei i = 0; i < count; i++) GPUMemoryTracker::instance().untrackTexture(textures[i]);
+    glDeleteTextures(count, textures);
+}
+
+// RAII wrapper for OpenGL buffers. Storage is immutable (glNamedBufferStorage); storage()
+// called again replaces the buffer under a new name, so re-attach it wherever it was bound
 class GLBuffer {
 private:
     GLuint id = 0;
     GLenum type = GL_ARRAY_BUFFER;
+    GLsizeiptr size = 0;
 
 public:
     GLBuffer() {
-        glGenBuffers(1, &id);
+        glCreateBuffers(1, &id);
     }
     
     GLBuffer(GLenum bufferType) : type(bufferType) {
-        glGenBuffers(1, &id);
+        glCreateBuffers(1, &id);
     }
     
-    GLBuffer(GLBuffer&& other) noexcept : id(other.id), type(other.type) {
+    GLBuffer(GLBuffer&& other) noexcept : id(other.id), type(other.type), size(other.size) {
         other.id = 0;
+        other.size = 0;
     }
     
     GLBuffer& operator=(GLBuffer&& other) noexcept {
@@ -222,7 +377,9 @@ public:
             cleanup();
             id = other.id;
             type = other.type;
+            size = other.size;
             other.id = 0;
+            other.size = 0;
         }
         return *this;
     }
@@ -239,14 +396,44 @@ public:
         glBindBuffer(type, 0);
     }
     
+    void bindBase(GLenum target, GLuint index) const {
+        glBindBufferBase(target, index, id);
+    }
+    
+    // flags as glBufferStorage: GL_DYNAMIC_STORAGE_BIT for subData, map bits for map()
+    void storage(GLsizeiptr bytes, const void* data, GLbitfield flags) {
+        if (size != 0) {
+            cleanup();
+            glCreateBuffers(1, &id);
+        }
+        glNamedBufferStorage(id, bytes, data, flags);
+        GPUMemoryTracker::instance().trackBuffer(id, size_t(bytes));
+        size = bytes;
+    }
+    
+    void subData(GLintptr offset, GLsizeiptr bytes, const void* data) const {
+        glNamedBufferSubData(id, offset, bytes, data);
+    }
+    
+    void* map(GLintptr offset, GLsizeiptr length, GLbitfield access) const {
+        return glMapNamedBufferRange(id, offset, length, access);
+    }
+    
+    void unmap() const {
+        glUnmapNamedBuffer(id);
+    }
+    
     void cleanup() {
         if (id != 0) {
+            GPUMemoryTracker::instance().untrackBuffer(id);
             glDeleteBuffers(1, &id);
             id = 0;
         }
+        size = 0;
     }
     
     GLuint get() const { return id; }
+    GLsizeiptr getSize() const { return size; }
     
     // Delete copy constructor and assignment
     GLBuffer(const GLBuffer&) = delete;
@@ -260,7 +447,7 @@ private:
 
 public:
     GLFramebuffer() {
-        glGenFramebuffers(1, &id);
+        glCreateFramebuffers(1, &id);
     }
     
     GLFramebuffer(GLFramebuffer&& other) noexcept : id(other.id) {
@@ -288,11 +475,33 @@ public:
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
     }
     
+    // Attachments without binding the framebuffer; texture 0 detaches
+    void attachTexture(GLenum attachment, GLuint texture, GLint level = 0) const {
+        glNamedFramebufferTexture(id, attachment, texture, level);
+    }
+    
+    void attachTextureLayer(GLenum attachment, GLuint texture, GLint level, GLint layer) const {
+        glNamedFramebufferTextureLayer(id, attachment, texture, level, layer);
+    }
+    
+    void attachRenderbuffer(GLenum attachment, GLuint renderbuffer) const {
+        glNamedFramebufferRenderbuffer(id, attachment, GL_RENDERBUFFER, renderbuffer);
+    }
+    
+    void drawBuffers(GLsizei count, const GLenum* buffers) const {
+        glNamedFramebufferDrawBuffers(id, count, buffers);
+    }
+    
+    void readBuffer(GLenum buffer) const {
+        glNamedFramebufferReadBuffer(id, buffer);
+    }
+    
+    GLenum status() const {
+        return glCheckNamedFramebufferStatus(id, GL_FRAMEBUFFER);
+    }
+    
     bool isValid() const {
-        if (id == 0) return false;
-        glBindFramebuffer(GL_FRAMEBUFFER, id);
-        GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
-        return status == GL_FRAMEBUFFER_COMPLETE;
+        return id != 0 && status() == GL_FRAMEBUFFER_COMPLETE;
     }
     
     void cleanup() {
@@ -316,30 +525,23 @@ public:
         glBindTexture(GL_TEXTURE_2D, get());
     }
     
-    void storage(GLsizei width, GLsizei height, GLenum internalFormat) {
-        glBindTexture(GL_TEXTURE_2D, get());
-        
-        // Determine the correct format and type based on internal format
-        GLenum format = GL_RGBA;
-        GLenum type = GL_FLOAT;
-        
-        if (internalFormat == GL_DEPTH_COMPONENT32F || internalFormat == GL_DEPTH_COMPONENT32 || 
-            internalFormat == GL_DEPTH_COMPONENT24 || internalFormat == GL_DEPTH_COMPONENT16) {
-            format = GL_DEPTH_COMPONENT;
-            type = GL_FLOAT;
-        } else if (internalFormat == GL_R32F || internalFormat == GL_R16F || internalFormat == GL_R8) {
-            format = GL_RED;
-        } else if (internalFormat == GL_RG32F || internalFormat == GL_RG16F || internalFormat == GL_RG8) {
-            format = GL_RG;
-        } else if (internalFormat == GL_RGB32F || internalFormat == GL_RGB16F || internalFormat == GL_RGB8) {
-            format = GL_RGB;
-        }
-        
-        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, nullptr);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    // Immutable storage on a new texture object, sampled nearest and clamped. Calling it
+    // again reallocates under a new name, which must be re-attached wherever it was
+    void storage(GLsizei width, GLsizei height, GLenum internalFormat, GLsizei levels = 1) {
+        create(GL_TEXTURE_2D);
+        storage2D(levels, internalFormat, width, height);
+        sampling(levels > 1 ? GL_NEAREST_MIPMAP_NEAREST : GL_NEAREST, GL_NEAREST, GL_CLAMP_TO_EDGE);
+    }
+    
+    // As storage(), from the RenderTargetPool: for targets sized to the window or a setting
+    void renderTarget(GLsizei width, GLsizei height, GLenum internalFormat, GLsizei levels = 1) {
+        RenderTargetDesc desc;
+        desc.internalFormat = internalFormat;
+        desc.width = width;
+        desc.height = height;
+        desc.levels = levels;
+        acquire(desc);
+        sampling(levels > 1 ? GL_NEAREST_MIPMAP_NEAREST : GL_NEAREST, GL_NEAREST, GL_CLAMP_TO_EDGE);
     }
 };
 
@@ -349,25 +551,11 @@ public:
         glBindTexture(GL_TEXTURE_3D, get());
     }
     
+    // As GLTexture2D::storage, one level
     void storage(GLsizei width, GLsizei height, GLsizei depth, GLenum internalFormat) {
-        glBindTexture(GL_TEXTURE_3D, get());
-        
-        // Determine the correct format based on internal format
-        GLenum format = GL_RGBA;
-        if (internalFormat == GL_R32F || internalFormat == GL_R16F || internalFormat == GL_R8) {
-            format = GL_RED;
-        } else if (internalFormat == GL_RG32F || internalFormat == GL_RG16F || internalFormat == GL_RG8) {
-            format = GL_RG;
-        } else if (internalFormat == GL_RGB32F || internalFormat == GL_RGB16F || internalFormat == GL_RGB8) {
-            format = GL_RGB;
-        }
-        
-        glTexImage3D(GL_TEXTURE_3D, 0, internalFormat, width, height, depth, 0, format, GL_FLOAT, nullptr);
-        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        create(GL_TEXTURE_3D);
+        storage3D(1, internalFormat, width, height, depth);
+        sampling(GL_NEAREST, GL_NEAREST, GL_CLAMP_TO_EDGE);
     }
 };
 
@@ -420,6 +608,141 @@ public:
     GLTransformFeedback& operator=(const GLTransformFeedback&) = delete;
 };
 
+// Shadow copy of the bindings and fixed-function state the render loop sets, so calls that
+// would not change anything are dropped before they reach the driver. Code that calls GL
+// directly leaves the copy stale; invalidate() (or invalidateTextures() after texture binds
+// only) marks the state unknown, and the next call for it is always issued.
+class GLStateCache {
+public:
+    static constexpr int MAX_TEXTURE_UNITS = 16;
+    
+    // Calls passed to the driver and calls dropped as redundant, since resetCounters
+    struct Counters {
+        uint64_t issued = 0;
+        uint64_t skipped = 0;
+    };
+    
+    void useProgram(GLuint program) {
+        if (update(currentProgram, program)) glUseProgram(program);
+    }
+    
+    void bindVertexArray(GLuint vao) {
+        if (update(vertexArray, vao)) glBindVertexArray(vao);
+    }
+    
+    // GL_FRAMEBUFFER, both draw and read
+    void bindFramebuffer(GLuint framebuffer) {
+        if (update(this->framebuffer, framebuffer)) glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    }
+    
+    // GL_TEXTURE_2D and GL_TEXTURE_CUBE_MAP on the first MAX_TEXTURE_UNITS units are
+    // tracked; other targets and units are always bound
+    void bindTexture(int unit, GLenum target, GLuint texture) {
+        int targetIndex = target == GL_TEXTURE_2D ? 0 : (target == GL_TEXTURE_CUBE_MAP ? 1 : -1);
+        if (targetIndex < 0 || unit < 0 || unit >= MAX_TEXTURE_UNITS) {
+            activeTexture(unit);
+            glBindTexture(target, texture);
+            counters.issued++;
+            return;
+        }
+        if (update(textures[unit][targetIndex], texture)) {
+            activeTexture(unit);
+            glBindTexture(target, texture);
+        }
+    }
+    
+    void activeTexture(int unit) {
+        if (update(activeUnit, unit)) glActiveTexture(GL_TEXTURE0 + unit);
+    }
+    
+    // GL_BLEND, GL_DEPTH_TEST and GL_CULL_FACE are tracked; other capabilities always issued
+    void setEnabled(GLenum capability, bool enabled) {
+        Slot<bool>* slot = capability == GL_BLEND ? &blend
+                         : capability == GL_DEPTH_TEST ? &depthTest
+                         : capability == GL_CULL_FACE ? &cullFace : nullptr;
+        if (!slot) {
+            enabled ? glEnable(capability) : glDisable(capability);
+            counters.issued++;
+            return;
+        }
+        if (update(*slot, enabled)) {
+            enabled ? glEnable(capability) : glDisable(capability);
+        }
+    }
+    
+    void blendFunc(GLenum source, GLenum destination) {
+        if (update(blendFactors, (uint64_t(source) << 32) | destination)) glBlendFunc(source, destination);
+    }
+    
+    void depthFunc(GLenum function) {
+        if (update(depthFunction, function)) glDepthFunc(function);
+    }
+    
+    void depthMask(bool write) {
+        if (update(depthWrite, write)) glDepthMask(write ? GL_TRUE : GL_FALSE);
+    }
+    
+    void invalidate() {
+        currentProgram.known = false;
+        vertexArray.known = false;
+        framebuffer.known = false;
+        blend.known = false;
+        depthTest.known = false;
+        cullFace.known = false;
+        blendFactors.known = false;
+        depthFunction.known = false;
+        depthWrite.known = false;
+        invalidateTextures();
+    }
+    
+    // After a draw helper that binds its own VAO and leaves 0 bound
+    void invalidateVertexArray() { vertexArray.known = false; }
+    
+    void invalidateTextures() {
+        activeUnit.known = false;
+        for (auto& unit : textures) {
+            unit[0].known = false;
+            unit[1].known = false;
+        }
+    }
+    
+    const Counters& getCounters() const { return counters; }
+    void resetCounters() { counters = Counters(); }
+
+private:
+    template <typename T>
+    struct Slot {
+        T value{};
+        bool known = false;   // Until set through the cache, the GL value is unknown
+    };
+    
+    // Record value; true when it differs from the shadow and must be issued
+    template <typename T>
+    bool update(Slot<T>& slot, T value) {
+        if (slot.known && slot.value == value) {
+            counters.skipped++;
+            return false;
+        }
+        slot.value = value;
+        slot.known = true;
+        counters.issued++;
+        return true;
+    }
+    
+    Slot<GLuint> currentProgram;
+    Slot<GLuint> vertexArray;
+    Slot<GLuint> framebuffer;
+    Slot<int> activeUnit;
+    Slot<GLuint> textures[MAX_TEXTURE_UNITS][2];   // 2D, cube map
+    Slot<bool> blend;
+    Slot<bool> depthTest;
+    Slot<bool> cullFace;
+    Slot<uint64_t> blendFactors;
+    Slot<GLenum> depthFunction;
+    Slot<bool> depthWrite;
+    Counters counters;
+};
+
 // Utility function to check OpenGL errors
 inline void checkGLError(const std::string& location) {
 #ifdef DEBUG
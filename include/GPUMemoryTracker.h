@@ -0,0 +1,125 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace WaterSim {
+
+// GPU memory by the subsystem that allocated it, for the debug UI. The GLResources wrappers
+// and their raw-name helpers (bufferStorage, textureStorage2D, ...), and the
+// RenderTargetPool, report each buffer and texture's storage here when it is allocated and
+// deleted; the innermost GPUMemoryScope open at the allocation names its subsystem. Pooled
+// targets move to the subsystem that acquires them and to POOL_IDLE once given back.
+// Storage allocated by plain GL calls elsewhere goes uncounted, so the total is a lower bound
+// to hold against the driver's own numbers (queryDriverMemory).
+//
+// Compute passes also declare the bytes they read and write per run (addTraffic), a
+// footprint of the resources they bind rather than a measurement; endFrame keeps the last
+// frame's totals. Context thread only.
+class GPUMemoryTracker {
+public:
+    static constexpr const char* UNTAGGED = "Other";
+    static constexpr const char* POOL_IDLE = "Render target pool (idle)";
+
+    struct Subsystem {
+        std::string name;
+        size_t bufferBytes = 0;
+        size_t textureBytes = 0;
+        int buffers = 0;
+        int textures = 0;
+    };
+
+    struct PassTraffic {
+        std::string name;
+        size_t readBytes = 0;
+        size_t writtenBytes = 0;
+        int runs = 0;
+    };
+
+    // GL_NVX_gpu_memory_info or GL_ATI_meminfo, whichever the driver has; in bytes
+    struct DriverMemory {
+        const char* source = nullptr;   // Null without either extension
+        size_t dedicatedBytes = 0;      // NVX only
+        size_t availableBytes = 0;      // Free video memory now (ATI: for textures)
+        size_t evictedBytes = 0;        // NVX only, since startup
+        int evictions = 0;
+    };
+
+    static GPUMemoryTracker& instance();
+
+    // GPUMemoryScope is the usual way in; the name must outlive the scope
+    void pushSubsystem(const char* name) { scopes_.push_back(name); }
+    void popSubsystem() { if (!scopes_.empty()) scopes_.pop_back(); }
+
+    // Tracking a name again replaces its entry: immutable storage is only ever re-created
+    void trackBuffer(GLuint buffer, size_t bytes);
+    void untrackBuffer(GLuint buffer);
+    void trackTexture(GLuint texture, size_t bytes);
+    void untrackTexture(GLuint texture);
+
+    // A tracked texture under another subsystem; null for the current scope's
+    void retagTexture(GLuint texture, const char* name = nullptr);
+
+    // Zero for names not tracked
+    size_t getBufferBytes(GLuint buffer) const;
+    size_t getTextureBytes(GLuint texture) const;
+
+    // Largest first
+    std::vector<Subsystem> getSubsystems() const;
+    size_t getTotalBytes() const { return totalBytes_; }
+
+    void addTraffic(const std::string& pass, size_t readBytes, size_t writtenBytes);
+
+    // Once per frame: this frame's traffic becomes the last frame's
+    void endFrame();
+    const std::vector<PassTraffic>& getLastFrameTraffic() const { return lastTraffic_; }
+
+    DriverMemory queryDriverMemory() const;
+
+    // Bytes of a level of the format, 4 for those not listed
+    static size_t bytesPerTexel(GLenum internalFormat);
+
+    // Every level of the storage; depth is the layer count of an array and only halves per
+    // level for a volume
+    static size_t storageBytes(GLenum internalFormat, int width, int height, int depth = 1, int levels = 1,
+                               bool volume = false);
+
+private:
+    struct Allocation {
+        size_t bytes = 0;
+        int subsystem = 0;
+    };
+
+    GPUMemoryTracker() = default;
+    ~GPUMemoryTracker() = default;
+
+    GPUMemoryTracker(const GPUMemoryTracker&) = delete;
+    GPUMemoryTracker& operator=(const GPUMemoryTracker&) = delete;
+
+    int subsystemIndex(const char* name);
+    int currentSubsystem();
+
+    std::vector<std::string> subsystemNames_;   // Interned, indexed by Allocation::subsystem
+    std::vector<const char*> scopes_;
+    std::unordered_map<GLuint, Allocation> buffers_;
+    std::unordered_map<GLuint, Allocation> textures_;
+    size_t totalBytes_ = 0;
+
+    std::vector<PassTraffic> traffic_;          // This frame, in first-run order
+    std::vector<PassTraffic> lastTraffic_;
+};
+
+// Allocations inside are counted under the name
+class GPUMemoryScope {
+public:
+    explicit GPUMemoryScope(const char* name) { GPUMemoryTracker::instance().pushSubsystem(name); }
+    ~GPUMemoryScope() { GPUMemoryTracker::instance().popSubsystem(); }
+
+    GPUMemoryScope(const GPUMemoryScope&) = delete;
+    GPUMemoryScope& operator=(const GPUMemoryScope&) = delete;
+};
+
+} // namespace WaterSim
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <cstdint>
+
+namespace WaterSim {
+
+struct PickResult {
+    bool hit = false;               // false: the depth there was the far plane
+    glm::vec3 position{0.0f};       // World space, on the nearest opaque surface
+    float distance = 0.0f;          // From the camera of the frame captured
+    glm::vec2 cursor{0.0f};         // Window coordinates it was captured at
+    uint64_t frame = 0;             // Picker frame of the capture; 0 before the first
+};
+
+// Mouse picking from the depth buffer without a pipeline stall. Each frame, a pass after
+// the opaque scene copies the depth at the requested cursor into a persistently mapped
+// pixel-pack buffer and fences it; the first beginFrame that finds the fence signaled turns
+// the depth into a world position with the inverse view-projection of the frame it was
+// captured in. A capture comes back a frame or two later, and a ring slot still in flight
+// is skipped rather than waited for.
+//
+// beginFrame also caches the frame's inverse matrices, so unprojecting a cursor costs no
+// inverse (and sees the same near and far planes the frame was drawn with).
+class GPUPicker {
+public:
+    GPUPicker() = default;
+    ~GPUPicker();
+
+    GPUPicker(const GPUPicker&) = delete;
+    GPUPicker& operator=(const GPUPicker&) = delete;
+
+    bool initialize();
+
+    // Once per frame, with the matrices the frame draws with: collects the captures that
+    // have landed and advances the frame
+    void beginFrame(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& cameraPosition,
+                    int width, int height);
+
+    // Window coordinates (origin top left) to read in this frame's capture; the last call wins
+    void request(const glm::vec2& cursor);
+
+    // From a pass after the opaque scene, with its depth texture; one rendered at another
+    // size than the window (the temporal upscale) gives its size
+    void capture(GLuint depthTexture, const glm::ivec2& depthSize = glm::ivec2(0));
+
+    uint64_t getFrame() const { return frame_; }
+
+    // Newest pick that has landed
+    const PickResult& getLatest() const { return latest_; }
+    bool hasResultSince(uint64_t frame) const { return latest_.frame >= frame; }
+
+    // Through the cached inverses: the view ray under a cursor, and the point on it at a
+    // distance from the camera
+    glm::vec3 rayDirection(const glm::vec2& cursor) const;
+    glm::vec3 pointAtDistance(const glm::vec2& cursor, float distance) const;
+
+    static constexpr uint32_t READBACK_FRAMES = 3;
+
+private:
+    struct Capture {
+        GLsync fence = nullptr;
+        glm::mat4 inverseViewProjection{1.0f};
+        glm::vec3 cameraPosition{0.0f};
+        glm::vec2 cursor{0.0f};
+        uint64_t frame = 0;
+    };
+
+    glm::vec2 toNDC(const glm::vec2& cursor) const;
+    void collect();
+
+    GLuint readbackBuffer_ = 0;
+    const float* readbackDepths_ = nullptr;   // One depth per ring slot
+    Capture captures_[READBACK_FRAMES];
+    uint32_t writeIndex_ = 0;
+
+    glm::mat4 inverseView_{1.0f};
+    glm::mat4 inverseProjection_{1.0f};
+    glm::mat4 inverseViewProjection_{1.0f};
+    glm::vec3 cameraPosition_{0.0f};
+    glm::ivec2 viewport_{1, 1};
+
+    glm::vec2 requestedCursor_{0.0f};
+    bool requested_ = false;
+    uint64_t frame_ = 0;
+    PickResult latest_;
+};
+
+} // namespace WaterSim
@@ -9,6 +9,8 @@ public:
     GlassContainer(float width = 10.0f, float height = 10.0f, float depth = 10.0f);
     ~GlassContainer();
 
+    // The mesh alone, on any thread before initialize(), which generates it otherwise
+    void prepareMesh() { generateMesh(); }
     void initialize();
     void render(unsigned int shaderProgram);
 
@@ -27,6 +29,10 @@ public:
     float getHeight() const { return height; }
     float getDepth() const { return depth; }
 
+    // 8-float vertices (position, normal, uv) around the origin, for the scene batch
+    const std::vector<float>& getVertices() const { return vertices; }
+    const std::vector<unsigned int>& getIndices() const { return indices; }
+
 private:
     unsigned int VAO, VBO, EBO;
     
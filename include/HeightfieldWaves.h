@@ -0,0 +1,87 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <algorithm>
+
+// Interactive ripples as a wave-equation heightfield over the water surface, stepped on the
+// GPU (heightfield_waves.cs). Disturbances are brush stamps queued on the CPU and applied
+// at the next update, so the cost per frame is the same however many there are; waves
+// reflect off the surface edges (the container walls) and off the obstacle disc.
+class HeightfieldWaves {
+public:
+    static constexpr int MAX_STAMPS = 32;  // Per update; MAX_STAMPS of heightfield_waves.cs
+    static constexpr float DEPOSIT_SCALE = 1.0e6f;  // Fixed-point units per world unit of the deposits
+
+    HeightfieldWaves();
+    ~HeightfieldWaves();
+
+    // Grid of resolution^2 texels over a square surface of the given size; false if
+    // the kernel failed to compile
+    bool initialize(int resolution, float surfaceSize);
+
+    // Brush of the given world radius and peak height at a surface point; a non-zero
+    // direction starts the pulse travelling that way
+    void addStamp(const glm::vec2& center, float radius, float amplitude, const glm::vec2& direction = glm::vec2(0.0f));
+    
+    // Brush that adds (or, negative, removes) the given volume of water
+    void addVolume(const glm::vec2& center, float radius, float volume);
+    
+    // Water handed over by other solvers (the SPH splash absorption): two ints per texel,
+    // row-major, the added height and that height times its vertical speed, both in
+    // DEPOSIT_SCALE fixed point. The next update adds them, moving a column of the deposit
+    // depth by the momentum, and clears them. Created on first use
+    GLuint getDepositBuffer();
+    void setDepositDepth(float depth) { depositDepth_ = std::max(depth, 1.0e-3f); }
+    int getResolution() const { return resolution_; }
+    float getSurfaceSize() const { return surfaceSize_; }
+
+    // Disc the water cannot enter (the sphere at the waterline), radius <= 0 for none
+    void setObstacle(const glm::vec2& center, float radius);
+
+    void setWaveSpeed(float speed) { waveSpeed_ = speed; }
+    float getWaveSpeed() const { return waveSpeed_; }
+    void setDamping(float damping) { damping_ = damping; }
+    float getDamping() const { return damping_; }
+
+    // Flattens the surface and drops pending stamps
+    void clear();
+
+    // Advances by fixed steps covering deltaTime, applying the queued stamps first
+    void update(float deltaTime);
+
+    // Both height steps side by side in a 2 * resolution by resolution R32F texture (current
+    // first), and the step accumulator, for a rewind keyframe; restoring drops pending stamps
+    // and deposits
+    void saveState(GLuint texture, float& accumulator) const;
+    void restoreState(GLuint texture, float accumulator);
+
+    // Height in world units, texel i centred at (i + 0.5) * size / resolution - size / 2
+    GLuint getHeightTexture() const { return heightTextures_[current_]; }
+
+    // Render interpolation between fixed simulation ticks: the heights this many seconds
+    // before the last update, blended from the two steps into a texture of their own (at
+    // most a step back). Call after each frame's updates; 0 draws the current step
+    void setRenderLag(float seconds);
+    GLuint getRenderHeightTexture() const { return renderBlended_ ? renderTexture_ : getHeightTexture(); }
+
+private:
+    int resolution_ = 0;
+    float surfaceSize_ = 1.0f;
+    float waveSpeed_ = 1.5f;     // World units per second
+    float damping_ = 0.004f;     // Fraction of the velocity lost per step
+    float accumulator_ = 0.0f;
+
+    glm::vec2 obstacleCenter_{0.0f};
+    float obstacleRadius_ = 0.0f;
+    std::vector<glm::vec4> stamps_;  // Two vec4s per stamp, as uStamps
+    GLuint depositBuffer_ = 0;
+    float depositDepth_ = 0.25f;
+
+    GLuint heightTextures_[2] = {0, 0};  // Current and previous, swapped every step
+    int current_ = 0;
+    GLuint renderTexture_ = 0;           // Allocated on first use
+    bool renderBlended_ = false;         // renderTexture_ holds this frame's heights
+    GLuint program_ = 0;
+};
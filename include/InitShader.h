@@ -1,13 +1,51 @@
 #pragma once
 
 #include <glad/glad.h>
+#include <cstdint>
 #include <string>
+#include <vector>
+
+// Linked programs are cached as driver binaries in this directory (default "shader_cache")
+// and reused while their sources and the driver stay the same; any other program compiles
+// from source and refreshes the cache. An empty path disables the cache
+void SetShaderCacheDirectory(const std::string& directory);
+
+// One stage of a program, by final source (defines already injected)
+struct ShaderStageSource {
+    GLenum type;
+    const std::string* source;
+};
+
+// Cache internals, shared with the asynchronous ShaderCompiler. LoadCachedProgram returns 0
+// on a miss or when the driver rejects the binary; the caller then compiles from source and
+// stores the linked result
+uint64_t ProgramCacheKey(const std::vector<ShaderStageSource>& stages);
+GLuint LoadCachedProgram(uint64_t key, const char* label);
+void StoreCachedProgram(uint64_t key, GLuint program);
 
 // Function to initialize and compile shaders
 GLuint InitShader(const char* vertexShaderPath, const char* fragmentShaderPath);
 
+// Variant whose fragment source gets fragmentDefines after #version
+GLuint InitShader(const char* vertexShaderPath, const char* fragmentShaderPath, const std::string& fragmentDefines);
+
+// Program with tessellation stages; the evaluation shader source gets tesDefines after
+// #version, so a vertex shader can double as the evaluation stage
+GLuint InitTessellationShader(const char* vertexShaderPath, const char* controlShaderPath,
+                              const char* evaluationShaderPath, const char* fragmentShaderPath,
+                              const std::string& tesDefines);
+
+// Program with a geometry stage between the vertex and fragment shaders
+GLuint InitGeometryShader(const char* vertexShaderPath, const char* geometryShaderPath, const char* fragmentShaderPath);
+
 // Function to initialize compute shader
 GLuint InitComputeShader(const char* computeShaderPath);
 
+// Compute shader variant with preprocessor lines (e.g. "#define FOO 1\n") inserted after #version
+GLuint InitComputeShader(const char* computeShaderPath, const std::string& defines);
+
+// Helper function to insert preprocessor lines after the #version directive of a shader source
+std::string InjectShaderDefines(const std::string& source, const std::string& defines);
+
 // Helper function to read shader source from file
 std::string ReadShaderSource(const char* filePath); 
\ No newline at end of file
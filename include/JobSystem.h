@@ -0,0 +1,146 @@
+#pragma once
+
+#include "CpuTopology.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace WaterSim {
+
+// Shared work-stealing pool for the CPU stages. Every worker keeps a deque of tasks: it
+// pushes and pops its own at the back, newest first while their data is still in cache, and
+// an idle worker steals the oldest task from the front of another's. Threads outside the
+// pool queue into a shared injection deque. Tasks are counted into a TaskGroup, whose
+// wait() runs queued tasks instead of blocking, so a task may fork subtasks and join them.
+//
+// On a machine of several NUMA nodes or core classes (CpuTopology) every worker is pinned to
+// one processor, the workers numbered node by node, so a partitioned loop's span stays on
+// the node holding its first-touched data and an efficiency core gets a span it finishes
+// with the rest.
+class JobSystem {
+public:
+    using Task = std::function<void()>;
+
+    // Fork-join counter: run() forks, wait() joins, and then() queues a continuation that
+    // runs once every task forked so far has finished (wait() also covers it)
+    class TaskGroup {
+    public:
+        TaskGroup() = default;
+        ~TaskGroup() { wait(); }
+
+        TaskGroup(const TaskGroup&) = delete;
+        TaskGroup& operator=(const TaskGroup&) = delete;
+
+        void run(Task task);
+        void then(Task continuation);
+        void wait();
+        bool done() const;
+
+    private:
+        friend class JobSystem;
+        void finish();
+
+        // Counted under the lock: the last task's unlock is its final touch of the group,
+        // so a waiter may destroy the group as soon as it sees zero
+        mutable std::mutex mutex_;
+        int pending_ = 0;       // Tasks queued or running, the pending continuation included
+        Task continuation_;
+    };
+
+    // Created on first use with one worker per hardware thread besides the caller's
+    static JobSystem& instance();
+    int getWorkerCount() const { return static_cast<int>(workers_.size()); }
+
+    // body(first, last) over [begin, end) in chunks of grain indices (0 picks a few chunks
+    // per thread); the caller works on chunks too and returns when all are done
+    void parallelFor(int begin, int end, int grain, const std::function<void(int, int)>& body);
+
+    // body(first, last) over [begin, end) in one contiguous span per worker, sized by the
+    // throughput of its core and cut at multiples of grain (0: 1). The same range always
+    // splits the same way onto the same workers, so data a span first wrote (FirstTouchVector)
+    // sits on its worker's node; an idle thread may still steal a span whose owner is busy.
+    // The caller only helps, through wait().
+    void parallelForPartitioned(int begin, int end, int grain, const std::function<void(int, int)>& body);
+
+    const CpuTopology& getTopology() const { return topology_; }
+    bool isPinned() const { return pinned_; }
+
+    // Most threads, the caller included, a parallelFor spreads over (0: every worker), for
+    // measuring how the CPU stages scale
+    void setParallelism(int threads) { parallelism_.store(std::max(threads, 0)); }
+    int getParallelism() const { return parallelism_.load(); }
+
+    // Runs one queued task on the calling thread; false if there was none
+    bool runPending();
+
+private:
+    JobSystem();
+    ~JobSystem();
+
+    struct Job {
+        Task task;
+        TaskGroup* group;
+    };
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+    };
+
+    void submit(Job job);
+    void submitTo(int worker, Job job);
+    bool takeJob(Job& job);
+    void workerLoop(int index);
+    void placeWorkers(int workerCount);
+
+    std::vector<std::unique_ptr<Queue>> queues_;   // One per worker
+    Queue injection_;                              // Tasks from threads outside the pool
+    std::vector<std::thread> workers_;
+
+    CpuTopology topology_;
+    std::vector<int> placement_;                   // Each worker's processor in topology_
+    std::vector<float> workerWeights_;             // Each worker's share of a partitioned loop
+    bool pinned_ = false;
+
+    std::atomic<int> queued_{0};
+    std::atomic<int> parallelism_{0};
+    std::mutex sleepMutex_;
+    std::condition_variable wake_;
+    bool stop_ = false;
+
+    static thread_local int workerIndex_;          // -1 outside the pool
+};
+
+// Allocator that leaves elements default-initialized, so allocating touches no pages and
+// each page lands on the NUMA node of the thread that first writes it. Fill a
+// FirstTouchVector from parallelForPartitioned over the range the same loops later read.
+template <typename T>
+struct FirstTouchAllocator : std::allocator<T> {
+    template <typename U>
+    struct rebind { using other = FirstTouchAllocator<U>; };
+
+    FirstTouchAllocator() = default;
+    template <typename U>
+    FirstTouchAllocator(const FirstTouchAllocator<U>&) noexcept {}
+
+    template <typename U>
+    void construct(U* p) noexcept(std::is_nothrow_default_constructible<U>::value) {
+        ::new (static_cast<void*>(p)) U;
+    }
+    template <typename U, typename... Args>
+    void construct(U* p, Args&&... args) {
+        ::new (static_cast<void*>(p)) U(std::forward<Args>(args)...);
+    }
+};
+
+template <typename T>
+using FirstTouchVector = std::vector<T, FirstTouchAllocator<T>>;
+
+} // namespace WaterSim
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+// Levels below this are compiled out: their WATERSIM_LOG_* lines expand to nothing, arguments
+// included. 0 trace, 1 debug, 2 info, 3 warning, 4 error
+#ifndef WATERSIM_LOG_MIN_LEVEL
+#define WATERSIM_LOG_MIN_LEVEL 1
+#endif
+
+namespace WaterSim {
+
+// Prefixed: DEBUG and ERROR are macros in some builds
+enum class LogLevel : uint8_t {
+    LOG_TRACE = 0,
+    LOG_DEBUG = 1,
+    LOG_INFO = 2,
+    LOG_WARNING = 3,
+    LOG_ERROR = 4
+};
+
+// Rate limits are per category, so a noisy renderer cannot crowd out the simulation
+enum class LogCategory : uint8_t {
+    GENERAL,
+    SPH,
+    RENDER,
+    RAY_TRACING,
+    COUNT
+};
+
+// Leveled logging off the render thread. A message is formatted by the thread that logs it,
+// copied into a slot of a bounded lock-free ring and written out by a background thread, so
+// the caller never touches stdout. A full ring drops the message and counts it.
+//
+// Warnings and errors always pass (subject to the rate limit). Trace, debug and info need
+// logging enabled (Config::Debug::enableLogging); with it off, a call site costs one relaxed
+// load and its arguments are never evaluated.
+class Logger {
+public:
+    static Logger& instance();
+
+    void setEnabled(bool enable) { enabled_.store(enable, std::memory_order_relaxed); }
+    bool isEnabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+    // Messages a category may write per second (DEFAULT_RATE_LIMIT to begin with); further
+    // ones in the same second are dropped and counted on the next one that passes. 0 lifts
+    // the limit
+    void setRateLimit(LogCategory category, uint32_t messagesPerSecond);
+
+    // Cheap check for the macros; also spends the category's rate budget
+    bool shouldLog(LogLevel level, LogCategory category) {
+        if (level < LogLevel::LOG_WARNING && !enabled_.load(std::memory_order_relaxed)) return false;
+        return admit(category);
+    }
+
+    // Queues stream's text and clears the stream for the next message
+    void write(LogLevel level, LogCategory category, std::ostringstream& stream);
+
+    // Blocks until everything queued so far is written
+    void flush();
+
+    // Writes what is left and stops the writer thread; logging afterwards writes directly
+    void shutdown();
+
+    // The calling thread's scratch stream, reused so formatting does not allocate each time
+    static std::ostringstream& threadStream();
+
+    static constexpr size_t RING_MESSAGES = 512;          // Power of two
+    static constexpr size_t MESSAGE_LENGTH = 512;         // Longer messages are cut
+    static constexpr uint32_t DEFAULT_RATE_LIMIT = 20;
+
+private:
+    struct Slot {
+        std::atomic<uint64_t> sequence{0};
+        LogLevel level = LogLevel::LOG_INFO;
+        uint32_t suppressed = 0;            // Dropped by the rate limit before this one
+        char text[MESSAGE_LENGTH];
+    };
+
+    struct CategoryState {
+        std::atomic<uint32_t> limit{0};
+        std::atomic<int64_t> windowStart{0};     // ms
+        std::atomic<uint32_t> windowCount{0};
+        std::atomic<uint32_t> suppressed{0};
+    };
+
+    Logger();
+    ~Logger();
+
+    bool admit(LogCategory category);
+    void output(LogLevel level, uint32_t suppressed, const char* text) const;
+    void writerLoop();
+    void drain();
+
+    std::atomic<bool> enabled_{false};
+    CategoryState categories_[static_cast<size_t>(LogCategory::COUNT)];
+
+    // Multi-producer ring: enqueue_ hands out positions, a slot's sequence says whether it
+    // is free for that position or holds a message for the writer
+    std::unique_ptr<Slot[]> slots_;
+    std::atomic<uint64_t> enqueue_{0};
+    uint64_t dequeue_ = 0;                  // Writer thread only
+    std::atomic<uint64_t> written_{0};
+    std::atomic<uint64_t> dropped_{0};
+    std::atomic<bool> running_{false};
+
+    // The writer polls; only flush and shutdown wake it early
+    std::mutex wakeMutex_;
+    std::condition_variable wake_;
+    std::condition_variable drained_;
+    std::thread writer_;
+};
+
+} // namespace WaterSim
+
+#define WATERSIM_LOG(level, category, message)                                                  \
+    do {                                                                                        \
+        ::WaterSim::Logger& watersimLogger_ = ::WaterSim::Logger::instance();                   \
+        if (watersimLogger_.shouldLog(level, category)) {                                       \
+            std::ostringstream& watersimStream_ = ::WaterSim::Logger::threadStream();           \
+            watersimStream_ << message;                                                         \
+            watersimLogger_.write(level, category, watersimStream_);                            \
+        }                                                                                       \
+    } while (0)
+
+#define WATERSIM_LOG_DISCARD(category, message) do {} while (0)
+
+#if WATERSIM_LOG_MIN_LEVEL <= 0
+#define WATERSIM_LOG_TRACE(category, message) WATERSIM_LOG(::WaterSim::LogLevel::LOG_TRACE, category, message)
+#else
+#define WATERSIM_LOG_TRACE(category, message) WATERSIM_LOG_DISCARD(category, message)
+#endif
+
+#if WATERSIM_LOG_MIN_LEVEL <= 1
+#define WATERSIM_LOG_DEBUG(category, message) WATERSIM_LOG(::WaterSim::LogLevel::LOG_DEBUG, category, message)
+#else
+#define WATERSIM_LOG_DEBUG(category, message) WATERSIM_LOG_DISCARD(category, message)
+#endif
+
+#if WATERSIM_LOG_MIN_LEVEL <= 2
+#define WATERSIM_LOG_INFO(category, message) WATERSIM_LOG(::WaterSim::LogLevel::LOG_INFO, category, message)
+#else
+#define WATERSIM_LOG_INFO(category, message) WATERSIM_LOG_DISCARD(category, message)
+#endif
+
+#if WATERSIM_LOG_MIN_LEVEL <= 3
+#define WATERSIM_LOG_WARNING(category, message) WATERSIM_LOG(::WaterSim::LogLevel::LOG_WARNING, category, message)
+#else
+#define WATERSIM_LOG_WARNING(category, message) WATERSIM_LOG_DISCARD(category, message)
+#endif
+
+#define WATERSIM_LOG_ERROR(category, message) WATERSIM_LOG(::WaterSim::LogLevel::LOG_ERROR, category, message)
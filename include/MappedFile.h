@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace WaterSim {
+
+// Read-only or read-write memory mapping of a whole file (POSIX mmap / Win32 file mapping)
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+    
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    
+    // Map an existing file for reading
+    bool openRead(const std::string& path);
+    
+    // Create (or truncate) a file of the given size and map it for writing
+    bool create(const std::string& path, size_t size);
+    
+    void close();
+    
+    void* data() const { return data_; }
+    size_t size() const { return size_; }
+    bool isOpen() const { return data_ != nullptr; }
+
+private:
+    void* data_ = nullptr;
+    size_t size_ = 0;
+#ifdef _WIN32
+    void* fileHandle_ = nullptr;
+    void* mappingHandle_ = nullptr;
+#else
+    int fd_ = -1;
+#endif
+};
+
+} // namespace WaterSim
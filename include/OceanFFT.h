@@ -0,0 +1,65 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+// Tessendorf FFT ocean: a wind-driven spectrum of N x N wave vectors over a square, tiling
+// patch, evolved and transformed back to the spatial domain on the GPU every update.
+// Cost is O(N^2 log N) whatever the number of waves, against the per-wave cost of the
+// Gerstner sum. Results are two repeating textures over the patch:
+//   displacement: xyz offset of the surface point (choppy horizontal, height), w Jacobian
+//   normal/foam:  xyz unit normal, w foam from the folding (Jacobian) with temporal decay
+class OceanFFT {
+public:
+    enum class Spectrum { PHILLIPS, JONSWAP };
+
+    struct Settings {
+        int resolution = 256;                 // Power of two, 256 to 1024
+        float patchSize = 32.0f;              // World size of one tile
+        Spectrum spectrum = Spectrum::PHILLIPS;
+        float windSpeed = 8.0f;               // m/s at 10 m
+        glm::vec2 windDirection{1.0f, 0.6f};
+        float fetch = 50000.0f;               // JONSWAP fetch in m
+        float rmsHeight = 0.08f;              // Spectrum scaled to this RMS surface height
+        float choppiness = 1.2f;              // Horizontal displacement scale (Tessendorf's lambda)
+        float foamThreshold = 0.6f;           // Jacobian below which the surface foams
+        float foamDecay = 0.9f;               // Foam kept per update
+    };
+
+    OceanFFT();
+    ~OceanFFT();
+
+    // Loads the kernels and builds the spectrum; false if a kernel failed to compile
+    bool initialize(const Settings& settings);
+
+    // Rebuilds the initial spectrum after a settings change (reallocates on a new resolution)
+    void setSettings(const Settings& settings);
+    const Settings& getSettings() const { return settings_; }
+
+    // Evolves the spectrum to the given time and refreshes both textures
+    void update(float time);
+
+    GLuint getDisplacementTexture() const { return displacementTexture_; }
+    GLuint getNormalFoamTexture() const { return normalFoamTexture_; }
+    float getPatchSize() const { return settings_.patchSize; }
+
+private:
+    void createTextures();
+    void destroyTextures();
+    void buildInitialSpectrum();
+    void runFFT(int direction);
+
+    Settings settings_;
+    bool initialized_ = false;
+
+    // Spectrum h0(k) and conj(h0(-k)) per wave vector, then the evolved spectra: four
+    // complex fields packed two per texel in a two-layer array, ping-ponged by the FFT
+    GLuint initialSpectrumTexture_ = 0;
+    GLuint spectrumTextures_[2] = {0, 0};
+    GLuint displacementTexture_ = 0;
+    GLuint normalFoamTexture_ = 0;
+
+    GLuint spectrumProgram_ = 0;
+    GLuint fftProgram_ = 0;
+    GLuint finalizeProgram_ = 0;
+};
@@ -2,55 +2,139 @@
 
 #include <glad/glad.h>
 #include <glm/glm.hpp>
-#include "Framebuffer.h"
+#include <vector>
 
+// Post-processing of the HDR scene into the bound framebuffer. Bloom runs on a mip chain
+// of its own: a bright pass into half resolution, 13-tap downsamples to the smallest level,
+// then tent-filtered upsamples added back up level by level. Every level is a single
+// fixed-size pass, so the cost does not grow with the bloom radius.
+// Depth of field is a pipeline of its own at half resolution: the circle of confusion from
+// the scene depth, a tile maximum of it, a gather into separate far and near fields (the
+// near one spread by the dilated tile maximum over what is behind it), and a composite
+// over the sharp scene in the final pass. Its targets exist only while it is in use.
+// Volumetric lighting is one fetch per pixel of FroxelVolumetrics' integrated froxels.
+// Everything meets in one final composite, a single read of each input and one write,
+// compiled per combination of enabled effects so that none pays for the others.
 class PostProcessManager {
 public:
     PostProcessManager(int width, int height);
     ~PostProcessManager();
 
-    // Begin/end post-processing pass
-    void beginPostProcess();
-    void endPostProcess();
-    
-    // Apply effects
-    void applyPostProcessing(GLuint inputTexture, GLuint depthTexture = 0);
+    // Apply effects to the currently bound framebuffer. The bloom chain and depth of field
+    // bind their own targets and restore the caller's framebuffer, viewport and blending
+    // before the composite. Depth of field and volumetric lighting need the depth texture.
+    // The ray traced water, when given, is blended over the scene by its alpha
+    void applyPostProcessing(GLuint inputTexture, GLuint depthTexture = 0, GLuint rayTracedTexture = 0);
     
     // Effect toggles
     void setBloomEnabled(bool enabled) { bloomEnabled = enabled; }
     void setDOFEnabled(bool enabled) { dofEnabled = enabled; }
     void setVolumetricLightingEnabled(bool enabled) { volumetricEnabled = enabled; }
+    bool isDOFEnabled() const { return dofEnabled; }
+    bool isBloomEnabled() const { return bloomEnabled; }
+    
+    // Frame budget degradation: skips the bloom chain while it is enabled
+    void setBloomAllowed(bool allowed) { bloomAllowed = allowed; }
     
     // Effect parameters
     void setBloomParams(float threshold, float intensity) { 
         bloomThreshold = threshold; 
         bloomIntensity = intensity; 
     }
+    void setBloomRadius(float radius) { bloomRadius = radius; }
     void setDOFParams(float focusDistance, float focusRange) {
         this->focusDistance = focusDistance;
         this->focusRange = focusRange;
     }
+    float getFocusDistance() const { return focusDistance; }
+    float getFocusRange() const { return focusRange; }
+    
+    // Camera near and far planes the depth texture was rendered with
+    void setDepthRange(float nearPlane, float farPlane) {
+        this->nearPlane = nearPlane;
+        this->farPlane = farPlane;
+    }
+    
+    // FroxelVolumetrics' integrated froxels and the view depth of its first and last
+    // slice; 0 leaves out volumetric lighting
+    void setVolumetricFroxels(GLuint texture, float nearDepth, float farDepth) {
+        froxelTexture = texture;
+        froxelNear = nearDepth;
+        froxelFar = farDepth;
+    }
     
     // Resize
     void resize(int width, int height);
 
+    int getBloomLevelCount() const { return static_cast<int>(bloomMips.size()); }
+
 private:
-    Framebuffer* postProcessFBO;
-    GLuint postProcessShader;
+    struct BloomMip {
+        GLuint texture = 0;
+        GLuint fbo = 0;
+        int width = 0, height = 0;
+    };
+    
+    std::vector<BloomMip> bloomMips;    // Half resolution first
+    // Final composite by effect combination (COMPOSITE_ bits), 0 until first used
+    enum CompositeEffect : unsigned int {
+        COMPOSITE_BLOOM = 1,
+        COMPOSITE_DOF = 2,
+        COMPOSITE_VOLUMETRIC = 4,
+        COMPOSITE_RAY_TRACED = 8,
+        COMPOSITE_VARIANTS = 16
+    };
+    GLuint compositeShaders[COMPOSITE_VARIANTS] = {};
+    GLuint bloomDownsampleShader = 0;
+    GLuint bloomUpsampleShader = 0;
+    
+    // Depth of field: half-resolution color with signed CoC, per-tile CoC maxima, and the
+    // far and near fields gathered from them
+    GLuint dofHalfTexture = 0, dofTileTexture = 0, dofFarTexture = 0, dofNearTexture = 0;
+    GLuint dofHalfFBO = 0, dofTileFBO = 0, dofGatherFBO = 0;
+    int dofWidth = 0, dofHeight = 0;
+    int dofTilesX = 0, dofTilesY = 0;
+    GLuint dofPrepareShader = 0;
+    GLuint dofTileShader = 0;
+    GLuint dofGatherShader = 0;
     GLuint quadVAO, quadVBO;
     
     int width, height;
     
     // Effect parameters
     bool bloomEnabled = true;
+    bool bloomAllowed = true;
     bool dofEnabled = false;
-    bool volumetricEnabled = false;  // Disable volumetric lighting to reduce brightness
+    bool volumetricEnabled = true;
     
     float bloomThreshold = 2.0f;    // Higher threshold = less bloom
     float bloomIntensity = 0.2f;    // Much lower intensity
+    float bloomRadius = 1.0f;       // Upsample tent radius in texels of the smaller level
     float focusDistance = 10.0f;
     float focusRange = 5.0f;
+    float nearPlane = 0.1f;
+    float farPlane = 100.0f;
+    GLuint froxelTexture = 0;
+    float froxelNear = 0.5f;
+    float froxelFar = 40.0f;
+    
+    // Smallest level is at least this many pixels on a side
+    static constexpr int MAX_BLOOM_LEVELS = 6;
+    static constexpr int MIN_BLOOM_LEVEL_SIZE = 8;
+    
+    // Largest blur radius in half-resolution pixels; the 3x3 tile dilation covers it as
+    // long as it is at most the tile size (TILE_SIZE of dof_tiles.fs and dof_gather.fs)
+    static constexpr int DOF_TILE_SIZE = 8;
+    static constexpr float DOF_MAX_COC = 8.0f;
     
     void setupQuad();
     void loadShaders();
+    GLuint compositeShader(unsigned int effects);
+    void createBloomChain();
+    void destroyBloomChain();
+    void renderBloom(GLuint inputTexture);
+    void createDOFTargets();
+    void destroyDOFTargets();
+    void setCoCUniforms(GLuint program);
+    void renderDOF(GLuint inputTexture, GLuint depthTexture);
 };
\ No newline at end of file
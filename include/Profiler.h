@@ -0,0 +1,141 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace WaterSim {
+
+// Scoped CPU and GPU markers with a rolling history of frames. A ProfileScope records the
+// CPU time between its construction and destruction and, on the thread that runs the
+// frames, a GL timestamp on each side, inside a glPushDebugGroup of the same name so
+// capture tools show the regions too. Scopes on other threads get CPU time only, on a
+// track of their own thread.
+//
+// GPU results are read back a few frames late; a frame joins the history once they are in.
+// Only when the GPU falls more than QUERY_FRAMES behind does beginFrame wait for the oldest.
+class Profiler {
+public:
+    struct Marker {
+        std::string name;
+        int track = 0;                  // 0: the frame thread, then other threads in first-seen order
+        int depth = 0;                  // Nesting within the track
+        double cpuStartMs = 0.0;        // From the frame's start
+        double cpuEndMs = 0.0;
+        double gpuStartMs = -1.0;       // From the frame's first timestamp; negative if untimed
+        double gpuEndMs = -1.0;
+    };
+
+    struct Frame {
+        uint64_t index = 0;
+        double cpuMs = 0.0;             // beginFrame to endFrame
+        double gpuMs = -1.0;            // First to last timestamp; negative if untimed
+        std::vector<Marker> markers;    // In begin order
+    };
+
+    static Profiler& instance();
+
+    // Timing runs while the panel wants it or the GPU slices are traced (TraceRecorder).
+    // Off: scopes only label their debug group and trace their CPU slice. Needs the
+    // context current when it changes
+    void setEnabled(bool enable);
+    bool isEnabled() const { return panelEnabled_; }
+    void setTracing(bool enable);
+    bool isTracing() const { return tracing_; }
+
+    // Paused: frames keep being timed but the history stops changing, to inspect a spike
+    void setPaused(bool pause) { paused_ = pause; }
+    bool isPaused() const { return paused_; }
+
+    // Around everything the frame thread does per frame; endFrame also reads back the
+    // oldest frame whose GPU timestamps have landed
+    void beginFrame();
+    void endFrame();
+
+    // Oldest first
+    const std::deque<Frame>& getHistory() const { return history_; }
+    std::vector<std::string> getTrackNames();
+
+    // Deletes the queries; call while the context is still current
+    void shutdown();
+
+    static constexpr size_t HISTORY_FRAMES = 240;
+
+private:
+    friend class ProfileScope;
+
+    // One frame's open and closed markers and the timestamps they use
+    struct FrameSlot {
+        Frame frame;
+        std::vector<GLuint> queries;
+        std::vector<int> markerStartQuery;      // Per marker; -1 if untimed
+        std::vector<int> markerEndQuery;
+        size_t usedQueries = 0;
+        bool pending = false;                   // Ended, waiting for its results
+    };
+
+    Profiler() = default;
+
+    int beginMarker(const char* name, uint64_t& frame);
+    void endMarker(int marker, uint64_t frame);
+    void updateActive();
+    int issueTimestamp(FrameSlot& slot);
+    bool readBack(FrameSlot& slot, bool wait);
+    int trackOf(std::thread::id thread);
+    double sinceFrameStart() const;
+
+    std::atomic<bool> active_{false};
+    bool panelEnabled_ = false;
+    bool tracing_ = false;
+    bool paused_ = false;
+    bool inFrame_ = false;                      // Under the lock
+    uint64_t frameIndex_ = 0;
+    std::atomic<std::thread::id> frameThread_{};
+    std::chrono::steady_clock::time_point frameStart_;
+    int64_t frameStartTraceNs_ = 0;
+    
+    // GPU timestamp minus TraceRecorder::now(), measured every CLOCK_SYNC_FRAMES
+    int64_t gpuClockOffset_ = 0;
+    uint64_t clockSyncFrame_ = 0;
+    bool clockSynced_ = false;
+    static constexpr uint64_t CLOCK_SYNC_FRAMES = 120;
+
+    static constexpr int QUERY_FRAMES = 4;
+    FrameSlot slots_[QUERY_FRAMES];
+    int slot_ = 0;
+    int frameDepth_ = 0;                        // Open markers on the frame thread
+
+    // Other threads' markers land under the lock
+    std::mutex mutex_;
+    std::vector<std::thread::id> trackThreads_;
+    std::vector<std::string> trackNames_;
+
+    std::deque<Frame> history_;
+};
+
+// RAII marker. Cheap when the profiler is off: one debug group push and pop on the frame
+// thread and a trace slice. name must outlive the scope
+class ProfileScope {
+public:
+    explicit ProfileScope(const char* name);
+    explicit ProfileScope(const std::string& name) : ProfileScope(name.c_str()) {}
+    ~ProfileScope();
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    const char* name_;
+    int64_t startNs_ = -1;      // Trace clock; negative when not traced
+    int marker_ = -1;
+    uint64_t frame_ = 0;
+    bool debugGroup_ = false;
+};
+
+} // namespace WaterSim
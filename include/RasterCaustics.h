@@ -0,0 +1,79 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include "GLResources.h"
+#include "WaterSurface.h"
+
+namespace WaterSim {
+
+// Floor caustics of the raster path, from the waves as they are this frame. A flat grid in
+// the light's view of the surface takes its heights and slopes from the surface's textures
+// (the Gerstner height map, the wave-equation heightfield and the FFT ocean), refracts the
+// light at each vertex and splats its triangles onto a low-resolution floor-space map with
+// additive blending: rt_caustic_map.vs/.fs, shared with the ray tracer's caustic map, give
+// each the irradiance it brings relative to a flat surface, so the map is 1 under calm
+// water. water.fs samples it where its refracted rays reach the floor; the walls keep the
+// scrolled caustic texture. The CPU mesh's own displacement is not in any texture, so only
+// the waves those carry show. Context thread only.
+class RasterCaustics {
+public:
+    struct Settings {
+        bool enabled = true;
+        int resolution = 256;               // Map texels per side; the grid has half as many vertices
+        int interval = 1;                   // Frames between redraws
+    };
+
+    RasterCaustics() = default;
+    ~RasterCaustics();
+
+    RasterCaustics(const RasterCaustics&) = delete;
+    RasterCaustics& operator=(const RasterCaustics&) = delete;
+
+    // Submits the splat program
+    void initialize();
+
+    // Another resolution is allocated at the next draw
+    void setSettings(const Settings& settings);
+    const Settings& getSettings() const { return settings_; }
+
+    // Once per frame, active while the raster path shows the floor: whether draw() redraws
+    // the map this frame, allocated by then. An inactive frame drops the map, so it is
+    // redrawn before use
+    bool beginFrame(bool active);
+
+    // The surface as WaterSurface::getGeometry() gives it, with the frame's Gerstner height
+    // map; the light travels along lightDirection toward a floor at floorLevel
+    void draw(const WaterSurfaceGeometry& surface, const glm::vec3& lightDirection, float floorLevel);
+
+    // 0 before the first allocation; holds a map once isDrawn()
+    GLuint getTexture() const { return mapTexture_.get(); }
+    bool isDrawn() const { return drawn_; }
+    int getResolution() const { return mapSize_; }
+    float getExtent() const { return extent_; }
+
+    // water.fs's causticMap uniforms, off until there is a map; the map goes on textureUnit
+    void applyToReceiver(const GLShaderProgram& program, int textureUnit) const;
+
+private:
+    void allocate();
+    void buildGrid(int resolution);
+
+    Settings settings_;
+    GLShaderProgram splatProgram_;          // rt_caustic_map.vs/.fs
+    GLTexture2D mapTexture_;
+    GLFramebuffer mapBuffer_;
+    int mapSize_ = 0;
+    bool drawn_ = false;
+    float extent_ = 10.0f;                  // World size of the square floor area the map covers
+    int framesSinceDraw_ = 0;
+    bool due_ = false;
+
+    GLVertexArray gridArray_;
+    GLBuffer gridVertices_;
+    GLBuffer gridIndices_;
+    int gridResolution_ = 0;
+    GLsizei gridIndexCount_ = 0;
+};
+
+} // namespace WaterSim
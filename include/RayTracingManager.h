@@ -2,9 +2,12 @@
 
 #include <glm/glm.hpp>
 #include <memory>
+#include <string>
 #include <vector>
 #include "GLResources.h"
 #include "Config.h"
+#include "ComputeAutotuner.h"
+#include "WaterSurface.h"
 
 namespace WaterSim {
 
@@ -14,7 +17,15 @@ enum class RayTracingQuality {
     LOW = 1,        // 1/4 resolution, 1 ray per pixel
     MEDIUM = 2,     // 1/2 resolution, 1 ray per pixel  
     HIGH = 3,       // Full resolution, 1 ray per pixel
-    ULTRA = 4       // Full resolution, 4 rays per pixel (supersampling)
+    ULTRA = 4,      // Full resolution, adaptive reflection rays where the surface varies (up to 4 per pixel)
+    CHECKERBOARD = 5,       // 1/2 resolution, half the pixels traced per frame, the rest reprojected
+    INTERLEAVED_2X2 = 6     // 1/2 resolution, one pixel of each 2x2 traced per frame
+};
+
+// Reconstruction of the traced result at screen resolution (upsampleToFullResolution)
+enum class RayTracingUpsampler {
+    BILINEAR = 0,   // 4 taps and an unconditional sharpen
+    EDGE_AWARE      // EASU-style, guided by full-resolution water depth and normals, then RCAS
 };
 
 // Ray tracing feature flags
@@ -25,6 +36,35 @@ struct RayTracingFeatures {
     bool volumetricLighting = false;
     bool softShadows = true;
     bool globalIllumination = false;
+    bool temporalDenoise = true;    // Accumulate over frames and filter before compositing
+    bool fusedKernel = false;       // Reflect, refract and composite in one dispatch (rt_fused.cs)
+    int causticInterval = 2;        // Frames between caustic traces with the fused kernel
+    bool compactGBuffer = true;     // Positions rebuilt from depth, octahedral RG16 normals
+    RayTracingUpsampler upsampler = RayTracingUpsampler::EDGE_AWARE;
+    bool causticMap = true;         // Floor-space photon map instead of 64 rays per pixel
+    int causticMapInterval = 4;     // Frames between caustic map refreshes, 0 only when the surface changes
+    int adaptiveMaxSamples = 4;     // ULTRA: reflection rays per pixel at most (rt_adaptive_sampling.glsl)
+    float adaptiveSampleBudget = 0.75f; // ULTRA: extra rays per traced pixel, on average over the frame
+};
+
+// Where the G-buffer's water surface comes from
+enum class RayTracingSurface {
+    WATER_GRID = 0,     // The grid of setWaterSurface, rasterized
+    FLUID_DEPTH,        // A screen-space fluid depth target of the traced camera, resolved as is
+    FLUID_MESH          // A GPU-extracted fluid mesh (SPHComputeSystem::getSurfaceMeshBuffer)
+};
+
+// GPU passes of RayTracingManager::renderWaterRayTraced, timed separately
+enum class RayTracingPass {
+    GBUFFER = 0,
+    DEPTH_PYRAMID,
+    REFLECTIONS,
+    REFRACTIONS,
+    CAUSTICS,
+    DENOISE,
+    COMPOSITE,          // The fused kernel, reflections and refractions included, when on
+    UPSAMPLE,
+    COUNT
 };
 
 class RayTracingManager {
@@ -43,29 +83,88 @@ public:
     // Quality and feature control
     void setQuality(RayTracingQuality quality);
     void setFeatures(const RayTracingFeatures& features);
+    const RayTracingFeatures& getFeatures() const { return features_; }
     RayTracingQuality getQuality() const { return quality_; }
     
-    // Performance monitoring
+    // Dynamic resolution: the traced resolution follows the measured GPU time to hold a
+    // budget of milliseconds per frame, between 1/4 and full screen resolution (0 keeps the
+    // quality's fixed resolution)
+    void setFrameBudget(float milliseconds);
+    float getFrameBudget() const { return frameBudgetMs_; }
+    float getResolutionScale() const { return screenWidth_ > 0 ? static_cast<float>(rtWidth_) / screenWidth_ : 0.0f; }
+    
+    // Frame budget degradation: scales the quality's fixed resolution, or caps the dynamic
+    // one at that fraction of the screen, inside the allocated textures (between 1/4 and 1)
+    void setBudgetScale(float scale);
+    float getBudgetScale() const { return budgetScale_; }
+    
+    // Performance monitoring: GPU milliseconds from timestamp queries, a few frames behind
     float getLastFrameTime() const { return lastFrameTime_; }
     int getRaysPerSecond() const { return raysPerSecond_; }
+    float getPassTime(RayTracingPass pass) const { return passTimes_[static_cast<int>(pass)]; }
+    // ULTRA's adaptive sampling in the same measured frame: rays traced beyond one per
+    // pixel, and the pixels that asked for more
+    int getAdaptiveSamples() const { return adaptiveSamples_; }
+    int getAdaptiveTexels() const { return adaptiveTexels_; }
+    static const char* getPassName(RayTracingPass pass);
     
     // Screen space settings
     void resize(int width, int height);
     
-    // Water surface data input
-    void updateWaterSurface(const std::vector<glm::vec3>& vertices,
-                           const std::vector<glm::vec3>& normals);
-    
     // Result texture for compositing
     GLuint getRayTracedTexture() const { return finalTexture_.get(); }
     GLuint getReflectionTexture() const { return reflectionTexture_.get(); }
     GLuint getRefractionTexture() const { return refractionTexture_.get(); }
     GLuint getCausticTexture() const { return causticTexture_.get(); }
     
-    // Set water geometry for G-buffer rendering
-    void setWaterGeometry(GLuint waterVAO, int vertexCount) {
-        waterVAO_ = waterVAO;
-        waterVertexCount_ = vertexCount;
+    // The water grid the G-buffer and caustic map draw, the surface's own buffers and
+    // textures by handle (WaterSurface::getGeometry). Set every frame: the vertex ring slot
+    // and the heightfield's texture change; the caustic map is redone when the shape does
+    void setWaterSurface(const WaterSurfaceGeometry& geometry) {
+        causticMapDirty_ |= geometry.vao != water_.vao || geometry.indexCount != water_.indexCount ||
+                            geometry.baseVertex != water_.baseVertex || geometry.packedVertices != water_.packedVertices ||
+                            geometry.size != water_.size || geometry.flatGrid != water_.flatGrid ||
+                            geometry.oceanDisplacement != water_.oceanDisplacement ||
+                            geometry.oceanPatchSize != water_.oceanPatchSize ||
+                            (geometry.heightfield != 0) != (water_.heightfield != 0) ||
+                            surfaceSource_ != RayTracingSurface::WATER_GRID;
+        surfaceSource_ = RayTracingSurface::WATER_GRID;
+        water_ = geometry;
+    }
+    
+    // SPH fluid surfaces the G-buffer is filled from instead of the water grid: the smoothed
+    // window depth of the screen-space pipeline, drawn this frame with the traced camera, or
+    // the marching cubes mesh buffer (draw command at offset 0, then position/normal pairs)
+    void setFluidDepthSurface(GLuint depthTexture) {
+        surfaceSource_ = RayTracingSurface::FLUID_DEPTH;
+        fluidDepthTexture_ = depthTexture;
+    }
+    void setFluidMeshSurface(GLuint meshBuffer) {
+        surfaceSource_ = RayTracingSurface::FLUID_MESH;
+        fluidMeshBuffer_ = meshBuffer;
+    }
+    RayTracingSurface getSurfaceSource() const { return surfaceSource_; }
+    
+    // World-space stand-ins for geometry off screen (rt_world_trace.glsl): the glass
+    // container's box, whose floor reflections can hit, and the sphere
+    void setSceneProxies(const glm::vec3& boxMin, const glm::vec3& boxMax,
+                         const glm::vec3& sphereCenter, float sphereRadius, const glm::vec3& sphereColor) {
+        proxyBoxMin_ = boxMin;
+        proxyBoxMax_ = boxMax;
+        proxySphere_ = glm::vec4(sphereCenter, sphereRadius);
+        proxySphereColor_ = sphereColor;
+        proxiesSet_ = true;
+    }
+    
+    // Sky for reflection rays that miss everything; its mip 0 is sampled, so the
+    // prefiltered environment of Skybox serves as well as the plain cubemap
+    void setEnvironmentMap(GLuint cubemap) { environmentMap_ = cubemap; }
+    
+    // Window rate image of ShadingRateImage: the composite, or the fused kernel, shades a
+    // coarse tile's blocks once each (rt_coarse_shading.glsl). 0 shades every texel
+    void setShadingRateImage(GLuint texture, int tileSize) {
+        shadingRateTexture_ = texture;
+        shadingRateTile_ = tileSize;
     }
     
 private:
@@ -77,6 +176,14 @@ private:
     int screenWidth_, screenHeight_;
     int rtWidth_, rtHeight_;  // Ray tracing resolution
     
+    // Size the ray tracing textures are allocated at: the largest the current mode traces,
+    // so dynamic resolution narrows the viewport into them instead of reallocating
+    int allocWidth_ = 0, allocHeight_ = 0;
+    float frameBudgetMs_ = 0.0f;
+    float resolutionScale_ = 0.5f;     // Of the screen, before snapping to RESOLUTION_STEPS
+    float budgetScale_ = 1.0f;         // setBudgetScale
+    static constexpr int RESOLUTION_STEPS = 32;
+    
     // GPU resources
     GLTexture2D rayTracedTexture_;
     GLTexture2D finalTexture_;  // Full resolution output
@@ -88,13 +195,115 @@ private:
     GLTexture2D causticTexture_;
     GLFramebuffer gBuffer_;
     
+    // Water depth and octahedral normals at screen resolution, guiding the edge-aware
+    // upsample (rt_upsample.cs); upsampledTexture_ holds it until RCAS (rt_sharpen.cs)
+    GLFramebuffer guideBuffer_;
+    GLTexture2D guideDepthTexture_;
+    GLTexture2D guideNormalTexture_;
+    GLTexture2D upsampledTexture_;
+    
+    // Min-max depth pyramid over the G-buffer (rt_hiz_build.cs), traced by the reflection
+    // and refraction kernels (rt_hiz_trace.glsl)
+    GLTexture2D hiZTexture_;
+    int hiZLevels_ = 0;
+    GLShaderProgram hiZBuildShader_;
+    
+    // Scene proxies of setSceneProxies
+    glm::vec3 proxyBoxMin_{0.0f};
+    glm::vec3 proxyBoxMax_{0.0f};
+    glm::vec4 proxySphere_{0.0f};
+    glm::vec3 proxySphereColor_{0.0f};
+    bool proxiesSet_ = false;
+    GLuint environmentMap_ = 0;
+    
+    // Rate image of setShadingRateImage
+    GLuint shadingRateTexture_ = 0;
+    int shadingRateTile_ = 16;
+    
+    // Camera of the frame being traced
+    glm::mat4 viewMatrix_{1.0f};
+    glm::mat4 projectionMatrix_{1.0f};
+    
+    // Temporal accumulation (rt_temporal.cs) and à-trous filtering (rt_atrous.cs) of the
+    // traced signals, reprojected through the G-buffer into the previous frame
+    enum DenoisedSignal {
+        SIGNAL_REFLECTION = 0,
+        SIGNAL_REFRACTION,
+        SIGNAL_CAUSTICS,
+        SIGNAL_COUNT
+    };
+    struct SignalHistory {
+        GLTexture2D color[2];           // Filtered colour, variance in alpha
+        GLTexture2D moments[2];         // Luminance moments, history length, clip w
+        int index = 0;                  // Which of each pair the next denoise writes
+        bool valid = false;
+        glm::mat4 viewProjection{1.0f}; // Camera and traced size the history was made at,
+        glm::ivec2 resolution{0};       // which may be frames back for low-rate caustics
+    };
+    SignalHistory histories_[SIGNAL_COUNT];
+    GLTexture2D denoiseTexture_;        // Scratch between the filter passes
+    bool causticsTraced_ = false;       // causticTexture_ was traced this frame
+    unsigned int frameIndex_ = 0;
+    GLShaderProgram temporalShader_;
+    GLShaderProgram atrousShader_;
+    
+    // Interleaved tracing (rt_interleave.glsl): the texels a frame skips, reprojected from the
+    // signal's last complete frame where the G-buffer saw the same surface (rt_interleave.cs)
+    struct InterleaveHistory {
+        GLTexture2D color;              // The last complete frame
+        GLTexture2D clipW[2];           // Per texel, 0 for no water; the last one at index
+        int index = 0;
+        bool valid = false;
+        glm::mat4 viewProjection{1.0f};
+        glm::ivec2 resolution{0};
+        unsigned int frame = 0;         // Reconstructions so far, stepping the pattern
+    };
+    InterleaveHistory interleaveHistories_[SIGNAL_COUNT];
+    GLShaderProgram interleaveShader_;
+    
+    // Floor-space caustic map: the water grid splatted as refracted photon triangles
+    // (rt_caustic_map.vs/.fs), blended into the map over refreshes (rt_caustic_blend.cs)
+    // and looked up per traced texel by rt_caustics.cs
+    GLFramebuffer causticMapBuffer_;
+    GLTexture2D causticSplatTexture_;
+    GLTexture2D causticMapTexture_;
+    GLShaderProgram causticMapShader_;
+    GLShaderProgram causticBlendShader_;
+    int causticMapSize_ = 0;
+    bool causticMapDirty_ = true;       // Inputs changed: the next refresh replaces the map
+    unsigned int causticMapFrame_ = 0;  // frameIndex_ of the last refresh
+    
     // Water geometry for G-buffer rendering
-    GLuint waterVAO_ = 0;
-    int waterVertexCount_ = 0;
+    WaterSurfaceGeometry water_;
     
     // G-buffer shader
     GLShaderProgram gBufferShader_;
     
+    // SPH fluid surface sources (rt_gbuffer_depth.fs, rt_gbuffer_mesh.vs)
+    RayTracingSurface surfaceSource_ = RayTracingSurface::WATER_GRID;
+    GLuint fluidDepthTexture_ = 0;
+    GLuint fluidMeshBuffer_ = 0;
+    GLuint emptyVAO_ = 0;           // Attribute-less draws: the fullscreen triangle, the pulled mesh
+    GLShaderProgram gBufferDepthShader_;
+    GLShaderProgram gBufferMeshShader_;
+    
+    // Ray tracing compute kernels (index into localSizes_)
+    enum RayTracingKernel {
+        RT_REFLECTION = 0,
+        RT_REFRACTION,
+        RT_CAUSTICS,
+        RT_COMPOSITE,
+        RT_UPSAMPLE,
+        RT_FUSED,
+        RT_SHARPEN,
+        RT_KERNEL_COUNT
+    };
+    
+    // Workgroup sizes, from the per-GPU autotune cache or tuned on the first traced frame
+    glm::ivec2 localSizes_[RT_KERNEL_COUNT];
+    std::unique_ptr<ComputeAutotuner> autotuner_;
+    bool autotuned_ = false;
+    
     // Ray tracing compute shaders
     GLShaderProgram rayGenShader_;
     GLShaderProgram reflectionShader_;
@@ -102,28 +311,87 @@ private:
     GLShaderProgram causticShader_;
     GLShaderProgram compositingShader_;
     GLShaderProgram upsampleShader_;
+    GLShaderProgram fusedShader_;
+    GLShaderProgram sharpenShader_;
     
-    // Water surface data
-    GLBuffer waterVertexBuffer_{GL_ARRAY_BUFFER};
-    GLBuffer waterNormalBuffer_{GL_ARRAY_BUFFER};
-    GLTexture2D heightMapTexture_;
-    GLTexture2D normalMapTexture_;
-    
-    // Performance tracking
+    // Performance tracking: a ring of GL_TIMESTAMP queries at every pass boundary, read
+    // back once available so the CPU never waits on the GPU
+    static constexpr int TIMER_FRAMES = 4;
+    static constexpr int PASS_COUNT = static_cast<int>(RayTracingPass::COUNT);
     float lastFrameTime_;
     int raysPerSecond_;
-    GLuint timeQuery_;
+    float passTimes_[PASS_COUNT] = {};
+    GLuint timestampQueries_[TIMER_FRAMES][PASS_COUNT + 1] = {};
+    bool timerPending_[TIMER_FRAMES] = {};
+    int timerRays_[TIMER_FRAMES] = {};
+    int timerPixels_[TIMER_FRAMES] = {};
+    int timedPixels_ = 0;       // Traced pixels of the frame lastFrameTime_ measured
+    
+    // Adaptive sampling (rt_adaptive_sampling.glsl): the tiled blue noise, the GPU counters of
+    // the extra rays and the texels asking for them, cleared every frame and copied into a
+    // persistently mapped slot of the timed frame, read with its timestamps
+    GLTexture2D blueNoiseTexture_;
+    GLuint sampleCounterBuffer_ = 0;
+    GLuint sampleReadbackBuffer_ = 0;
+    const uint32_t* sampleReadback_ = nullptr;     // Two counters per timer slot
+    uint32_t timerSampleBudget_[TIMER_FRAMES] = {};
+    int adaptiveSamples_ = 0;
+    int adaptiveTexels_ = 0;
+    int timerSlot_ = 0;
+    bool timing_ = false;       // This frame's passes are being timed
     
     // Private methods
     void createRayTracingShaders();
     void createFramebuffers();
     void updateResolution();
-    void renderGBuffer(const glm::mat4& view, const glm::mat4& projection);
+    void applyResolutionScale();
+    void updateDynamicResolution();
+    void renderGBuffer(const glm::mat4& view, const glm::mat4& projection,
+                       GLFramebuffer& target, int width, int height, bool compact);
+    void buildHiZ();
+    void bindSurfaceHeights(const GLShaderProgram& program) const;  // Heights the water grid does not carry
+    void setCameraUniforms(const GLShaderProgram& shader) const;
+    void setSceneProxyUniforms(const GLShaderProgram& shader) const;
+    void setCoarseShadingUniforms(const GLShaderProgram& shader) const;  // Binds the rate image on unit 7
+    int traceIterations() const;
+    int interleavePhases() const;   // Patterns per complete frame: 1, 2 or 4
+    void setInterleaveUniforms(const GLShaderProgram& shader, int signal) const;
+    // Binds the blue noise on unit 8 and the counters; ULTRA only traces more than one ray
+    void setAdaptiveSamplingUniforms(const GLShaderProgram& shader) const;
+    void createAdaptiveSampling();
+    uint32_t sampleBudget() const;      // Extra rays this frame may trace, 0 off ULTRA
+    void dispatchInterleaved(int kernel) const;
+    void reconstructInterleaved(int signal, GLTexture2D& texture);
     void traceReflections(const glm::vec3& cameraPos, const glm::vec3& lightPos);
     void traceRefractions(const glm::vec3& cameraPos);
     void traceCaustics(const glm::vec3& lightPos);
+    bool useCausticMap() const {
+        return features_.causticMap && surfaceSource_ == RayTracingSurface::WATER_GRID &&
+               causticMapShader_.isValid() && causticBlendShader_.isValid();
+    }
+    bool hasWaterSurface() const;
+    void updateCausticMap();
+    void denoiseResults();
+    int denoiseIterations() const;
     void compositeResults(const glm::vec3& cameraPos);
+    void traceFused(const glm::vec3& cameraPos, const glm::vec3& lightPos);
+    bool useFusedKernel() const { return features_.fusedKernel && fusedShader_.isValid(); }
+    void invalidateHistories();
     void upsampleToFullResolution();
+    void sharpenUpsampled();
+    bool readBackTimers();
+    void markPassEnd(RayTracingPass pass);
+    
+    // The pass's declared traffic to the GPUMemoryTracker: the targets it binds, at the traced size
+    void recordTraffic(RayTracingPass pass) const;
+    
+    // Compute kernel variants and workgroup autotuning
+    GLuint loadKernel(int kernel, const glm::ivec2& localSize) const;
+    std::string gBufferSource() const;
+    GLShaderProgram& kernelProgram(int kernel);
+    void dispatchKernel(int kernel, int width, int height) const;
+    void autotuneKernels(const glm::mat4& view, const glm::mat4& projection,
+                         const glm::vec3& cameraPos, const glm::vec3& lightPos);
     
     // RTX hardware acceleration (if available)
     bool initializeRTX();
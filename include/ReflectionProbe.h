@@ -0,0 +1,90 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include "GLResources.h"
+
+namespace WaterSim {
+
+// Box-projected cubemap probe of the far field the water reflects: the sky and whatever
+// stands in the container around it. The water shader corrects each reflected direction for
+// parallax against the probe's box (the container, open to the sky) before the lookup, and
+// blends the result with the planar reflection by the surface point's distance from the
+// camera and the roughness, so the planar targets only need the near-field geometry.
+//
+// The faces refresh one per frame: in round robin with continuous updates, otherwise only
+// while the scene differs from what they were drawn from (probe moved, sphere moved past a
+// threshold, sky changed), so a still scene costs nothing. The mips, sampled by roughness,
+// are rebuilt once a cycle of faces is complete. Until the first cycle is, setUniforms
+// leaves the probe disabled and the water reflects the plain sky. Render thread only.
+class ReflectionProbe {
+public:
+    struct Settings {
+        bool enabled = true;
+        int resolution = 128;           // Texels per face edge of mip 0
+        bool continuous = false;        // Round robin every frame, changed or not
+        float sphereThreshold = 0.05f;  // World units the sphere moves before the faces redraw
+        float nearDistance = 6.0f;      // Planar reflection alone up to here from the camera,
+        float farDistance = 16.0f;      // the probe alone past here
+    };
+
+    ReflectionProbe() = default;
+    ~ReflectionProbe() = default;
+
+    ReflectionProbe(const ReflectionProbe&) = delete;
+    ReflectionProbe& operator=(const ReflectionProbe&) = delete;
+
+    // Picks the face that refreshes this frame, after (re)allocating the cubemap if its size
+    // changed. skyTexture is the cubemap behind the scene, to notice it being swapped.
+    // Call once per frame before the passes
+    void beginFrame(const glm::vec3& position, const glm::vec3& boxMin, const glm::vec3& boxMax,
+                    const glm::vec3& spherePosition, GLuint skyTexture);
+    bool needsUpdate() const { return face_ >= 0; }
+
+    // Binds the face's framebuffer and clears it; the caller draws the sky and scene through
+    // getFaceView() and getFaceProjection() in between
+    void beginFaceRender();
+    void endFaceRender();
+    glm::mat4 getFaceView() const;
+    glm::mat4 getFaceProjection() const;
+
+    // Bind the cubemap on textureUnit and set reflectionProbeEnabled, reflectionProbe,
+    // probePosition, probeBoxMin, probeBoxMax, probeMaxLod and probeBlendDistance of the
+    // program in use (see water.fs)
+    void setUniforms(const GLShaderProgram& program, int textureUnit) const;
+
+    GLuint getTexture() const { return cubemap_.get(); }
+    bool isValid() const { return valid_; }
+    int getResolution() const { return resolution_; }
+    int getFacesUpdated() const { return facesUpdated_; }   // This frame, 0 or 1
+
+    Settings& getSettings() { return settings_; }
+
+private:
+    static constexpr int FACE_COUNT = 6;
+    static constexpr unsigned ALL_FACES = (1u << FACE_COUNT) - 1;
+
+    bool allocate();
+    int mipLevels() const;
+
+    Settings settings_;
+    GLTexture cubemap_;                 // RGBA16F with mips
+    GLTexture2D depth_;
+    GLFramebuffer framebuffer_;
+    int resolution_ = 0;
+
+    // What the faces were drawn from
+    glm::vec3 position_ = glm::vec3(0.0f);
+    glm::vec3 boxMin_ = glm::vec3(0.0f);
+    glm::vec3 boxMax_ = glm::vec3(0.0f);
+    glm::vec3 spherePosition_ = glm::vec3(0.0f);
+    GLuint skyTexture_ = 0;
+
+    unsigned staleFaces_ = ALL_FACES;   // Bit per face still showing an older scene
+    int nextFace_ = 0;                  // Round robin position
+    int face_ = -1;                     // Refreshing this frame, -1 for none
+    int facesUpdated_ = 0;
+    bool valid_ = false;                // Every face drawn at least once
+};
+
+} // namespace WaterSim
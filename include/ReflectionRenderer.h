@@ -3,41 +3,135 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
-#include "Framebuffer.h"
 #include "Camera.h"
 
+enum PlanarTarget {
+    PLANAR_REFLECTION = 0,
+    PLANAR_REFRACTION = 1,
+    PLANAR_TARGET_COUNT
+};
+
+// Planar reflection and refraction targets of the water surface. Each renders at a fraction
+// of the window and is refreshed only every few frames, or sooner once the camera, sphere or
+// water level move past a threshold. In between, the water shader reprojects the last
+// refresh through its view-projection (getViewProjection). With layered rendering both
+// targets are layers of one texture array, drawn in a single pass by a geometry shader.
+//
+// The targets persist across frames, so the frame graph imports them rather than owning them.
 class ReflectionRenderer {
 public:
+    struct TargetSettings {
+        float resolutionScale = 0.5f;   // Of the window: 1, 1/2 or 1/4
+        int updateInterval = 2;         // Frames between refreshes; 1 refreshes every frame
+    };
+
+    // Motion since the last refresh that forces the next one early
+    struct UpdateThresholds {
+        float cameraDistance = 0.1f;    // World units
+        float cameraAngle = 2.0f;       // Degrees of view direction
+        float sphereDistance = 0.05f;   // World units
+    };
+
     ReflectionRenderer(int width, int height);
     ~ReflectionRenderer();
 
+    // Picks the targets that refresh this frame, after (re)allocating them if their size or
+    // layout changed. Call once per frame before the passes
+    void beginFrame(const Camera& camera, float waterLevel, const glm::vec3& spherePosition);
+    bool needsUpdate(PlanarTarget target) const { return targets[target].updating; }
+    bool isLayeredUpdate() const { return layeredActive && targets[PLANAR_REFLECTION].updating; }
+
     // Begin/end reflection rendering
     void beginReflectionRender(const Camera& camera, float waterLevel = 0.0f);
     void endReflectionRender();
-    
+
     // Begin/end refraction rendering
     void beginRefractionRender(const Camera& camera, float waterLevel = 0.0f);
     void endRefractionRender();
-    
+
+    // Both targets at once, layer 0 reflection and layer 1 refraction
+    void beginLayeredRender(const Camera& camera, float waterLevel = 0.0f);
+    void endLayeredRender();
+
+    // Camera of a target: mirrored across the water plane for the reflection
+    glm::mat4 getTargetView(PlanarTarget target, const Camera& camera, float waterLevel) const;
+    glm::mat4 getProjection(const Camera& camera) const;
+
+    // World-space plane keeping the geometry on the target's side of the water
+    glm::vec4 getClipPlane(PlanarTarget target, float waterLevel) const;
+
     // Get texture IDs for binding to water shader
-    GLuint getReflectionTexture() const;
-    GLuint getRefractionTexture() const;
-    
-    // Resize framebuffers
+    GLuint getReflectionTexture() const { return targets[PLANAR_REFLECTION].colorTexture; }
+    GLuint getRefractionTexture() const { return targets[PLANAR_REFRACTION].colorTexture; }
+
+    // View-projection the target was last rendered with, for reprojecting it
+    const glm::mat4& getViewProjection(PlanarTarget target) const { return targets[target].viewProjection; }
+
+    int getTargetWidth(PlanarTarget target) const { return targets[target].width; }
+    int getTargetHeight(PlanarTarget target) const { return targets[target].height; }
+
+    // Settings; the layered path uses the reflection's settings for both targets
+    TargetSettings& getSettings(PlanarTarget target) { return settings[target]; }
+    UpdateThresholds& getThresholds() { return thresholds; }
+    void setLayeredRendering(bool enabled) { layeredRendering = enabled; }
+    bool isLayeredRendering() const { return layeredRendering; }
+
+    // Frame budget degradation on top of the settings: the refresh intervals multiplied, with
+    // motion forcing a refresh no sooner than that many frames, and the resolutions scaled
+    void setBudget(int intervalScale, float resolutionFactor);
+
+    // With a ReflectionProbe behind the reflection, only geometry within distance of the
+    // camera is drawn, over a transparent clear the water shader fills from the probe; 0
+    // draws everything over the sky color
+    void setNearFieldDistance(float distance);
+    float getNearFieldDistance() const { return nearFieldDistance; }
+
+    // Size of the window the targets are scaled from
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
     void resize(int width, int height);
 
 private:
-    Framebuffer* reflectionFBO;
-    Framebuffer* refractionFBO;
-    
-    glm::mat4 reflectionMatrix;
-    glm::mat4 refractionMatrix;
-    
+    struct Target {
+        GLuint fbo = 0;                 // Separate mode only
+        GLuint colorTexture = 0;        // 2D texture, or a 2D view of a layer of layeredColor
+        GLuint depthTexture = 0;
+        int width = 0, height = 0;
+
+        bool updating = false;          // This frame
+        bool valid = false;             // Holds a refresh
+        int framesSinceUpdate = 0;
+        glm::vec3 cameraPosition = glm::vec3(0.0f);
+        glm::vec3 cameraFront = glm::vec3(0.0f, 0.0f, -1.0f);
+        glm::vec3 spherePosition = glm::vec3(0.0f);
+        float waterLevel = 0.0f;
+        glm::mat4 viewProjection = glm::mat4(1.0f);
+    };
+
+    Target targets[PLANAR_TARGET_COUNT];
+    TargetSettings settings[PLANAR_TARGET_COUNT];
+    UpdateThresholds thresholds;
+
+    bool layeredRendering = false;
+    bool layeredActive = false;         // Layout of the allocated targets
+    GLuint layeredFBO = 0;
+    GLuint layeredColor = 0;            // 2-layer arrays
+    GLuint layeredDepth = 0;
+
+    glm::vec3 frameSpherePosition = glm::vec3(0.0f);
+
+    int budgetInterval = 1;
+    float budgetResolution = 1.0f;
+    float nearFieldDistance = 0.0f;
+
     int width, height;
-    
+
     // Create reflection matrix for water plane
-    glm::mat4 createReflectionMatrix(float waterLevel);
-    
-    // Setup clipping planes for refraction/reflection
-    void setupClippingPlane(const glm::vec4& plane);
-};
\ No newline at end of file
+    glm::mat4 createReflectionMatrix(float waterLevel) const;
+
+    void allocateTargets();
+    void destroyTargets();
+    bool hasMoved(const Target& target, const Camera& camera, float waterLevel) const;
+    void beginTarget(PlanarTarget target, const Camera& camera, float waterLevel);
+    void clearTarget(PlanarTarget target);
+};
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "SimulationCommands.h"
+#include <glm/glm.hpp>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace WaterSim {
+
+// One decoded datagram of the remote-render control protocol
+struct RemoteCommand {
+    static constexpr int MAX_STREAM_SIZE = 4096;   // Largest width or height a hello may ask for
+
+    enum class Type {
+        HELLO,          // hello RTP_PORT [WIDTH HEIGHT]: take control, and unless RTP_PORT is 0
+                        // stream to the sender's address at RTP_PORT, at most MAX_STREAM_SIZE
+                        // on a side
+        BYE,            // bye: stop streaming and give up control
+        SIMULATE,       // Into SimulationManager's command queue:
+                        //   ripple X Y Z MAGNITUDE
+                        //   splash X Y Z MAGNITUDE
+                        //   impulse X Y Z IX IY IZ RADIUS
+                        //   stream X Y Z DX DY DZ PARTICLES
+                        //   volume MINX MINY MINZ MAXX MAXY MAXZ
+                        //   gravity GX GY GZ
+                        //   set water-height|damping|friction VALUE
+        CAMERA,         // camera X Y Z YAW PITCH [FOV]: absolute free camera
+        SIMULATION      // simulation regular|sph
+    };
+
+    Type type = Type::BYE;
+    SimulationCommand simulation;           // SIMULATE
+    glm::vec3 position = glm::vec3(0.0f);   // Camera
+    glm::vec3 vector = glm::vec3(0.0f);     // Camera yaw, pitch, field of view
+    int port = 0;
+    int width = 0;
+    int height = 0;
+    bool sph = false;
+    std::string client;                     // Sender's address, dotted
+};
+
+// Non-blocking UDP control socket of the streaming server (--serve), or of a visible session
+// driven from outside (--control). A client sends the session token and one whitespace-
+// separated text command per datagram (see RemoteCommand::Type); poll() drains whatever has
+// arrived without waiting, once per frame on the main thread. Malformed datagrams and ones
+// without the token are counted and dropped. The socket listens on loopback unless bound to
+// another interface. The first hello makes its sender, by address and port, the session's
+// one controller; anyone else is refused until it says bye or stays silent for the
+// controller timeout.
+class RemoteControl {
+public:
+    struct Settings {
+        std::string bindAddress = "127.0.0.1";  // IPv4 interface to listen on, 0.0.0.0 for all
+        std::string token;                      // Empty: generate one and print it
+        float controllerTimeout = 30.0f;        // Seconds of silence that release the controller
+    };
+
+    RemoteControl() = default;
+    ~RemoteControl();
+
+    RemoteControl(const RemoteControl&) = delete;
+    RemoteControl& operator=(const RemoteControl&) = delete;
+
+    bool open(int port, const Settings& settings);
+    void close();
+    bool isOpen() const { return socket_ != INVALID; }
+
+    // Appends the commands received since the last call
+    void poll(std::vector<RemoteCommand>& commands);
+
+    const std::string& getClient() const { return client_; }   // Controller, address:port
+    const std::string& getToken() const { return token_; }
+    uint32_t getReceived() const { return received_; }
+    uint32_t getRejected() const { return rejected_; }
+
+    static bool parse(const char* text, RemoteCommand& command);
+
+    // Skips the leading token; false when it is not the session's
+    bool acceptToken(const char* text, const char*& command) const;
+
+private:
+#ifdef _WIN32
+    using Socket = uintptr_t;
+    static constexpr Socket INVALID = ~Socket(0);
+#else
+    using Socket = int;
+    static constexpr Socket INVALID = -1;
+#endif
+
+    Socket socket_ = INVALID;
+    Settings settings_;
+    std::string token_;
+    bool hasController_ = false;
+    uint32_t controllerAddress_ = 0;     // Network byte order, as received
+    uint16_t controllerPort_ = 0;
+    std::chrono::steady_clock::time_point lastHeard_;
+    std::string client_;
+    uint32_t received_ = 0;
+    uint32_t rejected_ = 0;
+};
+
+} // namespace WaterSim
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+namespace WaterSim {
+
+// Storage of a pooled texture; textures are interchangeable when these match
+struct RenderTargetDesc {
+    GLenum target = GL_TEXTURE_2D;      // GL_TEXTURE_2D, GL_TEXTURE_2D_ARRAY or GL_TEXTURE_2D_MULTISAMPLE
+    GLenum internalFormat = GL_RGBA16F;
+    int width = 0;
+    int height = 0;
+    int layers = 1;                     // 2D arrays only
+    int levels = 1;
+    int samples = 1;                    // Multisampled only
+
+    bool operator==(const RenderTargetDesc& other) const {
+        return target == other.target && internalFormat == other.internalFormat &&
+               width == other.width && height == other.height && layers == other.layers &&
+               levels == other.levels && samples == other.samples;
+    }
+};
+
+// Immutable-storage render targets shared by every subsystem that sizes its targets to the
+// window or a quality setting (Framebuffer, the planar reflections, bloom, ray tracing, the
+// SPH screen-space targets, the frame graph). A resize or mode switch gives its old targets
+// back with release() and takes new ones with acquire(); a texture of a matching size and
+// format comes back out of the pool instead of a new allocation, so switching back and forth
+// costs nothing and a drag-resize frees nothing mid-frame.
+//
+// Released textures may still be read by commands in flight, so they wait behind the fence
+// endFrame() inserts after them and are handed out again only once it has signalled. Free
+// textures are deleted after going unused for IDLE_FRAMES_BEFORE_RELEASE frames, oldest
+// first past MAX_IDLE_BYTES, so the sizes a drag-resize passes through do not stay resident.
+//
+// Context thread only. An acquired texture's filters are linear and its wrap clamped to the
+// edge, whatever its previous owner set.
+class RenderTargetPool {
+public:
+    struct Stats {
+        int liveTextures = 0;       // Acquired and not released
+        int freeTextures = 0;       // Ready to be handed out again
+        int fencedTextures = 0;     // Released, waiting for the GPU
+        size_t liveBytes = 0;
+        size_t idleBytes = 0;       // Free and fenced
+        int allocations = 0;        // Since startup
+        int reuses = 0;
+    };
+
+    static RenderTargetPool& instance();
+
+    GLuint acquire(const RenderTargetDesc& desc);
+    GLuint acquire2D(GLenum internalFormat, int width, int height, int levels = 1);
+
+    // Back to the pool; 0 and textures the pool did not hand out are ignored. Framebuffers
+    // and views of it should go first
+    void release(GLuint texture);
+
+    // Once per frame, after its commands are submitted: fences this frame's releases, frees
+    // the textures whose fence has signalled and deletes the idle ones
+    void endFrame();
+
+    // Before the context goes away: deletes everything, live textures included
+    void clear();
+
+    const Stats& getStats() const { return stats_; }
+
+    static size_t textureBytes(const RenderTargetDesc& desc);
+
+private:
+    struct Entry {
+        RenderTargetDesc desc;
+        GLuint texture = 0;
+        uint64_t releasedFrame = 0;
+    };
+
+    struct FencedBatch {
+        GLsync fence = nullptr;
+        std::vector<Entry> entries;
+    };
+
+    RenderTargetPool() = default;
+    ~RenderTargetPool() = default;
+
+    RenderTargetPool(const RenderTargetPool&) = delete;
+    RenderTargetPool& operator=(const RenderTargetPool&) = delete;
+
+    GLuint createTexture(const RenderTargetDesc& desc);
+    static void deleteTexture(GLuint texture);
+    void deleteIdle();
+    void updateStats();
+
+    std::vector<Entry> live_;
+    std::vector<Entry> released_;       // This frame's releases, not fenced yet
+    std::deque<FencedBatch> fenced_;    // In submission order, so they signal in order
+    std::vector<Entry> free_;
+    uint64_t frame_ = 0;
+    Stats stats_;
+
+    static constexpr uint64_t IDLE_FRAMES_BEFORE_RELEASE = 30;
+    static constexpr size_t MAX_IDLE_BYTES = size_t(256) << 20;
+};
+
+} // namespace WaterSim
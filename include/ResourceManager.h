@@ -1,44 +1,162 @@
 #pragma once
 
-#include <unordered_map>
-#include <string>
+#include <glad/glad.h>
+#include "JobSystem.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
 #include <memory>
-#include "GLResources.h"
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 namespace WaterSim {
 
+// Shared owner of named GPU textures and programs. Requests may come from any thread and
+// return a Handle at once; the GL work behind them (uploads, builds, deletes) happens in
+// update() on the thread owning the context. Files decode on the job pool meanwhile, their
+// texels go up through the UploadQueue, and a handle reads as the placeholder until its
+// object is resident.
+//
+// Every resident object's bytes count against the budget. An object nobody holds a handle
+// to stays cached until the budget needs its bytes. Streamable textures, the ones loaded
+// from a file, may be evicted even while held, least recently used first; a held one is
+// read again from its file the next time its handle is used.
 class ResourceManager {
 private:
-    std::unordered_map<std::string, GLShaderProgram> shaders;
-    std::unordered_map<std::string, GLTexture> textures;
-    
-    static std::unique_ptr<ResourceManager> instance;
-    
+    struct Entry;
+
 public:
-    static ResourceManager& getInstance() {
-        if (!instance) {
-            instance = std::make_unique<ResourceManager>();
-        }
-        return *instance;
-    }
-    
-    // Shader management
-    GLShaderProgram& loadShader(const std::string& name, 
-                                const std::string& vertexPath, 
-                                const std::string& fragmentPath);
-    
-    GLShaderProgram& getShader(const std::string& name);
-    
-    // Texture management
-    GLTexture& loadTexture(const std::string& name, const std::string& path);
-    GLTexture& createTexture(const std::string& name);
-    GLTexture& getTexture(const std::string& name);
-    
-    // Clean up all resources
+    enum class Kind {
+        TEXTURE,
+        PROGRAM
+    };
+
+    // Counted reference to an entry; copies share it
+    class Handle {
+    public:
+        Handle() = default;
+
+        // The object, or while it is not resident the placeholder texture (0 for a program).
+        // Marks the resource as used this frame, which keeps eviction away from it
+        GLuint get() const;
+        bool isReady() const;
+        size_t getBytes() const;
+        const std::string& getName() const;
+        explicit operator bool() const { return entry_ != nullptr; }
+
+        void reset() { entry_.reset(); }
+
+    private:
+        friend class ResourceManager;
+        explicit Handle(std::shared_ptr<Entry> entry) : entry_(std::move(entry)) {}
+
+        std::shared_ptr<Entry> entry_;
+    };
+
+    struct Stats {
+        size_t residentBytes = 0;
+        size_t budgetBytes = 0;         // 0 for no limit
+        int textures = 0;
+        int programs = 0;
+        int pending = 0;                // Requested and not resident yet
+        int evictions = 0;              // Since startup
+    };
+
+    static ResourceManager& instance();
+
+    // Creates the placeholder and picks the default budget: half the dedicated video memory
+    // the driver reports (NVX_gpu_memory_info or ATI_meminfo), otherwise no limit
+    void initialize();
+
+    // Any thread. A repeated name returns the existing entry. The texture is an RGBA8 2D
+    // texture with a full mip chain, loaded from path and streamable
+    Handle requestTexture(const std::string& name, const std::string& path);
+    Handle requestProgram(const std::string& name, const std::string& vertexPath, const std::string& fragmentPath);
+
+    // Context thread. Takes ownership of an object created elsewhere, replacing any object
+    // already under the name; never evicted while a handle holds it
+    Handle adoptTexture(const std::string& name, GLuint texture, GLenum target = GL_TEXTURE_2D);
+    Handle adoptProgram(const std::string& name, GLuint program);
+
+    // Any thread; an empty handle if the name is unknown
+    Handle find(const std::string& name);
+
+    // Context thread, once per frame: starts queued loads, submits decoded files for upload
+    // (at most UPLOAD_BYTES_PER_UPDATE), makes finished uploads resident, then evicts down to
+    // the budget
+    void update();
+
+    void setBudget(size_t bytes);
+    size_t getBudget() const { return budgetBytes_.load(); }
+    Stats getStats() const;
+
+    // Context thread, before it goes away: deletes every object; handles read as empty
     void clear();
-    
+
+    // Bytes of every level (and face) of a texture, queried from the driver
+    static size_t queryTextureBytes(GLuint texture, GLenum target);
+
 private:
+    enum class State {
+        QUEUED,         // Waiting for update() to start its load
+        DECODING,       // Job pool reading the file
+        DECODED,        // Texels waiting for their upload
+        UPLOADING,      // With the UploadQueue; the texels stay until it is done
+        BUILDING,       // Program with the shader compiler
+        RESIDENT,
+        EVICTED,        // Storage dropped; reloaded on the next use
+        FAILED
+    };
+
+    struct Entry {
+        std::string name;
+        Kind kind = Kind::TEXTURE;
+        GLenum target = GL_TEXTURE_2D;
+        bool streamable = false;
+        std::vector<std::string> paths;         // Texture file, or vertex and fragment shaders
+
+        // Read by handles without the lock
+        std::atomic<GLuint> id{0};
+        std::atomic<uint64_t> lastUsedFrame{0};
+        std::atomic<size_t> bytes{0};
+        std::atomic<bool> reloadWanted{false};
+
+        // Under the manager's lock
+        State state = State::QUEUED;
+        unsigned char* pixels = nullptr;        // DECODED and UPLOADING texels, RGBA8
+        int width = 0, height = 0;
+        GLuint uploadingTexture = 0;            // UPLOADING storage, resident once its ticket completes
+        uint64_t uploadTicket = 0;
+    };
+
     ResourceManager() = default;
+    ~ResourceManager();
+
+    std::shared_ptr<Entry> findOrCreate(const std::string& name, Kind kind, bool& created);
+    void startLoad(const std::shared_ptr<Entry>& entry);
+    void buildProgram(const std::shared_ptr<Entry>& entry);
+    void uploadTexture(Entry& entry);
+    void finishUpload(Entry& entry);
+    void release(Entry& entry);
+    void evictToBudget();
+    size_t residentBytes() const;
+
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, std::shared_ptr<Entry>> entries_;
+    std::unique_ptr<JobSystem::TaskGroup> decodeJobs_ = std::make_unique<JobSystem::TaskGroup>();
+    std::atomic<size_t> budgetBytes_{0};
+    int evictions_ = 0;
+
+    GLuint placeholder_ = 0;
+    static std::atomic<uint64_t> frame_;   // update() calls so far, for the LRU order
+
+    // Upload size per update(), so a burst of loads spreads over frames
+    static constexpr size_t UPLOAD_BYTES_PER_UPDATE = 16u << 20;
+
+    // A streamable texture used this recently stays resident even over budget
+    static constexpr uint64_t EVICTION_GRACE_FRAMES = 2;
 };
 
-} // namespace WaterSim
\ No newline at end of file
+} // namespace WaterSim
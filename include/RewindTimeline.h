@@ -0,0 +1,119 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <deque>
+#include <string>
+#include <vector>
+#include "SimulationManager.h"
+
+namespace WaterSim {
+
+// In-memory rewind of the simulation. Every keyframeInterval-th frame is kept as a keyframe:
+// the SPH particles quantized to 16 bytes each (sph_rewind.cs) into one GPU ring buffer, the
+// heightfield into a pooled texture, the rest on the host (SimulationManager::Keyframe). Each
+// frame between keeps its time step, the sphere and the interactions logged while it ran, so
+// seeking restores the nearest keyframe at or before the frame and steps the recorded frames
+// after it again, at most an interval of updates; seeking forward steps on from where it is.
+// The oldest keyframes, and the frames they cover, go first when the budget is full.
+//
+// A replay tracks the recording closely, not bit for bit: the keyframes are quantized, the
+// SPH sums in atomic order, and the rigid bodies and foam are not kept. Refused while the SPH
+// runs asynchronously or on the CPU. Context thread only.
+class RewindTimeline {
+public:
+    struct Settings {
+        bool enabled = false;
+        int keyframeInterval = 30;          // Frames
+        size_t budgetBytes = 256u << 20;    // Keyframes kept; the SPH ring is allocated at this size
+    };
+
+    struct Sphere {
+        glm::vec3 position = glm::vec3(0.0f);
+        glm::vec3 velocity = glm::vec3(0.0f);
+        float radius = 0.0f;
+    };
+
+    struct Stats {
+        int keyframes = 0;
+        size_t keyframeBytes = 0;
+        int firstFrame = 0;                 // Oldest frame a seek can reach
+        int lastFrame = 0;
+        int currentFrame = 0;
+    };
+
+    explicit RewindTimeline(SimulationManager& simulation);
+    ~RewindTimeline();
+
+    RewindTimeline(const RewindTimeline&) = delete;
+    RewindTimeline& operator=(const RewindTimeline&) = delete;
+
+    // Disabling, or another budget, drops the timeline
+    void setSettings(const Settings& settings);
+    const Settings& getSettings() const { return settings_; }
+
+    // Right after each frame's simulation update, with the sphere it ran with: interactions
+    // logged since the previous call belong to this frame. Takes a keyframe when one is due
+    void record(float deltaTime, const Sphere& sphere);
+
+    // The simulation as it was after the frame, paused there; the sphere it ran with comes
+    // back for the caller to put in place. False outside [firstFrame, lastFrame]
+    bool seek(int frame, Sphere& sphere);
+
+    // While paused the caller skips the simulation update and record()
+    bool isPaused() const { return paused_; }
+    void pause() { if (settings_.enabled && !keyframes_.empty()) paused_ = true; }
+
+    // Recording carries on from the paused frame; the frames after it are dropped
+    void resume();
+
+    void clear();
+
+    bool hasFrames() const { return !keyframes_.empty(); }
+    Stats getStats() const;
+    const std::string& getStatus() const { return status_; }   // Why nothing is recorded, if so
+
+private:
+    struct Frame {
+        float deltaTime = 0.0f;
+        Sphere sphere;
+        std::vector<SimulationCommand> commands;
+    };
+
+    struct Keyframe {
+        int frame = 0;
+        GLintptr offset = 0;                // Into the ring
+        GLsizeiptr ringBytes = 0;           // 0 without the SPH
+        GLuint heightfieldTexture = 0;      // From the RenderTargetPool, 0 without a heightfield
+        size_t bytes = 0;                   // Ring range and texture, against the budget
+        SimulationManager::Keyframe state;
+    };
+
+    bool captureKeyframe(int frame);
+    void popOldestKeyframe();
+    void popNewestKeyframe();
+    bool overlapsRing(GLintptr offset, GLsizeiptr bytes) const;
+    void applySphere(const Sphere& sphere);
+    void releaseRing();
+
+    SimulationManager& simulation_;
+    Settings settings_;
+
+    GLuint ring_ = 0;
+    GLsizeiptr ringCapacity_ = 0;
+    GLintptr ringHead_ = 0;                 // Where the next keyframe goes
+    size_t usedBytes_ = 0;
+
+    std::deque<Keyframe> keyframes_;        // Oldest first
+    std::deque<Frame> frames_;              // From the oldest keyframe's frame on
+    int firstFrame_ = 0;                    // Frame of frames_.front()
+    int lastFrame_ = 0;                     // Newest recorded
+    int currentFrame_ = 0;                  // The simulation's state
+    bool paused_ = false;
+
+    std::vector<SimulationCommand> pending_;    // Logged since the last record()
+    std::string status_;
+};
+
+} // namespace WaterSim
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+#include "GLResources.h"
+#include "SPHComputeSystem.h"
+
+namespace WaterSim {
+
+// Spheres and boxes simulated entirely on the GPU, hundreds at a time. The state is one
+// storage buffer of structure-of-arrays (position, velocity, orientation, angular velocity,
+// shape, CAPACITY vec4s each), integrated by rigid_integrate.cs into the other of two such
+// buffers every substep. A uniform-grid broadphase (rigid_broadphase.cs) lists the bodies
+// of each cell; its cells are CELL_FACTOR SPH cells on a side from the SPH grid's origin,
+// so body-body contacts and the SPH particles (sph_step1.cs) look bodies up in the same
+// grid. All the bodies couple with the fluid in SPH step 1, which sums the momentum each
+// body pushes into the water; the next integration takes it back from the body, so the
+// coupling never reads anything back to the CPU. Drawn as one instanced draw (rigid_body.vs).
+//
+// Bodies are only added (from the CPU, uploaded at the next update) or cleared all at once.
+class RigidBodySystem {
+public:
+    static constexpr uint32_t CAPACITY = 1024;      // RIGID_BODY_CAPACITY of the rigid and SPH step 1 shaders
+    static constexpr uint32_t CELL_CAPACITY = 8;    // RIGID_CELL_CAPACITY, bodies listed per cell
+    static constexpr int CELL_FACTOR = 4;           // SPH cells per broadphase cell and axis
+
+    enum class Shape { SPHERE = 0, BOX = 1 };
+
+    struct Settings {
+        int substeps = 2;
+        float restitution = 0.2f;
+        float friction = 0.4f;          // Between bodies and with the walls
+        float fluidFriction = 0.3f;     // Tangential slip the particles lose on a body
+        float damping = 0.05f;          // Linear and angular, per second
+    };
+
+    RigidBodySystem() = default;
+    ~RigidBodySystem();
+
+    RigidBodySystem(const RigidBodySystem&) = delete;
+    RigidBodySystem& operator=(const RigidBodySystem&) = delete;
+
+    // Allocates the state and submits the kernels
+    bool initialize();
+    bool isReady() const { return broadphaseProgram_.isValid() && integrateProgram_.isValid(); }
+
+    void setSettings(const Settings& settings) { settings_ = settings; }
+    const Settings& getSettings() const { return settings_; }
+
+    // The box the bodies stay in
+    void setBounds(const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+
+    // The broadphase grid, CELL_FACTOR times coarser than this SPH grid; without SPH, a grid
+    // of SPH cell size over the bounds. Rebuilds the grid buffer when it changes
+    void setGrid(const SPHComputeSystem* sph);
+
+    // size is the radius of a sphere, the half extents of a box; clamped so the body fits a
+    // broadphase cell. Returns the body index, or -1 at capacity
+    int addBody(Shape shape, const glm::vec3& position, const glm::vec3& size, float density,
+                const glm::vec3& velocity = glm::vec3(0.0f));
+    void clear();
+    uint32_t getBodyCount() const { return count_; }
+
+    // Integrates the substeps of deltaTime and rebuilds the broadphase at the new positions
+    void update(float deltaTime, const glm::vec3& gravity);
+
+    // The buffers SPH step 1 collides with, as of the last update
+    SPHRigidBodies getFluidCoupling() const;
+
+    // One instanced draw of every body with a program linking rigid_body.vs
+    void render(const GLShaderProgram& program) const;
+
+    float getMaxBodySize() const { return maxBodySize_; }   // Bounding radius a body may have
+
+private:
+    struct PendingBody {
+        glm::vec4 position;
+        glm::vec4 velocity;
+        glm::vec4 orientation;
+        glm::vec4 angularVelocity;
+        glm::vec4 shape;
+    };
+
+    void createMesh();
+    void uploadPending();
+    void buildBroadphase();
+
+    Settings settings_;
+    glm::vec3 boundsMin_{-1.0f};
+    glm::vec3 boundsMax_{1.0f};
+
+    // Broadphase grid
+    glm::vec3 gridOrigin_{0.0f};
+    float cellSize_ = 1.0f;
+    glm::ivec3 gridRes_{1};
+    float maxBodySize_ = 0.5f;
+    GLuint gridBuffer_ = 0;             // Per cell a count and CELL_CAPACITY body ids
+    GLsizeiptr gridBufferSize_ = 0;
+
+    // State ping-pongs between the two buffers; current_ holds the latest
+    GLuint stateBuffers_[2] = {0, 0};
+    int current_ = 0;
+    GLuint impulseBuffer_ = 0;          // Fixed point fluid momentum per body, SPH step 1
+    uint32_t count_ = 0;
+    std::vector<PendingBody> pending_;
+
+    GLShaderProgram broadphaseProgram_; // rigid_broadphase.cs
+    GLShaderProgram integrateProgram_;  // rigid_integrate.cs
+
+    GLuint vao_ = 0;
+    GLuint vbo_ = 0;
+    GLuint ebo_ = 0;
+    GLsizei indexCount_ = 0;
+};
+
+} // namespace WaterSim
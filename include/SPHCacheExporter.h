@@ -0,0 +1,101 @@
+#ifndef SPH_CACHE_EXPORTER_H
+#define SPH_CACHE_EXPORTER_H
+
+#include <string>
+#include <deque>
+#include <cstdio>
+#include <cstdint>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <glm/glm.hpp>
+#include "SPHComputeSystem.h"
+
+namespace WaterSim {
+
+enum class SPHCacheContent {
+    PARTICLES,      // Point clouds: position, density, velocity, pressure
+    SURFACE         // The marching cubes mesh: positions and normals, triangle soup
+};
+
+// Writes a per-frame geometry cache for DCC hand-off: BASE_particles_NNNNNN.ply or
+// BASE_surface_NNNNNN.ply, binary little-endian PLY that Houdini, Blender and most VFX
+// tools import as a file sequence, with the simulation time in a header comment.
+//
+// Memory is fixed whatever the length of the cache: a ring of persistently mapped readback
+// slots is all it holds, and the writer thread writes straight from a slot before handing it
+// back, so nothing accumulates per frame. capture() refuses a frame while every slot is in
+// flight or being written, which is the back-pressure: the caller retries on its next
+// update instead of stalling on the disk, and an offline run can wait for canCapture().
+class SPHCacheExporter {
+public:
+    SPHCacheExporter() = default;
+    ~SPHCacheExporter();
+
+    SPHCacheExporter(const SPHCacheExporter&) = delete;
+    SPHCacheExporter& operator=(const SPHCacheExporter&) = delete;
+
+    // capacity: particles, or surface vertices
+    bool open(const std::string& basePath, SPHCacheContent content, uint32_t capacity);
+    void close();
+    bool isOpen() const { return open_; }
+    SPHCacheContent getContent() const { return content_; }
+
+    // A slot is free for the next capture (GL thread)
+    bool canCapture() const;
+
+    // Queue a copy of the first count particles of buffer, trimmed to the GPU live count in
+    // countBuffer (GL thread, never blocks); false when deferred by back-pressure
+    bool captureParticles(GLuint buffer, uint32_t count, GLuint countBuffer, double simulationTime);
+    // Queue a copy of a surface mesh buffer: DrawArraysIndirectCommand, then vec4 position /
+    // vec4 normal pairs (GL thread, never blocks)
+    bool captureSurface(GLuint meshBuffer, double simulationTime);
+
+    // Hand completed readbacks to the writer thread (GL thread, never blocks)
+    void poll();
+
+    uint32_t getWrittenFrames() const { return writtenFrames_; }
+    uint32_t getDeferredFrames() const { return deferredFrames_; }
+    uint32_t getFailedFrames() const { return failedFrames_; }
+
+private:
+    enum class SlotState { FREE, READING, WRITING };
+
+    static constexpr int CACHE_SLOTS = 3;
+
+    GLuint buffers_[CACHE_SLOTS] = {};
+    const uint8_t* pointers_[CACHE_SLOTS] = {};
+    GLsync fences_[CACHE_SLOTS] = {};
+    uint32_t counts_[CACHE_SLOTS] = {};
+    bool hasLiveCount_[CACHE_SLOTS] = {};  // Live count copied behind the particles
+    double times_[CACHE_SLOTS] = {};
+    uint32_t frameIndices_[CACHE_SLOTS] = {};
+    SlotState states_[CACHE_SLOTS] = {};    // WRITING is the writer's; guarded by mutex_
+    int nextSlot_ = 0;
+
+    bool open_ = false;
+    std::string basePath_;
+    SPHCacheContent content_ = SPHCacheContent::PARTICLES;
+    uint32_t capacity_ = 0;
+    uint32_t capturedFrames_ = 0;
+    uint32_t deferredFrames_ = 0;
+
+    // Writer thread
+    std::thread writer_;
+    mutable std::mutex mutex_;
+    std::condition_variable wake_;
+    std::deque<int> queue_;                 // Slots in capture order
+    bool stopping_ = false;
+    std::atomic<uint32_t> writtenFrames_{0};
+    std::atomic<uint32_t> failedFrames_{0};
+
+    bool claimSlot();
+    void submit();
+    void writerLoop();
+    bool writeFrame(int slot) const;
+};
+
+} // namespace WaterSim
+
+#endif // SPH_CACHE_EXPORTER_H
@@ -3,13 +3,23 @@
 
 #define _USE_MATH_DEFINES // For M_PI in MSVC
 #include <vector>
+#include <string>
 #include <cstdint>
 #include <cmath> // Added for M_PI and other math functions
+#include <algorithm>
+#include <memory>
+#include <atomic>
+#include <map>
 #include <glm/glm.hpp>
 #include "GLResources.h" // For SPHParticleCompute if defined there, or define SPHParticleCompute here
 
 namespace WaterSim {
 
+class SPHFrameExporter;
+class SPHCacheExporter;
+class ComputeAutotuner;
+class ShadingRateImage;
+
 // SPH particle structure
 struct SPHParticleCompute {
     glm::vec3 position;
@@ -18,6 +28,104 @@ struct SPHParticleCompute {
     float pressure;
 };
 
+// GPU particle statistics, laid out as the two vec4s written by sph_reduce.cs
+struct SPHStatistics {
+    float minSpeed = 0.0f;
+    float maxSpeed = 0.0f;
+    float meanSpeed = 0.0f;
+    uint32_t liveParticles = 0;  // GPU live count when the statistics were reduced
+    float minDensity = 0.0f;
+    float maxDensity = 0.0f;
+    float meanDensity = 0.0f;
+    float padding1 = 0.0f;
+};
+
+// Substep constants of the simulation passes, laid out as the std140 SPHParameters
+// uniform block they all declare (binding 0)
+struct SPHParameterBlock {
+    glm::vec3 gridOrigin;
+    float dt;
+    glm::vec3 gridSize;
+    float maxVelocity;
+    glm::vec3 invCellSize;
+    float wallDamping;
+    glm::ivec3 gridRes;
+    float sceneStride;
+    glm::vec3 gravity;
+    int32_t sceneCount;
+    glm::vec3 stepGravity;     // Zero when PCISPH integrates gravity
+    int32_t batchScenes;
+    float particleMass;
+    float halfSkinSq;
+    uint32_t listStride;
+    int32_t useNeighborList;
+    int32_t diffusePotentials;
+    int32_t particleSleeping;
+    uint32_t sleepSubsteps;
+    float sleepVelocity;
+    float sleepDensityChange;
+    float padding[3];
+};
+static_assert(sizeof(SPHParameterBlock) == 144, "SPHParameterBlock must match the std140 SPHParameters block");
+
+// Analytic vs. tabulated kernel comparison from SPHComputeSystem::benchmarkKernels().
+// Times are GPU milliseconds per pass; errors are relative L2 norms over all particles
+struct SPHKernelBenchmark {
+    bool valid = false;
+    float analyticDensityMs = 0.0f;
+    float tableDensityMs = 0.0f;
+    float analyticForceMs = 0.0f;
+    float tableForceMs = 0.0f;
+    float densityError = 0.0f;        // Step 5 densities
+    float maxDensityError = 0.0f;     // Worst single particle, relative
+    float accelerationError = 0.0f;   // Step 6 velocity change
+};
+
+// GPU time of the substep passes from SPHComputeSystem::takePassProfile(), indexed by
+// runSimulationPass() id: steps 1-6, then neighbor lists (7), PCISPH (8) and sleeping (9).
+// A pass's time runs from the end of the previous one, so it includes its barrier wait
+struct SPHPassProfile {
+    static constexpr int PASS_SLOTS = 15;
+    float passMs[PASS_SLOTS] = {};    // Totals over all profiled substeps
+    int passRuns[PASS_SLOTS] = {};
+    int substeps = 0;
+};
+
+// Grid occupancy and neighborhood size from SPHComputeSystem::measureGridOccupancy()
+struct SPHGridOccupancy {
+    uint32_t particles = 0;
+    uint32_t occupiedCells = 0;
+    uint32_t maxCellParticles = 0;
+    float meanCellParticles = 0.0f;       // Over occupied cells
+    float candidatesPerParticle = 0.0f;   // Particles in the 3x3x3 cells the search visits
+    float neighborsPerParticle = 0.0f;    // Of those, within the kernel radius (sampled)
+};
+
+// Health counters of the last substep, accumulated by the instrumented steps 3, 5 and 6
+// and laid out as the sphCounterBuf block they declare. Only SPH_GPU_COUNTERS builds
+// (CMake option WATERSIM_SPH_COUNTERS) compile the instrumentation in
+struct SPHCounters {
+    static constexpr uint32_t BINS = 32;               // Histogram bins, the last one open
+    static constexpr uint32_t BIN_WIDTH = 8;           // Particles per bin
+    static constexpr uint32_t CELL_LIMIT = 255;        // Largest count an 8-bit packed cell holds
+    
+    uint32_t outOfGrid = 0;           // Step 3: live particles outside the grid, left unsorted
+    uint32_t droppedWrites = 0;       // Step 3: sorted slots past the end of the output buffer
+    uint32_t occupiedCells = 0;
+    uint32_t maxCellOccupancy = 0;
+    uint32_t overfullCells = 0;       // Cells over CELL_LIMIT particles
+    uint32_t cellParticles = 0;       // Summed over the occupied cells
+    uint32_t candidateSum = 0;        // Step 5: particles the neighbor search visited
+    uint32_t maxCandidates = 0;
+    uint32_t neighborSum = 0;         // Step 6: of those, within the kernel radius
+    uint32_t maxNeighbors = 0;
+    uint32_t sampledParticles = 0;    // Particles steps 5 and 6 counted
+    uint32_t gridCounted = 0;         // Nonzero when the atomic scatter (step 3) sorted; the Morton sort does not count
+    uint32_t candidateHistogram[BINS] = {};
+    uint32_t neighborHistogram[BINS] = {};
+};
+static_assert(sizeof(SPHCounters) == (12 + 2 * SPHCounters::BINS) * sizeof(uint32_t), "SPHCounters must match sphCounterBuf");
+
 // SPH constants
 namespace SPHConstants {
     constexpr float PARTICLE_RADIUS = 0.0457f;       
@@ -43,15 +151,226 @@ namespace SPHConstants {
     constexpr float VIS_KERNEL_WEIGHT_CONST = 45.0f / (PI_VALUE * H6);
 
     constexpr uint32_t INVALID_INDEX = 0xFFFFFFFFu; // Used for linked lists in grid cells
+
+    constexpr float NEIGHBOR_SKIN = KERNEL_RADIUS * 0.15f; // Verlet list margin beyond h
+
+    // Adaptive time stepping: dt = CFL_FACTOR * h / (c + vmax) with c = sqrt(STIFFNESS),
+    // which is close to DT for fluid at rest, and dt <= FORCE_FACTOR * sqrt(h / amax)
+    constexpr float CFL_FACTOR = 0.1f;
+    constexpr float PCISPH_CFL_FACTOR = 0.4f;         // No sound speed term: incompressibility is iterated
+    constexpr float PCISPH_DT_SCALE = 5.0f;           // Largest PCISPH step relative to DT
+    constexpr float FORCE_FACTOR = 0.25f;
+    constexpr float VISCOSITY_DT_FACTOR = 0.125f;     // Explicit viscosity: dt <= factor * h^2 * rho0 / mu
+    constexpr uint32_t READBACK_FRAMES = 3;           // Fenced readback ring depth
+    constexpr uint32_t REDUCE_BLOCK_SIZE = 256;       // Must match sph_reduce.cs
+    
+    // Particle injection: fenced, persistently mapped staging ring
+    constexpr uint32_t STAGING_SLOTS = 3;
+    constexpr uint32_t STAGING_SLOT_PARTICLES = 16384;
+    constexpr uint32_t EMIT_BLOCK_SIZE = 64;          // Must match sph_emit.cs
+    constexpr uint32_t INITIAL_PARTICLE_CAPACITY = 4096; // Per-particle storage doubles from here
+    
+    // Byte offsets of the indirect dispatch records in the particle count buffer
+    constexpr GLintptr DISPATCH_32_OFFSET = 0;
+    constexpr GLintptr DISPATCH_64_OFFSET = 16;
+    constexpr GLintptr DISPATCH_256_OFFSET = 32;
+    constexpr GLintptr LIVE_COUNT_OFFSET = 12;        // Live count in the first record's padding
+    constexpr GLsizeiptr COUNT_RECORD_SIZE = 16;      // First record plus the live count
+    
+    constexpr uint32_t MAX_SINKS = 8;                 // Must match sph_step1.cs
+    constexpr float WALL_MARGIN = 0.5f;               // Container wall inset, SAFE_BOUNDS in sph_step1.cs
+    constexpr int OBSTACLE_FIELD_NODES_PER_CELL = 2;  // Signed distance texels per grid cell and axis
+    constexpr int OBSTACLE_FIELD_MAX_RESOLUTION = 128;
+    constexpr float SPHERE_IMPULSE_SCALE = 65536.0f;  // Fixed point coupling impulses, must match sph_step1.cs
+
+    constexpr uint32_t SCAN_BLOCK_SIZE = 512;         // Must match sph_step2.cs
+    constexpr uint32_t GRID_BLOCK_SIZE = 4;           // Hierarchical grid block edge in cells, must match sph_grid_blocks.cs
+    constexpr uint32_t GRID_BLOCK_CELLS = GRID_BLOCK_SIZE * GRID_BLOCK_SIZE * GRID_BLOCK_SIZE;
+    constexpr uint32_t RADIX_BLOCK_SIZE = 256;        // Must match sph_radix_sort.cs
+    constexpr uint32_t RADIX_BINS = 256;              // 8-bit digits per radix pass
+    constexpr uint32_t KERNEL_TABLE_SIZE = 1024;      // Kernel lookup entries over r^2 / h^2 in [0, 1]
+    constexpr int SMOOTH_ITERATIONS_PER_DISPATCH = 4; // Curvature flow apron, must match sph_smooth.cs
+    constexpr int SURFACE_MAX_RESOLUTION = 256;       // Marching cubes field nodes per axis
+    constexpr uint32_t SURFACE_MAX_TRIANGLES = 1u << 18; // Surface mesh capacity (32 bytes per vertex)
+    constexpr float SURFACE_FIELD_SCALE = 65536.0f;   // Fixed point scale of the splatted field
+    constexpr uint32_t DIFFUSE_PARTICLE_CAPACITY = 1u << 19; // Secondary particle ring, power of two
+    constexpr uint32_t DIFFUSE_BLOCK_SIZE = 256;      // Must match sph_diffuse.cs
+
+    constexpr uint32_t PHASE_BITS = 2;                // Phase index bits in the pressure (sph_tags.glsl)
+    constexpr uint32_t MAX_PHASES = 1u << PHASE_BITS;
+    constexpr float ADAPTIVE_MASS_SCALE = 2.0f;       // Coarse particle mass, must match sph_step5.cs/sph_step6.cs
+    constexpr float ADAPTIVE_RADIUS_SCALE = 1.25992105f; // Cube root of the mass scale, same density
+    constexpr uint32_t ADAPTIVE_SPLIT_BUDGET = 4096;  // Splits per adaptive pass
+    constexpr int ADAPTIVE_INTERVAL = 8;              // Substeps between adaptive passes
+    constexpr uint32_t NARROW_BAND_COLUMN_CELLS = 2;  // Grid cells on a side of a bulk column
+    constexpr float NARROW_BAND_HEIGHT_SCALE = 65536.0f; // Bulk height fixed point, must match sph_narrow_band.cs/sph_step1.cs
+    constexpr uint32_t NARROW_BAND_SEED_BUDGET = 4096; // Particles seeded per narrow band pass
+    constexpr int NARROW_BAND_INTERVAL = 8;           // Substeps between narrow band passes
+    constexpr uint32_t TIME_LEVEL_BITS = 2;           // Time level bits in the pressure (sph_tags.glsl)
+    constexpr uint32_t MULTIRATE_LEVELS = 1u << TIME_LEVEL_BITS; // Time levels DT to 8 DT (sph_time_levels.cs)
+    constexpr float MULTIRATE_CFL_FACTOR = 0.4f;      // Level step limit on h / speed (FORCE_FACTOR on acceleration)
+    constexpr int INDEX_SORT_GATHER_INTERVAL = 8;     // Substeps between index sort gathers
+    
+    // Checkpoint files: header, then the particle buffer at a page-aligned offset
+    constexpr uint32_t CHECKPOINT_VERSION = 1;
+    constexpr uint64_t CHECKPOINT_DATA_ALIGNMENT = 4096;
+    
+    // Rewind keyframes (sph_rewind.cs): the count buffer's dispatch records, then the particles
+    // quantized to 16 bytes each at an offset storage buffer ranges can bind
+    constexpr GLsizeiptr COUNT_BUFFER_SIZE = 48;      // Three dispatch records
+    constexpr GLsizeiptr KEYFRAME_HEADER_BYTES = 256;
+    constexpr GLsizeiptr KEYFRAME_PARTICLE_BYTES = 16;
+    constexpr GLsizeiptr keyframeBytes(uint32_t particles) {
+        return KEYFRAME_HEADER_BYTES + GLsizeiptr(particles) * KEYFRAME_PARTICLE_BYTES;
+    }
 }
 
+// Phase index, level bit and time level share the low mantissa bits of the pressure
+// (sph_tags.glsl); five bits keep the relative error below 4e-6
+static_assert(SPHConstants::PHASE_BITS + 1 + SPHConstants::TIME_LEVEL_BITS <= 5, "Particle tags must fit the pressure's five low mantissa bits");
+
+// Fluid parameters compiled into the neighbor-loop shaders (steps 4-6, PCISPH) as
+// #defines, so the kernel constants fold at compile time. Each distinct set is compiled
+// once and cached, so switching back to a previous set costs nothing.
+struct SPHShaderParameters {
+    float kernelRadius = SPHConstants::KERNEL_RADIUS; // Clamped to the grid cell size
+    float mass = SPHConstants::MASS;
+    float restDensity = SPHConstants::REST_DENSITY;
+    float stiffness = SPHConstants::STIFFNESS;
+    float viscosity = SPHConstants::VIS_COEFF;
+    uint32_t workGroupSize = 64;   // Steps 5-6 and PCISPH: 32, 64 or 256 (the indirect dispatch records)
+    bool kernelTable = false;      // Steps 5-6 interpolate tabulated kernels instead of sqrt/pow
+    // Step 5 equation of state: linear stiffness * (rho - rho0), or Tait B((rho/rho0)^gamma - 1)
+    // with an integer exponent unrolled into multiplies and B = stiffness * rho0 / gamma, so
+    // both agree near rest density and Tait only stiffens under compression
+    bool taitEquation = false;
+    int taitExponent = 7;          // 1-15
+    float pressureLimit = 50000.0f; // Step 5 clamps pressure to +-limit (Pa)
+    
+    bool operator==(const SPHShaderParameters& other) const {
+        return kernelRadius == other.kernelRadius && mass == other.mass && restDensity == other.restDensity &&
+               stiffness == other.stiffness && viscosity == other.viscosity && workGroupSize == other.workGroupSize &&
+               kernelTable == other.kernelTable && taitEquation == other.taitEquation &&
+               taitExponent == other.taitExponent && pressureLimit == other.pressureLimit;
+    }
+    bool operator!=(const SPHShaderParameters& other) const { return !(*this == other); }
+};
+
+// Secondary particle generation and dynamics (sph_diffuse.cs). Potentials are clamped to
+// their [min, max] range and mapped to [0, 1]; kinetic energy is per unit mass.
+struct SPHDiffuseParameters {
+    glm::vec2 trappedAirRange = glm::vec2(1.0f, 8.0f);
+    glm::vec2 waveCrestRange = glm::vec2(0.5f, 4.0f);
+    glm::vec2 kineticEnergyRange = glm::vec2(0.5f, 5.0f);
+    float trappedAirRate = 40.0f;   // Particles per fluid particle and second at full potential
+    float waveCrestRate = 40.0f;
+    glm::vec2 lifetimeRange = glm::vec2(1.0f, 3.0f); // Seconds
+    float sprayFill = 0.15f;        // Fluid occupancy around a particle, relative to a full
+    float bubbleFill = 0.7f;        // block of cells: spray below, bubbles above, foam between
+    float buoyancy = 2.0f;          // Bubble lift in units of gravity
+    float drag = 0.5f;              // Bubble velocity blend towards the fluid per frame
+};
+
+// One scene of a batched run (SPHComputeSystem::setBatchScenes); replaces the matching
+// SPHShaderParameters fields for that scene's particles
+struct SPHSceneParameters {
+    float stiffness = SPHConstants::STIFFNESS;
+    float viscosity = SPHConstants::VIS_COEFF;
+};
+
+// One fluid of a multiphase run (SPHComputeSystem::setPhases). A particle's phase index is
+// packed into the low mantissa bits of its pressure, so the 32-byte record keeps its size and
+// the one sort and neighbor pass carry it along
+struct SPHPhase {
+    float restDensity = SPHConstants::REST_DENSITY; // Particle mass scales with it at the shared spacing
+    float viscosity = SPHConstants::VIS_COEFF;
+    float interfaceTension = 0.0f;                  // Against the other phases; a pair uses the mean
+};
+
+// Fluid volume for SPHComputeSystem::seedVolume: a lattice filling the box minPos..maxPos,
+// or its points inside the sphere inscribed in that box (radius half the smallest extent)
+struct SPHSeedVolume {
+    enum Shape { BOX = 0, SPHERE = 1 };
+    Shape shape = BOX;
+    glm::vec3 minPos = glm::vec3(0.0f);
+    glm::vec3 maxPos = glm::vec3(0.0f);
+    float spacing = SPHConstants::PARTICLE_RADIUS * 2.0f;
+    float jitter = 0.0f;          // Random offset per particle, as a fraction of the spacing
+    glm::vec3 velocity = glm::vec3(0.0f);
+    uint32_t phase = 0;           // Multiphase index (SPHComputeSystem::setPhases)
+};
+
+// Rigid bodies step 1 collides the particles with (RigidBodySystem): the body state, the
+// per-body impulse sums and the body broadphase grid, whose cells are cellFactor SPH cells
+// on a side from the same origin
+struct SPHRigidBodies {
+    GLuint stateBuffer = 0;
+    GLuint impulseBuffer = 0;
+    GLuint gridBuffer = 0;
+    uint32_t count = 0;
+    glm::ivec3 gridRes = glm::ivec3(0);
+    int cellFactor = 1;
+    float friction = 0.5f;
+};
+
+// Wave heightfield the particles drain into (hybrid splashes, HeightfieldWaves): the height
+// texture and deposit buffer, their square grid centred on x = z = 0 at the undisturbed
+// water level, the depth below the surface at which particles are absorbed, and the
+// deposits' fixed-point units per world unit
+struct SPHHeightfieldCoupling {
+    GLuint heightTexture = 0;
+    GLuint depositBuffer = 0;
+    int resolution = 0;
+    float surfaceSize = 1.0f;
+    float waterLevel = 0.0f;
+    float bandDepth = 0.15f;
+    float depositScale = 1.0f;
+};
+
+// Checkpoint file header (little-endian, fixed-size fields). The particle records follow
+// at dataOffset in SPHParticleCompute layout, so restore uploads straight from the mapping.
+struct SPHCheckpointHeader {
+    char magic[8];                 // "WSPHCKPT"
+    uint32_t version;
+    uint32_t headerSize;
+    uint64_t dataOffset;
+    uint32_t particleCount;
+    uint32_t particleStride;
+    float gridOrigin[3];
+    float gridSize[3];
+    int32_t gridRes[3];
+    float gravity[3];
+    float accumulatedTime;
+    float timeStep;
+    double simulationTime;
+};
+
+// Host side of a rewind keyframe (SPHComputeSystem::captureKeyframe); the particles stay on
+// the GPU in the caller's buffer
+struct SPHKeyframe {
+    uint32_t particleCount = 0;
+    uint64_t removedParticles = 0;
+    glm::vec3 gravity = glm::vec3(0.0f);
+    float accumulatedTime = 0.0f;
+    float timeStep = 0.0f;
+    double simulationTime = 0.0;
+};
+
+// Particle storage used by the neighbor loops (steps 4-6)
+enum class SPHParticleLayout {
+    AOS,                    // Neighbors read the full 32-byte SPHParticleCompute record
+    SOA,                    // Sorted position/velocity/density-pressure streams mirror the AoS buffer
+    SOA_HALF_VELOCITY       // As SOA, with velocities packed to half precision
+};
+
 class SPHComputeSystem {
 public:
     SPHComputeSystem();
     ~SPHComputeSystem();
     
     // Initialize with particle count
-    bool initialize(uint32_t numParticles, const glm::vec3& boxMin, const glm::vec3& boxMax);
+    bool initialize(uint32_t numParticles, const glm::vec3& boxMin, const glm::vec3& boxMax,
+                    SPHParticleLayout layout = SPHParticleLayout::AOS);
     
     // Update simulation
     void update(float deltaTime);
@@ -59,17 +378,146 @@ public:
     // Render particles
     void render(const glm::mat4& view, const glm::mat4& projection);
     
+    // Secondary particles and the container glass, from the caller's transparent pass
+    // (WeightedOIT): blending is set by the pass, and the shaders write through oit.fs
+    void renderTransparent(const glm::mat4& view, const glm::mat4& projection);
+    
     // Reset simulation
     void reset();
     
-    // Add particles
+    // Drop every particle without seeding the dam break
+    void clear();
+    
+    // Checkpoint the particle buffer, counters, grid, gravity and time to a memory-mappable
+    // file, or restore one into the current buffers (grid parameters must match)
+    bool saveCheckpoint(const std::string& path);
+    bool loadCheckpoint(const std::string& path);
+    double getSimulationTime() const { return simulationTime_; }
+    
+    // Rewind keyframe of the particles, counters, gravity and time into a GPU buffer at offset
+    // (a multiple of 256, SPHConstants::keyframeBytes(getParticleCount()) free), without a
+    // stall. Restoring recomputes density on the next step; neither runs asynchronously
+    bool captureKeyframe(GLuint buffer, GLintptr offset, SPHKeyframe& keyframe);
+    bool restoreKeyframe(GLuint buffer, GLintptr offset, const SPHKeyframe& keyframe);
+    
+    // Stream every frameInterval-th updated frame to disk through an asynchronous exporter
+    bool startExport(const std::string& path, int frameInterval = 1);
+    void stopExport();
+    bool isExporting() const { return exporter_ != nullptr; }
+    
+    // Write every frameInterval-th updated frame as a PLY geometry cache (SPHCacheExporter):
+    // the particles, or the marching cubes surface, which needs the synchronous simulation.
+    // A frame the cache has no room for is retried on the next update; an offline run that
+    // must not skip any waits while isCacheBackedUp(), calling pollCache()
+    bool startCache(const std::string& basePath, bool surface, int frameInterval = 1);
+    void stopCache();
+    bool isCaching() const { return cache_ != nullptr; }
+    bool isCacheBackedUp() const;
+    void pollCache();
+    
+    // Asynchronous simulation: update() runs on a second, shared context and publishes
+    // each finished frame into a triple-buffered snapshot that render() draws from
+    void setRenderSnapshots(bool enable);
+    bool getRenderSnapshots() const { return renderSnapshots_; }
+    
+    // Release objects owned by the calling context (call on the updating thread before it exits)
+    void releaseContextResources();
+    
+    // Add particles (staged through the persistent ring, no allocation or pipeline stall)
     void addParticles(const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& velocities);
     
+    // Spawn count particles on a disk of the given radius, generated entirely on the GPU.
+    // Returns how many fit.
+    uint32_t emitStream(const glm::vec3& origin, const glm::vec3& velocity, float radius, uint32_t count);
+    
+    // Fill a volume with lattice particles computed on the GPU from the descriptor alone,
+    // appended after the live particles in x, y, z order (z fastest). Returns how many fit.
+    uint32_t seedVolume(const SPHSeedVolume& volume);
+    
     // Sphere interaction
     void applyImpulse(const glm::vec3& position, const glm::vec3& impulse, float radius);
     
-    // Getters
+    // Two-way sphere coupling: step 1 keeps the particles out of the sphere, matching their
+    // normal velocity to the sphere's and removing part of their tangential slip (friction),
+    // and sums the momentum that transfers into a four-word GPU buffer. A fenced readback a
+    // frame or two later turns that into the fluid's force on the sphere (pressure and drag,
+    // so buoyancy included) without reading any particle data back.
+    // setCoupledSphere is called every frame with the sphere's current state
+    void setUseSphereCoupling(bool enable);
+    bool getUseSphereCoupling() const { return useSphereCoupling_; }
+    void setCoupledSphere(const glm::vec3& center, const glm::vec3& velocity, float radius);
+    void setSphereFriction(float friction) { sphereFriction_ = std::min(std::max(friction, 0.0f), 1.0f); }
+    float getSphereFriction() const { return sphereFriction_; }
+    const glm::vec3& getSphereForce() const { return sphereForce_; }   // Zero until a readback arrives
+    uint32_t getSphereContacts() const { return sphereContacts_; }     // Particle contacts over that frame
+    
+    // WaterQueries in SPH mode: answers count vec4 points (SSBO) into WaterQueryResults from
+    // the grid of the last substep; false when there is no grid or program to answer with
+    bool dispatchWaterQuery(GLuint pointBuffer, GLuint resultBuffer, uint32_t count);
+    // FluidQueries: answers count FluidQuery entries (SSBO) into FluidQueryResults with a
+    // workgroup per query over the same grid; false likewise
+    bool dispatchSpatialQuery(GLuint queryBuffer, GLuint resultBuffer, uint32_t count);
+    
+    // Rigid bodies, any number, in the same step 1 pass: a particle tests only the bodies
+    // listed in its broadphase cell and adds what it pushes into the fluid to that body's
+    // impulse sum, which RigidBodySystem applies on the GPU. Set every frame; count 0 is off
+    void setRigidBodies(const SPHRigidBodies& bodies) { rigidBodies_ = bodies; }
+    
+    // Sinks: particles entering a box (and particles whose position is no longer finite)
+    // are removed in step 1 and compacted out by the step 3 reorder, which also updates
+    // the GPU live count, so freed slots are reused by later emits. Removal needs the
+    // reorder, so substeps run in grid mode instead of on Verlet lists while sinks exist.
+    // addSink returns the sink index, or -1 once MAX_SINKS are in use
+    int addSink(const glm::vec3& boxMin, const glm::vec3& boxMax);
+    void clearSinks();
+    size_t getSinkCount() const { return sinkMins_.size(); }
+    
+    // Heightfield coupling: step 1 removes particles below the band like a sink and adds
+    // their volume and vertical momentum to the heightfield's deposits. Set every frame
+    // (the height texture swaps); a zero heightTexture is off
+    void setHeightfieldCoupling(const SPHHeightfieldCoupling& coupling) { heightfieldCoupling_ = coupling; }
+    
+    // Static obstacles: analytic shapes baked, together with the container walls, into a
+    // signed distance field over the domain (sph_obstacle_sdf.cs), so step 1 collides with
+    // any number of them in one texture fetch per particle. The field is rebaked at the
+    // next update after a change. Off, step 1 only clamps to the walls. The add functions
+    // return the obstacle index
+    int addObstacleSphere(const glm::vec3& center, float radius);
+    int addObstacleBox(const glm::vec3& boxMin, const glm::vec3& boxMax);
+    void clearObstacles();
+    size_t getObstacleCount() const { return obstacles_.size() / 2; }
+    void setUseObstacleField(bool enable) { useObstacleField_ = enable; }
+    bool getUseObstacleField() const { return useObstacleField_; }
+    
+    // Batched scenes for parameter sweeps: independent copies of the container, each with
+    // its own stiffness and viscosity, side by side along +x in one grid and particle
+    // buffer, so every pass runs all of them in the same dispatches. The walls keep each
+    // particle in its scene's slab, which doubles as its scene id, and reset() fills every
+    // scene with the same dam break. Emitters, sinks and the spheres act in world space.
+    // Must be called before initialize(), whose box becomes the first scene's
+    void setBatchScenes(const std::vector<SPHSceneParameters>& scenes);
+    void setSceneParameters(uint32_t scene, const SPHSceneParameters& parameters);
+    const std::vector<SPHSceneParameters>& getSceneParameters() const { return sceneParameters_; }
+    
+    // Multiphase (oil/water, foam/water): up to MAX_PHASES fluids with their own rest density,
+    // viscosity and interface tension, read by steps 5 and 6 from a uniform block. Two or more
+    // phases compile the multiphase variants of steps 5-6, and reset() layers the dam break
+    // block, phase 0 at the bottom. Streams and added particles take the emit phase. PCISPH
+    // and the implicit viscosity solve carry the phases but treat the fluid as one
+    void setPhases(const std::vector<SPHPhase>& phases);
+    const std::vector<SPHPhase>& getPhases() const { return phases_; }
+    void setEmitPhase(uint32_t phase) { emitPhase_ = phase; }
+    uint32_t getEmitPhase() const { return emitPhase_; }
+    uint32_t getSceneCount() const { return std::max<uint32_t>(static_cast<uint32_t>(sceneParameters_.size()), 1u); }
+    glm::vec3 getSceneOffset(uint32_t scene) const { return glm::vec3(sceneStride_ * scene, 0.0f, 0.0f); }
+    
+    // Particles removed since reset, as far as the CPU has seen (asynchronous readbacks)
+    uint64_t getRemovedParticleCount() const { return removedParticles_; }
+    
+    // Getters (an upper bound of the GPU live count while removals are in flight)
     uint32_t getParticleCount() const { return numParticles_; }
+    uint32_t getParticleCapacity() const { return particleCapacity_; }  // Allocated, <= max
+    SPHParticleLayout getParticleLayout() const { return particleLayout_; }
     const glm::vec3& getBoxMin() const { return boxMin_; }
     const glm::vec3& getBoxMax() const { return boxMax_; }
     
@@ -78,20 +526,364 @@ public:
         COLOR_NORMAL = 0,
         COLOR_VELOCITY = 1,
         COLOR_DENSITY = 2,
-        COLOR_PRESSURE = 3
+        COLOR_PRESSURE = 3,
+        COLOR_PHASE = 4,
+        COLOR_MODE_COUNT
     };
     
+    // Each mode has its own compiled billboard and render stream variant, picked by the mode
     void setColorMode(ColorMode mode) { colorMode_ = mode; }
     ColorMode getColorMode() const { return colorMode_; }
     
+    // The final shading pass runs at these rates (ShadingRateImage::begin); null shades every pixel
+    void setShadingRateImage(const ShadingRateImage* rates) { shadingRates_ = rates; }
+    
+    // The screen-space depth pass splats each particle's motion since the last frame, seen
+    // through the unjittered cameras of the two frames, into getMotionTexture (window UV)
+    void setMotionVectors(bool enable, const glm::mat4& viewProjection = glm::mat4(1.0f),
+                          const glm::mat4& previousViewProjection = glm::mat4(1.0f), float frameTime = 0.0f) {
+        motionVectors_ = enable;
+        motionViewProjection_ = viewProjection;
+        previousViewProjection_ = previousViewProjection;
+        motionFrameTime_ = frameTime;
+    }
+    GLuint getMotionTexture() const { return motionTexture_; }
+    
+    // Particle reordering strategy (step 3)
+    enum SortMode {
+        SORT_ATOMIC_SCATTER = 0, // Scatter through per-cell atomic cursors (unordered within a cell)
+        SORT_MORTON_RADIX = 1    // Stable GPU radix sort by Z-order cell key
+    };
+    
+    void setSortMode(SortMode mode) { sortMode_ = mode; }
+    SortMode getSortMode() const { return sortMode_; }
+    
+    // Deterministic mode for reproducible benchmarks: the same input and update sequence
+    // gives bit-identical particle state. Step 3 always uses the stable radix sort, so each
+    // cell keeps its particles in the previous substep's order and every neighbor loop sums
+    // in a fixed order; Verlet lists (atomically binned) and the adaptive time step (fed by
+    // asynchronous readbacks) are bypassed, and readbacks are consumed at a fixed frame
+    // latency. Secondary particles are not covered; they never feed back into the fluid
+    void setDeterministic(bool enable) { deterministic_ = enable; }
+    bool getDeterministic() const { return deterministic_; }
+    
+    // FNV-1a hash of the live particle records, to compare runs (blocks on the GPU)
+    uint64_t computeStateHash();
+    
+    // Fused grid clear: step 1 clears only the cells touched in the previous substep
+    // instead of a full-volume clear + barrier per substep
+    void setUseFusedGridClear(bool enable) { useFusedGridClear_ = enable; cellCountsDirty_ = true; }
+    bool getUseFusedGridClear() const { return useFusedGridClear_; }
+    
+    // Verlet neighbor lists: steps 5 and 6 read a per-particle list that is rebuilt only
+    // when a particle has moved more than half of SPHConstants::NEIGHBOR_SKIN
+    void setUseNeighborLists(bool enable);
+    bool getUseNeighborLists() const { return useNeighborLists_; }
+    void setNeighborLimit(uint32_t limit) { neighborLimit_ = limit; } // Must be called before initialize()
+    
+    // Sparse domain: step 1 appends each newly occupied cell to an active-cell list and
+    // step 4 runs indirectly over that list into a compact velocity buffer, instead of over
+    // every voxel into a dense 3D texture. Must be called before initialize()
+    void setUseSparseDomain(bool enable) { useSparseDomain_ = enable; }
+    bool getUseSparseDomain() const { return useSparseDomain_; }
+    
+    // Hierarchical grid: step 1 flags coarse blocks of GRID_BLOCK_SIZE^3 cells and fine cells
+    // are allocated only inside the occupied ones, so the cell buffers and the step 2 scan
+    // scale with the fluid instead of the container; neighbor walks skip empty blocks. The
+    // sparse domain, tiled loop, sleeping, fused clear and Verlet lists index the dense grid
+    // and stay off. Must be called before initialize()
+    void setUseHierarchicalGrid(bool enable) { useHierarchicalGrid_ = enable; }
+    bool getUseHierarchicalGrid() const { return useHierarchicalGrid_; }
+    
+    // Adaptive resolution (WCSPH with explicit viscosity): every ADAPTIVE_INTERVAL substeps,
+    // close pairs of interior particles beyond the detail distance from the camera merge
+    // into one coarse particle of twice the mass and a larger kernel, and coarse particles
+    // at the surface or nearer than 3/4 of the detail distance split again. Steps 5 and 6
+    // weigh each pair by the two levels; the grid cell grows to the coarse kernel radius.
+    // Must be called before initialize()
+    void setAdaptiveResolution(bool enable) { adaptiveResolution_ = enable; }
+    bool getAdaptiveResolution() const { return adaptiveResolution_; }
+    void setAdaptiveMergeDensityRatio(float ratio) { adaptiveMergeDensityRatio_ = ratio; }
+    float getAdaptiveMergeDensityRatio() const { return adaptiveMergeDensityRatio_; }
+    void setAdaptiveDetailDistance(float distance) { adaptiveDetailDistance_ = std::max(distance, 0.0f); }
+    float getAdaptiveDetailDistance() const { return adaptiveDetailDistance_; }
+    
+    // Narrow band (deep pools): particles are kept only in a band bandDepth kernel radii
+    // thick below the free surface, over a hydrostatic bulk held as water heights on a
+    // coarse xz grid of columns NARROW_BAND_COLUMN_CELLS cells on a side. Every
+    // NARROW_BAND_INTERVAL substeps a column whose band is a layer too thick absorbs its
+    // bottom layer into the bulk, and one a layer too thin gets a layer seeded back out of
+    // it, so volume is conserved to the particle. Step 1 rests the band on the bulk's top
+    // and pushes it down the top's slope. reset() fills a resting pool and seedVolume()
+    // moves the depth of a box on the floor below the band straight into the bulk.
+    // Absorbing needs the step 3 compaction, so the Verlet lists stay off; batched scenes
+    // and deterministic mode keep every particle. Must be called before reset()
+    void setNarrowBand(bool enable) { narrowBand_ = enable; }
+    bool getNarrowBand() const { return narrowBand_; }
+    void setNarrowBandDepth(float kernelRadii) { narrowBandDepth_ = std::max(kernelRadii, 1.0f); }
+    float getNarrowBandDepth() const { return narrowBandDepth_; }
+    
+    // Multirate time stepping (WCSPH with explicit viscosity): each particle advances by
+    // DT * 2^L at time level L < MULTIRATE_LEVELS, chosen in step 6 from its own speed and
+    // acceleration and at most one level above its neighbors. Step 1 integrates only the
+    // levels due in a substep and step 6 runs indirectly over a compacted list of them;
+    // DT still bounds the finest level. The tiled loop and sleeping stay off
+    void setUseMultirate(bool enable) { useMultirate_ = enable; }
+    bool getUseMultirate() const { return useMultirate_; }
+    
+    // Index-only sort: step 3 bins just the particle indices into the cell slots and the
+    // neighbor loops read through them, so the particles stay in storage order and there is
+    // a single particle buffer. Every INDEX_SORT_GATHER_INTERVAL substeps (and after an
+    // adaptive pass) a gather reorders the particles by cell and compacts out the removed
+    // ones, which step 1 defers to those substeps. Sorts by atomic scatter only, so neither
+    // the Morton sort nor deterministic mode apply; the tiled loop and sleeping stay off.
+    // Must be called before initialize()
+    void setUseIndexSort(bool enable) { useIndexSort_ = enable; }
+    bool getUseIndexSort() const { return useIndexSort_; }
+    
+    // Morton cell addressing: the cell count/start buffers hold the grid as GRID_BLOCK_SIZE^3
+    // bricks, row-major, each brick's cells in Morton order (denseCell in the grid shaders;
+    // the hierarchical grid's blocks order their cells the same way), so the 27-cell walk of
+    // every pass and query stays within a few cache lines. The buffers pad the grid to whole
+    // bricks. The tiled loop reads cell rows as contiguous ranges, so it and sleeping stay
+    // off. Must be called before initialize()
+    void setUseMortonCells(bool enable) { useMortonCells_ = enable; }
+    bool getUseMortonCells() const { return useMortonCells_; }
+    
+    // Tiled neighbor loop: steps 5 and 6 run one workgroup per active cell and share the
+    // neighbor particles through shared memory (grid mode only; lists take precedence)
+    void setUseTiledNeighborLoop(bool enable) { useTiledNeighborLoop_ = enable; }
+    bool getUseTiledNeighborLoop() const { return useTiledNeighborLoop_; }
+    
+    // Particle sleeping (tiled neighbor loop, WCSPH): a cell whose particles stay slower than
+    // the velocity threshold, with densities changing by less than the relative threshold,
+    // for the given number of substeps falls asleep. Its particles are held still and it
+    // drops out of the active-cell dispatches of steps 4-6 until motion in it or in any of
+    // its 26 neighbors wakes it
+    void setUseParticleSleeping(bool enable) { useParticleSleeping_ = enable; }
+    bool getUseParticleSleeping() const { return useParticleSleeping_; }
+    void setSleepThresholds(float velocity, float densityChange, int substeps);
+    float getSleepVelocity() const { return sleepVelocity_; }
+    float getSleepDensityChange() const { return sleepDensityChange_; }
+    int getSleepSubsteps() const { return sleepSubsteps_; }
+    
+    // Fluid parameters: recompiles (or reuses cached) shader variants. Before initialize()
+    // the set is only stored. Returns false and keeps the current set if a variant fails
+    bool setShaderParameters(const SPHShaderParameters& parameters);
+    const SPHShaderParameters& getShaderParameters() const { return shaderParameters_; }
+    
+    // Time steps 5 and 6 with analytic and tabulated kernels on the current particle state
+    // and compare their results; the state is restored afterwards. Call after update()
+    SPHKernelBenchmark benchmarkKernels(int repetitions);
+    
+    // Scaling measurements. While profiling, every substep writes a timestamp after each of
+    // its passes; takePassProfile() waits for them and returns the totals since the last take
+    void setPassProfiling(bool enable);
+    bool getPassProfiling() const { return passProfiling_; }
+    SPHPassProfile takePassProfile();
+    
+    // Reads the last substep's cell counts and the particles back: occupancy of every cell,
+    // and neighbors within the kernel radius of up to sampleCount particles spread over the
+    // buffer. Stalls; for benchmarks. Call after update()
+    SPHGridOccupancy measureGridOccupancy(uint32_t sampleCount = 65536);
+    
+#ifdef SPH_GPU_COUNTERS
+    // Counters of the newest update whose readback has landed, a few frames late and
+    // without stalling, like the statistics
+    const SPHCounters& getCounters() const { return counters_; }
+#endif
+    
+    // Grid cell edge, at least the kernel radius since the search spans 3x3x3 cells. Must
+    // be called before initialize()
+    void setCellSize(float size) { cellSize_ = std::max(size, SPHConstants::KERNEL_RADIUS); }
+    float getCellSize() const { return cellSize_; }
+    glm::ivec3 getGridResolution() const { return gridRes_; }
+    const glm::vec3& getGridOrigin() const { return gridOrigin_; }
+    float getGridCellSize() const { return gridCellSize_; }     // Once initialized
+    
+    // Pick the steps 5-6 / PCISPH workgroup size for this GPU and pipeline mode: the cached
+    // winner if there is one, otherwise each candidate is timed on one substep of the
+    // current particles (state restored afterwards) and the fastest is cached. Call after
+    // initialize(); returns the size in use
+    int autotuneWorkGroupSize(ComputeAutotuner& tuner, int repetitions = 8);
+    
+    // Subgroup operations (GL_KHR_shader_subgroup ballot and arithmetic) for the grid scan,
+    // the statistics reduction, active-cell compaction and the PCISPH error maximum, with
+    // the shared-memory/atomic paths as fallback. Must be called before initialize()
+    void setUseSubgroups(bool enable) { useSubgroups_ = enable; }
+    bool getUseSubgroups() const { return !subgroupDefines_.empty(); }
+    
+    // Pressure solver: the weakly compressible equation of state in step 6, or PCISPH
+    // iterating predicted density to rest density (allows larger steps; grid mode only)
+    enum PressureSolver {
+        PRESSURE_WCSPH = 0,
+        PRESSURE_PCISPH = 1
+    };
+    
+    void setPressureSolver(PressureSolver solver) { pressureSolver_ = solver; }
+    PressureSolver getPressureSolver() const { return pressureSolver_; }
+    void setPCISPHIterations(int minIterations, int maxIterations) { pcisphMinIterations_ = std::max(minIterations, 1); pcisphMaxIterations_ = std::max(maxIterations, pcisphMinIterations_); }
+    void setPCISPHErrorThreshold(float threshold) { pcisphErrorThreshold_ = threshold; }
+    
+    // Implicit viscosity: backward Euler viscosity by matrix-free conjugate gradients after
+    // the pressure pass, in place of the explicit term, so honey or mud runs at the water
+    // timestep (grid mode: bypasses the Verlet lists and particle sleeping)
+    void setImplicitViscosity(bool enable);
+    bool getImplicitViscosity() const { return implicitViscosity_; }
+    void setViscosityIterations(int maxIterations) { viscosityMaxIterations_ = std::max(maxIterations, 1); }
+    void setViscosityTolerance(float tolerance) { viscosityTolerance_ = tolerance; }
+    
+    // Time stepping: per-frame substep cap, what to do with time left over when the cap
+    // is hit, and CFL-driven dt from a GPU max-speed reduction read back a few frames late
+    enum SubstepOverflow {
+        OVERFLOW_DROP_TIME = 0,  // Discard the backlog (simulation runs slower than real time)
+        OVERFLOW_CARRY = 1       // Carry the backlog, bounded to one frame's worth of substeps
+    };
+    
+    void setAdaptiveTimeStep(bool enable) { adaptiveTimeStep_ = enable; }
+    bool getAdaptiveTimeStep() const { return adaptiveTimeStep_; }
+    void setMaxSubsteps(int substeps) { maxSubsteps_ = std::max(substeps, 1); }
+    // Frame budget degradation: fractions of the max substeps and curvature flow iterations
+    // that run, leaving the settings themselves alone
+    void setSubstepBudget(float fraction) { substepBudget_ = std::max(0.0f, std::min(fraction, 1.0f)); }
+    void setCurvatureFlowBudget(float fraction) { curvatureFlowBudget_ = std::max(0.0f, std::min(fraction, 1.0f)); }
+    void setSubstepOverflow(SubstepOverflow policy) { substepOverflow_ = policy; }
+    void setTimeStepLimits(float minTimeStep, float velocityLimit) { minTimeStep_ = minTimeStep; velocityLimit_ = velocityLimit; }
+    float getTimeStep() const { return timeStep_; }
+    int getLastSubstepCount() const { return lastSubstepCount_; }
+    
+    // Asynchronous diagnostics: the statistics reduction also runs when this is off but
+    // adaptive time stepping needs the max speed; the log line is only printed when on
+    void setStatisticsEnabled(bool enable) { statisticsEnabled_ = enable; }
+    bool getStatisticsEnabled() const { return statisticsEnabled_; }
+    const SPHStatistics& getStatistics() const { return statistics_; }
+    
+    // GPU time of the last measured simulation update (all substeps), in milliseconds
+    float getSimulationTimeMs() const { return simulationTimeMs_; }
+    
     // Gravity control
-    void setGravity(const glm::vec3& gravity) { gravity_ = gravity; }
+    void setGravity(const glm::vec3& gravity) { sleepStateDirty_ |= gravity != gravity_; gravity_ = gravity; }
     const glm::vec3& getGravity() const { return gravity_; }
     
+    // Fraction of the normal velocity a particle keeps when it bounces off a wall or obstacle
+    void setBoundaryDamping(float damping) { wallDamping_ = glm::clamp(damping, 0.0f, 1.0f); }
+    float getBoundaryDamping() const { return wallDamping_; }
+    
+    // Surface tension coefficient of the Akinci cohesion and curvature forces step 6 adds
+    // (0 disables them and step 5's normal pass). The weakly compressible solver only
+    void setSurfaceTension(float tension) { surfaceTension_ = std::max(tension, 0.0f); }
+    float getSurfaceTension() const { return surfaceTension_; }
+    
     // Enable/disable features
+    // Filtered viscosity: step 6 takes the viscosity from step 4's half-resolution velocity
+    // field, one fetch per particle, instead of summing it over the neighbors. Grid passes
+    // of the weakly compressible solver only
     void setUseFilteredViscosity(bool enable) { useFilteredViscosity_ = enable; }
     void setCurvatureFlowIterations(int iterations) { curvatureFlowIterations_ = iterations; }
     
+    // Screen-space depth smoothing: curvature flow as one fragment pass per iteration, or
+    // in a compute shader that fuses SMOOTH_ITERATIONS_PER_DISPATCH iterations per dispatch
+    // in shared memory, or a cheaper separable narrow-range bilateral filter
+    enum SmoothingMode {
+        SMOOTH_CURVATURE_FLOW_FRAGMENT = 0,
+        SMOOTH_CURVATURE_FLOW_COMPUTE = 1,
+        SMOOTH_BILATERAL = 2
+    };
+    
+    void setSmoothingMode(SmoothingMode mode) { smoothingMode_ = mode; }
+    SmoothingMode getSmoothingMode() const { return smoothingMode_; }
+    void setBilateralParameters(float sigmaSpace, float sigmaDepth) { bilateralSigmaSpace_ = sigmaSpace; bilateralSigmaDepth_ = sigmaDepth; }
+    
+    // GPU culling of the particle draws: a compute pass keeps the particles inside the view
+    // frustum and, on the screen-space path, not hidden behind the previous frame's particle
+    // depth (Hi-Z pyramid, reprojected), and the draws run indirectly over the survivors
+    void setUseParticleCulling(bool enable) { useParticleCulling_ = enable; hiZValid_ = false; }
+    bool getUseParticleCulling() const { return useParticleCulling_; }
+    
+    // Render stream: after a frame's last substep the particles are packed into 8 bytes each,
+    // 16-bit positions across the container bounds plus the color mode's 8-bit attribute,
+    // and the billboard draws read that instead of the simulation buffer. Falls back to the
+    // particles until the stream matches the current count and color mode, and with
+    // render snapshots, which draw another context's copy
+    void setUseRenderStream(bool enable) { useRenderStream_ = enable; }
+    bool getUseRenderStream() const { return useRenderStream_; }
+    
+    // Render interpolation between fixed simulation ticks (SimulationClock): render() draws
+    // the particles this many seconds before the last update, a copy taken back along their
+    // velocities (sph_interpolate.cs) once per call of this, which the other views then
+    // share. 0 draws the simulation buffer; ignored with render snapshots, and the render
+    // stream is bypassed while it is in use
+    void setRenderLag(float seconds) { renderLag_ = std::max(seconds, 0.0f); renderLagApplied_ = false; }
+    void setUseOcclusionCulling(bool enable) { useOcclusionCulling_ = enable; hiZValid_ = false; }
+    bool getUseOcclusionCulling() const { return useOcclusionCulling_; }
+    
+    // Surface splatting (needs particle culling): the cull pass classifies particles whose
+    // step 5 density is below ratio * rest density as surface; only those are splatted into
+    // the depth target, and the interior is drawn into a half-resolution thickness target
+    void setUseSurfaceSplatting(bool enable) { useSurfaceSplatting_ = enable; hiZValid_ = false; }
+    bool getUseSurfaceSplatting() const { return useSurfaceSplatting_; }
+    void setSurfaceDensityRatio(float ratio) { surfaceDensityRatio_ = ratio; }
+    float getSurfaceDensityRatio() const { return surfaceDensityRatio_; }
+    
+    // Compute splatting of the screen-space depth (sph_depth_splat.cs): one thread per
+    // particle writes its sphere's depth with atomics instead of drawing two triangles. The
+    // smoothing passes read the result as they read the raster depth. Frames that need fluid
+    // motion vectors (the temporal upscale) draw the triangles, which also write the motion
+    void setUseComputeSplat(bool enable) { useComputeSplat_ = enable; }
+    bool getUseComputeSplat() const { return useComputeSplat_; }
+    
+    // How render() draws the fluid: particle billboards, the screen-space pipeline, or a
+    // marching cubes mesh extracted on the GPU from the splatted particle density
+    enum RenderMode {
+        RENDER_POINTS = 0,
+        RENDER_SCREEN_SPACE = 1,
+        RENDER_SURFACE_MESH = 2
+    };
+    
+    void setRenderMode(RenderMode mode) { renderMode_ = mode; }
+    RenderMode getRenderMode() const { return renderMode_; }
+    
+    // Surface mesh: field nodes per grid cell along each axis (1-4, the node count is capped
+    // at SURFACE_MAX_RESOLUTION) and the volume fraction the surface is drawn at
+    void setSurfaceResolution(int nodesPerCell) { surfaceResolution_ = std::min(std::max(nodesPerCell, 1), 4); }
+    int getSurfaceResolution() const { return surfaceResolution_; }
+    void setSurfaceIsoLevel(float level) { surfaceIsoLevel_ = level; }
+    float getSurfaceIsoLevel() const { return surfaceIsoLevel_; }
+    
+    // The mesh render() last extracted, for passes that draw the fluid from other views
+    // (reflection, shadow, G-buffer): a DrawArraysIndirectCommand at offset 0, then
+    // world-space vec4 position / vec4 normal pairs, laid out as SSBO binding 30 of
+    // sph_surface.vs. renderSurfaceMesh draws it with the surface shading
+    void renderSurfaceMesh(const glm::mat4& view, const glm::mat4& projection);
+    GLuint getSurfaceMeshBuffer() const { return surfaceMeshValid_ ? surfaceMeshBuffer_ : 0; }
+    
+    // Smoothed window depth of the screen-space pipeline's last render(), at the fluid render
+    // scale (0 or 1 off the fluid), for passes that reuse the surface with the same camera
+    GLuint getSmoothedDepthTexture() const { return renderMode_ == RENDER_SCREEN_SPACE ? smoothTexture_[finalSmoothedBuffer_] : 0; }
+    
+    // Particles render() last drew (SSBO binding 0 of sph_depth.vs) with their live count
+    // record (binding 24) and CPU upper bound, for passes drawing them from other views
+    GLuint getRenderParticleBuffer() const { return renderBuffer_; }
+    GLuint getRenderCountBuffer() const { return renderCountBuffer_; }
+    uint32_t getRenderParticleCount() const { return renderCount_; }
+    
+    // Baked playback (SPHPlayback): render() draws these particles with their live count
+    // record in place of the simulation's; a zero buffer draws the simulation again
+    void setPlaybackSource(GLuint particleBuffer, GLuint countBuffer, uint32_t count) {
+        playbackBuffer_ = particleBuffer;
+        playbackCountBuffer_ = countBuffer;
+        playbackCount_ = count;
+    }
+    
+    // Secondary particles (Ihmsen et al. 2012): steps 5 and 6 also compute trapped-air and
+    // wave-crest potentials, fast fluid particles seed spray, foam and bubbles from them into
+    // a fixed-capacity GPU ring, and render() draws the ring as instanced billboards. The wave
+    // crest needs step 6, so under PCISPH only trapped air spawns particles
+    void setUseDiffuseParticles(bool enable);
+    bool getUseDiffuseParticles() const { return useDiffuseParticles_; }
+    void setDiffuseParameters(const SPHDiffuseParameters& parameters) { diffuseParameters_ = parameters; }
+    const SPHDiffuseParameters& getDiffuseParameters() const { return diffuseParameters_; }
+    
     // Container rendering
     void setRenderContainer(bool render) { renderContainer_ = render; }
     bool getRenderContainer() const { return renderContainer_; }
@@ -99,10 +891,17 @@ public:
     // Window resize handling
     void onWindowResize(int width, int height);
     
+    // Resolution of the screen-space fluid targets (depth, smoothing, thickness, Hi-Z)
+    // relative to the window, 0.25-1; the final shading pass upsamples the smoothed depth
+    // with a joint bilateral filter guided by the low-resolution depth
+    void setFluidRenderScale(float scale);
+    float getFluidRenderScale() const { return fluidRenderScale_; }
+    
 private:
     // Particle data
     uint32_t numParticles_;
-    uint32_t maxParticles_;
+    uint32_t maxParticles_;          // Capacity ceiling (config and device limits)
+    uint32_t particleCapacity_ = 0;  // Allocated per-particle storage, grown by reserveParticles
     
     // Simulation bounds
     glm::vec3 boxMin_;
@@ -117,19 +916,260 @@ private:
     float sphereRadius_;
     bool sphereActive_;
     
+    // Two-way coupled sphere, with its impulse sum read back like the statistics
+    bool useSphereCoupling_ = true;
+    bool coupledSphereValid_ = false;      // setCoupledSphere called since coupling was enabled
+    glm::vec3 coupledSphereCenter_ = glm::vec3(0.0f);
+    glm::vec3 coupledSphereVelocity_ = glm::vec3(0.0f);
+    float coupledSphereRadius_ = 0.0f;
+    float sphereFriction_ = 0.5f;
+    GLuint sphereImpulseBuffer_ = 0;       // Summed fixed point momentum and contact count
+    GLuint sphereReadbackBuffers_[SPHConstants::READBACK_FRAMES] = {};
+    void* sphereReadbackPointers_[SPHConstants::READBACK_FRAMES] = {};
+    GLsync sphereReadbackFences_[SPHConstants::READBACK_FRAMES] = {};
+    float sphereReadbackDurations_[SPHConstants::READBACK_FRAMES] = {}; // Simulated time each slot covers
+    uint32_t sphereReadbackWriteIndex_ = 0;
+    glm::vec3 sphereForce_ = glm::vec3(0.0f);
+    uint32_t sphereContacts_ = 0;
+    
+    // Rigid bodies of the step 1 coupling, buffers owned by RigidBodySystem
+    SPHRigidBodies rigidBodies_;
+    
+#ifdef SPH_GPU_COUNTERS
+    // Instrumentation counters, cleared every substep and read back after the last
+    SPHCounters counters_;
+    GLuint counterBuffer_ = 0;
+    GLuint counterReadbackBuffers_[SPHConstants::READBACK_FRAMES] = {};
+    void* counterReadbackPointers_[SPHConstants::READBACK_FRAMES] = {};
+    GLsync counterReadbackFences_[SPHConstants::READBACK_FRAMES] = {};
+    uint32_t counterReadbackWriteIndex_ = 0;
+#endif
+    
     // Grid parameters
+    float cellSize_ = SPHConstants::CELL_SIZE;   // Requested; gridCellSize_ once initialized
     float gridCellSize_;
     glm::vec3 gridOrigin_;
     glm::vec3 gridSize_;
     glm::ivec3 gridRes_;
     
     // OpenGL resources
-    GLuint particleBuffers_[2]; // Double buffering
+    GLuint particleBuffers_[2]; // Double buffering; the index sort creates only the first
     GLuint particleVAO_;
-    GLuint billboardIndexBuffer_; // Index buffer for billboard quads
-    GLuint gridTexture_ = 0;
-    GLuint counterBuffer_ = 0;  // For atomic counters
-    GLuint velocityTexture_ = 0; // For filtered velocity field
+    GLuint cellCountBuffer_ = 0;   // Particles per grid cell (filled by step 1)
+    GLuint previousCellCountBuffer_ = 0; // Last substep's counts, cleared by step 1 in fused mode
+    bool useFusedGridClear_ = true;
+    bool fuseGridClear_ = false;   // Fused clear active for the current substep
+    bool useTiledNeighborLoop_ = false;
+    bool tiledNeighborPass_ = false; // Tiled steps 5/6 active for the current substep
+    bool cellCountsDirty_ = true;  // Forces a full clear of both count buffers
+    GLuint cellStartBuffer_ = 0;   // Exclusive prefix sum of cell counts (step 2)
+    GLuint cellCursorBuffer_ = 0;  // Per-cell write cursor for reordering (step 3)
+    GLuint scanBlockSumBuffer_ = 0; // Per-workgroup totals for the prefix scan
+    uint32_t cellCount_ = 0;       // Cells in the count/start/cursor buffers (the block pool when hierarchical)
+    uint32_t scanBlockCount_ = 0;
+    
+    // Hierarchical grid: coarse block table and the fine cell pool it allocates from
+    bool useHierarchicalGrid_ = false;
+    glm::uvec3 gridBlockDim_ = glm::uvec3(0);
+    uint32_t gridBlockCount_ = 0;
+    uint32_t gridBlockCapacity_ = 0;   // Pool slots of GRID_BLOCK_CELLS cells each
+    GLuint blockSlotBuffer_ = 0;       // Per block: pool slot + 1, 0 when empty
+    GLuint blockStateBuffer_ = 0;      // Allocated slot counter
+    GLuint gridBlockProgram_ = 0;
+    
+    // Adaptive resolution: merge/split pass and the camera it refines toward
+    bool adaptiveResolution_ = false;
+    bool adaptivePass_ = false;        // Merge/split pass due in the current substep
+    int adaptiveSubsteps_ = 0;         // Substeps since the last adaptive pass
+    float adaptiveMergeDensityRatio_ = 1.0f;
+    float adaptiveDetailDistance_ = 2.0f;
+    glm::vec3 cameraPosition_ = glm::vec3(0.0f);
+    GLuint adaptiveProgram_ = 0;
+    
+    // Narrow band: bulk columns under the particle band and the pass that trades with them
+    bool narrowBand_ = false;
+    bool narrowBandPass_ = false;      // Exchange pass due in the current substep
+    int narrowBandSubsteps_ = 0;       // Substeps since the last narrow band pass
+    float narrowBandDepth_ = 3.0f;     // Band thickness in kernel radii
+    glm::ivec2 bulkColumnRes_ = glm::ivec2(0);
+    GLuint bulkColumnBuffer_ = 0;      // Per column: bulk height, band count, absorb mark
+    GLuint narrowBandProgram_ = 0;
+    
+    // Multirate time stepping: due particle list and its indirect step 6 dispatch
+    bool useMultirate_ = false;
+    bool multiratePass_ = false;       // Time levels active for the current substep
+    uint32_t multirateSubstep_ = 0;    // Substep index the level schedules run on
+    GLuint dueParticleBuffer_ = 0;
+    GLuint dueDispatchBuffer_ = 0;     // DispatchIndirectCommand, due count in its padding
+    GLuint timeLevelProgram_ = 0;
+    
+    // Index-only sort: cell slot indices in sortedIndexBuffer_, gathered every few substeps
+    bool useMortonCells_ = false;      // Brick-swizzled cell addressing (SPH_MORTON_CELLS)
+    bool useIndexSort_ = false;
+    bool gatherPass_ = false;          // Step 3 gathers the particles in the current substep
+    int gatherSubsteps_ = 0;           // Substeps since the last gather
+    GLuint gatherProgram_ = 0;
+    
+    // Rewind keyframe quantization (sph_rewind.cs)
+    GLuint rewindPackProgram_ = 0;
+    GLuint rewindUnpackProgram_ = 0;
+    
+    // Structure-of-arrays neighbor streams (SPHParticleLayout::SOA*)
+    SPHParticleLayout particleLayout_ = SPHParticleLayout::AOS;
+    GLuint soaPositionBuffer_ = 0;
+    GLuint soaVelocityBuffer_ = 0;
+    GLuint soaDensityPressureBuffer_ = 0;
+    
+    // Adaptive time stepping
+    bool adaptiveTimeStep_ = false;
+    int maxSubsteps_ = 20;
+    float substepBudget_ = 1.0f;
+    float curvatureFlowBudget_ = 1.0f;
+    SubstepOverflow substepOverflow_ = OVERFLOW_DROP_TIME;
+    float minTimeStep_ = 0.0001f;
+    float velocityLimit_ = 50.0f;
+    float wallDamping_ = 0.5f;
+    float surfaceTension_ = 0.0f;
+    float timeStep_ = SPHConstants::DT;
+    int lastSubstepCount_ = 0;
+    float estimatedMaxAcceleration_ = 0.0f;
+    
+    // PCISPH pressure solver
+    PressureSolver pressureSolver_ = PRESSURE_WCSPH;
+    int pcisphMinIterations_ = 3;
+    int pcisphMaxIterations_ = 8;
+    float pcisphErrorThreshold_ = 0.01f;   // Relative density error
+    float pcisphDeltaBase_ = 0.0f;         // Pressure scaling factor times dt^2
+    GLuint pcisphParticleBuffer_ = 0;      // Predicted position/pressure and accelerations
+    GLuint pcisphStateBuffer_ = 0;         // Max error, converged flag, iteration count
+    
+    // Implicit viscosity solve
+    bool implicitViscosity_ = false;
+    int viscosityMaxIterations_ = 30;
+    float viscosityTolerance_ = 0.001f;    // Relative preconditioned residual
+    GLuint viscosityProgram_ = 0;
+    GLuint viscositySolverBuffer_ = 0;     // x, r, p and Ap per particle (four vec4s)
+    GLuint viscosityPartialBuffer_ = 0;    // One dot product partial per workgroup
+    GLuint viscosityStateBuffer_ = 0;      // Dot products, CG step sizes, converged flag, iterations
+    GLuint viscosityWarmStartBuffers_[2] = {}; // Last velocity change, ping-ponged with particleBuffers_
+    GLuint kernelTableBuffer_ = 0;         // Tabulated kernels (vec4 per entry, see sph_step5.cs)
+    
+    // Secondary particles
+    bool useDiffuseParticles_ = false;
+    SPHDiffuseParameters diffuseParameters_;
+    GLuint diffusePotentialBuffer_ = 0;    // Per particle: normal, trapped air, wave crest
+    GLuint surfaceNormalBuffer_ = 0;       // Per particle: surface tension color-field normal
+    GLuint diffuseParticleBuffer_ = 0;     // Ring of DIFFUSE_PARTICLE_CAPACITY particles
+    GLuint diffuseStateBuffer_ = 0;        // Indirect draw command, then the spawn head
+    GLuint diffuseCellBuffer_ = 0;         // Per cell: fluid count and summed velocity
+    GLuint diffuseProgram_ = 0;
+    GLuint diffuseRenderProgram_ = 0;
+    uint32_t diffuseFrame_ = 0;
+    bool diffuseStateDirty_ = true;        // Empties the ring before the next spawn
+    
+    // GPU statistics and their fenced, persistently mapped readback ring
+    bool statisticsEnabled_ = false;
+    SPHStatistics statistics_;
+    GLuint statisticsBuffer_ = 0;
+    GLuint statisticsPartialBuffer_ = 0;
+    GLuint readbackBuffers_[SPHConstants::READBACK_FRAMES] = {};
+    void* readbackPointers_[SPHConstants::READBACK_FRAMES] = {};
+    GLsync readbackFences_[SPHConstants::READBACK_FRAMES] = {};
+    uint32_t readbackWriteIndex_ = 0;
+    float readbackAge_ = 0.0f;
+    
+    // Active cell list (sparse domain and tiled neighbor loop) and sparse domain resources
+    bool useSparseDomain_ = false;
+    uint32_t activeCellCapacity_ = 0;
+    GLuint activeCellBuffer_ = 0;      // Occupied cell ids in first-touch order
+    GLuint sparseDispatchBuffer_ = 0;  // Indirect step 4 dispatch (count in the 4th word), then one group per cell
+    
+    // Particle sleeping: per cell activity, and the awake subset of the active cell list
+    // with its own dispatch record (same layout as the active list's)
+    bool useParticleSleeping_ = false;
+    bool particleSleepingPass_ = false; // Sleeping active for the current substep
+    bool sleepStateDirty_ = true;       // Wakes every cell before the next sleeping substep
+    float sleepVelocity_ = 0.05f;
+    float sleepDensityChange_ = 0.0005f;
+    int sleepSubsteps_ = 30;
+    GLuint sleepProgram_ = 0;
+    GLuint cellActivityBuffer_ = 0;     // Per cell: quiet substeps, motion, latched motion
+    GLuint awakeCellBuffer_ = 0;
+    GLuint awakeDispatchBuffer_ = 0;
+    
+    // Live particle count and the indirect dispatch commands derived from it, kept on the
+    // GPU; numParticles_ mirrors it on the CPU for spawn clamping, sorting and drawing.
+    // Step 1 counts removed particles into the second record's padding and the compaction
+    // after step 3 subtracts them, so the mirror is an upper bound until a readback arrives
+    GLuint particleCountBuffer_ = 0;
+    uint64_t removedParticles_ = 0;    // Removals the mirror has been corrected for
+    uint64_t readbackSpawned_[SPHConstants::READBACK_FRAMES] = {}; // Particles spawned when each readback was issued
+    
+    // Sinks (kill volumes), uploaded to step 1 as uniform arrays
+    std::vector<glm::vec3> sinkMins_;
+    std::vector<glm::vec3> sinkMaxs_;
+    SPHHeightfieldCoupling heightfieldCoupling_;
+    
+    // Static obstacles: (centre, type) and size vec4 pairs as in sph_obstacle_sdf.cs
+    std::vector<glm::vec4> obstacles_;
+    bool useObstacleField_ = true;
+    bool obstacleFieldDirty_ = true;
+    GLuint obstacleProgram_ = 0;
+    GLuint obstacleFieldTexture_ = 0;  // rgba16f: normal into free space, signed distance
+    glm::ivec3 obstacleFieldRes_ = glm::ivec3(0);
+    uint32_t mortonRemovedKey_ = 0;    // Sorts removed particles after every cell
+    
+    // Batched scenes; empty when not batched
+    std::vector<SPHSceneParameters> sceneParameters_;
+    float sceneStride_ = 0.0f;         // Box width, the x offset between scenes
+    GLuint sceneParameterBuffer_ = 0;  // vec4 per scene: stiffness, viscosity
+    
+    // Multiphase; fewer than two phases is the single-phase pipeline
+    std::vector<SPHPhase> phases_;
+    uint32_t emitPhase_ = 0;
+    GLuint phaseBuffer_ = 0;           // SPHPhases uniform block: vec4 per phase
+    bool phasesDirty_ = false;
+    
+    // SPHParameters uniform block and the contents last uploaded to it
+    GLuint parameterBuffer_ = 0;
+    SPHParameterBlock parameterBlock_ = {};
+    bool sceneParametersDirty_ = false;
+    
+    // Particle staging ring, each slot reusable once its fence has signaled
+    GLuint stagingBuffer_ = 0;
+    SPHParticleCompute* stagingPointer_ = nullptr;
+    GLsync stagingFences_[SPHConstants::STAGING_SLOTS] = {};
+    uint32_t stagingSlot_ = 0;
+    uint32_t emitSeed_ = 0;
+    
+    // Verlet neighbor list resources
+    bool useNeighborLists_ = false;
+    bool neighborListsDirty_ = true;
+    uint32_t neighborLimit_ = 64;
+    GLuint rebuildFlagBuffer_ = 0;
+    GLuint sortedIndexBuffer_ = 0;
+    GLuint neighborCountBuffer_ = 0;
+    GLuint neighborListBuffer_ = 0;
+    GLuint referencePositionBuffer_ = 0;
+    
+    // Morton radix sort resources
+    GLuint sortKeyBuffers_[2] = { 0, 0 };
+    GLuint sortValueBuffers_[2] = { 0, 0 };
+    GLuint radixHistogramBuffer_ = 0;
+    GLuint radixOffsetBuffer_ = 0;
+    uint32_t radixPassCount_ = 0;
+    
+    // GPU timing of the simulation step
+    GLuint simulationTimerQuery_ = 0;
+    bool simulationTimerPending_ = false;
+    float simulationTimeMs_ = 0.0f;
+    
+    // Per-pass timestamps while profiling: a substep's start mark (pass 0), then one per pass
+    bool passProfiling_ = false;
+    std::vector<GLuint> passTimerQueries_;
+    std::vector<int> passTimerMarks_;       // Pass id of each used query
+    SPHPassProfile passProfile_;
+    GLuint velocityTexture_ = 0; // Filtered velocity at half grid resolution (step 4)
     glm::uvec3 gridDim_ = glm::uvec3(0);
     
     // Billboard rendering for screen-space fluid
@@ -142,18 +1182,103 @@ private:
     GLuint simStep4Program_;   // Velocity field calculation
     GLuint simStep5Program_;   // Density and pressure
     GLuint simStep6Program_;   // Force calculation
-    GLuint renderProgram_;     // Particle rendering shader
+    GLuint simStep5TiledProgram_ = 0; // Cell-cooperative variants of steps 5 and 6
+    GLuint simStep6TiledProgram_ = 0;
+    GLuint mortonProgram_ = 0;    // Morton key generation + sorted gather
+    GLuint radixSortProgram_ = 0; // Radix sort histogram/scatter
+    GLuint neighborListProgram_ = 0; // Verlet neighbor list rebuild
+    GLuint reduceProgram_ = 0;       // Statistics reduction
+    GLuint emitProgram_ = 0;         // GPU particle emitter
+    GLuint particleCountProgram_ = 0; // Live count and indirect dispatch update
+    GLuint pcisphProgram_ = 0;       // PCISPH pressure solver
+    GLuint queryProgram_ = 0;        // Water queries (sph_query.cs)
+    GLuint spatialQueryProgram_ = 0; // Fluid queries (sph_spatial_query.cs)
+    
+    // Parameterized variants (steps 4-6 and PCISPH above point into this cache, which owns
+    // them), keyed by shader path and injected defines
+    SPHShaderParameters shaderParameters_;
+    bool useSubgroups_ = true;
+    std::string subgroupDefines_;   // "#define SPH_SUBGROUPS" when requested and supported
+    std::map<std::string, GLuint> shaderVariants_;
+    GLuint renderPrograms_[COLOR_MODE_COUNT] = {};   // Particle rendering shader, per color mode
     GLuint depthProgram_;      // Depth rendering for screen-space fluid
+    GLuint depthSplatProgram_ = 0;    // The same depth splatted in compute
     GLuint smoothProgram_;     // Curvature flow smoothing
-    GLuint finalProgram_;      // Final surface shading
+    GLuint smoothComputeProgram_ = 0; // Fused-iteration curvature flow
+    GLuint bilateralProgram_ = 0;     // Separable bilateral depth filter
+    GLuint finalPrograms_[2] = {};  // Final surface shading, without and with the thickness
     
-    // Framebuffers for screen-space rendering
+    // Framebuffers for screen-space rendering; the textures come from the RenderTargetPool
     GLuint depthFBO_;
     GLuint depthTexture_;
+    GLuint motionTexture_ = 0;         // Color of the depth pass: the nearest particle's window UV motion
+    bool useComputeSplat_ = true;
+    GLuint splatDepthTexture_ = 0;     // r32ui window depth bits of the compute splat
+    GLuint splatDepthView_ = 0;        // The same storage as r32f, sampled like depthTexture_
+    bool splatDepthActive_ = false;    // This frame's particle depth is in the splat target
+    bool motionVectors_ = false;
+    glm::mat4 motionViewProjection_{1.0f};
+    glm::mat4 previousViewProjection_{1.0f};
+    float motionFrameTime_ = 0.0f;
     GLuint smoothFBO_[2];
     GLuint smoothTexture_[2];
     int windowWidth_;
     int windowHeight_;
+    GLuint targetFramebuffer_ = 0;     // Bound by the caller of render(); the final shading goes there
+    float fluidRenderScale_ = 1.0f;
+    int fluidWidth_ = 1;               // Screen-space fluid target size (window * render scale)
+    int fluidHeight_ = 1;
+    
+    // Particle culling (rendering context)
+    bool useParticleCulling_ = true;
+    bool useOcclusionCulling_ = true;
+    GLuint cullProgram_ = 0;
+    GLuint hiZProgram_ = 0;
+    GLuint visibleParticleBuffer_ = 0; // Surface and interior DrawArraysIndirectCommands, then the two id lists
+    
+    // Quantized render stream (uvec2 per particle), allocated on first use
+    bool useRenderStream_ = false;
+    bool renderFromStream_ = false;    // The current frame's draws read the stream
+    uint32_t renderStreamCount_ = 0;   // Particles streamed by the last write, 0 when stale
+    ColorMode renderStreamColorMode_ = COLOR_NORMAL;
+    GLuint renderStreamBuffer_ = 0;
+    GLuint renderStreamPrograms_[COLOR_MODE_COUNT] = {};   // Per color mode
+    
+    // Render interpolation, allocated on first use and sized like the particle storage
+    float renderLag_ = 0.0f;
+    bool renderLagApplied_ = false;    // interpolatedBuffer_ holds this lag's copy
+    GLuint interpolatedBuffer_ = 0;
+    GLuint interpolateProgram_ = 0;
+    uint32_t visibleParticleCapacity_ = 0;
+    bool useSurfaceSplatting_ = true;
+    float surfaceDensityRatio_ = 0.9f;
+    GLuint thicknessProgram_ = 0;
+    GLuint thicknessFBO_ = 0;
+    GLuint thicknessTexture_ = 0;      // Half resolution, interior particle thickness
+    bool thicknessValid_ = false;      // Drawn this frame (surface splatting active)
+    GLuint hiZTexture_ = 0;            // Farthest depth pyramid of the last depth pass
+    int hiZLevels_ = 0;
+    bool hiZValid_ = false;
+    glm::mat4 hiZViewProjection_ = glm::mat4(1.0f);
+    
+    // Marching cubes surface (rendering context)
+    RenderMode renderMode_ = RENDER_POINTS;
+    GLuint surfaceSplatProgram_ = 0;
+    GLuint marchingCubesProgram_ = 0;
+    GLuint surfaceProgram_ = 0;
+    GLuint surfaceFieldTexture_ = 0;          // r32ui fixed point volume fractions
+    GLuint surfaceTableBuffer_ = 0;           // Triangle count and edges per cube case
+    uint32_t surfaceTableStride_ = 0;
+    GLuint surfaceTriangleCountBuffer_ = 0;   // Per cell, scanned into the offsets
+    GLuint surfaceTriangleOffsetBuffer_ = 0;
+    GLuint surfaceScanBlockSumBuffer_ = 0;
+    GLuint surfaceMeshBuffer_ = 0;            // Indirect draw command, then the vertices
+    int surfaceResolution_ = 2;
+    float surfaceIsoLevel_ = 0.5f;
+    glm::ivec3 surfaceVolumeRes_ = glm::ivec3(0);
+    glm::vec3 surfaceVolumeOrigin_ = glm::vec3(0.0f);
+    float surfaceVoxelSize_ = 0.0f;
+    bool surfaceMeshValid_ = false;
     
     // Container rendering
     GLuint containerVAO_;
@@ -166,12 +1291,54 @@ private:
     int currentBuffer_;
     
     // Rendering options
+    SortMode sortMode_ = SORT_ATOMIC_SCATTER;
+    bool deterministic_ = false;
     ColorMode colorMode_;
+    const ShadingRateImage* shadingRates_ = nullptr;
     bool useFilteredViscosity_;
     int curvatureFlowIterations_;
+    SmoothingMode smoothingMode_ = SMOOTH_CURVATURE_FLOW_COMPUTE;
+    float bilateralSigmaSpace_ = 5.0f;   // Texels
+    float bilateralSigmaDepth_ = 0.002f; // Window-space depth
     
     // Timing
     float accumulatedTime_;
+    double simulationTime_ = 0.0;   // Simulated seconds since reset or restore
+    
+    // Render snapshots: slot ownership passes between the simulating and rendering contexts
+    // through publishedSnapshot_ (index plus a fresh flag); fences order the buffer accesses
+    static constexpr int SNAPSHOT_SLOTS = 3;
+    static constexpr int SNAPSHOT_FRESH = 0x4;
+    bool renderSnapshots_ = false;
+    GLuint snapshotBuffers_[SNAPSHOT_SLOTS] = {};
+    uint32_t snapshotCounts_[SNAPSHOT_SLOTS] = {};
+    GLuint snapshotCountBuffers_[SNAPSHOT_SLOTS] = {}; // GPU live count record of each slot
+    GLsync snapshotWriteFences_[SNAPSHOT_SLOTS] = {}; // Copy into the slot finished
+    GLsync snapshotReadFences_[SNAPSHOT_SLOTS] = {};  // Draws from the slot finished
+    std::atomic<int> publishedSnapshot_{2};
+    int snapshotBack_ = 1;             // Owned by the simulating context
+    int snapshotFront_ = 0;            // Owned by the rendering context
+    GLuint renderBuffer_ = 0;          // Buffer and count the current render() draws
+    uint32_t renderCount_ = 0;
+    GLuint renderCountBuffer_ = 0;     // Live count record bounding the draw on the GPU
+    GLuint playbackBuffer_ = 0;        // setPlaybackSource
+    GLuint playbackCountBuffer_ = 0;
+    uint32_t playbackCount_ = 0;
+    
+    void publishSnapshot();
+    void acquireSnapshot();
+    void releaseSnapshot();
+    
+    // Particle stream export
+    std::unique_ptr<SPHFrameExporter> exporter_;
+    int exportInterval_ = 1;
+    int exportFrameCounter_ = 0;
+    
+    // Geometry cache export
+    std::unique_ptr<SPHCacheExporter> cache_;
+    int cacheInterval_ = 1;
+    int cacheFrameCounter_ = 0;
+    bool captureCacheFrame();
     
     // Smoothing result buffer tracking
     int finalSmoothedBuffer_;
@@ -179,22 +1346,160 @@ private:
     // Helper methods
     void initializeGrid();
     void createBuffers();
+    // Per-particle buffers sized by capacity. Growth keeps the current particle buffer's
+    // contents; the rest is derived state that the next substep rebuilds
+    void createParticleStorage(uint32_t capacity);
+    void releaseParticleStorage();
+    bool reserveParticles(uint32_t count);
     void loadShaders();
     void createContainerGeometry();
     void createFramebuffers();
+    void recreateFramebuffers();
+    void releaseFramebuffers();
+    
+    // Substep pass graph: each pass declares the resources it reads and writes and when it
+    // is enabled; runPassGraph() derives the barriers from those declarations
+    enum PassResource : uint32_t {
+        RES_PARTICLES = 1u << 0,
+        RES_SOA = 1u << 1,
+        RES_CELL_COUNTS = 1u << 2,
+        RES_CELL_STARTS = 1u << 3,   // Including cursors and the Morton cell starts
+        RES_NEIGHBOR_LISTS = 1u << 4,
+        RES_ACTIVE_CELLS = 1u << 5,  // Active cell list and its indirect dispatch commands
+        RES_VELOCITY_FIELD = 1u << 6,
+        RES_PARTICLE_COUNT = 1u << 7,  // Live/removed counts and the particle dispatch records
+        RES_DIFFUSE_POTENTIALS = 1u << 8,
+        RES_CELL_ACTIVITY = 1u << 9,   // Particle sleeping state
+        RES_SURFACE_NORMALS = 1u << 10, // Surface tension color-field normals
+        RES_VISCOSITY_WARM_START = 1u << 11,
+        RES_GRID_BLOCKS = 1u << 12,    // Hierarchical grid block table
+        RES_DUE_PARTICLES = 1u << 13,  // Multirate due list and its indirect dispatch command
+        RES_BULK_COLUMNS = 1u << 14    // Narrow band bulk heights
+    };
+    
+    static constexpr int PASS_NEIGHBOR_LISTS = 7;
+    static constexpr int PASS_PCISPH = 8;
+    static constexpr int PASS_SLEEP = 9;
+    static constexpr int PASS_VISCOSITY = 10;
+    static constexpr int PASS_GRID_BLOCKS = 11;
+    static constexpr int PASS_ADAPTIVE = 12;
+    static constexpr int PASS_TIME_LEVELS = 13;
+    static constexpr int PASS_NARROW_BAND = 14;
+    
+    struct PassDesc {
+        int pass;                              // runSimulationPass() id
+        uint32_t reads;
+        uint32_t writes;
+        bool (SPHComputeSystem::*enabled)() const;
+        const char* name;                      // Profiler and debug group label
+    };
+    static const PassDesc PASS_GRAPH[];
+    
+    uint32_t pendingWrites_ = 0;       // Resources written since the last barrier
+    bool listModePass_ = false;        // Verlet list pipeline active for the current substep
+    
+    bool passAlwaysEnabled() const;
+    bool passUsesGrid() const;
+    bool passNeedsGridScan() const;
+    bool passUsesNeighborLists() const;
+    bool passNeedsVelocityField() const;
+    bool passUsesWCSPH() const;
+    bool passUsesPCISPH() const;
+    bool passUsesImplicitViscosity() const;
+    bool passUsesSleeping() const;
+    bool passUsesGridBlocks() const;
+    bool passUsesAdaptiveResolution() const;
+    bool passUsesMultirate() const;
+    bool passUsesNarrowBand() const;
+    SortMode passSortMode() const;
+    bool readbackReady(GLsync fence, bool newest) const;
+    static GLbitfield barrierBitsFor(uint32_t resources);
     
+    // Tracked bytes of the resources (GPUMemoryTracker), per-particle ones scaled to the live
+    // count: the pass's declared traffic, each resource counted once
+    size_t resourceBytes(uint32_t resources) const;
+    void runPassGraph();
+    void flushPassBarriers();
+    void ensureVelocityField();
+    
+    void updateParameterBlock();
     void runSimulationPass(int pass);
+    void dispatchPrefixScan(GLuint input, GLuint output, GLuint cursor, uint32_t count, GLuint blockSums = 0);
+    void sortParticlesMorton(const glm::vec3& invCellSize);
+    void sortParticleIndices();
+    void buildNeighborLists();
+    SPHParticleCompute* acquireStagingSlot();
+    void dispatchEmitter(int mode, uint32_t count, uint32_t stagingOffset);
+    float bulkColumnSize() const;
+    float bulkFloor() const;               // Container floor, where the bulk heights start
+    void setNarrowBandUniforms();          // Of the bound narrow band program, and its column buffer
+    void depositBulk(SPHSeedVolume& volume);   // Moves a box's rows below the band into the bulk
+    void resetParticleCount();
+    void compactParticleCount();
+    void syncParticleCount();
+    void applyRestoredState(const SPHKeyframe& state);   // After a checkpoint or keyframe restore
+    void dispatchParticles(uint32_t localSize);
+    void dispatchActiveCells(GLuint program);
+    void prepareParticleSleeping();
+    void updateSleepingCells();
+    void dispatchStatistics();
+    void readBackStatistics(float deltaTime);
+#ifdef SPH_GPU_COUNTERS
+    void publishCounters();
+    void readBackCounters();
+#endif
+    void readBackSphereForce();
+    void publishSphereImpulse(float duration);
+    float computeAdaptiveTimeStep() const;
+    uint32_t maxParticlesForDevice() const;
+    float maxTimeStep() const;
+    void computePCISPHDelta();
+    void updateKernelTable();
+    float timeKernelPass(int pass, int repetitions, GLuint restoreBuffer);
+    std::string layoutDefines() const;
+    std::string counterDefines() const;    // Empty unless SPH_GPU_COUNTERS
+    std::string gridDefines() const;       // Hierarchical grid variant of the cell readers
+    std::string gridSource() const;        // gridDefines() and the cell addressing of sph_grid.glsl
+    std::string tagSource() const;         // The particle tag layout of sph_tags.glsl
+    bool subgroupsSupported() const;
+    std::string shaderParameterDefines(const SPHShaderParameters& parameters) const;
+    GLuint loadShaderVariant(const char* path, const std::string& defines, const char* name);
+    bool loadParameterShaders(const SPHShaderParameters& parameters);
+    void solvePCISPH();
+    void solveImplicitViscosity();
+    void bindViscosityWarmStart(GLuint program);
+    void uploadPhases();
+    uint32_t clampedPhase(uint32_t phase) const;
+    void updateDiffuseParticles(float deltaTime);
+    void bakeObstacleField();
+    void bindSoABuffers();
     void swapBuffers();
     
     void renderParticles(const glm::mat4& view, const glm::mat4& projection);
     void renderParticlesAsPoints(const glm::mat4& view, const glm::mat4& projection);
-    void renderGlassContainer(const glm::mat4& view, const glm::mat4& projection);
+    bool cullParticles(const glm::mat4& viewProjection, float radius, bool occlusion, bool classify);
+    void drawParticleBillboards(GLuint program, bool culled, bool interior = false);
+    void bindRenderStream(GLuint program);
+    void writeRenderStream();
+    void interpolateRenderParticles();
+    void buildHiZ(const glm::mat4& viewProjection);
+    void renderGlassContainer();
+    void renderDiffuseParticles(const glm::mat4& view, const glm::mat4& projection);
     
     // Screen-space fluid rendering pipeline
     void renderScreenSpaceFluid(const glm::mat4& view, const glm::mat4& projection);
     void renderParticleDepth(const glm::mat4& view, const glm::mat4& projection);
+    void splatParticleDepth(const glm::mat4& view, const glm::mat4& projection, float pointRadius, bool culled);
+    GLuint particleDepthTexture() const { return splatDepthActive_ ? splatDepthView_ : depthTexture_; }
+    void renderParticleThickness(const glm::mat4& view, const glm::mat4& projection, float pointRadius);
     void applyCurvatureFlowSmoothing();
+    void applyCurvatureFlowCompute();
+    void applyBilateralSmoothing();
     void renderFinalShading(const glm::mat4& view, const glm::mat4& projection);
+    
+    // Marching cubes surface pipeline
+    void ensureSurfaceVolume();
+    void extractSurfaceMesh();
 };
 
 } // namespace WaterSim
@@ -0,0 +1,124 @@
+#ifndef SPH_CPU_SYSTEM_H
+#define SPH_CPU_SYSTEM_H
+
+#include <vector>
+#include <cstdint>
+#include <random>
+#include <glm/glm.hpp>
+#include "SPHComputeSystem.h" // SPHConstants and SPHParticleCompute
+#include "JobSystem.h"
+
+namespace WaterSim {
+
+// CPU implementation of the compute shader pipeline (sph_step1.cs - sph_step6.cs) for
+// machines without GL 4.6 compute. Needs no OpenGL context, so it runs headless; the
+// simulation-facing API mirrors SPHComputeSystem so scenarios move between backends.
+//
+// Particles are kept as structure-of-arrays streams in cell order. Each substep counts
+// particles per cell, scans the counts and gathers the streams into grid order, then
+// runs the density and force kernels over small batches of cells on the shared JobSystem,
+// which balances dense and sparse regions by stealing; the inner neighbor loops run over
+// contiguous cell ranges and are vectorized with omp simd. The per-particle passes run in
+// fixed partitions (JobSystem::parallelForPartitioned) over streams first touched by the
+// same partitions, so on a multi-socket machine each worker streams its own node's memory.
+class SPHCpuSystem {
+public:
+    SPHCpuSystem();
+    ~SPHCpuSystem() = default;
+
+    // Initialize the system
+    bool initialize(uint32_t numParticles, const glm::vec3& boxMin, const glm::vec3& boxMax);
+
+    // Update simulation
+    void update(float deltaTime);
+
+    // Reset simulation (same dam-break block as SPHComputeSystem::reset)
+    void reset();
+
+    // Add particles, clamped to capacity
+    void addParticles(const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& velocities);
+
+    // Spawn count particles on a disk of the given radius. Returns how many fit.
+    uint32_t emitStream(const glm::vec3& origin, const glm::vec3& velocity, float radius, uint32_t count);
+
+    // Sphere interaction
+    void applyImpulse(const glm::vec3& position, const glm::vec3& impulse, float radius);
+
+    // Copy the particle state out in the GPU particle layout
+    void getParticles(std::vector<SPHParticleCompute>& particles) const;
+
+    // Getters
+    uint32_t getParticleCount() const { return numParticles_; }
+    uint32_t getMaxParticles() const { return maxParticles_; }
+    const glm::vec3& getBoxMin() const { return boxMin_; }
+    const glm::vec3& getBoxMax() const { return boxMax_; }
+
+    // Time stepping (fixed DT substeps; time beyond the cap is dropped)
+    void setMaxSubsteps(int substeps) { maxSubsteps_ = std::max(substeps, 1); }
+    void setVelocityLimit(float velocityLimit) { velocityLimit_ = velocityLimit; }
+    int getLastSubstepCount() const { return lastSubstepCount_; }
+
+    // Gravity control
+    void setGravity(const glm::vec3& gravity) { gravity_ = gravity; }
+    const glm::vec3& getGravity() const { return gravity_; }
+
+private:
+    // Particle data
+    uint32_t numParticles_ = 0;
+    uint32_t maxParticles_ = 0;
+
+    // Simulation bounds
+    glm::vec3 boxMin_;
+    glm::vec3 boxMax_;
+    glm::vec3 gravity_;
+
+    // Grid parameters (same derivation as SPHComputeSystem::initialize)
+    glm::vec3 gridOrigin_;
+    glm::vec3 gridSize_;
+    glm::vec3 invCellSize_;
+    glm::ivec3 gridRes_;
+    uint32_t cellCount_ = 0;
+
+    // Structure-of-arrays particle streams, in cell order after each grid build
+    FirstTouchVector<float> positionX_, positionY_, positionZ_;
+    FirstTouchVector<float> velocityX_, velocityY_, velocityZ_;
+    FirstTouchVector<float> density_, pressure_;
+
+    // Gather targets, swapped with the streams above after reordering
+    FirstTouchVector<float> scratchPositionX_, scratchPositionY_, scratchPositionZ_;
+    FirstTouchVector<float> scratchVelocityX_, scratchVelocityY_, scratchVelocityZ_;
+
+    // Counting sort grid
+    std::vector<uint32_t> particleCell_;
+    std::vector<uint32_t> cellCounts_;
+    std::vector<uint32_t> cellStarts_;
+    std::vector<uint32_t> cellCursors_;
+    std::vector<uint32_t> activeCells_;
+
+    // Sphere interaction (consumed by the next substep)
+    glm::vec3 spherePosition_;
+    glm::vec3 sphereImpulse_;
+    float sphereRadius_ = 0.0f;
+    bool sphereActive_ = false;
+
+    // Time stepping
+    float accumulatedTime_ = 0.0f;
+    int maxSubsteps_ = 20;
+    int lastSubstepCount_ = 0;
+    float velocityLimit_ = 50.0f;
+
+    std::mt19937 emitRandom_;
+
+    // Pipeline stages
+    void integrate(float dt);         // Step 1
+    void buildGrid();                 // Steps 2-3: counting sort into cell order
+    void computeDensityPressure();    // Step 5
+    void computeForces(float dt);     // Step 6
+
+    void resizeStreams(uint32_t capacity);
+    void cellRange(int x, int y, int z, uint32_t& start, uint32_t& end) const;
+};
+
+} // namespace WaterSim
+
+#endif // SPH_CPU_SYSTEM_H
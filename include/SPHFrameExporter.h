@@ -0,0 +1,118 @@
+#ifndef SPH_FRAME_EXPORTER_H
+#define SPH_FRAME_EXPORTER_H
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <cstdio>
+#include <cstdint>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <glm/glm.hpp>
+#include "SPHComputeSystem.h"
+
+namespace WaterSim {
+
+// Streams particle frames to a chunked, seekable file without stalling the simulation.
+//
+// capture() copies the particle buffer into one slot of a persistently mapped, fenced
+// readback ring; poll() hands slots whose fence has signaled to a writer thread, which
+// quantizes positions (to the grid box) and velocities (to the velocity limit) to 16 bits,
+// delta-codes consecutive particles per channel (they are stored in cell order, so
+// neighbors are close) and writes zigzag varints. Frames that find the ring or the writer
+// queue full are dropped and counted rather than waited for.
+//
+// File layout: SPHStreamHeader, then one SPHStreamFrameHeader + payload per frame, then a
+// frame offset index and an SPHStreamFooter pointing at it.
+struct SPHStreamHeader {
+    char magic[8];             // "WSPHSTRM"
+    uint32_t version;
+    uint32_t headerSize;
+    float gridOrigin[3];
+    float gridSize[3];
+    float velocityScale;       // Quantized velocity 32767 == velocityScale (m/s)
+    uint32_t reserved;
+};
+
+struct SPHStreamFrameHeader {
+    uint32_t magic;            // 'FRME'
+    uint32_t frameIndex;
+    uint32_t particleCount;
+    uint32_t reserved;
+    double simulationTime;
+    uint64_t payloadSize;
+};
+
+struct SPHStreamFooter {
+    uint64_t indexOffset;      // uint64 frame offsets, frameCount entries
+    uint32_t frameCount;
+    uint32_t reserved;
+    char magic[8];             // "WSPHEND"
+};
+
+class SPHFrameExporter {
+public:
+    SPHFrameExporter() = default;
+    ~SPHFrameExporter();
+
+    bool open(const std::string& path, uint32_t maxParticles, const glm::vec3& gridOrigin,
+              const glm::vec3& gridSize, float velocityScale);
+    void close();
+    bool isOpen() const { return file_ != nullptr; }
+
+    // Queue a copy of the first count particles of buffer (GL thread, never blocks). With a
+    // countBuffer (SPHComputeSystem's live count record) the frame is trimmed to the GPU live
+    // count, which may be below count while removed particles are being compacted out
+    void capture(GLuint buffer, uint32_t count, double simulationTime, GLuint countBuffer = 0);
+
+    // Hand completed readbacks to the writer thread (GL thread, never blocks)
+    void poll();
+
+    uint32_t getWrittenFrames() const { return writtenFrames_; }
+    uint32_t getDroppedFrames() const { return droppedFrames_; }
+
+private:
+    struct Frame {
+        uint32_t frameIndex = 0;
+        double simulationTime = 0.0;
+        std::vector<SPHParticleCompute> particles;
+    };
+
+    static constexpr uint32_t READBACK_SLOTS = 3;
+    static constexpr size_t MAX_QUEUED_FRAMES = 4;
+
+    // GL readback ring
+    GLuint readbackBuffers_[READBACK_SLOTS] = {};
+    void* readbackPointers_[READBACK_SLOTS] = {};
+    GLsync readbackFences_[READBACK_SLOTS] = {};
+    uint32_t readbackCounts_[READBACK_SLOTS] = {};
+    bool readbackHasLiveCount_[READBACK_SLOTS] = {};  // Live count copied behind the particles
+    double readbackTimes_[READBACK_SLOTS] = {};
+    uint32_t readbackIndices_[READBACK_SLOTS] = {};
+    uint32_t nextSlot_ = 0;
+    uint32_t maxParticles_ = 0;
+    uint32_t capturedFrames_ = 0;
+    uint32_t droppedFrames_ = 0;
+
+    // Writer thread
+    std::FILE* file_ = nullptr;
+    SPHStreamHeader header_ = {};
+    std::thread writer_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::deque<Frame> queue_;
+    std::vector<Frame> freeFrames_;
+    bool stopping_ = false;
+    std::vector<uint64_t> frameOffsets_;
+    uint64_t fileOffset_ = 0;  // Tracked rather than ftell'd, which is 32-bit on some platforms
+    std::atomic<uint32_t> writtenFrames_{0};
+
+    void writerLoop();
+    void encodeFrame(const Frame& frame, std::vector<uint8_t>& payload) const;
+};
+
+} // namespace WaterSim
+
+#endif // SPH_FRAME_EXPORTER_H
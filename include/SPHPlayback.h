@@ -0,0 +1,157 @@
+#ifndef SPH_PLAYBACK_H
+#define SPH_PLAYBACK_H
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <glm/glm.hpp>
+#include "SPHComputeSystem.h"
+#include "SPHFrameExporter.h"
+
+namespace WaterSim {
+
+// Plays a baked particle stream (SPHFrameExporter's file, --export) back through the SPH
+// rendering, for scenes too expensive to simulate on the machine showing them.
+//
+// open() reads the stream's frame index and every frame header, so each frame is a keyframe
+// to seek to by its index and the playhead maps simulation time to a frame. A streaming thread
+// reads the compressed frames ahead of the playhead, in its direction and stepping as far as
+// it moved on the last update, and decodes them into a ring of persistently mapped particle
+// buffers with their live count records, laid out as the simulation's. update() shows the
+// decoded frame nearest the playhead without passing it and hands the one it replaces back to
+// the thread once the GPU has drawn it; when decoding falls behind, the last frame stays up
+// and is counted late rather than waited for.
+//
+// The stream holds positions and velocities only, so the played particles carry the rest
+// density and no pressure. Context thread only, apart from the streaming thread it owns.
+class SPHPlayback {
+public:
+    static constexpr uint32_t RING_SLOTS = 4;   // Decoded frames resident at once
+
+    struct Settings {
+        float speed = 1.0f;         // Simulated seconds per second; negative plays backwards
+        bool loop = true;
+        bool paused = false;
+        int readAhead = 8;          // Compressed frames read ahead of the playhead
+    };
+
+    SPHPlayback() = default;
+    ~SPHPlayback();
+
+    SPHPlayback(const SPHPlayback&) = delete;
+    SPHPlayback& operator=(const SPHPlayback&) = delete;
+
+    bool open(const std::string& path);
+    void close();
+    bool isOpen() const { return file_ != nullptr; }
+
+    // Advance the playhead by deltaTime at the settings' speed and show the newest decoded
+    // frame at it (GL thread, never blocks)
+    void update(float deltaTime);
+
+    // Jump to a frame of the stream's index; the frame on show stays up until it is decoded
+    void seek(uint32_t keyframe);
+
+    // The frame on show, for SPHComputeSystem::setPlaybackSource; 0 before the first lands
+    GLuint getParticleBuffer() const { return shownSlot_ >= 0 ? particleBuffers_[shownSlot_] : 0; }
+    GLuint getCountBuffer() const { return shownSlot_ >= 0 ? countBuffers_[shownSlot_] : 0; }
+    uint32_t getParticleCount() const { return shownSlot_ >= 0 ? slotCounts_[shownSlot_] : 0; }
+
+    uint32_t getKeyframeCount() const { return static_cast<uint32_t>(keyframes_.size()); }
+    uint32_t getCurrentKeyframe() const { return shownSlot_ >= 0 ? slotFrames_[shownSlot_] : 0; }
+    double getPlayhead() const { return playhead_; }
+    double getStartTime() const { return keyframes_.empty() ? 0.0 : keyframes_.front().time; }
+    double getEndTime() const { return keyframes_.empty() ? 0.0 : keyframes_.back().time; }
+    uint32_t getMaxParticles() const { return maxParticles_; }
+    glm::vec3 getBoxMin() const { return gridOrigin_; }
+    glm::vec3 getBoxMax() const { return gridOrigin_ + gridSize_; }
+    uint32_t getLateFrames() const { return lateFrames_; }     // Updates showing an earlier frame
+    uint32_t getDecodedFrames() const { return decodedFrames_; }
+    uint32_t getFailedFrames() const { return failedFrames_; }
+
+    Settings& getSettings() { return settings_; }
+
+private:
+    enum class SlotState {
+        FREE,       // The streaming thread may decode into it
+        DECODING,   // Being written by the streaming thread
+        READY,      // Decoded, not shown yet
+        SHOWN,      // Drawn by this frame
+        RETIRED     // Replaced, waiting for the GPU to finish drawing it
+    };
+
+    struct Keyframe {
+        uint64_t offset = 0;        // Of its SPHStreamFrameHeader
+        uint64_t payloadSize = 0;
+        uint32_t particleCount = 0;
+        double time = 0.0;
+    };
+
+    // A compressed frame read ahead of the playhead
+    struct Chunk {
+        uint32_t frame = 0;
+        std::vector<uint8_t> payload;
+    };
+
+    // Where the streaming thread reads: frames from wanted, stride apart in direction
+    struct Plan {
+        uint32_t wanted = 0;
+        int direction = 1;
+        uint32_t stride = 1;
+        bool loop = true;
+        uint32_t readAhead = 8;
+        uint64_t generation = 0;    // Bumped when the reading restarts (seek, direction, loop)
+    };
+
+    Settings settings_;
+    std::FILE* file_ = nullptr;     // Read by the streaming thread only once it runs
+    SPHStreamHeader header_ = {};
+    glm::vec3 gridOrigin_ = glm::vec3(0.0f);
+    glm::vec3 gridSize_ = glm::vec3(0.0f);
+    std::vector<Keyframe> keyframes_;
+    uint32_t maxParticles_ = 0;
+
+    // Decoded ring; the state, frames and counts are guarded by mutex_
+    GLuint particleBuffers_[RING_SLOTS] = {};
+    GLuint countBuffers_[RING_SLOTS] = {};
+    SPHParticleCompute* particlePointers_[RING_SLOTS] = {};
+    uint32_t* countPointers_[RING_SLOTS] = {};
+    GLsync fences_[RING_SLOTS] = {};
+    SlotState states_[RING_SLOTS] = {};
+    uint32_t slotFrames_[RING_SLOTS] = {};
+    uint32_t slotCounts_[RING_SLOTS] = {};
+    uint64_t slotGenerations_[RING_SLOTS] = {};
+    int shownSlot_ = -1;
+
+    // Playhead (GL thread)
+    double playhead_ = 0.0;
+    uint32_t lateFrames_ = 0;
+
+    // Streaming thread
+    std::thread streamer_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    Plan plan_;
+    bool stopping_ = false;
+    std::atomic<uint32_t> decodedFrames_{0};
+    std::atomic<uint32_t> failedFrames_{0};
+
+    bool readIndex();
+    bool allocateRing();
+    void releaseRing();
+    uint32_t frameAt(double time) const;
+    int64_t stepsTo(uint32_t from, uint32_t to, const Plan& plan) const;
+    void restartReading();
+    void streamerLoop();
+    bool readChunk(uint32_t frame, Chunk& chunk);
+    bool decodeChunk(const Chunk& chunk, int slot, std::vector<SPHParticleCompute>& scratch) const;
+};
+
+} // namespace WaterSim
+
+#endif // SPH_PLAYBACK_H
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+
+namespace WaterSim {
+
+// Static meshes of the scene in one vertex and one index buffer, drawn a list at a time
+// with glMultiDrawElementsIndirect. Meshes share the 8-float vertex of Sphere and
+// GlassContainer (position, normal, uv on attributes 0-2) and are added once; a DrawList
+// holds the draws of one material class, each with its model matrix and material in a
+// record the vertex stage reads at SCENE_DRAW_BINDING through gl_DrawID.
+//
+// A list is uploaded when it changed and drawn by every pass that needs it with that pass's
+// program: the shadow map draws its casters' lists once per cascade.
+class SceneBatch {
+public:
+    static constexpr GLuint SCENE_DRAW_BINDING = 62;   // std430 records, see shadow_map.vs
+
+    // Draws of one material class
+    class DrawList {
+    public:
+        DrawList() = default;
+        ~DrawList();
+
+        DrawList(const DrawList&) = delete;
+        DrawList& operator=(const DrawList&) = delete;
+
+        void clear();
+        void add(int mesh, const glm::mat4& model, const glm::vec4& material = glm::vec4(1.0f));
+        bool empty() const { return records_.empty(); }
+        size_t size() const { return records_.size(); }
+
+    private:
+        friend class SceneBatch;
+
+        struct Command {
+            GLuint count;
+            GLuint instanceCount;
+            GLuint firstIndex;
+            GLint baseVertex;
+            GLuint baseInstance;
+        };
+
+        struct Record {
+            glm::mat4 model;
+            glm::vec4 material;     // Color and opacity, for the lit classes
+        };
+
+        // Per add, the mesh and the record until the upload resolves the mesh
+        std::vector<int> meshes_;
+        std::vector<Record> records_;
+        GLuint commandBuffer_ = 0;
+        GLuint recordBuffer_ = 0;
+        size_t capacity_ = 0;       // In draws, of both buffers
+        bool dirty_ = true;
+    };
+
+    SceneBatch() = default;
+    ~SceneBatch();
+
+    SceneBatch(const SceneBatch&) = delete;
+    SceneBatch& operator=(const SceneBatch&) = delete;
+
+    // Index of the mesh for DrawList::add. The buffers are rebuilt by the next draw
+    int addMesh(const std::vector<float>& vertices, const std::vector<unsigned int>& indices);
+    int getMeshCount() const { return static_cast<int>(meshes_.size()); }
+
+    // One multi-draw of the list with the program in use; uploads the list if it changed
+    void draw(DrawList& list);
+
+private:
+    struct Mesh {
+        GLuint firstIndex;
+        GLuint indexCount;
+        GLint baseVertex;
+    };
+
+    void upload();
+    void upload(DrawList& list) const;
+
+    std::vector<Mesh> meshes_;
+    std::vector<float> vertices_;
+    std::vector<unsigned int> indices_;
+    bool meshesDirty_ = false;
+
+    GLuint vao_ = 0;
+    GLuint vertexBuffer_ = 0;
+    GLuint indexBuffer_ = 0;
+};
+
+} // namespace WaterSim
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace WaterSim {
+
+// Asynchronous program builds. submit() hands every stage to the driver at once and returns;
+// with KHR_parallel_shader_compile the driver compiles and links on its own threads, and
+// poll() only checks GL_COMPLETION_STATUS_KHR, so the thread issuing frames never waits on a
+// compile. Without the extension, poll() finishes one program per call, which still spreads
+// a cold start over frames. Cached binaries (see SetShaderCacheDirectory) skip compilation.
+//
+// A finished program goes to its job's callback, which owns it from then on; the callback
+// runs from poll() or finish(), or from submit() itself on a cache hit. A failed job only
+// logs. With hot reload, editing a source rebuilds the job in the background and calls
+// the callback again with the new program, so the old one stays in use until the swap and
+// is kept when the edit does not compile.
+class ShaderCompiler {
+public:
+    struct Stage {
+        GLenum type;
+        std::string path;
+        std::string defines;    // Inserted after #version
+    };
+
+    using ReadyCallback = std::function<void(GLuint program)>;
+
+    struct Stats {
+        int submitted = 0;
+        int completed = 0;      // Built from source or taken from the binary cache
+        int cacheHits = 0;
+        int failed = 0;
+        int reloads = 0;        // Rebuilds started by source edits
+    };
+
+    static ShaderCompiler& instance();
+
+    // Asks the driver for its compiler threads; call once the context is current
+    void initialize();
+    bool isParallel() const { return parallel_; }
+
+    // Starts building now. owner groups jobs for cancel(); name is for the log
+    void submit(const void* owner, const std::string& name, const std::vector<Stage>& stages, ReadyCallback onReady);
+    void submit(const void* owner, const std::string& name, const char* vertexPath, const char* fragmentPath,
+                ReadyCallback onReady);
+    void submitCompute(const void* owner, const std::string& name, const char* computePath, const std::string& defines,
+                       ReadyCallback onReady);
+
+    // Drops an owner's jobs, in flight or watched, before it goes away
+    void cancel(const void* owner);
+
+    // Advances the jobs that are done without blocking; call once per frame
+    void poll();
+
+    // Blocks until the owner's jobs have finished or failed; the other owners' keep going.
+    // Submitting a batch first still lets the driver compile it in parallel
+    void finish(const void* owner);
+
+    int getPendingCount() const;
+    const Stats& getStats() const { return stats_; }
+
+    void setHotReload(bool enabled) { hotReload_ = enabled; }
+    bool isHotReloadEnabled() const { return hotReload_; }
+
+private:
+    enum class State {
+        COMPILING,
+        LINKING,
+        IDLE        // Finished or failed; kept for hot reload
+    };
+
+    struct Job {
+        const void* owner = nullptr;
+        std::string name;
+        std::vector<Stage> stages;
+        ReadyCallback onReady;
+        State state = State::IDLE;
+        std::vector<GLuint> shaders;
+        GLuint program = 0;
+        uint64_t cacheKey = 0;
+        std::vector<std::filesystem::file_time_type> sourceTimes;
+    };
+
+    ShaderCompiler() = default;
+
+    void start(Job& job);
+    bool advance(Job& job, bool block);
+    void fail(Job& job, const std::string& message);
+    void release(Job& job);
+    void checkSources();
+    static std::vector<std::filesystem::file_time_type> sourceTimes(const Job& job);
+
+    std::vector<Job> jobs_;
+    bool parallel_ = false;
+    bool hotReload_ = false;
+    double lastSourceCheck_ = 0.0;
+    Stats stats_;
+
+    // Seconds between checks of the sources' modification times
+    static constexpr double SOURCE_CHECK_INTERVAL = 0.5;
+};
+
+} // namespace WaterSim
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <glad/glad.h>
+#include "GLResources.h"
+
+namespace WaterSim {
+
+// Variable-rate shading of the water and fluid passes. shading_rate.cs classifies every
+// screen tile of the finished scene into an R8UI rate image for the next frame: tiles whose
+// luminance is flat along an axis shade at half rate along it, nearly flat in both at a
+// quarter, and tiles the depth of field blurs at least as coarsely as the blur. Rougher water
+// reflections widen what counts as flat.
+//
+// With NV_shading_rate_image the water surface and SPH final draws run inside begin()/end()
+// and the rasterizer shades each tile at its rate. The ray traced composite runs on every
+// GPU in compute, where the kernels sample the same image per workgroup and shade one texel
+// per block (rt_coarse_shading.glsl).
+//
+// The rates are a frame behind the camera. Each tile's gradients take in a one-pixel border,
+// so an edge on the line between two tiles keeps both at full rate.
+class ShadingRateImage {
+public:
+    // The image's texel values, and the palette entries the hardware path maps them through
+    enum Rate : GLubyte {
+        RATE_1X1,
+        RATE_2X1,       // Half rate horizontally
+        RATE_1X2,       // Half rate vertically
+        RATE_2X2,
+        RATE_4X4,
+        RATE_COUNT
+    };
+
+    struct Settings {
+        float contrastThreshold = 0.03f;    // Largest neighbour luminance step of a coarse axis
+        float roughness = 0.05f;            // Of the water's sky reflection (water.fs); widens the threshold
+        bool depthOfField = false;          // As PostProcessManager blurs
+        float focusDistance = 10.0f;
+        float focusRange = 5.0f;
+    };
+
+    ShadingRateImage() = default;
+    ~ShadingRateImage();
+
+    ShadingRateImage(const ShadingRateImage&) = delete;
+    ShadingRateImage& operator=(const ShadingRateImage&) = delete;
+
+    // Allocates the image for the window and submits shading_rate.cs
+    bool initialize(int width, int height);
+    void resize(int width, int height);
+
+    void setSettings(const Settings& settings) { settings_ = settings; }
+    const Settings& getSettings() const { return settings_; }
+
+    // Off leaves the image at full rate and begin() a no-op
+    void setEnabled(bool enabled);
+    bool isEnabled() const { return enabled_; }
+
+    // NV_shading_rate_image: the rasterizer path of begin()/end()
+    bool isHardwareSupported() const { return hardwareSupported_; }
+
+    // Classifies this frame's scene (HDR colour, window depth) into the next frame's rates
+    void build(GLuint sceneColor, GLuint sceneDepth);
+
+    // Shading of the draws in between follows the rates, when the hardware path is active.
+    // Only for passes into the window-sized scene target through viewport 0
+    void begin() const {
+        if (!enabled_ || !hardwareSupported_ || !built_) return;
+        glBindShadingRateImageNV(texture_.get());
+        glEnable(GL_SHADING_RATE_IMAGE_NV);
+    }
+    void end() const {
+        if (!enabled_ || !hardwareSupported_ || !built_) return;
+        glDisable(GL_SHADING_RATE_IMAGE_NV);
+    }
+
+    // Rate image for the compute path; 0 until the first build, or while disabled
+    GLuint getTexture() const { return enabled_ && built_ ? texture_.get() : 0; }
+    int getTileSize() const { return tileSize_; }
+
+private:
+    void createTexture();
+
+    Settings settings_;
+    GLShaderProgram classifyProgram_;   // shading_rate.cs
+    GLTexture texture_;
+    int width_ = 0, height_ = 0;
+    int tileSize_ = 16;                 // The hardware's rate texel, when it has one
+    bool hardwareSupported_ = false;
+    bool enabled_ = true;
+    bool built_ = false;                // Holds a classification of the current size
+};
+
+} // namespace WaterSim
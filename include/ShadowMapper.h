@@ -0,0 +1,163 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include "GLResources.h"
+#include "SceneBatch.h"
+
+namespace WaterSim {
+
+// Cascaded shadow maps of the fixed directional light. The camera's view range splits into
+// CASCADES slices, each covered by an orthographic light frustum around the slice's bounding
+// sphere. The sphere's radius does not change as the camera turns, and its center snaps to
+// a coarse grid of light-space texels, so a cascade's frustum only moves when the camera has
+// travelled a fraction of the cascade: shadow edges stay put, and the frustum a cascade was
+// last drawn with is reused for as many frames as possible.
+//
+// Casters live in one of two layered depth maps. The static map (the container) is drawn
+// only when its cascade's frustum moves or invalidateStatic() is called; the dynamic map (the
+// sphere, the SPH particles) is cleared and drawn every frame, in only the cascades a caster
+// overlaps, and not touched at all while nothing dynamic is in one. Receivers read both
+// through caustic_shadow.fs, the static one scaled by its opacity as glass lets most light by.
+class ShadowMapper {
+public:
+    static constexpr int CASCADES = 3;
+
+    struct Settings {
+        bool enabled = true;
+        int resolution = 2048;          // Per cascade, square
+        float maxDistance = 40.0f;      // Of the camera's view range that casts shadows
+        float splitLambda = 0.75f;      // Logarithmic (1) to uniform (0) cascade splits
+        float staticOpacity = 0.35f;    // Light the static casters block
+        bool cacheStatic = true;        // Off: the static map is redrawn every frame too
+    };
+
+    struct Stats {
+        int staticCascadesDrawn = 0;    // This frame
+        int dynamicCascadesDrawn = 0;
+        uint64_t staticRedraws = 0;     // Cascades since initialize
+        float splits[CASCADES + 1] = {};
+    };
+
+    // A caster drawn with the mesh program's "model" uniform already set; the center and
+    // radius bound it for the per-cascade culling. One with a mesh of the scene batch joins
+    // the multi-draw of its map instead, under batchModel; draw is the fallback while the
+    // batch program builds
+    struct Caster {
+        glm::vec3 center{0.0f};
+        float radius = 0.0f;
+        glm::mat4 model{1.0f};
+        std::function<void(const GLShaderProgram& program)> draw;
+        int batchMesh = -1;
+        glm::mat4 batchModel{1.0f};
+    };
+
+    // SPH particles as round points, from the buffers of SPHComputeSystem's last render
+    struct ParticleCasters {
+        GLuint particleBuffer = 0;
+        GLuint countBuffer = 0;
+        uint32_t count = 0;
+        float radius = 0.0f;
+        glm::vec3 boundsMin{0.0f};
+        glm::vec3 boundsMax{0.0f};
+    };
+
+    ShadowMapper() = default;
+    ~ShadowMapper();
+
+    ShadowMapper(const ShadowMapper&) = delete;
+    ShadowMapper& operator=(const ShadowMapper&) = delete;
+
+    // Allocates the maps and submits the caster programs
+    bool initialize();
+
+    void setSettings(const Settings& settings);
+    const Settings& getSettings() const { return settings_; }
+
+    // Meshes of the batched casters; not owned
+    void setSceneBatch(SceneBatch* batch) { sceneBatch_ = batch; }
+
+    // From the light position toward the target, for the whole scene
+    void setLight(const glm::vec3& position, const glm::vec3& target);
+
+    // Everything that casts or receives; bounds the depth range and drops the cascades
+    // that cannot reach it. A change redraws the static map
+    void setSceneBounds(const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+
+    // The static casters changed: redraw them in every cascade next frame
+    void invalidateStatic() { staticDirty_ = true; }
+
+    // Fits the cascades to the camera of this frame
+    void beginFrame(const glm::mat4& view, float fovYDegrees, float aspect, float nearPlane, float farPlane);
+
+    // Draws what the frame needs of both maps
+    void render(const std::vector<Caster>& staticCasters, const std::vector<Caster>& dynamicCasters,
+                const ParticleCasters& particles);
+
+    // Sets the uniforms of caustic_shadow.fs on a program that links it; after render()
+    void applyToReceiver(const GLShaderProgram& program) const;
+
+    bool isActive() const { return settings_.enabled && staticTexture_ != 0 && meshProgram_.isValid(); }
+    GLuint getStaticTexture() const { return staticTexture_; }
+    GLuint getDynamicTexture() const { return dynamicTexture_; }
+    const Stats& getStats() const { return stats_; }
+
+    // Receivers sample the maps on these units; nothing else binds them
+    static constexpr int STATIC_TEXTURE_UNIT = 12;
+    static constexpr int DYNAMIC_TEXTURE_UNIT = 13;
+
+private:
+    struct Cascade {
+        bool active = false;            // Reaches the scene bounds
+        glm::mat4 lightSpace{1.0f};     // Light view-projection
+        glm::mat4 texture{1.0f};        // lightSpace into [0,1] texture space
+        float texelWorld = 0.0f;        // World size of a texel
+        glm::vec2 center{0.0f};         // Light space, snapped
+        float halfSize = 0.0f;
+        glm::ivec3 key{0};              // Snapped center and radius the static layer was drawn with
+        bool staticValid = false;
+        bool dynamicEmpty = true;       // Cleared and left empty last frame
+    };
+
+    void allocate();
+    void release();
+    void updateDepthRange();
+    bool overlaps(const Cascade& cascade, const glm::vec3& center, float radius) const;
+    bool batchReady() const { return sceneBatch_ && batchProgram_.isValid(); }
+    void buildBatch(const std::vector<Caster>& casters, SceneBatch::DrawList& list) const;
+    void drawCasters(const Cascade& cascade, const std::vector<Caster>& casters, SceneBatch::DrawList& batched);
+    void drawParticles(const Cascade& cascade, const ParticleCasters& particles) const;
+
+    Settings settings_;
+    Stats stats_;
+    Cascade cascades_[CASCADES];
+
+    GLuint staticTexture_ = 0;          // GL_TEXTURE_2D_ARRAY of CASCADES depth layers each
+    GLuint dynamicTexture_ = 0;
+    GLuint framebuffer_ = 0;
+    GLuint particleVAO_ = 0;            // Empty; the particles are pulled from their buffer
+    int allocatedResolution_ = 0;
+    float maxPointSize_ = 64.0f;
+
+    GLShaderProgram meshProgram_;       // shadow_map.vs/fs
+    GLShaderProgram particleProgram_;   // The same with SHADOW_PARTICLES
+    GLShaderProgram batchProgram_;      // The same with SCENE_BATCH
+
+    // Batched casters of each map, built once per redraw and drawn in every cascade
+    SceneBatch* sceneBatch_ = nullptr;
+    SceneBatch::DrawList staticBatch_;
+    SceneBatch::DrawList dynamicBatch_;
+
+    glm::mat3 lightRotation_{1.0f};     // World to light view, looking along -z
+    glm::vec3 toLight_{0.0f, 1.0f, 0.0f};
+    glm::vec3 boundsMin_{-1.0f};
+    glm::vec3 boundsMax_{1.0f};
+    float depthNear_ = 0.0f;            // Light view z range of the bounds, as glm::ortho takes it
+    float depthFar_ = 1.0f;
+    bool staticDirty_ = true;
+};
+
+} // namespace WaterSim
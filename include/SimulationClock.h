@@ -0,0 +1,38 @@
+#pragma once
+
+namespace WaterSim {
+
+// Fixed-rate simulation tick, apart from the render rate. Each frame advance() takes the
+// frame's time and says how many ticks of getTickTime() to run; what is left over places the
+// frame between the last two ticks, and the renderers draw the simulation getRenderLag()
+// seconds before the last one (SimulationManager::setRenderLag), so its motion stays smooth
+// at any frame rate for one tick of latency. At most maxTicksPerFrame run per frame and a
+// longer frame drops the rest of its time, so a slow render slows the simulation only past
+// that. A tick rate of 0 is lockstep: one tick of the frame's own time every frame.
+class SimulationClock {
+public:
+    // Ticks per second
+    void setTickRate(float ticksPerSecond);
+    float getTickRate() const { return tickRate_; }
+    void setMaxTicksPerFrame(int ticks);
+
+    // Once per frame: the ticks to run now
+    int advance(float frameTime);
+
+    float getTickTime() const { return tickRate_ > 0.0f ? 1.0f / tickRate_ : frameTime_; }
+
+    // How far the frame is from the last tick towards the next, 0 to 1; 1 in lockstep
+    float getAlpha() const;
+    float getRenderLag() const { return tickRate_ > 0.0f ? getTickTime() - accumulator_ : 0.0f; }
+
+    // Drops the time carried over, after a pause or anything else that moved the simulation
+    void reset() { accumulator_ = 0.0f; }
+
+private:
+    float tickRate_ = 60.0f;
+    int maxTicksPerFrame_ = 4;
+    float accumulator_ = 0.0f;
+    float frameTime_ = 0.0f;
+};
+
+} // namespace WaterSim
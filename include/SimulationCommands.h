@@ -0,0 +1,81 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <atomic>
+#include <cstdint>
+
+namespace WaterSim {
+
+// One interaction with the running simulation. Plain data, so any thread can build one and
+// SimulationManager applies it on the render thread before the frame's update
+struct SimulationCommand {
+    enum class Type : uint32_t {
+        RIPPLE,             // addRipple(position, magnitude)
+        DIRECTIONAL_RIPPLE, // addDirectionalRipple(position, vector.xz, magnitude)
+        SPLASH,             // createSplash(position, magnitude)
+        FLOW_IMPULSE,       // addWaterFlowImpulse(position, vector.xz, magnitude as the radius)
+        IMPULSE,            // applyImpulse(position, vector, magnitude as the radius)
+        FLUID_STREAM,       // addFluidStream(position, vector, magnitude particles)
+        FLUID_VOLUME,       // addFluidVolume(position as the min corner, vector as the max)
+        GRAVITY,            // SPH gravity = vector
+        PARAMETER           // parameter = magnitude
+    };
+
+    enum class Parameter : uint32_t {
+        WATER_HEIGHT,
+        BOUNDARY_DAMPING,   // SPH wall restitution, 0 to 1
+        SPHERE_FRICTION     // SPH sphere coupling, 0 to 1
+    };
+
+    Type type = Type::RIPPLE;
+    Parameter parameter = Parameter::WATER_HEIGHT;
+    glm::vec3 position = glm::vec3(0.0f);
+    glm::vec3 vector = glm::vec3(0.0f);
+    float magnitude = 0.0f;
+
+    static SimulationCommand ripple(const glm::vec3& position, float magnitude);
+    static SimulationCommand directionalRipple(const glm::vec3& position, const glm::vec2& direction, float magnitude);
+    static SimulationCommand splash(const glm::vec3& position, float magnitude);
+    static SimulationCommand flowImpulse(const glm::vec3& position, const glm::vec2& impulse, float radius);
+    static SimulationCommand impulse(const glm::vec3& position, const glm::vec3& impulse, float radius);
+    static SimulationCommand fluidStream(const glm::vec3& origin, const glm::vec3& direction, float rate);
+    static SimulationCommand fluidVolume(const glm::vec3& minPos, const glm::vec3& maxPos);
+    static SimulationCommand gravity(const glm::vec3& gravity);
+    static SimulationCommand setParameter(Parameter parameter, float value);
+};
+
+// Bounded multi-producer queue of SimulationCommands; lock-free, after Vyukov's MPMC ring.
+// Each cell carries a sequence number: a producer claims a slot by advancing the enqueue
+// position with a CAS and publishes it with a release store of the cell's sequence, which
+// the consumer acquires before reading. A full queue drops the command rather than block
+// a producer, and counts it. push() may be called from any thread; pop() from one
+// consumer, SimulationManager's update.
+class SimulationCommandQueue {
+public:
+    static constexpr uint32_t CAPACITY = 1024;     // Power of two
+
+    SimulationCommandQueue();
+
+    SimulationCommandQueue(const SimulationCommandQueue&) = delete;
+    SimulationCommandQueue& operator=(const SimulationCommandQueue&) = delete;
+
+    bool push(const SimulationCommand& command);
+    bool pop(SimulationCommand& command);
+
+    uint32_t getDropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    struct Cell {
+        std::atomic<uint32_t> sequence;
+        SimulationCommand command;
+    };
+
+    static_assert((CAPACITY & (CAPACITY - 1)) == 0, "SimulationCommandQueue capacity must be a power of two");
+
+    Cell cells_[CAPACITY];
+    alignas(64) std::atomic<uint32_t> enqueuePosition_{0};  // Apart, so producers and the
+    alignas(64) std::atomic<uint32_t> dequeuePosition_{0};  // consumer do not share a line
+    alignas(64) std::atomic<uint32_t> dropped_{0};
+};
+
+} // namespace WaterSim
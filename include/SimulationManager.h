@@ -2,16 +2,28 @@
 
 #include <glm/glm.hpp>
 #include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <string>
+#include <vector>
 #include "WaterSurface.h"
 #include "SPHComputeSystem.h"
+#include "SPHCpuSystem.h"
+#include "SPHPlayback.h"
 #include "Config.h"
+#include "SimulationCommands.h"
+
+struct GLFWwindow;
 
 namespace WaterSim {
 
 enum class SimulationType {
     NONE,
     REGULAR_WATER,
-    SPH_COMPUTE   // GPU-optimized SPH using compute shaders
+    SPH_COMPUTE,  // GPU-optimized SPH using compute shaders
+    SPH_PLAYBACK  // A baked particle stream drawn through the SPH rendering (SPHPlayback)
 };
 
 class SimulationManager {
@@ -19,26 +31,50 @@ public:
     SimulationManager(const Config& config);
     ~SimulationManager();
     
-    // Simulation control
+    // Simulation control. Switching away parks the simulation on warm standby while
+    // config.standby allows: its objects, with their compiled programs, buffers and state,
+    // are kept as they are and not updated, and switching back resumes them where they
+    // stopped instead of initializing again
     void setSimulationType(SimulationType type);
     SimulationType getCurrentType() const { return currentType_; }
     
+    // The parked simulations are held to config.standby, the oldest parked going first: its
+    // memory budget, and the driver's free video memory where it reports it. trimStandby()
+    // applies it again after the settings change; evictStandby() drops them all, for memory
+    // pressure or settings they no longer match
+    void trimStandby();
+    void evictStandby();
+    size_t getStandbyBytes() const;
+    bool isOnStandby(SimulationType type) const;
+    
     // Initialize the selected simulation
     void initialize();
     void cleanup();
     
-    // Update simulation
+    // Update simulation; the queued commands are applied first
     void update(float deltaTime);
     
+    // Interactions from any thread (input, automation, remote control), applied by update()
+    SimulationCommandQueue& getCommandQueue() { return commands_; }
+    
+    // Wait for an in-flight asynchronous SPH update (call before touching SPH state directly)
+    void synchronize();
+    bool isAsyncSimulation() const { return simulationThread_.joinable(); }
+    
     // Render simulation
     void render(const glm::mat4& view, const glm::mat4& projection, 
                 unsigned int waterShader, bool rayTracingEnabled);
     
+    // Seconds before the last update the next frame draws the simulation at, between fixed
+    // ticks (SimulationClock); every frame, after the updates. Not for the asynchronous SPH
+    void setRenderLag(float seconds);
+    
     // Water surface interactions (for regular water)
     void addRipple(const glm::vec3& position, float magnitude);
     void addDirectionalRipple(const glm::vec3& position, const glm::vec2& direction, float magnitude);
     void createSplash(const glm::vec3& position, float magnitude);
     void addWaterFlowImpulse(const glm::vec3& position, const glm::vec2& impulse, float radius);
+    void setWaterObstacle(const glm::vec3& center, float radius);  // World space sphere
     
     // SPH interactions
     void applyImpulse(const glm::vec3& position, const glm::vec3& impulse, float radius);
@@ -50,14 +86,58 @@ public:
     // Getters for external systems
     WaterSurface* getWaterSurface() const { return waterSurface_.get(); }
     SPHComputeSystem* getSPHComputeSystem() const { return sphComputeSystem_.get(); }
+    SPHCpuSystem* getSPHCpuSystem() const { return sphCpuSystem_.get(); }
+    SPHPlayback* getPlayback() const { return playback_.get(); }   // Playing config.playback.path
     
     // State queries
     bool isRegularWaterActive() const { return currentType_ == SimulationType::REGULAR_WATER; }
     bool isSPHComputeActive() const { return currentType_ == SimulationType::SPH_COMPUTE; }
+    bool isSPHPlaybackActive() const { return currentType_ == SimulationType::SPH_PLAYBACK; }
+    
+    // SPH particles are drawn, simulated or played back: getSPHComputeSystem() renders them,
+    // though only a simulated one takes interactions
+    bool isSPHRenderActive() const { return (isSPHComputeActive() || isSPHPlaybackActive()) && sphComputeSystem_; }
     
     // Configuration
-    void setWaterHeight(float height) { waterHeight_ = height; }
+    void setWaterHeight(float height);
     float getWaterHeight() const { return waterHeight_; }
+    
+    // While set, every interaction (the methods above, the water height and the queued
+    // commands) is appended to the log as it is applied, for RewindTimeline; null stops it
+    void setCommandLog(std::vector<SimulationCommand>* log) { commandLog_ = log; }
+    
+    // The same for a session recording (CommandRecorder), apart from the rewind's log
+    void setRecordingLog(std::vector<SimulationCommand>* log) { recordingLog_ = log; }
+    
+    // While replaying a recording, only the queued commands reach the simulation: the
+    // interaction methods above drop calls from anywhere else (input, the render loop's
+    // own emitters), since the recording already holds what they did
+    void setReplaying(bool replaying) { replaying_ = replaying; }
+    bool isReplaying() const { return replaying_; }
+    
+    // Rewind keyframe: the SPH particles quantized into sphBuffer at sphOffset (256-byte
+    // aligned, SPHConstants::keyframeBytes of the particle count), the heightfield into
+    // heightfieldTexture (HeightfieldWaves::saveState, 0 without one), the rest in the
+    // struct. Restoring needs the same simulation type. Neither works while the SPH runs
+    // asynchronously or on the CPU (canKeyframe)
+    struct Keyframe {
+        SimulationType type = SimulationType::NONE;
+        float waterHeight = 0.0f;
+        float streamAccumulator = 0.0f;
+        bool sph = false;
+        SPHKeyframe sphState;
+        bool surface = false;
+        WaterSurface::State surfaceState;
+        bool heightfield = false;
+        float heightfieldAccumulator = 0.0f;
+    };
+    bool canKeyframe(std::string* reason = nullptr) const;
+    bool captureKeyframe(Keyframe& keyframe, GLuint sphBuffer, GLintptr sphOffset, GLuint heightfieldTexture);
+    bool restoreKeyframe(const Keyframe& keyframe, GLuint sphBuffer, GLintptr sphOffset, GLuint heightfieldTexture);
+    
+    // The water surface and the SPH final shading run at these rates (ShadingRateImage);
+    // null shades every pixel
+    void setShadingRateImage(const ShadingRateImage* rates) { shadingRates_ = rates; }
 
 private:
     const Config& config_;
@@ -66,16 +146,71 @@ private:
     // Water simulations
     std::unique_ptr<WaterSurface> waterSurface_;
     std::unique_ptr<SPHComputeSystem> sphComputeSystem_;
+    std::unique_ptr<SPHCpuSystem> sphCpuSystem_;      // Used instead when GPU acceleration is off
+    std::unique_ptr<SPHPlayback> playback_;           // SPH_PLAYBACK's stream, drawn by sphComputeSystem_
+    
+    // Warm standby: a parked simulation's objects, and the tracked GPU memory its
+    // initialization allocated (a lower bound, as the tracker's totals are)
+    struct Standby {
+        SimulationType type = SimulationType::NONE;
+        std::unique_ptr<WaterSurface> waterSurface;
+        std::unique_ptr<SPHComputeSystem> sphComputeSystem;
+        std::unique_ptr<SPHCpuSystem> sphCpuSystem;
+        float streamAccumulator = 0.0f;
+        size_t bytes = 0;
+    };
+    std::vector<Standby> standby_;      // Oldest parked first
+    size_t residentBytes_ = 0;          // The current simulation's, for when it is parked
     
     // State
     float waterHeight_;
     bool initialized_;
+    const ShadingRateImage* shadingRates_ = nullptr;
+    float streamAccumulator_ = 0.0f; // Fractional particles carried between stream calls
+    SimulationCommandQueue commands_;
+    std::vector<SimulationCommand>* commandLog_ = nullptr;
+    std::vector<SimulationCommand>* recordingLog_ = nullptr;
+    bool replaying_ = false;
+    bool executingCommands_ = false;
+    void logCommand(const SimulationCommand& command) {
+        if (commandLog_) commandLog_->push_back(command);
+        if (recordingLog_) recordingLog_->push_back(command);
+    }
+    bool acceptsInteraction() const { return !replaying_ || executingCommands_; }
+    
+    // Asynchronous SPH: a worker thread owns a hidden context shared with the main one and
+    // runs one update per frame while the main thread renders the previous snapshot
+    using SPHCommand = std::function<void(SPHComputeSystem&)>;
+    std::thread simulationThread_;
+    GLFWwindow* simulationContext_ = nullptr;
+    std::mutex simulationMutex_;
+    std::condition_variable simulationWake_;
+    std::vector<SPHCommand> pendingCommands_;
+    float pendingDeltaTime_ = 0.0f;
+    bool simulationWorkPending_ = false;
+    bool stopSimulationThread_ = false;
     
     // Private methods
     void initializeRegularWater();
     void initializeSPHCompute();
+    void initializePlayback();
     void cleanupRegularWater();
     void cleanupSPHCompute();
+    void cleanupPlayback();
+    bool parkCurrent();
+    bool resumeStandby(SimulationType type);
+    bool startSimulationThread();
+    void stopSimulationThread();
+    void simulationThreadLoop();
+    void executeCommands();
+    void executeCommand(const SimulationCommand& command);
+    void runSPHCommand(const SPHCommand& command);  // On the worker when the SPH runs there
+    
+    // Hybrid splashes: regular water keeps a GPU SPH system for the spray, fed by splashes
+    // and streams and drained back into the wave heightfield every update
+    bool hybridSplashesActive() const;
+    void initializeHybridSplashes();
+    void emitHybridSplash(const glm::vec3& position, float magnitude);
 };
 
 } // namespace WaterSim
\ No newline at end of file
@@ -1,9 +1,13 @@
 #pragma once
 
 #include <glad/glad.h>
+#include "GLResources.h"
+#include "JobSystem.h"
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <cstdint>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -15,13 +19,38 @@ public:
     ~Skybox();
 
     void initialize();
+    
+    // Starts loading the six faces and returns. Faces block-compressed by an earlier run are
+    // read from a DDS cache beside them and ready at once; otherwise they decode on the job
+    // pool and update() streams them up, while a 1x1 placeholder stands in
     void loadCubemap(const std::vector<std::string>& faces);
+    
+    // Hands the decoded faces to the UploadQueue, then once they are up swaps the finished
+    // cubemap in and builds the prefiltered map. Call once per frame
+    void update();
+    
     void render(const glm::mat4& view, const glm::mat4& projection);
+    // The cube with a program of skybox.vs whose cameras are set already (the stereo variant)
+    void renderWith(unsigned int program);
     void cleanup();
 
-    // Getters
+    // Getters. The cubemap is the placeholder until isLoaded(), so re-read it each frame
     unsigned int getCubemapTexture() const { return cubemapTexture; }
     bool isLoaded() const { return loaded; }
+    bool isLoading() const { return loading; }
+    
+    // GGX-prefiltered copy of the cubemap: mip m holds roughness m / getPrefilteredMaxLod().
+    // 0 until loadCubemap has built it or read it from the cache beside the faces
+    unsigned int getPrefilteredTexture() const { return prefilteredTexture; }
+    float getPrefilteredMaxLod() const { return float(PREFILTER_LEVELS - 1); }
+    
+    // Nine RGB spherical harmonic coefficients of the sky's irradiance over pi, the cosine
+    // lobe's band factors folded in (evaluated by shIrradiance in sphere.fs)
+    const glm::vec3* getIrradianceSH() const { return irradianceSH; }
+    
+    // Bind the prefiltered map on textureUnit and set environmentLighting, prefilteredEnv,
+    // prefilteredMaxLod and irradianceSH[] of the program in use
+    void setEnvironmentUniforms(const GLShaderProgram& program, int textureUnit) const;
 
 private:
     // OpenGL resources
@@ -29,13 +58,59 @@ private:
     unsigned int cubemapTexture;
     unsigned int shaderProgram;
     
+    // Prefiltered environment (env_prefilter.cs) and its irradiance
+    unsigned int prefilteredTexture;
+    unsigned int prefilterShader;
+    glm::vec3 irradianceSH[9];
+    static constexpr int PREFILTER_SIZE = 128;     // Texels per face edge of mip 0
+    static constexpr int PREFILTER_LEVELS = 6;     // Down to 4x4, roughness 1
+    static constexpr int PREFILTER_SAMPLES = 256;
+    static constexpr int SH_PROJECTION_SIZE = 32;  // Face edge the irradiance is projected from
+    
+    // Asynchronous loading: decodedFaces fill on the job pool, then go up through the
+    // UploadQueue into pendingTexture, compressed to BC7 by the driver (FACE_FORMAT)
+    struct DecodedFace {
+        const unsigned char* data = nullptr;  // RGBA8
+        int width = 0, height = 0;
+        bool found = false;
+        bool packed = false;            // data points into the asset pack, not owned
+    };
+    std::vector<std::string> sourceFaces;
+    std::vector<DecodedFace> decodedFaces;
+    std::unique_ptr<JobSystem::TaskGroup> decodeJobs;
+    unsigned int pendingTexture;
+    std::vector<uint64_t> faceUploads;  // UploadQueue tickets
+    int nextFace;
+    int uploadedFaces;
+    int sourceSize;                     // Face edge in texels
+    uint64_t sourceKey;
+    static constexpr GLenum FACE_FORMAT = GL_COMPRESSED_RGBA_BPTC_UNORM;
+    
     // State
     bool loaded;
+    bool loading;
     
     // Helper methods
     void setupCube();
     void setupShaders();
     unsigned int loadTexture(const std::string& path);
+    void createPlaceholder();
+    void finishLoad(unsigned int texture);
+    void releaseDecodedFaces();
+    
+    // BC7 copy of the faces (skybox_bc7.dds beside them), keyed like the prefilter cache
+    std::string compressedCachePath() const;
+    unsigned int readCompressedCache();
+    void writeCompressedCache(unsigned int texture) const;
+    
+    // Build the prefiltered map and irradiance once per set of faces; the result is cached
+    // beside the faces, keyed by their sizes and modification times. With source 0 only the
+    // cache is tried; false if it was stale or the build failed
+    std::string prefilterCachePath() const;
+    bool prefilterEnvironment(unsigned int source);
+    bool readPrefilterCache(const std::string& cachePath, uint64_t sourceKey);
+    void writePrefilterCache(const std::string& cachePath, uint64_t sourceKey) const;
+    void projectIrradianceSH(unsigned int source);
     
     // Skybox cube vertices
     static const float skyboxVertices[];
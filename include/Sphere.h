@@ -4,14 +4,46 @@
 #include <glm/glm.hpp>
 #include <vector>
 
+// Sphere geometry is shared by every Sphere: LOD_COUNT icosphere levels of the unit sphere in
+// one vertex and index buffer, and an instance buffer of centre offset and radius that
+// feeds attribute 3 (sphere.vs, planar_layered.vs, shadow_map.vs). Each sphere draws as one
+// instance of its own slot; renderInstanced draws any number of spheres in one call.
 class Sphere {
 public:
-    Sphere(float radius = 1.0f, int sectorCount = 36, int stackCount = 18);
+    static constexpr int LOD_COUNT = 4;          // Icosphere subdivisions 1 (80 triangles) to 4 (5120)
+    static constexpr int MAX_OBJECTS = 64;       // Spheres alive at once, one instance slot each
+    static constexpr int MAX_INSTANCES = 4096;   // Per renderInstanced call
+
+    Sphere(float radius = 1.0f);
     ~Sphere();
 
     void initialize();
     void update(float deltaTime);
+
+    // At the level set by setLOD, or the one given
     void render(unsigned int shaderProgram);
+    void render(unsigned int shaderProgram, int level);
+
+    // Spheres of one level in one draw: per instance the centre in xyz, the radius in w,
+    // under the program's model matrix. Needs a live Sphere for the shared geometry
+    static void renderInstanced(unsigned int shaderProgram, const std::vector<glm::vec4>& instances, int lod);
+
+    // Builds the unit sphere of every level on the CPU, once; the first initialize or
+    // buildLevel does it otherwise. Any thread, before either runs
+    static void prepareLevels();
+
+    // A level's unit sphere in the 8-float vertex of the shared buffer, for a copy in the
+    // scene batch (SceneBatch)
+    static void buildLevel(int level, std::vector<float>& vertices, std::vector<unsigned int>& indices);
+
+    // Level of detail: the coarsest level whose edges project to at most about
+    // LOD_EDGE_PIXELS, from the radius on screen. focalPixels is the viewport height over
+    // 2 tan(fov / 2), see focalLength
+    static int selectLOD(float projectedRadiusPixels);
+    static float focalLength(int viewportHeight, float fovYDegrees);
+    int lodFor(const glm::vec3& eye, float focalPixels) const;
+    void setLOD(int level) { lod = level < 0 ? 0 : (level >= LOD_COUNT ? LOD_COUNT - 1 : level); }
+    int getLOD() const { return lod; }
 
     // Getters and setters
     void setPosition(const glm::vec3& pos) { position = pos; }
@@ -40,12 +72,9 @@ public:
 
 private:
     // Geometry
-    unsigned int VAO, VBO, EBO;
     float radius;
-    int sectorCount;
-    int stackCount;
-    std::vector<float> vertices;
-    std::vector<unsigned int> indices;
+    int lod;
+    int instanceSlot;   // Of the shared instance buffer, -1 before initialize
     
     // Physics properties
     glm::vec3 position;
@@ -60,12 +89,4 @@ private:
     
     // Interaction
     bool dragged;
-    
-    // Helper methods
-    void generateVertices();
-    void generateIndices();
-    
-    // Calculate vertices with normals and texture coordinates
-    void buildVertices();
-    std::vector<float> getUnitCircleVertices();
-}; 
\ No newline at end of file
+};
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace WaterSim {
+
+// Startup work as a dependency graph over the job pool. A task has a CPU part, which runs
+// on a worker once every task it depends on is complete, and an upload part, which runs on
+// the context thread after it; either may be empty, and the task is complete once both have
+// run. run() starts the CPU parts as their dependencies resolve and does the uploads in
+// between, helping with queued jobs while nothing is ready, so a pool without workers still
+// gets through it. Each part is recorded as a trace slice.
+class StartupGraph {
+public:
+    using Task = std::function<void()>;
+
+    StartupGraph() = default;
+
+    StartupGraph(const StartupGraph&) = delete;
+    StartupGraph& operator=(const StartupGraph&) = delete;
+
+    // An id for the dependencies of later tasks; those must already have been added
+    int add(const std::string& name, Task prepare, Task upload, const std::vector<int>& dependencies = {});
+
+    // Context thread: returns once every task is complete
+    void run();
+
+    float getElapsedMs() const { return elapsedMs_; }
+
+private:
+    enum class State { WAITING, PREPARING, PREPARED, COMPLETE };
+
+    struct Node {
+        std::string name;
+        Task prepare;
+        Task upload;
+        std::vector<int> dependencies;
+        State state = State::WAITING;
+        std::atomic<bool> prepared{false};  // Set by the worker that ran the CPU part
+        float prepareMs = 0.0f;
+        float uploadMs = 0.0f;
+    };
+
+    bool ready(const Node& node) const;
+
+    std::vector<std::unique_ptr<Node>> nodes_;
+    float elapsedMs_ = 0.0f;
+};
+
+} // namespace WaterSim
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+namespace WaterSim {
+
+// Both eyes of a head-mounted display from one pass over the scene. The opaque scene is
+// drawn once into a two-layer color and depth array attached through GL_OVR_multiview2:
+// every draw runs for both views, and the programs built with STEREO_MULTIVIEW pick the
+// eye's camera from the frame uniform block by gl_ViewID_OVR. resolve() then lays the two
+// layers side by side in the window-sized scene target, so post-processing runs once over
+// both eyes. The simulation and the planar reflection and refraction are shared with the
+// mono path; the eyes only differ in their camera.
+//
+// Eyes are parallel cameras eyeSeparation apart with asymmetric frusta meeting at the
+// convergence distance, so objects there have no parallax.
+class StereoRenderer {
+public:
+    static constexpr int EYE_COUNT = 2;     // num_views of the STEREO_MULTIVIEW shaders
+
+    struct Settings {
+        float eyeSeparation = 0.064f;       // Interpupillary distance, world units
+        float convergence = 10.0f;          // Distance of zero parallax
+    };
+
+    StereoRenderer() = default;
+    ~StereoRenderer();
+
+    StereoRenderer(const StereoRenderer&) = delete;
+    StereoRenderer& operator=(const StereoRenderer&) = delete;
+
+    // Whether the driver exposes GL_OVR_multiview2 with at least two views
+    bool initialize();
+    bool isSupported() const { return supported_; }
+
+    void setSettings(const Settings& settings) { settings_ = settings; }
+    const Settings& getSettings() const { return settings_; }
+
+    // Eye cameras of a mono camera with a vertical field of view in degrees; aspect is of
+    // one eye, half the window's
+    void setCamera(const glm::mat4& view, float fovDegrees, float aspect, float nearPlane, float farPlane);
+    const glm::mat4& getView(int eye) const { return views_[eye]; }
+    const glm::mat4& getProjection(int eye) const { return projections_[eye]; }
+    const glm::mat4* getViews() const { return views_; }
+    const glm::mat4* getProjections() const { return projections_; }
+
+    // Binds the multiview target at half the window's width per eye, reallocating it from
+    // the RenderTargetPool on a size change, and clears it
+    void begin(int windowWidth, int windowHeight, const glm::vec4& clearColor);
+
+    // Left eye to the left half of the framebuffer, right to the right, color and depth;
+    // the framebuffer is bound again afterwards
+    void resolve(GLuint framebuffer);
+
+    int getEyeWidth() const { return eyeWidth_; }
+    int getEyeHeight() const { return eyeHeight_; }
+
+private:
+    void allocate(int eyeWidth, int eyeHeight);
+    void release();
+
+    Settings settings_;
+    bool supported_ = false;
+
+    glm::mat4 views_[EYE_COUNT] = { glm::mat4(1.0f), glm::mat4(1.0f) };
+    glm::mat4 projections_[EYE_COUNT] = { glm::mat4(1.0f), glm::mat4(1.0f) };
+
+    GLuint colorArray_ = 0;     // EYE_COUNT layers, RGBA16F as the scene target
+    GLuint depthArray_ = 0;     // DEPTH_COMPONENT24 as the scene depth, so depth blits
+    GLuint multiviewFBO_ = 0;
+    GLuint eyeFBOs_[EYE_COUNT] = { 0, 0 };  // One layer each, read by resolve()
+    int eyeWidth_ = 0;
+    int eyeHeight_ = 0;
+};
+
+} // namespace WaterSim
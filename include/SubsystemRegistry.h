@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace WaterSim {
+
+// Heavyweight subsystems created on first use instead of at startup, and released again
+// after a stretch of disuse, so startup time and the baseline GPU memory only pay for the
+// features in use. Each registers a factory that allocates and initializes it (compiling
+// through the ShaderCompiler where it can, so the programs arrive asynchronously) and a
+// release that frees all of it; its owner keeps the pointer the two assign. use() creates
+// it on the first frame that needs it, and endFrame() releases it once that many frames
+// have gone by without one. Context thread only.
+class SubsystemRegistry {
+public:
+    struct Subsystem {
+        std::string name;
+        std::function<void()> create;
+        std::function<void()> release;
+        int idleFrames = 1800;              // Unused frames before a release; 0 keeps it once created
+    };
+
+    struct Status {
+        std::string name;
+        bool resident = false;
+        int idleFrames = 0;                 // Since the last use
+        int creations = 0;
+        float createMs = 0.0f;              // CPU time of the last creation
+    };
+
+    SubsystemRegistry() = default;
+
+    SubsystemRegistry(const SubsystemRegistry&) = delete;
+    SubsystemRegistry& operator=(const SubsystemRegistry&) = delete;
+
+    // An id for use()
+    int add(Subsystem subsystem);
+
+    // Needed this frame: created first when it is not resident
+    void use(int id);
+    bool isResident(int id) const;
+
+    // Once per frame, after the last use()
+    void endFrame();
+
+    void release(int id);
+    void releaseAll();
+
+    std::vector<Status> getStatus() const;
+
+private:
+    struct Entry {
+        Subsystem subsystem;
+        bool resident = false;
+        uint64_t lastUse = 0;
+        int creations = 0;
+        float createMs = 0.0f;
+    };
+
+    std::vector<Entry> entries_;
+    uint64_t frame_ = 0;
+};
+
+} // namespace WaterSim
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include "GLResources.h"
+
+namespace WaterSim {
+
+// Temporal anti-aliasing with upscaling of the whole scene. The scene renders at a fraction
+// of the window through a projection jittered along a Halton (2, 3) sequence, and
+// taa_resolve.cs reconstructs each window pixel from the render texels around it, blended
+// with the previous output reprojected to it. The history is clipped to the current 3x3
+// neighbourhood in YCoCg, so what the reprojection misses fades in rather than ghosts.
+//
+// Motion comes from the nearest depth in the 3x3 reprojected through last frame's camera.
+// The sphere moves by its own translation where its volume covers the depth, and SPH fluid
+// in front of the scene by the particle velocities its depth pass splats (SPHComputeSystem).
+class TemporalUpscaler {
+public:
+    static constexpr int JITTER_PHASES = 8;
+
+    struct Settings {
+        float renderScale = 1.0f;       // Of the window, 0.5 to 1
+        float feedback = 0.9f;          // History weight of a still pixel
+        float varianceGamma = 1.25f;    // Width of the clip box in standard deviations
+    };
+
+    // What the resolve reads besides the scene: zero fluid textures go without fluid motion
+    struct Inputs {
+        GLuint color = 0;               // HDR scene at the render size
+        GLuint depth = 0;
+        GLuint fluidDepth = 0;          // Smoothed SPH window depth, 1 where there is none
+        GLuint fluidMotion = 0;         // Window UV the fluid moved by since the last frame
+        glm::vec4 sphere{0.0f};         // Center and radius this frame
+        glm::vec3 previousSphereCenter{0.0f};
+    };
+
+    TemporalUpscaler() = default;
+    ~TemporalUpscaler();
+
+    TemporalUpscaler(const TemporalUpscaler&) = delete;
+    TemporalUpscaler& operator=(const TemporalUpscaler&) = delete;
+
+    // Allocates the window-sized history and submits taa_resolve.cs
+    bool initialize(int outputWidth, int outputHeight);
+    void resize(int outputWidth, int outputHeight);
+
+    void setSettings(const Settings& settings);
+    const Settings& getSettings() const { return settings_; }
+
+    // Until the program is built the scene renders at the window size, unjittered
+    bool isReady() const { return resolveProgram_.isValid(); }
+
+    // The scene's targets follow this size
+    glm::ivec2 getRenderSize() const;
+    glm::ivec2 getOutputSize() const { return glm::ivec2(outputWidth_, outputHeight_); }
+
+    // Starts a frame of the unjittered camera; returns the jitter in render pixels
+    glm::vec2 beginFrame(const glm::mat4& view, const glm::mat4& projection);
+    const glm::mat4& getViewProjection() const { return viewProjection_; }
+    const glm::mat4& getPreviousViewProjection() const { return previousViewProjection_; }
+
+    // Resolves this frame into the next history and returns it, window-sized
+    GLuint resolve(const Inputs& inputs);
+
+    // The next resolve starts over from the current frame
+    void resetHistory() { historyValid_ = false; }
+
+private:
+    void createHistory();
+
+    Settings settings_;
+    GLShaderProgram resolveProgram_;    // taa_resolve.cs
+    GLTexture history_[2];
+    int historyIndex_ = 0;              // The one the last resolve wrote
+    bool historyValid_ = false;
+    int outputWidth_ = 0, outputHeight_ = 0;
+
+    unsigned int frameIndex_ = 0;
+    glm::vec2 jitter_{0.0f};
+    glm::mat4 viewProjection_{1.0f};
+    glm::mat4 previousViewProjection_{1.0f};
+};
+
+} // namespace WaterSim
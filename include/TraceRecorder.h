@@ -0,0 +1,109 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace WaterSim {
+
+// Always-on event log for offline analysis of long sessions, saved on demand as Chrome
+// trace JSON (chrome://tracing, ui.perfetto.dev) or as a Perfetto protobuf trace.
+//
+// Every thread records into a ring of its own: the writer fills a slot and then publishes
+// it by bumping the ring's head, so recording takes no lock and never waits. A full ring
+// overwrites its oldest events; the ring therefore holds the last RING_EVENTS of each
+// thread. save() copies the rings while recording goes on, and drops any event a writer
+// overtook during the copy.
+//
+// ProfileScope records a CPU slice per scope, and the Profiler a GPU slice per timed
+// marker once its timestamps land, placed on the CPU clock so both tracks line up.
+class TraceRecorder {
+public:
+    enum class EventType : uint8_t {
+        SLICE,          // CPU work of duration on the recording thread
+        GPU_SLICE,      // GPU work of duration, on the GPU track whichever thread records it
+        COUNTER,        // value of name from here on
+        INSTANT,        // Something happened (a ripple, a splash)
+        MESSAGE         // Text too long for a name (GL debug output); value indexes the message ring
+    };
+
+    static TraceRecorder& instance();
+
+    // On by default; off makes every record call a single load
+    void setEnabled(bool enable) { enabled_.store(enable, std::memory_order_relaxed); }
+    bool isEnabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+    // Nanoseconds on the recorder's clock (steady_clock since the recorder started)
+    static int64_t now();
+
+    // Any thread. Names longer than NAME_LENGTH - 1 are cut
+    void slice(const char* name, int64_t startNs, int64_t endNs);
+    void gpuSlice(const char* name, int64_t startNs, int64_t endNs);
+    void counter(const char* name, double value);
+    void instant(const char* name, double value = 0.0);
+    
+    // An instant carrying text of any length, kept in a ring of its own of the last
+    // MESSAGE_RING entries (a lock per call, for rare events only)
+    void message(const char* name, const char* text);
+
+    // Names the calling thread's track
+    void setThreadName(const std::string& name);
+
+    // Chrome trace JSON, or the Perfetto protobuf when the path ends in .pftrace or
+    // .perfetto-trace. Only the events from sinceNs on go out (the slices still open then
+    // too); 0 is all the rings hold. False if the file cannot be written
+    bool save(const std::string& path, int64_t sinceNs = 0);
+
+    static constexpr size_t RING_EVENTS = 1u << 16;
+    static constexpr size_t NAME_LENGTH = 40;
+    static constexpr size_t MESSAGE_RING = 256;
+
+private:
+    struct Event {
+        char name[NAME_LENGTH];
+        EventType type;
+        int64_t timestamp;      // ns
+        int64_t duration;       // ns, slices only
+        double value;           // Counters and instants
+    };
+
+    // Single-producer ring; head counts every event ever written
+    struct ThreadRing {
+        std::unique_ptr<Event[]> events{new Event[RING_EVENTS]};
+        std::atomic<uint64_t> head{0};
+        uint32_t threadId = 0;
+        std::string threadName;
+    };
+
+    struct Snapshot {
+        uint32_t threadId;
+        std::string threadName;
+        std::vector<Event> events;
+        std::map<uint64_t, std::string> messages;   // The MESSAGE events' text, by index
+    };
+
+    TraceRecorder() = default;
+
+    void record(EventType type, const char* name, int64_t timestamp, int64_t duration, double value);
+    ThreadRing& threadRing();
+    std::vector<Snapshot> snapshot(int64_t sinceNs);
+    bool writeJSON(const std::string& path, const std::vector<Snapshot>& threads) const;
+    bool writePerfetto(const std::string& path, const std::vector<Snapshot>& threads) const;
+
+    std::atomic<bool> enabled_{true};
+
+    // Rings outlive their threads so a save after a thread exits still sees its events.
+    // The lock is taken once per thread, on its first event, and by save()
+    std::mutex ringsMutex_;
+    std::vector<std::unique_ptr<ThreadRing>> rings_;
+
+    std::mutex messagesMutex_;
+    std::vector<std::string> messages_ = std::vector<std::string>(MESSAGE_RING);
+    uint64_t messageCount_ = 0;
+};
+
+} // namespace WaterSim
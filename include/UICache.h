@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace WaterSim {
+
+// Dear ImGui's draw data kept from one UI build to the next. The widgets are rebuilt
+// (NewFrame, the panels, Render) only when input has arrived, a widget is being held or
+// typed into, a watched value has moved past its threshold, invalidate() was called, or
+// 1 / refreshHz seconds have passed for the live stats; every other frame draws the last
+// build's lists again. A rebuild brought on by a change is followed by a few more, as
+// ImGui settles hover states and window sizes over frames. Context thread only.
+class UICache {
+public:
+    struct Settings {
+        bool enabled = true;
+        float refreshHz = 10.0f;            // Rebuilds for the live stats alone
+    };
+
+    struct Stats {
+        int rebuilds = 0;
+        int replays = 0;
+    };
+
+    void setSettings(const Settings& settings) { settings_ = settings; }
+    const Settings& getSettings() const { return settings_; }
+
+    // Before beginFrame, every frame, in the same order: a change of more than threshold
+    // since the last build rebuilds the UI
+    void watch(float value, float threshold = 0.0f);
+
+    // Whether this frame builds the UI: the caller then runs NewFrame, the widgets and
+    // Render, otherwise it draws ImGui::GetDrawData() as it is. deltaTime advances the
+    // refresh clock
+    bool beginFrame(float deltaTime);
+
+    // Seconds since the previous build, for per-frame work done from the widgets
+    float getBuildInterval() const { return buildInterval_; }
+
+    void invalidate() { invalidated_ = true; }
+
+    const Stats& getStats() const { return stats_; }
+
+private:
+    bool inputPending() const;
+
+    Settings settings_;
+    Stats stats_;
+    std::vector<float> built_;              // Watched values as the last build saw them
+    std::vector<float> current_;
+    size_t watchIndex_ = 0;
+    bool watchChanged_ = false;
+    bool invalidated_ = true;
+    bool hasDrawData_ = false;
+    int settleFrames_ = 0;
+    float sinceBuild_ = 0.0f;
+    float buildInterval_ = 0.0f;
+};
+
+} // namespace WaterSim
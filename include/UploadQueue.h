@@ -0,0 +1,120 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+struct GLFWwindow;
+
+namespace WaterSim {
+
+// Large texture and buffer fills on a dedicated thread, whose hidden window's context shares
+// objects with the main one, so they never stall the thread issuing frames. submit() queues
+// a job: the upload thread copies its bytes into a persistently mapped staging ring, runs its
+// commands with the ring bound as GL_PIXEL_UNPACK_BUFFER and fences them. The context
+// thread polls isComplete() and calls waitForUse() before the first draw that reads the
+// result, which queues a wait on the fence in its own command stream rather than blocking.
+// Objects a job writes must exist before submit(), which flushes so the other context sees
+// them. Without the thread (not started, or no shared context) a job runs inside submit()
+// straight from the caller's bytes.
+class UploadQueue {
+public:
+    using Ticket = uint64_t;            // 0: nothing left to wait for
+
+    // Where a job's bytes are: pixels() goes as the data pointer of glTex(Sub)Image* calls,
+    // and a buffer copies from buffer at offset, or from data when buffer is 0
+    struct Staging {
+        GLuint buffer = 0;
+        GLintptr offset = 0;
+        const void* data = nullptr;
+        const void* pixels() const { return buffer ? reinterpret_cast<const void*>(offset) : data; }
+    };
+    using Command = std::function<void(const Staging& staging)>;
+
+    struct Stats {
+        int submitted = 0;
+        int completed = 0;
+        size_t bytes = 0;               // Through the staging ring or past it
+        int unstaged = 0;               // Jobs larger than the ring, read from client memory
+    };
+
+    static UploadQueue& instance();
+
+    // Context thread, its context current: creates the upload context, thread and ring
+    bool start(size_t stagingBytes);
+    // Runs what is queued, then destroys the context; before the main context goes away
+    void stop();
+    bool isThreaded() const { return thread_.joinable(); }
+
+    // Context thread. bytes are read when the job runs: they must stay valid until its
+    // ticket has been waited on. The vector overload keeps its bytes itself
+    Ticket submit(const std::string& name, const void* data, size_t bytes, Command command);
+    Ticket submit(const std::string& name, std::vector<unsigned char> bytes, Command command);
+
+    // Level 0 (or one layer or cube face of it) of a texture with its storage allocated,
+    // optionally followed by its mip chain
+    Ticket uploadTexture(GLuint texture, int layer, int width, int height, GLenum format, GLenum type,
+                         const void* data, size_t bytes, bool generateMipmaps);
+    Ticket uploadBuffer(GLuint buffer, GLintptr offset, const void* data, size_t bytes);
+
+    // Context thread. Whether the job's commands have finished on the GPU, without waiting
+    bool isComplete(Ticket ticket);
+    // Before the first use of what the job wrote; releases the ticket. Blocks only until the
+    // upload thread has issued the job, never on the GPU
+    void waitForUse(Ticket ticket);
+
+    Stats getStats() const;
+    int getPendingCount() const;
+
+private:
+    struct Job {
+        Ticket ticket = 0;
+        std::string name;
+        const void* data = nullptr;
+        size_t bytes = 0;
+        std::vector<unsigned char> owned;
+        Command command;
+    };
+    struct Issued {
+        bool done = false;
+        GLsync fence = nullptr;
+    };
+    struct Region {
+        size_t begin, end;
+        GLsync fence;                   // The ring's own, so tickets release theirs freely
+    };
+
+    UploadQueue() = default;
+    ~UploadQueue();
+
+    Ticket enqueue(Job job);
+    void threadLoop();
+    Staging stage(const Job& job);
+
+    GLFWwindow* context_ = nullptr;
+    std::thread thread_;
+    mutable std::mutex mutex_;
+    std::condition_variable wake_;      // Jobs for the thread
+    std::condition_variable issued_;    // Fences for waitForUse
+    std::deque<Job> jobs_;
+    std::unordered_map<Ticket, Issued> tickets_;
+    Ticket nextTicket_ = 1;
+    bool stop_ = false;
+    Stats stats_;
+
+    // Upload thread only
+    GLuint ringBuffer_ = 0;
+    unsigned char* ringMapping_ = nullptr;
+    size_t ringSize_ = 0;
+    size_t ringCursor_ = 0;
+    std::deque<Region> regions_;
+};
+
+} // namespace WaterSim
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+#include "GLResources.h"
+
+namespace WaterSim {
+
+class WaveState;
+class SPHComputeSystem;
+
+// One query point's answer, laid out as water_query.cs and sph_query.cs write it
+struct WaterQueryResult {
+    glm::vec3 normal{0.0f, 1.0f, 0.0f};
+    float height = 0.0f;            // World height of the surface over the point
+    glm::vec3 velocity{0.0f};       // Of the water at the point (the surface's, above it)
+    float fraction = 0.0f;          // Submerged: 1 in the water, 0 in the air
+};
+
+// Batched water queries for floating objects: callers submit world points during the
+// frame, one dispatch after the wave state update answers all of them (from the WaveState
+// textures over regular water, from the particle grid in SPH mode) into a persistently
+// mapped readback ring, and the first beginFrame that finds a slot's fence signaled
+// publishes it. Like GPUPicker, nothing waits: results trail by a frame or two, and a frame
+// whose ring slot is still in flight goes unanswered.
+//
+// A ticket is the range its points took in the frame's batch; a caller that submits the same
+// points in the same order every frame reads, with this frame's ticket, the newest results
+// that have landed for them. Context thread only.
+class WaterQueries {
+public:
+    static constexpr uint32_t MAX_POINTS = 1024;    // Per frame, the rest are dropped
+    static constexpr uint32_t READBACK_FRAMES = 3;
+
+    struct Ticket {
+        uint32_t first = 0;
+        uint32_t count = 0;         // 0: nothing was queued
+    };
+
+    WaterQueries() = default;
+    ~WaterQueries();
+
+    WaterQueries(const WaterQueries&) = delete;
+    WaterQueries& operator=(const WaterQueries&) = delete;
+
+    bool initialize();
+
+    // Once per frame, before the callers submit: collects the batches that have landed
+    void beginFrame();
+
+    Ticket submit(const glm::vec3* points, uint32_t count);
+    Ticket submit(const glm::vec3& point) { return submit(&point, 1); }
+
+    // After the wave state update: answers the frame's batch from the waves around
+    // waterLevel, or from the fluid when sph is given (its grid is that of the last substep)
+    void dispatch(const WaveState& waves, float waterLevel);
+    void dispatch(SPHComputeSystem& sph);
+
+    // The newest landed results for the ticket's range; false before any have landed, or
+    // when the landed batch was shorter (the caller's points moved in the batch)
+    bool getResults(const Ticket& ticket, WaterQueryResult* results) const;
+    // How many frames old they are
+    uint64_t getResultAge() const { return latestFrame_ ? frame_ - latestFrame_ : 0; }
+
+private:
+    struct Slot {
+        GLsync fence = nullptr;
+        uint32_t count = 0;
+        uint64_t frame = 0;
+    };
+
+    // Uploads the batch and claims a ring slot; false when there is nothing to do
+    bool beginDispatch();
+    void endDispatch();
+
+    GLShaderProgram program_;           // water_query.cs
+    GLuint pointBuffer_ = 0;            // vec4 per point
+    GLuint resultBuffer_ = 0;           // Written by the dispatch, copied into the ring
+    GLuint readbackBuffer_ = 0;         // READBACK_FRAMES batches of MAX_POINTS
+    const WaterQueryResult* readbackResults_ = nullptr;
+    Slot slots_[READBACK_FRAMES];
+    uint32_t writeIndex_ = 0;
+
+    std::vector<glm::vec4> points_;     // This frame's batch
+    std::vector<WaterQueryResult> latest_;
+    uint64_t latestFrame_ = 0;
+    uint64_t frame_ = 0;
+};
+
+} // namespace WaterSim
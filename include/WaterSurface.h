@@ -3,7 +3,41 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 #include <vector>
+#include <array>
+#include <cstdint>
 #include <random>
+#include "WaveKernel.h"
+#include "OceanFFT.h"
+#include "HeightfieldWaves.h"
+#include "FlowMap.h"
+#include "FoamParticles.h"
+#include "FrameArena.h"
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// The water grid as other passes draw it (the ray tracing G-buffer and caustic map): the
+// surface's own vertex array and buffers by handle, never copied, and the textures that
+// displace it on the GPU. A flat grid (GPU waves) takes its Gerstner displacement from the
+// frame's wave state (WaveState), which the caller fills in; the heightfield adds on top
+struct WaterSurfaceGeometry {
+    GLuint vao = 0;
+    int indexCount = 0;
+    int baseVertex = 0;                 // Newest vertex ring slot
+    GLenum primitive = GL_TRIANGLES;
+    GLenum indexType = GL_UNSIGNED_INT;
+    bool packedVertices = false;
+    float size = 10.0f;
+    bool flatGrid = false;              // GPU Gerstner waves: the grid carries no heights
+    GLuint oceanDisplacement = 0;       // FFT ocean, 0 when off
+    GLuint oceanNormalFoam = 0;
+    float oceanPatchSize = 1.0f;
+    GLuint heightfield = 0;             // Wave-equation heights, 0 when off
+    GLuint waveHeightMap = 0;           // WaveState: height, horizontal displacement
+    GLuint waveNormalMap = 0;
+    float waveHeightMapSize = 10.0f;
+};
 
 class WaterSurface {
 public:
@@ -14,6 +48,11 @@ public:
     void update(float deltaTime);
     void render(unsigned int shaderProgram);
 
+    // Render interpolation between fixed simulation ticks, after each frame's updates: the
+    // GPU waves, flow and heightfield are drawn this many seconds before the last update.
+    // The CPU mesh and the ocean keep the update's time
+    void setRenderLag(float seconds);
+
     // Gerstner wave parameters
     struct WaveParam {
         glm::vec2 direction;
@@ -23,15 +62,19 @@ public:
         float steepness;
     };
     
-    // Foam particles
-    struct FoamParticle {
+    // Displaced surface point of the grid position (x, z): waves plus ripples, with the
+    // normal and the x tangent from the analytic derivatives
+    struct WaveSample {
         glm::vec3 position;
-        glm::vec3 velocity;
-        float lifetime;
-        float maxLifetime;
-        float size;
+        glm::vec3 normal;
+        glm::vec3 tangent;
     };
-
+    WaveSample sampleWaves(float x, float z, float time) const;
+    
+    // Largest difference of the batched CPU wave kernel from its scalar reference over the
+    // grid at the given time (positions and normals, without ripples)
+    float validateWaveKernel(float time) const;
+    
     // Wave interactions
     void addRipple(const glm::vec3& position, float magnitude);
     void addDirectionalRipple(const glm::vec3& position, const glm::vec2& direction, float magnitude);
@@ -51,29 +94,188 @@ public:
     glm::vec2 getFlowVelocity() const { return flowVelocity; }
     void addImpulse(const glm::vec3& position, const glm::vec2& impulse, float radius);
     
-    // Foam generation
+    // Flow map mode: impulses are splatted into a GPU velocity field (FlowMap) that carries
+    // the foam, scrolls the micro-detail and drifts the ripples with the local current
+    // rather than the one uniform flowVelocity, which becomes the current it relaxes to
+    void setFlowMap(bool enable, int flowMapResolution = 64);
+    bool getFlowMapEnabled() const { return flowMapEnabled; }
+    FlowMap* getFlowMap() { return flowMapEnabled ? flowMap.get() : nullptr; }
+    
+    // Animation time, flow and ripple pools for a rewind keyframe; the heightfield has its
+    // own (HeightfieldWaves::saveState), the flow map restarts from the base current and
+    // the foam is not kept
+    struct State;
+    State getState() const;
+    void setState(const State& state);
+    
+    // Foam generation, simulated and drawn on the GPU (FoamParticles)
+    static constexpr int FOAM_CAPACITY = 16384;
     void generateFoam(const glm::vec3& position, float intensity, int count = 20);
     void updateFoam(float deltaTime);
-    const std::vector<FoamParticle>& getFoamParticles() const { return foamParticles; }
+    
+    // The frame's wave state (WaveState) the foam lands on, 0 to let it fall through
+    void setFoamWaveSurface(GLuint heightTexture, GLuint velocityTexture, float stateSize);
+    
+    // GPU wave mode: water.vs displaces the static grid from the wave parameter block, so
+    // update() uploads the wave and ripple parameters instead of every vertex
+    static constexpr int MAX_GPU_WAVES = 16;
+    static constexpr int MAX_GPU_RIPPLES = 32;  // The newest ripples when there are more
+    void setGPUWaves(bool enable);
+    bool getGPUWaves() const { return gpuWaves; }
+    
+    // FFT ocean mode: water.vs displaces the flat grid from the tiling OceanFFT textures
+    // instead of the Gerstner waves; ripples still apply on top
+    void setOceanWaves(bool enable);
+    bool getOceanWaves() const { return oceanWaves; }
+    void setOceanSettings(const OceanFFT::Settings& settings);
+    const OceanFFT::Settings& getOceanSettings() const { return oceanSettings; }
+    const OceanFFT* getOcean() const { return oceanWaves ? ocean.get() : nullptr; }
+    
+    // Heightfield ripple mode: addRipple, addDirectionalRipple and createSplash stamp a
+    // wave-equation heightfield instead of adding analytic rings, and the obstacle (the
+    // sphere, in surface coordinates with the water plane at y = 0) reflects its waves
+    void setHeightfieldWaves(bool enable, int heightfieldResolution = 256);
+    bool getHeightfieldWaves() const { return heightfieldWaves; }
+    HeightfieldWaves* getHeightfield() { return heightfieldWaves ? heightfield.get() : nullptr; }
+    void setObstacle(const glm::vec3& center, float radius);
+    
+    // Camera-centred LOD mesh (CDLOD, Strugar 2009): a quadtree over the surface picks
+    // patches of one shared grid, finer near the camera and frustum culled, drawn instanced
+    // and geomorphed between levels in water.vs. Only used while the waves are displaced on
+    // the GPU; the CPU path keeps the uniform grid. setCamera is given the surface's
+    // model-view each frame before render
+    static constexpr int LOD_PATCH_RESOLUTION = 16; // Quads per patch side
+    static constexpr int MAX_LOD_LEVELS = 12;
+    void setLODMesh(bool enable) { lodMesh = enable; }
+    bool getLODMesh() const { return lodMesh; }
+    bool isLODMeshActive() const { return lodMesh && !isTessellationActive() && (gpuWaves || oceanWaves); }
+    void setCamera(const glm::mat4& modelView, const glm::mat4& projection);
+    int getLODPatchCount() const { return static_cast<int>(lodPatches.size()); }
+    int getLODLevels() const { return lodLevels; }
+    
+    // Hardware tessellation: a coarse grid of patches drawn as GL_PATCHES with the program
+    // from InitTessellationShader (water_tess.vs, water.tcs, water.vs as evaluation stage,
+    // water.fs), split per edge to a target on-screen length. Takes precedence over the LOD
+    // mesh; main.cpp picks the program from isTessellationActive
+    static constexpr int TESS_PATCH_RESOLUTION = 16; // Patches per side
+    void setTessellation(bool enable) { tessellation = enable; }
+    bool getTessellation() const { return tessellation; }
+    bool isTessellationActive() const { return tessellation && (gpuWaves || oceanWaves); }
+    void setTessEdgePixels(float pixels) { tessEdgePixels = pixels; }
+    float getTessEdgePixels() const { return tessEdgePixels; }
+    
+    // Bind the wave parameter block (water.vs and wave_state.cs)
+    void bindWaveParameters() const;
+    
+    // The flow, wave, ocean and heightfield inputs of water.vs for another program drawn
+    // against this surface (the water volume); render() sets the same for its own draw
+    void bindDisplacement(unsigned int shaderProgram) const;
+    
+    // Compact grid: 16-byte vertices (position, octahedral normal in 2 x snorm16, texture
+    // coordinates from the position) drawn as restart-separated triangle strips in bands
+    // narrow enough for the post-transform cache, with 16-bit indices when the grid fits.
+    // Changing it rebuilds the grid buffers
+    static constexpr int STRIP_BAND_QUADS = 16;
+    void setCompactMesh(bool enable);
+    bool getCompactMesh() const { return compactMesh; }
     
     // For ray tracing integration
     unsigned int getVAO() const { return VAO; }
     int getVertexCount() const { return indices.size(); }
+    int getBaseVertex() const { return vertexSlot * resolution * resolution; } // Newest vertex ring slot
+    GLenum getPrimitiveMode() const { return compactMesh ? GL_TRIANGLE_STRIP : GL_TRIANGLES; }
+    GLenum getIndexType() const { return indexType; }
+    WaterSurfaceGeometry getGeometry() const;
+    
+    // Pipelined CPU path: the grid is written on a worker thread one update ahead of the
+    // draw (waits for the job in flight when turned off)
+    void setAsyncUpdate(bool enable);
+    bool getAsyncUpdate() const { return asyncUpdate; }
+    
+    // Tiles of the CPU grid rewritten by the last update, of RIPPLE_BINS^2 (all for a full rewrite)
+    int getLastUpdatedTiles() const { return lastUpdatedTiles; }
+    int getTileCount() const { return RIPPLE_BINS * RIPPLE_BINS; }
+    float getSize() const { return size; }
 
     // Foam rendering
-    void renderFoam(unsigned int foamShader, const glm::mat4& view, const glm::mat4& projection);
+    void renderFoam(unsigned int foamShader);
 
 private:
+    // bench/surface_bench.cpp times the private CPU stages
+    friend class WaterSurfaceBenchmark;
+    
     // Geometry data
     unsigned int VAO, VBO, EBO;
     int resolution;
     float size;
     std::vector<float> vertices;
     std::vector<unsigned int> indices;
+    bool compactMesh = false;
+    int vertexFloats = 8;                  // Floats (or float-sized words) per vertex
+    GLenum indexType = GL_UNSIGNED_INT;
+    
+    // Persistently mapped vertex ring, one mesh per slot, fenced after each draw
+    static constexpr int VERTEX_RING_SLOTS = 3;
+    float* vertexRing;
+    int vertexSlot;
+    GLsync vertexFences[VERTEX_RING_SLOTS] = {};
+    
+    // CPU path without global waves: only the tiles (the ripple bins) a ripple reaches are
+    // evaluated, and tiles a slot still holds displaced are flattened; a flat surface with
+    // nothing to add keeps drawing the current slot. tileDisplaced is per slot and tile
+    std::array<std::vector<uint8_t>, VERTEX_RING_SLOTS> tileDisplaced;
+    
+    // Per-band row scratch of writeSurface, reset by each write: the asynchronous writer
+    // runs across frame boundaries, so it cannot use the main loop's frame arena
+    WaterSim::FrameArena rowArena;
+    std::vector<int> tileVertexStart;  // First vertex row/column of each tile, then resolution
+    int lastUpdatedTiles = 0;
     
-    // Foam rendering data
-    unsigned int foamVAO, foamVBO;
-    bool foamBuffersInitialized;
+    // Wave parameter block, laid out as the std140 WaveParameters block of water.vs
+    struct WaveBlock {
+        glm::vec4 waves[2 * MAX_GPU_WAVES];     // direction.xy, amplitude, wavelength; speed, steepness
+        glm::vec4 ripples[2 * MAX_GPU_RIPPLES]; // center.xy, decayed amplitude, radius;
+                                                // direction.xy, distance travelled, directional
+        glm::ivec4 counts;                      // Waves, ripples
+        glm::vec4 timing;                       // Time, grid step
+        glm::vec4 rippleAges[MAX_GPU_RIPPLES / 4]; // Seconds since each ripple started, for the flow drift
+    };
+    unsigned int waveUBO;
+    bool gpuWaves;
+    
+    // FFT ocean, created when first enabled
+    std::unique_ptr<OceanFFT> ocean;
+    OceanFFT::Settings oceanSettings;
+    bool oceanWaves;
+    
+    // Wave-equation ripples, created when first enabled
+    std::unique_ptr<HeightfieldWaves> heightfield;
+    bool heightfieldWaves;
+    
+    // Surface currents, created when first enabled
+    std::unique_ptr<FlowMap> flowMap;
+    bool flowMapEnabled = false;
+    
+    // LOD mesh: one patch grid, instanced with aPatch (origin.xz, size, level) per patch
+    unsigned int lodVAO = 0, lodVBO = 0, lodEBO = 0, lodInstanceVBO = 0;
+    int lodIndexCount = 0;
+    size_t lodInstanceCapacity = 0;  // Patches lodInstanceVBO holds; it grows by reallocation
+    int lodLevels = 1;
+    float lodFinestRange = 1.0f;   // Camera distance level 0 reaches; doubles per level
+    bool lodMesh = true;
+    bool lodCameraValid = false;
+    glm::vec3 lodCamera{0.0f};     // Surface coordinates
+    glm::mat4 lodViewProjection{1.0f};
+    std::vector<glm::vec4> lodPatches;
+    
+    // Tessellation patch grid, four corners per patch
+    unsigned int tessVAO = 0, tessVBO = 0, tessEBO = 0;
+    int tessIndexCount = 0;
+    bool tessellation = false;
+    float tessEdgePixels = 8.0f;
+    
+    // Waves of the CPU path, rebuilt each update for the batched kernel
+    WaveKernel::WaveSoA waveSoA;
 
     // Water properties
     glm::vec3 waterColor;
@@ -83,36 +285,120 @@ private:
     // Water flow
     glm::vec2 flowVelocity;
     float flowOffset;
+    float renderLag = 0.0f;
+    
+    // Fixed-capacity pools as structures of arrays: remove() moves the last entry into the
+    // freed slot, so expiring entries shift nothing and adding never allocates. A full pool
+    // reuses the slot of its oldest entry. Slots are in no particular order.
+    static constexpr int MAX_FLOW_IMPULSES = 64;
+    static constexpr int MAX_RIPPLES = 128;
     
     // Flow impulses (temporary flow disturbances)
-    struct FlowImpulse {
-        glm::vec2 position;
-        glm::vec2 velocity;
-        float radius;
-        float strength;
-        float time;
+    struct FlowImpulsePool {
+        int count = 0;
+        std::array<float, MAX_FLOW_IMPULSES> positionX, positionZ;
+        std::array<float, MAX_FLOW_IMPULSES> velocityX, velocityZ;
+        std::array<float, MAX_FLOW_IMPULSES> radius, strength, time;
+        
+        int add();
+        void remove(int slot);
     };
-    std::vector<FlowImpulse> flowImpulses;
+    FlowImpulsePool flowImpulses;
     
     // Ripples
-    struct Ripple {
+    struct RipplePool {
+        int count = 0;
+        std::array<float, MAX_RIPPLES> centerX, centerZ;
+        std::array<float, MAX_RIPPLES> amplitude, radius, speed, decay, time;
+        std::array<float, MAX_RIPPLES> directionX, directionZ; // Direction of wave propagation (0,0 = radial)
+        std::array<uint8_t, MAX_RIPPLES> directional;
+        
+        int add();
+        void remove(int slot);
+        void clear() { count = 0; }
+    };
+    RipplePool ripples;
+    
+public:
+    struct State {
+        float time = 0.0f;
+        float flowOffset = 0.0f;
+        glm::vec2 flowVelocity = glm::vec2(0.0f);
+        FlowImpulsePool flowImpulses;
+        RipplePool ripples;
+    };
+    
+private:
+    void addRippleToPool(const glm::vec2& center, float amplitude, float radius, float speed, float decay,
+                         const glm::vec2& direction, bool directional);
+    
+    // Ripples at their current time, with the decay and travel evaluated once, binned on a
+    // uniform grid over the surface by the bounds of their moving wave front so each point
+    // only evaluates the ripples that can reach it (binStart indexes binEntries per bin, in
+    // CSR form). Term i is pool slot i
+    struct RippleTerm {
         glm::vec2 center;
-        float amplitude;
+        float amplitude;    // Decayed
         float radius;
-        float speed;
-        float decay;
-        float time;
-        glm::vec2 direction; // Direction of wave propagation (0,0 = radial)
+        float frequency;
+        float travelled;    // Distance of the wave front from the center
+        glm::vec2 direction;
         bool isDirectional;
     };
-    std::vector<Ripple> ripples;
+    static constexpr int RIPPLE_BINS = 16;  // Per side
+    struct RippleField {
+        std::vector<RippleTerm> terms;
+        std::vector<int> binStart;
+        std::vector<int> binEntries;
+    };
+    RippleField rippleField;
+    std::vector<int> rippleBinFill;         // Scratch of buildRippleBins
+    
+    // Pipelined CPU path: a worker thread writes the next ring slot from a snapshot of the
+    // waves and ripples while the GPU draws the current one, and the following update
+    // publishes that slot, so the surface drawn is one update behind. The snapshot is
+    // taken on the render thread, which keeps the ripple pools and every GL call
+    struct SurfaceJob {
+        WaveKernel::WaveSoA waves;
+        RippleField ripples;
+        float* vertices = nullptr;  // Mapped ring slot
+        int slot = 0;
+        int updatedTiles = 0;
+    };
+    SurfaceJob surfaceJob;
+    bool asyncUpdate = false;
+    std::thread surfaceWorker;
+    std::mutex surfaceMutex;
+    std::condition_variable surfaceWake;
+    bool surfaceJobQueued = false;  // Handed to the worker, not yet written
+    bool surfaceJobDone = false;    // Written, not yet published
+    bool stopSurfaceWorker = false;
     
-    // Foam particles
-    std::vector<FoamParticle> foamParticles;
+    // Foam particles, null if the update kernel failed to load
+    std::unique_ptr<FoamParticles> foam;
 
     // Helper methods
     void generateMesh();
     void generateIndices();
-    glm::vec3 calculateGerstnerWave(float x, float z, float time);
-    float rippleHeight(float x, float z, float time);
+    void createGridBuffers();
+    int writeSurface(float* slotVertices, int slot, const WaveKernel::WaveSoA& soa, const RippleField& field);
+    void writeVertexRow(float* slotVertices, int z, int first, int last, const WaveKernel::WaveSoA& soa,
+                        const RippleField* field, float* rippleData, float* rowData) const;
+    void surfaceWorkerLoop();
+    void finishSurfaceJob();
+    void destroyGridBuffers();
+    float* acquireVertexSlot();
+    float* waitForVertexSlot(int slot);
+    void uploadFlatGrid();
+    void generateLODMesh();
+    void generateTessellationPatches();
+    void displacementBounds(glm::vec2& horizontal, float& height) const;
+    void selectLODPatches();
+    void selectLODNode(const glm::vec2& origin, float nodeSize, int level, const glm::vec4* planes,
+                       const glm::vec2& horizontalBound, float heightBound);
+    void updateWaveBlock(float time);
+    void buildWaveSoA(float time, WaveKernel::WaveSoA& soa) const;
+    void buildRippleBins();
+    float rippleHeight(float x, float z, glm::vec2& gradient) const { return rippleHeight(rippleField, x, z, gradient); }
+    float rippleHeight(const RippleField& field, float x, float z, glm::vec2& gradient) const;
 }; 
\ No newline at end of file
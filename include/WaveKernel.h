@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// Batched Gerstner evaluation for WaterSurface's CPU path: a row of grid vertices at a
+// time against structure-of-arrays wave parameters, several vertices per instruction with
+// AVX2 or NEON when the CPU has them. Positions and normals go straight into the
+// interleaved vertex buffer.
+namespace WaveKernel {
+
+// Waves with everything that does not depend on the vertex folded in
+struct WaveSoA {
+    std::vector<float> dirX, dirZ;   // Unit direction
+    std::vector<float> k;            // Wave number
+    std::vector<float> amplitude;
+    std::vector<float> horizontal;   // Amplitude times the horizontal scale (2 * steepness)
+    std::vector<float> phaseOffset;  // Speed times angular frequency times time
+
+    size_t size() const { return k.size(); }
+    void clear();
+    void add(float dirX, float dirZ, float k, float amplitude, float horizontal, float phaseOffset);
+};
+
+// Per-vertex ripple height and gradient for a row, added before the normal is formed
+struct RippleRow {
+    const float* height;
+    const float* gradientX;
+    const float* gradientZ;
+};
+
+enum class Isa { Scalar, AVX2, NEON };
+
+// Best instruction set this CPU supports, detected once
+Isa activeIsa();
+const char* isaName(Isa isa);
+
+// Vertices x0 + i * dx, i < count, of the row at z. Vertex i is written at out + i * stride
+// floats: position in 0-2, normal in 3-5. ripples may be null.
+void evaluateRow(const WaveSoA& waves, float x0, float dx, float z, int count,
+                 const RippleRow* ripples, float* out, int stride);
+
+// Scalar reference with std::sin / std::cos, for validating the batched kernels
+void evaluateRowReference(const WaveSoA& waves, float x0, float dx, float z, int count,
+                          const RippleRow* ripples, float* out, int stride);
+
+} // namespace WaveKernel
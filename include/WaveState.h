@@ -0,0 +1,58 @@
+#pragma once
+
+#include <glad/glad.h>
+#include "GLResources.h"
+
+class WaterSurface;
+
+namespace WaterSim {
+
+// The water surface's wave state on the GPU: wave_state.cs evaluates the Gerstner waves
+// and ripples of the surface's wave parameter block, with the same function water.vs
+// displaces the grid by, once per frame on a RESOLUTION^2 grid spanning the surface
+// (centred on the origin, texel centres on the grid points). Everything else that needs
+// the waves samples these textures instead of evaluating them again: the ray tracing
+// G-buffer and caustic map, the raster caustics, the water shaders' material set and the
+// foam particles, which ride the surface. Context thread only.
+class WaveState {
+public:
+    static constexpr int RESOLUTION = 256;
+
+    WaveState() = default;
+    ~WaveState();
+
+    WaveState(const WaveState&) = delete;
+    WaveState& operator=(const WaveState&) = delete;
+
+    // Allocates the textures and submits the program
+    void initialize();
+
+    bool isReady() const { return program_.isValid(); }
+
+    // Once per frame, after the simulation updates; deltaTime is since the last update, for
+    // the velocities. The ripples drift with the surface's flow map as in water.vs
+    void update(WaterSurface& surface, float deltaTime);
+
+    // False until the first update, and after the waves stopped being updated
+    bool isValid() const { return valid_; }
+    void invalidate() { valid_ = false; }
+
+    // r height, gb horizontal displacement of the grid point
+    GLuint getHeightTexture() const { return height_.get(); }
+    // xyz normal, w Jacobian of the horizontal displacement (below 1 where crests bunch up)
+    GLuint getNormalTexture() const { return normal_.get(); }
+    // xyz velocity of the displaced point
+    GLuint getVelocityTexture() const { return velocity_.get(); }
+    // World size the textures span
+    float getSize() const { return size_; }
+
+private:
+    GLShaderProgram program_;   // wave_state.cs
+    GLTexture height_;          // RGBA32F, read back by the next update for the velocities
+    GLTexture normal_;          // RGBA16F
+    GLTexture velocity_;        // RGBA16F
+    float size_ = 10.0f;
+    bool valid_ = false;
+};
+
+} // namespace WaterSim
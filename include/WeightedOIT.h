@@ -0,0 +1,48 @@
+#pragma once
+
+#include <glad/glad.h>
+#include "GLResources.h"
+
+namespace WaterSim {
+
+// Weighted blended order-independent transparency (McGuire and Bavoil 2013). Transparent
+// draws go unsorted into two targets over the opaque depth: a premultiplied color and alpha
+// sum scaled by a depth weight, and the product of (1 - alpha), the light that gets past
+// every layer. The composite divides the sum by its weight and lays it over the opaque
+// scene by that product. The result does not depend on draw order, so the glass, water
+// volume, foam and SPH secondary particles can be drawn in any order and batched.
+//
+// The weighted average is exact for one layer per pixel and close for a few low-alpha
+// ones, which is what the scene's transparents are.
+//
+// Fragment shaders of the transparent draws link oit.fs and write with writeTransparent().
+class WeightedOIT {
+public:
+    static constexpr GLenum ACCUM_FORMAT = GL_RGBA16F;
+    static constexpr GLenum REVEALAGE_FORMAT = GL_R16F;
+
+    WeightedOIT() = default;
+    ~WeightedOIT();
+
+    WeightedOIT(const WeightedOIT&) = delete;
+    WeightedOIT& operator=(const WeightedOIT&) = delete;
+
+    // Submits the composite program
+    void initialize();
+    bool isReady() const { return compositeProgram_.isValid(); }
+
+    // With the accumulation targets bound as color attachments 0 (accum) and 1 (revealage)
+    // over the opaque depth: clears them and sets the blending of the transparent draws.
+    // Depth is tested but not written
+    void beginAccumulation() const;
+    void endAccumulation() const;
+
+    // With the opaque scene bound: blends the accumulated layers over it
+    void composite(GLuint accumTexture, GLuint revealageTexture) const;
+
+private:
+    GLShaderProgram compositeProgram_;      // oit_composite.vs/fs
+    GLuint vao_ = 0;                        // Empty; the triangle comes from gl_VertexID
+};
+
+} // namespace WaterSim
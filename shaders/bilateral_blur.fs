@@ -1,6 +1,9 @@
 #version 460 core
 
-in vec2 texCoord;
+// Separable pass, drawn as a fullscreen triangle by sph_smooth.vs. Background (cleared
+// to 0 or the far plane) is left alone and never blended into the fluid
+
+in vec2 vTexCoord;
 
 out float smoothedDepth;
 
@@ -13,10 +16,10 @@ uniform vec2 texelSize;
 const int KERNEL_RADIUS = 15;
 
 void main() {
-    float centerDepth = texture(depthTexture, texCoord).r;
+    float centerDepth = texture(depthTexture, vTexCoord).r;
     
-    if (centerDepth == 0.0) {
-        smoothedDepth = 0.0;
+    if (centerDepth == 0.0 || centerDepth >= 0.999) {
+        smoothedDepth = centerDepth;
         return;
     }
     
@@ -25,10 +28,10 @@ void main() {
     
     // Bilateral filter
     for (int i = -KERNEL_RADIUS; i <= KERNEL_RADIUS; i++) {
-        vec2 sampleCoord = texCoord + float(i) * direction * texelSize;
+        vec2 sampleCoord = vTexCoord + float(i) * direction * texelSize;
         float sampleDepth = texture(depthTexture, sampleCoord).r;
         
-        if (sampleDepth == 0.0) continue;
+        if (sampleDepth == 0.0 || sampleDepth >= 0.999) continue;
         
         // Spatial weight (Gaussian)
         float spatialWeight = exp(-float(i * i) / (2.0 * sigmaSpace * sigmaSpace));
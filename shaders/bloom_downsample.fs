@@ -0,0 +1,71 @@
+#version 460 core
+
+// One level down the bloom chain: 13 bilinear taps (five overlapping 2x2 box filters) of
+// the level above, which keeps the downsample free of aliasing and shimmer. The first level
+// also applies the bright pass, and averages its boxes weighted by inverse luminance so a
+// single very bright pixel cannot flicker the whole bloom
+
+in vec2 TexCoord;
+out vec4 FragColor;
+
+uniform sampler2D sourceTexture;
+uniform vec2 sourceTexelSize;
+uniform bool prefilter;
+uniform float bloomThreshold;
+uniform float bloomKnee;       // Width of the soft transition below the threshold
+
+float luminance(vec3 color) {
+    return dot(color, vec3(0.2126, 0.7152, 0.0722));
+}
+
+// Soft-knee bright pass
+vec3 brightPass(vec3 color) {
+    float brightness = max(color.r, max(color.g, color.b));
+    float soft = clamp(brightness - bloomThreshold + bloomKnee, 0.0, 2.0 * bloomKnee);
+    soft = soft * soft / (4.0 * bloomKnee + 1e-5);
+    float contribution = max(soft, brightness - bloomThreshold) / max(brightness, 1e-5);
+    return color * contribution;
+}
+
+vec3 tap(vec2 offset) {
+    return texture(sourceTexture, TexCoord + offset * sourceTexelSize).rgb;
+}
+
+void main() {
+    vec3 a = tap(vec2(-2.0,  2.0));
+    vec3 b = tap(vec2( 0.0,  2.0));
+    vec3 c = tap(vec2( 2.0,  2.0));
+    vec3 d = tap(vec2(-2.0,  0.0));
+    vec3 e = tap(vec2( 0.0,  0.0));
+    vec3 f = tap(vec2( 2.0,  0.0));
+    vec3 g = tap(vec2(-2.0, -2.0));
+    vec3 h = tap(vec2( 0.0, -2.0));
+    vec3 i = tap(vec2( 2.0, -2.0));
+    vec3 j = tap(vec2(-1.0,  1.0));
+    vec3 k = tap(vec2( 1.0,  1.0));
+    vec3 l = tap(vec2(-1.0, -1.0));
+    vec3 m = tap(vec2( 1.0, -1.0));
+    
+    // The inner box weighs half, the four corner boxes an eighth each
+    vec3 boxes[5] = vec3[5]((j + k + l + m) * 0.25,
+                            (a + b + d + e) * 0.25, (b + c + e + f) * 0.25,
+                            (d + e + g + h) * 0.25, (e + f + h + i) * 0.25);
+    float weights[5] = float[5](0.5, 0.125, 0.125, 0.125, 0.125);
+    
+    vec3 color = vec3(0.0);
+    float weightSum = 0.0;
+    for (int n = 0; n < 5; n++) {
+        float w = weights[n];
+        if (prefilter) {
+            w /= 1.0 + luminance(boxes[n]);
+        }
+        color += boxes[n] * w;
+        weightSum += w;
+    }
+    color /= weightSum;
+    
+    if (prefilter) {
+        color = brightPass(color);
+    }
+    FragColor = vec4(max(color, vec3(0.0)), 1.0);
+}
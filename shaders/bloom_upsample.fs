@@ -0,0 +1,23 @@
+#version 460 core
+
+// One level up the bloom chain: a 3x3 tent filter of the smaller level, added onto the
+// larger one by the blend state. The radius is in source texels, so each level spreads the
+// light twice as far as the one above it at the same cost
+
+in vec2 TexCoord;
+out vec4 FragColor;
+
+uniform sampler2D sourceTexture;
+uniform vec2 sourceTexelSize;
+uniform float filterRadius;
+
+vec3 tap(vec2 offset) {
+    return texture(sourceTexture, TexCoord + offset * sourceTexelSize * filterRadius).rgb;
+}
+
+void main() {
+    vec3 color = tap(vec2(0.0, 0.0)) * 4.0;
+    color += (tap(vec2(0.0, 1.0)) + tap(vec2(-1.0, 0.0)) + tap(vec2(1.0, 0.0)) + tap(vec2(0.0, -1.0))) * 2.0;
+    color += tap(vec2(-1.0, 1.0)) + tap(vec2(1.0, 1.0)) + tap(vec2(-1.0, -1.0)) + tap(vec2(1.0, -1.0));
+    FragColor = vec4(color / 16.0, 1.0);
+}
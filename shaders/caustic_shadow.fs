@@ -1,107 +1,54 @@
 #version 460 core
 
-in vec3 FragPos;
-in vec3 Normal;
-in vec2 TexCoord;
-in vec4 FragPosLightSpace;
+// Cascaded shadows of ShadowMapper and the caustics they occlude. No main(): linked as a
+// second fragment stage into the programs that receive shadows (and as a second compute
+// stage into froxel_inject.cs), which declare
+//   float cascadeShadow(vec3 worldPos, vec3 normal);
+//   vec3 shadowedCaustics(vec3 caustics, vec3 worldPos, vec3 normal);
+// ShadowMapper::applyToReceiver sets the uniforms.
 
-out vec4 FragColor;
+const int SHADOW_CASCADES = 3;
 
-uniform sampler2D diffuseTexture;
-uniform sampler2D shadowMap;
-uniform sampler2D causticTexture;
+uniform bool shadowsEnabled = false;
+uniform sampler2DArrayShadow shadowStatic;      // The container, cached between frames
+uniform sampler2DArrayShadow shadowDynamic;     // The sphere and the SPH particles
+uniform mat4 shadowMatrices[SHADOW_CASCADES];   // World to [0,1] texture space, finest first
+uniform float shadowTexelWorld[SHADOW_CASCADES];
+uniform float shadowStaticOpacity = 0.35;       // Glass lets most of the light through
 
-uniform vec3 lightPos;
-uniform vec3 lightColor;
-uniform vec3 viewPos;
-uniform float time;
-
-// Calculate shadow with PCF
-float calculateShadow(vec4 fragPosLightSpace) {
-    // Perform perspective divide
-    vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
-    
-    // Transform to [0,1] range
-    projCoords = projCoords * 0.5 + 0.5;
-    
-    // Get closest depth value from light's perspective
-    float closestDepth = texture(shadowMap, projCoords.xy).r;
-    
-    // Get depth of current fragment from light's perspective
-    float currentDepth = projCoords.z;
-    
-    // Calculate bias to prevent shadow acne
-    vec3 normal = normalize(Normal);
-    vec3 lightColor = normalize(lightPos - FragPos);
-    float bias = max(0.05 * (1.0 - dot(normal, lightColor)), 0.005);
-    
-    // PCF
-    float shadow = 0.0;
-    vec2 texelSize = 1.0 / textureSize(shadowMap, 0);
-    for(int x = -1; x <= 1; ++x) {
-        for(int y = -1; y <= 1; ++y) {
-            float pcfDepth = texture(shadowMap, projCoords.xy + vec2(x, y) * texelSize).r;
-            shadow += currentDepth - bias > pcfDepth ? 1.0 : 0.0;
+// 3x3 taps of the hardware's 2x2 comparison filter; 0 lit, 1 shadowed
+float shadowPCF(sampler2DArrayShadow map, vec3 coord, float layer) {
+    vec2 texel = 1.0 / vec2(textureSize(map, 0).xy);
+    float lit = 0.0;
+    for (int x = -1; x <= 1; x++) {
+        for (int y = -1; y <= 1; y++) {
+            lit += texture(map, vec4(coord.xy + vec2(x, y) * texel, layer, coord.z));
         }
     }
-    shadow /= 9.0;
-    
-    // Keep the shadow at 0.0 when outside the far_plane region of the light's frustum.
-    if(projCoords.z > 1.0)
-        shadow = 0.0;
-        
-    return shadow;
+    return 1.0 - lit / 9.0;
 }
 
-// Calculate underwater caustics
-vec3 calculateCaustics(vec3 worldPos) {
-    // Multiple layers of caustics for more realism
-    vec2 causticCoord1 = worldPos.xz * 0.15 + time * 0.02;
-    vec2 causticCoord2 = worldPos.xz * 0.25 - time * 0.03;
-    
-    vec3 caustic1 = texture(causticTexture, causticCoord1).rgb;
-    vec3 caustic2 = texture(causticTexture, causticCoord2).rgb;
-    
-    // Combine caustics
-    vec3 caustic = (caustic1 + caustic2) * 0.5;
-    
-    // Enhance contrast
-    caustic = pow(caustic, vec3(1.5));
-    
-    return caustic;
+float cascadeShadow(vec3 worldPos, vec3 normal) {
+    if (!shadowsEnabled) {
+        return 0.0;
+    }
+
+    // The finest cascade the point is inside, leaving room for the filter
+    for (int c = 0; c < SHADOW_CASCADES; c++) {
+        // Pushed along the normal by about a texel against acne on surfaces facing the light
+        vec3 coord = (shadowMatrices[c] * vec4(worldPos + normal * (1.5 * shadowTexelWorld[c]), 1.0)).xyz;
+        float margin = 2.0 / float(textureSize(shadowDynamic, 0).x);
+        if (all(greaterThan(coord.xy, vec2(margin))) && all(lessThan(coord.xy, vec2(1.0 - margin))) &&
+            coord.z > 0.0 && coord.z < 1.0) {
+            float dynamicShadow = shadowPCF(shadowDynamic, coord, float(c));
+            float staticShadow = shadowPCF(shadowStatic, coord, float(c)) * shadowStaticOpacity;
+            return max(dynamicShadow, staticShadow);
+        }
+    }
+    return 0.0;
 }
 
-void main() {
-    vec3 color = texture(diffuseTexture, TexCoord).rgb;
-    vec3 normal = normalize(Normal);
-    vec3 ambient = 0.15 * color;
-    
-    // Diffuse lighting
-    vec3 lightColor = normalize(lightPos - FragPos);
-    float diff = max(dot(lightColor, normal), 0.0);
-    vec3 diffuse = diff * lightColor;
-    
-    // Specular lighting
-    vec3 viewDir = normalize(viewPos - FragPos);
-    vec3 reflectDir = reflect(-lightColor, normal);
-    float spec = 0.0;
-    vec3 halfwayDir = normalize(lightColor + viewDir);
-    spec = pow(max(dot(normal, halfwayDir), 0.0), 64.0);
-    vec3 specular = spec * lightColor;
-    
-    // Calculate shadow
-    float shadow = calculateShadow(FragPosLightSpace);
-    
-    // Calculate caustics (only in underwater areas)
-    vec3 caustics = calculateCaustics(FragPos);
-    
-    // Apply caustics to areas that are lit (not in shadow)
-    vec3 lighting = ambient + (1.0 - shadow) * (diffuse + specular);
-    
-    // Add caustics to lit areas with modulation
-    lighting += caustics * (1.0 - shadow) * 0.8;
-    
-    vec3 result = lighting * color;
-    
-    FragColor = vec4(result, 1.0);
-}
\ No newline at end of file
+// Caustics only form where the light reaches
+vec3 shadowedCaustics(vec3 caustics, vec3 worldPos, vec3 normal) {
+    return caustics * (1.0 - cascadeShadow(worldPos, normal));
+}
@@ -0,0 +1,106 @@
+#version 460 core
+
+// Clustered dynamic lights of ClusteredLights. No main(): linked as another fragment stage
+// into the programs they light, which declare
+//   void clusteredLighting(vec3 worldPos, vec3 normal, vec3 viewDir, float shininess,
+//                          out vec3 diffuse, out vec3 specular);
+// diffuse and specular are the lights' sums, for the caller's own material to scale. The
+// froxel comes from the world position through the grid's camera, so any pass can light
+// with it; points outside the grid walk every light. Screen-space passes of the main
+// camera get their surface back through that camera too:
+//   vec3 clusterWorldPosition(vec2 uv, float depth);   // Window depth
+//   vec3 clusterCameraPosition();
+
+const uint CLUSTER_MAX_LIGHTS = 32u;
+
+struct ClusterLight
+{
+    vec4 positionRange;
+    vec4 colorCosInner;         // Color times intensity
+    vec4 directionCosOuter;     // Spot axis; below -1 a point light
+};
+
+layout(std140, binding = 5) uniform ClusterParameters
+{
+    mat4 clusterView;
+    mat4 clusterProjection;
+    mat4 clusterInverseViewProjection;
+    vec4 clusterCamera;
+    vec4 clusterDepth;          // Near, far, slices per log depth
+    uvec4 clusterGrid;          // Clusters per axis, light count
+};
+
+layout(binding = 63, std430) restrict readonly buffer clusterLightBuf
+{
+    ClusterLight clusterLights[];
+};
+
+layout(binding = 64, std430) restrict readonly buffer clusterCountBuf
+{
+    uint clusterLightCounts[];
+};
+
+layout(binding = 65, std430) restrict readonly buffer clusterIndexBuf
+{
+    uint clusterLightIndices[];
+};
+
+void addClusterLight(ClusterLight light, vec3 worldPos, vec3 normal, vec3 viewDir, float shininess,
+                     inout vec3 diffuse, inout vec3 specular) {
+    vec3 toLight = light.positionRange.xyz - worldPos;
+    float distanceSquared = dot(toLight, toLight);
+    float range = light.positionRange.w;
+    if (distanceSquared >= range * range) {
+        return;
+    }
+    vec3 lightDir = toLight * inversesqrt(max(distanceSquared, 1e-8));
+
+    // Inverse square, windowed to reach nothing at the range
+    float window = clamp(1.0 - pow(distanceSquared / (range * range), 2.0), 0.0, 1.0);
+    float attenuation = window * window / (distanceSquared + 1.0);
+    attenuation *= smoothstep(light.directionCosOuter.w, light.colorCosInner.w, dot(-lightDir, light.directionCosOuter.xyz));
+
+    vec3 radiance = light.colorCosInner.rgb * attenuation;
+    diffuse += radiance * max(dot(normal, lightDir), 0.0);
+    vec3 halfwayDir = normalize(lightDir + viewDir);
+    specular += radiance * pow(max(dot(normal, halfwayDir), 0.0), shininess);
+}
+
+void clusteredLighting(vec3 worldPos, vec3 normal, vec3 viewDir, float shininess,
+                       out vec3 diffuse, out vec3 specular) {
+    diffuse = vec3(0.0);
+    specular = vec3(0.0);
+    uint lightCount = clusterGrid.w;
+    if (lightCount == 0u) {
+        return;
+    }
+
+    vec4 viewPoint = clusterView * vec4(worldPos, 1.0);
+    vec4 clip = clusterProjection * viewPoint;
+    float depth = -viewPoint.z;
+    vec2 ndc = clip.xy / max(clip.w, 1e-6);
+    if (clip.w <= 0.0 || any(greaterThan(abs(ndc), vec2(1.0))) || depth < clusterDepth.x || depth >= clusterDepth.y) {
+        for (uint i = 0u; i < lightCount; i++) {
+            addClusterLight(clusterLights[i], worldPos, normal, viewDir, shininess, diffuse, specular);
+        }
+        return;
+    }
+
+    uvec3 cell = uvec3(min(uvec2((ndc * 0.5 + 0.5) * vec2(clusterGrid.xy)), clusterGrid.xy - 1u),
+                       min(uint(log(depth / clusterDepth.x) * clusterDepth.z), clusterGrid.z - 1u));
+    uint cluster = cell.x + clusterGrid.x * (cell.y + clusterGrid.y * cell.z);
+    uint count = clusterLightCounts[cluster];
+    for (uint i = 0u; i < count; i++) {
+        uint index = clusterLightIndices[cluster * CLUSTER_MAX_LIGHTS + i];
+        addClusterLight(clusterLights[index], worldPos, normal, viewDir, shininess, diffuse, specular);
+    }
+}
+
+vec3 clusterWorldPosition(vec2 uv, float depth) {
+    vec4 worldPoint = clusterInverseViewProjection * vec4(vec3(uv, depth) * 2.0 - 1.0, 1.0);
+    return worldPoint.xyz / worldPoint.w;
+}
+
+vec3 clusterCameraPosition() {
+    return clusterCamera.xyz;
+}
@@ -0,0 +1,7 @@
+#version 460 core
+
+// Depth prepass of the opaque surfaces (main.cpp): their own vertex stages, no color. The
+// vertex stages declare gl_Position invariant, so the shading pass afterwards lands on
+// exactly these depths
+void main() {
+}
@@ -0,0 +1,65 @@
+#version 460 core
+
+// Depth of field, gather pass at half resolution, into a far and a near field. Both sample
+// a disc of TAPS points on a golden-angle spiral, each tap counted only where its own CoC
+// reaches this pixel (scatter as gather), so in-focus pixels do not smear into the blur
+// around them. The far disc is this pixel's CoC; the near disc is the dilated tile
+// maximum, so a blurred foreground spreads over the sharper pixels behind it, and its
+// alpha is the share of the disc the near field covers
+
+in vec2 TexCoord;
+layout(location = 0) out vec4 FarColor;     // Blurred background, weight 1
+layout(location = 1) out vec4 NearColor;    // Blurred foreground, coverage in alpha
+
+#define TILE_SIZE 8
+#define TAPS 32
+
+uniform sampler2D halfTexture; // Color, signed CoC
+uniform sampler2D tileTexture; // Largest near and far CoC per tile
+uniform vec2 texelSize;        // Of the half-resolution targets
+
+vec2 diskTap(int i) {
+    float radius = sqrt((float(i) + 0.5) / float(TAPS));
+    float angle = float(i) * 2.39996323;
+    return radius * vec2(cos(angle), sin(angle));
+}
+
+void main() {
+    vec4 center = textureLod(halfTexture, TexCoord, 0.0);
+    
+    ivec2 tile = ivec2(gl_FragCoord.xy) / TILE_SIZE;
+    ivec2 lastTile = textureSize(tileTexture, 0) - 1;
+    float nearRadius = 0.0;
+    for (int y = -1; y <= 1; y++) {
+        for (int x = -1; x <= 1; x++) {
+            nearRadius = max(nearRadius, texelFetch(tileTexture, clamp(tile + ivec2(x, y), ivec2(0), lastTile), 0).r);
+        }
+    }
+    
+    float farRadius = max(center.a, 0.0);
+    vec3 farSum = center.rgb;
+    float farWeight = 1.0;
+    if (farRadius >= 0.5) {
+        for (int i = 0; i < TAPS; i++) {
+            vec2 offset = diskTap(i) * farRadius;
+            vec4 tap = textureLod(halfTexture, TexCoord + offset * texelSize, 0.0);
+            float weight = clamp(tap.a - length(offset) + 1.0, 0.0, 1.0);
+            farSum += tap.rgb * weight;
+            farWeight += weight;
+        }
+    }
+    FarColor = vec4(farSum / farWeight, 1.0);
+    
+    vec3 nearSum = vec3(0.0);
+    float nearWeight = 0.0;
+    if (nearRadius >= 0.5) {
+        for (int i = 0; i < TAPS; i++) {
+            vec2 offset = diskTap(i) * nearRadius;
+            vec4 tap = textureLod(halfTexture, TexCoord + offset * texelSize, 0.0);
+            float weight = tap.a < 0.0 ? clamp(-tap.a - length(offset) + 1.0, 0.0, 1.0) : 0.0;
+            nearSum += tap.rgb * weight;
+            nearWeight += weight;
+        }
+    }
+    NearColor = vec4(nearSum / max(nearWeight, 1e-4), nearWeight / float(TAPS));
+}
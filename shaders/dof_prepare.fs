@@ -0,0 +1,30 @@
+#version 460 core
+
+// Depth of field, first pass: the scene at half resolution with its signed circle of
+// confusion in alpha, in half-resolution pixels and negative in front of the focus. Of the
+// 2x2 full-resolution depths under a pixel the nearest CoC is kept, so the downsample does
+// not erode the silhouettes of the near field
+
+in vec2 TexCoord;
+out vec4 FragColor;
+
+uniform sampler2D sceneTexture;
+uniform sampler2D depthTexture;
+uniform float focusDistance;
+uniform float focusRange;
+uniform float maxCoC;          // Half-resolution pixels, at most the tile size
+uniform vec2 depthRange;       // Near and far planes of the camera projection
+
+float circleOfConfusion(float depth) {
+    float z = depth * 2.0 - 1.0;
+    float linearDepth = 2.0 * depthRange.x * depthRange.y / (depthRange.y + depthRange.x - z * (depthRange.y - depthRange.x));
+    return clamp((linearDepth - focusDistance) / focusRange, -1.0, 1.0) * maxCoC;
+}
+
+void main() {
+    // The half-resolution pixel centre is the shared corner of its four texels
+    vec4 depths = textureGather(depthTexture, TexCoord, 0);
+    float coc = min(min(circleOfConfusion(depths.x), circleOfConfusion(depths.y)),
+                    min(circleOfConfusion(depths.z), circleOfConfusion(depths.w)));
+    FragColor = vec4(texture(sceneTexture, TexCoord).rgb, coc);
+}
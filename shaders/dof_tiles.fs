@@ -0,0 +1,26 @@
+#version 460 core
+
+// Depth of field, tile pass: the largest near and far CoC of each TILE_SIZE square of the
+// half-resolution scene. The gather takes the largest of a 3x3 block of tiles, which bounds
+// how far any near pixel can spread over the pixels around it
+
+out vec4 FragColor;
+
+#define TILE_SIZE 8
+
+uniform sampler2D halfTexture; // Color, signed CoC
+
+void main() {
+    ivec2 origin = ivec2(gl_FragCoord.xy) * TILE_SIZE;
+    ivec2 last = textureSize(halfTexture, 0) - 1;
+    float nearMax = 0.0;
+    float farMax = 0.0;
+    for (int y = 0; y < TILE_SIZE; y++) {
+        for (int x = 0; x < TILE_SIZE; x++) {
+            float coc = texelFetch(halfTexture, min(origin + ivec2(x, y), last), 0).a;
+            nearMax = max(nearMax, -coc);
+            farMax = max(farMax, coc);
+        }
+    }
+    FragColor = vec4(nearMax, farMax, 0.0, 0.0);
+}
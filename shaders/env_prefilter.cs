@@ -0,0 +1,86 @@
+#version 460 core
+
+// One mip of Skybox's prefiltered environment: the skybox convolved with a GGX lobe of
+// uRoughness, importance sampled with the normal, view and reflection directions taken
+// as equal (split-sum). Each sample reads the source mip whose texels cover the solid
+// angle it stands for, so a few hundred samples do without fireflies. Mip 0 is
+// roughness 0, a plain copy of the sky.
+
+layout(local_size_x = 8, local_size_y = 8) in;
+
+layout(binding = 0) uniform samplerCube uSource;   // The skybox, mipmapped
+layout(rgba16f, binding = 0) uniform restrict writeonly imageCube uTarget;
+
+uniform int uFaceSize;        // Texels per face edge of the mip being written
+uniform float uSourceSize;    // Texels per face edge of the source's base level
+uniform float uRoughness;
+uniform int uSampleCount = 256;
+
+const float PI = 3.14159265359;
+
+// Direction through a texel of a cube face, in GL face order (+X, -X, +Y, -Y, +Z, -Z)
+vec3 cubeDirection(ivec3 texel, int size) {
+    vec2 st = (vec2(texel.xy) + 0.5) / float(size) * 2.0 - 1.0;
+    switch (texel.z) {
+    case 0: return normalize(vec3(1.0, -st.y, -st.x));
+    case 1: return normalize(vec3(-1.0, -st.y, st.x));
+    case 2: return normalize(vec3(st.x, 1.0, st.y));
+    case 3: return normalize(vec3(st.x, -1.0, -st.y));
+    case 4: return normalize(vec3(st.x, -st.y, 1.0));
+    default: return normalize(vec3(-st.x, -st.y, -1.0));
+    }
+}
+
+vec2 hammersley(uint i, uint count) {
+    return vec2(float(i) / float(count), float(bitfieldReverse(i)) * 2.3283064365386963e-10);
+}
+
+// GGX half vector around n for alpha = roughness^2
+vec3 importanceSampleGGX(vec2 xi, float alpha, vec3 n) {
+    float phi = 2.0 * PI * xi.x;
+    float cosTheta = sqrt((1.0 - xi.y) / (1.0 + (alpha * alpha - 1.0) * xi.y));
+    float sinTheta = sqrt(1.0 - cosTheta * cosTheta);
+
+    vec3 up = abs(n.z) < 0.999 ? vec3(0.0, 0.0, 1.0) : vec3(1.0, 0.0, 0.0);
+    vec3 tangent = normalize(cross(up, n));
+    vec3 bitangent = cross(n, tangent);
+    return normalize(tangent * (cos(phi) * sinTheta) + bitangent * (sin(phi) * sinTheta) + n * cosTheta);
+}
+
+void main() {
+    ivec3 texel = ivec3(gl_GlobalInvocationID);
+    if (texel.x >= uFaceSize || texel.y >= uFaceSize) {
+        return;
+    }
+
+    vec3 n = cubeDirection(texel, uFaceSize);
+    if (uRoughness <= 0.0) {
+        imageStore(uTarget, texel, vec4(textureLod(uSource, n, 0.0).rgb, 1.0));
+        return;
+    }
+
+    float alpha = uRoughness * uRoughness;
+    float texelSolidAngle = 4.0 * PI / (6.0 * uSourceSize * uSourceSize);
+    uint count = uint(uSampleCount);
+
+    vec3 sum = vec3(0.0);
+    float weightSum = 0.0;
+    for (uint i = 0u; i < count; i++) {
+        vec3 h = importanceSampleGGX(hammersley(i, count), alpha, n);
+        float NdotH = max(dot(n, h), 0.0);
+        vec3 l = 2.0 * NdotH * h - n;
+        float NdotL = dot(n, l);
+        if (NdotL <= 0.0) continue;
+
+        // With v = n the pdf of l is D / 4
+        float d = NdotH * NdotH * (alpha * alpha - 1.0) + 1.0;
+        float pdf = alpha * alpha / (PI * d * d) * 0.25;
+        float sampleSolidAngle = 1.0 / (float(count) * pdf + 1e-6);
+        float lod = max(0.5 * log2(sampleSolidAngle / texelSolidAngle) + 1.0, 0.0);
+
+        sum += textureLod(uSource, l, lod).rgb * NdotL;
+        weightSum += NdotL;
+    }
+
+    imageStore(uTarget, texel, vec4(sum / max(weightSum, 1e-6), 1.0));
+}
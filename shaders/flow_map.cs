@@ -0,0 +1,54 @@
+#version 460 core
+// Flow map (FlowMap): one step of the surface current field. Each texel traces back along
+// its own velocity for the step, samples the previous field there bilinearly
+// (semi-Lagrangian advection, stable at any step), relaxes the result toward the uniform
+// base current and adds this update's impulses under a raised-cosine brush. At the grid
+// edge (the container walls) the velocity into the wall is removed.
+// Texel i is centred at world x = (i + 0.5) * texel size - half the surface size.
+
+layout(local_size_x = 16, local_size_y = 16) in;
+
+#define MAX_IMPULSES 32
+#define PI 3.14159265
+
+layout(rg16f, binding = 0) uniform restrict writeonly image2D uDestination;
+uniform sampler2D uSource;
+
+uniform int uResolution;
+uniform float uStepTexels;       // Step time / texel size: world velocity to texels per step
+uniform float uRelax;            // Fraction of the way to the base current this step
+uniform vec2 uBaseVelocity;
+uniform int uImpulseCount;
+uniform vec4 uImpulses[2 * MAX_IMPULSES];  // Texel centre xy, radius in texels; world velocity xy
+
+float brush(vec2 offset, float radius)
+{
+  float distance = length(offset);
+  return distance < radius ? 0.5 + 0.5 * cos(PI * distance / radius) : 0.0;
+}
+
+void main()
+{
+  ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+  if (any(greaterThanEqual(texel, ivec2(uResolution)))) return;
+  vec2 p = vec2(texel);
+  float size = float(uResolution);
+
+  vec2 velocity = texelFetch(uSource, texel, 0).xy;
+  vec2 departure = p - velocity * uStepTexels;
+  velocity = textureLod(uSource, (departure + 0.5) / size, 0.0).xy;
+  velocity = mix(velocity, uBaseVelocity, uRelax);
+
+  for (int i = 0; i < uImpulseCount; i++)
+  {
+    vec4 impulse = uImpulses[2 * i];
+    velocity += uImpulses[2 * i + 1].xy * brush(p - impulse.xy, impulse.z);
+  }
+
+  if (texel.x == 0) velocity.x = max(velocity.x, 0.0);
+  if (texel.x == uResolution - 1) velocity.x = min(velocity.x, 0.0);
+  if (texel.y == 0) velocity.y = max(velocity.y, 0.0);
+  if (texel.y == uResolution - 1) velocity.y = min(velocity.y, 0.0);
+
+  imageStore(uDestination, texel, vec4(velocity, 0.0, 0.0));
+}
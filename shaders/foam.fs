@@ -3,7 +3,8 @@
 in vec2 TexCoord;
 in float Alpha;
 
-out vec4 FragColor;
+// Order-independent transparency, linked in from oit.fs
+void writeTransparent(vec4 color);
 
 void main() {
     // Calculate distance from center for circular shape
@@ -16,5 +17,5 @@ void main() {
     // White foam color with transparency
     vec3 foamColor = vec3(0.95, 0.95, 0.95);
     
-    FragColor = vec4(foamColor, alpha);
+    writeTransparent(vec4(foamColor, alpha));
 }
\ No newline at end of file
@@ -1,31 +1,52 @@
 #version 460 core
+// Foam billboards, one instance per live particle of FoamParticles; the quad corners come
+// from gl_VertexID
 
-layout (location = 0) in vec3 aPos;
+struct FoamParticle
+{
+  vec4 positionSize;     // xyz position, w size
+  vec4 velocityLifetime; // xyz velocity, w seconds left
+  vec4 maxLifetime;      // x lifetime at spawn
+};
+
+layout(binding = 43, std430) restrict readonly buffer FoamParticles
+{
+  FoamParticle particles[];
+};
 
 out vec2 TexCoord;
 out float Alpha;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-uniform vec3 foamPosition;
-uniform float foamSize;
-uniform float foamLifetime; // 0-1 normalized
+// Camera and light of the pass being drawn (updateFrameUniforms in main.cpp)
+layout(std140, binding = 2) uniform FrameUniforms
+{
+    mat4 view;
+    mat4 projection;
+    vec3 viewPos;
+    float time;
+    vec3 lightPos;
+    vec3 lightColor;
+};
+
+const vec2 corners[4] = vec2[](vec2(-0.5, -0.5), vec2(0.5, -0.5), vec2(0.5, 0.5), vec2(-0.5, 0.5));
 
 void main() {
+    FoamParticle particle = particles[gl_InstanceID];
+    vec2 corner = corners[gl_VertexID];
+    
     // Billboard the foam particle
     vec3 cameraRight = vec3(view[0][0], view[1][0], view[2][0]);
     vec3 cameraUp = vec3(view[0][1], view[1][1], view[2][1]);
     
-    vec3 worldPos = foamPosition + 
-                    cameraRight * aPos.x * foamSize + 
-                    cameraUp * aPos.y * foamSize;
+    vec3 worldPos = particle.positionSize.xyz + 
+                    cameraRight * corner.x * particle.positionSize.w + 
+                    cameraUp * corner.y * particle.positionSize.w;
     
     gl_Position = projection * view * vec4(worldPos, 1.0);
     
     // Pass texture coordinates
-    TexCoord = aPos.xy + 0.5;
+    TexCoord = corner + 0.5;
     
     // Fade out based on lifetime
-    Alpha = foamLifetime;
-}
\ No newline at end of file
+    Alpha = particle.velocityLifetime.w / particle.maxLifetime.x;
+}
@@ -0,0 +1,150 @@
+#version 460 core
+// Foam particles (FoamParticles): spawns this update's bursts and ages the live particles
+// of the source buffer, appending every particle still alive to the other buffer and
+// counting it into that buffer's indirect draw command. Surviving the update keeps the
+// live particles packed at the front, so no free list is needed. Threads below
+// uSpawnCount spawn; the rest each age one source slot. Particles past uCapacity are
+// dropped. With a flow map (FlowMap) the drag pulls the horizontal velocity toward the
+// surface current under the particle instead of toward rest, so the foam drifts with it.
+// With the wave surface (WaveState) a particle that falls to the waves lands on them and
+// moves with the surface from then on.
+
+layout(local_size_x = 256) in;
+
+#define MAX_BURSTS 32
+
+struct FoamParticle
+{
+  vec4 positionSize;     // xyz position, w size
+  vec4 velocityLifetime; // xyz velocity, w seconds left
+  vec4 maxLifetime;      // x lifetime at spawn
+};
+
+layout(binding = 43, std430) restrict readonly buffer FoamParticlesIn
+{
+  FoamParticle source[];
+};
+
+layout(binding = 44, std430) restrict writeonly buffer FoamParticlesOut
+{
+  FoamParticle destination[];
+};
+
+// glDrawArraysIndirect commands of the two buffers: count, instanceCount, first, baseInstance
+layout(binding = 45, std430) restrict buffer FoamCommands
+{
+  uvec4 commands[2];
+};
+
+uniform float uDeltaTime;
+uniform uint uCapacity;
+uniform int uSource;
+uniform uint uSeed;
+uniform int uSpawnCount;
+uniform int uBurstCount;
+uniform vec4 uBursts[2 * MAX_BURSTS];  // Position xyz, intensity; first particle, count
+uniform int uUseFlowMap;
+uniform sampler2D uFlowMap;            // World velocity xz over the surface
+uniform float uFlowMapSize;
+uniform int uUseWaveSurface;
+uniform sampler2D uWaveHeight;         // Height in r, over the surface
+uniform sampler2D uWaveVelocity;       // Surface point velocity
+uniform float uWaveSize;
+
+// PCG hash, a fresh random sequence per particle and update
+uint hash(uint value)
+{
+  uint state = value * 747796405u + 2891336453u;
+  uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+  return (word >> 22u) ^ word;
+}
+
+float random(inout uint state)
+{
+  state = hash(state);
+  return float(state) / 4294967295.0;
+}
+
+void append(FoamParticle particle)
+{
+  uint slot = atomicAdd(commands[1 - uSource].y, 1u);
+  if (slot < uCapacity)
+  {
+    destination[slot] = particle;
+  }
+  else
+  {
+    atomicAdd(commands[1 - uSource].y, 0xFFFFFFFFu);
+  }
+}
+
+FoamParticle spawn(int index)
+{
+  int burst = 0;
+  while (burst + 1 < uBurstCount && float(index) >= uBursts[2 * (burst + 1) + 1].x) burst++;
+  vec3 origin = uBursts[2 * burst].xyz;
+  float intensity = uBursts[2 * burst].w;
+
+  // Random direction and speed around the impact point, with an upward bias
+  uint state = hash(uint(index) ^ hash(uSeed));
+  float angle = random(state) * 6.28318531;
+  float speed = mix(0.5, 2.0, random(state)) * intensity;
+  vec2 direction = vec2(cos(angle), sin(angle));
+
+  FoamParticle particle;
+  float lifetime = mix(1.0, 3.0, random(state));
+  float size = mix(0.02, 0.08, random(state)) * (1.0 + intensity * 0.5);
+  particle.positionSize = vec4(origin + vec3(direction.x, 0.0, direction.y) * 0.1, size);
+  particle.velocityLifetime = vec4(direction.x * speed, 0.5 + mix(0.5, 2.0, random(state)) * 0.5 * intensity,
+                                   direction.y * speed, lifetime);
+  particle.maxLifetime = vec4(lifetime, 0.0, 0.0, 0.0);
+  return particle;
+}
+
+void main()
+{
+  int thread = int(gl_GlobalInvocationID.x);
+  if (thread < uSpawnCount)
+  {
+    append(spawn(thread));
+    return;
+  }
+
+  uint slot = uint(thread - uSpawnCount);
+  if (slot >= commands[uSource].y) return;
+
+  FoamParticle particle = source[slot];
+  float lifetime = particle.velocityLifetime.w - uDeltaTime;
+  if (lifetime <= 0.0) return;
+
+  // Light gravity, then drag relative to the water
+  vec3 velocity = particle.velocityLifetime.xyz;
+  velocity.y -= 9.81 * uDeltaTime * 0.1;
+  particle.positionSize.xyz += velocity * uDeltaTime;
+  vec3 current = vec3(0.0);
+  if (uUseFlowMap != 0)
+  {
+    current.xz = textureLod(uFlowMap, particle.positionSize.xz / uFlowMapSize + 0.5, 0.0).xy;
+  }
+  
+  // On the waves the particle is held at the surface and dragged toward its motion
+  vec2 waveUV = particle.positionSize.xz / uWaveSize + 0.5;
+  if (uUseWaveSurface != 0 && all(greaterThanEqual(waveUV, vec2(0.0))) && all(lessThanEqual(waveUV, vec2(1.0))))
+  {
+    float surface = textureLod(uWaveHeight, waveUV, 0.0).r;
+    if (particle.positionSize.y <= surface)
+    {
+      vec3 surfaceVelocity = textureLod(uWaveVelocity, waveUV, 0.0).xyz;
+      particle.positionSize.y = surface;
+      current += surfaceVelocity;
+      velocity.y = surfaceVelocity.y;
+    }
+  }
+  velocity = current + (velocity - current) * (1.0 - uDeltaTime * 2.0);
+
+  // Shrink as the particle ages
+  float lifetimeRatio = lifetime / particle.maxLifetime.x;
+  particle.positionSize.w *= 0.95 + lifetimeRatio * 0.05;
+  particle.velocityLifetime = vec4(velocity, lifetime);
+  append(particle);
+}
@@ -0,0 +1,99 @@
+#version 460 core
+// Froxel lighting (FroxelVolumetrics): the light scattered toward the camera at one point of
+// every froxel. The point sits at a jittered depth inside its slice, which the history
+// averages over frames. Inside the water it is lit by the key light, refracted at the
+// surface and attenuated over its path below it, through the cascaded shadows and with the
+// caustic focus of the floor point it travels on to; a Henyey-Greenstein phase sends it
+// toward the camera. The previous frame's froxels are sampled at the same world point.
+// Slice w (0..1) is at view depth near * (far / near)^w.
+
+layout(local_size_x = 8, local_size_y = 8, local_size_z = 1) in;
+
+#define PI 3.14159265
+
+layout(rgba16f, binding = 0) uniform restrict writeonly image3D uScattering;
+uniform sampler3D uHistory;
+uniform sampler2D uCausticMap;
+
+uniform mat4 uInverseView;
+uniform mat4 uInverseProjection;
+uniform mat4 uPreviousViewProjection;
+uniform mat4 uPreviousView;
+uniform vec2 uDepthRange;           // View depth of the first and last slice
+uniform float uJitter;              // Depth within the slice this frame, 0..1
+uniform vec3 uRefracted;            // Light travel direction below the surface
+uniform vec3 uLightColor;
+uniform vec3 uWaterMin;
+uniform vec3 uWaterMax;
+uniform float uScattering;
+uniform float uExtinction;
+uniform float uAnisotropy;
+uniform float uFloorLevel;
+uniform bool uCausticMapEnabled = false;
+uniform float uCausticExtent;
+uniform float uHistoryBlend;        // 0 without a history
+
+// caustic_shadow.fs
+float cascadeShadow(vec3 worldPos, vec3 normal);
+
+float henyeyGreenstein(float cosTheta, float g)
+{
+  float denominator = 1.0 + g * g - 2.0 * g * cosTheta;
+  return (1.0 - g * g) / (4.0 * PI * denominator * sqrt(denominator));
+}
+
+float sliceDepth(float w)
+{
+  return uDepthRange.x * pow(uDepthRange.y / uDepthRange.x, w);
+}
+
+vec3 froxelWorld(vec2 uv, float depth)
+{
+  vec4 ray = uInverseProjection * vec4(uv * 2.0 - 1.0, 1.0, 1.0);
+  vec3 viewPos = ray.xyz / ray.w;
+  viewPos *= depth / -viewPos.z;
+  return (uInverseView * vec4(viewPos, 1.0)).xyz;
+}
+
+void main()
+{
+  ivec3 froxel = ivec3(gl_GlobalInvocationID);
+  ivec3 size = imageSize(uScattering);
+  if (any(greaterThanEqual(froxel, size))) return;
+
+  vec2 uv = (vec2(froxel.xy) + 0.5) / vec2(size.xy);
+  vec3 worldPos = froxelWorld(uv, sliceDepth((float(froxel.z) + uJitter) / float(size.z)));
+  vec3 cameraPos = uInverseView[3].xyz;
+
+  vec4 current = vec4(0.0);
+  if (all(greaterThanEqual(worldPos, uWaterMin)) && all(lessThanEqual(worldPos, uWaterMax))) {
+    // Down from the surface to the point, and on to the floor for the caustic focus there
+    float travelDown = max(-uRefracted.y, 0.05);
+    float path = (uWaterMax.y - worldPos.y) / travelDown;
+    vec3 light = uLightColor * exp(-uExtinction * path) * (1.0 - cascadeShadow(worldPos, vec3(0.0)));
+    if (uCausticMapEnabled) {
+      vec3 floorPoint = worldPos + uRefracted * (max(worldPos.y - uFloorLevel, 0.0) / travelDown);
+      light *= texture(uCausticMap, floorPoint.xz / uCausticExtent + 0.5).r;
+    }
+
+    vec3 toCamera = normalize(cameraPos - worldPos);
+    float phase = henyeyGreenstein(dot(uRefracted, toCamera), uAnisotropy);
+    current = vec4(light * uScattering * phase, uExtinction);
+  }
+
+  // The froxel centre where the previous frame saw it
+  if (uHistoryBlend > 0.0) {
+    vec3 centre = froxelWorld(uv, sliceDepth((float(froxel.z) + 0.5) / float(size.z)));
+    vec4 clip = uPreviousViewProjection * vec4(centre, 1.0);
+    float depth = -(uPreviousView * vec4(centre, 1.0)).z;
+    if (clip.w > 0.0 && depth > 0.0) {
+      vec3 previous = vec3(clip.xy / clip.w * 0.5 + 0.5,
+                           log(depth / uDepthRange.x) / log(uDepthRange.y / uDepthRange.x));
+      if (all(greaterThanEqual(previous, vec3(0.0))) && all(lessThanEqual(previous, vec3(1.0)))) {
+        current = mix(current, textureLod(uHistory, previous, 0.0), uHistoryBlend);
+      }
+    }
+  }
+
+  imageStore(uScattering, froxel, current);
+}
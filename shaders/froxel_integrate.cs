@@ -0,0 +1,43 @@
+#version 460 core
+// Froxel integration (FroxelVolumetrics): marches each tile's column of lit froxels front
+// to back once. Every slice adds its in-scattering over its thickness along the view ray,
+// integrated against its own extinction ((S - S * T) / extinction, which keeps thick slices
+// from gaining energy), times the transmittance in front of it. Texel z holds the
+// scattered light and the transmittance from the camera to the far side of slice z.
+
+layout(local_size_x = 8, local_size_y = 8) in;
+
+layout(rgba16f, binding = 0) uniform restrict readonly image3D uScattering;
+layout(rgba16f, binding = 1) uniform restrict writeonly image3D uIntegrated;
+
+uniform mat4 uInverseProjection;
+uniform vec2 uDepthRange;
+
+void main()
+{
+  ivec2 tile = ivec2(gl_GlobalInvocationID.xy);
+  ivec3 size = imageSize(uScattering);
+  if (any(greaterThanEqual(tile, size.xy))) return;
+
+  // View depth to distance along this tile's ray
+  vec2 uv = (vec2(tile) + 0.5) / vec2(size.xy);
+  vec4 ray = uInverseProjection * vec4(uv * 2.0 - 1.0, 1.0, 1.0);
+  vec3 direction = ray.xyz / ray.w;
+  float rayScale = length(direction) / abs(direction.z);
+
+  vec3 scattered = vec3(0.0);
+  float transmittance = 1.0;
+  float nearDepth = 0.0;
+  for (int z = 0; z < size.z; z++) {
+    float farDepth = uDepthRange.x * pow(uDepthRange.y / uDepthRange.x, float(z + 1) / float(size.z));
+    float thickness = (farDepth - nearDepth) * rayScale;
+    nearDepth = farDepth;
+
+    vec4 froxel = imageLoad(uScattering, ivec3(tile, z));
+    float extinction = max(froxel.a, 1e-5);
+    float sliceTransmittance = exp(-extinction * thickness);
+    scattered += transmittance * (froxel.rgb - froxel.rgb * sliceTransmittance) / extinction;
+    transmittance *= sliceTransmittance;
+    imageStore(uIntegrated, ivec3(tile, z), vec4(scattered, transmittance));
+  }
+}
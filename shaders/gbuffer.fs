@@ -6,15 +6,29 @@ layout(location = 1) out vec4 gNormal;
 in vec3 FragPos;
 in vec3 Normal;
 in vec2 TexCoord;
+in vec2 OceanUV;
 
 uniform float uWaterLevel;
 uniform vec3 uWaterColor;
+uniform bool uOceanWaves;
+uniform sampler2D uOceanNormalFoam;
+uniform bool uCompactGBuffer;   // No position target; normal octahedral in the first two channels
+
+// Octahedral encoding of a unit normal, decoded by rt_gbuffer.glsl
+vec2 octahedralEncode(vec3 n) {
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 e = n.xy;
+    if (n.z < 0.0) {
+        e = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return e;
+}
 
 void main() {
     // Store world position and water level flag
     gPosition = vec4(FragPos, 1.0); // w = 1.0 indicates water surface
     
     // Store normal and material properties
-    vec3 normal = normalize(Normal);
-    gNormal = vec4(normal, 0.5); // w = 0.5 indicates water material
+    vec3 normal = uOceanWaves ? normalize(texture(uOceanNormalFoam, OceanUV).xyz) : normalize(Normal); // Water model is identity
+    gNormal = uCompactGBuffer ? vec4(octahedralEncode(normal), 0.0, 0.0) : vec4(normal, 0.5); // w = 0.5 indicates water material
 }
\ No newline at end of file
@@ -7,16 +7,77 @@ layout(location = 2) in vec2 aTexCoord;
 out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoord;
+out vec2 OceanUV;
 
 uniform mat4 uModel;
 uniform mat4 uView;
 uniform mat4 uProjection;
 uniform mat3 uNormalMatrix;
 
+// FFT ocean displacement of the flat grid (OceanFFT, as water.vs)
+uniform bool uOceanWaves;
+uniform sampler2D uOceanDisplacement;
+uniform float uOceanPatchSize;
+
+// Compact water grid: octahedral normal in aNormal.xy, texture coordinates from the position
+uniform bool uPackedVertices;
+uniform float uSurfaceSize;
+
+// Displacement the water grid does not carry (RayTracingManager::bindSurfaceHeights): the
+// frame's wave state (WaveState: height and horizontal displacement, and normal), when the
+// grid is flat for GPU waves, and the wave-equation heightfield; both span the surface,
+// centred on the origin. The normal tilts by their slopes
+uniform bool uWaveHeights;
+uniform sampler2D uWaveHeightMap;
+uniform sampler2D uWaveNormalMap;
+uniform float uWaveHeightMapSize;
+uniform bool uHeightfieldWaves;
+uniform sampler2D uHeightfield;
+
+float heightfieldHeight(vec2 xz) {
+    return textureLod(uHeightfield, xz / uSurfaceSize + 0.5, 0.0).r;
+}
+
+void addSurfaceHeight(vec2 xz, inout vec3 pos, inout vec3 normal) {
+    if (!uWaveHeights && !uHeightfieldWaves) return;
+    vec2 slope = vec2(0.0);
+    if (uWaveHeights) {
+        vec2 uv = xz / uWaveHeightMapSize + 0.5;
+        vec3 displacement = textureLod(uWaveHeightMap, uv, 0.0).rgb;
+        pos += vec3(displacement.g, displacement.r, displacement.b);
+        vec3 waveNormal = textureLod(uWaveNormalMap, uv, 0.0).xyz;
+        slope -= waveNormal.xz / max(waveNormal.y, 1e-3);
+    }
+    if (uHeightfieldWaves) {
+        float step = uSurfaceSize / 256.0;
+        slope += vec2(heightfieldHeight(xz + vec2(step, 0.0)) - heightfieldHeight(xz - vec2(step, 0.0)),
+                      heightfieldHeight(xz + vec2(0.0, step)) - heightfieldHeight(xz - vec2(0.0, step))) / (2.0 * step);
+        pos.y += heightfieldHeight(xz);
+    }
+    normal = normalize(normal / max(normal.y, 1e-3) - vec3(slope.x, 0.0, slope.y));
+}
+
+vec3 octahedralDecode(vec2 e) {
+    vec3 n = vec3(e.x, 1.0 - abs(e.x) - abs(e.y), e.y);
+    if (n.y < 0.0) {
+        n.xz = (1.0 - abs(n.zx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.z >= 0.0 ? 1.0 : -1.0);
+    }
+    return normalize(n);
+}
+
 void main() {
-    FragPos = vec3(uModel * vec4(aPos, 1.0));
-    Normal = normalize(uNormalMatrix * aNormal);
-    TexCoord = aTexCoord;
+    vec3 pos = aPos;
+    OceanUV = uOceanWaves ? aPos.xz / uOceanPatchSize : vec2(0.0);
+    if (uOceanWaves) {
+        pos += textureLod(uOceanDisplacement, OceanUV, 0.0).xyz;
+    }
+    
+    vec3 normal = uPackedVertices ? octahedralDecode(aNormal.xy) : normalize(aNormal);
+    addSurfaceHeight(aPos.xz, pos, normal);
+    
+    FragPos = vec3(uModel * vec4(pos, 1.0));
+    Normal = normalize(uNormalMatrix * normal);
+    TexCoord = uPackedVertices ? aPos.xz / uSurfaceSize + 0.5 : aTexCoord;
     
     gl_Position = uProjection * uView * vec4(FragPos, 1.0);
 }
\ No newline at end of file
@@ -1,26 +1,70 @@
 #version 460 core
+#ifdef BINDLESS_TEXTURES
+#extension GL_ARB_bindless_texture : require
+#endif
 
 in vec3 FragPos;
 in vec3 Normal;
 in vec2 TexCoord;
 
-out vec4 FragColor;
+// Order-independent transparency, linked in from oit.fs
+void writeTransparent(vec4 color);
 
-uniform vec3 viewPos;
+// Dynamic lights, linked in from clustered_lights.fs
+void clusteredLighting(vec3 worldPos, vec3 normal, vec3 viewDir, float shininess,
+                       out vec3 diffuse, out vec3 specular);
+
+// Static material textures: resident handles in one block (BindlessTextures.h) or units
+#ifdef BINDLESS_TEXTURES
+layout(std140, binding = 4) uniform MaterialTextures
+{
+    samplerCube skybox;
+    sampler2D causticTex;
+    sampler2D tileTexture;
+    sampler2D waveHeightMap;
+    sampler2D sphereTexture;
+};
+#else
 uniform samplerCube skybox;
+#endif
+
+// Prefiltered environment of Skybox::setEnvironmentUniforms (see sphere.fs)
+uniform bool environmentLighting = false;
+uniform samplerCube prefilteredEnv;
+uniform float prefilteredMaxLod;
+uniform vec3 irradianceSH[9];
 
 // Glass properties
 uniform float glassTransparency = 0.15;  // Increased transparency
 uniform vec3 glassColor = vec3(0.95, 0.95, 1.0);  // Slightly bluer
 uniform float glassRefractionIndex = 1.05;  // Less refraction for better visibility
 
+// Camera and light of the pass being drawn (updateFrameUniforms in main.cpp)
+layout(std140, binding = 2) uniform FrameUniforms
+{
+    mat4 view;
+    mat4 projection;
+    vec3 viewPos;
+    float time;
+    vec3 lightPos;
+    vec3 lightColor;
+};
+
 // Lighting properties
-uniform vec3 lightPos;
-uniform vec3 lightColor;
 uniform float ambientStrength;
 uniform float specularStrength;
 uniform float shininess;
 
+// Irradiance over pi, from the SH9 coefficients (as in sphere.fs)
+vec3 shIrradiance(vec3 n) {
+    vec3 e = irradianceSH[0] * 0.282095
+           + irradianceSH[1] * (0.488603 * n.y) + irradianceSH[2] * (0.488603 * n.z) + irradianceSH[3] * (0.488603 * n.x)
+           + irradianceSH[4] * (1.092548 * n.x * n.y) + irradianceSH[5] * (1.092548 * n.y * n.z)
+           + irradianceSH[6] * (0.315392 * (3.0 * n.z * n.z - 1.0)) + irradianceSH[7] * (1.092548 * n.x * n.z)
+           + irradianceSH[8] * (0.546274 * (n.x * n.x - n.y * n.y));
+    return max(e, vec3(0.0));
+}
+
 void main() {
     // Normalize vectors
     vec3 norm = normalize(Normal);
@@ -42,8 +86,8 @@ void main() {
     vec3 refractionColor = texture(skybox, refractDir).rgb;
     
     // Lighting calculations
-    // Ambient
-    vec3 ambient = ambientStrength * lightColor;
+    // Ambient, from the sky's irradiance when it has been prefiltered
+    vec3 ambient = ambientStrength * (environmentLighting ? shIrradiance(norm) : lightColor);
     
     // Diffuse
     vec3 lightDir = normalize(lightPos - FragPos);
@@ -55,6 +99,12 @@ void main() {
     float spec = pow(max(dot(norm, halfwayDir), 0.0), shininess);
     vec3 specular = specularStrength * spec * lightColor;
     
+    // Dynamic lights
+    vec3 clusterDiffuse, clusterSpecular;
+    clusteredLighting(FragPos, norm, viewDir, shininess, clusterDiffuse, clusterSpecular);
+    diffuse += clusterDiffuse;
+    specular += specularStrength * clusterSpecular;
+    
     // Mix reflection and refraction based on fresnel
     vec3 glassEffect = mix(refractionColor, reflectionColor, fresnel);
     
@@ -63,5 +113,5 @@ void main() {
     vec3 result = (ambient + diffuse) * glassColor * 0.3 + specular + glassEffect;
     
     // Final color with fixed transparency value
-    FragColor = vec4(result, glassTransparency);
+    writeTransparent(vec4(result, glassTransparency));
 } 
\ No newline at end of file
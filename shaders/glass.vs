@@ -9,8 +9,17 @@ out vec3 Normal;
 out vec2 TexCoord;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+
+// Camera and light of the pass being drawn (updateFrameUniforms in main.cpp)
+layout(std140, binding = 2) uniform FrameUniforms
+{
+    mat4 view;
+    mat4 projection;
+    vec3 viewPos;
+    float time;
+    vec3 lightPos;
+    vec3 lightColor;
+};
 
 void main() {
     FragPos = vec3(model * vec4(aPos, 1.0));
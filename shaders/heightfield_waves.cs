@@ -0,0 +1,106 @@
+#version 460 core
+// Heightfield ripples: the 2D wave equation on a grid over the water surface, integrated
+// with the explicit leapfrog scheme of two height textures (current and previous). Two
+// phases selected by uPass:
+//   0: stamp this update's brushes into both heights; a directional brush is shifted in
+//      the previous height by one step of travel, so the pulse starts moving that way.
+//      Deposited water (HeightfieldWaves::getDepositBuffer) is added and cleared here too
+//   1: one step, next = h + (1 - damping)(h - previous) + courant^2 * laplacian(h),
+//      written over the previous height. Neighbors are clamped at the grid edge, which
+//      reflects waves off the container walls; inside the obstacle disc the height is
+//      held at zero, which reflects them off the sphere.
+//   2: render interpolation, mix(current, previous, uBlend) into uInterpolated for drawing
+//      between fixed simulation ticks.
+// Texel i is centred at world x = (i + 0.5) * texel size - half the surface size.
+
+layout(local_size_x = 16, local_size_y = 16) in;
+
+#define MAX_STAMPS 32
+#define PI 3.14159265
+
+layout(r32f, binding = 0) uniform restrict image2D uCurrent;
+layout(r32f, binding = 1) uniform restrict image2D uPrevious;
+layout(r32f, binding = 2) uniform restrict writeonly image2D uInterpolated;
+
+uniform int uPass;
+uniform int uResolution;
+uniform float uCourantSq;        // (wave speed * dt / texel size)^2, at most 0.5
+uniform float uDamping;          // Fraction of the velocity lost per step
+uniform vec3 uObstacle;          // Texel centre xy, radius in texels (<= 0 for none)
+uniform int uStampCount;
+uniform vec4 uStamps[2 * MAX_STAMPS];  // Texel centre xy, radius, amplitude; travel per step xy
+
+// Per texel: added height and height times vertical speed, fixed point
+layout(binding = 0, std430) restrict buffer depositBuf
+{
+  int deposits[];
+};
+
+uniform int uUseDeposits;
+uniform float uDepositScale;     // Fixed-point units per world unit
+uniform float uDepositDepth;     // Column depth the deposited momentum moves
+uniform float uStepTime;
+uniform float uBlend;            // Pass 2: fraction of a step back from the current height
+
+float brush(vec2 offset, float radius)
+{
+  float distance = length(offset);
+  return distance < radius ? 0.5 + 0.5 * cos(PI * distance / radius) : 0.0;
+}
+
+float heightAt(ivec2 texel)
+{
+  return imageLoad(uCurrent, clamp(texel, ivec2(0), ivec2(uResolution - 1))).r;
+}
+
+void main()
+{
+  ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+  if (any(greaterThanEqual(texel, ivec2(uResolution)))) return;
+  vec2 p = vec2(texel);
+
+  if (uPass == 2)
+  {
+    imageStore(uInterpolated, texel, vec4(mix(imageLoad(uCurrent, texel).r, imageLoad(uPrevious, texel).r, uBlend)));
+    return;
+  }
+
+  if (uPass == 0)
+  {
+    float current = imageLoad(uCurrent, texel).r;
+    float previous = imageLoad(uPrevious, texel).r;
+    for (int i = 0; i < uStampCount; i++)
+    {
+      vec4 stamp = uStamps[2 * i];
+      vec2 travel = uStamps[2 * i + 1].xy;
+      current += stamp.w * brush(p - stamp.xy, stamp.z);
+      previous += stamp.w * brush(p + travel - stamp.xy, stamp.z);
+    }
+    if (uUseDeposits != 0)
+    {
+      // The column's velocity (current - previous) / dt changes by momentum / depth
+      uint index = 2u * uint(texel.y * uResolution + texel.x);
+      float height = float(deposits[index]) / uDepositScale;
+      float momentum = float(deposits[index + 1u]) / uDepositScale;
+      deposits[index] = 0;
+      deposits[index + 1u] = 0;
+      current += height;
+      previous += height - momentum / uDepositDepth * uStepTime;
+    }
+    imageStore(uCurrent, texel, vec4(current));
+    imageStore(uPrevious, texel, vec4(previous));
+    return;
+  }
+
+  float h = imageLoad(uCurrent, texel).r;
+  float previous = imageLoad(uPrevious, texel).r;
+  float laplacian = heightAt(texel + ivec2(1, 0)) + heightAt(texel - ivec2(1, 0)) +
+                    heightAt(texel + ivec2(0, 1)) + heightAt(texel - ivec2(0, 1)) - 4.0 * h;
+  float next = h + (1.0 - uDamping) * (h - previous) + uCourantSq * laplacian;
+
+  if (uObstacle.z > 0.0 && distance(p, uObstacle.xy) < uObstacle.z)
+  {
+    next = 0.0;
+  }
+  imageStore(uPrevious, texel, vec4(next));
+}
@@ -0,0 +1,108 @@
+#version 460 core
+// Clustered lighting: lists per froxel of the main camera the lights whose range reaches it
+// (ClusteredLights)
+//
+// One invocation per froxel. The froxel's view-space bounding box spans its screen tile
+// between two exponential depth slices; a light is listed when its range sphere touches
+// the box. The group stages the lights through shared memory, already in view space.
+
+layout(local_size_x = 64) in;
+
+const uint MAX_LIGHTS_PER_CLUSTER = 32u;
+
+struct ClusterLight
+{
+  vec4 positionRange;
+  vec4 colorCosInner;
+  vec4 directionCosOuter;
+};
+
+layout(std140, binding = 5) uniform ClusterParameters
+{
+  mat4 clusterView;
+  mat4 clusterProjection;
+  mat4 clusterInverseViewProjection;
+  vec4 clusterCamera;
+  vec4 clusterDepth;      // Near, far, slices per log depth
+  uvec4 clusterGrid;      // Clusters per axis, light count
+};
+
+layout(binding = 63, std430) restrict readonly buffer clusterLightBuf
+{
+  ClusterLight clusterLights[];
+};
+
+layout(binding = 64, std430) restrict writeonly buffer clusterCountBuf
+{
+  uint clusterLightCounts[];
+};
+
+layout(binding = 65, std430) restrict writeonly buffer clusterIndexBuf
+{
+  uint clusterLightIndices[];
+};
+
+uniform mat4 uInverseProjection;
+
+shared vec4 sharedLights[64];   // View-space center and range
+
+// View-space point on the ray through an NDC position, at a view depth
+vec3 pointAtDepth(vec2 ndc, float depth)
+{
+  vec4 view = uInverseProjection * vec4(ndc, -1.0, 1.0);
+  vec3 ray = view.xyz / view.w;
+  return ray * (depth / -ray.z);
+}
+
+float sliceDepth(uint slice)
+{
+  return clusterDepth.x * pow(clusterDepth.y / clusterDepth.x, float(slice) / float(clusterGrid.z));
+}
+
+void main()
+{
+  uint cluster = gl_GlobalInvocationID.x;
+  uint clusterCount = clusterGrid.x * clusterGrid.y * clusterGrid.z;
+  bool active = cluster < clusterCount;
+
+  // x fastest, then y, then the depth slice
+  uvec3 cell = uvec3(cluster % clusterGrid.x, (cluster / clusterGrid.x) % clusterGrid.y, cluster / (clusterGrid.x * clusterGrid.y));
+  vec2 tileMin = vec2(cell.xy) / vec2(clusterGrid.xy) * 2.0 - 1.0;
+  vec2 tileMax = vec2(cell.xy + 1u) / vec2(clusterGrid.xy) * 2.0 - 1.0;
+  float nearDepth = sliceDepth(cell.z);
+  float farDepth = sliceDepth(cell.z + 1u);
+
+  vec3 boxMin = vec3(1e30);
+  vec3 boxMax = vec3(-1e30);
+  for (int corner = 0; corner < 4; corner++) {
+    vec2 ndc = vec2((corner & 1) != 0 ? tileMax.x : tileMin.x, (corner & 2) != 0 ? tileMax.y : tileMin.y);
+    vec3 nearPoint = pointAtDepth(ndc, nearDepth);
+    vec3 farPoint = pointAtDepth(ndc, farDepth);
+    boxMin = min(boxMin, min(nearPoint, farPoint));
+    boxMax = max(boxMax, max(nearPoint, farPoint));
+  }
+
+  uint count = 0u;
+  uint lightCount = clusterGrid.w;
+  for (uint base = 0u; base < lightCount; base += gl_WorkGroupSize.x) {
+    uint index = base + gl_LocalInvocationID.x;
+    if (index < lightCount) {
+      vec4 light = clusterLights[index].positionRange;
+      sharedLights[gl_LocalInvocationID.x] = vec4((clusterView * vec4(light.xyz, 1.0)).xyz, light.w);
+    }
+    barrier();
+
+    uint batch = min(gl_WorkGroupSize.x, lightCount - base);
+    for (uint i = 0u; active && i < batch; i++) {
+      vec4 light = sharedLights[i];
+      vec3 offset = clamp(light.xyz, boxMin, boxMax) - light.xyz;
+      if (dot(offset, offset) <= light.w * light.w && count < MAX_LIGHTS_PER_CLUSTER) {
+        clusterLightIndices[cluster * MAX_LIGHTS_PER_CLUSTER + count] = base + i;
+        count++;
+      }
+    }
+    barrier();
+  }
+
+  if (active) clusterLightCounts[cluster] = count;
+}
@@ -0,0 +1,81 @@
+#version 460 core
+// FFT ocean, step 2: one pass of the 2D inverse FFT, a row (uDirection 0) or column
+// (uDirection 1) per work group and a spectrum layer per z. The line is transformed in
+// shared memory with the radix-2 Stockham formulation, so every stage reads and writes in
+// natural order and no bit reversal is needed. Each texel carries two complex values that
+// share the twiddles.
+
+#define MAX_RESOLUTION 1024
+#define GROUP_SIZE 256
+#define BUTTERFLIES_PER_THREAD (MAX_RESOLUTION / 2 / GROUP_SIZE)
+#define PI 3.14159265
+
+layout(local_size_x = GROUP_SIZE) in;
+
+layout(rgba32f, binding = 0) uniform restrict readonly image2DArray uInput;
+layout(rgba32f, binding = 1) uniform restrict writeonly image2DArray uOutput;
+
+uniform int uResolution;  // Power of two up to MAX_RESOLUTION
+uniform int uDirection;
+
+shared vec4 line[MAX_RESOLUTION];
+
+ivec3 lineTexel(int i)
+{
+  int lineIndex = int(gl_WorkGroupID.x);
+  return uDirection == 0 ? ivec3(i, lineIndex, gl_WorkGroupID.y) : ivec3(lineIndex, i, gl_WorkGroupID.y);
+}
+
+vec4 rotatePair(vec4 pair, vec2 w)
+{
+  return vec4(pair.x * w.x - pair.y * w.y, pair.x * w.y + pair.y * w.x,
+              pair.z * w.x - pair.w * w.y, pair.z * w.y + pair.w * w.x);
+}
+
+void main()
+{
+  int thread = int(gl_LocalInvocationID.x);
+  int halfResolution = uResolution / 2;
+
+  for (int i = thread; i < uResolution; i += GROUP_SIZE)
+  {
+    line[i] = imageLoad(uInput, lineTexel(i));
+  }
+  barrier();
+
+  for (int span = 1; span < uResolution; span *= 2)
+  {
+    vec4 sums[BUTTERFLIES_PER_THREAD];
+    vec4 differences[BUTTERFLIES_PER_THREAD];
+    int targets[BUTTERFLIES_PER_THREAD];
+
+    for (int b = 0; b < BUTTERFLIES_PER_THREAD; b++)
+    {
+      int j = thread + b * GROUP_SIZE;
+      if (j >= halfResolution) break;
+
+      int position = j & (span - 1);
+      float angle = PI * float(position) / float(span);  // Inverse transform: positive exponent
+      vec4 even = line[j];
+      vec4 odd = rotatePair(line[j + halfResolution], vec2(cos(angle), sin(angle)));
+      sums[b] = even + odd;
+      differences[b] = even - odd;
+      targets[b] = (j - position) * 2 + position;
+    }
+    barrier();
+
+    for (int b = 0; b < BUTTERFLIES_PER_THREAD; b++)
+    {
+      int j = thread + b * GROUP_SIZE;
+      if (j >= halfResolution) break;
+      line[targets[b]] = sums[b];
+      line[targets[b] + span] = differences[b];
+    }
+    barrier();
+  }
+
+  for (int i = thread; i < uResolution; i += GROUP_SIZE)
+  {
+    imageStore(uOutput, lineTexel(i), line[i]);
+  }
+}
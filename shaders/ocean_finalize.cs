@@ -0,0 +1,45 @@
+#version 460 core
+// FFT ocean, step 3: unpacks the transformed fields into the textures the water shaders
+// sample. The spectrum was centred on k = 0, which leaves a (-1)^(x+y) factor on every
+// output. Foam comes from the folding of the choppy surface: where the Jacobian of the
+// horizontal displacement drops below uFoamThreshold, and decays by uFoamDecay per update.
+
+layout(local_size_x = 16, local_size_y = 16) in;
+
+layout(rgba32f, binding = 0) uniform restrict readonly image2DArray uFields;
+layout(rgba16f, binding = 1) uniform restrict writeonly image2D uDisplacement;  // xyz offset, w Jacobian
+layout(rgba16f, binding = 2) uniform restrict image2D uNormalFoam;             // xyz normal, w foam
+
+uniform int uResolution;
+uniform float uChoppiness;
+uniform float uFoamThreshold;
+uniform float uFoamDecay;
+
+void main()
+{
+  ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+  if (any(greaterThanEqual(texel, ivec2(uResolution)))) return;
+
+  float parity = ((texel.x + texel.y) & 1) == 0 ? 1.0 : -1.0;
+  vec4 fields0 = parity * imageLoad(uFields, ivec3(texel, 0));  // h, Dx, Dz, dh/dx
+  vec4 fields1 = parity * imageLoad(uFields, ivec3(texel, 1));  // dh/dz, dDx/dx, dDz/dz, dDx/dz
+
+  float height = fields0.x;
+  vec2 displacement = uChoppiness * fields0.yz;
+  vec2 slope = vec2(fields0.w, fields1.x);
+
+  // Jacobian of x + lambda D(x)
+  float jxx = 1.0 + uChoppiness * fields1.y;
+  float jzz = 1.0 + uChoppiness * fields1.z;
+  float jxz = uChoppiness * fields1.w;
+  float jacobian = jxx * jzz - jxz * jxz;
+
+  // Tangents (jxx, dh/dx, jxz) and (jxz, dh/dz, jzz) of the displaced surface
+  vec3 normal = normalize(cross(vec3(jxz, slope.y, jzz), vec3(jxx, slope.x, jxz)));
+
+  float previousFoam = imageLoad(uNormalFoam, texel).w;
+  float foam = max(previousFoam * uFoamDecay, clamp(uFoamThreshold - jacobian, 0.0, 1.0));
+
+  imageStore(uDisplacement, texel, vec4(displacement.x, height, displacement.y, jacobian));
+  imageStore(uNormalFoam, texel, vec4(normal, foam));
+}
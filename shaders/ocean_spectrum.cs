@@ -0,0 +1,57 @@
+#version 460 core
+// FFT ocean, step 1: evolves the initial spectrum to uTime (Tessendorf 2001, "Simulating
+// Ocean Water") and forms the spectra of every field the surface needs. Texel n holds wave
+// vector k = 2 pi (n - N/2) / L. Four complex fields are packed two per texel:
+//   layer 0: h + i Dx, Dz + i dh/dx
+//   layer 1: dh/dz + i dDx/dx, dDz/dz + i dDx/dz
+// Each is the spectrum of two real fields, so one complex inverse FFT recovers both.
+
+layout(local_size_x = 16, local_size_y = 16) in;
+
+layout(rgba32f, binding = 0) uniform restrict readonly image2D uInitialSpectrum;  // h0(k), conj(h0(-k))
+layout(rgba32f, binding = 1) uniform restrict writeonly image2DArray uSpectrum;
+
+uniform int uResolution;
+uniform float uPatchSize;
+uniform float uTime;
+
+#define GRAVITY 9.81
+#define PI 3.14159265
+
+vec2 complexMul(vec2 a, vec2 b)
+{
+  return vec2(a.x * b.x - a.y * b.y, a.x * b.y + a.y * b.x);
+}
+
+// i * a
+vec2 timesI(vec2 a)
+{
+  return vec2(-a.y, a.x);
+}
+
+void main()
+{
+  ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+  if (any(greaterThanEqual(texel, ivec2(uResolution)))) return;
+
+  vec2 k = 2.0 * PI * vec2(texel - uResolution / 2) / uPatchSize;
+  float kLength = length(k);
+
+  vec4 initial = imageLoad(uInitialSpectrum, texel);
+  float omega = sqrt(GRAVITY * kLength);  // Deep water dispersion
+  vec2 rotation = vec2(cos(omega * uTime), sin(omega * uTime));
+  vec2 h = complexMul(initial.xy, rotation) + complexMul(initial.zw, vec2(rotation.x, -rotation.y));
+
+  // Choppy displacement D = i k / |k| h; derivatives multiply by i k
+  vec2 kUnit = kLength > 1.0e-6 ? k / kLength : vec2(0.0);
+  vec2 dx = timesI(h) * kUnit.x;
+  vec2 dz = timesI(h) * kUnit.y;
+  vec2 slopeX = timesI(h) * k.x;
+  vec2 slopeZ = timesI(h) * k.y;
+  vec2 dxdx = -h * k.x * kUnit.x;
+  vec2 dzdz = -h * k.y * kUnit.y;
+  vec2 dxdz = -h * k.x * kUnit.y;
+
+  imageStore(uSpectrum, ivec3(texel, 0), vec4(h + timesI(dx), dz + timesI(slopeX)));
+  imageStore(uSpectrum, ivec3(texel, 1), vec4(slopeZ + timesI(dxdx), dzdz + timesI(dxdz)));
+}
@@ -0,0 +1,17 @@
+#version 460 core
+
+// Weighted blended transparency (WeightedOIT). No main(): linked as a second fragment stage
+// into the transparent draws, which declare
+//   void writeTransparent(vec4 color);
+// and call it with their straight (not premultiplied) color instead of writing an output.
+
+layout(location = 0) out vec4 oitAccum;        // Weighted premultiplied color, weighted alpha
+layout(location = 1) out float oitRevealage;   // Multiplied by (1 - alpha) through the blend
+
+void writeTransparent(vec4 color) {
+    // Depth weight of McGuire and Bavoil (2013): nearer and more opaque layers dominate
+    float alpha = clamp(color.a, 0.0, 1.0);
+    float weight = clamp(pow(min(1.0, alpha * 10.0) + 0.01, 3.0) * 1e8 * pow(1.0 - gl_FragCoord.z * 0.9, 3.0), 1e-2, 3e3);
+    oitAccum = vec4(color.rgb * alpha, alpha) * weight;
+    oitRevealage = alpha;
+}
@@ -0,0 +1,25 @@
+#version 460 core
+
+// Resolves the WeightedOIT targets over the opaque scene, blended with
+// (ONE_MINUS_SRC_ALPHA, SRC_ALPHA): the output alpha is the light the layers let through
+
+uniform sampler2D accumTexture;
+uniform sampler2D revealageTexture;
+
+out vec4 FragColor;
+
+void main() {
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float revealage = texelFetch(revealageTexture, pixel, 0).r;
+    if (revealage >= 1.0) {
+        discard;    // No transparent layer here
+    }
+
+    // Weighted average of the layers; a sum past the 16-bit range falls back to its alpha
+    vec4 accum = texelFetch(accumTexture, pixel, 0);
+    if (isinf(max(max(abs(accum.r), abs(accum.g)), abs(accum.b)))) {
+        accum.rgb = vec3(accum.a);
+    }
+    vec3 average = accum.rgb / clamp(accum.a, 1e-4, 5e4);
+    FragColor = vec4(average, revealage);
+}
@@ -0,0 +1,38 @@
+#version 460 core
+
+// Both planar targets of ReflectionRenderer in one pass: invocation 0 draws each triangle
+// into layer 0 through the mirrored camera, invocation 1 into layer 1 through the camera
+// itself. The outputs match sphere.vs, so sphere.fs shades them unchanged
+
+layout(triangles, invocations = 2) in;
+layout(triangle_strip, max_vertices = 3) out;
+
+in vec3 vWorldPos[];
+in vec3 vNormal[];
+in vec2 vTexCoord[];
+
+out vec3 FragPos;
+out vec3 Normal;
+out vec2 TexCoord;
+
+uniform mat4 layerViewProjection[2];
+uniform vec4 layerClipPlane[2];
+uniform bool layerEnabled[2];   // The object is drawn into the targets on its side of the water
+
+void main() {
+    int layer = gl_InvocationID;
+    if (!layerEnabled[layer]) return;
+    
+    // The mirror flips the winding, so the reflection emits the triangle reversed
+    for (int i = 0; i < 3; i++) {
+        int v = layer == 0 ? 2 - i : i;
+        FragPos = vWorldPos[v];
+        Normal = vNormal[v];
+        TexCoord = vTexCoord[v];
+        gl_Position = layerViewProjection[layer] * vec4(vWorldPos[v], 1.0);
+        gl_ClipDistance[0] = dot(vec4(vWorldPos[v], 1.0), layerClipPlane[layer]);
+        gl_Layer = layer;
+        EmitVertex();
+    }
+    EndPrimitive();
+}
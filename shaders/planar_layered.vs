@@ -0,0 +1,21 @@
+#version 460 core
+
+// World-space vertices for planar_layered.gs, which projects them once per planar target
+
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoord;
+layout (location = 3) in vec4 aInstance;   // Centre offset and radius of the unit sphere (Sphere)
+
+out vec3 vWorldPos;
+out vec3 vNormal;
+out vec2 vTexCoord;
+
+uniform mat4 model;
+
+void main() {
+    vWorldPos = vec3(model * vec4(aInstance.xyz + aPos * aInstance.w, 1.0));
+    vNormal = mat3(transpose(inverse(model))) * aNormal;
+    vTexCoord = aTexCoord;
+    gl_Position = vec4(vWorldPos, 1.0);
+}
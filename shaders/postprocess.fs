@@ -3,54 +3,42 @@
 in vec2 TexCoord;
 out vec4 FragColor;
 
+// The final composite of the frame, one read of every input and one write. The effects
+// PostProcessManager enables are compiled in, one program per combination:
+//   DOF          depth of field
+//   RAY_TRACED   the ray traced water blended over the scene by its alpha
+//   VOLUMETRIC   volumetric lighting
+//   BLOOM        bloom
+
 uniform sampler2D screenTexture;
 uniform sampler2D depthTexture;
 uniform float time;
 uniform vec2 resolution;
 
-// Post-processing effects
-uniform bool enableBloom;
-uniform bool enableSSR; // Screen-space reflections
-uniform bool enableDOF; // Depth of field
-uniform bool enableVolumetricLighting;
+// Ray traced water of RayTracingManager, alpha its coverage
+uniform sampler2D rayTracedTexture;
 
 // Screen-space refraction
 uniform sampler2D refractionTexture;
 uniform float refractionStrength;
 
-// Bloom parameters
-uniform float bloomThreshold;
+// Bloom: first level of the mip chain PostProcessManager builds before this pass
+uniform sampler2D bloomTexture;
 uniform float bloomIntensity;
 
-// DOF parameters
+// Depth of field: the half-resolution far and near fields of PostProcessManager::renderDOF,
+// blended over the sharp scene by the full-resolution CoC (dof_prepare.fs)
+uniform sampler2D dofFarTexture;
+uniform sampler2D dofNearTexture;
 uniform float focusDistance;
 uniform float focusRange;
+uniform float maxCoC;
+uniform vec2 depthRange;
 
-// Volumetric lighting parameters
-uniform vec3 lightPos;
-uniform vec3 cameraPos;
-
-// Simple box blur for bloom
-vec3 boxBlur(sampler2D tex, vec2 uv, vec2 texelSize, int radius) {
-    vec3 result = vec3(0.0);
-    float count = 0.0;
-    
-    for (int x = -radius; x <= radius; x++) {
-        for (int y = -radius; y <= radius; y++) {
-            vec2 offset = vec2(float(x), float(y)) * texelSize;
-            result += texture(tex, uv + offset).rgb;
-            count += 1.0;
-        }
-    }
-    
-    return result / count;
-}
-
-// Extract bright areas for bloom
-vec3 extractBrights(vec3 color) {
-    float brightness = dot(color, vec3(0.2126, 0.7152, 0.0722));
-    return color * max(0.0, brightness - bloomThreshold);
-}
+// Volumetric lighting: FroxelVolumetrics' integrated froxels, scattered light in rgb and
+// transmittance in alpha up to the far side of each slice, slices exponential in view depth
+uniform sampler3D froxelTexture;
+uniform vec2 froxelRange;       // View depth of the first and last slice
 
 // Screen-space refraction effect
 vec3 screenSpaceRefraction(vec2 uv, vec3 normal) {
@@ -67,70 +55,52 @@ vec3 screenSpaceRefraction(vec2 uv, vec3 normal) {
     return texture(screenTexture, uv).rgb;
 }
 
-// Simple depth of field
-vec3 depthOfField(vec2 uv) {
-    float depth = texture(depthTexture, uv).r;
-    
-    // Convert depth to linear distance
-    float linearDepth = (2.0 * 0.1) / (100.0 + 0.1 - depth * (100.0 - 0.1));
-    
-    // Calculate blur amount based on distance from focus
-    float blur = abs(linearDepth - focusDistance) / focusRange;
-    blur = clamp(blur, 0.0, 1.0);
-    
-    // Sample with varying blur
-    vec2 texelSize = 1.0 / resolution;
-    int blurRadius = int(blur * 5.0);
-    
-    return boxBlur(screenTexture, uv, texelSize, blurRadius);
+float linearDepth(float depth) {
+    float z = depth * 2.0 - 1.0;
+    return 2.0 * depthRange.x * depthRange.y / (depthRange.y + depthRange.x - z * (depthRange.y - depthRange.x));
 }
 
-// Volumetric lighting
-float volumetricLighting(vec2 uv) {
-    // Convert light position to screen space
-    vec2 lightScreen = vec2(0.5, 0.8); // Assume light is at top center
-    
-    vec2 deltaTexCoord = (uv - lightScreen);
-    deltaTexCoord *= 1.0 / 100.0; // Number of samples
-    
-    float illuminationDecay = 1.0;
-    vec2 coord = uv;
-    float density = 0.0;
-    
-    for (int i = 0; i < 100; i++) {
-        coord -= deltaTexCoord;
-        vec3 sampleColor = texture(screenTexture, coord).rgb;
-        float sampleBrightness = dot(sampleColor, vec3(0.33));
-        
-        density += sampleBrightness * illuminationDecay;
-        illuminationDecay *= 0.96;
-    }
-    
-    return density / 100.0;
+// Signed, in half-resolution pixels, as dof_prepare.fs
+float circleOfConfusion(float depth) {
+    return clamp((linearDepth(depth) - focusDistance) / focusRange, -1.0, 1.0) * maxCoC;
+}
+
+// One fetch of the integrated froxels at the pixel's depth; texel z ends at slice z + 1
+vec3 volumetricLighting(vec2 uv, vec3 color) {
+    float viewDepth = linearDepth(texture(depthTexture, uv).r);
+    float slices = float(textureSize(froxelTexture, 0).z);
+    float w = log(viewDepth / froxelRange.x) / log(froxelRange.y / froxelRange.x) - 0.5 / slices;
+    vec4 froxel = texture(froxelTexture, vec3(uv, w));
+    return color * froxel.a + froxel.rgb;
 }
 
 void main() {
     vec2 uv = TexCoord;
     vec3 color = texture(screenTexture, uv).rgb;
     
-    // Apply depth of field if enabled
-    if (enableDOF) {
-        color = depthOfField(uv);
-    }
-    
-    // Apply bloom if enabled
-    if (enableBloom) {
-        vec2 texelSize = 1.0 / resolution;
-        vec3 bloom = boxBlur(screenTexture, uv, texelSize * 2.0, 3);
-        bloom = extractBrights(bloom);
-        color += bloom * bloomIntensity;
-    }
-    
-    // Apply volumetric lighting if enabled
-    if (enableVolumetricLighting) {
-        float volumetric = volumetricLighting(uv);
-        color += vec3(0.8, 0.9, 1.0) * volumetric * 0.5;
+#ifdef DOF
+    {
+        float coc = circleOfConfusion(texture(depthTexture, uv).r);
+        color = mix(color, texture(dofFarTexture, uv).rgb, smoothstep(0.5, 1.5, coc));
+        vec4 near = texture(dofNearTexture, uv);
+        color = mix(color, near.rgb, near.a);
     }
+#endif
+    
+    // The ray traced water stays sharp: the depth of field fields are of the raster scene
+#ifdef RAY_TRACED
+    vec4 rayTraced = texture(rayTracedTexture, uv);
+    color = mix(color, rayTraced.rgb, rayTraced.a);
+#endif
+    
+    // Over the blurred scene as well
+#ifdef VOLUMETRIC
+    color = volumetricLighting(uv, color);
+#endif
+    
+#ifdef BLOOM
+    color += texture(bloomTexture, uv).rgb * bloomIntensity;
+#endif
     
     // Tone mapping (simple Reinhard)
     color = color / (color + vec3(1.0));
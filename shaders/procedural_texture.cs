@@ -0,0 +1,70 @@
+#version 460 core
+
+// Procedural surface textures generated at startup, the GPU twins of generateCausticPixels
+// and generateTilePixels in main.cpp: PROCEDURAL_CAUSTIC or PROCEDURAL_TILE picks the
+// pattern. Each invocation writes one texel of the base level; the mips are generated after.
+
+layout(local_size_x = 8, local_size_y = 8) in;
+
+layout(rgba8, binding = 0) uniform restrict writeonly image2D uTarget;
+
+uniform int uSize;   // Texels per edge
+
+#ifdef PROCEDURAL_CAUSTIC
+// The three sine layers, large to small scale
+float causticLayer(ivec2 texel, float scale, vec2 phase) {
+    vec2 n = vec2(texel) / float(uSize) * scale;
+    return 0.5 + 0.5 * sin(n.x * 3.14159 + phase.x) * sin(n.y * 3.14159 + phase.y);
+}
+
+vec4 proceduralColor(ivec2 texel) {
+    float noise1 = causticLayer(texel, 4.0, vec2(0.0));
+    float noise2 = causticLayer(texel, 8.0, vec2(0.5, 1.5));
+
+    // Distortion toward another texel of the large and small layers
+    vec2 distortion = 0.05 * sin(vec2(noise2, noise1) * 10.0);
+    ivec2 sampleTexel = clamp(texel + ivec2(distortion * float(uSize)), ivec2(0), ivec2(uSize - 1));
+    float distortedNoise = causticLayer(sampleTexel, 4.0, vec2(0.0)) * 0.6 +
+                           causticLayer(sampleTexel, 16.0, vec2(1.0, 2.0)) * 0.4;
+
+    // Sharpened caustic with a band of sharp edges
+    float caustic = pow(distortedNoise, 4.0);
+    if (caustic > 0.5 && caustic < 0.55) {
+        caustic += 0.5;
+    }
+    caustic = min(1.0, caustic);
+
+    // Bluish tint for the underwater light
+    return vec4(min(vec3(caustic) * vec3(180.0, 230.0, 255.0), vec3(255.0)) / 255.0, 1.0);
+}
+#endif
+
+#ifdef PROCEDURAL_TILE
+// White tiles with dark grout, sixteen to an edge
+vec4 proceduralColor(ivec2 texel) {
+    int tileSize = uSize / 16;
+    int groutWidth = tileSize / 8;
+    ivec2 grid = texel % tileSize;
+    bool inGrout = any(lessThan(grid, ivec2(groutWidth))) || any(greaterThanEqual(grid, ivec2(tileSize - groutWidth)));
+
+    // Slight per-texel variation of both colors
+    float noise = float((texel.x * 17 + texel.y * 29) % 10) / 100.0;
+    int value = inGrout ? 80 + int(noise * 20.0) : 240 + int(noise * 15.0);
+
+    // Subtle highlight toward the tile's center
+    if (!inGrout) {
+        vec2 tileUV = vec2(grid - tileSize / 2) / float(tileSize / 2);
+        float highlight = max(0.0, 1.0 - length(tileUV) * 1.2);
+        value = min(255, value + int(highlight * 15.0));
+    }
+    return vec4(vec3(float(value) / 255.0), 1.0);
+}
+#endif
+
+void main() {
+    ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+    if (texel.x >= uSize || texel.y >= uSize) {
+        return;
+    }
+    imageStore(uTarget, texel, proceduralColor(texel));
+}
@@ -0,0 +1,76 @@
+#version 460 core
+// Rigid bodies, one instance per body of RigidBodySystem. Every shape draws the same mesh,
+// a cube with subdivided faces: boxes scale it by their half extents, spheres push its
+// points out to their radius, so spheres and boxes are one instanced draw. Shaded by
+// sphere.fs
+#ifdef STEREO_MULTIVIEW
+// Both eyes in one draw (StereoRenderer); each view takes its camera from the frame block
+#extension GL_OVR_multiview2 : require
+layout(num_views = 2) in;
+#endif
+
+layout (location = 0) in vec3 aPos;      // On the [-1, 1] cube
+layout (location = 1) in vec3 aNormal;   // Of the cube face
+layout (location = 2) in vec2 aTexCoord;
+
+#define RIGID_BODY_CAPACITY 1024
+#define RIGID_BOX 1.0
+
+layout(binding = 46, std430) restrict readonly buffer rigidBodyStateBuf
+{
+  vec4 bodyPosition[RIGID_BODY_CAPACITY];
+  vec4 bodyVelocity[RIGID_BODY_CAPACITY];
+  vec4 bodyOrientation[RIGID_BODY_CAPACITY];
+  vec4 bodyAngularVelocity[RIGID_BODY_CAPACITY];
+  vec4 bodyShape[RIGID_BODY_CAPACITY];
+};
+
+out vec3 FragPos;
+out vec3 Normal;
+out vec2 TexCoord;
+invariant gl_Position;   // Matches the depth prepass (depth_only.fs)
+
+// Camera and light of the pass being drawn (updateFrameUniforms in main.cpp)
+layout(std140, binding = 2) uniform FrameUniforms
+{
+    mat4 view;
+    mat4 projection;
+    vec3 viewPos;
+    float time;
+    vec3 lightPos;
+    vec3 lightColor;
+#ifdef STEREO_MULTIVIEW
+    mat4 eyeView[2];
+    mat4 eyeProjection[2];
+#endif
+};
+#ifdef STEREO_MULTIVIEW
+#define view eyeView[gl_ViewID_OVR]
+#define projection eyeProjection[gl_ViewID_OVR]
+#endif
+
+vec3 rotateByQuaternion(vec4 q, vec3 v) {
+    return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+
+void main() {
+    int body = gl_InstanceID;
+    vec4 shape = bodyShape[body];
+    vec4 orientation = bodyOrientation[body];
+
+    vec3 localPos;
+    vec3 localNormal;
+    if (shape.w == RIGID_BOX) {
+        localPos = aPos * shape.xyz;
+        localNormal = aNormal;
+    } else {
+        localNormal = normalize(aPos);
+        localPos = localNormal * shape.x;
+    }
+
+    FragPos = bodyPosition[body].xyz + rotateByQuaternion(orientation, localPos);
+    Normal = rotateByQuaternion(orientation, localNormal);
+    TexCoord = aTexCoord;
+
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+}
@@ -0,0 +1,55 @@
+#version 460 core
+// Rigid body broadphase (RigidBodySystem): lists every body in each grid cell its bounding
+// sphere, grown by uMargin, overlaps. The cells are RigidBodySystem::CELL_FACTOR SPH cells on
+// a side from the SPH grid's origin, so a particle finds the bodies it may touch in the one
+// cell its SPH voxel maps to (sph_step1.cs). Bodies are at most one cell across, so a body
+// enters at most eight cells; a full cell drops the bodies past its capacity.
+
+layout(local_size_x = 64) in;
+
+#define RIGID_BODY_CAPACITY 1024
+#define RIGID_CELL_CAPACITY 8
+
+layout(binding = 46, std430) restrict readonly buffer rigidBodyStateBuf
+{
+  vec4 bodyPosition[RIGID_BODY_CAPACITY];         // Centre, bounding radius
+  vec4 bodyVelocity[RIGID_BODY_CAPACITY];
+  vec4 bodyOrientation[RIGID_BODY_CAPACITY];
+  vec4 bodyAngularVelocity[RIGID_BODY_CAPACITY];
+  vec4 bodyShape[RIGID_BODY_CAPACITY];
+};
+
+// Per cell a count, then up to RIGID_CELL_CAPACITY body ids; counts cleared before
+layout(binding = 48, std430) restrict buffer rigidBodyGridBuf
+{
+  uint bodyCells[];
+};
+
+uniform uint uBodyCount;
+uniform vec3 uGridOrigin;
+uniform float uCellSize;
+uniform ivec3 uGridRes;
+uniform float uMargin;
+
+void main()
+{
+  uint body = gl_GlobalInvocationID.x;
+  if (body >= uBodyCount) return;
+
+  vec4 bounds = bodyPosition[body];
+  float reach = bounds.w + uMargin;
+  ivec3 lo = clamp(ivec3(floor((bounds.xyz - reach - uGridOrigin) / uCellSize)), ivec3(0), uGridRes - 1);
+  ivec3 hi = clamp(ivec3(floor((bounds.xyz + reach - uGridOrigin) / uCellSize)), ivec3(0), uGridRes - 1);
+
+  for (int z = lo.z; z <= hi.z; z++) {
+    for (int y = lo.y; y <= hi.y; y++) {
+      for (int x = lo.x; x <= hi.x; x++) {
+        uint cellBase = uint(x + uGridRes.x * (y + uGridRes.y * z)) * (RIGID_CELL_CAPACITY + 1);
+        uint slot = atomicAdd(bodyCells[cellBase], 1u);
+        if (slot < RIGID_CELL_CAPACITY) {
+          bodyCells[cellBase + 1 + slot] = body;
+        }
+      }
+    }
+  }
+}
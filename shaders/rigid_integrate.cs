@@ -0,0 +1,283 @@
+#version 460 core
+// Rigid body integration (RigidBodySystem), one thread per body, from the source state into
+// the other of the two state buffers:
+//  1. On the first substep of a frame, the momentum the fluid took from the body in the last
+//     SPH update (summed per body in sph_step1.cs) is taken back from it, and the sums cleared
+//  2. Gravity
+//  3. Contacts with the bodies sharing a broadphase cell and with the walls of the bounds,
+//     resolved against the source state of both bodies, so every body only writes itself:
+//     a restitution and friction impulse while the contact closes, and a share of the
+//     penetration by inverse mass pushed out
+//  4. Position and orientation step
+// Inertia is one scalar per body, the mean of the shape's principal moments.
+
+layout(local_size_x = 64) in;
+
+#define RIGID_BODY_CAPACITY 1024
+#define RIGID_CELL_CAPACITY 8
+#define RIGID_BOX 1.0
+#define SPHERE_IMPULSE_SCALE 65536.0  // Fixed point of the SPH impulse sums
+
+const float PENETRATION_SLOP = 0.002;
+const float PENETRATION_CORRECTION = 0.6;
+
+layout(binding = 46, std430) restrict readonly buffer rigidBodyStateBuf
+{
+  vec4 bodyPosition[RIGID_BODY_CAPACITY];         // Centre, bounding radius
+  vec4 bodyVelocity[RIGID_BODY_CAPACITY];         // Linear velocity, inverse mass
+  vec4 bodyOrientation[RIGID_BODY_CAPACITY];      // Unit quaternion, xyz vector part
+  vec4 bodyAngularVelocity[RIGID_BODY_CAPACITY];  // Angular velocity, inverse inertia
+  vec4 bodyShape[RIGID_BODY_CAPACITY];            // Radius or half extents, shape
+};
+
+layout(binding = 49, std430) restrict writeonly buffer rigidBodyNextStateBuf
+{
+  vec4 nextPosition[RIGID_BODY_CAPACITY];
+  vec4 nextVelocity[RIGID_BODY_CAPACITY];
+  vec4 nextOrientation[RIGID_BODY_CAPACITY];
+  vec4 nextAngularVelocity[RIGID_BODY_CAPACITY];
+  vec4 nextShape[RIGID_BODY_CAPACITY];
+};
+
+layout(binding = 47, std430) restrict buffer rigidBodyImpulseBuf
+{
+  ivec4 bodyLinearImpulse[RIGID_BODY_CAPACITY];   // Momentum into the fluid, contact count
+  ivec4 bodyAngularImpulse[RIGID_BODY_CAPACITY];
+};
+
+layout(binding = 48, std430) restrict readonly buffer rigidBodyGridBuf
+{
+  uint bodyCells[];
+};
+
+uniform uint uBodyCount;
+uniform float uDT;
+uniform vec3 uGravity;
+uniform vec3 uBoundsMin;
+uniform vec3 uBoundsMax;
+uniform vec3 uGridOrigin;
+uniform float uCellSize;
+uniform ivec3 uGridRes;
+uniform float uMargin;        // As the broadphase was built with
+uniform float uRestitution;
+uniform float uFriction;
+uniform float uDamping;       // Linear and angular, per second
+uniform int uApplyFluid;
+
+vec3 rotateByQuaternion(vec4 q, vec3 v) {
+  return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+
+// Outward normal and signed distance of a point to a body's surface, as sph_step1.cs
+vec4 bodyDistance(uint body, vec3 point) {
+  vec3 local = point - bodyPosition[body].xyz;
+  vec4 shape = bodyShape[body];
+  if (shape.w != RIGID_BOX) {
+    float distToCenter = length(local);
+    return vec4(distToCenter > 0.0001 ? local / distToCenter : vec3(0.0, 1.0, 0.0), distToCenter - shape.x);
+  }
+  vec4 q = bodyOrientation[body];
+  vec4 inverse = vec4(-q.xyz, q.w);
+  vec3 p = rotateByQuaternion(inverse, local);
+  vec3 d = abs(p) - shape.xyz;
+  float outside = length(max(d, 0.0));
+  vec3 normal;
+  if (outside > 0.0) {
+    normal = sign(p) * max(d, 0.0) / outside;
+  } else {
+    vec3 axis = d.x > d.y ? (d.x > d.z ? vec3(1.0, 0.0, 0.0) : vec3(0.0, 0.0, 1.0))
+                          : (d.y > d.z ? vec3(0.0, 1.0, 0.0) : vec3(0.0, 0.0, 1.0));
+    normal = axis * sign(p);
+  }
+  return vec4(rotateByQuaternion(q, normal), outside + min(max(d.x, max(d.y, d.z)), 0.0));
+}
+
+vec3 boxCorner(uint body, int corner) {
+  vec3 signs = vec3((corner & 1) != 0 ? 1.0 : -1.0, (corner & 2) != 0 ? 1.0 : -1.0, (corner & 4) != 0 ? 1.0 : -1.0);
+  return bodyPosition[body].xyz + rotateByQuaternion(bodyOrientation[body], signs * bodyShape[body].xyz);
+}
+
+struct Contact {
+  vec3 normal;   // Toward the body being resolved
+  float depth;
+  vec3 point;
+};
+
+// Deepest contact of body a against body b; spheres exactly, box pairs by their corners
+Contact bodyContact(uint a, uint b) {
+  Contact contact = Contact(vec3(0.0), 0.0, vec3(0.0));
+  bool boxA = bodyShape[a].w == RIGID_BOX;
+  bool boxB = bodyShape[b].w == RIGID_BOX;
+  if (!boxA) {
+    vec4 surface = bodyDistance(b, bodyPosition[a].xyz);
+    contact.normal = surface.xyz;
+    contact.depth = bodyShape[a].x - surface.w;
+    contact.point = bodyPosition[a].xyz - surface.xyz * bodyShape[a].x;
+  } else if (!boxB) {
+    vec4 surface = bodyDistance(a, bodyPosition[b].xyz);
+    contact.normal = -surface.xyz;
+    contact.depth = bodyShape[b].x - surface.w;
+    contact.point = bodyPosition[b].xyz + surface.xyz * bodyShape[b].x;
+  } else {
+    for (int corner = 0; corner < 8; corner++) {
+      vec3 cornerA = boxCorner(a, corner);
+      vec4 surface = bodyDistance(b, cornerA);
+      if (-surface.w > contact.depth) {
+        contact = Contact(surface.xyz, -surface.w, cornerA);
+      }
+      vec3 cornerB = boxCorner(b, corner);
+      surface = bodyDistance(a, cornerB);
+      if (-surface.w > contact.depth) {
+        contact = Contact(-surface.xyz, -surface.w, cornerB);
+      }
+    }
+  }
+  return contact;
+}
+
+// Impulse on the body from one closing contact with another body, static when its inverse
+// mass is zero
+vec3 contactImpulse(vec3 relative, vec3 normal, vec3 arm, vec3 otherArm, float invMass, float invInertia,
+                    float otherInvMass, float otherInvInertia) {
+  float normalVelocity = dot(relative, normal);
+  if (normalVelocity >= 0.0) return vec3(0.0);
+
+  vec3 armNormal = cross(arm, normal);
+  vec3 otherArmNormal = cross(otherArm, normal);
+  float effective = invMass + otherInvMass + invInertia * dot(armNormal, armNormal) +
+                    otherInvInertia * dot(otherArmNormal, otherArmNormal);
+  float normalImpulse = -(1.0 + uRestitution) * normalVelocity / effective;
+  vec3 impulse = normalImpulse * normal;
+
+  // Coulomb friction, at most what stops the slip
+  vec3 tangential = relative - normalVelocity * normal;
+  float slip = length(tangential);
+  if (slip > 1e-5) {
+    vec3 tangent = tangential / slip;
+    vec3 armTangent = cross(arm, tangent);
+    vec3 otherArmTangent = cross(otherArm, tangent);
+    float tangentEffective = invMass + otherInvMass + invInertia * dot(armTangent, armTangent) +
+                             otherInvInertia * dot(otherArmTangent, otherArmTangent);
+    impulse -= tangent * min(uFriction * normalImpulse, slip / tangentEffective);
+  }
+  return impulse;
+}
+
+ivec3 gridCell(vec3 point) {
+  return clamp(ivec3(floor((point - uGridOrigin) / uCellSize)), ivec3(0), uGridRes - 1);
+}
+
+void main()
+{
+  uint body = gl_GlobalInvocationID.x;
+  if (body >= uBodyCount) return;
+
+  vec4 bounds = bodyPosition[body];
+  vec3 center = bounds.xyz;
+  float invMass = bodyVelocity[body].w;
+  float invInertia = bodyAngularVelocity[body].w;
+  vec3 velocity = bodyVelocity[body].xyz;
+  vec3 angular = bodyAngularVelocity[body].xyz;
+  vec4 orientation = bodyOrientation[body];
+
+  if (uApplyFluid != 0) {
+    velocity -= vec3(bodyLinearImpulse[body].xyz) / SPHERE_IMPULSE_SCALE * invMass;
+    angular -= vec3(bodyAngularImpulse[body].xyz) / SPHERE_IMPULSE_SCALE * invInertia;
+    bodyLinearImpulse[body] = ivec4(0);
+    bodyAngularImpulse[body] = ivec4(0);
+  }
+  velocity += uGravity * uDT;
+
+  vec3 impulse = vec3(0.0);
+  vec3 angularImpulse = vec3(0.0);
+  vec3 correction = vec3(0.0);
+
+  // Bodies: each pair once, in the first cell both are listed in
+  float reach = bounds.w + uMargin;
+  ivec3 lo = gridCell(center - reach);
+  ivec3 hi = gridCell(center + reach);
+  for (int z = lo.z; z <= hi.z; z++) {
+    for (int y = lo.y; y <= hi.y; y++) {
+      for (int x = lo.x; x <= hi.x; x++) {
+        uint cellBase = uint(x + uGridRes.x * (y + uGridRes.y * z)) * (RIGID_CELL_CAPACITY + 1);
+        uint count = min(bodyCells[cellBase], uint(RIGID_CELL_CAPACITY));
+        for (uint i = 0; i < count; i++) {
+          uint other = bodyCells[cellBase + 1 + i];
+          if (other == body) continue;
+          vec4 otherBounds = bodyPosition[other];
+          vec3 offset = center - otherBounds.xyz;
+          if (dot(offset, offset) > (bounds.w + otherBounds.w) * (bounds.w + otherBounds.w)) continue;
+          if (max(lo, gridCell(otherBounds.xyz - (otherBounds.w + uMargin))) != ivec3(x, y, z)) continue;
+
+          Contact contact = bodyContact(body, other);
+          if (contact.depth <= 0.0) continue;
+
+          float otherInvMass = bodyVelocity[other].w;
+          vec3 arm = contact.point - center;
+          vec3 otherArm = contact.point - otherBounds.xyz;
+          vec3 relative = velocity + cross(angular, arm) -
+                          (bodyVelocity[other].xyz + cross(bodyAngularVelocity[other].xyz, otherArm));
+          vec3 j = contactImpulse(relative, contact.normal, arm, otherArm, invMass, invInertia,
+                                  otherInvMass, bodyAngularVelocity[other].w);
+          impulse += j;
+          angularImpulse += cross(arm, j);
+          correction += contact.normal * max(contact.depth - PENETRATION_SLOP, 0.0) *
+                        (invMass / max(invMass + otherInvMass, 1e-6));
+        }
+      }
+    }
+  }
+
+  // Walls: a sphere touches with one point, a box with the mean of its corners past the wall
+  bool box = bodyShape[body].w == RIGID_BOX;
+  for (int wall = 0; wall < 6; wall++) {
+    int axis = wall >> 1;
+    float side = (wall & 1) == 0 ? 1.0 : -1.0;
+    vec3 normal = vec3(0.0);
+    normal[axis] = side;
+    float plane = side > 0.0 ? uBoundsMin[axis] : -uBoundsMax[axis];
+
+    float depth = 0.0;
+    vec3 point = vec3(0.0);
+    if (!box) {
+      point = center - normal * bodyShape[body].x;
+      depth = plane - dot(point, normal);
+    } else {
+      float touching = 0.0;
+      vec3 pointSum = vec3(0.0);
+      for (int corner = 0; corner < 8; corner++) {
+        vec3 cornerPoint = boxCorner(body, corner);
+        float cornerDepth = plane - dot(cornerPoint, normal);
+        if (cornerDepth > 0.0) {
+          depth = max(depth, cornerDepth);
+          pointSum += cornerPoint;
+          touching += 1.0;
+        }
+      }
+      point = touching > 0.0 ? pointSum / touching : center;
+    }
+    if (depth <= 0.0) continue;
+
+    vec3 arm = point - center;
+    vec3 j = contactImpulse(velocity + cross(angular, arm), normal, arm, vec3(0.0), invMass, invInertia, 0.0, 0.0);
+    impulse += j;
+    angularImpulse += cross(arm, j);
+    correction += normal * max(depth - PENETRATION_SLOP, 0.0);
+  }
+
+  velocity += impulse * invMass;
+  angular += angularImpulse * invInertia;
+  float damping = 1.0 / (1.0 + uDamping * uDT);
+  velocity *= damping;
+  angular *= damping;
+
+  center += correction * PENETRATION_CORRECTION + velocity * uDT;
+  orientation = normalize(orientation + 0.5 * uDT * vec4(angular * orientation.w + cross(angular, orientation.xyz),
+                                                         -dot(angular, orientation.xyz)));
+
+  nextPosition[body] = vec4(center, bounds.w);
+  nextVelocity[body] = vec4(velocity, invMass);
+  nextOrientation[body] = orientation;
+  nextAngularVelocity[body] = vec4(angular, invInertia);
+  nextShape[body] = bodyShape[body];
+}
@@ -0,0 +1,76 @@
+// Adaptive reflection sampling (RayTracingQuality::ULTRA), ahead of the reflection and fused
+// kernels after their local size. Every texel traces its mirror ray; only where the
+// G-buffer normals vary around it (ripples, crests, silhouettes) or the surface is rough do
+// further rays follow, jittered within the normal's spread by a tiled blue-noise texture, up
+// to uMaxSamples. The extra rays come out of a per-frame budget counted on the GPU, so calm
+// water costs one ray per texel whatever the cap.
+
+layout(binding = 8) uniform sampler2D uBlueNoise;     // 64x64 R8, tiled over the screen
+
+uniform int uMaxSamples = 1;            // 1 traces the mirror ray only
+uniform uint uSampleBudget = 0u;        // Extra rays over the whole frame
+uniform float uVarianceThreshold = 0.002;
+
+layout(binding = 0, std430) restrict buffer rtSampleCounterBuf
+{
+  uint extraSamples;                    // Granted this frame, may overshoot the budget
+  uint adaptiveTexels;                  // Texels that asked for more than the mirror ray
+};
+
+// R2 sequence steps between the tiles of successive frames and samples, so neither repeats
+// the pattern of the last
+const vec2 BLUE_NOISE_STEP = vec2(0.7548776662, 0.5698402909);
+
+// Blue noise in [0, 1) per texel: for sample index and dimension of the frame
+float blueNoise(ivec2 texel, int index, int frame)
+{
+  ivec2 size = textureSize(uBlueNoise, 0);
+  ivec2 offset = ivec2(fract(BLUE_NOISE_STEP * float(frame * 8 + index)) * vec2(size));
+  return texelFetch(uBlueNoise, (texel + offset) % size, 0).r;
+}
+
+vec2 blueNoise2(ivec2 texel, int index, int frame)
+{
+  // The second dimension reads the tile at a fixed offset, uncorrelated with the first
+  return vec2(blueNoise(texel, index, frame), blueNoise(texel + ivec2(23, 41), index, frame));
+}
+
+// Variance of the 3x3 normals around the texel: 1 - length of their mean, 0 on flat water
+float normalVariance(ivec2 texel, ivec2 resolution)
+{
+  vec3 sum = vec3(0.0);
+  for (int y = -1; y <= 1; y++) {
+    for (int x = -1; x <= 1; x++) {
+      sum += gbufferNormal(clamp(texel + ivec2(x, y), ivec2(0), resolution - 1));
+    }
+  }
+  return 1.0 - length(sum) / 9.0;
+}
+
+// Rays beyond the mirror one the texel gets from the budget, 0 off ULTRA or once it ran out;
+// spread is how far the normals around the texel stray, for adaptiveSampleNormal
+int adaptiveExtraSamples(ivec2 texel, ivec2 resolution, float roughness, out float spread)
+{
+  spread = 0.0;
+  if (uMaxSamples <= 1) return 0;
+
+  float variance = normalVariance(texel, resolution) + roughness * roughness;
+  spread = sqrt(variance);
+  if (variance < uVarianceThreshold) return 0;
+
+  // Twice the threshold asks for one more ray, and so on up to the cap
+  int wanted = min(int(log2(variance / uVarianceThreshold)) + 1, uMaxSamples - 1);
+  uint granted = atomicAdd(extraSamples, uint(wanted));
+  atomicAdd(adaptiveTexels, 1u);
+  return granted >= uSampleBudget ? 0 : min(wanted, int(uSampleBudget - granted));
+}
+
+// A normal jittered uniformly over a disk of tangent offsets, as wide as the spread
+vec3 adaptiveSampleNormal(vec3 normal, float spread, vec2 noise)
+{
+  vec3 tangent = normalize(abs(normal.y) < 0.99 ? cross(normal, vec3(0.0, 1.0, 0.0)) : cross(normal, vec3(1.0, 0.0, 0.0)));
+  vec3 bitangent = cross(normal, tangent);
+  float radius = sqrt(noise.x) * spread;
+  float angle = 6.28318531 * noise.y;
+  return normalize(normal + (tangent * cos(angle) + bitangent * sin(angle)) * radius);
+}
@@ -0,0 +1,91 @@
+#version 460 core
+
+// One à-trous wavelet pass over a signal from rt_temporal.cs: a 5x5 B3-spline kernel with
+// its taps uStepSize texels apart. The step doubles every pass, so a few passes of 25 taps
+// cover a wide footprint. A tap is weighted down by its normal and its distance from the
+// centre's tangent plane, so the filter stops at wave edges, and by its luminance
+// difference over the centre's standard deviation, so converged texels stay sharp. The
+// variance in alpha is filtered along with the colour for the next pass.
+
+layout(local_size_x = 8, local_size_y = 8) in;
+
+layout(binding = 0) uniform sampler2D uInputTexture;     // Colour, variance in a
+layout(binding = 1) uniform sampler2D uPositionTexture;
+layout(binding = 2) uniform sampler2D uNormalTexture;
+layout(binding = 3) uniform sampler2D uDepthTexture;
+
+layout(rgba16f, binding = 0) uniform restrict writeonly image2D uOutput;
+
+uniform vec2 uResolution;              // Traced texels, a corner of the textures under dynamic resolution
+uniform int uStepSize = 1;
+uniform bool uFinalPass = false;       // Water alpha back to 1 for compositing instead of the variance
+uniform float uLuminanceSigma = 4.0;
+uniform float uNormalPower = 32.0;
+uniform float uPlaneSigma = 0.2;       // Tolerated tangent-plane distance, per unit of tap distance
+
+float luminance(vec3 color) {
+    return dot(color, vec3(0.2126, 0.7152, 0.0722));
+}
+
+void main() {
+    ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 size = ivec2(uResolution);
+    if (any(greaterThanEqual(texel, size))) {
+        return;
+    }
+
+    vec4 center = texelFetch(uInputTexture, texel, 0);
+    if (texelFetch(uDepthTexture, texel, 0).r >= 1.0) {
+        imageStore(uOutput, texel, vec4(center.rgb, 0.0));
+        return;
+    }
+    vec3 centerPos = gbufferPosition(texel);
+    vec3 centerNormal = normalize(gbufferNormal(texel));
+
+    // Centre variance blurred over 3x3, steadier than one texel's estimate
+    const float gaussian[2] = float[](0.5, 0.25);
+    float variance = 0.0;
+    float varianceWeight = 0.0;
+    for (int y = -1; y <= 1; y++) {
+        for (int x = -1; x <= 1; x++) {
+            ivec2 q = clamp(texel + ivec2(x, y), ivec2(0), size - 1);
+            if (texelFetch(uDepthTexture, q, 0).r >= 1.0) continue;
+            float w = gaussian[abs(x)] * gaussian[abs(y)];
+            variance += texelFetch(uInputTexture, q, 0).a * w;
+            varianceWeight += w;
+        }
+    }
+    float lumScale = uLuminanceSigma * sqrt(variance / varianceWeight) + 1e-4;
+    float centerLum = luminance(center.rgb);
+
+    const float kernel[3] = float[](3.0 / 8.0, 1.0 / 4.0, 1.0 / 16.0);
+    vec3 colorSum = vec3(0.0);
+    float varianceSum = 0.0;
+    float weightSum = 0.0;
+    for (int y = -2; y <= 2; y++) {
+        for (int x = -2; x <= 2; x++) {
+            ivec2 q = texel + ivec2(x, y) * uStepSize;
+            if (any(lessThan(q, ivec2(0))) || any(greaterThanEqual(q, size))) continue;
+            if (texelFetch(uDepthTexture, q, 0).r >= 1.0) continue;
+
+            vec4 c = texelFetch(uInputTexture, q, 0);
+            vec3 offset = gbufferPosition(q) - centerPos;
+            vec3 n = normalize(gbufferNormal(q));
+
+            float tapDistance = length(offset);
+            float wPlane = tapDistance > 0.0 ? exp(-abs(dot(centerNormal, offset)) / (uPlaneSigma * tapDistance)) : 1.0;
+            float wNormal = pow(max(dot(centerNormal, n), 0.0), uNormalPower);
+            float wLum = exp(-abs(luminance(c.rgb) - centerLum) / lumScale);
+            float w = kernel[abs(x)] * kernel[abs(y)] * wPlane * wNormal * wLum;
+
+            colorSum += c.rgb * w;
+            varianceSum += c.a * w * w;
+            weightSum += w;
+        }
+    }
+
+    // The centre tap always counts, so weightSum > 0
+    vec3 color = colorSum / weightSum;
+    float filteredVariance = varianceSum / (weightSum * weightSum);
+    imageStore(uOutput, texel, vec4(color, uFinalPass ? 1.0 : filteredVariance));
+}
@@ -0,0 +1,23 @@
+#version 460 core
+
+// Temporal blend of a fresh photon splat (rt_caustic_map.*) into the floor-space caustic
+// map, which keeps the refreshes a few frames apart from popping
+
+layout(local_size_x = 8, local_size_y = 8) in;
+
+layout(r16f, binding = 0) uniform restrict readonly image2D uSplatTexture;
+layout(r16f, binding = 1) uniform restrict image2D uCausticMap;
+
+uniform int uMapSize;
+uniform float uBlend = 0.5;     // Weight of the fresh splat, 1 replaces the map
+
+void main() {
+    ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(texel, ivec2(uMapSize)))) {
+        return;
+    }
+    
+    float splat = imageLoad(uSplatTexture, texel).r;
+    float previous = imageLoad(uCausticMap, texel).r;
+    imageStore(uCausticMap, texel, vec4(mix(previous, splat, uBlend)));
+}
@@ -0,0 +1,24 @@
+#version 460 core
+
+// Irradiance a photon triangle of rt_caustic_map.vs brings to the floor, relative to a
+// flat surface: the light it would have spread over its flat footprint is concentrated
+// in (or spread out over) its refracted one. Triangles add up where the surface folds
+// the light onto the same spot.
+
+in vec2 FloorPos;
+in vec2 FlatFloorPos;
+
+layout(location = 0) out vec4 FragColor;
+
+uniform float uMaxIntensity = 8.0;  // Nearly degenerate triangles would focus without bound
+
+float footprint(vec2 p) {
+    vec2 dx = dFdx(p);
+    vec2 dy = dFdy(p);
+    return abs(dx.x * dy.y - dx.y * dy.x);
+}
+
+void main() {
+    float intensity = footprint(FlatFloorPos) / max(footprint(FloorPos), 1e-12);
+    FragColor = vec4(min(intensity, uMaxIntensity), 0.0, 0.0, 1.0);
+}
@@ -0,0 +1,91 @@
+#version 460 core
+
+// Photon splatting of the water surface into the floor-space caustic map. Every vertex of
+// the water grid refracts the light once at its displaced surface and once at the flat
+// rest surface; both rays are carried down to the floor. The triangles land where the
+// refracted light does, and rt_caustic_map.fs compares their area with the flat one.
+// RasterCaustics draws a flat grid of its own through it, lifted by the height textures.
+
+layout(location = 0) in vec3 aPos;
+layout(location = 1) in vec3 aNormal;
+
+out vec2 FloorPos;      // Where the refracted light reaches the floor
+out vec2 FlatFloorPos;  // Where it would through a flat surface
+
+uniform vec3 uLightDir;
+uniform float uWaterIOR = 1.33;
+uniform float uWaterLevel = 0.0;
+uniform float uFloorLevel;
+uniform float uMapExtent;   // World size of the square floor area the map covers
+
+// Same vertex inputs as gbuffer.vs
+uniform bool uOceanWaves;
+uniform sampler2D uOceanDisplacement;
+uniform sampler2D uOceanNormalFoam;
+uniform float uOceanPatchSize;
+uniform bool uPackedVertices;
+uniform float uSurfaceSize;
+
+// Displacement the water grid does not carry (RayTracingManager::bindSurfaceHeights): the
+// frame's wave state (WaveState: height and horizontal displacement, and normal), when the
+// grid is flat for GPU waves, and the wave-equation heightfield; both span the surface,
+// centred on the origin. The normal tilts by their slopes
+uniform bool uWaveHeights;
+uniform sampler2D uWaveHeightMap;
+uniform sampler2D uWaveNormalMap;
+uniform float uWaveHeightMapSize;
+uniform bool uHeightfieldWaves;
+uniform sampler2D uHeightfield;
+
+float heightfieldHeight(vec2 xz) {
+    return textureLod(uHeightfield, xz / uSurfaceSize + 0.5, 0.0).r;
+}
+
+void addSurfaceHeight(vec2 xz, inout vec3 pos, inout vec3 normal) {
+    if (!uWaveHeights && !uHeightfieldWaves) return;
+    vec2 slope = vec2(0.0);
+    if (uWaveHeights) {
+        vec2 uv = xz / uWaveHeightMapSize + 0.5;
+        vec3 displacement = textureLod(uWaveHeightMap, uv, 0.0).rgb;
+        pos += vec3(displacement.g, displacement.r, displacement.b);
+        vec3 waveNormal = textureLod(uWaveNormalMap, uv, 0.0).xyz;
+        slope -= waveNormal.xz / max(waveNormal.y, 1e-3);
+    }
+    if (uHeightfieldWaves) {
+        float step = uSurfaceSize / 256.0;
+        slope += vec2(heightfieldHeight(xz + vec2(step, 0.0)) - heightfieldHeight(xz - vec2(step, 0.0)),
+                      heightfieldHeight(xz + vec2(0.0, step)) - heightfieldHeight(xz - vec2(0.0, step))) / (2.0 * step);
+        pos.y += heightfieldHeight(xz);
+    }
+    normal = normalize(normal / max(normal.y, 1e-3) - vec3(slope.x, 0.0, slope.y));
+}
+
+vec3 octahedralDecode(vec2 e) {
+    vec3 n = vec3(e.x, 1.0 - abs(e.x) - abs(e.y), e.y);
+    if (n.y < 0.0) {
+        n.xz = (1.0 - abs(n.zx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.z >= 0.0 ? 1.0 : -1.0);
+    }
+    return normalize(n);
+}
+
+// Floor point of a refracted ray leaving the surface at pos
+vec2 floorHit(vec3 pos, vec3 direction) {
+    return pos.xz + direction.xz * ((uFloorLevel - pos.y) / min(direction.y, -1e-4));
+}
+
+void main() {
+    vec3 pos = aPos;
+    vec3 normal = uPackedVertices ? octahedralDecode(aNormal.xy) : normalize(aNormal);
+    if (uOceanWaves) {
+        vec2 oceanUV = aPos.xz / uOceanPatchSize;
+        pos += textureLod(uOceanDisplacement, oceanUV, 0.0).xyz;
+        normal = normalize(textureLod(uOceanNormalFoam, oceanUV, 0.0).xyz);
+    }
+    addSurfaceHeight(aPos.xz, pos, normal);
+    
+    float eta = 1.0 / uWaterIOR;
+    FloorPos = floorHit(pos, refract(uLightDir, normal, eta));
+    FlatFloorPos = floorHit(vec3(aPos.x, uWaterLevel, aPos.z), refract(uLightDir, vec3(0.0, 1.0, 0.0), eta));
+    
+    gl_Position = vec4(FloorPos / uMapExtent * 2.0, 0.0, 1.0);
+}
@@ -1,13 +1,26 @@
 #version 460 core
 
 // Real-time ray traced caustics generation
+// With uCausticMap set, no rays are traced here: the view ray is refracted at the water's
+// G-buffer texel down to the floor and looks up the floor-space map of rt_caustic_map.*,
+// which RayTracingManager refreshes every few frames
 
-layout(local_size_x = 16, local_size_y = 16) in;
+// Autotuned per GPU by RayTracingManager
+#ifndef RT_LOCAL_SIZE_X
+#define RT_LOCAL_SIZE_X 16
+#endif
+#ifndef RT_LOCAL_SIZE_Y
+#define RT_LOCAL_SIZE_Y 16
+#endif
+layout(local_size_x = RT_LOCAL_SIZE_X, local_size_y = RT_LOCAL_SIZE_Y) in;
 
-// Input textures
+// Input textures; the water's are the frame's wave state (WaveState) when uWaveState is set
 layout(binding = 0) uniform sampler2D uWaterHeightMap;
 layout(binding = 1) uniform sampler2D uWaterNormalMap;
 layout(binding = 2) uniform sampler2D uDepthTexture;
+layout(binding = 3) uniform sampler2D uPositionTexture;
+layout(binding = 4) uniform sampler2D uNormalTexture;
+layout(binding = 5) uniform sampler2D uCausticMapTexture;   // Floor irradiance, 1 under flat water
 
 // Output texture
 layout(rgba16f, binding = 2) uniform image2D uCausticTexture;
@@ -26,6 +39,19 @@ uniform int uCausticRays = 64;
 uniform float uCausticRadius = 2.0;
 uniform float uFloorDepth = -5.0;
 
+// The surface the caustic rays refract at: the wave state over the uWaveStateSize square it
+// spans, flat beyond it; procedural noise without it
+uniform bool uWaveState = false;
+uniform float uWaveStateSize = 10.0;
+
+// Rotates the ray offsets every frame when the temporal pass accumulates them (0 keeps them fixed)
+uniform int uFrameIndex = 0;
+
+// Floor-space caustic map lookup
+uniform bool uCausticMap = false;
+uniform vec3 uCameraPos;
+uniform float uMapExtent;   // World size of the floor area the map covers, centred on the origin
+
 // Random number generation
 float random(vec2 st) {
     return fract(sin(dot(st.xy, vec2(12.9898, 78.233))) * 43758.5453123);
@@ -54,6 +80,14 @@ float noise(vec2 st) {
 
 // Generate water surface normal with multiple octaves
 vec3 getWaterNormal(vec2 worldPos, float time) {
+    if (uWaveState) {
+        vec2 uv = worldPos / uWaveStateSize + 0.5;
+        if (any(lessThan(uv, vec2(0.0))) || any(greaterThan(uv, vec2(1.0)))) {
+            return vec3(0.0, 1.0, 0.0);
+        }
+        return normalize(textureLod(uWaterNormalMap, uv, 0.0).xyz);
+    }
+    
     vec2 p = worldPos * 0.1;
     
     // Multiple octaves for realistic water surface
@@ -102,23 +136,53 @@ vec3 traceCausticRay(vec2 lightSurfacePos) {
     }
     
     // Trace to floor
-    float t = (uFloorDepth - uWaterLevel) / refractedRay.y;
+    float surfaceLevel = uWaterLevel;
+    vec2 waveUV = lightSurfacePos / uWaveStateSize + 0.5;
+    if (uWaveState && all(greaterThanEqual(waveUV, vec2(0.0))) && all(lessThanEqual(waveUV, vec2(1.0)))) {
+        surfaceLevel += textureLod(uWaterHeightMap, waveUV, 0.0).r;
+    }
+    float t = (uFloorDepth - surfaceLevel) / refractedRay.y;
     if (t > 0.0) {
-        vec3 floorHitPos = vec3(lightSurfacePos.x, uWaterLevel, lightSurfacePos.y) + refractedRay * t;
+        vec3 floorHitPos = vec3(lightSurfacePos.x, surfaceLevel, lightSurfacePos.y) + refractedRay * t;
         return floorHitPos;
     }
     
     return vec3(0.0);
 }
 
+// Caustic seen through the water at a G-buffer texel, from the floor-space map
+vec4 causticMapLookup(ivec2 coord) {
+    if (texelFetch(uDepthTexture, coord, 0).r >= 1.0) {
+        return vec4(0.0);
+    }
+    vec3 surfacePos = gbufferPosition(coord);
+    vec3 viewRay = refract(normalize(surfacePos - uCameraPos), normalize(gbufferNormal(coord)), 1.0 / uWaterIOR);
+    if (viewRay.y >= -1e-4) {
+        return vec4(0.0); // Total internal reflection or grazing: the floor is not seen
+    }
+    vec2 floorPos = surfacePos.xz + viewRay.xz * ((uFloorDepth - surfacePos.y) / viewRay.y);
+    
+    // Only the light focused beyond a flat surface's shows up as caustics
+    vec2 mapUV = floorPos / uMapExtent + 0.5;
+    float irradiance = all(greaterThanEqual(mapUV, vec2(0.0))) && all(lessThanEqual(mapUV, vec2(1.0)))
+        ? texture(uCausticMapTexture, mapUV).r : 0.0;
+    float causticIntensity = clamp((irradiance - 1.0) * uCausticStrength, 0.0, 2.0);
+    return vec4(vec3(0.8, 0.9, 1.0) * causticIntensity, causticIntensity);
+}
+
 void main() {
-    ivec2 coord = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 coord = interleaveTexel(ivec2(gl_GlobalInvocationID.xy));  // This frame's texels (rt_interleave.glsl)
     
     // Check bounds
     if (coord.x >= int(uResolution.x) || coord.y >= int(uResolution.y)) {
         return;
     }
     
+    if (uCausticMap) {
+        imageStore(uCausticTexture, coord, causticMapLookup(coord));
+        return;
+    }
+    
     vec2 uv = (vec2(coord) + 0.5) / uResolution;
     
     // Convert screen coordinate to world space floor position
@@ -131,7 +195,7 @@ void main() {
     for (int i = 0; i < uCausticRays; i++) {
         // Generate sample positions around the floor position
         float angle = float(i) * 6.28318 / float(uCausticRays);
-        vec2 offset = vec2(cos(angle), sin(angle)) * uCausticRadius * random(uv + float(i));
+        vec2 offset = vec2(cos(angle), sin(angle)) * uCausticRadius * random(uv + float(i) + float(uFrameIndex) * 0.618);
         vec2 lightSurfacePos = floorPos + offset;
         
         // Trace caustic ray
@@ -0,0 +1,47 @@
+// Coarse shading of the traced composite (ShadingRateImage), ahead of rt_composite.cs and
+// rt_fused.cs after their local size. The workgroup looks its tile's rate up once; in a coarse
+// tile one invocation per block shades, at the block's middle texel, and writes the whole
+// block. The shading invocations are the workgroup's first, so the subgroups past them retire
+// at once rather than idle beside them.
+
+layout(binding = 7) uniform usampler2D uShadingRateTexture;
+uniform bool uCoarseShading = false;
+uniform vec2 uCoarseScale = vec2(1.0);     // Traced texels per window pixel
+uniform int uShadingRateTile = 16;         // Window pixels per rate texel
+
+// The workgroup's block in traced texels: the rate's pixels, down to a power of two of texels
+ivec2 coarseBlockSize()
+{
+  if (!uCoarseShading) return ivec2(1);
+
+  const ivec2 localSize = ivec2(RT_LOCAL_SIZE_X, RT_LOCAL_SIZE_Y);
+  vec2 groupCenter = vec2(ivec2(gl_WorkGroupID.xy) * localSize) + vec2(localSize) * 0.5;
+  ivec2 rateTexel = ivec2(groupCenter / uCoarseScale) / uShadingRateTile;
+  uint rate = texelFetch(uShadingRateTexture, min(rateTexel, textureSize(uShadingRateTexture, 0) - 1), 0).r;
+
+  // ShadingRateImage::Rate
+  ivec2 pixels = rate == 1u ? ivec2(2, 1) : rate == 2u ? ivec2(1, 2) :
+                 rate == 3u ? ivec2(2) : rate == 4u ? ivec2(4) : ivec2(1);
+  ivec2 texels = max(ivec2(vec2(pixels) * uCoarseScale), ivec2(1));
+  return ivec2(1) << findMSB(texels);
+}
+
+// The block this invocation shades, by its first texel; false for the invocations left idle
+bool coarseShadingBlock(ivec2 resolution, out ivec2 origin, out ivec2 block)
+{
+  const ivec2 localSize = ivec2(RT_LOCAL_SIZE_X, RT_LOCAL_SIZE_Y);
+  block = coarseBlockSize();
+  ivec2 blocks = localSize / block;
+  int index = int(gl_LocalInvocationIndex);
+  origin = ivec2(0);
+  if (index >= blocks.x * blocks.y) return false;
+
+  origin = ivec2(gl_WorkGroupID.xy) * localSize + ivec2(index % blocks.x, index / blocks.x) * block;
+  return all(lessThan(origin, resolution));
+}
+
+// The texel a block is shaded at
+ivec2 coarseShadingTexel(ivec2 origin, ivec2 block, ivec2 resolution)
+{
+  return min(origin + block / 2, resolution - 1);
+}
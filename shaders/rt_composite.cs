@@ -3,7 +3,14 @@
 // Real-time ray tracing compositing shader
 // Combines reflections, refractions, and caustics
 
-layout(local_size_x = 16, local_size_y = 16) in;
+// Autotuned per GPU by RayTracingManager
+#ifndef RT_LOCAL_SIZE_X
+#define RT_LOCAL_SIZE_X 16
+#endif
+#ifndef RT_LOCAL_SIZE_Y
+#define RT_LOCAL_SIZE_Y 16
+#endif
+layout(local_size_x = RT_LOCAL_SIZE_X, local_size_y = RT_LOCAL_SIZE_Y) in;
 
 // Input textures
 layout(binding = 0) uniform sampler2D uBaseColorTexture;   // Original rendered scene
@@ -79,23 +86,18 @@ vec3 temporalBlend(vec3 currentColor, vec3 previousColor, float alpha) {
     return mix(previousColor, currentColor, alpha);
 }
 
-void main() {
-    ivec2 coord = ivec2(gl_GlobalInvocationID.xy);
-    
-    // Check bounds
-    if (coord.x >= int(uResolution.x) || coord.y >= int(uResolution.y)) {
-        return;
-    }
-    
+// The composited texel, alpha for blending with the normal scene
+vec4 compositeTexel(ivec2 coord) {
     vec2 uv = (vec2(coord) + 0.5) / uResolution;
     
     // Sample input textures
     vec3 baseColor = texture(uBaseColorTexture, uv).rgb;
-    vec3 reflectionColor = texture(uReflectionTexture, uv).rgb;
-    vec3 refractionColor = texture(uRefractionTexture, uv).rgb;
-    vec3 causticColor = texture(uCausticTexture, uv).rgb;
-    float depth = texture(uDepthTexture, uv).r;
-    vec3 normal = texture(uNormalTexture, uv).xyz;
+    // Ray traced buffers are fetched: the traced area may be a corner of larger textures
+    vec3 reflectionColor = texelFetch(uReflectionTexture, coord, 0).rgb;
+    vec3 refractionColor = texelFetch(uRefractionTexture, coord, 0).rgb;
+    vec3 causticColor = texelFetch(uCausticTexture, coord, 0).rgb;
+    float depth = texelFetch(uDepthTexture, coord, 0).r;
+    vec3 normal = gbufferNormal(coord);
     
     // Initialize final color with base, fallback to water color if no base texture
     // For water surfaces, always start with a visible water color
@@ -103,8 +105,7 @@ void main() {
     
     // Skip ray tracing for background pixels (make transparent)
     if (depth >= 1.0) {
-        imageStore(uFinalTexture, coord, vec4(0.0, 0.0, 0.0, 0.0));
-        return;
+        return vec4(0.0, 0.0, 0.0, 0.0);
     }
     
     // For water surface pixels, ensure we have a visible base
@@ -153,7 +154,24 @@ void main() {
     // Clamp to valid range
     finalColor = clamp(finalColor, 0.0, 1.0);
     
-    // Store final result with appropriate alpha for blending
+    // Final result with appropriate alpha for blending
     float alpha = 0.7; // Semi-transparent for blending with normal scene
-    imageStore(uFinalTexture, coord, vec4(finalColor, alpha));
+    return vec4(finalColor, alpha);
+}
+
+void main() {
+    // One invocation per block of a coarse tile (rt_coarse_shading.glsl), else per texel
+    ivec2 resolution = ivec2(uResolution);
+    ivec2 origin, block;
+    if (!coarseShadingBlock(resolution, origin, block)) {
+        return;
+    }
+    
+    vec4 result = compositeTexel(coarseShadingTexel(origin, block, resolution));
+    for (int y = 0; y < block.y; y++) {
+        for (int x = 0; x < block.x; x++) {
+            ivec2 texel = origin + ivec2(x, y);
+            if (all(lessThan(texel, resolution))) imageStore(uFinalTexture, texel, result);
+        }
+    }
 }
\ No newline at end of file
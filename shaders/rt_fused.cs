@@ -0,0 +1,262 @@
+#version 460 core
+
+// Fused ray traced water: the reflection (rt_reflection.cs), refraction (rt_refraction.cs)
+// and compositing (rt_composite.cs) kernels in one dispatch. Each invocation fetches its
+// G-buffer texel once and keeps both traced colours in registers, so the two RGBA16F
+// intermediates are never written or read back. Caustics come in from their own pass,
+// which RayTracingManager runs at a lower rate. The math follows the three kernels; the
+// unbound scene colour input of rt_composite.cs is left out.
+
+// Autotuned per GPU by RayTracingManager
+#ifndef RT_LOCAL_SIZE_X
+#define RT_LOCAL_SIZE_X 16
+#endif
+#ifndef RT_LOCAL_SIZE_Y
+#define RT_LOCAL_SIZE_Y 16
+#endif
+layout(local_size_x = RT_LOCAL_SIZE_X, local_size_y = RT_LOCAL_SIZE_Y) in;
+
+// Input textures (uHiZTexture is on binding 4, see rt_hiz_trace.glsl; scene proxies in
+// rt_world_trace.glsl)
+layout(binding = 0) uniform sampler2D uPositionTexture;
+layout(binding = 1) uniform sampler2D uNormalTexture;
+layout(binding = 2) uniform sampler2D uDepthTexture;
+layout(binding = 3) uniform samplerCube uEnvironmentMap;
+layout(binding = 5) uniform sampler2D uUnderwaterTexture; // Pre-rendered underwater scene
+layout(binding = 6) uniform sampler2D uCausticTexture;    // Latest caustics, possibly a few frames old
+
+// Output texture
+layout(rgba8, binding = 0) uniform image2D uFinalTexture;
+
+// Uniforms
+uniform vec3 uCameraPos;
+uniform vec3 uLightPos;
+uniform vec2 uResolution;
+uniform mat4 uViewMatrix;
+uniform mat4 uProjectionMatrix;
+uniform mat4 uInverseViewMatrix;
+uniform mat4 uInverseProjectionMatrix;
+
+// Ray tracing quality settings (uMaxRaySteps counts pyramid cells, see rt_hiz_trace.glsl)
+uniform int uMaxRaySteps = 64;
+uniform float uMaxRayDistance = 10.0;
+uniform float uWaterDepth = 5.0;
+uniform float uWaterAbsorption = 0.1;
+uniform int uFrameIndex = 0;
+
+// Compositing
+uniform float uReflectionStrength = 1.0;
+uniform float uRefractionStrength = 1.0;
+uniform float uCausticStrength = 1.0;
+uniform bool uEnableReflections = true;
+uniform bool uEnableRefractions = true;
+uniform bool uEnableCaustics = true;
+
+// Water properties
+uniform float uWaterIOR = 1.33;
+uniform float uWaterRoughness = 0.02;
+uniform vec3 uWaterColor = vec3(0.1, 0.4, 0.7);
+uniform vec3 uRefractionWaterColor = vec3(0.1, 0.3, 0.6);  // rt_refraction.cs's uWaterColor
+
+// Post-processing
+uniform float uExposure = 1.0;
+uniform float uGamma = 2.2;
+uniform bool uEnableToneMapping = true;
+
+// Fresnel reflection calculation
+float fresnel(vec3 viewDir, vec3 normal, float ior) {
+    float cosTheta = max(dot(viewDir, normal), 0.0);
+    float eta = 1.0 / ior;
+    float k = 1.0 - eta * eta * (1.0 - cosTheta * cosTheta);
+
+    if (k < 0.0) return 1.0; // Total internal reflection
+
+    float cosTheta2 = sqrt(k);
+    float rs = (eta * cosTheta - cosTheta2) / (eta * cosTheta + cosTheta2);
+    float rp = (cosTheta - eta * cosTheta2) / (cosTheta + eta * cosTheta2);
+
+    return 0.5 * (rs * rs + rp * rp);
+}
+
+// Snell's law refraction
+vec3 refract2(vec3 incident, vec3 normal, float eta) {
+    float cosI = -dot(normal, incident);
+    float sinT2 = eta * eta * (1.0 - cosI * cosI);
+
+    if (sinT2 > 1.0) {
+        return vec3(0.0); // Total internal reflection
+    }
+
+    float cosT = sqrt(1.0 - sinT2);
+    return eta * incident + (eta * cosI - cosT) * normal;
+}
+
+// Screen space reflection, traced hierarchically through the min-max depth pyramid
+vec3 screenSpaceReflection(vec3 worldPos, vec3 normal, vec3 viewDir, vec2 depthParams) {
+    vec3 reflectionDir = reflect(-viewDir, normal);
+
+    vec3 rayOrigin, rayDelta;
+    vec2 clipW;
+    float rayDistance;
+    hizScreenRay(worldPos, reflectionDir, uMaxRayDistance, uProjectionMatrix * uViewMatrix,
+                 rayOrigin, rayDelta, clipW, rayDistance);
+
+    float tHit;
+    if (hizTrace(rayOrigin, rayDelta, HIZ_BEHIND, depthParams, uMaxRaySteps, tHit)) {
+        ivec2 hitTexel = ivec2((rayOrigin.xy + rayDelta.xy * tHit) * uResolution);
+        vec3 hitPos = gbufferPosition(hitTexel);
+        vec3 hitNormal = gbufferNormal(hitTexel);
+        float NdotL = max(dot(hitNormal, normalize(uLightPos - hitPos)), 0.0);
+        return vec3(0.2, 0.5, 0.8) * NdotL + vec3(0.1); // Water-like color
+    }
+
+    // No hit - the scene proxies (rt_world_trace.glsl), then the environment map (the
+    // G-buffer, and so the ray, is in world space)
+    vec3 proxyColor;
+    if (worldTrace(worldPos, reflectionDir, uLightPos, proxyColor)) {
+        return proxyColor;
+    }
+    return textureLod(uEnvironmentMap, reflectionDir, 0.0).rgb;
+}
+
+// Screen space refraction, traced hierarchically through the min-max depth pyramid
+vec3 screenSpaceRefraction(vec3 worldPos, vec3 normal, vec3 viewDir, vec2 depthParams) {
+    vec3 refractionDir = refract2(viewDir, normal, 1.0 / uWaterIOR);
+    if (length(refractionDir) < 0.001) {
+        return uRefractionWaterColor;
+    }
+
+    vec3 rayOrigin, rayDelta;
+    vec2 clipW;
+    float rayDistance;
+    hizScreenRay(worldPos, refractionDir, uWaterDepth, uProjectionMatrix * uViewMatrix,
+                 rayOrigin, rayDelta, clipW, rayDistance);
+
+    float t;
+    hizTrace(rayOrigin, rayDelta, HIZ_INFRONT, depthParams, uMaxRaySteps, t);
+
+    vec2 samplePos = rayOrigin.xy + rayDelta.xy * t;
+    if (samplePos.x < 0.0 || samplePos.x > 1.0 ||
+        samplePos.y < 0.0 || samplePos.y > 1.0) {
+        return uRefractionWaterColor;
+    }
+
+    vec3 underwaterColor = texture(uUnderwaterTexture, samplePos).rgb;
+    float travelDistance = hizWorldFraction(t, clipW) * rayDistance;
+    float absorption = exp(-uWaterAbsorption * travelDistance);
+    return mix(uRefractionWaterColor, underwaterColor, absorption);
+}
+
+// Caustic pattern generation (simplified)
+float causticPattern(vec2 uv, float time) {
+    vec2 p = uv * 8.0;
+
+    float caustic = 0.0;
+    caustic += sin(p.x * 2.0 + time * 2.0) * sin(p.y * 1.5 + time * 1.5) * 0.5;
+    caustic += sin(p.x * 3.0 - time * 3.0) * sin(p.y * 2.5 - time * 2.0) * 0.3;
+    caustic += sin(p.x * 5.0 + time * 4.0) * sin(p.y * 4.0 + time * 3.0) * 0.2;
+
+    return max(0.0, caustic) * 0.5 + 0.5;
+}
+
+// Tone mapping
+vec3 toneMap(vec3 color) {
+    if (!uEnableToneMapping) return color;
+
+    color *= uExposure;
+
+    // ACES tone mapping
+    const float a = 2.51;
+    const float b = 0.03;
+    const float c = 2.43;
+    const float d = 0.59;
+    const float e = 0.14;
+    color = (color * (a * color + b)) / (color * (c * color + d) + e);
+
+    return pow(color, vec3(1.0 / uGamma));
+}
+
+// The traced and composited texel
+vec4 fusedTexel(ivec2 coord) {
+    vec2 uv = (vec2(coord) + 0.5) / uResolution;
+
+    // One G-buffer fetch for all three stages
+    vec3 worldPos = gbufferPosition(coord);
+    vec3 normal = gbufferNormal(coord);
+    float depth = texelFetch(uDepthTexture, coord, 0).r;
+
+    // Background pixels stay transparent
+    if (depth >= 1.0) {
+        return vec4(0.0);
+    }
+
+    vec2 depthParams = vec2(uProjectionMatrix[3][2], uProjectionMatrix[2][2]);
+    vec3 toCamera = normalize(uCameraPos - worldPos);
+
+    // Reflection, weighted by Fresnel as rt_reflection.cs stores it
+    vec3 reflectionColor = vec3(0.0);
+    if (uEnableReflections) {
+        reflectionColor = screenSpaceReflection(worldPos, normal, toCamera, depthParams);
+        float spread;
+        int extraSamples = adaptiveExtraSamples(coord, ivec2(uResolution), uWaterRoughness, spread);
+        for (int i = 0; i < extraSamples; i++) {
+            vec3 sampleNormal = adaptiveSampleNormal(normal, spread, blueNoise2(coord, i + 1, uFrameIndex));
+            reflectionColor += screenSpaceReflection(worldPos, sampleNormal, toCamera, depthParams);
+        }
+        reflectionColor /= float(extraSamples + 1);
+        reflectionColor *= fresnel(toCamera, normal, uWaterIOR);
+        float noise = blueNoise(coord, 0, uFrameIndex);
+        reflectionColor += (noise - 0.5) * 0.02; // Subtle noise
+    }
+
+    // Refraction with rt_refraction.cs's animated caustic tint
+    vec3 refractionColor = vec3(0.0);
+    if (uEnableRefractions) {
+        refractionColor = screenSpaceRefraction(worldPos, normal, -toCamera, depthParams);
+        float time = coord.x * 0.01 + coord.y * 0.01; // Pseudo time
+        float caustics = causticPattern(uv, time);
+        refractionColor += vec3(caustics * 0.2, caustics * 0.3, caustics * 0.1);
+    }
+
+    vec3 causticColor = uEnableCaustics ? texelFetch(uCausticTexture, coord, 0).rgb : vec3(0.0);
+
+    // Composite as rt_composite.cs does
+    vec3 finalColor = uWaterColor * 0.6;
+    vec3 viewDir = normalize(uCameraPos - vec3(uv * 2.0 - 1.0, depth)); // Simplified
+    float fresnelFactor = fresnel(viewDir, normal, uWaterIOR);
+
+    if (uEnableReflections && length(reflectionColor) > 0.001) {
+        finalColor = mix(finalColor, reflectionColor, fresnelFactor * uReflectionStrength);
+    }
+    if (uEnableRefractions && length(refractionColor) > 0.001) {
+        finalColor = mix(finalColor, refractionColor, (1.0 - fresnelFactor) * uRefractionStrength);
+    }
+    if (uEnableCaustics && length(causticColor) > 0.001) {
+        finalColor += causticColor * uCausticStrength;
+    }
+
+    // Water color tinting for underwater areas
+    float waterDepthFactor = clamp(depth * 10.0, 0.0, 1.0);
+    finalColor = mix(finalColor, finalColor * uWaterColor, waterDepthFactor * 0.3);
+    finalColor = mix(finalColor, finalColor * vec3(0.9, 1.0, 1.1), 0.1); // Slight blue tint
+
+    finalColor = clamp(toneMap(finalColor), 0.0, 1.0);
+    return vec4(finalColor, 0.7);
+}
+
+void main() {
+    // One trace per block of a coarse tile (rt_coarse_shading.glsl), else per texel
+    ivec2 resolution = ivec2(uResolution);
+    ivec2 origin, block;
+    if (!coarseShadingBlock(resolution, origin, block)) {
+        return;
+    }
+
+    vec4 result = fusedTexel(coarseShadingTexel(origin, block, resolution));
+    for (int y = 0; y < block.y; y++) {
+        for (int x = 0; x < block.x; x++) {
+            ivec2 texel = origin + ivec2(x, y);
+            if (all(lessThan(texel, resolution))) imageStore(uFinalTexture, texel, result);
+        }
+    }
+}
@@ -0,0 +1,31 @@
+// G-buffer reads shared by the ray tracing kernels (RayTracingManager inserts this file
+// after their #version). gbufferPosition and gbufferNormal are macros, so they resolve the
+// kernel's own uPositionTexture, uNormalTexture, uDepthTexture and uResolution, declared
+// after this point. With RT_COMPACT_GBUFFER there is no position target: the world position
+// is rebuilt from depth through uInverseViewProjection, and the normal is octahedral in two
+// channels (gbuffer.fs encodes it).
+
+uniform mat4 uInverseViewProjection;
+
+// World position of a traced texel's window depth
+vec3 gbufferWorldPosition(ivec2 texel, float depth, vec2 resolution) {
+    vec4 ndc = vec4((vec2(texel) + 0.5) / resolution * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+    vec4 world = uInverseViewProjection * ndc;
+    return world.xyz / world.w;
+}
+
+// Unit normal from its octahedral encoding
+vec3 gbufferDecodeOctahedral(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+
+#ifdef RT_COMPACT_GBUFFER
+#define gbufferPosition(texel) gbufferWorldPosition(texel, texelFetch(uDepthTexture, texel, 0).r, uResolution)
+#define gbufferNormal(texel) gbufferDecodeOctahedral(texelFetch(uNormalTexture, texel, 0).rg)
+#else
+#define gbufferPosition(texel) texelFetch(uPositionTexture, texel, 0).xyz
+#define gbufferNormal(texel) texelFetch(uNormalTexture, texel, 0).xyz
+#endif
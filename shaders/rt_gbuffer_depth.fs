@@ -0,0 +1,77 @@
+#version 460 core
+
+// Fills the ray tracing G-buffer from a screen-space fluid depth target of the traced camera
+// (SPHComputeSystem's smoothed depth) instead of rasterizing the surface again. The depth
+// goes to the depth attachment and the world position is rebuilt from it; the normal comes
+// from the neighbouring depths, each axis taken on the side closer in depth so silhouettes
+// do not bend it
+
+in vec2 vTexCoord;
+
+layout(location = 0) out vec4 gPosition;
+layout(location = 1) out vec4 gNormal;
+
+uniform sampler2D uFluidDepth;  // Window depth, 0 or 1 off the fluid as in sph_final.fs
+uniform mat4 uInverseViewProjection;
+uniform vec3 uCameraPos;
+uniform bool uCompactGBuffer;   // No position target; normal octahedral in the first two channels
+
+// Octahedral encoding of a unit normal as gbuffer.fs writes it
+vec2 octahedralEncode(vec3 n) {
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    vec2 e = n.xy;
+    if (n.z < 0.0) {
+        e = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return e;
+}
+
+bool isFluid(float depth) {
+    return depth > 0.001 && depth < 0.999;
+}
+
+vec3 worldPosition(ivec2 texel, float depth, ivec2 size) {
+    vec4 ndc = vec4((vec2(texel) + 0.5) / vec2(size) * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+    vec4 world = uInverseViewProjection * ndc;
+    return world.xyz / world.w;
+}
+
+// Step along one screen axis to the neighbour on the fluid closer in depth (zero if none)
+vec3 surfaceTangent(ivec2 texel, ivec2 axis, vec3 center, float depth, ivec2 size) {
+    ivec2 forward = clamp(texel + axis, ivec2(0), size - 1);
+    ivec2 backward = clamp(texel - axis, ivec2(0), size - 1);
+    float forwardDepth = texelFetch(uFluidDepth, forward, 0).r;
+    float backwardDepth = texelFetch(uFluidDepth, backward, 0).r;
+    
+    bool useForward = isFluid(forwardDepth) &&
+        (!isFluid(backwardDepth) || abs(forwardDepth - depth) <= abs(backwardDepth - depth));
+    if (useForward) {
+        return worldPosition(forward, forwardDepth, size) - center;
+    }
+    if (isFluid(backwardDepth)) {
+        return center - worldPosition(backward, backwardDepth, size);
+    }
+    return vec3(0.0);
+}
+
+void main() {
+    ivec2 size = textureSize(uFluidDepth, 0);
+    ivec2 texel = clamp(ivec2(vTexCoord * vec2(size)), ivec2(0), size - 1);
+    float depth = texelFetch(uFluidDepth, texel, 0).r;
+    if (!isFluid(depth)) {
+        discard;
+    }
+    
+    vec3 center = worldPosition(texel, depth, size);
+    vec3 toCamera = normalize(uCameraPos - center);
+    vec3 normal = cross(surfaceTangent(texel, ivec2(1, 0), center, depth, size),
+                        surfaceTangent(texel, ivec2(0, 1), center, depth, size));
+    normal = length(normal) > 1e-10 ? normalize(normal) : toCamera;
+    if (dot(normal, toCamera) < 0.0) {
+        normal = -normal;
+    }
+    
+    gl_FragDepth = depth;
+    gPosition = vec4(center, 1.0);
+    gNormal = uCompactGBuffer ? vec4(octahedralEncode(normal), 0.0, 0.0) : vec4(normal, 0.5);
+}
@@ -0,0 +1,32 @@
+#version 460 core
+
+// G-buffer vertex shader for a fluid mesh extracted on the GPU (SPHComputeSystem's marching
+// cubes, laid out as sph_surface.vs reads it), drawn indirectly into gbuffer.fs
+
+struct SurfaceVertex {
+    vec4 position;
+    vec4 normal;
+};
+
+layout(binding = 30, std430) restrict readonly buffer surfaceMeshBuf {
+    uint meshDraw[4];
+    SurfaceVertex vertices[];
+};
+
+out vec3 FragPos;
+out vec3 Normal;
+out vec2 TexCoord;
+out vec2 OceanUV;
+
+uniform mat4 uView;
+uniform mat4 uProjection;
+
+void main() {
+    SurfaceVertex vertex = vertices[gl_VertexID];
+    FragPos = vertex.position.xyz;
+    Normal = vertex.normal.xyz;
+    TexCoord = vec2(0.0);
+    OceanUV = vec2(0.0);
+    
+    gl_Position = uProjection * uView * vec4(FragPos, 1.0);
+}
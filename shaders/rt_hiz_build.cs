@@ -0,0 +1,46 @@
+#version 460 core
+
+// Min-max depth pyramid over the ray tracing G-buffer for rt_hiz_trace.glsl: r is the
+// nearest and g the farthest window depth within each texel's footprint. Texels without
+// geometry hold the empty range (1, 0), so the reductions skip them. uLevel 0 copies the
+// depth buffer; every later level reduces the level below it, 2x2 texels, or 3 wide at
+// the last row or column of an odd-sized level so no texel is dropped. Only the traced
+// corner of each level is built (uLevelSize), the textures being allocated for the
+// largest resolution dynamic scaling may reach.
+
+layout(local_size_x = 8, local_size_y = 8) in;
+
+layout(binding = 0) uniform sampler2D uDepthTexture;
+layout(rg32f, binding = 0) uniform restrict readonly image2D uHiZPrevious;
+layout(rg32f, binding = 1) uniform restrict writeonly image2D uHiZLevel;
+
+uniform int uLevel;
+uniform vec2 uLevelSize;      // Texels of this level and the one below that are in use
+uniform vec2 uPreviousSize;
+
+void main() {
+    ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 size = ivec2(uLevelSize);
+    if (any(greaterThanEqual(texel, size))) {
+        return;
+    }
+
+    if (uLevel == 0) {
+        float depth = texelFetch(uDepthTexture, texel, 0).r;
+        imageStore(uHiZLevel, texel, depth < 1.0 ? vec4(depth, depth, 0.0, 0.0) : vec4(1.0, 0.0, 0.0, 0.0));
+        return;
+    }
+
+    ivec2 previousSize = ivec2(uPreviousSize);
+    ivec2 first = texel * 2;
+    ivec2 last = min(first + 1 + ivec2(equal(texel, size - 1)) * (previousSize & 1), previousSize - 1);
+
+    vec2 range = vec2(1.0, 0.0);
+    for (int y = first.y; y <= last.y; y++) {
+        for (int x = first.x; x <= last.x; x++) {
+            vec2 child = imageLoad(uHiZPrevious, ivec2(x, y)).rg;
+            range = vec2(min(range.x, child.x), max(range.y, child.y));
+        }
+    }
+    imageStore(uHiZLevel, texel, vec4(range, 0.0, 0.0));
+}
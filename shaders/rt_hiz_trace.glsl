@@ -0,0 +1,121 @@
+// Hierarchical screen-space tracing through the min-max depth pyramid of rt_hiz_build.cs,
+// shared by rt_reflection.cs and rt_refraction.cs (RayTracingManager inserts this file
+// after their #version). A ray is a line in (uv, window depth), where depth is affine in
+// screen space. It crosses one pyramid cell per iteration: a cell whose depth range the
+// ray misses over its extent is skipped whole and the next cell is taken a level
+// coarser, and a cell it may touch is refined a level finer, so open space costs a
+// handful of fetches and the hit is still found on the finest level.
+
+layout(binding = 4) uniform sampler2D uHiZTexture;
+uniform int uHiZLevels = 1;
+uniform vec2 uHiZSize;              // Traced texels of level 0; each level halves it, like rt_hiz_build.cs
+uniform float uHiZThickness = 0.5;  // View-space depth a surface is taken to extend behind itself
+
+#define HIZ_BEHIND 0   // Stop where the ray first passes behind the nearest surface (reflections)
+#define HIZ_INFRONT 1  // Stop where the ray first comes back in front of the farthest surface (refractions)
+
+// View-space distance of a window depth; depthParams is (projection[3][2], projection[2][2])
+// Cells of a pyramid level in use, its traced corner when the texture is larger
+vec2 hizLevelSize(int level) {
+    return vec2(max(ivec2(uHiZSize) >> level, ivec2(1)));
+}
+
+float hizViewDepth(float windowDepth, vec2 depthParams) {
+    return depthParams.x / (windowDepth * 2.0 - 1.0 + depthParams.y);
+}
+
+// Screen-space ray of maxDistance from a world point, its far end pulled in front of the
+// near plane: origin and delta in (uv, window depth), the clip w of both ends, and the
+// world length actually covered
+void hizScreenRay(vec3 worldPos, vec3 direction, float maxDistance, mat4 viewProjection,
+                  out vec3 origin, out vec3 delta, out vec2 clipW, out float rayDistance) {
+    const float nearW = 0.01;
+    vec4 startClip = viewProjection * vec4(worldPos, 1.0);
+    vec4 endClip = viewProjection * vec4(worldPos + direction * maxDistance, 1.0);
+    rayDistance = maxDistance;
+    if (endClip.w < nearW) {
+        float s = (startClip.w - nearW) / (startClip.w - endClip.w);
+        endClip = mix(startClip, endClip, s);
+        rayDistance *= s;
+    }
+
+    origin = startClip.xyz / startClip.w * 0.5 + 0.5;
+    delta = endClip.xyz / endClip.w * 0.5 + 0.5 - origin;
+    clipW = vec2(startClip.w, endClip.w);
+}
+
+// Fraction of the world ray covered at screen parameter t (1/w is affine in screen space)
+float hizWorldFraction(float t, vec2 clipW) {
+    return (t / clipW.y) / ((1.0 - t) / clipW.x + t / clipW.y);
+}
+
+// Traces origin + t * delta, t in [0, 1], for at most maxIterations cells. True with the
+// stopping parameter in tHit; false with the parameter reached when the ray leaves the
+// screen, ends or runs out of iterations
+bool hizTrace(vec3 origin, vec3 delta, int mode, vec2 depthParams, int maxIterations, out float tHit) {
+    vec2 finestSize = hizLevelSize(0);
+    float pixels = length(delta.xy * finestSize);
+    tHit = 0.0;
+    if (pixels < 1.0) {
+        return false;
+    }
+
+    // Start a texel and a half out so the ray leaves the surface it starts on; cell exits
+    // are nudged a twentieth of a texel so the next cell is the one beyond
+    float t = 1.5 / pixels;
+    float crossEpsilon = 0.05 / pixels;
+    int level = 0;
+
+    for (int i = 0; i < maxIterations && t <= 1.0; i++) {
+        vec3 p = origin + delta * t;
+        if (any(lessThan(p.xy, vec2(0.0))) || any(greaterThanEqual(p.xy, vec2(1.0)))) {
+            break;
+        }
+
+        // Parameter where the ray leaves this cell
+        vec2 cells = hizLevelSize(level);
+        vec2 cell = floor(p.xy * cells);
+        vec2 boundary = (cell + step(0.0, delta.xy)) / cells;
+        float tExitX = delta.x != 0.0 ? (boundary.x - origin.x) / delta.x : 1e30;
+        float tExitY = delta.y != 0.0 ? (boundary.y - origin.y) / delta.y : 1e30;
+        float tExit = min(min(tExitX, tExitY), 1.0);
+
+        vec2 range = texelFetch(uHiZTexture, ivec2(cell), level).rg;
+        float zExit = origin.z + delta.z * tExit;
+        bool touches = mode == HIZ_BEHIND ? max(p.z, zExit) >= range.x : min(p.z, zExit) <= range.y;
+
+        if (!touches) {
+            t = tExit + crossEpsilon;
+            level = min(level + 1, uHiZLevels - 1);
+            continue;
+        }
+        if (level > 0) {
+            level--;
+            continue;
+        }
+
+        // Finest level: where the ray crosses the surface depth inside this texel
+        float tSurface = t;
+        if (mode == HIZ_BEHIND && p.z < range.x && delta.z > 0.0) {
+            tSurface = (range.x - origin.z) / delta.z;
+        } else if (mode == HIZ_INFRONT && p.z > range.y && delta.z < 0.0) {
+            tSurface = (range.y - origin.z) / delta.z;
+        }
+        tSurface = clamp(tSurface, t, tExit);
+
+        // Passing far behind a surface is not a hit on it
+        if (mode == HIZ_BEHIND) {
+            float behind = hizViewDepth(origin.z + delta.z * tSurface, depthParams) - hizViewDepth(range.x, depthParams);
+            if (behind > uHiZThickness) {
+                t = tExit + crossEpsilon;
+                continue;
+            }
+        }
+
+        tHit = tSurface;
+        return true;
+    }
+
+    tHit = min(t, 1.0);
+    return false;
+}
@@ -0,0 +1,96 @@
+#version 460 core
+
+// Reconstruction of one interleaved signal (reflections, refractions or caustics) before
+// the denoiser. The texels this frame's pattern skipped (rt_interleave.glsl) are reprojected
+// into the signal's last complete frame through their G-buffer world position, taking only
+// the history texels whose clip w says they saw the same surface. The result is clamped to
+// the range of the traced neighbours, so a wave that moved does not keep its old reflection;
+// without a usable history the traced neighbours are averaged. Every texel's clip w goes out
+// for the next frame's test.
+
+layout(local_size_x = 8, local_size_y = 8) in;
+
+layout(binding = 0) uniform sampler2D uHistoryTexture;   // The signal's last complete frame
+layout(binding = 1) uniform sampler2D uHistoryClipW;     // Its uClipW, 0 for no water
+layout(binding = 2) uniform sampler2D uPositionTexture;
+layout(binding = 3) uniform sampler2D uDepthTexture;
+
+layout(rgba16f, binding = 0) uniform restrict image2D uSignal;   // Traced texels in, the rest out
+layout(r32f, binding = 1) uniform restrict writeonly image2D uClipW;
+
+uniform vec2 uResolution;
+uniform vec2 uPrevResolution;
+uniform mat4 uViewProjection;
+uniform mat4 uPrevViewProjection;
+uniform bool uHistoryValid = false;
+uniform float uDepthTolerance = 0.05;  // Relative clip w difference still taken as the same surface
+
+void main() {
+    ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 size = ivec2(uResolution);
+    if (any(greaterThanEqual(texel, size))) {
+        return;
+    }
+
+    bool water = texelFetch(uDepthTexture, texel, 0).r < 1.0;
+    vec3 worldPos = water ? gbufferPosition(texel) : vec3(0.0);
+    imageStore(uClipW, texel, vec4(water ? (uViewProjection * vec4(worldPos, 1.0)).w : 0.0));
+
+    // Traced texels are only read here, the others only written, so the image is shared
+    if (interleaveTraced(texel)) {
+        return;
+    }
+    if (!water) {
+        imageStore(uSignal, texel, vec4(0.0));
+        return;
+    }
+
+    // The traced water around: two to four texels under either pattern
+    vec4 lowest = vec4(1e20);
+    vec4 highest = vec4(-1e20);
+    vec4 sum = vec4(0.0);
+    float count = 0.0;
+    for (int y = -1; y <= 1; y++) {
+        for (int x = -1; x <= 1; x++) {
+            ivec2 q = texel + ivec2(x, y);
+            if (any(lessThan(q, ivec2(0))) || any(greaterThanEqual(q, size)) || !interleaveTraced(q)) continue;
+            if (texelFetch(uDepthTexture, q, 0).r >= 1.0) continue;
+            vec4 c = imageLoad(uSignal, q);
+            lowest = min(lowest, c);
+            highest = max(highest, c);
+            sum += c;
+            count += 1.0;
+        }
+    }
+
+    // Bilinear history at the reprojected point, from the taps on the same surface
+    vec4 history = vec4(0.0);
+    float weightSum = 0.0;
+    vec4 prevClip = uPrevViewProjection * vec4(worldPos, 1.0);
+    if (uHistoryValid && prevClip.w > 0.0) {
+        ivec2 prevSize = ivec2(uPrevResolution);
+        vec2 prevTexel = (prevClip.xy / prevClip.w * 0.5 + 0.5) * vec2(prevSize) - 0.5;
+        ivec2 base = ivec2(floor(prevTexel));
+        vec2 f = prevTexel - vec2(base);
+        for (int i = 0; i < 4; i++) {
+            ivec2 offset = ivec2(i & 1, i >> 1);
+            ivec2 q = base + offset;
+            if (any(lessThan(q, ivec2(0))) || any(greaterThanEqual(q, prevSize))) continue;
+
+            float historyW = texelFetch(uHistoryClipW, q, 0).r;
+            if (historyW <= 0.0 || abs(historyW - prevClip.w) > uDepthTolerance * prevClip.w) continue;
+
+            vec2 axis = mix(1.0 - f, f, vec2(offset));
+            float w = axis.x * axis.y;
+            history += texelFetch(uHistoryTexture, q, 0) * w;
+            weightSum += w;
+        }
+    }
+
+    vec4 result = count > 0.0 ? sum / count : vec4(0.0);
+    if (weightSum > 1e-3) {
+        history /= weightSum;
+        result = count > 0.0 ? clamp(history, lowest, highest) : history;
+    }
+    imageStore(uSignal, texel, result);
+}
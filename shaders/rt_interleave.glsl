@@ -0,0 +1,30 @@
+// Interleaved tracing (RayTracingQuality::CHECKERBOARD and INTERLEAVED_2X2), ahead of the
+// reflection, refraction and caustic kernels after their local size. The dispatch covers
+// only this frame's texels, packed: a checkerboard half rotating every frame, or one texel
+// of each 2x2 quad in turn. rt_interleave.cs fills in the texels left out.
+
+uniform int uInterleavePhases = 1;     // 1 traces every texel, 2 a checkerboard, 4 a 2x2 quad's texel
+uniform int uInterleavePhase = 0;      // This frame's, below uInterleavePhases
+
+// The quad's texel of a phase; the diagonal comes second, so two frames already span the quad
+ivec2 interleaveOffset(int phase)
+{
+  const ivec2 offsets[4] = ivec2[4](ivec2(0, 0), ivec2(1, 1), ivec2(1, 0), ivec2(0, 1));
+  return offsets[phase & 3];
+}
+
+// The texel an invocation of the packed dispatch traces
+ivec2 interleaveTexel(ivec2 invocation)
+{
+  if (uInterleavePhases == 2) return ivec2(invocation.x * 2 + ((invocation.y + uInterleavePhase) & 1), invocation.y);
+  if (uInterleavePhases == 4) return invocation * 2 + interleaveOffset(uInterleavePhase);
+  return invocation;
+}
+
+// Whether this frame traces the texel
+bool interleaveTraced(ivec2 texel)
+{
+  if (uInterleavePhases == 2) return ((texel.x + texel.y + uInterleavePhase) & 1) == 0;
+  if (uInterleavePhases == 4) return all(equal(texel & 1, interleaveOffset(uInterleavePhase)));
+  return true;
+}
@@ -3,7 +3,14 @@
 // Real-time ray traced reflections for water surface
 
 
-layout(local_size_x = 16, local_size_y = 16) in;
+// Autotuned per GPU by RayTracingManager
+#ifndef RT_LOCAL_SIZE_X
+#define RT_LOCAL_SIZE_X 16
+#endif
+#ifndef RT_LOCAL_SIZE_Y
+#define RT_LOCAL_SIZE_Y 16
+#endif
+layout(local_size_x = RT_LOCAL_SIZE_X, local_size_y = RT_LOCAL_SIZE_Y) in;
 
 // Input textures from G-Buffer
 layout(binding = 0) uniform sampler2D uPositionTexture;
@@ -23,9 +30,9 @@ uniform mat4 uProjectionMatrix;
 uniform mat4 uInverseViewMatrix;
 uniform mat4 uInverseProjectionMatrix;
 
-// Ray tracing quality settings
+// Ray tracing quality settings (uMaxRaySteps counts pyramid cells, see rt_hiz_trace.glsl)
 uniform int uMaxRaySteps = 64;
-uniform float uRayStepSize = 0.1;
+uniform float uMaxRayDistance = 10.0;
 uniform float uReflectionStrength = 1.0;
 uniform bool uUseFresnel = true;
 
@@ -33,10 +40,8 @@ uniform bool uUseFresnel = true;
 uniform float uWaterIOR = 1.33;
 uniform float uWaterRoughness = 0.02;
 
-// Random number generation for noise
-float random(vec2 st) {
-    return fract(sin(dot(st.xy, vec2(12.9898, 78.233))) * 43758.5453123);
-}
+// Reseeds the surface noise every frame when the temporal pass averages it (0 keeps it fixed)
+uniform int uFrameIndex = 0;
 
 // Fresnel reflection calculation
 float fresnel(vec3 viewDir, vec3 normal, float ior) {
@@ -53,79 +58,56 @@ float fresnel(vec3 viewDir, vec3 normal, float ior) {
     return 0.5 * (rs * rs + rp * rp);
 }
 
-// Screen space ray marching
+// Screen space reflection, traced hierarchically through the min-max depth pyramid
 vec3 screenSpaceReflection(vec3 worldPos, vec3 normal, vec3 viewDir) {
     // Calculate reflection ray
     vec3 reflectionDir = reflect(-viewDir, normal);
     
-    // Convert to screen space
-    vec4 startClip = uProjectionMatrix * uViewMatrix * vec4(worldPos, 1.0);
-    vec3 startNDC = startClip.xyz / startClip.w;
-    vec2 startScreen = (startNDC.xy + 1.0) * 0.5;
-    
-    // Ray end point
-    vec3 endWorld = worldPos + reflectionDir * 10.0; // Max reflection distance
-    vec4 endClip = uProjectionMatrix * uViewMatrix * vec4(endWorld, 1.0);
-    vec3 endNDC = endClip.xyz / endClip.w;
-    vec2 endScreen = (endNDC.xy + 1.0) * 0.5;
-    
-    // Ray marching in screen space
-    vec2 rayDir = endScreen - startScreen;
-    float rayLength = length(rayDir);
-    rayDir = normalize(rayDir);
-    
-    vec2 currentPos = startScreen;
-    float currentDepth = startNDC.z;
-    
-    for (int i = 0; i < uMaxRaySteps; i++) {
-        currentPos += rayDir * uRayStepSize * (1.0 / uResolution);
+    // Convert to a screen space ray in (uv, window depth)
+    vec3 rayOrigin, rayDelta;
+    vec2 clipW;
+    float rayDistance;
+    hizScreenRay(worldPos, reflectionDir, uMaxRayDistance, uProjectionMatrix * uViewMatrix,
+                 rayOrigin, rayDelta, clipW, rayDistance);
+    
+    float tHit;
+    vec2 depthParams = vec2(uProjectionMatrix[3][2], uProjectionMatrix[2][2]);
+    if (hizTrace(rayOrigin, rayDelta, HIZ_BEHIND, depthParams, uMaxRaySteps, tHit)) {
+        // Hit! Sample the position texture for color
+        vec2 hitUV = rayOrigin.xy + rayDelta.xy * tHit;
+        ivec2 hitTexel = ivec2(hitUV * uResolution);
+        vec3 hitPos = gbufferPosition(hitTexel);
         
-        // Check bounds
-        if (currentPos.x < 0.0 || currentPos.x > 1.0 || 
-            currentPos.y < 0.0 || currentPos.y > 1.0) {
-            break;
-        }
+        // Simple shading calculation
+        vec3 lightDir = normalize(uLightPos - hitPos);
+        vec3 hitNormal = gbufferNormal(hitTexel);
+        float NdotL = max(dot(hitNormal, lightDir), 0.0);
         
-        // Sample depth buffer
-        float sampledDepth = texture(uDepthTexture, currentPos).r;
-        
-        // Check for intersection
-        if (sampledDepth < currentDepth) {
-            // Hit! Sample the position texture for color
-            vec3 hitPos = texture(uPositionTexture, currentPos).xyz;
-            
-            // Simple shading calculation
-            vec3 lightDir = normalize(uLightPos - hitPos);
-            vec3 hitNormal = texture(uNormalTexture, currentPos).xyz;
-            float NdotL = max(dot(hitNormal, lightDir), 0.0);
-            
-            // Return reflected color
-            return vec3(0.2, 0.5, 0.8) * NdotL + vec3(0.1); // Water-like color
-        }
-        
-        // Update depth along ray
-        currentDepth += rayLength * uRayStepSize / float(uMaxRaySteps);
+        // Return reflected color
+        return vec3(0.2, 0.5, 0.8) * NdotL + vec3(0.1); // Water-like color
     }
     
-    // No hit - sample environment map
-    vec3 worldReflectionDir = mat3(uInverseViewMatrix) * reflectionDir;
-    return texture(uEnvironmentMap, worldReflectionDir).rgb;
+    // No hit - the scene proxies (rt_world_trace.glsl), then the environment map (the
+    // G-buffer, and so the ray, is in world space)
+    vec3 proxyColor;
+    if (worldTrace(worldPos, reflectionDir, uLightPos, proxyColor)) {
+        return proxyColor;
+    }
+    return textureLod(uEnvironmentMap, reflectionDir, 0.0).rgb;
 }
 
 void main() {
-    ivec2 coord = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 coord = interleaveTexel(ivec2(gl_GlobalInvocationID.xy));  // This frame's texels (rt_interleave.glsl)
     
     // Check bounds
     if (coord.x >= int(uResolution.x) || coord.y >= int(uResolution.y)) {
         return;
     }
     
-    vec2 uv = (vec2(coord) + 0.5) / uResolution;
-    
-    // Sample G-Buffer
-    vec3 worldPos = texture(uPositionTexture, uv).xyz;
-    vec3 normal = texture(uNormalTexture, uv).xyz;
-    float depth = texture(uDepthTexture, uv).r;
+    // Sample G-Buffer (fetched: the traced area may be a corner of larger textures)
+    vec3 worldPos = gbufferPosition(coord);
+    vec3 normal = gbufferNormal(coord);
+    float depth = texelFetch(uDepthTexture, coord, 0).r;
     
     // Skip background pixels
     if (depth >= 1.0) {
@@ -142,14 +124,21 @@ void main() {
         fresnelFactor = fresnel(viewDir, normal, uWaterIOR);
     }
     
-    // Perform screen space reflection
+    // Perform screen space reflection; under ULTRA more rays where the surface varies
     vec3 reflectionColor = screenSpaceReflection(worldPos, normal, viewDir);
+    float spread;
+    int extraSamples = adaptiveExtraSamples(coord, ivec2(uResolution), uWaterRoughness, spread);
+    for (int i = 0; i < extraSamples; i++) {
+        vec3 sampleNormal = adaptiveSampleNormal(normal, spread, blueNoise2(coord, i + 1, uFrameIndex));
+        reflectionColor += screenSpaceReflection(worldPos, sampleNormal, viewDir);
+    }
+    reflectionColor /= float(extraSamples + 1);
     
     // Apply reflection strength and Fresnel
     reflectionColor *= uReflectionStrength * fresnelFactor;
     
     // Add some noise for realistic water surface
-    float noise = random(uv + fract(sin(gl_GlobalInvocationID.x * 12.9898 + gl_GlobalInvocationID.y * 78.233) * 43758.5453));
+    float noise = blueNoise(coord, 0, uFrameIndex);
     reflectionColor += (noise - 0.5) * 0.02; // Subtle noise
     
     // Store result
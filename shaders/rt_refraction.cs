@@ -2,7 +2,14 @@
 
 // Real-time ray traced refractions for underwater visibility
 
-layout(local_size_x = 16, local_size_y = 16) in;
+// Autotuned per GPU by RayTracingManager
+#ifndef RT_LOCAL_SIZE_X
+#define RT_LOCAL_SIZE_X 16
+#endif
+#ifndef RT_LOCAL_SIZE_Y
+#define RT_LOCAL_SIZE_Y 16
+#endif
+layout(local_size_x = RT_LOCAL_SIZE_X, local_size_y = RT_LOCAL_SIZE_Y) in;
 
 // Input textures
 layout(binding = 0) uniform sampler2D uPositionTexture;
@@ -28,9 +35,8 @@ uniform vec3 uWaterColor = vec3(0.1, 0.3, 0.6);
 uniform float uWaterAbsorption = 0.1;
 uniform float uRefractionStrength = 1.0;
 
-// Ray marching settings
+// Ray tracing settings (uMaxRaySteps counts pyramid cells, see rt_hiz_trace.glsl)
 uniform int uMaxRaySteps = 32;
-uniform float uRayStepSize = 0.2;
 
 // Snell's law refraction
 vec3 refract2(vec3 incident, vec3 normal, float eta) {
@@ -45,7 +51,7 @@ vec3 refract2(vec3 incident, vec3 normal, float eta) {
     return eta * incident + (eta * cosI - cosT) * normal;
 }
 
-// Screen space refraction ray marching
+// Screen space refraction, traced hierarchically through the min-max depth pyramid
 vec3 screenSpaceRefraction(vec3 worldPos, vec3 normal, vec3 viewDir) {
     // Calculate refraction ray using Snell's law
     float eta = 1.0 / uWaterIOR; // Air to water
@@ -56,47 +62,33 @@ vec3 screenSpaceRefraction(vec3 worldPos, vec3 normal, vec3 viewDir) {
         return uWaterColor;
     }
     
-    // Convert to screen space
-    vec4 startClip = uProjectionMatrix * uViewMatrix * vec4(worldPos, 1.0);
-    vec3 startNDC = startClip.xyz / startClip.w;
-    vec2 startScreen = (startNDC.xy + 1.0) * 0.5;
-    
-    // Ray end point
-    vec3 endWorld = worldPos + refractionDir * uWaterDepth;
-    vec4 endClip = uProjectionMatrix * uViewMatrix * vec4(endWorld, 1.0);
-    vec3 endNDC = endClip.xyz / endClip.w;
-    vec2 endScreen = (endNDC.xy + 1.0) * 0.5;
-    
-    // Ray marching in screen space
-    vec2 rayDir = endScreen - startScreen;
-    float rayLength = length(rayDir);
-    rayDir = normalize(rayDir);
-    
-    vec2 currentPos = startScreen;
-    float travelDistance = 0.0;
-    
-    for (int i = 0; i < uMaxRaySteps; i++) {
-        currentPos += rayDir * uRayStepSize * (1.0 / uResolution);
-        travelDistance += uRayStepSize;
-        
-        // Check bounds
-        if (currentPos.x < 0.0 || currentPos.x > 1.0 || 
-            currentPos.y < 0.0 || currentPos.y > 1.0) {
-            break;
-        }
-        
-        // Sample underwater scene or bottom
-        vec3 underwaterColor = texture(uUnderwaterTexture, currentPos).rgb;
-        
-        // Apply water color absorption based on travel distance
-        float absorption = exp(-uWaterAbsorption * travelDistance);
-        vec3 finalColor = mix(uWaterColor, underwaterColor, absorption);
-        
-        return finalColor;
+    // Screen space ray in (uv, window depth), traced through the min-max depth pyramid
+    // until it comes back out through the surface (a wave in front of it) or has
+    // travelled uWaterDepth
+    vec3 rayOrigin, rayDelta;
+    vec2 clipW;
+    float rayDistance;
+    hizScreenRay(worldPos, refractionDir, uWaterDepth, uProjectionMatrix * uViewMatrix,
+                 rayOrigin, rayDelta, clipW, rayDistance);
+    
+    float t;
+    vec2 depthParams = vec2(uProjectionMatrix[3][2], uProjectionMatrix[2][2]);
+    hizTrace(rayOrigin, rayDelta, HIZ_INFRONT, depthParams, uMaxRaySteps, t);
+    
+    // Check bounds
+    vec2 samplePos = rayOrigin.xy + rayDelta.xy * t;
+    if (samplePos.x < 0.0 || samplePos.x > 1.0 || 
+        samplePos.y < 0.0 || samplePos.y > 1.0) {
+        return uWaterColor;
     }
     
-    // Default water color if no hit
-    return uWaterColor;
+    // Sample underwater scene or bottom
+    vec3 underwaterColor = texture(uUnderwaterTexture, samplePos).rgb;
+    
+    // Apply water color absorption based on the world distance travelled
+    float travelDistance = hizWorldFraction(t, clipW) * rayDistance;
+    float absorption = exp(-uWaterAbsorption * travelDistance);
+    return mix(uWaterColor, underwaterColor, absorption);
 }
 
 // Caustic pattern generation (simplified)
@@ -113,7 +105,7 @@ float causticPattern(vec2 uv, float time) {
 }
 
 void main() {
-    ivec2 coord = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 coord = interleaveTexel(ivec2(gl_GlobalInvocationID.xy));  // This frame's texels (rt_interleave.glsl)
     
     // Check bounds
     if (coord.x >= int(uResolution.x) || coord.y >= int(uResolution.y)) {
@@ -123,9 +115,9 @@ void main() {
     vec2 uv = (vec2(coord) + 0.5) / uResolution;
     
     // Sample G-Buffer
-    vec3 worldPos = texture(uPositionTexture, uv).xyz;
-    vec3 normal = texture(uNormalTexture, uv).xyz;
-    float depth = texture(uDepthTexture, uv).r;
+    vec3 worldPos = gbufferPosition(coord);
+    vec3 normal = gbufferNormal(coord);
+    float depth = texelFetch(uDepthTexture, coord, 0).r;
     
     // Skip background pixels
     if (depth >= 1.0) {
@@ -140,7 +132,7 @@ void main() {
     vec3 refractionColor = screenSpaceRefraction(worldPos, normal, viewDir);
     
     // Add caustic effects
-    float time = gl_GlobalInvocationID.x * 0.01 + gl_GlobalInvocationID.y * 0.01; // Pseudo time
+    float time = float(coord.x) * 0.01 + float(coord.y) * 0.01; // Pseudo time
     float caustics = causticPattern(uv, time);
     refractionColor += vec3(caustics * 0.2, caustics * 0.3, caustics * 0.1);
     
@@ -0,0 +1,61 @@
+#version 460 core
+
+// Robust contrast-adaptive sharpening (FSR1 RCAS) of the edge-aware upsample from
+// rt_upsample.cs. The 4-tap cross is given the strongest negative lobe that keeps the
+// result inside the neighbourhood's range, so it sharpens without ringing. Taps off the
+// water stand in as the centre, so the container edge is not sharpened into a halo.
+
+// Autotuned per GPU by RayTracingManager
+#ifndef RT_LOCAL_SIZE_X
+#define RT_LOCAL_SIZE_X 16
+#endif
+#ifndef RT_LOCAL_SIZE_Y
+#define RT_LOCAL_SIZE_Y 16
+#endif
+layout(local_size_x = RT_LOCAL_SIZE_X, local_size_y = RT_LOCAL_SIZE_Y) in;
+
+layout(binding = 0) uniform sampler2D uUpsampledTexture;
+layout(rgba8, binding = 0) restrict writeonly uniform image2D uSharpenedTexture;
+
+uniform vec2 uResolution;
+uniform float uSharpness = 0.87;   // exp2(-stops); 1 is the strongest
+
+// Strongest lobe RCAS allows, 1/4 being a full Laplacian
+const float RCAS_LIMIT = 0.25 - 1.0 / 16.0;
+
+void main() {
+    ivec2 coord = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 size = ivec2(uResolution);
+    if (any(greaterThanEqual(coord, size))) {
+        return;
+    }
+
+    vec4 e = texelFetch(uUpsampledTexture, coord, 0);
+    if (e.a <= 0.0) {
+        imageStore(uSharpenedTexture, coord, e);
+        return;
+    }
+
+    //    b
+    //  d e f
+    //    h
+    vec4 b = texelFetch(uUpsampledTexture, clamp(coord + ivec2(0, -1), ivec2(0), size - 1), 0);
+    vec4 d = texelFetch(uUpsampledTexture, clamp(coord + ivec2(-1, 0), ivec2(0), size - 1), 0);
+    vec4 f = texelFetch(uUpsampledTexture, clamp(coord + ivec2(1, 0), ivec2(0), size - 1), 0);
+    vec4 h = texelFetch(uUpsampledTexture, clamp(coord + ivec2(0, 1), ivec2(0), size - 1), 0);
+    vec3 cb = b.a > 0.0 ? b.rgb : e.rgb;
+    vec3 cd = d.a > 0.0 ? d.rgb : e.rgb;
+    vec3 cf = f.a > 0.0 ? f.rgb : e.rgb;
+    vec3 ch = h.a > 0.0 ? h.rgb : e.rgb;
+
+    // Lobe at which each channel would leave [min, max] of the cross
+    vec3 mn = min(min(cb, cd), min(cf, ch));
+    vec3 mx = max(max(cb, cd), max(cf, ch));
+    vec3 hitMin = mn / (4.0 * mx + 1e-5);
+    vec3 hitMax = (1.0 - mx) / (4.0 * mn - 4.0 - 1e-5);
+    vec3 lobeRGB = max(-hitMin, hitMax);
+    float lobe = max(-RCAS_LIMIT, min(max(lobeRGB.r, max(lobeRGB.g, lobeRGB.b)), 0.0)) * uSharpness;
+
+    vec3 color = (lobe * (cb + cd + cf + ch) + e.rgb) / (4.0 * lobe + 1.0);
+    imageStore(uSharpenedTexture, coord, vec4(clamp(color, 0.0, 1.0), e.a));
+}
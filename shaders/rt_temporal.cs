@@ -0,0 +1,119 @@
+#version 460 core
+
+// Temporal accumulation of one ray traced signal (reflections, refractions or caustics)
+// ahead of the à-trous filter in rt_atrous.cs. Each water texel is reprojected into the
+// previous frame through its G-buffer world position. Only the history texels that saw
+// the same surface there are blended in, and the history is clamped to the spread of this
+// frame's 3x3 neighbourhood so moving waves do not leave trails. Luminance moments are
+// accumulated alongside; their variance (spatial while the history is still short) goes
+// out in alpha to steer the filter.
+
+layout(local_size_x = 8, local_size_y = 8) in;
+
+layout(binding = 0) uniform sampler2D uCurrentTexture;   // This frame's trace
+layout(binding = 1) uniform sampler2D uHistoryTexture;   // Last frame's filtered colour, variance in a
+layout(binding = 2) uniform sampler2D uHistoryMoments;   // Last frame's uMoments
+layout(binding = 3) uniform sampler2D uPositionTexture;
+layout(binding = 4) uniform sampler2D uDepthTexture;
+
+layout(rgba16f, binding = 0) uniform restrict writeonly image2D uIntegrated;
+// Luminance mean, mean square, history length in frames, clip w (0 for no water)
+layout(rgba16f, binding = 1) uniform restrict writeonly image2D uMoments;
+
+uniform vec2 uResolution;              // Traced texels this frame and last; under dynamic
+uniform vec2 uPrevResolution;          // resolution both are corners of the textures
+uniform mat4 uViewProjection;
+uniform mat4 uPrevViewProjection;
+uniform bool uHistoryValid = false;
+uniform float uMaxHistory = 32.0;      // Longest history blended in, in frames
+uniform float uMomentAlpha = 0.2;      // Least weight of this frame in the moments
+uniform float uClipGamma = 1.5;        // Neighbourhood standard deviations the history may stray
+uniform float uDepthTolerance = 0.05;  // Relative clip w difference still taken as the same surface
+
+float luminance(vec3 color) {
+    return dot(color, vec3(0.2126, 0.7152, 0.0722));
+}
+
+void main() {
+    ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 size = ivec2(uResolution);
+    if (any(greaterThanEqual(texel, size))) {
+        return;
+    }
+
+    vec4 current = texelFetch(uCurrentTexture, texel, 0);
+    if (texelFetch(uDepthTexture, texel, 0).r >= 1.0) {
+        imageStore(uIntegrated, texel, vec4(current.rgb, 0.0));
+        imageStore(uMoments, texel, vec4(0.0));
+        return;
+    }
+    vec3 worldPos = gbufferPosition(texel);
+    float clipW = (uViewProjection * vec4(worldPos, 1.0)).w;
+
+    // Colour and luminance spread over this frame's water neighbourhood
+    vec3 colorSum = vec3(0.0);
+    vec3 colorSquares = vec3(0.0);
+    vec2 lumSum = vec2(0.0);
+    float count = 0.0;
+    for (int y = -1; y <= 1; y++) {
+        for (int x = -1; x <= 1; x++) {
+            ivec2 q = clamp(texel + ivec2(x, y), ivec2(0), size - 1);
+            if (texelFetch(uDepthTexture, q, 0).r >= 1.0) continue;
+            vec3 c = texelFetch(uCurrentTexture, q, 0).rgb;
+            float l = luminance(c);
+            colorSum += c;
+            colorSquares += c * c;
+            lumSum += vec2(l, l * l);
+            count += 1.0;
+        }
+    }
+    vec3 mean = colorSum / count;
+    vec3 sigma = sqrt(max(colorSquares / count - mean * mean, vec3(0.0)));
+    lumSum /= count;
+
+    // Bilinear history at the reprojected point, from the taps on the same surface
+    vec4 history = vec4(0.0);
+    vec3 historyMoments = vec3(0.0);
+    float weightSum = 0.0;
+    vec4 prevClip = uPrevViewProjection * vec4(worldPos, 1.0);
+    if (uHistoryValid && prevClip.w > 0.0) {
+        ivec2 prevSize = ivec2(uPrevResolution);
+        vec2 prevTexel = (prevClip.xy / prevClip.w * 0.5 + 0.5) * vec2(prevSize) - 0.5;
+        ivec2 base = ivec2(floor(prevTexel));
+        vec2 f = prevTexel - vec2(base);
+        for (int i = 0; i < 4; i++) {
+            ivec2 offset = ivec2(i & 1, i >> 1);
+            ivec2 q = base + offset;
+            if (any(lessThan(q, ivec2(0))) || any(greaterThanEqual(q, prevSize))) continue;
+
+            vec4 m = texelFetch(uHistoryMoments, q, 0);
+            if (m.w <= 0.0 || abs(m.w - prevClip.w) > uDepthTolerance * prevClip.w) continue;
+
+            vec2 axis = mix(1.0 - f, f, vec2(offset));
+            float w = axis.x * axis.y;
+            history += texelFetch(uHistoryTexture, q, 0) * w;
+            historyMoments += m.xyz * w;
+            weightSum += w;
+        }
+    }
+
+    float l = luminance(current.rgb);
+    vec3 color = current.rgb;
+    vec2 moments = vec2(l, l * l);
+    float historyLength = 1.0;
+    if (weightSum > 1e-3) {
+        history /= weightSum;
+        historyMoments /= weightSum;
+        historyLength = min(historyMoments.z + 1.0, uMaxHistory);
+
+        vec3 clipped = clamp(history.rgb, mean - uClipGamma * sigma, mean + uClipGamma * sigma);
+        color = mix(clipped, current.rgb, 1.0 / historyLength);
+        moments = mix(historyMoments.xy, moments, max(1.0 / historyLength, uMomentAlpha));
+    }
+
+    // A few frames of moments say little yet; the neighbourhood stands in until then
+    float variance = historyLength < 4.0 ? lumSum.y - lumSum.x * lumSum.x : moments.y - moments.x * moments.x;
+
+    imageStore(uIntegrated, texel, vec4(color, max(variance, 0.0)));
+    imageStore(uMoments, texel, vec4(moments, historyLength, clipW));
+}
@@ -1,28 +1,55 @@
 #version 460 core
 
 // Upsampling compute shader for ray tracing resolution scaling
-// Bilinear upsampling from low resolution to full resolution
+// Bilinear upsampling from low resolution to full resolution, or with uEdgeAware an
+// FSR1 EASU-style reconstruction guided by the water's full-resolution depth and normals:
+// a 12-tap Lanczos-2 kernel stretched along the local luminance edge, each tap weighted
+// down where its traced surface is not the one this pixel sees, so the water does not
+// bleed over the container. rt_sharpen.cs then applies RCAS to the result.
 
-layout(local_size_x = 16, local_size_y = 16) in;
+// Autotuned per GPU by RayTracingManager
+#ifndef RT_LOCAL_SIZE_X
+#define RT_LOCAL_SIZE_X 16
+#endif
+#ifndef RT_LOCAL_SIZE_Y
+#define RT_LOCAL_SIZE_Y 16
+#endif
+layout(local_size_x = RT_LOCAL_SIZE_X, local_size_y = RT_LOCAL_SIZE_Y) in;
 
 // Input and output textures
 layout(binding = 0) uniform sampler2D uLowResTexture;
+layout(binding = 1) uniform sampler2D uDepthTexture;        // Traced G-buffer
+layout(binding = 2) uniform sampler2D uNormalTexture;
+layout(binding = 3) uniform sampler2D uGuideDepthTexture;   // Water at full resolution
+layout(binding = 4) uniform sampler2D uGuideNormalTexture;  // Octahedral, as in the compact G-buffer
 layout(rgba8, binding = 0) restrict writeonly uniform image2D uHighResTexture;
 
-uniform vec2 uLowResolution;
+uniform vec2 uLowResolution;     // Traced texels of uLowResTexture
 uniform vec2 uHighResolution;
 uniform float uSharpenAmount = 0.2;
 
+// Edge-aware reconstruction
+uniform bool uEdgeAware = false;
+uniform vec2 uDepthParams;             // (projection[3][2], projection[2][2])
+uniform float uDepthSigma = 0.05;      // Relative view depth difference still taken as the same surface
+uniform float uNormalPower = 8.0;
+
+// Texel of the traced area, clamped to it (under dynamic resolution it is a corner of a
+// larger texture, and the rest holds stale data)
+vec3 lowResTexel(sampler2D tex, vec2 texel) {
+    return texelFetch(tex, clamp(ivec2(texel), ivec2(0), ivec2(uLowResolution) - 1), 0).rgb;
+}
+
 // Bicubic interpolation for higher quality upsampling
 vec3 bicubicSample(sampler2D tex, vec2 uv, vec2 texelSize) {
     vec2 coord = uv / texelSize - 0.5;
     vec2 fcoord = fract(coord);
     coord -= fcoord;
     
-    vec3 c00 = texture(tex, (coord + vec2(0.0, 0.0)) * texelSize).rgb;
-    vec3 c10 = texture(tex, (coord + vec2(1.0, 0.0)) * texelSize).rgb;
-    vec3 c01 = texture(tex, (coord + vec2(0.0, 1.0)) * texelSize).rgb;
-    vec3 c11 = texture(tex, (coord + vec2(1.0, 1.0)) * texelSize).rgb;
+    vec3 c00 = lowResTexel(tex, coord + vec2(0.0, 0.0));
+    vec3 c10 = lowResTexel(tex, coord + vec2(1.0, 0.0));
+    vec3 c01 = lowResTexel(tex, coord + vec2(0.0, 1.0));
+    vec3 c11 = lowResTexel(tex, coord + vec2(1.0, 1.0));
     
     vec3 cx0 = mix(c00, c10, fcoord.x);
     vec3 cx1 = mix(c01, c11, fcoord.x);
@@ -32,17 +59,122 @@ vec3 bicubicSample(sampler2D tex, vec2 uv, vec2 texelSize) {
 
 // Sharpening filter
 vec3 sharpen(sampler2D tex, vec2 uv, vec2 texelSize, float amount) {
-    vec3 center = texture(tex, uv).rgb;
+    vec2 texel = floor(uv / texelSize);
+    vec3 center = lowResTexel(tex, texel);
     vec3 blur = (
-        texture(tex, uv + vec2(-texelSize.x, 0.0)).rgb +
-        texture(tex, uv + vec2(texelSize.x, 0.0)).rgb +
-        texture(tex, uv + vec2(0.0, -texelSize.y)).rgb +
-        texture(tex, uv + vec2(0.0, texelSize.y)).rgb
+        lowResTexel(tex, texel + vec2(-1.0, 0.0)) +
+        lowResTexel(tex, texel + vec2(1.0, 0.0)) +
+        lowResTexel(tex, texel + vec2(0.0, -1.0)) +
+        lowResTexel(tex, texel + vec2(0.0, 1.0))
     ) * 0.25;
     
     return center + (center - blur) * amount;
 }
 
+float luminance(vec3 color) {
+    return dot(color, vec3(0.2126, 0.7152, 0.0722));
+}
+
+float viewDepth(float windowDepth) {
+    return uDepthParams.x / (windowDepth * 2.0 - 1.0 + uDepthParams.y);
+}
+
+// EASU's polynomial Lanczos-2 approximation at squared distance d2; lobe 0.25 is Lanczos-2,
+// larger values pull the negative lobe in
+float lanczos2(float d2, float lobe) {
+    d2 = min(d2, 1.0 / lobe);
+    float window = (2.0 / 5.0) * d2 - 1.0;
+    float base = lobe * d2 - 1.0;
+    return ((25.0 / 16.0) * window * window - (25.0 / 16.0 - 1.0)) * base * base;
+}
+
+// The 12 taps of EASU: the 4x4 around the sample point without its corners
+const ivec2 EASU_TAPS[12] = ivec2[](
+    ivec2(0, -1), ivec2(1, -1),
+    ivec2(-1, 0), ivec2(0, 0), ivec2(1, 0), ivec2(2, 0),
+    ivec2(-1, 1), ivec2(0, 1), ivec2(1, 1), ivec2(2, 1),
+    ivec2(0, 2), ivec2(1, 2)
+);
+
+vec4 edgeAwareSample(ivec2 coord) {
+    float guideDepth = texelFetch(uGuideDepthTexture, coord, 0).r;
+    if (guideDepth >= 1.0) {
+        return vec4(0.0); // No water here at full resolution
+    }
+    float guideZ = viewDepth(guideDepth);
+    vec3 guideNormal = gbufferDecodeOctahedral(texelFetch(uGuideNormalTexture, coord, 0).rg);
+    
+    vec2 samplePos = (vec2(coord) + 0.5) * uLowResolution / uHighResolution - 0.5;
+    ivec2 base = ivec2(floor(samplePos));
+    vec2 f = samplePos - vec2(base);
+    ivec2 lastTexel = ivec2(uLowResolution) - 1;
+    
+    vec4 taps[12];
+    float lum[12];
+    float similarity[12];
+    for (int i = 0; i < 12; i++) {
+        ivec2 q = clamp(base + EASU_TAPS[i], ivec2(0), lastTexel);
+        taps[i] = texelFetch(uLowResTexture, q, 0);
+        lum[i] = luminance(taps[i].rgb);
+        
+        // Joint bilateral term: the tap must have traced the surface this pixel shows
+        float depth = texelFetch(uDepthTexture, q, 0).r;
+        if (depth >= 1.0) {
+            similarity[i] = 0.0;
+            continue;
+        }
+        float wDepth = exp(-abs(viewDepth(depth) - guideZ) / (uDepthSigma * abs(guideZ)));
+        float wNormal = pow(max(dot(normalize(gbufferNormal(q)), guideNormal), 0.0), uNormalPower);
+        similarity[i] = wDepth * wNormal;
+    }
+    
+    // Luminance gradient at the four inner taps, bilinearly blended to the sample point
+    // (indices into EASU_TAPS: 3 = (0,0), 4 = (1,0), 7 = (0,1), 8 = (1,1))
+    vec2 gradient =
+        vec2(lum[4] - lum[2], lum[7] - lum[0]) * (1.0 - f.x) * (1.0 - f.y) +
+        vec2(lum[5] - lum[3], lum[8] - lum[1]) * f.x * (1.0 - f.y) +
+        vec2(lum[8] - lum[6], lum[10] - lum[3]) * (1.0 - f.x) * f.y +
+        vec2(lum[9] - lum[7], lum[11] - lum[4]) * f.x * f.y;
+    float gradientLength = length(gradient);
+    vec2 across = gradientLength > 1e-5 ? gradient / gradientLength : vec2(1.0, 0.0);
+    
+    // Edge strength against the local luminance range: the kernel is stretched along
+    // strong edges and its negative lobe pulled in, as EASU does
+    float lumMin = min(min(lum[3], lum[4]), min(lum[7], lum[8]));
+    float lumMax = max(max(lum[3], lum[4]), max(lum[7], lum[8]));
+    float edge = clamp(gradientLength / (2.0 * (lumMax - lumMin) + 1e-4), 0.0, 1.0);
+    edge *= edge;
+    float along = mix(1.0, 0.5, edge);
+    float lobe = mix(0.5, 0.21, edge);
+    
+    vec4 colorSum = vec4(0.0);
+    float weightSum = 0.0;
+    vec4 ringMin = vec4(1e30);
+    vec4 ringMax = vec4(-1e30);
+    int nearest = 3;
+    for (int i = 0; i < 12; i++) {
+        vec2 offset = vec2(EASU_TAPS[i]) - f;
+        vec2 rotated = vec2(dot(offset, across), dot(offset, vec2(-across.y, across.x)) * along);
+        float w = lanczos2(dot(rotated, rotated), lobe) * similarity[i];
+        colorSum += taps[i] * w;
+        weightSum += w;
+        if (similarity[i] > similarity[nearest]) nearest = i;
+        
+        // Deringing bounds from the inner taps on this surface
+        if ((i == 3 || i == 4 || i == 7 || i == 8) && similarity[i] > 0.0) {
+            ringMin = min(ringMin, taps[i]);
+            ringMax = max(ringMax, taps[i]);
+        }
+    }
+    
+    // No tap traced this surface well enough: the most similar one stands in
+    if (weightSum < 1e-3) {
+        return similarity[nearest] > 0.0 ? taps[nearest] : vec4(0.0);
+    }
+    vec4 color = colorSum / weightSum;
+    return ringMin.x <= ringMax.x ? clamp(color, ringMin, ringMax) : max(color, vec4(0.0));
+}
+
 void main() {
     ivec2 coord = ivec2(gl_GlobalInvocationID.xy);
     
@@ -50,6 +182,11 @@ void main() {
         return;
     }
     
+    if (uEdgeAware) {
+        imageStore(uHighResTexture, coord, edgeAwareSample(coord));
+        return;
+    }
+    
     // Calculate UV coordinates for low resolution texture
     vec2 uv = (vec2(coord) + 0.5) / uHighResolution;
     vec2 lowResTexelSize = 1.0 / uLowResolution;
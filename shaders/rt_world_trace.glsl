@@ -0,0 +1,58 @@
+// World-space stand-ins for what a screen-space ray cannot see, shared by rt_reflection.cs
+// and rt_fused.cs (RayTracingManager inserts this file after their #version). The sphere
+// and the container floor are intersected analytically by rays the depth pyramid traced
+// off screen or past its end, so they still show up in reflections; the rest falls back
+// to the environment map. RayTracingManager::setSceneProxies keeps them in place.
+
+uniform bool uProxiesEnabled = false;
+uniform vec3 uProxyBoxMin;          // Glass container, its floor at uProxyBoxMin.y
+uniform vec3 uProxyBoxMax;
+uniform vec4 uProxySphere;          // Centre and radius
+uniform vec3 uProxySphereColor;
+uniform vec3 uProxyFloorColor = vec3(0.55, 0.6, 0.6);
+
+// Nearest proxy along origin + t * direction (direction unit length), shaded by a point light
+bool worldTrace(vec3 origin, vec3 direction, vec3 lightPos, out vec3 color) {
+    color = vec3(0.0);
+    if (!uProxiesEnabled) {
+        return false;
+    }
+    
+    float tNearest = 1e30;
+    vec3 hitNormal = vec3(0.0);
+    vec3 albedo = vec3(0.0);
+    
+    // Sphere: nearest root in front of the origin
+    vec3 toOrigin = origin - uProxySphere.xyz;
+    float b = dot(toOrigin, direction);
+    float c = dot(toOrigin, toOrigin) - uProxySphere.w * uProxySphere.w;
+    float discriminant = b * b - c;
+    if (discriminant >= 0.0) {
+        float root = sqrt(discriminant);
+        float t = -b - root > 1e-3 ? -b - root : -b + root;
+        if (t > 1e-3) {
+            tNearest = t;
+            hitNormal = normalize(toOrigin + direction * t);
+            albedo = uProxySphereColor;
+        }
+    }
+    
+    // Container floor, inside the box's footprint
+    if (direction.y < 0.0) {
+        float t = (uProxyBoxMin.y - origin.y) / direction.y;
+        vec3 p = origin + direction * t;
+        if (t > 1e-3 && t < tNearest && all(greaterThanEqual(p.xz, uProxyBoxMin.xz)) && all(lessThanEqual(p.xz, uProxyBoxMax.xz))) {
+            tNearest = t;
+            hitNormal = vec3(0.0, 1.0, 0.0);
+            albedo = uProxyFloorColor;
+        }
+    }
+    
+    if (tNearest >= 1e30) {
+        return false;
+    }
+    vec3 hitPos = origin + direction * tNearest;
+    float NdotL = max(dot(hitNormal, normalize(lightPos - hitPos)), 0.0);
+    color = albedo * (0.2 + 0.8 * NdotL);
+    return true;
+}
@@ -0,0 +1,104 @@
+#version 460 core
+// Shading rate classification: one workgroup per tile of the finished scene, writing the tile's
+// rate for the next frame (ShadingRateImage)
+//
+// The tile's luminance plus a one-pixel border is staged in shared memory. An axis whose
+// largest neighbour step stays under the threshold shades at half rate along it; under a
+// quarter of the threshold on both axes the tile takes 4x4. The depth of field's blur, as
+// postprocess.fs computes it, coarsens the tile to its least blurred pixel's radius.
+
+#ifndef SHADING_RATE_TILE
+#define SHADING_RATE_TILE 16
+#endif
+layout(local_size_x = SHADING_RATE_TILE, local_size_y = SHADING_RATE_TILE) in;
+
+layout(binding = 0) uniform sampler2D uSceneColor;   // HDR
+layout(binding = 1) uniform sampler2D uSceneDepth;
+layout(r8ui, binding = 0) uniform restrict writeonly uimage2D uRateImage;
+
+uniform float uContrastThreshold;
+uniform bool uDepthOfField;
+uniform float uFocusDistance;
+uniform float uFocusRange;
+
+// ShadingRateImage::Rate, ordered from fine to coarse
+const uint RATE_1X1 = 0u;
+const uint RATE_2X1 = 1u;
+const uint RATE_1X2 = 2u;
+const uint RATE_2X2 = 3u;
+const uint RATE_4X4 = 4u;
+
+const int APRON = SHADING_RATE_TILE + 2;
+
+shared float tileLuminance[APRON * APRON];
+shared uint gradientX;      // Float bits: the gradients are positive, so they order as uints
+shared uint gradientY;
+shared uint leastBlur;
+
+// Weighed as displayed: a Reinhard curve keeps bright HDR steps from dominating
+float displayLuminance(ivec2 pixel, ivec2 size)
+{
+  vec3 color = max(texelFetch(uSceneColor, clamp(pixel, ivec2(0), size - 1), 0).rgb, vec3(0.0));
+  float luminance = dot(color, vec3(0.2126, 0.7152, 0.0722));
+  return luminance / (1.0 + luminance);
+}
+
+// postprocess.fs's blur radius of the pixel, in pixels
+uint blurRadius(ivec2 pixel)
+{
+  float depth = texelFetch(uSceneDepth, pixel, 0).r;
+  float linearDepth = (2.0 * 0.1) / (100.0 + 0.1 - depth * (100.0 - 0.1));
+  return uint(clamp(abs(linearDepth - uFocusDistance) / uFocusRange, 0.0, 1.0) * 5.0);
+}
+
+void main()
+{
+  ivec2 size = textureSize(uSceneColor, 0);
+  ivec2 tileOrigin = ivec2(gl_WorkGroupID.xy) * SHADING_RATE_TILE;
+
+  if (gl_LocalInvocationIndex == 0u) {
+    gradientX = 0u;
+    gradientY = 0u;
+    leastBlur = 0xFFFFFFFFu;
+  }
+  for (uint i = gl_LocalInvocationIndex; i < uint(APRON * APRON); i += uint(SHADING_RATE_TILE * SHADING_RATE_TILE)) {
+    ivec2 local = ivec2(int(i) % APRON, int(i) / APRON);
+    tileLuminance[i] = displayLuminance(tileOrigin + local - 1, size);
+  }
+  barrier();
+
+  ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+  if (all(lessThan(pixel, size))) {
+    int center = (int(gl_LocalInvocationID.y) + 1) * APRON + int(gl_LocalInvocationID.x) + 1;
+    float luminance = tileLuminance[center];
+    float stepX = max(abs(luminance - tileLuminance[center - 1]), abs(luminance - tileLuminance[center + 1]));
+    float stepY = max(abs(luminance - tileLuminance[center - APRON]), abs(luminance - tileLuminance[center + APRON]));
+    atomicMax(gradientX, floatBitsToUint(stepX));
+    atomicMax(gradientY, floatBitsToUint(stepY));
+    if (uDepthOfField) atomicMin(leastBlur, blurRadius(pixel));
+  }
+  barrier();
+
+  if (gl_LocalInvocationIndex != 0u) return;
+
+  float tileStepX = uintBitsToFloat(gradientX);
+  float tileStepY = uintBitsToFloat(gradientY);
+  bool coarseX = tileStepX < uContrastThreshold;
+  bool coarseY = tileStepY < uContrastThreshold;
+
+  uint rate = RATE_1X1;
+  if (coarseX && coarseY) {
+    rate = max(tileStepX, tileStepY) < uContrastThreshold * 0.25 ? RATE_4X4 : RATE_2X2;
+  } else if (coarseX) {
+    rate = RATE_2X1;
+  } else if (coarseY) {
+    rate = RATE_1X2;
+  }
+
+  // What the blur spreads over two or four pixels need not be shaded finer
+  if (uDepthOfField && leastBlur != 0xFFFFFFFFu) {
+    if (leastBlur >= 4u) rate = RATE_4X4;
+    else if (leastBlur >= 2u) rate = max(rate, RATE_2X2);
+  }
+  imageStore(uRateImage, ivec2(gl_WorkGroupID.xy), uvec4(rate));
+}
@@ -1,6 +1,11 @@
 #version 460 core
 
-// No output needed for depth-only rendering
+// Depth only. Particles are round
 void main() {
-    // gl_FragDepth is automatically written
-}
\ No newline at end of file
+#ifdef SHADOW_PARTICLES
+    vec2 offset = gl_PointCoord * 2.0 - 1.0;
+    if (dot(offset, offset) > 1.0) {
+        discard;
+    }
+#endif
+}
@@ -1,10 +1,68 @@
 #version 460 core
 
-layout (location = 0) in vec3 aPos;
+// Depth of the shadow casters from the light (ShadowMapper), in one cascade's layer
 
 uniform mat4 lightSpaceMatrix;
+
+#ifdef SHADOW_PARTICLES
+// SPH particles as points, pulled from the buffers of sph_depth.vs
+struct Particle
+{
+  vec3 position;
+  float density;
+  vec3 velocity;
+  float pressure;
+};
+
+layout(binding = 0, std430) restrict readonly buffer particleBuf
+{
+  Particle particles[];
+};
+
+layout(binding = 24, std430) restrict readonly buffer particleCountBuf
+{
+  uint particleDispatch[3];
+  uint liveParticleCount;
+};
+
+uniform uint uNumParticles;
+uniform float pointSize;    // Particle diameter in texels of the cascade
+
+void main() {
+    uint gid = uint(gl_VertexID);
+    if (gid >= uNumParticles || gid >= liveParticleCount) {
+        gl_Position = vec4(0.0, 0.0, 2.0, 1.0); // Clipped
+        gl_PointSize = 1.0;
+        return;
+    }
+    gl_Position = lightSpaceMatrix * vec4(particles[gid].position, 1.0);
+    gl_PointSize = pointSize;
+}
+#elif defined(SCENE_BATCH)
+// Casters of the scene batch (SceneBatch), one multi-draw: each draw's model is its record
+layout (location = 0) in vec3 aPos;
+
+struct SceneDraw
+{
+  mat4 model;
+  vec4 material;
+};
+
+layout(binding = 62, std430) restrict readonly buffer sceneDrawBuf
+{
+  SceneDraw sceneDraws[];
+};
+
+void main() {
+    gl_Position = lightSpaceMatrix * sceneDraws[gl_DrawID].model * vec4(aPos, 1.0);
+}
+#else
+layout (location = 0) in vec3 aPos;
+layout (location = 3) in vec4 aInstance;   // Sphere's offset and radius; (0, 0, 0, 1) for meshes without it
+
 uniform mat4 model;
 
 void main() {
-    gl_Position = lightSpaceMatrix * model * vec4(aPos, 1.0);
-}
\ No newline at end of file
+    gl_Position = lightSpaceMatrix * model * vec4(aInstance.xyz + aPos * aInstance.w, 1.0);
+}
+#endif
@@ -1,11 +1,32 @@
 #version 460 core
+#ifdef STEREO_MULTIVIEW
+// Both eyes in one draw (StereoRenderer): the cameras come from the frame block instead
+#extension GL_OVR_multiview2 : require
+layout(num_views = 2) in;
+#endif
 
 layout (location = 0) in vec3 aPos;
 
 out vec3 TexCoords;
 
+#ifdef STEREO_MULTIVIEW
+layout(std140, binding = 2) uniform FrameUniforms
+{
+    mat4 frameView;
+    mat4 frameProjection;
+    vec3 viewPos;
+    float time;
+    vec3 lightPos;
+    vec3 lightColor;
+    mat4 eyeView[2];
+    mat4 eyeProjection[2];
+};
+#define view eyeView[gl_ViewID_OVR]
+#define projection eyeProjection[gl_ViewID_OVR]
+#else
 uniform mat4 projection;
 uniform mat4 view;
+#endif
 
 void main() {
     TexCoords = aPos;
@@ -0,0 +1,122 @@
+#version 460 core
+// SPH adaptive resolution: merges interior particle pairs into coarse particles and splits
+// coarse particles again near the surface or the camera
+//
+// A coarse particle carries LEVEL_BIT in its pressure next to the phase bits and has
+// ADAPTIVE_MASS_SCALE times the mass and the cube root of that times the kernel radius
+// (steps 5 and 6). Runs at the start of a substep on the order the last step 3 left, in two
+// phases selected by uAdaptivePhase so that no merge reads a particle a split is writing:
+//   0: an even particle i merges with i + 1 (usually its cell neighbor) when both are fine,
+//     of one phase, close, interior by step 5's density and beyond the detail distance;
+//     i takes the combined particle, i + 1 is removed for step 3 to compact out
+//   1: a coarse particle at the surface (the surface splatting classification) or within
+//     the split distance of the camera splits into two fine ones along a hashed direction,
+//     the second appended after the live count, up to uSplitBudget per pass
+// Positions and velocities are averaged and copied, so mass and momentum are conserved.
+
+layout(local_size_x = 64) in;
+
+struct Particle
+{
+  vec3 position;
+  float density;
+  vec3 velocity;
+  float pressure;
+};
+
+layout(binding = 0, std430) restrict buffer particleBuf
+{
+  Particle particles[];
+};
+
+// Live particle count (sph_particle_count.cs): merges count their removals in the padding of
+// the second record and splits their appends in the padding of the third
+layout(binding = 24, std430) restrict buffer particleCountBuf
+{
+  uint dispatch32[3];
+  uint liveParticleCount;
+  uint dispatch64[3];
+  uint removedParticleCount;
+  uint dispatch256[3];
+  uint splitParticleCount;
+};
+
+const float REMOVED_DENSITY = -1.0;
+
+uniform int uAdaptivePhase;
+uniform uint uSplitBudget;
+uniform float uMergeDistance;        // Largest pair separation that merges
+uniform float uSplitOffset;          // Half the separation of a split pair
+uniform float uMergeDensityRatio;    // Interior: density above ratio * rest density
+uniform float uSurfaceDensityRatio;  // Surface: density below ratio * rest density
+uniform float uPhaseRestDensity[SPH_MAX_PHASES];
+uniform vec3 uCameraPosition;
+uniform float uDetailDistance;       // Fine particles closer to the camera never merge
+uniform float uSplitDistance;        // Coarse particles closer to the camera split
+
+// Direction of a split, spread over the sphere by index (golden angle spiral)
+vec3 splitDirection(uint id)
+{
+  float z = 1.0 - 2.0 * fract(float(id) * 0.618034);
+  float angle = float(id) * 2.39996323;
+  float radius = sqrt(max(1.0 - z * z, 0.0));
+  return vec3(radius * cos(angle), radius * sin(angle), z);
+}
+
+bool mergeCandidate(Particle particle)
+{
+  uint tags = particleTags(particle.pressure);
+  return particle.density >= 0.0 && (tags & LEVEL_BIT) == 0u &&
+         particle.density > uMergeDensityRatio * uPhaseRestDensity[tags & PHASE_MASK] &&
+         distance(particle.position, uCameraPosition) > uDetailDistance;
+}
+
+void main()
+{
+  uint id = gl_GlobalInvocationID.x;
+  if (id >= liveParticleCount) return;
+
+  Particle particle = particles[id];
+  if (particle.density < 0.0) return;
+  uint tags = particleTags(particle.pressure);
+
+  // A particle merged in phase 0 is interior and far, so it never splits in phase 1
+  if (uAdaptivePhase == 1)
+  {
+    if ((tags & LEVEL_BIT) == 0u) return;
+
+    bool surface = particle.density < uSurfaceDensityRatio * uPhaseRestDensity[tags & PHASE_MASK];
+    bool near = distance(particle.position, uCameraPosition) < uSplitDistance;
+    if (!surface && !near) return;
+
+    uint slot = atomicAdd(splitParticleCount, 1u);
+    if (slot >= uSplitBudget) return;
+
+    vec3 offset = splitDirection(id) * uSplitOffset;
+    Particle fine = particle;
+    fine.pressure = withTags(particle.pressure, tags & ~LEVEL_BIT);
+    fine.position = particle.position + offset;
+    particles[liveParticleCount + slot] = fine;
+    fine.position = particle.position - offset;
+    particles[id] = fine;
+    return;
+  }
+
+  // Pairs are (even, odd); the odd particle's own invocation leaves it alone
+  if ((id & 1u) != 0u || id + 1u >= liveParticleCount) return;
+
+  Particle other = particles[id + 1u];
+  if (!mergeCandidate(particle) || !mergeCandidate(other)) return;
+  // Pairs merge within a phase and a level; their time levels may differ
+  if (((particleTags(other.pressure) ^ tags) & (PHASE_MASK | LEVEL_BIT)) != 0u) return;
+  if (distance(particle.position, other.position) > uMergeDistance) return;
+
+  particle.position = 0.5 * (particle.position + other.position);
+  particle.velocity = 0.5 * (particle.velocity + other.velocity);
+  particle.pressure = withTags(particle.pressure, tags | LEVEL_BIT);
+  particles[id] = particle;
+
+  other.density = REMOVED_DENSITY;
+  particles[id + 1u] = other;
+  atomicAdd(removedParticleCount, 1u);
+}
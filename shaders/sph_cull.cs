@@ -0,0 +1,109 @@
+#version 460 core
+// SPH particle culling: tests each live particle's billboard sphere against the view
+// frustum and, when a pyramid is available, against the Hi-Z of the previous frame's
+// particle depth, and appends the survivors to a compact index list whose header is the
+// DrawArraysIndirectCommand for sph_render.vs / sph_depth.vs (six vertices per particle).
+//
+// With uClassify the list is split by the density step 5 left on each particle (a kernel
+// weighted neighbor count): particles short of neighbors form the surface shell that is
+// depth-splatted, the rest go to a second list behind it for the thickness pass. Interior
+// particles sit behind the shell by definition, so only the shell is occlusion culled
+
+layout(local_size_x = 256) in;
+
+struct Particle
+{
+  vec3 position;
+  float density;
+  vec3 velocity;
+  float pressure;
+};
+
+layout(binding = 0, std430) restrict readonly buffer particleBuf
+{
+  Particle particles[];
+};
+
+layout(binding = 24, std430) restrict readonly buffer particleCountBuf
+{
+  uint particleDispatch[3];
+  uint liveParticleCount;
+};
+
+// Two DrawArraysIndirectCommands (surface, interior), reset to { 0, 1, 0, 0 } by the CPU
+// before each dispatch; the interior ids start at uListCapacity
+layout(binding = 29, std430) restrict buffer visibleParticleBuf
+{
+  uint surfaceVertexCount;
+  uint surfaceDraw[3];
+  uint interiorVertexCount;
+  uint interiorDraw[3];
+  uint visibleParticles[];
+};
+
+// Hi-Z pyramid: farthest window-space depth per texel, level 0 at the depth target size
+layout(binding = 0) uniform sampler2D uHiZ;
+
+uniform uint uParticleCount;
+uniform float uRadius;
+uniform vec4 uFrustumPlanes[6];   // Inside where dot(plane.xyz, p) + plane.w >= 0
+uniform int uOcclusion;
+uniform mat4 uHiZViewProj;        // View-projection the pyramid was rendered with
+uniform ivec2 uHiZSize;
+uniform int uHiZLevels;
+uniform int uClassify;
+uniform float uSurfaceDensity;    // Particles below this density are on the surface
+uniform uint uListCapacity;
+
+bool occluded(vec3 center)
+{
+  // Screen rectangle and nearest depth of the sphere's bounding box in the pyramid's view
+  vec3 rectMin = vec3(1.0);
+  vec3 rectMax = vec3(-1.0);
+  for (int i = 0; i < 8; i++)
+  {
+    vec3 corner = center + uRadius * vec3((i & 1) != 0 ? 1.0 : -1.0, (i & 2) != 0 ? 1.0 : -1.0, (i & 4) != 0 ? 1.0 : -1.0);
+    vec4 clip = uHiZViewProj * vec4(corner, 1.0);
+    if (clip.w <= 0.0) return false; // Straddles the camera plane
+    vec3 ndc = clip.xyz / clip.w;
+    rectMin = min(rectMin, ndc);
+    rectMax = max(rectMax, ndc);
+  }
+  vec2 uvMin = clamp(rectMin.xy * 0.5 + 0.5, 0.0, 1.0);
+  vec2 uvMax = clamp(rectMax.xy * 0.5 + 0.5, 0.0, 1.0);
+  float nearestDepth = rectMin.z * 0.5 + 0.5;
+
+  // The level where the rectangle spans at most two texels per axis
+  vec2 extent = (uvMax - uvMin) * vec2(uHiZSize);
+  int level = clamp(int(ceil(log2(max(max(extent.x, extent.y), 1.0)))), 0, uHiZLevels - 1);
+  ivec2 levelSize = textureSize(uHiZ, level);
+  ivec2 texelMin = clamp(ivec2(uvMin * vec2(levelSize)), ivec2(0), levelSize - 1);
+  ivec2 texelMax = clamp(ivec2(uvMax * vec2(levelSize)), ivec2(0), levelSize - 1);
+
+  float farthest = max(max(texelFetch(uHiZ, texelMin, level).r, texelFetch(uHiZ, ivec2(texelMax.x, texelMin.y), level).r),
+                       max(texelFetch(uHiZ, ivec2(texelMin.x, texelMax.y), level).r, texelFetch(uHiZ, texelMax, level).r));
+  return nearestDepth > farthest;
+}
+
+void main()
+{
+  uint id = gl_GlobalInvocationID.x;
+  if (id >= uParticleCount || id >= liveParticleCount) return;
+
+  vec3 center = particles[id].position;
+  for (int i = 0; i < 6; i++)
+  {
+    if (dot(uFrustumPlanes[i].xyz, center) + uFrustumPlanes[i].w < -uRadius) return;
+  }
+
+  if (uClassify != 0 && particles[id].density >= uSurfaceDensity)
+  {
+    uint slot = atomicAdd(interiorVertexCount, 6u) / 6u;
+    visibleParticles[uListCapacity + slot] = id;
+    return;
+  }
+  if (uOcclusion != 0 && occluded(center)) return;
+
+  uint slot = atomicAdd(surfaceVertexCount, 6u) / 6u;
+  visibleParticles[slot] = id;
+}
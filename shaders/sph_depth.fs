@@ -5,8 +5,9 @@
 in vec3 vCenterPos;  // Eye space center position
 in vec2 vUV;
 in vec3 vColor;
+in vec2 vMotion;
 
-out vec4 fragColor;
+out vec4 fragColor;  // Motion of the nearest particle (TemporalUpscaler)
 
 uniform mat4 uProjection;
 uniform float uPointRadius;
@@ -36,8 +37,5 @@ void main() {
     // Convert NDC depth to window coordinates [0, 1]
     gl_FragDepth = ndcDepth * 0.5 + 0.5;
     
-    // Output depth as color for visualization and debug
-    // In production, this would output to depth buffer only
-    float depthVis = gl_FragDepth;
-    fragColor = vec4(depthVis, depthVis, depthVis, 1.0);
+    fragColor = vec4(vMotion, 0.0, 1.0);
 }
\ No newline at end of file
@@ -14,30 +14,80 @@ layout(binding = 0, std430) restrict readonly buffer particleBuf
   Particle particles[];
 };
 
+// Live particle count record (see sph_particle_count.cs); the CPU count is only an upper
+// bound while removed particles are being compacted out
+layout(binding = 24, std430) restrict readonly buffer particleCountBuf
+{
+  uint particleDispatch[3];
+  uint liveParticleCount;
+};
+
+// Quantized render stream (sph_render_stream.cs), read in place of the particles when set
+layout(binding = 60, std430) restrict readonly buffer renderStreamBuf
+{
+  uvec2 renderStream[];
+};
+
+// Culled draws: the survivors of sph_cull.cs after its two indirect draw commands
+layout(binding = 29, std430) restrict readonly buffer visibleParticleBuf
+{
+  uint visibleDraws[8];
+  uint visibleParticles[];
+};
+
 uniform mat4 uMVP;
 uniform mat4 uView;
 uniform mat4 uProjection;
 uniform float uPointRadius;
 uniform uint uNumParticles;
+uniform bool uUseVisibleList;
+uniform uint uVisibleListOffset; // Start of the drawn list (surface or interior)
+uniform bool uUseRenderStream;
+uniform vec3 uStreamOrigin;
+uniform vec3 uStreamExtent;
+
+// Motion of the particle since the last frame, for the temporal upscale: the unjittered
+// camera of this frame and the last, and the time between them
+uniform bool uMotionVectors = false;
+uniform mat4 uMotionViewProjection;
+uniform mat4 uPreviousViewProjection;
+uniform float uFrameTime;
 
 out vec3 vCenterPos;
 out vec2 vUV;
 out vec3 vColor;
+out vec2 vMotion;  // Window UV
 
 vec2 UVS[4] = { vec2(0,0), vec2(1,0), vec2(0,1), vec2(1,1) };
 vec2 OFFSETS[4] = { vec2(-1,-1), vec2(-1,+1), vec2(+1,-1), vec2(+1,+1) };
+// Two triangles per particle from gl_VertexID alone, so no index buffer is needed
+const uint QUAD_CORNERS[6] = { 0, 1, 2, 2, 1, 3 };
 
 void main() {
-    uint gid = gl_VertexID / 4;
-    uint lid = gl_VertexID % 4;
+    uint gid = uint(gl_VertexID) / 6u;
+    if (uUseVisibleList) gid = visibleParticles[uVisibleListOffset + gid];
+    uint lid = QUAD_CORNERS[uint(gl_VertexID) % 6u];
 
     // Bounds check
-    if (gid >= uNumParticles) {
+    if (gid >= uNumParticles || gid >= liveParticleCount) {
         gl_Position = vec4(0.0, 0.0, -1.0, 1.0);
         return;
     }
 
-    vec3 particlePos = particles[gid].position;
+    vec3 particlePos;
+    if (uUseRenderStream) {
+        uvec2 packed = renderStream[gid];
+        particlePos = uStreamOrigin + vec3(packed.x & 0xFFFFu, packed.x >> 16, packed.y & 0xFFFFu) / 65535.0 * uStreamExtent;
+    } else {
+        particlePos = particles[gid].position;
+    }
+
+    vMotion = vec2(0.0);
+    if (uMotionVectors) {
+        vec4 clip = uMotionViewProjection * vec4(particlePos, 1.0);
+        vec4 previousClip = uPreviousViewProjection * vec4(particlePos - particles[gid].velocity * uFrameTime, 1.0);
+        vMotion = (clip.xy / clip.w - previousClip.xy / previousClip.w) * 0.5;
+    }
 
     vCenterPos = (uView * vec4(particlePos, 1.0)).xyz;
     vUV = UVS[lid];
@@ -0,0 +1,102 @@
+#version 460 core
+// SPH depth splat: the sphere impostors of sph_depth.vs / sph_depth.fs rasterized in compute.
+// Each thread projects one particle's camera-facing quad, which lands on screen as a
+// rectangle scaled affinely (the quad is parallel to the image plane), and walks the pixels
+// of it: inside the disc the sphere's front surface depth goes into the target with
+// imageAtomicMin. Window-space depth is never negative, so its float bits order like the
+// floats. Most particles cover a handful of pixels, where the triangle path spends its time
+// on quad overdraw and gl_FragDepth turns early Z off. The step 3 reorder keeps the
+// particles in cell order, so neighbouring threads splat neighbouring pixels.
+
+layout(local_size_x = 64) in;
+
+struct Particle
+{
+  vec3 position;
+  float density;
+  vec3 velocity;
+  float pressure;
+};
+
+layout(binding = 0, std430) restrict readonly buffer particleBuf
+{
+  Particle particles[];
+};
+
+layout(binding = 24, std430) restrict readonly buffer particleCountBuf
+{
+  uint particleDispatch[3];
+  uint liveParticleCount;
+};
+
+layout(binding = 60, std430) restrict readonly buffer renderStreamBuf
+{
+  uvec2 renderStream[];
+};
+
+// sph_cull.cs survivors; the surface command's vertex count is six per particle
+layout(binding = 29, std430) restrict readonly buffer visibleParticleBuf
+{
+  uint surfaceVertexCount;
+  uint surfaceDraw[7];
+  uint visibleParticles[];
+};
+
+layout(r32ui, binding = 0) uniform restrict coherent uimage2D uDepth;
+
+uniform mat4 uView;
+uniform mat4 uProjection;
+uniform float uPointRadius;
+uniform uint uNumParticles;
+uniform bool uUseVisibleList;
+uniform bool uUseRenderStream;
+uniform vec3 uStreamOrigin;
+uniform vec3 uStreamExtent;
+
+void main()
+{
+  uint gid = gl_GlobalInvocationID.x;
+  if (uUseVisibleList) {
+    if (gid >= surfaceVertexCount / 6u) return;
+    gid = visibleParticles[gid];
+  }
+  if (gid >= uNumParticles || gid >= liveParticleCount) return;
+
+  vec3 particlePos;
+  if (uUseRenderStream) {
+    uvec2 packed = renderStream[gid];
+    particlePos = uStreamOrigin + vec3(packed.x & 0xFFFFu, packed.x >> 16, packed.y & 0xFFFFu) / 65535.0 * uStreamExtent;
+  } else {
+    particlePos = particles[gid].position;
+  }
+
+  // Spheres reaching the camera would need clipping; they are the rare case
+  vec3 center = (uView * vec4(particlePos, 1.0)).xyz;
+  if (center.z > -2.0 * uPointRadius) return;
+
+  vec4 lowClip = uProjection * vec4(center.xy - uPointRadius, center.z, 1.0);
+  vec4 highClip = uProjection * vec4(center.xy + uPointRadius, center.z, 1.0);
+  vec2 lowNdc = lowClip.xy / lowClip.w;
+  vec2 highNdc = highClip.xy / highClip.w;
+
+  ivec2 size = imageSize(uDepth);
+  vec2 lowPixel = (lowNdc * 0.5 + 0.5) * vec2(size);
+  vec2 highPixel = (highNdc * 0.5 + 0.5) * vec2(size);
+  ivec2 first = max(ivec2(ceil(lowPixel - 0.5)), ivec2(0));
+  ivec2 last = min(ivec2(floor(highPixel - 0.5)), size - 1);
+
+  for (int y = first.y; y <= last.y; y++) {
+    for (int x = first.x; x <= last.x; x++) {
+      // Pixel centre to the quad's UV, then as sph_depth.fs
+      vec2 uv = (vec2(x, y) + 0.5 - lowPixel) / (highPixel - lowPixel);
+      vec2 disc = uv * 2.0 - 1.0;
+      float r2 = dot(disc, disc);
+      if (r2 > 1.0) continue;
+
+      vec3 spherePos = center + vec3(disc, sqrt(1.0 - r2)) * uPointRadius;
+      vec4 clipPos = uProjection * vec4(spherePos, 1.0);
+      float depth = clipPos.z / clipPos.w * 0.5 + 0.5;
+      imageAtomicMin(uDepth, ivec2(x, y), floatBitsToUint(clamp(depth, 0.0, 1.0)));
+    }
+  }
+}
@@ -0,0 +1,257 @@
+#version 460 core
+// SPH secondary (diffuse) particles after Ihmsen et al. 2012, "Unified Spray, Foam and Air
+// Bubbles for Particle-Based Fluids". Runs once per frame in three phases selected by uPass:
+//   0: bin the fluid particles into the simulation cells (count and summed velocity)
+//   1: spawn secondary particles from the step 5 / step 6 potentials into a fixed-capacity
+//      ring that overwrites the oldest entries
+//   2: classify each secondary particle by the fluid around it and advect it: spray is
+//      ballistic, foam follows the fluid and ages, bubbles are buoyant and dragged along
+//
+// The state buffer starts with the DrawArraysIndirectCommand of sph_diffuse.vs (four
+// vertices, one instance per ring slot in use).
+
+layout(local_size_x = 256) in;
+
+#define DIFFUSE_SPRAY 0.0
+#define DIFFUSE_FOAM 1.0
+#define DIFFUSE_BUBBLE 2.0
+#define MAX_SPAWN_PER_PARTICLE 8u
+#define VELOCITY_SCALE 1024.0       // Fixed point scale of the binned velocities
+
+struct Particle
+{
+  vec3 position;
+  float density;
+  vec3 velocity;
+  float pressure;
+};
+
+layout(binding = 0, std430) restrict readonly buffer particleBuf
+{
+  Particle particles[];
+};
+
+layout(binding = 24, std430) restrict readonly buffer particleCountBuf
+{
+  uint particleDispatch[3];
+  uint liveParticleCount;
+};
+
+struct DiffusePotential
+{
+  vec4 normalTrappedAir;
+  vec4 waveCrest;
+};
+
+layout(binding = 32, std430) restrict readonly buffer diffusePotentialBuf
+{
+  DiffusePotential diffusePotentials[];
+};
+
+struct DiffuseParticle
+{
+  vec4 positionLifetime;  // Lifetime left in seconds; <= 0 is a free slot
+  vec4 velocityType;      // DIFFUSE_SPRAY, DIFFUSE_FOAM or DIFFUSE_BUBBLE
+};
+
+layout(binding = 33, std430) restrict buffer diffuseParticleBuf
+{
+  DiffuseParticle diffuseParticles[];
+};
+
+layout(binding = 34, std430) restrict buffer diffuseStateBuf
+{
+  uint drawVertexCount;
+  uint drawInstanceCount;  // Ring slots written so far, up to the capacity
+  uint drawFirst;
+  uint drawBaseInstance;
+  uint spawnHead;          // Total spawned; the ring slot is spawnHead modulo the capacity
+};
+
+// Per simulation cell: fluid particle count and the fixed point sum of their velocities
+layout(binding = 35, std430) restrict buffer diffuseCellBuf
+{
+  ivec4 diffuseCells[];
+};
+
+uniform int uPass;
+uniform uint uParticleCount;
+uniform uint uCapacity;           // Power of two
+uniform float uDT;
+uniform uint uFrame;
+uniform vec3 uGravity;
+uniform vec3 uGridOrigin;
+uniform vec3 uGridSize;
+uniform vec3 uInvCellSize;
+uniform ivec3 uGridRes;
+
+uniform vec2 uTrappedAirRange;    // Potential clamping ranges (Ihmsen's tau min / max)
+uniform vec2 uWaveCrestRange;
+uniform vec2 uKineticEnergyRange; // Kinetic energy per unit mass
+uniform float uTrappedAirRate;    // Secondary particles per second at full potential
+uniform float uWaveCrestRate;
+uniform vec2 uLifetimeRange;      // Seconds, drawn per particle
+uniform float uSpawnRadius;
+uniform float uSprayFill;         // Mean cell occupancy, relative to a full cell, below
+uniform float uBubbleFill;        // which a particle is spray / above which it is a bubble
+uniform float uFullCellCount;
+uniform float uBuoyancy;
+uniform float uDrag;
+
+// PCG hash, one stream per particle and frame
+uint hash(uint value)
+{
+  uint state = value * 747796405u + 2891336453u;
+  uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+  return (word >> 22u) ^ word;
+}
+
+float random(inout uint seed)
+{
+  seed = hash(seed);
+  return float(seed) / 4294967295.0;
+}
+
+float clampPotential(float value, vec2 range)
+{
+  return (min(value, range.y) - min(value, range.x)) / max(range.y - range.x, 1.0e-6);
+}
+
+ivec3 cellOf(vec3 position)
+{
+  return ivec3(floor((position - uGridOrigin) * uInvCellSize));
+}
+
+uint cellIndex(ivec3 cell)
+{
+  return uint(cell.x + uGridRes.x * (cell.y + uGridRes.y * cell.z));
+}
+
+void binFluidParticle(uint id)
+{
+  Particle particle = particles[id];
+  ivec3 cell = clamp(cellOf(particle.position), ivec3(0), uGridRes - 1);
+  uint index = cellIndex(cell);
+  ivec3 velocity = ivec3(round(particle.velocity * VELOCITY_SCALE));
+  atomicAdd(diffuseCells[index].x, 1);
+  atomicAdd(diffuseCells[index].y, velocity.x);
+  atomicAdd(diffuseCells[index].z, velocity.y);
+  atomicAdd(diffuseCells[index].w, velocity.z);
+}
+
+void spawnSecondaryParticles(uint id)
+{
+  Particle particle = particles[id];
+  DiffusePotential potential = diffusePotentials[id];
+
+  float kineticEnergy = clampPotential(0.5 * dot(particle.velocity, particle.velocity), uKineticEnergyRange);
+  if (kineticEnergy <= 0.0) return;
+  float trappedAir = clampPotential(potential.normalTrappedAir.w, uTrappedAirRange);
+  float waveCrest = clampPotential(potential.waveCrest.x, uWaveCrestRange);
+
+  uint seed = hash(id ^ hash(uFrame));
+  float expected = kineticEnergy * (uTrappedAirRate * trappedAir + uWaveCrestRate * waveCrest) * uDT;
+  uint count = min(uint(expected + random(seed)), MAX_SPAWN_PER_PARTICLE);
+  if (count == 0u) return;
+
+  uint first = atomicAdd(spawnHead, count);
+  atomicMax(drawInstanceCount, min(first + count, uCapacity));
+
+  // Spread over a disk around the velocity, moving outward from the fluid particle
+  float speed = length(particle.velocity);
+  vec3 axis = speed > 0.0001 ? particle.velocity / speed : vec3(0.0, 1.0, 0.0);
+  vec3 tangent = normalize(abs(axis.y) < 0.99 ? cross(axis, vec3(0.0, 1.0, 0.0)) : cross(axis, vec3(1.0, 0.0, 0.0)));
+  vec3 bitangent = cross(axis, tangent);
+
+  for (uint i = 0u; i < count; i++)
+  {
+    float radius = uSpawnRadius * sqrt(random(seed));
+    float angle = 6.2831853 * random(seed);
+    vec3 radial = cos(angle) * tangent + sin(angle) * bitangent;
+    vec3 position = particle.position + radius * radial + axis * (random(seed) * speed * uDT);
+    vec3 velocity = particle.velocity + radial * (radius / max(uSpawnRadius, 0.0001)) * 0.5 * speed;
+    float lifetime = mix(uLifetimeRange.x, uLifetimeRange.y, random(seed));
+
+    uint slot = (first + i) & (uCapacity - 1u);
+    diffuseParticles[slot].positionLifetime = vec4(position, lifetime);
+    diffuseParticles[slot].velocityType = vec4(velocity, DIFFUSE_SPRAY);
+  }
+}
+
+void advectSecondaryParticle(uint slot)
+{
+  DiffuseParticle diffuse = diffuseParticles[slot];
+  float lifetime = diffuse.positionLifetime.w;
+  if (lifetime <= 0.0) return;
+
+  vec3 position = diffuse.positionLifetime.xyz;
+  vec3 velocity = diffuse.velocityType.xyz;
+
+  // Fluid occupancy and velocity over the 3x3x3 cells around the particle
+  ivec3 cell = cellOf(position);
+  float fluidCount = 0.0;
+  vec3 fluidVelocity = vec3(0.0);
+  for (int dz = -1; dz <= 1; dz++)
+  {
+    for (int dy = -1; dy <= 1; dy++)
+    {
+      for (int dx = -1; dx <= 1; dx++)
+      {
+        ivec3 neighbor = cell + ivec3(dx, dy, dz);
+        if (any(lessThan(neighbor, ivec3(0))) || any(greaterThanEqual(neighbor, uGridRes))) continue;
+        ivec4 binned = diffuseCells[cellIndex(neighbor)];
+        fluidCount += float(binned.x);
+        fluidVelocity += vec3(binned.yzw) / VELOCITY_SCALE;
+      }
+    }
+  }
+  fluidVelocity = fluidCount > 0.0 ? fluidVelocity / fluidCount : vec3(0.0);
+  float fill = fluidCount / (27.0 * uFullCellCount);
+
+  float type = fill < uSprayFill ? DIFFUSE_SPRAY : (fill > uBubbleFill ? DIFFUSE_BUBBLE : DIFFUSE_FOAM);
+  if (type == DIFFUSE_SPRAY)
+  {
+    velocity += uGravity * uDT;
+  }
+  else if (type == DIFFUSE_BUBBLE)
+  {
+    velocity += uDT * (-uBuoyancy * uGravity) + uDrag * (fluidVelocity - velocity);
+  }
+  else
+  {
+    velocity = fluidVelocity;
+    lifetime -= uDT; // Only foam dissolves; spray lands and bubbles rise into foam
+  }
+  position += velocity * uDT;
+
+  // Particles leaving the domain are dropped; at the walls they come to rest
+  vec3 boxMin = uGridOrigin;
+  vec3 boxMax = uGridOrigin + uGridSize;
+  if (position.y > boxMax.y + uGridSize.y) lifetime = 0.0;
+  vec3 clamped = clamp(position, boxMin, vec3(boxMax.x, position.y, boxMax.z));
+  velocity = mix(velocity, vec3(0.0), vec3(notEqual(clamped, position)));
+
+  diffuseParticles[slot].positionLifetime = vec4(clamped, lifetime);
+  diffuseParticles[slot].velocityType = vec4(velocity, type);
+}
+
+void main()
+{
+  uint id = gl_GlobalInvocationID.x;
+
+  if (uPass == 2)
+  {
+    if (id < drawInstanceCount) advectSecondaryParticle(id);
+    return;
+  }
+
+  if (id >= uParticleCount || id >= liveParticleCount) return;
+  if (uPass == 0)
+  {
+    binFluidParticle(id);
+  }
+  else
+  {
+    spawnSecondaryParticles(id);
+  }
+}
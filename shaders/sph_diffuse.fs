@@ -0,0 +1,20 @@
+#version 460 core
+// SPH secondary particle billboards: soft disks, over the fluid in the transparent pass
+
+in vec4 vColor;
+in vec2 vUV;
+
+// Order-independent transparency, linked in from oit.fs
+void writeTransparent(vec4 color);
+
+void main(void)
+{
+    vec2 offset = vUV * 2.0 - 1.0;
+    float r2 = dot(offset, offset);
+    if (r2 > 1.0)
+    {
+        discard;
+    }
+
+    writeTransparent(vec4(vColor.rgb, vColor.a * (1.0 - r2)));
+}
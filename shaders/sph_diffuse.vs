@@ -0,0 +1,67 @@
+#version 460 core
+// SPH secondary particle billboards: one instance per ring slot of sph_diffuse.cs, drawn
+// as a four-vertex triangle strip
+
+#define DIFFUSE_SPRAY 0.0
+#define DIFFUSE_FOAM 1.0
+
+struct DiffuseParticle
+{
+  vec4 positionLifetime;
+  vec4 velocityType;
+};
+
+layout(binding = 33, std430) restrict readonly buffer diffuseParticleBuf
+{
+  DiffuseParticle diffuseParticles[];
+};
+
+uniform mat4 uVP;
+uniform mat4 uView;
+uniform float uPointRadius;
+
+out vec4 vColor;
+out vec2 vUV;
+
+vec2 UVS[4] = { vec2(0,0), vec2(1,0), vec2(0,1), vec2(1,1) };
+vec2 OFFSETS[4] = { vec2(-1,-1), vec2(+1,-1), vec2(-1,+1), vec2(+1,+1) };
+
+void main()
+{
+  DiffuseParticle diffuse = diffuseParticles[gl_InstanceID];
+  uint lid = uint(gl_VertexID) & 3u;
+
+  // Free slots stay in the instance range; clip them
+  if (diffuse.positionLifetime.w <= 0.0) {
+    gl_Position = vec4(0.0, 0.0, -2.0, 1.0);
+    vColor = vec4(0.0);
+    vUV = vec2(0.0);
+    return;
+  }
+
+  // Spray is small and bright, foam large and dense, bubbles faint; all fade out over
+  // their last half second
+  float type = diffuse.velocityType.w;
+  float radius = uPointRadius;
+  vec4 color = vec4(0.8, 0.85, 0.9, 0.35);
+  if (type == DIFFUSE_SPRAY)
+  {
+    radius *= 0.6;
+    color = vec4(0.95, 0.97, 1.0, 0.8);
+  }
+  else if (type == DIFFUSE_FOAM)
+  {
+    radius *= 1.2;
+    color = vec4(0.92, 0.95, 0.97, 0.7);
+  }
+  color.a *= clamp(diffuse.positionLifetime.w * 2.0, 0.0, 1.0);
+  vColor = color;
+  vUV = UVS[lid];
+
+  vec3 wsCameraRight = vec3(uView[0][0], uView[1][0], uView[2][0]);
+  vec3 wsCameraUp = vec3(uView[0][1], uView[1][1], uView[2][1]);
+
+  vec3 wsVertPos = diffuse.positionLifetime.xyz + (wsCameraRight * OFFSETS[lid].x + wsCameraUp * OFFSETS[lid].y) * radius;
+
+  gl_Position = uVP * vec4(wsVertPos, 1.0);
+}
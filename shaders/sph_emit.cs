@@ -0,0 +1,134 @@
+#version 460 core
+// SPH emitter: appends particles after the GPU-resident live count
+//
+// uEmitMode selects the source:
+//   0: a stream scattered over a disk of radius uEmitRadius perpendicular to its velocity
+//   1: particles the CPU wrote into the persistently mapped staging ring
+//   2: a jittered lattice filling a box, or the lattice points inside a sphere; point
+//      uSeedFirst + id in z-fastest order, the sphere's rows located through uSeedRows
+// sph_particle_count.cs advances the live count afterwards.
+
+layout(local_size_x = 64) in;
+
+struct Particle
+{
+  vec3 position;
+  float density;
+  vec3 velocity;
+  float pressure;
+};
+
+layout(binding = 0, std430) restrict writeonly buffer particleBuf
+{
+  Particle particles[];
+};
+
+layout(binding = 24, std430) restrict readonly buffer particleCountBuf
+{
+  uint particleDispatch[3];
+  uint liveParticleCount;
+};
+
+layout(binding = 25, std430) restrict readonly buffer stagingBuf
+{
+  Particle stagedParticles[];
+};
+
+uniform int uEmitMode;
+uniform uint uEmitCount;
+uniform uint uStagingOffset;
+uniform uint uCapacity;
+uniform uint uSeed;
+uniform vec3 uEmitOrigin;
+uniform vec3 uEmitVelocity;
+uniform float uEmitRadius;
+uniform float uRestDensity;
+uniform uint uEmitPhase;       // Phase index, in the low mantissa bits of the pressure (sph_step5.cs)
+
+// Lattice seeding (mode 2)
+#define SEED_SPHERE 1
+
+// Sphere rows (x, y) of the lattice: first particle index and first z index
+layout(binding = 42, std430) restrict readonly buffer seedRowBuf
+{
+  uvec2 seedRows[];
+};
+
+uniform int uSeedShape;
+uniform uint uSeedFirst;
+uniform uint uSeedRowCount;
+uniform ivec3 uLatticeDim;
+uniform vec3 uLatticeOrigin;   // First lattice point
+uniform float uSpacing;
+uniform float uJitter;         // Fraction of the spacing
+
+// PCG hash, mapped to [0, 1)
+float random(inout uint state)
+{
+  state = state * 747796405u + 2891336453u;
+  uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+  return float((word >> 22u) ^ word) * (1.0 / 4294967296.0);
+}
+
+void main()
+{
+  uint emitId = gl_GlobalInvocationID.x;
+  uint particleId = liveParticleCount + emitId;
+  if (emitId >= uEmitCount || particleId >= uCapacity) return;
+
+  if (uEmitMode == 1)
+  {
+    particles[particleId] = stagedParticles[uStagingOffset + emitId];
+    return;
+  }
+
+  uint state = uSeed ^ (emitId * 0x9E3779B9u);
+
+  if (uEmitMode == 2)
+  {
+    uint index = uSeedFirst + emitId;
+    state = uSeed ^ (index * 0x9E3779B9u);
+    ivec3 lattice;
+    if (uSeedShape == SEED_SPHERE)
+    {
+      // Last row starting at or before this particle
+      uint low = 0u;
+      uint high = uSeedRowCount - 1u;
+      while (low < high)
+      {
+        uint middle = (low + high + 1u) / 2u;
+        if (seedRows[middle].x <= index) low = middle; else high = middle - 1u;
+      }
+      lattice = ivec3(int(low) / uLatticeDim.y, int(low) % uLatticeDim.y, int(seedRows[low].y + index - seedRows[low].x));
+    }
+    else
+    {
+      uint rowLength = uint(uLatticeDim.z);
+      uint planeSize = uint(uLatticeDim.y) * rowLength;
+      lattice = ivec3(index / planeSize, (index / rowLength) % uint(uLatticeDim.y), index % rowLength);
+    }
+
+    vec3 jitter = vec3(random(state), random(state), random(state)) - 0.5;
+    particles[particleId].position = uLatticeOrigin + (vec3(lattice) + uJitter * jitter) * uSpacing;
+    particles[particleId].density = uRestDensity;
+    particles[particleId].velocity = uEmitVelocity;
+    particles[particleId].pressure = uintBitsToFloat(uEmitPhase);
+    return;
+  }
+
+  // Orthonormal basis around the stream direction
+  vec3 axis = length(uEmitVelocity) > 0.0 ? normalize(uEmitVelocity) : vec3(0.0, -1.0, 0.0);
+  vec3 helper = abs(axis.y) < 0.99 ? vec3(0.0, 1.0, 0.0) : vec3(1.0, 0.0, 0.0);
+  vec3 tangent = normalize(cross(helper, axis));
+  vec3 bitangent = cross(axis, tangent);
+
+  // Uniform point on the disk
+  float r = uEmitRadius * sqrt(random(state));
+  float theta = 6.28318530718 * random(state);
+  vec3 offset = r * (cos(theta) * tangent + sin(theta) * bitangent);
+
+  particles[particleId].position = uEmitOrigin + offset;
+  particles[particleId].density = uRestDensity;
+  particles[particleId].velocity = uEmitVelocity;
+  particles[particleId].pressure = uintBitsToFloat(uEmitPhase);
+}
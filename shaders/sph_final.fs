@@ -6,24 +6,77 @@ in vec2 vTexCoord;
 out vec4 fragColor;
 
 uniform sampler2D uTexture;
+uniform sampler2D uThickness;   // Interior particles behind the splatted surface (SPH_THICKNESS variant)
 
-void main() {
-    float depth = texture(uTexture, vTexCoord).r;
+// Dynamic lights, linked in from clustered_lights.fs; the grid's camera is this pass's
+void clusteredLighting(vec3 worldPos, vec3 normal, vec3 viewDir, float shininess,
+                       out vec3 diffuse, out vec3 specular);
+vec3 clusterWorldPosition(vec2 uv, float depth);
+vec3 clusterCameraPosition();
+
+const float THICKNESS_ABSORPTION = 4.0;
+const float UPSAMPLE_DEPTH_SIGMA = 0.002;  // Window-space depth
+
+// Joint bilateral upsample of the (possibly reduced resolution) smoothed depth: the four
+// nearest low-resolution texels are weighted bilinearly and by their depth distance to the
+// nearest fluid texel among them, so background and farther layers never bleed across a
+// silhouette. At render scale 1 this is a plain fetch
+float upsampleDepth() {
+    vec2 position = vTexCoord * vec2(textureSize(uTexture, 0)) - 0.5;
+    ivec2 base = ivec2(floor(position));
+    vec2 f = position - vec2(base);
+    ivec2 maxTexel = textureSize(uTexture, 0) - 1;
     
-    // Skip background pixels (far plane)
-    if (depth >= 0.999) {
-        discard;
+    float depths[4];
+    float weights[4] = { (1.0 - f.x) * (1.0 - f.y), f.x * (1.0 - f.y), (1.0 - f.x) * f.y, f.x * f.y };
+    float nearest = 1.0;
+    for (int i = 0; i < 4; i++) {
+        depths[i] = texelFetch(uTexture, clamp(base + ivec2(i & 1, i >> 1), ivec2(0), maxTexel), 0).r;
+        if (depths[i] > 0.001 && depths[i] < 0.999) nearest = min(nearest, depths[i]);
     }
     
-    // Skip empty pixels (no particles)
-    if (depth <= 0.001) {
-        discard;
+    float coverage = 0.0;
+    float weightSum = 0.0;
+    float depthSum = 0.0;
+    for (int i = 0; i < 4; i++) {
+        if (depths[i] <= 0.001 || depths[i] >= 0.999) continue;
+        coverage += weights[i];
+        float difference = (depths[i] - nearest) / UPSAMPLE_DEPTH_SIGMA;
+        float weight = max(weights[i], 1e-4) * exp(-0.5 * difference * difference);
+        weightSum += weight;
+        depthSum += depths[i] * weight;
     }
     
+    // Silhouettes land halfway between fluid and background texels
+    return coverage >= 0.5 && weightSum > 0.0 ? depthSum / weightSum : 1.0;
+}
+
+void main() {
+    float depth = upsampleDepth();
+#ifdef SPH_THICKNESS
+    float thickness = texture(uThickness, vTexCoord).r;
+#else
+    float thickness = 0.0;
+#endif
+    
+    // The surface point and its normal, the derivatives taken before any pixel leaves
+    vec3 surfacePos = clusterWorldPosition(vTexCoord, depth);
+    vec3 surfaceNormal = cross(dFdx(surfacePos), dFdy(surfacePos));
+    
     // Create beautiful water appearance
     vec3 deepWater = vec3(0.0, 0.1, 0.4);    // Deep blue
     vec3 shallowWater = vec3(0.1, 0.4, 0.8); // Light blue
     
+    // Background or empty pixels (no surface particles): interior fluid showing through a
+    // gap in the surface shell, if any
+    if (depth >= 0.999 || depth <= 0.001) {
+        if (thickness <= 0.0) {
+            discard;
+        }
+        fragColor = vec4(deepWater, 0.8 * (1.0 - exp(-THICKNESS_ABSORPTION * thickness)));
+        return;
+    }
+    
     // Use depth for color variation
     float depthFactor = clamp(depth, 0.0, 1.0);
     vec3 waterColor = mix(shallowWater, deepWater, depthFactor);
@@ -32,6 +85,19 @@ void main() {
     float fresnel = 1.0 - depthFactor;
     waterColor += vec3(0.1, 0.3, 0.5) * fresnel;
     
+    // Absorption through the interior
+    waterColor = mix(waterColor, deepWater, 1.0 - exp(-THICKNESS_ABSORPTION * thickness));
+    
+    // Dynamic lights on the surface
+    vec3 viewDir = normalize(clusterCameraPosition() - surfacePos);
+    surfaceNormal = dot(surfaceNormal, surfaceNormal) > 0.0 ? normalize(surfaceNormal) : viewDir;
+    if (dot(surfaceNormal, viewDir) < 0.0) {
+        surfaceNormal = -surfaceNormal;
+    }
+    vec3 lightDiffuse, lightSpecular;
+    clusteredLighting(surfacePos, surfaceNormal, viewDir, 64.0, lightDiffuse, lightSpecular);
+    waterColor += lightDiffuse * waterColor + lightSpecular * 0.5;
+    
     // Output with transparency
     fragColor = vec4(waterColor, 0.8);
 }
\ No newline at end of file
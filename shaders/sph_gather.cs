@@ -0,0 +1,69 @@
+#version 460 core
+// SPH index sort gather: reorders the particles by cell every few substeps
+//
+// Between gathers step 3 sorts only the particle indices (SPH_INDEX_SORT) and the neighbor
+// loops read the particles through them in storage order. The gather follows the step 3
+// compaction: slot i takes the particle step 3 binned there, into a scratch buffer the
+// host copies back over the particle buffer, and the sorted indices become the identity
+// until the next substep's sort.
+
+layout(local_size_x = 64) in;
+
+struct Particle
+{
+  vec3 position;
+  float density;
+  vec3 velocity;
+  float pressure;
+};
+
+layout(binding = 0, std430) restrict readonly buffer particleBuf
+{
+  Particle particles[];
+};
+
+layout(binding = 1, std430) restrict writeonly buffer gatheredParticleBuf
+{
+  Particle gatheredParticles[];
+};
+
+layout(binding = 14, std430) restrict buffer sortedIndexBuf
+{
+  uint sortedIndices[];
+};
+
+// Implicit viscosity warm start (sph_viscosity.cs), moved with its particle when enabled
+layout(binding = 51, std430) restrict readonly buffer warmStartBuf1
+{
+  vec4 inWarmStart[];
+};
+
+layout(binding = 52, std430) restrict writeonly buffer warmStartBuf2
+{
+  vec4 outWarmStart[];
+};
+
+uniform int uCarryWarmStart;
+
+// Live particle count, already compacted by sph_particle_count.cs
+layout(binding = 24, std430) restrict readonly buffer particleCountBuf
+{
+  uint particleDispatch[3];
+  uint liveParticleCount;
+};
+
+void main()
+{
+  uint slot = gl_GlobalInvocationID.x;
+  if (slot >= liveParticleCount) return;
+
+  uint id = sortedIndices[slot];
+  Particle particle = particles[id];
+  gatheredParticles[slot] = particle;
+  if (uCarryWarmStart != 0) outWarmStart[slot] = inWarmStart[id];
+#ifdef SPH_SOA_LAYOUT
+  // The structure-of-arrays mirror follows the particles into cell order
+  writeSoAParticle(slot, particle.position, particle.velocity);
+#endif
+  sortedIndices[slot] = slot;
+}
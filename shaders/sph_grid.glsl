@@ -0,0 +1,100 @@
+// Cell addressing of the SPH grid, ahead of every pass that indexes the cell buffers
+// (SPHComputeSystem::gridSource()). The passes take the grid resolution from SPHParameters
+// or a uniform of their own, declared after this, so each defines gridResolution() for it.
+
+ivec3 gridResolution();
+
+// Two-level grid (sph_grid_blocks.cs): fine cells exist only inside occupied coarse blocks,
+// at the block's pool slot; blockSlots holds slot + 1, 0 for an empty block. Step 1 flags the
+// blocks and sph_grid_blocks.cs allocates them (SPH_BLOCK_SLOT_WRITER); the rest only read
+#define GRID_BLOCK_SIZE 4
+#define GRID_BLOCK_CELLS 64
+
+#if defined(SPH_BLOCK_SLOT_WRITER)
+layout(binding = 56, std430) restrict buffer blockSlotBuf
+{
+  uint blockSlots[];
+};
+#elif defined(SPH_HIERARCHICAL_GRID)
+layout(binding = 56, std430) restrict readonly buffer blockSlotBuf
+{
+  uint blockSlots[];
+};
+#endif
+
+const uint EMPTY_CELL = 0xFFFFFFFFu;
+
+// Cell order within a brick of 4x4x4 cells (SPHConstants::GRID_BLOCK_SIZE): Morton order with
+// SPH_MORTON_CELLS, so the 27 cells around a particle span a few cache lines; row-major
+// otherwise
+uint brickLocalCell(ivec3 local)
+{
+#ifdef SPH_MORTON_CELLS
+  return uint((local.x & 1) | ((local.y & 1) << 1) | ((local.z & 1) << 2) |
+              ((local.x & 2) << 2) | ((local.y & 2) << 3) | ((local.z & 2) << 4));
+#else
+  return uint(local.x + 4 * (local.y + 4 * local.z));
+#endif
+}
+
+// Dense grid index of an in-grid voxel: whole bricks row-major with SPH_MORTON_CELLS (the cell
+// buffers are padded to whole bricks), row-major voxels otherwise
+uint denseCell(ivec3 voxel)
+{
+  ivec3 gridRes = gridResolution();
+#ifdef SPH_MORTON_CELLS
+  ivec3 brickRes = (gridRes + 3) / 4;
+  ivec3 brick = voxel >> 2;
+  return uint(brick.x + brickRes.x * (brick.y + brickRes.y * brick.z)) * 64u + brickLocalCell(voxel & 3);
+#else
+  return uint(voxel.x + gridRes.x * (voxel.y + gridRes.y * voxel.z));
+#endif
+}
+
+// Inverse of denseCell, for the active cells step 1 lists
+ivec3 denseVoxel(uint cellId)
+{
+  ivec3 gridRes = gridResolution();
+#ifdef SPH_MORTON_CELLS
+  ivec3 brickRes = (gridRes + 3) / 4;
+  uint brick = cellId >> 6;
+  uint m = cellId & 63u;
+  ivec3 local = ivec3((m & 1u) | ((m >> 2) & 2u), ((m >> 1) & 1u) | ((m >> 3) & 2u), ((m >> 2) & 1u) | ((m >> 4) & 2u));
+  return ivec3(brick % uint(brickRes.x), (brick / uint(brickRes.x)) % uint(brickRes.y),
+               brick / uint(brickRes.x * brickRes.y)) * 4 + local;
+#else
+  return ivec3(cellId % uint(gridRes.x), (cellId / uint(gridRes.x)) % uint(gridRes.y),
+               cellId / uint(gridRes.x * gridRes.y));
+#endif
+}
+
+// Cell buffer index of an in-grid voxel, EMPTY_CELL when its block holds no particles
+uint gridCell(ivec3 voxel)
+{
+#ifdef SPH_HIERARCHICAL_GRID
+  ivec3 gridRes = gridResolution();
+  ivec3 blockRes = (gridRes + GRID_BLOCK_SIZE - 1) / GRID_BLOCK_SIZE;
+  ivec3 block = voxel / GRID_BLOCK_SIZE;
+  uint slot = blockSlots[block.x + blockRes.x * (block.y + blockRes.y * block.z)];
+  if (slot == 0u) return EMPTY_CELL;
+  return (slot - 1u) * GRID_BLOCK_CELLS + brickLocalCell(voxel - block * GRID_BLOCK_SIZE);
+#else
+  return denseCell(voxel);
+#endif
+}
+
+// Particle in a cell slot. With the index-only sort (sph_step3.cs) the slots hold particle
+// indices and the particles stay put until sph_gather.cs reorders them; otherwise they are the
+// particles' own. Step 3 and the neighbor list fill sortedIndices (SPH_SORTED_INDEX_WRITER)
+#ifndef SPH_SORTED_INDEX_WRITER
+#ifdef SPH_INDEX_SORT
+layout(binding = 14, std430) restrict readonly buffer sortedIndexBuf
+{
+  uint sortedIndices[];
+};
+
+uint cellParticle(uint slot) { return sortedIndices[slot]; }
+#else
+uint cellParticle(uint slot) { return slot; }
+#endif
+#endif
@@ -0,0 +1,108 @@
+#version 460 core
+// SPH hierarchical grid: fine cells allocated only inside occupied coarse blocks
+//
+// Step 1 flags the GRID_BLOCK_SIZE^3 block of every particle in blockSlots. Runs in two
+// phases selected by uBlockPhase:
+//   0: one invocation per block; a flagged block takes the next pool slot, so its
+//      GRID_BLOCK_CELLS fine cells live at slot * GRID_BLOCK_CELLS in the cell buffers
+//   1: one invocation per particle; counts it into its fine cell, as step 1 does on the
+//      dense grid
+//
+// blockSlots holds slot + 1, 0 for an empty block. The pool has a slot for every block or
+// every particle, whichever is fewer, so an occupied block always gets one.
+
+layout(local_size_x = 64) in;
+
+struct Particle
+{
+  vec3 position;
+  float density;
+  vec3 velocity;
+  float pressure;
+};
+
+layout(binding = 0, std430) restrict readonly buffer particleBuf
+{
+  Particle particles[];
+};
+
+layout(binding = 2, std430) restrict buffer cellCountBuf
+{
+  uint cellCount[];
+};
+
+// Live particle count, maintained on the GPU by sph_particle_count.cs
+layout(binding = 24, std430) restrict readonly buffer particleCountBuf
+{
+  uint particleDispatch[3];
+  uint liveParticleCount;
+};
+
+// Allocated slots, reset before every substep
+layout(binding = 57, std430) restrict buffer blockStateBuf
+{
+  uint allocatedBlocks;
+};
+
+layout(std140, binding = 0) uniform SPHParameters
+{
+  vec3 uGridOrigin;
+  float uDT;
+  vec3 uGridSize;
+  float uMaxVelocity;
+  vec3 uInvCellSize;
+  float uWallDamping;         // Fraction of the normal velocity kept by a wall bounce
+  ivec3 uGridRes;
+  float uSceneStride;         // Batched scenes: x offset between the scenes
+  vec3 uGravity;
+  int uSceneCount;
+  vec3 uStepGravity;          // Gravity step 1 integrates; zero when PCISPH does
+  int uBatchScenes;           // Scene count, 0 when not batched
+  float uParticleMass;
+  float uHalfSkinSq;
+  uint uListStride;
+  int uUseNeighborList;
+  int uDiffusePotentials;
+  int uParticleSleeping;
+  uint uSleepSubsteps;
+  float uSleepVelocity;
+  float uSleepDensityChange;  // Relative density change per substep
+};
+
+// Grid resolution of the cell addressing in sph_grid.glsl
+ivec3 gridResolution() { return uGridRes; }
+
+uniform int uBlockPhase;
+uniform uint uBlockCount;
+uniform uint uBlockCapacity;
+
+void main()
+{
+  uint id = gl_GlobalInvocationID.x;
+  ivec3 blockRes = (uGridRes + GRID_BLOCK_SIZE - 1) / GRID_BLOCK_SIZE;
+
+  if (uBlockPhase == 0)
+  {
+    if (id >= uBlockCount || blockSlots[id] == 0u) return;
+
+    uint slot = atomicAdd(allocatedBlocks, 1u);
+    blockSlots[id] = slot < uBlockCapacity ? slot + 1u : 0u;
+    return;
+  }
+
+  if (id >= liveParticleCount) return;
+
+  // Removed particles were flagged by step 1 and never marked a block
+  Particle particle = particles[id];
+  if (particle.density < 0.0) return;
+
+  ivec3 voxelCoord = ivec3(uInvCellSize * (particle.position - uGridOrigin));
+  if (any(lessThan(voxelCoord, ivec3(0))) || any(greaterThanEqual(voxelCoord, uGridRes))) return;
+
+  ivec3 block = voxelCoord / GRID_BLOCK_SIZE;
+  uint slot = blockSlots[block.x + blockRes.x * (block.y + blockRes.y * block.z)];
+  if (slot == 0u) return;
+
+  uint cellId = (slot - 1u) * GRID_BLOCK_CELLS + brickLocalCell(voxelCoord - block * GRID_BLOCK_SIZE);
+  atomicAdd(cellCount[cellId], 1u);
+}
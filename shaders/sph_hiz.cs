@@ -0,0 +1,38 @@
+#version 460 core
+// Hi-Z pyramid for SPH particle occlusion culling: level 0 copies the particle depth
+// target, each further level keeps the farthest depth of the texels it covers (three
+// per axis at the edge of an odd-sized level, so no texel is skipped)
+
+layout(local_size_x = 16, local_size_y = 16) in;
+
+layout(binding = 0) uniform sampler2D uDepth;            // Level 0 source
+layout(binding = 0, r32f) uniform restrict readonly image2D uSource; // Previous level
+layout(binding = 1, r32f) uniform restrict writeonly image2D uTarget;
+
+uniform int uFromDepth;
+
+void main()
+{
+  ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+  ivec2 targetSize = imageSize(uTarget);
+  if (any(greaterThanEqual(texel, targetSize))) return;
+
+  if (uFromDepth != 0)
+  {
+    imageStore(uTarget, texel, vec4(texelFetch(uDepth, texel, 0).r));
+    return;
+  }
+
+  ivec2 sourceSize = imageSize(uSource);
+  ivec2 span = ivec2(2) + ivec2(equal(texel, targetSize - 1)) * (sourceSize & 1);
+  float farthest = 0.0;
+  for (int y = 0; y < span.y; y++)
+  {
+    for (int x = 0; x < span.x; x++)
+    {
+      ivec2 source = min(texel * 2 + ivec2(x, y), sourceSize - 1);
+      farthest = max(farthest, imageLoad(uSource, source).r);
+    }
+  }
+  imageStore(uTarget, texel, vec4(farthest));
+}
@@ -0,0 +1,47 @@
+#version 460 core
+// SPH render interpolation: the particles as they were uLag seconds before the last
+// simulation tick, drawn when rendering runs between fixed ticks. The counting sort reorders
+// the two particle buffers every substep, so particle i of the previous buffer is not
+// particle i of the current one; each position is instead taken back along its velocity,
+// held inside the grid box. Density, velocity and pressure are copied as they are.
+
+layout(local_size_x = 256) in;
+
+struct Particle
+{
+  vec3 position;
+  float density;
+  vec3 velocity;
+  float pressure;
+};
+
+layout(binding = 0, std430) restrict readonly buffer particleBuf
+{
+  Particle particles[];
+};
+
+// Live particle count, maintained on the GPU by sph_particle_count.cs
+layout(binding = 24, std430) restrict readonly buffer particleCountBuf
+{
+  uint particleDispatch[3];
+  uint liveParticleCount;
+};
+
+layout(binding = 67, std430) restrict writeonly buffer interpolatedBuf
+{
+  Particle interpolated[];
+};
+
+uniform float uLag;
+uniform vec3 uGridOrigin;
+uniform vec3 uGridSize;
+
+void main()
+{
+  uint id = gl_GlobalInvocationID.x;
+  if (id >= liveParticleCount) return;
+
+  Particle particle = particles[id];
+  particle.position = clamp(particle.position - particle.velocity * uLag, uGridOrigin, uGridOrigin + uGridSize);
+  interpolated[id] = particle;
+}
@@ -0,0 +1,34 @@
+// Particle layout variants, ahead of the reorder and neighbor-loop passes
+// (SPHComputeSystem::layoutDefines()). Step 3, the Morton reorder and the index sort gather
+// write the structure-of-arrays mirror (SPH_SOA_WRITER); steps 4-6 read it with their own
+// declarations. The streams are written here only, so a new one reaches every writer.
+
+#if defined(SPH_SOA_LAYOUT) && defined(SPH_SOA_WRITER)
+// Structure-of-arrays mirror of the sorted particles for the neighbor loops in steps 4-6
+layout(binding = 10, std430) restrict writeonly buffer soaPositionBuf
+{
+  vec4 soaPositions[];
+};
+
+#ifdef SPH_HALF_VELOCITY
+layout(binding = 11, std430) restrict writeonly buffer soaVelocityBuf
+{
+  uvec2 soaVelocities[];
+};
+#else
+layout(binding = 11, std430) restrict writeonly buffer soaVelocityBuf
+{
+  vec4 soaVelocities[];
+};
+#endif
+
+void writeSoAParticle(uint id, vec3 position, vec3 velocity)
+{
+  soaPositions[id] = vec4(position, 0.0);
+#ifdef SPH_HALF_VELOCITY
+  soaVelocities[id] = uvec2(packHalf2x16(velocity.xy), packHalf2x16(vec2(velocity.z, 0.0)));
+#else
+  soaVelocities[id] = vec4(velocity, 0.0);
+#endif
+}
+#endif
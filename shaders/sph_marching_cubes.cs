@@ -0,0 +1,134 @@
+#version 460 core
+// SPH surface extraction, steps 2 and 3: marching cubes over the splatted field, compacted
+// through the step 2 prefix scan. Runs in two phases selected by uPass:
+//   0: classify each cell and write its triangle count
+//   (the CPU scans the counts into per-cell triangle offsets with sph_step2.cs)
+//   1: write each cell's triangles at its offset; the last cell stores the total vertex
+//      count into the DrawArraysIndirectCommand at the head of the mesh buffer
+//
+// Corner i of a cell is node (i & 1, (i >> 1) & 1, (i >> 2) & 1); edge e runs along axis
+// a = e / 4 from the corner with bits (e & 1, (e >> 1) & 1) on the two following axes.
+// The triangle table is generated on the CPU from the same numbering
+// (SPHComputeSystem::buildSurfaceTables).
+
+layout(local_size_x = 256) in;
+
+struct SurfaceVertex
+{
+  vec4 position;
+  vec4 normal;
+};
+
+layout(binding = 2, std430) restrict buffer triangleCountBuf
+{
+  uint triangleCounts[];
+};
+
+layout(binding = 3, std430) restrict readonly buffer triangleOffsetBuf
+{
+  uint triangleOffsets[];
+};
+
+layout(binding = 30, std430) restrict buffer surfaceMeshBuf
+{
+  uint meshVertexCount;
+  uint meshDraw[3];
+  SurfaceVertex vertices[];
+};
+
+// Per case: triangle count, then three edge indices per triangle (uTableStride entries)
+layout(binding = 31, std430) restrict readonly buffer triangleTableBuf
+{
+  uint triangleTable[];
+};
+
+layout(binding = 0) uniform usampler3D uField;
+
+uniform int uPass;
+uniform ivec3 uVolumeRes;       // Nodes per axis; cells are one fewer
+uniform vec3 uVolumeOrigin;
+uniform float uVoxelSize;
+uniform float uFieldScale;
+uniform float uIsoLevel;
+uniform uint uTableStride;
+uniform uint uMaxTriangles;
+
+float field(ivec3 node)
+{
+  return float(texelFetch(uField, clamp(node, ivec3(0), uVolumeRes - 1), 0).r) / uFieldScale;
+}
+
+ivec3 cornerOffset(uint corner)
+{
+  return ivec3(corner & 1u, (corner >> 1) & 1u, (corner >> 2) & 1u);
+}
+
+// Central difference; the field grows into the fluid, so the outward normal is its negation
+vec3 fieldGradient(ivec3 node)
+{
+  return vec3(field(node + ivec3(1, 0, 0)) - field(node - ivec3(1, 0, 0)),
+              field(node + ivec3(0, 1, 0)) - field(node - ivec3(0, 1, 0)),
+              field(node + ivec3(0, 0, 1)) - field(node - ivec3(0, 0, 1)));
+}
+
+SurfaceVertex edgeVertex(ivec3 cell, uint edge, float corners[8])
+{
+  uint axis = edge / 4u;
+  uint lowCorner = ((edge & 1u) << ((axis + 1u) % 3u)) | (((edge >> 1) & 1u) << ((axis + 2u) % 3u));
+  uint highCorner = lowCorner | (1u << axis);
+
+  float f0 = corners[lowCorner];
+  float f1 = corners[highCorner];
+  float t = abs(f1 - f0) > 1e-6 ? clamp((uIsoLevel - f0) / (f1 - f0), 0.0, 1.0) : 0.5;
+
+  ivec3 node0 = cell + cornerOffset(lowCorner);
+  ivec3 node1 = cell + cornerOffset(highCorner);
+  vec3 gradient = mix(fieldGradient(node0), fieldGradient(node1), t);
+
+  SurfaceVertex vertex;
+  vertex.position = vec4(uVolumeOrigin + mix(vec3(node0), vec3(node1), t) * uVoxelSize, 1.0);
+  vertex.normal = vec4(length(gradient) > 0.0 ? -normalize(gradient) : vec3(0.0, 1.0, 0.0), 0.0);
+  return vertex;
+}
+
+void main()
+{
+  ivec3 cellRes = uVolumeRes - 1;
+  uint cellCount = uint(cellRes.x * cellRes.y * cellRes.z);
+  uint cellId = gl_GlobalInvocationID.x;
+  if (cellId >= cellCount) return;
+
+  ivec3 cell = ivec3(cellId % uint(cellRes.x), (cellId / uint(cellRes.x)) % uint(cellRes.y),
+                     cellId / uint(cellRes.x * cellRes.y));
+
+  float corners[8];
+  uint cubeIndex = 0u;
+  for (uint i = 0u; i < 8u; i++)
+  {
+    corners[i] = field(cell + cornerOffset(i));
+    if (corners[i] >= uIsoLevel) cubeIndex |= 1u << i;
+  }
+  uint tableBase = cubeIndex * uTableStride;
+  uint triangles = triangleTable[tableBase];
+
+  if (uPass == 0)
+  {
+    triangleCounts[cellId] = triangles;
+    return;
+  }
+
+  uint firstTriangle = triangleOffsets[cellId];
+  if (cellId == cellCount - 1u)
+  {
+    meshVertexCount = min(firstTriangle + triangles, uMaxTriangles) * 3u;
+  }
+
+  for (uint t = 0u; t < triangles && firstTriangle + t < uMaxTriangles; t++)
+  {
+    for (uint k = 0u; k < 3u; k++)
+    {
+      uint edge = triangleTable[tableBase + 1u + t * 3u + k];
+      vertices[(firstTriangle + t) * 3u + k] = edgeVertex(cell, edge, corners);
+    }
+  }
+}
@@ -0,0 +1,130 @@
+#version 460 core
+// SPH Morton ordering: Z-order key generation and sorted particle gather
+//
+// Phase 0 writes one (key, index) pair per particle for the radix sort.
+// Phase 1 gathers particles in sorted key order and records where each cell starts.
+
+layout(local_size_x = 256) in;
+
+struct Particle
+{
+  vec3 position;
+  float density;
+  vec3 velocity;
+  float pressure;
+};
+
+layout(binding = 0, std430) restrict readonly buffer particleBuf1
+{
+  Particle inParticles[];
+};
+
+layout(binding = 1, std430) restrict writeonly buffer particleBuf2
+{
+  Particle outParticles[];
+};
+
+// Implicit viscosity warm start (sph_viscosity.cs), moved with its particle when enabled
+layout(binding = 51, std430) restrict readonly buffer warmStartBuf1
+{
+  vec4 inWarmStart[];
+};
+
+layout(binding = 52, std430) restrict writeonly buffer warmStartBuf2
+{
+  vec4 outWarmStart[];
+};
+
+uniform int uCarryWarmStart;
+
+layout(binding = 3, std430) restrict writeonly buffer cellStartBuf
+{
+  uint cellStart[];
+};
+
+layout(binding = 6, std430) restrict buffer sortKeyBuf
+{
+  uint sortKeys[];
+};
+
+layout(binding = 7, std430) restrict buffer sortValueBuf
+{
+  uint sortValues[];
+};
+
+// Live particle count, maintained on the GPU by sph_particle_count.cs
+layout(binding = 24, std430) restrict readonly buffer particleCountBuf
+{
+  uint particleDispatch[3];
+  uint liveParticleCount;
+};
+
+uniform uint uParticleCount;  // CPU mirror, an upper bound of the live count
+uniform uint uRemovedKey;     // One bit above every cell key: sorts after all cells
+uniform int uMortonPhase;
+uniform vec3 uInvCellSize;
+uniform vec3 uGridOrigin;
+uniform ivec3 uGridRes;
+
+// Grid resolution of the cell addressing in sph_grid.glsl
+ivec3 gridResolution() { return uGridRes; }
+
+// Spread the low 10 bits of v so there are two zero bits between each
+uint expandBits(uint v)
+{
+  v = (v * 0x00010001u) & 0xFF0000FFu;
+  v = (v * 0x00000101u) & 0x0F00F00Fu;
+  v = (v * 0x00000011u) & 0xC30C30C3u;
+  v = (v * 0x00000005u) & 0x49249249u;
+  return v;
+}
+
+// Inverse of expandBits
+uint compactBits(uint v)
+{
+  v &= 0x09249249u;
+  v = (v ^ (v >> 2)) & 0x030C30C3u;
+  v = (v ^ (v >> 4)) & 0x0300F00Fu;
+  v = (v ^ (v >> 8)) & 0xFF0000FFu;
+  v = (v ^ (v >> 16)) & 0x000003FFu;
+  return v;
+}
+
+void main()
+{
+  uint id = gl_GlobalInvocationID.x;
+  if (id >= uParticleCount) return;
+
+  if (uMortonPhase == 0)
+  {
+    // Particles removed in step 1 and slots past the live count gather behind the live ones
+    if (id >= liveParticleCount || inParticles[id].density < 0.0)
+    {
+      sortKeys[id] = uRemovedKey;
+    }
+    else
+    {
+      ivec3 voxelCoord = ivec3(uInvCellSize * (inParticles[id].position - uGridOrigin));
+      uvec3 cell = uvec3(clamp(voxelCoord, ivec3(0), uGridRes - 1));
+      sortKeys[id] = expandBits(cell.x) | (expandBits(cell.y) << 1) | (expandBits(cell.z) << 2);
+    }
+    sortValues[id] = id;
+  }
+  else
+  {
+    Particle particle = inParticles[sortValues[id]];
+    outParticles[id] = particle;
+    if (uCarryWarmStart != 0) outWarmStart[id] = inWarmStart[sortValues[id]];
+#ifdef SPH_SOA_LAYOUT
+    writeSoAParticle(id, particle.position, particle.velocity);
+#endif
+
+    uint key = sortKeys[id];
+    if (key != uRemovedKey && (id == 0 || sortKeys[id - 1] != key))
+    {
+      uvec3 cell = uvec3(compactBits(key), compactBits(key >> 1), compactBits(key >> 2));
+      uint cellId = gridCell(ivec3(cell));
+      if (cellId != EMPTY_CELL) cellStart[cellId] = id;
+    }
+  }
+}
@@ -0,0 +1,201 @@
+#version 460 core
+// SPH narrow band: below a band of particles a few kernel radii thick the fluid is a
+// hydrostatic bulk, held as fixed-point water heights on a coarse xz grid of columns
+// (SPHConstants::NARROW_BAND_COLUMN_CELLS cells on a side, clipped to the walls). The
+// band's inner edge trades particles with the bulk in phases selected by uBandPhase:
+//   0: each particle counts itself into its column
+//   1: each column takes its band as its particles' volume over its area; a band more than
+//     a layer too thick marks its bottom layer for absorption, a band more than a layer too
+//     thin gets a lattice layer seeded back out of the bulk, appended after the live count
+//     up to uSeedBudget per pass
+//   2: particles below their column's mark are removed for step 3 to compact out and their
+//     volume added to the column
+//   3: seedVolume(): the depth of a box below the band added to the columns it covers
+// One particle's volume is the same fixed-point height both ways, so the exchange
+// conserves volume exactly. Step 1 rests the band on the bulk's top and pushes it down the
+// top's slope.
+
+layout(local_size_x = 64) in;
+
+struct Particle
+{
+  vec3 position;
+  float density;
+  vec3 velocity;
+  float pressure;
+};
+
+layout(binding = 0, std430) restrict buffer particleBuf
+{
+  Particle particles[];
+};
+
+// Live particle count (sph_particle_count.cs): absorbed particles count as removed in the
+// padding of the second record, seeded ones as splits in the padding of the third
+layout(binding = 24, std430) restrict buffer particleCountBuf
+{
+  uint dispatch32[3];
+  uint liveParticleCount;
+  uint dispatch64[3];
+  uint removedParticleCount;
+  uint dispatch256[3];
+  uint splitParticleCount;
+};
+
+#define NARROW_BAND_HEIGHT_SCALE 65536.0
+
+struct BulkColumn
+{
+  int bulk;             // Height above uBulkFloor, fixed point
+  uint particles;       // Band particles counted by phase 0
+  float absorbBelow;    // Phase 2 removes the particles below this height...
+  uint absorb;          // ...when set
+};
+
+layout(binding = 72, std430) restrict buffer bulkColumnBuf
+{
+  BulkColumn columns[];
+};
+
+const float REMOVED_DENSITY = -1.0;
+
+// A sliver of a column inside the walls would turn one particle into a tall column of water
+const float MIN_COLUMN_FRACTION = 0.0625;
+
+uniform int uBandPhase;
+uniform vec2 uColumnOrigin;       // xz of column (0, 0)'s lower corner
+uniform ivec2 uColumnRes;
+uniform float uColumnSize;
+uniform vec2 uWallMin;            // xz the particles are kept within (step 1's walls)
+uniform vec2 uWallMax;
+uniform float uBulkFloor;
+uniform float uBandDepth;         // Band thickness kept above the bulk
+uniform float uLayer;             // Particle spacing, the thickness of one lattice layer
+uniform float uParticleHeight;    // One particle's volume over a whole column, fixed point
+uniform uint uSeedBudget;
+uniform float uRestDensity;
+uniform vec2 uFillMin;            // Phase 3: the box's xz footprint...
+uniform vec2 uFillMax;
+uniform float uFillHeight;        // ...and the height it adds under it
+
+ivec2 columnOf(vec3 position)
+{
+  return clamp(ivec2(floor((position.xz - uColumnOrigin) / uColumnSize)), ivec2(0), uColumnRes - 1);
+}
+
+// xz min and max of a column's part inside the walls
+vec4 columnRect(ivec2 column)
+{
+  vec2 lower = uColumnOrigin + vec2(column) * uColumnSize;
+  return vec4(max(lower, uWallMin), min(lower + uColumnSize, uWallMax));
+}
+
+float rectArea(vec4 rect)
+{
+  vec2 size = max(rect.zw - rect.xy, vec2(0.0));
+  return size.x * size.y;
+}
+
+// Fixed-point height of one particle's volume spread over the column's part inside the walls
+int particleHeight(vec4 rect)
+{
+  float fraction = rectArea(rect) / (uColumnSize * uColumnSize);
+  return int(round(uParticleHeight / max(fraction, MIN_COLUMN_FRACTION)));
+}
+
+void measureColumn(uint id, vec4 rect)
+{
+  uint count = columns[id].particles;
+  int bulk = columns[id].bulk;
+  columns[id].particles = 0u;
+  columns[id].absorb = 0u;
+
+  int unit = particleHeight(rect);
+  float thickness = float(count) * float(unit) / NARROW_BAND_HEIGHT_SCALE;
+  float top = uBulkFloor + float(bulk) / NARROW_BAND_HEIGHT_SCALE;
+  if (thickness > uBandDepth + uLayer)
+  {
+    columns[id].absorbBelow = top + uLayer;
+    columns[id].absorb = 1u;
+    return;
+  }
+  if (thickness >= uBandDepth - uLayer) return;
+
+  // One lattice layer over the column, only when the bulk holds all of it
+  vec2 size = rect.zw - rect.xy;
+  ivec2 lattice = max(ivec2(round(size / uLayer)), ivec2(1));
+  uint seeds = uint(lattice.x * lattice.y);
+  int released = int(seeds) * unit;
+  if (released > bulk) return;
+
+  // Reserve the whole layer or nothing, so no slot inside the budget is left unwritten
+  uint base = splitParticleCount;
+  while (true)
+  {
+    if (base + seeds > uSeedBudget) return;
+    uint previous = atomicCompSwap(splitParticleCount, base, base + seeds);
+    if (previous == base) break;
+    base = previous;
+  }
+
+  bulk -= released;
+  columns[id].bulk = bulk;
+  float y = uBulkFloor + (float(bulk) + 0.5 * float(released)) / NARROW_BAND_HEIGHT_SCALE;
+  vec2 spacing = size / vec2(lattice);
+
+  Particle seed;
+  seed.density = uRestDensity;
+  seed.velocity = vec3(0.0);
+  seed.pressure = 0.0;    // Phase 0, time level 0
+  for (int z = 0; z < lattice.y; z++)
+  {
+    for (int x = 0; x < lattice.x; x++)
+    {
+      vec2 xz = rect.xy + (vec2(x, z) + 0.5) * spacing;
+      seed.position = vec3(xz.x, y, xz.y);
+      particles[liveParticleCount + base + uint(x + lattice.x * z)] = seed;
+    }
+  }
+}
+
+void main()
+{
+  uint id = gl_GlobalInvocationID.x;
+
+  if (uBandPhase == 1 || uBandPhase == 3)
+  {
+    if (id >= uint(uColumnRes.x * uColumnRes.y)) return;
+    ivec2 column = ivec2(int(id) % uColumnRes.x, int(id) / uColumnRes.x);
+    vec4 rect = columnRect(column);
+    float area = rectArea(rect);
+    if (area <= 0.0) return;
+
+    if (uBandPhase == 1)
+    {
+      measureColumn(id, rect);
+      return;
+    }
+    vec2 overlap = max(min(rect.zw, uFillMax) - max(rect.xy, uFillMin), vec2(0.0));
+    int height = int(round(uFillHeight * NARROW_BAND_HEIGHT_SCALE * overlap.x * overlap.y / area));
+    if (height > 0) atomicAdd(columns[id].bulk, height);
+    return;
+  }
+
+  if (id >= liveParticleCount) return;
+  Particle particle = particles[id];
+  if (particle.density < 0.0) return;
+
+  ivec2 column = columnOf(particle.position);
+  uint index = uint(column.x + uColumnRes.x * column.y);
+  if (uBandPhase == 0)
+  {
+    atomicAdd(columns[index].particles, 1u);
+    return;
+  }
+
+  if (columns[index].absorb == 0u || particle.position.y >= columns[index].absorbBelow) return;
+  atomicAdd(columns[index].bulk, particleHeight(columnRect(column)));
+  particle.density = REMOVED_DENSITY;
+  particles[id] = particle;
+  atomicAdd(removedParticleCount, 1u);
+}
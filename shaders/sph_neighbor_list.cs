@@ -0,0 +1,140 @@
+#version 460 core
+// SPH Verlet neighbor lists: rebuilt only when some particle moved more than half the skin
+//
+// Particles keep their buffer order while lists are in use, so the grid is built over
+// particle indices instead of reordering the particles themselves. Every phase returns
+// immediately unless step 1 raised the rebuild flag.
+//   0: count particles per cell
+//   1: scatter particle indices into cell order (cursors seeded by the step 2 scan)
+//   2: gather neighbors within kernel radius + skin and record reference positions
+
+layout(local_size_x = 64) in;
+
+struct Particle
+{
+  vec3 position;
+  float density;
+  vec3 velocity;
+  float pressure;
+};
+
+layout(binding = 0, std430) restrict readonly buffer particleBuf
+{
+  Particle particles[];
+};
+
+layout(binding = 2, std430) restrict buffer cellCountBuf
+{
+  uint cellCount[];
+};
+
+layout(binding = 3, std430) restrict readonly buffer cellStartBuf
+{
+  uint cellStart[];
+};
+
+layout(binding = 4, std430) restrict buffer cellCursorBuf
+{
+  uint cellCursor[];
+};
+
+layout(binding = 13, std430) restrict readonly buffer rebuildFlagBuf
+{
+  uint rebuildFlag;
+};
+
+layout(binding = 14, std430) restrict buffer sortedIndexBuf
+{
+  uint sortedIndices[];
+};
+
+layout(binding = 15, std430) restrict writeonly buffer neighborCountBuf
+{
+  uint neighborCounts[];
+};
+
+layout(binding = 16, std430) restrict writeonly buffer neighborListBuf
+{
+  uint neighborList[];
+};
+
+layout(binding = 17, std430) restrict writeonly buffer referencePositionBuf
+{
+  vec4 referencePositions[];
+};
+
+// Live particle count, maintained on the GPU by sph_particle_count.cs
+layout(binding = 24, std430) restrict readonly buffer particleCountBuf
+{
+  uint particleDispatch[3];
+  uint liveParticleCount;
+};
+uniform uint uListStride;
+uniform uint uNeighborLimit;
+uniform float uSearchRadius;
+uniform int uListPhase;
+uniform int uCellRange;
+uniform vec3 uInvCellSize;
+uniform vec3 uGridOrigin;
+uniform ivec3 uGridRes;
+
+// Grid resolution of the cell addressing in sph_grid.glsl
+ivec3 gridResolution() { return uGridRes; }
+
+void main()
+{
+  if (rebuildFlag == 0) return;
+
+  uint particleId = gl_GlobalInvocationID.x;
+  if (particleId >= liveParticleCount) return;
+
+  vec3 position = particles[particleId].position;
+  ivec3 voxelId = clamp(ivec3(uInvCellSize * (position - uGridOrigin)), ivec3(0), uGridRes - 1);
+
+  if (uListPhase == 0)
+  {
+    atomicAdd(cellCount[denseCell(voxelId)], 1);
+  }
+  else if (uListPhase == 1)
+  {
+    uint slot = atomicAdd(cellCursor[denseCell(voxelId)], 1);
+    sortedIndices[slot] = particleId;
+  }
+  else
+  {
+    // The search radius includes the skin, so it can reach past the adjacent cells;
+    // uCellRange covers ceil(radius / cell size) rings around the particle's cell
+    uint count = 0;
+    float searchRadius2 = uSearchRadius * uSearchRadius;
+    ivec3 voxelMin = max(voxelId - uCellRange, ivec3(0));
+    ivec3 voxelMax = min(voxelId + uCellRange, uGridRes - 1);
+
+    for (int z = voxelMin.z; z <= voxelMax.z; z++)
+    {
+      for (int y = voxelMin.y; y <= voxelMax.y; y++)
+      {
+        for (int x = voxelMin.x; x <= voxelMax.x; x++)
+        {
+          uint cellId = denseCell(ivec3(x, y, z));
+          uint start = cellStart[cellId];
+          uint end = start + cellCount[cellId];
+
+          for (uint j = start; j < end && count < uNeighborLimit; j++)
+          {
+            uint otherId = sortedIndices[j];
+            vec3 r = position - particles[otherId].position;
+            if (dot(r, r) < searchRadius2)
+            {
+              // Interleaved by slot so consecutive particles read consecutive words
+              neighborList[count * uListStride + particleId] = otherId;
+              count++;
+            }
+          }
+        }
+      }
+    }
+
+    neighborCounts[particleId] = count;
+    referencePositions[particleId] = vec4(position, 0.0);
+  }
+}
@@ -0,0 +1,79 @@
+#version 460 core
+// SPH obstacle field: bakes the container walls and every static obstacle into one signed
+// distance field over the simulation domain, so step 1 resolves all collisions with a
+// single trilinear fetch. Texel i is centred at uGridOrigin + (i + 0.5) * uVoxelSize;
+// rgb is the unit normal pointing into free space and a the distance, positive where
+// particles may go and negative inside an obstacle or past the walls. Batched scenes
+// repeat the walls and obstacles every uSceneStride along x.
+
+layout(local_size_x = 4, local_size_y = 4, local_size_z = 4) in;
+
+#define OBSTACLE_SPHERE 0.0
+#define OBSTACLE_BOX 1.0
+
+struct Obstacle
+{
+  vec4 centerType;   // xyz centre, w OBSTACLE_SPHERE or OBSTACLE_BOX
+  vec4 size;         // Sphere: x radius; box: xyz half extents
+};
+
+layout(binding = 36, std430) restrict readonly buffer obstacleBuf
+{
+  Obstacle obstacles[];
+};
+
+layout(rgba16f, binding = 0) uniform restrict writeonly image3D uObstacleField;
+
+uniform ivec3 uFieldRes;
+uniform vec3 uGridOrigin;
+uniform vec3 uVoxelSize;
+uniform vec3 uWallMin;      // Box the particle centres are kept in
+uniform vec3 uWallMax;
+uniform int uObstacleCount;
+uniform float uSceneStride;
+uniform int uSceneCount;
+
+float boxDistance(vec3 p, vec3 halfExtents)
+{
+  vec3 q = abs(p) - halfExtents;
+  return length(max(q, vec3(0.0))) + min(max(q.x, max(q.y, q.z)), 0.0);
+}
+
+float freeDistance(vec3 p)
+{
+  // Into the coordinates of the first scene, which the walls and obstacles are given in
+  int scene = clamp(int(floor((p.x - uGridOrigin.x) / uSceneStride)), 0, uSceneCount - 1);
+  p.x -= float(scene) * uSceneStride;
+
+  // Inside the walls: distance to the nearest wall plane
+  vec3 toWalls = min(p - uWallMin, uWallMax - p);
+  float distance = min(toWalls.x, min(toWalls.y, toWalls.z));
+
+  for (int i = 0; i < uObstacleCount; i++)
+  {
+    vec3 local = p - obstacles[i].centerType.xyz;
+    float obstacleDistance = obstacles[i].centerType.w == OBSTACLE_SPHERE
+                           ? length(local) - obstacles[i].size.x
+                           : boxDistance(local, obstacles[i].size.xyz);
+    distance = min(distance, obstacleDistance);
+  }
+  return distance;
+}
+
+void main()
+{
+  ivec3 texel = ivec3(gl_GlobalInvocationID);
+  if (any(greaterThanEqual(texel, uFieldRes))) return;
+
+  vec3 p = uGridOrigin + (vec3(texel) + 0.5) * uVoxelSize;
+  float distance = freeDistance(p);
+
+  // Central differences of the analytic field give the normal
+  vec3 e = 0.5 * uVoxelSize;
+  vec3 gradient = vec3(freeDistance(p + vec3(e.x, 0.0, 0.0)) - freeDistance(p - vec3(e.x, 0.0, 0.0)),
+                       freeDistance(p + vec3(0.0, e.y, 0.0)) - freeDistance(p - vec3(0.0, e.y, 0.0)),
+                       freeDistance(p + vec3(0.0, 0.0, e.z)) - freeDistance(p - vec3(0.0, 0.0, e.z)));
+  vec3 normal = dot(gradient, gradient) > 0.0 ? normalize(gradient) : vec3(0.0, 1.0, 0.0);
+
+  imageStore(uObstacleField, texel, vec4(normal, distance));
+}
@@ -0,0 +1,49 @@
+#version 460 core
+// SPH live particle count: advances the GPU-resident count after spawning, or drops the
+// particles step 1 removed once the step 3 reorder has compacted them out, and rebuilds
+// the indirect dispatch commands for each particle-parallel local size from it
+
+layout(local_size_x = 1) in;
+
+// Three DispatchIndirectCommand records, each padded to 16 bytes; the count rides in the
+// padding of the first so shaders can read it from the same binding, step 1 counts
+// removed particles in the padding of the second and sph_adaptive.cs its split particles
+// in the padding of the third
+layout(binding = 24, std430) restrict buffer particleCountBuf
+{
+  uint dispatch32[3];
+  uint liveParticleCount;
+  uint dispatch64[3];
+  uint removedParticleCount;
+  uint dispatch256[3];
+  uint splitParticleCount;
+};
+
+uniform uint uSpawnCount;
+uniform uint uCapacity;
+uniform int uCompact;
+uniform int uAddSplits;     // Advance by the adaptive splits, at most uSpawnCount of them
+
+void main()
+{
+  uint count;
+  if (uCompact != 0)
+  {
+    count = liveParticleCount - min(removedParticleCount, liveParticleCount);
+    removedParticleCount = 0;
+  }
+  else if (uAddSplits != 0)
+  {
+    count = min(liveParticleCount + min(splitParticleCount, uSpawnCount), uCapacity);
+    splitParticleCount = 0;
+  }
+  else
+  {
+    count = min(liveParticleCount + uSpawnCount, uCapacity);
+  }
+  liveParticleCount = count;
+
+  dispatch32[0] = (count + 31) / 32;
+  dispatch64[0] = (count + 63) / 64;
+  dispatch256[0] = (count + 255) / 256;
+}
@@ -0,0 +1,302 @@
+#version 460 core
+// SPH PCISPH pressure solver: predictive-corrective iterations replacing step 6
+//
+// Runs after step 5 (density at the current positions) in phases selected by uPhase:
+//   0: non-pressure acceleration (viscosity + gravity), zero pressure and pressure acceleration
+//   1: predict velocity and position from the current pressure acceleration
+//   2: density at the predicted positions, pressure update, max density error
+//   3: pressure acceleration at the predicted positions
+//   4: single invocation convergence test and error reset
+//   5: final velocity update
+// Phases 1-3 return immediately once phase 4 has marked the solve converged, so the CPU
+// can issue the maximum iteration count without reading anything back.
+
+#ifdef SPH_SUBGROUPS
+#extension GL_KHR_shader_subgroup_basic : require
+#extension GL_KHR_shader_subgroup_arithmetic : require
+#endif
+
+#ifndef SPH_WORKGROUP_SIZE
+#define SPH_WORKGROUP_SIZE 64 // Injected by SPHComputeSystem
+#endif
+
+layout(local_size_x = SPH_WORKGROUP_SIZE) in;
+
+struct Particle
+{
+  vec3 position;
+  float density;
+  vec3 velocity;
+  float pressure;
+};
+
+struct SolverParticle
+{
+  vec4 predictedPosition;   // w = pressure
+  vec4 nonPressureAccel;
+  vec4 pressureAccel;
+};
+
+layout(binding = 0, std430) restrict buffer particleBuf
+{
+  Particle particles[];
+};
+
+layout(binding = 2, std430) restrict readonly buffer cellCountBuf
+{
+  uint cellCount[];
+};
+
+layout(binding = 3, std430) restrict readonly buffer cellStartBuf
+{
+  uint cellStart[];
+};
+
+// Live particle count, maintained on the GPU by sph_particle_count.cs
+layout(binding = 24, std430) restrict readonly buffer particleCountBuf
+{
+  uint particleDispatch[3];
+  uint liveParticleCount;
+};
+
+layout(binding = 26, std430) restrict buffer solverParticleBuf
+{
+  SolverParticle solver[];
+};
+
+layout(binding = 27, std430) restrict buffer solverStateBuf
+{
+  uint maxDensityErrorBits;
+  uint converged;
+  uint iterations;
+  uint lastDensityErrorBits;
+};
+
+uniform int uPhase;
+// Substep constants shared by the simulation passes, uploaded once per substep
+// (SPHParameterBlock)
+layout(std140, binding = 0) uniform SPHParameters
+{
+  vec3 uGridOrigin;
+  float uDT;
+  vec3 uGridSize;
+  float uMaxVelocity;
+  vec3 uInvCellSize;
+  float uWallDamping;         // Fraction of the normal velocity kept by a wall bounce
+  ivec3 uGridRes;
+  float uSceneStride;         // Batched scenes: x offset between the scenes
+  vec3 uGravity;
+  int uSceneCount;
+  vec3 uStepGravity;          // Gravity step 1 integrates; zero when PCISPH does
+  int uBatchScenes;           // Scene count, 0 when not batched
+  float uParticleMass;
+  float uHalfSkinSq;
+  uint uListStride;
+  int uUseNeighborList;
+  int uDiffusePotentials;
+  int uParticleSleeping;
+  uint uSleepSubsteps;
+  float uSleepVelocity;
+  float uSleepDensityChange;  // Relative density change per substep
+};
+
+// Grid resolution of the cell addressing in sph_grid.glsl
+ivec3 gridResolution() { return uGridRes; }
+
+uniform float uDelta;              // Pressure scaling factor for this dt
+uniform float uErrorThreshold;     // Relative density error
+uniform uint uMinIterations;
+uniform int uImplicitViscosity;  // sph_viscosity.cs applies the viscosity after this pass
+
+// Fluid parameters, injected as #defines by SPHComputeSystem (defaults match SPHConstants)
+#ifndef SPH_MASS
+#define SPH_MASS 0.02
+#endif
+#ifndef SPH_KERNEL_RADIUS
+#define SPH_KERNEL_RADIUS 0.1828
+#endif
+#ifndef SPH_REST_DENSITY
+#define SPH_REST_DENSITY 998.27
+#endif
+#ifndef SPH_VISCOSITY
+#define SPH_VISCOSITY 0.035
+#endif
+
+// SPH constants (the CPU-side scaling factor is computed from the same parameter set)
+const float MASS = SPH_MASS;
+const float KERNEL_RADIUS = SPH_KERNEL_RADIUS;
+const float REST_DENSITY = SPH_REST_DENSITY;
+const float VIS_COEFF = SPH_VISCOSITY;
+const float POLY6_KERNEL_WEIGHT_CONST = 315.0 / (64.0 * 3.14159265 * pow(KERNEL_RADIUS, 9));
+const float SPIKY_GRADIENT_CONST = 45.0 / (3.14159265 * pow(KERNEL_RADIUS, 6));
+const float VIS_KERNEL_WEIGHT_CONST = 45.0 / (3.14159265 * pow(KERNEL_RADIUS, 6));
+
+// Batched scenes (SPHComputeSystem::setBatchScenes): a particle's scene is the slab of
+// uSceneStride along x it is in, and that scene's parameters replace the compiled viscosity
+layout(binding = 41, std430) restrict readonly buffer sceneParameterBuf
+{
+  vec4 sceneParameters[];  // Stiffness, viscosity, unused, unused
+};
+
+float sceneViscosity(vec3 position)
+{
+  if (uImplicitViscosity != 0) return 0.0;
+  if (uBatchScenes == 0) return VIS_COEFF;
+  int scene = clamp(int(floor((position.x - uGridOrigin.x) / uSceneStride)), 0, uBatchScenes - 1);
+  return sceneParameters[scene].y;
+}
+
+// Multiphase, adaptive resolution and multirate stepping: the particle tags in the low
+// mantissa bits of the pressure (sph_tags.glsl) are carried over; the solve itself treats
+// the fluid as one phase at one resolution and one rate
+
+// Particle range of neighbor cell n (0-26) around voxel, empty outside the grid
+void neighborRange(ivec3 voxel, int n, out uint start, out uint end)
+{
+  ivec3 neighbor = voxel + ivec3(n % 3, (n / 3) % 3, n / 9) - 1;
+  start = 0;
+  end = 0;
+  if (any(lessThan(neighbor, ivec3(0))) || any(greaterThanEqual(neighbor, uGridRes))) return;
+
+  uint cellId = gridCell(neighbor);
+  if (cellId == EMPTY_CELL) return;
+  start = cellStart[cellId];
+  end = start + cellCount[cellId];
+}
+
+vec3 spikyGradient(vec3 r, float rLen)
+{
+  return -SPIKY_GRADIENT_CONST * (KERNEL_RADIUS - rLen) * (KERNEL_RADIUS - rLen) * (r / rLen);
+}
+
+void main()
+{
+  if (uPhase == 4)
+  {
+    if (gl_GlobalInvocationID.x != 0 || converged != 0) return;
+
+    iterations++;
+    float maxError = uintBitsToFloat(maxDensityErrorBits);
+    lastDensityErrorBits = maxDensityErrorBits;
+    if (iterations >= uMinIterations && maxError < uErrorThreshold)
+    {
+      converged = 1;
+    }
+    maxDensityErrorBits = 0;
+    return;
+  }
+
+  uint particleId = gl_GlobalInvocationID.x;
+  if (particleId >= liveParticleCount) return;
+  if (converged != 0 && uPhase >= 1 && uPhase <= 3) return;
+
+  Particle particle = particles[particleId];
+  ivec3 voxelId = ivec3(uInvCellSize * (particle.position - uGridOrigin));
+
+  if (uPhase == 0)
+  {
+    vec3 forceViscosity = vec3(0.0);
+    for (int n = 0; n < 27; n++)
+    {
+      uint start, end;
+      neighborRange(voxelId, n, start, end);
+      for (uint slot = start; slot < end; slot++)
+      {
+        uint j = cellParticle(slot);
+        if (j == particleId) continue;
+
+        vec3 r = particle.position - particles[j].position;
+        float rLen = length(r);
+        if (rLen >= KERNEL_RADIUS) continue;
+
+        float weightVis = VIS_KERNEL_WEIGHT_CONST * (KERNEL_RADIUS - rLen);
+        forceViscosity += (MASS * (particles[j].velocity - particle.velocity) * weightVis) / particles[j].density;
+      }
+    }
+
+    vec3 accel = uGravity;
+    if (particle.density > 0.0)
+    {
+      accel += (forceViscosity * sceneViscosity(particle.position)) / particle.density;
+    }
+
+    solver[particleId].predictedPosition = vec4(particle.position, 0.0);
+    solver[particleId].nonPressureAccel = vec4(accel, 0.0);
+    solver[particleId].pressureAccel = vec4(0.0);
+  }
+  else if (uPhase == 1)
+  {
+    vec3 velocity = particle.velocity + uDT * (solver[particleId].nonPressureAccel.xyz + solver[particleId].pressureAccel.xyz);
+    solver[particleId].predictedPosition.xyz = particle.position + uDT * velocity;
+  }
+  else if (uPhase == 2)
+  {
+    vec3 predicted = solver[particleId].predictedPosition.xyz;
+    float density = 0.0;
+    for (int n = 0; n < 27; n++)
+    {
+      uint start, end;
+      neighborRange(voxelId, n, start, end);
+      for (uint slot = start; slot < end; slot++)
+      {
+        uint j = cellParticle(slot);
+        vec3 r = predicted - solver[j].predictedPosition.xyz;
+        float r2 = dot(r, r);
+        if (r2 >= KERNEL_RADIUS * KERNEL_RADIUS) continue;
+
+        float w = KERNEL_RADIUS * KERNEL_RADIUS - r2;
+        density += MASS * POLY6_KERNEL_WEIGHT_CONST * w * w * w;
+      }
+    }
+
+    // Only compression is corrected; free-surface particles would otherwise be pulled inward
+    float densityError = max(density - REST_DENSITY, 0.0);
+    float pressure = max(solver[particleId].predictedPosition.w + uDelta * densityError, 0.0);
+    solver[particleId].predictedPosition.w = pressure;
+    particles[particleId].pressure = withTags(pressure, particleTags(particle.pressure));
+
+#ifdef SPH_SUBGROUPS
+    // One atomic per subgroup; the error is non-negative, so its bits order like the floats
+    float subgroupError = subgroupMax(densityError / REST_DENSITY);
+    if (subgroupElect())
+    {
+      atomicMax(maxDensityErrorBits, floatBitsToUint(subgroupError));
+    }
+#else
+    atomicMax(maxDensityErrorBits, floatBitsToUint(densityError / REST_DENSITY));
+#endif
+  }
+  else if (uPhase == 3)
+  {
+    vec4 self = solver[particleId].predictedPosition;
+    float selfTerm = self.w / (REST_DENSITY * REST_DENSITY);
+    vec3 accel = vec3(0.0);
+    for (int n = 0; n < 27; n++)
+    {
+      uint start, end;
+      neighborRange(voxelId, n, start, end);
+      for (uint slot = start; slot < end; slot++)
+      {
+        uint j = cellParticle(slot);
+        if (j == particleId) continue;
+
+        vec4 other = solver[j].predictedPosition;
+        vec3 r = self.xyz - other.xyz;
+        float rLen = length(r);
+        if (rLen >= KERNEL_RADIUS || rLen <= 0.0001) continue;
+
+        accel -= MASS * (selfTerm + other.w / (REST_DENSITY * REST_DENSITY)) * spikyGradient(r, rLen);
+      }
+    }
+    solver[particleId].pressureAccel = vec4(accel, 0.0);
+  }
+  else
+  {
+    vec3 velocity = particle.velocity + uDT * (solver[particleId].nonPressureAccel.xyz + solver[particleId].pressureAccel.xyz);
+    if (length(velocity) > uMaxVelocity)
+    {
+      velocity = normalize(velocity) * uMaxVelocity;
+    }
+    particles[particleId].velocity = velocity;
+  }
+}
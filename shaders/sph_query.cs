@@ -0,0 +1,153 @@
+#version 460 core
+// SPH water queries (WaterQueries): the fluid around each query point from the grid of the
+// last substep. Poly6 density and the density-weighted velocity over the 27 cells around
+// the point; the submerged fraction is the density over rest density, the normal points
+// down the density gradient, and the surface height is where the density, extrapolated
+// along that gradient, falls to half the rest density (a local estimate, good within a
+// kernel radius of the surface; the point's own height away from it).
+
+layout(local_size_x = 64) in;
+
+layout(binding = 2, std430) restrict readonly buffer cellCountBuf
+{
+  uint cellCount[];
+};
+
+layout(binding = 3, std430) restrict readonly buffer cellStartBuf
+{
+  uint cellStart[];
+};
+
+struct Particle
+{
+  vec3 position;
+  float density;
+  vec3 velocity;
+  float pressure;
+};
+
+layout(binding = 0, std430) restrict readonly buffer particleBuf
+{
+  Particle particles[];
+};
+
+layout(binding = 68, std430) restrict readonly buffer queryPointBuf
+{
+  vec4 points[];
+};
+
+struct Result
+{
+  vec4 normalHeight;      // xyz normal, w surface height
+  vec4 velocityFraction;  // xyz fluid velocity, w submerged fraction
+};
+
+layout(binding = 69, std430) restrict writeonly buffer queryResultBuf
+{
+  Result results[];
+};
+
+uniform uint uQueryCount;
+
+// Substep constants shared by the simulation passes, uploaded once per substep
+// (SPHParameterBlock)
+layout(std140, binding = 0) uniform SPHParameters
+{
+  vec3 uGridOrigin;
+  float uDT;
+  vec3 uGridSize;
+  float uMaxVelocity;
+  vec3 uInvCellSize;
+  float uWallDamping;         // Fraction of the normal velocity kept by a wall bounce
+  ivec3 uGridRes;
+  float uSceneStride;         // Batched scenes: x offset between the scenes
+  vec3 uGravity;
+  int uSceneCount;
+  vec3 uStepGravity;          // Gravity step 1 integrates; zero when PCISPH does
+  int uBatchScenes;           // Scene count, 0 when not batched
+  float uParticleMass;
+  float uHalfSkinSq;
+  uint uListStride;
+  int uUseNeighborList;
+  int uDiffusePotentials;
+  int uParticleSleeping;
+  uint uSleepSubsteps;
+  float uSleepVelocity;
+  float uSleepDensityChange;  // Relative density change per substep
+};
+
+// Grid resolution of the cell addressing in sph_grid.glsl
+ivec3 gridResolution() { return uGridRes; }
+
+// Fluid parameters, injected as #defines by SPHComputeSystem (defaults match SPHConstants)
+#ifndef SPH_KERNEL_RADIUS
+#define SPH_KERNEL_RADIUS 0.1828
+#endif
+#ifndef SPH_REST_DENSITY
+#define SPH_REST_DENSITY 1000.0
+#endif
+
+const float KERNEL_RADIUS = SPH_KERNEL_RADIUS;
+const float REST_DENSITY = SPH_REST_DENSITY;
+const float POLY6_KERNEL_WEIGHT_CONST = 315.0 / (64.0 * 3.14159265 * pow(KERNEL_RADIUS, 9));
+const float POLY6_GRADIENT_CONST = -945.0 / (32.0 * 3.14159265 * pow(KERNEL_RADIUS, 9));
+
+void main()
+{
+  uint id = gl_GlobalInvocationID.x;
+  if (id >= uQueryCount) return;
+
+  vec3 point = points[id].xyz;
+  ivec3 cell = ivec3(floor((point - uGridOrigin) * uInvCellSize));
+
+  float density = 0.0;
+  vec3 gradient = vec3(0.0);
+  vec3 momentum = vec3(0.0);
+
+  for (int z = -1; z <= 1; z++)
+  {
+    for (int y = -1; y <= 1; y++)
+    {
+      for (int x = -1; x <= 1; x++)
+      {
+        ivec3 neighborCell = cell + ivec3(x, y, z);
+        if (any(lessThan(neighborCell, ivec3(0))) || any(greaterThanEqual(neighborCell, uGridRes))) continue;
+        uint cellId = gridCell(neighborCell);
+        if (cellId == EMPTY_CELL) continue;
+
+        uint first = cellStart[cellId];
+        uint end = first + cellCount[cellId];
+        for (uint slot = first; slot < end; slot++)
+        {
+          Particle particle = particles[cellParticle(slot)];
+          vec3 r = point - particle.position;
+          float diff = KERNEL_RADIUS * KERNEL_RADIUS - dot(r, r);
+          if (diff <= 0.0) continue;
+
+          float weight = uParticleMass * POLY6_KERNEL_WEIGHT_CONST * diff * diff * diff;
+          density += weight;
+          gradient += uParticleMass * POLY6_GRADIENT_CONST * diff * diff * r;
+          momentum += particle.velocity * weight;
+        }
+      }
+    }
+  }
+
+  // Outside the fluid the normal is up and the surface is the point itself
+  Result result;
+  result.normalHeight = vec4(0.0, 1.0, 0.0, point.y);
+  result.velocityFraction = vec4(0.0, 0.0, 0.0, clamp(density / REST_DENSITY, 0.0, 1.0));
+  if (density > 0.0)
+  {
+    result.velocityFraction.xyz = momentum / density;
+    float slope = length(gradient);
+    if (slope > 1e-3 * REST_DENSITY / KERNEL_RADIUS)
+    {
+      result.normalHeight.xyz = -gradient / slope;
+      float rise = (density - 0.5 * REST_DENSITY) / max(-gradient.y, slope * 0.25);
+      result.normalHeight.w = point.y + clamp(rise, -KERNEL_RADIUS, KERNEL_RADIUS);
+    }
+  }
+
+  results[id] = result;
+}
@@ -0,0 +1,92 @@
+#version 460 core
+// SPH radix sort: one 8-bit digit pass of a stable LSD radix sort over (key, value) pairs
+//
+// Phase 0 builds a per-workgroup digit histogram laid out digit-major so that an
+// exclusive scan of it (sph_step2.cs) yields every block's output offset per digit.
+// Phase 1 scatters each pair to its scanned offset plus its stable rank in the block.
+
+#define RADIX_BLOCK_SIZE 256
+#define RADIX_BINS 256
+
+layout(local_size_x = RADIX_BLOCK_SIZE) in;
+
+layout(binding = 2, std430) restrict writeonly buffer histogramBuf
+{
+  uint histogram[];
+};
+
+layout(binding = 3, std430) restrict readonly buffer offsetBuf
+{
+  uint digitOffsets[];
+};
+
+layout(binding = 6, std430) restrict readonly buffer keyInBuf
+{
+  uint keysIn[];
+};
+
+layout(binding = 7, std430) restrict readonly buffer valueInBuf
+{
+  uint valuesIn[];
+};
+
+layout(binding = 8, std430) restrict writeonly buffer keyOutBuf
+{
+  uint keysOut[];
+};
+
+layout(binding = 9, std430) restrict writeonly buffer valueOutBuf
+{
+  uint valuesOut[];
+};
+
+uniform uint uParticleCount;
+uniform uint uBlockCount;
+uniform uint uShift;
+uniform int uRadixPhase;
+
+shared uint localHistogram[RADIX_BINS];
+shared uint localDigits[RADIX_BLOCK_SIZE];
+
+void main()
+{
+  uint id = gl_GlobalInvocationID.x;
+  uint localId = gl_LocalInvocationID.x;
+  uint blockId = gl_WorkGroupID.x;
+
+  bool active = id < uParticleCount;
+  uint key = active ? keysIn[id] : 0;
+  uint digit = active ? (key >> uShift) & (RADIX_BINS - 1) : RADIX_BINS;
+
+  if (uRadixPhase == 0)
+  {
+    localHistogram[localId] = 0;
+    barrier();
+
+    if (active)
+    {
+      atomicAdd(localHistogram[digit], 1);
+    }
+    barrier();
+
+    histogram[localId * uBlockCount + blockId] = localHistogram[localId];
+  }
+  else
+  {
+    localDigits[localId] = digit;
+    barrier();
+
+    if (!active) return;
+
+    // Rank among earlier pairs in this block with the same digit keeps the sort stable
+    uint rank = 0;
+    for (uint i = 0; i < localId; i++)
+    {
+      rank += localDigits[i] == digit ? 1 : 0;
+    }
+
+    uint dst = digitOffsets[digit * uBlockCount + blockId] + rank;
+    keysOut[dst] = key;
+    valuesOut[dst] = valuesIn[id];
+  }
+}
@@ -0,0 +1,179 @@
+#version 460 core
+// SPH statistics reduction: min/max/mean particle speed and density
+//
+// Runs in two phases selected by uReducePhase:
+//   0: per-workgroup shared-memory tree over the particles into partial results
+//   1: single workgroup reduction of the partials into the final statistics
+//
+// With SPH_SUBGROUPS each level combines in registers with subgroup min/max/add and only
+// one value per subgroup goes through shared memory.
+
+#ifdef SPH_SUBGROUPS
+#extension GL_KHR_shader_subgroup_basic : require
+#extension GL_KHR_shader_subgroup_arithmetic : require
+#endif
+
+#define REDUCE_BLOCK_SIZE 256
+
+layout(local_size_x = REDUCE_BLOCK_SIZE) in;
+
+struct Particle
+{
+  vec3 position;
+  float density;
+  vec3 velocity;
+  float pressure;
+};
+
+// x = min, y = max, z = sum (mean after phase 1)
+struct Statistics
+{
+  vec4 speed;
+  vec4 density;
+};
+
+layout(binding = 0, std430) restrict readonly buffer particleBuf
+{
+  Particle particles[];
+};
+
+layout(binding = 19, std430) restrict writeonly buffer statisticsBuf
+{
+  Statistics statistics;
+};
+
+layout(binding = 20, std430) restrict buffer partialBuf
+{
+  Statistics partials[];
+};
+
+// Live particle count, maintained on the GPU by sph_particle_count.cs
+layout(binding = 24, std430) restrict readonly buffer particleCountBuf
+{
+  uint particleDispatch[3];
+  uint liveParticleCount;
+};
+uniform int uReducePhase;
+
+shared vec3 localSpeed[REDUCE_BLOCK_SIZE];
+shared vec3 localDensity[REDUCE_BLOCK_SIZE];
+
+// Empty entries use identities so every invocation can take part in the tree
+const vec3 EMPTY = vec3(3.402823e38, 0.0, 0.0);
+
+vec3 combine(vec3 a, vec3 b)
+{
+  return vec3(min(a.x, b.x), max(a.y, b.y), a.z + b.z);
+}
+
+#ifdef SPH_SUBGROUPS
+vec3 subgroupCombine(vec3 value)
+{
+  return vec3(subgroupMin(value.x), subgroupMax(value.y), subgroupAdd(value.z));
+}
+#endif
+
+// Reduces localSpeed/localDensity into element 0
+void reduceLocal()
+{
+  uint localId = gl_LocalInvocationID.x;
+  barrier();
+
+#ifdef SPH_SUBGROUPS
+  vec3 speed = subgroupCombine(localSpeed[localId]);
+  vec3 density = subgroupCombine(localDensity[localId]);
+  barrier(); // Every slot is read before the subgroup results overwrite the first ones
+
+  if (subgroupElect())
+  {
+    localSpeed[gl_SubgroupID] = speed;
+    localDensity[gl_SubgroupID] = density;
+  }
+  barrier();
+
+  if (gl_SubgroupID == 0)
+  {
+    speed = EMPTY;
+    density = EMPTY;
+    for (uint base = 0; base < gl_NumSubgroups; base += gl_SubgroupSize)
+    {
+      uint index = base + gl_SubgroupInvocationID;
+      speed = combine(speed, subgroupCombine(index < gl_NumSubgroups ? localSpeed[index] : EMPTY));
+      density = combine(density, subgroupCombine(index < gl_NumSubgroups ? localDensity[index] : EMPTY));
+    }
+    if (subgroupElect())
+    {
+      localSpeed[0] = speed;
+      localDensity[0] = density;
+    }
+  }
+  barrier();
+#else
+  for (uint stride = REDUCE_BLOCK_SIZE / 2; stride > 0; stride >>= 1)
+  {
+    if (localId < stride)
+    {
+      localSpeed[localId] = combine(localSpeed[localId], localSpeed[localId + stride]);
+      localDensity[localId] = combine(localDensity[localId], localDensity[localId + stride]);
+    }
+    barrier();
+  }
+#endif
+}
+
+void main()
+{
+  uint localId = gl_LocalInvocationID.x;
+
+  if (uReducePhase == 0)
+  {
+    uint particleId = gl_GlobalInvocationID.x;
+    if (particleId < liveParticleCount)
+    {
+      float speed = length(particles[particleId].velocity);
+      float density = particles[particleId].density;
+      localSpeed[localId] = vec3(speed, speed, speed);
+      localDensity[localId] = vec3(density, density, density);
+    }
+    else
+    {
+      localSpeed[localId] = EMPTY;
+      localDensity[localId] = EMPTY;
+    }
+
+    reduceLocal();
+
+    if (localId == 0)
+    {
+      partials[gl_WorkGroupID.x].speed = vec4(localSpeed[0], 0.0);
+      partials[gl_WorkGroupID.x].density = vec4(localDensity[0], 0.0);
+    }
+  }
+  else
+  {
+    // Partials are few enough for one workgroup to walk them in chunks
+    uint partialCount = (liveParticleCount + REDUCE_BLOCK_SIZE - 1) / REDUCE_BLOCK_SIZE;
+    vec3 speed = EMPTY;
+    vec3 density = EMPTY;
+    for (uint base = 0; base < partialCount; base += REDUCE_BLOCK_SIZE)
+    {
+      uint partialId = base + localId;
+      localSpeed[localId] = partialId < partialCount ? partials[partialId].speed.xyz : EMPTY;
+      localDensity[localId] = partialId < partialCount ? partials[partialId].density.xyz : EMPTY;
+
+      reduceLocal();
+
+      speed = combine(speed, localSpeed[0]);
+      density = combine(density, localDensity[0]);
+      barrier();
+    }
+
+    if (localId == 0)
+    {
+      float invCount = liveParticleCount > 0 ? 1.0 / float(liveParticleCount) : 0.0;
+      // The live count rides in the padding so the CPU can shrink its particle count mirror
+      statistics.speed = vec4(speed.xy, speed.z * invCount, uintBitsToFloat(liveParticleCount));
+      statistics.density = vec4(density.xy, density.z * invCount, 0.0);
+    }
+  }
+}
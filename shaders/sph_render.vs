@@ -5,6 +5,7 @@ const float FLOAT_MIN = 1.175494351e-38;
 const float GRID_EPS = 0.000001;
 const float MAX_DENSITY = 30.0;
 const vec3 PARTICLE_COLOR = vec3(0.2, 0.5, 0.8);
+const vec3 PHASE_COLORS[4] = { vec3(0.2, 0.5, 0.8), vec3(0.9, 0.7, 0.1), vec3(0.9, 0.9, 0.9), vec3(0.8, 0.2, 0.3) };
 
 struct Particle
 {
@@ -19,6 +20,27 @@ layout(binding = 0, std430) restrict readonly buffer particleBuf
   Particle particles[];
 };
 
+// Live particle count record (see sph_particle_count.cs); the CPU count is only an upper
+// bound while removed particles are being compacted out
+layout(binding = 24, std430) restrict readonly buffer particleCountBuf
+{
+  uint particleDispatch[3];
+  uint liveParticleCount;
+};
+
+// Quantized render stream (sph_render_stream.cs), read in place of the particles when set
+layout(binding = 60, std430) restrict readonly buffer renderStreamBuf
+{
+  uvec2 renderStream[];
+};
+
+// Culled draws: the survivors of sph_cull.cs after its two indirect draw commands
+layout(binding = 29, std430) restrict readonly buffer visibleParticleBuf
+{
+  uint visibleDraws[8];
+  uint visibleParticles[];
+};
+
 uniform mat4 uVP;
 uniform mat4 uView;
 uniform mat4 uProjection;
@@ -26,8 +48,17 @@ uniform vec3 uGridSize;
 uniform vec3 uGridOrigin;
 uniform ivec3 uGridRes;
 uniform uint uParticleCount;
+uniform bool uUseVisibleList;
+uniform uint uVisibleListOffset; // Start of the drawn list (surface or interior)
 uniform float uPointRadius;
-uniform int uColorMode;
+
+// Color mode (SPHComputeSystem::ColorMode), one program variant each
+#ifndef SPH_COLOR_MODE
+#define SPH_COLOR_MODE 0
+#endif
+uniform bool uUseRenderStream;
+uniform vec3 uStreamOrigin;
+uniform vec3 uStreamExtent;
 
 out vec3 vColor;
 out vec3 vCenterPos;
@@ -35,14 +66,17 @@ out vec2 vUV;
 
 vec2 UVS[4] = { vec2(0,0), vec2(1,0), vec2(0,1), vec2(1,1) };
 vec2 OFFSETS[4] = { vec2(-1,-1), vec2(-1,+1), vec2(+1,-1), vec2(+1,+1) };
+// Two triangles per particle from gl_VertexID alone, so no index buffer is needed
+const uint QUAD_CORNERS[6] = { 0, 1, 2, 2, 1, 3 };
 
 void main()
 {
-  uint gid = gl_VertexID / 4;
-  uint lid = gl_VertexID % 4;
+  uint gid = uint(gl_VertexID) / 6u;
+  if (uUseVisibleList) gid = visibleParticles[uVisibleListOffset + gid];
+  uint lid = QUAD_CORNERS[uint(gl_VertexID) % 6u];
 
   // Bounds check to avoid out-of-bounds access
-  if (gid >= uParticleCount) {
+  if (gid >= uParticleCount || gid >= liveParticleCount) {
     gl_Position = vec4(0.0, 0.0, -1.0, 1.0); // Clip this vertex
     vColor = vec3(1.0, 0.0, 0.0); // Red for debugging
     vCenterPos = vec3(0.0);
@@ -50,22 +84,41 @@ void main()
     return;
   }
 
-  vec3 particlePos = particles[gid].position;
-
   // Force bright color for debugging black particle issue
   vColor = vec3(1.0, 0.0, 1.0); // Bright magenta for maximum visibility
   
-  if (uColorMode == 1)
+  vec3 particlePos;
+  if (uUseRenderStream)
   {
+    // The stream's color attribute already holds the ramp position or phase of the color mode
+    uvec2 packed = renderStream[gid];
+    particlePos = uStreamOrigin + vec3(packed.x & 0xFFFFu, packed.x >> 16, packed.y & 0xFFFFu) / 65535.0 * uStreamExtent;
+    float attribute = float(packed.y >> 16) / 255.0;
+#if SPH_COLOR_MODE == 1
+    vColor = mix(vec3(0.0, 0.2, 0.8), vec3(1.0, 0.5, 0.0), attribute);
+#elif SPH_COLOR_MODE == 2
+    vColor = mix(vec3(0.0, 0.0, 1.0), vec3(1.0, 0.0, 0.0), attribute);
+#elif SPH_COLOR_MODE == 4
+    vColor = PHASE_COLORS[(packed.y >> 16) & 3u];
+#endif
+  }
+  else
+  {
+    particlePos = particles[gid].position;
+    
+#if SPH_COLOR_MODE == 1
     vec3 velocity = particles[gid].velocity;
     float speed = length(velocity);
     vColor = mix(vec3(0.0, 0.2, 0.8), vec3(1.0, 0.5, 0.0), clamp(speed / 5.0, 0.0, 1.0));
-  }
-  else if (uColorMode == 2)
-  {
+#elif SPH_COLOR_MODE == 2
     float density = particles[gid].density;
     float norm = clamp(density / 1200.0, 0.0, 1.0);
     vColor = mix(vec3(0.0, 0.0, 1.0), vec3(1.0, 0.0, 0.0), norm);
+#elif SPH_COLOR_MODE == 4
+    // Multiphase index from the low mantissa bits of the pressure (sph_step5.cs)
+    uint phase = floatBitsToUint(particles[gid].pressure) & 3u;
+    vColor = PHASE_COLORS[phase];
+#endif
   }
 
   vCenterPos = (uView * vec4(particlePos, 1.0)).xyz;
@@ -0,0 +1,69 @@
+#version 460 core
+// SPH render stream: packs the particles the billboard draws read into 8 bytes each
+//
+// Written after the last substep of a frame. Positions are 16-bit fixed point across the
+// container bounds, and the 8-bit color attribute is the scalar the color mode shows
+// (speed, density or phase), so sph_render.vs and sph_depth.vs never touch the 32-byte
+// simulation particles:
+//   x: position.x | position.y << 16
+//   y: position.z | color << 16
+
+layout(local_size_x = 256) in;
+
+struct Particle
+{
+  vec3 position;
+  float density;
+  vec3 velocity;
+  float pressure;
+};
+
+layout(binding = 0, std430) restrict readonly buffer particleBuf
+{
+  Particle particles[];
+};
+
+// Live particle count, maintained on the GPU by sph_particle_count.cs
+layout(binding = 24, std430) restrict readonly buffer particleCountBuf
+{
+  uint particleDispatch[3];
+  uint liveParticleCount;
+};
+
+layout(binding = 60, std430) restrict writeonly buffer renderStreamBuf
+{
+  uvec2 renderStream[];
+};
+
+const float MAX_SPEED = 5.0;        // sph_render.vs color ramps
+const float MAX_DENSITY = 1200.0;
+
+uniform vec3 uStreamOrigin;
+uniform vec3 uStreamExtent;
+// Color mode (SPHComputeSystem::ColorMode), one program variant each
+#ifndef SPH_COLOR_MODE
+#define SPH_COLOR_MODE 0
+#endif
+
+uint colorAttribute(Particle particle)
+{
+#if SPH_COLOR_MODE == 1
+  return uint(clamp(length(particle.velocity) / MAX_SPEED, 0.0, 1.0) * 255.0 + 0.5);
+#elif SPH_COLOR_MODE == 2
+  return uint(clamp(particle.density / MAX_DENSITY, 0.0, 1.0) * 255.0 + 0.5);
+#elif SPH_COLOR_MODE == 4
+  return floatBitsToUint(particle.pressure) & 3u; // Phase bits (sph_step5.cs)
+#else
+  return 0u;
+#endif
+}
+
+void main()
+{
+  uint id = gl_GlobalInvocationID.x;
+  if (id >= liveParticleCount) return;
+
+  Particle particle = particles[id];
+  uvec3 quantized = uvec3(clamp((particle.position - uStreamOrigin) / uStreamExtent, 0.0, 1.0) * 65535.0 + 0.5);
+  renderStream[id] = uvec2(quantized.x | (quantized.y << 16), quantized.z | (colorAttribute(particle) << 16));
+}
@@ -0,0 +1,56 @@
+#version 460 core
+// SPH rewind keyframes (RewindTimeline): each particle quantized to 16 bytes, the position
+// to 16 bits per axis over the grid box and the velocity to half floats. The pressure keeps
+// its raw bits for the phase, resolution and time level tags riding in them; the density is
+// left for the next step to recompute. REWIND_UNPACK expands a keyframe back into the
+// particle buffer
+
+layout(local_size_x = 256) in;
+
+struct Particle
+{
+  vec3 position;
+  float density;
+  vec3 velocity;
+  float pressure;
+};
+
+layout(binding = 0, std430) restrict buffer particleBuf
+{
+  Particle particles[];
+};
+
+// x: position xy, y: position z | velocity z << 16, z: velocity xy, w: pressure bits
+layout(binding = 66, std430) restrict buffer keyframeBuf
+{
+  uvec4 keyframe[];
+};
+
+uniform uint uCount;
+uniform vec3 uGridOrigin;
+uniform vec3 uGridSize;
+uniform float uRestDensity;
+
+void main()
+{
+  uint i = gl_GlobalInvocationID.x;
+  if (i >= uCount) return;
+
+#ifdef REWIND_UNPACK
+  uvec4 packed = keyframe[i];
+  vec3 normalized = vec3(unpackUnorm2x16(packed.x), unpackUnorm2x16(packed.y & 0xFFFFu).x);
+  Particle particle;
+  particle.position = uGridOrigin + normalized * uGridSize;
+  particle.density = uRestDensity;
+  particle.velocity = vec3(unpackHalf2x16(packed.z), unpackHalf2x16(packed.y >> 16).x);
+  particle.pressure = uintBitsToFloat(packed.w);
+  particles[i] = particle;
+#else
+  Particle particle = particles[i];
+  vec3 normalized = clamp((particle.position - uGridOrigin) / uGridSize, 0.0, 1.0);
+  keyframe[i] = uvec4(packUnorm2x16(normalized.xy),
+                      (packUnorm2x16(vec2(normalized.z, 0.0)) & 0xFFFFu) | (packHalf2x16(vec2(particle.velocity.z, 0.0)) << 16),
+                      packHalf2x16(particle.velocity.xy),
+                      floatBitsToUint(particle.pressure));
+#endif
+}
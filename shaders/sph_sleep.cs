@@ -0,0 +1,113 @@
+#version 460 core
+// SPH particle sleeping: picks the occupied cells steps 4-6 still have to run this substep.
+// Runs after the grid is built, one invocation per cell of step 1's active list, in two
+// phases selected by uPass:
+//   0: latch the motion recorded since the last decision (steps 5 and 6 of the previous
+//      substep, and step 1 for particles entering a cell or moving in a sleeping one) and
+//      clear it for the coming substep
+//   1: a cell with no latched motion in itself or any occupied neighbor counts one more
+//      quiet substep, any motion resets the count; cells quiet for fewer than
+//      uSleepSubsteps are appended to the awake list, which has the layout of step 1's
+//      active list and dispatch record so steps 4-6 can consume it unchanged
+//
+// Motion is the float bits of the largest measure normalised by its threshold, so values
+// above 1.0 are moving and unsigned comparisons order them.
+
+layout(local_size_x = 64) in;
+
+#define SPARSE_BLOCK_SIZE 64
+
+layout(binding = 2, std430) restrict readonly buffer cellCountBuf
+{
+  uint cellCount[];
+};
+
+layout(binding = 21, std430) restrict readonly buffer activeCellBuf
+{
+  uint activeCells[];
+};
+
+layout(binding = 22, std430) restrict readonly buffer sparseDispatchBuf
+{
+  uint sparseGroups[3];
+  uint activeCellCount;
+};
+
+layout(binding = 38, std430) restrict buffer cellActivityBuf
+{
+  uvec4 cellActivity[];  // Quiet substeps, motion, latched motion, unused
+};
+
+layout(binding = 39, std430) restrict writeonly buffer awakeCellBuf
+{
+  uint awakeCells[];
+};
+
+layout(binding = 40, std430) restrict buffer awakeDispatchBuf
+{
+  uint awakeGroupsX;
+  uint awakeGroupsY;
+  uint awakeGroupsZ;
+  uint awakeCellCount;
+  uint awakeCellGroupsX;
+  uint awakeCellGroupsY;
+  uint awakeCellGroupsZ;
+  uint padding;
+};
+
+uniform int uPass;
+uniform ivec3 uGridRes;
+uniform uint uSleepSubsteps;
+
+void main()
+{
+  uint activeSlot = gl_GlobalInvocationID.x;
+  if (activeSlot >= activeCellCount) return;
+
+  uint cellId = activeCells[activeSlot];
+
+  if (uPass == 0)
+  {
+    cellActivity[cellId].z = cellActivity[cellId].y;
+    cellActivity[cellId].y = 0u;
+    return;
+  }
+
+  ivec3 voxelId = ivec3(cellId % uint(uGridRes.x),
+                        (cellId / uint(uGridRes.x)) % uint(uGridRes.y),
+                        cellId / uint(uGridRes.x * uGridRes.y));
+
+  // Empty cells were not latched this substep and may hold stale motion, so only occupied
+  // neighbors count
+  uint motion = 0u;
+  for (int dz = -1; dz <= 1; dz++)
+  {
+    for (int dy = -1; dy <= 1; dy++)
+    {
+      for (int dx = -1; dx <= 1; dx++)
+      {
+        ivec3 neighbor = voxelId + ivec3(dx, dy, dz);
+        if (any(lessThan(neighbor, ivec3(0))) || any(greaterThanEqual(neighbor, uGridRes))) continue;
+
+        uint neighborCell = uint(neighbor.x + uGridRes.x * (neighbor.y + uGridRes.y * neighbor.z));
+        if (cellCount[neighborCell] > 0u)
+        {
+          motion = max(motion, cellActivity[neighborCell].z);
+        }
+      }
+    }
+  }
+
+  uint quietSubsteps = motion > floatBitsToUint(1.0) ? 0u : min(cellActivity[cellId].x + 1u, uSleepSubsteps);
+  cellActivity[cellId].x = quietSubsteps;
+
+  if (quietSubsteps < uSleepSubsteps)
+  {
+    uint slot = atomicAdd(awakeCellCount, 1);
+    awakeCells[slot] = cellId;
+    atomicAdd(awakeCellGroupsX, 1);
+    if (slot % SPARSE_BLOCK_SIZE == 0) {
+      atomicAdd(awakeGroupsX, 1);
+    }
+  }
+}
@@ -0,0 +1,72 @@
+#version 460 core
+// Curvature flow smoothing (same update as sph_smooth.fs) with several iterations fused
+// per dispatch: each workgroup loads its tile plus an apron of one texel per iteration into
+// shared memory, iterates there while the valid region shrinks by a texel per side per
+// iteration, and writes back only the centre. Neighbors are clamped to the image like the
+// fragment version's CLAMP_TO_EDGE fetches, so the result matches it texel for texel
+
+#define TILE 16
+#ifndef SMOOTH_MAX_ITERATIONS
+#define SMOOTH_MAX_ITERATIONS 4 // Apron width; SPHConstants::SMOOTH_ITERATIONS_PER_DISPATCH
+#endif
+#define SPAN (TILE + 2 * SMOOTH_MAX_ITERATIONS)
+
+layout(local_size_x = TILE, local_size_y = TILE) in;
+
+layout(binding = 0) uniform sampler2D uSource;                      // Depth or previous result
+layout(binding = 0, r32f) uniform restrict writeonly image2D uTarget;
+
+uniform ivec2 uScreenSize;
+uniform int uIterations;  // <= SMOOTH_MAX_ITERATIONS; 0 copies
+
+shared float depths[2][SPAN * SPAN];
+
+void main()
+{
+  ivec2 tileOrigin = ivec2(gl_WorkGroupID.xy) * TILE - SMOOTH_MAX_ITERATIONS;
+  uint localIndex = gl_LocalInvocationIndex;
+
+  for (uint i = localIndex; i < SPAN * SPAN; i += TILE * TILE)
+  {
+    ivec2 texel = clamp(tileOrigin + ivec2(i % SPAN, i / SPAN), ivec2(0), uScreenSize - 1);
+    depths[0][i] = texelFetch(uSource, texel, 0).r;
+  }
+  barrier();
+
+  int current = 0;
+  for (int iteration = 0; iteration < uIterations; iteration++)
+  {
+    // Texels [iteration + 1, SPAN - 2 - iteration] have every neighbor from the last round
+    int first = iteration + 1;
+    int size = SPAN - 2 * first;
+    for (uint i = localIndex; i < uint(size * size); i += TILE * TILE)
+    {
+      ivec2 local = ivec2(first) + ivec2(i % uint(size), i / uint(size));
+      ivec2 global = tileOrigin + local;
+      ivec2 lo = clamp(global - 1, ivec2(0), uScreenSize - 1) - tileOrigin;
+      ivec2 hi = clamp(global + 1, ivec2(0), uScreenSize - 1) - tileOrigin;
+
+      float depth_c = depths[current][local.y * SPAN + local.x];
+      float newDepth = depth_c;
+      if (depth_c < 0.999)
+      {
+        float depth_l = depths[current][local.y * SPAN + lo.x];
+        float depth_r = depths[current][local.y * SPAN + hi.x];
+        float depth_b = depths[current][lo.y * SPAN + local.x];
+        float depth_t = depths[current][hi.y * SPAN + local.x];
+        float smoothed = (depth_c * 4.0 + depth_l + depth_r + depth_b + depth_t) / 8.0;
+        newDepth = mix(depth_c, smoothed, 0.3);
+      }
+      depths[1 - current][local.y * SPAN + local.x] = newDepth;
+    }
+    barrier();
+    current = 1 - current;
+  }
+
+  ivec2 local = ivec2(gl_LocalInvocationID.xy) + SMOOTH_MAX_ITERATIONS;
+  ivec2 texel = tileOrigin + local;
+  if (all(lessThan(texel, uScreenSize)))
+  {
+    imageStore(uTarget, texel, vec4(depths[current][local.y * SPAN + local.x]));
+  }
+}
@@ -0,0 +1,208 @@
+#version 460 core
+// SPH spatial queries (FluidQueries): one workgroup per query over the sorted grid of the
+// last substep, visiting the cells the query's bounds overlap as step 5 does (cellStart and
+// cellCount, through the block slots and sorted indices when those are on). The group
+// strides over the cells, then reduces:
+//   density  Poly6 density and weighted velocity at a point (the 27 cells around it)
+//   box      particles inside an axis-aligned box
+//   sphere   particles within a radius of a point
+// A region's density is its particle mass over its volume, and its fill the volume the
+// particles would take at rest density over the region's.
+
+#define QUERY_DENSITY 0u
+#define QUERY_BOX 1u
+#define QUERY_SPHERE 2u
+
+layout(local_size_x = 64) in;
+
+layout(binding = 2, std430) restrict readonly buffer cellCountBuf
+{
+  uint cellCount[];
+};
+
+layout(binding = 3, std430) restrict readonly buffer cellStartBuf
+{
+  uint cellStart[];
+};
+
+struct Particle
+{
+  vec3 position;
+  float density;
+  vec3 velocity;
+  float pressure;
+};
+
+layout(binding = 0, std430) restrict readonly buffer particleBuf
+{
+  Particle particles[];
+};
+
+struct Query
+{
+  vec4 minType;           // xyz box min or point, w type (uint bits)
+  vec4 maxRadius;         // xyz box max, w radius
+};
+
+layout(binding = 70, std430) restrict readonly buffer spatialQueryBuf
+{
+  Query queries[];
+};
+
+struct Result
+{
+  uint count;
+  float mass;
+  float density;
+  float fill;
+  vec4 velocity;          // xyz mean fluid velocity
+};
+
+layout(binding = 71, std430) restrict writeonly buffer spatialResultBuf
+{
+  Result results[];
+};
+
+// Substep constants shared by the simulation passes, uploaded once per substep
+// (SPHParameterBlock)
+layout(std140, binding = 0) uniform SPHParameters
+{
+  vec3 uGridOrigin;
+  float uDT;
+  vec3 uGridSize;
+  float uMaxVelocity;
+  vec3 uInvCellSize;
+  float uWallDamping;         // Fraction of the normal velocity kept by a wall bounce
+  ivec3 uGridRes;
+  float uSceneStride;         // Batched scenes: x offset between the scenes
+  vec3 uGravity;
+  int uSceneCount;
+  vec3 uStepGravity;          // Gravity step 1 integrates; zero when PCISPH does
+  int uBatchScenes;           // Scene count, 0 when not batched
+  float uParticleMass;
+  float uHalfSkinSq;
+  uint uListStride;
+  int uUseNeighborList;
+  int uDiffusePotentials;
+  int uParticleSleeping;
+  uint uSleepSubsteps;
+  float uSleepVelocity;
+  float uSleepDensityChange;  // Relative density change per substep
+};
+
+// Grid resolution of the cell addressing in sph_grid.glsl
+ivec3 gridResolution() { return uGridRes; }
+
+// Fluid parameters, injected as #defines by SPHComputeSystem (defaults match SPHConstants)
+#ifndef SPH_KERNEL_RADIUS
+#define SPH_KERNEL_RADIUS 0.1828
+#endif
+#ifndef SPH_REST_DENSITY
+#define SPH_REST_DENSITY 1000.0
+#endif
+
+const float KERNEL_RADIUS = SPH_KERNEL_RADIUS;
+const float REST_DENSITY = SPH_REST_DENSITY;
+const float POLY6_KERNEL_WEIGHT_CONST = 315.0 / (64.0 * 3.14159265 * pow(KERNEL_RADIUS, 9));
+
+shared uint sharedCount[64];
+shared float sharedWeight[64];      // Poly6 density for a point, particle count otherwise
+shared vec3 sharedMomentum[64];
+
+void main()
+{
+  uint id = gl_WorkGroupID.x;
+  uint lane = gl_LocalInvocationIndex;
+  Query query = queries[id];
+  uint type = floatBitsToUint(query.minType.w);
+  float radius = query.maxRadius.w;
+
+  // The query's bounds, and the cells they overlap within the grid
+  vec3 lower = query.minType.xyz;
+  vec3 upper = query.maxRadius.xyz;
+  if (type == QUERY_DENSITY)
+  {
+    lower = query.minType.xyz - KERNEL_RADIUS;
+    upper = query.minType.xyz + KERNEL_RADIUS;
+  }
+  else if (type == QUERY_SPHERE)
+  {
+    lower = query.minType.xyz - radius;
+    upper = query.minType.xyz + radius;
+  }
+  ivec3 firstCell = clamp(ivec3(floor((lower - uGridOrigin) * uInvCellSize)), ivec3(0), uGridRes - 1);
+  ivec3 lastCell = clamp(ivec3(floor((upper - uGridOrigin) * uInvCellSize)), ivec3(0), uGridRes - 1);
+  ivec3 span = max(lastCell - firstCell + 1, ivec3(0));
+  uint cells = uint(span.x * span.y * span.z);
+
+  uint count = 0u;
+  float weight = 0.0;
+  vec3 momentum = vec3(0.0);
+  for (uint c = lane; c < cells; c += gl_WorkGroupSize.x)
+  {
+    ivec3 voxel = firstCell + ivec3(int(c) % span.x, (int(c) / span.x) % span.y, int(c) / (span.x * span.y));
+    uint cellId = gridCell(voxel);
+    if (cellId == EMPTY_CELL) continue;
+
+    uint first = cellStart[cellId];
+    uint end = first + cellCount[cellId];
+    for (uint slot = first; slot < end; slot++)
+    {
+      Particle particle = particles[cellParticle(slot)];
+      if (type == QUERY_DENSITY)
+      {
+        vec3 r = query.minType.xyz - particle.position;
+        float diff = KERNEL_RADIUS * KERNEL_RADIUS - dot(r, r);
+        if (diff <= 0.0) continue;
+        float w = uParticleMass * POLY6_KERNEL_WEIGHT_CONST * diff * diff * diff;
+        count++;
+        weight += w;
+        momentum += particle.velocity * w;
+      }
+      else
+      {
+        bool inside = type == QUERY_BOX
+            ? all(greaterThanEqual(particle.position, lower)) && all(lessThanEqual(particle.position, upper))
+            : distance(particle.position, query.minType.xyz) <= radius;
+        if (!inside) continue;
+        count++;
+        weight += 1.0;
+        momentum += particle.velocity;
+      }
+    }
+  }
+
+  sharedCount[lane] = count;
+  sharedWeight[lane] = weight;
+  sharedMomentum[lane] = momentum;
+  barrier();
+  for (uint stride = gl_WorkGroupSize.x / 2u; stride > 0u; stride >>= 1)
+  {
+    if (lane < stride)
+    {
+      sharedCount[lane] += sharedCount[lane + stride];
+      sharedWeight[lane] += sharedWeight[lane + stride];
+      sharedMomentum[lane] += sharedMomentum[lane + stride];
+    }
+    barrier();
+  }
+  if (lane != 0u) return;
+
+  Result result;
+  result.count = sharedCount[0];
+  result.velocity = vec4(sharedWeight[0] > 0.0 ? sharedMomentum[0] / sharedWeight[0] : vec3(0.0), 0.0);
+  if (type == QUERY_DENSITY)
+  {
+    result.density = sharedWeight[0];
+    result.mass = float(result.count) * uParticleMass;
+  }
+  else
+  {
+    vec3 size = max(upper - lower, vec3(0.0));
+    float volume = type == QUERY_BOX ? size.x * size.y * size.z : 4.18879020 * radius * radius * radius;
+    result.mass = float(result.count) * uParticleMass;
+    result.density = volume > 0.0 ? result.mass / volume : 0.0;
+  }
+  result.fill = clamp(result.density / REST_DENSITY, 0.0, 1.0);
+  results[id] = result;
+}
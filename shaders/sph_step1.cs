@@ -1,5 +1,13 @@
 #version 460 core
 // SPH Step 1: Position integration and grid population
+//
+// With SPH_SUBGROUPS the active-cell appends of a subgroup are ballot-aggregated into one
+// set of atomics, with each appending invocation taking its slot from the ballot prefix.
+
+#ifdef SPH_SUBGROUPS
+#extension GL_KHR_shader_subgroup_basic : require
+#extension GL_KHR_shader_subgroup_ballot : require
+#endif
 
 layout(local_size_x = 32) in;
 
@@ -16,13 +24,187 @@ layout(binding = 0, std430) restrict buffer particleBuf
   Particle particles[];
 };
 
-layout(r32ui, binding = 0) uniform restrict uimage3D grid;
+layout(binding = 2, std430) restrict buffer cellCountBuf
+{
+  uint cellCount[];
+};
+
+// Substep constants shared by the simulation passes, uploaded once per substep
+// (SPHParameterBlock)
+layout(std140, binding = 0) uniform SPHParameters
+{
+  vec3 uGridOrigin;
+  float uDT;
+  vec3 uGridSize;
+  float uMaxVelocity;
+  vec3 uInvCellSize;
+  float uWallDamping;         // Fraction of the normal velocity kept by a wall bounce
+  ivec3 uGridRes;
+  float uSceneStride;         // Batched scenes: x offset between the scenes
+  vec3 uGravity;
+  int uSceneCount;
+  vec3 uStepGravity;          // Gravity step 1 integrates; zero when PCISPH does
+  int uBatchScenes;           // Scene count, 0 when not batched
+  float uParticleMass;
+  float uHalfSkinSq;
+  uint uListStride;
+  int uUseNeighborList;
+  int uDiffusePotentials;
+  int uParticleSleeping;
+  uint uSleepSubsteps;
+  float uSleepVelocity;
+  float uSleepDensityChange;  // Relative density change per substep
+};
 
-uniform float uDT;
-uniform vec3 uGravity;
-uniform vec3 uGridOrigin;
-uniform vec3 uGridSize;
-uniform vec3 uInvCellSize;
+// Grid resolution of the cell addressing in sph_grid.glsl
+ivec3 gridResolution() { return uGridRes; }
+
+// Verlet neighbor list mode: flag a rebuild once a particle leaves half the skin
+layout(binding = 13, std430) restrict buffer rebuildFlagBuf
+{
+  uint rebuildFlag;
+};
+
+layout(binding = 17, std430) restrict readonly buffer referencePositionBuf
+{
+  vec4 referencePositions[];
+};
+
+// Fused grid clear: zero the cell this particle was counted into last substep
+layout(binding = 18, std430) restrict writeonly buffer previousCellCountBuf
+{
+  uint previousCellCount[];
+};
+
+// Live particle count, maintained on the GPU by sph_particle_count.cs; removed particles
+// are counted here and subtracted once step 3 has compacted them out
+layout(binding = 24, std430) restrict buffer particleCountBuf
+{
+  uint particleDispatch[3];
+  uint liveParticleCount;
+  uint particleDispatch64[3];
+  uint removedParticleCount;
+};
+
+// Sinks: particles inside a box, or whose position is no longer finite, are flagged with
+// a negative density and left out of the grid, so the step 3 reorder drops them
+#define MAX_SINKS 8
+const float REMOVED_DENSITY = -1.0;
+
+uniform int uRemoveParticles; // Off in Verlet list mode, which keeps the particle order
+uniform int uSinkCount;
+uniform vec3 uSinkMin[MAX_SINKS];
+uniform vec3 uSinkMax[MAX_SINKS];
+
+bool insideSink(vec3 position)
+{
+  if (any(isnan(position)) || any(isinf(position))) return true;
+  for (int i = 0; i < uSinkCount; i++)
+  {
+    if (all(greaterThanEqual(position, uSinkMin[i])) && all(lessThanEqual(position, uSinkMax[i]))) return true;
+  }
+  return false;
+}
+
+// Heightfield coupling (hybrid splashes): a particle that falls deeper than the exchange
+// band below the wave surface is removed like a sink's and its volume and vertical
+// momentum are deposited into the texel under it (HeightfieldWaves::getDepositBuffer)
+layout(binding = 61, std430) restrict buffer heightfieldDepositBuf
+{
+  int heightfieldDeposits[];
+};
+
+layout(binding = 2) uniform sampler2D uHeightfield;
+
+uniform int uHeightfieldCoupling;
+uniform int uHeightfieldResolution;
+uniform float uHeightfieldSize;      // Surface edge length, centred on x = z = 0
+uniform float uHeightfieldLevel;     // World height of the undisturbed surface
+uniform float uHeightfieldBand;      // Depth below the surface that absorbs particles
+uniform float uHeightfieldDeposit;   // Height one particle adds to its texel, fixed point
+
+bool absorbIntoHeightfield(vec3 position, float verticalSpeed)
+{
+  vec2 uv = position.xz / uHeightfieldSize + 0.5;
+  if (any(lessThan(uv, vec2(0.0))) || any(greaterThanEqual(uv, vec2(1.0)))) return false;
+  ivec2 texel = ivec2(uv * float(uHeightfieldResolution));
+  float surface = uHeightfieldLevel + texelFetch(uHeightfield, texel, 0).r;
+  if (position.y > surface - uHeightfieldBand) return false;
+
+  int index = 2 * (texel.y * uHeightfieldResolution + texel.x);
+  atomicAdd(heightfieldDeposits[index], int(uHeightfieldDeposit));
+  atomicAdd(heightfieldDeposits[index + 1], int(uHeightfieldDeposit * verticalSpeed));
+  return true;
+}
+
+// Narrow band (sph_narrow_band.cs): below the band the fluid is a hydrostatic bulk held as
+// fixed-point water heights on a coarse xz grid of columns. Its top is a floor under the
+// band, and its slope the bulk's pressure gradient on particles within reach above it
+#define NARROW_BAND_HEIGHT_SCALE 65536.0
+
+struct BulkColumn
+{
+  int bulk;             // Height above uBulkFloor, fixed point
+  uint particles;
+  float absorbBelow;
+  uint absorb;
+};
+
+layout(binding = 72, std430) restrict readonly buffer bulkColumnBuf
+{
+  BulkColumn bulkColumns[];
+};
+
+uniform int uNarrowBand;
+uniform ivec2 uColumnRes;
+uniform float uColumnSize;
+uniform float uBulkFloor;     // World height the column heights start from
+uniform float uBulkReach;     // Height above the top the slope still pushes, one kernel radius
+
+float bulkTop(ivec2 column)
+{
+  column = clamp(column, ivec2(0), uColumnRes - 1);
+  return uBulkFloor + float(bulkColumns[column.x + uColumnRes.x * column.y].bulk) / NARROW_BAND_HEIGHT_SCALE;
+}
+
+// Active cells (sparse domain, tiled neighbor loop): cells are appended to the active list
+// the first time they are touched; every append adds one workgroup to the per-cell dispatch
+// and every SPARSE_BLOCK_SIZE-th append one to the step 4 sparse dispatch
+#define SPARSE_BLOCK_SIZE 64
+
+layout(binding = 21, std430) restrict writeonly buffer activeCellBuf
+{
+  uint activeCells[];
+};
+
+layout(binding = 22, std430) restrict buffer sparseDispatchBuf
+{
+  uint sparseGroupsX;
+  uint sparseGroupsY;
+  uint sparseGroupsZ;
+  uint activeCellCount;
+  uint cellGroupsX;
+  uint cellGroupsY;
+  uint cellGroupsZ;
+  uint padding;
+};
+
+uniform int uTrackActiveCells;
+uniform int uClearPreviousCells;
+
+// Multirate time stepping (sph_time_levels.cs): a particle of time level L advances by
+// uDT * 2^L when the substep index is a multiple of 2^L and waits in place otherwise;
+// contacts still act on a waiting particle's velocity
+
+uniform int uMultirate;
+uniform uint uTimeSubstep;
+
+float particleTimeStep(float pressure)
+{
+  if (uMultirate == 0) return uDT;
+  uint level = timeLevel(pressure);
+  return (uTimeSubstep & ((1u << level) - 1u)) == 0u ? uDT * float(1u << level) : 0.0;
+}
 
 // Sphere collision uniforms
 uniform vec3 uSpherePosition;
@@ -30,19 +212,138 @@ uniform vec3 uSphereImpulse;
 uniform float uSphereRadius;
 uniform int uSphereActive;
 
+// Two-way coupled sphere: the momentum pushed into the fluid is summed in fixed point, and
+// its negation over the frame is the fluid's force on the sphere (SPHComputeSystem)
+#define SPHERE_IMPULSE_SCALE 65536.0
+
+layout(binding = 37, std430) restrict buffer sphereImpulseBuf
+{
+  int sphereImpulse[3];
+  int sphereContacts;
+};
+
+uniform int uCoupledSphereActive;
+uniform vec4 uCoupledSphere;          // Centre, radius the particle centres are kept out of
+uniform vec3 uCoupledSphereVelocity;
+uniform float uCoupledSphereFriction; // Tangential slip removed per contact, 0-1
+
+// Rigid bodies (RigidBodySystem): structure-of-arrays state, fixed point impulse sums like
+// the coupled sphere's, and the broadphase cells of cellFactor SPH cells on a side, each a
+// count followed by RIGID_CELL_CAPACITY body ids. Layouts must match rigid_integrate.cs
+#define RIGID_BODY_CAPACITY 1024
+#define RIGID_CELL_CAPACITY 8
+#define RIGID_BOX 1.0
+
+layout(binding = 46, std430) restrict readonly buffer rigidBodyStateBuf
+{
+  vec4 bodyPosition[RIGID_BODY_CAPACITY];         // Centre, bounding radius
+  vec4 bodyVelocity[RIGID_BODY_CAPACITY];         // Linear velocity, inverse mass
+  vec4 bodyOrientation[RIGID_BODY_CAPACITY];      // Unit quaternion, xyz vector part
+  vec4 bodyAngularVelocity[RIGID_BODY_CAPACITY];  // Angular velocity, inverse inertia
+  vec4 bodyShape[RIGID_BODY_CAPACITY];            // Radius or half extents, shape
+};
+
+layout(binding = 47, std430) restrict buffer rigidBodyImpulseBuf
+{
+  ivec4 bodyLinearImpulse[RIGID_BODY_CAPACITY];   // Momentum into the fluid, contact count
+  ivec4 bodyAngularImpulse[RIGID_BODY_CAPACITY];
+};
+
+layout(binding = 48, std430) restrict readonly buffer rigidBodyGridBuf
+{
+  uint bodyCells[];
+};
+
+uniform int uRigidBodyCount;
+uniform ivec3 uRigidBodyGridRes;
+uniform int uRigidBodyCellFactor;
+uniform float uRigidBodySkin;         // Particle centres are kept this far out of a body
+uniform float uRigidBodyFriction;
+
+vec3 rotateByQuaternion(vec4 q, vec3 v) {
+  return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+
+// Outward normal and signed distance of a point to a body's surface
+vec4 bodyDistance(uint body, vec3 point) {
+  vec3 local = point - bodyPosition[body].xyz;
+  vec4 shape = bodyShape[body];
+  if (shape.w != RIGID_BOX) {
+    float distToCenter = length(local);
+    return vec4(distToCenter > 0.0001 ? local / distToCenter : vec3(0.0, 1.0, 0.0), distToCenter - shape.x);
+  }
+  vec4 q = bodyOrientation[body];
+  vec4 inverse = vec4(-q.xyz, q.w);
+  vec3 p = rotateByQuaternion(inverse, local);
+  vec3 d = abs(p) - shape.xyz;
+  float outside = length(max(d, 0.0));
+  vec3 normal;
+  if (outside > 0.0) {
+    normal = sign(p) * max(d, 0.0) / outside;
+  } else {
+    // Inside: out through the nearest face
+    vec3 axis = d.x > d.y ? (d.x > d.z ? vec3(1.0, 0.0, 0.0) : vec3(0.0, 0.0, 1.0))
+                          : (d.y > d.z ? vec3(0.0, 1.0, 0.0) : vec3(0.0, 0.0, 1.0));
+    normal = axis * sign(p);
+  }
+  return vec4(rotateByQuaternion(q, normal), outside + min(max(d.x, max(d.y, d.z)), 0.0));
+}
+
 const float SAFE_BOUNDS = 0.5;
 
+// Container walls and static obstacles baked into one signed distance field
+// (sph_obstacle_sdf.cs): rgb normal into free space, a distance, negative inside
+uniform int uUseObstacleField;
+layout(binding = 1) uniform sampler3D uObstacleField;
+
+// Particle sleeping (sph_sleep.cs): particles resting in a sleeping cell are held still,
+// and particles entering a cell or moving in a sleeping one record motion that wakes it
+#define WAKE_MOTION 2.0
+
+layout(binding = 38, std430) restrict buffer cellActivityBuf
+{
+  uvec4 cellActivity[];  // Quiet substeps, motion, latched motion, unused
+};
+
 void main()
 {
   uint particleId = gl_GlobalInvocationID.x;
   
   // Bounds check
-  if (particleId >= particles.length()) return;
+  if (particleId >= liveParticleCount) return;
   
   Particle particle = particles[particleId];
   
+  // Positions only change here, so the cell of the current position is exactly the
+  // cell counted last substep; every writer stores 0, so colliding writes are benign
+  if (uClearPreviousCells != 0) {
+    ivec3 previousVoxel = ivec3(uInvCellSize * (particle.position - uGridOrigin));
+    if (all(greaterThanEqual(previousVoxel, ivec3(0))) && all(lessThan(previousVoxel, uGridRes))) {
+      previousCellCount[denseCell(previousVoxel)] = 0;
+    }
+  }
+  
+  // Merged away by sph_adaptive.cs (already counted as removed); never binned, so step 3
+  // drops it
+  if (particle.density < 0.0) return;
+  
+  // A slow particle of a sleeping cell stays put; anything faster, e.g. a particle just
+  // emitted into the cell, integrates as usual and wakes the cell below
+  uint sleepCell = 0xFFFFFFFFu;
+  bool frozen = false;
+  if (uParticleSleeping != 0) {
+    ivec3 sleepVoxel = ivec3(uInvCellSize * (particle.position - uGridOrigin));
+    if (all(greaterThanEqual(sleepVoxel, ivec3(0))) && all(lessThan(sleepVoxel, uGridRes))) {
+      sleepCell = denseCell(sleepVoxel);
+      frozen = cellActivity[sleepCell].x >= uSleepSubsteps &&
+               dot(particle.velocity, particle.velocity) < uSleepVelocity * uSleepVelocity;
+    }
+  }
+  
+  float dt = particleTimeStep(particle.pressure);
+  
   // Apply gravity
-  vec3 newVelo = particle.velocity + uGravity * uDT;
+  vec3 newVelo = frozen ? vec3(0.0) : particle.velocity + uStepGravity * dt;
   
   // Apply sphere impulse if active
   if (uSphereActive != 0) {
@@ -57,17 +358,97 @@ void main()
       float impulseStrength = 1.0 - (distToSphere / uSphereRadius);
       impulseStrength = impulseStrength * impulseStrength; // Quadratic falloff
       
-      newVelo += uSphereImpulse * impulseStrength * uDT;
+      newVelo += uSphereImpulse * impulseStrength * dt;
     }
   }
   
   // Integrate position
-  vec3 newPos = particle.position + newVelo * uDT;
+  vec3 newPos = particle.position + newVelo * dt;
+  
+  // Coupled sphere: penetrating particles move to its surface, stop approaching it and
+  // lose part of their tangential slip (pressure and drag on the sphere, by reaction)
+  if (uCoupledSphereActive != 0) {
+    vec3 offset = newPos - uCoupledSphere.xyz;
+    float distToCenter = length(offset);
+    if (distToCenter < uCoupledSphere.w && distToCenter > 0.0001) {
+      vec3 normal = offset / distToCenter;
+      vec3 relative = newVelo - uCoupledSphereVelocity;
+      float normalVelocity = dot(relative, normal);
+      vec3 tangential = relative - normalVelocity * normal;
+      vec3 contactVelo = uCoupledSphereVelocity + max(normalVelocity, 0.0) * normal +
+                         tangential * (1.0 - uCoupledSphereFriction);
+      
+      ivec3 impulse = ivec3(round(uParticleMass * (contactVelo - newVelo) * SPHERE_IMPULSE_SCALE));
+      atomicAdd(sphereImpulse[0], impulse.x);
+      atomicAdd(sphereImpulse[1], impulse.y);
+      atomicAdd(sphereImpulse[2], impulse.z);
+      atomicAdd(sphereContacts, 1);
+      
+      newPos = uCoupledSphere.xyz + normal * uCoupledSphere.w;
+      newVelo = contactVelo;
+    }
+  }
+  
+  // Rigid bodies: the same contact against every body listed in the particle's cell, the
+  // pushed momentum summed per body, with its moment about the body's centre
+  if (uRigidBodyCount > 0) {
+    ivec3 bodyCell = ivec3(uInvCellSize * (newPos - uGridOrigin)) / uRigidBodyCellFactor;
+    if (all(greaterThanEqual(bodyCell, ivec3(0))) && all(lessThan(bodyCell, uRigidBodyGridRes))) {
+      uint cellBase = uint(bodyCell.x + uRigidBodyGridRes.x * (bodyCell.y + uRigidBodyGridRes.y * bodyCell.z)) *
+                      (RIGID_CELL_CAPACITY + 1);
+      uint bodyCount = min(bodyCells[cellBase], uint(RIGID_CELL_CAPACITY));
+      for (uint i = 0; i < bodyCount; i++) {
+        uint body = bodyCells[cellBase + 1 + i];
+        vec4 surface = bodyDistance(body, newPos);
+        if (surface.w >= uRigidBodySkin) continue;
+        
+        vec3 normal = surface.xyz;
+        vec3 arm = newPos - bodyPosition[body].xyz;
+        vec3 bodyVelo = bodyVelocity[body].xyz + cross(bodyAngularVelocity[body].xyz, arm);
+        vec3 relative = newVelo - bodyVelo;
+        float normalVelocity = dot(relative, normal);
+        vec3 tangential = relative - normalVelocity * normal;
+        vec3 contactVelo = bodyVelo + max(normalVelocity, 0.0) * normal + tangential * (1.0 - uRigidBodyFriction);
+        
+        vec3 momentum = uParticleMass * (contactVelo - newVelo);
+        ivec3 linear = ivec3(round(momentum * SPHERE_IMPULSE_SCALE));
+        ivec3 angular = ivec3(round(cross(arm, momentum) * SPHERE_IMPULSE_SCALE));
+        atomicAdd(bodyLinearImpulse[body].x, linear.x);
+        atomicAdd(bodyLinearImpulse[body].y, linear.y);
+        atomicAdd(bodyLinearImpulse[body].z, linear.z);
+        atomicAdd(bodyLinearImpulse[body].w, 1);
+        atomicAdd(bodyAngularImpulse[body].x, angular.x);
+        atomicAdd(bodyAngularImpulse[body].y, angular.y);
+        atomicAdd(bodyAngularImpulse[body].z, angular.z);
+        
+        newPos += normal * (uRigidBodySkin - surface.w);
+        newVelo = contactVelo;
+      }
+    }
+  }
   
   // Boundary handling with damping
-  float wallDamping = 0.5;
-  vec3 boundsL = uGridOrigin + SAFE_BOUNDS;
-  vec3 boundsH = uGridOrigin + uGridSize - SAFE_BOUNDS;
+  float wallDamping = uWallDamping;
+  
+  // Obstacles: project penetrating particles back onto the surface and reflect the
+  // normal velocity, whatever the number of colliders
+  if (uUseObstacleField != 0) {
+    vec4 obstacle = texture(uObstacleField, (newPos - uGridOrigin) / uGridSize);
+    if (obstacle.a < 0.0 && dot(obstacle.rgb, obstacle.rgb) > 0.0) {
+      vec3 normal = normalize(obstacle.rgb);
+      newPos -= normal * obstacle.a;
+      float normalVelocity = dot(newVelo, normal);
+      if (normalVelocity < 0.0) newVelo -= (1.0 + wallDamping) * normalVelocity * normal;
+    }
+  }
+  
+  // The walls again as a backstop for particles that left the field. Batched scenes are
+  // copies of the container side by side along x; a particle's scene is the slab it starts
+  // the substep in, and it never leaves it
+  int scene = clamp(int(floor((particle.position.x - uGridOrigin.x) / uSceneStride)), 0, uSceneCount - 1);
+  vec3 sceneOrigin = uGridOrigin + vec3(float(scene) * uSceneStride, 0.0, 0.0);
+  vec3 boundsL = sceneOrigin + SAFE_BOUNDS;
+  vec3 boundsH = sceneOrigin + vec3(uSceneStride, uGridSize.yz) - SAFE_BOUNDS;
   
   if (newPos.x < boundsL.x) { newVelo.x *= -wallDamping; newPos.x = boundsL.x; }
   if (newPos.x > boundsH.x) { newVelo.x *= -wallDamping; newPos.x = boundsH.x; }
@@ -76,16 +457,101 @@ void main()
   if (newPos.z < boundsL.z) { newVelo.z *= -wallDamping; newPos.z = boundsL.z; }
   if (newPos.z > boundsH.z) { newVelo.z *= -wallDamping; newPos.z = boundsH.z; }
   
+  // Narrow band: the bulk's top as a floor above the container's, pushing the particles
+  // just above it down its slope as the hydrostatic pressure of the deeper side would
+  if (uNarrowBand != 0) {
+    ivec2 column = ivec2(floor((newPos.xz - uGridOrigin.xz) / uColumnSize));
+    float height = newPos.y - bulkTop(column);
+    if (height < uBulkReach && !frozen) {
+      vec2 slope = vec2(bulkTop(column + ivec2(1, 0)) - bulkTop(column - ivec2(1, 0)),
+                        bulkTop(column + ivec2(0, 1)) - bulkTop(column - ivec2(0, 1))) / (2.0 * uColumnSize);
+      float weight = 1.0 - max(height, 0.0) / uBulkReach;
+      newVelo.xz -= length(uGravity) * clamp(slope, vec2(-1.0), vec2(1.0)) * weight * dt;
+    }
+    if (height < 0.0) {
+      newPos.y -= height;
+      if (newVelo.y < 0.0) newVelo.y *= -wallDamping;
+    }
+  }
+  
+  // Frozen particles only record motion when something (an impulse, the coupled sphere)
+  // moved them faster than the sleep threshold; collision push-outs stay below it
+  vec3 frozenDisplacement = newPos - particle.position;
+  bool recordsMotion = !frozen || dot(frozenDisplacement, frozenDisplacement) > uSleepVelocity * uSleepVelocity * uDT * uDT;
+  
   // Update particle
   particle.velocity = newVelo;
   particle.position = newPos;
+  
+  if (uRemoveParticles != 0 && (insideSink(newPos) || (uHeightfieldCoupling != 0 && absorbIntoHeightfield(newPos, newVelo.y))))
+  {
+    particle.density = REMOVED_DENSITY;
+    particles[particleId] = particle;
+    atomicAdd(removedParticleCount, 1);
+    return;
+  }
   particles[particleId] = particle;
   
+  if (uUseNeighborList != 0)
+  {
+    // The list pass bins particles itself, and only when a rebuild is due
+    vec3 displacement = newPos - referencePositions[particleId].xyz;
+    if (dot(displacement, displacement) > uHalfSkinSq)
+    {
+      atomicOr(rebuildFlag, 1);
+    }
+    return;
+  }
+  
   // Add to spatial grid - count particles per cell
   ivec3 voxelCoord = ivec3(uInvCellSize * (newPos - uGridOrigin));
   
   // Make sure particle is within grid bounds
-  if (all(greaterThanEqual(voxelCoord, ivec3(0))) && all(lessThan(voxelCoord, imageSize(grid)))) {
-    imageAtomicAdd(grid, voxelCoord, 1);
+  if (all(greaterThanEqual(voxelCoord, ivec3(0))) && all(lessThan(voxelCoord, uGridRes))) {
+#ifdef SPH_HIERARCHICAL_GRID
+    // Every writer stores the same flag, so colliding writes are benign
+    ivec3 block = voxelCoord / GRID_BLOCK_SIZE;
+    ivec3 blockRes = (uGridRes + GRID_BLOCK_SIZE - 1) / GRID_BLOCK_SIZE;
+    blockSlots[block.x + blockRes.x * (block.y + blockRes.y * block.z)] = 1u;
+    return;
+#endif
+    uint cellId = denseCell(voxelCoord);
+    uint previousCount = atomicAdd(cellCount[cellId], 1);
+    
+    if (uParticleSleeping != 0 && recordsMotion &&
+        (cellId != sleepCell || cellActivity[cellId].x >= uSleepSubsteps)) {
+      atomicMax(cellActivity[cellId].y, floatBitsToUint(WAKE_MOTION));
+    }
+    
+#ifdef SPH_SUBGROUPS
+    if (uTrackActiveCells != 0) {
+      uvec4 ballot = subgroupBallot(previousCount == 0);
+      uint appendCount = subgroupBallotBitCount(ballot);
+      uint base = 0;
+      if (appendCount > 0 && subgroupElect()) {
+        base = atomicAdd(activeCellCount, appendCount);
+        atomicAdd(cellGroupsX, appendCount);
+        // Sparse workgroups started by slots base .. base + appendCount - 1
+        uint sparseBlocks = (base + appendCount + SPARSE_BLOCK_SIZE - 1) / SPARSE_BLOCK_SIZE
+                          - (base + SPARSE_BLOCK_SIZE - 1) / SPARSE_BLOCK_SIZE;
+        if (sparseBlocks > 0) {
+          atomicAdd(sparseGroupsX, sparseBlocks);
+        }
+      }
+      base = subgroupBroadcastFirst(base);
+      if (previousCount == 0) {
+        activeCells[base + subgroupBallotExclusiveBitCount(ballot)] = cellId;
+      }
+    }
+#else
+    if (uTrackActiveCells != 0 && previousCount == 0) {
+      uint slot = atomicAdd(activeCellCount, 1);
+      activeCells[slot] = cellId;
+      atomicAdd(cellGroupsX, 1);
+      if (slot % SPARSE_BLOCK_SIZE == 0) {
+        atomicAdd(sparseGroupsX, 1);
+      }
+    }
+#endif
   }
 }
\ No newline at end of file
@@ -1,43 +1,173 @@
 #version 460 core
-// SPH Step 2: Grid offset calculation
+// SPH Step 2: Grid offset calculation (parallel exclusive prefix scan of cell counts)
+//
+// Runs in three phases selected by uScanPhase:
+//   0: per-block exclusive scan of cellCount into cellStart, block totals into blockSums
+//   1: single workgroup exclusive scan of blockSums
+//   2: add scanned block offsets to cellStart and seed cellCursor for step 3
+//
+// The radix sort reuses this scan for its digit histograms with uWriteCursor = 0.
+//
+// With SPH_SUBGROUPS the block scan is a subgroup inclusive add plus one scan of the
+// subgroup totals, instead of a log2(SCAN_BLOCK_SIZE)-step shared-memory ladder.
 
-layout(local_size_x = 4, local_size_y = 4, local_size_z = 4) in;
+#ifdef SPH_SUBGROUPS
+#extension GL_KHR_shader_subgroup_basic : require
+#extension GL_KHR_shader_subgroup_arithmetic : require
+#endif
 
-layout(binding = 0, std430) buffer counters
+#define SCAN_BLOCK_SIZE 512
+
+layout(local_size_x = SCAN_BLOCK_SIZE) in;
+
+layout(binding = 2, std430) restrict readonly buffer cellCountBuf
+{
+  uint cellCount[];
+};
+
+layout(binding = 3, std430) restrict buffer cellStartBuf
 {
-  uint globalParticleCount;
+  uint cellStart[];
 };
 
-layout(r32ui, binding = 0) uniform restrict uimage3D grid;
+layout(binding = 4, std430) restrict writeonly buffer cellCursorBuf
+{
+  uint cellCursor[];
+};
 
-shared uint localParticleCount;
-shared uint globalParticleBaseOffset;
+layout(binding = 5, std430) restrict buffer blockSumBuf
+{
+  uint blockSums[];
+};
 
-void main()
+uniform uint uCellCount;
+uniform uint uBlockCount;
+uniform int uScanPhase;
+uniform int uWriteCursor;
+
+#ifdef SPH_SUBGROUPS
+shared uint subgroupSums[SCAN_BLOCK_SIZE]; // One entry per subgroup (at most one per invocation)
+shared uint scanTotal;
+
+// Subgroup scans at both levels, returns the exclusive prefix
+uint blockExclusiveScan(uint value, out uint blockTotal)
 {
-  ivec3 voxelId = ivec3(gl_GlobalInvocationID);
-  
-  if (gl_LocalInvocationIndex == 0)
+  uint inclusive = subgroupInclusiveAdd(value);
+  if (gl_SubgroupInvocationID == gl_SubgroupSize - 1)
+  {
+    subgroupSums[gl_SubgroupID] = inclusive;
+  }
+  barrier();
+
+  // The first subgroup turns the totals into exclusive subgroup offsets
+  if (gl_SubgroupID == 0)
   {
-    localParticleCount = 0;
+    uint carry = 0;
+    for (uint base = 0; base < gl_NumSubgroups; base += gl_SubgroupSize)
+    {
+      uint index = base + gl_SubgroupInvocationID;
+      uint sum = index < gl_NumSubgroups ? subgroupSums[index] : 0;
+      uint scanned = subgroupInclusiveAdd(sum);
+      if (index < gl_NumSubgroups)
+      {
+        subgroupSums[index] = carry + scanned - sum;
+      }
+      carry += subgroupAdd(sum);
+    }
+    if (gl_SubgroupInvocationID == 0)
+    {
+      scanTotal = carry;
+    }
   }
-  
   barrier();
-  
-  uint voxelParticleCount = imageLoad(grid, voxelId).x;
-  
-  uint localParticleOffset = atomicAdd(localParticleCount, voxelParticleCount);
-  
+
+  blockTotal = scanTotal;
+  uint exclusive = subgroupSums[gl_SubgroupID] + inclusive - value;
+  barrier();
+
+  return exclusive;
+}
+#else
+shared uint scanData[2][SCAN_BLOCK_SIZE];
+
+// Inclusive Hillis-Steele scan of one value per invocation, returns the exclusive prefix
+uint blockExclusiveScan(uint value, out uint blockTotal)
+{
+  uint localId = gl_LocalInvocationID.x;
+  uint src = 0;
+
+  scanData[src][localId] = value;
   barrier();
-  
-  if (gl_LocalInvocationIndex == 0)
+
+  for (uint stride = 1; stride < SCAN_BLOCK_SIZE; stride <<= 1)
   {
-    globalParticleBaseOffset = atomicAdd(globalParticleCount, localParticleCount);
+    uint sum = scanData[src][localId];
+    if (localId >= stride)
+    {
+      sum += scanData[src][localId - stride];
+    }
+    scanData[1 - src][localId] = sum;
+    src = 1 - src;
+    barrier();
   }
-  
+
+  blockTotal = scanData[src][SCAN_BLOCK_SIZE - 1];
+  uint inclusive = scanData[src][localId];
   barrier();
-  
-  uint globalParticleOffset = globalParticleBaseOffset + localParticleOffset;
-  
-  imageStore(grid, voxelId, uvec4(globalParticleOffset << 8));
-}
\ No newline at end of file
+
+  return inclusive - value;
+}
+#endif
+
+void main()
+{
+  uint localId = gl_LocalInvocationID.x;
+  uint blockTotal;
+
+  if (uScanPhase == 0)
+  {
+    uint cellId = gl_GlobalInvocationID.x;
+    uint count = cellId < uCellCount ? cellCount[cellId] : 0;
+
+    uint prefix = blockExclusiveScan(count, blockTotal);
+
+    if (cellId < uCellCount)
+    {
+      cellStart[cellId] = prefix;
+    }
+    if (localId == 0)
+    {
+      blockSums[gl_WorkGroupID.x] = blockTotal;
+    }
+  }
+  else if (uScanPhase == 1)
+  {
+    // Block totals are few enough for one workgroup to walk them in chunks
+    uint carry = 0;
+    for (uint base = 0; base < uBlockCount; base += SCAN_BLOCK_SIZE)
+    {
+      uint blockId = base + localId;
+      uint sum = blockId < uBlockCount ? blockSums[blockId] : 0;
+
+      uint prefix = blockExclusiveScan(sum, blockTotal);
+
+      if (blockId < uBlockCount)
+      {
+        blockSums[blockId] = carry + prefix;
+      }
+      carry += blockTotal;
+    }
+  }
+  else
+  {
+    uint cellId = gl_GlobalInvocationID.x;
+    if (cellId >= uCellCount) return;
+
+    uint start = cellStart[cellId] + blockSums[gl_WorkGroupID.x];
+    cellStart[cellId] = start;
+    if (uWriteCursor != 0)
+    {
+      cellCursor[cellId] = start;
+    }
+  }
+}
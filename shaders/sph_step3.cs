@@ -21,36 +21,166 @@ layout(binding = 1, std430) restrict writeonly buffer particleBuf2
   Particle outParticles[];
 };
 
-layout(r32ui, binding = 0) uniform restrict uimage3D grid;
+// Implicit viscosity warm start (sph_viscosity.cs), moved with its particle when enabled
+layout(binding = 51, std430) restrict readonly buffer warmStartBuf1
+{
+  vec4 inWarmStart[];
+};
+
+layout(binding = 52, std430) restrict writeonly buffer warmStartBuf2
+{
+  vec4 outWarmStart[];
+};
+
+uniform int uCarryWarmStart;
+
+#ifdef SPH_INDEX_SORT
+// Index-only sort: only the particle index moves into its cell slot; the particles stay in
+// storage order until sph_gather.cs reorders them
+layout(binding = 14, std430) restrict writeonly buffer sortedIndexBuf
+{
+  uint sortedIndices[];
+};
+#endif
+
+layout(binding = 4, std430) restrict buffer cellCursorBuf
+{
+  uint cellCursor[];
+};
 
-uniform vec3 uInvCellSize;
-uniform vec3 uGridOrigin;
+// Substep constants shared by the simulation passes, uploaded once per substep
+// (SPHParameterBlock)
+layout(std140, binding = 0) uniform SPHParameters
+{
+  vec3 uGridOrigin;
+  float uDT;
+  vec3 uGridSize;
+  float uMaxVelocity;
+  vec3 uInvCellSize;
+  float uWallDamping;         // Fraction of the normal velocity kept by a wall bounce
+  ivec3 uGridRes;
+  float uSceneStride;         // Batched scenes: x offset between the scenes
+  vec3 uGravity;
+  int uSceneCount;
+  vec3 uStepGravity;          // Gravity step 1 integrates; zero when PCISPH does
+  int uBatchScenes;           // Scene count, 0 when not batched
+  float uParticleMass;
+  float uHalfSkinSq;
+  uint uListStride;
+  int uUseNeighborList;
+  int uDiffusePotentials;
+  int uParticleSleeping;
+  uint uSleepSubsteps;
+  float uSleepVelocity;
+  float uSleepDensityChange;  // Relative density change per substep
+};
+
+// Grid resolution of the cell addressing in sph_grid.glsl
+ivec3 gridResolution() { return uGridRes; }
+
+#ifdef SPH_COUNTERS
+// Instrumentation build (SPH_GPU_COUNTERS): health counters of the substep, cleared before
+// it and read back by SPHComputeSystem (SPHCounters). Steps 3, 5 and 6 all declare it
+layout(binding = 43, std430) restrict buffer sphCounterBuf
+{
+  uint counterOutOfGrid;
+  uint counterDroppedWrites;
+  uint counterOccupiedCells;
+  uint counterMaxCellOccupancy;
+  uint counterOverfullCells;
+  uint counterCellParticles;
+  uint counterCandidateSum;
+  uint counterMaxCandidates;
+  uint counterNeighborSum;
+  uint counterMaxNeighbors;
+  uint counterSampledParticles;
+  uint counterGridCounted;
+  uint candidateHistogram[SPH_COUNTER_BINS];
+  uint neighborHistogram[SPH_COUNTER_BINS];
+};
+
+// The first particle sorted into a cell reports the cell's occupancy
+layout(binding = 2, std430) restrict readonly buffer cellCountBuf
+{
+  uint cellCount[];
+};
+
+layout(binding = 3, std430) restrict readonly buffer cellStartBuf
+{
+  uint cellStart[];
+};
+#endif
+
+// Live particle count, maintained on the GPU by sph_particle_count.cs
+layout(binding = 24, std430) restrict readonly buffer particleCountBuf
+{
+  uint particleDispatch[3];
+  uint liveParticleCount;
+};
 
 void main()
 {
   uint inParticleId = gl_GlobalInvocationID.x;
+#ifdef SPH_COUNTERS
+  if (inParticleId == 0) counterGridCounted = 1u;
+#endif
   
   // Bounds check
-  if (inParticleId >= inParticles.length()) return;
+  if (inParticleId >= liveParticleCount) return;
   
   Particle particle = inParticles[inParticleId];
   
+  // Removed in step 1 (negative density flag): compacted out by not being written
+  if (particle.density < 0.0) return;
+  
   // Calculate voxel coordinate for this particle
   ivec3 voxelCoord = ivec3(uInvCellSize * (particle.position - uGridOrigin));
   
-  // Atomically increment count and get the previous value
-  // The grid contains: (offset << 8) | 0, and we're incrementing the count
-  uint voxelValue = imageAtomicAdd(grid, voxelCoord, 1);
+  // Particles outside the grid were not counted in step 1
+  if (any(lessThan(voxelCoord, ivec3(0))) || any(greaterThanEqual(voxelCoord, uGridRes)))
+  {
+#ifdef SPH_COUNTERS
+    atomicAdd(counterOutOfGrid, 1u);
+#endif
+    return;
+  }
   
-  // Extract offset and count
-  uint offset = (voxelValue >> 8);
-  uint count = (voxelValue & 0xFF);
+  // The cursor starts at the cell's prefix-sum offset, so the previous value is this particle's slot
+  uint cellId = gridCell(voxelCoord);
+  uint outParticleId = atomicAdd(cellCursor[cellId], 1);
   
-  // Calculate output position: offset + count gives us the slot for this particle
-  uint outParticleId = offset + count;
+#ifdef SPH_COUNTERS
+  if (outParticleId == cellStart[cellId])
+  {
+    uint occupancy = cellCount[cellId];
+    atomicAdd(counterOccupiedCells, 1u);
+    atomicAdd(counterCellParticles, occupancy);
+    atomicMax(counterMaxCellOccupancy, occupancy);
+    if (occupancy > uint(SPH_COUNTER_CELL_LIMIT)) atomicAdd(counterOverfullCells, 1u);
+  }
+#ifdef SPH_INDEX_SORT
+  if (outParticleId >= sortedIndices.length()) atomicAdd(counterDroppedWrites, 1u);
+#else
+  if (outParticleId >= outParticles.length()) atomicAdd(counterDroppedWrites, 1u);
+#endif
+#endif
   
+#ifdef SPH_INDEX_SORT
+  // The SoA mirror stays in storage order with its particles
+  if (outParticleId < sortedIndices.length()) {
+    sortedIndices[outParticleId] = inParticleId;
+#ifdef SPH_SOA_LAYOUT
+    writeSoAParticle(inParticleId, particle.position, particle.velocity);
+#endif
+  }
+#else
   // Write particle to its new sorted position
   if (outParticleId < outParticles.length()) {
     outParticles[outParticleId] = particle;
+    if (uCarryWarmStart != 0) outWarmStart[outParticleId] = inWarmStart[inParticleId];
+#ifdef SPH_SOA_LAYOUT
+    writeSoAParticle(outParticleId, particle.position, particle.velocity);
+#endif
   }
+#endif
 }
\ No newline at end of file
@@ -1,10 +1,47 @@
 #version 460 core
-// SPH Step 4: Velocity field calculation with O(n) spatial hashing
+// SPH Step 4: Filtered velocity field for step 6's filtered viscosity
+//
+// The field is half the grid resolution in half floats: one voxel per 2x2x2 block of grid
+// cells, centered on the block's middle corner, holding the Poly6-weighted mean velocity of
+// the particles within two kernel radii. Occupied voxels store alpha 1 and the rest keep
+// the clear's zero, so a trilinear fetch is premultiplied by the occupancy around it.
+//
+// With SPH_SPARSE_DOMAIN the pass runs indirectly over the cells step 1 found occupied, and
+// the first occupied cell of each block computes its voxel; otherwise it covers every voxel
+// and skips those whose block holds no particles.
 
+#ifdef SPH_SPARSE_DOMAIN
+layout(local_size_x = 64) in;
+#else
 layout(local_size_x = 4, local_size_y = 4, local_size_z = 4) in;
+#endif
 
-layout(r32ui, binding = 0) uniform restrict readonly uimage3D grid;
-layout(rgba32f, binding = 1) uniform restrict writeonly image3D velocityField;
+layout(binding = 2, std430) restrict readonly buffer cellCountBuf
+{
+  uint cellCount[];
+};
+
+layout(binding = 3, std430) restrict readonly buffer cellStartBuf
+{
+  uint cellStart[];
+};
+
+#ifdef SPH_SPARSE_DOMAIN
+layout(binding = 21, std430) restrict readonly buffer activeCellBuf
+{
+  uint activeCells[];
+};
+
+layout(binding = 22, std430) restrict readonly buffer sparseDispatchBuf
+{
+  uint sparseGroupsX;
+  uint sparseGroupsY;
+  uint sparseGroupsZ;
+  uint activeCellCount;
+};
+#endif
+
+layout(rgba16f, binding = 1) uniform restrict writeonly image3D velocityField;
 
 struct Particle
 {
@@ -19,88 +56,155 @@ layout(binding = 0, std430) restrict readonly buffer particleBuf
   Particle particles[];
 };
 
-uniform vec3 uGridOrigin;
-uniform vec3 uGridSize;
-uniform ivec3 uGridRes;
-
-// SPH constants
-const float MASS = 0.02;
-const float KERNEL_RADIUS = 0.1828;
-const float POLY6_KERNEL_WEIGHT_CONST = 315.0 / (64.0 * 3.14159265 * pow(KERNEL_RADIUS, 9));
-
-const ivec3 NEIGHBORHOOD_LUT[27] = {
-  ivec3(-1, -1, -1), ivec3(0, -1, -1), ivec3(1, -1, -1),
-  ivec3(-1, -1,  0), ivec3(0, -1,  0), ivec3(1, -1,  0),
-  ivec3(-1, -1,  1), ivec3(0, -1,  1), ivec3(1, -1,  1),
-  ivec3(-1,  0, -1), ivec3(0,  0, -1), ivec3(1,  0, -1),
-  ivec3(-1,  0,  0), ivec3(0,  0,  0), ivec3(1,  0,  0),
-  ivec3(-1,  0,  1), ivec3(0,  0,  1), ivec3(1,  0,  1),
-  ivec3(-1,  1, -1), ivec3(0,  1, -1), ivec3(1,  1, -1),
-  ivec3(-1,  1,  0), ivec3(0,  1,  0), ivec3(1,  1,  0),
-  ivec3(-1,  1,  1), ivec3(0,  1,  1), ivec3(1,  1,  1)
+#ifdef SPH_SOA_LAYOUT
+// Neighbor fields come from the structure-of-arrays mirror written by the reorder pass
+layout(binding = 10, std430) restrict readonly buffer soaPositionBuf
+{
+  vec4 soaPositions[];
+};
+
+#ifdef SPH_HALF_VELOCITY
+layout(binding = 11, std430) restrict readonly buffer soaVelocityBuf
+{
+  uvec2 soaVelocities[];
+};
+
+vec3 neighborVelocity(uint id)
+{
+  uvec2 packedVelocity = soaVelocities[id];
+  return vec3(unpackHalf2x16(packedVelocity.x), unpackHalf2x16(packedVelocity.y).x);
+}
+#else
+layout(binding = 11, std430) restrict readonly buffer soaVelocityBuf
+{
+  vec4 soaVelocities[];
+};
+
+vec3 neighborVelocity(uint id) { return soaVelocities[id].xyz; }
+#endif
+
+vec3 neighborPosition(uint id) { return soaPositions[id].xyz; }
+#else
+vec3 neighborPosition(uint id) { return particles[id].position; }
+vec3 neighborVelocity(uint id) { return particles[id].velocity; }
+#endif
+
+// Substep constants shared by the simulation passes, uploaded once per substep
+// (SPHParameterBlock)
+layout(std140, binding = 0) uniform SPHParameters
+{
+  vec3 uGridOrigin;
+  float uDT;
+  vec3 uGridSize;
+  float uMaxVelocity;
+  vec3 uInvCellSize;
+  float uWallDamping;         // Fraction of the normal velocity kept by a wall bounce
+  ivec3 uGridRes;
+  float uSceneStride;         // Batched scenes: x offset between the scenes
+  vec3 uGravity;
+  int uSceneCount;
+  vec3 uStepGravity;          // Gravity step 1 integrates; zero when PCISPH does
+  int uBatchScenes;           // Scene count, 0 when not batched
+  float uParticleMass;
+  float uHalfSkinSq;
+  uint uListStride;
+  int uUseNeighborList;
+  int uDiffusePotentials;
+  int uParticleSleeping;
+  uint uSleepSubsteps;
+  float uSleepVelocity;
+  float uSleepDensityChange;  // Relative density change per substep
 };
 
+// Grid resolution of the cell addressing in sph_grid.glsl
+ivec3 gridResolution() { return uGridRes; }
+
+// Fluid parameters, injected as #defines by SPHComputeSystem (defaults match SPHConstants)
+#ifndef SPH_KERNEL_RADIUS
+#define SPH_KERNEL_RADIUS 0.1828
+#endif
+
+const float KERNEL_RADIUS = SPH_KERNEL_RADIUS;
+
+// The voxels are two cells (at least two kernel radii) apart, so the filter reaches two
+// kernel radii to cover the particles between them; the weights are normalized, so Poly6 needs no constant
+const float FILTER_RADIUS = 2.0 * KERNEL_RADIUS;
+
+// Particle count of an in-grid cell, 0 for an empty block
+uint occupancy(ivec3 voxel)
+{
+  uint cellId = gridCell(voxel);
+  return cellId == EMPTY_CELL ? 0u : cellCount[cellId];
+}
+
 void main()
 {
-  ivec3 voxelId = ivec3(gl_GlobalInvocationID);
+#ifdef SPH_SPARSE_DOMAIN
+  uint activeSlot = gl_GlobalInvocationID.x;
+  if (activeSlot >= activeCellCount) return;
   
-  if (any(greaterThanEqual(voxelId, uGridRes))) return;
+  uint activeCell = activeCells[activeSlot];
+  ivec3 cell = denseVoxel(activeCell);
+  ivec3 blockId = cell / 2;
   
-  // Calculate world position of this voxel center
-  vec3 voxelWorldPos = uGridOrigin + (vec3(voxelId) + 0.5) * (uGridSize / vec3(uGridRes));
+  // Only the block's first occupied cell goes on, so each voxel is computed once
+  for (int i = 0; i < 8; i++)
+  {
+    ivec3 mate = blockId * 2 + ivec3(i & 1, (i >> 1) & 1, i >> 2);
+    if (mate == cell) break;
+    if (all(lessThan(mate, uGridRes)) && occupancy(mate) > 0u) return;
+  }
+#else
+  ivec3 blockId = ivec3(gl_GlobalInvocationID);
+  if (any(greaterThanEqual(blockId, imageSize(velocityField)))) return;
+  
+  uint blockParticles = 0u;
+  for (int i = 0; i < 8; i++)
+  {
+    ivec3 cell = blockId * 2 + ivec3(i & 1, (i >> 1) & 1, i >> 2);
+    if (all(lessThan(cell, uGridRes))) blockParticles += occupancy(cell);
+  }
+  if (blockParticles == 0u) return;
+#endif
+  
+  // The corner the block's eight cells share, in cells and in world space
+  vec3 center = vec3(blockId * 2 + 1);
+  vec3 voxelWorldPos = uGridOrigin + center / uInvCellSize;
+  ivec3 cellMin = max(ivec3(floor(center - FILTER_RADIUS * uInvCellSize)), ivec3(0));
+  ivec3 cellMax = min(ivec3(floor(center + FILTER_RADIUS * uInvCellSize)), uGridRes - 1);
   
   vec3 velocitySum = vec3(0.0);
   float weightSum = 0.0;
   
-  uint voxelCount = 0;
-  uint voxelParticleCount = 0;
-  uint voxelParticleOffset = 0;
-  
-  // O(n) spatial hashing neighbor search
-  #pragma unroll 1
-  while (voxelCount < 27 || voxelParticleCount > 0)
+  for (int z = cellMin.z; z <= cellMax.z; z++)
   {
-    if (voxelParticleCount == 0)
+    for (int y = cellMin.y; y <= cellMax.y; y++)
     {
-      ivec3 neighborVoxel = voxelId + NEIGHBORHOOD_LUT[voxelCount];
-      voxelCount++;
-      
-      if (any(lessThan(neighborVoxel, ivec3(0))) || any(greaterThanEqual(neighborVoxel, uGridRes)))
-      {
-        continue;
-      }
-      
-      uint voxelValue = imageLoad(grid, neighborVoxel).r;
-      voxelParticleOffset = (voxelValue >> 8);
-      voxelParticleCount = (voxelValue & 0xFF);
-      
-      if (voxelParticleCount == 0)
+      for (int x = cellMin.x; x <= cellMax.x; x++)
       {
-        continue;
+        uint cellId = gridCell(ivec3(x, y, z));
+        if (cellId == EMPTY_CELL) continue;
+        
+        uint first = cellStart[cellId];
+        uint end = first + cellCount[cellId];
+        for (uint slot = first; slot < end; slot++)
+        {
+          uint particleId = cellParticle(slot);
+          vec3 r = voxelWorldPos - neighborPosition(particleId);
+          float rSq = dot(r, r);
+          if (rSq >= FILTER_RADIUS * FILTER_RADIUS) continue;
+          
+          float weight = pow(FILTER_RADIUS * FILTER_RADIUS - rSq, 3);
+          velocitySum += neighborVelocity(particleId) * weight;
+          weightSum += weight;
+        }
       }
     }
-    
-    voxelParticleCount--;
-    
-    uint particleId = voxelParticleOffset + voxelParticleCount;
-    vec3 particlePos = particles[particleId].position;
-    
-    vec3 r = voxelWorldPos - particlePos;
-    float rLen = length(r);
-    
-    if (rLen >= KERNEL_RADIUS) continue;
-    
-    // Poly6 kernel weight
-    float weight = POLY6_KERNEL_WEIGHT_CONST * pow(KERNEL_RADIUS * KERNEL_RADIUS - rLen * rLen, 3);
-    
-    velocitySum += particles[particleId].velocity * weight;
-    weightSum += weight;
   }
   
-  vec3 filteredVelocity = vec3(0.0);
-  if (weightSum > 0.0) {
-    filteredVelocity = velocitySum / weightSum;
+  // A voxel no particle reaches stays cleared instead of reading as still fluid
+  if (weightSum > 0.0)
+  {
+    imageStore(velocityField, blockId, vec4(velocitySum / weightSum, 1.0));
   }
-  
-  imageStore(velocityField, voxelId, vec4(filteredVelocity, 1.0));
-}
\ No newline at end of file
+}
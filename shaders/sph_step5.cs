@@ -1,9 +1,31 @@
 #version 460 core
 // SPH Step 5: Density and pressure calculation with O(n) spatial hashing
+//
+// With SPH_TILED_NEIGHBORS one workgroup handles one active cell: the neighbor particles
+// are staged into shared memory a tile at a time and every particle of the cell iterates
+// the shared tile, instead of each thread fetching its own neighbors from global memory.
+//
+// With uDiffusePotentials the same neighbor walk accumulates the surface normal and the
+// trapped-air potential that seed secondary particles (sph_diffuse.cs).
+//
+// With uSurfaceTension it also sums the color-field normal step 6's surface tension reads.
 
-layout(local_size_x = 64) in;
+#ifndef SPH_WORKGROUP_SIZE
+#define SPH_WORKGROUP_SIZE 64 // Injected by SPHComputeSystem
+#endif
+#define TILE_SIZE SPH_WORKGROUP_SIZE
 
-layout(r32ui, binding = 0) uniform restrict readonly uimage3D grid;
+layout(local_size_x = TILE_SIZE) in;
+
+layout(binding = 2, std430) restrict readonly buffer cellCountBuf
+{
+  uint cellCount[];
+};
+
+layout(binding = 3, std430) restrict readonly buffer cellStartBuf
+{
+  uint cellStart[];
+};
 
 struct Particle
 {
@@ -18,17 +40,273 @@ layout(binding = 0, std430) restrict buffer particleBuf
   Particle particles[];
 };
 
-uniform vec3 uInvCellSize;
-uniform vec3 uGridOrigin;
-uniform ivec3 uGridRes;
+#ifdef SPH_SOA_LAYOUT
+// Neighbor positions come from the structure-of-arrays mirror written by the reorder pass
+layout(binding = 10, std430) restrict readonly buffer soaPositionBuf
+{
+  vec4 soaPositions[];
+};
+
+layout(binding = 12, std430) restrict writeonly buffer soaDensityPressureBuf
+{
+  vec2 soaDensityPressure[];
+};
+
+vec3 neighborPosition(uint id) { return soaPositions[id].xyz; }
+#else
+vec3 neighborPosition(uint id) { return particles[id].position; }
+#endif
+
+// Verlet neighbor list mode (indices into the unsorted particle buffer)
+layout(binding = 15, std430) restrict readonly buffer neighborCountBuf
+{
+  uint neighborCounts[];
+};
+
+layout(binding = 16, std430) restrict readonly buffer neighborListBuf
+{
+  uint neighborList[];
+};
+
+#ifdef SPH_COUNTERS
+// Instrumentation build (SPH_GPU_COUNTERS): health counters of the substep, cleared before
+// it and read back by SPHComputeSystem (SPHCounters). Steps 3, 5 and 6 all declare it
+layout(binding = 43, std430) restrict buffer sphCounterBuf
+{
+  uint counterOutOfGrid;
+  uint counterDroppedWrites;
+  uint counterOccupiedCells;
+  uint counterMaxCellOccupancy;
+  uint counterOverfullCells;
+  uint counterCellParticles;
+  uint counterCandidateSum;
+  uint counterMaxCandidates;
+  uint counterNeighborSum;
+  uint counterMaxNeighbors;
+  uint counterSampledParticles;
+  uint counterGridCounted;
+  uint candidateHistogram[SPH_COUNTER_BINS];
+  uint neighborHistogram[SPH_COUNTER_BINS];
+};
+
+uint counterBin(uint count)
+{
+  return min(count / uint(SPH_COUNTER_BIN_WIDTH), uint(SPH_COUNTER_BINS - 1));
+}
+
+void countCandidates(uint candidates)
+{
+  atomicAdd(counterSampledParticles, 1u);
+  atomicAdd(counterCandidateSum, candidates);
+  atomicMax(counterMaxCandidates, candidates);
+  atomicAdd(candidateHistogram[counterBin(candidates)], 1u);
+}
+#endif
+
+// Live particle count, maintained on the GPU by sph_particle_count.cs
+layout(binding = 24, std430) restrict readonly buffer particleCountBuf
+{
+  uint particleDispatch[3];
+  uint liveParticleCount;
+};
+
+// Secondary particle potentials; step 6 adds the wave crest potential
+struct DiffusePotential
+{
+  vec4 normalTrappedAir;  // Unnormalized surface normal, trapped air
+  vec4 waveCrest;         // x = wave crest
+};
+
+layout(binding = 32, std430) restrict writeonly buffer diffusePotentialBuf
+{
+  DiffusePotential diffusePotentials[];
+};
+
+// Surface tension (Akinci et al. 2013): the color-field normal scaled by the kernel radius,
+// zero inside the fluid, for step 6. Skipped when the coefficient is 0
+layout(binding = 50, std430) restrict writeonly buffer surfaceNormalBuf
+{
+  vec4 surfaceNormals[];
+};
+
+uniform float uSurfaceTension;
+
+// Substep constants shared by the simulation passes, uploaded once per substep
+// (SPHParameterBlock)
+layout(std140, binding = 0) uniform SPHParameters
+{
+  vec3 uGridOrigin;
+  float uDT;
+  vec3 uGridSize;
+  float uMaxVelocity;
+  vec3 uInvCellSize;
+  float uWallDamping;         // Fraction of the normal velocity kept by a wall bounce
+  ivec3 uGridRes;
+  float uSceneStride;         // Batched scenes: x offset between the scenes
+  vec3 uGravity;
+  int uSceneCount;
+  vec3 uStepGravity;          // Gravity step 1 integrates; zero when PCISPH does
+  int uBatchScenes;           // Scene count, 0 when not batched
+  float uParticleMass;
+  float uHalfSkinSq;
+  uint uListStride;
+  int uUseNeighborList;
+  int uDiffusePotentials;
+  int uParticleSleeping;
+  uint uSleepSubsteps;
+  float uSleepVelocity;
+  float uSleepDensityChange;  // Relative density change per substep
+};
+
+// Grid resolution of the cell addressing in sph_grid.glsl
+ivec3 gridResolution() { return uGridRes; }
+
+#ifdef SPH_TILED_NEIGHBORS
+layout(binding = 21, std430) restrict readonly buffer activeCellBuf
+{
+  uint activeCells[];
+};
+
+layout(binding = 22, std430) restrict readonly buffer sparseDispatchBuf
+{
+  uint sparseGroups[3];
+  uint activeCellCount;
+};
+
+// Cells are laid out in linear order by the atomic scatter, so the three cells of an x row
+// form one contiguous particle range; the Morton sort only guarantees per-cell ranges
+uniform int uRowContiguous;
+
+shared vec3 tilePositions[TILE_SIZE];
+shared vec3 tileVelocities[TILE_SIZE]; // Staged only for the diffuse potentials
+
+// Particle sleeping (sph_sleep.cs): the largest motion of the cell's particles, normalised
+// by its sleep threshold, as float bits
+layout(binding = 38, std430) restrict buffer cellActivityBuf
+{
+  uvec4 cellActivity[];  // Quiet substeps, motion, latched motion, unused
+};
+
+shared uint cellMotion;
+#endif
+
+// Fluid parameters, injected as #defines by SPHComputeSystem (defaults match SPHConstants)
+#ifndef SPH_MASS
+#define SPH_MASS 0.02
+#endif
+#ifndef SPH_KERNEL_RADIUS
+#define SPH_KERNEL_RADIUS 0.1828
+#endif
+#ifndef SPH_REST_DENSITY
+#define SPH_REST_DENSITY 998.27
+#endif
+#ifndef SPH_STIFFNESS
+#define SPH_STIFFNESS 250.0
+#endif
+#ifndef SPH_PRESSURE_LIMIT
+#define SPH_PRESSURE_LIMIT 50000.0
+#endif
 
 // SPH constants
-const float MASS = 0.02;
-const float KERNEL_RADIUS = 0.1828; // 4 * 0.0457
+const float MASS = SPH_MASS;
+const float KERNEL_RADIUS = SPH_KERNEL_RADIUS;
 const float POLY6_KERNEL_WEIGHT_CONST = 315.0 / (64.0 * 3.14159265 * pow(KERNEL_RADIUS, 9));
-const float STIFFNESS_K = 250.0;
-const float REST_DENSITY = 998.27;
+const float POLY6_GRADIENT_CONST = -945.0 / (32.0 * 3.14159265 * pow(KERNEL_RADIUS, 9));
+const float STIFFNESS_K = SPH_STIFFNESS;
+const float REST_DENSITY = SPH_REST_DENSITY;
 const float REST_PRESSURE = 0.0;
+const float PRESSURE_LIMIT = SPH_PRESSURE_LIMIT;
+
+// Batched scenes (SPHComputeSystem::setBatchScenes): a particle's scene is the slab of
+// uSceneStride along x it is in, and that scene's parameters replace the compiled stiffness
+layout(binding = 41, std430) restrict readonly buffer sceneParameterBuf
+{
+  vec4 sceneParameters[];  // Stiffness, viscosity, unused, unused
+};
+
+float sceneStiffness(vec3 position)
+{
+  if (uBatchScenes == 0) return STIFFNESS_K;
+  int scene = clamp(int(floor((position.x - uGridOrigin.x) / uSceneStride)), 0, uBatchScenes - 1);
+  return sceneParameters[scene].x;
+}
+
+// Adaptive resolution (sph_adaptive.cs): LEVEL_BIT marks a coarse particle with
+// ADAPTIVE_MASS_SCALE times the mass and ADAPTIVE_RADIUS_SCALE times the kernel radius. A
+// pair uses the mean of the two radii, W_sh(r) = W_h(r / s) / s^3
+#ifdef SPH_ADAPTIVE_RESOLUTION
+#ifndef SPH_ADAPTIVE_MASS_SCALE
+#define SPH_ADAPTIVE_MASS_SCALE 2.0
+#endif
+#ifndef SPH_ADAPTIVE_RADIUS_SCALE
+#define SPH_ADAPTIVE_RADIUS_SCALE 1.25992105
+#endif
+
+uint particleLevel(uint id)
+{
+  return floatBitsToUint(particles[id].pressure) & LEVEL_BIT;
+}
+#else
+uint particleLevel(uint id)
+{
+  return 0u;
+}
+#endif
+
+#ifdef SPH_MULTIPHASE
+layout(std140, binding = 3) uniform SPHPhases
+{
+  vec4 uPhaseParameters[SPH_MAX_PHASES];  // Rest density, mass, viscosity, interface tension
+};
+#endif
+
+// Density contrast (Solenthaler and Pajarola 2008): the number density times the particle's
+// own phase mass, so a light phase next to a heavy one is not smeared toward its density
+float phaseDensity(float density, uint phase)
+{
+#ifdef SPH_MULTIPHASE
+  return density * (uPhaseParameters[phase].y / MASS);
+#else
+  return density;
+#endif
+}
+
+float phaseRestDensity(uint phase)
+{
+#ifdef SPH_MULTIPHASE
+  return uPhaseParameters[phase].x;
+#else
+  return REST_DENSITY;
+#endif
+}
+
+// SPH_TAIT_EXPONENT is a compile-time constant, so the loop unrolls into squarings
+// (x^7: three multiplies and a squaring) instead of pow's exp2/log2
+#ifdef SPH_TAIT_EXPONENT
+float taitPower(float x)
+{
+  float result = 1.0;
+  float base = x;
+  for (int e = SPH_TAIT_EXPONENT; e > 0; e >>= 1)
+  {
+    if ((e & 1) != 0) result *= base;
+    base *= base;
+  }
+  return result;
+}
+#endif
+
+float equationOfState(float density, float restDensity, float stiffness)
+{
+#ifdef SPH_TAIT_EXPONENT
+  // Tait, B = stiffness * rho0 / gamma: the slope at rest matches the linear state
+  const float gamma = float(SPH_TAIT_EXPONENT);
+  float pressure = REST_PRESSURE + stiffness * restDensity / gamma * (taitPower(density / restDensity) - 1.0);
+#else
+  float pressure = REST_PRESSURE + stiffness * (density - restDensity);
+#endif
+  return clamp(pressure, -PRESSURE_LIMIT, PRESSURE_LIMIT);
+}
 
 const ivec3 NEIGHBORHOOD_LUT[27] = {
   ivec3(-1, -1, -1), ivec3(0, -1, -1), ivec3(1, -1, -1),
@@ -42,20 +320,262 @@ const ivec3 NEIGHBORHOOD_LUT[27] = {
   ivec3(-1,  1,  1), ivec3(0,  1,  1), ivec3(1,  1,  1)
 };
 
+#ifdef SPH_KERNEL_TABLE
+// Kernel weights tabulated over q = r^2 / h^2 by SPHComputeSystem::updateKernelTable():
+// x = Poly6 W, y = Spiky gradient / r, z = viscosity laplacian. Linear interpolation
+// replaces the sqrt and pow of the analytic kernels
+layout(binding = 28, std430) restrict readonly buffer kernelTableBuf
+{
+  vec4 kernelTable[];
+};
+
+vec4 kernelLookup(float r2)
+{
+  float x = min(r2 / (KERNEL_RADIUS * KERNEL_RADIUS), 1.0) * float(SPH_KERNEL_TABLE_SIZE - 1);
+  uint i = min(uint(x), uint(SPH_KERNEL_TABLE_SIZE - 2));
+  return mix(kernelTable[i], kernelTable[i + 1], x - float(i));
+}
+#endif
+
+// Poly6 density contribution of a neighbor at offset r (zero outside the kernel)
+float densityWeight(vec3 r)
+{
+#ifdef SPH_KERNEL_TABLE
+  float r2 = dot(r, r);
+  return r2 < KERNEL_RADIUS * KERNEL_RADIUS ? MASS * kernelLookup(r2).x : 0.0;
+#else
+  float rLen = length(r);
+  return rLen < KERNEL_RADIUS ? MASS * pow(KERNEL_RADIUS * KERNEL_RADIUS - rLen * rLen, 3) * POLY6_KERNEL_WEIGHT_CONST : 0.0;
+#endif
+}
+
+// Density contribution of a neighbor of level otherLevel to a particle of level level
+float neighborDensityWeight(vec3 r, uint level, uint otherLevel)
+{
+#ifdef SPH_ADAPTIVE_RESOLUTION
+  float scale = 1.0 + (SPH_ADAPTIVE_RADIUS_SCALE - 1.0) * 0.5 * float((level + otherLevel) / LEVEL_BIT);
+  float mass = otherLevel != 0u ? SPH_ADAPTIVE_MASS_SCALE : 1.0;
+  return mass * densityWeight(r / scale) / (scale * scale * scale);
+#else
+  return densityWeight(r);
+#endif
+}
+
+// Poly6 gradient for the color-field normal. The neighbors' volume is taken at the rest
+// density, since their densities are what this pass computes
+vec3 colorFieldGradient(vec3 r)
+{
+  float diff = KERNEL_RADIUS * KERNEL_RADIUS - dot(r, r);
+  return diff > 0.0 ? POLY6_GRADIENT_CONST * diff * diff * r : vec3(0.0);
+}
+
+void storeSurfaceNormal(uint particleId, vec3 gradient)
+{
+  surfaceNormals[particleId] = vec4(gradient * (KERNEL_RADIUS * MASS / REST_DENSITY), 0.0);
+}
+
+// Trapped air (Ihmsen et al. 2012): neighbors closing in on each other, weighted by the
+// radially symmetric 1 - r / h; the same weights sum the offsets into the surface normal
+void accumulateDiffusePotentials(vec3 r, vec3 velocityDiff, inout vec3 normal, inout float trappedAir)
+{
+  float rLen = length(r);
+  if (rLen >= KERNEL_RADIUS || rLen <= 0.0001) return;
+  
+  float weight = 1.0 - rLen / KERNEL_RADIUS;
+  normal += r / rLen * weight;
+  float speed = length(velocityDiff);
+  if (speed > 0.0001)
+  {
+    trappedAir += speed * (1.0 - dot(velocityDiff / speed, r / rLen)) * weight;
+  }
+}
+
+#ifdef SPH_TILED_NEIGHBORS
+void main()
+{
+  // Everything up to the per-particle work is uniform across the workgroup, as the
+  // barriers require
+  if (gl_WorkGroupID.x >= activeCellCount) return;
+  
+  uint localId = gl_LocalInvocationID.x;
+  uint cellId = activeCells[gl_WorkGroupID.x];
+  if (uParticleSleeping != 0)
+  {
+    if (localId == 0) cellMotion = 0u;
+    barrier();
+  }
+  
+  ivec3 voxelId = ivec3(cellId % uint(uGridRes.x),
+                        (cellId / uint(uGridRes.x)) % uint(uGridRes.y),
+                        cellId / uint(uGridRes.x * uGridRes.y));
+  uint firstParticle = cellStart[cellId];
+  uint cellParticleCount = cellCount[cellId];
+  
+  int xMin = max(voxelId.x - 1, 0);
+  int xMax = min(voxelId.x + 1, uGridRes.x - 1);
+  
+  for (uint base = 0; base < cellParticleCount; base += TILE_SIZE)
+  {
+    bool active = base + localId < cellParticleCount;
+    uint particleId = firstParticle + base + localId;
+    vec3 position = active ? neighborPosition(particleId) : vec3(0.0);
+    vec3 velocity = active && uDiffusePotentials != 0 ? particles[particleId].velocity : vec3(0.0);
+    uint level = active ? particleLevel(particleId) : 0u;
+    float density = 0.0;
+    vec3 normal = vec3(0.0);
+    float trappedAir = 0.0;
+    vec3 colorGradient = vec3(0.0);
+#ifdef SPH_COUNTERS
+    uint candidates = 0u;
+#endif
+    
+    for (int dz = -1; dz <= 1; dz++)
+    {
+      for (int dy = -1; dy <= 1; dy++)
+      {
+        ivec2 row = voxelId.yz + ivec2(dy, dz);
+        if (any(lessThan(row, ivec2(0))) || any(greaterThanEqual(row, uGridRes.yz))) continue;
+        
+        uint rowCell = uint(uGridRes.x * (row.x + uGridRes.y * row.y));
+        int rangeCount = uRowContiguous != 0 ? 1 : xMax - xMin + 1;
+        
+        for (int range = 0; range < rangeCount; range++)
+        {
+          uint rangeStart;
+          uint rangeEnd;
+          if (uRowContiguous != 0)
+          {
+            rangeStart = cellStart[rowCell + xMin];
+            rangeEnd = cellStart[rowCell + xMax] + cellCount[rowCell + xMax];
+          }
+          else
+          {
+            uint neighborCell = rowCell + uint(xMin + range);
+            rangeStart = cellStart[neighborCell];
+            rangeEnd = rangeStart + cellCount[neighborCell];
+          }
+          
+          for (uint tileStart = rangeStart; tileStart < rangeEnd; tileStart += TILE_SIZE)
+          {
+            uint tileCount = min(uint(TILE_SIZE), rangeEnd - tileStart);
+            if (localId < tileCount)
+            {
+              tilePositions[localId] = neighborPosition(tileStart + localId);
+              if (uDiffusePotentials != 0)
+              {
+                tileVelocities[localId] = particles[tileStart + localId].velocity;
+              }
+            }
+            barrier();
+            
+            if (active)
+            {
+#ifdef SPH_COUNTERS
+              candidates += tileCount;
+#endif
+              for (uint j = 0; j < tileCount; j++)
+              {
+                vec3 r = position - tilePositions[j];
+                density += neighborDensityWeight(r, level, particleLevel(tileStart + j));
+                if (uSurfaceTension > 0.0)
+                {
+                  colorGradient += colorFieldGradient(r);
+                }
+                if (uDiffusePotentials != 0)
+                {
+                  accumulateDiffusePotentials(r, velocity - tileVelocities[j], normal, trappedAir);
+                }
+              }
+            }
+            barrier();
+          }
+        }
+      }
+    }
+    
+    if (active)
+    {
+      uint tags = particleTags(particles[particleId].pressure);
+      uint phase = tags & PHASE_MASK;
+      density = phaseDensity(density, phase);
+      float pressure = withTags(equationOfState(density, phaseRestDensity(phase), sceneStiffness(position)), tags);
+      if (uParticleSleeping != 0)
+      {
+        float densityChange = abs(density - particles[particleId].density) / max(density, 0.0001);
+        atomicMax(cellMotion, floatBitsToUint(densityChange / uSleepDensityChange));
+      }
+      particles[particleId].density = density;
+      particles[particleId].pressure = pressure;
+#ifdef SPH_SOA_LAYOUT
+      soaDensityPressure[particleId] = vec2(density, pressure);
+#endif
+      if (uDiffusePotentials != 0)
+      {
+        diffusePotentials[particleId].normalTrappedAir = vec4(normal, trappedAir);
+      }
+      if (uSurfaceTension > 0.0)
+      {
+        storeSurfaceNormal(particleId, colorGradient);
+      }
+#ifdef SPH_COUNTERS
+      countCandidates(candidates);
+#endif
+    }
+  }
+  
+  if (uParticleSleeping != 0)
+  {
+    barrier();
+    if (localId == 0) atomicMax(cellActivity[cellId].y, cellMotion);
+  }
+}
+#else
 void main()
 {
   uint particleId = gl_GlobalInvocationID.x;
   
   // Bounds check
-  if (particleId >= particles.length()) return;
+  if (particleId >= liveParticleCount) return;
   
   Particle particle = particles[particleId];
   
   ivec3 voxelId = ivec3(uInvCellSize * (particle.position - uGridOrigin));
+  // Other passes keep the tag bits, so a neighbor's level reads the same before or after
+  // its pressure is written here
+  uint level = particleTags(particle.pressure) & LEVEL_BIT;
   
   float density = 0.0;
+  vec3 normal = vec3(0.0);
+  float trappedAir = 0.0;
+  vec3 colorGradient = vec3(0.0);
+#ifdef SPH_COUNTERS
+  uint candidates = 0u;
+#endif
   
-  uint voxelCount = 0;
+  if (uUseNeighborList != 0)
+  {
+    uint neighborCount = neighborCounts[particleId];
+#ifdef SPH_COUNTERS
+    candidates = neighborCount;
+#endif
+    for (uint i = 0; i < neighborCount; i++)
+    {
+      uint otherParticleId = neighborList[i * uListStride + particleId];
+      vec3 r = particle.position - particles[otherParticleId].position;
+      density += neighborDensityWeight(r, level, particleLevel(otherParticleId));
+      if (uSurfaceTension > 0.0)
+      {
+        colorGradient += colorFieldGradient(r);
+      }
+      if (uDiffusePotentials != 0)
+      {
+        accumulateDiffusePotentials(r, particle.velocity - particles[otherParticleId].velocity, normal, trappedAir);
+      }
+    }
+  }
+  
+  // Starting past the last neighborhood entry skips the grid walk in list mode
+  uint voxelCount = uUseNeighborList != 0 ? 27 : 0;
   uint voxelParticleCount = 0;
   uint voxelParticleOffset = 0;
   
@@ -73,9 +593,14 @@ void main()
         continue;
       }
 
-      uint voxelValue = imageLoad(grid, newVoxelId).r;
-      voxelParticleOffset = (voxelValue >> 8);
-      voxelParticleCount = (voxelValue & 0xFF);
+      // Empty coarse blocks are skipped before any fine cell is read
+      uint cellId = gridCell(newVoxelId);
+      if (cellId == EMPTY_CELL)
+      {
+        continue;
+      }
+      voxelParticleOffset = cellStart[cellId];
+      voxelParticleCount = cellCount[cellId];
 
       if (voxelParticleCount == 0)
       {
@@ -84,29 +609,48 @@ void main()
     }
 
     voxelParticleCount--;
+#ifdef SPH_COUNTERS
+    candidates++;
+#endif
 
-    uint otherParticleId = voxelParticleOffset + voxelParticleCount;
-    vec3 otherParticlePos = particles[otherParticleId].position;
+    uint otherParticleId = cellParticle(voxelParticleOffset + voxelParticleCount);
+    vec3 otherParticlePos = neighborPosition(otherParticleId);
 
     vec3 r = particle.position - otherParticlePos;
 
-    float rLen = length(r);
-
-    if (rLen >= KERNEL_RADIUS)
+    density += neighborDensityWeight(r, level, particleLevel(otherParticleId));
+    if (uSurfaceTension > 0.0)
     {
-      continue;
+      colorGradient += colorFieldGradient(r);
+    }
+    if (uDiffusePotentials != 0)
+    {
+      accumulateDiffusePotentials(r, particle.velocity - particles[otherParticleId].velocity, normal, trappedAir);
     }
-
-    float weight = pow(KERNEL_RADIUS * KERNEL_RADIUS - rLen * rLen, 3) * POLY6_KERNEL_WEIGHT_CONST;
-
-    density += MASS * weight;
   }
   
-  // Calculate pressure using Tait equation
-  float pressure = REST_PRESSURE + STIFFNESS_K * (density - REST_DENSITY);
+  uint tags = particleTags(particle.pressure);
+  uint phase = tags & PHASE_MASK;
+  density = phaseDensity(density, phase);
+  float pressure = withTags(equationOfState(density, phaseRestDensity(phase), sceneStiffness(particle.position)), tags);
   
   particle.density = density;
   particle.pressure = pressure;
   
   particles[particleId] = particle;
-}
\ No newline at end of file
+#ifdef SPH_SOA_LAYOUT
+  soaDensityPressure[particleId] = vec2(density, pressure);
+#endif
+  if (uDiffusePotentials != 0)
+  {
+    diffusePotentials[particleId].normalTrappedAir = vec4(normal, trappedAir);
+  }
+  if (uSurfaceTension > 0.0)
+  {
+    storeSurfaceNormal(particleId, colorGradient);
+  }
+#ifdef SPH_COUNTERS
+  countCandidates(candidates);
+#endif
+}
+#endif
@@ -1,9 +1,34 @@
 #version 460 core
 // SPH Step 6: Force calculation with O(n) spatial hashing
+//
+// With SPH_TILED_NEIGHBORS one workgroup handles one active cell and stages neighbor
+// position/density and velocity/pressure tiles in shared memory (see sph_step5.cs).
+//
+// With uDiffusePotentials the neighbor walk also sums the wave crest potential from the
+// surface normals step 5 left for every particle.
+//
+// With uSurfaceTension the same neighbor walk adds Akinci-style cohesion and curvature from
+// the color-field normals step 5 wrote, so there is no extra neighbor pass.
+//
+// With uFilteredViscosity one trilinear fetch of step 4's velocity field replaces the
+// neighbor viscosity sum.
 
-layout(local_size_x = 64) in;
+#ifndef SPH_WORKGROUP_SIZE
+#define SPH_WORKGROUP_SIZE 64 // Injected by SPHComputeSystem
+#endif
+#define TILE_SIZE SPH_WORKGROUP_SIZE
 
-layout(r32ui, binding = 0) uniform restrict readonly uimage3D grid;
+layout(local_size_x = TILE_SIZE) in;
+
+layout(binding = 2, std430) restrict readonly buffer cellCountBuf
+{
+  uint cellCount[];
+};
+
+layout(binding = 3, std430) restrict readonly buffer cellStartBuf
+{
+  uint cellStart[];
+};
 
 struct Particle
 {
@@ -18,18 +43,253 @@ layout(binding = 0, std430) restrict buffer particleBuf
   Particle particles[];
 };
 
-uniform float uDT;
-uniform vec3 uGravity;
-uniform vec3 uInvCellSize;
-uniform vec3 uGridOrigin;
-uniform ivec3 uGridRes;
+#ifdef SPH_SOA_LAYOUT
+// Neighbor fields come from the structure-of-arrays mirror written by the reorder pass
+layout(binding = 10, std430) restrict readonly buffer soaPositionBuf
+{
+  vec4 soaPositions[];
+};
+
+#ifdef SPH_HALF_VELOCITY
+layout(binding = 11, std430) restrict readonly buffer soaVelocityBuf
+{
+  uvec2 soaVelocities[];
+};
+
+vec3 neighborVelocity(uint id)
+{
+  uvec2 packedVelocity = soaVelocities[id];
+  return vec3(unpackHalf2x16(packedVelocity.x), unpackHalf2x16(packedVelocity.y).x);
+}
+#else
+layout(binding = 11, std430) restrict readonly buffer soaVelocityBuf
+{
+  vec4 soaVelocities[];
+};
+
+vec3 neighborVelocity(uint id) { return soaVelocities[id].xyz; }
+#endif
+
+layout(binding = 12, std430) restrict readonly buffer soaDensityPressureBuf
+{
+  vec2 soaDensityPressure[];
+};
+
+vec2 neighborDensityPressure(uint id) { return soaDensityPressure[id]; }
+
+vec3 neighborPosition(uint id) { return soaPositions[id].xyz; }
+#else
+vec3 neighborPosition(uint id) { return particles[id].position; }
+vec3 neighborVelocity(uint id) { return particles[id].velocity; }
+vec2 neighborDensityPressure(uint id) { return vec2(particles[id].density, particles[id].pressure); }
+#endif
+
+// Verlet neighbor list mode (indices into the unsorted particle buffer)
+layout(binding = 15, std430) restrict readonly buffer neighborCountBuf
+{
+  uint neighborCounts[];
+};
+
+layout(binding = 16, std430) restrict readonly buffer neighborListBuf
+{
+  uint neighborList[];
+};
+
+#ifdef SPH_COUNTERS
+// Instrumentation build (SPH_GPU_COUNTERS): health counters of the substep, cleared before
+// it and read back by SPHComputeSystem (SPHCounters). Steps 3, 5 and 6 all declare it
+layout(binding = 43, std430) restrict buffer sphCounterBuf
+{
+  uint counterOutOfGrid;
+  uint counterDroppedWrites;
+  uint counterOccupiedCells;
+  uint counterMaxCellOccupancy;
+  uint counterOverfullCells;
+  uint counterCellParticles;
+  uint counterCandidateSum;
+  uint counterMaxCandidates;
+  uint counterNeighborSum;
+  uint counterMaxNeighbors;
+  uint counterSampledParticles;
+  uint counterGridCounted;
+  uint candidateHistogram[SPH_COUNTER_BINS];
+  uint neighborHistogram[SPH_COUNTER_BINS];
+};
+
+uint counterBin(uint count)
+{
+  return min(count / uint(SPH_COUNTER_BIN_WIDTH), uint(SPH_COUNTER_BINS - 1));
+}
+
+void countNeighbors(uint neighbors)
+{
+  atomicAdd(counterNeighborSum, neighbors);
+  atomicMax(counterMaxNeighbors, neighbors);
+  atomicAdd(neighborHistogram[counterBin(neighbors)], 1u);
+}
+#endif
+
+// Live particle count, maintained on the GPU by sph_particle_count.cs
+layout(binding = 24, std430) restrict readonly buffer particleCountBuf
+{
+  uint particleDispatch[3];
+  uint liveParticleCount;
+};
+
+// Secondary particle potentials (see sph_step5.cs)
+struct DiffusePotential
+{
+  vec4 normalTrappedAir;
+  vec4 waveCrest;
+};
+
+layout(binding = 32, std430) restrict buffer diffusePotentialBuf
+{
+  DiffusePotential diffusePotentials[];
+};
+
+// Surface tension color-field normals (see sph_step5.cs)
+layout(binding = 50, std430) restrict readonly buffer surfaceNormalBuf
+{
+  vec4 surfaceNormals[];
+};
+
+uniform float uSurfaceTension;
+uniform int uImplicitViscosity;  // sph_viscosity.cs applies the viscosity after this pass
+uniform int uFilteredViscosity;
+uniform sampler3D velocityField; // Half resolution, premultiplied by occupancy (sph_step4.cs)
+
+// Substep constants shared by the simulation passes, uploaded once per substep
+// (SPHParameterBlock)
+layout(std140, binding = 0) uniform SPHParameters
+{
+  vec3 uGridOrigin;
+  float uDT;
+  vec3 uGridSize;
+  float uMaxVelocity;
+  vec3 uInvCellSize;
+  float uWallDamping;         // Fraction of the normal velocity kept by a wall bounce
+  ivec3 uGridRes;
+  float uSceneStride;         // Batched scenes: x offset between the scenes
+  vec3 uGravity;
+  int uSceneCount;
+  vec3 uStepGravity;          // Gravity step 1 integrates; zero when PCISPH does
+  int uBatchScenes;           // Scene count, 0 when not batched
+  float uParticleMass;
+  float uHalfSkinSq;
+  uint uListStride;
+  int uUseNeighborList;
+  int uDiffusePotentials;
+  int uParticleSleeping;
+  uint uSleepSubsteps;
+  float uSleepVelocity;
+  float uSleepDensityChange;  // Relative density change per substep
+};
+
+// Grid resolution of the cell addressing in sph_grid.glsl
+ivec3 gridResolution() { return uGridRes; }
+
+// Multirate time stepping (sph_time_levels.cs): the grid and list loops run indirectly over
+// the particles due in this substep, integrate over each one's own step and pick its next
+// time level; levels ride in the pressure bits above the phase and resolution tags
+
+layout(binding = 58, std430) restrict readonly buffer dueParticleBuf
+{
+  uint dueParticles[];
+};
+
+layout(binding = 59, std430) restrict readonly buffer dueDispatchBuf
+{
+  uint dueGroups[3];
+  uint dueParticleCount;
+};
+
+uniform int uMultirate;
+uniform uint uTimeSubstep;
+uniform uint uTimeLevels;       // SPHConstants::MULTIRATE_LEVELS
+uniform float uMultirateCFL;    // Step limit as a fraction of h / speed
+uniform float uMultirateForce;  // Step limit as a fraction of sqrt(h / acceleration)
+
+// The coarsest level within the particle's own speed and acceleration limits, at most one
+// above its finest neighbor and one above its current level. A coarser level has to have
+// the substep the particle is next due at on its schedule; a finer one always has
+uint nextTimeLevel(uint level, uint neighborLevel, vec3 velocity, vec3 acceleration)
+{
+  float limit = min(uMultirateCFL * KERNEL_RADIUS / max(length(velocity), 1.0e-6),
+                    uMultirateForce * sqrt(KERNEL_RADIUS / max(length(acceleration), 1.0e-6)));
+  uint target = 0u;
+  while (target + 1u < uTimeLevels && uDT * float(2u << target) <= limit) target++;
+  target = min(target, min(neighborLevel, level) + 1u);
+  
+  uint nextDue = uTimeSubstep + (1u << level);
+  while (target > level && (nextDue & ((1u << target) - 1u)) != 0u) target--;
+  return target;
+}
+
+#ifdef SPH_TILED_NEIGHBORS
+layout(binding = 21, std430) restrict readonly buffer activeCellBuf
+{
+  uint activeCells[];
+};
+
+layout(binding = 22, std430) restrict readonly buffer sparseDispatchBuf
+{
+  uint sparseGroups[3];
+  uint activeCellCount;
+};
+
+uniform int uRowContiguous;
+
+shared vec4 tilePositionDensity[TILE_SIZE];
+shared vec4 tileVelocityPressure[TILE_SIZE];
+
+// Particle sleeping (sph_sleep.cs): the largest motion of the cell's particles, normalised
+// by its sleep threshold, as float bits
+layout(binding = 38, std430) restrict buffer cellActivityBuf
+{
+  uvec4 cellActivity[];  // Quiet substeps, motion, latched motion, unused
+};
+
+shared uint cellMotion;
+#endif
+
+// Fluid parameters, injected as #defines by SPHComputeSystem (defaults match SPHConstants)
+#ifndef SPH_MASS
+#define SPH_MASS 0.02
+#endif
+#ifndef SPH_KERNEL_RADIUS
+#define SPH_KERNEL_RADIUS 0.1828
+#endif
+#ifndef SPH_VISCOSITY
+#define SPH_VISCOSITY 0.035
+#endif
+#ifndef SPH_REST_DENSITY
+#define SPH_REST_DENSITY 998.27
+#endif
 
 // SPH constants
-const float MASS = 0.02;
-const float KERNEL_RADIUS = 0.1828; // 4 * 0.0457
-const float VIS_COEFF = 0.035;
+const float MASS = SPH_MASS;
+const float KERNEL_RADIUS = SPH_KERNEL_RADIUS;
+const float VIS_COEFF = SPH_VISCOSITY;
 const float SPIKY_KERNEL_WEIGHT_CONST = 15.0 / (3.14159265 * pow(KERNEL_RADIUS, 6));
 const float VIS_KERNEL_WEIGHT_CONST = 45.0 / (3.14159265 * pow(KERNEL_RADIUS, 6));
+const float REST_DENSITY = SPH_REST_DENSITY;
+const float COHESION_KERNEL_CONST = 32.0 / (3.14159265 * pow(KERNEL_RADIUS, 9));
+
+// Batched scenes (SPHComputeSystem::setBatchScenes): a particle's scene is the slab of
+// uSceneStride along x it is in, and that scene's parameters replace the compiled viscosity
+layout(binding = 41, std430) restrict readonly buffer sceneParameterBuf
+{
+  vec4 sceneParameters[];  // Stiffness, viscosity, unused, unused
+};
+
+float sceneViscosity(vec3 position)
+{
+  if (uImplicitViscosity != 0) return 0.0;
+  if (uBatchScenes == 0) return VIS_COEFF;
+  int scene = clamp(int(floor((position.x - uGridOrigin.x) / uSceneStride)), 0, uBatchScenes - 1);
+  return sceneParameters[scene].y;
+}
 
 const ivec3 NEIGHBORHOOD_LUT[27] = {
   ivec3(-1, -1, -1), ivec3(0, -1, -1), ivec3(1, -1, -1),
@@ -43,21 +303,416 @@ const ivec3 NEIGHBORHOOD_LUT[27] = {
   ivec3(-1,  1,  1), ivec3(0,  1,  1), ivec3(1,  1,  1)
 };
 
+#ifdef SPH_KERNEL_TABLE
+// Kernel weights tabulated over q = r^2 / h^2 by SPHComputeSystem::updateKernelTable():
+// x = Poly6 W, y = Spiky gradient / r, z = viscosity laplacian. Linear interpolation
+// replaces the sqrt and pow of the analytic kernels
+layout(binding = 28, std430) restrict readonly buffer kernelTableBuf
+{
+  vec4 kernelTable[];
+};
+
+vec4 kernelLookup(float r2)
+{
+  float x = min(r2 / (KERNEL_RADIUS * KERNEL_RADIUS), 1.0) * float(SPH_KERNEL_TABLE_SIZE - 1);
+  uint i = min(uint(x), uint(SPH_KERNEL_TABLE_SIZE - 2));
+  return mix(kernelTable[i], kernelTable[i + 1], x - float(i));
+}
+#endif
+
+// Spiky gradient (as a factor of r) and viscosity laplacian for a neighbor at offset r;
+// false outside the kernel or for coincident particles
+bool pairWeights(vec3 r, out float gradientOverR, out float laplacian)
+{
+#ifdef SPH_KERNEL_TABLE
+  float r2 = dot(r, r);
+  if (r2 >= KERNEL_RADIUS * KERNEL_RADIUS || r2 <= 1.0e-8) return false;
+  vec4 weights = kernelLookup(r2);
+  gradientOverR = weights.y;
+  laplacian = weights.z;
+#else
+  float rLen = length(r);
+  if (rLen >= KERNEL_RADIUS || rLen <= 0.0001) return false;
+  gradientOverR = SPIKY_KERNEL_WEIGHT_CONST * pow(KERNEL_RADIUS - rLen, 2) / rLen;
+  laplacian = VIS_KERNEL_WEIGHT_CONST * (KERNEL_RADIUS - rLen);
+#endif
+  return true;
+}
+
+// Akinci et al. 2013 cohesion spline: attracting beyond h / 2, repelling closer in
+float cohesionWeight(float rLen)
+{
+  float outer = pow(KERNEL_RADIUS - rLen, 3) * pow(rLen, 3);
+  float value = 2.0 * rLen > KERNEL_RADIUS ? outer : 2.0 * outer - pow(KERNEL_RADIUS, 6) / 64.0;
+  return COHESION_KERNEL_CONST * value;
+}
+
+// Surface tension acceleration from one neighbor: cohesion along r plus curvature from the
+// normal difference, with the symmetric correction that pulls harder on particles short of
+// neighbors (the surface)
+vec3 surfaceTension(vec3 r, float density, float otherDensity, vec3 normal, vec3 otherNormal)
+{
+  float rLen = length(r);
+  if (rLen >= KERNEL_RADIUS || rLen <= 0.0001) return vec3(0.0);
+  float correction = 2.0 * REST_DENSITY / (density + otherDensity);
+  vec3 cohesion = MASS * cohesionWeight(rLen) * (r / rLen);
+  return -uSurfaceTension * correction * (cohesion + normal - otherNormal);
+}
+
+#ifdef SPH_MULTIPHASE
+layout(std140, binding = 3) uniform SPHPhases
+{
+  vec4 uPhaseParameters[SPH_MAX_PHASES];  // Rest density, mass, viscosity, interface tension
+};
+#endif
+
+// Adaptive resolution (sph_adaptive.cs): LEVEL_BIT marks a coarse particle with
+// ADAPTIVE_MASS_SCALE times the mass and ADAPTIVE_RADIUS_SCALE times the kernel radius,
+// taken per pair as in step 5
+
+#ifdef SPH_ADAPTIVE_RESOLUTION
+#ifndef SPH_ADAPTIVE_MASS_SCALE
+#define SPH_ADAPTIVE_MASS_SCALE 2.0
+#endif
+#ifndef SPH_ADAPTIVE_RADIUS_SCALE
+#define SPH_ADAPTIVE_RADIUS_SCALE 1.25992105
+#endif
+#endif
+
+float levelMass(float pressure)
+{
+#ifdef SPH_ADAPTIVE_RESOLUTION
+  return (floatBitsToUint(pressure) & LEVEL_BIT) != 0u ? SPH_ADAPTIVE_MASS_SCALE : 1.0;
+#else
+  return 1.0;
+#endif
+}
+
+// Neighbor mass: its phase's and level's, as step 5 took it for the neighbor's density
+float pairMass(float otherPressure)
+{
+#ifdef SPH_MULTIPHASE
+  return uPhaseParameters[particlePhase(otherPressure)].y * levelMass(otherPressure);
+#else
+  return MASS * levelMass(otherPressure);
+#endif
+}
+
+// pairWeights for a pair of levels: with W_sh(r) = W_h(r / s) / s^3 both the gradient over
+// r and the laplacian scale by s^-5
+bool levelPairWeights(vec3 r, float pressure, float otherPressure, out float gradientOverR, out float laplacian)
+{
+#ifdef SPH_ADAPTIVE_RESOLUTION
+  uint levels = ((floatBitsToUint(pressure) & LEVEL_BIT) + (floatBitsToUint(otherPressure) & LEVEL_BIT)) / LEVEL_BIT;
+  float scale = 1.0 + (SPH_ADAPTIVE_RADIUS_SCALE - 1.0) * 0.5 * float(levels);
+  if (!pairWeights(r / scale, gradientOverR, laplacian)) return false;
+  float inverse5 = 1.0 / pow(scale, 5.0);
+  gradientOverR *= inverse5;
+  laplacian *= inverse5;
+  return true;
+#else
+  return pairWeights(r, gradientOverR, laplacian);
+#endif
+}
+
+float particleViscosity(vec3 position, float pressure)
+{
+#ifdef SPH_MULTIPHASE
+  if (uImplicitViscosity == 0) return uPhaseParameters[particlePhase(pressure)].z;
+#endif
+  return sceneViscosity(position);
+}
+
+// The viscosity laplacian integrated over the kernel support: what the neighbor sum's
+// weights add up to inside the fluid
+const float FILTERED_VISCOSITY_RATE = 15.0 / (KERNEL_RADIUS * KERNEL_RADIUS);
+
+// Neighbor viscosity sum from the filtered field: the pull toward the mean velocity around
+// the particle, weaker by the occupancy near the surface the way the missing neighbors
+// weaken the sum. Field voxel k is centered on grid cell corner 2k + 1
+vec3 filteredViscosity(vec3 position, vec3 velocity)
+{
+  vec3 coord = (position - uGridOrigin) * uInvCellSize / vec3(2 * textureSize(velocityField, 0));
+  vec4 field = texture(velocityField, coord);
+  return (field.rgb - velocity * field.a) * FILTERED_VISCOSITY_RATE;
+}
+
+// Interface tension: neighbors of another phase push apart with the positive (outer) part
+// of the cohesion spline and the mean of the two phases' coefficients, which shrinks the
+// interface the way cohesion shrinks a free surface
+vec3 interfaceTension(vec3 r, float pressure, float otherPressure)
+{
+#ifdef SPH_MULTIPHASE
+  uint phase = particlePhase(pressure);
+  uint otherPhase = particlePhase(otherPressure);
+  float rLen = length(r);
+  if (phase == otherPhase || rLen >= KERNEL_RADIUS || rLen <= 0.0001) return vec3(0.0);
+  
+  float tension = 0.5 * (uPhaseParameters[phase].w + uPhaseParameters[otherPhase].w);
+  float weight = COHESION_KERNEL_CONST * pow(KERNEL_RADIUS - rLen, 3) * pow(rLen, 3);
+  return tension * uPhaseParameters[otherPhase].y * weight * (r / rLen);
+#else
+  return vec3(0.0);
+#endif
+}
+
+vec3 surfaceNormal(uint id)
+{
+  vec3 normal = diffusePotentials[id].normalTrappedAir.xyz;
+  return dot(normal, normal) > 1.0e-8 ? normalize(normal) : vec3(0.0);
+}
+
+// Wave crest (Ihmsen et al. 2012): normal variation over the neighbors behind the particle,
+// so only convex parts of the surface count
+void accumulateWaveCrest(vec3 r, vec3 normal, vec3 otherNormal, inout float waveCrest)
+{
+  float rLen = length(r);
+  if (rLen >= KERNEL_RADIUS || rLen <= 0.0001 || dot(r, normal) <= 0.0) return;
+  waveCrest += (1.0 - dot(normal, otherNormal)) * (1.0 - rLen / KERNEL_RADIUS);
+}
+
+// Only particles moving out along their normal form a crest
+void storeWaveCrest(uint particleId, vec3 velocity, vec3 normal, float waveCrest)
+{
+  float speed = length(velocity);
+  bool rising = speed > 0.0001 && dot(velocity / speed, normal) >= 0.6;
+  diffusePotentials[particleId].waveCrest = vec4(rising ? waveCrest : 0.0, 0.0, 0.0, 0.0);
+}
+
+#ifdef SPH_TILED_NEIGHBORS
+void main()
+{
+  // Everything up to the per-particle work is uniform across the workgroup, as the
+  // barriers require
+  if (gl_WorkGroupID.x >= activeCellCount) return;
+  
+  uint localId = gl_LocalInvocationID.x;
+  uint cellId = activeCells[gl_WorkGroupID.x];
+  if (uParticleSleeping != 0)
+  {
+    if (localId == 0) cellMotion = 0u;
+    barrier();
+  }
+  
+  ivec3 voxelId = ivec3(cellId % uint(uGridRes.x),
+                        (cellId / uint(uGridRes.x)) % uint(uGridRes.y),
+                        cellId / uint(uGridRes.x * uGridRes.y));
+  uint firstParticle = cellStart[cellId];
+  uint cellParticleCount = cellCount[cellId];
+  
+  int xMin = max(voxelId.x - 1, 0);
+  int xMax = min(voxelId.x + 1, uGridRes.x - 1);
+  
+  for (uint base = 0; base < cellParticleCount; base += TILE_SIZE)
+  {
+    bool active = base + localId < cellParticleCount;
+    uint particleId = firstParticle + base + localId;
+    Particle particle;
+    if (active)
+    {
+      particle = particles[particleId];
+    }
+    
+    vec3 forcePressure = vec3(0.0);
+    vec3 forceViscosity = vec3(0.0);
+    vec3 normal = active && uDiffusePotentials != 0 ? surfaceNormal(particleId) : vec3(0.0);
+    float waveCrest = 0.0;
+    vec3 tensionNormal = active && uSurfaceTension > 0.0 ? surfaceNormals[particleId].xyz : vec3(0.0);
+    vec3 accelerationTension = vec3(0.0);
+#ifdef SPH_COUNTERS
+    uint neighbors = 0u;
+#endif
+    
+    for (int dz = -1; dz <= 1; dz++)
+    {
+      for (int dy = -1; dy <= 1; dy++)
+      {
+        ivec2 row = voxelId.yz + ivec2(dy, dz);
+        if (any(lessThan(row, ivec2(0))) || any(greaterThanEqual(row, uGridRes.yz))) continue;
+        
+        uint rowCell = uint(uGridRes.x * (row.x + uGridRes.y * row.y));
+        int rangeCount = uRowContiguous != 0 ? 1 : xMax - xMin + 1;
+        
+        for (int range = 0; range < rangeCount; range++)
+        {
+          uint rangeStart;
+          uint rangeEnd;
+          if (uRowContiguous != 0)
+          {
+            rangeStart = cellStart[rowCell + xMin];
+            rangeEnd = cellStart[rowCell + xMax] + cellCount[rowCell + xMax];
+          }
+          else
+          {
+            uint neighborCell = rowCell + uint(xMin + range);
+            rangeStart = cellStart[neighborCell];
+            rangeEnd = rangeStart + cellCount[neighborCell];
+          }
+          
+          for (uint tileStart = rangeStart; tileStart < rangeEnd; tileStart += TILE_SIZE)
+          {
+            uint tileCount = min(uint(TILE_SIZE), rangeEnd - tileStart);
+            if (localId < tileCount)
+            {
+              uint otherParticleId = tileStart + localId;
+              vec2 otherDensityPressure = neighborDensityPressure(otherParticleId);
+              tilePositionDensity[localId] = vec4(neighborPosition(otherParticleId), otherDensityPressure.x);
+              tileVelocityPressure[localId] = vec4(neighborVelocity(otherParticleId), otherDensityPressure.y);
+            }
+            barrier();
+            
+            if (active)
+            {
+              for (uint j = 0; j < tileCount; j++)
+              {
+                if (tileStart + j == particleId) continue;
+                
+                vec4 otherPositionDensity = tilePositionDensity[j];
+                vec4 otherVelocityPressure = tileVelocityPressure[j];
+                vec3 r = particle.position - otherPositionDensity.xyz;
+                float gradientOverR, weightVis;
+                if (!levelPairWeights(r, particle.pressure, otherVelocityPressure.w, gradientOverR, weightVis)) continue;
+#ifdef SPH_COUNTERS
+                neighbors++;
+#endif
+                
+                
+                vec3 weightPressure = gradientOverR * r;
+                float pressure = particle.pressure + otherVelocityPressure.w;
+                float otherMass = pairMass(otherVelocityPressure.w);
+                forcePressure -= (otherMass * pressure * weightPressure) / (2.0 * otherPositionDensity.w);
+                
+                if (uFilteredViscosity == 0)
+                {
+                  vec3 velocityDiff = otherVelocityPressure.xyz - particle.velocity;
+                  forceViscosity += (otherMass * velocityDiff * weightVis) / otherPositionDensity.w;
+                }
+#ifdef SPH_MULTIPHASE
+                accelerationTension += interfaceTension(r, particle.pressure, otherVelocityPressure.w);
+#endif
+                
+                if (uDiffusePotentials != 0)
+                {
+                  accumulateWaveCrest(r, normal, surfaceNormal(tileStart + j), waveCrest);
+                }
+                if (uSurfaceTension > 0.0)
+                {
+                  accelerationTension += surfaceTension(r, particle.density, otherPositionDensity.w,
+                                                        tensionNormal, surfaceNormals[tileStart + j].xyz);
+                }
+              }
+            }
+            barrier();
+          }
+        }
+      }
+    }
+    
+    if (active)
+    {
+      if (uFilteredViscosity != 0)
+      {
+        forceViscosity = filteredViscosity(particle.position, particle.velocity);
+      }
+      vec3 forceGravity = uGravity * particle.density;
+      vec3 totalForce = (forceViscosity * particleViscosity(particle.position, particle.pressure)) + forcePressure + forceGravity +
+                        accelerationTension * particle.density;
+      vec3 velocity = particle.velocity + (totalForce / particle.density) * uDT;
+      
+      if (length(velocity) > uMaxVelocity) {
+        velocity = normalize(velocity) * uMaxVelocity;
+      }
+      particles[particleId].velocity = velocity;
+      if (uParticleSleeping != 0)
+      {
+        atomicMax(cellMotion, floatBitsToUint(length(velocity) / uSleepVelocity));
+      }
+      
+      if (uDiffusePotentials != 0)
+      {
+        storeWaveCrest(particleId, particle.velocity, normal, waveCrest);
+      }
+#ifdef SPH_COUNTERS
+      countNeighbors(neighbors);
+#endif
+    }
+  }
+  
+  if (uParticleSleeping != 0)
+  {
+    barrier();
+    if (localId == 0) atomicMax(cellActivity[cellId].y, cellMotion);
+  }
+}
+#else
 void main()
 {
   uint particleId = gl_GlobalInvocationID.x;
+  if (uMultirate != 0)
+  {
+    if (particleId >= dueParticleCount) return;
+    particleId = dueParticles[particleId];
+  }
   
   // Bounds check
-  if (particleId >= particles.length()) return;
+  if (particleId >= liveParticleCount) return;
   
   Particle particle = particles[particleId];
   
   ivec3 voxelId = ivec3(uInvCellSize * (particle.position - uGridOrigin));
+  uint neighborLevel = uTimeLevels;
   
   vec3 forcePressure = vec3(0.0);
   vec3 forceViscosity = vec3(0.0);
+  vec3 normal = uDiffusePotentials != 0 ? surfaceNormal(particleId) : vec3(0.0);
+  float waveCrest = 0.0;
+  vec3 tensionNormal = uSurfaceTension > 0.0 ? surfaceNormals[particleId].xyz : vec3(0.0);
+  vec3 accelerationTension = vec3(0.0);
+#ifdef SPH_COUNTERS
+  uint neighbors = 0u;
+#endif
+  
+  if (uUseNeighborList != 0)
+  {
+    uint neighborCount = neighborCounts[particleId];
+    for (uint i = 0; i < neighborCount; i++)
+    {
+      uint otherParticleId = neighborList[i * uListStride + particleId];
+      if (otherParticleId == particleId) continue;
+      
+      Particle otherParticle = particles[otherParticleId];
+      vec3 r = particle.position - otherParticle.position;
+      float gradientOverR, weightVis;
+      if (!levelPairWeights(r, particle.pressure, otherParticle.pressure, gradientOverR, weightVis)) continue;
+#ifdef SPH_COUNTERS
+      neighbors++;
+#endif
+      
+      neighborLevel = min(neighborLevel, timeLevel(otherParticle.pressure));
+      vec3 weightPressure = gradientOverR * r;
+      float pressure = particle.pressure + otherParticle.pressure;
+      float otherMass = pairMass(otherParticle.pressure);
+      forcePressure -= (otherMass * pressure * weightPressure) / (2.0 * otherParticle.density);
+      
+      forceViscosity += (otherMass * (otherParticle.velocity - particle.velocity) * weightVis) / otherParticle.density;
+#ifdef SPH_MULTIPHASE
+      accelerationTension += interfaceTension(r, particle.pressure, otherParticle.pressure);
+#endif
+      
+      if (uDiffusePotentials != 0)
+      {
+        accumulateWaveCrest(r, normal, surfaceNormal(otherParticleId), waveCrest);
+      }
+      if (uSurfaceTension > 0.0)
+      {
+        accelerationTension += surfaceTension(r, particle.density, otherParticle.density,
+                                              tensionNormal, surfaceNormals[otherParticleId].xyz);
+      }
+    }
+  }
   
-  uint voxelCount = 0;
+  // Starting past the last neighborhood entry skips the grid walk in list mode
+  uint voxelCount = uUseNeighborList != 0 ? 27 : 0;
   uint voxelParticleCount = 0;
   uint voxelParticleOffset = 0;
   
@@ -75,9 +730,14 @@ void main()
         continue;
       }
 
-      uint voxelValue = imageLoad(grid, newVoxelId).r;
-      voxelParticleOffset = (voxelValue >> 8);
-      voxelParticleCount = (voxelValue & 0xFF);
+      // Empty coarse blocks are skipped before any fine cell is read
+      uint cellId = gridCell(newVoxelId);
+      if (cellId == EMPTY_CELL)
+      {
+        continue;
+      }
+      voxelParticleOffset = cellStart[cellId];
+      voxelParticleCount = cellCount[cellId];
 
       if (voxelParticleCount == 0)
       {
@@ -87,42 +747,87 @@ void main()
 
     voxelParticleCount--;
 
-    uint otherParticleId = voxelParticleOffset + voxelParticleCount;
+    uint otherParticleId = cellParticle(voxelParticleOffset + voxelParticleCount);
     
     if (otherParticleId == particleId) continue;
     
-    Particle otherParticle = particles[otherParticleId];
-    vec3 r = particle.position - otherParticle.position;
-    float rLen = length(r);
+    vec3 otherPosition = neighborPosition(otherParticleId);
+    vec2 otherDensityPressure = neighborDensityPressure(otherParticleId);
+    vec3 r = particle.position - otherPosition;
+    float gradientOverR, weightVis;
+    if (!levelPairWeights(r, particle.pressure, otherDensityPressure.y, gradientOverR, weightVis)) continue;
+#ifdef SPH_COUNTERS
+    neighbors++;
+#endif
     
-    if (rLen >= KERNEL_RADIUS || rLen <= 0.0001) continue;
+    
+    neighborLevel = min(neighborLevel, timeLevel(otherDensityPressure.y));
     
     // Pressure force (using spiky kernel gradient)
-    vec3 weightPressure = SPIKY_KERNEL_WEIGHT_CONST * pow(KERNEL_RADIUS - rLen, 2) * (r / rLen);
-    float pressure = particle.pressure + otherParticle.pressure;
-    forcePressure -= (MASS * pressure * weightPressure) / (2.0 * otherParticle.density);
+    vec3 weightPressure = gradientOverR * r;
+    float pressure = particle.pressure + otherDensityPressure.y;
+    float otherMass = pairMass(otherDensityPressure.y);
+    forcePressure -= (otherMass * pressure * weightPressure) / (2.0 * otherDensityPressure.x);
     
     // Viscosity force (using viscosity kernel laplacian)
-    float weightVis = VIS_KERNEL_WEIGHT_CONST * (KERNEL_RADIUS - rLen);
-    vec3 velocityDiff = otherParticle.velocity - particle.velocity;
-    forceViscosity += (MASS * velocityDiff * weightVis) / otherParticle.density;
+    if (uFilteredViscosity == 0)
+    {
+      vec3 velocityDiff = neighborVelocity(otherParticleId) - particle.velocity;
+      forceViscosity += (otherMass * velocityDiff * weightVis) / otherDensityPressure.x;
+    }
+#ifdef SPH_MULTIPHASE
+    accelerationTension += interfaceTension(r, particle.pressure, otherDensityPressure.y);
+#endif
+    
+    if (uDiffusePotentials != 0)
+    {
+      accumulateWaveCrest(r, normal, surfaceNormal(otherParticleId), waveCrest);
+    }
+    if (uSurfaceTension > 0.0)
+    {
+      accelerationTension += surfaceTension(r, particle.density, otherDensityPressure.x,
+                                            tensionNormal, surfaceNormals[otherParticleId].xyz);
+    }
+  }
+  
+  if (uFilteredViscosity != 0)
+  {
+    forceViscosity = filteredViscosity(particle.position, particle.velocity);
   }
   
   // Apply gravity force
   vec3 forceGravity = uGravity * particle.density;
   
-  // Total force
-  vec3 totalForce = (forceViscosity * VIS_COEFF) + forcePressure + forceGravity;
+  // Total force; surface tension is summed as an acceleration
+  vec3 totalForce = (forceViscosity * particleViscosity(particle.position, particle.pressure)) + forcePressure + forceGravity +
+                    accelerationTension * particle.density;
   
   // Calculate acceleration (F = ma, so a = F/m)
   vec3 acceleration = totalForce / particle.density;
   
-  // Update velocity using forward Euler integration
-  particles[particleId].velocity += acceleration * uDT;
+  // Update velocity using forward Euler integration, over the particle's own step when
+  // multirate; step 1 moved it over the same step this substep
+  float dt = uDT;
+  if (uMultirate != 0)
+  {
+    uint level = timeLevel(particle.pressure);
+    dt = uDT * float(1u << level);
+    uint next = nextTimeLevel(level, neighborLevel, particle.velocity, acceleration);
+    particles[particleId].pressure = withTimeLevel(particle.pressure, next);
+  }
+  particles[particleId].velocity += acceleration * dt;
   
   // Clamp velocity to prevent instability
-  float maxVel = 50.0;
-  if (length(particles[particleId].velocity) > maxVel) {
-    particles[particleId].velocity = normalize(particles[particleId].velocity) * maxVel;
+  if (length(particles[particleId].velocity) > uMaxVelocity) {
+    particles[particleId].velocity = normalize(particles[particleId].velocity) * uMaxVelocity;
+  }
+  
+  if (uDiffusePotentials != 0)
+  {
+    storeWaveCrest(particleId, particle.velocity, normal, waveCrest);
   }
-}
\ No newline at end of file
+#ifdef SPH_COUNTERS
+  countNeighbors(neighbors);
+#endif
+}
+#endif
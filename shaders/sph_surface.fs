@@ -0,0 +1,29 @@
+#version 460 core
+// SPH surface mesh shading: the screen-space path's water colors with diffuse, specular
+// and a Schlick fresnel term from the mesh normal
+
+in vec3 vWorldPos;
+in vec3 vNormal;
+
+out vec4 fragColor;
+
+uniform vec3 uViewPos;
+uniform vec3 uLightPos;
+
+void main() {
+    vec3 deepWater = vec3(0.0, 0.1, 0.4);    // Deep blue
+    vec3 shallowWater = vec3(0.1, 0.4, 0.8); // Light blue
+    
+    vec3 normal = normalize(vNormal);
+    vec3 viewDir = normalize(uViewPos - vWorldPos);
+    vec3 lightDir = normalize(uLightPos - vWorldPos);
+    
+    float diffuse = max(dot(normal, lightDir), 0.0);
+    float specular = pow(max(dot(normal, normalize(lightDir + viewDir)), 0.0), 64.0);
+    float fresnel = 0.02 + 0.98 * pow(1.0 - max(dot(normal, viewDir), 0.0), 5.0);
+    
+    vec3 waterColor = mix(deepWater, shallowWater, 0.3 + 0.7 * diffuse);
+    waterColor += vec3(0.1, 0.3, 0.5) * fresnel + vec3(specular);
+    
+    fragColor = vec4(waterColor, mix(0.8, 1.0, fresnel));
+}
@@ -0,0 +1,28 @@
+#version 460 core
+// SPH surface mesh vertex shader: pulls the marching cubes vertices of
+// sph_marching_cubes.cs, drawn indirectly with the command at the head of the buffer
+
+struct SurfaceVertex
+{
+  vec4 position;
+  vec4 normal;
+};
+
+layout(binding = 30, std430) restrict readonly buffer surfaceMeshBuf
+{
+  uint meshDraw[4];
+  SurfaceVertex vertices[];
+};
+
+uniform mat4 uVP;
+
+out vec3 vWorldPos;
+out vec3 vNormal;
+
+void main()
+{
+  SurfaceVertex vertex = vertices[gl_VertexID];
+  vWorldPos = vertex.position.xyz;
+  vNormal = vertex.normal.xyz;
+  gl_Position = uVP * vertex.position;
+}
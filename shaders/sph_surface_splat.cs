@@ -0,0 +1,69 @@
+#version 460 core
+// SPH surface extraction, step 1: splats every live particle's poly6 kernel into a 3D
+// field of volume fractions, normalized by the kernel sum of a filled lattice at the
+// particle spacing so the field is about 1 inside the fluid and 0 outside.
+// The field texture is r32ui in fixed point so the splat can accumulate with image atomics
+// instead of gathering neighbors from the simulation grid, which keeps the pass valid for
+// render snapshots and neighbor-list mode alike
+
+layout(local_size_x = 256) in;
+
+struct Particle
+{
+  vec3 position;
+  float density;
+  vec3 velocity;
+  float pressure;
+};
+
+layout(binding = 0, std430) restrict readonly buffer particleBuf
+{
+  Particle particles[];
+};
+
+layout(binding = 24, std430) restrict readonly buffer particleCountBuf
+{
+  uint particleDispatch[3];
+  uint liveParticleCount;
+};
+
+layout(binding = 0, r32ui) uniform restrict uimage3D uField;
+
+uniform uint uParticleCount;
+uniform vec3 uVolumeOrigin;   // World position of node (0, 0, 0)
+uniform float uVoxelSize;
+uniform ivec3 uVolumeRes;     // Nodes per axis
+uniform float uKernelRadius;
+uniform float uWeight;        // 1 / sum of (h^2 - r^2)^3 over a filled lattice
+uniform float uFieldScale;    // Fixed point scale of the field texture
+
+void main()
+{
+  uint id = gl_GlobalInvocationID.x;
+  if (id >= uParticleCount || id >= liveParticleCount) return;
+
+  vec3 position = particles[id].position;
+  float h2 = uKernelRadius * uKernelRadius;
+  ivec3 first = max(ivec3(ceil((position - uKernelRadius - uVolumeOrigin) / uVoxelSize)), ivec3(0));
+  ivec3 last = min(ivec3(floor((position + uKernelRadius - uVolumeOrigin) / uVoxelSize)), uVolumeRes - 1);
+
+  for (int z = first.z; z <= last.z; z++)
+  {
+    for (int y = first.y; y <= last.y; y++)
+    {
+      for (int x = first.x; x <= last.x; x++)
+      {
+        vec3 offset = uVolumeOrigin + vec3(x, y, z) * uVoxelSize - position;
+        float r2 = dot(offset, offset);
+        if (r2 >= h2) continue;
+
+        float diff = h2 - r2;
+        uint contribution = uint(uWeight * diff * diff * diff * uFieldScale + 0.5);
+        if (contribution != 0u)
+        {
+          imageAtomicAdd(uField, ivec3(x, y, z), contribution);
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,48 @@
+// Particle tags in the low mantissa bits of the pressure, ahead of every pass that reads or
+// carries them (SPHComputeSystem::tagSource(), which sizes them from SPHConstants). Every
+// pass that writes pressure carries them over; readers that only want the pressure use it
+// as is.
+
+// Multiphase (SPHComputeSystem::setPhases): the phase index in the lowest bits, a relative
+// error below 1e-6
+const uint PHASE_MASK = (1u << SPH_PHASE_BITS) - 1u;  // SPHConstants::MAX_PHASES - 1
+
+uint particlePhase(float pressure)
+{
+  return floatBitsToUint(pressure) & PHASE_MASK;
+}
+
+float withPhase(float pressure, uint phase)
+{
+  return uintBitsToFloat((floatBitsToUint(pressure) & ~PHASE_MASK) | phase);
+}
+
+// Adaptive resolution (sph_adaptive.cs): the next bit marks a coarse particle
+const uint LEVEL_BIT = 1u << SPH_PHASE_BITS;
+
+// Multirate time stepping (sph_time_levels.cs): the time level in the bits above it
+// (SPHConstants::MULTIRATE_LEVELS); five tag bits in all, a relative error below 4e-6
+const uint TIME_LEVEL_SHIFT = SPH_PHASE_BITS + 1u;
+const uint TIME_LEVEL_MASK = ((1u << SPH_TIME_LEVEL_BITS) - 1u) << TIME_LEVEL_SHIFT;
+
+const uint TAG_MASK = PHASE_MASK | LEVEL_BIT | TIME_LEVEL_MASK;
+
+uint particleTags(float pressure)
+{
+  return floatBitsToUint(pressure) & TAG_MASK;
+}
+
+float withTags(float pressure, uint tags)
+{
+  return uintBitsToFloat((floatBitsToUint(pressure) & ~TAG_MASK) | tags);
+}
+
+uint timeLevel(float pressure)
+{
+  return (floatBitsToUint(pressure) & TIME_LEVEL_MASK) >> TIME_LEVEL_SHIFT;
+}
+
+float withTimeLevel(float pressure, uint level)
+{
+  return uintBitsToFloat((floatBitsToUint(pressure) & ~TIME_LEVEL_MASK) | (level << TIME_LEVEL_SHIFT));
+}
@@ -0,0 +1,22 @@
+#version 460 core
+
+// Thickness pass for screen-space fluid rendering: interior particles accumulate the
+// length of their sphere along the view ray (additive blending, low-resolution target)
+
+in vec3 vCenterPos;
+in vec2 vUV;
+in vec3 vColor;
+
+out vec4 fragColor;
+
+uniform float uPointRadius;
+
+void main() {
+    vec2 offset = vUV * 2.0 - 1.0;
+    float r2 = dot(offset, offset);
+    if (r2 > 1.0) {
+        discard;
+    }
+    
+    fragColor = vec4(2.0 * sqrt(1.0 - r2) * uPointRadius);
+}
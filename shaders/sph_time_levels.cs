@@ -0,0 +1,63 @@
+#version 460 core
+// SPH multirate time stepping: lists the particles due in this substep for step 6
+//
+// A particle's time level L (0 to TIME_LEVELS - 1) rides in the pressure bits above the
+// phase and resolution tags (sph_step5.cs); it advances by uDT * 2^L every 2^L substeps,
+// so level L is due when the substep index is a multiple of 2^L. Step 1 integrates only
+// the due particles, and step 6 runs indirectly over this list, picking each particle's
+// next level from its own speed and acceleration. Every append past a multiple of
+// uGroupSize adds one workgroup to the step 6 dispatch, as step 1 does for active cells.
+
+layout(local_size_x = 64) in;
+
+struct Particle
+{
+  vec3 position;
+  float density;
+  vec3 velocity;
+  float pressure;
+};
+
+layout(binding = 0, std430) restrict readonly buffer particleBuf
+{
+  Particle particles[];
+};
+
+layout(binding = 24, std430) restrict readonly buffer particleCountBuf
+{
+  uint particleDispatch[3];
+  uint liveParticleCount;
+};
+
+layout(binding = 58, std430) restrict writeonly buffer dueParticleBuf
+{
+  uint dueParticles[];
+};
+
+// One DispatchIndirectCommand with the due count in its padding, reset every substep
+layout(binding = 59, std430) restrict buffer dueDispatchBuf
+{
+  uint dueGroupsX;
+  uint dueGroupsY;
+  uint dueGroupsZ;
+  uint dueParticleCount;
+};
+
+uniform uint uTimeSubstep;
+uniform uint uGroupSize;  // Step 6 local size
+
+void main()
+{
+  uint id = gl_GlobalInvocationID.x;
+  if (id >= liveParticleCount) return;
+
+  uint level = timeLevel(particles[id].pressure);
+  if ((uTimeSubstep & ((1u << level) - 1u)) != 0u) return;
+
+  uint slot = atomicAdd(dueParticleCount, 1u);
+  dueParticles[slot] = id;
+  if (slot % uGroupSize == 0u)
+  {
+    atomicAdd(dueGroupsX, 1u);
+  }
+}
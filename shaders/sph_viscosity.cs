@@ -0,0 +1,370 @@
+#version 460 core
+// SPH implicit viscosity: backward Euler viscosity, solved by matrix-free conjugate
+// gradients after step 6 or PCISPH (which then leave their explicit viscosity out)
+//
+// Per velocity component, with the pair coefficient c_ij = dt mu_ij m lap(W_ij) / rho_ij,
+// where mu_ij and rho_ij are the means of the two particles' viscosity and density:
+//   rho_i v*_i + sum_j c_ij (v*_i - v*_j) = rho_i v_i
+// The matrix is symmetric positive definite, so Jacobi-preconditioned CG converges from
+// any guess. The guess is v plus the change the previous substep's solve made, which steps
+// 3 and the Morton gather carry through the reorder (binding 51).
+//
+// Phases selected by uPhase:
+//   0: Jacobi diagonal, per-particle dt * viscosity and the warm-started guess x
+//   1: r = b - Ax, p = z = r / diag, partial r.z
+//   2: (one workgroup) initial r.z; an exact guess converges at once
+//   3: Ap, partial p.Ap
+//   4: (one workgroup) alpha = r.z / p.Ap
+//   5: x += alpha p, r -= alpha Ap, partial r.z
+//   6: (one workgroup) beta, convergence test on the relative residual
+//   7: p = z + beta p
+//   8: velocity = x, keep x - velocity as the next guess
+// Phases 1-7 return immediately once the solve has converged, so the CPU issues the
+// maximum iteration count without reading anything back.
+
+#ifndef SPH_WORKGROUP_SIZE
+#define SPH_WORKGROUP_SIZE 64 // Injected by SPHComputeSystem
+#endif
+
+layout(local_size_x = SPH_WORKGROUP_SIZE) in;
+
+struct Particle
+{
+  vec3 position;
+  float density;
+  vec3 velocity;
+  float pressure;
+};
+
+struct SolverParticle
+{
+  vec4 solution;   // x, w = Jacobi diagonal
+  vec4 residual;   // r, w = dt * viscosity of the particle's scene
+  vec4 direction;  // p
+  vec4 product;    // Ap
+};
+
+layout(binding = 0, std430) restrict buffer particleBuf
+{
+  Particle particles[];
+};
+
+layout(binding = 2, std430) restrict readonly buffer cellCountBuf
+{
+  uint cellCount[];
+};
+
+layout(binding = 3, std430) restrict readonly buffer cellStartBuf
+{
+  uint cellStart[];
+};
+
+// Live particle count, maintained on the GPU by sph_particle_count.cs
+layout(binding = 24, std430) restrict readonly buffer particleCountBuf
+{
+  uint particleDispatch[3];
+  uint liveParticleCount;
+};
+
+// Velocity change of the previous solve, in the current particle order
+layout(binding = 51, std430) restrict buffer warmStartBuf
+{
+  vec4 warmStart[];
+};
+
+layout(binding = 53, std430) restrict buffer solverParticleBuf
+{
+  SolverParticle solver[];
+};
+
+layout(binding = 54, std430) restrict buffer partialSumBuf
+{
+  float partialSums[];  // One per workgroup of the particle phases
+};
+
+layout(binding = 55, std430) restrict buffer solverStateBuf
+{
+  float rz;
+  float initialRz;
+  float alpha;
+  float beta;
+  uint converged;
+  uint iterations;
+  float lastResidual;   // sqrt(rz / initialRz) after the last iteration
+  uint padding;
+};
+
+uniform int uPhase;
+uniform float uTolerance;   // Relative preconditioned residual
+// Substep constants shared by the simulation passes, uploaded once per substep
+// (SPHParameterBlock)
+layout(std140, binding = 0) uniform SPHParameters
+{
+  vec3 uGridOrigin;
+  float uDT;
+  vec3 uGridSize;
+  float uMaxVelocity;
+  vec3 uInvCellSize;
+  float uWallDamping;         // Fraction of the normal velocity kept by a wall bounce
+  ivec3 uGridRes;
+  float uSceneStride;         // Batched scenes: x offset between the scenes
+  vec3 uGravity;
+  int uSceneCount;
+  vec3 uStepGravity;          // Gravity step 1 integrates; zero when PCISPH does
+  int uBatchScenes;           // Scene count, 0 when not batched
+  float uParticleMass;
+  float uHalfSkinSq;
+  uint uListStride;
+  int uUseNeighborList;
+  int uDiffusePotentials;
+  int uParticleSleeping;
+  uint uSleepSubsteps;
+  float uSleepVelocity;
+  float uSleepDensityChange;  // Relative density change per substep
+};
+
+// Grid resolution of the cell addressing in sph_grid.glsl
+ivec3 gridResolution() { return uGridRes; }
+
+// Fluid parameters, injected as #defines by SPHComputeSystem (defaults match SPHConstants)
+#ifndef SPH_MASS
+#define SPH_MASS 0.02
+#endif
+#ifndef SPH_KERNEL_RADIUS
+#define SPH_KERNEL_RADIUS 0.1828
+#endif
+#ifndef SPH_VISCOSITY
+#define SPH_VISCOSITY 0.035
+#endif
+
+const float MASS = SPH_MASS;
+const float KERNEL_RADIUS = SPH_KERNEL_RADIUS;
+const float VIS_COEFF = SPH_VISCOSITY;
+const float VIS_KERNEL_WEIGHT_CONST = 45.0 / (3.14159265 * pow(KERNEL_RADIUS, 6));
+const float MIN_DENSITY = 0.001;
+
+// Batched scenes (SPHComputeSystem::setBatchScenes): a particle's scene is the slab of
+// uSceneStride along x it is in, and that scene's parameters replace the compiled viscosity
+layout(binding = 41, std430) restrict readonly buffer sceneParameterBuf
+{
+  vec4 sceneParameters[];  // Stiffness, viscosity, unused, unused
+};
+
+float sceneViscosity(vec3 position)
+{
+  if (uBatchScenes == 0) return VIS_COEFF;
+  int scene = clamp(int(floor((position.x - uGridOrigin.x) / uSceneStride)), 0, uBatchScenes - 1);
+  return sceneParameters[scene].y;
+}
+
+// Particle range of neighbor cell n (0-26) around voxel, empty outside the grid
+void neighborRange(ivec3 voxel, int n, out uint start, out uint end)
+{
+  ivec3 neighbor = voxel + ivec3(n % 3, (n / 3) % 3, n / 9) - 1;
+  start = 0;
+  end = 0;
+  if (any(lessThan(neighbor, ivec3(0))) || any(greaterThanEqual(neighbor, uGridRes))) return;
+
+  uint cellId = gridCell(neighbor);
+  if (cellId == EMPTY_CELL) return;
+  start = cellStart[cellId];
+  end = start + cellCount[cellId];
+}
+
+// m lap(W_ij) / rho_ij, zero outside the kernel
+float pairWeight(Particle particle, uint j)
+{
+  vec3 r = particle.position - particles[j].position;
+  float rLen = length(r);
+  if (rLen >= KERNEL_RADIUS) return 0.0;
+  float density = 0.5 * (max(particle.density, MIN_DENSITY) + max(particles[j].density, MIN_DENSITY));
+  return MASS * VIS_KERNEL_WEIGHT_CONST * (KERNEL_RADIUS - rLen) / density;
+}
+
+// Matrix-free product for particle i: diag_i y_i - sum_j c_ij y_j. Component 0 reads the
+// guess x, 1 the search direction p
+vec3 applyMatrix(uint particleId, Particle particle, int component)
+{
+  ivec3 voxelId = ivec3(uInvCellSize * (particle.position - uGridOrigin));
+  float selfViscosity = solver[particleId].residual.w;
+  vec3 self = component == 0 ? solver[particleId].solution.xyz : solver[particleId].direction.xyz;
+  vec3 result = solver[particleId].solution.w * self;
+  for (int n = 0; n < 27; n++)
+  {
+    uint start, end;
+    neighborRange(voxelId, n, start, end);
+    for (uint slot = start; slot < end; slot++)
+    {
+      uint j = cellParticle(slot);
+      if (j == particleId) continue;
+      float weight = pairWeight(particle, j);
+      if (weight == 0.0) continue;
+
+      float coefficient = 0.5 * (selfViscosity + solver[j].residual.w) * weight;
+      vec3 other = component == 0 ? solver[j].solution.xyz : solver[j].direction.xyz;
+      result -= coefficient * other;
+    }
+  }
+  return result;
+}
+
+shared float reduction[SPH_WORKGROUP_SIZE];
+
+// Workgroup sum into reduction[0]; every invocation must call it
+float workgroupSum(float value)
+{
+  uint localId = gl_LocalInvocationID.x;
+  reduction[localId] = value;
+  barrier();
+  for (uint stride = SPH_WORKGROUP_SIZE / 2; stride > 0; stride >>= 1)
+  {
+    if (localId < stride)
+    {
+      reduction[localId] += reduction[localId + stride];
+    }
+    barrier();
+  }
+  return reduction[0];
+}
+
+// Particle phases: one partial per workgroup, in a fixed order so runs are reproducible
+void storePartial(float value)
+{
+  float sum = workgroupSum(value);
+  if (gl_LocalInvocationID.x == 0)
+  {
+    partialSums[gl_WorkGroupID.x] = sum;
+  }
+}
+
+// Reduction phases: a single workgroup sums the particle phases' partials
+float sumPartials()
+{
+  uint groups = (liveParticleCount + SPH_WORKGROUP_SIZE - 1) / SPH_WORKGROUP_SIZE;
+  float sum = 0.0;
+  for (uint i = gl_LocalInvocationID.x; i < groups; i += SPH_WORKGROUP_SIZE)
+  {
+    sum += partialSums[i];
+  }
+  return workgroupSum(sum);
+}
+
+void main()
+{
+  // converged is uniform across the dispatch, so whole workgroups return before the barriers
+  if (converged != 0 && uPhase >= 1 && uPhase <= 7) return;
+
+  if (uPhase == 2 || uPhase == 4 || uPhase == 6)
+  {
+    float sum = sumPartials();
+    if (gl_LocalInvocationID.x != 0) return;
+
+    if (uPhase == 2)
+    {
+      rz = sum;
+      initialRz = sum;
+      lastResidual = 0.0;
+      if (sum <= 0.0) converged = 1;
+    }
+    else if (uPhase == 4)
+    {
+      alpha = sum > 0.0 ? rz / sum : 0.0;
+      if (sum <= 0.0) converged = 1;
+    }
+    else
+    {
+      iterations++;
+      beta = rz > 0.0 ? sum / rz : 0.0;
+      rz = sum;
+      lastResidual = sqrt(sum / initialRz);
+      if (sum <= uTolerance * uTolerance * initialRz) converged = 1;
+    }
+    return;
+  }
+
+  uint particleId = gl_GlobalInvocationID.x;
+  bool active = particleId < liveParticleCount;
+
+  if (uPhase == 0)
+  {
+    if (!active) return;
+    Particle particle = particles[particleId];
+    ivec3 voxelId = ivec3(uInvCellSize * (particle.position - uGridOrigin));
+    float selfViscosity = uDT * sceneViscosity(particle.position);
+
+    float diagonal = max(particle.density, MIN_DENSITY);
+    for (int n = 0; n < 27; n++)
+    {
+      uint start, end;
+      neighborRange(voxelId, n, start, end);
+      for (uint slot = start; slot < end; slot++)
+      {
+        uint j = cellParticle(slot);
+        if (j == particleId) continue;
+        float weight = pairWeight(particle, j);
+        if (weight == 0.0) continue;
+
+        diagonal += 0.5 * (selfViscosity + uDT * sceneViscosity(particles[j].position)) * weight;
+      }
+    }
+
+    solver[particleId].solution = vec4(particle.velocity + warmStart[particleId].xyz, diagonal);
+    solver[particleId].residual = vec4(0.0, 0.0, 0.0, selfViscosity);
+  }
+  else if (uPhase == 1)
+  {
+    float partial = 0.0;
+    if (active)
+    {
+      Particle particle = particles[particleId];
+      vec3 b = max(particle.density, MIN_DENSITY) * particle.velocity;
+      vec3 r = b - applyMatrix(particleId, particle, 0);
+      vec3 z = r / solver[particleId].solution.w;
+      solver[particleId].residual.xyz = r;
+      solver[particleId].direction = vec4(z, 0.0);
+      partial = dot(r, z);
+    }
+    storePartial(partial);
+  }
+  else if (uPhase == 3)
+  {
+    float partial = 0.0;
+    if (active)
+    {
+      vec3 product = applyMatrix(particleId, particles[particleId], 1);
+      solver[particleId].product = vec4(product, 0.0);
+      partial = dot(solver[particleId].direction.xyz, product);
+    }
+    storePartial(partial);
+  }
+  else if (uPhase == 5)
+  {
+    float partial = 0.0;
+    if (active)
+    {
+      solver[particleId].solution.xyz += alpha * solver[particleId].direction.xyz;
+      vec3 r = solver[particleId].residual.xyz - alpha * solver[particleId].product.xyz;
+      solver[particleId].residual.xyz = r;
+      partial = dot(r, r / solver[particleId].solution.w);
+    }
+    storePartial(partial);
+  }
+  else if (uPhase == 7)
+  {
+    if (!active) return;
+    vec3 z = solver[particleId].residual.xyz / solver[particleId].solution.w;
+    solver[particleId].direction.xyz = z + beta * solver[particleId].direction.xyz;
+  }
+  else
+  {
+    if (!active) return;
+    vec3 previous = particles[particleId].velocity;
+    vec3 velocity = solver[particleId].solution.xyz;
+    if (length(velocity) > uMaxVelocity)
+    {
+      velocity = normalize(velocity) * uMaxVelocity;
+    }
+    particles[particleId].velocity = velocity;
+    warmStart[particleId] = vec4(velocity - previous, 0.0);
+  }
+}
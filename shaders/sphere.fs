@@ -1,4 +1,7 @@
 #version 460 core
+#ifdef BINDLESS_TEXTURES
+#extension GL_ARB_bindless_texture : require
+#endif
 
 in vec3 FragPos;
 in vec3 Normal;
@@ -7,38 +10,90 @@ in vec2 TexCoord;
 out vec4 FragColor;
 
 uniform vec3 sphereColor;
-uniform vec3 viewPos;
 uniform bool useTexture;
+// Static material textures: resident handles in one block (BindlessTextures.h) or units
+#ifdef BINDLESS_TEXTURES
+layout(std140, binding = 4) uniform MaterialTextures
+{
+    samplerCube skybox;
+    sampler2D causticTex;
+    sampler2D tileTexture;
+    sampler2D waveHeightMap;
+    sampler2D sphereTexture;
+};
+#else
 uniform sampler2D sphereTexture;
 uniform samplerCube skybox;
+#endif
 uniform bool enableReflections;
 uniform float reflectivity;
+uniform float roughness = 0.0;
+
+// Prefiltered environment of Skybox::setEnvironmentUniforms: mip m holds GGX roughness
+// m / prefilteredMaxLod, and irradianceSH the sky's diffuse light
+uniform bool environmentLighting = false;
+uniform samplerCube prefilteredEnv;
+uniform float prefilteredMaxLod;
+uniform vec3 irradianceSH[9];
+
+// Camera and light of the pass being drawn (updateFrameUniforms in main.cpp)
+layout(std140, binding = 2) uniform FrameUniforms
+{
+    mat4 view;
+    mat4 projection;
+    vec3 viewPos;
+    float time;
+    vec3 lightPos;
+    vec3 lightColor;
+};
 
 // Lighting properties
-uniform vec3 lightPos;
-uniform vec3 lightColor;
 uniform float ambientStrength;
 uniform float specularStrength;
 uniform float shininess;
 
+// Cascaded shadows, linked in from caustic_shadow.fs
+float cascadeShadow(vec3 worldPos, vec3 normal);
+
+// Dynamic lights, linked in from clustered_lights.fs
+void clusteredLighting(vec3 worldPos, vec3 normal, vec3 viewDir, float shininess,
+                       out vec3 diffuse, out vec3 specular);
+
+// Irradiance over pi, from the SH9 coefficients
+vec3 shIrradiance(vec3 n) {
+    vec3 e = irradianceSH[0] * 0.282095
+           + irradianceSH[1] * (0.488603 * n.y) + irradianceSH[2] * (0.488603 * n.z) + irradianceSH[3] * (0.488603 * n.x)
+           + irradianceSH[4] * (1.092548 * n.x * n.y) + irradianceSH[5] * (1.092548 * n.y * n.z)
+           + irradianceSH[6] * (0.315392 * (3.0 * n.z * n.z - 1.0)) + irradianceSH[7] * (1.092548 * n.x * n.z)
+           + irradianceSH[8] * (0.546274 * (n.x * n.x - n.y * n.y));
+    return max(e, vec3(0.0));
+}
+
 void main() {
     // Normalize vectors
     vec3 norm = normalize(Normal);
     vec3 viewDir = normalize(viewPos - FragPos);
     
     // Lighting calculations
-    // Ambient
-    vec3 ambient = ambientStrength * lightColor;
+    // Ambient, from the sky's irradiance when it has been prefiltered
+    vec3 ambient = ambientStrength * (environmentLighting ? shIrradiance(norm) : lightColor);
     
     // Diffuse
+    float directLight = 1.0 - cascadeShadow(FragPos, norm);
     vec3 lightDir = normalize(lightPos - FragPos);
-    float diff = max(dot(norm, lightDir), 0.0);
+    float diff = max(dot(norm, lightDir), 0.0) * directLight;
     vec3 diffuse = diff * lightColor;
     
     // Specular (Blinn-Phong)
     vec3 halfwayDir = normalize(lightDir + viewDir);
     float spec = pow(max(dot(norm, halfwayDir), 0.0), shininess);
-    vec3 specular = specularStrength * spec * lightColor;
+    vec3 specular = specularStrength * spec * lightColor * directLight;
+    
+    // Dynamic lights, unshadowed
+    vec3 clusterDiffuse, clusterSpecular;
+    clusteredLighting(FragPos, norm, viewDir, shininess, clusterDiffuse, clusterSpecular);
+    diffuse += clusterDiffuse;
+    specular += specularStrength * clusterSpecular;
     
     // Get base color from texture or uniform
     vec3 baseColor;
@@ -59,9 +114,9 @@ void main() {
         vec3 I = normalize(FragPos - viewPos);
         vec3 R = reflect(I, norm);
         
-        // Sample from environment map
-        reflectionColor = texture(skybox, R).rgb;
-        
+        // Sample from environment map, blurred to the roughness in its mips
+        reflectionColor = environmentLighting ? textureLod(prefilteredEnv, R, roughness * prefilteredMaxLod).rgb
+                                              : texture(skybox, R).rgb;
     }
     
     vec3 result;
@@ -1,21 +1,46 @@
 #version 460 core
+#ifdef STEREO_MULTIVIEW
+// Both eyes in one draw (StereoRenderer); each view takes its camera from the frame block
+#extension GL_OVR_multiview2 : require
+layout(num_views = 2) in;
+#endif
 
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoord;
+layout (location = 3) in vec4 aInstance;   // Centre offset and radius of the unit sphere (Sphere)
 
 out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoord;
+invariant gl_Position;   // Matches the depth prepass (depth_only.fs)
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+
+// Camera and light of the pass being drawn (updateFrameUniforms in main.cpp)
+layout(std140, binding = 2) uniform FrameUniforms
+{
+    mat4 view;
+    mat4 projection;
+    vec3 viewPos;
+    float time;
+    vec3 lightPos;
+    vec3 lightColor;
+#ifdef STEREO_MULTIVIEW
+    mat4 eyeView[2];
+    mat4 eyeProjection[2];
+#endif
+};
+#ifdef STEREO_MULTIVIEW
+#define view eyeView[gl_ViewID_OVR]
+#define projection eyeProjection[gl_ViewID_OVR]
+#endif
 
 void main() {
-    FragPos = vec3(model * vec4(aPos, 1.0));
+    vec3 localPos = aInstance.xyz + aPos * aInstance.w;
+    FragPos = vec3(model * vec4(localPos, 1.0));
     Normal = mat3(transpose(inverse(model))) * aNormal;
     TexCoord = aTexCoord;
     
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    gl_Position = projection * view * vec4(FragPos, 1.0);
 } 
\ No newline at end of file
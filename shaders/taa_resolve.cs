@@ -0,0 +1,153 @@
+#version 460 core
+// Temporal upscale resolve (TemporalUpscaler): one invocation per window pixel
+//
+// The 3x3 render texels around the pixel are weighed by their jittered sample's distance to
+// it into this frame's colour. The nearest depth among them is reprojected through last
+// frame's camera (the sphere by its own motion, SPH fluid in front by its splatted motion) to
+// fetch the history with a Catmull-Rom filter. The history is clipped to the texels' colour
+// box, mean and deviation in YCoCg, then blended in by the feedback. Both blends weigh HDR
+// samples down by their brightness, so a lone bright texel does not flicker.
+
+layout(local_size_x = 8, local_size_y = 8) in;
+
+layout(binding = 0) uniform sampler2D uSceneColor;      // Render size, HDR
+layout(binding = 1) uniform sampler2D uSceneDepth;
+layout(binding = 2) uniform sampler2D uFluidDepth;      // Smoothed SPH window depth
+layout(binding = 3) uniform sampler2D uFluidMotion;     // Window UV moved since the last frame
+layout(binding = 4) uniform sampler2D uHistory;         // Window size
+layout(rgba16f, binding = 0) uniform restrict writeonly image2D uOutput;
+
+uniform vec2 uRenderSize;
+uniform vec2 uOutputSize;
+uniform vec2 uJitter;                   // Render pixels the image is shifted by
+uniform mat4 uInverseViewProjection;    // Unjittered, this frame
+uniform mat4 uPreviousViewProjection;   // Unjittered
+uniform float uFeedback;
+uniform float uVarianceGamma;
+uniform bool uHistoryValid;
+uniform bool uFluidMotion;
+uniform vec4 uSphere;                   // Center, radius
+uniform vec3 uPreviousSphereCenter;
+
+vec3 toYCoCg(vec3 color)
+{
+  return vec3(dot(color, vec3(0.25, 0.5, 0.25)), dot(color, vec3(0.5, 0.0, -0.5)), dot(color, vec3(-0.25, 0.5, -0.25)));
+}
+
+vec3 fromYCoCg(vec3 color)
+{
+  return vec3(color.x + color.y - color.z, color.x + color.z, color.x - color.y - color.z);
+}
+
+float toneWeight(vec3 ycocg)
+{
+  return 1.0 / (1.0 + max(ycocg.x, 0.0));
+}
+
+// Catmull-Rom in five bilinear taps, the corners left out
+vec3 sampleHistory(vec2 uv)
+{
+  vec2 position = uv * uOutputSize;
+  vec2 center = floor(position - 0.5) + 0.5;
+  vec2 f = position - center;
+  vec2 w0 = f * (-0.5 + f * (1.0 - 0.5 * f));
+  vec2 w1 = 1.0 + f * f * (-2.5 + 1.5 * f);
+  vec2 w2 = f * (0.5 + f * (2.0 - 1.5 * f));
+  vec2 w3 = f * f * (-0.5 + 0.5 * f);
+  vec2 w12 = w1 + w2;
+  vec2 uv0 = (center - 1.0) / uOutputSize;
+  vec2 uv3 = (center + 2.0) / uOutputSize;
+  vec2 uv12 = (center + w2 / w12) / uOutputSize;
+
+  vec3 color = textureLod(uHistory, vec2(uv12.x, uv0.y), 0.0).rgb * (w12.x * w0.y) +
+               textureLod(uHistory, vec2(uv0.x, uv12.y), 0.0).rgb * (w0.x * w12.y) +
+               textureLod(uHistory, uv12, 0.0).rgb * (w12.x * w12.y) +
+               textureLod(uHistory, vec2(uv3.x, uv12.y), 0.0).rgb * (w3.x * w12.y) +
+               textureLod(uHistory, vec2(uv12.x, uv3.y), 0.0).rgb * (w12.x * w3.y);
+  float weight = w12.x * w0.y + w0.x * w12.y + w12.x * w12.y + w3.x * w12.y + w12.x * w3.y;
+  return max(color / weight, vec3(0.0));
+}
+
+// Pulls the history toward the box's center until it is inside
+vec3 clipToBox(vec3 history, vec3 boxMin, vec3 boxMax)
+{
+  vec3 center = 0.5 * (boxMin + boxMax);
+  vec3 extent = 0.5 * (boxMax - boxMin) + 1e-4;
+  vec3 offset = history - center;
+  vec3 units = abs(offset / extent);
+  float largest = max(units.x, max(units.y, units.z));
+  return largest > 1.0 ? center + offset / largest : history;
+}
+
+void main()
+{
+  ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+  if (any(greaterThanEqual(pixel, ivec2(uOutputSize)))) return;
+
+  // The pixel in render texels; texel t holds the scene at t + 0.5 - jitter
+  vec2 uv = (vec2(pixel) + 0.5) / uOutputSize;
+  vec2 renderPosition = uv * uRenderSize;
+  ivec2 nearest = ivec2(floor(renderPosition + uJitter));
+  ivec2 renderMax = ivec2(uRenderSize) - 1;
+
+  vec3 colorSum = vec3(0.0);
+  float weightSum = 0.0;
+  vec3 moment1 = vec3(0.0);
+  vec3 moment2 = vec3(0.0);
+  float closestDepth = 1.0;
+  ivec2 closestTexel = clamp(nearest, ivec2(0), renderMax);
+  for (int y = -1; y <= 1; y++) {
+    for (int x = -1; x <= 1; x++) {
+      ivec2 texel = clamp(nearest + ivec2(x, y), ivec2(0), renderMax);
+      vec3 color = toYCoCg(max(texelFetch(uSceneColor, texel, 0).rgb, vec3(0.0)));
+      vec2 offset = vec2(texel) + 0.5 - uJitter - renderPosition;
+      float weight = exp(-2.29 * dot(offset, offset)) * toneWeight(color);  // Blackman-Harris fit
+      colorSum += color * weight;
+      weightSum += weight;
+      moment1 += color;
+      moment2 += color * color;
+
+      float depth = texelFetch(uSceneDepth, texel, 0).r;
+      if (depth < closestDepth) {
+        closestDepth = depth;
+        closestTexel = texel;
+      }
+    }
+  }
+  vec3 current = colorSum / max(weightSum, 1e-6);
+  if (!uHistoryValid) {
+    imageStore(uOutput, pixel, vec4(max(fromYCoCg(current), vec3(0.0)), 1.0));
+    return;
+  }
+
+  // Camera motion of the nearest surface, so edges move with what is in front
+  vec2 closestUV = (vec2(closestTexel) + 0.5 - uJitter) / uRenderSize;
+  vec4 world = uInverseViewProjection * vec4(vec3(closestUV, closestDepth) * 2.0 - 1.0, 1.0);
+  world.xyz /= world.w;
+  if (uSphere.w > 0.0 && distance(world.xyz, uSphere.xyz) < uSphere.w * 1.05) {
+    world.xyz -= uSphere.xyz - uPreviousSphereCenter;
+  }
+  vec4 previousClip = uPreviousViewProjection * vec4(world.xyz, 1.0);
+  vec2 previousUV = uv + (previousClip.xy / previousClip.w * 0.5 + 0.5 - closestUV);
+
+  // Fluid in front of the scene moves as its particles did
+  if (uFluidMotion && textureLod(uFluidDepth, uv, 0.0).r < closestDepth) {
+    previousUV = uv - textureLod(uFluidMotion, uv, 0.0).xy;
+  }
+
+  vec3 result = current;
+  if (all(greaterThanEqual(previousUV, vec2(0.0))) && all(lessThanEqual(previousUV, vec2(1.0)))) {
+    vec3 mean = moment1 / 9.0;
+    vec3 deviation = sqrt(max(moment2 / 9.0 - mean * mean, vec3(0.0)));
+    vec3 history = clipToBox(toYCoCg(sampleHistory(previousUV)), mean - uVarianceGamma * deviation,
+                             mean + uVarianceGamma * deviation);
+
+    // Fast motion keeps less history: every resampling of it blurs a little
+    float motionPixels = length((previousUV - uv) * uOutputSize);
+    float feedback = uFeedback * mix(1.0, 0.8, clamp(motionPixels / 16.0, 0.0, 1.0));
+    float currentWeight = (1.0 - feedback) * toneWeight(current);
+    float historyWeight = feedback * toneWeight(history);
+    result = (current * currentWeight + history * historyWeight) / (currentWeight + historyWeight);
+  }
+  imageStore(uOutput, pixel, vec4(max(fromYCoCg(result), vec3(0.0)), 1.0));
+}
@@ -1,26 +1,89 @@
 #version 460 core
+#ifdef BINDLESS_TEXTURES
+#extension GL_ARB_bindless_texture : require
+#endif
 
 in vec3 FragPos;
 in vec3 Normal;
 in vec2 TexCoord;
 in vec4 ClipSpace;
+in vec2 OceanUV;
+in vec2 HeightfieldUV;
 
+// The water volume draws in the transparent pass (OIT_PASS), through oit.fs
+#ifdef OIT_PASS
+void writeTransparent(vec4 color);
+#else
 out vec4 FragColor;
+#endif
 
 // Water properties
 uniform vec3 waterColor;
 uniform float transparency;
-uniform vec3 viewPos;
+
+// Static material textures: resident handles in one block (BindlessTextures.h) or units
+#ifdef BINDLESS_TEXTURES
+layout(std140, binding = 4) uniform MaterialTextures
+{
+    samplerCube skybox;
+    sampler2D causticTex;
+    sampler2D tileTexture;
+    sampler2D waveHeightMap;
+    sampler2D sphereTexture;
+};
+#else
 uniform samplerCube skybox;
-uniform sampler2D reflectionTexture;
-uniform sampler2D refractionTexture;
 uniform sampler2D causticTex;
 uniform sampler2D tileTexture;
 uniform sampler2D waveHeightMap;
+#endif
+uniform float roughness = 0.05;    // Of the sky reflection, for ripples finer than the mesh
+
+// Prefiltered environment of Skybox::setEnvironmentUniforms (see sphere.fs)
+uniform bool environmentLighting = false;
+uniform samplerCube prefilteredEnv;
+uniform float prefilteredMaxLod;
+uniform vec3 irradianceSH[9];
+uniform sampler2D reflectionTexture;
+uniform sampler2D refractionTexture;
+uniform mat4 reflectionViewProjection; // Mirrored camera of the reflection's last refresh
+
+// Far-field reflection probe (ReflectionProbe.h): a cubemap box-projected onto the container,
+// taking over from the planar reflection between the blend distances from the camera and
+// as the surface roughens. The planar target is then cleared transparent, so its alpha
+// says where it holds near-field geometry
+uniform bool reflectionProbeEnabled = false;
+uniform samplerCube reflectionProbe;
+uniform vec3 probePosition;
+uniform vec3 probeBoxMin;
+uniform vec3 probeBoxMax;
+uniform float probeMaxLod;
+uniform vec2 probeBlendDistance;    // Planar alone up to x, probe alone past y
+uniform bool oceanWaves;
+uniform sampler2D oceanNormalFoam; // FFT ocean normal and foam, per pixel
+uniform bool heightfieldWaves;
+uniform sampler2D heightfield;     // Wave-equation ripple heights over the surface
+uniform float heightfieldSize;
+
+// Floor caustics splatted from this frame's waves (RasterCaustics.h), 1 under calm water;
+// without them the floor scrolls causticTex as the walls do
+uniform bool causticMapEnabled = false;
+uniform sampler2D causticMap;
+uniform float causticMapExtent;     // World size of the square of floor it covers
+
+// Camera and light of the pass being drawn (updateFrameUniforms in main.cpp); time
+// animates the caustics
+layout(std140, binding = 2) uniform FrameUniforms
+{
+    mat4 view;
+    mat4 projection;
+    vec3 viewPos;
+    float time;
+    vec3 lightPos;
+    vec3 lightColor;
+};
 
 // Lighting properties
-uniform vec3 lightPos;
-uniform vec3 lightColor;
 uniform float ambientStrength;
 uniform float specularStrength;
 uniform float shininess;
@@ -30,11 +93,23 @@ const float IOR_AIR = 1.0;
 const float IOR_WATER = 1.333;
 const float poolHeight = -5.0; // Floor level
 
-// Caustics parameters
-uniform float time; // For caustic animation
+// Cascaded shadows, linked in from caustic_shadow.fs
+float cascadeShadow(vec3 worldPos, vec3 normal);
+vec3 shadowedCaustics(vec3 caustics, vec3 worldPos, vec3 normal);
+
+// Dynamic lights, linked in from clustered_lights.fs
+void clusteredLighting(vec3 worldPos, vec3 normal, vec3 viewDir, float shininess,
+                       out vec3 diffuse, out vec3 specular);
 
 // Function to calculate underwater caustic effect
 vec3 calculateCaustics(vec3 pos, float depth) {
+    if (causticMapEnabled && abs(pos.y - poolHeight) < 0.01) {
+        // Squared like the texture below, so the focused light stands out of the calm level
+        float focus = texture(causticMap, pos.xz / causticMapExtent + 0.5).r;
+        vec3 mapCaustic = vec3(0.7, 0.9, 1.0) * min(focus * focus * 0.25, 2.0);
+        return mapCaustic * 0.8 * exp(-depth * 0.15);
+    }
+    
     // Multiple layers of caustics with different scales and speeds
     vec2 causticCoord1 = pos.xz * 0.2 - time * 0.03;
     vec2 causticCoord2 = pos.xz * 0.3 - time * 0.05;
@@ -75,6 +150,16 @@ vec3 getTileColor(vec3 pos) {
     return texture(tileTexture, tileCoord).rgb;
 }
 
+// Inward normal of the pool surface at a point getTileColor accepts
+vec3 getPoolNormal(vec3 pos) {
+    if (abs(pos.y - poolHeight) < 0.01) {
+        return vec3(0.0, 1.0, 0.0);
+    } else if (abs(abs(pos.x) - 5.0) < 0.01) {
+        return vec3(-sign(pos.x), 0.0, 0.0);
+    }
+    return vec3(0.0, 0.0, -sign(pos.z));
+}
+
 // Ray-box intersection for refraction
 vec2 rayBoxIntersect(vec3 rayOrigin, vec3 rayDir, vec3 boxMin, vec3 boxMax) {
     vec3 invDir = 1.0 / rayDir;
@@ -87,9 +172,42 @@ vec2 rayBoxIntersect(vec3 rayOrigin, vec3 rayDir, vec3 boxMin, vec3 boxMax) {
     return vec2(tNear, tFar);
 }
 
+// Direction from the probe to where the ray leaves its box, for the parallax-corrected lookup;
+// the ray itself from outside the box
+vec3 boxProjectedDirection(vec3 position, vec3 dir) {
+    if (any(lessThan(position, probeBoxMin)) || any(greaterThan(position, probeBoxMax))) return dir;
+    vec3 exitT = max((probeBoxMax - position) / dir, (probeBoxMin - position) / dir);
+    float t = min(min(exitT.x, exitT.y), exitT.z);
+    return position + dir * t - probePosition;
+}
+
+// Irradiance over pi, from the SH9 coefficients (as in sphere.fs)
+vec3 shIrradiance(vec3 n) {
+    vec3 e = irradianceSH[0] * 0.282095
+           + irradianceSH[1] * (0.488603 * n.y) + irradianceSH[2] * (0.488603 * n.z) + irradianceSH[3] * (0.488603 * n.x)
+           + irradianceSH[4] * (1.092548 * n.x * n.y) + irradianceSH[5] * (1.092548 * n.y * n.z)
+           + irradianceSH[6] * (0.315392 * (3.0 * n.z * n.z - 1.0)) + irradianceSH[7] * (1.092548 * n.x * n.z)
+           + irradianceSH[8] * (0.546274 * (n.x * n.x - n.y * n.y));
+    return max(e, vec3(0.0));
+}
+
 void main() {
     // Normalize vectors
     vec3 norm = normalize(Normal);
+    float foam = 0.0;
+    if (oceanWaves) {
+        vec4 normalFoam = texture(oceanNormalFoam, OceanUV);
+        norm = normalize(normalize(normalFoam.xyz) + norm - vec3(0.0, 1.0, 0.0));
+        foam = normalFoam.w;
+    }
+    if (heightfieldWaves) {
+        // Central differences of the ripple heights tilt the normal
+        vec2 texel = 1.0 / vec2(textureSize(heightfield, 0));
+        vec2 slope = vec2(texture(heightfield, HeightfieldUV + vec2(texel.x, 0.0)).r - texture(heightfield, HeightfieldUV - vec2(texel.x, 0.0)).r,
+                          texture(heightfield, HeightfieldUV + vec2(0.0, texel.y)).r - texture(heightfield, HeightfieldUV - vec2(0.0, texel.y)).r) /
+                     (2.0 * texel * heightfieldSize);
+        norm = normalize(norm + vec3(-slope.x, 0.0, -slope.y));
+    }
     vec3 viewDir = normalize(viewPos - FragPos);
     
     // Improved Fresnel effect using Schlick's approximation
@@ -100,13 +218,23 @@ void main() {
     vec3 reflectDir = reflect(-viewDir, norm);
     vec3 refractDir = refract(-viewDir, norm, IOR_AIR / IOR_WATER);
     
-    // Sample reflection texture if available, otherwise use skybox
-    vec2 ndcCoords = ClipSpace.xy / ClipSpace.w / 2.0 + 0.5;
-    vec3 reflectionColor = mix(
-        texture(skybox, reflectDir).rgb,
-        texture(reflectionTexture, vec2(ndcCoords.x, 1.0 - ndcCoords.y)).rgb,
-        0.8  // Blend factor - adjust as needed
-    );
+    // Sample reflection texture if available, otherwise use skybox. The reflection may be a
+    // few frames old, so the surface point is projected with the camera it was rendered from;
+    // on the plane the mirrored camera sees it where the current one does
+    vec4 reflectionClip = reflectionViewProjection * vec4(FragPos, 1.0);
+    vec2 reflectionUV = clamp(reflectionClip.xy / reflectionClip.w * 0.5 + 0.5, 0.0, 1.0);
+    vec3 skyColor = environmentLighting ? textureLod(prefilteredEnv, reflectDir, roughness * prefilteredMaxLod).rgb
+                                        : texture(skybox, reflectDir).rgb;
+    vec4 planarColor = texture(reflectionTexture, reflectionUV);
+    float planarWeight = 0.8;  // Blend factor - adjust as needed
+    if (reflectionProbeEnabled) {
+        // The probe is the far field: the planar target only where it drew, near the camera
+        // and on smooth water
+        skyColor = textureLod(reflectionProbe, boxProjectedDirection(FragPos, reflectDir), roughness * probeMaxLod).rgb;
+        float nearField = 1.0 - smoothstep(probeBlendDistance.x, probeBlendDistance.y, distance(viewPos, FragPos));
+        planarWeight = planarColor.a * nearField * (1.0 - smoothstep(0.0, 0.5, roughness));
+    }
+    vec3 reflectionColor = mix(skyColor, planarColor.rgb, planarWeight);
     
     // Calculate water depth
     float waterDepth = abs(FragPos.y - poolHeight);
@@ -130,32 +258,47 @@ void main() {
             // Get tile color at intersection point
             vec3 tileColor = getTileColor(hitPos);
             
+            // What the sphere, fluid and glass keep from the pool takes its direct light
+            vec3 poolNormal = getPoolNormal(hitPos);
+            tileColor *= 1.0 - 0.6 * cascadeShadow(hitPos, poolNormal);
+            
+            // Pool lights on the tiles
+            vec3 tileLight, tileHighlight;
+            clusteredLighting(hitPos, poolNormal, -refractDir, shininess, tileLight, tileHighlight);
+            tileColor += tileColor * tileLight;
+            
             // Apply underwater lighting (bluish tint and depth-based attenuation)
             float depthFactor = exp(-waterDepth * 0.1);
             vec3 waterTint = mix(waterColor, vec3(1.0), 0.5);
             
             // Apply caustics to the tile color
-            vec3 causticEffect = calculateCaustics(hitPos, waterDepth);
+            vec3 causticEffect = shadowedCaustics(calculateCaustics(hitPos, waterDepth), hitPos, poolNormal);
             
             // Combine caustics with tile color, affected by water depth and tint
             underwaterColor = mix(tileColor * depthFactor, causticEffect, 0.5) * waterTint;
         }
     }
     
-    // Standard lighting calculations for water surface
+    // Standard lighting calculations for water surface, without the direct light in shadow
+    float surfaceLight = 1.0 - cascadeShadow(FragPos, norm);
     vec3 lightDir = normalize(lightPos - FragPos);
-    float diff = max(dot(norm, lightDir), 0.0);
+    float diff = max(dot(norm, lightDir), 0.0) * surfaceLight;
     vec3 diffuse = diff * lightColor;
     
     // Specular (Blinn-Phong)
     vec3 halfwayDir = normalize(lightDir + viewDir);
     float spec = pow(max(dot(norm, halfwayDir), 0.0), shininess * 4.0); // Sharper highlights
-    vec3 specular = specularStrength * spec * lightColor;
+    vec3 specular = specularStrength * spec * lightColor * surfaceLight;
+    
+    // Dynamic lights glint on the surface and tint the water they shine through
+    vec3 clusterDiffuse, clusterSpecular;
+    clusteredLighting(FragPos, norm, viewDir, shininess * 4.0, clusterDiffuse, clusterSpecular);
+    specular += specularStrength * clusterSpecular;
     
     // Water surface sparkles (tiny, sharp specular highlights based on time)
     float sparkles = pow(max(dot(norm, halfwayDir), 0.0), 512.0) * 
                    (0.5 + 0.5 * sin(time * 5.0 + FragPos.x * 10.0 + FragPos.z * 10.0));
-    vec3 sparkleColor = lightColor * sparkles;
+    vec3 sparkleColor = lightColor * sparkles * surfaceLight;
     
     // Final color mixing based on Fresnel
     // Higher fresnel = more reflection, less refraction
@@ -163,10 +306,19 @@ void main() {
     
     // Add highlights and sparkles (reduced intensity)
     result += specular * 0.3 + sparkleColor * 0.5;
+    result += clusterDiffuse * waterColor * (1.0 - fresnel);
+    
+    // Ocean foam where the choppy waves fold over
+    vec3 foamLight = environmentLighting ? ambientStrength * shIrradiance(norm) + diff : vec3(ambientStrength + diff);
+    result = mix(result, vec3(0.9) * foamLight, foam * 0.8);
     
     // Calculate transparency based on view angle (more transparent when looking straight down)
-    float viewAngleTransparency = transparency * (1.0 - fresnel * 0.5);
+    float viewAngleTransparency = mix(transparency * (1.0 - fresnel * 0.5), 1.0, foam);
     
     // Final color with angle-dependent transparency
+#ifdef OIT_PASS
+    writeTransparent(vec4(result, viewAngleTransparency));
+#else
     FragColor = vec4(result, viewAngleTransparency);
+#endif
 } 
\ No newline at end of file
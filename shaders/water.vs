@@ -1,58 +1,294 @@
 #version 460 core
+#ifdef STEREO_MULTIVIEW
+// Both eyes in one draw (StereoRenderer); each view takes its camera from the frame block
+#extension GL_OVR_multiview2 : require
+layout(num_views = 2) in;
+#endif
 
+#ifdef WATER_TESSELLATION
+// Built as the evaluation stage of the tessellated water (InitTessellationShader): the
+// vertex is interpolated over the flat patch from water.tcs instead of read as attributes
+layout (quads, fractional_even_spacing, cw) in;
+in vec3 tcPosition[];
+vec3 aPos;
+vec3 aNormal;
+vec2 aTexCoord;
+vec4 aPatch;
+#else
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoord;
+layout (location = 3) in vec4 aPatch; // LOD mesh instance: origin.xz, size, level
+#endif
 
 out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoord;
 out vec4 ClipSpace;
+out vec2 OceanUV;
+out vec2 HeightfieldUV;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-uniform float time; // Animation time
+
+// Camera and light of the pass being drawn (updateFrameUniforms in main.cpp); time
+// animates the waves
+layout(std140, binding = 2) uniform FrameUniforms
+{
+    mat4 view;
+    mat4 projection;
+    vec3 viewPos;
+    float time;
+    vec3 lightPos;
+    vec3 lightColor;
+#ifdef STEREO_MULTIVIEW
+    mat4 eyeView[2];
+    mat4 eyeProjection[2];
+#endif
+};
+#ifdef STEREO_MULTIVIEW
+#define view eyeView[gl_ViewID_OVR]
+#define projection eyeProjection[gl_ViewID_OVR]
+#endif
+
 uniform bool enableMicroWaves; // Control micro-detail waves
 uniform vec2 flowVelocity; // Water flow velocity
 uniform float flowOffset; // Time-based flow offset
+uniform bool gpuWaves; // Displace the flat grid here instead of using the CPU-displaced vertices
+uniform bool oceanWaves; // Displace the flat grid from the FFT ocean textures (OceanFFT)
+uniform sampler2D oceanDisplacement; // xyz offset over one tiling patch
+uniform float oceanPatchSize;
+uniform bool heightfieldWaves; // Add the wave-equation ripple heights (HeightfieldWaves)
+uniform sampler2D heightfield;
+uniform float heightfieldSize; // World size the heightfield spans
+uniform bool flowMapEnabled; // Local currents from the flow map (FlowMap) in place of flowVelocity
+uniform sampler2D flowMap; // World velocity xz over the surface
+uniform float flowMapSize;
+
+// Flow map mode scrolls the micro-detail in two layers half a period apart, each restarting
+// while the other carries its full weight, so the detail follows a varying current without
+// stretching without bound
+#define FLOW_PERIOD 2.0
+
+#ifdef WATER_VOLUME
+// Water volume box (main.cpp): static geometry whose top vertices sit at y = 0 and are
+// lifted here to the water height plus the surface's displacement there, so the walls
+// and the top follow the waves; the floor vertices stay where they are
+uniform float volumeHeight;
+#endif
+
+// CDLOD mesh (WaterSurface LOD mode): aPos.xz is the vertex in the unit patch grid, scaled
+// and placed by aPatch, and morphed towards the next coarser grid as the camera distance
+// approaches the end of its level's range, so neighbouring levels meet without cracks
+uniform bool lodMesh;
+uniform vec3 lodCamera;       // Camera position in surface coordinates
+uniform float lodFinestRange; // Range of level 0; each level doubles it
+uniform float lodPatchResolution;
+uniform float surfaceSize;
+
+// Compact grid (WaterSurface::setCompactMesh): aNormal.xy is an octahedral normal and the
+// texture coordinates follow from the position
+uniform bool packedVertices;
+
+vec3 octahedralDecode(vec2 e) {
+    vec3 n = vec3(e.x, 1.0 - abs(e.x) - abs(e.y), e.y);
+    if (n.y < 0.0) {
+        n.xz = (1.0 - abs(n.zx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.z >= 0.0 ? 1.0 : -1.0);
+    }
+    return normalize(n);
+}
+
+vec3 lodVertex() {
+    vec2 grid = aPos.xz;
+    vec2 world = aPatch.xy + grid * aPatch.z;
+    float range = lodFinestRange * exp2(aPatch.w);
+    float distanceToCamera = distance(lodCamera, vec3(world.x, 0.0, world.y));
+    float morph = clamp((distanceToCamera - 0.7 * range) / (0.3 * range), 0.0, 1.0);
+    vec2 oddOffset = fract(grid * lodPatchResolution * 0.5) * 2.0 / lodPatchResolution;
+    world -= oddOffset * aPatch.z * morph;
+    return vec3(world.x, 0.0, world.y);
+}
+
+// Gerstner waves and ripples, written by WaterSurface::updateWaveBlock
+#define MAX_WAVES 16
+#define MAX_RIPPLES 32
+
+layout(std140, binding = 1) uniform WaveParameters
+{
+    vec4 waves[2 * MAX_WAVES];     // direction.xy, amplitude, wavelength; speed, steepness
+    vec4 ripples[2 * MAX_RIPPLES]; // center.xy, decayed amplitude, radius; direction.xy, distance travelled, directional
+    ivec4 waveCounts;              // Waves, ripples
+    vec4 waveTiming;               // Time, grid step
+    vec4 rippleAges[MAX_RIPPLES / 4]; // Seconds since each ripple started
+};
+
+// Local current the ripples drift with since they started, zero without the flow map
+vec2 rippleFlow = vec2(0.0);
 
 // Noise function for additional micro-detail
 float noise(vec2 uv) {
     return fract(sin(dot(uv, vec2(12.9898, 78.233))) * 43758.5453);
 }
 
+// Same displacement and analytic derivatives as WaterSurface::sampleWaves
+vec3 waveDisplacement(vec2 xz, out vec3 dPdx, out vec3 dPdz) {
+    vec3 result = vec3(xz.x, 0.0, xz.y);
+    dPdx = vec3(1.0, 0.0, 0.0);
+    dPdz = vec3(0.0, 0.0, 1.0);
+    
+    for (int i = 0; i < waveCounts.x; i++) {
+        float A = waves[2 * i].z;
+        if (abs(A) < 0.001) {
+            continue;
+        }
+        
+        vec2 D = normalize(waves[2 * i].xy);
+        float S = waves[2 * i + 1].y;
+        float k = 2.0 * 3.14159265 / waves[2 * i].w;
+        float w = sqrt(9.8 * k);
+        float phase = k * dot(D, xz) - waves[2 * i + 1].x * w * waveTiming.x;
+        float sinPhase = sin(phase);
+        float cosPhase = cos(phase);
+        
+        float horizontalScale = S * 2.0;
+        result.xz += D * A * horizontalScale * cosPhase;
+        result.y += A * sinPhase;
+        
+        float horizontalSlope = A * horizontalScale * k * sinPhase;
+        float verticalSlope = A * k * cosPhase;
+        dPdx -= vec3(D.x * D.x * horizontalSlope, -D.x * verticalSlope, D.x * D.y * horizontalSlope);
+        dPdz -= vec3(D.x * D.y * horizontalSlope, -D.y * verticalSlope, D.y * D.y * horizontalSlope);
+    }
+    
+    // Ripples (WaterSurface::rippleHeight)
+    for (int i = 0; i < waveCounts.y; i++) {
+        vec4 ripple = ripples[2 * i];
+        vec4 propagation = ripples[2 * i + 1];
+        vec2 d = xz - ripple.xy - rippleFlow * rippleAges[i / 4][i % 4];
+        float frequency = 3.14159265 / ripple.w;
+        
+        if (propagation.w > 0.5) {
+            float distanceInDirection = dot(d, propagation.xy);
+            float perpendicular = d.x * propagation.y - d.y * propagation.x;
+            float perpendicularDistance = abs(perpendicular);
+            float waveDistance = distanceInDirection - propagation.z;
+            if (waveDistance >= 0.0 && waveDistance <= ripple.w && perpendicularDistance < ripple.w * 0.5) {
+                float factor = sin(waveDistance * frequency);
+                float perpFactor = exp(-perpendicularDistance * 2.0 / ripple.w);
+                result.y += factor * ripple.z * perpFactor;
+                
+                vec2 perpendicularGradient = sign(perpendicular) * vec2(propagation.y, -propagation.x);
+                vec2 gradient = ripple.z * perpFactor * (frequency * cos(waveDistance * frequency) * propagation.xy -
+                                                         factor * 2.0 / ripple.w * perpendicularGradient);
+                dPdx.y += gradient.x;
+                dPdz.y += gradient.y;
+            }
+        } else {
+            float distance = length(d);
+            float waveDistance = distance - propagation.z;
+            if (waveDistance >= 0.0 && waveDistance <= ripple.w) {
+                result.y += sin(waveDistance * frequency) * ripple.z;
+                if (distance > 0.0) {
+                    vec2 gradient = ripple.z * frequency * cos(waveDistance * frequency) * d / distance;
+                    dPdx.y += gradient.x;
+                    dPdz.y += gradient.y;
+                }
+            }
+        }
+    }
+    
+    return result;
+}
+
+// Flow height variation and, if enabled, micro-detail waves of the point moved back by the
+// flow displacement; slope is the micro-detail's tilt of the normal
+float flowDetail(vec2 p, vec2 displacement, out vec2 slope) {
+    float detail = 0.02 * sin(p.x * 3.0 - displacement.x * 5.0) * sin(p.y * 3.0 - displacement.y * 5.0);
+    slope = vec2(0.0);
+    if (enableMicroWaves) {
+        vec2 q = p - displacement;
+        vec2 r = p - displacement * 0.5;
+        detail += 0.05 * sin(q.x * 5.0 + time * 2.0) * sin(q.y * 5.0 + time * 1.5);
+        detail += 0.03 * sin(r.x * 8.0 + time * 1.7) * sin(r.y * 7.0 + time * 2.3);
+        slope = 0.2 * vec2(cos(q.x * 5.0 + time * 2.0) * sin(q.y * 5.0 + time * 1.5),
+                           sin(q.x * 5.0 + time * 2.0) * cos(q.y * 5.0 + time * 1.5));
+    }
+    return detail;
+}
+
 void main() {
+#ifdef WATER_TESSELLATION
+    vec2 uv = gl_TessCoord.xy;
+    aPos = mix(mix(tcPosition[0], tcPosition[1], uv.x), mix(tcPosition[3], tcPosition[2], uv.x), uv.y);
+    aNormal = vec3(0.0, 1.0, 0.0);
+    aTexCoord = aPos.xz / surfaceSize + 0.5;
+    aPatch = vec4(0.0);
+#endif
+    
     // Copy original position
-    vec3 pos = aPos;
-    vec3 normal = aNormal;
+    vec3 basePos = lodMesh ? lodVertex() : aPos;
+    vec2 baseTexCoord = (lodMesh || packedVertices) ? basePos.xz / surfaceSize + 0.5 : aTexCoord;
+    vec3 pos = basePos;
+    vec3 normal = packedVertices ? octahedralDecode(aNormal.xy) : aNormal;
     
-    // Apply flow displacement
-    vec2 flowDisplacement = flowVelocity * flowOffset;
+    vec2 localFlow = flowMapEnabled ? textureLod(flowMap, basePos.xz / flowMapSize + 0.5, 0.0).xy : flowVelocity;
+    rippleFlow = flowMapEnabled ? localFlow : vec2(0.0);
     
-    // Add flow-based height variation
-    float flowHeight = 0.02 * sin(aPos.x * 3.0 - flowDisplacement.x * 5.0) * sin(aPos.z * 3.0 - flowDisplacement.y * 5.0);
-    pos.y += flowHeight;
+    OceanUV = oceanWaves ? basePos.xz / oceanPatchSize : vec2(0.0);
+    float surfaceWeight = 1.0;
+#ifdef WATER_VOLUME
+    // Heights only: the Gerstner block is written whatever draws the surface, and a
+    // horizontal shift would pull the walls off the glass
+    surfaceWeight = aPos.y >= 0.0 ? 1.0 : 0.0;
+    if (surfaceWeight > 0.0) {
+        vec3 dPdx, dPdz;
+        pos.y = volumeHeight + waveDisplacement(basePos.xz, dPdx, dPdz).y;
+        if (oceanWaves) {
+            pos.y += textureLod(oceanDisplacement, OceanUV, 0.0).y;
+        }
+    }
+#else
+    if (gpuWaves || oceanWaves) {
+        // In ocean mode the block holds only the ripples; water.fs adds this normal's tilt
+        // to the per-pixel ocean normal
+        vec3 dPdx, dPdz;
+        pos = waveDisplacement(basePos.xz, dPdx, dPdz);
+        normal = normalize(cross(dPdz, dPdx));
+        if (oceanWaves) {
+            pos += textureLod(oceanDisplacement, OceanUV, 0.0).xyz;
+        }
+    }
+#endif
+    
+    // Ripple heights; water.fs takes the normal from the same texture per pixel
+    HeightfieldUV = heightfieldWaves ? basePos.xz / heightfieldSize + 0.5 : vec2(0.0);
+    if (heightfieldWaves) {
+        pos.y += surfaceWeight * textureLod(heightfield, HeightfieldUV, 0.0).r;
+    }
+    
+    // Flow-based height variation and micro-detail, the whole pattern moved along the flow
+    vec2 detailSlope;
+    if (flowMapEnabled) {
+        float phase = fract(flowOffset / FLOW_PERIOD);
+        float weight = 1.0 - abs(1.0 - 2.0 * phase);
+        vec2 slope0, slope1;
+        float detail0 = flowDetail(basePos.xz, localFlow * phase * FLOW_PERIOD, slope0);
+        float detail1 = flowDetail(basePos.xz, localFlow * fract(phase + 0.5) * FLOW_PERIOD, slope1);
+        pos.y += mix(detail1, detail0, weight);
+        detailSlope = mix(slope1, slope0, weight);
+    } else {
+        pos.y += flowDetail(basePos.xz, flowVelocity * flowOffset, detailSlope);
+    }
     
-    // Add micro-detail waves based on position and time only if enabled
     if (enableMicroWaves) {
-        // Modify micro-detail with flow
-        float microDetail = 0.05 * sin((aPos.x - flowDisplacement.x) * 5.0 + time * 2.0) * sin((aPos.z - flowDisplacement.y) * 5.0 + time * 1.5);
-        float microDetail2 = 0.03 * sin((aPos.x - flowDisplacement.x * 0.5) * 8.0 + time * 1.7) * sin((aPos.z - flowDisplacement.y * 0.5) * 7.0 + time * 2.3);
-        
-        // Add micro-detail to position
-        pos.y += microDetail + microDetail2;
-        
         // Update normal based on micro-detail slopes and flow
-        normal.x += 0.2 * cos((aPos.x - flowDisplacement.x) * 5.0 + time * 2.0) * sin((aPos.z - flowDisplacement.y) * 5.0 + time * 1.5) + flowVelocity.x * 0.1;
-        normal.z += 0.2 * sin((aPos.x - flowDisplacement.x) * 5.0 + time * 2.0) * cos((aPos.z - flowDisplacement.y) * 5.0 + time * 1.5) + flowVelocity.y * 0.1;
+        normal.xz += detailSlope + localFlow * 0.1;
         normal = normalize(normal);
         
         // Pass texture coordinates with flow-based distortion
-        TexCoord = aTexCoord + vec2(sin(time * 0.5 + aPos.x), cos(time * 0.7 + aPos.z)) * 0.01 + flowVelocity * 0.02;
+        TexCoord = baseTexCoord + vec2(sin(time * 0.5 + basePos.x), cos(time * 0.7 + basePos.z)) * 0.01 + localFlow * 0.02;
     } else {
         // Without micro-detail, still apply flow distortion to texture
-        TexCoord = aTexCoord + flowVelocity * 0.02;
+        TexCoord = baseTexCoord + localFlow * 0.02;
     }
     
     // Calculate world-space position
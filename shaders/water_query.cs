@@ -0,0 +1,64 @@
+#version 460 core
+// Water queries over regular water (WaterQueries): the wave surface above or below each
+// point, from the WaveState textures. Those hold the displacement of each grid point, so
+// the grid point whose displaced position lands on the query is found by a few fixed-point
+// steps back along the horizontal displacement.
+
+layout(local_size_x = 64) in;
+
+layout(binding = 0, std430) restrict readonly buffer pointBuf
+{
+  vec4 points[];
+};
+
+struct Result
+{
+  vec4 normalHeight;      // xyz normal, w surface height
+  vec4 velocityFraction;  // xyz water velocity, w submerged fraction
+};
+
+layout(binding = 1, std430) restrict writeonly buffer resultBuf
+{
+  Result results[];
+};
+
+uniform int uCount;
+uniform float uSize;            // World size the wave textures span, centred on the origin
+uniform float uWaterLevel;
+uniform sampler2D uWaveHeight;  // r height, gb horizontal displacement
+uniform sampler2D uWaveNormal;  // xyz normal
+uniform sampler2D uWaveVelocity;
+
+const int INVERSION_STEPS = 3;
+
+void main()
+{
+  uint id = gl_GlobalInvocationID.x;
+  if (id >= uint(uCount)) return;
+
+  vec3 point = points[id].xyz;
+  vec2 uv = point.xz / uSize + 0.5;
+
+  // Off the square the water is flat and still
+  Result result;
+  result.normalHeight = vec4(0.0, 1.0, 0.0, uWaterLevel);
+  result.velocityFraction = vec4(0.0, 0.0, 0.0, point.y <= uWaterLevel ? 1.0 : 0.0);
+
+  if (all(greaterThanEqual(uv, vec2(0.0))) && all(lessThanEqual(uv, vec2(1.0))))
+  {
+    vec2 source = point.xz;
+    vec4 displacement = textureLod(uWaveHeight, uv, 0.0);
+    for (int i = 0; i < INVERSION_STEPS; i++)
+    {
+      source = point.xz - displacement.gb;
+      displacement = textureLod(uWaveHeight, source / uSize + 0.5, 0.0);
+    }
+    vec2 sourceUV = source / uSize + 0.5;
+
+    float height = uWaterLevel + displacement.r;
+    result.normalHeight = vec4(normalize(textureLod(uWaveNormal, sourceUV, 0.0).xyz), height);
+    result.velocityFraction = vec4(textureLod(uWaveVelocity, sourceUV, 0.0).xyz, point.y <= height ? 1.0 : 0.0);
+  }
+
+  results[id] = result;
+}
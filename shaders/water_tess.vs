@@ -0,0 +1,11 @@
+#version 460 core
+// Tessellated water (WaterSurface tessellation mode): passes the corners of the coarse,
+// flat patch grid on to water.tcs; water.vs, built as the evaluation stage, displaces them
+
+layout (location = 0) in vec3 aPos;
+
+out vec3 vPosition;
+
+void main() {
+    vPosition = aPos;
+}
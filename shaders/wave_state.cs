@@ -0,0 +1,130 @@
+#version 460 core
+// Wave state of the water surface (WaveState): the displacement, normal and velocity of
+// every grid point of a square over the surface, from the wave parameter block water.vs
+// displaces the grid with. waveDisplacement is water.vs's; keep the two the same. Each
+// thread reads back its own texel's last displacement before writing the new one, so the
+// velocity needs no second texture.
+
+layout(local_size_x = 16, local_size_y = 16) in;
+
+layout(rgba32f, binding = 0) uniform restrict image2D uHeight;         // Height, displacement xz
+layout(rgba16f, binding = 1) uniform restrict writeonly image2D uNormal; // Normal, Jacobian
+layout(rgba16f, binding = 2) uniform restrict writeonly image2D uVelocity;
+
+uniform float uSize;               // World size of the square, centred on the origin
+uniform float uInverseDeltaTime;   // 0 when there is no previous update
+uniform bool uFlowMapEnabled;
+uniform sampler2D uFlowMap;        // World velocity xz over the surface (FlowMap)
+
+// Gerstner waves and ripples, written by WaterSurface::updateWaveBlock
+#define MAX_WAVES 16
+#define MAX_RIPPLES 32
+
+layout(std140, binding = 1) uniform WaveParameters
+{
+    vec4 waves[2 * MAX_WAVES];     // direction.xy, amplitude, wavelength; speed, steepness
+    vec4 ripples[2 * MAX_RIPPLES]; // center.xy, decayed amplitude, radius; direction.xy, distance travelled, directional
+    ivec4 waveCounts;              // Waves, ripples
+    vec4 waveTiming;               // Time, grid step
+    vec4 rippleAges[MAX_RIPPLES / 4]; // Seconds since each ripple started
+};
+
+// Local current the ripples drift with since they started, zero without the flow map
+vec2 rippleFlow = vec2(0.0);
+
+// Same displacement and analytic derivatives as WaterSurface::sampleWaves
+vec3 waveDisplacement(vec2 xz, out vec3 dPdx, out vec3 dPdz) {
+    vec3 result = vec3(xz.x, 0.0, xz.y);
+    dPdx = vec3(1.0, 0.0, 0.0);
+    dPdz = vec3(0.0, 0.0, 1.0);
+
+    for (int i = 0; i < waveCounts.x; i++) {
+        float A = waves[2 * i].z;
+        if (abs(A) < 0.001) {
+            continue;
+        }
+
+        vec2 D = normalize(waves[2 * i].xy);
+        float S = waves[2 * i + 1].y;
+        float k = 2.0 * 3.14159265 / waves[2 * i].w;
+        float w = sqrt(9.8 * k);
+        float phase = k * dot(D, xz) - waves[2 * i + 1].x * w * waveTiming.x;
+        float sinPhase = sin(phase);
+        float cosPhase = cos(phase);
+
+        float horizontalScale = S * 2.0;
+        result.xz += D * A * horizontalScale * cosPhase;
+        result.y += A * sinPhase;
+
+        float horizontalSlope = A * horizontalScale * k * sinPhase;
+        float verticalSlope = A * k * cosPhase;
+        dPdx -= vec3(D.x * D.x * horizontalSlope, -D.x * verticalSlope, D.x * D.y * horizontalSlope);
+        dPdz -= vec3(D.x * D.y * horizontalSlope, -D.y * verticalSlope, D.y * D.y * horizontalSlope);
+    }
+
+    // Ripples (WaterSurface::rippleHeight)
+    for (int i = 0; i < waveCounts.y; i++) {
+        vec4 ripple = ripples[2 * i];
+        vec4 propagation = ripples[2 * i + 1];
+        vec2 d = xz - ripple.xy - rippleFlow * rippleAges[i / 4][i % 4];
+        float frequency = 3.14159265 / ripple.w;
+
+        if (propagation.w > 0.5) {
+            float distanceInDirection = dot(d, propagation.xy);
+            float perpendicular = d.x * propagation.y - d.y * propagation.x;
+            float perpendicularDistance = abs(perpendicular);
+            float waveDistance = distanceInDirection - propagation.z;
+            if (waveDistance >= 0.0 && waveDistance <= ripple.w && perpendicularDistance < ripple.w * 0.5) {
+                float factor = sin(waveDistance * frequency);
+                float perpFactor = exp(-perpendicularDistance * 2.0 / ripple.w);
+                result.y += factor * ripple.z * perpFactor;
+
+                vec2 perpendicularGradient = sign(perpendicular) * vec2(propagation.y, -propagation.x);
+                vec2 gradient = ripple.z * perpFactor * (frequency * cos(waveDistance * frequency) * propagation.xy -
+                                                         factor * 2.0 / ripple.w * perpendicularGradient);
+                dPdx.y += gradient.x;
+                dPdz.y += gradient.y;
+            }
+        } else {
+            float distance = length(d);
+            float waveDistance = distance - propagation.z;
+            if (waveDistance >= 0.0 && waveDistance <= ripple.w) {
+                result.y += sin(waveDistance * frequency) * ripple.z;
+                if (distance > 0.0) {
+                    vec2 gradient = ripple.z * frequency * cos(waveDistance * frequency) * d / distance;
+                    dPdx.y += gradient.x;
+                    dPdz.y += gradient.y;
+                }
+            }
+        }
+    }
+
+    return result;
+}
+
+void main() {
+    ivec2 coord = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 size = imageSize(uHeight);
+    if (any(greaterThanEqual(coord, size))) {
+        return;
+    }
+
+    // Texel centres on the grid points, so a bilinear lookup at xz / uSize + 0.5 lands on them
+    vec2 uv = (vec2(coord) + 0.5) / vec2(size);
+    vec2 xz = (uv - 0.5) * uSize;
+    if (uFlowMapEnabled) {
+        rippleFlow = textureLod(uFlowMap, uv, 0.0).xy;
+    }
+
+    vec3 dPdx, dPdz;
+    vec3 displacement = waveDisplacement(xz, dPdx, dPdz) - vec3(xz.x, 0.0, xz.y);
+    vec3 normal = normalize(cross(dPdz, dPdx));
+    float jacobian = dPdx.x * dPdz.z - dPdx.z * dPdz.x;
+
+    vec4 previous = imageLoad(uHeight, coord);
+    vec3 velocity = (displacement - vec3(previous.g, previous.r, previous.b)) * uInverseDeltaTime;
+
+    imageStore(uHeight, coord, vec4(displacement.y, displacement.x, displacement.z, 0.0));
+    imageStore(uNormal, coord, vec4(normal, jacobian));
+    imageStore(uVelocity, coord, vec4(velocity, 0.0));
+}
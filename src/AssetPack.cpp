@@ -0,0 +1,75 @@
+#include "../include/AssetPack.h"
+#include <cstring>
+#include <iostream>
+
+namespace WaterSim {
+
+AssetPack& AssetPack::instance() {
+    static AssetPack pack;
+    return pack;
+}
+
+bool AssetPack::open(const std::string& path) {
+    using namespace AssetPackFormat;
+    entries_.clear();
+    file_.close();
+    if (!file_.openRead(path)) {
+        return false;
+    }
+    
+    const char* bytes = static_cast<const char*>(file_.data());
+    Header header;
+    bool valid = file_.size() >= sizeof(header);
+    if (valid) {
+        std::memcpy(&header, bytes, sizeof(header));
+        valid = std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0 && header.version == VERSION &&
+                sizeof(header) + uint64_t(header.entryCount) * sizeof(Entry) <= file_.size();
+    }
+    
+    // Every range is checked once here, so the lookups can trust the entries
+    const Entry* entries = reinterpret_cast<const Entry*>(bytes + sizeof(header));
+    for (uint32_t i = 0; valid && i < header.entryCount; i++) {
+        const Entry& entry = entries[i];
+        valid = uint64_t(entry.pathOffset) + entry.pathLength <= file_.size() &&
+                entry.dataOffset + entry.dataSize <= file_.size() &&
+                (entry.kind != TEXTURE_RGBA8 || uint64_t(entry.width) * entry.height * 4 == entry.dataSize);
+        if (valid) {
+            entries_[std::string_view(bytes + entry.pathOffset, entry.pathLength)] = &entry;
+        }
+    }
+    if (!valid) {
+        std::cerr << "WARNING: " << path << " is not an asset pack of version " << VERSION << "; loading loose files" << std::endl;
+        entries_.clear();
+        file_.close();
+        return false;
+    }
+    
+    std::cout << "Asset pack " << path << ": " << entries_.size() << " assets, " << (file_.size() >> 20) << " MB mapped" << std::endl;
+    return true;
+}
+
+const AssetPackFormat::Entry* AssetPack::findEntry(std::string_view path) const {
+    // The callers' paths may start with "./"; the pack stores them without
+    while (path.size() > 2 && path.compare(0, 2, "./") == 0) {
+        path.remove_prefix(2);
+    }
+    auto it = entries_.find(path);
+    return it != entries_.end() ? it->second : nullptr;
+}
+
+std::string_view AssetPack::find(std::string_view path) const {
+    const AssetPackFormat::Entry* entry = findEntry(path);
+    if (!entry || entry->kind != AssetPackFormat::RAW) return std::string_view();
+    return std::string_view(static_cast<const char*>(file_.data()) + entry->dataOffset, entry->dataSize);
+}
+
+bool AssetPack::findTexture(std::string_view path, Texture& texture) const {
+    const AssetPackFormat::Entry* entry = findEntry(path);
+    if (!entry || entry->kind != AssetPackFormat::TEXTURE_RGBA8) return false;
+    texture.pixels = static_cast<const unsigned char*>(file_.data()) + entry->dataOffset;
+    texture.width = static_cast<int>(entry->width);
+    texture.height = static_cast<int>(entry->height);
+    return true;
+}
+
+} // namespace WaterSim
@@ -0,0 +1,330 @@
+#include "Benchmark.h"
+#include "Camera.h"
+#include "ResourceManager.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+namespace WaterSim {
+
+namespace {
+
+constexpr float GOLDEN_ANGLE = 2.39996323f;
+
+std::vector<BenchmarkScenario> createScenarios() {
+    std::vector<BenchmarkScenario> scenarios;
+
+    // Analytic ripples and splashes on the regular water surface
+    BenchmarkScenario ripples;
+    ripples.name = "ripples";
+    ripples.description = "Regular water, a ripple every 15 frames and a splash every 90";
+    ripples.events.push_back({ BenchmarkAction::RIPPLE, 0, 15, -1, glm::vec3(0.0f), glm::vec3(0.0f, -1.0f, 0.0f), 0.3f, 3.0f });
+    ripples.events.push_back({ BenchmarkAction::SPLASH, 45, 90, -1, glm::vec3(0.0f), glm::vec3(0.0f, -1.0f, 0.0f), 1.5f, 2.0f });
+    scenarios.push_back(ripples);
+
+    // The sphere falling into the regular water, through the collision path of the loop
+    BenchmarkScenario sphereDrop;
+    sphereDrop.name = "sphere-drop";
+    sphereDrop.description = "Regular water, the sphere dropped from 4 m every 150 frames";
+    sphereDrop.events.push_back({ BenchmarkAction::SPHERE_DROP, 0, 150, -1, glm::vec3(0.0f, 4.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f), 0.0f, 2.0f });
+    scenarios.push_back(sphereDrop);
+
+    // SPH filling towards its capacity from a stream, with the sphere dropped in halfway
+    BenchmarkScenario sphStream;
+    sphStream.name = "sph-stream";
+    sphStream.description = "SPH compute, 100k capacity, a stream for 600 frames and a sphere drop";
+    sphStream.simulation = SimulationType::SPH_COMPUTE;
+    sphStream.maxParticles = 100000;
+    sphStream.frames = 900;
+    sphStream.orbitCenter = glm::vec3(0.0f, -3.0f, 0.0f);
+    sphStream.orbitDistance = 12.0f;
+    sphStream.orbitHeight = 4.0f;
+    sphStream.events.push_back({ BenchmarkAction::FLUID_STREAM, 0, 1, 599, glm::vec3(0.0f, 3.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.1f), 200.0f, 0.0f });
+    sphStream.events.push_back({ BenchmarkAction::SPHERE_DROP, 450, 0, -1, glm::vec3(0.0f, 3.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f), 0.0f, 0.0f });
+    scenarios.push_back(sphStream);
+
+    // The ripples again with the water ray traced
+    BenchmarkScenario rayTraced = ripples;
+    rayTraced.name = "raytraced";
+    rayTraced.description = "The ripples scenario with ray-traced water";
+    rayTraced.rayTracing = true;
+    scenarios.push_back(rayTraced);
+
+    return scenarios;
+}
+
+// Mean, median and 99th percentile of a column
+struct Summary {
+    double mean = 0.0;
+    double median = 0.0;
+    double p99 = 0.0;
+    size_t count = 0;
+};
+
+Summary summarize(std::vector<double> values) {
+    Summary summary;
+    summary.count = values.size();
+    if (values.empty()) return summary;
+    std::sort(values.begin(), values.end());
+    for (double value : values) summary.mean += value;
+    summary.mean /= static_cast<double>(values.size());
+    summary.median = values[values.size() / 2];
+    summary.p99 = values[std::min(values.size() - 1, static_cast<size_t>(std::ceil(0.99 * values.size())) - 1)];
+    return summary;
+}
+
+std::string escapeJSON(const std::string& text) {
+    std::string escaped;
+    for (char c : text) {
+        if (c == '"' || c == '\\') escaped += '\\';
+        escaped += c;
+    }
+    return escaped;
+}
+
+void writeSummary(std::ofstream& out, const std::string& name, const Summary& summary) {
+    out << "    \"" << escapeJSON(name) << "\": { \"mean\": " << summary.mean << ", \"median\": " << summary.median
+        << ", \"p99\": " << summary.p99 << ", \"samples\": " << summary.count << " }";
+}
+
+} // namespace
+
+const std::vector<BenchmarkScenario>& Benchmark::getScenarios() {
+    static const std::vector<BenchmarkScenario> scenarios = createScenarios();
+    return scenarios;
+}
+
+const BenchmarkScenario* Benchmark::findScenario(const std::string& name) {
+    for (const BenchmarkScenario& scenario : getScenarios()) {
+        if (scenario.name == name) return &scenario;
+    }
+    return nullptr;
+}
+
+Benchmark::Benchmark(const BenchmarkScenario& scenario, int frames)
+    : scenario_(scenario)
+    , frameCount_(frames > 0 ? frames : scenario.frames)
+{
+    records_.reserve(static_cast<size_t>(frameCount_));
+}
+
+void Benchmark::configure(Config& config) const {
+    // Fixed substeps and a stable sort; the simulation thread would decouple its timing
+    // from the frame being measured
+    config.sph.deterministic = true;
+    config.sph.asyncSimulation = false;
+    if (scenario_.maxParticles > 0) {
+        config.sph.maxParticles = scenario_.maxParticles;
+    }
+}
+
+void Benchmark::poseCamera(Camera& camera) const {
+    // The path starts with the recording; the warm-up holds its first pose
+    int frame = std::max(frame_ - scenario_.warmupFrames, 0);
+    float angle = glm::radians(scenario_.orbitDegreesPerFrame * static_cast<float>(frame));
+    glm::vec3 position = scenario_.orbitCenter +
+                         glm::vec3(std::sin(angle) * scenario_.orbitDistance, scenario_.orbitHeight, std::cos(angle) * scenario_.orbitDistance);
+    glm::vec3 direction = glm::normalize(scenario_.orbitCenter - position);
+
+    camera.Mode = FREE_CAMERA;
+    camera.Position = position;
+    camera.Yaw = glm::degrees(std::atan2(direction.z, direction.x));
+    camera.Pitch = glm::degrees(std::asin(direction.y));
+    camera.updateCameraVectors();
+}
+
+std::vector<BenchmarkEvent> Benchmark::getDueEvents() const {
+    std::vector<BenchmarkEvent> due;
+    int frame = frame_ - scenario_.warmupFrames;
+    if (frame < 0) return due;
+
+    for (const BenchmarkEvent& event : scenario_.events) {
+        int sinceFirst = frame - event.firstFrame;
+        if (sinceFirst < 0 || (event.lastFrame >= 0 && frame > event.lastFrame)) continue;
+        if (event.interval > 0 ? sinceFirst % event.interval != 0 : sinceFirst != 0) continue;
+
+        BenchmarkEvent resolved = event;
+        float angle = GOLDEN_ANGLE * static_cast<float>(event.interval > 0 ? sinceFirst / event.interval : 0);
+        resolved.position += event.spread * glm::vec3(std::cos(angle), 0.0f, std::sin(angle));
+        due.push_back(resolved);
+    }
+    return due;
+}
+
+void Benchmark::beginFrame() {
+    frameStart_ = std::chrono::steady_clock::now();
+}
+
+void Benchmark::endFrame(uint64_t graphFrame, uint32_t particles, const MemorySample& memory) {
+    auto now = std::chrono::steady_clock::now();
+    if (isRecording() && !isFinished()) {
+        FrameRecord record;
+        record.frame = frame_ - scenario_.warmupFrames;
+        record.graphFrame = graphFrame;
+        record.cpuMs = std::chrono::duration<double, std::milli>(now - frameStart_).count();
+        record.frameMs = hasPreviousFrame_ ? std::chrono::duration<double, std::milli>(frameStart_ - previousFrameStart_).count() : 0.0;
+        record.particles = particles;
+        record.memory = memory;
+        records_.push_back(record);
+    }
+    previousFrameStart_ = frameStart_;
+    hasPreviousFrame_ = true;
+    frame_++;
+}
+
+int Benchmark::passIndex(const std::string& name) {
+    for (size_t i = 0; i < passNames_.size(); i++) {
+        if (passNames_[i] == name) return static_cast<int>(i);
+    }
+    passNames_.push_back(name);
+    return static_cast<int>(passNames_.size() - 1);
+}
+
+void Benchmark::recordPassTimings(uint64_t graphFrame, const std::vector<FrameGraph::PassTiming>& timings) {
+    // Frames are recorded in graph order, and the timings are of a recent one
+    for (auto it = records_.rbegin(); it != records_.rend(); ++it) {
+        if (it->graphFrame < graphFrame) return;
+        if (it->graphFrame != graphFrame) continue;
+        if (it->gpuResolved) return;
+
+        for (const FrameGraph::PassTiming& timing : timings) {
+            size_t index = static_cast<size_t>(passIndex(timing.name));
+            if (it->passMs.size() <= index) {
+                it->passMs.resize(index + 1, -1.0f);
+            }
+            it->passMs[index] = timing.milliseconds;
+        }
+        it->gpuResolved = true;
+        return;
+    }
+}
+
+Benchmark::MemorySample Benchmark::sampleMemory(const FrameGraph& frameGraph) {
+    MemorySample memory;
+    memory.residentBytes = ResourceManager::instance().getStats().residentBytes;
+    memory.pooledBytes = frameGraph.getStats().pooledBytes;
+    if (GLAD_GL_NVX_gpu_memory_info) {
+        glGetIntegerv(GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX, &memory.availableVideoKB);
+    }
+    return memory;
+}
+
+bool Benchmark::writeResults(const std::string& basePath, const std::string& renderer) const {
+    bool written = writeCSV(basePath + ".csv");
+    written = writeJSON(basePath + ".json", renderer) && written;
+    if (written) {
+        std::cout << "Benchmark '" << scenario_.name << "': " << records_.size() << " frames written to "
+                  << basePath << ".csv and .json" << std::endl;
+    }
+    return written;
+}
+
+bool Benchmark::writeCSV(const std::string& path) const {
+    std::ofstream out(path);
+    if (!out) {
+        std::cerr << "Failed to write benchmark results to " << path << std::endl;
+        return false;
+    }
+
+    out << "frame,time_s,cpu_ms,frame_ms,gpu_total_ms";
+    for (const std::string& name : passNames_) {
+        out << ",\"gpu " << name << " ms\"";
+    }
+    out << ",particles,resident_mb,pooled_mb,available_video_mb\n";
+
+    // GPU cells stay empty for unresolved frames and for passes that did not run
+    out << std::fixed << std::setprecision(4);
+    for (const FrameRecord& record : records_) {
+        double gpuTotal = 0.0;
+        for (float ms : record.passMs) gpuTotal += std::max(ms, 0.0f);
+
+        out << record.frame << ',' << (record.frame * scenario_.frameTime) << ',' << record.cpuMs << ',' << record.frameMs << ',';
+        if (record.gpuResolved) out << gpuTotal;
+        for (size_t i = 0; i < passNames_.size(); i++) {
+            out << ',';
+            if (i < record.passMs.size() && record.passMs[i] >= 0.0f) out << record.passMs[i];
+        }
+        out << ',' << record.particles
+            << ',' << record.memory.residentBytes / (1024.0 * 1024.0)
+            << ',' << record.memory.pooledBytes / (1024.0 * 1024.0)
+            << ',';
+        if (record.memory.availableVideoKB >= 0) out << record.memory.availableVideoKB / 1024.0;
+        out << '\n';
+    }
+    return static_cast<bool>(out);
+}
+
+bool Benchmark::writeJSON(const std::string& path, const std::string& renderer) const {
+    std::ofstream out(path);
+    if (!out) {
+        std::cerr << "Failed to write benchmark results to " << path << std::endl;
+        return false;
+    }
+
+    std::vector<double> cpuMs, frameMs, gpuTotalMs;
+    std::vector<std::vector<double>> passMs(passNames_.size());
+    for (const FrameRecord& record : records_) {
+        cpuMs.push_back(record.cpuMs);
+        if (record.frameMs > 0.0) frameMs.push_back(record.frameMs);
+        if (!record.gpuResolved) continue;
+        double total = 0.0;
+        for (size_t i = 0; i < record.passMs.size(); i++) {
+            if (record.passMs[i] < 0.0f) continue;
+            passMs[i].push_back(record.passMs[i]);
+            total += record.passMs[i];
+        }
+        gpuTotalMs.push_back(total);
+    }
+
+    out << std::fixed << std::setprecision(4);
+    out << "{\n";
+    out << "  \"scenario\": \"" << escapeJSON(scenario_.name) << "\",\n";
+    out << "  \"description\": \"" << escapeJSON(scenario_.description) << "\",\n";
+    out << "  \"renderer\": \"" << escapeJSON(renderer) << "\",\n";
+    out << "  \"frames\": " << records_.size() << ",\n";
+    out << "  \"frameTime\": " << scenario_.frameTime << ",\n";
+
+    out << "  \"summary\": {\n";
+    writeSummary(out, "cpu_ms", summarize(cpuMs));
+    out << ",\n";
+    writeSummary(out, "frame_ms", summarize(frameMs));
+    out << ",\n";
+    writeSummary(out, "gpu_total_ms", summarize(gpuTotalMs));
+    for (size_t i = 0; i < passNames_.size(); i++) {
+        out << ",\n";
+        writeSummary(out, "gpu " + passNames_[i] + " ms", summarize(passMs[i]));
+    }
+    out << "\n  },\n";
+
+    out << "  \"passes\": [";
+    for (size_t i = 0; i < passNames_.size(); i++) {
+        out << (i ? ", " : "") << '"' << escapeJSON(passNames_[i]) << '"';
+    }
+    out << "],\n";
+
+    // Per frame, with the GPU times in the order of "passes" (null: not run or unresolved)
+    out << "  \"perFrame\": [\n";
+    for (size_t r = 0; r < records_.size(); r++) {
+        const FrameRecord& record = records_[r];
+        out << "    { \"frame\": " << record.frame << ", \"cpu_ms\": " << record.cpuMs << ", \"frame_ms\": " << record.frameMs
+            << ", \"gpu_ms\": [";
+        for (size_t i = 0; i < passNames_.size(); i++) {
+            out << (i ? ", " : "");
+            if (record.gpuResolved && i < record.passMs.size() && record.passMs[i] >= 0.0f) {
+                out << record.passMs[i];
+            } else {
+                out << "null";
+            }
+        }
+        out << "], \"particles\": " << record.particles << ", \"resident_bytes\": " << record.memory.residentBytes
+            << ", \"pooled_bytes\": " << record.memory.pooledBytes << ", \"available_video_kb\": " << record.memory.availableVideoKB
+            << " }" << (r + 1 < records_.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n";
+    out << "}\n";
+    return static_cast<bool>(out);
+}
+
+} // namespace WaterSim
@@ -0,0 +1,58 @@
+#include "../include/BindlessTextures.h"
+#include <iostream>
+
+namespace WaterSim {
+
+BindlessTextures::~BindlessTextures() {
+    release();
+}
+
+bool BindlessTextures::initialize() {
+    supported_ = false;
+    if (!GLAD_GL_ARB_bindless_texture) {
+        std::cout << "Bindless textures unavailable: no GL_ARB_bindless_texture" << std::endl;
+        return false;
+    }
+    glCreateBuffers(1, &buffer_);
+    glNamedBufferStorage(buffer_, sizeof(handles_), handles_, GL_DYNAMIC_STORAGE_BIT);
+    glBindBufferBase(GL_UNIFORM_BUFFER, UNIFORM_BINDING, buffer_);
+    supported_ = true;
+    return true;
+}
+
+void BindlessTextures::setTexture(Slot slot, GLuint texture) {
+    if (!supported_ || textures_[slot] == texture) return;
+
+    // A texture deleted by its owner (the skybox placeholder) took its handle with it
+    GLuint64 previous = handles_[slot];
+    if (previous && glIsTexture(textures_[slot]) && glIsTextureHandleResidentARB(previous)) {
+        bool shared = false;
+        for (int other = 0; other < SLOT_COUNT; other++) {
+            shared |= other != slot && handles_[other] == previous;
+        }
+        if (!shared) glMakeTextureHandleNonResidentARB(previous);
+    }
+
+    // The same texture always yields the same handle; residency is per handle, not per slot
+    GLuint64 handle = 0;
+    if (texture) {
+        handle = glGetTextureHandleARB(texture);
+        if (!glIsTextureHandleResidentARB(handle)) glMakeTextureHandleResidentARB(handle);
+    }
+    textures_[slot] = texture;
+    handles_[slot] = handle;
+    glNamedBufferSubData(buffer_, slot * sizeof(GLuint64), sizeof(GLuint64), &handle);
+}
+
+void BindlessTextures::release() {
+    for (int slot = 0; slot < SLOT_COUNT; slot++) {
+        setTexture(static_cast<Slot>(slot), 0);
+    }
+    if (buffer_) {
+        glDeleteBuffers(1, &buffer_);
+        buffer_ = 0;
+    }
+    supported_ = false;
+}
+
+} // namespace WaterSim
@@ -25,6 +25,17 @@ glm::mat4 Camera::GetViewMatrix() const {
     return glm::lookAt(Position, Position + Front, Up);
 }
 
+glm::mat4 Camera::GetProjectionMatrix(float aspect, float nearPlane, float farPlane, bool jittered) const {
+    glm::mat4 projection = glm::perspective(glm::radians(Zoom), aspect, nearPlane, farPlane);
+    if (!jittered) return projection;
+    // Offsetting clip x and y by the jitter times w moves every projected point by it
+    return glm::translate(glm::mat4(1.0f), glm::vec3(ProjectionJitter, 0.0f)) * projection;
+}
+
+void Camera::SetJitter(const glm::vec2& pixels, const glm::vec2& targetSize) {
+    ProjectionJitter = 2.0f * pixels / glm::max(targetSize, glm::vec2(1.0f));
+}
+
 void Camera::ProcessKeyboard(CameraMovement direction, float deltaTime) {
     if (Mode == ORBIT_CAMERA) {
         // In orbit mode, keyboard moves the orbit center
@@ -0,0 +1,91 @@
+#include "../include/ClusteredLights.h"
+#include "../include/Profiler.h"
+#include "../include/ShaderCompiler.h"
+#include <algorithm>
+#include <cmath>
+
+namespace WaterSim {
+
+namespace {
+
+constexpr GLuint CULL_GROUP_SIZE = 64;  // light_cluster.cs
+
+} // namespace
+
+ClusteredLights::~ClusteredLights() {
+    ShaderCompiler::instance().cancel(this);
+    for (GLuint* buffer : {&parameterBuffer_, &lightBuffer_, &clusterCountBuffer_, &clusterIndexBuffer_}) {
+        if (*buffer) deleteBuffers(1, buffer);
+        *buffer = 0;
+    }
+}
+
+bool ClusteredLights::initialize() {
+    GPUMemoryScope memoryScope("Clustered lights");
+    Parameters parameters = {};
+    glCreateBuffers(1, &parameterBuffer_);
+    bufferStorage(parameterBuffer_, sizeof(Parameters), &parameters, GL_DYNAMIC_STORAGE_BIT);
+    glCreateBuffers(1, &lightBuffer_);
+    bufferStorage(lightBuffer_, MAX_LIGHTS * sizeof(GPULight), nullptr, GL_DYNAMIC_STORAGE_BIT);
+    glCreateBuffers(1, &clusterCountBuffer_);
+    bufferStorage(clusterCountBuffer_, CLUSTER_COUNT * sizeof(GLuint), nullptr, 0);
+    glCreateBuffers(1, &clusterIndexBuffer_);
+    bufferStorage(clusterIndexBuffer_, size_t(CLUSTER_COUNT) * MAX_LIGHTS_PER_CLUSTER * sizeof(GLuint), nullptr, 0);
+    bind();
+
+    ShaderCompiler::instance().submitCompute(this, "light clusters", "shaders/light_cluster.cs", "",
+                                             [this](GLuint program) { cullProgram_.setId(program); });
+    return parameterBuffer_ != 0;
+}
+
+void ClusteredLights::bind() const {
+    glBindBufferBase(GL_UNIFORM_BUFFER, PARAMETER_BINDING, parameterBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, LIGHT_BINDING, lightBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CLUSTER_COUNT_BINDING, clusterCountBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CLUSTER_INDEX_BINDING, clusterIndexBuffer_);
+}
+
+void ClusteredLights::setLights(const std::vector<Light>& lights) {
+    std::vector<GPULight> packed;
+    packed.reserve(std::min<size_t>(lights.size(), MAX_LIGHTS));
+    for (const Light& light : lights) {
+        if (packed.size() == MAX_LIGHTS) break;
+        float outer = std::clamp(light.outerAngle, 0.0f, 180.0f);
+        float inner = std::clamp(light.innerAngle, 0.0f, outer);
+        // A point light's cone takes in every direction: cos 180 is -1, its edge below that
+        float cosOuter = outer >= 180.0f ? -2.0f : std::cos(glm::radians(outer));
+        float cosInner = std::max(std::cos(glm::radians(inner)), cosOuter + 1e-4f);
+        glm::vec3 direction = glm::length(light.direction) > 0.0f ? glm::normalize(light.direction) : glm::vec3(0.0f, -1.0f, 0.0f);
+        packed.push_back({ glm::vec4(light.position, std::max(light.range, 1e-3f)),
+                           glm::vec4(light.color * light.intensity, cosInner),
+                           glm::vec4(direction, cosOuter) });
+    }
+    lightCount_ = static_cast<int>(packed.size());
+    if (!packed.empty()) {
+        glNamedBufferSubData(lightBuffer_, 0, packed.size() * sizeof(GPULight), packed.data());
+    }
+}
+
+void ClusteredLights::update(const glm::mat4& view, const glm::mat4& projection, float nearPlane, float farPlane) {
+    // Until the culling program is built, no light reaches the shaders
+    int lightCount = cullProgram_.isValid() ? lightCount_ : 0;
+
+    Parameters parameters;
+    parameters.view = view;
+    parameters.projection = projection;
+    parameters.inverseViewProjection = glm::inverse(projection * view);
+    parameters.cameraPosition = glm::inverse(view)[3];
+    parameters.depth = glm::vec4(nearPlane, farPlane, float(GRID_Z) / std::log(farPlane / nearPlane), 0.0f);
+    parameters.grid = glm::uvec4(GRID_X, GRID_Y, GRID_Z, static_cast<GLuint>(lightCount));
+    glNamedBufferSubData(parameterBuffer_, 0, sizeof(Parameters), &parameters);
+    bind();
+    if (lightCount == 0) return;
+
+    ProfileScope scope("Light clusters");
+    cullProgram_.use();
+    cullProgram_.setMat4("uInverseProjection", glm::inverse(projection));
+    glDispatchCompute((CLUSTER_COUNT + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+} // namespace WaterSim
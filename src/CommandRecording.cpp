@@ -0,0 +1,264 @@
+#include "CommandRecording.h"
+#include "MappedFile.h"
+#include <cstring>
+#include <iostream>
+
+namespace WaterSim {
+
+namespace {
+    constexpr uint32_t RECORDING_VERSION = 1;
+    constexpr uint8_t HAS_DELTA_TIME = 1;
+
+    // The fields each command type reads, so a record carries no unused floats
+    enum Fields : uint8_t {
+        POSITION = 1,       // position xyz
+        VECTOR = 2,         // vector xyz
+        PLANAR = 4,         // vector xz
+        MAGNITUDE = 8
+    };
+
+    uint8_t commandFields(SimulationCommand::Type type) {
+        using Type = SimulationCommand::Type;
+        switch (type) {
+            case Type::RIPPLE: return POSITION | MAGNITUDE;
+            case Type::DIRECTIONAL_RIPPLE: return POSITION | PLANAR | MAGNITUDE;
+            case Type::SPLASH: return POSITION | MAGNITUDE;
+            case Type::FLOW_IMPULSE: return POSITION | PLANAR | MAGNITUDE;
+            case Type::IMPULSE: return POSITION | VECTOR | MAGNITUDE;
+            case Type::FLUID_STREAM: return POSITION | VECTOR | MAGNITUDE;
+            case Type::FLUID_VOLUME: return POSITION | VECTOR;
+            case Type::GRAVITY: return VECTOR;
+            case Type::PARAMETER: return MAGNITUDE;
+        }
+        return 0;
+    }
+
+    void writeVarint(std::vector<uint8_t>& out, uint32_t value) {
+        while (value >= 0x80u) {
+            out.push_back(static_cast<uint8_t>(value | 0x80u));
+            value >>= 7;
+        }
+        out.push_back(static_cast<uint8_t>(value));
+    }
+
+    void writeFloat(std::vector<uint8_t>& out, float value) {
+        uint8_t bytes[sizeof(float)];
+        std::memcpy(bytes, &value, sizeof(float));
+        out.insert(out.end(), bytes, bytes + sizeof(float));
+    }
+
+    // Bounds-checked cursor over the mapped recording
+    struct Reader {
+        const uint8_t* data;
+        size_t size;
+        size_t offset;
+
+        bool readByte(uint8_t& value) {
+            if (offset >= size) return false;
+            value = data[offset++];
+            return true;
+        }
+
+        bool readVarint(uint32_t& value) {
+            value = 0;
+            for (int shift = 0; shift < 35; shift += 7) {
+                uint8_t byte;
+                if (!readByte(byte)) return false;
+                value |= uint32_t(byte & 0x7Fu) << shift;
+                if (!(byte & 0x80u)) return true;
+            }
+            return false;
+        }
+
+        bool readFloat(float& value) {
+            if (size - offset < sizeof(float)) return false;
+            std::memcpy(&value, data + offset, sizeof(float));
+            offset += sizeof(float);
+            return true;
+        }
+    };
+}
+
+CommandRecorder::~CommandRecorder() {
+    close();
+}
+
+bool CommandRecorder::open(const std::string& path, uint32_t simulationType, bool deterministic) {
+    close();
+
+    file_ = std::fopen(path.c_str(), "wb");
+    if (!file_) {
+        std::cerr << "ERROR: Failed to open command recording " << path << std::endl;
+        return false;
+    }
+    path_ = path;
+
+    header_ = {};
+    std::memcpy(header_.magic, "WSCMDREC", sizeof(header_.magic));
+    header_.version = RECORDING_VERSION;
+    header_.simulationType = simulationType;
+    header_.deterministic = deterministic ? 1u : 0u;
+    std::fwrite(&header_, sizeof(header_), 1, file_);
+
+    pending_.clear();
+    lastRecordTick_ = 0;
+    lastDeltaTime_ = 0.0f;
+    hasRecord_ = false;
+    commandCount_ = 0;
+    bytesWritten_ = sizeof(header_);
+    std::cout << "Recording simulation commands to " << path << std::endl;
+    return true;
+}
+
+void CommandRecorder::close() {
+    if (!file_) return;
+
+    // The tick count is known only now
+    std::fseek(file_, 0, SEEK_SET);
+    std::fwrite(&header_, sizeof(header_), 1, file_);
+    std::fclose(file_);
+    file_ = nullptr;
+    pending_.clear();
+    std::cout << "Command recording closed: " << path_ << " (" << header_.tickCount << " ticks, " << commandCount_
+              << " commands, " << bytesWritten_ << " bytes)" << std::endl;
+}
+
+void CommandRecorder::endTick(float deltaTime) {
+    if (!file_) return;
+
+    uint32_t tick = header_.tickCount++;
+    bool newDeltaTime = !hasRecord_ || deltaTime != lastDeltaTime_;
+    if (pending_.empty() && !newDeltaTime) return;
+
+    record_.clear();
+    writeVarint(record_, tick - lastRecordTick_);
+    record_.push_back(newDeltaTime ? HAS_DELTA_TIME : 0);
+    if (newDeltaTime) {
+        writeFloat(record_, deltaTime);
+    }
+    writeVarint(record_, static_cast<uint32_t>(pending_.size()));
+    for (const SimulationCommand& command : pending_) {
+        uint8_t fields = commandFields(command.type);
+        record_.push_back(static_cast<uint8_t>(command.type));
+        if (command.type == SimulationCommand::Type::PARAMETER) {
+            record_.push_back(static_cast<uint8_t>(command.parameter));
+        }
+        if (fields & POSITION) {
+            for (int i = 0; i < 3; i++) writeFloat(record_, command.position[i]);
+        }
+        if (fields & VECTOR) {
+            for (int i = 0; i < 3; i++) writeFloat(record_, command.vector[i]);
+        }
+        if (fields & PLANAR) {
+            writeFloat(record_, command.vector.x);
+            writeFloat(record_, command.vector.z);
+        }
+        if (fields & MAGNITUDE) {
+            writeFloat(record_, command.magnitude);
+        }
+    }
+    std::fwrite(record_.data(), 1, record_.size(), file_);
+
+    bytesWritten_ += record_.size();
+    commandCount_ += static_cast<uint32_t>(pending_.size());
+    lastRecordTick_ = tick;
+    lastDeltaTime_ = deltaTime;
+    hasRecord_ = true;
+    pending_.clear();
+}
+
+bool CommandReplay::open(const std::string& path) {
+    open_ = false;
+    ticks_.clear();
+    commands_.clear();
+    currentTick_ = 0;
+    nextRecord_ = 0;
+    deltaTime_ = 0.0f;
+
+    MappedFile file;
+    CommandRecordingHeader header;
+    if (!file.openRead(path) || file.size() < sizeof(header)) {
+        std::cerr << "ERROR: Failed to read command recording " << path << std::endl;
+        return false;
+    }
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (std::memcmp(header.magic, "WSCMDREC", sizeof(header.magic)) != 0 || header.version != RECORDING_VERSION) {
+        std::cerr << "ERROR: " << path << " is not a command recording of this version" << std::endl;
+        return false;
+    }
+
+    Reader reader = { static_cast<const uint8_t*>(file.data()), file.size(), sizeof(header) };
+    uint32_t tick = 0;
+    float deltaTime = 0.0f;
+    while (reader.offset < reader.size) {
+        uint32_t tickDelta, commandCount;
+        uint8_t flags;
+        bool valid = reader.readVarint(tickDelta) && reader.readByte(flags);
+        if (valid && (flags & HAS_DELTA_TIME)) {
+            valid = reader.readFloat(deltaTime);
+        }
+        valid = valid && reader.readVarint(commandCount);
+
+        Tick record;
+        record.index = tick += tickDelta;
+        record.deltaTime = deltaTime;
+        record.firstCommand = static_cast<uint32_t>(commands_.size());
+        record.commandCount = commandCount;
+        for (uint32_t i = 0; valid && i < commandCount; i++) {
+            SimulationCommand command;
+            uint8_t type, parameter = 0;
+            valid = reader.readByte(type) && type <= static_cast<uint8_t>(SimulationCommand::Type::PARAMETER);
+            if (!valid) break;
+            command.type = static_cast<SimulationCommand::Type>(type);
+            if (command.type == SimulationCommand::Type::PARAMETER) {
+                valid = reader.readByte(parameter) && parameter <= static_cast<uint8_t>(SimulationCommand::Parameter::SPHERE_FRICTION);
+                command.parameter = static_cast<SimulationCommand::Parameter>(parameter);
+            }
+
+            uint8_t fields = commandFields(command.type);
+            if (fields & POSITION) {
+                for (int j = 0; j < 3; j++) valid = valid && reader.readFloat(command.position[j]);
+            }
+            if (fields & VECTOR) {
+                for (int j = 0; j < 3; j++) valid = valid && reader.readFloat(command.vector[j]);
+            }
+            if (fields & PLANAR) {
+                valid = valid && reader.readFloat(command.vector.x) && reader.readFloat(command.vector.z);
+            }
+            if (fields & MAGNITUDE) {
+                valid = valid && reader.readFloat(command.magnitude);
+            }
+            commands_.push_back(command);
+        }
+        if (!valid || (!ticks_.empty() && record.index <= ticks_.back().index) || record.index >= header.tickCount) {
+            std::cerr << "ERROR: Command recording " << path << " is truncated or corrupt at byte " << reader.offset << std::endl;
+            ticks_.clear();
+            commands_.clear();
+            return false;
+        }
+        ticks_.push_back(record);
+    }
+
+    open_ = true;
+    simulationType_ = header.simulationType;
+    deterministic_ = header.deterministic != 0;
+    tickCount_ = header.tickCount;
+    std::cout << "Replaying " << path << ": " << tickCount_ << " ticks, " << commands_.size() << " commands" << std::endl;
+    return true;
+}
+
+float CommandReplay::nextTick(SimulationCommandQueue& queue) {
+    if (isFinished()) return 0.0f;
+
+    if (nextRecord_ < ticks_.size() && ticks_[nextRecord_].index == currentTick_) {
+        const Tick& record = ticks_[nextRecord_++];
+        deltaTime_ = record.deltaTime;
+        for (uint32_t i = 0; i < record.commandCount; i++) {
+            queue.push(commands_[record.firstCommand + i]);
+        }
+    }
+    currentTick_++;
+    return deltaTime_;
+}
+
+} // namespace WaterSim
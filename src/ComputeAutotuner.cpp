@@ -0,0 +1,98 @@
+#include "ComputeAutotuner.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+namespace WaterSim {
+
+namespace {
+    std::string glString(GLenum name) {
+        const GLubyte* value = glGetString(name);
+        std::string result = value ? reinterpret_cast<const char*>(value) : "unknown";
+        // Tabs and newlines delimit the cache fields
+        std::replace(result.begin(), result.end(), '\t', ' ');
+        std::replace(result.begin(), result.end(), '\n', ' ');
+        return result;
+    }
+}
+
+ComputeAutotuner::ComputeAutotuner(const std::string& cachePath)
+    : cachePath_(cachePath) {
+    deviceKey_ = glString(GL_VENDOR) + " | " + glString(GL_RENDERER) + " | " + glString(GL_VERSION);
+
+    std::map<std::string, std::map<std::string, uint32_t>> devices;
+    readCache(devices);
+    entries_ = devices[deviceKey_];
+    if (!entries_.empty()) {
+        std::cout << "Compute autotune cache: " << entries_.size() << " entries for " << deviceKey_ << std::endl;
+    }
+}
+
+void ComputeAutotuner::readCache(std::map<std::string, std::map<std::string, uint32_t>>& devices) const {
+    std::ifstream file(cachePath_);
+    if (!file) return; // No cache yet
+
+    std::string line;
+    while (std::getline(file, line)) {
+        size_t first = line.find('\t');
+        size_t second = first == std::string::npos ? std::string::npos : line.find('\t', first + 1);
+        if (second == std::string::npos) continue;
+
+        std::istringstream value(line.substr(second + 1));
+        uint32_t parsed = 0;
+        if (!(value >> parsed)) continue;
+        devices[line.substr(0, first)][line.substr(first + 1, second - first - 1)] = parsed;
+    }
+}
+
+bool ComputeAutotuner::lookup(const std::string& kernel, uint32_t& value) const {
+    auto entry = entries_.find(kernel);
+    if (entry == entries_.end()) return false;
+    value = entry->second;
+    return true;
+}
+
+void ComputeAutotuner::store(const std::string& kernel, uint32_t value) {
+    entries_[kernel] = value;
+
+    // Re-read so entries written by other devices (or runs) since construction survive
+    std::map<std::string, std::map<std::string, uint32_t>> devices;
+    readCache(devices);
+    devices[deviceKey_][kernel] = value;
+
+    std::ofstream file(cachePath_, std::ios::trunc);
+    if (!file) {
+        std::cerr << "WARNING: Failed to write compute autotune cache " << cachePath_ << std::endl;
+        return;
+    }
+    for (const auto& device : devices) {
+        for (const auto& entry : device.second) {
+            file << device.first << '\t' << entry.first << '\t' << entry.second << '\n';
+        }
+    }
+}
+
+float ComputeAutotuner::timeDispatch(const std::function<void()>& dispatch, int repetitions) {
+    repetitions = std::max(repetitions, 1);
+
+    // Warm-up: first use of a program can include driver-side compilation
+    dispatch();
+
+    GLuint queries[2] = {};
+    glGenQueries(2, queries);
+    glQueryCounter(queries[0], GL_TIMESTAMP);
+    for (int i = 0; i < repetitions; i++) {
+        dispatch();
+    }
+    glQueryCounter(queries[1], GL_TIMESTAMP);
+
+    GLuint64 start = 0, end = 0;
+    glGetQueryObjectui64v(queries[0], GL_QUERY_RESULT, &start);
+    glGetQueryObjectui64v(queries[1], GL_QUERY_RESULT, &end);
+    glDeleteQueries(2, queries);
+
+    return static_cast<float>(end - start) / 1.0e6f / static_cast<float>(repetitions);
+}
+
+} // namespace WaterSim
@@ -0,0 +1,562 @@
+#include "ConfigFile.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace WaterSim {
+
+namespace {
+    struct Field {
+        enum class Type { BOOL, INT, UINT, FLOAT, VEC2, VEC3, STRING };
+
+        const char* key;
+        Type type;
+        ConfigApply apply;
+        void* (*locate)(Config&);
+    };
+
+#define CONFIG_FIELD(path, type, apply) \
+    { #path, Field::Type::type, ConfigApply::apply, [](Config& c) -> void* { return &c.path; } }
+
+    // The fields something reads, with what a change to each takes
+    const Field FIELDS[] = {
+        CONFIG_FIELD(display.width, UINT, RESTART),
+        CONFIG_FIELD(display.height, UINT, RESTART),
+        CONFIG_FIELD(display.vsync, BOOL, LIVE),
+        CONFIG_FIELD(display.depthPrepass, BOOL, LIVE),
+        CONFIG_FIELD(display.bindlessTextures, BOOL, RESTART),
+        CONFIG_FIELD(display.variableRateShading, BOOL, LIVE),
+        CONFIG_FIELD(display.shadingRateContrast, FLOAT, LIVE),
+        CONFIG_FIELD(display.temporalUpscale, BOOL, LIVE),
+        CONFIG_FIELD(display.renderScale, FLOAT, LIVE),
+        CONFIG_FIELD(display.temporalFeedback, FLOAT, LIVE),
+        CONFIG_FIELD(display.title, STRING, RESTART),
+
+        CONFIG_FIELD(physics.floorLevel, FLOAT, SIMULATION),
+        CONFIG_FIELD(physics.tickRate, FLOAT, LIVE),
+        CONFIG_FIELD(physics.maxTicksPerFrame, INT, LIVE),
+
+        CONFIG_FIELD(water.surfaceResolution, INT, SIMULATION),
+        CONFIG_FIELD(water.surfaceSize, FLOAT, SIMULATION),
+        CONFIG_FIELD(water.gpuWaves, BOOL, SIMULATION),
+        CONFIG_FIELD(water.oceanWaves, BOOL, SIMULATION),
+        CONFIG_FIELD(water.oceanResolution, INT, SIMULATION),
+        CONFIG_FIELD(water.oceanPatchSize, FLOAT, SIMULATION),
+        CONFIG_FIELD(water.oceanJonswap, BOOL, SIMULATION),
+        CONFIG_FIELD(water.oceanWindSpeed, FLOAT, SIMULATION),
+        CONFIG_FIELD(water.oceanRmsHeight, FLOAT, SIMULATION),
+        CONFIG_FIELD(water.oceanChoppiness, FLOAT, SIMULATION),
+        CONFIG_FIELD(water.heightfieldWaves, BOOL, SIMULATION),
+        CONFIG_FIELD(water.heightfieldResolution, INT, SIMULATION),
+        CONFIG_FIELD(water.flowMap, BOOL, SIMULATION),
+        CONFIG_FIELD(water.flowMapResolution, INT, SIMULATION),
+        CONFIG_FIELD(water.hybridSplashes, BOOL, SIMULATION),
+        CONFIG_FIELD(water.hybridSplashParticles, INT, SIMULATION),
+        CONFIG_FIELD(water.hybridMaxParticles, INT, SIMULATION),
+        CONFIG_FIELD(water.hybridBandDepth, FLOAT, SIMULATION),
+        CONFIG_FIELD(water.lodMesh, BOOL, SIMULATION),
+        CONFIG_FIELD(water.compactMesh, BOOL, SIMULATION),
+        CONFIG_FIELD(water.asyncCpuWaves, BOOL, SIMULATION),
+        CONFIG_FIELD(water.tessellation, BOOL, SIMULATION),
+        CONFIG_FIELD(water.tessEdgePixels, FLOAT, SIMULATION),
+
+        CONFIG_FIELD(textures.causticSize, INT, TARGETS),
+
+        CONFIG_FIELD(sph.maxParticles, INT, SIMULATION),
+        CONFIG_FIELD(sph.timeStep, FLOAT, SIMULATION),
+        CONFIG_FIELD(sph.useGPUAcceleration, BOOL, SIMULATION),
+        CONFIG_FIELD(sph.asyncSimulation, BOOL, SIMULATION),
+        CONFIG_FIELD(sph.workGroupSize, INT, SIMULATION),
+        CONFIG_FIELD(sph.neighborLimit, INT, SIMULATION),
+        CONFIG_FIELD(sph.useNeighborLists, BOOL, SIMULATION),
+        CONFIG_FIELD(sph.useSoALayout, BOOL, SIMULATION),
+        CONFIG_FIELD(sph.halfPrecisionVelocity, BOOL, SIMULATION),
+        CONFIG_FIELD(sph.useSparseDomain, BOOL, SIMULATION),
+        CONFIG_FIELD(sph.useHierarchicalGrid, BOOL, SIMULATION),
+        CONFIG_FIELD(sph.adaptiveResolution, BOOL, SIMULATION),
+        CONFIG_FIELD(sph.adaptiveMergeDensityRatio, FLOAT, SIMULATION),
+        CONFIG_FIELD(sph.adaptiveDetailDistance, FLOAT, SIMULATION),
+        CONFIG_FIELD(sph.narrowBand, BOOL, SIMULATION),
+        CONFIG_FIELD(sph.narrowBandDepth, FLOAT, SIMULATION),
+        CONFIG_FIELD(sph.multirate, BOOL, SIMULATION),
+        CONFIG_FIELD(sph.indexSort, BOOL, SIMULATION),
+        CONFIG_FIELD(sph.mortonCells, BOOL, SIMULATION),
+        CONFIG_FIELD(sph.useTiledNeighborLoop, BOOL, SIMULATION),
+        CONFIG_FIELD(sph.particleSleeping, BOOL, SIMULATION),
+        CONFIG_FIELD(sph.useKernelTable, BOOL, SIMULATION),
+        CONFIG_FIELD(sph.useSubgroups, BOOL, SIMULATION),
+        CONFIG_FIELD(sph.deterministic, BOOL, SIMULATION),
+        CONFIG_FIELD(sph.boundaryDamping, FLOAT, LIVE),
+        CONFIG_FIELD(sph.surfaceTension, FLOAT, SIMULATION),
+        CONFIG_FIELD(sph.multiphase, BOOL, SIMULATION),
+        CONFIG_FIELD(sph.secondPhaseRestDensity, FLOAT, SIMULATION),
+        CONFIG_FIELD(sph.secondPhaseViscosity, FLOAT, SIMULATION),
+        CONFIG_FIELD(sph.interfaceTension, FLOAT, SIMULATION),
+        CONFIG_FIELD(sph.velocityLimit, FLOAT, SIMULATION),
+        CONFIG_FIELD(sph.pressureLimit, FLOAT, SIMULATION),
+        CONFIG_FIELD(sph.useTaitEquation, BOOL, SIMULATION),
+        CONFIG_FIELD(sph.gamma, FLOAT, SIMULATION),
+        CONFIG_FIELD(sph.adaptiveTimeStep, BOOL, SIMULATION),
+        CONFIG_FIELD(sph.maxSubstepsPerFrame, INT, SIMULATION),
+        CONFIG_FIELD(sph.carrySubstepOverflow, BOOL, SIMULATION),
+        CONFIG_FIELD(sph.usePCISPH, BOOL, SIMULATION),
+        CONFIG_FIELD(sph.pcisphMinIterations, INT, SIMULATION),
+        CONFIG_FIELD(sph.pcisphMaxIterations, INT, SIMULATION),
+        CONFIG_FIELD(sph.pcisphDensityErrorThreshold, FLOAT, SIMULATION),
+        CONFIG_FIELD(sph.implicitViscosity, BOOL, SIMULATION),
+        CONFIG_FIELD(sph.viscosityMaxIterations, INT, SIMULATION),
+        CONFIG_FIELD(sph.viscosityTolerance, FLOAT, SIMULATION),
+        CONFIG_FIELD(sph.streamSpeed, FLOAT, SIMULATION),
+        CONFIG_FIELD(sph.streamRadius, FLOAT, SIMULATION),
+        CONFIG_FIELD(sph.streamRate, FLOAT, SIMULATION),
+        CONFIG_FIELD(sph.fluidRenderScale, FLOAT, SIMULATION),
+        CONFIG_FIELD(sph.diffuseParticles, BOOL, SIMULATION),
+        CONFIG_FIELD(sph.obstacleField, BOOL, SIMULATION),
+        CONFIG_FIELD(sph.sphereCoupling, BOOL, SIMULATION),
+        CONFIG_FIELD(sph.sphereFriction, FLOAT, LIVE),
+        CONFIG_FIELD(sph.batchStiffnessSteps, INT, SIMULATION),
+        CONFIG_FIELD(sph.batchViscositySteps, INT, SIMULATION),
+        CONFIG_FIELD(sph.batchStiffnessScale, VEC2, SIMULATION),
+        CONFIG_FIELD(sph.batchViscosityScale, VEC2, SIMULATION),
+
+        CONFIG_FIELD(compute.autotune, BOOL, SIMULATION),
+        CONFIG_FIELD(compute.autotuneCachePath, STRING, SIMULATION),
+        CONFIG_FIELD(compute.autotuneRepetitions, INT, SIMULATION),
+        CONFIG_FIELD(subsystems.lazy, BOOL, RESTART),
+        CONFIG_FIELD(subsystems.releaseFrames, INT, RESTART),
+        CONFIG_FIELD(uploads.thread, BOOL, RESTART),
+        CONFIG_FIELD(uploads.stagingMB, INT, RESTART),
+        CONFIG_FIELD(assets.pack, STRING, RESTART),
+        CONFIG_FIELD(assets.looseOverride, BOOL, RESTART),
+        CONFIG_FIELD(ui.cache, BOOL, LIVE),
+        CONFIG_FIELD(ui.refreshHz, FLOAT, LIVE),
+
+        CONFIG_FIELD(pacing.maxFramesInFlight, INT, LIVE),
+        CONFIG_FIELD(pacing.frameRateCap, FLOAT, LIVE),
+        CONFIG_FIELD(pacing.lateInputSampling, BOOL, LIVE),
+
+        CONFIG_FIELD(budget.enabled, BOOL, LIVE),
+        CONFIG_FIELD(budget.targetMs, FLOAT, LIVE),
+        CONFIG_FIELD(caustics.raster, BOOL, LIVE),
+        CONFIG_FIELD(caustics.resolution, INT, LIVE),
+        CONFIG_FIELD(caustics.interval, INT, LIVE),
+
+        CONFIG_FIELD(shadows.enabled, BOOL, LIVE),
+        CONFIG_FIELD(shadows.resolution, INT, LIVE),
+        CONFIG_FIELD(shadows.maxDistance, FLOAT, LIVE),
+        CONFIG_FIELD(shadows.cacheStatic, BOOL, LIVE),
+        CONFIG_FIELD(volumetrics.enabled, BOOL, LIVE),
+        CONFIG_FIELD(volumetrics.maxDistance, FLOAT, LIVE),
+        CONFIG_FIELD(volumetrics.scattering, FLOAT, LIVE),
+        CONFIG_FIELD(volumetrics.absorption, FLOAT, LIVE),
+        CONFIG_FIELD(volumetrics.anisotropy, FLOAT, LIVE),
+        CONFIG_FIELD(volumetrics.intensity, FLOAT, LIVE),
+        CONFIG_FIELD(volumetrics.temporalBlend, FLOAT, LIVE),
+        CONFIG_FIELD(lighting.poolLights, INT, LIVE),
+        CONFIG_FIELD(lighting.poolLightIntensity, FLOAT, LIVE),
+        CONFIG_FIELD(lighting.poolLightRange, FLOAT, LIVE),
+        CONFIG_FIELD(lighting.poolLightColor, VEC3, LIVE),
+
+        CONFIG_FIELD(stereo.enabled, BOOL, LIVE),
+        CONFIG_FIELD(stereo.eyeSeparation, FLOAT, LIVE),
+        CONFIG_FIELD(stereo.convergence, FLOAT, LIVE),
+
+        CONFIG_FIELD(rewind.enabled, BOOL, LIVE),
+        CONFIG_FIELD(rewind.keyframeInterval, INT, LIVE),
+        CONFIG_FIELD(rewind.budgetMB, INT, LIVE),
+        CONFIG_FIELD(standby.enabled, BOOL, LIVE),
+        CONFIG_FIELD(standby.budgetMB, INT, LIVE),
+        CONFIG_FIELD(standby.minFreeMB, INT, LIVE),
+
+        CONFIG_FIELD(capture.hardwareEncode, BOOL, LIVE),
+        CONFIG_FIELD(capture.frameRate, INT, LIVE),
+
+        CONFIG_FIELD(spikeTrace.enabled, BOOL, LIVE),
+        CONFIG_FIELD(spikeTrace.thresholdMs, FLOAT, LIVE),
+        CONFIG_FIELD(spikeTrace.contextSeconds, FLOAT, LIVE),
+        CONFIG_FIELD(spikeTrace.afterSeconds, FLOAT, LIVE),
+        CONFIG_FIELD(spikeTrace.cooldownSeconds, FLOAT, LIVE),
+        CONFIG_FIELD(spikeTrace.maxTraces, INT, LIVE),
+        CONFIG_FIELD(spikeTrace.directory, STRING, LIVE),
+
+        CONFIG_FIELD(playback.path, STRING, SIMULATION),
+        CONFIG_FIELD(playback.speed, FLOAT, SIMULATION),
+        CONFIG_FIELD(playback.loop, BOOL, SIMULATION),
+        CONFIG_FIELD(playback.readAhead, INT, SIMULATION),
+
+        CONFIG_FIELD(server.bindAddress, STRING, RESTART),
+        CONFIG_FIELD(server.token, STRING, RESTART),
+        CONFIG_FIELD(server.controllerTimeout, FLOAT, RESTART),
+
+        CONFIG_FIELD(debug.enableLogging, BOOL, LIVE),
+        CONFIG_FIELD(debug.showSPHDebug, BOOL, LIVE),
+    };
+
+#undef CONFIG_FIELD
+
+    const Field* findField(const std::string& key) {
+        for (const Field& field : FIELDS) {
+            if (key == field.key) return &field;
+        }
+        return nullptr;
+    }
+
+    // Recursive descent over one JSON document; // comments are allowed, as in most editors'
+    // settings files
+    class JsonReader {
+    public:
+        JsonReader(const std::string& text) : text_(text) {}
+
+        template <typename Values, typename Value>
+        bool document(Values& values, std::string& error) {
+            skip();
+            bool ok = object<Values, Value>("", values);
+            skip();
+            if (ok && pos_ != text_.size()) fail("trailing characters");
+            if (!error_.empty()) {
+                error = "line " + std::to_string(line()) + ": " + error_;
+                return false;
+            }
+            return true;
+        }
+
+    private:
+        const std::string& text_;
+        size_t pos_ = 0;
+        std::string error_;
+
+        bool fail(const std::string& message) {
+            if (error_.empty()) error_ = message;
+            return false;
+        }
+
+        int line() const {
+            return 1 + static_cast<int>(std::count(text_.begin(), text_.begin() + std::min(pos_, text_.size()), '\n'));
+        }
+
+        void skip() {
+            while (pos_ < text_.size()) {
+                if (std::isspace(static_cast<unsigned char>(text_[pos_]))) {
+                    pos_++;
+                } else if (text_.compare(pos_, 2, "//") == 0) {
+                    while (pos_ < text_.size() && text_[pos_] != '\n') pos_++;
+                } else {
+                    break;
+                }
+            }
+        }
+
+        bool expect(char c) {
+            skip();
+            if (pos_ >= text_.size() || text_[pos_] != c) return fail(std::string("expected '") + c + "'");
+            pos_++;
+            return true;
+        }
+
+        bool peek(char c) {
+            skip();
+            return pos_ < text_.size() && text_[pos_] == c;
+        }
+
+        bool string(std::string& out) {
+            if (!expect('"')) return false;
+            out.clear();
+            while (pos_ < text_.size() && text_[pos_] != '"') {
+                char c = text_[pos_++];
+                if (c == '\\' && pos_ < text_.size()) {
+                    char escaped = text_[pos_++];
+                    switch (escaped) {
+                        case 'n': c = '\n'; break;
+                        case 't': c = '\t'; break;
+                        default: c = escaped; break;    // \" \\ \/
+                    }
+                }
+                out.push_back(c);
+            }
+            if (pos_ >= text_.size()) return fail("unterminated string");
+            pos_++;
+            return true;
+        }
+
+        bool number(double& out) {
+            skip();
+            const char* begin = text_.c_str() + pos_;
+            char* end = nullptr;
+            out = std::strtod(begin, &end);
+            if (end == begin) return fail("expected a value");
+            pos_ += static_cast<size_t>(end - begin);
+            return true;
+        }
+
+        template <typename Values, typename Value>
+        bool object(const std::string& prefix, Values& values) {
+            if (!expect('{')) return false;
+            if (peek('}')) {
+                pos_++;
+                return true;
+            }
+            while (true) {
+                std::string key;
+                if (!string(key) || !expect(':')) return false;
+                std::string path = prefix.empty() ? key : prefix + "." + key;
+                if (!value<Values, Value>(path, values)) return false;
+                if (peek(',')) {
+                    pos_++;
+                    continue;
+                }
+                return expect('}');
+            }
+        }
+
+        template <typename Values, typename Value>
+        bool value(const std::string& path, Values& values) {
+            skip();
+            if (peek('{')) return object<Values, Value>(path, values);
+
+            Value v;
+            if (peek('"')) {
+                v.kind = Value::Kind::STRING;
+                if (!string(v.string)) return false;
+            } else if (peek('[')) {
+                pos_++;
+                v.kind = Value::Kind::ARRAY;
+                while (!peek(']')) {
+                    double element = 0.0;
+                    if (!number(element)) return false;
+                    v.array.push_back(element);
+                    if (peek(',')) pos_++;
+                    else if (!peek(']')) return fail("expected ',' or ']'");
+                }
+                pos_++;
+            } else if (text_.compare(pos_, 4, "true") == 0 || text_.compare(pos_, 5, "false") == 0) {
+                v.kind = Value::Kind::BOOL;
+                v.boolean = text_[pos_] == 't';
+                pos_ += v.boolean ? 4 : 5;
+            } else {
+                v.kind = Value::Kind::NUMBER;
+                if (!number(v.number)) return false;
+            }
+            values[path] = v;
+            return true;
+        }
+    };
+
+    // Performance tiers: the simulation and render budgets of one class of machine together
+    const std::vector<ConfigFile::Preset> PRESETS = {
+        { "kiosk-igpu", "Integrated GPU at 1080p30: small SPH, half-resolution fluid, light shadows", R"({
+            "display": { "vsync": true },
+            "water": { "surfaceResolution": 64, "oceanResolution": 256, "heightfieldResolution": 128,
+                       "flowMapResolution": 32, "tessellation": false },
+            "textures": { "causticSize": 256 },
+            "caustics": { "resolution": 128, "interval": 2 },
+            "sph": { "maxParticles": 20000, "maxSubstepsPerFrame": 6, "fluidRenderScale": 0.5,
+                     "diffuseParticles": false, "useTiledNeighborLoop": false, "neighborLimit": 48 },
+            "pacing": { "frameRateCap": 30, "maxFramesInFlight": 2 },
+            "shadows": { "resolution": 1024, "maxDistance": 20.0 },
+            "volumetrics": { "maxDistance": 20.0 },
+            "ui": { "refreshHz": 5 },
+            "assets": { "looseOverride": false }
+        })" },
+        { "desktop", "Mid-range discrete GPU at 1440p60: the compiled-in defaults", R"({
+            "display": { "vsync": false },
+            "water": { "surfaceResolution": 100, "oceanResolution": 256, "heightfieldResolution": 256 },
+            "textures": { "causticSize": 512 },
+            "sph": { "maxParticles": 100000, "maxSubstepsPerFrame": 20, "fluidRenderScale": 1.0,
+                     "diffuseParticles": false, "neighborLimit": 64 },
+            "pacing": { "frameRateCap": 0 },
+            "shadows": { "resolution": 2048, "maxDistance": 40.0 }
+        })" },
+        { "4k-rtx", "High-end GPU at 2160p: large SPH with spray, fine ocean, 4K shadows", R"({
+            "display": { "width": 3840, "height": 2160 },
+            "water": { "surfaceResolution": 200, "oceanResolution": 512, "heightfieldResolution": 512,
+                       "tessellation": true },
+            "textures": { "causticSize": 1024 },
+            "sph": { "maxParticles": 500000, "maxSubstepsPerFrame": 20, "fluidRenderScale": 0.75,
+                     "diffuseParticles": true, "useTiledNeighborLoop": true, "neighborLimit": 64 },
+            "pacing": { "frameRateCap": 0, "maxFramesInFlight": 2 },
+            "shadows": { "resolution": 4096, "maxDistance": 60.0 }
+        })" },
+    };
+}
+
+bool ConfigChanges::has(const char* key) const {
+    return std::find(keys.begin(), keys.end(), key) != keys.end();
+}
+
+const std::vector<ConfigFile::Preset>& ConfigFile::getPresets() {
+    return PRESETS;
+}
+
+const ConfigFile::Preset* ConfigFile::findPreset(const std::string& name) {
+    for (const Preset& preset : PRESETS) {
+        if (name == preset.name) return &preset;
+    }
+    return nullptr;
+}
+
+bool ConfigFile::load(const std::string& path, Config& config, const std::string& presetOverride) {
+    path_ = path;
+    presetOverride_ = presetOverride;
+
+    Values values;
+    if (!gather(values)) return false;
+
+    ConfigChanges changes;
+    apply(values, nullptr, config, changes);
+    loaded_ = std::move(values);
+
+    if (!path_.empty()) {
+        std::error_code error;
+        modified_ = std::filesystem::last_write_time(path_, error);
+        std::cout << "Config: " << path_ << (preset_.empty() ? "" : " (preset " + preset_ + ")")
+                  << ", " << changes.keys.size() << " fields set" << std::endl;
+    } else if (!preset_.empty()) {
+        std::cout << "Config: preset " << preset_ << ", " << changes.keys.size() << " fields set" << std::endl;
+    }
+    lastCheck_ = std::chrono::steady_clock::now();
+    return true;
+}
+
+bool ConfigFile::poll(Config& config, ConfigChanges& changes) {
+    changes = ConfigChanges();
+    if (path_.empty()) return false;
+
+    auto now = std::chrono::steady_clock::now();
+    if (now - lastCheck_ < std::chrono::milliseconds(500)) return false;
+    lastCheck_ = now;
+
+    std::error_code error;
+    std::filesystem::file_time_type modified = std::filesystem::last_write_time(path_, error);
+    if (error || modified == modified_) return false;
+    modified_ = modified;
+
+    Values values;
+    if (!gather(values)) return false;    // Reported; wait for the next save
+
+    apply(values, &loaded_, config, changes);
+    loaded_ = std::move(values);
+    reloads_++;
+
+    std::cout << "Config reloaded: " << changes.keys.size() << " fields changed" << std::endl;
+    for (const std::string& key : changes.restartKeys) {
+        std::cout << "  " << key << " takes effect at the next start" << std::endl;
+    }
+    return changes.any();
+}
+
+bool ConfigFile::gather(Values& values) {
+    Values fileValues;
+    if (!path_.empty()) {
+        std::ifstream file(path_);
+        if (!file) {
+            std::cerr << "ERROR: Failed to open config file " << path_ << std::endl;
+            return false;
+        }
+        std::stringstream text;
+        text << file.rdbuf();
+
+        std::string error;
+        if (!parse(text.str(), fileValues, error)) {
+            std::cerr << "ERROR: " << path_ << ", " << error << std::endl;
+            return false;
+        }
+    }
+
+    std::string presetName = presetOverride_;
+    auto presetKey = fileValues.find("preset");
+    if (presetName.empty() && presetKey != fileValues.end() && presetKey->second.kind == Value::Kind::STRING) {
+        presetName = presetKey->second.string;
+    }
+    fileValues.erase("preset");
+
+    if (!presetName.empty()) {
+        const Preset* preset = findPreset(presetName);
+        if (!preset) {
+            std::cerr << "ERROR: Unknown config preset " << presetName << std::endl;
+            return false;
+        }
+        std::string error;
+        if (!parse(preset->json, values, error)) {
+            std::cerr << "ERROR: Preset " << presetName << ", " << error << std::endl;
+            return false;
+        }
+    }
+    preset_ = presetName;
+
+    for (auto& entry : fileValues) {
+        values[entry.first] = entry.second;
+    }
+    return true;
+}
+
+bool ConfigFile::parse(const std::string& text, Values& values, std::string& error) {
+    JsonReader reader(text);
+    return reader.document<Values, Value>(values, error);
+}
+
+void ConfigFile::apply(const Values& values, const Values* previous, Config& config, ConfigChanges& changes) {
+    for (const auto& entry : values) {
+        const std::string& key = entry.first;
+        const Value& value = entry.second;
+        if (previous) {
+            auto before = previous->find(key);
+            if (before != previous->end() && before->second == value) continue;
+        }
+
+        const Field* field = findField(key);
+        if (!field) {
+            std::cerr << "Config: " << key << " is not a configurable field" << std::endl;
+            continue;
+        }
+
+        void* target = field->locate(config);
+        bool typed = true;
+        switch (field->type) {
+            case Field::Type::BOOL:
+                typed = value.kind == Value::Kind::BOOL;
+                if (typed) *static_cast<bool*>(target) = value.boolean;
+                break;
+            case Field::Type::INT:
+                typed = value.kind == Value::Kind::NUMBER;
+                if (typed) *static_cast<int*>(target) = static_cast<int>(value.number);
+                break;
+            case Field::Type::UINT:
+                typed = value.kind == Value::Kind::NUMBER && value.number >= 0.0;
+                if (typed) *static_cast<unsigned int*>(target) = static_cast<unsigned int>(value.number);
+                break;
+            case Field::Type::FLOAT:
+                typed = value.kind == Value::Kind::NUMBER;
+                if (typed) *static_cast<float*>(target) = static_cast<float>(value.number);
+                break;
+            case Field::Type::VEC2:
+                typed = value.kind == Value::Kind::ARRAY && value.array.size() == 2;
+                if (typed) *static_cast<glm::vec2*>(target) = glm::vec2(value.array[0], value.array[1]);
+                break;
+            case Field::Type::VEC3:
+                typed = value.kind == Value::Kind::ARRAY && value.array.size() == 3;
+                if (typed) *static_cast<glm::vec3*>(target) = glm::vec3(value.array[0], value.array[1], value.array[2]);
+                break;
+            case Field::Type::STRING:
+                typed = value.kind == Value::Kind::STRING;
+                if (typed) *static_cast<std::string*>(target) = value.string;
+                break;
+        }
+        if (!typed) {
+            std::cerr << "Config: " << key << " has the wrong type, skipped" << std::endl;
+            continue;
+        }
+
+        changes.keys.push_back(key);
+        switch (field->apply) {
+            case ConfigApply::LIVE: changes.live = true; break;
+            case ConfigApply::SIMULATION: changes.simulation = true; break;
+            case ConfigApply::TARGETS: changes.targets = true; break;
+            case ConfigApply::RESTART: changes.restartKeys.push_back(key); break;
+        }
+    }
+}
+
+} // namespace WaterSim
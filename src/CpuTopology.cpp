@@ -0,0 +1,256 @@
+#include "CpuTopology.h"
+#include <algorithm>
+#include <cstdlib>
+#include <functional>
+#include <map>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#elif defined(__linux__)
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace WaterSim {
+
+namespace {
+#if defined(_WIN32) || defined(__linux__)
+    // Throughput of an efficiency core against a performance core where the OS gives no
+    // measure of its own: Gracemont against Golden Cove at the clocks they ship at
+    constexpr float E_CORE_WEIGHT = 0.6f;
+
+    // Cores within this fraction of a class's fastest belong to it: favoured cores boost a
+    // few hundred MHz above their siblings without being another class
+    constexpr float CLASS_TOLERANCE = 0.9f;
+
+    // Classes and weights from each processor's relative performance, higher faster
+    void assignClasses(CpuTopology& topology, const std::vector<float>& performance) {
+        float fastest = *std::max_element(performance.begin(), performance.end());
+        if (fastest <= 0.0f) return;
+
+        std::vector<float> levels(performance);
+        std::sort(levels.begin(), levels.end(), std::greater<float>());
+        std::vector<float> leaders;
+        for (float level : levels) {
+            if (leaders.empty() || level < leaders.back() * CLASS_TOLERANCE) leaders.push_back(level);
+        }
+
+        for (size_t i = 0; i < topology.processors.size(); i++) {
+            CpuTopology::Processor& processor = topology.processors[i];
+            int coreClass = 0;
+            while (coreClass + 1 < static_cast<int>(leaders.size()) &&
+                   performance[i] < leaders[coreClass] * CLASS_TOLERANCE) {
+                coreClass++;
+            }
+            processor.coreClass = coreClass;
+            processor.weight = std::max(performance[i] / fastest, 0.05f);
+        }
+        topology.classCount = static_cast<int>(leaders.size());
+    }
+
+    // Dense node numbers in the order the OS numbers them
+    void renumberNodes(CpuTopology& topology) {
+        std::map<int, int> nodes;
+        for (const CpuTopology::Processor& processor : topology.processors) nodes.emplace(processor.node, 0);
+        int next = 0;
+        for (auto& node : nodes) node.second = next++;
+        for (CpuTopology::Processor& processor : topology.processors) processor.node = nodes[processor.node];
+        topology.nodeCount = std::max(next, 1);
+    }
+#endif
+
+#if defined(__linux__) && !defined(_WIN32)
+    bool readText(const std::string& path, std::string& text) {
+        std::ifstream file(path);
+        if (!file) return false;
+        std::getline(file, text);
+        return true;
+    }
+
+    bool readNumber(const std::string& path, long& value) {
+        std::string text;
+        if (!readText(path, text) || text.empty()) return false;
+        value = std::strtol(text.c_str(), nullptr, 10);
+        return true;
+    }
+
+    // sysfs list format: "0-3,8,10-11"
+    std::vector<int> parseCpuList(const std::string& text) {
+        std::vector<int> cpus;
+        std::stringstream ranges(text);
+        std::string range;
+        while (std::getline(ranges, range, ',')) {
+            if (range.empty()) continue;
+            size_t dash = range.find('-');
+            int first = std::atoi(range.c_str());
+            int last = dash == std::string::npos ? first : std::atoi(range.c_str() + dash + 1);
+            for (int cpu = first; cpu <= last; cpu++) cpus.push_back(cpu);
+        }
+        return cpus;
+    }
+#endif
+}
+
+#ifdef _WIN32
+CpuTopology CpuTopology::detect() {
+    CpuTopology topology;
+
+    DWORD length = 0;
+    GetLogicalProcessorInformationEx(RelationAll, nullptr, &length);
+    if (GetLastError() != ERROR_INSUFFICIENT_BUFFER || length == 0) return topology;
+    std::vector<BYTE> buffer(length);
+    auto* first = reinterpret_cast<SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX*>(buffer.data());
+    if (!GetLogicalProcessorInformationEx(RelationAll, first, &length)) return topology;
+
+    std::vector<BYTE> efficiency;
+    std::vector<GROUP_AFFINITY> nodeMasks;
+    std::vector<int> nodeNumbers;
+    int core = 0;
+    for (DWORD offset = 0; offset < length;) {
+        auto* info = reinterpret_cast<SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX*>(buffer.data() + offset);
+        if (info->Relationship == RelationProcessorCore) {
+            int thread = 0;
+            for (WORD g = 0; g < info->Processor.GroupCount; g++) {
+                const GROUP_AFFINITY& mask = info->Processor.GroupMask[g];
+                for (int bit = 0; bit < static_cast<int>(sizeof(KAFFINITY) * 8); bit++) {
+                    if (!(mask.Mask & (KAFFINITY(1) << bit))) continue;
+                    Processor processor;
+                    processor.id = bit;
+                    processor.group = mask.Group;
+                    processor.core = core;
+                    processor.thread = thread++;
+                    topology.processors.push_back(processor);
+                    efficiency.push_back(info->Processor.EfficiencyClass);
+                }
+            }
+            core++;
+        } else if (info->Relationship == RelationNumaNode) {
+            nodeMasks.push_back(info->NumaNode.GroupMask);
+            nodeNumbers.push_back(static_cast<int>(info->NumaNode.NodeNumber));
+        }
+        offset += info->Size;
+    }
+    if (topology.processors.empty()) return topology;
+
+    for (Processor& processor : topology.processors) {
+        for (size_t n = 0; n < nodeMasks.size(); n++) {
+            if (nodeMasks[n].Group == processor.group && (nodeMasks[n].Mask & (KAFFINITY(1) << processor.id))) {
+                processor.node = nodeNumbers[n];
+                break;
+            }
+        }
+    }
+    renumberNodes(topology);
+
+    // EfficiencyClass ranks the classes, higher faster, and says nothing of their throughput
+    BYTE fastest = *std::max_element(efficiency.begin(), efficiency.end());
+    std::vector<float> performance;
+    for (BYTE value : efficiency) {
+        float weight = 1.0f;
+        for (int rank = value; rank < fastest; rank++) weight *= E_CORE_WEIGHT;
+        performance.push_back(weight);
+    }
+    assignClasses(topology, performance);
+    return topology;
+}
+
+bool CpuTopology::pinCurrentThread(const Processor& processor) {
+    GROUP_AFFINITY affinity = {};
+    affinity.Group = static_cast<WORD>(processor.group);
+    affinity.Mask = KAFFINITY(1) << processor.id;
+    return SetThreadGroupAffinity(GetCurrentThread(), &affinity, nullptr) != 0;
+}
+
+#elif defined(__linux__)
+CpuTopology CpuTopology::detect() {
+    CpuTopology topology;
+    const std::string root = "/sys/devices/system/";
+
+    // Online processors this process may use (taskset, cgroup cpusets)
+    std::string online;
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (!readText(root + "cpu/online", online) || sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        return topology;
+    }
+
+    std::map<int, int> cpuNodes;
+    std::string nodesOnline;
+    if (readText(root + "node/online", nodesOnline)) {
+        for (int node : parseCpuList(nodesOnline)) {
+            std::string cpus;
+            if (!readText(root + "node/node" + std::to_string(node) + "/cpulist", cpus)) continue;
+            for (int cpu : parseCpuList(cpus)) cpuNodes[cpu] = node;
+        }
+    }
+
+    // Intel hybrid parts list their efficiency cores under the Atom PMU
+    std::vector<int> atomCpus;
+    std::string atomList;
+    if (readText("/sys/devices/cpu_atom/cpus", atomList)) atomCpus = parseCpuList(atomList);
+
+    std::map<std::pair<long, long>, int> cores;     // (package, core id) -> core
+    std::map<int, int> siblings;                    // core -> threads seen
+    std::vector<float> performance;
+    for (int cpu : parseCpuList(online)) {
+        if (cpu < 0 || cpu >= CPU_SETSIZE || !CPU_ISSET(cpu, &allowed)) continue;
+        std::string dir = root + "cpu/cpu" + std::to_string(cpu) + "/";
+
+        long package = 0, coreId = cpu;
+        readNumber(dir + "topology/physical_package_id", package);
+        readNumber(dir + "topology/core_id", coreId);
+        auto core = cores.emplace(std::make_pair(package, coreId), static_cast<int>(cores.size())).first->second;
+
+        Processor processor;
+        processor.id = cpu;
+        processor.core = core;
+        processor.thread = siblings[core]++;
+        auto node = cpuNodes.find(cpu);
+        processor.node = node != cpuNodes.end() ? node->second : 0;
+        topology.processors.push_back(processor);
+
+        // The scheduler's capacity where the platform sets one (arm big.LITTLE, recent x86
+        // hybrid kernels), else the highest clock
+        long capacity = 0;
+        if (!readNumber(dir + "cpu_capacity", capacity)) readNumber(dir + "cpufreq/cpuinfo_max_freq", capacity);
+        performance.push_back(static_cast<float>(std::max(capacity, 1L)));
+    }
+    if (topology.processors.empty()) return topology;
+
+    // A clock ratio flatters an efficiency core, which retires less per clock as well
+    float fastest = *std::max_element(performance.begin(), performance.end());
+    for (size_t i = 0; i < topology.processors.size(); i++) {
+        if (std::find(atomCpus.begin(), atomCpus.end(), topology.processors[i].id) != atomCpus.end()) {
+            performance[i] = std::min(performance[i], fastest * E_CORE_WEIGHT);
+        }
+    }
+
+    renumberNodes(topology);
+    assignClasses(topology, performance);
+    return topology;
+}
+
+bool CpuTopology::pinCurrentThread(const Processor& processor) {
+    if (processor.id < 0 || processor.id >= CPU_SETSIZE) return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(processor.id, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+#else
+CpuTopology CpuTopology::detect() {
+    return CpuTopology();
+}
+
+bool CpuTopology::pinCurrentThread(const Processor&) {
+    return false;
+}
+#endif
+
+} // namespace WaterSim
@@ -0,0 +1,275 @@
+#include "../include/DDSFile.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace WaterSim {
+
+namespace {
+
+constexpr uint32_t DDS_MAGIC = 0x20534444;          // "DDS "
+constexpr uint32_t DDS_FOURCC_DX10 = 0x30315844;    // "DX10"
+constexpr uint32_t DDS_USER_KEY_TAG = 0x4D495357;   // "WSIM", marks the key in reserved1
+
+constexpr uint32_t DDSD_CAPS = 0x1;
+constexpr uint32_t DDSD_HEIGHT = 0x2;
+constexpr uint32_t DDSD_WIDTH = 0x4;
+constexpr uint32_t DDSD_PIXELFORMAT = 0x1000;
+constexpr uint32_t DDSD_MIPMAPCOUNT = 0x20000;
+constexpr uint32_t DDSD_LINEARSIZE = 0x80000;
+constexpr uint32_t DDPF_FOURCC = 0x4;
+constexpr uint32_t DDSCAPS_COMPLEX = 0x8;
+constexpr uint32_t DDSCAPS_TEXTURE = 0x1000;
+constexpr uint32_t DDSCAPS_MIPMAP = 0x400000;
+constexpr uint32_t DDSCAPS2_CUBEMAP_ALL_FACES = 0xFE00;   // DDSCAPS2_CUBEMAP and the six faces
+constexpr uint32_t DDS_DIMENSION_TEXTURE2D = 3;
+constexpr uint32_t DDS_MISC_TEXTURECUBE = 0x4;
+constexpr uint32_t DDS_MAX_DIMENSION = 1u << 16;   // Past any GL texture size; keeps the level sizes in range
+
+struct DDSPixelFormat {
+    uint32_t size;
+    uint32_t flags;
+    uint32_t fourCC;
+    uint32_t rgbBitCount;
+    uint32_t masks[4];
+};
+
+struct DDSHeader {
+    uint32_t size;
+    uint32_t flags;
+    uint32_t height;
+    uint32_t width;
+    uint32_t pitchOrLinearSize;
+    uint32_t depth;
+    uint32_t mipMapCount;
+    uint32_t reserved1[11];
+    DDSPixelFormat pixelFormat;
+    uint32_t caps;
+    uint32_t caps2;
+    uint32_t caps3;
+    uint32_t caps4;
+    uint32_t reserved2;
+};
+
+struct DDSHeaderDX10 {
+    uint32_t dxgiFormat;
+    uint32_t resourceDimension;
+    uint32_t miscFlag;
+    uint32_t arraySize;
+    uint32_t miscFlags2;
+};
+
+static_assert(sizeof(DDSHeader) == 124, "DDS_HEADER is 124 bytes");
+
+constexpr size_t DDS_DATA_OFFSET = sizeof(uint32_t) + sizeof(DDSHeader) + sizeof(DDSHeaderDX10);
+
+struct FormatMapping {
+    uint32_t dxgiFormat;
+    GLenum internalFormat;
+};
+
+const FormatMapping FORMAT_MAPPINGS[] = {
+    {10, GL_RGBA16F},                               // DXGI_FORMAT_R16G16B16A16_FLOAT
+    {28, GL_RGBA8},                                 // DXGI_FORMAT_R8G8B8A8_UNORM
+    {29, GL_SRGB8_ALPHA8},                          // DXGI_FORMAT_R8G8B8A8_UNORM_SRGB
+    {95, GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT},    // DXGI_FORMAT_BC6H_UF16
+    {96, GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT},      // DXGI_FORMAT_BC6H_SF16
+    {98, GL_COMPRESSED_RGBA_BPTC_UNORM},            // DXGI_FORMAT_BC7_UNORM
+    {99, GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM},      // DXGI_FORMAT_BC7_UNORM_SRGB
+};
+
+GLenum internalFormatFromDXGI(uint32_t dxgiFormat) {
+    for (const FormatMapping& mapping : FORMAT_MAPPINGS) {
+        if (mapping.dxgiFormat == dxgiFormat) {
+            return mapping.internalFormat;
+        }
+    }
+    return 0;
+}
+
+uint32_t dxgiFromInternalFormat(GLenum internalFormat) {
+    for (const FormatMapping& mapping : FORMAT_MAPPINGS) {
+        if (mapping.internalFormat == internalFormat) {
+            return mapping.dxgiFormat;
+        }
+    }
+    return 0;
+}
+
+} // namespace
+
+bool DDSFile::isSupportedFormat(GLenum internalFormat) {
+    return dxgiFromInternalFormat(internalFormat) != 0;
+}
+
+bool DDSFile::isBlockCompressed(GLenum internalFormat) {
+    return internalFormat == GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT || internalFormat == GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT ||
+           internalFormat == GL_COMPRESSED_RGBA_BPTC_UNORM || internalFormat == GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM;
+}
+
+size_t DDSFile::levelSize(int level) const {
+    size_t width = std::max(description_.width >> level, 1);
+    size_t height = std::max(description_.height >> level, 1);
+    if (isBlockCompressed(description_.internalFormat)) {
+        // 16 bytes per 4x4 block for both BC6H and BC7
+        return ((width + 3) / 4) * ((height + 3) / 4) * 16;
+    }
+    return width * height * (description_.internalFormat == GL_RGBA16F ? 8 : 4);
+}
+
+size_t DDSFile::faceSize() const {
+    size_t size = 0;
+    for (int level = 0; level < description_.levels; level++) {
+        size += levelSize(level);
+    }
+    return size;
+}
+
+void* DDSFile::getLevel(int face, int level) const {
+    size_t offset = DDS_DATA_OFFSET + size_t(face) * faceSize();
+    for (int i = 0; i < level; i++) {
+        offset += levelSize(i);
+    }
+    return static_cast<char*>(file_.data()) + offset;
+}
+
+bool DDSFile::open(const std::string& path) {
+    description_ = Description();
+    if (!file_.openRead(path)) {
+        return false;
+    }
+
+    uint32_t magic;
+    DDSHeader header;
+    DDSHeaderDX10 extension;
+    if (file_.size() < DDS_DATA_OFFSET) {
+        std::cerr << "DDS file " << path << " is truncated" << std::endl;
+        file_.close();
+        return false;
+    }
+    const char* bytes = static_cast<const char*>(file_.data());
+    std::memcpy(&magic, bytes, sizeof(magic));
+    std::memcpy(&header, bytes + sizeof(magic), sizeof(header));
+    std::memcpy(&extension, bytes + sizeof(magic) + sizeof(header), sizeof(extension));
+
+    // Only the DX10 layout names BC6H and BC7; legacy FourCC files are left to other tools
+    if (magic != DDS_MAGIC || header.size != sizeof(DDSHeader) || !(header.pixelFormat.flags & DDPF_FOURCC) ||
+        header.pixelFormat.fourCC != DDS_FOURCC_DX10 || extension.resourceDimension != DDS_DIMENSION_TEXTURE2D ||
+        extension.arraySize != 1) {
+        std::cerr << "Unsupported DDS layout: " << path << std::endl;
+        file_.close();
+        return false;
+    }
+
+    description_.internalFormat = internalFormatFromDXGI(extension.dxgiFormat);
+    if (!description_.internalFormat) {
+        std::cerr << "Unsupported DDS format " << extension.dxgiFormat << ": " << path << std::endl;
+        file_.close();
+        return false;
+    }
+    // A corrupt or stale header must not reach the level size shifts: sizes in range, and no
+    // more levels than the full mip chain
+    uint32_t levels = std::max(header.mipMapCount, 1u);
+    uint32_t largest = std::max(header.width, header.height);
+    uint32_t chainLevels = 1;
+    while ((largest >> chainLevels) != 0) {
+        chainLevels++;
+    }
+    if (header.width == 0 || header.height == 0 || largest > DDS_MAX_DIMENSION || levels > chainLevels) {
+        std::cerr << "Invalid DDS size " << header.width << "x" << header.height << " with " << header.mipMapCount
+                  << " levels: " << path << std::endl;
+        file_.close();
+        description_ = Description();
+        return false;
+    }
+    description_.width = static_cast<int>(header.width);
+    description_.height = static_cast<int>(header.height);
+    description_.levels = static_cast<int>(levels);
+    description_.cubemap = (extension.miscFlag & DDS_MISC_TEXTURECUBE) != 0;
+    if (header.reserved1[0] == DDS_USER_KEY_TAG) {
+        description_.userKey = uint64_t(header.reserved1[1]) | (uint64_t(header.reserved1[2]) << 32);
+    }
+
+    if (DDS_DATA_OFFSET + getFaceCount() * faceSize() > file_.size()) {
+        std::cerr << "DDS file " << path << " is truncated" << std::endl;
+        file_.close();
+        description_ = Description();
+        return false;
+    }
+    return true;
+}
+
+bool DDSFile::create(const std::string& path, const Description& description) {
+    if (!isSupportedFormat(description.internalFormat)) {
+        return false;
+    }
+    description_ = description;
+    if (!file_.create(path, DDS_DATA_OFFSET + getFaceCount() * faceSize())) {
+        description_ = Description();
+        return false;
+    }
+
+    DDSHeader header = {};
+    header.size = sizeof(DDSHeader);
+    header.flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE;
+    header.height = static_cast<uint32_t>(description.height);
+    header.width = static_cast<uint32_t>(description.width);
+    header.pitchOrLinearSize = static_cast<uint32_t>(levelSize(0));
+    header.depth = 1;
+    header.mipMapCount = static_cast<uint32_t>(description.levels);
+    header.reserved1[0] = DDS_USER_KEY_TAG;
+    header.reserved1[1] = static_cast<uint32_t>(description.userKey);
+    header.reserved1[2] = static_cast<uint32_t>(description.userKey >> 32);
+    header.pixelFormat.size = sizeof(DDSPixelFormat);
+    header.pixelFormat.flags = DDPF_FOURCC;
+    header.pixelFormat.fourCC = DDS_FOURCC_DX10;
+    header.caps = DDSCAPS_TEXTURE | (description.levels > 1 ? DDSCAPS_MIPMAP | DDSCAPS_COMPLEX : 0);
+    if (description.cubemap) {
+        header.caps |= DDSCAPS_COMPLEX;
+        header.caps2 = DDSCAPS2_CUBEMAP_ALL_FACES;
+    }
+
+    DDSHeaderDX10 extension = {};
+    extension.dxgiFormat = dxgiFromInternalFormat(description.internalFormat);
+    extension.resourceDimension = DDS_DIMENSION_TEXTURE2D;
+    extension.miscFlag = description.cubemap ? DDS_MISC_TEXTURECUBE : 0;
+    extension.arraySize = 1;
+
+    char* bytes = static_cast<char*>(file_.data());
+    std::memcpy(bytes, &DDS_MAGIC, sizeof(DDS_MAGIC));
+    std::memcpy(bytes + sizeof(DDS_MAGIC), &header, sizeof(header));
+    std::memcpy(bytes + sizeof(DDS_MAGIC) + sizeof(header), &extension, sizeof(extension));
+    return true;
+}
+
+GLuint DDSFile::upload() const {
+    if (!file_.isOpen() || !isSupportedFormat(description_.internalFormat)) {
+        return 0;
+    }
+
+    GLenum target = description_.cubemap ? GL_TEXTURE_CUBE_MAP : GL_TEXTURE_2D;
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(target, texture);
+    glTexStorage2D(target, description_.levels, description_.internalFormat, description_.width, description_.height);
+    glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, description_.levels - 1);
+
+    bool compressed = isBlockCompressed(description_.internalFormat);
+    GLenum type = description_.internalFormat == GL_RGBA16F ? GL_HALF_FLOAT : GL_UNSIGNED_BYTE;
+    for (int face = 0; face < getFaceCount(); face++) {
+        GLenum faceTarget = description_.cubemap ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + face : GL_TEXTURE_2D;
+        for (int level = 0; level < description_.levels; level++) {
+            int width = std::max(description_.width >> level, 1);
+            int height = std::max(description_.height >> level, 1);
+            if (compressed) {
+                glCompressedTexSubImage2D(faceTarget, level, 0, 0, width, height, description_.internalFormat,
+                                          static_cast<GLsizei>(levelSize(level)), getLevel(face, level));
+            } else {
+                glTexSubImage2D(faceTarget, level, 0, 0, width, height, GL_RGBA, type, getLevel(face, level));
+            }
+        }
+    }
+    return texture;
+}
+
+} // namespace WaterSim
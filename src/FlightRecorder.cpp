@@ -0,0 +1,77 @@
+#include "FlightRecorder.h"
+#include "TraceRecorder.h"
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+
+namespace WaterSim {
+
+FlightRecorder::~FlightRecorder() {
+    wait();
+}
+
+void FlightRecorder::wait() {
+    if (writer_) writer_->wait();
+}
+
+void FlightRecorder::recordFrame(float frameMs, const Counters& counters) {
+    TraceRecorder& trace = TraceRecorder::instance();
+    if (!settings_.enabled || !trace.isEnabled()) {
+        armed_ = false;
+        return;
+    }
+
+    trace.counter("Frame ms", frameMs);
+    trace.counter("Frame-graph passes", counters.framePasses);
+    trace.counter("Uploads", counters.uploads);
+    trace.counter("Upload KB", counters.uploadKB);
+    trace.counter("Shader builds", counters.shaderBuilds);
+    trace.counter("Pacing wait ms", counters.pacingWaitMs);
+
+    int64_t now = TraceRecorder::now();
+    if (frameMs > settings_.thresholdMs) {
+        stats_.spikes++;
+        stats_.worstMs = std::max(stats_.worstMs, frameMs);
+        trace.instant("Frame spike", frameMs);
+
+        bool cooling = stats_.saved > 0 && now - lastSaveNs_ < static_cast<int64_t>(settings_.cooldownSeconds * 1e9);
+        if (!armed_ && !cooling && stats_.saved < settings_.maxTraces) {
+            armed_ = true;
+            spikeNs_ = now - static_cast<int64_t>(frameMs * 1e6);
+            spikeMs_ = frameMs;
+        } else if (armed_) {
+            spikeMs_ = std::max(spikeMs_, frameMs);
+        }
+    }
+
+    if (armed_ && now - spikeNs_ >= static_cast<int64_t>(settings_.afterSeconds * 1e9) && (!writer_ || writer_->done())) {
+        save();
+    }
+}
+
+void FlightRecorder::save() {
+    armed_ = false;
+    lastSaveNs_ = TraceRecorder::now();
+
+    char name[64];
+    std::snprintf(name, sizeof(name), "spike_%03d_%.0fms.json", stats_.saved + 1, spikeMs_);
+    std::filesystem::path path = std::filesystem::path(settings_.directory) / name;
+    stats_.saved++;
+    stats_.lastPath = path.string();
+
+    // The copy of the rings and the JSON both happen on the pool, away from the frames
+    int64_t sinceNs = spikeNs_ - static_cast<int64_t>(settings_.contextSeconds * 1e9);
+    std::string directory = settings_.directory;
+    float spikeMs = spikeMs_;
+    writer_ = std::make_unique<JobSystem::TaskGroup>();
+    writer_->run([directory, path, sinceNs, spikeMs]() {
+        std::error_code error;
+        std::filesystem::create_directories(directory, error);
+        if (TraceRecorder::instance().save(path.string(), sinceNs)) {
+            std::cout << "Frame spike of " << spikeMs << " ms recorded to " << path.string() << std::endl;
+        }
+    });
+}
+
+} // namespace WaterSim
@@ -0,0 +1,98 @@
+#include "../include/FlowMap.h"
+#include "../include/InitShader.h"
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+constexpr float MAX_STEP_TIME = 1.0f / 20.0f;  // Slow frames advect less rather than overshoot
+constexpr int TILE_SIZE = 16;                  // flow_map.cs work groups
+
+} // namespace
+
+FlowMap::FlowMap() {
+}
+
+FlowMap::~FlowMap() {
+    if (velocityTextures_[0]) glDeleteTextures(2, velocityTextures_);
+    if (sampler_) glDeleteSamplers(1, &sampler_);
+    if (program_) glDeleteProgram(program_);
+}
+
+bool FlowMap::initialize(int resolution, float surfaceSize) {
+    resolution_ = resolution;
+    surfaceSize_ = surfaceSize;
+
+    program_ = InitComputeShader("shaders/flow_map.cs");
+    if (!program_) {
+        std::cerr << "ERROR: Failed to load flow map shader!" << std::endl;
+        return false;
+    }
+    std::cout << "Flow map shader loaded successfully (ID: " << program_ << ")" << std::endl;
+
+    glCreateTextures(GL_TEXTURE_2D, 2, velocityTextures_);
+    for (GLuint texture : velocityTextures_) {
+        glTextureStorage2D(texture, 1, GL_RG16F, resolution_, resolution_);
+        glTextureParameteri(texture, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTextureParameteri(texture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTextureParameteri(texture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTextureParameteri(texture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+    glCreateSamplers(1, &sampler_);
+    glSamplerParameteri(sampler_, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glSamplerParameteri(sampler_, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glSamplerParameteri(sampler_, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glSamplerParameteri(sampler_, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    clear();
+    return true;
+}
+
+void FlowMap::addImpulse(const glm::vec2& center, const glm::vec2& velocity, float radius) {
+    if (static_cast<int>(impulses_.size()) >= 2 * MAX_IMPULSES || radius <= 0.0f) return;
+
+    // World to texel coordinates; the velocity stays in world units
+    float texelSize = surfaceSize_ / resolution_;
+    glm::vec2 texel = (center + 0.5f * surfaceSize_) / texelSize - 0.5f;
+    impulses_.push_back(glm::vec4(texel, std::max(radius / texelSize, 1.0f), 0.0f));
+    impulses_.push_back(glm::vec4(velocity, 0.0f, 0.0f));
+}
+
+void FlowMap::clear() {
+    const float velocity[2] = { baseVelocity_.x, baseVelocity_.y };
+    for (GLuint texture : velocityTextures_) {
+        if (texture) glClearTexImage(texture, 0, GL_RG, GL_FLOAT, velocity);
+    }
+    impulses_.clear();
+}
+
+void FlowMap::update(float deltaTime) {
+    if (!program_ || deltaTime <= 0.0f) return;
+
+    float stepTime = std::min(deltaTime, MAX_STEP_TIME);
+    float texelSize = surfaceSize_ / resolution_;
+    int tiles = (resolution_ + TILE_SIZE - 1) / TILE_SIZE;
+    int next = 1 - current_;
+
+    glUseProgram(program_);
+    glUniform1i(glGetUniformLocation(program_, "uResolution"), resolution_);
+    glUniform1f(glGetUniformLocation(program_, "uStepTexels"), stepTime / texelSize);
+    glUniform1f(glGetUniformLocation(program_, "uRelax"), 1.0f - std::exp(-relaxation_ * stepTime));
+    glUniform2fv(glGetUniformLocation(program_, "uBaseVelocity"), 1, &baseVelocity_.x);
+    glUniform1i(glGetUniformLocation(program_, "uImpulseCount"), static_cast<int>(impulses_.size() / 2));
+    if (!impulses_.empty()) {
+        glUniform4fv(glGetUniformLocation(program_, "uImpulses"), static_cast<GLsizei>(impulses_.size()), &impulses_[0].x);
+    }
+
+    glBindTextureUnit(0, velocityTextures_[current_]);
+    glBindSampler(0, sampler_);
+    glUniform1i(glGetUniformLocation(program_, "uSource"), 0);
+    glBindImageTexture(0, velocityTextures_[next], 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RG16F);
+    glDispatchCompute(tiles, tiles, 1);
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    glBindSampler(0, 0);
+    glUseProgram(0);
+
+    impulses_.clear();
+    current_ = next;
+}
@@ -0,0 +1,99 @@
+#include "../include/FluidQueries.h"
+#include "../include/GPUMemoryTracker.h"
+#include "../include/Profiler.h"
+#include "../include/SPHComputeSystem.h"
+#include <algorithm>
+#include <cstring>
+
+namespace WaterSim {
+
+namespace {
+    constexpr GLsizeiptr BATCH_BYTES = FluidQueries::MAX_QUERIES * sizeof(FluidQueryResult);
+}
+
+static_assert(sizeof(FluidQuery) == 2 * sizeof(glm::vec4), "FluidQuery must match the shader's two vec4s");
+static_assert(sizeof(FluidQueryResult) == 2 * sizeof(glm::vec4), "FluidQueryResult must match the shader's Result");
+
+FluidQueries::~FluidQueries() {
+    for (Slot& slot : slots_) {
+        if (slot.fence) glDeleteSync(slot.fence);
+    }
+    if (readbackBuffer_) {
+        glUnmapNamedBuffer(readbackBuffer_);
+        glDeleteBuffers(1, &readbackBuffer_);
+    }
+    if (queryBuffer_) glDeleteBuffers(1, &queryBuffer_);
+    if (resultBuffer_) glDeleteBuffers(1, &resultBuffer_);
+}
+
+bool FluidQueries::initialize() {
+    GPUMemoryScope memoryScope("Fluid queries");
+    glCreateBuffers(1, &queryBuffer_);
+    glNamedBufferStorage(queryBuffer_, MAX_QUERIES * sizeof(FluidQuery), nullptr, GL_DYNAMIC_STORAGE_BIT);
+    glCreateBuffers(1, &resultBuffer_);
+    glNamedBufferStorage(resultBuffer_, BATCH_BYTES, nullptr, 0);
+
+    GLbitfield readbackFlags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glCreateBuffers(1, &readbackBuffer_);
+    glNamedBufferStorage(readbackBuffer_, READBACK_FRAMES * BATCH_BYTES, nullptr, readbackFlags);
+    readbackResults_ = static_cast<const FluidQueryResult*>(
+        glMapNamedBufferRange(readbackBuffer_, 0, READBACK_FRAMES * BATCH_BYTES, readbackFlags));
+
+    queries_.reserve(MAX_QUERIES);
+    return readbackResults_ != nullptr;
+}
+
+void FluidQueries::beginFrame() {
+    // Oldest slot first; a zero-timeout wait only polls the fence
+    for (uint32_t i = 0; i < READBACK_FRAMES; i++) {
+        uint32_t index = (writeIndex_ + i) % READBACK_FRAMES;
+        Slot& slot = slots_[index];
+        if (!slot.fence) continue;
+        GLenum status = glClientWaitSync(slot.fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) break;
+        glDeleteSync(slot.fence);
+        slot.fence = nullptr;
+
+        const FluidQueryResult* batch = readbackResults_ + index * MAX_QUERIES;
+        latest_.assign(batch, batch + slot.count);
+        latestFrame_ = slot.frame;
+    }
+
+    queries_.clear();
+    frame_++;
+}
+
+FluidQueries::Ticket FluidQueries::submit(const FluidQuery* queries, uint32_t count) {
+    Ticket ticket;
+    ticket.first = static_cast<uint32_t>(queries_.size());
+    ticket.count = std::min(count, MAX_QUERIES - ticket.first);
+    queries_.insert(queries_.end(), queries, queries + ticket.count);
+    return ticket;
+}
+
+void FluidQueries::dispatch(SPHComputeSystem& sph) {
+    // The GPU is a whole ring behind: this frame goes without
+    if (queries_.empty() || !readbackResults_ || slots_[writeIndex_].fence) return;
+
+    ProfileScope scope("Fluid queries");
+    uint32_t count = static_cast<uint32_t>(queries_.size());
+    glNamedBufferSubData(queryBuffer_, 0, count * sizeof(FluidQuery), queries_.data());
+    if (!sph.dispatchSpatialQuery(queryBuffer_, resultBuffer_, count)) return;
+
+    Slot& slot = slots_[writeIndex_];
+    slot.count = count;
+    slot.frame = frame_;
+
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glCopyNamedBufferSubData(resultBuffer_, readbackBuffer_, 0, writeIndex_ * BATCH_BYTES, count * sizeof(FluidQueryResult));
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    writeIndex_ = (writeIndex_ + 1) % READBACK_FRAMES;
+}
+
+bool FluidQueries::getResults(const Ticket& ticket, FluidQueryResult* results) const {
+    if (ticket.count == 0 || latestFrame_ == 0 || ticket.first + ticket.count > latest_.size()) return false;
+    std::memcpy(results, latest_.data() + ticket.first, ticket.count * sizeof(FluidQueryResult));
+    return true;
+}
+
+} // namespace WaterSim
@@ -0,0 +1,139 @@
+#include "../include/FoamParticles.h"
+#include "../include/InitShader.h"
+#include <glm/gtc/type_ptr.hpp>
+#include <iostream>
+#include <algorithm>
+#include <cstddef>
+
+namespace {
+
+constexpr int GROUP_SIZE = 256;           // foam_update.cs work groups
+constexpr GLuint PARTICLES_IN_BINDING = 43;
+constexpr GLuint PARTICLES_OUT_BINDING = 44;
+constexpr GLuint COMMANDS_BINDING = 45;
+
+// std430 particle of foam_update.cs and foam.vs
+struct GpuFoamParticle {
+    glm::vec4 positionSize;
+    glm::vec4 velocityLifetime;
+    glm::vec4 maxLifetime;  // x; rest padding
+};
+
+// glDrawArraysIndirect command, instanceCount the live particles
+struct DrawCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint first;
+    GLuint baseInstance;
+};
+
+} // namespace
+
+FoamParticles::FoamParticles() {
+}
+
+FoamParticles::~FoamParticles() {
+    if (particleBuffers_[0]) glDeleteBuffers(2, particleBuffers_);
+    if (commandBuffer_) glDeleteBuffers(1, &commandBuffer_);
+    if (vao_) glDeleteVertexArrays(1, &vao_);
+    if (program_) glDeleteProgram(program_);
+}
+
+bool FoamParticles::initialize(int capacity) {
+    capacity_ = capacity;
+
+    program_ = InitComputeShader("shaders/foam_update.cs");
+    if (!program_) {
+        std::cerr << "ERROR: Failed to load foam update shader!" << std::endl;
+        return false;
+    }
+    std::cout << "Foam update shader loaded successfully (ID: " << program_ << ")" << std::endl;
+
+    glCreateBuffers(2, particleBuffers_);
+    for (GLuint buffer : particleBuffers_) {
+        glNamedBufferStorage(buffer, static_cast<GLsizeiptr>(capacity_) * sizeof(GpuFoamParticle), nullptr, 0);
+    }
+
+    // Four-vertex fans, none alive yet
+    DrawCommand commands[2] = { { 4, 0, 0, 0 }, { 4, 0, 0, 0 } };
+    glCreateBuffers(1, &commandBuffer_);
+    glNamedBufferStorage(commandBuffer_, sizeof(commands), commands, GL_DYNAMIC_STORAGE_BIT);
+
+    glCreateVertexArrays(1, &vao_);
+    return true;
+}
+
+void FoamParticles::emit(const glm::vec3& position, float intensity, int count) {
+    if (static_cast<int>(bursts_.size()) >= 2 * MAX_BURSTS || count <= 0) return;
+
+    // The shader finds a particle's burst from the running count of the bursts before it
+    bursts_.push_back(glm::vec4(position, intensity));
+    bursts_.push_back(glm::vec4(static_cast<float>(burstParticles_), static_cast<float>(count), 0.0f, 0.0f));
+    burstParticles_ += count;
+}
+
+void FoamParticles::update(float deltaTime) {
+    if (!program_) return;
+
+    // Survivors and new particles are appended to the other buffer, counted into its command
+    int next = 1 - current_;
+    GLuint zero = 0;
+    glNamedBufferSubData(commandBuffer_, next * sizeof(DrawCommand) + offsetof(DrawCommand, instanceCount),
+                         sizeof(GLuint), &zero);
+
+    glUseProgram(program_);
+    glUniform1f(glGetUniformLocation(program_, "uDeltaTime"), deltaTime);
+    glUniform1ui(glGetUniformLocation(program_, "uCapacity"), static_cast<GLuint>(capacity_));
+    glUniform1i(glGetUniformLocation(program_, "uSource"), current_);
+    glUniform1ui(glGetUniformLocation(program_, "uSeed"), seed_++);
+    glUniform1i(glGetUniformLocation(program_, "uSpawnCount"), burstParticles_);
+    glUniform1i(glGetUniformLocation(program_, "uBurstCount"), static_cast<int>(bursts_.size() / 2));
+    if (!bursts_.empty()) {
+        glUniform4fv(glGetUniformLocation(program_, "uBursts"), static_cast<GLsizei>(bursts_.size()), &bursts_[0].x);
+    }
+
+    glUniform1i(glGetUniformLocation(program_, "uUseFlowMap"), flowMap_ ? 1 : 0);
+    if (flowMap_) {
+        glBindTextureUnit(0, flowMap_);
+        glUniform1i(glGetUniformLocation(program_, "uFlowMap"), 0);
+        glUniform1f(glGetUniformLocation(program_, "uFlowMapSize"), flowMapSize_);
+    }
+    bool waveSurface = waveHeight_ && waveVelocity_;
+    glUniform1i(glGetUniformLocation(program_, "uUseWaveSurface"), waveSurface ? 1 : 0);
+    if (waveSurface) {
+        glBindTextureUnit(1, waveHeight_);
+        glBindTextureUnit(2, waveVelocity_);
+        glUniform1i(glGetUniformLocation(program_, "uWaveHeight"), 1);
+        glUniform1i(glGetUniformLocation(program_, "uWaveVelocity"), 2);
+        glUniform1f(glGetUniformLocation(program_, "uWaveSize"), waveSize_);
+    }
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, PARTICLES_IN_BINDING, particleBuffers_[current_]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, PARTICLES_OUT_BINDING, particleBuffers_[next]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, COMMANDS_BINDING, commandBuffer_);
+
+    // One thread per new particle, then one per slot the live particles may occupy
+    int threads = burstParticles_ + capacity_;
+    glDispatchCompute((threads + GROUP_SIZE - 1) / GROUP_SIZE, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+    glUseProgram(0);
+
+    bursts_.clear();
+    burstParticles_ = 0;
+    current_ = next;
+}
+
+void FoamParticles::render(GLuint program) {
+    if (!program_) return;
+
+    // Blending and the read-only depth come from the transparent pass (WeightedOIT).
+    // The camera comes from the frame uniform block (foam.vs)
+    glUseProgram(program);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, PARTICLES_IN_BINDING, particleBuffers_[current_]);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer_);
+    glBindVertexArray(vao_);
+    glDrawArraysIndirect(GL_TRIANGLE_FAN, reinterpret_cast<const void*>(current_ * sizeof(DrawCommand)));
+    glBindVertexArray(0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
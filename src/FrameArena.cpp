@@ -0,0 +1,79 @@
+#include "../include/FrameArena.h"
+#include <algorithm>
+#include <new>
+
+namespace WaterSim {
+
+FrameArena& FrameArena::instance() {
+    static FrameArena arena(size_t(1) << 20);
+    return arena;
+}
+
+FrameArena::FrameArena(size_t initialBytes) {
+    allocateBlock(initialBytes);
+}
+
+FrameArena::~FrameArena() {
+    reset();
+    freeBlock();
+}
+
+void* FrameArena::allocate(size_t bytes, size_t alignment) {
+    if (bytes == 0) bytes = 1;
+    if (alignment > BLOCK_ALIGNMENT) return allocateHeap(bytes, alignment);
+
+    // Offsets are relative to a BLOCK_ALIGNMENT-aligned block, so aligning them aligns the pointer
+    size_t offset = offset_.load(std::memory_order_relaxed);
+    size_t aligned;
+    do {
+        aligned = (offset + alignment - 1) & ~(alignment - 1);
+        if (aligned + bytes > capacity_) return allocateHeap(bytes, alignment);
+    } while (!offset_.compare_exchange_weak(offset, aligned + bytes, std::memory_order_relaxed));
+    return block_ + aligned;
+}
+
+void* FrameArena::allocateHeap(size_t bytes, size_t alignment) {
+    alignment = std::max(alignment, alignof(std::max_align_t));
+    void* memory = ::operator new(bytes, std::align_val_t(alignment));
+    std::lock_guard<std::mutex> lock(heapMutex_);
+    heapBlocks_.push_back({ memory, alignment });
+    heapBytes_ += bytes + alignment;
+    stats_.heapAllocations++;
+    return memory;
+}
+
+void FrameArena::reset() {
+    size_t used = std::min(offset_.load(std::memory_order_relaxed), capacity_) + heapBytes_;
+    stats_.peakBytes = std::max(stats_.peakBytes, used);
+
+    for (const HeapBlock& heapBlock : heapBlocks_) {
+        ::operator delete(heapBlock.memory, std::align_val_t(heapBlock.alignment));
+    }
+    heapBlocks_.clear();
+
+    // Overflowed: one block big enough for the whole of this use from now on
+    if (heapBytes_ > 0) {
+        size_t grown = capacity_ + heapBytes_;
+        freeBlock();
+        allocateBlock(grown + grown / 4);
+    }
+    heapBytes_ = 0;
+    offset_.store(0, std::memory_order_relaxed);
+}
+
+void FrameArena::allocateBlock(size_t bytes) {
+    capacity_ = (bytes + BLOCK_ALIGNMENT - 1) & ~(BLOCK_ALIGNMENT - 1);
+    block_ = capacity_ > 0 ? static_cast<char*>(::operator new(capacity_, std::align_val_t(BLOCK_ALIGNMENT))) : nullptr;
+    stats_.capacity = capacity_;
+}
+
+void FrameArena::freeBlock() {
+    if (block_) {
+        ::operator delete(block_, std::align_val_t(BLOCK_ALIGNMENT));
+    }
+    block_ = nullptr;
+    capacity_ = 0;
+    stats_.capacity = 0;
+}
+
+} // namespace WaterSim
@@ -0,0 +1,166 @@
+#include "../include/FrameBudget.h"
+#include <algorithm>
+#include <iostream>
+
+namespace WaterSim {
+
+namespace {
+    constexpr float SMOOTHING = 0.2f;       // Weight of a new sample in the moving averages
+
+    float smooth(float average, float sample) {
+        return average + (sample - average) * SMOOTHING;
+    }
+}
+
+void FrameBudget::setSettings(const Settings& settings) {
+    bool wasEnabled = settings_.enabled;
+    settings_ = settings;
+    settings_.targetMs = std::max(settings_.targetMs, 1.0f);
+    settings_.cooldownFrames = std::max(settings_.cooldownFrames, 0);
+    if (wasEnabled && !settings_.enabled) {
+        resetLevels();
+    }
+    sampled_ = false;
+    frameMs_ = 0.0f;
+    cooldown_ = 0;
+}
+
+void FrameBudget::addKnob(Knob knob) {
+    if (knob.levels.empty() || knob.relativeCost.size() != knob.levels.size() || !knob.apply) {
+        std::cerr << "ERROR: Frame budget knob '" << knob.name << "' needs a cost and an apply per level" << std::endl;
+        return;
+    }
+    KnobState state;
+    state.knob = std::move(knob);
+    knobs_.push_back(std::move(state));
+}
+
+void FrameBudget::update(const FrameGraph& graph) {
+    if (!settings_.enabled) return;
+
+    // A new frame's timings, and only from after the last change
+    uint64_t timed = graph.getTimedFrame();
+    if (timed == 0 || timed == lastTimedFrame_) return;
+    lastTimedFrame_ = timed;
+    if (timed <= changeFrame_) return;
+
+    float frameMs = 0.0f;
+    for (const FrameGraph::PassTiming& pass : graph.getPassTimings()) {
+        frameMs += pass.milliseconds;
+    }
+    for (KnobState& state : knobs_) {
+        state.active = !state.knob.active || state.knob.active();
+        if (!state.active) {
+            // Nothing to save, and back at full rate for when it is needed again
+            if (state.level != 0) setLevel(state, 0);
+            state.sampled = false;
+            continue;
+        }
+
+        // Skipped passes count as zero, so an amortized knob measures its per-frame share
+        float measured = 0.0f;
+        for (const FrameGraph::PassTiming& pass : graph.getPassTimings()) {
+            if (std::find(state.knob.passes.begin(), state.knob.passes.end(), pass.name) != state.knob.passes.end()) {
+                measured += pass.milliseconds;
+            }
+        }
+        if (state.knob.measure) {
+            float outside = state.knob.measure();
+            measured += outside;
+            frameMs += outside;
+        }
+        state.measuredMs = state.sampled ? smooth(state.measuredMs, measured) : measured;
+        state.sampled = true;
+    }
+    frameMs_ = sampled_ ? smooth(frameMs_, frameMs) : frameMs;
+    sampled_ = true;
+
+    if (cooldown_ > 0) {
+        cooldown_--;
+        return;
+    }
+    bool changed = false;
+    if (frameMs_ > settings_.targetMs * (1.0f + settings_.shedMargin)) {
+        changed = shed();
+    } else if (frameMs_ < settings_.targetMs * (1.0f - settings_.restoreMargin)) {
+        changed = restore();
+    }
+    if (changed) {
+        changeFrame_ = graph.getFrame();
+        cooldown_ = settings_.cooldownFrames;
+    }
+}
+
+float FrameBudget::fullCost(const KnobState& state) const {
+    float relative = state.knob.relativeCost[state.level];
+    return relative > 0.0f ? state.measuredMs / relative : 0.0f;
+}
+
+bool FrameBudget::shed() {
+    KnobState* best = nullptr;
+    float bestSaving = 0.0f;
+    for (KnobState& state : knobs_) {
+        if (!state.active || !state.sampled || state.level + 1 >= static_cast<int>(state.knob.levels.size())) continue;
+        const std::vector<float>& cost = state.knob.relativeCost;
+        float saving = fullCost(state) * (cost[state.level] - cost[state.level + 1]);
+        if (saving <= 0.0f) continue;
+        if (!best || state.knob.priority < best->knob.priority ||
+            (state.knob.priority == best->knob.priority && saving > bestSaving)) {
+            best = &state;
+            bestSaving = saving;
+        }
+    }
+    if (!best) return false;
+    setLevel(*best, best->level + 1);
+    return true;
+}
+
+bool FrameBudget::restore() {
+    KnobState* best = nullptr;
+    for (KnobState& state : knobs_) {
+        if (!state.active || !state.sampled || state.level == 0) continue;
+        if (!best || state.knob.priority > best->knob.priority) {
+            best = &state;
+        }
+    }
+    if (!best) return false;
+
+    // Only when the dearer level is predicted to fit, or it would be shed straight away again
+    const std::vector<float>& cost = best->knob.relativeCost;
+    float predicted = frameMs_ + fullCost(*best) * (cost[best->level - 1] - cost[best->level]);
+    if (predicted > settings_.targetMs) return false;
+    setLevel(*best, best->level - 1);
+    return true;
+}
+
+void FrameBudget::setLevel(KnobState& state, int level) {
+    // Rescaled so the average stays an estimate of the new level until it is measured
+    float from = state.knob.relativeCost[state.level];
+    float to = state.knob.relativeCost[level];
+    state.measuredMs = from > 0.0f ? state.measuredMs * to / from : 0.0f;
+    state.level = level;
+    state.knob.apply(level);
+}
+
+void FrameBudget::resetLevels() {
+    for (KnobState& state : knobs_) {
+        if (state.level != 0) setLevel(state, 0);
+        state.sampled = false;
+    }
+}
+
+std::vector<FrameBudget::KnobStatus> FrameBudget::getStatus() const {
+    std::vector<KnobStatus> status;
+    for (const KnobState& state : knobs_) {
+        KnobStatus knob;
+        knob.name = state.knob.name;
+        knob.level = state.knob.levels[state.level];
+        knob.active = state.active;
+        knob.measuredMs = state.measuredMs;
+        knob.fullMs = fullCost(state);
+        status.push_back(knob);
+    }
+    return status;
+}
+
+} // namespace WaterSim
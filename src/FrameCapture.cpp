@@ -0,0 +1,362 @@
+#include "FrameCapture.h"
+#include <algorithm>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#endif
+
+namespace WaterSim {
+
+namespace {
+    uint32_t crcTable[256];
+
+    void initCrcTable() {
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++) c = (c & 1u) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            crcTable[n] = c;
+        }
+    }
+
+    uint32_t crc32(uint32_t crc, const uint8_t* data, size_t size) {
+        crc = ~crc;
+        for (size_t i = 0; i < size; i++) crc = crcTable[(crc ^ data[i]) & 0xFFu] ^ (crc >> 8);
+        return ~crc;
+    }
+
+    void putBigEndian(std::vector<uint8_t>& out, uint32_t value) {
+        for (int shift = 24; shift >= 0; shift -= 8) out.push_back(static_cast<uint8_t>(value >> shift));
+    }
+
+    void writeChunk(std::FILE* file, const char* type, const std::vector<uint8_t>& data) {
+        std::vector<uint8_t> chunk;
+        chunk.reserve(data.size() + 12);
+        putBigEndian(chunk, static_cast<uint32_t>(data.size()));
+        chunk.insert(chunk.end(), type, type + 4);
+        chunk.insert(chunk.end(), data.begin(), data.end());
+        putBigEndian(chunk, crc32(0, chunk.data() + 4, chunk.size() - 4));
+        std::fwrite(chunk.data(), 1, chunk.size(), file);
+    }
+
+    // Unfiltered RGB in stored (uncompressed) deflate blocks: the worker keeps up at full
+    // frame rate, and the files compress well offline
+    bool writePNG(const std::string& path, const uint8_t* rgba, int width, int height) {
+        std::FILE* file = std::fopen(path.c_str(), "wb");
+        if (!file) return false;
+
+        static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+        std::fwrite(signature, 1, sizeof(signature), file);
+
+        std::vector<uint8_t> header;
+        putBigEndian(header, static_cast<uint32_t>(width));
+        putBigEndian(header, static_cast<uint32_t>(height));
+        header.insert(header.end(), { 8, 2, 0, 0, 0 });    // 8-bit RGB, no interlace
+        writeChunk(file, "IHDR", header);
+
+        // Scanlines top-down, from GL's bottom-up rows
+        std::vector<uint8_t> raw;
+        size_t rowSize = size_t(width) * 3 + 1;
+        raw.reserve(rowSize * size_t(height));
+        for (int y = height - 1; y >= 0; y--) {
+            const uint8_t* row = rgba + size_t(y) * size_t(width) * 4;
+            raw.push_back(0);
+            for (int x = 0; x < width; x++) {
+                raw.insert(raw.end(), row + x * 4, row + x * 4 + 3);
+            }
+        }
+
+        std::vector<uint8_t> zlib;
+        zlib.reserve(raw.size() + raw.size() / 65535 * 5 + 16);
+        zlib.push_back(0x78);
+        zlib.push_back(0x01);
+        uint32_t adlerA = 1, adlerB = 0;
+        for (size_t offset = 0; offset < raw.size() || offset == 0; ) {
+            size_t length = std::min<size_t>(raw.size() - offset, 65535);
+            bool last = offset + length >= raw.size();
+            zlib.push_back(last ? 1 : 0);
+            zlib.push_back(static_cast<uint8_t>(length));
+            zlib.push_back(static_cast<uint8_t>(length >> 8));
+            zlib.push_back(static_cast<uint8_t>(~length));
+            zlib.push_back(static_cast<uint8_t>(~length >> 8));
+            zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + length);
+            for (size_t i = offset; i < offset + length; i++) {
+                adlerA = (adlerA + raw[i]) % 65521u;
+                adlerB = (adlerB + adlerA) % 65521u;
+            }
+            offset += length;
+            if (last) break;
+        }
+        putBigEndian(zlib, (adlerB << 16) | adlerA);
+        writeChunk(file, "IDAT", zlib);
+        writeChunk(file, "IEND", {});
+
+        bool ok = std::ferror(file) == 0;
+        std::fclose(file);
+        return ok;
+    }
+}
+
+FrameCapture::~FrameCapture() {
+    stop();
+}
+
+bool FrameCapture::start(const std::string& basePath, int width, int height, int frameRate, bool hardwareEncode) {
+    stop();
+    if (basePath.empty()) return false;
+
+    basePath_ = basePath;
+    streamUrl_.clear();
+    hardwareEncode_ = hardwareEncode;
+    if (!begin(width, height, frameRate)) return false;
+
+    std::cout << "Frame capture started: " << basePath << " (" << width << "x" << height << ")" << std::endl;
+    return true;
+}
+
+bool FrameCapture::startStream(const std::string& url, int width, int height, int frameRate) {
+    stop();
+    if (url.empty()) return false;
+
+    basePath_ = url;
+    streamUrl_ = url;
+    hardwareEncode_ = true;
+    if (!begin(width, height, frameRate)) return false;
+
+    std::cout << "Streaming started: " << url << " (" << width << "x" << height << ")" << std::endl;
+    return true;
+}
+
+bool FrameCapture::begin(int width, int height, int frameRate) {
+    if (width <= 0 || height <= 0) return false;
+
+    width_ = width;
+    height_ = height;
+    frameRate_ = std::max(frameRate, 1);
+
+    GLsizeiptr slotSize = GLsizeiptr(width) * height * 4;
+    GLbitfield readbackFlags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    for (int i = 0; i < CAPTURE_SLOTS; i++) {
+        glCreateBuffers(1, &buffers_[i]);
+        glNamedBufferStorage(buffers_[i], slotSize, nullptr, readbackFlags);
+        pointers_[i] = static_cast<const uint8_t*>(glMapNamedBufferRange(buffers_[i], 0, slotSize, readbackFlags));
+        states_[i] = SlotState::FREE;
+    }
+
+    initCrcTable();
+#ifndef _WIN32
+    // A dead encoder pipe should fail the write, not end the process
+    std::signal(SIGPIPE, SIG_IGN);
+#endif
+
+    nextSlot_ = 0;
+    capturedFrames_ = 0;
+    droppedFrames_ = 0;
+    writtenFrames_ = 0;
+    encoder_ = Encoder::NONE;
+    stopping_ = false;
+    recording_ = true;
+    worker_ = std::thread(&FrameCapture::workerLoop, this);
+    return true;
+}
+
+void FrameCapture::stop() {
+    if (!recording_) return;
+
+    // Drain the ring; blocking is acceptable when the recording ends
+    for (int i = 0; i < CAPTURE_SLOTS; i++) {
+        if (fences_[i]) glClientWaitSync(fences_[i], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+    }
+    poll();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_one();
+    worker_.join();
+
+    for (int i = 0; i < CAPTURE_SLOTS; i++) {
+        if (fences_[i]) glDeleteSync(fences_[i]);
+        if (buffers_[i]) glDeleteBuffers(1, &buffers_[i]);
+        fences_[i] = 0;
+        buffers_[i] = 0;
+        pointers_[i] = nullptr;
+        states_[i] = SlotState::FREE;
+    }
+    queue_.clear();
+    recording_ = false;
+    streamUrl_.clear();
+
+    std::cout << "Frame capture finished: " << writtenFrames_ << " frames written ("
+              << getEncoderName() << "), " << droppedFrames_ << " dropped" << std::endl;
+}
+
+void FrameCapture::capture(int width, int height) {
+    if (!recording_) return;
+
+    int slot = nextSlot_;
+    bool free;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        free = states_[slot] == SlotState::FREE;
+    }
+    if (!free || !pointers_[slot] || width != width_ || height != height_) {
+        droppedFrames_++; // Ring busy or resized: skip rather than stall
+        return;
+    }
+
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, buffers_[slot]);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    fences_[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    frameIndices_[slot] = capturedFrames_++;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        states_[slot] = SlotState::READING;
+    }
+    nextSlot_ = (slot + 1) % CAPTURE_SLOTS;
+}
+
+void FrameCapture::poll() {
+    if (!recording_) return;
+
+    // Oldest first, so frames reach the worker in capture order
+    bool queued = false;
+    for (int i = 0; i < CAPTURE_SLOTS; i++) {
+        int slot = (nextSlot_ + i) % CAPTURE_SLOTS;
+        if (!fences_[slot]) continue;
+
+        GLenum status = glClientWaitSync(fences_[slot], 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) break;
+
+        glDeleteSync(fences_[slot]);
+        fences_[slot] = 0;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        states_[slot] = SlotState::ENCODING;
+        queue_.push_back(slot);
+        queued = true;
+    }
+    if (queued) wake_.notify_one();
+}
+
+void FrameCapture::workerLoop() {
+    openEncoder();
+
+    while (true) {
+        int slot;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+            if (queue_.empty()) break;
+            slot = queue_.front();
+            queue_.pop_front();
+        }
+
+        if (encodeFrame(pointers_[slot], frameIndices_[slot])) {
+            writtenFrames_++;
+        } else {
+            droppedFrames_++;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        states_[slot] = SlotState::FREE;
+    }
+
+    closeEncoder();
+}
+
+void FrameCapture::openEncoder() {
+    bool streaming = !streamUrl_.empty();
+    encoder_ = streaming ? Encoder::NONE : Encoder::PNG_SEQUENCE;
+    if (!hardwareEncode_) return;
+
+    // Probed here rather than in start(), so spawning ffmpeg never costs the render thread
+    bool hasNvenc = false;
+    bool hasX264 = false;
+    if (std::FILE* probe = popen("ffmpeg -hide_banner -encoders 2>&1", "r")) {
+        char line[512];
+        while (std::fgets(line, sizeof(line), probe)) {
+            if (std::strstr(line, "h264_nvenc")) hasNvenc = true;
+            if (std::strstr(line, "libx264")) hasX264 = true;
+        }
+        pclose(probe);
+    }
+
+    Encoder encoder = Encoder::NVENC;
+    std::string codec;
+    std::string output;
+    if (streaming) {
+        if (hasNvenc) {
+            codec = " -c:v h264_nvenc -preset p1 -tune ull -zerolatency 1 -rc cbr -b:v 8M";
+        } else if (hasX264) {
+            encoder = Encoder::SOFTWARE_H264;
+            codec = " -c:v libx264 -preset ultrafast -tune zerolatency -b:v 8M";
+        } else {
+            std::cerr << "Streaming: ffmpeg with an H.264 encoder not found, frames are dropped" << std::endl;
+            return;
+        }
+        codec += " -bf 0 -g " + std::to_string(frameRate_);
+        output = " -f rtp \"" + streamUrl_ + "\"";
+    } else {
+        if (!hasNvenc) {
+            std::cout << "Frame capture: ffmpeg with h264_nvenc not found, writing a PNG sequence" << std::endl;
+            return;
+        }
+        codec = " -c:v h264_nvenc -preset p4 -cq 20";
+        output = " \"" + basePath_ + ".mp4\"";
+    }
+
+    // GL rows are bottom-up, hence the flip
+    std::string command = "ffmpeg -y -hide_banner -loglevel error -f rawvideo -pixel_format rgba" +
+                          std::string(" -video_size ") + std::to_string(width_) + "x" + std::to_string(height_) +
+                          " -framerate " + std::to_string(frameRate_) + " -i - -vf vflip" +
+                          codec + " -pix_fmt yuv420p" + output;
+#ifdef _WIN32
+    pipe_ = popen(command.c_str(), "wb");
+#else
+    pipe_ = popen(command.c_str(), "w");
+#endif
+    if (pipe_) encoder_ = encoder;
+}
+
+void FrameCapture::closeEncoder() {
+    if (pipe_) {
+        pclose(pipe_);
+        pipe_ = nullptr;
+    }
+}
+
+bool FrameCapture::encodeFrame(const uint8_t* pixels, uint32_t frameIndex) {
+    size_t frameSize = size_t(width_) * size_t(height_) * 4;
+    if (pipe_) {
+        if (std::fwrite(pixels, 1, frameSize, pipe_) == frameSize) return true;
+
+        // The encoder went away: the rest of a recording becomes a PNG sequence
+        std::cerr << "Frame capture: video encoder failed at frame " << frameIndex << std::endl;
+        closeEncoder();
+        encoder_ = streamUrl_.empty() ? Encoder::PNG_SEQUENCE : Encoder::NONE;
+    }
+    if (encoder_ != Encoder::PNG_SEQUENCE) return false;
+
+    char suffix[32];
+    std::snprintf(suffix, sizeof(suffix), "_%06u.png", frameIndex);
+    return writePNG(basePath_ + suffix, pixels, width_, height_);
+}
+
+const char* FrameCapture::getEncoderName() const {
+    switch (encoder_.load()) {
+        case Encoder::NVENC: return "h264_nvenc";
+        case Encoder::SOFTWARE_H264: return "libx264";
+        case Encoder::PNG_SEQUENCE: return "PNG sequence";
+        default: return "none";
+    }
+}
+
+} // namespace WaterSim
@@ -0,0 +1,484 @@
+#include "FrameGraph.h"
+#include "GPUMemoryTracker.h"
+#include "Profiler.h"
+#include "RenderTargetPool.h"
+#include <algorithm>
+#include <iostream>
+#include <unordered_map>
+
+namespace WaterSim {
+
+namespace {
+
+// The barrier that makes an earlier image store visible to an access
+GLbitfield barrierFor(FrameGraphAccess access) {
+    switch (access) {
+        case FrameGraphAccess::ATTACHMENT: return GL_FRAMEBUFFER_BARRIER_BIT;
+        case FrameGraphAccess::SAMPLED:    return GL_TEXTURE_FETCH_BARRIER_BIT;
+        case FrameGraphAccess::IMAGE:      return GL_SHADER_IMAGE_ACCESS_BARRIER_BIT;
+        case FrameGraphAccess::RENDERED:   return GL_FRAMEBUFFER_BARRIER_BIT;
+    }
+    return 0;
+}
+
+} // namespace
+
+bool FrameGraphTextureDesc::isDepth() const {
+    return internalFormat == GL_DEPTH_COMPONENT16 || internalFormat == GL_DEPTH_COMPONENT24 ||
+           internalFormat == GL_DEPTH_COMPONENT32F || internalFormat == GL_DEPTH24_STENCIL8 ||
+           internalFormat == GL_DEPTH32F_STENCIL8;
+}
+
+FrameGraph::Resource FrameGraph::Builder::read(Resource resource, FrameGraphAccess access) {
+    if (resource == INVALID_RESOURCE) return resource;
+    graph_.passes_[pass_].reads.push_back({ resource, access });
+    return resource;
+}
+
+FrameGraph::Resource FrameGraph::Builder::write(Resource resource, FrameGraphAccess access) {
+    if (resource == INVALID_RESOURCE) return resource;
+    PassNode& pass = graph_.passes_[pass_];
+    for (const Access& existing : pass.writes) {
+        if (existing.resource == resource) return resource;
+    }
+    pass.writes.push_back({ resource, access });
+    graph_.resources_[resource].writers.push_back(pass_);
+    return resource;
+}
+
+void FrameGraph::Builder::setSideEffect() {
+    graph_.passes_[pass_].sideEffect = true;
+}
+
+GLuint FrameGraph::PassResources::getTexture(Resource resource) const {
+    if (resource == INVALID_RESOURCE) return 0;
+    return graph_.resources_[resource].texture;
+}
+
+FrameGraph::~FrameGraph() {
+    for (const auto& entry : framebuffers_) {
+        glDeleteFramebuffers(1, &entry.second);
+    }
+    for (const PooledTexture& pooled : pool_) {
+        RenderTargetPool::instance().release(pooled.texture);
+    }
+    setTiming(false);
+}
+
+FrameGraph::Resource FrameGraph::createTexture(const std::string& name, const FrameGraphTextureDesc& desc) {
+    ResourceNode node;
+    node.name = name;
+    node.desc = desc;
+    resources_.push_back(node);
+    return static_cast<Resource>(resources_.size() - 1);
+}
+
+FrameGraph::Resource FrameGraph::importTexture(const std::string& name, GLuint texture, const FrameGraphTextureDesc& desc) {
+    ResourceNode node;
+    node.name = name;
+    node.desc = desc;
+    node.imported = true;
+    node.texture = texture;
+    resources_.push_back(node);
+    return static_cast<Resource>(resources_.size() - 1);
+}
+
+void FrameGraph::addPass(const std::string& name, const SetupFunction& setup, ExecuteFunction execute) {
+    PassNode node;
+    node.name = name;
+    node.execute = std::move(execute);
+    passes_.push_back(std::move(node));
+
+    Builder builder(*this, static_cast<int>(passes_.size() - 1));
+    setup(builder);
+}
+
+void FrameGraph::compile() {
+    frame_++;
+    stats_ = Stats();
+    stats_.passes = static_cast<int>(passes_.size());
+
+    cullPasses();
+    computeLifetimes();
+    assignTextures();
+    deriveBarriers();
+    prepareFramebuffers();
+    releaseIdleTextures();
+
+    for (const PooledTexture& pooled : pool_) {
+        stats_.pooledBytes += textureBytes(pooled.desc);
+    }
+    compiled_ = true;
+}
+
+void FrameGraph::cullPasses() {
+    // A pass is referenced by the resources it writes, a resource by the passes reading it.
+    // A pass reading what it also writes (blending onto its target) does not keep itself alive
+    for (PassNode& pass : passes_) {
+        pass.references = static_cast<int>(pass.writes.size());
+        pass.culled = false;
+    }
+    for (ResourceNode& resource : resources_) {
+        resource.readers = 0;
+    }
+    for (const PassNode& pass : passes_) {
+        for (const Access& read : pass.reads) {
+            bool writesIt = std::any_of(pass.writes.begin(), pass.writes.end(),
+                                        [&](const Access& write) { return write.resource == read.resource; });
+            if (!writesIt) resources_[read.resource].readers++;
+        }
+    }
+
+    // Unread resources release their writers; a writer left unreferenced is culled and
+    // releases what it reads in turn
+    std::vector<Resource> unread;
+    for (size_t i = 0; i < resources_.size(); i++) {
+        if (resources_[i].readers == 0) unread.push_back(static_cast<Resource>(i));
+    }
+    auto cull = [&](PassNode& pass) {
+        pass.culled = true;
+        for (const Access& read : pass.reads) {
+            ResourceNode& resource = resources_[read.resource];
+            bool writesIt = std::any_of(pass.writes.begin(), pass.writes.end(),
+                                        [&](const Access& write) { return write.resource == read.resource; });
+            if (!writesIt && --resource.readers == 0) unread.push_back(read.resource);
+        }
+    };
+    for (PassNode& pass : passes_) {
+        if (pass.references == 0 && !pass.sideEffect) cull(pass);
+    }
+    while (!unread.empty()) {
+        Resource resource = unread.back();
+        unread.pop_back();
+        for (int writer : resources_[resource].writers) {
+            PassNode& pass = passes_[writer];
+            if (pass.culled || pass.sideEffect) continue;
+            if (--pass.references == 0) cull(pass);
+        }
+    }
+
+    for (const PassNode& pass : passes_) {
+        if (pass.culled) stats_.culledPasses++;
+    }
+}
+
+void FrameGraph::computeLifetimes() {
+    for (ResourceNode& resource : resources_) {
+        resource.firstPass = -1;
+        resource.lastPass = -1;
+    }
+    for (size_t i = 0; i < passes_.size(); i++) {
+        const PassNode& pass = passes_[i];
+        if (pass.culled) continue;
+        auto touch = [&](const Access& access) {
+            ResourceNode& resource = resources_[access.resource];
+            if (resource.firstPass < 0) resource.firstPass = static_cast<int>(i);
+            resource.lastPass = static_cast<int>(i);
+        };
+        std::for_each(pass.reads.begin(), pass.reads.end(), touch);
+        std::for_each(pass.writes.begin(), pass.writes.end(), touch);
+    }
+}
+
+void FrameGraph::assignTextures() {
+    for (PooledTexture& pooled : pool_) {
+        pooled.busyUntilPass = -1;
+    }
+
+    // In order of first use, each transient takes a pooled texture of its description that
+    // is free by then, so transients with disjoint lifetimes share one
+    std::vector<Resource> transients;
+    for (size_t i = 0; i < resources_.size(); i++) {
+        if (!resources_[i].imported && resources_[i].firstPass >= 0) transients.push_back(static_cast<Resource>(i));
+    }
+    std::stable_sort(transients.begin(), transients.end(), [&](Resource a, Resource b) {
+        return resources_[a].firstPass < resources_[b].firstPass;
+    });
+
+    std::vector<GLuint> physical;
+    for (Resource index : transients) {
+        ResourceNode& resource = resources_[index];
+        PooledTexture* chosen = nullptr;
+        for (PooledTexture& pooled : pool_) {
+            if (pooled.desc == resource.desc && pooled.busyUntilPass < resource.firstPass) {
+                chosen = &pooled;
+                break;
+            }
+        }
+        if (!chosen) {
+            PooledTexture pooled;
+            pooled.desc = resource.desc;
+            pooled.texture = createPooledTexture(resource.desc);
+            pool_.push_back(pooled);
+            chosen = &pool_.back();
+        }
+        chosen->busyUntilPass = resource.lastPass;
+        chosen->lastUsedFrame = frame_;
+        resource.texture = chosen->texture;
+
+        if (std::find(physical.begin(), physical.end(), chosen->texture) == physical.end()) {
+            physical.push_back(chosen->texture);
+        }
+    }
+    stats_.transientTextures = static_cast<int>(transients.size());
+    stats_.physicalTextures = static_cast<int>(physical.size());
+
+    // Unused transients keep no texture
+    for (ResourceNode& resource : resources_) {
+        if (!resource.imported && resource.firstPass < 0) resource.texture = 0;
+    }
+}
+
+void FrameGraph::deriveBarriers() {
+    // Per texture: the barrier bits issued since an image store left it pending. Textures
+    // rather than resources, so the store of a transient also covers the next one aliasing it
+    std::unordered_map<GLuint, GLbitfield> pendingStores;
+    for (PassNode& pass : passes_) {
+        pass.barriers = 0;
+        if (pass.culled) continue;
+
+        auto need = [&](const Access& access) {
+            GLuint texture = resources_[access.resource].texture;
+            auto it = pendingStores.find(texture);
+            if (it == pendingStores.end()) return;
+            GLbitfield bit = barrierFor(access.access);
+            if (!(it->second & bit)) pass.barriers |= bit;
+        };
+        std::for_each(pass.reads.begin(), pass.reads.end(), need);
+        std::for_each(pass.writes.begin(), pass.writes.end(), need);
+
+        // glMemoryBarrier is global: what this pass issues covers every pending store
+        for (auto& pending : pendingStores) {
+            pending.second |= pass.barriers;
+        }
+        for (const Access& write : pass.writes) {
+            GLuint texture = resources_[write.resource].texture;
+            if (write.access == FrameGraphAccess::IMAGE) {
+                pendingStores[texture] = 0;
+            } else {
+                pendingStores.erase(texture);
+            }
+        }
+    }
+}
+
+void FrameGraph::prepareFramebuffers() {
+    for (PassNode& pass : passes_) {
+        pass.hasAttachments = false;
+        pass.framebuffer = 0;
+        if (pass.culled) continue;
+
+        // Attachments in declaration order: writes first, then targets only tested against
+        std::vector<GLuint> colors;
+        GLuint depth = 0;
+        bool defaultFramebuffer = false;
+        auto attach = [&](const Access& access) {
+            if (access.access != FrameGraphAccess::ATTACHMENT) return;
+            const ResourceNode& resource = resources_[access.resource];
+            if (!pass.hasAttachments) {
+                pass.viewportWidth = resource.desc.width;
+                pass.viewportHeight = resource.desc.height;
+            }
+            pass.hasAttachments = true;
+            if (resource.imported && resource.texture == 0) {
+                defaultFramebuffer = true;
+            } else if (resource.desc.isDepth()) {
+                depth = resource.texture;
+            } else if (std::find(colors.begin(), colors.end(), resource.texture) == colors.end()) {
+                colors.push_back(resource.texture);
+            }
+        };
+        std::for_each(pass.writes.begin(), pass.writes.end(), attach);
+        std::for_each(pass.reads.begin(), pass.reads.end(), attach);
+
+        if (!pass.hasAttachments) continue;
+        if (defaultFramebuffer) {
+            if (!colors.empty() || depth != 0) {
+                std::cerr << "FrameGraph: pass " << pass.name << " mixes the default framebuffer with textures" << std::endl;
+            }
+            continue;
+        }
+        pass.framebuffer = getFramebuffer(colors, depth);
+    }
+}
+
+void FrameGraph::releaseIdleTextures() {
+    // Textures of culled passes and old window sizes go once they sit idle long enough
+    for (size_t i = 0; i < pool_.size();) {
+        if (frame_ - pool_[i].lastUsedFrame <= IDLE_FRAMES_BEFORE_RELEASE) {
+            i++;
+            continue;
+        }
+        GLuint texture = pool_[i].texture;
+        for (auto it = framebuffers_.begin(); it != framebuffers_.end();) {
+            if (std::find(it->first.begin(), it->first.end(), texture) != it->first.end()) {
+                glDeleteFramebuffers(1, &it->second);
+                it = framebuffers_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        RenderTargetPool::instance().release(texture);
+        pool_.erase(pool_.begin() + i);
+    }
+}
+
+void FrameGraph::setTiming(bool enable) {
+    if (enable == timing_) return;
+    timing_ = enable;
+    if (!enable) {
+        for (TimerSlot& slot : timerSlots_) {
+            if (!slot.queries.empty()) {
+                glDeleteQueries(static_cast<GLsizei>(slot.queries.size()), slot.queries.data());
+            }
+            slot = TimerSlot();
+        }
+        passTimings_.clear();
+        timedFrame_ = 0;
+    }
+}
+
+bool FrameGraph::readBackTimings() {
+    // The oldest pending slot only, so a caller reading after every call sees every frame
+    for (int i = 0; i < TIMER_FRAMES; i++) {
+        TimerSlot& slot = timerSlots_[(timerSlot_ + i) % TIMER_FRAMES];
+        if (!slot.pending) continue;
+
+        // The last timestamp is the last to land; once it has, all of them have. Frames
+        // finish in order, so a newer slot is not ready either
+        size_t marks = slot.passNames.size() + 1;
+        GLint available = 0;
+        glGetQueryObjectiv(slot.queries[marks - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) return false;
+
+        std::vector<GLuint64> timestamps(marks);
+        for (size_t mark = 0; mark < marks; mark++) {
+            glGetQueryObjectui64v(slot.queries[mark], GL_QUERY_RESULT, &timestamps[mark]);
+        }
+        passTimings_.resize(slot.passNames.size());
+        for (size_t pass = 0; pass < slot.passNames.size(); pass++) {
+            passTimings_[pass].name = slot.passNames[pass];
+            passTimings_[pass].milliseconds = static_cast<float>(timestamps[pass + 1] - timestamps[pass]) / 1.0e6f;
+        }
+        timedFrame_ = slot.frame;
+        slot.pending = false;
+        return true;
+    }
+    return false;
+}
+
+void FrameGraph::execute() {
+    if (!compiled_) compile();
+
+    // Time this frame in the next ring slot, unless the GPU still owes that slot's results
+    TimerSlot* timer = nullptr;
+    if (timing_) {
+        readBackTimings();
+        if (!timerSlots_[timerSlot_].pending) {
+            timer = &timerSlots_[timerSlot_];
+            timerSlot_ = (timerSlot_ + 1) % TIMER_FRAMES;
+
+            size_t marks = 1;
+            for (const PassNode& pass : passes_) {
+                if (!pass.culled) marks++;
+            }
+            while (timer->queries.size() < marks) {
+                GLuint query = 0;
+                glCreateQueries(GL_TIMESTAMP, 1, &query);
+                timer->queries.push_back(query);
+            }
+            timer->passNames.clear();
+            timer->frame = frame_;
+            timer->pending = true;
+            glQueryCounter(timer->queries[0], GL_TIMESTAMP);
+        }
+    }
+
+    for (size_t i = 0; i < passes_.size(); i++) {
+        PassNode& pass = passes_[i];
+        if (pass.culled) continue;
+
+        if (pass.barriers) {
+            glMemoryBarrier(pass.barriers);
+        }
+        if (pass.hasAttachments) {
+            glBindFramebuffer(GL_FRAMEBUFFER, pass.framebuffer);
+            glViewport(0, 0, pass.viewportWidth, pass.viewportHeight);
+        }
+        if (pass.execute) {
+            ProfileScope scope(pass.name);
+            pass.execute(PassResources(*this, pass.framebuffer));
+        }
+        if (timer) {
+            timer->passNames.push_back(pass.name);
+            glQueryCounter(timer->queries[timer->passNames.size()], GL_TIMESTAMP);
+        }
+    }
+}
+
+void FrameGraph::reset() {
+    passes_.clear();
+    resources_.clear();
+    compiled_ = false;
+}
+
+bool FrameGraph::isPassCulled(const std::string& name) const {
+    for (const PassNode& pass : passes_) {
+        if (pass.name == name) return pass.culled;
+    }
+    return true;
+}
+
+GLuint FrameGraph::createPooledTexture(const FrameGraphTextureDesc& desc) {
+    // Linear and clamped; from the shared pool, so a size another subsystem gave up is reused
+    GPUMemoryScope memoryScope("Frame graph");
+    return RenderTargetPool::instance().acquire2D(desc.internalFormat, desc.width, desc.height);
+}
+
+GLuint FrameGraph::getFramebuffer(const std::vector<GLuint>& colors, GLuint depth) {
+    std::vector<GLuint> key;
+    key.push_back(depth);
+    key.insert(key.end(), colors.begin(), colors.end());
+
+    auto it = framebuffers_.find(key);
+    if (it != framebuffers_.end()) return it->second;
+
+    GLuint fbo = 0;
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    std::vector<GLenum> drawBuffers;
+    for (size_t i = 0; i < colors.size(); i++) {
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GLenum(GL_COLOR_ATTACHMENT0 + i), GL_TEXTURE_2D, colors[i], 0);
+        drawBuffers.push_back(GLenum(GL_COLOR_ATTACHMENT0 + i));
+    }
+    if (depth != 0) {
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depth, 0);
+    }
+    if (drawBuffers.empty()) {
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+    } else {
+        glDrawBuffers(static_cast<GLsizei>(drawBuffers.size()), drawBuffers.data());
+    }
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "FrameGraph: framebuffer is not complete" << std::endl;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    framebuffers_[key] = fbo;
+    return fbo;
+}
+
+size_t FrameGraph::textureBytes(const FrameGraphTextureDesc& desc) {
+    size_t bytesPerPixel = 4;
+    switch (desc.internalFormat) {
+        case GL_R8: bytesPerPixel = 1; break;
+        case GL_R16F: case GL_DEPTH_COMPONENT16: bytesPerPixel = 2; break;
+        case GL_RGBA16F: case GL_RG32F: case GL_DEPTH32F_STENCIL8: bytesPerPixel = 8; break;
+        case GL_RGBA32F: bytesPerPixel = 16; break;
+        default: break;
+    }
+    return bytesPerPixel * size_t(desc.width) * size_t(desc.height);
+}
+
+} // namespace WaterSim
@@ -0,0 +1,150 @@
+#include "FramePacer.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <thread>
+
+namespace WaterSim {
+
+namespace {
+
+constexpr GLuint64 FENCE_TIMEOUT_NS = 100000000;   // Per wait; the loop waits on regardless
+
+double msBetween(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end) {
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+} // namespace
+
+int64_t FramePacer::nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+}
+
+void FramePacer::setMaxFramesInFlight(int frames) {
+    maxFramesInFlight_ = std::clamp(frames, 1, MAX_FRAMES_IN_FLIGHT);
+}
+
+void FramePacer::setFrameRateCap(float framesPerSecond) {
+    frameRateCap_ = std::max(framesPerSecond, 0.0f);
+    if (frameRateCap_ == 0.0f) {
+        limiterStarted_ = false;
+    }
+}
+
+void FramePacer::syncClocks() {
+    GLint64 gpuNow = 0;
+    glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+    gpuClockOffset_ = static_cast<int64_t>(gpuNow) - nowNs();
+    clockSyncFrame_ = frames_;
+    clockSynced_ = true;
+}
+
+void FramePacer::beginFrame() {
+    if (!clockSynced_ || frames_ >= clockSyncFrame_ + CLOCK_SYNC_FRAMES) {
+        syncClocks();
+    }
+
+    // Whatever the GPU has finished, without waiting
+    while (!inFlight_.empty()) {
+        GLenum status = glClientWaitSync(inFlight_.front().fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) break;
+        retire(inFlight_.front());
+        inFlight_.pop_front();
+    }
+
+    Clock::time_point waitStart = Clock::now();
+    if (static_cast<int>(inFlight_.size()) >= maxFramesInFlight_) {
+        ProfileScope scope("Frame pacing: GPU");
+        while (static_cast<int>(inFlight_.size()) >= maxFramesInFlight_) {
+            GLenum status = glClientWaitSync(inFlight_.front().fence, GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT_NS);
+            if (status == GL_TIMEOUT_EXPIRED) continue;
+            retire(inFlight_.front());
+            inFlight_.pop_front();
+        }
+    }
+    Clock::time_point limiterStart = Clock::now();
+    stats_.gpuWaitMs = msBetween(waitStart, limiterStart);
+    stats_.framesInFlight = static_cast<int>(inFlight_.size());
+
+    // Frames start on a fixed period; one that is already late restarts the schedule rather
+    // than running the next ones back to back to catch up
+    stats_.limiterWaitMs = 0.0;
+    if (frameRateCap_ > 0.0f) {
+        auto period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / frameRateCap_));
+        Clock::time_point target = limiterStarted_ ? nextFrameStart_ + period : limiterStart;
+        if (target < limiterStart) {
+            target = limiterStart;
+        } else if (target > limiterStart) {
+            ProfileScope scope("Frame pacing: limiter");
+            if (target - limiterStart > SPIN_MARGIN) {
+                std::this_thread::sleep_for(target - limiterStart - SPIN_MARGIN);
+            }
+            while (Clock::now() < target) {
+                std::this_thread::yield();
+            }
+            stats_.limiterWaitMs = msBetween(limiterStart, Clock::now());
+        }
+        nextFrameStart_ = target;
+        limiterStarted_ = true;
+    }
+    inputNs_ = -1;
+}
+
+void FramePacer::markInputSampled() {
+    inputNs_ = nowNs();
+}
+
+void FramePacer::endFrame() {
+    InFlight frame;
+    if (!freeQueries_.empty()) {
+        frame.query = freeQueries_.front();
+        freeQueries_.pop_front();
+    } else {
+        glCreateQueries(GL_TIMESTAMP, 1, &frame.query);
+    }
+    glQueryCounter(frame.query, GL_TIMESTAMP);
+    frame.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    frame.inputNs = inputNs_;
+    inFlight_.push_back(frame);
+    frames_++;
+}
+
+void FramePacer::retire(InFlight& frame) {
+    glDeleteSync(frame.fence);
+    frame.fence = nullptr;
+    if (frame.inputNs >= 0) {
+        // Signaled fence: the timestamp before it has landed
+        GLuint64 gpuNs = 0;
+        glGetQueryObjectui64v(frame.query, GL_QUERY_RESULT, &gpuNs);
+        int64_t displayNs = static_cast<int64_t>(gpuNs) - gpuClockOffset_;
+        stats_.latencyMs = std::max(static_cast<double>(displayNs - frame.inputNs) / 1.0e6, 0.0);
+
+        latencyHistory_.push_back(static_cast<float>(stats_.latencyMs));
+        while (latencyHistory_.size() > HISTORY_FRAMES) {
+            latencyHistory_.pop_front();
+        }
+        double sum = 0.0;
+        double maximum = 0.0;
+        for (float latency : latencyHistory_) {
+            sum += latency;
+            maximum = std::max(maximum, static_cast<double>(latency));
+        }
+        stats_.averageLatencyMs = sum / static_cast<double>(latencyHistory_.size());
+        stats_.maxLatencyMs = maximum;
+    }
+    freeQueries_.push_back(frame.query);
+    frame.query = 0;
+}
+
+void FramePacer::shutdown() {
+    for (InFlight& frame : inFlight_) {
+        glDeleteSync(frame.fence);
+        glDeleteQueries(1, &frame.query);
+    }
+    inFlight_.clear();
+    for (GLuint query : freeQueries_) {
+        glDeleteQueries(1, &query);
+    }
+    freeQueries_.clear();
+}
+
+} // namespace WaterSim
@@ -1,4 +1,6 @@
 #include "../include/Framebuffer.h"
+#include "../include/GPUMemoryTracker.h"
+#include "../include/RenderTargetPool.h"
 
 Framebuffer::Framebuffer(int width, int height, FramebufferType type, int samples)
     : width(width), height(height), type(type), samples(samples),
@@ -11,87 +13,73 @@ Framebuffer::~Framebuffer() {
 }
 
 void Framebuffer::create() {
-    // Generate framebuffer
-    glGenFramebuffers(1, &fbo);
-    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    WaterSim::GPUMemoryScope memoryScope("Scene targets");
+    // Immutable storage through DSA; resize() gives the textures back to the render target
+    // pool and takes ones of the new size, linear and clamped
+    glCreateFramebuffers(1, &fbo);
+    WaterSim::RenderTargetPool& pool = WaterSim::RenderTargetPool::instance();
 
     // Create color attachment
     if (type != FRAMEBUFFER_DEPTH_ONLY) {
         if (samples > 1 && type == FRAMEBUFFER_MULTISAMPLED) {
             // Multisampled color texture
-            glGenTextures(1, &colorTexture);
-            glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, colorTexture);
-            glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, samples, GL_RGBA16F, width, height, GL_TRUE);
-            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D_MULTISAMPLE, colorTexture, 0);
+            WaterSim::RenderTargetDesc desc;
+            desc.target = GL_TEXTURE_2D_MULTISAMPLE;
+            desc.width = width;
+            desc.height = height;
+            desc.samples = samples;
+            colorTexture = pool.acquire(desc);
         } else {
             // Regular color texture with float precision for HDR
-            glGenTextures(1, &colorTexture);
-            glBindTexture(GL_TEXTURE_2D, colorTexture);
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_FLOAT, nullptr);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexture, 0);
+            colorTexture = pool.acquire2D(GL_RGBA16F, width, height);
         }
+        glNamedFramebufferTexture(fbo, GL_COLOR_ATTACHMENT0, colorTexture, 0);
     }
 
     // Create depth attachment
     if (type != FRAMEBUFFER_COLOR_ONLY) {
         if (type == FRAMEBUFFER_DEPTH_ONLY || (type == FRAMEBUFFER_COLOR_DEPTH && samples == 1)) {
             // Depth texture (can be sampled in shaders)
-            glGenTextures(1, &depthTexture);
-            glBindTexture(GL_TEXTURE_2D, depthTexture);
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+            depthTexture = pool.acquire2D(GL_DEPTH_COMPONENT24, width, height);
+            glNamedFramebufferTexture(fbo, GL_DEPTH_ATTACHMENT, depthTexture, 0);
         } else {
             // Depth renderbuffer (cannot be sampled, but faster)
-            glGenRenderbuffers(1, &depthRenderbuffer);
-            glBindRenderbuffer(GL_RENDERBUFFER, depthRenderbuffer);
+            glCreateRenderbuffers(1, &depthRenderbuffer);
             if (samples > 1 && type == FRAMEBUFFER_MULTISAMPLED) {
-                glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_DEPTH_COMPONENT24, width, height);
+                glNamedRenderbufferStorageMultisample(depthRenderbuffer, samples, GL_DEPTH_COMPONENT24, width, height);
             } else {
-                glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+                glNamedRenderbufferStorage(depthRenderbuffer, GL_DEPTH_COMPONENT24, width, height);
             }
-            glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthRenderbuffer);
+            glNamedFramebufferRenderbuffer(fbo, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthRenderbuffer);
         }
     }
 
     // Set draw buffers
     if (type == FRAMEBUFFER_DEPTH_ONLY) {
-        glDrawBuffer(GL_NONE);
-        glReadBuffer(GL_NONE);
+        glNamedFramebufferDrawBuffer(fbo, GL_NONE);
+        glNamedFramebufferReadBuffer(fbo, GL_NONE);
     }
 
     // Check framebuffer completeness
     if (!isComplete()) {
         std::cerr << "Framebuffer is not complete!" << std::endl;
     }
-
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
 void Framebuffer::destroy() {
-    if (colorTexture) {
-        glDeleteTextures(1, &colorTexture);
-        colorTexture = 0;
-    }
-    if (depthTexture) {
-        glDeleteTextures(1, &depthTexture);
-        depthTexture = 0;
+    // The framebuffer first, so the pool's textures go back unattached
+    if (fbo) {
+        glDeleteFramebuffers(1, &fbo);
+        fbo = 0;
     }
+    WaterSim::RenderTargetPool::instance().release(colorTexture);
+    WaterSim::RenderTargetPool::instance().release(depthTexture);
+    colorTexture = 0;
+    depthTexture = 0;
     if (depthRenderbuffer) {
         glDeleteRenderbuffers(1, &depthRenderbuffer);
         depthRenderbuffer = 0;
     }
-    if (fbo) {
-        glDeleteFramebuffers(1, &fbo);
-        fbo = 0;
-    }
 }
 
 void Framebuffer::bind() const {
@@ -121,9 +109,7 @@ void Framebuffer::clear(const glm::vec4& clearColor) {
 }
 
 bool Framebuffer::isComplete() const {
-    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    GLenum status = glCheckNamedFramebufferStatus(fbo, GL_FRAMEBUFFER);
     
     if (status != GL_FRAMEBUFFER_COMPLETE) {
         switch (status) {
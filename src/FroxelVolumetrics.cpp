@@ -0,0 +1,109 @@
+#include "../include/FroxelVolumetrics.h"
+#include "../include/GPUMemoryTracker.h"
+#include "../include/ShaderCompiler.h"
+#include "../include/ShadowMapper.h"
+#include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
+#include <cmath>
+
+namespace WaterSim {
+
+namespace {
+    constexpr int GROUP_SIZE = 8;       // froxel_inject.cs and froxel_integrate.cs, in x and y
+    constexpr float WATER_IOR = 1.33f;  // As water.fs and the ray tracer refract
+    constexpr int CAUSTIC_UNIT = 0;
+    constexpr int HISTORY_UNIT = 1;
+}
+
+FroxelVolumetrics::~FroxelVolumetrics() {
+    ShaderCompiler::instance().cancel(this);
+}
+
+void FroxelVolumetrics::initialize() {
+    GPUMemoryScope memoryScope("Volumetrics");
+    for (GLTexture* texture : { &scattering_[0], &scattering_[1], &integrated_ }) {
+        texture->create(GL_TEXTURE_3D);
+        texture->storage3D(1, GL_RGBA16F, WIDTH, HEIGHT, DEPTH);
+        texture->sampling(GL_LINEAR, GL_LINEAR, GL_CLAMP_TO_EDGE);
+    }
+
+    // The shadow lookups are the receivers' own, linked in as a second compute stage
+    ShaderCompiler::instance().submit(this, "froxel inject",
+                                      {{GL_COMPUTE_SHADER, "shaders/froxel_inject.cs", ""},
+                                       {GL_COMPUTE_SHADER, "shaders/caustic_shadow.fs", ""}},
+                                      [this](GLuint program) { injectProgram_.setId(program); });
+    ShaderCompiler::instance().submitCompute(this, "froxel integrate", "shaders/froxel_integrate.cs", "",
+                                             [this](GLuint program) { integrateProgram_.setId(program); });
+}
+
+void FroxelVolumetrics::setSettings(const Settings& settings) {
+    if (settings.maxDistance != settings_.maxDistance) {
+        historyValid_ = false;
+    }
+    settings_ = settings;
+    settings_.maxDistance = std::max(settings_.maxDistance, NEAR_DEPTH * 2.0f);
+    settings_.temporalBlend = glm::clamp(settings_.temporalBlend, 0.0f, 0.98f);
+}
+
+void FroxelVolumetrics::update(const Frame& frame, const ShadowMapper& shadows) {
+    if (!isReady()) return;
+
+    // A different depth within each slice every frame, averaged by the history; the
+    // golden ratio sequence covers the slice evenly over any run of frames
+    float jitter = std::fmod(0.5f + 0.61803399f * static_cast<float>(frameIndex_++), 1.0f);
+    glm::mat4 viewProjection = frame.projection * frame.view;
+
+    // The light refracted into the water, travelling down, for the caustic map lookup
+    glm::vec3 incident = glm::normalize(frame.lightDirection);
+    glm::vec3 refracted = glm::refract(incident, glm::vec3(0.0f, 1.0f, 0.0f), 1.0f / WATER_IOR);
+    if (glm::dot(refracted, refracted) == 0.0f || refracted.y >= 0.0f) {
+        refracted = glm::vec3(0.0f, -1.0f, 0.0f);
+    }
+
+    int history = 1 - current_;
+    shadows.applyToReceiver(injectProgram_);
+    injectProgram_.use();
+    injectProgram_.setMat4("uInverseView", glm::inverse(frame.view));
+    injectProgram_.setMat4("uInverseProjection", glm::inverse(frame.projection));
+    injectProgram_.setMat4("uPreviousViewProjection", previousViewProjection_);
+    injectProgram_.setMat4("uPreviousView", previousView_);
+    injectProgram_.setVec2("uDepthRange", glm::vec2(NEAR_DEPTH, settings_.maxDistance));
+    injectProgram_.setFloat("uJitter", jitter);
+    injectProgram_.setVec3("uRefracted", refracted);
+    injectProgram_.setVec3("uLightColor", frame.lightColor * settings_.intensity);
+    injectProgram_.setVec3("uWaterMin", frame.waterMin);
+    injectProgram_.setVec3("uWaterMax", frame.waterMax);
+    injectProgram_.setFloat("uScattering", settings_.scattering);
+    injectProgram_.setFloat("uExtinction", settings_.scattering + settings_.absorption);
+    injectProgram_.setFloat("uAnisotropy", settings_.anisotropy);
+    injectProgram_.setFloat("uFloorLevel", frame.floorLevel);
+    injectProgram_.setBool("uCausticMapEnabled", frame.causticMap != 0);
+    if (frame.causticMap) {
+        glBindTextureUnit(CAUSTIC_UNIT, frame.causticMap);
+        injectProgram_.setInt("uCausticMap", CAUSTIC_UNIT);
+        injectProgram_.setFloat("uCausticExtent", frame.causticExtent);
+    }
+    injectProgram_.setFloat("uHistoryBlend", historyValid_ ? settings_.temporalBlend : 0.0f);
+    scattering_[history].bindUnit(HISTORY_UNIT);
+    injectProgram_.setInt("uHistory", HISTORY_UNIT);
+    glBindImageTexture(0, scattering_[current_].get(), 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+    glDispatchCompute((WIDTH + GROUP_SIZE - 1) / GROUP_SIZE, (HEIGHT + GROUP_SIZE - 1) / GROUP_SIZE, DEPTH);
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+
+    // One thread per tile, marching its slices front to back
+    integrateProgram_.use();
+    integrateProgram_.setMat4("uInverseProjection", glm::inverse(frame.projection));
+    integrateProgram_.setVec2("uDepthRange", glm::vec2(NEAR_DEPTH, settings_.maxDistance));
+    glBindImageTexture(0, scattering_[current_].get(), 0, GL_TRUE, 0, GL_READ_ONLY, GL_RGBA16F);
+    glBindImageTexture(1, integrated_.get(), 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+    glDispatchCompute((WIDTH + GROUP_SIZE - 1) / GROUP_SIZE, (HEIGHT + GROUP_SIZE - 1) / GROUP_SIZE, 1);
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+    glUseProgram(0);
+
+    previousViewProjection_ = viewProjection;
+    previousView_ = frame.view;
+    historyValid_ = true;
+    current_ = history;
+}
+
+} // namespace WaterSim
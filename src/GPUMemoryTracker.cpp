@@ -0,0 +1,161 @@
+#include "../include/GPUMemoryTracker.h"
+#include <algorithm>
+
+namespace WaterSim {
+
+GPUMemoryTracker& GPUMemoryTracker::instance() {
+    static GPUMemoryTracker tracker;
+    return tracker;
+}
+
+int GPUMemoryTracker::subsystemIndex(const char* name) {
+    for (size_t i = 0; i < subsystemNames_.size(); i++) {
+        if (subsystemNames_[i] == name) return static_cast<int>(i);
+    }
+    subsystemNames_.emplace_back(name);
+    return static_cast<int>(subsystemNames_.size() - 1);
+}
+
+int GPUMemoryTracker::currentSubsystem() {
+    return subsystemIndex(scopes_.empty() ? UNTAGGED : scopes_.back());
+}
+
+void GPUMemoryTracker::trackBuffer(GLuint buffer, size_t bytes) {
+    if (buffer == 0) return;
+    untrackBuffer(buffer);
+    buffers_[buffer] = Allocation{bytes, currentSubsystem()};
+    totalBytes_ += bytes;
+}
+
+void GPUMemoryTracker::untrackBuffer(GLuint buffer) {
+    auto it = buffers_.find(buffer);
+    if (it == buffers_.end()) return;
+    totalBytes_ -= it->second.bytes;
+    buffers_.erase(it);
+}
+
+void GPUMemoryTracker::trackTexture(GLuint texture, size_t bytes) {
+    if (texture == 0) return;
+    untrackTexture(texture);
+    textures_[texture] = Allocation{bytes, currentSubsystem()};
+    totalBytes_ += bytes;
+}
+
+void GPUMemoryTracker::untrackTexture(GLuint texture) {
+    auto it = textures_.find(texture);
+    if (it == textures_.end()) return;
+    totalBytes_ -= it->second.bytes;
+    textures_.erase(it);
+}
+
+void GPUMemoryTracker::retagTexture(GLuint texture, const char* name) {
+    auto it = textures_.find(texture);
+    if (it == textures_.end()) return;
+    it->second.subsystem = name ? subsystemIndex(name) : currentSubsystem();
+}
+
+size_t GPUMemoryTracker::getBufferBytes(GLuint buffer) const {
+    auto it = buffers_.find(buffer);
+    return it == buffers_.end() ? 0 : it->second.bytes;
+}
+
+size_t GPUMemoryTracker::getTextureBytes(GLuint texture) const {
+    auto it = textures_.find(texture);
+    return it == textures_.end() ? 0 : it->second.bytes;
+}
+
+std::vector<GPUMemoryTracker::Subsystem> GPUMemoryTracker::getSubsystems() const {
+    std::vector<Subsystem> subsystems(subsystemNames_.size());
+    for (size_t i = 0; i < subsystems.size(); i++) subsystems[i].name = subsystemNames_[i];
+    for (const auto& [buffer, allocation] : buffers_) {
+        subsystems[allocation.subsystem].bufferBytes += allocation.bytes;
+        subsystems[allocation.subsystem].buffers++;
+    }
+    for (const auto& [texture, allocation] : textures_) {
+        subsystems[allocation.subsystem].textureBytes += allocation.bytes;
+        subsystems[allocation.subsystem].textures++;
+    }
+
+    subsystems.erase(std::remove_if(subsystems.begin(), subsystems.end(),
+                                    [](const Subsystem& s) { return s.buffers == 0 && s.textures == 0; }),
+                     subsystems.end());
+    std::sort(subsystems.begin(), subsystems.end(), [](const Subsystem& a, const Subsystem& b) {
+        return a.bufferBytes + a.textureBytes > b.bufferBytes + b.textureBytes;
+    });
+    return subsystems;
+}
+
+void GPUMemoryTracker::addTraffic(const std::string& pass, size_t readBytes, size_t writtenBytes) {
+    auto it = std::find_if(traffic_.begin(), traffic_.end(), [&](const PassTraffic& p) { return p.name == pass; });
+    if (it == traffic_.end()) {
+        traffic_.push_back(PassTraffic{pass});
+        it = traffic_.end() - 1;
+    }
+    it->readBytes += readBytes;
+    it->writtenBytes += writtenBytes;
+    it->runs++;
+}
+
+void GPUMemoryTracker::endFrame() {
+    lastTraffic_.swap(traffic_);
+    traffic_.clear();
+}
+
+GPUMemoryTracker::DriverMemory GPUMemoryTracker::queryDriverMemory() const {
+    DriverMemory memory;
+    if (GLAD_GL_NVX_gpu_memory_info) {
+        GLint dedicatedKB = 0, availableKB = 0, evictedKB = 0, evictions = 0;
+        glGetIntegerv(GL_GPU_MEMORY_INFO_DEDICATED_VIDMEM_NVX, &dedicatedKB);
+        glGetIntegerv(GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX, &availableKB);
+        glGetIntegerv(GL_GPU_MEMORY_INFO_EVICTED_MEMORY_NVX, &evictedKB);
+        glGetIntegerv(GL_GPU_MEMORY_INFO_EVICTION_COUNT_NVX, &evictions);
+        memory.source = "GL_NVX_gpu_memory_info";
+        memory.dedicatedBytes = size_t(dedicatedKB) * 1024;
+        memory.availableBytes = size_t(availableKB) * 1024;
+        memory.evictedBytes = size_t(evictedKB) * 1024;
+        memory.evictions = evictions;
+    } else if (GLAD_GL_ATI_meminfo) {
+        // Total free, largest free block, total and largest auxiliary, all in KB
+        GLint textureKB[4] = {0, 0, 0, 0};
+        glGetIntegerv(GL_TEXTURE_FREE_MEMORY_ATI, textureKB);
+        memory.source = "GL_ATI_meminfo";
+        memory.availableBytes = size_t(textureKB[0]) * 1024;
+    }
+    return memory;
+}
+
+size_t GPUMemoryTracker::bytesPerTexel(GLenum internalFormat) {
+    switch (internalFormat) {
+        case GL_R8: case GL_R8UI: case GL_R8I: case GL_STENCIL_INDEX8:
+            return 1;
+        case GL_R16F: case GL_R16: case GL_R16UI: case GL_RG8: case GL_RG8_SNORM: case GL_DEPTH_COMPONENT16:
+            return 2;
+        case GL_RGB8: case GL_DEPTH_COMPONENT24: case GL_DEPTH24_STENCIL8:
+            return 4;   // Padded to a word in practice
+        case GL_RGBA16F: case GL_RGBA16: case GL_RG32F: case GL_RG32UI: case GL_DEPTH32F_STENCIL8:
+        case GL_RGB16F:
+            return 8;
+        case GL_RGB32F:
+            return 12;
+        case GL_RGBA32F: case GL_RGBA32UI: case GL_RGBA32I:
+            return 16;
+        default:
+            return 4;   // R32F, RG16F, RGBA8, R11F_G11F_B10F, RG16_SNORM, R32UI, ...
+    }
+}
+
+size_t GPUMemoryTracker::storageBytes(GLenum internalFormat, int width, int height, int depth, int levels, bool volume) {
+    size_t bytes = 0;
+    size_t w = size_t(std::max(width, 1));
+    size_t h = size_t(std::max(height, 1));
+    size_t d = size_t(std::max(depth, 1));
+    for (int level = 0; level < std::max(levels, 1); level++) {
+        bytes += bytesPerTexel(internalFormat) * w * h * d;
+        w = std::max<size_t>(w / 2, 1);
+        h = std::max<size_t>(h / 2, 1);
+        if (volume) d = std::max<size_t>(d / 2, 1);
+    }
+    return bytes;
+}
+
+} // namespace WaterSim
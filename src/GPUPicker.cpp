@@ -0,0 +1,108 @@
+#include "GPUPicker.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cstdint>
+
+namespace WaterSim {
+
+GPUPicker::~GPUPicker() {
+    for (Capture& capture : captures_) {
+        if (capture.fence) glDeleteSync(capture.fence);
+    }
+    if (readbackBuffer_) {
+        glUnmapNamedBuffer(readbackBuffer_);
+        glDeleteBuffers(1, &readbackBuffer_);
+    }
+}
+
+bool GPUPicker::initialize() {
+    GLbitfield readbackFlags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glCreateBuffers(1, &readbackBuffer_);
+    glNamedBufferStorage(readbackBuffer_, READBACK_FRAMES * sizeof(float), nullptr, readbackFlags);
+    readbackDepths_ = static_cast<const float*>(glMapNamedBufferRange(readbackBuffer_, 0, READBACK_FRAMES * sizeof(float), readbackFlags));
+    return readbackDepths_ != nullptr;
+}
+
+void GPUPicker::beginFrame(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& cameraPosition,
+                           int width, int height) {
+    collect();
+
+    inverseView_ = glm::inverse(view);
+    inverseProjection_ = glm::inverse(projection);
+    inverseViewProjection_ = inverseView_ * inverseProjection_;
+    cameraPosition_ = cameraPosition;
+    viewport_ = glm::ivec2(std::max(width, 1), std::max(height, 1));
+    requested_ = false;
+    frame_++;
+}
+
+void GPUPicker::request(const glm::vec2& cursor) {
+    requestedCursor_ = cursor;
+    requested_ = true;
+}
+
+void GPUPicker::capture(GLuint depthTexture, const glm::ivec2& depthSize) {
+    if (!requested_ || !readbackDepths_ || depthTexture == 0) return;
+    glm::ivec2 size = depthSize.x > 0 && depthSize.y > 0 ? depthSize : viewport_;
+    glm::vec2 scale = glm::vec2(size) / glm::vec2(viewport_);
+    glm::ivec2 pixel(static_cast<int>(requestedCursor_.x * scale.x), size.y - 1 - static_cast<int>(requestedCursor_.y * scale.y));
+    if (pixel.x < 0 || pixel.y < 0 || pixel.x >= size.x || pixel.y >= size.y) return;
+
+    // The GPU is a whole ring behind: this frame goes without
+    Capture& slot = captures_[writeIndex_];
+    if (slot.fence) return;
+
+    ProfileScope scope("Picking");
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readbackBuffer_);
+    glGetTextureSubImage(depthTexture, 0, pixel.x, pixel.y, 0, 1, 1, 1, GL_DEPTH_COMPONENT, GL_FLOAT, sizeof(float),
+                         reinterpret_cast<void*>(static_cast<uintptr_t>(writeIndex_ * sizeof(float))));
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot.inverseViewProjection = inverseViewProjection_;
+    slot.cameraPosition = cameraPosition_;
+    slot.cursor = requestedCursor_;
+    slot.frame = frame_;
+    writeIndex_ = (writeIndex_ + 1) % READBACK_FRAMES;
+}
+
+void GPUPicker::collect() {
+    // Oldest slot first; a zero-timeout wait only polls the fence
+    for (uint32_t i = 0; i < READBACK_FRAMES; i++) {
+        uint32_t index = (writeIndex_ + i) % READBACK_FRAMES;
+        Capture& slot = captures_[index];
+        if (!slot.fence) continue;
+        GLenum status = glClientWaitSync(slot.fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) break;
+        glDeleteSync(slot.fence);
+        slot.fence = nullptr;
+
+        float depth = readbackDepths_[index];
+        PickResult result;
+        result.cursor = slot.cursor;
+        result.frame = slot.frame;
+        result.hit = depth < 1.0f;
+        if (result.hit) {
+            glm::vec4 world = slot.inverseViewProjection * glm::vec4(toNDC(slot.cursor), 2.0f * depth - 1.0f, 1.0f);
+            result.position = glm::vec3(world) / world.w;
+            result.distance = glm::length(result.position - slot.cameraPosition);
+        }
+        latest_ = result;
+    }
+}
+
+glm::vec2 GPUPicker::toNDC(const glm::vec2& cursor) const {
+    return glm::vec2((2.0f * cursor.x) / viewport_.x - 1.0f, 1.0f - (2.0f * cursor.y) / viewport_.y);
+}
+
+glm::vec3 GPUPicker::rayDirection(const glm::vec2& cursor) const {
+    glm::vec4 eye = inverseProjection_ * glm::vec4(toNDC(cursor), -1.0f, 1.0f);
+    glm::vec4 world = inverseView_ * glm::vec4(eye.x, eye.y, -1.0f, 0.0f);
+    return glm::normalize(glm::vec3(world));
+}
+
+glm::vec3 GPUPicker::pointAtDistance(const glm::vec2& cursor, float distance) const {
+    return cameraPosition_ + rayDirection(cursor) * distance;
+}
+
+} // namespace WaterSim
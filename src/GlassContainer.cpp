@@ -21,7 +21,9 @@ void GlassContainer::setDimensions(float width, float height, float depth) {
 }
 
 void GlassContainer::initialize() {
-    generateMesh();
+    if (vertices.empty()) {
+        generateMesh();
+    }
     
     // Create and bind VAO and VBO
     glGenVertexArrays(1, &VAO);
@@ -0,0 +1,193 @@
+#include "../include/HeightfieldWaves.h"
+#include "../include/InitShader.h"
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+constexpr float STEP_TIME = 1.0f / 120.0f;
+constexpr int MAX_STEPS_PER_UPDATE = 8;   // Slow frames drop time rather than spiral
+constexpr float MAX_COURANT_SQ = 0.5f;    // Stability limit of the 2D five-point scheme
+constexpr int TILE_SIZE = 16;             // heightfield_waves.cs work groups
+
+} // namespace
+
+HeightfieldWaves::HeightfieldWaves() {
+}
+
+HeightfieldWaves::~HeightfieldWaves() {
+    if (heightTextures_[0]) glDeleteTextures(2, heightTextures_);
+    if (renderTexture_) glDeleteTextures(1, &renderTexture_);
+    if (depositBuffer_) glDeleteBuffers(1, &depositBuffer_);
+    if (program_) glDeleteProgram(program_);
+}
+
+bool HeightfieldWaves::initialize(int resolution, float surfaceSize) {
+    resolution_ = resolution;
+    surfaceSize_ = surfaceSize;
+
+    program_ = InitComputeShader("shaders/heightfield_waves.cs");
+    if (!program_) {
+        std::cerr << "ERROR: Failed to load heightfield wave shader!" << std::endl;
+        return false;
+    }
+    std::cout << "Heightfield wave shader loaded successfully (ID: " << program_ << ")" << std::endl;
+
+    glCreateTextures(GL_TEXTURE_2D, 2, heightTextures_);
+    for (GLuint texture : heightTextures_) {
+        glTextureStorage2D(texture, 1, GL_R32F, resolution_, resolution_);
+        glTextureParameteri(texture, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTextureParameteri(texture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTextureParameteri(texture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTextureParameteri(texture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+    clear();
+    return true;
+}
+
+void HeightfieldWaves::addStamp(const glm::vec2& center, float radius, float amplitude, const glm::vec2& direction) {
+    if (static_cast<int>(stamps_.size()) >= 2 * MAX_STAMPS) return;
+
+    // World to texel coordinates; a travelling pulse moves one step of travel per step
+    float texelSize = surfaceSize_ / resolution_;
+    glm::vec2 texel = (center + 0.5f * surfaceSize_) / texelSize - 0.5f;
+    float length = glm::length(direction);
+    glm::vec2 travel = length > 0.0f ? direction / length * (waveSpeed_ * STEP_TIME / texelSize) : glm::vec2(0.0f);
+    stamps_.push_back(glm::vec4(texel, radius / texelSize, amplitude));
+    stamps_.push_back(glm::vec4(travel, 0.0f, 0.0f));
+}
+
+void HeightfieldWaves::addVolume(const glm::vec2& center, float radius, float volume) {
+    // The raised-cosine brush holds pi r^2 (1/2 - 2/pi^2) per unit amplitude
+    const float pi = 3.14159265f;
+    float brushVolume = pi * radius * radius * (0.5f - 2.0f / (pi * pi));
+    if (brushVolume > 0.0f) {
+        addStamp(center, radius, volume / brushVolume);
+    }
+}
+
+GLuint HeightfieldWaves::getDepositBuffer() {
+    if (!depositBuffer_ && resolution_ > 0) {
+        glCreateBuffers(1, &depositBuffer_);
+        glNamedBufferStorage(depositBuffer_, GLsizeiptr(resolution_) * resolution_ * 2 * sizeof(int32_t), nullptr, 0);
+        glClearNamedBufferData(depositBuffer_, GL_R32I, GL_RED_INTEGER, GL_INT, nullptr);
+    }
+    return depositBuffer_;
+}
+
+void HeightfieldWaves::setObstacle(const glm::vec2& center, float radius) {
+    obstacleCenter_ = center;
+    obstacleRadius_ = radius;
+}
+
+void HeightfieldWaves::clear() {
+    const float zero = 0.0f;
+    for (GLuint texture : heightTextures_) {
+        if (texture) glClearTexImage(texture, 0, GL_RED, GL_FLOAT, &zero);
+    }
+    stamps_.clear();
+    accumulator_ = 0.0f;
+    if (depositBuffer_) glClearNamedBufferData(depositBuffer_, GL_R32I, GL_RED_INTEGER, GL_INT, nullptr);
+}
+
+void HeightfieldWaves::saveState(GLuint texture, float& accumulator) const {
+    for (int i = 0; i < 2; i++) {
+        glCopyImageSubData(heightTextures_[(current_ + i) % 2], GL_TEXTURE_2D, 0, 0, 0, 0,
+                           texture, GL_TEXTURE_2D, 0, i * resolution_, 0, 0, resolution_, resolution_, 1);
+    }
+    accumulator = accumulator_;
+}
+
+void HeightfieldWaves::restoreState(GLuint texture, float accumulator) {
+    for (int i = 0; i < 2; i++) {
+        glCopyImageSubData(texture, GL_TEXTURE_2D, 0, i * resolution_, 0, 0,
+                           heightTextures_[(current_ + i) % 2], GL_TEXTURE_2D, 0, 0, 0, 0, resolution_, resolution_, 1);
+    }
+    stamps_.clear();
+    accumulator_ = accumulator;
+    if (depositBuffer_) glClearNamedBufferData(depositBuffer_, GL_R32I, GL_RED_INTEGER, GL_INT, nullptr);
+}
+
+void HeightfieldWaves::update(float deltaTime) {
+    if (!program_) return;
+
+    accumulator_ += deltaTime;
+    int steps = std::min(static_cast<int>(accumulator_ / STEP_TIME), MAX_STEPS_PER_UPDATE);
+    accumulator_ = steps == MAX_STEPS_PER_UPDATE ? 0.0f : accumulator_ - steps * STEP_TIME;
+    if (steps == 0) return;
+
+    float texelSize = surfaceSize_ / resolution_;
+    float courant = waveSpeed_ * STEP_TIME / texelSize;
+    float courantSq = std::min(courant * courant, MAX_COURANT_SQ);
+    glm::vec2 obstacleTexel = (obstacleCenter_ + 0.5f * surfaceSize_) / texelSize - 0.5f;
+    int tiles = (resolution_ + TILE_SIZE - 1) / TILE_SIZE;
+
+    glUseProgram(program_);
+    glUniform1i(glGetUniformLocation(program_, "uResolution"), resolution_);
+    glUniform1f(glGetUniformLocation(program_, "uCourantSq"), courantSq);
+    glUniform1f(glGetUniformLocation(program_, "uDamping"), damping_);
+    glUniform3f(glGetUniformLocation(program_, "uObstacle"), obstacleTexel.x, obstacleTexel.y,
+                obstacleRadius_ > 0.0f ? obstacleRadius_ / texelSize : 0.0f);
+
+    if (!stamps_.empty() || depositBuffer_) {
+        glBindImageTexture(0, heightTextures_[current_], 0, GL_FALSE, 0, GL_READ_WRITE, GL_R32F);
+        glBindImageTexture(1, heightTextures_[1 - current_], 0, GL_FALSE, 0, GL_READ_WRITE, GL_R32F);
+        glUniform1i(glGetUniformLocation(program_, "uPass"), 0);
+        glUniform1i(glGetUniformLocation(program_, "uUseDeposits"), depositBuffer_ ? 1 : 0);
+        if (depositBuffer_) {
+            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, depositBuffer_);
+            glUniform1f(glGetUniformLocation(program_, "uDepositScale"), DEPOSIT_SCALE);
+            glUniform1f(glGetUniformLocation(program_, "uDepositDepth"), depositDepth_);
+            glUniform1f(glGetUniformLocation(program_, "uStepTime"), STEP_TIME);
+        }
+        glUniform1i(glGetUniformLocation(program_, "uStampCount"), static_cast<int>(stamps_.size() / 2));
+        if (!stamps_.empty()) {
+            glUniform4fv(glGetUniformLocation(program_, "uStamps"), static_cast<GLsizei>(stamps_.size()), &stamps_[0].x);
+        }
+        glDispatchCompute(tiles, tiles, 1);
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        stamps_.clear();
+    }
+
+    // Each step writes the next height over the previous one, which then becomes current
+    glUniform1i(glGetUniformLocation(program_, "uPass"), 1);
+    for (int i = 0; i < steps; i++) {
+        glBindImageTexture(0, heightTextures_[current_], 0, GL_FALSE, 0, GL_READ_WRITE, GL_R32F);
+        glBindImageTexture(1, heightTextures_[1 - current_], 0, GL_FALSE, 0, GL_READ_WRITE, GL_R32F);
+        glDispatchCompute(tiles, tiles, 1);
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        current_ = 1 - current_;
+    }
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+    glUseProgram(0);
+}
+
+void HeightfieldWaves::setRenderLag(float seconds) {
+    // The current step is already behind the update by the accumulated time
+    float blend = std::min((seconds - accumulator_) / STEP_TIME, 1.0f);
+    renderBlended_ = program_ && blend > 0.0f;
+    if (!renderBlended_) return;
+
+    if (!renderTexture_) {
+        glCreateTextures(GL_TEXTURE_2D, 1, &renderTexture_);
+        glTextureStorage2D(renderTexture_, 1, GL_R32F, resolution_, resolution_);
+        glTextureParameteri(renderTexture_, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTextureParameteri(renderTexture_, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTextureParameteri(renderTexture_, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTextureParameteri(renderTexture_, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+
+    int tiles = (resolution_ + TILE_SIZE - 1) / TILE_SIZE;
+    glUseProgram(program_);
+    glUniform1i(glGetUniformLocation(program_, "uPass"), 2);
+    glUniform1i(glGetUniformLocation(program_, "uResolution"), resolution_);
+    glUniform1f(glGetUniformLocation(program_, "uBlend"), blend);
+    glBindImageTexture(0, heightTextures_[current_], 0, GL_FALSE, 0, GL_READ_WRITE, GL_R32F);
+    glBindImageTexture(1, heightTextures_[1 - current_], 0, GL_FALSE, 0, GL_READ_WRITE, GL_R32F);
+    glBindImageTexture(2, renderTexture_, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+    glDispatchCompute(tiles, tiles, 1);
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+    glUseProgram(0);
+}
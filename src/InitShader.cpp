@@ -1,9 +1,145 @@
 #include "../include/InitShader.h"
+#include "../include/AssetPack.h"
+#include "../include/MappedFile.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <vector>
+
+// Program binary cache. A program's key hashes the driver strings and every stage's type
+// and final source (defines included), so any edit, variant or driver update misses
+static std::string shaderCacheDirectory = "shader_cache";
+
+static const uint32_t PROGRAM_CACHE_VERSION = 1;
+
+struct ProgramCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t binaryFormat;
+    uint64_t key;
+    uint64_t binarySize;
+};
+
+void SetShaderCacheDirectory(const std::string& directory) {
+    shaderCacheDirectory = directory;
+}
+
+static bool ProgramCacheEnabled() {
+    if (shaderCacheDirectory.empty()) {
+        return false;
+    }
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    return formats > 0;
+}
+
+uint64_t ProgramCacheKey(const std::vector<ShaderStageSource>& stages) {
+    uint64_t key = 14695981039346656037ull;
+    auto hashBytes = [&key](const void* bytes, size_t size) {
+        for (size_t i = 0; i < size; i++) {
+            key = (key ^ static_cast<const unsigned char*>(bytes)[i]) * 1099511628211ull;
+        }
+    };
+    for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+        const char* driver = reinterpret_cast<const char*>(glGetString(name));
+        if (driver) {
+            hashBytes(driver, std::strlen(driver));
+        }
+    }
+    for (const ShaderStageSource& stage : stages) {
+        hashBytes(&stage.type, sizeof(stage.type));
+        hashBytes(stage.source->data(), stage.source->size());
+    }
+    return key;
+}
+
+static std::string ProgramCachePath(uint64_t key) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(key));
+    return (std::filesystem::path(shaderCacheDirectory) / name).string();
+}
+
+GLuint LoadCachedProgram(uint64_t key, const char* label) {
+    if (!ProgramCacheEnabled()) {
+        return 0;
+    }
+    
+    WaterSim::MappedFile file;
+    if (!file.openRead(ProgramCachePath(key))) {
+        return 0; // Not cached yet
+    }
+    
+    ProgramCacheHeader header;
+    if (file.size() < sizeof(header)) {
+        return 0;
+    }
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (std::memcmp(header.magic, "WPROGBIN", sizeof(header.magic)) != 0 || header.version != PROGRAM_CACHE_VERSION ||
+        header.key != key || sizeof(header) + header.binarySize > file.size()) {
+        return 0; // Stale or truncated; recompiled and overwritten
+    }
+    
+    GLuint program = glCreateProgram();
+    glProgramBinary(program, header.binaryFormat, static_cast<const char*>(file.data()) + sizeof(header),
+                    static_cast<GLsizei>(header.binarySize));
+    
+    GLint success;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success) {
+        std::cerr << "WARNING: Cached program binary rejected for: " << label << ", recompiling" << std::endl;
+        glDeleteProgram(program);
+        return 0;
+    }
+    std::cout << "Shader program loaded from cache: " << label << std::endl;
+    return program;
+}
+
+void StoreCachedProgram(uint64_t key, GLuint program) {
+    if (!ProgramCacheEnabled()) {
+        return;
+    }
+    
+    GLint binarySize = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &binarySize);
+    if (binarySize <= 0) {
+        return;
+    }
+    
+    std::error_code error;
+    std::filesystem::create_directories(shaderCacheDirectory, error);
+    
+    WaterSim::MappedFile file;
+    if (!file.create(ProgramCachePath(key), sizeof(ProgramCacheHeader) + binarySize)) {
+        std::cerr << "WARNING: Failed to write program binary cache in " << shaderCacheDirectory << std::endl;
+        return;
+    }
+    
+    // The binary is read back straight into the mapped pages
+    ProgramCacheHeader header = {};
+    GLenum binaryFormat = 0;
+    GLsizei written = 0;
+    glGetProgramBinary(program, binarySize, &written, &binaryFormat, static_cast<char*>(file.data()) + sizeof(header));
+    
+    std::memcpy(header.magic, "WPROGBIN", sizeof(header.magic));
+    header.version = PROGRAM_CACHE_VERSION;
+    header.binaryFormat = binaryFormat;
+    header.key = key;
+    header.binarySize = static_cast<uint64_t>(written);
+    std::memcpy(file.data(), &header, sizeof(header));
+}
 
 std::string ReadShaderSource(const char* filePath) {
+    // The asset pack's copy unless a loose file overrides it; only the one copy into the
+    // string glShaderSource takes is made from the mapping
+    std::string_view packed = WaterSim::AssetPack::instance().find(filePath);
+    if (packed.data() && !WaterSim::AssetPack::instance().getLooseOverride()) {
+        return std::string(packed);
+    }
+    
     std::string content;
     std::ifstream fileStream(filePath, std::ios::in);
     
@@ -20,6 +156,9 @@ std::string ReadShaderSource(const char* filePath) {
         fileStream.close();
         std::cout << "Successfully loaded shader: " << filePath << " (" << content.length() << " chars)" << std::endl;
     }
+    else if (packed.data()) {
+        content.assign(packed);
+    }
     else {
         std::cerr << "ERROR: Could not open file " << filePath << std::endl;
         std::cerr << "Current working directory might be incorrect for shader loading." << std::endl;
@@ -29,9 +168,13 @@ std::string ReadShaderSource(const char* filePath) {
 }
 
 GLuint InitShader(const char* vertexShaderPath, const char* fragmentShaderPath) {
+    return InitShader(vertexShaderPath, fragmentShaderPath, std::string());
+}
+
+GLuint InitShader(const char* vertexShaderPath, const char* fragmentShaderPath, const std::string& fragmentDefines) {
     // Read shader source code
     std::string vertexShaderSrc = ReadShaderSource(vertexShaderPath);
-    std::string fragmentShaderSrc = ReadShaderSource(fragmentShaderPath);
+    std::string fragmentShaderSrc = InjectShaderDefines(ReadShaderSource(fragmentShaderPath), fragmentDefines);
     
     // Check if shader sources were loaded successfully
     if (vertexShaderSrc.empty()) {
@@ -43,6 +186,12 @@ GLuint InitShader(const char* vertexShaderPath, const char* fragmentShaderPath)
         return 0;
     }
     
+    std::string label = std::string(vertexShaderPath) + " + " + fragmentShaderPath;
+    uint64_t cacheKey = ProgramCacheKey({{GL_VERTEX_SHADER, &vertexShaderSrc}, {GL_FRAGMENT_SHADER, &fragmentShaderSrc}});
+    if (GLuint cachedProgram = LoadCachedProgram(cacheKey, label.c_str())) {
+        return cachedProgram;
+    }
+    
     const char* vertexShaderCode = vertexShaderSrc.c_str();
     const char* fragmentShaderCode = fragmentShaderSrc.c_str();
     
@@ -82,6 +231,7 @@ GLuint InitShader(const char* vertexShaderPath, const char* fragmentShaderPath)
     GLuint shaderProgram = glCreateProgram();
     glAttachShader(shaderProgram, vertexShader);
     glAttachShader(shaderProgram, fragmentShader);
+    glProgramParameteri(shaderProgram, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
     glLinkProgram(shaderProgram);
     
     // Check for shader program linking errors
@@ -104,12 +254,38 @@ GLuint InitShader(const char* vertexShaderPath, const char* fragmentShaderPath)
     glDeleteShader(vertexShader);
     glDeleteShader(fragmentShader);
     
+    StoreCachedProgram(cacheKey, shaderProgram);
+    
     return shaderProgram;
 }
 
+std::string InjectShaderDefines(const std::string& source, const std::string& defines) {
+    if (defines.empty() || source.empty()) {
+        return source;
+    }
+    
+    // #version must stay the first line, so the defines go directly after it
+    size_t versionPos = source.find("#version");
+    if (versionPos == std::string::npos) {
+        return defines + source;
+    }
+    size_t lineEnd = source.find('\n', versionPos);
+    if (lineEnd == std::string::npos) {
+        return source + "\n" + defines;
+    }
+    
+    std::string result = source;
+    result.insert(lineEnd + 1, defines);
+    return result;
+}
+
 GLuint InitComputeShader(const char* computeShaderPath) {
+    return InitComputeShader(computeShaderPath, std::string());
+}
+
+GLuint InitComputeShader(const char* computeShaderPath, const std::string& defines) {
     // Read shader source code
-    std::string computeShaderSrc = ReadShaderSource(computeShaderPath);
+    std::string computeShaderSrc = InjectShaderDefines(ReadShaderSource(computeShaderPath), defines);
     const char* computeShaderCode = computeShaderSrc.c_str();
     
     if (computeShaderSrc.empty()) {
@@ -117,6 +293,11 @@ GLuint InitComputeShader(const char* computeShaderPath) {
         return 0;
     }
     
+    uint64_t cacheKey = ProgramCacheKey({{GL_COMPUTE_SHADER, &computeShaderSrc}});
+    if (GLuint cachedProgram = LoadCachedProgram(cacheKey, computeShaderPath)) {
+        return cachedProgram;
+    }
+    
     // Create and compile compute shader
     GLuint computeShader = glCreateShader(GL_COMPUTE_SHADER);
     glShaderSource(computeShader, 1, &computeShaderCode, NULL);
@@ -136,6 +317,7 @@ GLuint InitComputeShader(const char* computeShaderPath) {
     // Create shader program and link compute shader
     GLuint shaderProgram = glCreateProgram();
     glAttachShader(shaderProgram, computeShader);
+    glProgramParameteri(shaderProgram, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
     glLinkProgram(shaderProgram);
     
     // Check for shader program linking errors
@@ -151,5 +333,153 @@ GLuint InitComputeShader(const char* computeShaderPath) {
     // Delete shader as it's linked into the program now and no longer needed
     glDeleteShader(computeShader);
     
+    StoreCachedProgram(cacheKey, shaderProgram);
+    
     return shaderProgram;
-} 
\ No newline at end of file
+} 
+static GLuint CompileShaderStage(GLenum type, const std::string& source, const char* path) {
+    if (source.empty()) {
+        std::cerr << "ERROR: Failed to read shader source from: " << path << std::endl;
+        return 0;
+    }
+    
+    const char* code = source.c_str();
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &code, NULL);
+    glCompileShader(shader);
+    
+    GLint success;
+    GLchar infoLog[512];
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+    if (!success) {
+        glGetShaderInfoLog(shader, 512, NULL, infoLog);
+        std::cerr << "ERROR: Shader compilation failed for: " << path << std::endl;
+        std::cerr << "Error details: " << infoLog << std::endl;
+        glDeleteShader(shader);
+        return 0;
+    }
+    std::cout << "Shader compiled successfully: " << path << std::endl;
+    return shader;
+}
+
+GLuint InitTessellationShader(const char* vertexShaderPath, const char* controlShaderPath,
+                              const char* evaluationShaderPath, const char* fragmentShaderPath,
+                              const std::string& tesDefines) {
+    std::string sources[4] = {
+        ReadShaderSource(vertexShaderPath),
+        ReadShaderSource(controlShaderPath),
+        InjectShaderDefines(ReadShaderSource(evaluationShaderPath), tesDefines),
+        ReadShaderSource(fragmentShaderPath)
+    };
+    
+    std::string label = std::string(controlShaderPath) + " + " + evaluationShaderPath;
+    uint64_t cacheKey = ProgramCacheKey({{GL_VERTEX_SHADER, &sources[0]}, {GL_TESS_CONTROL_SHADER, &sources[1]},
+                                         {GL_TESS_EVALUATION_SHADER, &sources[2]}, {GL_FRAGMENT_SHADER, &sources[3]}});
+    if (GLuint cachedProgram = LoadCachedProgram(cacheKey, label.c_str())) {
+        return cachedProgram;
+    }
+    
+    GLuint shaders[4] = {
+        CompileShaderStage(GL_VERTEX_SHADER, sources[0], vertexShaderPath),
+        CompileShaderStage(GL_TESS_CONTROL_SHADER, sources[1], controlShaderPath),
+        CompileShaderStage(GL_TESS_EVALUATION_SHADER, sources[2], evaluationShaderPath),
+        CompileShaderStage(GL_FRAGMENT_SHADER, sources[3], fragmentShaderPath)
+    };
+    
+    bool compiled = true;
+    for (GLuint shader : shaders) {
+        compiled = compiled && shader != 0;
+    }
+    
+    GLuint shaderProgram = 0;
+    if (compiled) {
+        shaderProgram = glCreateProgram();
+        for (GLuint shader : shaders) {
+            glAttachShader(shaderProgram, shader);
+        }
+        glProgramParameteri(shaderProgram, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glLinkProgram(shaderProgram);
+        
+        GLint success;
+        GLchar infoLog[512];
+        glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);
+        if (!success) {
+            glGetProgramInfoLog(shaderProgram, 512, NULL, infoLog);
+            std::cerr << "ERROR: Tessellation program linking failed for: " << controlShaderPath << " + " << evaluationShaderPath << std::endl;
+            std::cerr << "Linking details: " << infoLog << std::endl;
+            glDeleteProgram(shaderProgram);
+            shaderProgram = 0;
+        } else {
+            std::cout << "Shader program linked successfully: " << controlShaderPath << " + " << evaluationShaderPath << std::endl;
+        }
+    }
+    
+    // Delete shaders as they're linked into the program now and no longer needed
+    for (GLuint shader : shaders) {
+        if (shader) glDeleteShader(shader);
+    }
+    
+    if (shaderProgram) {
+        StoreCachedProgram(cacheKey, shaderProgram);
+    }
+    return shaderProgram;
+}
+
+GLuint InitGeometryShader(const char* vertexShaderPath, const char* geometryShaderPath, const char* fragmentShaderPath) {
+    std::string sources[3] = {
+        ReadShaderSource(vertexShaderPath),
+        ReadShaderSource(geometryShaderPath),
+        ReadShaderSource(fragmentShaderPath)
+    };
+    
+    std::string label = std::string(geometryShaderPath) + " + " + fragmentShaderPath;
+    uint64_t cacheKey = ProgramCacheKey({{GL_VERTEX_SHADER, &sources[0]}, {GL_GEOMETRY_SHADER, &sources[1]},
+                                         {GL_FRAGMENT_SHADER, &sources[2]}});
+    if (GLuint cachedProgram = LoadCachedProgram(cacheKey, label.c_str())) {
+        return cachedProgram;
+    }
+    
+    GLuint shaders[3] = {
+        CompileShaderStage(GL_VERTEX_SHADER, sources[0], vertexShaderPath),
+        CompileShaderStage(GL_GEOMETRY_SHADER, sources[1], geometryShaderPath),
+        CompileShaderStage(GL_FRAGMENT_SHADER, sources[2], fragmentShaderPath)
+    };
+    
+    bool compiled = true;
+    for (GLuint shader : shaders) {
+        compiled = compiled && shader != 0;
+    }
+    
+    GLuint shaderProgram = 0;
+    if (compiled) {
+        shaderProgram = glCreateProgram();
+        for (GLuint shader : shaders) {
+            glAttachShader(shaderProgram, shader);
+        }
+        glProgramParameteri(shaderProgram, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glLinkProgram(shaderProgram);
+        
+        GLint success;
+        GLchar infoLog[512];
+        glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);
+        if (!success) {
+            glGetProgramInfoLog(shaderProgram, 512, NULL, infoLog);
+            std::cerr << "ERROR: Geometry program linking failed for: " << geometryShaderPath << " + " << fragmentShaderPath << std::endl;
+            std::cerr << "Linking details: " << infoLog << std::endl;
+            glDeleteProgram(shaderProgram);
+            shaderProgram = 0;
+        } else {
+            std::cout << "Shader program linked successfully: " << geometryShaderPath << " + " << fragmentShaderPath << std::endl;
+        }
+    }
+    
+    // Delete shaders as they're linked into the program now and no longer needed
+    for (GLuint shader : shaders) {
+        if (shader) glDeleteShader(shader);
+    }
+    
+    if (shaderProgram) {
+        StoreCachedProgram(cacheKey, shaderProgram);
+    }
+    return shaderProgram;
+}
@@ -0,0 +1,314 @@
+#include "JobSystem.h"
+#include <algorithm>
+#include <iostream>
+#include <numeric>
+
+namespace WaterSim {
+
+thread_local int JobSystem::workerIndex_ = -1;
+
+namespace {
+    // Share of a core each of two SMT siblings gets: the pair retires about 1.3x one thread
+    constexpr float SMT_THREAD_SHARE = 0.65f;
+}
+
+void JobSystem::TaskGroup::run(Task task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_++;
+    }
+    JobSystem::instance().submit({ std::move(task), this });
+}
+
+void JobSystem::TaskGroup::then(Task continuation) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (pending_ > 0) {
+            // Chained after any continuation already waiting
+            if (continuation_) {
+                Task first = std::move(continuation_);
+                continuation_ = [first, continuation]() { first(); continuation(); };
+            } else {
+                continuation_ = std::move(continuation);
+            }
+            return;
+        }
+        pending_++;
+    }
+    JobSystem::instance().submit({ std::move(continuation), this });
+}
+
+void JobSystem::TaskGroup::finish() {
+    Task continuation;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (--pending_ > 0 || !continuation_) return;
+
+        // The continuation takes over the finished task's count, so the group stays open
+        continuation = std::move(continuation_);
+        continuation_ = nullptr;
+        pending_++;
+    }
+    JobSystem::instance().submit({ std::move(continuation), this });
+}
+
+bool JobSystem::TaskGroup::done() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return pending_ == 0;
+}
+
+void JobSystem::TaskGroup::wait() {
+    // Help with queued work, this group's or any other, until the group drains
+    JobSystem& jobs = JobSystem::instance();
+    while (!done()) {
+        if (!jobs.runPending()) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+JobSystem& JobSystem::instance() {
+    static JobSystem jobs;
+    return jobs;
+}
+
+JobSystem::JobSystem() {
+    // The processors this process may run on where the OS lists them (affinity masks and
+    // cpusets shrink the list), every hardware thread otherwise
+    topology_ = CpuTopology::detect();
+    unsigned int hardwareThreads = topology_.processors.empty()
+        ? std::thread::hardware_concurrency() : static_cast<unsigned int>(topology_.processors.size());
+    int workerCount = hardwareThreads > 1 ? static_cast<int>(hardwareThreads) - 1 : 0;
+    placeWorkers(workerCount);
+
+    for (int i = 0; i < workerCount; i++) {
+        queues_.push_back(std::make_unique<Queue>());
+    }
+    for (int i = 0; i < workerCount; i++) {
+        workers_.emplace_back(&JobSystem::workerLoop, this, i);
+    }
+    std::cout << "Job system: " << workerCount << " worker threads";
+    if (pinned_) {
+        std::cout << ", pinned over " << topology_.nodeCount << " NUMA node(s) and "
+                  << topology_.classCount << " core class(es)";
+    }
+    std::cout << std::endl;
+}
+
+void JobSystem::placeWorkers(int workerCount) {
+    workerWeights_.assign(workerCount, 1.0f);
+    const std::vector<CpuTopology::Processor>& processors = topology_.processors;
+    pinned_ = !topology_.isUniform() && workerCount > 0 && static_cast<int>(processors.size()) > workerCount;
+    if (!pinned_) return;
+
+    // Whole cores before SMT siblings and fast classes before slow, so the processor left to
+    // the caller is the least useful one
+    std::vector<int> order(processors.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&processors](int a, int b) {
+        const CpuTopology::Processor& pa = processors[a];
+        const CpuTopology::Processor& pb = processors[b];
+        if (pa.thread != pb.thread) return pa.thread < pb.thread;
+        return pa.coreClass < pb.coreClass;
+    });
+    order.resize(workerCount);
+
+    // Then node by node, so the spans of a partitioned loop that neighbour share a node
+    std::stable_sort(order.begin(), order.end(), [&processors](int a, int b) {
+        const CpuTopology::Processor& pa = processors[a];
+        const CpuTopology::Processor& pb = processors[b];
+        if (pa.node != pb.node) return pa.node < pb.node;
+        if (pa.coreClass != pb.coreClass) return pa.coreClass < pb.coreClass;
+        if (pa.core != pb.core) return pa.core < pb.core;
+        return pa.thread < pb.thread;
+    });
+    placement_ = order;
+
+    std::vector<int> coreThreads;
+    for (int p : placement_) {
+        int core = processors[p].core;
+        if (core >= static_cast<int>(coreThreads.size())) coreThreads.resize(core + 1, 0);
+        coreThreads[core]++;
+    }
+    for (int i = 0; i < workerCount; i++) {
+        const CpuTopology::Processor& processor = processors[placement_[i]];
+        workerWeights_[i] = processor.weight * (coreThreads[processor.core] > 1 ? SMT_THREAD_SHARE : 1.0f);
+    }
+}
+
+JobSystem::~JobSystem() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto& worker : workers_) {
+        if (worker.joinable()) worker.join();
+    }
+}
+
+void JobSystem::submit(Job job) {
+    // No workers: the waiter runs everything itself from the injection queue
+    Queue& queue = workerIndex_ >= 0 ? *queues_[workerIndex_] : injection_;
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.jobs.push_back(std::move(job));
+    }
+    queued_.fetch_add(1, std::memory_order_release);
+
+    // Taking the sleep lock orders this push before a worker's check of queued_
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex_);
+    }
+    wake_.notify_one();
+}
+
+void JobSystem::submitTo(int worker, Job job) {
+    // The caller wakes the workers once every span is queued
+    {
+        std::lock_guard<std::mutex> lock(queues_[worker]->mutex);
+        queues_[worker]->jobs.push_back(std::move(job));
+    }
+    queued_.fetch_add(1, std::memory_order_release);
+}
+
+bool JobSystem::takeJob(Job& job) {
+    if (queued_.load(std::memory_order_acquire) == 0) return false;
+
+    auto popBack = [&job](Queue& queue) {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.jobs.empty()) return false;
+        job = std::move(queue.jobs.back());
+        queue.jobs.pop_back();
+        return true;
+    };
+    auto popFront = [&job](Queue& queue) {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.jobs.empty()) return false;
+        job = std::move(queue.jobs.front());
+        queue.jobs.pop_front();
+        return true;
+    };
+
+    // Own deque newest first, then the injection queue, then steal the oldest elsewhere
+    int self = workerIndex_;
+    bool found = (self >= 0 && popBack(*queues_[self])) || popFront(injection_);
+    int queueCount = static_cast<int>(queues_.size());
+    for (int i = 1; !found && i <= queueCount; i++) {
+        int victim = (std::max(self, 0) + i) % queueCount;
+        if (victim != self) found = popFront(*queues_[victim]);
+    }
+
+    if (found) {
+        queued_.fetch_sub(1, std::memory_order_acq_rel);
+    }
+    return found;
+}
+
+bool JobSystem::runPending() {
+    Job job;
+    if (!takeJob(job)) return false;
+
+    job.task();
+    job.group->finish();
+    return true;
+}
+
+void JobSystem::workerLoop(int index) {
+    workerIndex_ = index;
+    if (pinned_ && !CpuTopology::pinCurrentThread(topology_.processors[placement_[index]])) {
+        std::cerr << "WARNING: Could not pin job worker " << index << std::endl;
+    }
+
+    while (true) {
+        if (runPending()) continue;
+
+        std::unique_lock<std::mutex> lock(sleepMutex_);
+        wake_.wait(lock, [this] { return stop_ || queued_.load(std::memory_order_acquire) > 0; });
+        if (stop_) break;
+    }
+}
+
+void JobSystem::parallelFor(int begin, int end, int grain, const std::function<void(int, int)>& body) {
+    int count = end - begin;
+    if (count <= 0) return;
+
+    // A few chunks per thread leaves room to balance uneven chunks by stealing
+    if (grain <= 0) {
+        int threads = getWorkerCount() + 1;
+        grain = std::max(1, count / (threads * 4));
+    }
+    if (count <= grain || workers_.empty() || parallelism_.load() == 1) {
+        body(begin, end);
+        return;
+    }
+
+    // Limited: threads - 1 helpers and the caller claim chunks from a shared cursor
+    int threads = parallelism_.load();
+    if (threads > 1 && threads <= getWorkerCount()) {
+        std::atomic<int> cursor{begin};
+        auto claimChunks = [&body, &cursor, grain, end]() {
+            for (int first = cursor.fetch_add(grain); first < end; first = cursor.fetch_add(grain)) {
+                body(first, std::min(first + grain, end));
+            }
+        };
+        TaskGroup group;
+        for (int i = 1; i < threads; i++) {
+            group.run(claimChunks);
+        }
+        claimChunks();
+        group.wait();
+        return;
+    }
+
+    TaskGroup group;
+    for (int first = begin + grain; first < end; first += grain) {
+        int last = std::min(first + grain, end);
+        group.run([&body, first, last]() { body(first, last); });
+    }
+    body(begin, std::min(begin + grain, end));
+    group.wait();
+}
+
+void JobSystem::parallelForPartitioned(int begin, int end, int grain, const std::function<void(int, int)>& body) {
+    int count = end - begin;
+    if (count <= 0) return;
+    grain = std::max(grain, 1);
+
+    // Limited: the first threads - 1 workers, with the caller helping
+    int threads = parallelism_.load();
+    int workers = threads > 1 ? std::min(threads - 1, getWorkerCount()) : getWorkerCount();
+    if (count <= grain || workers == 0 || threads == 1) {
+        body(begin, end);
+        return;
+    }
+
+    float total = 0.0f;
+    for (int i = 0; i < workers; i++) total += workerWeights_[i];
+    double units = static_cast<double>((count + grain - 1) / grain);
+
+    TaskGroup group;
+    float share = 0.0f;
+    int first = begin;
+    for (int i = 0; i < workers && first < end; i++) {
+        share += workerWeights_[i];
+        int last = i + 1 == workers ? end
+            : std::min(end, begin + static_cast<int>(units * share / total + 0.5) * grain);
+        if (last <= first) continue;
+        {
+            std::lock_guard<std::mutex> lock(group.mutex_);
+            group.pending_++;
+        }
+        submitTo(i, { [&body, first, last]() { body(first, last); }, &group });
+        first = last;
+    }
+
+    // Every owner has a span: wake them all rather than one that would steal another's
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex_);
+    }
+    wake_.notify_all();
+    group.wait();
+}
+
+} // namespace WaterSim
@@ -0,0 +1,178 @@
+#include "Logger.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+namespace WaterSim {
+
+namespace {
+
+const char* levelPrefix(LogLevel level) {
+    switch (level) {
+        case LogLevel::LOG_WARNING: return "WARNING: ";
+        case LogLevel::LOG_ERROR:   return "ERROR: ";
+        default:                    return "";
+    }
+}
+
+int64_t steadyMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+constexpr auto WRITER_POLL = std::chrono::milliseconds(20);
+
+} // namespace
+
+Logger& Logger::instance() {
+    static Logger logger;
+    return logger;
+}
+
+Logger::Logger() : slots_(new Slot[RING_MESSAGES]) {
+    static_assert((RING_MESSAGES & (RING_MESSAGES - 1)) == 0, "RING_MESSAGES must be a power of two");
+    for (size_t i = 0; i < RING_MESSAGES; i++) {
+        slots_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    for (CategoryState& category : categories_) {
+        category.limit.store(DEFAULT_RATE_LIMIT, std::memory_order_relaxed);
+    }
+    running_ = true;
+    writer_ = std::thread(&Logger::writerLoop, this);
+}
+
+Logger::~Logger() {
+    shutdown();
+}
+
+void Logger::setRateLimit(LogCategory category, uint32_t messagesPerSecond) {
+    categories_[static_cast<size_t>(category)].limit.store(messagesPerSecond, std::memory_order_relaxed);
+}
+
+bool Logger::admit(LogCategory category) {
+    CategoryState& state = categories_[static_cast<size_t>(category)];
+    uint32_t limit = state.limit.load(std::memory_order_relaxed);
+    if (limit == 0) return true;
+
+    // One-second windows; whoever crosses into a new one restarts the count
+    int64_t now = steadyMs();
+    int64_t start = state.windowStart.load(std::memory_order_relaxed);
+    if (now - start >= 1000 && state.windowStart.compare_exchange_strong(start, now, std::memory_order_relaxed)) {
+        state.windowCount.store(0, std::memory_order_relaxed);
+    }
+    if (state.windowCount.fetch_add(1, std::memory_order_relaxed) < limit) return true;
+
+    state.suppressed.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+std::ostringstream& Logger::threadStream() {
+    thread_local std::ostringstream stream;
+    return stream;
+}
+
+void Logger::write(LogLevel level, LogCategory category, std::ostringstream& stream) {
+    std::string text = stream.str();
+    stream.str(std::string());
+    stream.clear();
+    uint32_t suppressed = categories_[static_cast<size_t>(category)].suppressed.exchange(0, std::memory_order_relaxed);
+
+    if (!running_.load(std::memory_order_acquire)) {
+        output(level, suppressed, text.c_str());
+        return;
+    }
+
+    // Claim the next position whose slot the writer has released
+    uint64_t position = enqueue_.load(std::memory_order_relaxed);
+    Slot* slot = nullptr;
+    for (;;) {
+        slot = &slots_[position & (RING_MESSAGES - 1)];
+        uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+        int64_t difference = static_cast<int64_t>(sequence) - static_cast<int64_t>(position);
+        if (difference == 0) {
+            if (enqueue_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+        } else if (difference < 0) {
+            // Full: the writer is a ring behind
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        } else {
+            position = enqueue_.load(std::memory_order_relaxed);
+        }
+    }
+
+    slot->level = level;
+    slot->suppressed = suppressed;
+    size_t length = std::min(text.size(), MESSAGE_LENGTH - 1);
+    std::memcpy(slot->text, text.data(), length);
+    slot->text[length] = '\0';
+    slot->sequence.store(position + 1, std::memory_order_release);
+}
+
+void Logger::output(LogLevel level, uint32_t suppressed, const char* text) const {
+    std::ostream& out = level >= LogLevel::LOG_WARNING ? std::cerr : std::cout;
+    out << levelPrefix(level) << text;
+    if (suppressed > 0) {
+        out << " (" << suppressed << " more suppressed)";
+    }
+    out << '\n';
+}
+
+void Logger::drain() {
+    for (;;) {
+        Slot& slot = slots_[dequeue_ & (RING_MESSAGES - 1)];
+        if (slot.sequence.load(std::memory_order_acquire) != dequeue_ + 1) break;
+        output(slot.level, slot.suppressed, slot.text);
+        slot.sequence.store(dequeue_ + RING_MESSAGES, std::memory_order_release);
+        dequeue_++;
+    }
+
+    uint64_t dropped = dropped_.exchange(0, std::memory_order_relaxed);
+    if (dropped > 0) {
+        std::cerr << "WARNING: Log ring full, " << dropped << " messages dropped" << '\n';
+    }
+    std::cout.flush();
+    std::cerr.flush();
+
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex_);
+        written_.store(dequeue_, std::memory_order_release);
+    }
+    drained_.notify_all();
+}
+
+void Logger::writerLoop() {
+    std::unique_lock<std::mutex> lock(wakeMutex_);
+    while (running_.load(std::memory_order_acquire)) {
+        lock.unlock();
+        drain();
+        lock.lock();
+        wake_.wait_for(lock, WRITER_POLL);
+    }
+    lock.unlock();
+    drain();
+}
+
+void Logger::flush() {
+    uint64_t target = enqueue_.load(std::memory_order_acquire);
+    std::unique_lock<std::mutex> lock(wakeMutex_);
+    if (!writer_.joinable()) return;
+    wake_.notify_one();
+    drained_.wait(lock, [&]() {
+        return written_.load(std::memory_order_acquire) >= target || !running_.load(std::memory_order_acquire);
+    });
+}
+
+void Logger::shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex_);
+        if (!running_.load(std::memory_order_acquire)) return;
+        running_.store(false, std::memory_order_release);
+    }
+    wake_.notify_one();
+    if (writer_.joinable()) {
+        writer_.join();
+    }
+}
+
+} // namespace WaterSim
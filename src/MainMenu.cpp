@@ -171,6 +171,7 @@ const char* MainMenu::getSimulationName(SimulationType type) const {
     switch (type) {
         case SimulationType::REGULAR_WATER: return "Regular Water Surface";
         case SimulationType::SPH_COMPUTE: return "SPH Fluid Simulation";
+        case SimulationType::SPH_PLAYBACK: return "SPH Playback";
         case SimulationType::NONE: 
         default: return "None";
     }
@@ -182,6 +183,8 @@ const char* MainMenu::getSimulationDescription(SimulationType type) const {
             return "Classic water surface simulation with Gerstner waves and ripple effects";
         case SimulationType::SPH_COMPUTE:
             return "GPU-optimized fluid simulation using compute shaders for real-time particle physics";
+        case SimulationType::SPH_PLAYBACK:
+            return "A baked SPH particle stream played back through the fluid rendering";
         case SimulationType::NONE: 
         default: return "No simulation selected";
     }
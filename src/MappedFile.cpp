@@ -0,0 +1,140 @@
+#include "MappedFile.h"
+#include <iostream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace WaterSim {
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+#ifdef _WIN32
+bool MappedFile::openRead(const std::string& path) {
+    close();
+    
+    fileHandle_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (fileHandle_ == INVALID_HANDLE_VALUE) {
+        fileHandle_ = nullptr;
+        std::cerr << "Failed to open " << path << std::endl;
+        return false;
+    }
+    
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(fileHandle_, &fileSize) || fileSize.QuadPart == 0) {
+        std::cerr << "Failed to map empty or unreadable file " << path << std::endl;
+        close();
+        return false;
+    }
+    
+    mappingHandle_ = CreateFileMappingA(fileHandle_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    data_ = mappingHandle_ ? MapViewOfFile(mappingHandle_, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (!data_) {
+        std::cerr << "Failed to map " << path << std::endl;
+        close();
+        return false;
+    }
+    size_ = static_cast<size_t>(fileSize.QuadPart);
+    return true;
+}
+
+bool MappedFile::create(const std::string& path, size_t size) {
+    close();
+    
+    fileHandle_ = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (fileHandle_ == INVALID_HANDLE_VALUE) {
+        fileHandle_ = nullptr;
+        std::cerr << "Failed to create " << path << std::endl;
+        return false;
+    }
+    
+    LARGE_INTEGER mappingSize;
+    mappingSize.QuadPart = static_cast<LONGLONG>(size);
+    mappingHandle_ = CreateFileMappingA(fileHandle_, nullptr, PAGE_READWRITE, mappingSize.HighPart, mappingSize.LowPart, nullptr);
+    data_ = mappingHandle_ ? MapViewOfFile(mappingHandle_, FILE_MAP_WRITE, 0, 0, size) : nullptr;
+    if (!data_) {
+        std::cerr << "Failed to map " << path << " for writing" << std::endl;
+        close();
+        return false;
+    }
+    size_ = size;
+    return true;
+}
+
+void MappedFile::close() {
+    if (data_) UnmapViewOfFile(data_);
+    if (mappingHandle_) CloseHandle(mappingHandle_);
+    if (fileHandle_) CloseHandle(fileHandle_);
+    data_ = nullptr;
+    mappingHandle_ = nullptr;
+    fileHandle_ = nullptr;
+    size_ = 0;
+}
+#else
+bool MappedFile::openRead(const std::string& path) {
+    close();
+    
+    fd_ = open(path.c_str(), O_RDONLY);
+    if (fd_ < 0) {
+        std::cerr << "Failed to open " << path << std::endl;
+        return false;
+    }
+    
+    struct stat fileStat;
+    if (fstat(fd_, &fileStat) != 0 || fileStat.st_size == 0) {
+        std::cerr << "Failed to map empty or unreadable file " << path << std::endl;
+        close();
+        return false;
+    }
+    
+    void* mapping = mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, fd_, 0);
+    if (mapping == MAP_FAILED) {
+        std::cerr << "Failed to map " << path << std::endl;
+        close();
+        return false;
+    }
+    data_ = mapping;
+    size_ = static_cast<size_t>(fileStat.st_size);
+    return true;
+}
+
+bool MappedFile::create(const std::string& path, size_t size) {
+    close();
+    
+    fd_ = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd_ < 0 || ftruncate(fd_, static_cast<off_t>(size)) != 0) {
+        std::cerr << "Failed to create " << path << std::endl;
+        close();
+        return false;
+    }
+    
+    void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (mapping == MAP_FAILED) {
+        std::cerr << "Failed to map " << path << " for writing" << std::endl;
+        close();
+        return false;
+    }
+    data_ = mapping;
+    size_ = size;
+    return true;
+}
+
+void MappedFile::close() {
+    if (data_) munmap(data_, size_);
+    if (fd_ >= 0) ::close(fd_);
+    data_ = nullptr;
+    fd_ = -1;
+    size_ = 0;
+}
+#endif
+
+} // namespace WaterSim
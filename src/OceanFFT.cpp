@@ -0,0 +1,237 @@
+#include "../include/OceanFFT.h"
+#include "../include/InitShader.h"
+#include <glm/gtc/constants.hpp>
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <random>
+#include <vector>
+
+namespace {
+
+constexpr float GRAVITY = 9.81f;
+constexpr int MIN_RESOLUTION = 256;
+constexpr int MAX_RESOLUTION = 1024;  // MAX_RESOLUTION of ocean_fft.cs
+constexpr int FFT_GROUP_SIZE = 256;   // GROUP_SIZE of ocean_fft.cs
+constexpr int TILE_SIZE = 16;         // ocean_spectrum.cs / ocean_finalize.cs work groups
+constexpr unsigned int SPECTRUM_SEED = 20011u;
+
+int validResolution(int resolution) {
+    int valid = MIN_RESOLUTION;
+    while (valid < resolution && valid < MAX_RESOLUTION) {
+        valid *= 2;
+    }
+    if (valid != resolution) {
+        std::cout << "WARNING: Ocean resolution " << resolution << " is not a power of two in ["
+                  << MIN_RESOLUTION << ", " << MAX_RESOLUTION << "], using " << valid << std::endl;
+    }
+    return valid;
+}
+
+// Directional spreading: cos^2 towards the wind, strongly damped against it
+float spreading(const glm::vec2& kUnit, const glm::vec2& wind) {
+    float alignment = glm::dot(kUnit, wind);
+    return alignment * alignment * (alignment < 0.0f ? 0.07f : 1.0f);
+}
+
+// Wave energy at wave vector k, up to a constant factor the RMS normalisation removes
+float spectrumDensity(const OceanFFT::Settings& settings, const glm::vec2& k) {
+    float kLength = glm::length(k);
+    if (kLength < 1.0e-6f) return 0.0f;
+
+    glm::vec2 wind = glm::normalize(settings.windDirection);
+    glm::vec2 kUnit = k / kLength;
+    float windSpeed = std::max(settings.windSpeed, 0.1f);
+
+    if (settings.spectrum == OceanFFT::Spectrum::JONSWAP) {
+        // Hasselmann et al. 1973 in frequency, moved to wave number with the deep water
+        // dispersion omega^2 = g k (d omega / dk = g / (2 omega), the 1 / k of the polar area)
+        float omega = std::sqrt(GRAVITY * kLength);
+        float fetch = std::max(settings.fetch, 1.0f);
+        float peakOmega = 22.0f * std::pow(GRAVITY * GRAVITY / (windSpeed * fetch), 1.0f / 3.0f);
+        float alpha = 0.076f * std::pow(windSpeed * windSpeed / (fetch * GRAVITY), 0.22f);
+        float sigma = omega <= peakOmega ? 0.07f : 0.09f;
+        float peakShape = std::exp(-(omega - peakOmega) * (omega - peakOmega) / (2.0f * sigma * sigma * peakOmega * peakOmega));
+        float energy = alpha * GRAVITY * GRAVITY / std::pow(omega, 5.0f) *
+                       std::exp(-1.25f * std::pow(peakOmega / omega, 4.0f)) * std::pow(3.3f, peakShape);
+        return energy * GRAVITY / (2.0f * omega) / kLength * spreading(kUnit, wind);
+    }
+
+    // Phillips spectrum with the small wave suppression of Tessendorf's notes
+    float largestWave = windSpeed * windSpeed / GRAVITY;
+    float smallestWave = largestWave * 0.001f;
+    float kL = kLength * largestWave;
+    return std::exp(-1.0f / (kL * kL)) / (kLength * kLength * kLength * kLength) *
+           spreading(kUnit, wind) * std::exp(-kLength * kLength * smallestWave * smallestWave);
+}
+
+} // namespace
+
+OceanFFT::OceanFFT() {
+}
+
+OceanFFT::~OceanFFT() {
+    destroyTextures();
+    if (spectrumProgram_) glDeleteProgram(spectrumProgram_);
+    if (fftProgram_) glDeleteProgram(fftProgram_);
+    if (finalizeProgram_) glDeleteProgram(finalizeProgram_);
+}
+
+bool OceanFFT::initialize(const Settings& settings) {
+    settings_ = settings;
+    settings_.resolution = validResolution(settings.resolution);
+
+    spectrumProgram_ = InitComputeShader("shaders/ocean_spectrum.cs");
+    fftProgram_ = InitComputeShader("shaders/ocean_fft.cs");
+    finalizeProgram_ = InitComputeShader("shaders/ocean_finalize.cs");
+    if (!spectrumProgram_ || !fftProgram_ || !finalizeProgram_) {
+        std::cerr << "ERROR: Failed to load FFT ocean shaders!" << std::endl;
+        return false;
+    }
+    std::cout << "FFT ocean shaders loaded successfully (IDs: " << spectrumProgram_ << ", "
+              << fftProgram_ << ", " << finalizeProgram_ << ")" << std::endl;
+
+    createTextures();
+    buildInitialSpectrum();
+    initialized_ = true;
+    return true;
+}
+
+void OceanFFT::setSettings(const Settings& settings) {
+    int resolution = validResolution(settings.resolution);
+    bool resized = resolution != settings_.resolution;
+    settings_ = settings;
+    settings_.resolution = resolution;
+    if (!initialized_) return;
+
+    if (resized) {
+        destroyTextures();
+        createTextures();
+    }
+    buildInitialSpectrum();
+}
+
+void OceanFFT::createTextures() {
+    int n = settings_.resolution;
+
+    glCreateTextures(GL_TEXTURE_2D, 1, &initialSpectrumTexture_);
+    glTextureStorage2D(initialSpectrumTexture_, 1, GL_RGBA32F, n, n);
+
+    glCreateTextures(GL_TEXTURE_2D_ARRAY, 2, spectrumTextures_);
+    for (GLuint texture : spectrumTextures_) {
+        glTextureStorage3D(texture, 1, GL_RGBA32F, n, n, 2);
+    }
+
+    // The outputs tile the patch, so they repeat and are filtered like any surface texture
+    int levels = 1;
+    while ((n >> levels) > 0) levels++;
+    glCreateTextures(GL_TEXTURE_2D, 1, &displacementTexture_);
+    glTextureStorage2D(displacementTexture_, 1, GL_RGBA16F, n, n);
+    glCreateTextures(GL_TEXTURE_2D, 1, &normalFoamTexture_);
+    glTextureStorage2D(normalFoamTexture_, levels, GL_RGBA16F, n, n);
+    for (GLuint texture : { displacementTexture_, normalFoamTexture_ }) {
+        glTextureParameteri(texture, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTextureParameteri(texture, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTextureParameteri(texture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    }
+    glTextureParameteri(displacementTexture_, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTextureParameteri(normalFoamTexture_, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+
+    // Foam accumulates from the previous update, so start from a calm surface
+    const float calm[4] = { 0.0f, 1.0f, 0.0f, 0.0f };
+    glClearTexImage(normalFoamTexture_, 0, GL_RGBA, GL_FLOAT, calm);
+}
+
+void OceanFFT::destroyTextures() {
+    if (initialSpectrumTexture_) glDeleteTextures(1, &initialSpectrumTexture_);
+    if (spectrumTextures_[0]) glDeleteTextures(2, spectrumTextures_);
+    if (displacementTexture_) glDeleteTextures(1, &displacementTexture_);
+    if (normalFoamTexture_) glDeleteTextures(1, &normalFoamTexture_);
+    initialSpectrumTexture_ = 0;
+    spectrumTextures_[0] = spectrumTextures_[1] = 0;
+    displacementTexture_ = 0;
+    normalFoamTexture_ = 0;
+}
+
+void OceanFFT::buildInitialSpectrum() {
+    int n = settings_.resolution;
+
+    // h0(k) = (xi_r + i xi_i) sqrt(P(k) / 2) with unit Gaussians xi, from a fixed seed so
+    // the same settings always give the same sea
+    std::mt19937 rng(SPECTRUM_SEED);
+    std::normal_distribution<float> gaussian(0.0f, 1.0f);
+    std::vector<std::complex<float>> h0(size_t(n) * n);
+    double variance = 0.0;
+    for (int y = 0; y < n; y++) {
+        for (int x = 0; x < n; x++) {
+            glm::vec2 k = 2.0f * glm::pi<float>() * glm::vec2(x - n / 2, y - n / 2) / settings_.patchSize;
+            float amplitude = std::sqrt(spectrumDensity(settings_, k) * 0.5f);
+            float real = gaussian(rng);
+            float imaginary = gaussian(rng);
+            h0[size_t(y) * n + x] = std::complex<float>(real, imaginary) * amplitude;
+            variance += 2.0 * std::norm(h0[size_t(y) * n + x]);  // h0(k) and h0(-k) both reach h(k, t)
+        }
+    }
+
+    // Scale to the requested RMS height (variance of the surface is the summed spectrum power)
+    float scale = variance > 0.0 ? settings_.rmsHeight / static_cast<float>(std::sqrt(variance)) : 0.0f;
+
+    std::vector<glm::vec4> texels(size_t(n) * n);
+    for (int y = 0; y < n; y++) {
+        for (int x = 0; x < n; x++) {
+            std::complex<float> positive = h0[size_t(y) * n + x] * scale;
+            std::complex<float> negative = std::conj(h0[size_t((n - y) % n) * n + (n - x) % n]) * scale;
+            texels[size_t(y) * n + x] = glm::vec4(positive.real(), positive.imag(), negative.real(), negative.imag());
+        }
+    }
+    glTextureSubImage2D(initialSpectrumTexture_, 0, 0, 0, n, n, GL_RGBA, GL_FLOAT, texels.data());
+}
+
+void OceanFFT::runFFT(int direction) {
+    int n = settings_.resolution;
+    int source = direction == 0 ? 0 : 1;
+    glBindImageTexture(0, spectrumTextures_[source], 0, GL_TRUE, 0, GL_READ_ONLY, GL_RGBA32F);
+    glBindImageTexture(1, spectrumTextures_[1 - source], 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+    glUniform1i(glGetUniformLocation(fftProgram_, "uResolution"), n);
+    glUniform1i(glGetUniformLocation(fftProgram_, "uDirection"), direction);
+    glDispatchCompute(n, 2, 1);  // One work group per line and layer
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+}
+
+void OceanFFT::update(float time) {
+    if (!initialized_) return;
+    int n = settings_.resolution;
+    int tiles = (n + TILE_SIZE - 1) / TILE_SIZE;
+
+    // Spectrum at this time into spectrumTextures_[0]
+    glUseProgram(spectrumProgram_);
+    glBindImageTexture(0, initialSpectrumTexture_, 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
+    glBindImageTexture(1, spectrumTextures_[0], 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+    glUniform1i(glGetUniformLocation(spectrumProgram_, "uResolution"), n);
+    glUniform1f(glGetUniformLocation(spectrumProgram_, "uPatchSize"), settings_.patchSize);
+    glUniform1f(glGetUniformLocation(spectrumProgram_, "uTime"), time);
+    glDispatchCompute(tiles, tiles, 1);
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+    // Rows into spectrumTextures_[1], columns back into spectrumTextures_[0]
+    static_assert(MAX_RESOLUTION / 2 % FFT_GROUP_SIZE == 0, "ocean_fft.cs butterflies must divide among its threads");
+    glUseProgram(fftProgram_);
+    runFFT(0);
+    runFFT(1);
+
+    glUseProgram(finalizeProgram_);
+    glBindImageTexture(0, spectrumTextures_[0], 0, GL_TRUE, 0, GL_READ_ONLY, GL_RGBA32F);
+    glBindImageTexture(1, displacementTexture_, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+    glBindImageTexture(2, normalFoamTexture_, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA16F);
+    glUniform1i(glGetUniformLocation(finalizeProgram_, "uResolution"), n);
+    glUniform1f(glGetUniformLocation(finalizeProgram_, "uChoppiness"), settings_.choppiness);
+    glUniform1f(glGetUniformLocation(finalizeProgram_, "uFoamThreshold"), settings_.foamThreshold);
+    glUniform1f(glGetUniformLocation(finalizeProgram_, "uFoamDecay"), settings_.foamDecay);
+    glDispatchCompute(tiles, tiles, 1);
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+    // Distant water samples the coarser normal and foam levels
+    glGenerateTextureMipmap(normalFoamTexture_);
+    glUseProgram(0);
+}
@@ -1,23 +1,132 @@
 #include "../include/PostProcessManager.h"
+#include "../include/GPUMemoryTracker.h"
 #include "../include/InitShader.h"
+#include "../include/RenderTargetPool.h"
 #include <GLFW/glfw3.h>
 #include <iostream>
+#include <algorithm>
+#include <initializer_list>
 
 PostProcessManager::PostProcessManager(int width, int height)
     : width(width), height(height) {
     
-    postProcessFBO = new Framebuffer(width, height, FRAMEBUFFER_COLOR_ONLY);
-    
+    createBloomChain();
     setupQuad();
     loadShaders();
 }
 
 PostProcessManager::~PostProcessManager() {
-    delete postProcessFBO;
+    destroyBloomChain();
+    destroyDOFTargets();
     glDeleteVertexArrays(1, &quadVAO);
     glDeleteBuffers(1, &quadVBO);
-    if (postProcessShader) {
-        glDeleteProgram(postProcessShader);
+    for (GLuint program : compositeShaders) {
+        if (program) {
+            glDeleteProgram(program);
+        }
+    }
+    if (bloomDownsampleShader) {
+        glDeleteProgram(bloomDownsampleShader);
+    }
+    if (bloomUpsampleShader) {
+        glDeleteProgram(bloomUpsampleShader);
+    }
+    for (GLuint program : { dofPrepareShader, dofTileShader, dofGatherShader }) {
+        if (program) {
+            glDeleteProgram(program);
+        }
+    }
+}
+
+void PostProcessManager::resize(int width, int height) {
+    if (width == this->width && height == this->height) return;
+    this->width = width;
+    this->height = height;
+    destroyBloomChain();
+    createBloomChain();
+    destroyDOFTargets();
+}
+
+void PostProcessManager::createBloomChain() {
+    WaterSim::GPUMemoryScope memoryScope("Post-process");
+    int mipWidth = width / 2;
+    int mipHeight = height / 2;
+    
+    while (static_cast<int>(bloomMips.size()) < MAX_BLOOM_LEVELS &&
+           mipWidth >= MIN_BLOOM_LEVEL_SIZE && mipHeight >= MIN_BLOOM_LEVEL_SIZE) {
+        BloomMip mip;
+        mip.width = mipWidth;
+        mip.height = mipHeight;
+        
+        // Sampled bilinearly and clamped, as the pool hands targets out: the 13-tap and
+        // tent filters rely on both
+        mip.texture = WaterSim::RenderTargetPool::instance().acquire2D(GL_R11F_G11F_B10F, mipWidth, mipHeight);
+        
+        glGenFramebuffers(1, &mip.fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, mip.fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mip.texture, 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            std::cerr << "Bloom framebuffer " << bloomMips.size() << " is not complete!" << std::endl;
+        }
+        
+        bloomMips.push_back(mip);
+        mipWidth /= 2;
+        mipHeight /= 2;
+    }
+    
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void PostProcessManager::destroyBloomChain() {
+    for (BloomMip& mip : bloomMips) {
+        glDeleteFramebuffers(1, &mip.fbo);
+        WaterSim::RenderTargetPool::instance().release(mip.texture);
+    }
+    bloomMips.clear();
+}
+
+void PostProcessManager::createDOFTargets() {
+    WaterSim::GPUMemoryScope memoryScope("Post-process");
+    WaterSim::RenderTargetPool& pool = WaterSim::RenderTargetPool::instance();
+    dofWidth = std::max(width / 2, 1);
+    dofHeight = std::max(height / 2, 1);
+    dofTilesX = (dofWidth + DOF_TILE_SIZE - 1) / DOF_TILE_SIZE;
+    dofTilesY = (dofHeight + DOF_TILE_SIZE - 1) / DOF_TILE_SIZE;
+    
+    // The CoC needs its sign, so the half-resolution scene keeps a float alpha
+    dofHalfTexture = pool.acquire2D(GL_RGBA16F, dofWidth, dofHeight);
+    dofTileTexture = pool.acquire2D(GL_RG16F, dofTilesX, dofTilesY);
+    dofFarTexture = pool.acquire2D(GL_R11F_G11F_B10F, dofWidth, dofHeight);
+    dofNearTexture = pool.acquire2D(GL_RGBA16F, dofWidth, dofHeight);
+    
+    auto createFramebuffer = [](GLuint& fbo, std::initializer_list<GLuint> textures, const char* name) {
+        glGenFramebuffers(1, &fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        std::vector<GLenum> attachments;
+        for (GLuint texture : textures) {
+            GLenum attachment = GL_COLOR_ATTACHMENT0 + static_cast<GLenum>(attachments.size());
+            glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, texture, 0);
+            attachments.push_back(attachment);
+        }
+        glDrawBuffers(static_cast<GLsizei>(attachments.size()), attachments.data());
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            std::cerr << "Depth of field " << name << " framebuffer is not complete!" << std::endl;
+        }
+    };
+    createFramebuffer(dofHalfFBO, { dofHalfTexture }, "half-resolution");
+    createFramebuffer(dofTileFBO, { dofTileTexture }, "tile");
+    createFramebuffer(dofGatherFBO, { dofFarTexture, dofNearTexture }, "gather");
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void PostProcessManager::destroyDOFTargets() {
+    if (!dofHalfFBO) return;
+    GLuint framebuffers[] = { dofHalfFBO, dofTileFBO, dofGatherFBO };
+    glDeleteFramebuffers(3, framebuffers);
+    dofHalfFBO = dofTileFBO = dofGatherFBO = 0;
+    for (GLuint* texture : { &dofHalfTexture, &dofTileTexture, &dofFarTexture, &dofNearTexture }) {
+        WaterSim::RenderTargetPool::instance().release(*texture);
+        *texture = 0;
     }
 }
 
@@ -54,43 +163,221 @@ void PostProcessManager::setupQuad() {
 
 void PostProcessManager::loadShaders() {
     try {
-        postProcessShader = InitShader("shaders/postprocess.vs", "shaders/postprocess.fs");
-        
-        if (postProcessShader == 0) {
+        // The plain composite up front; the variants with effects compile on first use
+        if (compositeShader(0) == 0) {
             std::cerr << "Failed to load post-process shaders!" << std::endl;
             return;
         }
         
-        // Set uniform locations
-        glUseProgram(postProcessShader);
-        glUniform1i(glGetUniformLocation(postProcessShader, "screenTexture"), 0);
-        glUniform1i(glGetUniformLocation(postProcessShader, "depthTexture"), 1);
-        glUniform1i(glGetUniformLocation(postProcessShader, "refractionTexture"), 2);
+        bloomDownsampleShader = InitShader("shaders/postprocess.vs", "shaders/bloom_downsample.fs");
+        bloomUpsampleShader = InitShader("shaders/postprocess.vs", "shaders/bloom_upsample.fs");
+        if (bloomDownsampleShader == 0 || bloomUpsampleShader == 0) {
+            std::cerr << "Failed to load bloom shaders!" << std::endl;
+        } else {
+            glUseProgram(bloomDownsampleShader);
+            glUniform1i(glGetUniformLocation(bloomDownsampleShader, "sourceTexture"), 0);
+            glUseProgram(bloomUpsampleShader);
+            glUniform1i(glGetUniformLocation(bloomUpsampleShader, "sourceTexture"), 0);
+        }
+        
+        dofPrepareShader = InitShader("shaders/postprocess.vs", "shaders/dof_prepare.fs");
+        dofTileShader = InitShader("shaders/postprocess.vs", "shaders/dof_tiles.fs");
+        dofGatherShader = InitShader("shaders/postprocess.vs", "shaders/dof_gather.fs");
+        if (dofPrepareShader == 0 || dofTileShader == 0 || dofGatherShader == 0) {
+            std::cerr << "Failed to load depth of field shaders!" << std::endl;
+        } else {
+            glUseProgram(dofPrepareShader);
+            glUniform1i(glGetUniformLocation(dofPrepareShader, "sceneTexture"), 0);
+            glUniform1i(glGetUniformLocation(dofPrepareShader, "depthTexture"), 1);
+            glUseProgram(dofTileShader);
+            glUniform1i(glGetUniformLocation(dofTileShader, "halfTexture"), 0);
+            glUseProgram(dofGatherShader);
+            glUniform1i(glGetUniformLocation(dofGatherShader, "halfTexture"), 0);
+            glUniform1i(glGetUniformLocation(dofGatherShader, "tileTexture"), 1);
+        }
         
     } catch (const std::exception& e) {
         std::cerr << "Error loading post-process shaders: " << e.what() << std::endl;
-        postProcessShader = 0;
+        compositeShaders[0] = 0;
+    }
+}
+
+GLuint PostProcessManager::compositeShader(unsigned int effects) {
+    GLuint& program = compositeShaders[effects];
+    if (program) return program;
+    
+    std::string defines;
+    if (effects & COMPOSITE_BLOOM) defines += "#define BLOOM\n";
+    if (effects & COMPOSITE_DOF) defines += "#define DOF\n";
+    if (effects & COMPOSITE_VOLUMETRIC) defines += "#define VOLUMETRIC\n";
+    if (effects & COMPOSITE_RAY_TRACED) defines += "#define RAY_TRACED\n";
+    program = InitShader("shaders/postprocess.vs", "shaders/postprocess.fs", defines);
+    if (program == 0) return 0;
+    
+    // Set uniform locations
+    glUseProgram(program);
+    glUniform1i(glGetUniformLocation(program, "screenTexture"), 0);
+    glUniform1i(glGetUniformLocation(program, "depthTexture"), 1);
+    glUniform1i(glGetUniformLocation(program, "refractionTexture"), 2);
+    glUniform1i(glGetUniformLocation(program, "bloomTexture"), 3);
+    glUniform1i(glGetUniformLocation(program, "dofFarTexture"), 4);
+    glUniform1i(glGetUniformLocation(program, "dofNearTexture"), 5);
+    glUniform1i(glGetUniformLocation(program, "froxelTexture"), 6);
+    glUniform1i(glGetUniformLocation(program, "rayTracedTexture"), 7);
+    return program;
+}
+
+void PostProcessManager::renderBloom(GLuint inputTexture) {
+    // The chain draws into its own targets; the composite goes to whatever the caller bound
+    GLint previousFramebuffer = 0;
+    GLint previousViewport[4];
+    GLint previousBlendSrcRGB, previousBlendDstRGB, previousBlendSrcAlpha, previousBlendDstAlpha;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer);
+    glGetIntegerv(GL_VIEWPORT, previousViewport);
+    glGetIntegerv(GL_BLEND_SRC_RGB, &previousBlendSrcRGB);
+    glGetIntegerv(GL_BLEND_DST_RGB, &previousBlendDstRGB);
+    glGetIntegerv(GL_BLEND_SRC_ALPHA, &previousBlendSrcAlpha);
+    glGetIntegerv(GL_BLEND_DST_ALPHA, &previousBlendDstAlpha);
+    GLboolean previousBlend = glIsEnabled(GL_BLEND);
+    
+    glBindVertexArray(quadVAO);
+    glActiveTexture(GL_TEXTURE0);
+    
+    // Bright pass into the first level, then each level from the one above it. Every level
+    // is overwritten in full, so none needs clearing
+    glDisable(GL_BLEND);
+    glUseProgram(bloomDownsampleShader);
+    glUniform1f(glGetUniformLocation(bloomDownsampleShader, "bloomThreshold"), bloomThreshold);
+    glUniform1f(glGetUniformLocation(bloomDownsampleShader, "bloomKnee"), bloomThreshold * 0.5f);
+    
+    GLuint source = inputTexture;
+    int sourceWidth = width, sourceHeight = height;
+    for (size_t i = 0; i < bloomMips.size(); i++) {
+        const BloomMip& mip = bloomMips[i];
+        glBindFramebuffer(GL_FRAMEBUFFER, mip.fbo);
+        glViewport(0, 0, mip.width, mip.height);
+        glBindTexture(GL_TEXTURE_2D, source);
+        glUniform2f(glGetUniformLocation(bloomDownsampleShader, "sourceTexelSize"),
+                    1.0f / sourceWidth, 1.0f / sourceHeight);
+        glUniform1i(glGetUniformLocation(bloomDownsampleShader, "prefilter"), i == 0);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+        
+        source = mip.texture;
+        sourceWidth = mip.width;
+        sourceHeight = mip.height;
+    }
+    
+    // Back up the chain, adding each level into the next larger one
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+    glUseProgram(bloomUpsampleShader);
+    glUniform1f(glGetUniformLocation(bloomUpsampleShader, "filterRadius"), bloomRadius);
+    
+    for (size_t i = bloomMips.size() - 1; i > 0; i--) {
+        const BloomMip& smaller = bloomMips[i];
+        const BloomMip& larger = bloomMips[i - 1];
+        glBindFramebuffer(GL_FRAMEBUFFER, larger.fbo);
+        glViewport(0, 0, larger.width, larger.height);
+        glBindTexture(GL_TEXTURE_2D, smaller.texture);
+        glUniform2f(glGetUniformLocation(bloomUpsampleShader, "sourceTexelSize"),
+                    1.0f / smaller.width, 1.0f / smaller.height);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+    }
+    
+    glBindVertexArray(0);
+    glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+    glViewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+    glBlendFuncSeparate(previousBlendSrcRGB, previousBlendDstRGB, previousBlendSrcAlpha, previousBlendDstAlpha);
+    if (previousBlend) {
+        glEnable(GL_BLEND);
+    } else {
+        glDisable(GL_BLEND);
     }
 }
 
-void PostProcessManager::beginPostProcess() {
-    postProcessFBO->bind();
-    glClear(GL_COLOR_BUFFER_BIT);
+void PostProcessManager::setCoCUniforms(GLuint program) {
+    glUniform1f(glGetUniformLocation(program, "focusDistance"), focusDistance);
+    glUniform1f(glGetUniformLocation(program, "focusRange"), std::max(focusRange, 1e-3f));
+    glUniform1f(glGetUniformLocation(program, "maxCoC"), DOF_MAX_COC);
+    glUniform2f(glGetUniformLocation(program, "depthRange"), nearPlane, farPlane);
 }
 
-void PostProcessManager::endPostProcess() {
-    postProcessFBO->unbind();
+void PostProcessManager::renderDOF(GLuint inputTexture, GLuint depthTexture) {
+    if (!dofHalfFBO) {
+        createDOFTargets();
+    }
+    
+    GLint previousFramebuffer = 0;
+    GLint previousViewport[4];
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer);
+    glGetIntegerv(GL_VIEWPORT, previousViewport);
+    GLboolean previousBlend = glIsEnabled(GL_BLEND);
+    glDisable(GL_BLEND);
+    glBindVertexArray(quadVAO);
+    
+    // Scene and CoC at half resolution
+    glBindFramebuffer(GL_FRAMEBUFFER, dofHalfFBO);
+    glViewport(0, 0, dofWidth, dofHeight);
+    glUseProgram(dofPrepareShader);
+    setCoCUniforms(dofPrepareShader);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, inputTexture);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, depthTexture);
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+    
+    // Tile maxima of the near and far CoC
+    glBindFramebuffer(GL_FRAMEBUFFER, dofTileFBO);
+    glViewport(0, 0, dofTilesX, dofTilesY);
+    glUseProgram(dofTileShader);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, dofHalfTexture);
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+    
+    // Far and near fields
+    glBindFramebuffer(GL_FRAMEBUFFER, dofGatherFBO);
+    glViewport(0, 0, dofWidth, dofHeight);
+    glUseProgram(dofGatherShader);
+    glUniform2f(glGetUniformLocation(dofGatherShader, "texelSize"), 1.0f / dofWidth, 1.0f / dofHeight);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, dofTileTexture);
+    glActiveTexture(GL_TEXTURE0);
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+    
+    glBindVertexArray(0);
+    glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+    glViewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+    if (previousBlend) {
+        glEnable(GL_BLEND);
+    }
 }
 
-void PostProcessManager::applyPostProcessing(GLuint inputTexture, GLuint depthTexture) {
-    if (postProcessShader == 0) return;
+void PostProcessManager::applyPostProcessing(GLuint inputTexture, GLuint depthTexture, GLuint rayTracedTexture) {
+    if (compositeShaders[0] == 0) return;
     
-    // Bind shader
-    glUseProgram(postProcessShader);
+    bool bloom = bloomEnabled && bloomAllowed && !bloomMips.empty() && bloomDownsampleShader != 0 && bloomUpsampleShader != 0;
+    bool dof = dofEnabled && depthTexture && dofPrepareShader != 0 && dofTileShader != 0 && dofGatherShader != 0;
+    bool volumetric = volumetricEnabled && depthTexture && froxelTexture;
+    unsigned int effects = (bloom ? COMPOSITE_BLOOM : 0u) | (dof ? COMPOSITE_DOF : 0u) |
+                           (volumetric ? COMPOSITE_VOLUMETRIC : 0u) | (rayTracedTexture ? COMPOSITE_RAY_TRACED : 0u);
+    GLuint composite = compositeShader(effects);
+    if (composite == 0) return;
     
     // Disable depth testing for post-processing
     glDisable(GL_DEPTH_TEST);
     
+    if (bloom) {
+        renderBloom(inputTexture);
+    }
+    if (dof) {
+        renderDOF(inputTexture, depthTexture);
+    } else {
+        destroyDOFTargets();
+    }
+    
+    // Bind shader
+    glUseProgram(composite);
+    
     // Bind textures
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, inputTexture);
@@ -100,23 +387,41 @@ void PostProcessManager::applyPostProcessing(GLuint inputTexture, GLuint depthTe
         glBindTexture(GL_TEXTURE_2D, depthTexture);
     }
     
+    if (bloom) {
+        glActiveTexture(GL_TEXTURE3);
+        glBindTexture(GL_TEXTURE_2D, bloomMips[0].texture);
+        glActiveTexture(GL_TEXTURE0);
+    }
+    
+    if (dof) {
+        glActiveTexture(GL_TEXTURE4);
+        glBindTexture(GL_TEXTURE_2D, dofFarTexture);
+        glActiveTexture(GL_TEXTURE5);
+        glBindTexture(GL_TEXTURE_2D, dofNearTexture);
+        glActiveTexture(GL_TEXTURE0);
+    }
+    
+    if (volumetric) {
+        glBindTextureUnit(6, froxelTexture);
+        glUniform2f(glGetUniformLocation(composite, "froxelRange"), froxelNear, froxelFar);
+    }
+    
+    if (rayTracedTexture) {
+        glBindTextureUnit(7, rayTracedTexture);
+    }
+    
     // Set uniforms
-    glUniform2f(glGetUniformLocation(postProcessShader, "resolution"), 
+    glUniform2f(glGetUniformLocation(composite, "resolution"), 
                 static_cast<float>(width), static_cast<float>(height));
     
-    glUniform1f(glGetUniformLocation(postProcessShader, "time"), 
+    glUniform1f(glGetUniformLocation(composite, "time"), 
                 static_cast<float>(glfwGetTime()));
     
-    // Effect toggles
-    glUniform1i(glGetUniformLocation(postProcessShader, "enableBloom"), bloomEnabled);
-    glUniform1i(glGetUniformLocation(postProcessShader, "enableDOF"), dofEnabled);
-    glUniform1i(glGetUniformLocation(postProcessShader, "enableVolumetricLighting"), volumetricEnabled);
-    
     // Effect parameters
-    glUniform1f(glGetUniformLocation(postProcessShader, "bloomThreshold"), bloomThreshold);
-    glUniform1f(glGetUniformLocation(postProcessShader, "bloomIntensity"), bloomIntensity);
-    glUniform1f(glGetUniformLocation(postProcessShader, "focusDistance"), focusDistance);
-    glUniform1f(glGetUniformLocation(postProcessShader, "focusRange"), focusRange);
+    // The first level holds the sum of every level, one copy of the bright pass each
+    glUniform1f(glGetUniformLocation(composite, "bloomIntensity"),
+                bloom ? bloomIntensity / bloomMips.size() : 0.0f);
+    setCoCUniforms(composite);
     
     // Render full-screen quad
     glBindVertexArray(quadVAO);
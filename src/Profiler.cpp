@@ -0,0 +1,272 @@
+#include "Profiler.h"
+#include "TraceRecorder.h"
+#include <algorithm>
+#include <sstream>
+
+namespace WaterSim {
+
+namespace {
+
+thread_local int t_depth = 0;   // Open markers of a thread other than the frame thread
+
+} // namespace
+
+Profiler& Profiler::instance() {
+    static Profiler profiler;
+    return profiler;
+}
+
+void Profiler::setEnabled(bool enable) {
+    panelEnabled_ = enable;
+    updateActive();
+}
+
+void Profiler::setTracing(bool enable) {
+    tracing_ = enable;
+    clockSynced_ = false;
+    updateActive();
+}
+
+void Profiler::updateActive() {
+    bool active = panelEnabled_ || tracing_;
+    if (active == active_) return;
+    active_ = active;
+
+    // Whatever was in flight belongs to the old state
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (FrameSlot& slot : slots_) {
+        slot.pending = false;
+        slot.usedQueries = 0;
+        slot.frame.markers.clear();
+        slot.markerStartQuery.clear();
+        slot.markerEndQuery.clear();
+    }
+    frameDepth_ = 0;
+    inFrame_ = false;
+}
+
+void Profiler::shutdown() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (FrameSlot& slot : slots_) {
+        if (!slot.queries.empty()) {
+            glDeleteQueries(static_cast<GLsizei>(slot.queries.size()), slot.queries.data());
+        }
+        slot = FrameSlot();
+    }
+    active_ = false;
+    panelEnabled_ = false;
+    tracing_ = false;
+    inFrame_ = false;
+}
+
+double Profiler::sinceFrameStart() const {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart_).count();
+}
+
+int Profiler::issueTimestamp(FrameSlot& slot) {
+    if (slot.usedQueries == slot.queries.size()) {
+        GLuint query = 0;
+        glCreateQueries(GL_TIMESTAMP, 1, &query);
+        slot.queries.push_back(query);
+    }
+    glQueryCounter(slot.queries[slot.usedQueries], GL_TIMESTAMP);
+    return static_cast<int>(slot.usedQueries++);
+}
+
+std::vector<std::string> Profiler::getTrackNames() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return trackNames_;
+}
+
+int Profiler::trackOf(std::thread::id thread) {
+    auto found = std::find(trackThreads_.begin(), trackThreads_.end(), thread);
+    if (found != trackThreads_.end()) {
+        return static_cast<int>(found - trackThreads_.begin());
+    }
+    std::ostringstream name;
+    if (trackThreads_.empty()) {
+        name << "Frame";
+    } else {
+        name << "Thread " << thread;
+    }
+    trackThreads_.push_back(thread);
+    trackNames_.push_back(name.str());
+    return static_cast<int>(trackThreads_.size() - 1);
+}
+
+void Profiler::beginFrame() {
+    frameThread_.store(std::this_thread::get_id());
+    if (!active_) return;
+
+    FrameSlot& slot = slots_[slot_];
+    // GPU more than QUERY_FRAMES behind: the oldest frame is collected waiting
+    if (slot.pending) {
+        readBack(slot, true);
+    }
+
+    // Traced GPU slices go on the CPU clock: the current GPU time against it, now and then
+    if (tracing_ && (!clockSynced_ || frameIndex_ >= clockSyncFrame_ + CLOCK_SYNC_FRAMES)) {
+        GLint64 gpuNow = 0;
+        glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+        gpuClockOffset_ = static_cast<int64_t>(gpuNow) - TraceRecorder::now();
+        clockSyncFrame_ = frameIndex_;
+        clockSynced_ = true;
+    }
+    
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (trackThreads_.empty()) {
+        trackOf(frameThread_.load());
+    }
+    frameStart_ = std::chrono::steady_clock::now();
+    frameStartTraceNs_ = TraceRecorder::now();
+    slot.frame = Frame();
+    slot.frame.index = ++frameIndex_;
+    slot.markerStartQuery.clear();
+    slot.markerEndQuery.clear();
+    slot.usedQueries = 0;
+    issueTimestamp(slot);
+    frameDepth_ = 0;
+    inFrame_ = true;
+}
+
+void Profiler::endFrame() {
+    if (!active_ || !inFrame_) return;
+    TraceRecorder::instance().slice("Frame", frameStartTraceNs_, TraceRecorder::now());
+
+    FrameSlot& slot = slots_[slot_];
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        double endMs = sinceFrameStart();
+        issueTimestamp(slot);
+        slot.frame.cpuMs = endMs;
+
+        // Scopes still open (another thread's, usually) end with the frame
+        for (size_t i = 0; i < slot.frame.markers.size(); i++) {
+            Marker& marker = slot.frame.markers[i];
+            if (marker.cpuEndMs < marker.cpuStartMs) {
+                marker.cpuEndMs = endMs;
+                slot.markerEndQuery[i] = -1;
+            }
+        }
+        slot.pending = true;
+        inFrame_ = false;
+    }
+    slot_ = (slot_ + 1) % QUERY_FRAMES;
+
+    // Oldest in flight first, so the history stays in frame order
+    for (int i = 0; i < QUERY_FRAMES; i++) {
+        FrameSlot& oldest = slots_[(slot_ + i) % QUERY_FRAMES];
+        if (oldest.pending) {
+            readBack(oldest, false);
+            break;
+        }
+    }
+}
+
+bool Profiler::readBack(FrameSlot& slot, bool wait) {
+    GLuint last = slot.queries[slot.usedQueries - 1];
+    if (!wait) {
+        GLint available = 0;
+        glGetQueryObjectiv(last, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) return false;
+    }
+
+    std::vector<GLuint64> timestamps(slot.usedQueries);
+    for (size_t i = 0; i < slot.usedQueries; i++) {
+        glGetQueryObjectui64v(slot.queries[i], GL_QUERY_RESULT, &timestamps[i]);
+    }
+    auto sinceStart = [&](int query) { return static_cast<double>(timestamps[query] - timestamps[0]) / 1.0e6; };
+
+    Frame& frame = slot.frame;
+    frame.gpuMs = sinceStart(static_cast<int>(slot.usedQueries - 1));
+    TraceRecorder& trace = TraceRecorder::instance();
+    bool traced = tracing_ && clockSynced_ && trace.isEnabled();
+    auto traceTime = [&](int query) { return static_cast<int64_t>(timestamps[query]) - gpuClockOffset_; };
+    if (traced) {
+        trace.gpuSlice("GPU frame", traceTime(0), traceTime(static_cast<int>(slot.usedQueries - 1)));
+    }
+    for (size_t i = 0; i < frame.markers.size(); i++) {
+        if (slot.markerStartQuery[i] >= 0 && slot.markerEndQuery[i] >= 0) {
+            frame.markers[i].gpuStartMs = sinceStart(slot.markerStartQuery[i]);
+            frame.markers[i].gpuEndMs = sinceStart(slot.markerEndQuery[i]);
+            if (traced) {
+                trace.gpuSlice(frame.markers[i].name.c_str(), traceTime(slot.markerStartQuery[i]), traceTime(slot.markerEndQuery[i]));
+            }
+        }
+    }
+    slot.pending = false;
+
+    if (!paused_) {
+        history_.push_back(std::move(frame));
+        while (history_.size() > HISTORY_FRAMES) {
+            history_.pop_front();
+        }
+    }
+    return true;
+}
+
+int Profiler::beginMarker(const char* name, uint64_t& frame) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!inFrame_) return -1;
+
+    FrameSlot& slot = slots_[slot_];
+    bool frameThread = std::this_thread::get_id() == frameThread_.load();
+    Marker marker;
+    marker.name = name;
+    marker.track = frameThread ? 0 : trackOf(std::this_thread::get_id());
+    marker.depth = frameThread ? frameDepth_++ : t_depth++;
+    marker.cpuStartMs = sinceFrameStart();
+    marker.cpuEndMs = -1.0;
+    slot.markerStartQuery.push_back(frameThread ? issueTimestamp(slot) : -1);
+    slot.markerEndQuery.push_back(-1);
+    slot.frame.markers.push_back(std::move(marker));
+    frame = slot.frame.index;
+    return static_cast<int>(slot.frame.markers.size() - 1);
+}
+
+void Profiler::endMarker(int index, uint64_t frame) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    bool frameThread = std::this_thread::get_id() == frameThread_.load();
+    if (frameThread) {
+        frameDepth_ = std::max(frameDepth_ - 1, 0);
+    } else {
+        t_depth = std::max(t_depth - 1, 0);
+    }
+
+    // A scope outliving its frame was closed by endFrame
+    FrameSlot& slot = slots_[slot_];
+    if (!inFrame_ || slot.frame.index != frame) return;
+    slot.frame.markers[index].cpuEndMs = sinceFrameStart();
+    if (frameThread) {
+        slot.markerEndQuery[index] = issueTimestamp(slot);
+    }
+}
+
+ProfileScope::ProfileScope(const char* name) : name_(name) {
+    Profiler& profiler = Profiler::instance();
+    if (TraceRecorder::instance().isEnabled()) {
+        startNs_ = TraceRecorder::now();
+    }
+    if (std::this_thread::get_id() == profiler.frameThread_.load() && glPushDebugGroup) {
+        glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 0, -1, name);
+        debugGroup_ = true;
+    }
+    if (profiler.active_) {
+        marker_ = profiler.beginMarker(name, frame_);
+    }
+}
+
+ProfileScope::~ProfileScope() {
+    Profiler& profiler = Profiler::instance();
+    if (marker_ >= 0) {
+        profiler.endMarker(marker_, frame_);
+    }
+    if (debugGroup_) {
+        glPopDebugGroup();
+    }
+    if (startNs_ >= 0) {
+        TraceRecorder::instance().slice(name_, startNs_, TraceRecorder::now());
+    }
+}
+
+} // namespace WaterSim
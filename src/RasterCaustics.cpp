@@ -0,0 +1,172 @@
+#include "../include/RasterCaustics.h"
+#include "../include/GPUMemoryTracker.h"
+#include "../include/ShaderCompiler.h"
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+namespace WaterSim {
+
+namespace {
+    constexpr int MIN_RESOLUTION = 16;
+    constexpr float WATER_IOR = 1.33f;  // As water.fs and the ray tracer refract
+}
+
+RasterCaustics::~RasterCaustics() {
+    ShaderCompiler::instance().cancel(this);
+}
+
+void RasterCaustics::initialize() {
+    ShaderCompiler::instance().submit(this, "raster caustics", "shaders/rt_caustic_map.vs", "shaders/rt_caustic_map.fs",
+                                      [this](GLuint program) { splatProgram_.setId(program); });
+}
+
+void RasterCaustics::setSettings(const Settings& settings) {
+    settings_ = settings;
+    settings_.resolution = std::max(settings_.resolution, MIN_RESOLUTION);
+    settings_.interval = std::max(settings_.interval, 1);
+}
+
+bool RasterCaustics::beginFrame(bool active) {
+    if (!active || !settings_.enabled) {
+        // The waves move on meanwhile, so the map is redrawn before it is sampled again
+        drawn_ = false;
+        due_ = false;
+        return false;
+    }
+    framesSinceDraw_++;
+    if (mapSize_ != settings_.resolution) {
+        allocate();
+    }
+    due_ = !drawn_ || framesSinceDraw_ >= settings_.interval;
+    return due_;
+}
+
+void RasterCaustics::allocate() {
+    GPUMemoryScope memoryScope("Caustics");
+    mapSize_ = settings_.resolution;
+    mapTexture_.renderTarget(mapSize_, mapSize_, GL_R16F);
+    mapTexture_.sampling(GL_LINEAR, GL_LINEAR, GL_CLAMP_TO_EDGE);
+    mapBuffer_.attachTexture(GL_COLOR_ATTACHMENT0, mapTexture_.get());
+    if (mapBuffer_.status() != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "ERROR: Raster caustic map framebuffer incomplete" << std::endl;
+    }
+    drawn_ = false;
+}
+
+void RasterCaustics::buildGrid(int resolution) {
+    // Flat and facing up: the shader tilts and lifts each vertex by the surface's textures
+    std::vector<float> vertices;
+    vertices.reserve(size_t(resolution + 1) * (resolution + 1) * 6);
+    for (int z = 0; z <= resolution; z++) {
+        for (int x = 0; x <= resolution; x++) {
+            float worldX = (float(x) / resolution - 0.5f) * extent_;
+            float worldZ = (float(z) / resolution - 0.5f) * extent_;
+            vertices.insert(vertices.end(), { worldX, 0.0f, worldZ, 0.0f, 1.0f, 0.0f });
+        }
+    }
+    std::vector<GLuint> indices;
+    indices.reserve(size_t(resolution) * resolution * 6);
+    for (int z = 0; z < resolution; z++) {
+        for (int x = 0; x < resolution; x++) {
+            GLuint corner = GLuint(z * (resolution + 1) + x);
+            GLuint below = corner + GLuint(resolution + 1);
+            indices.insert(indices.end(), { corner, below, corner + 1, corner + 1, below, below + 1 });
+        }
+    }
+
+    GPUMemoryScope memoryScope("Caustics");
+    gridVertices_.storage(GLsizeiptr(vertices.size() * sizeof(float)), vertices.data(), 0);
+    gridIndices_.storage(GLsizeiptr(indices.size() * sizeof(GLuint)), indices.data(), 0);
+    gridArray_.vertexBuffer(0, gridVertices_.get(), 0, 6 * sizeof(float));
+    gridArray_.attribute(0, 0, 3, GL_FLOAT, GL_FALSE, 0);
+    gridArray_.attribute(1, 0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float));
+    gridArray_.elementBuffer(gridIndices_.get());
+    gridResolution_ = resolution;
+    gridIndexCount_ = GLsizei(indices.size());
+}
+
+void RasterCaustics::draw(const WaterSurfaceGeometry& surface, const glm::vec3& lightDirection, float floorLevel) {
+    if (!due_ || !splatProgram_.isValid()) return;
+    due_ = false;
+    int gridResolution = std::max(mapSize_ / 2, MIN_RESOLUTION / 2);
+    if (gridResolution != gridResolution_ || surface.size != extent_) {
+        extent_ = surface.size;
+        buildGrid(gridResolution);
+    }
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    mapBuffer_.bind();
+    glViewport(0, 0, mapSize_, mapSize_);
+    GLenum drawBuffer = GL_COLOR_ATTACHMENT0;
+    glDrawBuffers(1, &drawBuffer);
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    splatProgram_.use();
+    splatProgram_.setVec3("uLightDir", glm::normalize(lightDirection));
+    splatProgram_.setFloat("uWaterIOR", WATER_IOR);
+    splatProgram_.setFloat("uWaterLevel", 0.0f);
+    splatProgram_.setFloat("uFloorLevel", floorLevel);
+    splatProgram_.setFloat("uMapExtent", extent_);
+    splatProgram_.setBool("uPackedVertices", false);
+    splatProgram_.setFloat("uSurfaceSize", surface.size);
+
+    // Units as RayTracingManager binds them: the ocean on 0 and 1, the heights on 2 to 4
+    bool ocean = surface.oceanDisplacement != 0;
+    splatProgram_.setBool("uOceanWaves", ocean);
+    if (ocean) {
+        glBindTextureUnit(0, surface.oceanDisplacement);
+        glBindTextureUnit(1, surface.oceanNormalFoam);
+        splatProgram_.setInt("uOceanDisplacement", 0);
+        splatProgram_.setInt("uOceanNormalFoam", 1);
+        splatProgram_.setFloat("uOceanPatchSize", surface.oceanPatchSize);
+    }
+    bool waveHeights = surface.flatGrid && surface.waveHeightMap != 0 && surface.waveNormalMap != 0;
+    splatProgram_.setBool("uWaveHeights", waveHeights);
+    if (waveHeights) {
+        glBindTextureUnit(2, surface.waveHeightMap);
+        glBindTextureUnit(4, surface.waveNormalMap);
+        splatProgram_.setInt("uWaveHeightMap", 2);
+        splatProgram_.setInt("uWaveNormalMap", 4);
+        splatProgram_.setFloat("uWaveHeightMapSize", surface.waveHeightMapSize);
+    }
+    splatProgram_.setBool("uHeightfieldWaves", surface.heightfield != 0);
+    if (surface.heightfield != 0) {
+        glBindTextureUnit(3, surface.heightfield);
+        splatProgram_.setInt("uHeightfield", 3);
+    }
+
+    // Folded triangles face away, and all of them count
+    GLboolean cullFace = glIsEnabled(GL_CULL_FACE);
+    GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+    GLboolean blend = glIsEnabled(GL_BLEND);
+    glDisable(GL_CULL_FACE);
+    glDisable(GL_DEPTH_TEST);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+
+    gridArray_.bind();
+    glDrawElements(GL_TRIANGLES, gridIndexCount_, GL_UNSIGNED_INT, nullptr);
+    gridArray_.unbind();
+
+    if (!blend) glDisable(GL_BLEND);
+    if (depthTest) glEnable(GL_DEPTH_TEST);
+    if (cullFace) glEnable(GL_CULL_FACE);
+    mapBuffer_.unbind();
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+    drawn_ = true;
+    framesSinceDraw_ = 0;
+}
+
+void RasterCaustics::applyToReceiver(const GLShaderProgram& program, int textureUnit) const {
+    program.setBool("causticMapEnabled", drawn_);
+    if (!drawn_) return;
+    glBindTextureUnit(textureUnit, mapTexture_.get());
+    program.setInt("causticMap", textureUnit);
+    program.setFloat("causticMapExtent", extent_);
+}
+
+} // namespace WaterSim
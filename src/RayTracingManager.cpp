@@ -1,13 +1,150 @@
 #include "RayTracingManager.h"
+#include "GPUMemoryTracker.h"
 #include "InitShader.h"
+#include "Logger.h"
 #include <iostream>
-#include <chrono>
 #include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <sstream>
 #include <vector>
 #include <GLFW/glfw3.h>
 
 namespace WaterSim {
 
+namespace {
+    // Indexed by RayTracingManager::RayTracingKernel
+    const char* const KERNEL_PATHS[] = {
+        "shaders/rt_reflection.cs",
+        "shaders/rt_refraction.cs",
+        "shaders/rt_caustics.cs",
+        "shaders/rt_composite.cs",
+        "shaders/rt_upsample.cs",
+        "shaders/rt_fused.cs",
+        "shaders/rt_sharpen.cs",
+    };
+    const char* const KERNEL_CACHE_KEYS[] = {
+        "rt.reflection",
+        "rt.refraction",
+        "rt.caustics",
+        "rt.composite",
+        "rt.upsample",
+        "rt.fused",
+        "rt.sharpen",
+    };
+    
+    // Directional light the caustics are cast by
+    const glm::vec3 CAUSTIC_LIGHT_DIR(0.0f, -1.0f, 0.2f);
+    
+    // Weight of a caustic map refresh against the map it is blended into
+    const float CAUSTIC_MAP_BLEND = 0.5f;
+    
+    // Candidate local sizes; 16x16 is the shaders' default
+    const glm::ivec2 LOCAL_SIZE_CANDIDATES[] = {
+        glm::ivec2(8, 8),
+        glm::ivec2(16, 8),
+        glm::ivec2(16, 16),
+        glm::ivec2(32, 8),
+    };
+    
+    // Levels of a min-max depth pyramid over width x height, down to 1x1
+    int hiZLevelCount(int width, int height) {
+        int levels = 1;
+        while ((std::max(width, height) >> levels) > 0) {
+            levels++;
+        }
+        return levels;
+    }
+    
+    // Tiled blue noise for the adaptive samples, BLUE_NOISE_SIZE^2 texels
+    const int BLUE_NOISE_SIZE = 64;
+    
+    // Void and cluster (Ulichney 1993) on the torus: every texel gets its rank, the order in
+    // which it is added to a pattern kept as even as possible, scaled to 0-255. The energy of
+    // a texel is the Gaussian-filtered density of the pattern around it, kept up to date as
+    // points come and go
+    std::vector<uint8_t> generateBlueNoise(int size) {
+        const int count = size * size;
+        const float sigma = 1.5f;
+        const int radius = 6;   // The Gaussian's tail beyond it is below 1e-3
+        
+        std::vector<float> kernel((2 * radius + 1) * (2 * radius + 1));
+        for (int y = -radius; y <= radius; y++) {
+            for (int x = -radius; x <= radius; x++) {
+                kernel[(y + radius) * (2 * radius + 1) + x + radius] = std::exp(-(x * x + y * y) / (2.0f * sigma * sigma));
+            }
+        }
+        
+        std::vector<uint8_t> pattern(count, 0);
+        std::vector<float> energy(count, 0.0f);
+        auto splat = [&](int texel, float sign) {
+            int tx = texel % size, ty = texel / size;
+            for (int y = -radius; y <= radius; y++) {
+                for (int x = -radius; x <= radius; x++) {
+                    int index = ((ty + y + size) % size) * size + (tx + x + size) % size;
+                    energy[index] += sign * kernel[(y + radius) * (2 * radius + 1) + x + radius];
+                }
+            }
+        };
+        // Tightest cluster: the set texel of most energy; largest void: the empty one of least
+        auto extreme = [&](uint8_t set) {
+            int best = -1;
+            for (int i = 0; i < count; i++) {
+                if (pattern[i] != set) continue;
+                if (best < 0 || (set ? energy[i] > energy[best] : energy[i] < energy[best])) best = i;
+            }
+            return best;
+        };
+        
+        // A random tenth, relaxed until moving the tightest cluster into the largest void
+        // would put it back where it was
+        std::mt19937 random(0x5eed);
+        int initial = count / 10;
+        for (int placed = 0; placed < initial;) {
+            int texel = static_cast<int>(random() % count);
+            if (pattern[texel]) continue;
+            pattern[texel] = 1;
+            splat(texel, 1.0f);
+            placed++;
+        }
+        while (true) {
+            int cluster = extreme(1);
+            pattern[cluster] = 0;
+            splat(cluster, -1.0f);
+            int hole = extreme(0);
+            pattern[hole] = 1;
+            splat(hole, 1.0f);
+            if (hole == cluster) break;
+        }
+        
+        // Ranks: the initial points by removing clusters from a copy, the rest by filling voids
+        std::vector<int> rank(count, 0);
+        std::vector<uint8_t> initialPattern = pattern;
+        std::vector<float> initialEnergy = energy;
+        for (int r = initial - 1; r >= 0; r--) {
+            int cluster = extreme(1);
+            pattern[cluster] = 0;
+            splat(cluster, -1.0f);
+            rank[cluster] = r;
+        }
+        pattern = initialPattern;
+        energy = initialEnergy;
+        for (int r = initial; r < count; r++) {
+            int hole = extreme(0);
+            pattern[hole] = 1;
+            splat(hole, 1.0f);
+            rank[hole] = r;
+        }
+        
+        std::vector<uint8_t> texels(count);
+        for (int i = 0; i < count; i++) {
+            texels[i] = static_cast<uint8_t>((rank[i] * 256) / count);
+        }
+        return texels;
+    }
+}
+
 RayTracingManager::RayTracingManager(const Config& config)
     : config_(config), quality_(RayTracingQuality::OFF),  // Start with OFF by default
       screenWidth_(1920), screenHeight_(1080),
@@ -22,6 +159,11 @@ RayTracingManager::RayTracingManager(const Config& config)
     features_.volumetricLighting = false;
     features_.softShadows = true;
     features_.globalIllumination = false;
+    features_.temporalDenoise = true;
+    
+    for (glm::ivec2& localSize : localSizes_) {
+        localSize = glm::ivec2(16, 16);
+    }
 }
 
 RayTracingManager::~RayTracingManager() {
@@ -61,6 +203,18 @@ bool RayTracingManager::initialize(int screenWidth, int screenHeight) {
         std::cout << "Using compute shader ray tracing fallback" << std::endl;
     }
     
+    // Local sizes tuned for this GPU on an earlier run
+    autotuner_.reset(new ComputeAutotuner(config_.compute.autotuneCachePath));
+    autotuned_ = true;
+    for (int kernel = 0; kernel < RT_KERNEL_COUNT; kernel++) {
+        uint32_t packed = 0;
+        if (autotuner_->lookup(KERNEL_CACHE_KEYS[kernel], packed)) {
+            localSizes_[kernel] = glm::ivec2(ComputeAutotuner::sizeX(packed), ComputeAutotuner::sizeY(packed));
+        } else {
+            autotuned_ = !config_.compute.autotune;
+        }
+    }
+    
     // Create ray tracing shaders
     std::cout << "Loading ray tracing shaders..." << std::endl;
     createRayTracingShaders();
@@ -73,8 +227,9 @@ bool RayTracingManager::initialize(int screenWidth, int screenHeight) {
     std::cout << "Updating resolution based on quality..." << std::endl;
     updateResolution();
     
-    // Create performance query
-    glGenQueries(1, &timeQuery_);
+    // Create the pass timestamp queries
+    glGenQueries(TIMER_FRAMES * (PASS_COUNT + 1), &timestampQueries_[0][0]);
+    createAdaptiveSampling();
     
     std::cout << "Ray Tracing System initialized successfully" << std::endl;
     std::cout << "========================================\n" << std::endl;
@@ -82,9 +237,26 @@ bool RayTracingManager::initialize(int screenWidth, int screenHeight) {
 }
 
 void RayTracingManager::cleanup() {
-    if (timeQuery_ != 0) {
-        glDeleteQueries(1, &timeQuery_);
-        timeQuery_ = 0;
+    if (emptyVAO_ != 0) {
+        glDeleteVertexArrays(1, &emptyVAO_);
+        emptyVAO_ = 0;
+    }
+    
+    if (sampleReadbackBuffer_ != 0) {
+        glUnmapNamedBuffer(sampleReadbackBuffer_);
+        glDeleteBuffers(1, &sampleReadbackBuffer_);
+        glDeleteBuffers(1, &sampleCounterBuffer_);
+        sampleReadbackBuffer_ = 0;
+        sampleCounterBuffer_ = 0;
+        sampleReadback_ = nullptr;
+    }
+    
+    if (timestampQueries_[0][0] != 0) {
+        glDeleteQueries(TIMER_FRAMES * (PASS_COUNT + 1), &timestampQueries_[0][0]);
+        for (int slot = 0; slot < TIMER_FRAMES; slot++) {
+            for (GLuint& query : timestampQueries_[slot]) query = 0;
+            timerPending_[slot] = false;
+        }
     }
     
     cleanupRTX();
@@ -94,44 +266,139 @@ void RayTracingManager::setQuality(RayTracingQuality quality) {
     if (quality_ != quality) {
         quality_ = quality;
         updateResolution();
+        invalidateHistories();  // An interleaved history would be missing the frames between
         std::cout << "Ray tracing quality set to: " << (int)quality << std::endl;
     }
 }
 
 void RayTracingManager::setFeatures(const RayTracingFeatures& features) {
+    bool layoutChanged = features.compactGBuffer != features_.compactGBuffer;
     features_ = features;
+    
+    // The G-buffer targets and every kernel reading them change with its layout
+    if (layoutChanged) {
+        createRayTracingShaders();
+        createFramebuffers();
+    }
+    
+    // A signal switched back on would reproject from frames it was not traced in
+    invalidateHistories();
+    causticMapDirty_ = true;
+}
+
+void RayTracingManager::invalidateHistories() {
+    for (SignalHistory& history : histories_) {
+        history.valid = false;
+    }
+    for (InterleaveHistory& history : interleaveHistories_) {
+        history.valid = false;
+    }
+}
+
+void RayTracingManager::setFrameBudget(float milliseconds) {
+    float budget = std::max(milliseconds, 0.0f);
+    if (budget == frameBudgetMs_) return;
+    
+    // Start from the fixed quality's resolution and let the measurements move it
+    if (frameBudgetMs_ == 0.0f) {
+        resolutionScale_ = quality_ == RayTracingQuality::LOW ? 0.25f :
+                           quality_ == RayTracingQuality::MEDIUM || interleavePhases() > 1 ? 0.5f : 1.0f;
+    }
+    frameBudgetMs_ = budget;
+    updateResolution();
+    std::cout << "Ray tracing frame budget set to: " << frameBudgetMs_ << " ms" << std::endl;
 }
 
 void RayTracingManager::updateResolution() {
+    int width = 0, height = 0;
     switch (quality_) {
         case RayTracingQuality::OFF:
-            rtWidth_ = 0;
-            rtHeight_ = 0;
+            width = 0;
+            height = 0;
             break;
         case RayTracingQuality::LOW:
-            rtWidth_ = screenWidth_ / 4;
-            rtHeight_ = screenHeight_ / 4;
+            width = screenWidth_ / 4;
+            height = screenHeight_ / 4;
             break;
         case RayTracingQuality::MEDIUM:
-            rtWidth_ = screenWidth_ / 2;
-            rtHeight_ = screenHeight_ / 2;
+        case RayTracingQuality::CHECKERBOARD:
+        case RayTracingQuality::INTERLEAVED_2X2:
+            width = screenWidth_ / 2;
+            height = screenHeight_ / 2;
             break;
         case RayTracingQuality::HIGH:
-            rtWidth_ = screenWidth_;
-            rtHeight_ = screenHeight_;
+            width = screenWidth_;
+            height = screenHeight_;
             break;
         case RayTracingQuality::ULTRA:
-            rtWidth_ = screenWidth_;
-            rtHeight_ = screenHeight_;
+            width = screenWidth_;
+            height = screenHeight_;
             break;
     }
     
-    if (rtWidth_ > 0 && rtHeight_ > 0) {
-        // Recreate framebuffers with new resolution
-        createFramebuffers();
+    // Dynamic resolution may climb to full resolution whatever the quality
+    bool dynamic = frameBudgetMs_ > 0.0f && quality_ != RayTracingQuality::OFF;
+    if (dynamic) {
+        width = screenWidth_;
+        height = screenHeight_;
+    }
+    
+    // A reloaded config may also have resized the caustic map
+    bool causticResized = causticMapSize_ != 0 && std::max(config_.textures.causticSize, 1) != causticMapSize_;
+    if (width != allocWidth_ || height != allocHeight_ || causticResized) {
+        allocWidth_ = width;
+        allocHeight_ = height;
+        if (allocWidth_ > 0 && allocHeight_ > 0) {
+            // Recreate framebuffers with new resolution
+            createFramebuffers();
+        }
+    }
+    
+    rtWidth_ = allocWidth_;
+    rtHeight_ = allocHeight_;
+    if (dynamic) {
+        applyResolutionScale();
+    } else if (budgetScale_ < 1.0f && allocWidth_ > 0 && allocHeight_ > 0) {
+        rtWidth_ = std::max(static_cast<int>(allocWidth_ * budgetScale_), 1);
+        rtHeight_ = std::max(static_cast<int>(allocHeight_ * budgetScale_), 1);
     }
 }
 
+void RayTracingManager::setBudgetScale(float scale) {
+    scale = std::max(0.25f, std::min(scale, 1.0f));
+    if (scale == budgetScale_) return;
+    budgetScale_ = scale;
+    updateResolution();
+}
+
+void RayTracingManager::applyResolutionScale() {
+    // Snapped to 1/RESOLUTION_STEPS of the screen so the size settles instead of moving a
+    // texel every frame
+    int steps = static_cast<int>(std::round(std::min(resolutionScale_, budgetScale_) * RESOLUTION_STEPS));
+    steps = std::max(RESOLUTION_STEPS / 4, std::min(steps, RESOLUTION_STEPS));
+    rtWidth_ = std::max(screenWidth_ * steps / RESOLUTION_STEPS, 1);
+    rtHeight_ = std::max(screenHeight_ * steps / RESOLUTION_STEPS, 1);
+}
+
+void RayTracingManager::updateDynamicResolution() {
+    if (lastFrameTime_ <= 0.0f || timedPixels_ <= 0) return;
+    
+    // GPU time taken as proportional to traced pixels: the scale that would have met the
+    // budget, with a tenth held back for splashes. The measured frame's own scale is the
+    // reference, so results a few frames late do not compound
+    float timedScale = std::sqrt(static_cast<float>(timedPixels_) / (static_cast<float>(screenWidth_) * screenHeight_));
+    float target = timedScale * std::sqrt(0.9f * frameBudgetMs_ / lastFrameTime_);
+    target = std::max(0.25f, std::min(target, 1.0f));
+    
+    // Over budget drops at once; headroom is taken back gradually
+    if (target < resolutionScale_) {
+        resolutionScale_ = target;
+    } else {
+        resolutionScale_ += (target - resolutionScale_) * 0.1f;
+    }
+    applyResolutionScale();
+}
+
 void RayTracingManager::createRayTracingShaders() {
     std::cout << "Loading ray tracing shaders..." << std::endl;
     
@@ -146,9 +413,27 @@ void RayTracingManager::createRayTracingShaders() {
             std::cerr << "  ✗ Failed to load G-buffer shader!" << std::endl;
         }
         
+        // Load the SPH fluid G-buffer shaders: its smoothed depth resolved over a fullscreen
+        // triangle (sph_final.vs), and its mesh through the regular G-buffer fragment shader
+        std::cout << "  Loading fluid G-buffer shaders..." << std::endl;
+        GLuint gBufferDepthProgram = InitShader("shaders/sph_final.vs", "shaders/rt_gbuffer_depth.fs");
+        if (gBufferDepthProgram != 0) {
+            gBufferDepthShader_.setId(gBufferDepthProgram);
+            std::cout << "  ✓ Fluid depth G-buffer shader loaded successfully (ID: " << gBufferDepthProgram << ")" << std::endl;
+        } else {
+            std::cerr << "  ✗ Failed to load fluid depth G-buffer shader!" << std::endl;
+        }
+        GLuint gBufferMeshProgram = InitShader("shaders/rt_gbuffer_mesh.vs", "shaders/gbuffer.fs");
+        if (gBufferMeshProgram != 0) {
+            gBufferMeshShader_.setId(gBufferMeshProgram);
+            std::cout << "  ✓ Fluid mesh G-buffer shader loaded successfully (ID: " << gBufferMeshProgram << ")" << std::endl;
+        } else {
+            std::cerr << "  ✗ Failed to load fluid mesh G-buffer shader!" << std::endl;
+        }
+        
         // Load reflection compute shader
         std::cout << "  Loading reflection compute shader..." << std::endl;
-        GLuint reflectionCS = InitComputeShader("shaders/rt_reflection.cs");
+        GLuint reflectionCS = loadKernel(RT_REFLECTION, localSizes_[RT_REFLECTION]);
         if (reflectionCS != 0) {
             reflectionShader_.setId(reflectionCS);
             std::cout << "  ✓ Reflection compute shader loaded successfully (ID: " << reflectionCS << ")" << std::endl;
@@ -158,7 +443,7 @@ void RayTracingManager::createRayTracingShaders() {
         
         // Load refraction compute shader
         std::cout << "  Loading refraction compute shader..." << std::endl;
-        GLuint refractionCS = InitComputeShader("shaders/rt_refraction.cs");
+        GLuint refractionCS = loadKernel(RT_REFRACTION, localSizes_[RT_REFRACTION]);
         if (refractionCS != 0) {
             refractionShader_.setId(refractionCS);
             std::cout << "  ✓ Refraction compute shader loaded successfully (ID: " << refractionCS << ")" << std::endl;
@@ -168,7 +453,7 @@ void RayTracingManager::createRayTracingShaders() {
         
         // Load caustic compute shader
         std::cout << "  Loading caustic compute shader..." << std::endl;
-        GLuint causticCS = InitComputeShader("shaders/rt_caustics.cs");
+        GLuint causticCS = loadKernel(RT_CAUSTICS, localSizes_[RT_CAUSTICS]);
         if (causticCS != 0) {
             causticShader_.setId(causticCS);
             std::cout << "  ✓ Caustic compute shader loaded successfully (ID: " << causticCS << ")" << std::endl;
@@ -178,7 +463,7 @@ void RayTracingManager::createRayTracingShaders() {
         
         // Load compositing compute shader
         std::cout << "  Loading compositing compute shader..." << std::endl;
-        GLuint compositingCS = InitComputeShader("shaders/rt_composite.cs");
+        GLuint compositingCS = loadKernel(RT_COMPOSITE, localSizes_[RT_COMPOSITE]);
         if (compositingCS != 0) {
             compositingShader_.setId(compositingCS);
             std::cout << "  ✓ Compositing compute shader loaded successfully (ID: " << compositingCS << ")" << std::endl;
@@ -188,7 +473,7 @@ void RayTracingManager::createRayTracingShaders() {
         
         // Load upsampling compute shader
         std::cout << "  Loading upsampling compute shader..." << std::endl;
-        GLuint upsampleCS = InitComputeShader("shaders/rt_upsample.cs");
+        GLuint upsampleCS = loadKernel(RT_UPSAMPLE, localSizes_[RT_UPSAMPLE]);
         if (upsampleCS != 0) {
             upsampleShader_.setId(upsampleCS);
             std::cout << "  ✓ Upsampling compute shader loaded successfully (ID: " << upsampleCS << ")" << std::endl;
@@ -196,14 +481,100 @@ void RayTracingManager::createRayTracingShaders() {
             std::cerr << "  ✗ Failed to load upsampling compute shader!" << std::endl;
         }
         
+        // Load fused reflection, refraction and compositing compute shader
+        std::cout << "  Loading fused compute shader..." << std::endl;
+        GLuint fusedCS = loadKernel(RT_FUSED, localSizes_[RT_FUSED]);
+        if (fusedCS != 0) {
+            fusedShader_.setId(fusedCS);
+            std::cout << "  ✓ Fused compute shader loaded successfully (ID: " << fusedCS << ")" << std::endl;
+        } else {
+            std::cerr << "  ✗ Failed to load fused compute shader!" << std::endl;
+        }
+        
+        // Load caustic map photon splatting and blending shaders (not autotuned)
+        std::cout << "  Loading caustic map shaders..." << std::endl;
+        GLuint causticMapProgram = InitShader("shaders/rt_caustic_map.vs", "shaders/rt_caustic_map.fs");
+        if (causticMapProgram != 0) {
+            causticMapShader_.setId(causticMapProgram);
+            std::cout << "  ✓ Caustic map shader loaded successfully (ID: " << causticMapProgram << ")" << std::endl;
+        } else {
+            std::cerr << "  ✗ Failed to load caustic map shader!" << std::endl;
+        }
+        GLuint causticBlendCS = InitComputeShader("shaders/rt_caustic_blend.cs");
+        if (causticBlendCS != 0) {
+            causticBlendShader_.setId(causticBlendCS);
+            std::cout << "  ✓ Caustic map blend compute shader loaded successfully (ID: " << causticBlendCS << ")" << std::endl;
+        } else {
+            std::cerr << "  ✗ Failed to load caustic map blend compute shader!" << std::endl;
+        }
+        
+        // Load RCAS sharpening compute shader for the edge-aware upsample
+        std::cout << "  Loading sharpening compute shader..." << std::endl;
+        GLuint sharpenCS = loadKernel(RT_SHARPEN, localSizes_[RT_SHARPEN]);
+        if (sharpenCS != 0) {
+            sharpenShader_.setId(sharpenCS);
+            std::cout << "  ✓ Sharpening compute shader loaded successfully (ID: " << sharpenCS << ")" << std::endl;
+        } else {
+            std::cerr << "  ✗ Failed to load sharpening compute shader!" << std::endl;
+        }
+        
+        // Load min-max depth pyramid builder (not autotuned: one small pass per level)
+        std::cout << "  Loading depth pyramid compute shader..." << std::endl;
+        GLuint hiZBuildCS = InitComputeShader("shaders/rt_hiz_build.cs");
+        if (hiZBuildCS != 0) {
+            hiZBuildShader_.setId(hiZBuildCS);
+            std::cout << "  ✓ Depth pyramid compute shader loaded successfully (ID: " << hiZBuildCS << ")" << std::endl;
+        } else {
+            std::cerr << "  ✗ Failed to load depth pyramid compute shader!" << std::endl;
+        }
+        
+        // Load temporal accumulation and à-trous denoising shaders (not autotuned either)
+        std::cout << "  Loading temporal accumulation compute shader..." << std::endl;
+        GLuint temporalCS = InitComputeShader("shaders/rt_temporal.cs", gBufferSource());
+        if (temporalCS != 0) {
+            temporalShader_.setId(temporalCS);
+            std::cout << "  ✓ Temporal accumulation compute shader loaded successfully (ID: " << temporalCS << ")" << std::endl;
+        } else {
+            std::cerr << "  ✗ Failed to load temporal accumulation compute shader!" << std::endl;
+        }
+        
+        std::cout << "  Loading a-trous denoise compute shader..." << std::endl;
+        GLuint atrousCS = InitComputeShader("shaders/rt_atrous.cs", gBufferSource());
+        if (atrousCS != 0) {
+            atrousShader_.setId(atrousCS);
+            std::cout << "  ✓ A-trous denoise compute shader loaded successfully (ID: " << atrousCS << ")" << std::endl;
+        } else {
+            std::cerr << "  ✗ Failed to load a-trous denoise compute shader!" << std::endl;
+        }
+        
+        std::cout << "  Loading interleave reconstruction compute shader..." << std::endl;
+        std::string interleave = ReadShaderSource("shaders/rt_interleave.glsl");
+        GLuint interleaveCS = interleave.empty() ? 0 : InitComputeShader("shaders/rt_interleave.cs", gBufferSource() + interleave + "\n");
+        if (interleaveCS != 0) {
+            interleaveShader_.setId(interleaveCS);
+            std::cout << "  ✓ Interleave reconstruction compute shader loaded successfully (ID: " << interleaveCS << ")" << std::endl;
+        } else {
+            std::cerr << "  ✗ Failed to load interleave reconstruction compute shader!" << std::endl;
+        }
+        
         // Check shader validity
         std::cout << "\nShader validity check:" << std::endl;
         std::cout << "  G-buffer shader valid: " << gBufferShader_.isValid() << std::endl;
+        std::cout << "  Fluid depth G-buffer shader valid: " << gBufferDepthShader_.isValid() << std::endl;
+        std::cout << "  Fluid mesh G-buffer shader valid: " << gBufferMeshShader_.isValid() << std::endl;
         std::cout << "  Reflection shader valid: " << reflectionShader_.isValid() << std::endl;
         std::cout << "  Refraction shader valid: " << refractionShader_.isValid() << std::endl;
         std::cout << "  Caustic shader valid: " << causticShader_.isValid() << std::endl;
         std::cout << "  Compositing shader valid: " << compositingShader_.isValid() << std::endl;
         std::cout << "  Upsampling shader valid: " << upsampleShader_.isValid() << std::endl;
+        std::cout << "  Fused shader valid: " << fusedShader_.isValid() << std::endl;
+        std::cout << "  Sharpening shader valid: " << sharpenShader_.isValid() << std::endl;
+        std::cout << "  Caustic map shader valid: " << causticMapShader_.isValid() << std::endl;
+        std::cout << "  Caustic map blend shader valid: " << causticBlendShader_.isValid() << std::endl;
+        std::cout << "  Depth pyramid shader valid: " << hiZBuildShader_.isValid() << std::endl;
+        std::cout << "  Temporal accumulation shader valid: " << temporalShader_.isValid() << std::endl;
+        std::cout << "  A-trous denoise shader valid: " << atrousShader_.isValid() << std::endl;
+        std::cout << "  Interleave reconstruction shader valid: " << interleaveShader_.isValid() << std::endl;
         
         std::cout << "Ray tracing shader loading completed" << std::endl;
     } catch (const std::exception& e) {
@@ -212,51 +583,97 @@ void RayTracingManager::createRayTracingShaders() {
 }
 
 void RayTracingManager::createFramebuffers() {
-    if (rtWidth_ <= 0 || rtHeight_ <= 0) return;
+    if (allocWidth_ <= 0 || allocHeight_ <= 0) return;
+    GPUMemoryScope memoryScope("Ray tracing");
     
-    // Create G-Buffer for deferred rendering
-    gBuffer_.bind();
+    // Each renderTarget() gives the old texture back to the pool and takes one of the new
+    // size, attached without binding the targets
     
-    // Position + depth texture
-    positionTexture_.generate();
-    positionTexture_.storage(rtWidth_, rtHeight_, GL_RGBA32F);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, positionTexture_.get(), 0);
+    // Position + depth texture; the compact layout rebuilds positions from depth instead
+    if (features_.compactGBuffer) {
+        positionTexture_.cleanup();
+    } else {
+        positionTexture_.renderTarget(allocWidth_, allocHeight_, GL_RGBA32F);
+    }
+    gBuffer_.attachTexture(GL_COLOR_ATTACHMENT0, positionTexture_.get());
     
-    // Normal texture
-    normalTexture_.generate();
-    normalTexture_.storage(rtWidth_, rtHeight_, GL_RGBA16F);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, normalTexture_.get(), 0);
+    // Normal texture, octahedral in two channels for the compact layout
+    normalTexture_.renderTarget(allocWidth_, allocHeight_, features_.compactGBuffer ? GL_RG16_SNORM : GL_RGBA16F);
+    gBuffer_.attachTexture(GL_COLOR_ATTACHMENT1, normalTexture_.get());
     
     // Depth texture
-    depthTexture_.generate();
-    depthTexture_.storage(rtWidth_, rtHeight_, GL_DEPTH_COMPONENT32F);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture_.get(), 0);
+    depthTexture_.renderTarget(allocWidth_, allocHeight_, GL_DEPTH_COMPONENT32F);
+    gBuffer_.attachTexture(GL_DEPTH_ATTACHMENT, depthTexture_.get());
+    
+    // Snorm targets are not required to be renderable; the same 4 bytes as half floats then
+    if (features_.compactGBuffer && gBuffer_.status() != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "WARNING: RG16 snorm normals not renderable, using RG16F" << std::endl;
+        normalTexture_.renderTarget(allocWidth_, allocHeight_, GL_RG16F);
+        gBuffer_.attachTexture(GL_COLOR_ATTACHMENT1, normalTexture_.get());
+    }
     
     // Check framebuffer completeness
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    if (gBuffer_.status() != GL_FRAMEBUFFER_COMPLETE) {
         std::cerr << "Ray tracing G-buffer not complete!" << std::endl;
     }
     
-    gBuffer_.unbind();
+    // Min-max depth pyramid, down to 1x1
+    hiZTexture_.renderTarget(allocWidth_, allocHeight_, GL_RG32F, hiZLevelCount(allocWidth_, allocHeight_));
     
     // Create ray traced result textures
-    rayTracedTexture_.generate();
-    rayTracedTexture_.storage(rtWidth_, rtHeight_, GL_RGBA16F);
+    rayTracedTexture_.renderTarget(allocWidth_, allocHeight_, GL_RGBA16F);
+    reflectionTexture_.renderTarget(allocWidth_, allocHeight_, GL_RGBA16F);
+    refractionTexture_.renderTarget(allocWidth_, allocHeight_, GL_RGBA16F);
+    causticTexture_.renderTarget(allocWidth_, allocHeight_, GL_RGBA16F);
+    
+    // Denoiser history, two of each so a frame reads the last one while writing its own
+    for (SignalHistory& history : histories_) {
+        for (int i = 0; i < 2; i++) {
+            history.color[i].renderTarget(allocWidth_, allocHeight_, GL_RGBA16F);
+            history.moments[i].renderTarget(allocWidth_, allocHeight_, GL_RGBA16F);
+        }
+    }
+    denoiseTexture_.renderTarget(allocWidth_, allocHeight_, GL_RGBA16F);
     
-    reflectionTexture_.generate();
-    reflectionTexture_.storage(rtWidth_, rtHeight_, GL_RGBA16F);
+    // Interleaved tracing's last complete frames, with the clip w they are tested against
+    for (InterleaveHistory& history : interleaveHistories_) {
+        history.color.renderTarget(allocWidth_, allocHeight_, GL_RGBA16F);
+        history.clipW[0].renderTarget(allocWidth_, allocHeight_, GL_R32F);
+        history.clipW[1].renderTarget(allocWidth_, allocHeight_, GL_R32F);
+    }
+    invalidateHistories();
     
-    refractionTexture_.generate();
-    refractionTexture_.storage(rtWidth_, rtHeight_, GL_RGBA16F);
+    // Create final full-resolution texture
+    finalTexture_.renderTarget(screenWidth_, screenHeight_, GL_RGBA8);
+    
+    // Full-resolution guide and intermediate of the edge-aware upsample
+    guideBuffer_.attachTexture(GL_COLOR_ATTACHMENT0, 0);
+    guideNormalTexture_.renderTarget(screenWidth_, screenHeight_, GL_RG16_SNORM);
+    guideBuffer_.attachTexture(GL_COLOR_ATTACHMENT1, guideNormalTexture_.get());
+    guideDepthTexture_.renderTarget(screenWidth_, screenHeight_, GL_DEPTH_COMPONENT32F);
+    guideBuffer_.attachTexture(GL_DEPTH_ATTACHMENT, guideDepthTexture_.get());
+    if (guideBuffer_.status() != GL_FRAMEBUFFER_COMPLETE) {
+        guideNormalTexture_.renderTarget(screenWidth_, screenHeight_, GL_RG16F);
+        guideBuffer_.attachTexture(GL_COLOR_ATTACHMENT1, guideNormalTexture_.get());
+    }
+    if (guideBuffer_.status() != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "Ray tracing upsampling guide not complete!" << std::endl;
+    }
     
-    causticTexture_.generate();
-    causticTexture_.storage(rtWidth_, rtHeight_, GL_RGBA16F);
+    upsampledTexture_.renderTarget(screenWidth_, screenHeight_, GL_RGBA8);
     
-    // Create final full-resolution texture
-    finalTexture_.generate();
-    finalTexture_.storage(screenWidth_, screenHeight_, GL_RGBA8);
+    // Floor-space caustic map, filtered where rt_caustics.cs looks it up
+    causticMapSize_ = std::max(config_.textures.causticSize, 1);
+    causticSplatTexture_.renderTarget(causticMapSize_, causticMapSize_, GL_R16F);
+    causticMapTexture_.renderTarget(causticMapSize_, causticMapSize_, GL_R16F);
+    causticMapTexture_.sampling(GL_LINEAR, GL_LINEAR, GL_CLAMP_TO_EDGE);
+    causticMapBuffer_.attachTexture(GL_COLOR_ATTACHMENT0, causticSplatTexture_.get());
+    if (causticMapBuffer_.status() != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "Ray tracing caustic map not complete!" << std::endl;
+    }
+    causticMapDirty_ = true;
     
-    std::cout << "Ray tracing framebuffers created: " << rtWidth_ << "x" << rtHeight_ << " -> " << screenWidth_ << "x" << screenHeight_ << std::endl;
+    std::cout << "Ray tracing framebuffers created: " << allocWidth_ << "x" << allocHeight_ << " -> " << screenWidth_ << "x" << screenHeight_ << std::endl;
 }
 
 void RayTracingManager::renderWaterRayTraced(const glm::mat4& view, const glm::mat4& projection,
@@ -268,43 +685,53 @@ void RayTracingManager::renderWaterRayTraced(const glm::mat4& view, const glm::m
     bool shouldDebug = (frameCount == 1 || frameCount % 60 == 0);
     
     if (shouldDebug) {
-        std::cout << "\n=== Ray Tracing Frame " << frameCount << " ===" << std::endl;
-        std::cout << "Quality: " << (int)quality_ << " (OFF=" << (int)RayTracingQuality::OFF << ")" << std::endl;
-        std::cout << "RT Resolution: " << rtWidth_ << "x" << rtHeight_ << std::endl;
-        std::cout << "Water VAO: " << waterVAO_ << ", Vertex Count: " << waterVertexCount_ << std::endl;
-        std::cout << "Features - Reflections: " << features_.reflections 
-                  << ", Refractions: " << features_.refractions 
-                  << ", Caustics: " << features_.caustics << std::endl;
+        WATERSIM_LOG_DEBUG(LogCategory::RAY_TRACING, "Ray tracing frame " << frameCount << ": quality " << (int)quality_
+                  << ", " << rtWidth_ << "x" << rtHeight_ << ", water VAO " << water_.vao << " (" << water_.indexCount
+                  << " vertices), reflections " << features_.reflections << ", refractions " << features_.refractions
+                  << ", caustics " << features_.caustics);
     }
     
     if (quality_ == RayTracingQuality::OFF) {
         if (shouldDebug) {
-            std::cout << "Ray tracing SKIPPED - Quality is OFF" << std::endl;
+            WATERSIM_LOG_DEBUG(LogCategory::RAY_TRACING, "Ray tracing SKIPPED - Quality is OFF");
         }
         return;
     }
     
     if (rtWidth_ <= 0 || rtHeight_ <= 0) {
         if (shouldDebug) {
-            std::cout << "Ray tracing SKIPPED - Invalid resolution" << std::endl;
+            WATERSIM_LOG_DEBUG(LogCategory::RAY_TRACING, "Ray tracing SKIPPED - Invalid resolution");
         }
         return;
     }
     
-    if (waterVAO_ == 0 || waterVertexCount_ == 0) {
+    if (!hasWaterSurface()) {
         if (shouldDebug) {
-            std::cout << "Ray tracing SKIPPED - No water geometry" << std::endl;
+            WATERSIM_LOG_DEBUG(LogCategory::RAY_TRACING, "Ray tracing SKIPPED - No water geometry");
         }
         return;
     }
     
-    if (shouldDebug) {
-        std::cout << "Starting ray tracing render..." << std::endl;
+    viewMatrix_ = view;
+    projectionMatrix_ = projection;
+    
+    // First traced frame without cached sizes: tune on its real inputs
+    if (!autotuned_) {
+        autotuneKernels(view, projection, cameraPos, lightPos);
     }
     
-    // Start timing
-    auto startTime = std::chrono::high_resolution_clock::now();
-    glBeginQuery(GL_TIME_ELAPSED, timeQuery_);
+    // Start timing in the next ring slot, unless the GPU still owes that slot's results.
+    // A new measurement resizes this frame's traced area under dynamic resolution
+    if (readBackTimers() && frameBudgetMs_ > 0.0f) {
+        updateDynamicResolution();
+    }
+    timing_ = timestampQueries_[0][0] != 0 && !timerPending_[timerSlot_];
+    if (timing_) {
+        glQueryCounter(timestampQueries_[timerSlot_][0], GL_TIMESTAMP);
+    }
+    if (sampleCounterBuffer_ != 0) {
+        glClearNamedBufferData(sampleCounterBuffer_, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+    }
     
     // Save current viewport
     GLint viewport[4];
@@ -314,80 +741,288 @@ void RayTracingManager::renderWaterRayTraced(const glm::mat4& view, const glm::m
     glViewport(0, 0, rtWidth_, rtHeight_);
     
     // 1. Render G-Buffer for water surface (this needs actual water geometry)
-    if (shouldDebug) std::cout << "Rendering G-Buffer..." << std::endl;
-    renderGBuffer(view, projection);
+    renderGBuffer(view, projection, gBuffer_, rtWidth_, rtHeight_, features_.compactGBuffer);
+    recordTraffic(RayTracingPass::GBUFFER);
+    markPassEnd(RayTracingPass::GBUFFER);
+    
+    // Min-max depth pyramid the reflection and refraction rays are traced through
+    if (features_.reflections || features_.refractions) {
+        buildHiZ();
+        recordTraffic(RayTracingPass::DEPTH_PYRAMID);
+    }
+    markPassEnd(RayTracingPass::DEPTH_PYRAMID);
+    
+    // The fused kernel traces reflections and refractions while compositing (step 6)
+    bool fused = useFusedKernel();
     
     // 2. Trace reflections if enabled
-    if (features_.reflections) {
-        if (shouldDebug) std::cout << "Tracing reflections..." << std::endl;
+    if (features_.reflections && !fused) {
         traceReflections(cameraPos, lightPos);
+        reconstructInterleaved(SIGNAL_REFLECTION, reflectionTexture_);
+        recordTraffic(RayTracingPass::REFLECTIONS);
     }
+    markPassEnd(RayTracingPass::REFLECTIONS);
     
     // 3. Trace refractions if enabled
-    if (features_.refractions) {
-        if (shouldDebug) std::cout << "Tracing refractions..." << std::endl;
+    if (features_.refractions && !fused) {
         traceRefractions(cameraPos);
+        reconstructInterleaved(SIGNAL_REFRACTION, refractionTexture_);
+        recordTraffic(RayTracingPass::REFRACTIONS);
     }
+    markPassEnd(RayTracingPass::REFRACTIONS);
     
-    // 4. Generate caustics if enabled
-    if (features_.caustics) {
-        if (shouldDebug) std::cout << "Generating caustics..." << std::endl;
+    // 4. Generate caustics if enabled; alongside the fused kernel only every
+    // causticInterval frames, the slow-moving pattern being reused in between
+    int causticInterval = fused ? std::max(features_.causticInterval, 1) : 1;
+    causticsTraced_ = features_.caustics && frameIndex_ % causticInterval == 0;
+    if (causticsTraced_) {
         traceCaustics(lightPos);
+        reconstructInterleaved(SIGNAL_CAUSTICS, causticTexture_);
+        recordTraffic(RayTracingPass::CAUSTICS);
     }
+    markPassEnd(RayTracingPass::CAUSTICS);
     
-    // 5. Composite all results
-    if (shouldDebug) std::cout << "Compositing results..." << std::endl;
-    compositeResults(cameraPos);
+    // 5. Accumulate with the previous frames and denoise
+    if (features_.temporalDenoise) {
+        denoiseResults();
+        recordTraffic(RayTracingPass::DENOISE);
+    }
+    markPassEnd(RayTracingPass::DENOISE);
     
-    // 6. Upsample to full resolution if needed
+    // 6. Composite all results
+    if (fused) {
+        traceFused(cameraPos, lightPos);
+    } else {
+        compositeResults(cameraPos);
+    }
+    recordTraffic(RayTracingPass::COMPOSITE);
+    markPassEnd(RayTracingPass::COMPOSITE);
+    
+    // 7. Upsample to full resolution if needed
     if (rtWidth_ != screenWidth_ || rtHeight_ != screenHeight_) {
-        if (shouldDebug) std::cout << "Upsampling to full resolution..." << std::endl;
         upsampleToFullResolution();
+        recordTraffic(RayTracingPass::UPSAMPLE);
+    }
+    
+    // The sample counters ahead of the last timestamp, which then says they have landed
+    if (timing_ && sampleReadback_) {
+        glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+        glCopyNamedBufferSubData(sampleCounterBuffer_, sampleReadbackBuffer_, 0,
+                                 timerSlot_ * 2 * sizeof(uint32_t), 2 * sizeof(uint32_t));
     }
+    markPassEnd(RayTracingPass::UPSAMPLE);
     
     // Restore original viewport
     glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
     
-    // End timing
-    glEndQuery(GL_TIME_ELAPSED);
+    frameIndex_++;
     
     // Ensure all compute shader operations are complete
     glMemoryBarrier(GL_ALL_BARRIER_BITS);
     
-    // Calculate performance metrics
-    auto endTime = std::chrono::high_resolution_clock::now();
-    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime);
-    lastFrameTime_ = duration.count() / 1000.0f; // Convert to milliseconds
-    
-    // Estimate rays per second (rough calculation)
-    int totalRays = rtWidth_ * rtHeight_;
-    if (quality_ == RayTracingQuality::ULTRA) totalRays *= 4; // Supersampling
-    raysPerSecond_ = (lastFrameTime_ > 0) ? (int)(totalRays / (lastFrameTime_ / 1000.0f)) : 0;
+    // Rays this frame, turned into a rate once its timestamps come back
+    if (timing_) {
+        // One ray per traced pixel; the adaptive extra rays are added when the counters land
+        int totalRays = rtWidth_ * rtHeight_ / interleavePhases();
+        timerRays_[timerSlot_] = totalRays;
+        timerSampleBudget_[timerSlot_] = sampleBudget();
+        timerPixels_[timerSlot_] = rtWidth_ * rtHeight_;
+        timerPending_[timerSlot_] = true;
+        timerSlot_ = (timerSlot_ + 1) % TIMER_FRAMES;
+        timing_ = false;
+    }
     
-    if (shouldDebug) {
-        std::cout << "Ray tracing completed - Frame time: " << lastFrameTime_ << "ms" << std::endl;
-        std::cout << "Final texture ID: " << finalTexture_.get() << std::endl;
-        std::cout << "============================\n" << std::endl;
+    if (shouldDebug && Logger::instance().isEnabled()) {
+        std::ostringstream passes;
+        for (int pass = 0; pass < PASS_COUNT; pass++) {
+            passes << (pass > 0 ? ", " : "") << getPassName(static_cast<RayTracingPass>(pass)) << " " << passTimes_[pass];
+        }
+        WATERSIM_LOG_DEBUG(LogCategory::RAY_TRACING, "Ray tracing completed - GPU frame time: " << lastFrameTime_
+                  << "ms (" << passes.str() << "), final texture " << finalTexture_.get());
+    }
+}
+
+const char* RayTracingManager::getPassName(RayTracingPass pass) {
+    switch (pass) {
+        case RayTracingPass::GBUFFER:       return "G-buffer";
+        case RayTracingPass::DEPTH_PYRAMID: return "Depth pyramid";
+        case RayTracingPass::REFLECTIONS:   return "Reflections";
+        case RayTracingPass::REFRACTIONS:   return "Refractions";
+        case RayTracingPass::CAUSTICS:      return "Caustics";
+        case RayTracingPass::DENOISE:       return "Denoise";
+        case RayTracingPass::COMPOSITE:     return "Composite";
+        case RayTracingPass::UPSAMPLE:      return "Upsample";
+        default:                            return "Unknown";
+    }
+}
+
+void RayTracingManager::recordTraffic(RayTracingPass pass) const {
+    const GPUMemoryTracker& tracker = GPUMemoryTracker::instance();
+    auto bytes = [&](std::initializer_list<GLuint> textures, double scale) {
+        size_t total = 0;
+        for (GLuint texture : textures) total += tracker.getTextureBytes(texture);
+        return static_cast<size_t>(double(total) * scale);
+    };
+    
+    // Targets are allocated at the largest traced size; a sparse pattern traces its share
+    double traced = double(rtWidth_) * rtHeight_ / std::max(double(allocWidth_) * allocHeight_, 1.0);
+    double rays = traced / interleavePhases();
+    size_t gBuffer = bytes({ positionTexture_.get(), normalTexture_.get(), depthTexture_.get() }, 1.0);
+    size_t signals = bytes({ reflectionTexture_.get(), refractionTexture_.get(), causticTexture_.get() }, traced);
+    
+    size_t read = 0, written = 0;
+    switch (pass) {
+        case RayTracingPass::GBUFFER:
+            written = static_cast<size_t>(double(gBuffer) * traced);
+            break;
+        case RayTracingPass::DEPTH_PYRAMID:
+            read = bytes({ depthTexture_.get() }, traced);
+            written = bytes({ hiZTexture_.get() }, traced);
+            break;
+        case RayTracingPass::REFLECTIONS:
+            read = static_cast<size_t>(double(gBuffer) * rays) + bytes({ hiZTexture_.get() }, rays);
+            written = bytes({ reflectionTexture_.get() }, rays);
+            break;
+        case RayTracingPass::REFRACTIONS:
+            read = static_cast<size_t>(double(gBuffer) * rays) + bytes({ hiZTexture_.get() }, rays);
+            written = bytes({ refractionTexture_.get() }, rays);
+            break;
+        case RayTracingPass::CAUSTICS:
+            read = static_cast<size_t>(double(gBuffer) * rays) + bytes({ causticMapTexture_.get() }, 1.0);
+            written = bytes({ causticTexture_.get() }, rays);
+            break;
+        case RayTracingPass::DENOISE:
+            // Each signal reads one history of each pair and writes the other
+            for (const SignalHistory& history : histories_) {
+                size_t pair = bytes({ history.color[0].get(), history.moments[0].get() }, traced);
+                read += pair;
+                written += pair;
+            }
+            read += signals;
+            break;
+        case RayTracingPass::COMPOSITE:
+            read = static_cast<size_t>(double(gBuffer) * traced) + signals;
+            if (useFusedKernel()) read += bytes({ hiZTexture_.get() }, traced);
+            written = bytes({ rayTracedTexture_.get() }, traced);
+            break;
+        case RayTracingPass::UPSAMPLE:
+            read = bytes({ rayTracedTexture_.get() }, traced) +
+                   bytes({ guideNormalTexture_.get(), guideDepthTexture_.get() }, 1.0);
+            written = bytes({ upsampledTexture_.get() }, 1.0);
+            break;
+        default:
+            return;
+    }
+    GPUMemoryTracker::instance().addTraffic(std::string("RT ") + getPassName(pass), read, written);
+}
+
+void RayTracingManager::markPassEnd(RayTracingPass pass) {
+    // A skipped pass still gets its timestamp and shows as ~0 ms
+    if (timing_) {
+        glQueryCounter(timestampQueries_[timerSlot_][static_cast<int>(pass) + 1], GL_TIMESTAMP);
     }
 }
 
-void RayTracingManager::renderGBuffer(const glm::mat4& view, const glm::mat4& projection) {
-    // Bind G-Buffer
-    gBuffer_.bind();
+bool RayTracingManager::readBackTimers() {
+    // Oldest slot first, so the latest finished frame is what stays in passTimes_
+    bool measured = false;
+    for (int i = 0; i < TIMER_FRAMES; i++) {
+        int slot = (timerSlot_ + i) % TIMER_FRAMES;
+        if (!timerPending_[slot]) continue;
+        
+        // The last timestamp is the last to land; once it has, all of them have
+        GLint available = 0;
+        glGetQueryObjectiv(timestampQueries_[slot][PASS_COUNT], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) continue;
+        
+        GLuint64 timestamps[PASS_COUNT + 1];
+        for (int mark = 0; mark <= PASS_COUNT; mark++) {
+            glGetQueryObjectui64v(timestampQueries_[slot][mark], GL_QUERY_RESULT, &timestamps[mark]);
+        }
+        for (int pass = 0; pass < PASS_COUNT; pass++) {
+            passTimes_[pass] = static_cast<float>(timestamps[pass + 1] - timestamps[pass]) / 1.0e6f;
+        }
+        lastFrameTime_ = static_cast<float>(timestamps[PASS_COUNT] - timestamps[0]) / 1.0e6f;
+        
+        // The extra rays asked for may overshoot the budget, what was traced does not
+        adaptiveSamples_ = 0;
+        adaptiveTexels_ = 0;
+        if (sampleReadback_) {
+            adaptiveSamples_ = static_cast<int>(std::min(sampleReadback_[slot * 2], timerSampleBudget_[slot]));
+            adaptiveTexels_ = static_cast<int>(sampleReadback_[slot * 2 + 1]);
+        }
+        double rays = static_cast<double>(timerRays_[slot]) + adaptiveSamples_;
+        raysPerSecond_ = lastFrameTime_ > 0.0f ? static_cast<int>(rays / (lastFrameTime_ / 1000.0f)) : 0;
+        timedPixels_ = timerPixels_[slot];
+        timerPending_[slot] = false;
+        measured = true;
+    }
+    return measured;
+}
+
+void RayTracingManager::renderGBuffer(const glm::mat4& view, const glm::mat4& projection,
+                                      GLFramebuffer& target, int width, int height, bool compact) {
+    // Bind G-Buffer (or the full-resolution upsampling guide)
+    target.bind();
     
     // Set viewport
-    glViewport(0, 0, rtWidth_, rtHeight_);
+    glViewport(0, 0, width, height);
     
-    // Enable multiple render targets
-    GLenum drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+    // Enable multiple render targets (only the normals in the compact layout)
+    GLenum drawBuffers[] = { compact ? GLenum(GL_NONE) : GLenum(GL_COLOR_ATTACHMENT0), GL_COLOR_ATTACHMENT1 };
     glDrawBuffers(2, drawBuffers);
     
     // Clear
     glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     
+    // SPH screen-space fluid: its smoothed depth resolved into the G-buffer as it is
+    if (surfaceSource_ == RayTracingSurface::FLUID_DEPTH) {
+        if (gBufferDepthShader_.isValid() && fluidDepthTexture_ != 0) {
+            gBufferDepthShader_.use();
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, fluidDepthTexture_);
+            gBufferDepthShader_.setInt("uFluidDepth", 0);
+            gBufferDepthShader_.setMat4("uInverseViewProjection", glm::inverse(projection * view));
+            gBufferDepthShader_.setVec3("uCameraPos", glm::vec3(glm::inverse(view)[3]));
+            gBufferDepthShader_.setBool("uCompactGBuffer", compact);
+            
+            glEnable(GL_DEPTH_TEST);
+            glDepthFunc(GL_LESS);
+            if (emptyVAO_ == 0) {
+                glGenVertexArrays(1, &emptyVAO_);
+            }
+            glBindVertexArray(emptyVAO_);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+            glBindVertexArray(0);
+            glDisable(GL_DEPTH_TEST);
+        }
+    }
+    // SPH marching cubes mesh, drawn from its buffer with the command at its head
+    else if (surfaceSource_ == RayTracingSurface::FLUID_MESH) {
+        if (gBufferMeshShader_.isValid() && fluidMeshBuffer_ != 0) {
+            gBufferMeshShader_.use();
+            gBufferMeshShader_.setMat4("uView", view);
+            gBufferMeshShader_.setMat4("uProjection", projection);
+            gBufferMeshShader_.setBool("uCompactGBuffer", compact);
+            gBufferMeshShader_.setBool("uOceanWaves", false);
+            
+            glEnable(GL_DEPTH_TEST);
+            glDepthFunc(GL_LESS);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 30, fluidMeshBuffer_);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, fluidMeshBuffer_);
+            if (emptyVAO_ == 0) {
+                glGenVertexArrays(1, &emptyVAO_);
+            }
+            glBindVertexArray(emptyVAO_);
+            glDrawArraysIndirect(GL_TRIANGLES, nullptr);
+            glBindVertexArray(0);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+            glDisable(GL_DEPTH_TEST);
+        }
+    }
     // Render water surface geometry to G-Buffer
-    if (waterVAO_ != 0 && waterVertexCount_ > 0) {
+    else if (water_.vao != 0 && water_.indexCount > 0) {
         gBufferShader_.use();
         
         // Set matrices
@@ -398,24 +1033,224 @@ void RayTracingManager::renderGBuffer(const glm::mat4& view, const glm::mat4& pr
         gBufferShader_.setMat4("uView", view);
         gBufferShader_.setMat4("uProjection", projection);
         gBufferShader_.setMat3("uNormalMatrix", normalMatrix);
+        gBufferShader_.setBool("uCompactGBuffer", compact);
         
         // Water properties
         gBufferShader_.setFloat("uWaterLevel", 0.0f);
         gBufferShader_.setVec3("uWaterColor", glm::vec3(0.1f, 0.4f, 0.7f));
         
+        // FFT ocean: same displacement and per-pixel normal as water.vs / water.fs
+        bool ocean = water_.oceanDisplacement != 0;
+        gBufferShader_.setBool("uOceanWaves", ocean);
+        gBufferShader_.setBool("uPackedVertices", water_.packedVertices);
+        gBufferShader_.setFloat("uSurfaceSize", water_.size);
+        if (ocean) {
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, water_.oceanDisplacement);
+            gBufferShader_.setInt("uOceanDisplacement", 0);
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, water_.oceanNormalFoam);
+            gBufferShader_.setInt("uOceanNormalFoam", 1);
+            gBufferShader_.setFloat("uOceanPatchSize", water_.oceanPatchSize);
+            glActiveTexture(GL_TEXTURE0);
+        }
+        bindSurfaceHeights(gBufferShader_);
+        
         // Enable depth testing
         glEnable(GL_DEPTH_TEST);
         glDepthFunc(GL_LESS);
         
         // Bind water geometry and render
-        glBindVertexArray(waterVAO_);
-        glDrawArrays(GL_TRIANGLES, 0, waterVertexCount_);
+        glBindVertexArray(water_.vao);
+        glEnable(GL_PRIMITIVE_RESTART_FIXED_INDEX);
+        glDrawElementsBaseVertex(water_.primitive, water_.indexCount, water_.indexType, 0, water_.baseVertex);
+        glDisable(GL_PRIMITIVE_RESTART_FIXED_INDEX);
         glBindVertexArray(0);
         
         glDisable(GL_DEPTH_TEST);
     }
     
-    gBuffer_.unbind();
+    target.unbind();
+}
+
+bool RayTracingManager::hasWaterSurface() const {
+    switch (surfaceSource_) {
+        case RayTracingSurface::FLUID_DEPTH: return fluidDepthTexture_ != 0;
+        case RayTracingSurface::FLUID_MESH:  return fluidMeshBuffer_ != 0;
+        default:                             return water_.vao != 0 && water_.indexCount > 0;
+    }
+}
+
+void RayTracingManager::buildHiZ() {
+    // Only over the traced corner of the allocated pyramid
+    hiZLevels_ = hiZLevelCount(rtWidth_, rtHeight_);
+    if (!hiZBuildShader_.isValid()) return;
+    
+    hiZBuildShader_.use();
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, depthTexture_.get());
+    hiZBuildShader_.setInt("uDepthTexture", 0);
+    
+    // Level 0 from the depth buffer, then each level from the one below
+    for (int level = 0; level < hiZLevels_; level++) {
+        int width = std::max(rtWidth_ >> level, 1);
+        int height = std::max(rtHeight_ >> level, 1);
+        glBindImageTexture(0, hiZTexture_.get(), std::max(level - 1, 0), GL_FALSE, 0, GL_READ_ONLY, GL_RG32F);
+        glBindImageTexture(1, hiZTexture_.get(), level, GL_FALSE, 0, GL_WRITE_ONLY, GL_RG32F);
+        hiZBuildShader_.setInt("uLevel", level);
+        hiZBuildShader_.setVec2("uLevelSize", glm::vec2(width, height));
+        hiZBuildShader_.setVec2("uPreviousSize", glm::vec2(std::max(rtWidth_ >> std::max(level - 1, 0), 1),
+                                                           std::max(rtHeight_ >> std::max(level - 1, 0), 1)));
+        glDispatchCompute((width + 7) / 8, (height + 7) / 8, 1);
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    }
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+}
+
+void RayTracingManager::setCameraUniforms(const GLShaderProgram& shader) const {
+    shader.setMat4("uViewMatrix", viewMatrix_);
+    shader.setMat4("uProjectionMatrix", projectionMatrix_);
+    shader.setMat4("uInverseViewMatrix", glm::inverse(viewMatrix_));
+    shader.setMat4("uInverseProjectionMatrix", glm::inverse(projectionMatrix_));
+    shader.setMat4("uInverseViewProjection", glm::inverse(projectionMatrix_ * viewMatrix_));
+    shader.setInt("uHiZLevels", hiZLevels_);
+    shader.setVec2("uHiZSize", glm::vec2(rtWidth_, rtHeight_));
+    shader.setInt("uMaxRaySteps", traceIterations());
+}
+
+void RayTracingManager::setSceneProxyUniforms(const GLShaderProgram& shader) const {
+    shader.setBool("uProxiesEnabled", proxiesSet_);
+    shader.setVec3("uProxyBoxMin", proxyBoxMin_);
+    shader.setVec3("uProxyBoxMax", proxyBoxMax_);
+    shader.setVec4("uProxySphere", proxySphere_);
+    shader.setVec3("uProxySphereColor", proxySphereColor_);
+}
+
+void RayTracingManager::setCoarseShadingUniforms(const GLShaderProgram& shader) const {
+    // The rates are per window tile; the traced texels cover the window at the traced scale
+    shader.setBool("uCoarseShading", shadingRateTexture_ != 0);
+    if (shadingRateTexture_ == 0) return;
+    glBindTextureUnit(7, shadingRateTexture_);
+    shader.setInt("uShadingRateTexture", 7);
+    shader.setVec2("uCoarseScale", glm::vec2(float(rtWidth_) / float(screenWidth_), float(rtHeight_) / float(screenHeight_)));
+    shader.setInt("uShadingRateTile", shadingRateTile_);
+}
+
+int RayTracingManager::traceIterations() const {
+    // Pyramid cells per ray; a skipped cell covers open space of any size, so these stay
+    // small even at full resolution
+    switch (quality_) {
+        case RayTracingQuality::LOW:    return 24;
+        case RayTracingQuality::MEDIUM:
+        case RayTracingQuality::CHECKERBOARD:
+        case RayTracingQuality::INTERLEAVED_2X2: return 32;
+        case RayTracingQuality::HIGH:   return 48;
+        default:                        return 64;
+    }
+}
+
+int RayTracingManager::interleavePhases() const {
+    // Without the reconstruction every texel is traced. The fused kernel's reflections and
+    // refractions always are, as it composites what it traces; its caustics still interleave
+    if (!interleaveShader_.isValid()) return 1;
+    switch (quality_) {
+        case RayTracingQuality::CHECKERBOARD:    return 2;
+        case RayTracingQuality::INTERLEAVED_2X2: return 4;
+        default:                                 return 1;
+    }
+}
+
+void RayTracingManager::setInterleaveUniforms(const GLShaderProgram& shader, int signal) const {
+    // Counted per signal: caustics traced every other frame still visit every phase
+    int phases = interleavePhases();
+    shader.setInt("uInterleavePhases", phases);
+    shader.setInt("uInterleavePhase", static_cast<int>(interleaveHistories_[signal].frame % phases));
+}
+
+void RayTracingManager::createAdaptiveSampling() {
+    GPUMemoryScope memoryScope("Ray tracing");
+    std::vector<uint8_t> noise = generateBlueNoise(BLUE_NOISE_SIZE);
+    blueNoiseTexture_.storage(BLUE_NOISE_SIZE, BLUE_NOISE_SIZE, GL_R8);
+    blueNoiseTexture_.sampling(GL_NEAREST, GL_NEAREST, GL_REPEAT);
+    glTextureSubImage2D(blueNoiseTexture_.get(), 0, 0, 0, BLUE_NOISE_SIZE, BLUE_NOISE_SIZE, GL_RED, GL_UNSIGNED_BYTE, noise.data());
+    
+    glCreateBuffers(1, &sampleCounterBuffer_);
+    glNamedBufferStorage(sampleCounterBuffer_, 2 * sizeof(uint32_t), nullptr, GL_DYNAMIC_STORAGE_BIT);
+    GLbitfield readbackFlags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    GLsizeiptr readbackBytes = TIMER_FRAMES * 2 * sizeof(uint32_t);
+    glCreateBuffers(1, &sampleReadbackBuffer_);
+    glNamedBufferStorage(sampleReadbackBuffer_, readbackBytes, nullptr, readbackFlags);
+    sampleReadback_ = static_cast<const uint32_t*>(glMapNamedBufferRange(sampleReadbackBuffer_, 0, readbackBytes, readbackFlags));
+}
+
+uint32_t RayTracingManager::sampleBudget() const {
+    if (quality_ != RayTracingQuality::ULTRA) return 0;
+    float texels = static_cast<float>(rtWidth_) * rtHeight_ / interleavePhases();
+    return static_cast<uint32_t>(std::max(features_.adaptiveSampleBudget, 0.0f) * texels);
+}
+
+void RayTracingManager::setAdaptiveSamplingUniforms(const GLShaderProgram& shader) const {
+    // Off ULTRA every texel traces its mirror ray alone; the blue noise still dithers
+    bool adaptive = quality_ == RayTracingQuality::ULTRA && sampleCounterBuffer_ != 0;
+    shader.setInt("uMaxSamples", adaptive ? std::max(features_.adaptiveMaxSamples, 1) : 1);
+    shader.setUint("uSampleBudget", sampleBudget());
+    glBindTextureUnit(8, blueNoiseTexture_.get());
+    shader.setInt("uBlueNoise", 8);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, sampleCounterBuffer_);
+}
+
+void RayTracingManager::dispatchInterleaved(int kernel) const {
+    // Packed: half the columns for the checkerboard, half of both for the 2x2 pattern
+    int phases = interleavePhases();
+    int width = phases > 1 ? (rtWidth_ + 1) / 2 : rtWidth_;
+    int height = phases > 2 ? (rtHeight_ + 1) / 2 : rtHeight_;
+    dispatchKernel(kernel, width, height);
+}
+
+void RayTracingManager::reconstructInterleaved(int signal, GLTexture2D& texture) {
+    if (interleavePhases() == 1) return;
+    
+    InterleaveHistory& history = interleaveHistories_[signal];
+    int current = history.index ^ 1;
+    glm::mat4 viewProjection = projectionMatrix_ * viewMatrix_;
+    
+    interleaveShader_.use();
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, history.color.get());
+    interleaveShader_.setInt("uHistoryTexture", 0);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, history.clipW[history.index].get());
+    interleaveShader_.setInt("uHistoryClipW", 1);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, positionTexture_.get());
+    interleaveShader_.setInt("uPositionTexture", 2);
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_2D, depthTexture_.get());
+    interleaveShader_.setInt("uDepthTexture", 3);
+    glActiveTexture(GL_TEXTURE0);
+    
+    glBindImageTexture(0, texture.get(), 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA16F);
+    glBindImageTexture(1, history.clipW[current].get(), 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+    
+    interleaveShader_.setVec2("uResolution", glm::vec2(rtWidth_, rtHeight_));
+    interleaveShader_.setVec2("uPrevResolution", glm::vec2(history.resolution));
+    interleaveShader_.setMat4("uViewProjection", viewProjection);
+    interleaveShader_.setMat4("uPrevViewProjection", history.viewProjection);
+    interleaveShader_.setMat4("uInverseViewProjection", glm::inverse(viewProjection));
+    interleaveShader_.setBool("uHistoryValid", history.valid);
+    setInterleaveUniforms(interleaveShader_, signal);
+    
+    glDispatchCompute((rtWidth_ + 7) / 8, (rtHeight_ + 7) / 8, 1);
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+    
+    // The complete frame the next one's skipped texels reproject into
+    glCopyImageSubData(texture.get(), GL_TEXTURE_2D, 0, 0, 0, 0,
+                       history.color.get(), GL_TEXTURE_2D, 0, 0, 0, 0, rtWidth_, rtHeight_, 1);
+    history.viewProjection = viewProjection;
+    history.resolution = glm::ivec2(rtWidth_, rtHeight_);
+    history.index = current;
+    history.valid = true;
+    history.frame++;
 }
 
 void RayTracingManager::traceReflections(const glm::vec3& cameraPos, const glm::vec3& lightPos) {
@@ -435,6 +1270,15 @@ void RayTracingManager::traceReflections(const glm::vec3& cameraPos, const glm::
     glBindTexture(GL_TEXTURE_2D, depthTexture_.get());
     reflectionShader_.setInt("uDepthTexture", 2);
     
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, environmentMap_);
+    reflectionShader_.setInt("uEnvironmentMap", 3);
+    
+    glActiveTexture(GL_TEXTURE4);
+    glBindTexture(GL_TEXTURE_2D, hiZTexture_.get());
+    reflectionShader_.setInt("uHiZTexture", 4);
+    glActiveTexture(GL_TEXTURE0);
+    
     // Bind output texture
     glBindImageTexture(0, reflectionTexture_.get(), 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
     
@@ -442,11 +1286,14 @@ void RayTracingManager::traceReflections(const glm::vec3& cameraPos, const glm::
     reflectionShader_.setVec3("uCameraPos", cameraPos);
     reflectionShader_.setVec3("uLightPos", lightPos);
     reflectionShader_.setVec2("uResolution", glm::vec2(rtWidth_, rtHeight_));
+    reflectionShader_.setInt("uFrameIndex", features_.temporalDenoise ? static_cast<int>(frameIndex_ % 64) : 0);
+    setCameraUniforms(reflectionShader_);
+    setSceneProxyUniforms(reflectionShader_);
     
     // Dispatch compute shader
-    int groupsX = (rtWidth_ + 15) / 16;
-    int groupsY = (rtHeight_ + 15) / 16;
-    glDispatchCompute(groupsX, groupsY, 1);
+    setAdaptiveSamplingUniforms(reflectionShader_);
+    setInterleaveUniforms(reflectionShader_, SIGNAL_REFLECTION);
+    dispatchInterleaved(RT_REFLECTION);
     
     // Memory barrier
     glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
@@ -469,34 +1316,72 @@ void RayTracingManager::traceRefractions(const glm::vec3& cameraPos) {
     glBindTexture(GL_TEXTURE_2D, depthTexture_.get());
     refractionShader_.setInt("uDepthTexture", 2);
     
+    glActiveTexture(GL_TEXTURE4);
+    glBindTexture(GL_TEXTURE_2D, hiZTexture_.get());
+    refractionShader_.setInt("uHiZTexture", 4);
+    glActiveTexture(GL_TEXTURE0);
+    
     // Bind output texture
     glBindImageTexture(1, refractionTexture_.get(), 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
     
     // Set uniforms
     refractionShader_.setVec3("uCameraPos", cameraPos);
     refractionShader_.setVec2("uResolution", glm::vec2(rtWidth_, rtHeight_));
+    setCameraUniforms(refractionShader_);
     refractionShader_.setFloat("uWaterIOR", 1.33f);
     refractionShader_.setFloat("uWaterDepth", 5.0f);
     refractionShader_.setVec3("uWaterColor", glm::vec3(0.1f, 0.3f, 0.6f));
     
     // Dispatch compute shader
-    int groupsX = (rtWidth_ + 15) / 16;
-    int groupsY = (rtHeight_ + 15) / 16;
-    glDispatchCompute(groupsX, groupsY, 1);
+    setInterleaveUniforms(refractionShader_, SIGNAL_REFRACTION);
+    dispatchInterleaved(RT_REFRACTION);
     
     glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
 }
 
 void RayTracingManager::traceCaustics(const glm::vec3& lightPos) {
-    // Generate caustic patterns using ray tracing
+    // Generate caustic patterns using ray tracing, or from the floor-space map when on
+    bool causticMap = useCausticMap();
+    if (causticMap) {
+        updateCausticMap();
+    }
+    
     causticShader_.use();
     
     // Bind output texture
     glBindImageTexture(2, causticTexture_.get(), 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
     
+    // G-buffer the view rays are refracted at, and the map they look up
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, depthTexture_.get());
+    causticShader_.setInt("uDepthTexture", 2);
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_2D, positionTexture_.get());
+    causticShader_.setInt("uPositionTexture", 3);
+    glActiveTexture(GL_TEXTURE4);
+    glBindTexture(GL_TEXTURE_2D, normalTexture_.get());
+    causticShader_.setInt("uNormalTexture", 4);
+    glActiveTexture(GL_TEXTURE5);
+    glBindTexture(GL_TEXTURE_2D, causticMapTexture_.get());
+    causticShader_.setInt("uCausticMapTexture", 5);
+    
+    // The traced rays refract at the frame's wave state, the same surface the G-buffer drew
+    bool waveState = water_.waveHeightMap != 0 && water_.waveNormalMap != 0;
+    causticShader_.setBool("uWaveState", waveState);
+    if (waveState) {
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, water_.waveHeightMap);
+        causticShader_.setInt("uWaterHeightMap", 0);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, water_.waveNormalMap);
+        causticShader_.setInt("uWaterNormalMap", 1);
+        causticShader_.setFloat("uWaveStateSize", water_.waveHeightMapSize);
+    }
+    glActiveTexture(GL_TEXTURE0);
+    
     // Set uniforms
     causticShader_.setVec3("uLightPos", lightPos);
-    causticShader_.setVec3("uLightDir", glm::normalize(glm::vec3(0.0f, -1.0f, 0.2f))); // Directional light
+    causticShader_.setVec3("uLightDir", glm::normalize(CAUSTIC_LIGHT_DIR)); // Directional light
     causticShader_.setVec2("uResolution", glm::vec2(rtWidth_, rtHeight_));
     causticShader_.setFloat("uTime", static_cast<float>(glfwGetTime()));
     causticShader_.setFloat("uWaterLevel", 0.0f);
@@ -504,16 +1389,195 @@ void RayTracingManager::traceCaustics(const glm::vec3& lightPos) {
     causticShader_.setFloat("uWaterIOR", 1.33f);
     causticShader_.setInt("uCausticRays", 64);
     causticShader_.setFloat("uCausticRadius", 2.0f);
-    causticShader_.setFloat("uFloorDepth", -5.0f);
+    causticShader_.setFloat("uFloorDepth", config_.physics.floorLevel);
+    causticShader_.setInt("uFrameIndex", features_.temporalDenoise ? static_cast<int>(frameIndex_ % 64) : 0);
+    causticShader_.setBool("uCausticMap", causticMap);
+    causticShader_.setVec3("uCameraPos", glm::vec3(glm::inverse(viewMatrix_)[3]));
+    causticShader_.setFloat("uMapExtent", water_.size);
+    causticShader_.setMat4("uInverseViewProjection", glm::inverse(projectionMatrix_ * viewMatrix_));
     
     // Dispatch compute shader
-    int groupsX = (rtWidth_ + 15) / 16;
-    int groupsY = (rtHeight_ + 15) / 16;
-    glDispatchCompute(groupsX, groupsY, 1);
+    setInterleaveUniforms(causticShader_, SIGNAL_CAUSTICS);
+    dispatchInterleaved(RT_CAUSTICS);
     
     glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
 }
 
+void RayTracingManager::updateCausticMap() {
+    // Caustics move slowly: refresh every causticMapInterval frames, or at once when the
+    // surface's inputs changed
+    int interval = features_.causticMapInterval;
+    bool due = interval > 0 && frameIndex_ - causticMapFrame_ >= static_cast<unsigned int>(interval);
+    if (!causticMapDirty_ && !due) return;
+    if (water_.vao == 0 || water_.indexCount == 0 || causticMapSize_ <= 0) return;
+    
+    // Splat the photon triangles of the water grid onto the floor, adding up where they overlap
+    causticMapBuffer_.bind();
+    glViewport(0, 0, causticMapSize_, causticMapSize_);
+    GLenum drawBuffer = GL_COLOR_ATTACHMENT0;
+    glDrawBuffers(1, &drawBuffer);
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    
+    causticMapShader_.use();
+    causticMapShader_.setVec3("uLightDir", glm::normalize(CAUSTIC_LIGHT_DIR));
+    causticMapShader_.setFloat("uWaterIOR", 1.33f);
+    causticMapShader_.setFloat("uWaterLevel", 0.0f);
+    causticMapShader_.setFloat("uFloorLevel", config_.physics.floorLevel);
+    causticMapShader_.setFloat("uMapExtent", water_.size);
+    causticMapShader_.setBool("uPackedVertices", water_.packedVertices);
+    bool ocean = water_.oceanDisplacement != 0;
+    causticMapShader_.setBool("uOceanWaves", ocean);
+    if (ocean) {
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, water_.oceanDisplacement);
+        causticMapShader_.setInt("uOceanDisplacement", 0);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, water_.oceanNormalFoam);
+        causticMapShader_.setInt("uOceanNormalFoam", 1);
+        causticMapShader_.setFloat("uOceanPatchSize", water_.oceanPatchSize);
+        glActiveTexture(GL_TEXTURE0);
+    }
+    bindSurfaceHeights(causticMapShader_);
+    
+    // Folded triangles face away, and all of them count
+    GLboolean cullFace = glIsEnabled(GL_CULL_FACE);
+    GLboolean blend = glIsEnabled(GL_BLEND);
+    glDisable(GL_CULL_FACE);
+    glDisable(GL_DEPTH_TEST);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+    
+    glBindVertexArray(water_.vao);
+    glEnable(GL_PRIMITIVE_RESTART_FIXED_INDEX);
+    glDrawElementsBaseVertex(water_.primitive, water_.indexCount, water_.indexType, 0, water_.baseVertex);
+    glDisable(GL_PRIMITIVE_RESTART_FIXED_INDEX);
+    glBindVertexArray(0);
+    
+    if (!blend) glDisable(GL_BLEND);
+    if (cullFace) glEnable(GL_CULL_FACE);
+    causticMapBuffer_.unbind();
+    glViewport(0, 0, rtWidth_, rtHeight_);
+    
+    // Blend the splat into the map; a changed surface replaces it outright
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_FRAMEBUFFER_BARRIER_BIT);
+    causticBlendShader_.use();
+    glBindImageTexture(0, causticSplatTexture_.get(), 0, GL_FALSE, 0, GL_READ_ONLY, GL_R16F);
+    glBindImageTexture(1, causticMapTexture_.get(), 0, GL_FALSE, 0, GL_READ_WRITE, GL_R16F);
+    causticBlendShader_.setInt("uMapSize", causticMapSize_);
+    causticBlendShader_.setFloat("uBlend", causticMapDirty_ ? 1.0f : CAUSTIC_MAP_BLEND);
+    GLuint groups = (causticMapSize_ + 7) / 8;
+    glDispatchCompute(groups, groups, 1);
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+    
+    causticMapDirty_ = false;
+    causticMapFrame_ = frameIndex_;
+}
+
+void RayTracingManager::denoiseResults() {
+    if (!temporalShader_.isValid() || !atrousShader_.isValid()) return;
+    
+    // Fused reflections and refractions never reach memory, so only caustics are left then
+    bool fused = useFusedKernel();
+    GLTexture2D* signals[SIGNAL_COUNT] = { &reflectionTexture_, &refractionTexture_, &causticTexture_ };
+    bool traced[SIGNAL_COUNT] = { features_.reflections && !fused, features_.refractions && !fused, causticsTraced_ };
+    glm::mat4 viewProjection = projectionMatrix_ * viewMatrix_;
+    int iterations = denoiseIterations();
+    GLuint groupsX = (rtWidth_ + 7) / 8;
+    GLuint groupsY = (rtHeight_ + 7) / 8;
+    
+    for (int signal = 0; signal < SIGNAL_COUNT; signal++) {
+        if (!traced[signal]) continue;
+        SignalHistory& history = histories_[signal];
+        int current = history.index;
+        int previous = history.index ^ 1;
+        
+        // Blend the reprojected history into the scratch texture
+        temporalShader_.use();
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, signals[signal]->get());
+        temporalShader_.setInt("uCurrentTexture", 0);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, history.color[previous].get());
+        temporalShader_.setInt("uHistoryTexture", 1);
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_2D, history.moments[previous].get());
+        temporalShader_.setInt("uHistoryMoments", 2);
+        glActiveTexture(GL_TEXTURE3);
+        glBindTexture(GL_TEXTURE_2D, positionTexture_.get());
+        temporalShader_.setInt("uPositionTexture", 3);
+        glActiveTexture(GL_TEXTURE4);
+        glBindTexture(GL_TEXTURE_2D, depthTexture_.get());
+        temporalShader_.setInt("uDepthTexture", 4);
+        
+        glBindImageTexture(0, denoiseTexture_.get(), 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+        glBindImageTexture(1, history.moments[current].get(), 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+        
+        temporalShader_.setMat4("uViewProjection", viewProjection);
+        temporalShader_.setMat4("uInverseViewProjection", glm::inverse(viewProjection));
+        temporalShader_.setMat4("uPrevViewProjection", history.viewProjection);
+        temporalShader_.setBool("uHistoryValid", history.valid);
+        temporalShader_.setVec2("uResolution", glm::vec2(rtWidth_, rtHeight_));
+        temporalShader_.setVec2("uPrevResolution", glm::vec2(history.resolution));
+        
+        glDispatchCompute(groupsX, groupsY, 1);
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+        
+        // À-trous passes: the first one's output is the next frame's history (filtered once, so
+        // the noise does not feed back), and the last lands in the signal texture for compositing
+        atrousShader_.use();
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, positionTexture_.get());
+        atrousShader_.setInt("uPositionTexture", 1);
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_2D, normalTexture_.get());
+        atrousShader_.setInt("uNormalTexture", 2);
+        glActiveTexture(GL_TEXTURE3);
+        glBindTexture(GL_TEXTURE_2D, depthTexture_.get());
+        atrousShader_.setInt("uDepthTexture", 3);
+        atrousShader_.setInt("uInputTexture", 0);
+        atrousShader_.setVec2("uResolution", glm::vec2(rtWidth_, rtHeight_));
+        atrousShader_.setMat4("uInverseViewProjection", glm::inverse(viewProjection));
+        
+        GLuint source = denoiseTexture_.get();
+        for (int i = 0; i < iterations; i++) {
+            GLuint target;
+            if (i == 0) {
+                target = history.color[current].get();
+            } else {
+                target = (iterations - 1 - i) % 2 == 0 ? signals[signal]->get() : denoiseTexture_.get();
+            }
+            
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, source);
+            glBindImageTexture(0, target, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+            atrousShader_.setInt("uStepSize", 1 << i);
+            atrousShader_.setBool("uFinalPass", i == iterations - 1);
+            
+            glDispatchCompute(groupsX, groupsY, 1);
+            glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+            source = target;
+        }
+        
+        // What the next frame tracing this signal reprojects into
+        history.viewProjection = viewProjection;
+        history.resolution = glm::ivec2(rtWidth_, rtHeight_);
+        history.index ^= 1;
+        history.valid = true;
+    }
+    glActiveTexture(GL_TEXTURE0);
+}
+
+int RayTracingManager::denoiseIterations() const {
+    // Coarser tracing leaves fewer texels per wave, so its filter reaches wider (the last
+    // step covers 4 * 2^(n-1) texels); at least 2 so the history is not the final output.
+    // Taken from the traced scale so dynamic resolution gets the same as the fixed qualities
+    float scale = getResolutionScale();
+    if (scale <= 0.3f) return 4;
+    if (scale <= 0.6f) return 3;
+    return 2;
+}
+
 void RayTracingManager::compositeResults(const glm::vec3& cameraPos) {
     // Composite all ray traced results into final texture
     compositingShader_.use();
@@ -558,17 +1622,82 @@ void RayTracingManager::compositeResults(const glm::vec3& cameraPos) {
     compositingShader_.setVec3("uWaterColor", glm::vec3(0.1f, 0.4f, 0.7f));
     compositingShader_.setFloat("uWaterRoughness", 0.02f);
     compositingShader_.setVec3("uCameraPos", cameraPos);
+    setCoarseShadingUniforms(compositingShader_);
     
     // Dispatch compute shader
-    int groupsX = (rtWidth_ + 15) / 16;
-    int groupsY = (rtHeight_ + 15) / 16;
-    glDispatchCompute(groupsX, groupsY, 1);
+    dispatchKernel(RT_COMPOSITE, rtWidth_, rtHeight_);
+    
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+}
+
+void RayTracingManager::traceFused(const glm::vec3& cameraPos, const glm::vec3& lightPos) {
+    // Reflection, refraction and composite in one dispatch, straight into the RGBA8 result
+    fusedShader_.use();
+    
+    // Bind input textures
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, positionTexture_.get());
+    fusedShader_.setInt("uPositionTexture", 0);
+    
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, normalTexture_.get());
+    fusedShader_.setInt("uNormalTexture", 1);
+    
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, depthTexture_.get());
+    fusedShader_.setInt("uDepthTexture", 2);
+    
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, environmentMap_);
+    fusedShader_.setInt("uEnvironmentMap", 3);
+    
+    glActiveTexture(GL_TEXTURE4);
+    glBindTexture(GL_TEXTURE_2D, hiZTexture_.get());
+    fusedShader_.setInt("uHiZTexture", 4);
+    
+    glActiveTexture(GL_TEXTURE6);
+    glBindTexture(GL_TEXTURE_2D, causticTexture_.get());
+    fusedShader_.setInt("uCausticTexture", 6);
+    glActiveTexture(GL_TEXTURE0);
+    
+    // Bind output texture
+    glBindImageTexture(0, rayTracedTexture_.get(), 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+    
+    // Set uniforms: tracing as traceReflections / traceRefractions, blending as compositeResults
+    fusedShader_.setVec3("uCameraPos", cameraPos);
+    fusedShader_.setVec3("uLightPos", lightPos);
+    fusedShader_.setVec2("uResolution", glm::vec2(rtWidth_, rtHeight_));
+    fusedShader_.setInt("uFrameIndex", features_.temporalDenoise ? static_cast<int>(frameIndex_ % 64) : 0);
+    setCameraUniforms(fusedShader_);
+    setSceneProxyUniforms(fusedShader_);
+    fusedShader_.setFloat("uWaterDepth", 5.0f);
+    fusedShader_.setVec3("uRefractionWaterColor", glm::vec3(0.1f, 0.3f, 0.6f));
+    fusedShader_.setFloat("uReflectionStrength", features_.reflections ? 1.0f : 0.0f);
+    fusedShader_.setFloat("uRefractionStrength", features_.refractions ? 1.0f : 0.0f);
+    fusedShader_.setFloat("uCausticStrength", features_.caustics ? 0.5f : 0.0f);
+    fusedShader_.setBool("uEnableReflections", features_.reflections);
+    fusedShader_.setBool("uEnableRefractions", features_.refractions);
+    fusedShader_.setBool("uEnableCaustics", features_.caustics);
+    setAdaptiveSamplingUniforms(fusedShader_);
+    fusedShader_.setFloat("uWaterIOR", 1.33f);
+    fusedShader_.setVec3("uWaterColor", glm::vec3(0.1f, 0.4f, 0.7f));
+    setCoarseShadingUniforms(fusedShader_);
+    
+    // Dispatch compute shader
+    dispatchKernel(RT_FUSED, rtWidth_, rtHeight_);
     
     glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
 }
 
 void RayTracingManager::upsampleToFullResolution() {
     // Upsample the composited ray traced result to full resolution
+    bool edgeAware = features_.upsampler == RayTracingUpsampler::EDGE_AWARE && sharpenShader_.isValid();
+    
+    // The edge-aware path is guided by the water rasterized at full resolution
+    if (edgeAware) {
+        renderGBuffer(viewMatrix_, projectionMatrix_, guideBuffer_, screenWidth_, screenHeight_, true);
+    }
+    
     upsampleShader_.use();
     
     // Bind input texture (composited ray traced result)
@@ -576,58 +1705,247 @@ void RayTracingManager::upsampleToFullResolution() {
     glBindTexture(GL_TEXTURE_2D, rayTracedTexture_.get());
     upsampleShader_.setInt("uLowResTexture", 0);
     
-    // Bind output texture
-    glBindImageTexture(0, finalTexture_.get(), 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+    // Traced G-buffer and full-resolution guide, compared per tap
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, depthTexture_.get());
+    upsampleShader_.setInt("uDepthTexture", 1);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, normalTexture_.get());
+    upsampleShader_.setInt("uNormalTexture", 2);
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_2D, guideDepthTexture_.get());
+    upsampleShader_.setInt("uGuideDepthTexture", 3);
+    glActiveTexture(GL_TEXTURE4);
+    glBindTexture(GL_TEXTURE_2D, guideNormalTexture_.get());
+    upsampleShader_.setInt("uGuideNormalTexture", 4);
+    glActiveTexture(GL_TEXTURE0);
+    
+    // Bind output texture, sharpened into the final texture afterwards when edge-aware
+    GLuint output = edgeAware ? upsampledTexture_.get() : finalTexture_.get();
+    glBindImageTexture(0, output, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
     
     // Set uniforms
     upsampleShader_.setVec2("uLowResolution", glm::vec2(rtWidth_, rtHeight_));
     upsampleShader_.setVec2("uHighResolution", glm::vec2(screenWidth_, screenHeight_));
     upsampleShader_.setFloat("uSharpenAmount", 0.2f); // Slight sharpening to reduce blur
+    upsampleShader_.setBool("uEdgeAware", edgeAware);
+    upsampleShader_.setVec2("uDepthParams", glm::vec2(projectionMatrix_[3][2], projectionMatrix_[2][2]));
     
     // Dispatch compute shader
-    int groupsX = (screenWidth_ + 15) / 16;
-    int groupsY = (screenHeight_ + 15) / 16;
-    glDispatchCompute(groupsX, groupsY, 1);
+    dispatchKernel(RT_UPSAMPLE, screenWidth_, screenHeight_);
     
     glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    
+    if (edgeAware) {
+        sharpenUpsampled();
+    }
 }
 
-void RayTracingManager::resize(int width, int height) {
-    screenWidth_ = width;
-    screenHeight_ = height;
-    updateResolution();
+void RayTracingManager::sharpenUpsampled() {
+    // RCAS over the edge-aware upsample, into the final texture
+    sharpenShader_.use();
+    
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, upsampledTexture_.get());
+    sharpenShader_.setInt("uUpsampledTexture", 0);
+    glBindImageTexture(0, finalTexture_.get(), 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+    
+    sharpenShader_.setVec2("uResolution", glm::vec2(screenWidth_, screenHeight_));
+    sharpenShader_.setFloat("uSharpness", std::exp2(-0.2f)); // FSR's default of 0.2 stops
+    
+    dispatchKernel(RT_SHARPEN, screenWidth_, screenHeight_);
+    
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
 }
 
-void RayTracingManager::updateWaterSurface(const std::vector<glm::vec3>& vertices,
-                                         const std::vector<glm::vec3>& normals) {
-    // Update water surface data for ray tracing
-    if (!vertices.empty()) {
-        waterVertexBuffer_.bind();
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), 
-                     vertices.data(), GL_DYNAMIC_DRAW);
+GLuint RayTracingManager::loadKernel(int kernel, const glm::ivec2& localSize) const {
+    std::string defines = "#define RT_LOCAL_SIZE_X " + std::to_string(localSize.x) + "\n" +
+                          "#define RT_LOCAL_SIZE_Y " + std::to_string(localSize.y) + "\n";
+    
+    // Every kernel reading the G-buffer goes through its layout's accessors
+    if (kernel == RT_REFLECTION || kernel == RT_REFRACTION || kernel == RT_CAUSTICS ||
+        kernel == RT_COMPOSITE || kernel == RT_FUSED || kernel == RT_UPSAMPLE) {
+        std::string gBuffer = gBufferSource();
+        if (gBuffer.empty()) return 0;
+        defines += gBuffer;
+    }
+    
+    // Reflection, refraction and the fused kernel share the hierarchical depth tracing
+    if (kernel == RT_REFLECTION || kernel == RT_REFRACTION || kernel == RT_FUSED) {
+        std::string trace = ReadShaderSource("shaders/rt_hiz_trace.glsl");
+        if (trace.empty()) {
+            std::cerr << "ERROR: Could not read shaders/rt_hiz_trace.glsl" << std::endl;
+            return 0;
+        }
+        defines += trace + "\n";
+    }
+    
+    // Reflection rays that leave the screen look for the scene proxies
+    if (kernel == RT_REFLECTION || kernel == RT_FUSED) {
+        std::string proxies = ReadShaderSource("shaders/rt_world_trace.glsl");
+        if (proxies.empty()) {
+            std::cerr << "ERROR: Could not read shaders/rt_world_trace.glsl" << std::endl;
+            return 0;
+        }
+        defines += proxies + "\n";
     }
     
-    if (!normals.empty()) {
-        waterNormalBuffer_.bind();
-        glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(glm::vec3),
-                     normals.data(), GL_DYNAMIC_DRAW);
+    // Reflections trace further rays where the surface varies, from a blue-noise tile
+    if (kernel == RT_REFLECTION || kernel == RT_FUSED) {
+        std::string sampling = ReadShaderSource("shaders/rt_adaptive_sampling.glsl");
+        if (sampling.empty()) {
+            std::cerr << "ERROR: Could not read shaders/rt_adaptive_sampling.glsl" << std::endl;
+            return 0;
+        }
+        defines += sampling + "\n";
+    }
+    
+    // The separately traced signals cover only this frame's texels when interleaved
+    if (kernel == RT_REFLECTION || kernel == RT_REFRACTION || kernel == RT_CAUSTICS) {
+        std::string interleave = ReadShaderSource("shaders/rt_interleave.glsl");
+        if (interleave.empty()) {
+            std::cerr << "ERROR: Could not read shaders/rt_interleave.glsl" << std::endl;
+            return 0;
+        }
+        defines += interleave + "\n";
     }
+    
+    // The kernels writing the composite shade coarse tiles once per block
+    if (kernel == RT_COMPOSITE || kernel == RT_FUSED) {
+        std::string coarse = ReadShaderSource("shaders/rt_coarse_shading.glsl");
+        if (coarse.empty()) {
+            std::cerr << "ERROR: Could not read shaders/rt_coarse_shading.glsl" << std::endl;
+            return 0;
+        }
+        defines += coarse + "\n";
+    }
+    return InitComputeShader(KERNEL_PATHS[kernel], defines);
 }
 
-bool RayTracingManager::initializeRTX() {
+std::string RayTracingManager::gBufferSource() const {
+    std::string accessors = ReadShaderSource("shaders/rt_gbuffer.glsl");
+    if (accessors.empty()) {
+        std::cerr << "ERROR: Could not read shaders/rt_gbuffer.glsl" << std::endl;
+        return std::string();
+    }
+    return (features_.compactGBuffer ? "#define RT_COMPACT_GBUFFER\n" : "") + accessors + "\n";
+}
 
+GLShaderProgram& RayTracingManager::kernelProgram(int kernel) {
+    switch (kernel) {
+        case RT_REFLECTION: return reflectionShader_;
+        case RT_REFRACTION: return refractionShader_;
+        case RT_CAUSTICS:   return causticShader_;
+        case RT_COMPOSITE:  return compositingShader_;
+        case RT_FUSED:      return fusedShader_;
+        case RT_SHARPEN:    return sharpenShader_;
+        default:            return upsampleShader_;
+    }
+}
+
+void RayTracingManager::dispatchKernel(int kernel, int width, int height) const {
+    const glm::ivec2& localSize = localSizes_[kernel];
+    glDispatchCompute((width + localSize.x - 1) / localSize.x, (height + localSize.y - 1) / localSize.y, 1);
+}
+
+void RayTracingManager::autotuneKernels(const glm::mat4& view, const glm::mat4& projection,
+                                        const glm::vec3& cameraPos, const glm::vec3& lightPos) {
+    autotuned_ = true;
+    if (!autotuner_) return;
+    
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    renderGBuffer(view, projection, gBuffer_, rtWidth_, rtHeight_, features_.compactGBuffer);
+    buildHiZ();
     
-    // Check for RTX capability
-    // For now, assume RTX is available
-    rtxAvailable_ = true;  // Would check actual hardware
+    GLint maxInvocations = 0;
+    glGetIntegerv(GL_MAX_COMPUTE_WORK_GROUP_INVOCATIONS, &maxInvocations);
     
-    if (rtxAvailable_) {
-        // Initialize OptiX context
-        // rtxContext_ = createOptiXContext();
-        std::cout << "RTX hardware detected" << std::endl;
-        return true;
+    std::cout << "Autotuning ray tracing workgroup sizes at " << rtWidth_ << "x" << rtHeight_ << "..." << std::endl;
+    for (int kernel = 0; kernel < RT_KERNEL_COUNT; kernel++) {
+        uint32_t packed = 0;
+        if (autotuner_->lookup(KERNEL_CACHE_KEYS[kernel], packed)) continue;
+        
+        // Each kernel is timed on its own frame inputs (earlier kernels have already run)
+        std::function<void()> dispatch;
+        switch (kernel) {
+            case RT_REFLECTION: dispatch = [&]() { traceReflections(cameraPos, lightPos); }; break;
+            case RT_REFRACTION: dispatch = [&]() { traceRefractions(cameraPos); }; break;
+            case RT_CAUSTICS:   dispatch = [&]() { traceCaustics(lightPos); }; break;
+            case RT_COMPOSITE:  dispatch = [&]() { compositeResults(cameraPos); }; break;
+            case RT_FUSED:      dispatch = [&]() { traceFused(cameraPos, lightPos); }; break;
+            case RT_SHARPEN:    dispatch = [&]() { sharpenUpsampled(); }; break;
+            default:            dispatch = [&]() { upsampleToFullResolution(); }; break;
+        }
+        
+        glm::ivec2 best = localSizes_[kernel];
+        float bestMs = -1.0f;
+        std::cout << "  " << KERNEL_CACHE_KEYS[kernel] << ":";
+        for (const glm::ivec2& candidate : LOCAL_SIZE_CANDIDATES) {
+            if (candidate.x * candidate.y > maxInvocations) continue;
+            GLuint program = loadKernel(kernel, candidate);
+            if (program == 0) continue;
+            kernelProgram(kernel).setId(program);
+            localSizes_[kernel] = candidate;
+            
+            float ms = autotuner_->timeDispatch(dispatch, config_.compute.autotuneRepetitions);
+            std::cout << " " << candidate.x << "x" << candidate.y << "=" << ms << "ms";
+            if (bestMs < 0.0f || ms < bestMs) {
+                bestMs = ms;
+                best = candidate;
+            }
+        }
+        std::cout << std::endl;
+        
+        localSizes_[kernel] = best;
+        GLuint program = loadKernel(kernel, best);
+        if (program != 0) {
+            kernelProgram(kernel).setId(program);
+        }
+        if (bestMs >= 0.0f) {
+            autotuner_->store(KERNEL_CACHE_KEYS[kernel], ComputeAutotuner::packSize(best.x, best.y));
+        }
     }
     
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+}
+
+void RayTracingManager::resize(int width, int height) {
+    screenWidth_ = width;
+    screenHeight_ = height;
+    updateResolution();
+}
+
+void RayTracingManager::bindSurfaceHeights(const GLShaderProgram& program) const {
+    // Units 2 to 4, after the ocean's; gbuffer.vs and rt_caustic_map.vs share the inputs
+    bool waveHeights = water_.flatGrid && water_.waveHeightMap != 0 && water_.waveNormalMap != 0;
+    program.setFloat("uSurfaceSize", water_.size);
+    program.setBool("uWaveHeights", waveHeights);
+    program.setBool("uHeightfieldWaves", water_.heightfield != 0);
+    if (waveHeights) {
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_2D, water_.waveHeightMap);
+        program.setInt("uWaveHeightMap", 2);
+        glActiveTexture(GL_TEXTURE4);
+        glBindTexture(GL_TEXTURE_2D, water_.waveNormalMap);
+        program.setInt("uWaveNormalMap", 4);
+        program.setFloat("uWaveHeightMapSize", water_.waveHeightMapSize);
+    }
+    if (water_.heightfield != 0) {
+        glActiveTexture(GL_TEXTURE3);
+        glBindTexture(GL_TEXTURE_2D, water_.heightfield);
+        program.setInt("uHeightfield", 3);
+    }
+    glActiveTexture(GL_TEXTURE0);
+}
+
+bool RayTracingManager::initializeRTX() {
+    // No hardware ray tracing backend (OptiX, or Vulkan ray queries shared back to GL) is
+    // built in, so RT cores are never claimed: the compute kernels trace everything, with
+    // the scene proxies standing in for geometry off screen
+    rtxAvailable_ = false;
+    rtxContext_ = nullptr;
+    std::cout << "Hardware ray tracing backend not built in" << std::endl;
     return false;
 }
 
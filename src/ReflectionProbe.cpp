@@ -0,0 +1,131 @@
+#include "../include/ReflectionProbe.h"
+#include "../include/GPUMemoryTracker.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace WaterSim {
+
+namespace {
+
+// Look direction and up of each face, in GL_TEXTURE_CUBE_MAP_POSITIVE_X + i order
+const glm::vec3 FACE_DIRECTIONS[6] = {
+    { 1.0f, 0.0f, 0.0f }, { -1.0f, 0.0f, 0.0f },
+    { 0.0f, 1.0f, 0.0f }, { 0.0f, -1.0f, 0.0f },
+    { 0.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, -1.0f },
+};
+const glm::vec3 FACE_UPS[6] = {
+    { 0.0f, -1.0f, 0.0f }, { 0.0f, -1.0f, 0.0f },
+    { 0.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, -1.0f },
+    { 0.0f, -1.0f, 0.0f }, { 0.0f, -1.0f, 0.0f },
+};
+
+const GLfloat PROBE_CLEAR_COLOR[4] = { 0.529f, 0.808f, 0.922f, 1.0f }; // As the planar reflection
+
+bool moved(const glm::vec3& a, const glm::vec3& b, float threshold) {
+    return glm::length(a - b) > threshold;
+}
+
+} // namespace
+
+int ReflectionProbe::mipLevels() const {
+    return static_cast<int>(std::log2(static_cast<float>(resolution_))) + 1;
+}
+
+bool ReflectionProbe::allocate() {
+    GPUMemoryScope memoryScope("Reflection probe");
+    resolution_ = std::max(settings_.resolution, 4);
+
+    cubemap_.create(GL_TEXTURE_CUBE_MAP);
+    cubemap_.storage2D(mipLevels(), GL_RGBA16F, resolution_, resolution_);
+    cubemap_.sampling(GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR, GL_CLAMP_TO_EDGE);
+    depth_.storage(resolution_, resolution_, GL_DEPTH_COMPONENT24);
+
+    framebuffer_.attachTexture(GL_DEPTH_ATTACHMENT, depth_.get());
+    framebuffer_.attachTextureLayer(GL_COLOR_ATTACHMENT0, cubemap_.get(), 0, 0);
+    if (!framebuffer_.isValid()) {
+        std::cerr << "ERROR: Reflection probe framebuffer is incomplete" << std::endl;
+        resolution_ = 0;
+        return false;
+    }
+
+    staleFaces_ = ALL_FACES;
+    valid_ = false;
+    return true;
+}
+
+void ReflectionProbe::beginFrame(const glm::vec3& position, const glm::vec3& boxMin, const glm::vec3& boxMax,
+                                 const glm::vec3& spherePosition, GLuint skyTexture) {
+    face_ = -1;
+    facesUpdated_ = 0;
+    if (!settings_.enabled) return;
+    if (resolution_ != std::max(settings_.resolution, 4) && !allocate()) return;
+
+    // Anything the faces show having changed marks them all stale
+    const float epsilon = 1e-4f;
+    if (moved(position, position_, epsilon) || moved(boxMin, boxMin_, epsilon) || moved(boxMax, boxMax_, epsilon) ||
+        moved(spherePosition, spherePosition_, settings_.sphereThreshold) || skyTexture != skyTexture_) {
+        staleFaces_ = ALL_FACES;
+        position_ = position;
+        boxMin_ = boxMin;
+        boxMax_ = boxMax;
+        spherePosition_ = spherePosition;
+        skyTexture_ = skyTexture;
+    }
+    if (settings_.continuous) {
+        staleFaces_ |= 1u << nextFace_;
+    }
+
+    // The next stale face in round robin order
+    for (int i = 0; i < FACE_COUNT && face_ < 0; i++) {
+        int face = (nextFace_ + i) % FACE_COUNT;
+        if (staleFaces_ & (1u << face)) face_ = face;
+    }
+    if (face_ >= 0) {
+        nextFace_ = (face_ + 1) % FACE_COUNT;
+    }
+}
+
+void ReflectionProbe::beginFaceRender() {
+    framebuffer_.attachTextureLayer(GL_COLOR_ATTACHMENT0, cubemap_.get(), 0, face_);
+    framebuffer_.bind();
+    glViewport(0, 0, resolution_, resolution_);
+    glClearColor(PROBE_CLEAR_COLOR[0], PROBE_CLEAR_COLOR[1], PROBE_CLEAR_COLOR[2], PROBE_CLEAR_COLOR[3]);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+void ReflectionProbe::endFaceRender() {
+    framebuffer_.unbind();
+    staleFaces_ &= ~(1u << face_);
+    facesUpdated_ = 1;
+
+    // A cycle is complete once no face is left stale, or at the last face in round robin
+    if (staleFaces_ == 0 || (settings_.continuous && face_ == FACE_COUNT - 1)) {
+        cubemap_.generateMipmap();
+        valid_ = valid_ || staleFaces_ == 0;
+    }
+}
+
+glm::mat4 ReflectionProbe::getFaceView() const {
+    return glm::lookAt(position_, position_ + FACE_DIRECTIONS[face_], FACE_UPS[face_]);
+}
+
+glm::mat4 ReflectionProbe::getFaceProjection() const {
+    return glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, 100.0f);
+}
+
+void ReflectionProbe::setUniforms(const GLShaderProgram& program, int textureUnit) const {
+    bool enabled = settings_.enabled && valid_;
+    program.setBool("reflectionProbeEnabled", enabled);
+    if (!enabled) return;
+    cubemap_.bindUnit(textureUnit);
+    program.setInt("reflectionProbe", textureUnit);
+    program.setVec3("probePosition", position_);
+    program.setVec3("probeBoxMin", boxMin_);
+    program.setVec3("probeBoxMax", boxMax_);
+    program.setFloat("probeMaxLod", static_cast<float>(mipLevels() - 1));
+    program.setVec2("probeBlendDistance", glm::vec2(settings_.nearDistance, std::max(settings_.farDistance, settings_.nearDistance + 0.01f)));
+}
+
+} // namespace WaterSim
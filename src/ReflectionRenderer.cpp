@@ -1,38 +1,77 @@
 #include "../include/ReflectionRenderer.h"
+#include "../include/GPUMemoryTracker.h"
+#include "../include/RenderTargetPool.h"
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 
+namespace {
+
+const GLfloat REFLECTION_CLEAR_COLOR[4] = { 0.529f, 0.808f, 0.922f, 1.0f }; // Light blue sky
+const GLfloat NEAR_FIELD_CLEAR_COLOR[4] = { 0.0f, 0.0f, 0.0f, 0.0f };        // Probe shows through
+const GLfloat REFRACTION_CLEAR_COLOR[4] = { 0.0f, 0.2f, 0.3f, 1.0f };       // Dark underwater
+
+// Linear and clamped, as the pool hands its targets out
+GLuint acquireLayers(GLenum internalFormat, int width, int height) {
+    WaterSim::RenderTargetDesc desc;
+    desc.target = GL_TEXTURE_2D_ARRAY;
+    desc.internalFormat = internalFormat;
+    desc.width = width;
+    desc.height = height;
+    desc.layers = PLANAR_TARGET_COUNT;
+    return WaterSim::RenderTargetPool::instance().acquire(desc);
+}
+
+int scaledSize(int size, float scale) {
+    return std::max(static_cast<int>(size * scale + 0.5f), 1);
+}
+
+} // namespace
+
 ReflectionRenderer::ReflectionRenderer(int width, int height)
     : width(width), height(height) {
-    
-    // Create framebuffers for reflection and refraction
-    reflectionFBO = new Framebuffer(width, height, FRAMEBUFFER_COLOR_DEPTH);
-    refractionFBO = new Framebuffer(width, height, FRAMEBUFFER_COLOR_DEPTH);
-    
-    if (!reflectionFBO->isComplete() || !refractionFBO->isComplete()) {
-        std::cerr << "Failed to create reflection/refraction framebuffers!" << std::endl;
-    }
+    // Start the refraction half an interval behind, so the two refresh on alternate frames
+    targets[PLANAR_REFRACTION].framesSinceUpdate = settings[PLANAR_REFRACTION].updateInterval / 2;
 }
 
 ReflectionRenderer::~ReflectionRenderer() {
-    delete reflectionFBO;
-    delete refractionFBO;
+    destroyTargets();
+}
+
+void ReflectionRenderer::beginFrame(const Camera& camera, float waterLevel, const glm::vec3& spherePosition) {
+    allocateTargets();
+    frameSpherePosition = spherePosition;
+
+    for (int i = 0; i < PLANAR_TARGET_COUNT; i++) {
+        Target& target = targets[i];
+        const TargetSettings& targetSettings = settings[layeredActive ? PLANAR_REFLECTION : i];
+        target.framesSinceUpdate++;
+        target.updating = !target.valid ||
+                          target.framesSinceUpdate >= std::max(targetSettings.updateInterval, 1) * budgetInterval ||
+                          (target.framesSinceUpdate >= budgetInterval && hasMoved(target, camera, waterLevel));
+    }
+
+    // One layered pass refreshes both
+    if (layeredActive) {
+        bool updating = targets[PLANAR_REFLECTION].updating || targets[PLANAR_REFRACTION].updating;
+        targets[PLANAR_REFLECTION].updating = updating;
+        targets[PLANAR_REFRACTION].updating = updating;
+    }
+}
+
+bool ReflectionRenderer::hasMoved(const Target& target, const Camera& camera, float waterLevel) const {
+    if (glm::length(camera.Position - target.cameraPosition) > thresholds.cameraDistance) return true;
+    if (glm::length(frameSpherePosition - target.spherePosition) > thresholds.sphereDistance) return true;
+    if (std::abs(waterLevel - target.waterLevel) > 1e-4f) return true;
+
+    float cosAngle = glm::dot(glm::normalize(camera.Front), target.cameraFront);
+    return cosAngle < std::cos(glm::radians(thresholds.cameraAngle));
 }
 
 void ReflectionRenderer::beginReflectionRender(const Camera& camera, float waterLevel) {
-    // Bind reflection framebuffer
-    reflectionFBO->bind();
-    
-    // Clear with sky color
-    glClearColor(0.529f, 0.808f, 0.922f, 1.0f); // Light blue sky
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    
-    // Create reflection matrix
-    reflectionMatrix = createReflectionMatrix(waterLevel);
-    
-    // Setup clipping plane to clip geometry below water
-    glm::vec4 clipPlane(0.0f, 1.0f, 0.0f, -waterLevel + 0.1f);
-    setupClippingPlane(clipPlane);
-    
+    beginTarget(PLANAR_REFLECTION, camera, waterLevel);
+    clearTarget(PLANAR_REFLECTION);
+
     // Enable clipping
     glEnable(GL_CLIP_DISTANCE0);
 }
@@ -40,26 +79,12 @@ void ReflectionRenderer::beginReflectionRender(const Camera& camera, float water
 void ReflectionRenderer::endReflectionRender() {
     // Disable clipping
     glDisable(GL_CLIP_DISTANCE0);
-    
-    // Unbind framebuffer
-    reflectionFBO->unbind();
-    
-    // Reset viewport to screen size
-    glViewport(0, 0, width, height);
 }
 
 void ReflectionRenderer::beginRefractionRender(const Camera& camera, float waterLevel) {
-    // Bind refraction framebuffer
-    refractionFBO->bind();
-    
-    // Clear with dark underwater color
-    glClearColor(0.0f, 0.2f, 0.3f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    
-    // Setup clipping plane to clip geometry above water
-    glm::vec4 clipPlane(0.0f, -1.0f, 0.0f, waterLevel + 0.1f);
-    setupClippingPlane(clipPlane);
-    
+    beginTarget(PLANAR_REFRACTION, camera, waterLevel);
+    clearTarget(PLANAR_REFRACTION);
+
     // Enable clipping
     glEnable(GL_CLIP_DISTANCE0);
 }
@@ -67,38 +92,194 @@ void ReflectionRenderer::beginRefractionRender(const Camera& camera, float water
 void ReflectionRenderer::endRefractionRender() {
     // Disable clipping
     glDisable(GL_CLIP_DISTANCE0);
-    
-    // Unbind framebuffer
-    refractionFBO->unbind();
-    
-    // Reset viewport to screen size
-    glViewport(0, 0, width, height);
 }
 
-GLuint ReflectionRenderer::getReflectionTexture() const {
-    return reflectionFBO->getColorTexture();
+void ReflectionRenderer::beginLayeredRender(const Camera& camera, float waterLevel) {
+    beginTarget(PLANAR_REFLECTION, camera, waterLevel);
+    beginTarget(PLANAR_REFRACTION, camera, waterLevel);
+
+    // Layered framebuffer: the depth clear covers both layers, the colors differ per layer
+    glBindFramebuffer(GL_FRAMEBUFFER, layeredFBO);
+    glViewport(0, 0, targets[PLANAR_REFLECTION].width, targets[PLANAR_REFLECTION].height);
+    glClear(GL_DEPTH_BUFFER_BIT);
+    clearTarget(PLANAR_REFLECTION);
+    clearTarget(PLANAR_REFRACTION);
+
+    glEnable(GL_CLIP_DISTANCE0);
 }
 
-GLuint ReflectionRenderer::getRefractionTexture() const {
-    return refractionFBO->getColorTexture();
+void ReflectionRenderer::endLayeredRender() {
+    glDisable(GL_CLIP_DISTANCE0);
+}
+
+void ReflectionRenderer::beginTarget(PlanarTarget index, const Camera& camera, float waterLevel) {
+    Target& target = targets[index];
+    if (!layeredActive) {
+        glBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+        glViewport(0, 0, target.width, target.height);
+    }
+
+    // What the refresh is drawn from, for the next frames' thresholds and reprojection
+    target.valid = true;
+    target.framesSinceUpdate = 0;
+    target.cameraPosition = camera.Position;
+    target.cameraFront = glm::normalize(camera.Front);
+    target.spherePosition = frameSpherePosition;
+    target.waterLevel = waterLevel;
+    target.viewProjection = getProjection(camera) * getTargetView(index, camera, waterLevel);
+}
+
+void ReflectionRenderer::clearTarget(PlanarTarget index) {
+    const GLfloat* color = index == PLANAR_REFRACTION ? REFRACTION_CLEAR_COLOR
+                         : nearFieldDistance > 0.0f ? NEAR_FIELD_CLEAR_COLOR : REFLECTION_CLEAR_COLOR;
+    if (layeredActive) {
+        const Target& target = targets[index];
+        glClearTexSubImage(layeredColor, 0, 0, 0, index, target.width, target.height, 1, GL_RGBA, GL_FLOAT, color);
+    } else {
+        glClearColor(color[0], color[1], color[2], color[3]);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    }
+}
+
+glm::mat4 ReflectionRenderer::getTargetView(PlanarTarget target, const Camera& camera, float waterLevel) const {
+    glm::mat4 view = camera.GetViewMatrix();
+    if (target == PLANAR_REFLECTION) {
+        view = view * createReflectionMatrix(waterLevel);
+    }
+    return view;
+}
+
+glm::mat4 ReflectionRenderer::getProjection(const Camera& camera) const {
+    float farPlane = nearFieldDistance > 0.0f ? nearFieldDistance : 100.0f;
+    return glm::perspective(glm::radians(camera.Zoom), (float)width / (float)height, 0.1f, farPlane);
+}
+
+glm::vec4 ReflectionRenderer::getClipPlane(PlanarTarget target, float waterLevel) const {
+    // Reflection keeps what is above the water, refraction what is below
+    if (target == PLANAR_REFLECTION) {
+        return glm::vec4(0.0f, 1.0f, 0.0f, -waterLevel + 0.1f);
+    }
+    return glm::vec4(0.0f, -1.0f, 0.0f, waterLevel + 0.1f);
+}
+
+void ReflectionRenderer::setBudget(int intervalScale, float resolutionFactor) {
+    budgetInterval = std::max(intervalScale, 1);
+    budgetResolution = std::max(0.125f, std::min(resolutionFactor, 1.0f));
+}
+
+void ReflectionRenderer::setNearFieldDistance(float distance) {
+    distance = std::max(distance, 0.0f);
+    if (distance == nearFieldDistance) return;
+    // The reflection's clear and far plane change with it
+    nearFieldDistance = distance;
+    targets[PLANAR_REFLECTION].valid = false;
 }
 
 void ReflectionRenderer::resize(int newWidth, int newHeight) {
     width = newWidth;
     height = newHeight;
-    
-    reflectionFBO->resize(width, height);
-    refractionFBO->resize(width, height);
 }
 
-glm::mat4 ReflectionRenderer::createReflectionMatrix(float waterLevel) {
+void ReflectionRenderer::allocateTargets() {
+    WaterSim::GPUMemoryScope memoryScope("Reflections");
+    // The layered path shares the reflection's scale
+    int desiredWidth[PLANAR_TARGET_COUNT];
+    int desiredHeight[PLANAR_TARGET_COUNT];
+    for (int i = 0; i < PLANAR_TARGET_COUNT; i++) {
+        float scale = settings[layeredRendering ? PLANAR_REFLECTION : i].resolutionScale * budgetResolution;
+        desiredWidth[i] = scaledSize(width, scale);
+        desiredHeight[i] = scaledSize(height, scale);
+    }
+
+    bool current = layeredActive == layeredRendering && targets[0].colorTexture != 0;
+    for (int i = 0; i < PLANAR_TARGET_COUNT && current; i++) {
+        current = targets[i].width == desiredWidth[i] && targets[i].height == desiredHeight[i];
+    }
+    if (current) return;
+
+    destroyTargets();
+    layeredActive = layeredRendering;
+
+    if (layeredActive) {
+        int layerWidth = desiredWidth[PLANAR_REFLECTION];
+        int layerHeight = desiredHeight[PLANAR_REFLECTION];
+
+        layeredColor = acquireLayers(GL_RGBA16F, layerWidth, layerHeight);
+        layeredDepth = acquireLayers(GL_DEPTH_COMPONENT24, layerWidth, layerHeight);
+
+        glGenFramebuffers(1, &layeredFBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, layeredFBO);
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, layeredColor, 0);
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, layeredDepth, 0);
+
+        // The water shaders sample each layer through a plain 2D view
+        for (int i = 0; i < PLANAR_TARGET_COUNT; i++) {
+            Target& target = targets[i];
+            glGenTextures(1, &target.colorTexture);
+            glTextureView(target.colorTexture, GL_TEXTURE_2D, layeredColor, GL_RGBA16F, 0, 1, i, 1);
+            glBindTexture(GL_TEXTURE_2D, target.colorTexture);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            target.width = layerWidth;
+            target.height = layerHeight;
+        }
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            std::cerr << "Failed to create layered reflection/refraction framebuffer!" << std::endl;
+        }
+    } else {
+        for (int i = 0; i < PLANAR_TARGET_COUNT; i++) {
+            Target& target = targets[i];
+            target.width = desiredWidth[i];
+            target.height = desiredHeight[i];
+            target.colorTexture = WaterSim::RenderTargetPool::instance().acquire2D(GL_RGBA16F, target.width, target.height);
+            target.depthTexture = WaterSim::RenderTargetPool::instance().acquire2D(GL_DEPTH_COMPONENT24, target.width, target.height);
+
+            glGenFramebuffers(1, &target.fbo);
+            glBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target.colorTexture, 0);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, target.depthTexture, 0);
+            if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+                std::cerr << "Failed to create reflection/refraction framebuffers!" << std::endl;
+            }
+        }
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void ReflectionRenderer::destroyTargets() {
+    // The pool's textures go back to it; the layered path's per-layer views are its own
+    WaterSim::RenderTargetPool& pool = WaterSim::RenderTargetPool::instance();
+    for (Target& target : targets) {
+        if (target.fbo) glDeleteFramebuffers(1, &target.fbo);
+        if (layeredActive) {
+            if (target.colorTexture) glDeleteTextures(1, &target.colorTexture);
+        } else {
+            pool.release(target.colorTexture);
+            pool.release(target.depthTexture);
+        }
+        target.fbo = 0;
+        target.colorTexture = 0;
+        target.depthTexture = 0;
+        target.width = 0;
+        target.height = 0;
+        target.valid = false;
+    }
+    if (layeredFBO) glDeleteFramebuffers(1, &layeredFBO);
+    pool.release(layeredColor);
+    pool.release(layeredDepth);
+    layeredFBO = 0;
+    layeredColor = 0;
+    layeredDepth = 0;
+}
+
+glm::mat4 ReflectionRenderer::createReflectionMatrix(float waterLevel) const {
     // Create reflection matrix across the water plane (y = waterLevel)
     glm::mat4 reflection(1.0f);
     reflection[1][1] = -1.0f;  // Flip Y coordinate
     reflection[3][1] = 2.0f * waterLevel;  // Translate to water level
-    
+
     return reflection;
 }
-
-void ReflectionRenderer::setupClippingPlane(const glm::vec4& plane) {
-}
\ No newline at end of file
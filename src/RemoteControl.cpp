@@ -0,0 +1,250 @@
+#include "RemoteControl.h"
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <random>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace WaterSim {
+
+RemoteControl::~RemoteControl() {
+    close();
+}
+
+bool RemoteControl::open(int port, const Settings& settings) {
+    close();
+
+    in_addr bindAddress = {};
+    if (inet_pton(AF_INET, settings.bindAddress.c_str(), &bindAddress) != 1) {
+        std::cerr << "ERROR: Invalid control socket address: " << settings.bindAddress << std::endl;
+        return false;
+    }
+
+#ifdef _WIN32
+    WSADATA wsaData;
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+        std::cerr << "ERROR: WSAStartup failed" << std::endl;
+        return false;
+    }
+#endif
+
+    Socket sock = static_cast<Socket>(::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP));
+    if (sock == INVALID) {
+        std::cerr << "ERROR: Failed to create the control socket" << std::endl;
+        return false;
+    }
+
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr = bindAddress;
+    address.sin_port = htons(static_cast<uint16_t>(port));
+    bool bound = ::bind(sock, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0;
+
+#ifdef _WIN32
+    u_long nonBlocking = 1;
+    bool configured = ioctlsocket(sock, FIONBIO, &nonBlocking) == 0;
+#else
+    bool configured = fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK) == 0;
+#endif
+
+    if (!bound || !configured) {
+        std::cerr << "ERROR: Failed to bind the control socket to UDP port " << port << std::endl;
+#ifdef _WIN32
+        closesocket(sock);
+        WSACleanup();
+#else
+        ::close(sock);
+#endif
+        return false;
+    }
+
+    // Without a configured token the session makes its own, 128 random bits in hex
+    token_ = settings.token;
+    if (token_.empty()) {
+        std::random_device random;
+        char hex[33] = {};
+        for (int i = 0; i < 4; i++) {
+            std::snprintf(hex + i * 8, 9, "%08x", static_cast<unsigned>(random()));
+        }
+        token_ = hex;
+    }
+
+    socket_ = sock;
+    settings_ = settings;
+    hasController_ = false;
+    client_.clear();
+    received_ = 0;
+    rejected_ = 0;
+    std::cout << "Remote control listening on " << settings.bindAddress << " UDP port " << port << std::endl;
+    if (settings.token.empty()) {
+        std::cout << "Remote control session token: " << token_ << std::endl;
+    }
+    return true;
+}
+
+void RemoteControl::close() {
+    if (socket_ == INVALID) return;
+#ifdef _WIN32
+    closesocket(socket_);
+    WSACleanup();
+#else
+    ::close(socket_);
+#endif
+    socket_ = INVALID;
+}
+
+void RemoteControl::poll(std::vector<RemoteCommand>& commands) {
+    if (socket_ == INVALID) return;
+
+    char datagram[512];
+    while (true) {
+        sockaddr_in sender = {};
+        socklen_t senderSize = sizeof(sender);
+        int size = static_cast<int>(::recvfrom(socket_, datagram, sizeof(datagram) - 1, 0,
+                                               reinterpret_cast<sockaddr*>(&sender), &senderSize));
+        if (size < 0) break;    // Nothing more waiting
+        datagram[size] = '\0';
+
+        char senderAddress[INET_ADDRSTRLEN] = {};
+        inet_ntop(AF_INET, &sender.sin_addr, senderAddress, sizeof(senderAddress));
+
+        RemoteCommand command;
+        const char* text = nullptr;
+        if (!acceptToken(datagram, text) || !parse(text, command)) {
+            rejected_++;
+            continue;
+        }
+
+        // Only the session's controller steers it; a hello takes over only a session without
+        // one, or whose controller has gone quiet
+        auto now = std::chrono::steady_clock::now();
+        bool fromController = hasController_ && sender.sin_addr.s_addr == controllerAddress_ &&
+                              sender.sin_port == controllerPort_;
+        bool released = !hasController_ ||
+                        now - lastHeard_ > std::chrono::duration<float>(settings_.controllerTimeout);
+        if (command.type == RemoteCommand::Type::HELLO ? !fromController && !released : !fromController) {
+            rejected_++;
+            continue;
+        }
+        if (command.type == RemoteCommand::Type::HELLO) {
+            hasController_ = true;
+            controllerAddress_ = sender.sin_addr.s_addr;
+            controllerPort_ = sender.sin_port;
+            client_ = std::string(senderAddress) + ":" + std::to_string(ntohs(sender.sin_port));
+        } else if (command.type == RemoteCommand::Type::BYE) {
+            hasController_ = false;
+            client_.clear();
+        }
+        lastHeard_ = now;
+
+        command.client = senderAddress;
+        commands.push_back(command);
+        received_++;
+    }
+}
+
+bool RemoteControl::acceptToken(const char* text, const char*& command) const {
+    while (std::isspace(static_cast<unsigned char>(*text))) text++;
+    const char* end = text;
+    while (*end && !std::isspace(static_cast<unsigned char>(*end))) end++;
+
+    // Compared in full whatever the first mismatch, so timing tells nothing of the token
+    size_t length = static_cast<size_t>(end - text);
+    unsigned char difference = length == token_.size() ? 0 : 1;
+    for (size_t i = 0; i < length && i < token_.size(); i++) {
+        difference |= static_cast<unsigned char>(text[i] ^ token_[i]);
+    }
+    command = end;
+    return difference == 0 && !token_.empty();
+}
+
+bool RemoteControl::parse(const char* text, RemoteCommand& command) {
+    char verb[16] = {};
+    int consumed = 0;
+    if (std::sscanf(text, "%15s%n", verb, &consumed) != 1) return false;
+    const char* args = text + consumed;
+
+    glm::vec3& p = command.position;
+    glm::vec3& v = command.vector;
+    SimulationCommand& simulation = command.simulation;
+    glm::vec3& sp = simulation.position;
+    glm::vec3& sv = simulation.vector;
+    float& magnitude = simulation.magnitude;
+    command.type = RemoteCommand::Type::SIMULATE;
+    if (std::strcmp(verb, "ripple") == 0 || std::strcmp(verb, "splash") == 0) {
+        simulation.type = verb[0] == 'r' ? SimulationCommand::Type::RIPPLE : SimulationCommand::Type::SPLASH;
+        return std::sscanf(args, "%f %f %f %f", &sp.x, &sp.y, &sp.z, &magnitude) == 4;
+    }
+    if (std::strcmp(verb, "impulse") == 0) {
+        simulation.type = SimulationCommand::Type::IMPULSE;
+        return std::sscanf(args, "%f %f %f %f %f %f %f", &sp.x, &sp.y, &sp.z, &sv.x, &sv.y, &sv.z, &magnitude) == 7 &&
+               magnitude > 0.0f;
+    }
+    if (std::strcmp(verb, "stream") == 0) {
+        simulation.type = SimulationCommand::Type::FLUID_STREAM;
+        return std::sscanf(args, "%f %f %f %f %f %f %f", &sp.x, &sp.y, &sp.z, &sv.x, &sv.y, &sv.z, &magnitude) == 7;
+    }
+    if (std::strcmp(verb, "volume") == 0) {
+        simulation.type = SimulationCommand::Type::FLUID_VOLUME;
+        return std::sscanf(args, "%f %f %f %f %f %f", &sp.x, &sp.y, &sp.z, &sv.x, &sv.y, &sv.z) == 6;
+    }
+    if (std::strcmp(verb, "gravity") == 0) {
+        simulation.type = SimulationCommand::Type::GRAVITY;
+        return std::sscanf(args, "%f %f %f", &sv.x, &sv.y, &sv.z) == 3;
+    }
+    if (std::strcmp(verb, "set") == 0) {
+        simulation.type = SimulationCommand::Type::PARAMETER;
+        char name[32] = {};
+        if (std::sscanf(args, "%31s %f", name, &magnitude) != 2) return false;
+        if (std::strcmp(name, "water-height") == 0) {
+            simulation.parameter = SimulationCommand::Parameter::WATER_HEIGHT;
+        } else if (std::strcmp(name, "damping") == 0) {
+            simulation.parameter = SimulationCommand::Parameter::BOUNDARY_DAMPING;
+        } else if (std::strcmp(name, "friction") == 0) {
+            simulation.parameter = SimulationCommand::Parameter::SPHERE_FRICTION;
+        } else {
+            return false;
+        }
+        return true;
+    }
+    if (std::strcmp(verb, "hello") == 0) {
+        command.type = RemoteCommand::Type::HELLO;
+        int fields = std::sscanf(args, "%d %d %d", &command.port, &command.width, &command.height);
+        if (fields == 3 && (command.width <= 0 || command.width > RemoteCommand::MAX_STREAM_SIZE ||
+                            command.height <= 0 || command.height > RemoteCommand::MAX_STREAM_SIZE)) {
+            return false;
+        }
+        return fields >= 1 && command.port >= 0 && command.port < 65536 && (fields == 1 || fields == 3);
+    }
+    if (std::strcmp(verb, "bye") == 0) {
+        command.type = RemoteCommand::Type::BYE;
+        return true;
+    }
+    if (std::strcmp(verb, "camera") == 0) {
+        command.type = RemoteCommand::Type::CAMERA;
+        v.z = 0.0f;     // Field of view unchanged
+        int fields = std::sscanf(args, "%f %f %f %f %f %f", &p.x, &p.y, &p.z, &v.x, &v.y, &v.z);
+        return fields == 5 || fields == 6;
+    }
+    if (std::strcmp(verb, "simulation") == 0) {
+        command.type = RemoteCommand::Type::SIMULATION;
+        char name[16] = {};
+        if (std::sscanf(args, "%15s", name) != 1) return false;
+        command.sph = std::strcmp(name, "sph") == 0;
+        return command.sph || std::strcmp(name, "regular") == 0;
+    }
+    return false;
+}
+
+} // namespace WaterSim
@@ -0,0 +1,171 @@
+#include "../include/RenderTargetPool.h"
+#include "../include/GPUMemoryTracker.h"
+#include <algorithm>
+
+namespace WaterSim {
+
+RenderTargetPool& RenderTargetPool::instance() {
+    static RenderTargetPool pool;
+    return pool;
+}
+
+GLuint RenderTargetPool::acquire(const RenderTargetDesc& desc) {
+    if (desc.width <= 0 || desc.height <= 0) return 0;
+
+    // The most recently freed match, the likeliest still in the driver's caches
+    for (size_t i = free_.size(); i-- > 0;) {
+        if (!(free_[i].desc == desc)) continue;
+        Entry entry = free_[i];
+        free_.erase(free_.begin() + i);
+
+        if (desc.target != GL_TEXTURE_2D_MULTISAMPLE) {
+            glTextureParameteri(entry.texture, GL_TEXTURE_MIN_FILTER, desc.levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+            glTextureParameteri(entry.texture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTextureParameteri(entry.texture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTextureParameteri(entry.texture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTextureParameteri(entry.texture, GL_TEXTURE_COMPARE_MODE, GL_NONE);
+            glTextureParameteri(entry.texture, GL_TEXTURE_BASE_LEVEL, 0);
+            glTextureParameteri(entry.texture, GL_TEXTURE_MAX_LEVEL, 1000);
+        }
+        live_.push_back(entry);
+        GPUMemoryTracker::instance().retagTexture(entry.texture);
+        stats_.reuses++;
+        updateStats();
+        return entry.texture;
+    }
+
+    Entry entry;
+    entry.desc = desc;
+    entry.texture = createTexture(desc);
+    live_.push_back(entry);
+    stats_.allocations++;
+    updateStats();
+    return entry.texture;
+}
+
+GLuint RenderTargetPool::acquire2D(GLenum internalFormat, int width, int height, int levels) {
+    RenderTargetDesc desc;
+    desc.internalFormat = internalFormat;
+    desc.width = width;
+    desc.height = height;
+    desc.levels = levels;
+    return acquire(desc);
+}
+
+void RenderTargetPool::release(GLuint texture) {
+    if (texture == 0) return;
+    auto it = std::find_if(live_.begin(), live_.end(), [&](const Entry& entry) { return entry.texture == texture; });
+    if (it == live_.end()) return;
+
+    released_.push_back(*it);
+    GPUMemoryTracker::instance().retagTexture(texture, GPUMemoryTracker::POOL_IDLE);
+    live_.erase(it);
+    updateStats();
+}
+
+void RenderTargetPool::endFrame() {
+    frame_++;
+
+    if (!released_.empty()) {
+        FencedBatch batch;
+        batch.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        batch.entries.swap(released_);
+        fenced_.push_back(std::move(batch));
+    }
+
+    // Polled, never waited on; the first unsignalled fence stops the rest as well
+    while (!fenced_.empty()) {
+        GLenum status = glClientWaitSync(fenced_.front().fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) break;
+
+        glDeleteSync(fenced_.front().fence);
+        for (Entry& entry : fenced_.front().entries) {
+            entry.releasedFrame = frame_;
+            free_.push_back(entry);
+        }
+        fenced_.pop_front();
+    }
+
+    deleteIdle();
+    updateStats();
+}
+
+void RenderTargetPool::clear() {
+    for (const Entry& entry : live_) deleteTexture(entry.texture);
+    for (const Entry& entry : released_) deleteTexture(entry.texture);
+    for (const Entry& entry : free_) deleteTexture(entry.texture);
+    for (const FencedBatch& batch : fenced_) {
+        for (const Entry& entry : batch.entries) deleteTexture(entry.texture);
+        glDeleteSync(batch.fence);
+    }
+    live_.clear();
+    released_.clear();
+    free_.clear();
+    fenced_.clear();
+    updateStats();
+}
+
+GLuint RenderTargetPool::createTexture(const RenderTargetDesc& desc) {
+    GLuint texture = 0;
+    glCreateTextures(desc.target, 1, &texture);
+    if (desc.target == GL_TEXTURE_2D_MULTISAMPLE) {
+        glTextureStorage2DMultisample(texture, desc.samples, desc.internalFormat, desc.width, desc.height, GL_TRUE);
+        GPUMemoryTracker::instance().trackTexture(texture, textureBytes(desc));
+        return texture;
+    }
+    if (desc.target == GL_TEXTURE_2D_ARRAY) {
+        glTextureStorage3D(texture, desc.levels, desc.internalFormat, desc.width, desc.height, desc.layers);
+    } else {
+        glTextureStorage2D(texture, desc.levels, desc.internalFormat, desc.width, desc.height);
+    }
+    glTextureParameteri(texture, GL_TEXTURE_MIN_FILTER, desc.levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTextureParameteri(texture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTextureParameteri(texture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTextureParameteri(texture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    GPUMemoryTracker::instance().trackTexture(texture, textureBytes(desc));
+    return texture;
+}
+
+void RenderTargetPool::deleteTexture(GLuint texture) {
+    GPUMemoryTracker::instance().untrackTexture(texture);
+    glDeleteTextures(1, &texture);
+}
+
+void RenderTargetPool::deleteIdle() {
+    // free_ is in release order, so the front is the longest idle
+    size_t idleBytes = 0;
+    for (const Entry& entry : free_) idleBytes += textureBytes(entry.desc);
+
+    size_t expired = 0;
+    while (expired < free_.size()) {
+        const Entry& entry = free_[expired];
+        bool old = frame_ - entry.releasedFrame > IDLE_FRAMES_BEFORE_RELEASE;
+        if (!old && idleBytes <= MAX_IDLE_BYTES) break;
+        idleBytes -= textureBytes(entry.desc);
+        deleteTexture(entry.texture);
+        expired++;
+    }
+    free_.erase(free_.begin(), free_.begin() + expired);
+}
+
+void RenderTargetPool::updateStats() {
+    stats_.liveTextures = static_cast<int>(live_.size());
+    stats_.freeTextures = static_cast<int>(free_.size());
+    stats_.fencedTextures = static_cast<int>(released_.size());
+    stats_.liveBytes = 0;
+    stats_.idleBytes = 0;
+    for (const Entry& entry : live_) stats_.liveBytes += textureBytes(entry.desc);
+    for (const Entry& entry : released_) stats_.idleBytes += textureBytes(entry.desc);
+    for (const Entry& entry : free_) stats_.idleBytes += textureBytes(entry.desc);
+    for (const FencedBatch& batch : fenced_) {
+        stats_.fencedTextures += static_cast<int>(batch.entries.size());
+        for (const Entry& entry : batch.entries) stats_.idleBytes += textureBytes(entry.desc);
+    }
+}
+
+size_t RenderTargetPool::textureBytes(const RenderTargetDesc& desc) {
+    return GPUMemoryTracker::storageBytes(desc.internalFormat, desc.width, desc.height, desc.layers, desc.levels) *
+           size_t(std::max(desc.samples, 1));
+}
+
+} // namespace WaterSim
@@ -0,0 +1,422 @@
+#include "../include/ResourceManager.h"
+#include "../include/ShaderCompiler.h"
+#include "../include/UploadQueue.h"
+#include "../include/stb_image.h"
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+
+namespace WaterSim {
+
+std::atomic<uint64_t> ResourceManager::frame_{0};
+
+GLuint ResourceManager::Handle::get() const {
+    if (!entry_) {
+        return 0;
+    }
+    entry_->lastUsedFrame.store(frame_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    GLuint id = entry_->id.load(std::memory_order_acquire);
+    if (id) {
+        return id;
+    }
+    entry_->reloadWanted.store(true, std::memory_order_relaxed);
+    return entry_->kind == Kind::TEXTURE ? ResourceManager::instance().placeholder_ : 0;
+}
+
+bool ResourceManager::Handle::isReady() const {
+    return entry_ && entry_->id.load(std::memory_order_acquire) != 0;
+}
+
+size_t ResourceManager::Handle::getBytes() const {
+    return entry_ ? entry_->bytes.load(std::memory_order_relaxed) : 0;
+}
+
+const std::string& ResourceManager::Handle::getName() const {
+    static const std::string empty;
+    return entry_ ? entry_->name : empty;
+}
+
+ResourceManager& ResourceManager::instance() {
+    static ResourceManager manager;
+    return manager;
+}
+
+ResourceManager::~ResourceManager() {
+    // The context is gone by now; clear() released the objects while it was current
+    decodeJobs_->wait();
+    for (auto& pair : entries_) {
+        stbi_image_free(pair.second->pixels);
+    }
+}
+
+void ResourceManager::initialize() {
+    if (!placeholder_) {
+        // Mid grey, so a material waiting for its texture still shades plausibly
+        const unsigned char texel[4] = {128, 128, 128, 255};
+        glGenTextures(1, &placeholder_);
+        glBindTexture(GL_TEXTURE_2D, placeholder_);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, 1, 1);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, texel);
+    }
+
+    GLint videoMemoryKB = 0;
+    if (GLAD_GL_NVX_gpu_memory_info) {
+        glGetIntegerv(GL_GPU_MEMORY_INFO_DEDICATED_VIDMEM_NVX, &videoMemoryKB);
+    } else if (GLAD_GL_ATI_meminfo) {
+        GLint textureMemory[4] = {};   // Free kB in the pool first
+        glGetIntegerv(GL_TEXTURE_FREE_MEMORY_ATI, textureMemory);
+        videoMemoryKB = textureMemory[0];
+    }
+    if (videoMemoryKB > 0) {
+        setBudget(size_t(videoMemoryKB) * 1024 / 2);
+        std::cout << "Resource budget: " << (getBudget() >> 20) << " MB of " << (videoMemoryKB >> 10)
+                  << " MB video memory" << std::endl;
+    } else {
+        std::cout << "Resource budget: unlimited (video memory size unknown)" << std::endl;
+    }
+}
+
+void ResourceManager::setBudget(size_t bytes) {
+    budgetBytes_.store(bytes);
+}
+
+std::shared_ptr<ResourceManager::Entry> ResourceManager::findOrCreate(const std::string& name, Kind kind, bool& created) {
+    auto it = entries_.find(name);
+    if (it != entries_.end()) {
+        created = false;
+        if (it->second->kind != kind) {
+            std::cerr << "WARNING: Resource " << name << " requested as another kind" << std::endl;
+        }
+        return it->second;
+    }
+    auto entry = std::make_shared<Entry>();
+    entry->name = name;
+    entry->kind = kind;
+    entries_.emplace(name, entry);
+    created = true;
+    return entry;
+}
+
+ResourceManager::Handle ResourceManager::requestTexture(const std::string& name, const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    bool created;
+    std::shared_ptr<Entry> entry = findOrCreate(name, Kind::TEXTURE, created);
+    if (created) {
+        entry->streamable = true;
+        entry->paths = {path};
+    }
+    return Handle(entry);
+}
+
+ResourceManager::Handle ResourceManager::requestProgram(const std::string& name, const std::string& vertexPath,
+                                                        const std::string& fragmentPath) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    bool created;
+    std::shared_ptr<Entry> entry = findOrCreate(name, Kind::PROGRAM, created);
+    if (created) {
+        entry->paths = {vertexPath, fragmentPath};
+    }
+    return Handle(entry);
+}
+
+ResourceManager::Handle ResourceManager::adoptTexture(const std::string& name, GLuint texture, GLenum target) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    bool created;
+    std::shared_ptr<Entry> entry = findOrCreate(name, Kind::TEXTURE, created);
+    if (entry->id.load() != texture) {
+        release(*entry);
+    }
+    entry->target = target;
+    entry->streamable = false;
+    entry->paths.clear();
+    entry->bytes = queryTextureBytes(texture, target);
+    entry->id.store(texture, std::memory_order_release);
+    entry->state = State::RESIDENT;
+    return Handle(entry);
+}
+
+ResourceManager::Handle ResourceManager::adoptProgram(const std::string& name, GLuint program) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    bool created;
+    std::shared_ptr<Entry> entry = findOrCreate(name, Kind::PROGRAM, created);
+    if (entry->id.load() != program) {
+        release(*entry);
+    }
+    GLint binaryLength = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &binaryLength);
+    entry->paths.clear();
+    entry->bytes = size_t(binaryLength);
+    entry->id.store(program, std::memory_order_release);
+    entry->state = State::RESIDENT;
+    return Handle(entry);
+}
+
+ResourceManager::Handle ResourceManager::find(const std::string& name) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(name);
+    return it != entries_.end() ? Handle(it->second) : Handle();
+}
+
+void ResourceManager::startLoad(const std::shared_ptr<Entry>& entry) {
+    entry->reloadWanted = false;
+    if (entry->kind == Kind::PROGRAM) {
+        // Submitted by update() once the lock is dropped: a cached binary calls back at once
+        entry->state = State::BUILDING;
+        return;
+    }
+
+    entry->state = State::DECODING;
+    decodeJobs_->run([this, entry]() {
+        int width = 0, height = 0, channels = 0;
+        unsigned char* pixels = nullptr;
+        if (std::filesystem::exists(entry->paths[0])) {
+            pixels = stbi_load(entry->paths[0].c_str(), &width, &height, &channels, STBI_rgb_alpha);
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!pixels) {
+            std::cerr << "Failed to load texture: " << entry->paths[0] << std::endl;
+            entry->state = State::FAILED;
+            return;
+        }
+        entry->pixels = pixels;
+        entry->width = width;
+        entry->height = height;
+        entry->state = State::DECODED;
+    });
+}
+
+void ResourceManager::uploadTexture(Entry& entry) {
+    int levels = 1;
+    while ((std::max(entry.width, entry.height) >> levels) > 0) {
+        levels++;
+    }
+
+    // The storage here; the texels and the mip chain on the upload thread
+    GLuint texture;
+    glCreateTextures(GL_TEXTURE_2D, 1, &texture);
+    glTextureStorage2D(texture, levels, GL_RGBA8, entry.width, entry.height);
+    glTextureParameteri(texture, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTextureParameteri(texture, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTextureParameteri(texture, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTextureParameteri(texture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    entry.uploadingTexture = texture;
+    entry.uploadTicket = UploadQueue::instance().uploadTexture(texture, 0, entry.width, entry.height, GL_RGBA,
+                                                               GL_UNSIGNED_BYTE, entry.pixels,
+                                                               size_t(entry.width) * entry.height * 4, true);
+    entry.state = State::UPLOADING;
+    if (UploadQueue::instance().isComplete(entry.uploadTicket)) {
+        finishUpload(entry);
+    }
+}
+
+void ResourceManager::finishUpload(Entry& entry) {
+    UploadQueue::instance().waitForUse(entry.uploadTicket);
+    GLuint texture = entry.uploadingTexture;
+    entry.uploadingTexture = 0;
+    entry.uploadTicket = 0;
+
+    stbi_image_free(entry.pixels);
+    entry.pixels = nullptr;
+    entry.bytes = queryTextureBytes(texture, GL_TEXTURE_2D);
+    entry.id.store(texture, std::memory_order_release);
+    entry.state = State::RESIDENT;
+    std::cout << "Loaded texture " << entry.name << ": " << entry.paths[0] << " (" << entry.width << "x"
+              << entry.height << ", " << (entry.bytes >> 10) << " KB)" << std::endl;
+}
+
+void ResourceManager::release(Entry& entry) {
+    GLuint id = entry.id.exchange(0);
+    if (id) {
+        if (entry.kind == Kind::TEXTURE) {
+            glDeleteTextures(1, &id);
+        } else {
+            glDeleteProgram(id);
+        }
+    }
+    entry.bytes = 0;
+}
+
+void ResourceManager::buildProgram(const std::shared_ptr<Entry>& entry) {
+    // Hot reloads come back through the same callback and swap the program in place
+    std::weak_ptr<Entry> weak = entry;
+    ShaderCompiler::instance().submit(this, entry->name, entry->paths[0].c_str(), entry->paths[1].c_str(),
+                                      [this, weak](GLuint program) {
+        std::shared_ptr<Entry> built = weak.lock();
+        if (!built) {
+            glDeleteProgram(program);
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        release(*built);
+        GLint binaryLength = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &binaryLength);
+        built->bytes = size_t(binaryLength);
+        built->id.store(program, std::memory_order_release);
+        built->state = State::RESIDENT;
+    });
+}
+
+void ResourceManager::update() {
+    frame_.fetch_add(1, std::memory_order_relaxed);
+
+    std::vector<std::shared_ptr<Entry>> programs;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        size_t uploaded = 0;
+        for (auto& pair : entries_) {
+            std::shared_ptr<Entry>& entry = pair.second;
+            if (entry->state == State::QUEUED || (entry->state == State::EVICTED && entry->reloadWanted)) {
+                startLoad(entry);
+                if (entry->kind == Kind::PROGRAM) {
+                    programs.push_back(entry);
+                }
+            } else if (entry->state == State::DECODED && uploaded < UPLOAD_BYTES_PER_UPDATE) {
+                uploaded += size_t(entry->width) * entry->height * 4;
+                uploadTexture(*entry);
+            } else if (entry->state == State::UPLOADING && UploadQueue::instance().isComplete(entry->uploadTicket)) {
+                finishUpload(*entry);
+            }
+        }
+        evictToBudget();
+    }
+
+    for (const std::shared_ptr<Entry>& entry : programs) {
+        buildProgram(entry);
+    }
+}
+
+size_t ResourceManager::residentBytes() const {
+    size_t total = 0;
+    for (const auto& pair : entries_) {
+        total += pair.second->bytes;
+    }
+    return total;
+}
+
+void ResourceManager::evictToBudget() {
+    size_t budget = budgetBytes_.load();
+    size_t resident = residentBytes();
+    if (budget == 0 || resident <= budget) {
+        return;
+    }
+
+    // Objects nobody holds go first, then streamable textures not used in a while, each
+    // least recently used first. The map's own reference is the only one of an unheld entry
+    uint64_t frame = frame_.load();
+    std::vector<std::shared_ptr<Entry>> candidates;
+    for (auto& pair : entries_) {
+        const std::shared_ptr<Entry>& entry = pair.second;
+        bool unheld = entry.use_count() == 1;
+        bool stale = entry->streamable && entry->lastUsedFrame + EVICTION_GRACE_FRAMES < frame;
+        if (entry->state == State::RESIDENT && (unheld || stale)) {
+            candidates.push_back(entry);
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(), [](const std::shared_ptr<Entry>& a, const std::shared_ptr<Entry>& b) {
+        // Each holds one more reference here, from candidates
+        bool aUnheld = a.use_count() == 2, bUnheld = b.use_count() == 2;
+        if (aUnheld != bUnheld) {
+            return aUnheld;
+        }
+        return a->lastUsedFrame < b->lastUsedFrame;
+    });
+
+    for (const std::shared_ptr<Entry>& entry : candidates) {
+        if (resident <= budget) {
+            break;
+        }
+        resident -= entry->bytes;
+        bool unheld = entry.use_count() == 2;
+        release(*entry);
+        evictions_++;
+        if (unheld) {
+            entries_.erase(entry->name);
+        } else {
+            entry->state = State::EVICTED;
+            entry->reloadWanted = false;
+        }
+    }
+}
+
+ResourceManager::Stats ResourceManager::getStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stats stats;
+    stats.residentBytes = residentBytes();
+    stats.budgetBytes = budgetBytes_.load();
+    stats.evictions = evictions_;
+    for (const auto& pair : entries_) {
+        const Entry& entry = *pair.second;
+        (entry.kind == Kind::TEXTURE ? stats.textures : stats.programs)++;
+        if (entry.state != State::RESIDENT && entry.state != State::EVICTED && entry.state != State::FAILED) {
+            stats.pending++;
+        }
+    }
+    return stats;
+}
+
+void ResourceManager::clear() {
+    ShaderCompiler::instance().cancel(this);
+    decodeJobs_->wait();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& pair : entries_) {
+        Entry& entry = *pair.second;
+        release(entry);
+        if (entry.state == State::UPLOADING) {
+            // The upload thread reads the texels until the job is issued
+            UploadQueue::instance().waitForUse(entry.uploadTicket);
+            glDeleteTextures(1, &entry.uploadingTexture);
+            entry.uploadingTexture = 0;
+        }
+        stbi_image_free(entry.pixels);
+        entry.pixels = nullptr;
+        entry.state = State::FAILED;
+    }
+    entries_.clear();
+    if (placeholder_) {
+        glDeleteTextures(1, &placeholder_);
+        placeholder_ = 0;
+    }
+}
+
+size_t ResourceManager::queryTextureBytes(GLuint texture, GLenum target) {
+    if (!texture) {
+        return 0;
+    }
+    bool cubemap = target == GL_TEXTURE_CUBE_MAP;
+    GLenum levelTarget = cubemap ? GL_TEXTURE_CUBE_MAP_POSITIVE_X : target;
+
+    glBindTexture(target, texture);
+    size_t total = 0;
+    for (int level = 0; level < 16; level++) {
+        GLint width = 0, height = 0, depth = 0, compressed = GL_FALSE;
+        glGetTexLevelParameteriv(levelTarget, level, GL_TEXTURE_WIDTH, &width);
+        if (width == 0) {
+            break;
+        }
+        glGetTexLevelParameteriv(levelTarget, level, GL_TEXTURE_HEIGHT, &height);
+        glGetTexLevelParameteriv(levelTarget, level, GL_TEXTURE_DEPTH, &depth);
+        glGetTexLevelParameteriv(levelTarget, level, GL_TEXTURE_COMPRESSED, &compressed);
+        if (compressed) {
+            GLint imageSize = 0;
+            glGetTexLevelParameteriv(levelTarget, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &imageSize);
+            total += size_t(imageSize);
+            continue;
+        }
+
+        const GLenum componentSizes[] = {GL_TEXTURE_RED_SIZE, GL_TEXTURE_GREEN_SIZE, GL_TEXTURE_BLUE_SIZE,
+                                         GL_TEXTURE_ALPHA_SIZE, GL_TEXTURE_DEPTH_SIZE, GL_TEXTURE_STENCIL_SIZE};
+        GLint bits = 0;
+        for (GLenum component : componentSizes) {
+            GLint size = 0;
+            glGetTexLevelParameteriv(levelTarget, level, component, &size);
+            bits += size;
+        }
+        total += size_t(width) * std::max(height, 1) * std::max(depth, 1) * ((bits + 7) / 8);
+    }
+    return cubemap ? total * 6 : total;
+}
+
+} // namespace WaterSim
@@ -0,0 +1,255 @@
+#include "../include/RewindTimeline.h"
+#include "../include/GLResources.h"
+#include "../include/GPUMemoryTracker.h"
+#include "../include/RenderTargetPool.h"
+#include <algorithm>
+#include <iostream>
+
+namespace WaterSim {
+
+namespace {
+    constexpr GLsizeiptr RING_ALIGNMENT = 256;  // Storage buffer offsets bind at multiples of it
+
+    GLsizeiptr alignRing(GLsizeiptr bytes) {
+        return (bytes + RING_ALIGNMENT - 1) / RING_ALIGNMENT * RING_ALIGNMENT;
+    }
+}
+
+RewindTimeline::RewindTimeline(SimulationManager& simulation)
+    : simulation_(simulation) {
+}
+
+RewindTimeline::~RewindTimeline() {
+    simulation_.setCommandLog(nullptr);
+    clear();
+    releaseRing();
+}
+
+void RewindTimeline::setSettings(const Settings& settings) {
+    if (!settings.enabled || settings.budgetBytes != settings_.budgetBytes) {
+        clear();
+        releaseRing();
+    }
+    settings_ = settings;
+    settings_.keyframeInterval = std::max(settings_.keyframeInterval, 1);
+    simulation_.setCommandLog(settings_.enabled ? &pending_ : nullptr);
+    if (!settings_.enabled) status_.clear();
+}
+
+void RewindTimeline::record(float deltaTime, const Sphere& sphere) {
+    if (!settings_.enabled || paused_) return;
+
+    std::string reason;
+    if (!simulation_.canKeyframe(&reason)) {
+        clear();
+        status_ = "Not recording: " + reason;
+        return;
+    }
+    if (!keyframes_.empty() && keyframes_.back().state.type != simulation_.getCurrentType()) {
+        clear();
+    }
+    status_.clear();
+
+    int frame = lastFrame_ + 1;
+    if (keyframes_.empty()) {
+        // Nothing to step from yet: this frame's keyframe starts the timeline
+        frames_.clear();
+        firstFrame_ = frame;
+    }
+    Frame record;
+    record.deltaTime = deltaTime;
+    record.sphere = sphere;
+    record.commands.swap(pending_);
+    frames_.push_back(std::move(record));
+    lastFrame_ = frame;
+    currentFrame_ = frame;
+
+    if (keyframes_.empty() || frame - keyframes_.back().frame >= settings_.keyframeInterval) {
+        if (!captureKeyframe(frame) && keyframes_.empty()) {
+            frames_.clear();
+        }
+    }
+}
+
+bool RewindTimeline::captureKeyframe(int frame) {
+    Keyframe keyframe;
+    keyframe.frame = frame;
+
+    SPHComputeSystem* sph = simulation_.getSPHComputeSystem();
+    if (sph) {
+        keyframe.ringBytes = alignRing(SPHConstants::keyframeBytes(sph->getParticleCount()));
+    }
+    WaterSurface* surface = simulation_.getWaterSurface();
+    HeightfieldWaves* heightfield = surface ? surface->getHeightfield() : nullptr;
+    int resolution = heightfield ? heightfield->getResolution() : 0;
+    size_t textureBytes = heightfield ? GPUMemoryTracker::storageBytes(GL_R32F, 2 * resolution, resolution) : 0;
+    keyframe.bytes = static_cast<size_t>(keyframe.ringBytes) + textureBytes;
+    if (keyframe.bytes > settings_.budgetBytes) {
+        status_ = "Not recording: a keyframe is larger than the budget";
+        return false;
+    }
+
+    GPUMemoryScope memoryScope("Rewind");
+    if (keyframe.ringBytes > 0) {
+        if (!ring_) {
+            ringCapacity_ = static_cast<GLsizeiptr>(settings_.budgetBytes) / RING_ALIGNMENT * RING_ALIGNMENT;
+            glCreateBuffers(1, &ring_);
+            bufferStorage(ring_, ringCapacity_, nullptr, 0);
+            ringHead_ = 0;
+        }
+        if (ringHead_ + keyframe.ringBytes > ringCapacity_) {
+            ringHead_ = 0;
+        }
+        keyframe.offset = ringHead_;
+    }
+    while (!keyframes_.empty() && (usedBytes_ + keyframe.bytes > settings_.budgetBytes ||
+                                   overlapsRing(keyframe.offset, keyframe.ringBytes))) {
+        popOldestKeyframe();
+    }
+
+    if (heightfield) {
+        keyframe.heightfieldTexture = RenderTargetPool::instance().acquire2D(GL_R32F, 2 * resolution, resolution);
+    }
+    if (!simulation_.captureKeyframe(keyframe.state, ring_, keyframe.offset, keyframe.heightfieldTexture)) {
+        RenderTargetPool::instance().release(keyframe.heightfieldTexture);
+        status_ = "Not recording: the keyframe capture failed";
+        return false;
+    }
+
+    ringHead_ = keyframe.offset + keyframe.ringBytes;
+    usedBytes_ += keyframe.bytes;
+    keyframes_.push_back(std::move(keyframe));
+    return true;
+}
+
+bool RewindTimeline::overlapsRing(GLintptr offset, GLsizeiptr bytes) const {
+    if (bytes == 0) return false;
+    for (const Keyframe& keyframe : keyframes_) {
+        if (keyframe.ringBytes > 0 && offset < keyframe.offset + keyframe.ringBytes &&
+            keyframe.offset < offset + bytes) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void RewindTimeline::popOldestKeyframe() {
+    RenderTargetPool::instance().release(keyframes_.front().heightfieldTexture);
+    usedBytes_ -= keyframes_.front().bytes;
+    keyframes_.pop_front();
+
+    // The frames up to the new oldest keyframe can no longer be reached
+    int keep = keyframes_.empty() ? lastFrame_ : keyframes_.front().frame;
+    while (firstFrame_ < keep && !frames_.empty()) {
+        frames_.pop_front();
+        firstFrame_++;
+    }
+}
+
+void RewindTimeline::popNewestKeyframe() {
+    RenderTargetPool::instance().release(keyframes_.back().heightfieldTexture);
+    usedBytes_ -= keyframes_.back().bytes;
+    keyframes_.pop_back();
+    ringHead_ = keyframes_.empty() ? 0 : keyframes_.back().offset + keyframes_.back().ringBytes;
+}
+
+bool RewindTimeline::seek(int frame, Sphere& sphere) {
+    if (!settings_.enabled || keyframes_.empty() || frame < keyframes_.front().frame || frame > lastFrame_) {
+        return false;
+    }
+    std::string reason;
+    if (!simulation_.canKeyframe(&reason)) {
+        status_ = "Cannot rewind: " + reason;
+        return false;
+    }
+
+    const Keyframe* from = &keyframes_.front();
+    for (auto it = keyframes_.rbegin(); it != keyframes_.rend(); ++it) {
+        if (it->frame <= frame) {
+            from = &*it;
+            break;
+        }
+    }
+
+    // Forward from the current state when it is past the keyframe and nothing has touched it
+    // since; interactions while paused went straight into the state, so they rule that out
+    bool stepOn = pending_.empty() && currentFrame_ >= from->frame && currentFrame_ <= frame;
+    if (!stepOn) {
+        if (!simulation_.restoreKeyframe(from->state, ring_, from->offset, from->heightfieldTexture)) {
+            std::cerr << "ERROR: Failed to restore the rewind keyframe of frame " << from->frame << std::endl;
+            return false;
+        }
+        currentFrame_ = from->frame;
+    }
+    pending_.clear();
+
+    // The recorded frames again, logging nothing
+    simulation_.setCommandLog(nullptr);
+    while (currentFrame_ < frame) {
+        const Frame& next = frames_[currentFrame_ + 1 - firstFrame_];
+        for (const SimulationCommand& command : next.commands) {
+            simulation_.getCommandQueue().push(command);
+        }
+        applySphere(next.sphere);
+        simulation_.update(next.deltaTime);
+        currentFrame_++;
+    }
+    simulation_.setCommandLog(&pending_);
+
+    paused_ = true;
+    sphere = frames_[frame - firstFrame_].sphere;
+    return true;
+}
+
+void RewindTimeline::applySphere(const Sphere& sphere) {
+    simulation_.setWaterObstacle(sphere.position, sphere.radius);
+    SPHComputeSystem* sph = simulation_.isSPHComputeActive() ? simulation_.getSPHComputeSystem() : nullptr;
+    if (sph && sph->getUseSphereCoupling()) {
+        sph->setCoupledSphere(sphere.position, sphere.velocity, sphere.radius);
+    }
+}
+
+void RewindTimeline::resume() {
+    if (!paused_) return;
+    while (!keyframes_.empty() && keyframes_.back().frame > currentFrame_) {
+        popNewestKeyframe();
+    }
+    while (lastFrame_ > currentFrame_ && !frames_.empty()) {
+        frames_.pop_back();
+        lastFrame_--;
+    }
+    lastFrame_ = currentFrame_;
+    paused_ = false;
+}
+
+void RewindTimeline::clear() {
+    for (const Keyframe& keyframe : keyframes_) {
+        RenderTargetPool::instance().release(keyframe.heightfieldTexture);
+    }
+    keyframes_.clear();
+    frames_.clear();
+    pending_.clear();
+    usedBytes_ = 0;
+    ringHead_ = 0;
+    firstFrame_ = lastFrame_ = currentFrame_ = 0;
+    paused_ = false;
+}
+
+void RewindTimeline::releaseRing() {
+    if (ring_) deleteBuffers(1, &ring_);
+    ring_ = 0;
+    ringCapacity_ = 0;
+    ringHead_ = 0;
+}
+
+RewindTimeline::Stats RewindTimeline::getStats() const {
+    Stats stats;
+    stats.keyframes = static_cast<int>(keyframes_.size());
+    stats.keyframeBytes = usedBytes_;
+    stats.firstFrame = keyframes_.empty() ? 0 : keyframes_.front().frame;
+    stats.lastFrame = lastFrame_;
+    stats.currentFrame = currentFrame_;
+    return stats;
+}
+
+} // namespace WaterSim
@@ -0,0 +1,282 @@
+#include "RigidBodySystem.h"
+#include "ShaderCompiler.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace WaterSim {
+
+namespace {
+
+constexpr GLuint STATE_BINDING = 46;        // Source state of the kernels, and of rigid_body.vs
+constexpr GLuint IMPULSE_BINDING = 47;
+constexpr GLuint GRID_BINDING = 48;
+constexpr GLuint NEXT_STATE_BINDING = 49;
+constexpr GLuint GROUP_SIZE = 64;           // Both kernels
+
+constexpr int STATE_ARRAYS = 5;             // Position, velocity, orientation, angular velocity, shape
+constexpr GLsizeiptr STATE_ARRAY_SIZE = RigidBodySystem::CAPACITY * sizeof(glm::vec4);
+
+// How far a body may move between broadphase builds, on top of the particles' contact skin
+constexpr float MOTION_MARGIN = 0.02f;
+constexpr float BROADPHASE_MARGIN = SPHConstants::PARTICLE_RADIUS + MOTION_MARGIN;
+
+constexpr int MESH_SEGMENTS = 8;            // Quads per cube face edge
+
+} // namespace
+
+RigidBodySystem::~RigidBodySystem() {
+    ShaderCompiler::instance().cancel(this);
+    if (stateBuffers_[0]) glDeleteBuffers(2, stateBuffers_);
+    if (impulseBuffer_) glDeleteBuffers(1, &impulseBuffer_);
+    if (gridBuffer_) glDeleteBuffers(1, &gridBuffer_);
+    if (vao_) glDeleteVertexArrays(1, &vao_);
+    if (vbo_) glDeleteBuffers(1, &vbo_);
+    if (ebo_) glDeleteBuffers(1, &ebo_);
+}
+
+bool RigidBodySystem::initialize() {
+    glCreateBuffers(2, stateBuffers_);
+    for (GLuint buffer : stateBuffers_) {
+        glNamedBufferStorage(buffer, STATE_ARRAYS * STATE_ARRAY_SIZE, nullptr, GL_DYNAMIC_STORAGE_BIT);
+    }
+    GLsizeiptr impulseSize = 2 * CAPACITY * sizeof(glm::ivec4);
+    glCreateBuffers(1, &impulseBuffer_);
+    glNamedBufferStorage(impulseBuffer_, impulseSize, nullptr, GL_DYNAMIC_STORAGE_BIT);
+    int32_t zero = 0;
+    glClearNamedBufferData(impulseBuffer_, GL_R32I, GL_RED_INTEGER, GL_INT, &zero);
+
+    createMesh();
+    setGrid(nullptr);
+
+    ShaderCompiler& compiler = ShaderCompiler::instance();
+    compiler.submitCompute(this, "rigid broadphase", "shaders/rigid_broadphase.cs", "",
+                           [this](GLuint program) { broadphaseProgram_.setId(program); });
+    compiler.submitCompute(this, "rigid integrate", "shaders/rigid_integrate.cs", "",
+                           [this](GLuint program) { integrateProgram_.setId(program); });
+    return stateBuffers_[0] != 0 && impulseBuffer_ != 0;
+}
+
+void RigidBodySystem::createMesh() {
+    // Each face its own grid of vertices, so boxes keep hard edges: position, face normal, uv
+    std::vector<float> vertices;
+    std::vector<GLuint> indices;
+    const glm::vec3 normals[6] = { {1, 0, 0}, {-1, 0, 0}, {0, 1, 0}, {0, -1, 0}, {0, 0, 1}, {0, 0, -1} };
+    for (const glm::vec3& normal : normals) {
+        glm::vec3 u = std::abs(normal.y) > 0.5f ? glm::vec3(1, 0, 0) : glm::vec3(0, 1, 0);
+        glm::vec3 v = glm::cross(normal, u);
+        GLuint base = static_cast<GLuint>(vertices.size() / 8);
+        for (int j = 0; j <= MESH_SEGMENTS; j++) {
+            for (int i = 0; i <= MESH_SEGMENTS; i++) {
+                float s = static_cast<float>(i) / MESH_SEGMENTS;
+                float t = static_cast<float>(j) / MESH_SEGMENTS;
+                glm::vec3 p = normal + u * (2.0f * s - 1.0f) + v * (2.0f * t - 1.0f);
+                vertices.insert(vertices.end(), { p.x, p.y, p.z, normal.x, normal.y, normal.z, s, t });
+            }
+        }
+        for (int j = 0; j < MESH_SEGMENTS; j++) {
+            for (int i = 0; i < MESH_SEGMENTS; i++) {
+                GLuint a = base + j * (MESH_SEGMENTS + 1) + i;
+                GLuint b = a + 1;
+                GLuint c = a + MESH_SEGMENTS + 1;
+                GLuint d = c + 1;
+                // Counter-clockwise seen from outside: u x v is the normal
+                indices.insert(indices.end(), { a, b, d, a, d, c });
+            }
+        }
+    }
+    indexCount_ = static_cast<GLsizei>(indices.size());
+
+    glCreateBuffers(1, &vbo_);
+    glNamedBufferStorage(vbo_, vertices.size() * sizeof(float), vertices.data(), 0);
+    glCreateBuffers(1, &ebo_);
+    glNamedBufferStorage(ebo_, indices.size() * sizeof(GLuint), indices.data(), 0);
+
+    glCreateVertexArrays(1, &vao_);
+    glVertexArrayVertexBuffer(vao_, 0, vbo_, 0, 8 * sizeof(float));
+    glVertexArrayElementBuffer(vao_, ebo_);
+    const GLint sizes[3] = { 3, 3, 2 };
+    const GLuint offsets[3] = { 0, 3 * sizeof(float), 6 * sizeof(float) };
+    for (GLuint attribute = 0; attribute < 3; attribute++) {
+        glEnableVertexArrayAttrib(vao_, attribute);
+        glVertexArrayAttribFormat(vao_, attribute, sizes[attribute], GL_FLOAT, GL_FALSE, offsets[attribute]);
+        glVertexArrayAttribBinding(vao_, attribute, 0);
+    }
+}
+
+void RigidBodySystem::setBounds(const glm::vec3& boundsMin, const glm::vec3& boundsMax) {
+    boundsMin_ = boundsMin;
+    boundsMax_ = boundsMax;
+}
+
+void RigidBodySystem::setGrid(const SPHComputeSystem* sph) {
+    glm::vec3 origin;
+    float cellSize;
+    glm::ivec3 res;
+    if (sph) {
+        origin = sph->getGridOrigin();
+        cellSize = sph->getGridCellSize() * CELL_FACTOR;
+        res = (sph->getGridResolution() + (CELL_FACTOR - 1)) / CELL_FACTOR;
+    } else {
+        origin = boundsMin_;
+        cellSize = SPHConstants::CELL_SIZE * CELL_FACTOR;
+        res = glm::ivec3(glm::ceil((boundsMax_ - boundsMin_) / cellSize));
+    }
+    res = glm::max(res, glm::ivec3(1));
+    if (gridBuffer_ && origin == gridOrigin_ && cellSize == cellSize_ && res == gridRes_) return;
+
+    gridOrigin_ = origin;
+    cellSize_ = cellSize;
+    gridRes_ = res;
+    // A body with its margins fits in one cell, so it is listed in at most two per axis
+    maxBodySize_ = 0.5f * cellSize_ - BROADPHASE_MARGIN;
+
+    GLsizeiptr size = static_cast<GLsizeiptr>(res.x) * res.y * res.z * (CELL_CAPACITY + 1) * sizeof(GLuint);
+    if (size != gridBufferSize_) {
+        if (gridBuffer_) glDeleteBuffers(1, &gridBuffer_);
+        glCreateBuffers(1, &gridBuffer_);
+        glNamedBufferStorage(gridBuffer_, size, nullptr, GL_DYNAMIC_STORAGE_BIT);
+        gridBufferSize_ = size;
+    }
+    buildBroadphase();
+}
+
+int RigidBodySystem::addBody(Shape shape, const glm::vec3& position, const glm::vec3& size, float density,
+                             const glm::vec3& velocity) {
+    if (count_ + pending_.size() >= CAPACITY) return -1;
+
+    PendingBody body;
+    float mass;
+    float inertia;
+    if (shape == Shape::SPHERE) {
+        float radius = std::min(size.x, maxBodySize_);
+        mass = density * (4.0f / 3.0f) * SPHConstants::PI_VALUE * radius * radius * radius;
+        inertia = 0.4f * mass * radius * radius;
+        body.shape = glm::vec4(radius, radius, radius, 0.0f);
+        body.position = glm::vec4(position, radius);
+    } else {
+        glm::vec3 halfExtents = size;
+        float bounding = glm::length(halfExtents);
+        if (bounding > maxBodySize_) halfExtents *= maxBodySize_ / bounding;
+        mass = density * 8.0f * halfExtents.x * halfExtents.y * halfExtents.z;
+        // Mean of the principal moments m/3 (b^2 + c^2)
+        inertia = (2.0f / 9.0f) * mass * glm::dot(halfExtents, halfExtents);
+        body.shape = glm::vec4(halfExtents, 1.0f);
+        body.position = glm::vec4(position, glm::length(halfExtents));
+    }
+    body.velocity = glm::vec4(velocity, mass > 0.0f ? 1.0f / mass : 0.0f);
+    body.orientation = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    body.angularVelocity = glm::vec4(0.0f, 0.0f, 0.0f, inertia > 0.0f ? 1.0f / inertia : 0.0f);
+    pending_.push_back(body);
+    return static_cast<int>(count_ + pending_.size() - 1);
+}
+
+void RigidBodySystem::clear() {
+    count_ = 0;
+    pending_.clear();
+    int32_t zero = 0;
+    glClearNamedBufferData(impulseBuffer_, GL_R32I, GL_RED_INTEGER, GL_INT, &zero);
+    buildBroadphase();
+}
+
+void RigidBodySystem::uploadPending() {
+    if (pending_.empty()) return;
+
+    // Each field into its own array of the latest state
+    GLsizeiptr count = static_cast<GLsizeiptr>(pending_.size());
+    std::vector<glm::vec4> field(pending_.size());
+    glm::vec4 PendingBody::* fields[STATE_ARRAYS] = { &PendingBody::position, &PendingBody::velocity,
+                                                      &PendingBody::orientation, &PendingBody::angularVelocity,
+                                                      &PendingBody::shape };
+    for (int array = 0; array < STATE_ARRAYS; array++) {
+        for (size_t i = 0; i < pending_.size(); i++) {
+            field[i] = pending_[i].*fields[array];
+        }
+        glNamedBufferSubData(stateBuffers_[current_], array * STATE_ARRAY_SIZE + count_ * sizeof(glm::vec4),
+                             count * sizeof(glm::vec4), field.data());
+    }
+    count_ += static_cast<uint32_t>(pending_.size());
+    pending_.clear();
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+}
+
+void RigidBodySystem::buildBroadphase() {
+    GLuint zero = 0;
+    glClearNamedBufferData(gridBuffer_, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    if (count_ == 0 || !broadphaseProgram_.isValid()) return;
+
+    broadphaseProgram_.use();
+    glUniform1ui(broadphaseProgram_.uniformLocation("uBodyCount"), count_);
+    broadphaseProgram_.setVec3("uGridOrigin", gridOrigin_);
+    broadphaseProgram_.setFloat("uCellSize", cellSize_);
+    glUniform3iv(broadphaseProgram_.uniformLocation("uGridRes"), 1, &gridRes_[0]);
+    broadphaseProgram_.setFloat("uMargin", BROADPHASE_MARGIN);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STATE_BINDING, stateBuffers_[current_]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, GRID_BINDING, gridBuffer_);
+    glDispatchCompute((count_ + GROUP_SIZE - 1) / GROUP_SIZE, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+void RigidBodySystem::update(float deltaTime, const glm::vec3& gravity) {
+    if (!isReady()) return;
+    uploadPending();
+    if (count_ == 0 || deltaTime <= 0.0f) return;
+
+    // The impulse sums of the SPH step 1 passes since the last update
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    int substeps = std::max(settings_.substeps, 1);
+    float dt = std::min(deltaTime, 1.0f / 30.0f) / substeps;
+    for (int substep = 0; substep < substeps; substep++) {
+        integrateProgram_.use();
+        glUniform1ui(integrateProgram_.uniformLocation("uBodyCount"), count_);
+        integrateProgram_.setFloat("uDT", dt);
+        integrateProgram_.setVec3("uGravity", gravity);
+        integrateProgram_.setVec3("uBoundsMin", boundsMin_);
+        integrateProgram_.setVec3("uBoundsMax", boundsMax_);
+        integrateProgram_.setVec3("uGridOrigin", gridOrigin_);
+        integrateProgram_.setFloat("uCellSize", cellSize_);
+        glUniform3iv(integrateProgram_.uniformLocation("uGridRes"), 1, &gridRes_[0]);
+        integrateProgram_.setFloat("uMargin", BROADPHASE_MARGIN);
+        integrateProgram_.setFloat("uRestitution", settings_.restitution);
+        integrateProgram_.setFloat("uFriction", settings_.friction);
+        integrateProgram_.setFloat("uDamping", settings_.damping);
+        integrateProgram_.setInt("uApplyFluid", substep == 0 ? 1 : 0);
+
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STATE_BINDING, stateBuffers_[current_]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, NEXT_STATE_BINDING, stateBuffers_[1 - current_]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, IMPULSE_BINDING, impulseBuffer_);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, GRID_BINDING, gridBuffer_);
+        glDispatchCompute((count_ + GROUP_SIZE - 1) / GROUP_SIZE, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        current_ = 1 - current_;
+
+        buildBroadphase();
+    }
+    glUseProgram(0);
+}
+
+SPHRigidBodies RigidBodySystem::getFluidCoupling() const {
+    SPHRigidBodies coupling;
+    coupling.stateBuffer = stateBuffers_[current_];
+    coupling.impulseBuffer = impulseBuffer_;
+    coupling.gridBuffer = gridBuffer_;
+    coupling.count = isReady() ? count_ : 0;
+    coupling.gridRes = gridRes_;
+    coupling.cellFactor = CELL_FACTOR;
+    coupling.friction = settings_.fluidFriction;
+    return coupling;
+}
+
+void RigidBodySystem::render(const GLShaderProgram& program) const {
+    if (count_ == 0) return;
+
+    program.use();
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STATE_BINDING, stateBuffers_[current_]);
+    glBindVertexArray(vao_);
+    glDrawElementsInstanced(GL_TRIANGLES, indexCount_, GL_UNSIGNED_INT, nullptr, static_cast<GLsizei>(count_));
+    glBindVertexArray(0);
+}
+
+} // namespace WaterSim
@@ -0,0 +1,268 @@
+#include "SPHCacheExporter.h"
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace WaterSim {
+
+namespace {
+    // The PLY vertex properties below are SPHParticleCompute's fields in order, so the
+    // particles are written from the readback as they are (PLY is little-endian here, as
+    // every platform the GL backend runs on)
+    static_assert(sizeof(SPHParticleCompute) == 8 * sizeof(float), "Particle layout changed");
+
+    constexpr uint32_t WRITE_CHUNK = 4096;  // Surface vertices repacked per fwrite
+
+    void writeHeader(std::FILE* file, double simulationTime, const char* body) {
+        std::fprintf(file, "ply\nformat binary_little_endian 1.0\ncomment WaterSimulation SPH cache\n"
+                           "comment time %.9f\n%send_header\n", simulationTime, body);
+    }
+}
+
+SPHCacheExporter::~SPHCacheExporter() {
+    close();
+}
+
+bool SPHCacheExporter::open(const std::string& basePath, SPHCacheContent content, uint32_t capacity) {
+    close();
+    if (basePath.empty() || capacity == 0) return false;
+
+    basePath_ = basePath;
+    content_ = content;
+    capacity_ = capacity;
+
+    // Particles with the live count behind them, or the whole mesh buffer
+    GLsizeiptr slotSize = content == SPHCacheContent::PARTICLES ?
+                          GLsizeiptr(capacity) * sizeof(SPHParticleCompute) + sizeof(uint32_t) :
+                          GLsizeiptr(4 * sizeof(uint32_t)) + GLsizeiptr(capacity) * 2 * sizeof(glm::vec4);
+    GLbitfield readbackFlags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    for (int i = 0; i < CACHE_SLOTS; i++) {
+        glCreateBuffers(1, &buffers_[i]);
+        glNamedBufferStorage(buffers_[i], slotSize, nullptr, readbackFlags);
+        pointers_[i] = static_cast<const uint8_t*>(glMapNamedBufferRange(buffers_[i], 0, slotSize, readbackFlags));
+        states_[i] = SlotState::FREE;
+    }
+
+    nextSlot_ = 0;
+    capturedFrames_ = 0;
+    deferredFrames_ = 0;
+    writtenFrames_ = 0;
+    failedFrames_ = 0;
+    stopping_ = false;
+    open_ = true;
+    writer_ = std::thread(&SPHCacheExporter::writerLoop, this);
+
+    std::cout << "SPH cache started: " << basePath << (content == SPHCacheContent::PARTICLES ? " (particles, " : " (surface, ")
+              << (slotSize * CACHE_SLOTS) / (1024 * 1024) << " MB of readback)" << std::endl;
+    return true;
+}
+
+void SPHCacheExporter::close() {
+    if (!open_) return;
+
+    // Drain the ring; blocking is acceptable when the cache ends
+    for (int i = 0; i < CACHE_SLOTS; i++) {
+        if (fences_[i]) glClientWaitSync(fences_[i], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+    }
+    poll();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_one();
+    writer_.join();
+
+    for (int i = 0; i < CACHE_SLOTS; i++) {
+        if (fences_[i]) glDeleteSync(fences_[i]);
+        if (buffers_[i]) glDeleteBuffers(1, &buffers_[i]);
+        fences_[i] = 0;
+        buffers_[i] = 0;
+        pointers_[i] = nullptr;
+        states_[i] = SlotState::FREE;
+    }
+    queue_.clear();
+    open_ = false;
+
+    std::cout << "SPH cache finished: " << writtenFrames_ << " frames written, " << deferredFrames_
+              << " captures deferred, " << failedFrames_ << " failed" << std::endl;
+}
+
+bool SPHCacheExporter::canCapture() const {
+    if (!open_ || !pointers_[nextSlot_]) return false;
+    std::lock_guard<std::mutex> lock(mutex_);
+    return states_[nextSlot_] == SlotState::FREE;
+}
+
+bool SPHCacheExporter::claimSlot() {
+    if (canCapture()) return true;
+    if (open_) deferredFrames_++;   // Ring full: the caller tries again next update
+    return false;
+}
+
+void SPHCacheExporter::submit() {
+    int slot = nextSlot_;
+    fences_[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    frameIndices_[slot] = capturedFrames_++;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        states_[slot] = SlotState::READING;
+    }
+    nextSlot_ = (slot + 1) % CACHE_SLOTS;
+}
+
+bool SPHCacheExporter::captureParticles(GLuint buffer, uint32_t count, GLuint countBuffer, double simulationTime) {
+    if (content_ != SPHCacheContent::PARTICLES || !claimSlot()) return false;
+
+    int slot = nextSlot_;
+    count = std::min(count, capacity_);
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    if (count > 0) {
+        glCopyNamedBufferSubData(buffer, buffers_[slot], 0, 0, GLsizeiptr(count) * sizeof(SPHParticleCompute));
+    }
+    // The live count behind the particles
+    if (countBuffer) {
+        glCopyNamedBufferSubData(countBuffer, buffers_[slot], SPHConstants::LIVE_COUNT_OFFSET,
+                                 GLintptr(capacity_) * sizeof(SPHParticleCompute), sizeof(uint32_t));
+    }
+    hasLiveCount_[slot] = countBuffer != 0;
+    counts_[slot] = count;
+    times_[slot] = simulationTime;
+    submit();
+    return true;
+}
+
+bool SPHCacheExporter::captureSurface(GLuint meshBuffer, double simulationTime) {
+    if (content_ != SPHCacheContent::SURFACE || !meshBuffer || !claimSlot()) return false;
+
+    // The vertex count is the indirect command's, unknown here without a stall: the whole
+    // buffer is copied, the writer reads the count from the copy
+    int slot = nextSlot_;
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glCopyNamedBufferSubData(meshBuffer, buffers_[slot], 0, 0,
+                             GLsizeiptr(4 * sizeof(uint32_t)) + GLsizeiptr(capacity_) * 2 * sizeof(glm::vec4));
+    counts_[slot] = capacity_;
+    hasLiveCount_[slot] = false;
+    times_[slot] = simulationTime;
+    submit();
+    return true;
+}
+
+void SPHCacheExporter::poll() {
+    if (!open_) return;
+
+    // Oldest first, so frames reach the writer in capture order
+    bool queued = false;
+    for (int i = 0; i < CACHE_SLOTS; i++) {
+        int slot = (nextSlot_ + i) % CACHE_SLOTS;
+        if (!fences_[slot]) continue;
+
+        GLenum status = glClientWaitSync(fences_[slot], 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) break;
+
+        glDeleteSync(fences_[slot]);
+        fences_[slot] = 0;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        states_[slot] = SlotState::WRITING;
+        queue_.push_back(slot);
+        queued = true;
+    }
+    if (queued) wake_.notify_one();
+}
+
+void SPHCacheExporter::writerLoop() {
+    while (true) {
+        int slot;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+            if (queue_.empty()) break;
+            slot = queue_.front();
+            queue_.pop_front();
+        }
+
+        if (writeFrame(slot)) {
+            writtenFrames_++;
+        } else {
+            failedFrames_++;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        states_[slot] = SlotState::FREE;
+    }
+}
+
+bool SPHCacheExporter::writeFrame(int slot) const {
+    const bool particles = content_ == SPHCacheContent::PARTICLES;
+    char path[1024];
+    std::snprintf(path, sizeof(path), "%s_%s_%06u.ply", basePath_.c_str(), particles ? "particles" : "surface",
+                  frameIndices_[slot]);
+    std::FILE* file = std::fopen(path, "wb");
+    if (!file) {
+        std::cerr << "ERROR: Failed to open SPH cache file " << path << std::endl;
+        return false;
+    }
+
+    const uint8_t* data = pointers_[slot];
+    char body[512];
+    if (particles) {
+        uint32_t count = counts_[slot];
+        if (hasLiveCount_[slot]) {
+            uint32_t live = 0;
+            std::memcpy(&live, data + size_t(capacity_) * sizeof(SPHParticleCompute), sizeof(live));
+            count = std::min(count, live);
+        }
+
+        std::snprintf(body, sizeof(body), "element vertex %u\nproperty float x\nproperty float y\nproperty float z\n"
+                      "property float density\nproperty float vx\nproperty float vy\nproperty float vz\n"
+                      "property float pressure\n", count);
+        writeHeader(file, times_[slot], body);
+        std::fwrite(data, sizeof(SPHParticleCompute), count, file);
+    } else {
+        uint32_t vertices = 0;
+        std::memcpy(&vertices, data, sizeof(vertices));
+        vertices = std::min(vertices, counts_[slot]) / 3 * 3;
+        const glm::vec4* pairs = reinterpret_cast<const glm::vec4*>(data + 4 * sizeof(uint32_t));
+
+        std::snprintf(body, sizeof(body), "element vertex %u\nproperty float x\nproperty float y\nproperty float z\n"
+                      "property float nx\nproperty float ny\nproperty float nz\n"
+                      "element face %u\nproperty list uchar int vertex_indices\n", vertices, vertices / 3);
+        writeHeader(file, times_[slot], body);
+
+        // Chunked, so the staging memory stays fixed however large the mesh
+        std::vector<float> packed;
+        packed.reserve(WRITE_CHUNK * 6);
+        for (uint32_t first = 0; first < vertices; first += WRITE_CHUNK) {
+            uint32_t last = std::min(first + WRITE_CHUNK, vertices);
+            packed.clear();
+            for (uint32_t v = first; v < last; v++) {
+                const glm::vec4& position = pairs[v * 2];
+                const glm::vec4& normal = pairs[v * 2 + 1];
+                packed.insert(packed.end(), { position.x, position.y, position.z, normal.x, normal.y, normal.z });
+            }
+            std::fwrite(packed.data(), sizeof(float), packed.size(), file);
+        }
+
+        std::vector<uint8_t> faces;
+        faces.reserve(WRITE_CHUNK / 3 * 13);
+        for (uint32_t first = 0; first < vertices; first += WRITE_CHUNK / 3 * 3) {
+            uint32_t last = std::min(first + WRITE_CHUNK / 3 * 3, vertices);
+            faces.clear();
+            for (uint32_t v = first; v < last; v += 3) {
+                int32_t indices[3] = { int32_t(v), int32_t(v + 1), int32_t(v + 2) };
+                faces.push_back(3);
+                const uint8_t* bytes = reinterpret_cast<const uint8_t*>(indices);
+                faces.insert(faces.end(), bytes, bytes + sizeof(indices));
+            }
+            std::fwrite(faces.data(), 1, faces.size(), file);
+        }
+    }
+
+    bool ok = std::ferror(file) == 0;
+    std::fclose(file);
+    return ok;
+}
+
+} // namespace WaterSim
@@ -1,19 +1,147 @@
 #include "SPHComputeSystem.h"
 #include "InitShader.h"
+#include "ShaderCompiler.h"
+#include "MappedFile.h"
+#include "SPHFrameExporter.h"
+#include "SPHCacheExporter.h"
+#include "ComputeAutotuner.h"
+#include "Profiler.h"
+#include "TraceRecorder.h"
+#include "Logger.h"
+#include "GPUMemoryTracker.h"
+#include "RenderTargetPool.h"
+#include "ShadingRateImage.h"
 #include <iostream>
 #include <algorithm>
 #include <random>
+#include <cstring>
+#include <sstream>
+#include <iomanip>
+#include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtx/string_cast.hpp>
 #include <glm/gtc/type_ptr.hpp> // For glm::value_ptr
 
 namespace WaterSim {
 
+namespace {
+    // Marching cubes cases for the corner and edge numbering of sph_marching_cubes.cs. Each
+    // cube face is walked counter-clockwise as seen from outside the cell, and a segment runs
+    // from every edge where the walk enters the fluid to the edge where it next leaves it, so
+    // the segments cut off the inside corners. The cell across a face walks it the other way
+    // round and pairs the same edges, which keeps ambiguous faces crack free. The segments
+    // chain into loops, and each loop is fanned into triangles that face out of the fluid
+    std::vector<uint32_t> buildMarchingCubesTable(uint32_t& stride) {
+        auto edgeBetween = [](int a, int b) {
+            int axis = (a ^ b) == 1 ? 0 : (a ^ b) == 2 ? 1 : 2;
+            int low = std::min(a, b);
+            return axis * 4 + ((low >> ((axis + 1) % 3)) & 1) + 2 * ((low >> ((axis + 2) % 3)) & 1);
+        };
+        auto edgeMidpoint = [](int edge) {
+            int axis = edge / 4;
+            glm::vec3 point(0.0f);
+            point[(axis + 1) % 3] = float(edge & 1);
+            point[(axis + 2) % 3] = float((edge >> 1) & 1);
+            point[axis] = 0.5f;
+            return point;
+        };
+    
+        // Face corners counter-clockwise around the outward normal: (u, v) = (axis + 1, axis + 2)
+        // is right-handed around +axis, so the face at side 0 takes the ring backwards
+        int faces[6][4];
+        const int ring[4][2] = { { 0, 0 }, { 1, 0 }, { 1, 1 }, { 0, 1 } };
+        for (int axis = 0; axis < 3; axis++) {
+            for (int side = 0; side < 2; side++) {
+                for (int k = 0; k < 4; k++) {
+                    int r = side ? k : 3 - k;
+                    faces[axis * 2 + side][k] = (side << axis) | (ring[r][0] << ((axis + 1) % 3)) | (ring[r][1] << ((axis + 2) % 3));
+                }
+            }
+        }
+    
+        auto shareFace = [&faces, &edgeBetween](int a, int b) {
+            for (const auto& face : faces) {
+                bool hasA = false, hasB = false;
+                for (int k = 0; k < 4; k++) {
+                    int edge = edgeBetween(face[k], face[(k + 1) % 4]);
+                    hasA |= edge == a;
+                    hasB |= edge == b;
+                }
+                if (hasA && hasB) return true;
+            }
+            return false;
+        };
+    
+        std::vector<std::vector<int>> cases(256);
+        size_t maxTriangles = 0;
+        for (int cube = 0; cube < 256; cube++) {
+            auto inside = [cube](int corner) { return ((cube >> corner) & 1) != 0; };
+            int next[12];
+            std::fill(std::begin(next), std::end(next), -1);
+            for (const auto& face : faces) {
+                for (int k = 0; k < 4; k++) {
+                    if (inside(face[k]) || !inside(face[(k + 1) % 4])) continue;
+                    int exit = k + 1;
+                    while (!inside(face[exit % 4]) || inside(face[(exit + 1) % 4])) exit++;
+                    next[edgeBetween(face[k], face[(k + 1) % 4])] = edgeBetween(face[exit % 4], face[(exit + 1) % 4]);
+                }
+            }
+        
+            bool visited[12] = {};
+            for (int start = 0; start < 12; start++) {
+                if (next[start] < 0 || visited[start]) continue;
+                std::vector<int> loop;
+                for (int edge = start; !visited[edge]; edge = next[edge]) {
+                    visited[edge] = true;
+                    loop.push_back(edge);
+                }
+                // Fan from a vertex whose diagonals stay off the cube faces: a diagonal between two
+                // edges of one face would put a triangle in the face the neighbouring cell covers
+                size_t best = 0;
+                for (size_t apex = 0; apex < loop.size(); apex++) {
+                    bool onFace = false;
+                    for (size_t i = 2; i + 1 < loop.size(); i++) {
+                        onFace |= shareFace(loop[apex], loop[(apex + i) % loop.size()]);
+                    }
+                    if (!onFace) {
+                        best = apex;
+                        break;
+                    }
+                }
+                for (size_t i = 1; i + 1 < loop.size(); i++) {
+                    cases[cube].insert(cases[cube].end(), { loop[best], loop[(best + i) % loop.size()], loop[(best + i + 1) % loop.size()] });
+                }
+            }
+            maxTriangles = std::max(maxTriangles, cases[cube].size() / 3);
+        }
+    
+        // The loop direction is the same for every case; orient by the single inside corner 0,
+        // whose triangle must face away from it
+        const std::vector<int>& single = cases[1];
+        glm::vec3 normal = glm::cross(edgeMidpoint(single[1]) - edgeMidpoint(single[0]), edgeMidpoint(single[2]) - edgeMidpoint(single[0]));
+        bool flip = glm::dot(normal, glm::vec3(1.0f)) < 0.0f;
+    
+        stride = uint32_t(1 + 3 * maxTriangles);
+        std::vector<uint32_t> table(256 * stride, 0);
+        for (int cube = 0; cube < 256; cube++) {
+            const std::vector<int>& edges = cases[cube];
+            uint32_t* entry = &table[cube * stride];
+            entry[0] = uint32_t(edges.size() / 3);
+            for (size_t i = 0; i < edges.size(); i += 3) {
+                entry[1 + i] = edges[i];
+                entry[2 + i] = edges[flip ? i + 2 : i + 1];
+                entry[3 + i] = edges[flip ? i + 1 : i + 2];
+            }
+        }
+        return table;
+    }
+}
+
 SPHComputeSystem::SPHComputeSystem()
     : numParticles_(0)
     , maxParticles_(0)
     , currentBuffer_(0)
     , colorMode_(COLOR_NORMAL)
-    , useFilteredViscosity_(true)
+    , useFilteredViscosity_(false)
     , curvatureFlowIterations_(50)
     , gravity_(0.0f, -9.81f, 0.0f)
     , spherePosition_(0.0f)
@@ -25,18 +153,14 @@ SPHComputeSystem::SPHComputeSystem()
     , finalSmoothedBuffer_(0)
     , particleVAO_(0)
     , billboardVAO_(0)
-    , gridTexture_(0)
-    , billboardIndexBuffer_(0)
     , simStep1Program_(0)
     , simStep2Program_(0)
     , simStep3Program_(0)
     , simStep4Program_(0)
     , simStep5Program_(0)
     , simStep6Program_(0)
-    , renderProgram_(0)
     , depthProgram_(0)
     , smoothProgram_(0)
-    , finalProgram_(0)
     , depthFBO_(0)
     , depthTexture_(0)
     , containerVAO_(0)
@@ -52,55 +176,199 @@ SPHComputeSystem::SPHComputeSystem()
 }
 
 SPHComputeSystem::~SPHComputeSystem() {
+    // Finish the export first; it reads from GL buffers and joins its writer thread
+    stopExport();
+    stopCache();
+    setRenderSnapshots(false);
+    
+    // Hot reload would otherwise write into the programs below
+    ShaderCompiler::instance().cancel(this);
+    
     // Clean up OpenGL resources
-    if (particleBuffers_[0]) glDeleteBuffers(2, particleBuffers_);
+    if (particleBuffers_[0]) deleteBuffers(2, particleBuffers_);
     if (particleVAO_) glDeleteVertexArrays(1, &particleVAO_);
     if (billboardVAO_) glDeleteVertexArrays(1, &billboardVAO_);
-    if (gridTexture_) glDeleteTextures(1, &gridTexture_);
-    if (billboardIndexBuffer_) glDeleteBuffers(1, &billboardIndexBuffer_);
-    if (counterBuffer_) glDeleteBuffers(1, &counterBuffer_);
-    if (velocityTexture_) glDeleteTextures(1, &velocityTexture_);
+    if (cellCountBuffer_) deleteBuffers(1, &cellCountBuffer_);
+    if (previousCellCountBuffer_) deleteBuffers(1, &previousCellCountBuffer_);
+    if (cellStartBuffer_) deleteBuffers(1, &cellStartBuffer_);
+    if (cellCursorBuffer_) deleteBuffers(1, &cellCursorBuffer_);
+    if (scanBlockSumBuffer_) deleteBuffers(1, &scanBlockSumBuffer_);
+    if (blockSlotBuffer_) deleteBuffers(1, &blockSlotBuffer_);
+    if (blockStateBuffer_) deleteBuffers(1, &blockStateBuffer_);
+    if (soaPositionBuffer_) deleteBuffers(1, &soaPositionBuffer_);
+    if (soaVelocityBuffer_) deleteBuffers(1, &soaVelocityBuffer_);
+    if (soaDensityPressureBuffer_) deleteBuffers(1, &soaDensityPressureBuffer_);
+    for (uint32_t i = 0; i < SPHConstants::READBACK_FRAMES; i++) {
+        if (readbackFences_[i]) glDeleteSync(readbackFences_[i]);
+        if (readbackBuffers_[i]) deleteBuffers(1, &readbackBuffers_[i]); // Deleting unmaps
+        if (sphereReadbackFences_[i]) glDeleteSync(sphereReadbackFences_[i]);
+        if (sphereReadbackBuffers_[i]) deleteBuffers(1, &sphereReadbackBuffers_[i]);
+#ifdef SPH_GPU_COUNTERS
+        if (counterReadbackFences_[i]) glDeleteSync(counterReadbackFences_[i]);
+        if (counterReadbackBuffers_[i]) deleteBuffers(1, &counterReadbackBuffers_[i]);
+#endif
+    }
+#ifdef SPH_GPU_COUNTERS
+    if (counterBuffer_) deleteBuffers(1, &counterBuffer_);
+#endif
+    if (sphereImpulseBuffer_) deleteBuffers(1, &sphereImpulseBuffer_);
+    if (statisticsBuffer_) deleteBuffers(1, &statisticsBuffer_);
+    if (statisticsPartialBuffer_) deleteBuffers(1, &statisticsPartialBuffer_);
+    for (uint32_t i = 0; i < SPHConstants::STAGING_SLOTS; i++) {
+        if (stagingFences_[i]) glDeleteSync(stagingFences_[i]);
+    }
+    if (stagingBuffer_) deleteBuffers(1, &stagingBuffer_);
+    if (particleCountBuffer_) deleteBuffers(1, &particleCountBuffer_);
+    if (bulkColumnBuffer_) deleteBuffers(1, &bulkColumnBuffer_);
+    if (pcisphParticleBuffer_) deleteBuffers(1, &pcisphParticleBuffer_);
+    if (pcisphStateBuffer_) deleteBuffers(1, &pcisphStateBuffer_);
+    if (viscositySolverBuffer_) deleteBuffers(1, &viscositySolverBuffer_);
+    if (viscosityPartialBuffer_) deleteBuffers(1, &viscosityPartialBuffer_);
+    if (viscosityStateBuffer_) deleteBuffers(1, &viscosityStateBuffer_);
+    deleteBuffers(2, viscosityWarmStartBuffers_);
+    if (kernelTableBuffer_) deleteBuffers(1, &kernelTableBuffer_);
+    if (rebuildFlagBuffer_) deleteBuffers(1, &rebuildFlagBuffer_);
+    if (sortedIndexBuffer_) deleteBuffers(1, &sortedIndexBuffer_);
+    if (neighborCountBuffer_) deleteBuffers(1, &neighborCountBuffer_);
+    if (neighborListBuffer_) deleteBuffers(1, &neighborListBuffer_);
+    if (referencePositionBuffer_) deleteBuffers(1, &referencePositionBuffer_);
+    if (dueParticleBuffer_) deleteBuffers(1, &dueParticleBuffer_);
+    if (dueDispatchBuffer_) deleteBuffers(1, &dueDispatchBuffer_);
+    if (sortKeyBuffers_[0]) deleteBuffers(2, sortKeyBuffers_);
+    if (sortValueBuffers_[0]) deleteBuffers(2, sortValueBuffers_);
+    if (radixHistogramBuffer_) deleteBuffers(1, &radixHistogramBuffer_);
+    if (radixOffsetBuffer_) deleteBuffers(1, &radixOffsetBuffer_);
+    if (simulationTimerQuery_) glDeleteQueries(1, &simulationTimerQuery_);
+    if (!passTimerQueries_.empty()) glDeleteQueries(static_cast<GLsizei>(passTimerQueries_.size()), passTimerQueries_.data());
+    if (velocityTexture_) deleteTextures(1, &velocityTexture_);
+    if (obstacleFieldTexture_) deleteTextures(1, &obstacleFieldTexture_);
+    if (activeCellBuffer_) deleteBuffers(1, &activeCellBuffer_);
+    if (sparseDispatchBuffer_) deleteBuffers(1, &sparseDispatchBuffer_);
+    if (diffusePotentialBuffer_) deleteBuffers(1, &diffusePotentialBuffer_);
+    if (surfaceNormalBuffer_) deleteBuffers(1, &surfaceNormalBuffer_);
+    if (diffuseParticleBuffer_) deleteBuffers(1, &diffuseParticleBuffer_);
+    if (diffuseStateBuffer_) deleteBuffers(1, &diffuseStateBuffer_);
+    if (diffuseCellBuffer_) deleteBuffers(1, &diffuseCellBuffer_);
+    if (cellActivityBuffer_) deleteBuffers(1, &cellActivityBuffer_);
+    if (awakeCellBuffer_) deleteBuffers(1, &awakeCellBuffer_);
+    if (awakeDispatchBuffer_) deleteBuffers(1, &awakeDispatchBuffer_);
+    if (sceneParameterBuffer_) deleteBuffers(1, &sceneParameterBuffer_);
+    if (parameterBuffer_) deleteBuffers(1, &parameterBuffer_);
+    if (phaseBuffer_) deleteBuffers(1, &phaseBuffer_);
     
     if (simStep1Program_) glDeleteProgram(simStep1Program_);
     if (simStep2Program_) glDeleteProgram(simStep2Program_);
     if (simStep3Program_) glDeleteProgram(simStep3Program_);
-    if (simStep4Program_) glDeleteProgram(simStep4Program_);
-    if (simStep5Program_) glDeleteProgram(simStep5Program_);
-    if (simStep6Program_) glDeleteProgram(simStep6Program_);
-    if (renderProgram_) glDeleteProgram(renderProgram_);
+    for (const auto& variant : shaderVariants_) {
+        glDeleteProgram(variant.second); // Includes steps 4-6 and PCISPH
+    }
+    if (mortonProgram_) glDeleteProgram(mortonProgram_);
+    if (radixSortProgram_) glDeleteProgram(radixSortProgram_);
+    if (neighborListProgram_) glDeleteProgram(neighborListProgram_);
+    if (reduceProgram_) glDeleteProgram(reduceProgram_);
+    if (emitProgram_) glDeleteProgram(emitProgram_);
+    if (particleCountProgram_) glDeleteProgram(particleCountProgram_);
+    if (obstacleProgram_) glDeleteProgram(obstacleProgram_);
+    if (sleepProgram_) glDeleteProgram(sleepProgram_);
+    if (gridBlockProgram_) glDeleteProgram(gridBlockProgram_);
+    if (adaptiveProgram_) glDeleteProgram(adaptiveProgram_);
+    if (narrowBandProgram_) glDeleteProgram(narrowBandProgram_);
+    if (timeLevelProgram_) glDeleteProgram(timeLevelProgram_);
+    if (gatherProgram_) glDeleteProgram(gatherProgram_);
+    if (rewindPackProgram_) glDeleteProgram(rewindPackProgram_);
+    if (rewindUnpackProgram_) glDeleteProgram(rewindUnpackProgram_);
+    for (GLuint program : renderStreamPrograms_) {
+        if (program) glDeleteProgram(program);
+    }
+    if (interpolateProgram_) glDeleteProgram(interpolateProgram_);
+    if (diffuseProgram_) glDeleteProgram(diffuseProgram_);
+    if (diffuseRenderProgram_) glDeleteProgram(diffuseRenderProgram_);
+    if (cullProgram_) glDeleteProgram(cullProgram_);
+    if (hiZProgram_) glDeleteProgram(hiZProgram_);
+    for (GLuint program : renderPrograms_) {
+        if (program) glDeleteProgram(program);
+    }
     if (depthProgram_) glDeleteProgram(depthProgram_);
+    if (depthSplatProgram_) glDeleteProgram(depthSplatProgram_);
+    if (thicknessProgram_) glDeleteProgram(thicknessProgram_);
     if (smoothProgram_) glDeleteProgram(smoothProgram_);
-    if (finalProgram_) glDeleteProgram(finalProgram_);
+    if (smoothComputeProgram_) glDeleteProgram(smoothComputeProgram_);
+    if (bilateralProgram_) glDeleteProgram(bilateralProgram_);
+    for (GLuint program : finalPrograms_) {
+        if (program) glDeleteProgram(program);
+    }
+    if (surfaceSplatProgram_) glDeleteProgram(surfaceSplatProgram_);
+    if (marchingCubesProgram_) glDeleteProgram(marchingCubesProgram_);
+    if (surfaceProgram_) glDeleteProgram(surfaceProgram_);
     
-    if (depthFBO_) glDeleteFramebuffers(1, &depthFBO_);
-    if (depthTexture_) glDeleteTextures(1, &depthTexture_);
-    if (smoothFBO_[0]) glDeleteFramebuffers(2, smoothFBO_);
-    if (smoothTexture_[0]) glDeleteTextures(2, smoothTexture_);
+    releaseFramebuffers();
+    if (visibleParticleBuffer_) deleteBuffers(1, &visibleParticleBuffer_);
+    if (surfaceFieldTexture_) deleteTextures(1, &surfaceFieldTexture_);
+    if (surfaceTableBuffer_) deleteBuffers(1, &surfaceTableBuffer_);
+    if (surfaceTriangleCountBuffer_) deleteBuffers(1, &surfaceTriangleCountBuffer_);
+    if (surfaceTriangleOffsetBuffer_) deleteBuffers(1, &surfaceTriangleOffsetBuffer_);
+    if (surfaceScanBlockSumBuffer_) deleteBuffers(1, &surfaceScanBlockSumBuffer_);
+    if (surfaceMeshBuffer_) deleteBuffers(1, &surfaceMeshBuffer_);
     
     if (containerVAO_) glDeleteVertexArrays(1, &containerVAO_);
-    if (containerVBO_) glDeleteBuffers(1, &containerVBO_);
-    if (containerEBO_) glDeleteBuffers(1, &containerEBO_);
+    if (containerVBO_) deleteBuffers(1, &containerVBO_);
+    if (containerEBO_) deleteBuffers(1, &containerEBO_);
     if (containerShader_) glDeleteProgram(containerShader_);
 }
 
-bool SPHComputeSystem::initialize(uint32_t numParticles, const glm::vec3& boxMin, const glm::vec3& boxMax) {
+bool SPHComputeSystem::initialize(uint32_t numParticles, const glm::vec3& boxMin, const glm::vec3& boxMax,
+                                  SPHParticleLayout layout) {
+    GPUMemoryScope memoryScope("SPH");
+    particleLayout_ = layout;
+    
     // Ensure particle count is aligned for compute shaders
     uint32_t minParticles = std::max(numParticles, 50000u); // Start with 50k for testing
     maxParticles_ = ((minParticles + 511) / 512) * 512; 
+    
+    // Large scenes are bounded by the biggest single storage block and dispatch size
+    uint32_t deviceLimit = maxParticlesForDevice();
+    if (maxParticles_ > deviceLimit) {
+        std::cerr << "WARNING: SPH capacity " << maxParticles_ << " exceeds device limits, clamped to "
+                  << deviceLimit << " particles" << std::endl;
+        maxParticles_ = deviceLimit;
+    }
     boxMin_ = boxMin;
     boxMax_ = boxMax;
     
-    // Calculate grid like  but using our box bounds
+    // Calculate grid like  but using our box bounds; batched scenes repeat the box along x
     gridSize_ = boxMax - boxMin;
-    gridCellSize_ = SPHConstants::CELL_SIZE;
+    sceneStride_ = gridSize_.x;
+    gridSize_.x *= getSceneCount();
+    gridCellSize_ = cellSize_;
+    if (adaptiveResolution_) {
+        // The 27-cell walk has to cover a coarse pair's kernel
+        gridCellSize_ = std::max(gridCellSize_, shaderParameters_.kernelRadius * SPHConstants::ADAPTIVE_RADIUS_SCALE);
+    }
     gridRes_ = glm::ivec3((gridSize_ / gridCellSize_) + 1.0f);
     gridOrigin_ = boxMin;
     gridDim_ = glm::uvec3(gridRes_);
+    if (useHierarchicalGrid_ && useSparseDomain_) {
+        std::cerr << "WARNING: SPH sparse domain indexes the dense grid, disabled by the hierarchical grid" << std::endl;
+        useSparseDomain_ = false;
+    }
     
     // Initialize OpenGL resources
     initializeGrid();
     createBuffers();
+    if (!sceneParameters_.empty()) {
+        glCreateBuffers(1, &sceneParameterBuffer_);
+        bufferStorage(sceneParameterBuffer_, sceneParameters_.size() * sizeof(glm::vec4), nullptr, GL_DYNAMIC_STORAGE_BIT);
+        sceneParametersDirty_ = true;
+        std::cout << "SPH batched mode: " << sceneParameters_.size() << " scenes, " << sceneStride_ << " apart" << std::endl;
+    }
+    glCreateBuffers(1, &parameterBuffer_);
+    bufferStorage(parameterBuffer_, sizeof(SPHParameterBlock), &parameterBlock_, GL_DYNAMIC_STORAGE_BIT);
+    glCreateBuffers(1, &phaseBuffer_);
+    bufferStorage(phaseBuffer_, SPHConstants::MAX_PHASES * sizeof(glm::vec4), nullptr, GL_DYNAMIC_STORAGE_BIT);
+    phasesDirty_ = true;
     loadShaders();
+    computePCISPHDelta();
+    updateKernelTable();
     createContainerGeometry();
     
     // Initialize with some particles
@@ -112,31 +380,54 @@ bool SPHComputeSystem::initialize(uint32_t numParticles, const glm::vec3& boxMin
     return true;
 }
 
+uint32_t SPHComputeSystem::maxParticlesForDevice() const {
+    GLint64 maxBlockSize = 0;
+    glGetInteger64v(GL_MAX_SHADER_STORAGE_BLOCK_SIZE, &maxBlockSize);
+    GLint maxGroups = 0;
+    glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_COUNT, 0, &maxGroups);
+    
+    // Per-particle bytes of the largest buffer bound as one block: the interleaved
+    // neighbor lists, or the PCISPH predictions for small neighbor limits
+    uint64_t largestStride = std::max<uint64_t>(uint64_t(neighborLimit_) * sizeof(uint32_t), 3 * sizeof(glm::vec4));
+    uint64_t limit = maxBlockSize > 0 ? uint64_t(maxBlockSize) / largestStride : UINT32_MAX;
+    if (maxGroups > 0) {
+        limit = std::min<uint64_t>(limit, uint64_t(maxGroups) * 32); // Particle passes use 32-wide groups
+    }
+    limit = std::min<uint64_t>(limit, UINT32_MAX);
+    
+    return static_cast<uint32_t>(limit / 512) * 512;
+}
+
 void SPHComputeSystem::createFramebuffers() {
-    // Create depth framebuffer with color attachment for now (depth-only rendering can be tricky)
-    glGenFramebuffers(1, &depthFBO_);
-    glGenTextures(1, &depthTexture_);
+    GPUMemoryScope memoryScope("SPH screen-space");
+    // The screen-space fluid targets run at the render scale; renderFinalShading upsamples
+    fluidWidth_ = std::max(static_cast<int>(windowWidth_ * fluidRenderScale_ + 0.5f), 1);
+    fluidHeight_ = std::max(static_cast<int>(windowHeight_ * fluidRenderScale_ + 0.5f), 1);
+    
+    // The targets come from the render target pool, linear and clamped, so a resize or a
+    // render scale change back to an earlier size reuses textures
+    RenderTargetPool& pool = RenderTargetPool::instance();
     
+    // Depth framebuffer; its color is the nearest particle's motion for the temporal upscale
+    glGenFramebuffers(1, &depthFBO_);
     glBindFramebuffer(GL_FRAMEBUFFER, depthFBO_);
     
-    // Create color texture for debugging
-    GLuint colorTexture;
-    glGenTextures(1, &colorTexture);
-    glBindTexture(GL_TEXTURE_2D, colorTexture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, windowWidth_, windowHeight_, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexture, 0);
+    motionTexture_ = pool.acquire2D(GL_RG16F, fluidWidth_, fluidHeight_);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, motionTexture_, 0);
     
     // Depth texture
-    glBindTexture(GL_TEXTURE_2D, depthTexture_);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, windowWidth_, windowHeight_, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    depthTexture_ = pool.acquire2D(GL_DEPTH_COMPONENT32F, fluidWidth_, fluidHeight_);
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture_, 0);
     
+    // Compute splat target, and a float view of it for the passes that sample the depth
+    splatDepthTexture_ = pool.acquire2D(GL_R32UI, fluidWidth_, fluidHeight_);
+    glGenTextures(1, &splatDepthView_);
+    glTextureView(splatDepthView_, GL_TEXTURE_2D, splatDepthTexture_, GL_R32F, 0, 1, 0, 1);
+    glTextureParameteri(splatDepthView_, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTextureParameteri(splatDepthView_, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTextureParameteri(splatDepthView_, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTextureParameteri(splatDepthView_, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    
     if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
         std::cerr << "ERROR: Depth framebuffer is not complete!" << std::endl;
         GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
@@ -145,17 +436,11 @@ void SPHComputeSystem::createFramebuffers() {
     
     // Create smoothing framebuffers (ping-pong)
     glGenFramebuffers(2, smoothFBO_);
-    glGenTextures(2, smoothTexture_);
     
     for (int i = 0; i < 2; ++i) {
         glBindFramebuffer(GL_FRAMEBUFFER, smoothFBO_[i]);
         
-        glBindTexture(GL_TEXTURE_2D, smoothTexture_[i]);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, windowWidth_, windowHeight_, 0, GL_RED, GL_FLOAT, nullptr);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        smoothTexture_[i] = pool.acquire2D(GL_R32F, fluidWidth_, fluidHeight_);
         glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, smoothTexture_[i], 0);
         
         if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
@@ -163,165 +448,605 @@ void SPHComputeSystem::createFramebuffers() {
         }
     }
     
+    // Half-resolution thickness of the interior particles (surface splatting)
+    glGenFramebuffers(1, &thicknessFBO_);
+    glBindFramebuffer(GL_FRAMEBUFFER, thicknessFBO_);
+    thicknessTexture_ = pool.acquire2D(GL_R16F, std::max(fluidWidth_ / 2, 1), std::max(fluidHeight_ / 2, 1));
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, thicknessTexture_, 0);
+    
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "ERROR: Thickness framebuffer is not complete!" << std::endl;
+    }
+    
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
 void SPHComputeSystem::initializeGrid() {
-    // Create 3D texture for spatial grid (stores head of linked list)
-    glGenTextures(1, &gridTexture_);
-    glBindTexture(GL_TEXTURE_3D, gridTexture_);
-    // GL_R32UI will store uint32_t, which will be the index of the first particle in that cell
-    // or SPHConstants::INVALID_INDEX if the cell is empty.
-    glTexImage3D(GL_TEXTURE_3D, 0, GL_R32UI, gridDim_.x, gridDim_.y, gridDim_.z, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
-    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-    std::cout << "Grid Texture initialized (ID: " << gridTexture_ << ") with dimensions: " 
+    GPUMemoryScope memoryScope("SPH");
+    // Cell layout is split into separate count/start buffers so a cell can hold any
+    // number of particles (the start offsets come from a GPU prefix scan in step 2)
+    cellCount_ = gridDim_.x * gridDim_.y * gridDim_.z;
+    if (useMortonCells_ && !useHierarchicalGrid_) {
+        // Whole bricks, the padding cells never counted
+        glm::uvec3 brickDim = (gridDim_ + SPHConstants::GRID_BLOCK_SIZE - 1u) / SPHConstants::GRID_BLOCK_SIZE;
+        cellCount_ = brickDim.x * brickDim.y * brickDim.z * SPHConstants::GRID_BLOCK_CELLS;
+    }
+    if (useHierarchicalGrid_) {
+        // Every occupied block holds a particle, so a slot per block or per particle, whichever
+        // is fewer, always suffices; a large, sparse container is bounded by the particles
+        gridBlockDim_ = (gridDim_ + SPHConstants::GRID_BLOCK_SIZE - 1u) / SPHConstants::GRID_BLOCK_SIZE;
+        gridBlockCount_ = gridBlockDim_.x * gridBlockDim_.y * gridBlockDim_.z;
+        gridBlockCapacity_ = std::min(gridBlockCount_, maxParticles_);
+        cellCount_ = gridBlockCapacity_ * SPHConstants::GRID_BLOCK_CELLS;
+        
+        glCreateBuffers(1, &blockSlotBuffer_);
+        bufferStorage(blockSlotBuffer_, gridBlockCount_ * sizeof(uint32_t), nullptr, GL_DYNAMIC_STORAGE_BIT);
+        glCreateBuffers(1, &blockStateBuffer_);
+        bufferStorage(blockStateBuffer_, sizeof(uint32_t), nullptr, GL_DYNAMIC_STORAGE_BIT);
+        
+        std::cout << "Hierarchical grid: " << gridBlockCount_ << " blocks of " << SPHConstants::GRID_BLOCK_CELLS
+                  << " cells, pool of " << gridBlockCapacity_ << " blocks" << std::endl;
+    }
+    scanBlockCount_ = (cellCount_ + SPHConstants::SCAN_BLOCK_SIZE - 1) / SPHConstants::SCAN_BLOCK_SIZE;
+    
+    size_t cellBufferSize = cellCount_ * sizeof(uint32_t);
+    glCreateBuffers(1, &cellCountBuffer_);
+    bufferStorage(cellCountBuffer_, cellBufferSize, nullptr, GL_DYNAMIC_STORAGE_BIT);
+    glCreateBuffers(1, &previousCellCountBuffer_);
+    bufferStorage(previousCellCountBuffer_, cellBufferSize, nullptr, GL_DYNAMIC_STORAGE_BIT);
+    glCreateBuffers(1, &cellStartBuffer_);
+    bufferStorage(cellStartBuffer_, cellBufferSize, nullptr, 0);
+    glCreateBuffers(1, &cellCursorBuffer_);
+    bufferStorage(cellCursorBuffer_, cellBufferSize, nullptr, 0);
+    
+    std::cout << "Grid buffers initialized (" << cellCount_ << " cells, " << scanBlockCount_
+              << " scan blocks) with dimensions: " 
               << gridDim_.x << "x" << gridDim_.y << "x" << gridDim_.z << std::endl;
 }
 
 void SPHComputeSystem::createBuffers() {
-    // Create particle buffers using modern OpenGL
-    glCreateBuffers(2, particleBuffers_);
+    GPUMemoryScope memoryScope("SPH");
+    // Per-particle storage starts small and doubles on demand, up to maxParticles_
+    createParticleStorage(std::min(maxParticles_, SPHConstants::INITIAL_PARTICLE_CAPACITY));
     
-    size_t bufferSize = maxParticles_ * sizeof(SPHParticleCompute);
-    for (int i = 0; i < 2; i++) {
-        glNamedBufferStorage(particleBuffers_[i], bufferSize, nullptr, GL_DYNAMIC_STORAGE_BIT | GL_MAP_READ_BIT | GL_MAP_WRITE_BIT);
+    // Morton keys interleave 3 axes of ceil(log2(res)) bits each, plus one bit above them
+    // for removed particles, sorted 8 bits per pass
+    uint32_t maxRes = std::max(gridDim_.x, std::max(gridDim_.y, gridDim_.z));
+    uint32_t axisBits = 0;
+    while ((1u << axisBits) < maxRes) axisBits++;
+    mortonRemovedKey_ = 1u << (axisBits * 3);
+    radixPassCount_ = (axisBits * 3 + 1 + 7) / 8;
+    
+    glCreateBuffers(1, &rebuildFlagBuffer_);
+    bufferStorage(rebuildFlagBuffer_, sizeof(uint32_t), nullptr, GL_DYNAMIC_STORAGE_BIT);
+    glCreateBuffers(1, &dueDispatchBuffer_);
+    bufferStorage(dueDispatchBuffer_, 4 * sizeof(uint32_t), nullptr, GL_DYNAMIC_STORAGE_BIT);
+    
+    // GPU statistics, copied each frame into a persistently mapped readback slot behind a fence
+    glCreateBuffers(1, &statisticsBuffer_);
+    bufferStorage(statisticsBuffer_, sizeof(SPHStatistics), nullptr, 0);
+    GLbitfield readbackFlags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    for (uint32_t i = 0; i < SPHConstants::READBACK_FRAMES; i++) {
+        glCreateBuffers(1, &readbackBuffers_[i]);
+        bufferStorage(readbackBuffers_[i], sizeof(SPHStatistics), nullptr, readbackFlags);
+        readbackPointers_[i] = glMapNamedBufferRange(readbackBuffers_[i], 0, sizeof(SPHStatistics), readbackFlags);
     }
-
-    // Create counter buffer for grid operations
+    
+    // Coupled sphere momentum sum, read back through its own ring of the same depth
+    glCreateBuffers(1, &sphereImpulseBuffer_);
+    bufferStorage(sphereImpulseBuffer_, 4 * sizeof(int32_t), nullptr, GL_DYNAMIC_STORAGE_BIT);
+    for (uint32_t i = 0; i < SPHConstants::READBACK_FRAMES; i++) {
+        glCreateBuffers(1, &sphereReadbackBuffers_[i]);
+        bufferStorage(sphereReadbackBuffers_[i], 4 * sizeof(int32_t), nullptr, readbackFlags);
+        sphereReadbackPointers_[i] = glMapNamedBufferRange(sphereReadbackBuffers_[i], 0, 4 * sizeof(int32_t), readbackFlags);
+    }
+    
+#ifdef SPH_GPU_COUNTERS
+    // Instrumentation counters, through a third ring of the same depth
     glCreateBuffers(1, &counterBuffer_);
-    glNamedBufferStorage(counterBuffer_, sizeof(uint32_t), nullptr, GL_DYNAMIC_STORAGE_BIT);
+    bufferStorage(counterBuffer_, sizeof(SPHCounters), nullptr, GL_DYNAMIC_STORAGE_BIT);
+    for (uint32_t i = 0; i < SPHConstants::READBACK_FRAMES; i++) {
+        glCreateBuffers(1, &counterReadbackBuffers_[i]);
+        bufferStorage(counterReadbackBuffers_[i], sizeof(SPHCounters), nullptr, readbackFlags);
+        counterReadbackPointers_[i] = glMapNamedBufferRange(counterReadbackBuffers_[i], 0, sizeof(SPHCounters), readbackFlags);
+    }
+#endif
     
-    // Create velocity field texture for step 4
-    glGenTextures(1, &velocityTexture_);
-    glBindTexture(GL_TEXTURE_3D, velocityTexture_);
-    glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA32F, gridDim_.x, gridDim_.y, gridDim_.z, 0, GL_RGBA, GL_FLOAT, nullptr);
-    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    // Live particle count with the particle-parallel indirect dispatch commands
+    glCreateBuffers(1, &particleCountBuffer_);
+    bufferStorage(particleCountBuffer_, 12 * sizeof(uint32_t), nullptr, GL_DYNAMIC_STORAGE_BIT);
     
-    // Create billboard index buffer
-    {
-        uint32_t billboardIndexCount = 6;
-        uint32_t billboardVertexCount = 4;
-        uint32_t billboardIndices[] = { 0, 1, 2, 2, 1, 3 };
-        
-        std::vector<uint32_t> indices(billboardIndexCount * maxParticles_);
-        
-        for (uint32_t i = 0; i < indices.size(); i++) {
-            uint32_t particleOffset = i / billboardIndexCount;
-            uint32_t particleIndexOffset = i % billboardIndexCount;
-            indices[i] = billboardIndices[particleIndexOffset] + particleOffset * billboardVertexCount;
-        }
-        
-        glCreateBuffers(1, &billboardIndexBuffer_);
-        glNamedBufferStorage(billboardIndexBuffer_, indices.size() * sizeof(uint32_t), indices.data(), 0);
+    // Narrow band bulk columns over the floor, empty until seeded or absorbed into
+    float columnSize = bulkColumnSize();
+    bulkColumnRes_ = glm::max(glm::ivec2(glm::ceil(glm::vec2(gridSize_.x, gridSize_.z) / columnSize)), glm::ivec2(1));
+    glCreateBuffers(1, &bulkColumnBuffer_);
+    bufferStorage(bulkColumnBuffer_, size_t(bulkColumnRes_.x) * bulkColumnRes_.y * 4 * sizeof(uint32_t), nullptr,
+                  GL_DYNAMIC_STORAGE_BIT);
+    
+    // PCISPH GPU-side convergence state
+    glCreateBuffers(1, &pcisphStateBuffer_);
+    bufferStorage(pcisphStateBuffer_, 4 * sizeof(uint32_t), nullptr, GL_DYNAMIC_STORAGE_BIT);
+    
+    // Implicit viscosity GPU-side CG state
+    glCreateBuffers(1, &viscosityStateBuffer_);
+    bufferStorage(viscosityStateBuffer_, 8 * sizeof(uint32_t), nullptr, GL_DYNAMIC_STORAGE_BIT);
+    
+    // Kernel lookup table, filled by updateKernelTable() per parameter set
+    glCreateBuffers(1, &kernelTableBuffer_);
+    bufferStorage(kernelTableBuffer_, SPHConstants::KERNEL_TABLE_SIZE * sizeof(glm::vec4), nullptr, GL_DYNAMIC_STORAGE_BIT);
+    
+    // Particle staging ring: the CPU writes particles straight into mapped memory and the
+    // GPU copies each slot into the particle buffer
+    GLsizeiptr stagingSize = GLsizeiptr(SPHConstants::STAGING_SLOTS) * SPHConstants::STAGING_SLOT_PARTICLES * sizeof(SPHParticleCompute);
+    GLbitfield stagingFlags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glCreateBuffers(1, &stagingBuffer_);
+    bufferStorage(stagingBuffer_, stagingSize, nullptr, stagingFlags);
+    stagingPointer_ = static_cast<SPHParticleCompute*>(glMapNamedBufferRange(stagingBuffer_, 0, stagingSize, stagingFlags));
+    if (!stagingPointer_) {
+        std::cerr << "ERROR: Failed to map SPH particle staging buffer!" << std::endl;
     }
+    
+    glCreateBuffers(1, &sparseDispatchBuffer_);
+    bufferStorage(sparseDispatchBuffer_, 8 * sizeof(uint32_t), nullptr, GL_DYNAMIC_STORAGE_BIT);
 
     glGenVertexArrays(1, &particleVAO_);
     glBindVertexArray(particleVAO_);
     glBindVertexArray(0);
     
-    // Create billboard VAO like 
+    // Billboard VAO, attribute-less: sph_render.vs / sph_depth.vs build the quads from gl_VertexID
     glGenVertexArrays(1, &billboardVAO_);
-    glBindVertexArray(billboardVAO_);
+}
+
+void SPHComputeSystem::createParticleStorage(uint32_t capacity) {
+    GPUMemoryScope memoryScope("SPH");
+    particleCapacity_ = capacity;
+    
+    // Create particle buffers using modern OpenGL; the index sort keeps the particles in place
+    int particleBufferCount = useIndexSort_ ? 1 : 2;
+    glCreateBuffers(particleBufferCount, particleBuffers_);
+    
+    size_t bufferSize = size_t(capacity) * sizeof(SPHParticleCompute);
+    for (int i = 0; i < particleBufferCount; i++) {
+        bufferStorage(particleBuffers_[i], bufferSize, nullptr, GL_DYNAMIC_STORAGE_BIT | GL_MAP_READ_BIT | GL_MAP_WRITE_BIT);
+    }
+
+    // Structure-of-arrays neighbor streams, refreshed by the reorder pass
+    if (particleLayout_ != SPHParticleLayout::AOS) {
+        size_t velocityStride = particleLayout_ == SPHParticleLayout::SOA_HALF_VELOCITY ? 2 * sizeof(uint32_t) : sizeof(glm::vec4);
+        glCreateBuffers(1, &soaPositionBuffer_);
+        bufferStorage(soaPositionBuffer_, capacity * sizeof(glm::vec4), nullptr, 0);
+        glCreateBuffers(1, &soaVelocityBuffer_);
+        bufferStorage(soaVelocityBuffer_, capacity * velocityStride, nullptr, 0);
+        glCreateBuffers(1, &soaDensityPressureBuffer_);
+        bufferStorage(soaDensityPressureBuffer_, capacity * sizeof(glm::vec2), nullptr, 0);
+    }
     
-    // Bind the billboard index buffe
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, billboardIndexBuffer_);
+    // Verlet neighbor lists, interleaved by slot (entry k of particle i at k * capacity + i)
+    glCreateBuffers(1, &sortedIndexBuffer_);
+    bufferStorage(sortedIndexBuffer_, capacity * sizeof(uint32_t), nullptr, 0);
+    glCreateBuffers(1, &neighborCountBuffer_);
+    bufferStorage(neighborCountBuffer_, capacity * sizeof(uint32_t), nullptr, 0);
+    glCreateBuffers(1, &neighborListBuffer_);
+    bufferStorage(neighborListBuffer_, static_cast<size_t>(capacity) * neighborLimit_ * sizeof(uint32_t), nullptr, 0);
+    glCreateBuffers(1, &referencePositionBuffer_);
+    bufferStorage(referencePositionBuffer_, capacity * sizeof(glm::vec4), nullptr, 0);
     
+    // Multirate due list, rebuilt every substep
+    glCreateBuffers(1, &dueParticleBuffer_);
+    bufferStorage(dueParticleBuffer_, capacity * sizeof(uint32_t), nullptr, 0);
     
-    glBindVertexArray(0);
+    // Morton radix sort buffers: ping-pong (key, value) pairs plus the digit histogram
+    for (int i = 0; i < 2; i++) {
+        glCreateBuffers(1, &sortKeyBuffers_[i]);
+        bufferStorage(sortKeyBuffers_[i], capacity * sizeof(uint32_t), nullptr, 0);
+        glCreateBuffers(1, &sortValueBuffers_[i]);
+        bufferStorage(sortValueBuffers_[i], capacity * sizeof(uint32_t), nullptr, 0);
+    }
+    
+    uint32_t radixBlocks = (capacity + SPHConstants::RADIX_BLOCK_SIZE - 1) / SPHConstants::RADIX_BLOCK_SIZE;
+    size_t histogramSize = radixBlocks * SPHConstants::RADIX_BINS * sizeof(uint32_t);
+    glCreateBuffers(1, &radixHistogramBuffer_);
+    bufferStorage(radixHistogramBuffer_, histogramSize, nullptr, 0);
+    glCreateBuffers(1, &radixOffsetBuffer_);
+    bufferStorage(radixOffsetBuffer_, histogramSize, nullptr, 0);
+    
+    // The prefix scan block totals are shared by the grid scan and the histogram scan
+    uint32_t histogramScanBlocks = (radixBlocks * SPHConstants::RADIX_BINS + SPHConstants::SCAN_BLOCK_SIZE - 1) / SPHConstants::SCAN_BLOCK_SIZE;
+    glCreateBuffers(1, &scanBlockSumBuffer_);
+    bufferStorage(scanBlockSumBuffer_, std::max(scanBlockCount_, histogramScanBlocks) * sizeof(uint32_t), nullptr, 0);
+    
+    // Statistics partials, one per reduction block
+    uint32_t partialCount = (capacity + SPHConstants::REDUCE_BLOCK_SIZE - 1) / SPHConstants::REDUCE_BLOCK_SIZE;
+    glCreateBuffers(1, &statisticsPartialBuffer_);
+    bufferStorage(statisticsPartialBuffer_, partialCount * sizeof(SPHStatistics), nullptr, 0);
+    
+    // PCISPH per-particle predictions (three vec4s)
+    glCreateBuffers(1, &pcisphParticleBuffer_);
+    bufferStorage(pcisphParticleBuffer_, capacity * 3 * sizeof(glm::vec4), nullptr, 0);
+    
+    // Implicit viscosity CG vectors (four vec4s), one partial per workgroup of the smallest
+    // size, and the warm start that moves with the particles (starts at zero)
+    glCreateBuffers(1, &viscositySolverBuffer_);
+    bufferStorage(viscositySolverBuffer_, capacity * 4 * sizeof(glm::vec4), nullptr, 0);
+    glCreateBuffers(1, &viscosityPartialBuffer_);
+    bufferStorage(viscosityPartialBuffer_, ((capacity + 31) / 32) * sizeof(float), nullptr, 0);
+    glCreateBuffers(2, viscosityWarmStartBuffers_);
+    for (GLuint buffer : viscosityWarmStartBuffers_) {
+        bufferStorage(buffer, capacity * sizeof(glm::vec4), nullptr, 0);
+        glClearNamedBufferData(buffer, GL_RGBA32F, GL_RGBA, GL_FLOAT, nullptr);
+    }
+    
+    // Secondary particle potentials from steps 5 and 6 (two vec4s)
+    glCreateBuffers(1, &diffusePotentialBuffer_);
+    bufferStorage(diffusePotentialBuffer_, capacity * 2 * sizeof(glm::vec4), nullptr, 0);
+    
+    // Surface tension normals from step 5 for step 6 (one vec4)
+    glCreateBuffers(1, &surfaceNormalBuffer_);
+    bufferStorage(surfaceNormalBuffer_, capacity * sizeof(glm::vec4), nullptr, 0);
+    
+    // Every active cell holds at least one particle, so the particle count bounds the list
+    activeCellCapacity_ = std::min(cellCount_, capacity);
+    glCreateBuffers(1, &activeCellBuffer_);
+    bufferStorage(activeCellBuffer_, activeCellCapacity_ * sizeof(uint32_t), nullptr, 0);
 }
 
-void SPHComputeSystem::loadShaders() {
-    // Load all 6 simulation shaders
-    simStep1Program_ = InitComputeShader("shaders/sph_step1.cs");
-    if (!simStep1Program_) {
-        std::cerr << "ERROR: Failed to load SPH step 1 shader!" << std::endl;
-    } else {
-        std::cout << "SPH step 1 shader loaded successfully (ID: " << simStep1Program_ << ")" << std::endl;
+void SPHComputeSystem::releaseParticleStorage() {
+    GLuint* buffers[] = {
+        &soaPositionBuffer_, &soaVelocityBuffer_, &soaDensityPressureBuffer_,
+        &sortedIndexBuffer_, &neighborCountBuffer_, &neighborListBuffer_, &referencePositionBuffer_, &dueParticleBuffer_,
+        &sortKeyBuffers_[0], &sortKeyBuffers_[1], &sortValueBuffers_[0], &sortValueBuffers_[1],
+        &radixHistogramBuffer_, &radixOffsetBuffer_, &scanBlockSumBuffer_, &statisticsPartialBuffer_,
+        &pcisphParticleBuffer_, &activeCellBuffer_, &diffusePotentialBuffer_, &surfaceNormalBuffer_,
+        &viscositySolverBuffer_, &viscosityPartialBuffer_, &viscosityWarmStartBuffers_[0], &viscosityWarmStartBuffers_[1],
+        &awakeCellBuffer_, &renderStreamBuffer_, &interpolatedBuffer_, &particleBuffers_[0], &particleBuffers_[1],
+    };
+    for (GLuint* buffer : buffers) {
+        if (*buffer) deleteBuffers(1, buffer);
+        *buffer = 0;
     }
+}
+
+bool SPHComputeSystem::reserveParticles(uint32_t count) {
+    if (count <= particleCapacity_) return true;
+    if (count > maxParticles_) return false;
     
-    simStep2Program_ = InitComputeShader("shaders/sph_step2.cs");
-    if (!simStep2Program_) {
-        std::cerr << "ERROR: Failed to load SPH step 2 shader!" << std::endl;
-    } else {
-        std::cout << "SPH step 2 shader loaded successfully (ID: " << simStep2Program_ << ")" << std::endl;
+    // Double, so a steadily filling scene reallocates O(log n) times
+    uint32_t capacity = std::max(count, particleCapacity_ * 2);
+    capacity = std::min(((capacity + 511) / 512) * 512, maxParticles_);
+    
+    // Only the current particle buffer holds state; everything else is rebuilt each substep
+    // (or, for the Verlet lists and the sparse velocity field, on the next use)
+    flushPassBarriers();
+    GLuint oldParticles = particleBuffers_[currentBuffer_];
+    particleBuffers_[currentBuffer_] = 0;
+    uint32_t oldCapacity = particleCapacity_;
+    releaseParticleStorage();
+    createParticleStorage(capacity);
+    
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    if (numParticles_ > 0) {
+        glCopyNamedBufferSubData(oldParticles, particleBuffers_[currentBuffer_], 0, 0,
+                                 GLsizeiptr(std::min(numParticles_, oldCapacity)) * sizeof(SPHParticleCompute));
     }
+    deleteBuffers(1, &oldParticles);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
     
-    simStep3Program_ = InitComputeShader("shaders/sph_step3.cs");
-    if (!simStep3Program_) {
-        std::cerr << "ERROR: Failed to load SPH step 3 shader!" << std::endl;
-    } else {
-        std::cout << "SPH step 3 shader loaded successfully (ID: " << simStep3Program_ << ")" << std::endl;
+    neighborListsDirty_ = true;
+    std::cout << "SPH particle capacity grown from " << oldCapacity << " to " << capacity << std::endl;
+    return true;
+}
+
+std::string SPHComputeSystem::layoutDefines() const {
+    // Layout variants of the reorder and neighbor-loop shaders
+    std::string defines;
+    if (particleLayout_ != SPHParticleLayout::AOS) {
+        defines += "#define SPH_SOA_LAYOUT\n";
+    }
+    if (particleLayout_ == SPHParticleLayout::SOA_HALF_VELOCITY) {
+        defines += "#define SPH_HALF_VELOCITY\n";
+    }
+    std::string layout = ReadShaderSource("shaders/sph_layout.glsl");
+    if (layout.empty()) {
+        std::cerr << "ERROR: Could not read shaders/sph_layout.glsl" << std::endl;
+    }
+    return defines + layout + "\n";
+}
+
+std::string SPHComputeSystem::counterDefines() const {
+#ifdef SPH_GPU_COUNTERS
+    // Instrumentation variants of steps 3, 5 and 6
+    return "#define SPH_COUNTERS\n#define SPH_COUNTER_BINS " + std::to_string(SPHCounters::BINS) +
+           "\n#define SPH_COUNTER_BIN_WIDTH " + std::to_string(SPHCounters::BIN_WIDTH) +
+           "\n#define SPH_COUNTER_CELL_LIMIT " + std::to_string(SPHCounters::CELL_LIMIT) + "\n";
+#else
+    return "";
+#endif
+}
+
+std::string SPHComputeSystem::gridDefines() const {
+    std::string defines = useHierarchicalGrid_ ? "#define SPH_HIERARCHICAL_GRID\n" : "";
+    if (useIndexSort_) {
+        defines += "#define SPH_INDEX_SORT\n";
+    }
+    if (useMortonCells_) {
+        defines += "#define SPH_MORTON_CELLS\n";
+    }
+    return defines;
+}
+
+std::string SPHComputeSystem::gridSource() const {
+    std::string grid = ReadShaderSource("shaders/sph_grid.glsl");
+    if (grid.empty()) {
+        std::cerr << "ERROR: Could not read shaders/sph_grid.glsl" << std::endl;
+    }
+    return gridDefines() + grid + "\n";
+}
+
+std::string SPHComputeSystem::tagSource() const {
+    std::string tags = ReadShaderSource("shaders/sph_tags.glsl");
+    if (tags.empty()) {
+        std::cerr << "ERROR: Could not read shaders/sph_tags.glsl" << std::endl;
     }
+    return "#define SPH_PHASE_BITS " + std::to_string(SPHConstants::PHASE_BITS) + "u\n" +
+           "#define SPH_MAX_PHASES " + std::to_string(SPHConstants::MAX_PHASES) + "\n" +
+           "#define SPH_TIME_LEVEL_BITS " + std::to_string(SPHConstants::TIME_LEVEL_BITS) + "u\n" + tags + "\n";
+}
+
+bool SPHComputeSystem::subgroupsSupported() const {
+    if (!GLAD_GL_KHR_shader_subgroup) return false;
     
-    simStep4Program_ = InitComputeShader("shaders/sph_step4.cs");
-    if (!simStep4Program_) {
-        std::cerr << "ERROR: Failed to load SPH step 4 shader!" << std::endl;
-    } else {
-        std::cout << "SPH step 4 shader loaded successfully (ID: " << simStep4Program_ << ")" << std::endl;
+    GLint stages = 0;
+    GLint features = 0;
+    GLint subgroupSize = 0;
+    glGetIntegerv(GL_SUBGROUP_SUPPORTED_STAGES_KHR, &stages);
+    glGetIntegerv(GL_SUBGROUP_SUPPORTED_FEATURES_KHR, &features);
+    glGetIntegerv(GL_SUBGROUP_SIZE_KHR, &subgroupSize);
+    
+    const GLint required = GL_SUBGROUP_FEATURE_BASIC_BIT_KHR | GL_SUBGROUP_FEATURE_ARITHMETIC_BIT_KHR |
+                           GL_SUBGROUP_FEATURE_BALLOT_BIT_KHR;
+    bool supported = (stages & GL_COMPUTE_SHADER_BIT) && (features & required) == required && subgroupSize > 0;
+    if (supported) {
+        std::cout << "SPH subgroup operations enabled (subgroup size " << subgroupSize << ")" << std::endl;
     }
+    return supported;
+}
+
+void SPHComputeSystem::loadShaders() {
+    std::string layoutDefines = this->layoutDefines() + gridSource();
+    subgroupDefines_ = useSubgroups_ && subgroupsSupported() ? "#define SPH_SUBGROUPS\n" : "";
+    // Step 1 flags the occupied blocks of the hierarchical grid, the grid block pass allocates them
+    std::string blockWriterDefines = "#define SPH_BLOCK_SLOT_WRITER\n" + gridSource();
+    // Step 3, the Morton reorder and the gather write the SoA mirror, steps 4-6 read it
+    const std::string soaWriterDefines = "#define SPH_SOA_WRITER\n";
     
-    simStep5Program_ = InitComputeShader("shaders/sph_step5.cs");
-    if (!simStep5Program_) {
-        std::cerr << "ERROR: Failed to load SPH step 5 shader!" << std::endl;
-    } else {
-        std::cout << "SPH step 5 shader loaded successfully (ID: " << simStep5Program_ << ")" << std::endl;
+    struct ComputeProgram {
+        GLuint* program;
+        const char* path;
+        std::string defines;
+        std::string name;
+    };
+    std::vector<ComputeProgram> computePrograms = {
+        {&simStep1Program_, "shaders/sph_step1.cs", subgroupDefines_ + blockWriterDefines + tagSource(), "step 1 shader"},
+        {&simStep2Program_, "shaders/sph_step2.cs", subgroupDefines_, "step 2 shader"},
+        {&simStep3Program_, "shaders/sph_step3.cs", soaWriterDefines + "#define SPH_SORTED_INDEX_WRITER\n" + layoutDefines + counterDefines(), "step 3 shader"},
+        {&mortonProgram_, "shaders/sph_morton.cs", soaWriterDefines + layoutDefines, "Morton shader"},
+        {&radixSortProgram_, "shaders/sph_radix_sort.cs", "", "radix sort shader"},
+        {&neighborListProgram_, "shaders/sph_neighbor_list.cs", "#define SPH_SORTED_INDEX_WRITER\n" + gridSource(), "neighbor list shader"},
+        {&reduceProgram_, "shaders/sph_reduce.cs", subgroupDefines_, "reduction shader"},
+        {&emitProgram_, "shaders/sph_emit.cs", "", "emitter shader"},
+        {&particleCountProgram_, "shaders/sph_particle_count.cs", "", "particle count shader"},
+        {&cullProgram_, "shaders/sph_cull.cs", "", "culling shader"},
+        {&hiZProgram_, "shaders/sph_hiz.cs", "", "Hi-Z shader"},
+        {&surfaceSplatProgram_, "shaders/sph_surface_splat.cs", "", "surface splat shader"},
+        {&marchingCubesProgram_, "shaders/sph_marching_cubes.cs", "", "marching cubes shader"},
+        {&obstacleProgram_, "shaders/sph_obstacle_sdf.cs", "", "obstacle field shader"},
+        {&sleepProgram_, "shaders/sph_sleep.cs", "", "sleep shader"},
+        {&gridBlockProgram_, "shaders/sph_grid_blocks.cs", blockWriterDefines, "grid block shader"},
+        {&adaptiveProgram_, "shaders/sph_adaptive.cs", tagSource(), "adaptive resolution shader"},
+        {&narrowBandProgram_, "shaders/sph_narrow_band.cs", "", "narrow band shader"},
+        {&timeLevelProgram_, "shaders/sph_time_levels.cs", tagSource(), "time level shader"},
+        {&gatherProgram_, "shaders/sph_gather.cs", soaWriterDefines + this->layoutDefines(), "index sort gather shader"},
+        {&rewindPackProgram_, "shaders/sph_rewind.cs", "", "rewind pack shader"},
+        {&rewindUnpackProgram_, "shaders/sph_rewind.cs", "#define REWIND_UNPACK\n", "rewind unpack shader"},
+        {&interpolateProgram_, "shaders/sph_interpolate.cs", "", "render interpolation shader"},
+        {&diffuseProgram_, "shaders/sph_diffuse.cs", "", "diffuse particle shader"},
+        {&smoothComputeProgram_, "shaders/sph_smooth.cs", "", "compute smooth shader"},
+        {&depthSplatProgram_, "shaders/sph_depth_splat.cs", "", "depth splat shader"}
+    };
+    
+    struct RenderProgram {
+        GLuint* program;
+        const char* vertexPath;
+        const char* fragmentPath;
+        std::string name;
+        std::vector<const char*> fragmentLibraries;     // Further fragment stages
+        std::string defines = "";                       // Of every stage
+    };
+    std::vector<RenderProgram> renderPrograms = {
+        {&depthProgram_, "shaders/sph_depth.vs", "shaders/sph_depth.fs", "depth shaders", {}},
+        {&smoothProgram_, "shaders/sph_smooth.vs", "shaders/sph_smooth.fs", "smooth shaders", {}},
+        {&bilateralProgram_, "shaders/sph_smooth.vs", "shaders/bilateral_blur.fs", "bilateral shaders", {}},
+        {&thicknessProgram_, "shaders/sph_depth.vs", "shaders/sph_thickness.fs", "thickness shaders", {}},
+        {&finalPrograms_[0], "shaders/sph_final.vs", "shaders/sph_final.fs", "final shaders", {"shaders/clustered_lights.fs"}},
+        {&finalPrograms_[1], "shaders/sph_final.vs", "shaders/sph_final.fs", "final shaders (thickness)", {"shaders/clustered_lights.fs"},
+         "#define SPH_THICKNESS\n"},
+        {&surfaceProgram_, "shaders/sph_surface.vs", "shaders/sph_surface.fs", "surface mesh shaders", {}},
+        {&diffuseRenderProgram_, "shaders/sph_diffuse.vs", "shaders/sph_diffuse.fs", "diffuse particle rendering shaders", {"shaders/oit.fs"}},
+        {&containerShader_, "shaders/glass.vs", "shaders/glass.fs", "container shader", {"shaders/oit.fs", "shaders/clustered_lights.fs"}} // Reuses the glass shader
+    };
+    
+    // The particle colors are compiled in, one billboard and render stream variant per mode
+    static const char* const COLOR_MODE_NAMES[COLOR_MODE_COUNT] = { "normal", "velocity", "density", "pressure", "phase" };
+    for (int mode = 0; mode < COLOR_MODE_COUNT; mode++) {
+        std::string defines = "#define SPH_COLOR_MODE " + std::to_string(mode) + "\n";
+        std::string suffix = std::string(" (") + COLOR_MODE_NAMES[mode] + " colors)";
+        computePrograms.push_back({&renderStreamPrograms_[mode], "shaders/sph_render_stream.cs", defines,
+                                   "render stream shader" + suffix});
+        renderPrograms.push_back({&renderPrograms_[mode], "shaders/sph_render.vs", "shaders/sph_render.fs",
+                                  "rendering shaders" + suffix, {}, defines});
     }
     
-    simStep6Program_ = InitComputeShader("shaders/sph_step6.cs");
-    if (!simStep6Program_) {
-        std::cerr << "ERROR: Failed to load SPH step 6 shader!" << std::endl;
-    } else {
-        std::cout << "SPH step 6 shader loaded successfully (ID: " << simStep6Program_ << ")" << std::endl;
+    // Everything goes to the driver before anything is waited on, so the programs compile in
+    // parallel. The callbacks stay registered and swap in hot-reloaded programs later
+    ShaderCompiler& compiler = ShaderCompiler::instance();
+    compiler.cancel(this);
+    auto assign = [](GLuint* target, const std::string& name) {
+        return [target, name](GLuint program) {
+            if (*target) glDeleteProgram(*target);
+            *target = program;
+            std::cout << "SPH " << name << " loaded successfully (ID: " << program << ")" << std::endl;
+        };
+    };
+    for (const ComputeProgram& entry : computePrograms) {
+        compiler.submitCompute(this, std::string("SPH ") + entry.name, entry.path, entry.defines,
+                               assign(entry.program, entry.name));
+    }
+    for (const RenderProgram& entry : renderPrograms) {
+        std::vector<ShaderCompiler::Stage> stages = {{GL_VERTEX_SHADER, entry.vertexPath, entry.defines},
+                                                     {GL_FRAGMENT_SHADER, entry.fragmentPath, entry.defines}};
+        for (const char* library : entry.fragmentLibraries) {
+            stages.push_back({GL_FRAGMENT_SHADER, library, entry.defines});
+        }
+        compiler.submit(this, std::string("SPH ") + entry.name, stages, assign(entry.program, entry.name));
     }
     
-    // Load rendering shaders
-    renderProgram_ = InitShader("shaders/sph_render.vs", "shaders/sph_render.fs");
-    if (!renderProgram_) {
-        std::cerr << "ERROR: Failed to load SPH rendering shaders!" << std::endl;
-    } else {
-        std::cout << "SPH rendering shaders loaded successfully (ID: " << renderProgram_ << ")" << std::endl;
+    // Steps 4-6 and PCISPH are compiled per fluid parameter set
+    loadParameterShaders(shaderParameters_);
+    
+    compiler.finish(this);
+    for (const ComputeProgram& entry : computePrograms) {
+        if (!*entry.program) {
+            std::cerr << "ERROR: Failed to load SPH " << entry.name << "!" << std::endl;
+        }
+    }
+    for (const RenderProgram& entry : renderPrograms) {
+        if (!*entry.program) {
+            std::cerr << "ERROR: Failed to load SPH " << entry.name << "!" << std::endl;
+        }
+    }
+}
+
+std::string SPHComputeSystem::shaderParameterDefines(const SPHShaderParameters& parameters) const {
+    // showpoint keeps whole numbers float literals (250 -> 250.000000)
+    std::ostringstream defines;
+    defines << std::showpoint << std::setprecision(9);
+    defines << "#define SPH_KERNEL_RADIUS " << parameters.kernelRadius << "\n";
+    defines << "#define SPH_MASS " << parameters.mass << "\n";
+    defines << "#define SPH_REST_DENSITY " << parameters.restDensity << "\n";
+    defines << "#define SPH_STIFFNESS " << parameters.stiffness << "\n";
+    defines << "#define SPH_VISCOSITY " << parameters.viscosity << "\n";
+    defines << "#define SPH_WORKGROUP_SIZE " << parameters.workGroupSize << "\n";
+    defines << "#define SPH_PRESSURE_LIMIT " << parameters.pressureLimit << "\n";
+    if (parameters.taitEquation) {
+        defines << "#define SPH_TAIT_EXPONENT " << parameters.taitExponent << "\n";
+    }
+    return defines.str();
+}
+
+GLuint SPHComputeSystem::loadShaderVariant(const char* path, const std::string& defines, const char* name) {
+    std::string key = std::string(path) + "\n" + defines;
+    auto cached = shaderVariants_.find(key);
+    if (cached != shaderVariants_.end()) {
+        return cached->second;
     }
     
-    // Load screen-space fluid rendering shaders
-    depthProgram_ = InitShader("shaders/sph_depth.vs", "shaders/sph_depth.fs");
-    if (!depthProgram_) {
-        std::cerr << "ERROR: Failed to load SPH depth shaders!" << std::endl;
-    } else {
-        std::cout << "SPH depth shaders loaded successfully (ID: " << depthProgram_ << ")" << std::endl;
+    GLuint program = InitComputeShader(path, defines);
+    if (!program) {
+        std::cerr << "ERROR: Failed to load SPH " << name << " shader!" << std::endl;
+        return 0; // Not cached, so a fixed shader is picked up on the next attempt
     }
+    std::cout << "SPH " << name << " shader loaded successfully (ID: " << program << ")" << std::endl;
+    shaderVariants_[key] = program;
+    return program;
+}
+
+bool SPHComputeSystem::loadParameterShaders(const SPHShaderParameters& parameters) {
+    std::string layout = layoutDefines() + gridSource();
+    std::string fluid = shaderParameterDefines(parameters);
+    std::string grid = gridSource();
+    std::string step4Defines = layout + fluid;
+    if (useSparseDomain_) {
+        step4Defines += "#define SPH_SPARSE_DOMAIN\n";
+    }
+    // Only steps 5 and 6 read the kernel table; the other shaders keep one variant for both modes
+    std::string neighborDefines = layout + fluid + counterDefines() + tagSource();
+    if (parameters.kernelTable) {
+        neighborDefines += "#define SPH_KERNEL_TABLE\n#define SPH_KERNEL_TABLE_SIZE " +
+                           std::to_string(SPHConstants::KERNEL_TABLE_SIZE) + "\n";
+    }
+    if (phases_.size() > 1) {
+        neighborDefines += "#define SPH_MULTIPHASE\n";
+    }
+    if (adaptiveResolution_) {
+        neighborDefines += "#define SPH_ADAPTIVE_RESOLUTION\n";
+    }
+    std::string tiledDefines = neighborDefines + "#define SPH_TILED_NEIGHBORS\n";
     
-    smoothProgram_ = InitShader("shaders/sph_smooth.vs", "shaders/sph_smooth.fs");
-    if (!smoothProgram_) {
-        std::cerr << "ERROR: Failed to load SPH smooth shaders!" << std::endl;
-    } else {
-        std::cout << "SPH smooth shaders loaded successfully (ID: " << smoothProgram_ << ")" << std::endl;
+    GLuint step4 = loadShaderVariant("shaders/sph_step4.cs", step4Defines, "step 4");
+    GLuint step5 = loadShaderVariant("shaders/sph_step5.cs", neighborDefines, "step 5");
+    GLuint step6 = loadShaderVariant("shaders/sph_step6.cs", neighborDefines, "step 6");
+    GLuint step5Tiled = loadShaderVariant("shaders/sph_step5.cs", tiledDefines, "tiled step 5");
+    GLuint step6Tiled = loadShaderVariant("shaders/sph_step6.cs", tiledDefines, "tiled step 6");
+    GLuint pcisph = loadShaderVariant("shaders/sph_pcisph.cs", fluid + grid + subgroupDefines_ + tagSource(), "PCISPH");
+    GLuint viscosity = loadShaderVariant("shaders/sph_viscosity.cs", fluid + grid, "implicit viscosity");
+    GLuint query = loadShaderVariant("shaders/sph_query.cs", fluid + grid, "water query");
+    GLuint spatialQuery = loadShaderVariant("shaders/sph_spatial_query.cs", fluid + grid, "spatial query");
+    
+    // Keep the running set on failure, unless nothing has been loaded yet
+    bool complete = step4 && step5 && step6 && step5Tiled && step6Tiled && pcisph && viscosity && query && spatialQuery;
+    if (!complete && simStep5Program_) {
+        return false;
     }
     
-    finalProgram_ = InitShader("shaders/sph_final.vs", "shaders/sph_final.fs");
-    if (!finalProgram_) {
-        std::cerr << "ERROR: Failed to load SPH final shaders!" << std::endl;
-    } else {
-        std::cout << "SPH final shaders loaded successfully (ID: " << finalProgram_ << ")" << std::endl;
+    simStep4Program_ = step4;
+    simStep5Program_ = step5;
+    simStep6Program_ = step6;
+    simStep5TiledProgram_ = step5Tiled;
+    simStep6TiledProgram_ = step6Tiled;
+    pcisphProgram_ = pcisph;
+    viscosityProgram_ = viscosity;
+    queryProgram_ = query;
+    spatialQueryProgram_ = spatialQuery;
+    return complete;
+}
+
+bool SPHComputeSystem::setShaderParameters(const SPHShaderParameters& parameters) {
+    SPHShaderParameters sanitized = parameters;
+    // Steps 4-6 search the 27 cells around a particle, so the kernel cannot outgrow a cell
+    // (with adaptive resolution the coarse kernel, which initialize() sized the cells for)
+    float kernelLimit = SPHConstants::CELL_SIZE;
+    if (adaptiveResolution_ && simStep1Program_) {
+        kernelLimit = std::min(kernelLimit, gridCellSize_ / SPHConstants::ADAPTIVE_RADIUS_SCALE);
+    }
+    sanitized.kernelRadius = glm::clamp(sanitized.kernelRadius, SPHConstants::PARTICLE_RADIUS, kernelLimit);
+    sanitized.mass = std::max(sanitized.mass, 1e-6f);
+    sanitized.restDensity = std::max(sanitized.restDensity, 1e-3f);
+    sanitized.stiffness = std::max(sanitized.stiffness, 0.0f);
+    sanitized.viscosity = std::max(sanitized.viscosity, 0.0f);
+    sanitized.taitExponent = glm::clamp(sanitized.taitExponent, 1, 15);
+    sanitized.pressureLimit = std::max(sanitized.pressureLimit, 1.0f);
+    if (sanitized.workGroupSize != 32 && sanitized.workGroupSize != 64 && sanitized.workGroupSize != 256) {
+        std::cerr << "WARNING: SPH workgroup size " << sanitized.workGroupSize << " unsupported, using 64" << std::endl;
+        sanitized.workGroupSize = 64;
     }
+    if (sanitized == shaderParameters_) return true;
     
-    // Load container shader (reuse glass shader)
-    containerShader_ = InitShader("shaders/glass.vs", "shaders/glass.fs");
-    if (!containerShader_) {
-        std::cerr << "ERROR: Failed to load container shader!" << std::endl;
-    } else {
-        std::cout << "Container shader loaded successfully (ID: " << containerShader_ << ")" << std::endl;
+    // Before initialize() the programs are built from the stored set
+    if (simStep1Program_ && !loadParameterShaders(sanitized)) {
+        std::cerr << "ERROR: SPH shader parameter change failed, keeping the previous set" << std::endl;
+        return false;
+    }
+    shaderParameters_ = sanitized;
+    phasesDirty_ = true; // Phase masses scale the particle mass
+    computePCISPHDelta();
+    if (kernelTableBuffer_) {
+        updateKernelTable();
     }
+    return true;
 }
 
 void SPHComputeSystem::createContainerGeometry() {
+    GPUMemoryScope memoryScope("SPH");
     // Create a wireframe box for the container
     std::vector<glm::vec3> vertices = {
         // Bottom face
@@ -348,26 +1073,38 @@ void SPHComputeSystem::createContainerGeometry() {
         3, 0, 4, 4, 7, 3
     };
     
-    glGenVertexArrays(1, &containerVAO_);
-    glGenBuffers(1, &containerVBO_);
-    glGenBuffers(1, &containerEBO_);
-    
-    glBindVertexArray(containerVAO_);
-    
-    glBindBuffer(GL_ARRAY_BUFFER, containerVBO_);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), vertices.data(), GL_STATIC_DRAW);
-    
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, containerEBO_);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
-    
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
-    glEnableVertexAttribArray(0);
+    // Immutable storage; the box never changes after initialization
+    glCreateBuffers(1, &containerVBO_);
+    bufferStorage(containerVBO_, vertices.size() * sizeof(glm::vec3), vertices.data(), 0);
+    glCreateBuffers(1, &containerEBO_);
+    bufferStorage(containerEBO_, indices.size() * sizeof(unsigned int), indices.data(), 0);
     
-    glBindVertexArray(0);
+    glCreateVertexArrays(1, &containerVAO_);
+    glVertexArrayVertexBuffer(containerVAO_, 0, containerVBO_, 0, sizeof(glm::vec3));
+    glVertexArrayElementBuffer(containerVAO_, containerEBO_);
+    glEnableVertexArrayAttrib(containerVAO_, 0);
+    glVertexArrayAttribFormat(containerVAO_, 0, 3, GL_FLOAT, GL_FALSE, 0);
+    glVertexArrayAttribBinding(containerVAO_, 0, 0);
 }
 
-void SPHComputeSystem::reset() {
+void SPHComputeSystem::clear() {
     numParticles_ = 0;
+    renderStreamCount_ = 0;
+    renderLagApplied_ = false;
+    simulationTime_ = 0.0;
+    resetParticleCount();
+    if (bulkColumnBuffer_) {
+        uint32_t clearValue = 0;
+        glClearNamedBufferData(bulkColumnBuffer_, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &clearValue);
+    }
+    narrowBandSubsteps_ = 0;
+    cellCountsDirty_ = true; // Removed particles' cells would never be cleared in fused mode
+    diffuseStateDirty_ = true;
+    sleepStateDirty_ = true;
+}
+
+void SPHComputeSystem::reset() {
+    clear();
     
     // Initialize particles in a dam break scenario inside the container
     std::vector<glm::vec3> positions;
@@ -377,16 +1114,26 @@ void SPHComputeSystem::reset() {
     float spacing = SPHConstants::PARTICLE_RADIUS * 2.0f;  // Standard SPH spacing
     
     // Start from 25% into the box, extend to 75% in X and Z, but only 50% in Y (half-height)
-    glm::vec3 fluidMin = gridOrigin_ + gridSize_ * 0.25f;
-    glm::vec3 fluidMax = gridOrigin_ + gridSize_ * 0.75f;
-    fluidMax.y = gridOrigin_.y + gridSize_.y * 0.5f; // Half height for dam break
+    glm::vec3 boxSize = boxMax_ - boxMin_;
+    glm::vec3 fluidMin = boxMin_ + boxSize * 0.25f;
+    glm::vec3 fluidMax = boxMin_ + boxSize * 0.75f;
+    fluidMax.y = boxMin_.y + boxSize.y * 0.5f; // Half height for dam break
+    
+    // Narrow band: a resting pool over the whole floor, the depth the mode is for; seedVolume()
+    // moves all of it below the band into the bulk
+    bool pool = narrowBand_ && getSceneCount() == 1;
+    if (pool) {
+        float inset = SPHConstants::WALL_MARGIN + SPHConstants::PARTICLE_RADIUS;
+        fluidMin = boxMin_ + glm::vec3(inset);
+        fluidMax = glm::vec3(boxMax_.x - inset, fluidMax.y, boxMax_.z - inset);
+    }
     
     // Ensure particles stay inside box bounds with some margin
     float margin = SPHConstants::PARTICLE_RADIUS;
     fluidMin = glm::max(fluidMin, boxMin_ + glm::vec3(margin));
     fluidMax = glm::min(fluidMax, boxMax_ - glm::vec3(margin));
     
-    std::cout << "Creating SPH fluid dam break simulation:" << std::endl;
+    std::cout << "Creating SPH fluid " << (pool ? "narrow band pool" : "dam break simulation") << ":" << std::endl;
     std::cout << "Container bounds: " << glm::to_string(boxMin_) << " to " << glm::to_string(boxMax_) << std::endl;
     std::cout << "Fluid block: " << glm::to_string(fluidMin) << " to " << glm::to_string(fluidMax) << std::endl;
     std::cout << "Particle spacing: " << spacing << std::endl;
@@ -396,143 +1143,1543 @@ void SPHComputeSystem::reset() {
     std::cout << "Container size: " << glm::to_string(containerSize) << std::endl;
     std::cout << "Container volume: " << (containerSize.x * containerSize.y * containerSize.z) << " cubic units" << std::endl;
     
-    int particleCount = 0;
-    for (float x = fluidMin.x; x <= fluidMax.x; x += spacing) {
-        for (float y = fluidMin.y; y <= fluidMax.y; y += spacing) {
-            for (float z = fluidMin.z; z <= fluidMax.z; z += spacing) {
-                positions.push_back(glm::vec3(x, y, z));
-                velocities.push_back(glm::vec3(0.0f)); // Start at rest
-                particleCount++;
-                
-                // O(n)
-                if (particleCount >= maxParticles_) goto done_creating;
+    // Multiphase: one horizontal layer per phase, split on lattice rows, phase 0 at the bottom
+    uint32_t layers = phases_.size() > 1 ? static_cast<uint32_t>(phases_.size()) : 1u;
+    int rows = static_cast<int>(std::floor((fluidMax.y - fluidMin.y) / spacing)) + 1;
+    int layerRows = (rows + static_cast<int>(layers) - 1) / static_cast<int>(layers);
+    
+    SPHSeedVolume volume;
+    volume.spacing = spacing;
+    uint32_t particleCount = 0;
+    for (uint32_t scene = 0; scene < getSceneCount(); scene++) {
+        for (uint32_t layer = 0; layer < layers; layer++) {
+            volume.minPos = fluidMin + getSceneOffset(scene);
+            volume.maxPos = fluidMax + getSceneOffset(scene);
+            volume.minPos.y = fluidMin.y + static_cast<float>(layer * layerRows) * spacing;
+            volume.maxPos.y = std::min(fluidMax.y, volume.minPos.y + (static_cast<float>(layerRows) - 0.5f) * spacing);
+            volume.phase = layer;
+            if (volume.minPos.y <= fluidMax.y) {
+                particleCount += seedVolume(volume);
             }
         }
     }
     
-    done_creating:
-    std::cout << "Created " << positions.size() << " fluid particles for dam break" << std::endl;
-    addParticles(positions, velocities);
+    std::cout << "Created " << particleCount << " fluid particles for " << (pool ? "the pool's band" : "dam break") << std::endl;
     std::cout << "SPH system initialized with " << numParticles_ << " particles" << std::endl;
 }
 
-void SPHComputeSystem::applyImpulse(const glm::vec3& position, const glm::vec3& impulse, float radius) {
-    spherePosition_ = position;
-    sphereImpulse_ = impulse;
-    sphereRadius_ = radius;
-    sphereActive_ = true;
+void SPHComputeSystem::setRenderSnapshots(bool enable) {
+    GPUMemoryScope memoryScope("SPH");
+    if (enable == renderSnapshots_) return;
     
-    std::cout << "SPH: Applied impulse at (" << position.x << ", " << position.y << ", " << position.z 
-              << ") with magnitude " << glm::length(impulse) << " and radius " << radius << std::endl;
+    if (enable) {
+        const uint32_t emptyRecord[4] = { 0, 1, 1, 0 };
+        glCreateBuffers(SNAPSHOT_SLOTS, snapshotBuffers_);
+        glCreateBuffers(SNAPSHOT_SLOTS, snapshotCountBuffers_);
+        for (int i = 0; i < SNAPSHOT_SLOTS; i++) {
+            bufferStorage(snapshotBuffers_[i], maxParticles_ * sizeof(SPHParticleCompute), nullptr, 0);
+            bufferStorage(snapshotCountBuffers_[i], SPHConstants::COUNT_RECORD_SIZE, emptyRecord, 0);
+            snapshotCounts_[i] = 0;
+        }
+        snapshotFront_ = 0;
+        snapshotBack_ = 1;
+        publishedSnapshot_ = 2;
+    } else {
+        for (int i = 0; i < SNAPSHOT_SLOTS; i++) {
+            if (snapshotWriteFences_[i]) glDeleteSync(snapshotWriteFences_[i]);
+            if (snapshotReadFences_[i]) glDeleteSync(snapshotReadFences_[i]);
+            snapshotWriteFences_[i] = 0;
+            snapshotReadFences_[i] = 0;
+        }
+        if (snapshotBuffers_[0]) deleteBuffers(SNAPSHOT_SLOTS, snapshotBuffers_);
+        if (snapshotCountBuffers_[0]) deleteBuffers(SNAPSHOT_SLOTS, snapshotCountBuffers_);
+        for (int i = 0; i < SNAPSHOT_SLOTS; i++) {
+            snapshotBuffers_[i] = 0;
+            snapshotCountBuffers_[i] = 0;
+        }
+    }
+    renderSnapshots_ = enable;
 }
 
-void SPHComputeSystem::addParticles(const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& velocities) {
-    if (positions.size() != velocities.size()) {
-        std::cerr << "Position and velocity arrays must have same size" << std::endl;
-        return;
-    }
-    
-    // Create local copies that we can modify if needed
-    std::vector<glm::vec3> finalPositions = positions;
-    std::vector<glm::vec3> finalVelocities = velocities;
+void SPHComputeSystem::publishSnapshot() {
+    int slot = snapshotBack_;
     
-    if (numParticles_ + finalPositions.size() > maxParticles_) {
-        std::cerr << "Too many particles! Requested: " << (numParticles_ + finalPositions.size()) 
-                  << ", Max: " << maxParticles_ << std::endl;
-        // Add as many particles as we can
-        size_t maxToAdd = maxParticles_ - numParticles_;
-        if (maxToAdd == 0) return;
-        
-        std::cout << "Adding only " << maxToAdd << " particles instead" << std::endl;
-        finalPositions.resize(maxToAdd);
-        finalVelocities.resize(maxToAdd);
+    // The renderer may still be drawing from this slot; wait on the GPU, not the CPU
+    if (snapshotReadFences_[slot]) {
+        glWaitSync(snapshotReadFences_[slot], 0, GL_TIMEOUT_IGNORED);
+        glDeleteSync(snapshotReadFences_[slot]);
+        snapshotReadFences_[slot] = 0;
     }
-    
-    // Create particle data
-    std::vector<SPHParticleCompute> particles(finalPositions.size());
-    for (size_t i = 0; i < finalPositions.size(); i++) {
-        particles[i].position = finalPositions[i];
-        particles[i].velocity = finalVelocities[i];
-        particles[i].density = SPHConstants::REST_DENSITY;
-        particles[i].pressure = 0.0f;
+    if (snapshotWriteFences_[slot]) {
+        glDeleteSync(snapshotWriteFences_[slot]);
     }
     
-    // Upload to GPU using modern OpenGL
-    glNamedBufferSubData(particleBuffers_[currentBuffer_], numParticles_ * sizeof(SPHParticleCompute),
-                         particles.size() * sizeof(SPHParticleCompute), particles.data());
-    
-    numParticles_ += static_cast<uint32_t>(finalPositions.size());
-    
-    std::cout << "Added " << finalPositions.size() << " particles. Total: " << numParticles_ << std::endl;
-    
-    // Verify particles were uploaded correctly
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
     if (numParticles_ > 0) {
-        std::cout << "SUCCESS: Particles added to buffer" << std::endl;
-    } else {
-        std::cerr << "ERROR: Failed to add particles!" << std::endl;
+        glCopyNamedBufferSubData(particleBuffers_[currentBuffer_], snapshotBuffers_[slot], 0, 0,
+                                 GLsizeiptr(numParticles_) * sizeof(SPHParticleCompute));
     }
+    glCopyNamedBufferSubData(particleCountBuffer_, snapshotCountBuffers_[slot], 0, 0, SPHConstants::COUNT_RECORD_SIZE);
+    snapshotCounts_[slot] = numParticles_;
+    snapshotWriteFences_[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush(); // Other contexts can only wait on fences that have been flushed
+    
+    snapshotBack_ = publishedSnapshot_.exchange(slot | SNAPSHOT_FRESH, std::memory_order_acq_rel) & ~SNAPSHOT_FRESH;
 }
 
-void SPHComputeSystem::update(float deltaTime) {
-    if (numParticles_ == 0) return;
+void SPHComputeSystem::acquireSnapshot() {
+    if (publishedSnapshot_.load(std::memory_order_acquire) & SNAPSHOT_FRESH) {
+        snapshotFront_ = publishedSnapshot_.exchange(snapshotFront_, std::memory_order_acq_rel) & ~SNAPSHOT_FRESH;
+    }
     
-    // DEBUG: Print update info and sample particle positions
-    static int updateCount = 0;
-    if (updateCount++ % 60 == 0) {
-        std::cout << "SPH Update: " << numParticles_ << " particles, dt=" << deltaTime << std::endl;
-        
-        // Sample first few particle positions for debugging
-        if (numParticles_ > 0) {
-            SPHParticleCompute* particles = static_cast<SPHParticleCompute*>(
-                glMapNamedBufferRange(particleBuffers_[currentBuffer_], 0, 
-                                    sizeof(SPHParticleCompute) * std::min(5u, numParticles_), 
-                                    GL_MAP_READ_BIT));
-            if (particles) {
-                std::cout << "Sample particle positions:" << std::endl;
-                for (uint32_t i = 0; i < std::min(5u, numParticles_); i++) {
-                    std::cout << "  Particle " << i << ": pos(" << particles[i].position.x 
-                              << ", " << particles[i].position.y << ", " << particles[i].position.z 
-                              << ") vel(" << glm::length(particles[i].velocity) << ")" << std::endl;
-                }
-                glUnmapNamedBuffer(particleBuffers_[currentBuffer_]);
-            }
+    int slot = snapshotFront_;
+    if (snapshotWriteFences_[slot]) {
+        glWaitSync(snapshotWriteFences_[slot], 0, GL_TIMEOUT_IGNORED);
+        glDeleteSync(snapshotWriteFences_[slot]);
+        snapshotWriteFences_[slot] = 0;
+    }
+    renderBuffer_ = snapshotBuffers_[slot];
+    renderCount_ = snapshotCounts_[slot];
+    renderCountBuffer_ = snapshotCountBuffers_[slot];
+}
+
+void SPHComputeSystem::releaseSnapshot() {
+    int slot = snapshotFront_;
+    if (snapshotReadFences_[slot]) {
+        glDeleteSync(snapshotReadFences_[slot]);
+    }
+    snapshotReadFences_[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();
+}
+
+void SPHComputeSystem::releaseContextResources() {
+    if (simulationTimerQuery_) {
+        if (simulationTimerPending_) {
+            glEndQuery(GL_TIME_ELAPSED);
         }
+        glDeleteQueries(1, &simulationTimerQuery_);
+        simulationTimerQuery_ = 0;
+        simulationTimerPending_ = false;
     }
+}
+
+bool SPHComputeSystem::startExport(const std::string& path, int frameInterval) {
+    stopExport();
     
-    // Simple fixed timestep update
-    accumulatedTime_ += deltaTime;
+    exporter_ = std::make_unique<SPHFrameExporter>();
+    if (!exporter_->open(path, maxParticles_, gridOrigin_, gridSize_, velocityLimit_)) {
+        exporter_.reset();
+        return false;
+    }
+    exportInterval_ = std::max(frameInterval, 1);
+    exportFrameCounter_ = 0;
+    return true;
+}
+
+void SPHComputeSystem::stopExport() {
+    if (exporter_) {
+        exporter_->close();
+        exporter_.reset();
+    }
+}
+
+bool SPHComputeSystem::startCache(const std::string& basePath, bool surface, int frameInterval) {
+    stopCache();
     
-    while (accumulatedTime_ >= SPHConstants::DT) {
-        // Clear grid
-        uint32_t clearValue = 0;
-        glClearTexImage(gridTexture_, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, &clearValue);
-        glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+    // The surface is extracted into the buffer render() draws, so only on its context
+    if (surface && renderSnapshots_) {
+        std::cerr << "ERROR: The SPH surface cache needs the synchronous simulation" << std::endl;
+        return false;
+    }
+    uint32_t capacity = surface ? SPHConstants::SURFACE_MAX_TRIANGLES * 3 : static_cast<uint32_t>(maxParticles_);
+    cache_ = std::make_unique<SPHCacheExporter>();
+    if (!cache_->open(basePath, surface ? SPHCacheContent::SURFACE : SPHCacheContent::PARTICLES, capacity)) {
+        cache_.reset();
+        return false;
+    }
+    cacheInterval_ = std::max(frameInterval, 1);
+    cacheFrameCounter_ = 0;
+    return true;
+}
 
-        // Run full SPH simulation pipeline with O(n) spatial hashing
-        runSimulationPass(1); // Step 1: Position integration and grid population
-        runSimulationPass(2); // Step 2: Grid offset calculation  
-        runSimulationPass(3); // Step 3: Particle reordering
-        runSimulationPass(4); // Step 4: Velocity field calculation (optional, for filtered viscosity)
-        runSimulationPass(5); // Step 5: Density and pressure calculation (O(n) with spatial hashing)
-        runSimulationPass(6); // Step 6: Force calculation (O(n) with spatial hashing)
-        
-        accumulatedTime_ -= SPHConstants::DT;
+void SPHComputeSystem::stopCache() {
+    if (cache_) {
+        cache_->close();
+        cache_.reset();
     }
 }
 
-void SPHComputeSystem::runSimulationPass(int pass) {
-    glm::vec3 invCellSize = glm::vec3(gridRes_) * (1.0f - 0.001f) / gridSize_;
+bool SPHComputeSystem::isCacheBackedUp() const {
+    return cache_ && cacheFrameCounter_ + 1 >= cacheInterval_ && !cache_->canCapture();
+}
+
+void SPHComputeSystem::pollCache() {
+    if (cache_) {
+        cache_->poll();
+    }
+}
+
+bool SPHComputeSystem::captureCacheFrame() {
+    if (cache_->getContent() == SPHCacheContent::PARTICLES) {
+        return cache_->captureParticles(particleBuffers_[currentBuffer_], numParticles_, particleCountBuffer_, simulationTime_);
+    }
+    if (!surfaceSplatProgram_ || !marchingCubesProgram_) {
+        return false;
+    }
+    // Extracted only when there is room for it; otherwise the capture is counted as deferred
+    if (cache_->canCapture()) {
+        renderBuffer_ = particleBuffers_[currentBuffer_];
+        renderCount_ = numParticles_;
+        renderCountBuffer_ = particleCountBuffer_;
+        extractSurfaceMesh();
+    }
+    return cache_->captureSurface(surfaceMeshBuffer_, simulationTime_);
+}
+
+bool SPHComputeSystem::saveCheckpoint(const std::string& path) {
+    syncParticleCount();
+    uint64_t dataBytes = uint64_t(numParticles_) * sizeof(SPHParticleCompute);
+    uint64_t dataOffset = (sizeof(SPHCheckpointHeader) + SPHConstants::CHECKPOINT_DATA_ALIGNMENT - 1)
+                          / SPHConstants::CHECKPOINT_DATA_ALIGNMENT * SPHConstants::CHECKPOINT_DATA_ALIGNMENT;
     
-    switch (pass) {
-        case 1: // Step 1: Position integration and grid population
+    MappedFile file;
+    if (!file.create(path, static_cast<size_t>(dataOffset + dataBytes))) {
+        std::cerr << "ERROR: Failed to write SPH checkpoint " << path << std::endl;
+        return false;
+    }
+    
+    SPHCheckpointHeader header = {};
+    std::memcpy(header.magic, "WSPHCKPT", sizeof(header.magic));
+    header.version = SPHConstants::CHECKPOINT_VERSION;
+    header.headerSize = sizeof(SPHCheckpointHeader);
+    header.dataOffset = dataOffset;
+    header.particleCount = numParticles_;
+    header.particleStride = sizeof(SPHParticleCompute);
+    for (int i = 0; i < 3; i++) {
+        header.gridOrigin[i] = gridOrigin_[i];
+        header.gridSize[i] = gridSize_[i];
+        header.gridRes[i] = gridRes_[i];
+        header.gravity[i] = gravity_[i];
+    }
+    header.accumulatedTime = accumulatedTime_;
+    header.timeStep = timeStep_;
+    header.simulationTime = simulationTime_;
+    std::memcpy(file.data(), &header, sizeof(header));
+    
+    // The particle buffer is read back straight into the mapped pages
+    char* particleData = static_cast<char*>(file.data()) + dataOffset;
+    if (dataBytes > 0) {
+        glGetNamedBufferSubData(particleBuffers_[currentBuffer_], 0, static_cast<GLsizeiptr>(dataBytes), particleData);
+    }
+    
+    std::cout << "SPH checkpoint saved: " << path << " (" << numParticles_ << " particles, t = " << simulationTime_ << " s)" << std::endl;
+    return true;
+}
+
+bool SPHComputeSystem::loadCheckpoint(const std::string& path) {
+    MappedFile file;
+    if (!file.openRead(path)) {
+        std::cerr << "ERROR: Failed to open SPH checkpoint " << path << std::endl;
+        return false;
+    }
+    
+    SPHCheckpointHeader header;
+    if (file.size() < sizeof(header)) {
+        std::cerr << "ERROR: SPH checkpoint " << path << " is truncated" << std::endl;
+        return false;
+    }
+    std::memcpy(&header, file.data(), sizeof(header));
+    
+    if (std::memcmp(header.magic, "WSPHCKPT", sizeof(header.magic)) != 0 ||
+        header.version != SPHConstants::CHECKPOINT_VERSION || header.headerSize != sizeof(SPHCheckpointHeader) ||
+        header.particleStride != sizeof(SPHParticleCompute)) {
+        std::cerr << "ERROR: " << path << " is not a version " << SPHConstants::CHECKPOINT_VERSION << " SPH checkpoint" << std::endl;
+        return false;
+    }
+    
+    uint64_t dataBytes = uint64_t(header.particleCount) * header.particleStride;
+    if (header.dataOffset + dataBytes > file.size()) {
+        std::cerr << "ERROR: SPH checkpoint " << path << " is truncated" << std::endl;
+        return false;
+    }
+    if (header.particleCount > maxParticles_) {
+        std::cerr << "ERROR: SPH checkpoint holds " << header.particleCount << " particles, capacity is " << maxParticles_ << std::endl;
+        return false;
+    }
+    for (int i = 0; i < 3; i++) {
+        if (header.gridRes[i] != gridRes_[i] || header.gridOrigin[i] != gridOrigin_[i] || header.gridSize[i] != gridSize_[i]) {
+            std::cerr << "ERROR: SPH checkpoint grid does not match the current simulation box" << std::endl;
+            return false;
+        }
+    }
+    
+    if (!reserveParticles(header.particleCount)) return false;
+    
+    // Upload straight from the mapped pages
+    const char* particleData = static_cast<const char*>(file.data()) + header.dataOffset;
+    if (dataBytes > 0) {
+        glNamedBufferSubData(particleBuffers_[currentBuffer_], 0, static_cast<GLsizeiptr>(dataBytes), particleData);
+    }
+    
+    // Live count and the matching indirect dispatch records
+    uint32_t count = header.particleCount;
+    const uint32_t countRecords[12] = { (count + 31) / 32, 1, 1, count,
+                                        (count + 63) / 64, 1, 1, 0,
+                                        (count + 255) / 256, 1, 1, 0 };
+    glNamedBufferSubData(particleCountBuffer_, 0, sizeof(countRecords), countRecords);
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    
+    SPHKeyframe state;
+    state.particleCount = count;
+    state.gravity = glm::vec3(header.gravity[0], header.gravity[1], header.gravity[2]);
+    state.accumulatedTime = header.accumulatedTime;
+    state.timeStep = header.timeStep;
+    state.simulationTime = header.simulationTime;
+    applyRestoredState(state);
+    
+    std::cout << "SPH checkpoint restored: " << path << " (" << count << " particles, t = " << simulationTime_ << " s)" << std::endl;
+    return true;
+}
+
+void SPHComputeSystem::applyRestoredState(const SPHKeyframe& state) {
+    numParticles_ = state.particleCount;
+    renderStreamCount_ = 0;
+    renderLagApplied_ = false;
+    removedParticles_ = state.removedParticles;
+    std::fill(std::begin(readbackSpawned_), std::end(readbackSpawned_), 0);
+    gravity_ = state.gravity;
+    accumulatedTime_ = state.accumulatedTime;
+    timeStep_ = state.timeStep;
+    simulationTime_ = state.simulationTime;
+    cellCountsDirty_ = true;
+    neighborListsDirty_ = true;
+    sleepStateDirty_ = true;
+}
+
+bool SPHComputeSystem::captureKeyframe(GLuint buffer, GLintptr offset, SPHKeyframe& keyframe) {
+    if (renderSnapshots_ || !rewindPackProgram_) {
+        return false;
+    }
+    
+    // The count buffer on the GPU may already be below numParticles_ from removals not read
+    // back yet; packing the stale slots past it is harmless, and the copy carries the live count
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+    glCopyNamedBufferSubData(particleCountBuffer_, buffer, 0, offset, SPHConstants::COUNT_BUFFER_SIZE);
+    
+    if (numParticles_ > 0) {
+        glUseProgram(rewindPackProgram_);
+        glUniform1ui(glGetUniformLocation(rewindPackProgram_, "uCount"), numParticles_);
+        glUniform3fv(glGetUniformLocation(rewindPackProgram_, "uGridOrigin"), 1, &gridOrigin_[0]);
+        glUniform3fv(glGetUniformLocation(rewindPackProgram_, "uGridSize"), 1, &gridSize_[0]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, particleBuffers_[currentBuffer_]);
+        glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 66, buffer, offset + SPHConstants::KEYFRAME_HEADER_BYTES,
+                          GLsizeiptr(numParticles_) * SPHConstants::KEYFRAME_PARTICLE_BYTES);
+        glDispatchCompute((numParticles_ + 255) / 256, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+    }
+    
+    keyframe.particleCount = numParticles_;
+    keyframe.removedParticles = removedParticles_;
+    keyframe.gravity = gravity_;
+    keyframe.accumulatedTime = accumulatedTime_;
+    keyframe.timeStep = timeStep_;
+    keyframe.simulationTime = simulationTime_;
+    return true;
+}
+
+bool SPHComputeSystem::restoreKeyframe(GLuint buffer, GLintptr offset, const SPHKeyframe& keyframe) {
+    if (renderSnapshots_ || !rewindUnpackProgram_) {
+        return false;
+    }
+    if (keyframe.particleCount > maxParticles_) {
+        std::cerr << "ERROR: SPH keyframe holds " << keyframe.particleCount << " particles, capacity is " << maxParticles_ << std::endl;
+        return false;
+    }
+    if (!reserveParticles(keyframe.particleCount)) return false;
+    
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+    glCopyNamedBufferSubData(buffer, particleCountBuffer_, offset, 0, SPHConstants::COUNT_BUFFER_SIZE);
+    
+    if (keyframe.particleCount > 0) {
+        glUseProgram(rewindUnpackProgram_);
+        glUniform1ui(glGetUniformLocation(rewindUnpackProgram_, "uCount"), keyframe.particleCount);
+        glUniform3fv(glGetUniformLocation(rewindUnpackProgram_, "uGridOrigin"), 1, &gridOrigin_[0]);
+        glUniform3fv(glGetUniformLocation(rewindUnpackProgram_, "uGridSize"), 1, &gridSize_[0]);
+        glUniform1f(glGetUniformLocation(rewindUnpackProgram_, "uRestDensity"), shaderParameters_.restDensity);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, particleBuffers_[currentBuffer_]);
+        glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 66, buffer, offset + SPHConstants::KEYFRAME_HEADER_BYTES,
+                          GLsizeiptr(keyframe.particleCount) * SPHConstants::KEYFRAME_PARTICLE_BYTES);
+        glDispatchCompute((keyframe.particleCount + 255) / 256, 1, 1);
+    }
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+    
+    applyRestoredState(keyframe);
+    return true;
+}
+
+void SPHComputeSystem::applyImpulse(const glm::vec3& position, const glm::vec3& impulse, float radius) {
+    spherePosition_ = position;
+    sphereImpulse_ = impulse;
+    sphereRadius_ = radius;
+    sphereActive_ = true;
+    
+    WATERSIM_LOG_DEBUG(LogCategory::SPH, "SPH: Applied impulse at (" << position.x << ", " << position.y << ", " << position.z
+              << ") with magnitude " << glm::length(impulse) << " and radius " << radius);
+}
+
+void SPHComputeSystem::setUseSphereCoupling(bool enable) {
+    useSphereCoupling_ = enable;
+    if (!enable) {
+        coupledSphereValid_ = false;
+        sphereForce_ = glm::vec3(0.0f);
+        sphereContacts_ = 0;
+    }
+}
+
+void SPHComputeSystem::setCoupledSphere(const glm::vec3& center, const glm::vec3& velocity, float radius) {
+    coupledSphereCenter_ = center;
+    coupledSphereVelocity_ = velocity;
+    coupledSphereRadius_ = radius;
+    coupledSphereValid_ = useSphereCoupling_;
+}
+
+void SPHComputeSystem::addParticles(const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& velocities) {
+    if (positions.size() != velocities.size()) {
+        WATERSIM_LOG_ERROR(LogCategory::SPH, "Position and velocity arrays must have same size");
+        return;
+    }
+    if (!emitProgram_ || !particleCountProgram_) {
+        WATERSIM_LOG_ERROR(LogCategory::SPH, "SPH emitter shaders not loaded, cannot add particles!");
+        return;
+    }
+    
+    size_t count = positions.size();
+    if (numParticles_ + count > maxParticles_) {
+        // Add as many particles as we can
+        size_t requested = numParticles_ + count;
+        count = maxParticles_ - numParticles_;
+        WATERSIM_LOG_WARNING(LogCategory::SPH, "Too many particles! Requested: " << requested
+                  << ", Max: " << maxParticles_ << ", adding only " << count);
+        if (count == 0) return;
+    }
+    if (!reserveParticles(numParticles_ + static_cast<uint32_t>(count))) return;
+    
+    // Fill staging slots in place and let the emitter append them after the live particles;
+    // zero pressure with the phase in its low mantissa bits
+    float phasePressure = glm::uintBitsToFloat(clampedPhase(emitPhase_));
+    for (size_t first = 0; first < count; first += SPHConstants::STAGING_SLOT_PARTICLES) {
+        size_t chunk = std::min<size_t>(count - first, SPHConstants::STAGING_SLOT_PARTICLES);
+        SPHParticleCompute* staged = acquireStagingSlot();
+        if (!staged) {
+            WATERSIM_LOG_ERROR(LogCategory::SPH, "Failed to add particles!");
+            return;
+        }
+        
+        for (size_t i = 0; i < chunk; i++) {
+            staged[i].position = positions[first + i];
+            staged[i].velocity = velocities[first + i];
+            staged[i].density = shaderParameters_.restDensity;
+            staged[i].pressure = phasePressure;
+        }
+        
+        dispatchEmitter(1, static_cast<uint32_t>(chunk), stagingSlot_ * SPHConstants::STAGING_SLOT_PARTICLES);
+        stagingFences_[stagingSlot_] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        stagingSlot_ = (stagingSlot_ + 1) % SPHConstants::STAGING_SLOTS;
+        
+        numParticles_ += static_cast<uint32_t>(chunk);
+    }
+    neighborListsDirty_ = true;
+    
+    WATERSIM_LOG_DEBUG(LogCategory::SPH, "Added " << count << " particles. Total: " << numParticles_);
+}
+
+uint32_t SPHComputeSystem::emitStream(const glm::vec3& origin, const glm::vec3& velocity, float radius, uint32_t count) {
+    if (!emitProgram_ || !particleCountProgram_) return 0;
+    
+    count = std::min(count, maxParticles_ - numParticles_);
+    if (count == 0 || !reserveParticles(numParticles_ + count)) return 0;
+    
+    glUseProgram(emitProgram_);
+    glUniform1ui(glGetUniformLocation(emitProgram_, "uSeed"), emitSeed_++ * 0x9E3779B9u);
+    glUniform3fv(glGetUniformLocation(emitProgram_, "uEmitOrigin"), 1, &origin[0]);
+    glUniform3fv(glGetUniformLocation(emitProgram_, "uEmitVelocity"), 1, &velocity[0]);
+    glUniform1f(glGetUniformLocation(emitProgram_, "uEmitRadius"), radius);
+    glUniform1ui(glGetUniformLocation(emitProgram_, "uEmitPhase"), clampedPhase(emitPhase_));
+    glUniform1f(glGetUniformLocation(emitProgram_, "uRestDensity"), shaderParameters_.restDensity);
+    dispatchEmitter(0, count, 0);
+    
+    numParticles_ += count;
+    neighborListsDirty_ = true;
+    return count;
+}
+
+uint32_t SPHComputeSystem::seedVolume(const SPHSeedVolume& request) {
+    GPUMemoryScope memoryScope("SPH");
+    if (!emitProgram_ || !particleCountProgram_) {
+        std::cerr << "ERROR: SPH emitter shaders not loaded, cannot seed particles!" << std::endl;
+        return 0;
+    }
+    if (request.spacing <= 0.0f) return 0;
+    
+    SPHSeedVolume volume = request;
+    if (narrowBand_) {
+        depositBulk(volume);
+    }
+    
+    // Lattice points from minPos up to maxPos inclusive
+    glm::vec3 extent = glm::max(volume.maxPos - volume.minPos, glm::vec3(0.0f));
+    glm::ivec3 dim = glm::ivec3(glm::floor(extent / volume.spacing)) + 1;
+    uint64_t count = static_cast<uint64_t>(dim.x) * dim.y * dim.z;
+    
+    // A sphere keeps one z interval per (x, y) row; record where each row starts in the
+    // particle order so the shader can find its row with a binary search
+    std::vector<glm::uvec2> rows;
+    if (volume.shape == SPHSeedVolume::SPHERE) {
+        glm::vec3 center = 0.5f * (volume.minPos + volume.maxPos);
+        float radius = 0.5f * std::min(extent.x, std::min(extent.y, extent.z));
+        rows.reserve(static_cast<size_t>(dim.x) * dim.y);
+        count = 0;
+        for (int x = 0; x < dim.x; x++) {
+            for (int y = 0; y < dim.y; y++) {
+                glm::vec2 offset = glm::vec2(volume.minPos.x + x * volume.spacing - center.x,
+                                             volume.minPos.y + y * volume.spacing - center.y);
+                float reach2 = radius * radius - glm::dot(offset, offset);
+                int first = 0;
+                int last = -1;
+                if (reach2 >= 0.0f) {
+                    float reach = std::sqrt(reach2);
+                    first = std::max(0, static_cast<int>(std::ceil((center.z - reach - volume.minPos.z) / volume.spacing)));
+                    last = std::min(dim.z - 1, static_cast<int>(std::floor((center.z + reach - volume.minPos.z) / volume.spacing)));
+                }
+                rows.push_back(glm::uvec2(static_cast<uint32_t>(count), static_cast<uint32_t>(first)));
+                count += static_cast<uint64_t>(std::max(0, last - first + 1));
+            }
+        }
+    }
+    
+    uint32_t seeded = static_cast<uint32_t>(std::min<uint64_t>(count, maxParticles_ - numParticles_));
+    if (seeded < count) {
+        std::cerr << "WARNING: Volume holds " << count << " particles, seeding only " << seeded << std::endl;
+    }
+    if (seeded == 0 || !reserveParticles(numParticles_ + seeded)) return 0;
+    
+    GLuint rowBuffer = 0;
+    if (!rows.empty()) {
+        glCreateBuffers(1, &rowBuffer);
+        bufferStorage(rowBuffer, rows.size() * sizeof(glm::uvec2), rows.data(), 0);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 42, rowBuffer);
+    }
+    
+    glUseProgram(emitProgram_);
+    glUniform1ui(glGetUniformLocation(emitProgram_, "uSeed"), emitSeed_++ * 0x9E3779B9u);
+    glUniform1i(glGetUniformLocation(emitProgram_, "uSeedShape"), volume.shape);
+    glUniform1ui(glGetUniformLocation(emitProgram_, "uSeedRowCount"), static_cast<uint32_t>(rows.size()));
+    glUniform3iv(glGetUniformLocation(emitProgram_, "uLatticeDim"), 1, &dim[0]);
+    glUniform3fv(glGetUniformLocation(emitProgram_, "uLatticeOrigin"), 1, &volume.minPos[0]);
+    glUniform1f(glGetUniformLocation(emitProgram_, "uSpacing"), volume.spacing);
+    glUniform1ui(glGetUniformLocation(emitProgram_, "uEmitPhase"), clampedPhase(volume.phase));
+    glUniform1f(glGetUniformLocation(emitProgram_, "uJitter"), volume.jitter);
+    glUniform3fv(glGetUniformLocation(emitProgram_, "uEmitVelocity"), 1, &volume.velocity[0]);
+    glUniform1f(glGetUniformLocation(emitProgram_, "uRestDensity"), shaderParameters_.restDensity);
+    
+    // Each dispatch appends at the live count the previous one advanced
+    const uint32_t maxDispatch = 65535u * SPHConstants::EMIT_BLOCK_SIZE;
+    for (uint32_t first = 0; first < seeded; first += maxDispatch) {
+        glUseProgram(emitProgram_);
+        glUniform1ui(glGetUniformLocation(emitProgram_, "uSeedFirst"), first);
+        dispatchEmitter(2, std::min(seeded - first, maxDispatch), 0);
+    }
+    
+    // Deleting after the dispatches is safe, the driver keeps the storage until they finish
+    if (rowBuffer) deleteBuffers(1, &rowBuffer);
+    
+    numParticles_ += seeded;
+    neighborListsDirty_ = true;
+    return seeded;
+}
+
+float SPHComputeSystem::bulkColumnSize() const {
+    return gridCellSize_ * static_cast<float>(SPHConstants::NARROW_BAND_COLUMN_CELLS);
+}
+
+float SPHComputeSystem::bulkFloor() const {
+    return gridOrigin_.y + SPHConstants::WALL_MARGIN;
+}
+
+void SPHComputeSystem::setNarrowBandUniforms() {
+    float columnSize = bulkColumnSize();
+    float spacing = SPHConstants::PARTICLE_RADIUS * 2.0f;
+    glm::vec2 columnOrigin(gridOrigin_.x, gridOrigin_.z);
+    glm::vec2 wallMin = columnOrigin + glm::vec2(SPHConstants::WALL_MARGIN);
+    glm::vec2 wallMax = columnOrigin + glm::vec2(gridSize_.x, gridSize_.z) - glm::vec2(SPHConstants::WALL_MARGIN);
+    float restDensity = phases_.empty() ? shaderParameters_.restDensity : phases_[0].restDensity;
+    
+    glUniform2fv(glGetUniformLocation(narrowBandProgram_, "uColumnOrigin"), 1, &columnOrigin[0]);
+    glUniform2iv(glGetUniformLocation(narrowBandProgram_, "uColumnRes"), 1, &bulkColumnRes_[0]);
+    glUniform1f(glGetUniformLocation(narrowBandProgram_, "uColumnSize"), columnSize);
+    glUniform2fv(glGetUniformLocation(narrowBandProgram_, "uWallMin"), 1, &wallMin[0]);
+    glUniform2fv(glGetUniformLocation(narrowBandProgram_, "uWallMax"), 1, &wallMax[0]);
+    glUniform1f(glGetUniformLocation(narrowBandProgram_, "uBulkFloor"), bulkFloor());
+    glUniform1f(glGetUniformLocation(narrowBandProgram_, "uBandDepth"), narrowBandDepth_ * shaderParameters_.kernelRadius);
+    glUniform1f(glGetUniformLocation(narrowBandProgram_, "uLayer"), spacing);
+    glUniform1f(glGetUniformLocation(narrowBandProgram_, "uParticleHeight"),
+                spacing * spacing * spacing / (columnSize * columnSize) * SPHConstants::NARROW_BAND_HEIGHT_SCALE);
+    glUniform1f(glGetUniformLocation(narrowBandProgram_, "uRestDensity"), restDensity);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 72, bulkColumnBuffer_);
+}
+
+void SPHComputeSystem::depositBulk(SPHSeedVolume& volume) {
+    // Only a box standing on the floor has a depth for the bulk to take over
+    if (volume.shape != SPHSeedVolume::BOX || !narrowBandProgram_ || !bulkColumnBuffer_ || getSceneCount() > 1) return;
+    float floor = bulkFloor();
+    if (volume.minPos.y > floor + volume.spacing) return;
+    
+    // Each lattice row stands for a slab one spacing thick around it, each column of the
+    // lattice for a square one spacing wide
+    float band = narrowBandDepth_ * shaderParameters_.kernelRadius;
+    int rows = static_cast<int>(std::floor((volume.maxPos.y - volume.minPos.y - band) / volume.spacing));
+    float height = volume.minPos.y + (static_cast<float>(rows) - 0.5f) * volume.spacing - floor;
+    if (rows <= 0 || height <= 0.0f) return;
+    glm::vec2 latticeMin(volume.minPos.x, volume.minPos.z);
+    glm::vec2 latticeMax(volume.maxPos.x, volume.maxPos.z);
+    glm::vec2 dim = glm::floor(glm::max(latticeMax - latticeMin, glm::vec2(0.0f)) / volume.spacing) + 1.0f;
+    glm::vec2 fillMin = latticeMin - 0.5f * volume.spacing;
+    glm::vec2 fillMax = latticeMin + (dim - 0.5f) * volume.spacing;
+    
+    glUseProgram(narrowBandProgram_);
+    setNarrowBandUniforms();
+    glUniform1i(glGetUniformLocation(narrowBandProgram_, "uBandPhase"), 3);
+    glUniform2fv(glGetUniformLocation(narrowBandProgram_, "uFillMin"), 1, &fillMin[0]);
+    glUniform2fv(glGetUniformLocation(narrowBandProgram_, "uFillMax"), 1, &fillMax[0]);
+    glUniform1f(glGetUniformLocation(narrowBandProgram_, "uFillHeight"), height);
+    glDispatchCompute((uint32_t(bulkColumnRes_.x * bulkColumnRes_.y) + 63) / 64, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    
+    volume.minPos.y += static_cast<float>(rows) * volume.spacing;
+}
+
+void SPHComputeSystem::dispatchEmitter(int mode, uint32_t count, uint32_t stagingOffset) {
+    // Append after the GPU-resident count, then advance it and rebuild the dispatch commands
+    glUseProgram(emitProgram_);
+    glUniform1i(glGetUniformLocation(emitProgram_, "uEmitMode"), mode);
+    glUniform1ui(glGetUniformLocation(emitProgram_, "uEmitCount"), count);
+    glUniform1ui(glGetUniformLocation(emitProgram_, "uStagingOffset"), stagingOffset);
+    glUniform1ui(glGetUniformLocation(emitProgram_, "uCapacity"), particleCapacity_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, particleBuffers_[currentBuffer_]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 24, particleCountBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 25, stagingBuffer_);
+    glDispatchCompute((count + SPHConstants::EMIT_BLOCK_SIZE - 1) / SPHConstants::EMIT_BLOCK_SIZE, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    
+    glUseProgram(particleCountProgram_);
+    glUniform1ui(glGetUniformLocation(particleCountProgram_, "uSpawnCount"), count);
+    glUniform1ui(glGetUniformLocation(particleCountProgram_, "uCapacity"), particleCapacity_);
+    glDispatchCompute(1, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+}
+
+void SPHComputeSystem::resetParticleCount() {
+    // Three empty DispatchIndirectCommand records, live count in the first record's padding
+    // and removed count in the second's
+    const uint32_t emptyCount[12] = { 0, 1, 1, 0, 0, 1, 1, 0, 0, 1, 1, 0 };
+    glNamedBufferSubData(particleCountBuffer_, 0, sizeof(emptyCount), emptyCount);
+    
+    // Readbacks issued before this point describe particles that no longer exist
+    removedParticles_ = 0;
+    std::fill(std::begin(readbackSpawned_), std::end(readbackSpawned_), 0);
+}
+
+void SPHComputeSystem::compactParticleCount() {
+    // Step 3 has written the surviving particles densely; drop the removed ones from the count
+    glUseProgram(particleCountProgram_);
+    glUniform1i(glGetUniformLocation(particleCountProgram_, "uCompact"), 1);
+    glDispatchCompute(1, 1, 1);
+    glUniform1i(glGetUniformLocation(particleCountProgram_, "uCompact"), 0);
+}
+
+void SPHComputeSystem::syncParticleCount() {
+    // Blocking: only for callers that read particles back anyway
+    uint32_t live = numParticles_;
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glGetNamedBufferSubData(particleCountBuffer_, SPHConstants::LIVE_COUNT_OFFSET, sizeof(live), &live);
+    if (live < numParticles_) {
+        removedParticles_ += numParticles_ - live;
+        numParticles_ = live;
+    }
+}
+
+int SPHComputeSystem::addSink(const glm::vec3& boxMin, const glm::vec3& boxMax) {
+    if (sinkMins_.size() >= SPHConstants::MAX_SINKS) {
+        std::cerr << "WARNING: SPH sink limit (" << SPHConstants::MAX_SINKS << ") reached" << std::endl;
+        return -1;
+    }
+    sinkMins_.push_back(glm::min(boxMin, boxMax));
+    sinkMaxs_.push_back(glm::max(boxMin, boxMax));
+    return static_cast<int>(sinkMins_.size()) - 1;
+}
+
+void SPHComputeSystem::clearSinks() {
+    sinkMins_.clear();
+    sinkMaxs_.clear();
+}
+
+int SPHComputeSystem::addObstacleSphere(const glm::vec3& center, float radius) {
+    obstacles_.push_back(glm::vec4(center, 0.0f));
+    obstacles_.push_back(glm::vec4(radius, 0.0f, 0.0f, 0.0f));
+    obstacleFieldDirty_ = true;
+    return static_cast<int>(getObstacleCount()) - 1;
+}
+
+int SPHComputeSystem::addObstacleBox(const glm::vec3& boxMin, const glm::vec3& boxMax) {
+    obstacles_.push_back(glm::vec4((boxMin + boxMax) * 0.5f, 1.0f));
+    obstacles_.push_back(glm::vec4(glm::abs(boxMax - boxMin) * 0.5f, 0.0f));
+    obstacleFieldDirty_ = true;
+    return static_cast<int>(getObstacleCount()) - 1;
+}
+
+void SPHComputeSystem::clearObstacles() {
+    obstacles_.clear();
+    obstacleFieldDirty_ = true;
+}
+
+void SPHComputeSystem::bakeObstacleField() {
+    GPUMemoryScope memoryScope("SPH");
+    // The domain never changes, so the texture is allocated once and only rebaked
+    if (!obstacleFieldTexture_) {
+        obstacleFieldRes_ = glm::min(gridRes_ * SPHConstants::OBSTACLE_FIELD_NODES_PER_CELL,
+                                     glm::ivec3(SPHConstants::OBSTACLE_FIELD_MAX_RESOLUTION));
+        glCreateTextures(GL_TEXTURE_3D, 1, &obstacleFieldTexture_);
+        textureStorage3D(obstacleFieldTexture_, 1, GL_RGBA16F, obstacleFieldRes_.x, obstacleFieldRes_.y, obstacleFieldRes_.z);
+        glTextureParameteri(obstacleFieldTexture_, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTextureParameteri(obstacleFieldTexture_, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTextureParameteri(obstacleFieldTexture_, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTextureParameteri(obstacleFieldTexture_, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTextureParameteri(obstacleFieldTexture_, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    }
+    
+    // Only the bake reads the shape list; the buffer is released once the dispatch is queued
+    GLuint obstacleBuffer = 0;
+    if (!obstacles_.empty()) {
+        glCreateBuffers(1, &obstacleBuffer);
+        bufferStorage(obstacleBuffer, obstacles_.size() * sizeof(glm::vec4), obstacles_.data(), 0);
+    }
+    
+    glm::vec3 voxelSize = gridSize_ / glm::vec3(obstacleFieldRes_);
+    glm::vec3 wallMin = boxMin_ + glm::vec3(SPHConstants::WALL_MARGIN);
+    glm::vec3 wallMax = boxMax_ - glm::vec3(SPHConstants::WALL_MARGIN);
+    
+    glUseProgram(obstacleProgram_);
+    glUniform3iv(glGetUniformLocation(obstacleProgram_, "uFieldRes"), 1, &obstacleFieldRes_[0]);
+    glUniform3fv(glGetUniformLocation(obstacleProgram_, "uGridOrigin"), 1, &gridOrigin_[0]);
+    glUniform3fv(glGetUniformLocation(obstacleProgram_, "uVoxelSize"), 1, &voxelSize[0]);
+    glUniform3fv(glGetUniformLocation(obstacleProgram_, "uWallMin"), 1, &wallMin[0]);
+    glUniform3fv(glGetUniformLocation(obstacleProgram_, "uWallMax"), 1, &wallMax[0]);
+    glUniform1i(glGetUniformLocation(obstacleProgram_, "uObstacleCount"), static_cast<GLint>(getObstacleCount()));
+    glUniform1f(glGetUniformLocation(obstacleProgram_, "uSceneStride"), sceneStride_);
+    glUniform1i(glGetUniformLocation(obstacleProgram_, "uSceneCount"), static_cast<GLint>(getSceneCount()));
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 36, obstacleBuffer);
+    glBindImageTexture(0, obstacleFieldTexture_, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+    glDispatchCompute((obstacleFieldRes_.x + 3) / 4, (obstacleFieldRes_.y + 3) / 4, (obstacleFieldRes_.z + 3) / 4);
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+    
+    if (obstacleBuffer) deleteBuffers(1, &obstacleBuffer);
+    obstacleFieldDirty_ = false;
+    sleepStateDirty_ = true; // Particles resting against a removed obstacle must fall
+    
+    std::cout << "SPH obstacle field baked: " << getObstacleCount() << " obstacles, "
+              << obstacleFieldRes_.x << "x" << obstacleFieldRes_.y << "x" << obstacleFieldRes_.z << " texels" << std::endl;
+}
+
+void SPHComputeSystem::dispatchParticles(uint32_t localSize) {
+    GLintptr offset = SPHConstants::DISPATCH_64_OFFSET;
+    if (localSize == 32) offset = SPHConstants::DISPATCH_32_OFFSET;
+    else if (localSize == 256) offset = SPHConstants::DISPATCH_256_OFFSET;
+    
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, particleCountBuffer_);
+    glDispatchComputeIndirect(offset);
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+}
+
+void SPHComputeSystem::ensureVelocityField() {
+    GPUMemoryScope memoryScope("SPH");
+    // Allocated on first use, so with filtered viscosity off the field costs no memory
+    if (velocityTexture_) return;
+    
+    // Half the grid resolution in half floats: step 6 only samples it trilinearly
+    glm::uvec3 fieldDim = (gridDim_ + 1u) / 2u;
+    glGenTextures(1, &velocityTexture_);
+    glBindTexture(GL_TEXTURE_3D, velocityTexture_);
+    glTexStorage3D(GL_TEXTURE_3D, 1, GL_RGBA16F, fieldDim.x, fieldDim.y, fieldDim.z);
+    GPUMemoryTracker::instance().trackTexture(
+        velocityTexture_, GPUMemoryTracker::storageBytes(GL_RGBA16F, fieldDim.x, fieldDim.y, fieldDim.z));
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    
+    std::cout << "Filtered velocity field: " << fieldDim.x << "x" << fieldDim.y << "x" << fieldDim.z << " RGBA16F" << std::endl;
+}
+
+void SPHComputeSystem::dispatchActiveCells(GLuint program) {
+    // One workgroup per cell step 1 found occupied; a row of three cells is one contiguous
+    // particle range only when the atomic scatter laid the cells out in linear order
+    glUniform1i(glGetUniformLocation(program, "uRowContiguous"), passSortMode() == SORT_ATOMIC_SCATTER ? 1 : 0);
+    
+    // Sleeping cells are left out: the sleep pass wrote the awake subset in the same layout,
+    // and the cell motion these passes record feeds its next decision
+    GLuint dispatchBuffer = particleSleepingPass_ ? awakeDispatchBuffer_ : sparseDispatchBuffer_;
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 21, particleSleepingPass_ ? awakeCellBuffer_ : activeCellBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 22, dispatchBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 38, cellActivityBuffer_);
+    
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, dispatchBuffer);
+    glDispatchComputeIndirect(4 * sizeof(uint32_t));
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+}
+
+void SPHComputeSystem::prepareParticleSleeping() {
+    GPUMemoryScope memoryScope("SPH");
+    if (!cellActivityBuffer_) {
+        glCreateBuffers(1, &cellActivityBuffer_);
+        bufferStorage(cellActivityBuffer_, GLsizeiptr(cellCount_) * 4 * sizeof(uint32_t), nullptr, 0);
+        glCreateBuffers(1, &awakeDispatchBuffer_);
+        bufferStorage(awakeDispatchBuffer_, 8 * sizeof(uint32_t), nullptr, GL_DYNAMIC_STORAGE_BIT);
+        sleepStateDirty_ = true;
+    }
+    // Sized like the active list, so it is released and regrown with the particle storage
+    if (!awakeCellBuffer_) {
+        glCreateBuffers(1, &awakeCellBuffer_);
+        bufferStorage(awakeCellBuffer_, GLsizeiptr(activeCellCapacity_) * sizeof(uint32_t), nullptr, 0);
+    }
+    if (sleepStateDirty_) {
+        // No quiet substeps anywhere: every cell starts awake
+        uint32_t clearValue = 0;
+        glClearNamedBufferData(cellActivityBuffer_, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &clearValue);
+        glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+        sleepStateDirty_ = false;
+    }
+}
+
+void SPHComputeSystem::updateSleepingCells() {
+    glUseProgram(sleepProgram_);
+    glUniform3iv(glGetUniformLocation(sleepProgram_, "uGridRes"), 1, &gridRes_[0]);
+    glUniform1ui(glGetUniformLocation(sleepProgram_, "uSleepSubsteps"), static_cast<GLuint>(sleepSubsteps_));
+    GLint passLoc = glGetUniformLocation(sleepProgram_, "uPass");
+    
+    const uint32_t dispatchReset[8] = { 0, 1, 1, 0, 0, 1, 1, 0 };
+    glNamedBufferSubData(awakeDispatchBuffer_, 0, sizeof(dispatchReset), dispatchReset);
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, cellCountBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 21, activeCellBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 22, sparseDispatchBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 38, cellActivityBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 39, awakeCellBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 40, awakeDispatchBuffer_);
+    
+    // One invocation per active cell, like sparse step 4; phase 1 reads what phase 0 latched
+    // in the neighboring cells
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, sparseDispatchBuffer_);
+    glUniform1i(passLoc, 0);
+    glDispatchComputeIndirect(0);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    glUniform1i(passLoc, 1);
+    glDispatchComputeIndirect(0);
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+}
+
+void SPHComputeSystem::setPhases(const std::vector<SPHPhase>& phases) {
+    bool wasMultiphase = phases_.size() > 1;
+    phases_.assign(phases.begin(), phases.begin() + std::min<size_t>(phases.size(), SPHConstants::MAX_PHASES));
+    if (phases.size() > SPHConstants::MAX_PHASES) {
+        std::cerr << "WARNING: SPH supports " << SPHConstants::MAX_PHASES << " phases, ignoring the rest" << std::endl;
+    }
+    phasesDirty_ = true;
+    
+    // Steps 5-6 compile the phase table in or out; before initialize() the first load does it
+    if (simStep1Program_ && wasMultiphase != (phases_.size() > 1) && !loadParameterShaders(shaderParameters_)) {
+        std::cerr << "ERROR: SPH multiphase shader variants failed to load" << std::endl;
+    }
+}
+
+uint32_t SPHComputeSystem::clampedPhase(uint32_t phase) const {
+    return phases_.size() > 1 ? std::min(phase, static_cast<uint32_t>(phases_.size()) - 1) : 0u;
+}
+
+void SPHComputeSystem::uploadPhases() {
+    // Rest density, mass, viscosity, interface tension; the mass keeps the lattice spacing
+    glm::vec4 packed[SPHConstants::MAX_PHASES];
+    for (uint32_t i = 0; i < SPHConstants::MAX_PHASES; i++) {
+        SPHPhase phase = i < phases_.size() ? phases_[i] : SPHPhase();
+        float mass = shaderParameters_.mass * phase.restDensity / shaderParameters_.restDensity;
+        packed[i] = glm::vec4(phase.restDensity, mass, phase.viscosity, phase.interfaceTension);
+    }
+    glNamedBufferSubData(phaseBuffer_, 0, sizeof(packed), packed);
+    phasesDirty_ = false;
+}
+
+void SPHComputeSystem::setBatchScenes(const std::vector<SPHSceneParameters>& scenes) {
+    if (cellCountBuffer_) {
+        std::cerr << "WARNING: SPH batched scenes must be set before initialize()" << std::endl;
+        return;
+    }
+    // A single scene runs on the compiled parameters like an unbatched simulation
+    sceneParameters_ = scenes.size() > 1 ? scenes : std::vector<SPHSceneParameters>();
+}
+
+void SPHComputeSystem::setSceneParameters(uint32_t scene, const SPHSceneParameters& parameters) {
+    if (scene >= sceneParameters_.size()) return;
+    sceneParameters_[scene] = parameters;
+    sceneParametersDirty_ = true;
+}
+
+void SPHComputeSystem::setSleepThresholds(float velocity, float densityChange, int substeps) {
+    sleepVelocity_ = std::max(velocity, 0.0001f);
+    sleepDensityChange_ = std::max(densityChange, 0.000001f);
+    sleepSubsteps_ = std::max(substeps, 1);
+}
+
+SPHParticleCompute* SPHComputeSystem::acquireStagingSlot() {
+    if (!stagingPointer_) return nullptr;
+    
+    // Three slots in flight: the slot coming round again was copied two submissions ago,
+    // so this wait almost never blocks
+    GLsync& fence = stagingFences_[stagingSlot_];
+    if (fence) {
+        GLenum status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+        if (status == GL_TIMEOUT_EXPIRED || status == GL_WAIT_FAILED) {
+            std::cerr << "ERROR: Timed out waiting for SPH particle staging slot" << std::endl;
+            return nullptr;
+        }
+        glDeleteSync(fence);
+        fence = 0;
+    }
+    
+    return stagingPointer_ + size_t(stagingSlot_) * SPHConstants::STAGING_SLOT_PARTICLES;
+}
+
+void SPHComputeSystem::update(float deltaTime) {
+    renderLagApplied_ = false;
+    if (numParticles_ == 0) return;
+    
+    // Periodic diagnostics from the asynchronous statistics (never maps simulation buffers)
+    static int updateCount = 0;
+    if (statisticsEnabled_ && updateCount++ % 60 == 0) {
+        WATERSIM_LOG_DEBUG(LogCategory::SPH, "SPH Update: " << numParticles_ << " particles, dt=" << deltaTime
+                  << ", sort=" << (passSortMode() == SORT_MORTON_RADIX ? "morton" : "atomic")
+                  << ", gpu=" << simulationTimeMs_ << "ms"
+                  << "\n  speed min/max/mean: " << statistics_.minSpeed << " / " << statistics_.maxSpeed
+                  << " / " << statistics_.meanSpeed
+                  << "\n  density min/max/mean: " << statistics_.minDensity << " / " << statistics_.maxDensity
+                  << " / " << statistics_.meanDensity);
+    }
+    
+    // Query objects are not shared between contexts, so the timer lives on the updating one
+    if (!simulationTimerQuery_) {
+        glGenQueries(1, &simulationTimerQuery_);
+    }
+    
+    // Pick up the previous GPU timing without stalling on it
+    if (simulationTimerPending_) {
+        GLint available = 0;
+        glGetQueryObjectiv(simulationTimerQuery_, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available) {
+            GLuint64 elapsed = 0;
+            glGetQueryObjectui64v(simulationTimerQuery_, GL_QUERY_RESULT, &elapsed);
+            simulationTimeMs_ = static_cast<float>(elapsed) / 1.0e6f;
+            simulationTimerPending_ = false;
+        }
+    }
+    
+    bool timing = !simulationTimerPending_;
+    if (timing) {
+        glBeginQuery(GL_TIME_ELAPSED, simulationTimerQuery_);
+    }
+    
+    // Choose this frame's substep from the latest statistics that have reached the CPU
+    readBackStatistics(deltaTime);
+    readBackSphereForce();
+#ifdef SPH_GPU_COUNTERS
+    readBackCounters();
+#endif
+    if (coupledSphereValid_) {
+        int32_t zero = 0;
+        glClearNamedBufferData(sphereImpulseBuffer_, GL_R32I, GL_RED_INTEGER, GL_INT, &zero);
+        glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    }
+    timeStep_ = adaptiveTimeStep_ && !deterministic_ ? computeAdaptiveTimeStep() : maxTimeStep();
+    
+    if (useObstacleField_ && obstacleFieldDirty_ && obstacleProgram_) {
+        bakeObstacleField();
+    }
+    
+    if (sceneParametersDirty_ && sceneParameterBuffer_) {
+        std::vector<glm::vec4> packed;
+        for (const SPHSceneParameters& scene : sceneParameters_) {
+            packed.push_back(glm::vec4(scene.stiffness, scene.viscosity, 0.0f, 0.0f));
+        }
+        glNamedBufferSubData(sceneParameterBuffer_, 0, packed.size() * sizeof(glm::vec4), packed.data());
+        sceneParametersDirty_ = false;
+    }
+    if (phasesDirty_ && phaseBuffer_) {
+        uploadPhases();
+    }
+    
+    // Fixed timestep accumulation, capped per frame to avoid a slow-frame death spiral
+    accumulatedTime_ += deltaTime;
+    int substeps = 0;
+    int substepLimit = std::max(static_cast<int>(std::lround(maxSubsteps_ * substepBudget_)), 1);
+    
+    while (accumulatedTime_ >= timeStep_ && substeps < substepLimit) {
+        // PCISPH and the implicit viscosity solve walk the grid directly and sinks need the
+        // step 3 compaction, so all of them bypass the Verlet lists
+        bool listMode = useNeighborLists_ && neighborListProgram_ && simStep2Program_ && !passUsesPCISPH() &&
+                        !passUsesImplicitViscosity() && !deterministic_ && sinkMins_.empty() && !heightfieldCoupling_.heightTexture &&
+                        !useHierarchicalGrid_ &&
+                        !adaptiveResolution_ && !narrowBand_;
+        
+        // Step 6 retags particles while their neighbors read them, which only moves the
+        // pressure's low bits but is not reproducible
+        multiratePass_ = useMultirate_ && timeLevelProgram_ && passUsesWCSPH() && !passUsesImplicitViscosity() &&
+                         !deterministic_;
+        
+        // Merges and splits need the step 3 compaction and shared atomics decide the split
+        // slots, so the pass runs in neither list nor deterministic mode. Under multirate it
+        // waits for a substep every time level is due at, when all particles are in step
+        uint32_t multiratePeriod = 1u << (SPHConstants::MULTIRATE_LEVELS - 1);
+        bool synchronized = !multiratePass_ || multirateSubstep_ % multiratePeriod == 0;
+        adaptivePass_ = false;
+        if (adaptiveResolution_ && adaptiveProgram_ && passUsesWCSPH() && !passUsesImplicitViscosity() &&
+            !deterministic_ && ++adaptiveSubsteps_ >= SPHConstants::ADAPTIVE_INTERVAL && synchronized) {
+            adaptivePass_ = true;
+            adaptiveSubsteps_ = 0;
+        }
+        
+        // The narrow band trades with the bulk under the same rules, and its seeds append past
+        // the live particles, so room for a full budget is made before the substep starts
+        narrowBandPass_ = false;
+        if (narrowBand_ && narrowBandProgram_ && bulkColumnBuffer_ && !deterministic_ && getSceneCount() == 1 &&
+            ++narrowBandSubsteps_ >= SPHConstants::NARROW_BAND_INTERVAL && synchronized) {
+            narrowBandPass_ = true;
+            narrowBandSubsteps_ = 0;
+            reserveParticles(std::min(numParticles_ + SPHConstants::NARROW_BAND_SEED_BUDGET, maxParticles_));
+        }
+        
+        // Fused mode: step 1 zeroes the cells its particles were counted into last substep
+        // in the other count buffer, which becomes next substep's target, so no full clear
+        // The hierarchical grid hands out its block slots afresh every substep, and the tiled
+        // loop decodes dense cell ids
+        // Merges move particles after they were counted, so an adaptive substep clears in full
+        fuseGridClear_ = useFusedGridClear_ && !listMode && !cellCountsDirty_ && !useHierarchicalGrid_ && !adaptivePass_;
+        listModePass_ = listMode;
+        tiledNeighborPass_ = useTiledNeighborLoop_ && !listMode && simStep5TiledProgram_ && simStep6TiledProgram_ &&
+                             !useHierarchicalGrid_ && !multiratePass_ && !useIndexSort_ && !useMortonCells_;
+        
+        // Index sort: gather on an interval, and right after merges or absorption so step 3
+        // compacts them out
+        gatherPass_ = false;
+        if (useIndexSort_ && !listMode &&
+            (++gatherSubsteps_ >= SPHConstants::INDEX_SORT_GATHER_INTERVAL || adaptivePass_ || narrowBandPass_)) {
+            gatherPass_ = true;
+            gatherSubsteps_ = 0;
+        }
+        
+        // Sleeping needs the per-cell dispatch; cells frozen while it was off may be stale
+        bool sleeping = useParticleSleeping_ && sleepProgram_ && tiledNeighborPass_ && passUsesWCSPH() &&
+                        !passUsesImplicitViscosity() && !adaptiveResolution_;
+        sleepStateDirty_ |= sleeping && !particleSleepingPass_;
+        particleSleepingPass_ = sleeping;
+        if (sleeping) {
+            prepareParticleSleeping();
+        }
+        if (fuseGridClear_) {
+            std::swap(cellCountBuffer_, previousCellCountBuffer_);
+        } else {
+            // Clear grid cell counts; outside list mode both buffers, so fused mode can resume cleanly
+            uint32_t clearValue = 0;
+            glClearNamedBufferData(cellCountBuffer_, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &clearValue);
+            if (!listMode) {
+                glClearNamedBufferData(previousCellCountBuffer_, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &clearValue);
+            }
+            glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+            cellCountsDirty_ = listMode;
+        }
+        if (useHierarchicalGrid_) {
+            // Only the coarse table and the slot counter; the pool cells were cleared above
+            uint32_t clearValue = 0;
+            glClearNamedBufferData(blockSlotBuffer_, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &clearValue);
+            glClearNamedBufferData(blockStateBuffer_, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &clearValue);
+            glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+        }
+
+        if (multiratePass_) {
+            // An empty step 6 dispatch that the time level pass grows
+            const uint32_t emptyDispatch[4] = { 0, 1, 1, 0 };
+            glNamedBufferSubData(dueDispatchBuffer_, 0, sizeof(emptyDispatch), emptyDispatch);
+            glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+        }
+        
+        if (listMode) {
+            // Raise the rebuild flag up front when the lists are known to be stale
+            uint32_t rebuildValue = neighborListsDirty_ ? 1u : 0u;
+            glClearNamedBufferData(rebuildFlagBuffer_, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &rebuildValue);
+            glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+            neighborListsDirty_ = false;
+        }
+        
+#ifdef SPH_GPU_COUNTERS
+        uint32_t zero = 0;
+        glClearNamedBufferData(counterBuffer_, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+        glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+#endif
+        runPassGraph();
+        if (multiratePass_) {
+            multirateSubstep_++;
+        }
+        
+        accumulatedTime_ -= timeStep_;
+        simulationTime_ += timeStep_;
+        substeps++;
+    }
+    
+    if (accumulatedTime_ >= timeStep_) {
+        if (substepOverflow_ == OVERFLOW_DROP_TIME) {
+            accumulatedTime_ = std::fmod(accumulatedTime_, timeStep_);
+        } else {
+            accumulatedTime_ = std::min(accumulatedTime_, timeStep_ * substepLimit);
+        }
+    }
+    lastSubstepCount_ = substeps;
+    TraceRecorder::instance().counter("SPH substeps", substeps);
+    TraceRecorder::instance().counter("SPH particles", numParticles_);
+    
+    // Make the last pass writes visible to the statistics reduction and rendering
+    flushPassBarriers();
+    
+    if (useDiffuseParticles_ && diffuseProgram_ && substeps > 0) {
+        updateDiffuseParticles(substeps * timeStep_);
+    }
+    
+    if (useRenderStream_ && renderStreamPrograms_[colorMode_] && !renderSnapshots_ && substeps > 0) {
+        writeRenderStream();
+    }
+    
+    // The statistics also carry the live count back, which frees slots removed by sinks for emitters
+    if (substeps > 0 && (adaptiveTimeStep_ || statisticsEnabled_ || !sinkMins_.empty() || heightfieldCoupling_.heightTexture ||
+                           adaptiveResolution_ || narrowBand_)) {
+        dispatchStatistics();
+    }
+    
+    if (coupledSphereValid_ && substeps > 0) {
+        publishSphereImpulse(substeps * timeStep_);
+    }
+#ifdef SPH_GPU_COUNTERS
+    if (substeps > 0) {
+        publishCounters();
+    }
+#endif
+    
+    if (renderSnapshots_ && substeps > 0) {
+        publishSnapshot();
+    }
+    
+    if (exporter_) {
+        exporter_->poll();
+        if (substeps > 0 && ++exportFrameCounter_ >= exportInterval_) {
+            exporter_->capture(particleBuffers_[currentBuffer_], numParticles_, simulationTime_, particleCountBuffer_);
+            exportFrameCounter_ = 0;
+        }
+    }
+    
+    if (cache_) {
+        cache_->poll();
+        // A deferred frame keeps the counter at the interval, so the next update retries it
+        if (substeps > 0 && ++cacheFrameCounter_ >= cacheInterval_ && captureCacheFrame()) {
+            cacheFrameCounter_ = 0;
+        }
+    }
+    
+    if (timing) {
+        glEndQuery(GL_TIME_ELAPSED);
+        simulationTimerPending_ = true;
+    }
+}
+
+// Declarative substep pipeline: passes run in table order when enabled, and a barrier is
+// issued only when a pass touches a resource an earlier pass wrote since the last barrier
+const SPHComputeSystem::PassDesc SPHComputeSystem::PASS_GRAPH[] = {
+    // Adaptive resolution: merge and split on last substep's densities before integrating
+    { PASS_ADAPTIVE, RES_PARTICLES | RES_PARTICLE_COUNT, RES_PARTICLES | RES_PARTICLE_COUNT,
+      &SPHComputeSystem::passUsesAdaptiveResolution, "SPH adaptive resolution" },
+    // Narrow band: trade the band's inner edge with the bulk columns, then rest on their tops
+    { PASS_NARROW_BAND, RES_PARTICLES | RES_PARTICLE_COUNT | RES_BULK_COLUMNS, RES_PARTICLES | RES_PARTICLE_COUNT | RES_BULK_COLUMNS,
+      &SPHComputeSystem::passUsesNarrowBand, "SPH narrow band" },
+    // Step 1: Position integration and grid population (skin displacement check in list mode)
+    { 1, RES_PARTICLES | RES_PARTICLE_COUNT | RES_CELL_ACTIVITY | RES_BULK_COLUMNS,
+      RES_PARTICLES | RES_CELL_COUNTS | RES_ACTIVE_CELLS | RES_PARTICLE_COUNT | RES_CELL_ACTIVITY | RES_GRID_BLOCKS,
+      &SPHComputeSystem::passAlwaysEnabled, "SPH step 1: integrate" },
+    // Hierarchical grid: allocate the flagged blocks, then count the particles into their cells
+    { PASS_GRID_BLOCKS, RES_PARTICLES | RES_PARTICLE_COUNT | RES_GRID_BLOCKS, RES_GRID_BLOCKS | RES_CELL_COUNTS,
+      &SPHComputeSystem::passUsesGridBlocks, "SPH grid blocks" },
+    // Step 2: Grid offset calculation (the Morton sort derives its own)
+    { 2, RES_CELL_COUNTS, RES_CELL_STARTS, &SPHComputeSystem::passNeedsGridScan, "SPH step 2: grid scan" },
+    // Step 3: Particle reordering, compacting out the particles step 1 removed (the index sort
+    // writes the sorted indices instead and reorders only on its gather substeps)
+    { 3, RES_PARTICLES | RES_CELL_COUNTS | RES_CELL_STARTS | RES_PARTICLE_COUNT | RES_GRID_BLOCKS,
+      RES_PARTICLES | RES_SOA | RES_CELL_STARTS | RES_PARTICLE_COUNT | RES_VISCOSITY_WARM_START, &SPHComputeSystem::passUsesGrid,
+      "SPH step 3: reorder" },
+    // Verlet list rebuild; particles keep their order in list mode
+    { PASS_NEIGHBOR_LISTS, RES_PARTICLES, RES_NEIGHBOR_LISTS | RES_CELL_COUNTS | RES_CELL_STARTS, &SPHComputeSystem::passUsesNeighborLists,
+      "SPH neighbor lists" },
+    // Particle sleeping: replaces the active cell list of steps 4-6 with its awake cells
+    { PASS_SLEEP, RES_CELL_COUNTS | RES_ACTIVE_CELLS | RES_CELL_ACTIVITY, RES_ACTIVE_CELLS | RES_CELL_ACTIVITY,
+      &SPHComputeSystem::passUsesSleeping, "SPH sleeping" },
+    // Multirate: list the particles whose time level is due
+    { PASS_TIME_LEVELS, RES_PARTICLES | RES_PARTICLE_COUNT, RES_DUE_PARTICLES, &SPHComputeSystem::passUsesMultirate,
+      "SPH time levels" },
+    // Step 4: Velocity field calculation, only consumed by filtered viscosity
+    { 4, RES_PARTICLES | RES_SOA | RES_CELL_COUNTS | RES_CELL_STARTS | RES_ACTIVE_CELLS | RES_GRID_BLOCKS, RES_VELOCITY_FIELD,
+      &SPHComputeSystem::passNeedsVelocityField, "SPH step 4: velocity field" },
+    // Step 5: Density and pressure calculation
+    { 5, RES_PARTICLES | RES_SOA | RES_CELL_COUNTS | RES_CELL_STARTS | RES_ACTIVE_CELLS | RES_NEIGHBOR_LISTS | RES_PARTICLE_COUNT |
+      RES_GRID_BLOCKS,
+      RES_PARTICLES | RES_SOA | RES_DIFFUSE_POTENTIALS | RES_SURFACE_NORMALS | RES_CELL_ACTIVITY, &SPHComputeSystem::passAlwaysEnabled,
+      "SPH step 5: density" },
+    // Step 6: Force calculation
+    { 6, RES_PARTICLES | RES_SOA | RES_CELL_COUNTS | RES_CELL_STARTS | RES_ACTIVE_CELLS | RES_NEIGHBOR_LISTS | RES_VELOCITY_FIELD |
+      RES_PARTICLE_COUNT | RES_DIFFUSE_POTENTIALS | RES_SURFACE_NORMALS | RES_GRID_BLOCKS | RES_DUE_PARTICLES,
+      RES_PARTICLES | RES_DIFFUSE_POTENTIALS | RES_CELL_ACTIVITY, &SPHComputeSystem::passUsesWCSPH, "SPH step 6: forces" },
+    // PCISPH pressure solve in place of step 6 (iterates with its own internal barriers)
+    { PASS_PCISPH, RES_PARTICLES | RES_CELL_COUNTS | RES_CELL_STARTS | RES_PARTICLE_COUNT | RES_GRID_BLOCKS, RES_PARTICLES,
+      &SPHComputeSystem::passUsesPCISPH, "SPH PCISPH solve" },
+    // Implicit viscosity on the velocities step 6 or PCISPH left (its own internal barriers)
+    { PASS_VISCOSITY, RES_PARTICLES | RES_CELL_COUNTS | RES_CELL_STARTS | RES_PARTICLE_COUNT | RES_VISCOSITY_WARM_START | RES_GRID_BLOCKS,
+      RES_PARTICLES | RES_VISCOSITY_WARM_START, &SPHComputeSystem::passUsesImplicitViscosity, "SPH implicit viscosity" },
+};
+
+bool SPHComputeSystem::passAlwaysEnabled() const { return true; }
+bool SPHComputeSystem::passUsesGrid() const { return !listModePass_; }
+bool SPHComputeSystem::passNeedsGridScan() const { return !listModePass_ && passSortMode() == SORT_ATOMIC_SCATTER; }
+bool SPHComputeSystem::passUsesNeighborLists() const { return listModePass_; }
+bool SPHComputeSystem::passNeedsVelocityField() const { return !listModePass_ && useFilteredViscosity_ && passUsesWCSPH(); }
+bool SPHComputeSystem::passUsesWCSPH() const { return !passUsesPCISPH(); }
+bool SPHComputeSystem::passUsesPCISPH() const { return pressureSolver_ == PRESSURE_PCISPH && pcisphProgram_; }
+bool SPHComputeSystem::passUsesImplicitViscosity() const { return implicitViscosity_ && viscosityProgram_; }
+bool SPHComputeSystem::passUsesSleeping() const { return particleSleepingPass_; }
+bool SPHComputeSystem::passUsesGridBlocks() const { return useHierarchicalGrid_ && !listModePass_; }
+bool SPHComputeSystem::passUsesAdaptiveResolution() const { return adaptivePass_; }
+bool SPHComputeSystem::passUsesMultirate() const { return multiratePass_; }
+bool SPHComputeSystem::passUsesNarrowBand() const { return narrowBandPass_; }
+
+// The atomic scatter orders each cell by whichever particle won the cursor first
+SPHComputeSystem::SortMode SPHComputeSystem::passSortMode() const {
+    bool radixSort = mortonProgram_ && radixSortProgram_ && simStep2Program_ && !useIndexSort_;
+    return (deterministic_ || sortMode_ == SORT_MORTON_RADIX) && radixSort ? SORT_MORTON_RADIX : SORT_ATOMIC_SCATTER;
+}
+
+GLbitfield SPHComputeSystem::barrierBitsFor(uint32_t resources) {
+    GLbitfield bits = 0;
+    if (resources & (RES_PARTICLES | RES_SOA | RES_CELL_COUNTS | RES_CELL_STARTS | RES_NEIGHBOR_LISTS | RES_ACTIVE_CELLS |
+                     RES_PARTICLE_COUNT | RES_DIFFUSE_POTENTIALS | RES_CELL_ACTIVITY | RES_SURFACE_NORMALS |
+                     RES_VISCOSITY_WARM_START | RES_GRID_BLOCKS | RES_DUE_PARTICLES | RES_BULK_COLUMNS)) {
+        bits |= GL_SHADER_STORAGE_BARRIER_BIT;
+    }
+    if (resources & (RES_ACTIVE_CELLS | RES_PARTICLE_COUNT | RES_DUE_PARTICLES)) {
+        bits |= GL_COMMAND_BARRIER_BIT; // Indirect dispatch arguments
+    }
+    if (resources & RES_VELOCITY_FIELD) {
+        bits |= GL_SHADER_STORAGE_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT;
+    }
+    return bits;
+}
+
+size_t SPHComputeSystem::resourceBytes(uint32_t resources) const {
+    const GPUMemoryTracker& tracker = GPUMemoryTracker::instance();
+    auto buffers = [&](std::initializer_list<GLuint> names) {
+        size_t bytes = 0;
+        for (GLuint name : names) bytes += tracker.getBufferBytes(name);
+        return bytes;
+    };
+    
+    size_t perParticle = 0;
+    size_t fixed = 0;
+    if (resources & RES_PARTICLES) perParticle += buffers({ particleBuffers_[currentBuffer_] });
+    if (resources & RES_SOA) perParticle += buffers({ soaPositionBuffer_, soaVelocityBuffer_, soaDensityPressureBuffer_ });
+    if (resources & RES_NEIGHBOR_LISTS) perParticle += buffers({ neighborCountBuffer_, neighborListBuffer_ });
+    if (resources & RES_DIFFUSE_POTENTIALS) perParticle += buffers({ diffusePotentialBuffer_ });
+    if (resources & RES_SURFACE_NORMALS) perParticle += buffers({ surfaceNormalBuffer_ });
+    if (resources & RES_VISCOSITY_WARM_START) perParticle += buffers({ viscosityWarmStartBuffers_[0], viscosityWarmStartBuffers_[1] });
+    if (resources & RES_DUE_PARTICLES) perParticle += buffers({ dueParticleBuffer_ });
+    if (resources & RES_CELL_COUNTS) fixed += buffers({ cellCountBuffer_, previousCellCountBuffer_ });
+    if (resources & RES_CELL_STARTS) fixed += buffers({ cellStartBuffer_, cellCursorBuffer_ });
+    if (resources & RES_ACTIVE_CELLS) fixed += buffers({ activeCellBuffer_, sparseDispatchBuffer_ });
+    if (resources & RES_VELOCITY_FIELD) fixed += tracker.getTextureBytes(velocityTexture_);
+    if (resources & RES_PARTICLE_COUNT) fixed += buffers({ particleCountBuffer_ });
+    if (resources & RES_CELL_ACTIVITY) fixed += buffers({ cellActivityBuffer_ });
+    if (resources & RES_GRID_BLOCKS) fixed += buffers({ blockSlotBuffer_ });
+    if (resources & RES_BULK_COLUMNS) fixed += buffers({ bulkColumnBuffer_ });
+    
+    double live = particleCapacity_ > 0 ? double(numParticles_) / double(particleCapacity_) : 1.0;
+    return fixed + static_cast<size_t>(double(perParticle) * std::min(live, 1.0));
+}
+
+void SPHComputeSystem::runPassGraph() {
+    updateParameterBlock();
+    
+    // Profiling marks the substep's start and then the end of every pass
+    auto markPass = [this](int pass) {
+        size_t used = passTimerMarks_.size();
+        if (used == passTimerQueries_.size()) {
+            GLuint query = 0;
+            glCreateQueries(GL_TIMESTAMP, 1, &query);
+            passTimerQueries_.push_back(query);
+        }
+        glQueryCounter(passTimerQueries_[used], GL_TIMESTAMP);
+        passTimerMarks_.push_back(pass);
+    };
+    if (passProfiling_) {
+        markPass(0);
+        passProfile_.substeps++;
+    }
+    
+    for (const PassDesc& desc : PASS_GRAPH) {
+        if (!(this->*desc.enabled)()) continue;
+        
+        // Read-after-write and write-after-write on anything written since the last barrier
+        uint32_t hazards = (desc.reads | desc.writes) & pendingWrites_;
+        if (hazards) {
+            glMemoryBarrier(barrierBitsFor(hazards));
+            pendingWrites_ &= ~hazards;
+        }
+        
+        {
+            ProfileScope scope(desc.name);
+            runSimulationPass(desc.pass);
+        }
+        GPUMemoryTracker::instance().addTraffic(desc.name, resourceBytes(desc.reads), resourceBytes(desc.writes));
+        pendingWrites_ |= desc.writes;
+        if (passProfiling_) {
+            markPass(desc.pass);
+        }
+    }
+}
+
+void SPHComputeSystem::setPassProfiling(bool enable) {
+    passProfiling_ = enable;
+    passTimerMarks_.clear();
+    passProfile_ = SPHPassProfile();
+}
+
+SPHPassProfile SPHComputeSystem::takePassProfile() {
+    // Blocks on the last timestamps; every earlier one has landed by then
+    GLuint64 previous = 0;
+    for (size_t i = 0; i < passTimerMarks_.size(); i++) {
+        GLuint64 timestamp = 0;
+        glGetQueryObjectui64v(passTimerQueries_[i], GL_QUERY_RESULT, &timestamp);
+        int pass = passTimerMarks_[i];
+        if (pass > 0 && pass < SPHPassProfile::PASS_SLOTS) {
+            passProfile_.passMs[pass] += static_cast<float>(timestamp - previous) / 1.0e6f;
+            passProfile_.passRuns[pass]++;
+        }
+        previous = timestamp;
+    }
+    
+    SPHPassProfile profile = passProfile_;
+    passTimerMarks_.clear();
+    passProfile_ = SPHPassProfile();
+    return profile;
+}
+
+SPHGridOccupancy SPHComputeSystem::measureGridOccupancy(uint32_t sampleCount) {
+    SPHGridOccupancy occupancy;
+    syncParticleCount();
+    flushPassBarriers();
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    if (numParticles_ == 0 || cellCount_ == 0) return occupancy;
+    
+    std::vector<uint32_t> counts(cellCount_);
+    glGetNamedBufferSubData(cellCountBuffer_, 0, counts.size() * sizeof(uint32_t), counts.data());
+    std::vector<SPHParticleCompute> particles(numParticles_);
+    glGetNamedBufferSubData(particleBuffers_[currentBuffer_], 0, particles.size() * sizeof(SPHParticleCompute), particles.data());
+    
+    uint64_t occupiedParticles = 0;
+    for (uint32_t count : counts) {
+        if (count == 0) continue;
+        occupancy.occupiedCells++;
+        occupancy.maxCellParticles = std::max(occupancy.maxCellParticles, count);
+        occupiedParticles += count;
+    }
+    occupancy.particles = numParticles_;
+    occupancy.meanCellParticles = occupancy.occupiedCells ? float(occupiedParticles) / float(occupancy.occupiedCells) : 0.0f;
+    
+    // Bucket the particles the way step 1 does, so the sample searches the same cells
+    glm::vec3 invCellSize = glm::vec3(gridRes_) * (1.0f - 0.001f) / gridSize_;
+    auto cellOf = [&](const glm::vec3& position) {
+        return glm::clamp(glm::ivec3(glm::floor((position - gridOrigin_) * invCellSize)), glm::ivec3(0), gridRes_ - 1);
+    };
+    auto cellIndex = [&](const glm::ivec3& cell) {
+        return (uint32_t(cell.z) * uint32_t(gridRes_.y) + uint32_t(cell.y)) * uint32_t(gridRes_.x) + uint32_t(cell.x);
+    };
+    // The dense layout, whatever the GPU grid allocates
+    uint32_t gridCells = gridDim_.x * gridDim_.y * gridDim_.z;
+    std::vector<uint32_t> cellStarts(gridCells + 1, 0);
+    for (const SPHParticleCompute& particle : particles) {
+        cellStarts[cellIndex(cellOf(particle.position)) + 1]++;
+    }
+    for (uint32_t cell = 0; cell < gridCells; cell++) {
+        cellStarts[cell + 1] += cellStarts[cell];
+    }
+    std::vector<uint32_t> cursor(cellStarts.begin(), cellStarts.end() - 1);
+    std::vector<glm::vec3> sorted(numParticles_);
+    for (const SPHParticleCompute& particle : particles) {
+        sorted[cursor[cellIndex(cellOf(particle.position))]++] = particle.position;
+    }
+    
+    float radiusSq = shaderParameters_.kernelRadius * shaderParameters_.kernelRadius;
+    uint32_t stride = std::max(numParticles_ / std::max(sampleCount, 1u), 1u);
+    uint64_t candidates = 0, neighbors = 0, sampled = 0;
+    for (uint32_t i = 0; i < numParticles_; i += stride) {
+        glm::vec3 position = particles[i].position;
+        glm::ivec3 cell = cellOf(position);
+        for (int z = -1; z <= 1; z++) {
+            for (int y = -1; y <= 1; y++) {
+                for (int x = -1; x <= 1; x++) {
+                    glm::ivec3 neighbor = cell + glm::ivec3(x, y, z);
+                    if (glm::any(glm::lessThan(neighbor, glm::ivec3(0))) || glm::any(glm::greaterThanEqual(neighbor, gridRes_))) continue;
+                    uint32_t index = cellIndex(neighbor);
+                    candidates += cellStarts[index + 1] - cellStarts[index];
+                    for (uint32_t j = cellStarts[index]; j < cellStarts[index + 1]; j++) {
+                        glm::vec3 offset = sorted[j] - position;
+                        neighbors += glm::dot(offset, offset) < radiusSq ? 1 : 0;
+                    }
+                }
+            }
+        }
+        sampled++;
+    }
+    occupancy.candidatesPerParticle = float(double(candidates) / double(sampled));
+    occupancy.neighborsPerParticle = float(double(neighbors) / double(sampled));
+    return occupancy;
+}
+
+void SPHComputeSystem::flushPassBarriers() {
+    if (pendingWrites_) {
+        glMemoryBarrier(barrierBitsFor(pendingWrites_));
+        pendingWrites_ = 0;
+    }
+}
+
+void SPHComputeSystem::updateParameterBlock() {
+    SPHParameterBlock block = {};
+    block.gridOrigin = gridOrigin_;
+    block.dt = timeStep_;
+    block.gridSize = gridSize_;
+    block.maxVelocity = velocityLimit_;
+    block.invCellSize = glm::vec3(gridRes_) * (1.0f - 0.001f) / gridSize_;
+    block.wallDamping = wallDamping_;
+    block.gridRes = gridRes_;
+    block.sceneStride = sceneStride_;
+    block.gravity = gravity_;
+    block.sceneCount = static_cast<int32_t>(getSceneCount());
+    // PCISPH integrates gravity with its other non-pressure forces
+    block.stepGravity = passUsesPCISPH() ? glm::vec3(0.0f) : gravity_;
+    block.batchScenes = static_cast<int32_t>(sceneParameters_.size());
+    block.particleMass = shaderParameters_.mass;
+    float halfSkin = SPHConstants::NEIGHBOR_SKIN * 0.5f;
+    block.halfSkinSq = halfSkin * halfSkin;
+    block.listStride = particleCapacity_;
+    block.useNeighborList = useNeighborLists_ ? 1 : 0;
+    block.diffusePotentials = useDiffuseParticles_ && diffuseProgram_ ? 1 : 0;
+    block.particleSleeping = particleSleepingPass_ ? 1 : 0;
+    block.sleepSubsteps = static_cast<uint32_t>(sleepSubsteps_);
+    block.sleepVelocity = sleepVelocity_;
+    block.sleepDensityChange = sleepDensityChange_;
+    
+    // Most substeps change nothing but dt, if that
+    if (std::memcmp(&block, &parameterBlock_, sizeof(block)) != 0) {
+        parameterBlock_ = block;
+        glNamedBufferSubData(parameterBuffer_, 0, sizeof(block), &block);
+    }
+    glBindBufferBase(GL_UNIFORM_BUFFER, 0, parameterBuffer_);
+    glBindBufferBase(GL_UNIFORM_BUFFER, 3, phaseBuffer_);
+}
+
+void SPHComputeSystem::runSimulationPass(int pass) {
+    glm::vec3 invCellSize = glm::vec3(gridRes_) * (1.0f - 0.001f) / gridSize_;
+    
+    // Nothing else uses the SoA binding points, so every pass can share them
+    bindSoABuffers();
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 24, particleCountBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 41, sceneParameterBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 56, blockSlotBuffer_);
+#ifdef SPH_GPU_COUNTERS
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 43, counterBuffer_);
+#endif
+    
+    switch (pass) {
+        case 1: // Step 1: Position integration and grid population
             if (simStep1Program_) {
                 glUseProgram(simStep1Program_);
                 
-                glUniform1f(glGetUniformLocation(simStep1Program_, "uDT"), SPHConstants::DT);
-                glUniform3fv(glGetUniformLocation(simStep1Program_, "uGravity"), 1, &gravity_[0]);
-                glUniform3fv(glGetUniformLocation(simStep1Program_, "uGridOrigin"), 1, &gridOrigin_[0]);
-                glUniform3fv(glGetUniformLocation(simStep1Program_, "uGridSize"), 1, &gridSize_[0]);
-                glUniform3fv(glGetUniformLocation(simStep1Program_, "uInvCellSize"), 1, &invCellSize[0]);
+                // Neighbor list displacement check
+                glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 13, rebuildFlagBuffer_);
+                glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 17, referencePositionBuffer_);
+                
+                // Sinks; list mode keeps the particle order, so nothing can be compacted, and
+                // the index sort compacts only when it gathers
+                GLsizei sinkCount = static_cast<GLsizei>(sinkMins_.size());
+                bool removeParticles = !listModePass_ && (!useIndexSort_ || gatherPass_);
+                glUniform1i(glGetUniformLocation(simStep1Program_, "uRemoveParticles"), removeParticles ? 1 : 0);
+                glUniform1i(glGetUniformLocation(simStep1Program_, "uSinkCount"), sinkCount);
+                if (sinkCount > 0) {
+                    glUniform3fv(glGetUniformLocation(simStep1Program_, "uSinkMin"), sinkCount, &sinkMins_[0][0]);
+                    glUniform3fv(glGetUniformLocation(simStep1Program_, "uSinkMax"), sinkCount, &sinkMaxs_[0][0]);
+                }
+                
+                // Heightfield coupling: one particle's volume spread over the texel it lands in
+                const SPHHeightfieldCoupling& coupling = heightfieldCoupling_;
+                bool coupleHeightfield = coupling.heightTexture && coupling.depositBuffer && coupling.resolution > 0;
+                glUniform1i(glGetUniformLocation(simStep1Program_, "uHeightfieldCoupling"), coupleHeightfield ? 1 : 0);
+                if (coupleHeightfield) {
+                    float texelSize = coupling.surfaceSize / static_cast<float>(coupling.resolution);
+                    float particleVolume = std::pow(SPHConstants::PARTICLE_RADIUS * 2.0f, 3.0f);
+                    glBindTextureUnit(2, coupling.heightTexture);
+                    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 61, coupling.depositBuffer);
+                    glUniform1i(glGetUniformLocation(simStep1Program_, "uHeightfieldResolution"), coupling.resolution);
+                    glUniform1f(glGetUniformLocation(simStep1Program_, "uHeightfieldSize"), coupling.surfaceSize);
+                    glUniform1f(glGetUniformLocation(simStep1Program_, "uHeightfieldLevel"), coupling.waterLevel);
+                    glUniform1f(glGetUniformLocation(simStep1Program_, "uHeightfieldBand"), coupling.bandDepth);
+                    glUniform1f(glGetUniformLocation(simStep1Program_, "uHeightfieldDeposit"),
+                                particleVolume / (texelSize * texelSize) * coupling.depositScale);
+                }
+                
+                // Narrow band: the bulk's top and slope under the band
+                glUniform1i(glGetUniformLocation(simStep1Program_, "uNarrowBand"), narrowBand_ && bulkColumnBuffer_ ? 1 : 0);
+                if (narrowBand_ && bulkColumnBuffer_) {
+                    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 72, bulkColumnBuffer_);
+                    glUniform2iv(glGetUniformLocation(simStep1Program_, "uColumnRes"), 1, &bulkColumnRes_[0]);
+                    glUniform1f(glGetUniformLocation(simStep1Program_, "uColumnSize"), bulkColumnSize());
+                    glUniform1f(glGetUniformLocation(simStep1Program_, "uBulkFloor"), bulkFloor());
+                    glUniform1f(glGetUniformLocation(simStep1Program_, "uBulkReach"), shaderParameters_.kernelRadius);
+                }
+                
+                // Sparse domain / tiled loop: restart the active-cell list and its indirect dispatches
+                bool trackActiveCells = useSparseDomain_ || tiledNeighborPass_;
+                glUniform1i(glGetUniformLocation(simStep1Program_, "uTrackActiveCells"), trackActiveCells ? 1 : 0);
+                if (trackActiveCells) {
+                    const uint32_t dispatchReset[8] = { 0, 1, 1, 0, 0, 1, 1, 0 };
+                    glNamedBufferSubData(sparseDispatchBuffer_, 0, sizeof(dispatchReset), dispatchReset);
+                    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 21, activeCellBuffer_);
+                    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 22, sparseDispatchBuffer_);
+                }
+                
+                // Particle sleeping: hold the particles of sleeping cells, record cell changes
+                glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 38, cellActivityBuffer_);
+                
+                // Multirate: only the due time levels move
+                glUniform1i(glGetUniformLocation(simStep1Program_, "uMultirate"), multiratePass_ ? 1 : 0);
+                glUniform1ui(glGetUniformLocation(simStep1Program_, "uTimeSubstep"), multirateSubstep_);
                 
                 // Sphere collision uniforms
                 glUniform3fv(glGetUniformLocation(simStep1Program_, "uSpherePosition"), 1, &spherePosition_[0]);
@@ -540,12 +2687,37 @@ void SPHComputeSystem::runSimulationPass(int pass) {
                 glUniform1f(glGetUniformLocation(simStep1Program_, "uSphereRadius"), sphereRadius_);
                 glUniform1i(glGetUniformLocation(simStep1Program_, "uSphereActive"), sphereActive_ ? 1 : 0);
                 
+                // Coupled sphere, kept one particle radius clear of the particle centres
+                glm::vec4 coupledSphere(coupledSphereCenter_, coupledSphereRadius_ + SPHConstants::PARTICLE_RADIUS);
+                glUniform1i(glGetUniformLocation(simStep1Program_, "uCoupledSphereActive"), coupledSphereValid_ ? 1 : 0);
+                glUniform4fv(glGetUniformLocation(simStep1Program_, "uCoupledSphere"), 1, &coupledSphere[0]);
+                glUniform3fv(glGetUniformLocation(simStep1Program_, "uCoupledSphereVelocity"), 1, &coupledSphereVelocity_[0]);
+                glUniform1f(glGetUniformLocation(simStep1Program_, "uCoupledSphereFriction"), sphereFriction_);
+                glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 37, sphereImpulseBuffer_);
+                
+                // Rigid bodies, looked up through their broadphase grid
+                glUniform1i(glGetUniformLocation(simStep1Program_, "uRigidBodyCount"), static_cast<GLint>(rigidBodies_.count));
+                if (rigidBodies_.count > 0) {
+                    glUniform3iv(glGetUniformLocation(simStep1Program_, "uRigidBodyGridRes"), 1, &rigidBodies_.gridRes[0]);
+                    glUniform1i(glGetUniformLocation(simStep1Program_, "uRigidBodyCellFactor"), rigidBodies_.cellFactor);
+                    glUniform1f(glGetUniformLocation(simStep1Program_, "uRigidBodySkin"), SPHConstants::PARTICLE_RADIUS);
+                    glUniform1f(glGetUniformLocation(simStep1Program_, "uRigidBodyFriction"), rigidBodies_.friction);
+                    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 46, rigidBodies_.stateBuffer);
+                    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 47, rigidBodies_.impulseBuffer);
+                    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 48, rigidBodies_.gridBuffer);
+                }
+                
+                // Container walls and static obstacles
+                bool obstacleField = useObstacleField_ && obstacleFieldTexture_ && !obstacleFieldDirty_;
+                glUniform1i(glGetUniformLocation(simStep1Program_, "uUseObstacleField"), obstacleField ? 1 : 0);
+                if (obstacleField) {
+                    glBindTextureUnit(1, obstacleFieldTexture_);
+                }
+                
                 glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, particleBuffers_[currentBuffer_]);
-                glBindImageTexture(0, gridTexture_, 0, GL_TRUE, 0, GL_READ_WRITE, GL_R32UI);
+                glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, cellCountBuffer_);
                 
-                uint32_t workGroups = (numParticles_ + 31) / 32;
-                glDispatchCompute(workGroups, 1, 1);
-                glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+                dispatchParticles(32);
                 
                 // Reset sphere impulse after applying it
                 if (sphereActive_) {
@@ -557,105 +2729,1101 @@ void SPHComputeSystem::runSimulationPass(int pass) {
             
         case 2: // Step 2: Grid offset calculation
             if (simStep2Program_) {
-                glUseProgram(simStep2Program_);
-                
-                // Clear counter buffer
-                uint32_t zero = 0;
-                glNamedBufferSubData(counterBuffer_, 0, sizeof(uint32_t), &zero);
-                
-                glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, counterBuffer_);
-                glBindImageTexture(0, gridTexture_, 0, GL_TRUE, 0, GL_READ_WRITE, GL_R32UI);
-                
-                uint32_t workGroupsX = (gridDim_.x + 3) / 4;
-                uint32_t workGroupsY = (gridDim_.y + 3) / 4;
-                uint32_t workGroupsZ = (gridDim_.z + 3) / 4;
-                glDispatchCompute(workGroupsX, workGroupsY, workGroupsZ);
-                glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+                dispatchPrefixScan(cellCountBuffer_, cellStartBuffer_, cellCursorBuffer_, cellCount_);
             }
             break;
             
         case 3: // Step 3: Particle reordering
-            if (simStep3Program_) {
+            if (passSortMode() == SORT_MORTON_RADIX) {
+                sortParticlesMorton(invCellSize);
+                swapBuffers();
+                compactParticleCount();
+            } else if (useIndexSort_ && simStep3Program_) {
+                sortParticleIndices();
+            } else if (simStep3Program_) {
                 glUseProgram(simStep3Program_);
                 
-                glUniform3fv(glGetUniformLocation(simStep3Program_, "uInvCellSize"), 1, &invCellSize[0]);
-                glUniform3fv(glGetUniformLocation(simStep3Program_, "uGridOrigin"), 1, &gridOrigin_[0]);
                 
                 // Bind input buffer (current) and output buffer (opposite)
                 glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, particleBuffers_[currentBuffer_]);
                 glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, particleBuffers_[1 - currentBuffer_]);
-                glBindImageTexture(0, gridTexture_, 0, GL_TRUE, 0, GL_READ_WRITE, GL_R32UI);
+                glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, cellCursorBuffer_);
+                bindViscosityWarmStart(simStep3Program_);
+#ifdef SPH_GPU_COUNTERS
+                glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, cellCountBuffer_);
+                glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, cellStartBuffer_);
+#endif
                 
-                uint32_t workGroups = (numParticles_ + 31) / 32;
-                glDispatchCompute(workGroups, 1, 1);
-                glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+                dispatchParticles(32);
                 
                 // Swap buffers after reordering
                 swapBuffers();
+                
+                // The reorder reads the live count the compaction rewrites
+                glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+                compactParticleCount();
             }
             break;
             
         case 4: // Step 4: Velocity field calculation
             if (simStep4Program_) {
+                ensureVelocityField();
                 glUseProgram(simStep4Program_);
                 
-                glUniform3fv(glGetUniformLocation(simStep4Program_, "uGridOrigin"), 1, &gridOrigin_[0]);
-                glUniform3fv(glGetUniformLocation(simStep4Program_, "uGridSize"), 1, &gridSize_[0]);
-                glUniform3iv(glGetUniformLocation(simStep4Program_, "uGridRes"), 1, &gridRes_[0]);
-                
                 glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, particleBuffers_[currentBuffer_]);
-                glBindImageTexture(0, gridTexture_, 0, GL_TRUE, 0, GL_READ_ONLY, GL_R32UI);
-                glBindImageTexture(1, velocityTexture_, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA32F);
-                
-                uint32_t workGroupsX = (gridDim_.x + 3) / 4;
-                uint32_t workGroupsY = (gridDim_.y + 3) / 4;
-                uint32_t workGroupsZ = (gridDim_.z + 3) / 4;
-                glDispatchCompute(workGroupsX, workGroupsY, workGroupsZ);
-                glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+                glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, cellCountBuffer_);
+                glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, cellStartBuffer_);
+                
+                // Only occupied voxels are written; the rest must read as empty, not as last substep's fluid
+                glClearTexImage(velocityTexture_, 0, GL_RGBA, GL_HALF_FLOAT, nullptr);
+                glBindImageTexture(1, velocityTexture_, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+                
+                if (useSparseDomain_) {
+                    // One invocation per active cell, step 1 sized the dispatch on the GPU. The
+                    // full list even when sleeping: particles next to sleeping cells sample them
+                    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 21, activeCellBuffer_);
+                    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 22, sparseDispatchBuffer_);
+                    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, sparseDispatchBuffer_);
+                    glDispatchComputeIndirect(0);
+                    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+                } else {
+                    glm::uvec3 fieldDim = (gridDim_ + 1u) / 2u;
+                    glDispatchCompute((fieldDim.x + 3) / 4, (fieldDim.y + 3) / 4, (fieldDim.z + 3) / 4);
+                }
             }
             break;
             
         case 5: // Step 5: Density and pressure calculation
-            if (simStep5Program_) {
-                glUseProgram(simStep5Program_);
+            if (GLuint program = tiledNeighborPass_ ? simStep5TiledProgram_ : simStep5Program_) {
+                glUseProgram(program);
                 
-                glUniform3fv(glGetUniformLocation(simStep5Program_, "uInvCellSize"), 1, &invCellSize[0]);
-                glUniform3fv(glGetUniformLocation(simStep5Program_, "uGridOrigin"), 1, &gridOrigin_[0]);
-                glUniform3iv(glGetUniformLocation(simStep5Program_, "uGridRes"), 1, &gridRes_[0]);
+                glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 15, neighborCountBuffer_);
+                glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 16, neighborListBuffer_);
                 
                 glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, particleBuffers_[currentBuffer_]);
-                glBindImageTexture(0, gridTexture_, 0, GL_TRUE, 0, GL_READ_ONLY, GL_R32UI);
+                glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, cellCountBuffer_);
+                glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, cellStartBuffer_);
+                glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 28, kernelTableBuffer_);
+                glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 32, diffusePotentialBuffer_);
+                glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 50, surfaceNormalBuffer_);
+                glUniform1f(glGetUniformLocation(program, "uSurfaceTension"), surfaceTension_);
                 
-                uint32_t workGroups = (numParticles_ + 63) / 64;
-                glDispatchCompute(workGroups, 1, 1);
-                glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+                if (tiledNeighborPass_) {
+                    dispatchActiveCells(program);
+                } else {
+                    dispatchParticles(shaderParameters_.workGroupSize);
+                }
             }
             break;
             
         case 6: // Step 6: Force calculation
-            if (simStep6Program_) {
-                glUseProgram(simStep6Program_);
+            if (GLuint program = tiledNeighborPass_ ? simStep6TiledProgram_ : simStep6Program_) {
+                glUseProgram(program);
                 
-                glUniform1f(glGetUniformLocation(simStep6Program_, "uDT"), SPHConstants::DT);
-                glUniform3fv(glGetUniformLocation(simStep6Program_, "uGravity"), 1, &gravity_[0]);
-                glUniform3fv(glGetUniformLocation(simStep6Program_, "uInvCellSize"), 1, &invCellSize[0]);
-                glUniform3fv(glGetUniformLocation(simStep6Program_, "uGridOrigin"), 1, &gridOrigin_[0]);
-                glUniform3iv(glGetUniformLocation(simStep6Program_, "uGridRes"), 1, &gridRes_[0]);
+                glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 15, neighborCountBuffer_);
+                glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 16, neighborListBuffer_);
                 
                 glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, particleBuffers_[currentBuffer_]);
-                glBindImageTexture(0, gridTexture_, 0, GL_TRUE, 0, GL_READ_ONLY, GL_R32UI);
+                glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, cellCountBuffer_);
+                glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, cellStartBuffer_);
+                glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 28, kernelTableBuffer_);
+                glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 32, diffusePotentialBuffer_);
+                glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 50, surfaceNormalBuffer_);
+                glUniform1f(glGetUniformLocation(program, "uSurfaceTension"), surfaceTension_);
+                glUniform1i(glGetUniformLocation(program, "uImplicitViscosity"), passUsesImplicitViscosity() ? 1 : 0);
                 
-                // Bind velocity texture for filtered viscosity (optional)
+                // Filtered viscosity samples the field step 4 wrote this substep in place of the neighbor sum
+                bool filteredViscosity = passNeedsVelocityField() && velocityTexture_;
+                glUniform1i(glGetUniformLocation(program, "uFilteredViscosity"), filteredViscosity ? 1 : 0);
                 glActiveTexture(GL_TEXTURE0);
-                glBindTexture(GL_TEXTURE_3D, velocityTexture_);
-                glUniform1i(glGetUniformLocation(simStep6Program_, "velocityField"), 0);
+                glBindTexture(GL_TEXTURE_3D, filteredViscosity ? velocityTexture_ : 0);
+                glUniform1i(glGetUniformLocation(program, "velocityField"), 0);
+                
+                // Multirate: indirectly over the due particles
+                glUniform1i(glGetUniformLocation(program, "uMultirate"), multiratePass_ ? 1 : 0);
+                glUniform1ui(glGetUniformLocation(program, "uTimeSubstep"), multirateSubstep_);
+                glUniform1ui(glGetUniformLocation(program, "uTimeLevels"), SPHConstants::MULTIRATE_LEVELS);
+                glUniform1f(glGetUniformLocation(program, "uMultirateCFL"), SPHConstants::MULTIRATE_CFL_FACTOR);
+                glUniform1f(glGetUniformLocation(program, "uMultirateForce"), SPHConstants::FORCE_FACTOR);
+                glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 58, dueParticleBuffer_);
+                glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 59, dueDispatchBuffer_);
+                
+                if (tiledNeighborPass_) {
+                    dispatchActiveCells(program);
+                } else if (multiratePass_) {
+                    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, dueDispatchBuffer_);
+                    glDispatchComputeIndirect(0);
+                    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+                } else {
+                    dispatchParticles(shaderParameters_.workGroupSize);
+                }
+            }
+            break;
+            
+        case PASS_TIME_LEVELS: // Multirate: compact the due particles for step 6
+            glUseProgram(timeLevelProgram_);
+            glUniform1ui(glGetUniformLocation(timeLevelProgram_, "uTimeSubstep"), multirateSubstep_);
+            glUniform1ui(glGetUniformLocation(timeLevelProgram_, "uGroupSize"), static_cast<GLuint>(shaderParameters_.workGroupSize));
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, particleBuffers_[currentBuffer_]);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 58, dueParticleBuffer_);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 59, dueDispatchBuffer_);
+            dispatchParticles(64);
+            break;
+            
+        case PASS_NEIGHBOR_LISTS: // Verlet list rebuild (only if step 1 raised the flag)
+            buildNeighborLists();
+            break;
+            
+        case PASS_PCISPH: // PCISPH pressure solve and velocity update
+            solvePCISPH();
+            break;
+            
+        case PASS_SLEEP: // Particle sleeping: pick the awake cells
+            updateSleepingCells();
+            break;
+            
+        case PASS_VISCOSITY: // Implicit viscosity solve and velocity update
+            solveImplicitViscosity();
+            break;
+            
+        case PASS_GRID_BLOCKS: // Hierarchical grid: block allocation and fine cell counts
+            if (gridBlockProgram_) {
+                glUseProgram(gridBlockProgram_);
+                glUniform1ui(glGetUniformLocation(gridBlockProgram_, "uBlockCount"), gridBlockCount_);
+                glUniform1ui(glGetUniformLocation(gridBlockProgram_, "uBlockCapacity"), gridBlockCapacity_);
+                GLint phaseLoc = glGetUniformLocation(gridBlockProgram_, "uBlockPhase");
+                
+                glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, particleBuffers_[currentBuffer_]);
+                glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, cellCountBuffer_);
+                glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 57, blockStateBuffer_);
                 
-                uint32_t workGroups = (numParticles_ + 63) / 64;
-                glDispatchCompute(workGroups, 1, 1);
+                glUniform1i(phaseLoc, 0);
+                glDispatchCompute((gridBlockCount_ + 63) / 64, 1, 1);
                 glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+                
+                glUniform1i(phaseLoc, 1);
+                dispatchParticles(64);
+            }
+            break;
+            
+        case PASS_ADAPTIVE: { // Adaptive resolution: merges and splits, then the count
+            // Splits append past the CPU count, an upper bound of the GPU one
+            uint32_t budget = std::min(SPHConstants::ADAPTIVE_SPLIT_BUDGET, particleCapacity_ - std::min(numParticles_, particleCapacity_));
+            float restDensities[SPHConstants::MAX_PHASES];
+            for (uint32_t phase = 0; phase < SPHConstants::MAX_PHASES; phase++) {
+                restDensities[phase] = phase < phases_.size() ? phases_[phase].restDensity : shaderParameters_.restDensity;
+            }
+            // Interior has to stay clear of the surface band, or a pair would merge and split back
+            float mergeRatio = std::max(adaptiveMergeDensityRatio_, surfaceDensityRatio_ + 0.05f);
+            
+            glUseProgram(adaptiveProgram_);
+            glUniform1ui(glGetUniformLocation(adaptiveProgram_, "uSplitBudget"), budget);
+            glUniform1f(glGetUniformLocation(adaptiveProgram_, "uMergeDistance"), 0.5f * shaderParameters_.kernelRadius);
+            glUniform1f(glGetUniformLocation(adaptiveProgram_, "uSplitOffset"), 0.5f * SPHConstants::PARTICLE_RADIUS);
+            glUniform1f(glGetUniformLocation(adaptiveProgram_, "uMergeDensityRatio"), mergeRatio);
+            glUniform1f(glGetUniformLocation(adaptiveProgram_, "uSurfaceDensityRatio"), surfaceDensityRatio_);
+            glUniform1fv(glGetUniformLocation(adaptiveProgram_, "uPhaseRestDensity"), SPHConstants::MAX_PHASES, restDensities);
+            glUniform3fv(glGetUniformLocation(adaptiveProgram_, "uCameraPosition"), 1, &cameraPosition_[0]);
+            glUniform1f(glGetUniformLocation(adaptiveProgram_, "uDetailDistance"), adaptiveDetailDistance_);
+            glUniform1f(glGetUniformLocation(adaptiveProgram_, "uSplitDistance"), 0.75f * adaptiveDetailDistance_);
+            GLint phaseLoc = glGetUniformLocation(adaptiveProgram_, "uAdaptivePhase");
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, particleBuffers_[currentBuffer_]);
+            
+            glUniform1i(phaseLoc, 0);
+            dispatchParticles(64);
+            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+            glUniform1i(phaseLoc, 1);
+            dispatchParticles(64);
+            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+            
+            glUseProgram(particleCountProgram_);
+            glUniform1i(glGetUniformLocation(particleCountProgram_, "uAddSplits"), 1);
+            glUniform1ui(glGetUniformLocation(particleCountProgram_, "uSpawnCount"), budget);
+            glUniform1ui(glGetUniformLocation(particleCountProgram_, "uCapacity"), particleCapacity_);
+            glDispatchCompute(1, 1, 1);
+            glUniform1i(glGetUniformLocation(particleCountProgram_, "uAddSplits"), 0);
+            numParticles_ += budget;
+            break;
+        }
+        
+        case PASS_NARROW_BAND: { // Narrow band: count the band, absorb or seed its edge, then the count
+            // Seeds append past the CPU count, an upper bound of the GPU one
+            uint32_t budget = std::min(SPHConstants::NARROW_BAND_SEED_BUDGET, particleCapacity_ - std::min(numParticles_, particleCapacity_));
+            uint32_t columns = static_cast<uint32_t>(bulkColumnRes_.x * bulkColumnRes_.y);
+            
+            glUseProgram(narrowBandProgram_);
+            setNarrowBandUniforms();
+            glUniform1ui(glGetUniformLocation(narrowBandProgram_, "uSeedBudget"), budget);
+            GLint phaseLoc = glGetUniformLocation(narrowBandProgram_, "uBandPhase");
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, particleBuffers_[currentBuffer_]);
+            
+            glUniform1i(phaseLoc, 0);
+            dispatchParticles(64);
+            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+            glUniform1i(phaseLoc, 1);
+            glDispatchCompute((columns + 63) / 64, 1, 1);
+            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+            glUniform1i(phaseLoc, 2);
+            dispatchParticles(64);
+            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+            
+            glUseProgram(particleCountProgram_);
+            glUniform1i(glGetUniformLocation(particleCountProgram_, "uAddSplits"), 1);
+            glUniform1ui(glGetUniformLocation(particleCountProgram_, "uSpawnCount"), budget);
+            glUniform1ui(glGetUniformLocation(particleCountProgram_, "uCapacity"), particleCapacity_);
+            glDispatchCompute(1, 1, 1);
+            glUniform1i(glGetUniformLocation(particleCountProgram_, "uAddSplits"), 0);
+            numParticles_ += budget;
+            break;
+        }
+    }
+}
+
+void SPHComputeSystem::solvePCISPH() {
+    glUseProgram(pcisphProgram_);
+    glUniform1f(glGetUniformLocation(pcisphProgram_, "uDelta"), pcisphDeltaBase_ / (timeStep_ * timeStep_));
+    glUniform1f(glGetUniformLocation(pcisphProgram_, "uErrorThreshold"), pcisphErrorThreshold_);
+    glUniform1ui(glGetUniformLocation(pcisphProgram_, "uMinIterations"), pcisphMinIterations_);
+    glUniform1i(glGetUniformLocation(pcisphProgram_, "uImplicitViscosity"), passUsesImplicitViscosity() ? 1 : 0);
+    GLint phaseLoc = glGetUniformLocation(pcisphProgram_, "uPhase");
+    
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, particleBuffers_[currentBuffer_]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, cellCountBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, cellStartBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 26, pcisphParticleBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 27, pcisphStateBuffer_);
+    
+    const uint32_t stateReset[4] = { 0, 0, 0, 0 };
+    glNamedBufferSubData(pcisphStateBuffer_, 0, sizeof(stateReset), stateReset);
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    
+    // Phase 0: non-pressure forces
+    glUniform1i(phaseLoc, 0);
+    dispatchParticles(shaderParameters_.workGroupSize);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    
+    // The full iteration count is always issued; once the GPU marks the solve converged
+    // the remaining dispatches return immediately, so there is no CPU round trip
+    for (int iteration = 0; iteration < pcisphMaxIterations_; iteration++) {
+        for (int phase = 1; phase <= 3; phase++) {
+            glUniform1i(phaseLoc, phase);
+            dispatchParticles(shaderParameters_.workGroupSize);
+            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        }
+        
+        glUniform1i(phaseLoc, 4);
+        glDispatchCompute(1, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    }
+    
+    // Phase 5: velocity update with the converged pressure acceleration
+    glUniform1i(phaseLoc, 5);
+    dispatchParticles(shaderParameters_.workGroupSize);
+}
+
+void SPHComputeSystem::solveImplicitViscosity() {
+    glUseProgram(viscosityProgram_);
+    glUniform1f(glGetUniformLocation(viscosityProgram_, "uTolerance"), viscosityTolerance_);
+    GLint phaseLoc = glGetUniformLocation(viscosityProgram_, "uPhase");
+    
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, particleBuffers_[currentBuffer_]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, cellCountBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, cellStartBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 51, viscosityWarmStartBuffers_[currentBuffer_]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 53, viscositySolverBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 54, viscosityPartialBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 55, viscosityStateBuffer_);
+    
+    const uint32_t stateReset[8] = {};
+    glNamedBufferSubData(viscosityStateBuffer_, 0, sizeof(stateReset), stateReset);
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    
+    // Particle phases are dispatched per particle, the reductions as one workgroup
+    auto runPhase = [&](int phase) {
+        glUniform1i(phaseLoc, phase);
+        if (phase == 2 || phase == 4 || phase == 6) {
+            glDispatchCompute(1, 1, 1);
+        } else {
+            dispatchParticles(shaderParameters_.workGroupSize);
+        }
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    };
+    
+    // Diagonal and warm-started guess, then the initial residual
+    runPhase(0);
+    runPhase(1);
+    runPhase(2);
+    
+    // As with PCISPH the full iteration count is issued and converged dispatches return at once
+    for (int iteration = 0; iteration < viscosityMaxIterations_; iteration++) {
+        for (int phase = 3; phase <= 7; phase++) {
+            runPhase(phase);
+        }
+    }
+    
+    // Phase 8: velocities from the solution, and the next substep's guess
+    glUniform1i(phaseLoc, 8);
+    dispatchParticles(shaderParameters_.workGroupSize);
+}
+
+void SPHComputeSystem::setImplicitViscosity(bool enable) {
+    // The warm start stopped following the particles while the solve was off
+    if (enable && !implicitViscosity_) {
+        for (GLuint buffer : viscosityWarmStartBuffers_) {
+            if (buffer) glClearNamedBufferData(buffer, GL_RGBA32F, GL_RGBA, GL_FLOAT, nullptr);
+        }
+    }
+    implicitViscosity_ = enable;
+}
+
+void SPHComputeSystem::computePCISPHDelta() {
+    // Precomputed scaling factor delta = -1 / (beta * (-sum(grad W) . sum(grad W) - sum(grad W . grad W)))
+    // with beta = 2 (dt m / rho0)^2, over a filled neighborhood at the rest spacing
+    const float h = shaderParameters_.kernelRadius;
+    const float spacing = std::cbrt(shaderParameters_.mass / shaderParameters_.restDensity);
+    const float gradientConst = 45.0f / (SPHConstants::PI_VALUE * std::pow(h, 6.0f)); // Must match sph_pcisph.cs
+    const int range = static_cast<int>(std::ceil(h / spacing));
+    
+    glm::vec3 sumGradient(0.0f);
+    float sumGradientDot = 0.0f;
+    for (int z = -range; z <= range; z++) {
+        for (int y = -range; y <= range; y++) {
+            for (int x = -range; x <= range; x++) {
+                glm::vec3 r = glm::vec3(x, y, z) * spacing;
+                float rLen = glm::length(r);
+                if (rLen <= 0.0f || rLen >= h) continue;
+                
+                glm::vec3 gradient = -gradientConst * (h - rLen) * (h - rLen) * (r / rLen);
+                sumGradient += gradient;
+                sumGradientDot += glm::dot(gradient, gradient);
             }
+        }
+    }
+    
+    float massRatio = shaderParameters_.mass / shaderParameters_.restDensity;
+    float denominator = 2.0f * massRatio * massRatio * (glm::dot(sumGradient, sumGradient) + sumGradientDot);
+    pcisphDeltaBase_ = denominator > 0.0f ? 1.0f / denominator : 0.0f;
+}
+
+void SPHComputeSystem::updateKernelTable() {
+    // Entry i holds the kernels at q = r^2 / h^2 = i / (N - 1), with the same constants as
+    // the analytic paths of sph_step5.cs and sph_step6.cs
+    const float h = shaderParameters_.kernelRadius;
+    const float h2 = h * h;
+    const float h6 = h2 * h2 * h2;
+    const float poly6Const = 315.0f / (64.0f * SPHConstants::PI_VALUE * h6 * h2 * h);
+    const float spikyConst = 15.0f / (SPHConstants::PI_VALUE * h6);
+    const float viscosityConst = 45.0f / (SPHConstants::PI_VALUE * h6);
+    const uint32_t last = SPHConstants::KERNEL_TABLE_SIZE - 1;
+    
+    std::vector<glm::vec4> table(SPHConstants::KERNEL_TABLE_SIZE);
+    for (uint32_t i = 0; i <= last; i++) {
+        float q = float(i) / float(last);
+        float r = std::sqrt(q * h2);
+        float d = h2 - q * h2;
+        
+        // The Spiky gradient / r diverges at r = 0; entry 0 holds its value a quarter step
+        // in, far closer than particles get under pressure
+        float rGradient = std::sqrt(std::max(q, 0.25f / float(last)) * h2);
+        table[i] = glm::vec4(poly6Const * d * d * d,
+                             spikyConst * (h - rGradient) * (h - rGradient) / rGradient,
+                             viscosityConst * (h - r),
+                             0.0f);
+    }
+    glNamedBufferSubData(kernelTableBuffer_, 0, table.size() * sizeof(glm::vec4), table.data());
+}
+
+float SPHComputeSystem::timeKernelPass(int pass, int repetitions, GLuint restoreBuffer) {
+    updateParameterBlock();
+    GLsizeiptr size = GLsizeiptr(numParticles_) * sizeof(SPHParticleCompute);
+    GLuint query = 0;
+    glGenQueries(1, &query);
+    
+    glCopyNamedBufferSubData(restoreBuffer, particleBuffers_[currentBuffer_], 0, 0, size);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    if (pass == 6) {
+        // Densities and pressures for the force pass come from the same kernel mode
+        runSimulationPass(5);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    }
+    
+    // Repeats rewrite the same outputs (step 6 keeps accumulating velocity, which does not
+    // change its cost), so only the measured work is in the query
+    glBeginQuery(GL_TIME_ELAPSED, query);
+    for (int i = 0; i < repetitions; i++) {
+        runSimulationPass(pass);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    }
+    glEndQuery(GL_TIME_ELAPSED);
+    
+    GLuint64 elapsed = 0;
+    glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+    glDeleteQueries(1, &query);
+    
+    // Leave the single-pass result for the accuracy comparison
+    glCopyNamedBufferSubData(restoreBuffer, particleBuffers_[currentBuffer_], 0, 0, size);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    runSimulationPass(5);
+    if (pass == 6) {
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        runSimulationPass(6);
+    }
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    
+    return static_cast<float>(elapsed) / 1.0e6f / static_cast<float>(std::max(repetitions, 1));
+}
+
+SPHKernelBenchmark SPHComputeSystem::benchmarkKernels(int repetitions) {
+    GPUMemoryScope memoryScope("SPH");
+    SPHKernelBenchmark result;
+    syncParticleCount();
+    if (numParticles_ == 0 || passUsesPCISPH() || !simStep5Program_) {
+        std::cerr << "ERROR: Kernel benchmark needs particles and the WCSPH pipeline" << std::endl;
+        return result;
+    }
+    repetitions = std::max(repetitions, 1);
+    flushPassBarriers();
+    
+    // Snapshot the particles; every measurement starts from it and it is restored at the end
+    GLsizeiptr size = GLsizeiptr(numParticles_) * sizeof(SPHParticleCompute);
+    GLuint original = 0;
+    glCreateBuffers(1, &original);
+    bufferStorage(original, size, nullptr, 0);
+    glCopyNamedBufferSubData(particleBuffers_[currentBuffer_], original, 0, 0, size);
+    
+    SPHShaderParameters savedParameters = shaderParameters_;
+    std::vector<SPHParticleCompute> before(numParticles_);
+    glGetNamedBufferSubData(original, 0, size, before.data());
+    
+    std::vector<SPHParticleCompute> densities[2];
+    std::vector<SPHParticleCompute> forces[2];
+    float densityMs[2] = {};
+    float forceMs[2] = {};
+    bool complete = true;
+    for (int mode = 0; mode < 2; mode++) {
+        SPHShaderParameters parameters = savedParameters;
+        parameters.kernelTable = mode == 1;
+        if (!loadParameterShaders(parameters)) {
+            complete = false;
             break;
+        }
+        shaderParameters_ = parameters; // Selects the table binding and dispatch size
+        
+        densityMs[mode] = timeKernelPass(5, repetitions, original);
+        densities[mode].resize(numParticles_);
+        glGetNamedBufferSubData(particleBuffers_[currentBuffer_], 0, size, densities[mode].data());
+        
+        forceMs[mode] = timeKernelPass(6, repetitions, original);
+        forces[mode].resize(numParticles_);
+        glGetNamedBufferSubData(particleBuffers_[currentBuffer_], 0, size, forces[mode].data());
+    }
+    
+    shaderParameters_ = savedParameters;
+    loadParameterShaders(savedParameters);
+    glCopyNamedBufferSubData(original, particleBuffers_[currentBuffer_], 0, 0, size);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    deleteBuffers(1, &original);
+    if (!complete) return result;
+    
+    // Relative L2 errors of the table results against the analytic ones
+    double densityDiff = 0.0, densityNorm = 0.0, accelerationDiff = 0.0, accelerationNorm = 0.0;
+    for (uint32_t i = 0; i < numParticles_; i++) {
+        float analytic = densities[0][i].density;
+        float table = densities[1][i].density;
+        densityDiff += double(table - analytic) * double(table - analytic);
+        densityNorm += double(analytic) * double(analytic);
+        result.maxDensityError = std::max(result.maxDensityError, std::abs(table - analytic) / std::max(std::abs(analytic), 1e-6f));
+        
+        glm::vec3 analyticDelta = forces[0][i].velocity - before[i].velocity;
+        glm::vec3 tableDelta = forces[1][i].velocity - before[i].velocity;
+        accelerationDiff += glm::dot(tableDelta - analyticDelta, tableDelta - analyticDelta);
+        accelerationNorm += glm::dot(analyticDelta, analyticDelta);
+    }
+    
+    result.valid = true;
+    result.analyticDensityMs = densityMs[0];
+    result.tableDensityMs = densityMs[1];
+    result.analyticForceMs = forceMs[0];
+    result.tableForceMs = forceMs[1];
+    result.densityError = densityNorm > 0.0 ? static_cast<float>(std::sqrt(densityDiff / densityNorm)) : 0.0f;
+    result.accelerationError = accelerationNorm > 0.0 ? static_cast<float>(std::sqrt(accelerationDiff / accelerationNorm)) : 0.0f;
+    return result;
+}
+
+int SPHComputeSystem::autotuneWorkGroupSize(ComputeAutotuner& tuner, int repetitions) {
+    GPUMemoryScope memoryScope("SPH");
+    syncParticleCount();
+    if (numParticles_ == 0 || !simStep5Program_) {
+        return shaderParameters_.workGroupSize;
+    }
+    
+    // The neighbor loop structure and particle layout decide the winner, so each mode is tuned
+    std::string kernel = "sph.step5-6";
+    if (useNeighborLists_) kernel += ".lists";
+    else if (useTiledNeighborLoop_) kernel += ".tiled";
+    if (particleLayout_ != SPHParticleLayout::AOS) kernel += ".soa";
+    if (shaderParameters_.kernelTable) kernel += ".table";
+    
+    SPHShaderParameters parameters = shaderParameters_;
+    uint32_t cached = 0;
+    if (tuner.lookup(kernel, cached)) {
+        parameters.workGroupSize = static_cast<int>(cached);
+        setShaderParameters(parameters);
+        return shaderParameters_.workGroupSize;
+    }
+    
+    // Run one substep so the grid (or neighbor lists) matches the particles; step 6 leaves
+    // positions alone, so steps 5-6 can then be repeated on that state
+    GLsizeiptr size = GLsizeiptr(numParticles_) * sizeof(SPHParticleCompute);
+    GLuint original = 0, substep = 0;
+    glCreateBuffers(1, &original);
+    glCreateBuffers(1, &substep);
+    bufferStorage(original, size, nullptr, 0);
+    bufferStorage(substep, size, nullptr, 0);
+    glCopyNamedBufferSubData(particleBuffers_[currentBuffer_], original, 0, 0, size);
+    double savedSimulationTime = simulationTime_;
+    float savedAccumulatedTime = accumulatedTime_;
+    
+    accumulatedTime_ = 0.0f;
+    update(adaptiveTimeStep_ && !deterministic_ ? computeAdaptiveTimeStep() : maxTimeStep());
+    glCopyNamedBufferSubData(particleBuffers_[currentBuffer_], substep, 0, 0, size);
+    
+    const int candidates[] = { 32, 64, 256 };
+    SPHShaderParameters best = shaderParameters_;
+    float bestMs = -1.0f;
+    std::cout << "SPH workgroup autotune (" << kernel << "):";
+    for (int candidate : candidates) {
+        parameters.workGroupSize = candidate;
+        if (!loadParameterShaders(parameters)) continue;
+        shaderParameters_ = parameters; // Selects the dispatch size
+        
+        glCopyNamedBufferSubData(substep, particleBuffers_[currentBuffer_], 0, 0, size);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        float ms = tuner.timeDispatch([this]() {
+            runSimulationPass(5);
+            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+            runSimulationPass(6);
+            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        }, repetitions);
+        std::cout << " " << candidate << "=" << ms << "ms";
+        if (bestMs < 0.0f || ms < bestMs) {
+            bestMs = ms;
+            best = parameters;
+        }
+    }
+    std::cout << std::endl;
+    
+    loadParameterShaders(best);
+    shaderParameters_ = best;
+    
+    // Back to the state before the tuning substep; the grid and lists are rebuilt from it
+    glCopyNamedBufferSubData(original, particleBuffers_[currentBuffer_], 0, 0, size);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    deleteBuffers(1, &original);
+    deleteBuffers(1, &substep);
+    simulationTime_ = savedSimulationTime;
+    accumulatedTime_ = savedAccumulatedTime;
+    cellCountsDirty_ = true;
+    neighborListsDirty_ = true;
+    
+    if (bestMs >= 0.0f) {
+        tuner.store(kernel, static_cast<uint32_t>(best.workGroupSize));
+        std::cout << "SPH workgroup size " << best.workGroupSize << " selected" << std::endl;
+    }
+    return shaderParameters_.workGroupSize;
+}
+
+void SPHComputeSystem::dispatchPrefixScan(GLuint input, GLuint output, GLuint cursor, uint32_t count, GLuint blockSums) {
+    uint32_t blockCount = (count + SPHConstants::SCAN_BLOCK_SIZE - 1) / SPHConstants::SCAN_BLOCK_SIZE;
+    
+    glUseProgram(simStep2Program_);
+    glUniform1ui(glGetUniformLocation(simStep2Program_, "uCellCount"), count);
+    glUniform1ui(glGetUniformLocation(simStep2Program_, "uBlockCount"), blockCount);
+    glUniform1i(glGetUniformLocation(simStep2Program_, "uWriteCursor"), cursor ? 1 : 0);
+    GLint phaseLoc = glGetUniformLocation(simStep2Program_, "uScanPhase");
+    
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, input);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, output);
+    if (cursor) glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, cursor);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, blockSums ? blockSums : scanBlockSumBuffer_);
+    
+    // Phase 0: scan each block, phase 1: scan block totals, phase 2: add block offsets
+    glUniform1i(phaseLoc, 0);
+    glDispatchCompute(blockCount, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    
+    glUniform1i(phaseLoc, 1);
+    glDispatchCompute(1, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    
+    glUniform1i(phaseLoc, 2);
+    glDispatchCompute(blockCount, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+void SPHComputeSystem::sortParticlesMorton(const glm::vec3& invCellSize) {
+    // Histogram and scan sizes are chosen on the CPU, so the sort is sized from the
+    // numParticles_ mirror rather than dispatched indirectly
+    uint32_t blockCount = (numParticles_ + SPHConstants::RADIX_BLOCK_SIZE - 1) / SPHConstants::RADIX_BLOCK_SIZE;
+    
+    // Generate Z-order keys for every particle
+    glUseProgram(mortonProgram_);
+    glUniform1ui(glGetUniformLocation(mortonProgram_, "uParticleCount"), numParticles_);
+    glUniform1ui(glGetUniformLocation(mortonProgram_, "uRemovedKey"), mortonRemovedKey_);
+    glUniform3fv(glGetUniformLocation(mortonProgram_, "uInvCellSize"), 1, &invCellSize[0]);
+    glUniform3fv(glGetUniformLocation(mortonProgram_, "uGridOrigin"), 1, &gridOrigin_[0]);
+    glUniform3iv(glGetUniformLocation(mortonProgram_, "uGridRes"), 1, &gridRes_[0]);
+    glUniform1i(glGetUniformLocation(mortonProgram_, "uMortonPhase"), 0);
+    
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, particleBuffers_[currentBuffer_]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, sortKeyBuffers_[0]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, sortValueBuffers_[0]);
+    glDispatchCompute(blockCount, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    
+    // Stable LSD radix sort, 8 bits per pass
+    int src = 0;
+    for (uint32_t pass = 0; pass < radixPassCount_; pass++) {
+        glUseProgram(radixSortProgram_);
+        glUniform1ui(glGetUniformLocation(radixSortProgram_, "uParticleCount"), numParticles_);
+        glUniform1ui(glGetUniformLocation(radixSortProgram_, "uBlockCount"), blockCount);
+        glUniform1ui(glGetUniformLocation(radixSortProgram_, "uShift"), pass * 8);
+        GLint phaseLoc = glGetUniformLocation(radixSortProgram_, "uRadixPhase");
+        
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, radixHistogramBuffer_);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, sortKeyBuffers_[src]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, sortValueBuffers_[src]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, sortKeyBuffers_[1 - src]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 9, sortValueBuffers_[1 - src]);
+        
+        glUniform1i(phaseLoc, 0);
+        glDispatchCompute(blockCount, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        
+        dispatchPrefixScan(radixHistogramBuffer_, radixOffsetBuffer_, 0, blockCount * SPHConstants::RADIX_BINS);
+        
+        glUseProgram(radixSortProgram_);
+        glUniform1i(phaseLoc, 1);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, radixOffsetBuffer_);
+        glDispatchCompute(blockCount, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        
+        src = 1 - src;
+    }
+    
+    // Gather particles into sorted order and mark the first particle of each cell
+    glUseProgram(mortonProgram_);
+    glUniform1i(glGetUniformLocation(mortonProgram_, "uMortonPhase"), 1);
+    
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, particleBuffers_[currentBuffer_]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, particleBuffers_[1 - currentBuffer_]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, cellStartBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, sortKeyBuffers_[src]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, sortValueBuffers_[src]);
+    bindViscosityWarmStart(mortonProgram_);
+    glDispatchCompute(blockCount, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+void SPHComputeSystem::bindViscosityWarmStart(GLuint program) {
+    // The reorders move the warm start with its particle, current to opposite like the particles
+    bool carry = passUsesImplicitViscosity();
+    glUniform1i(glGetUniformLocation(program, "uCarryWarmStart"), carry ? 1 : 0);
+    if (carry) {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 51, viscosityWarmStartBuffers_[currentBuffer_]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 52, viscosityWarmStartBuffers_[1 - currentBuffer_]);
+    }
+}
+
+void SPHComputeSystem::dispatchStatistics() {
+    if (!reduceProgram_) return;
+    
+    // Skip this frame rather than overwrite a slot the CPU has not consumed yet
+    uint32_t slot = readbackWriteIndex_;
+    if (readbackFences_[slot]) return;
+    
+    glUseProgram(reduceProgram_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, particleBuffers_[currentBuffer_]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 19, statisticsBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 20, statisticsPartialBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 24, particleCountBuffer_);
+    
+    glUniform1i(glGetUniformLocation(reduceProgram_, "uReducePhase"), 0);
+    dispatchParticles(SPHConstants::REDUCE_BLOCK_SIZE);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    
+    glUniform1i(glGetUniformLocation(reduceProgram_, "uReducePhase"), 1);
+    glDispatchCompute(1, 1, 1);
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    
+    glCopyNamedBufferSubData(statisticsBuffer_, readbackBuffers_[slot], 0, 0, sizeof(SPHStatistics));
+    readbackFences_[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    readbackSpawned_[slot] = numParticles_ + removedParticles_;
+    readbackWriteIndex_ = (slot + 1) % SPHConstants::READBACK_FRAMES;
+}
+
+void SPHComputeSystem::readBackStatistics(float deltaTime) {
+    readbackAge_ += deltaTime;
+    
+    // Oldest slot first; a zero-timeout wait only polls the fence
+    for (uint32_t i = 0; i < SPHConstants::READBACK_FRAMES; i++) {
+        uint32_t slot = (readbackWriteIndex_ + i) % SPHConstants::READBACK_FRAMES;
+        if (!readbackFences_[slot]) continue;
+        
+        uint32_t newest = (readbackWriteIndex_ + SPHConstants::READBACK_FRAMES - 1) % SPHConstants::READBACK_FRAMES;
+        if (!readbackReady(readbackFences_[slot], slot == newest)) break;
+        
+        glDeleteSync(readbackFences_[slot]);
+        readbackFences_[slot] = 0;
+        
+        SPHStatistics statistics;
+        std::memcpy(&statistics, readbackPointers_[slot], sizeof(SPHStatistics));
+        
+        // Everything spawned by then minus what was live is what had been removed by then;
+        // emits since are already in the mirror, so only the new removals come off it
+        if (readbackSpawned_[slot] > statistics.liveParticles) {
+            uint64_t removed = readbackSpawned_[slot] - statistics.liveParticles;
+            if (removed > removedParticles_) {
+                numParticles_ -= static_cast<uint32_t>(std::min<uint64_t>(removed - removedParticles_, numParticles_));
+                removedParticles_ = removed;
+            }
+        }
+        
+        // Speed-up between samples bounds the acceleration we may meet before the next one
+        if (readbackAge_ > 0.0f) {
+            estimatedMaxAcceleration_ = std::max(0.0f, statistics.maxSpeed - statistics_.maxSpeed) / readbackAge_;
+        }
+        statistics_ = statistics;
+        readbackAge_ = 0.0f;
+    }
+}
+
+void SPHComputeSystem::publishSphereImpulse(float duration) {
+    // As with the statistics, a frame whose slot is still in flight is dropped
+    uint32_t slot = sphereReadbackWriteIndex_;
+    if (sphereReadbackFences_[slot]) return;
+    
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glCopyNamedBufferSubData(sphereImpulseBuffer_, sphereReadbackBuffers_[slot], 0, 0, 4 * sizeof(int32_t));
+    sphereReadbackFences_[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    sphereReadbackDurations_[slot] = duration;
+    sphereReadbackWriteIndex_ = (slot + 1) % SPHConstants::READBACK_FRAMES;
+}
+
+void SPHComputeSystem::readBackSphereForce() {
+    for (uint32_t i = 0; i < SPHConstants::READBACK_FRAMES; i++) {
+        uint32_t slot = (sphereReadbackWriteIndex_ + i) % SPHConstants::READBACK_FRAMES;
+        if (!sphereReadbackFences_[slot]) continue;
+        
+        uint32_t newest = (sphereReadbackWriteIndex_ + SPHConstants::READBACK_FRAMES - 1) % SPHConstants::READBACK_FRAMES;
+        if (!readbackReady(sphereReadbackFences_[slot], slot == newest)) break;
+        
+        glDeleteSync(sphereReadbackFences_[slot]);
+        sphereReadbackFences_[slot] = 0;
+        if (!coupledSphereValid_) continue; // Coupling switched off while in flight
+        
+        // The momentum the fluid gained over the frame is what the sphere lost
+        int32_t impulse[4];
+        std::memcpy(impulse, sphereReadbackPointers_[slot], sizeof(impulse));
+        glm::vec3 momentum = glm::vec3(impulse[0], impulse[1], impulse[2]) / SPHConstants::SPHERE_IMPULSE_SCALE;
+        sphereForce_ = -momentum / sphereReadbackDurations_[slot];
+        sphereContacts_ = static_cast<uint32_t>(impulse[3]);
+    }
+}
+
+bool SPHComputeSystem::dispatchWaterQuery(GLuint pointBuffer, GLuint resultBuffer, uint32_t count) {
+    if (!queryProgram_ || !cellCountBuffer_ || count == 0) return false;
+    
+    // The parameter block still holds the last substep's grid
+    glUseProgram(queryProgram_);
+    glUniform1ui(glGetUniformLocation(queryProgram_, "uQueryCount"), count);
+    glBindBufferBase(GL_UNIFORM_BUFFER, 0, parameterBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, particleBuffers_[currentBuffer_]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, cellCountBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, cellStartBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 14, sortedIndexBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 56, blockSlotBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 68, pointBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 69, resultBuffer);
+    glDispatchCompute((count + 63) / 64, 1, 1);
+    glUseProgram(0);
+    return true;
+}
+
+bool SPHComputeSystem::dispatchSpatialQuery(GLuint queryBuffer, GLuint resultBuffer, uint32_t count) {
+    if (!spatialQueryProgram_ || !cellCountBuffer_ || count == 0) return false;
+    
+    // As dispatchWaterQuery, a workgroup per query
+    glUseProgram(spatialQueryProgram_);
+    glBindBufferBase(GL_UNIFORM_BUFFER, 0, parameterBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, particleBuffers_[currentBuffer_]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, cellCountBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, cellStartBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 14, sortedIndexBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 56, blockSlotBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 70, queryBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 71, resultBuffer);
+    glDispatchCompute(count, 1, 1);
+    glUseProgram(0);
+    return true;
+}
+
+#ifdef SPH_GPU_COUNTERS
+void SPHComputeSystem::publishCounters() {
+    uint32_t slot = counterReadbackWriteIndex_;
+    if (counterReadbackFences_[slot]) return;
+    
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glCopyNamedBufferSubData(counterBuffer_, counterReadbackBuffers_[slot], 0, 0, sizeof(SPHCounters));
+    counterReadbackFences_[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    counterReadbackWriteIndex_ = (slot + 1) % SPHConstants::READBACK_FRAMES;
+}
+
+void SPHComputeSystem::readBackCounters() {
+    for (uint32_t i = 0; i < SPHConstants::READBACK_FRAMES; i++) {
+        uint32_t slot = (counterReadbackWriteIndex_ + i) % SPHConstants::READBACK_FRAMES;
+        if (!counterReadbackFences_[slot]) continue;
+        
+        uint32_t newest = (counterReadbackWriteIndex_ + SPHConstants::READBACK_FRAMES - 1) % SPHConstants::READBACK_FRAMES;
+        if (!readbackReady(counterReadbackFences_[slot], slot == newest)) break;
+        
+        glDeleteSync(counterReadbackFences_[slot]);
+        counterReadbackFences_[slot] = 0;
+        std::memcpy(&counters_, counterReadbackPointers_[slot], sizeof(SPHCounters));
+    }
+}
+#endif
+
+bool SPHComputeSystem::readbackReady(GLsync fence, bool newest) const {
+    // Deterministic mode waits for every slot but the newest and never takes the newest,
+    // so each readback lands the same number of updates after it was issued
+    if (deterministic_) {
+        if (newest) return false;
+        GLenum status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+        return status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED;
+    }
+    GLenum status = glClientWaitSync(fence, 0, 0);
+    return status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED;
+}
+
+uint64_t SPHComputeSystem::computeStateHash() {
+    if (numParticles_ == 0) return 0;
+    
+    std::vector<SPHParticleCompute> particles(numParticles_);
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glGetNamedBufferSubData(particleBuffers_[currentBuffer_], 0, particles.size() * sizeof(SPHParticleCompute), particles.data());
+    
+    uint64_t hash = 14695981039346656037ull;
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(particles.data());
+    for (size_t i = 0; i < particles.size() * sizeof(SPHParticleCompute); i++) {
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+float SPHComputeSystem::computeAdaptiveTimeStep() const {
+    // The sample is a few frames old, so extrapolate speed over its age and pad by gravity
+    float acceleration = estimatedMaxAcceleration_ + glm::length(gravity_);
+    float maxSpeed = std::min(statistics_.maxSpeed + acceleration * readbackAge_, velocityLimit_);
+    
+    // PCISPH enforces incompressibility by iteration, so only the particle speed limits dt
+    float dt;
+    if (passUsesPCISPH()) {
+        dt = SPHConstants::PCISPH_CFL_FACTOR * shaderParameters_.kernelRadius / std::max(maxSpeed, 0.001f);
+    } else {
+        float soundSpeed = std::sqrt(shaderParameters_.stiffness);
+        dt = SPHConstants::CFL_FACTOR * shaderParameters_.kernelRadius / (soundSpeed + maxSpeed);
+    }
+    if (acceleration > 0.0f) {
+        dt = std::min(dt, SPHConstants::FORCE_FACTOR * std::sqrt(shaderParameters_.kernelRadius / acceleration));
+    }
+    // Explicit viscosity diffuses one kernel radius per step at most; the implicit solve has no limit
+    if (!passUsesImplicitViscosity() && shaderParameters_.viscosity > 0.0f) {
+        float h = shaderParameters_.kernelRadius;
+        dt = std::min(dt, SPHConstants::VISCOSITY_DT_FACTOR * h * h * shaderParameters_.restDensity / shaderParameters_.viscosity);
+    }
+    
+    return glm::clamp(dt, minTimeStep_, maxTimeStep());
+}
+
+float SPHComputeSystem::maxTimeStep() const {
+    return passUsesPCISPH() ? SPHConstants::DT * SPHConstants::PCISPH_DT_SCALE : SPHConstants::DT;
+}
+
+void SPHComputeSystem::setUseNeighborLists(bool enable) {
+    if (enable && !useNeighborLists_) {
+        neighborListsDirty_ = true;
+    }
+    useNeighborLists_ = enable;
+}
+
+void SPHComputeSystem::setUseDiffuseParticles(bool enable) {
+    if (enable && !useDiffuseParticles_) {
+        diffuseStateDirty_ = true;
+    }
+    useDiffuseParticles_ = enable;
+}
+
+void SPHComputeSystem::updateDiffuseParticles(float deltaTime) {
+    GPUMemoryScope memoryScope("SPH");
+    if (!diffuseParticleBuffer_) {
+        glCreateBuffers(1, &diffuseParticleBuffer_);
+        bufferStorage(diffuseParticleBuffer_, GLsizeiptr(SPHConstants::DIFFUSE_PARTICLE_CAPACITY) * 2 * sizeof(glm::vec4),
+                             nullptr, 0);
+        glCreateBuffers(1, &diffuseStateBuffer_);
+        bufferStorage(diffuseStateBuffer_, 8 * sizeof(uint32_t), nullptr, GL_DYNAMIC_STORAGE_BIT);
+        glCreateBuffers(1, &diffuseCellBuffer_);
+        bufferStorage(diffuseCellBuffer_, GLsizeiptr(gridDim_.x) * gridDim_.y * gridDim_.z * 4 * sizeof(int32_t), nullptr, 0);
+        diffuseStateDirty_ = true;
+    }
+    if (diffuseStateDirty_) {
+        // Four billboard vertices, no instances, spawn head at zero
+        const uint32_t state[8] = { 4, 0, 0, 0, 0, 0, 0, 0 };
+        glNamedBufferSubData(diffuseStateBuffer_, 0, sizeof(state), state);
+        diffuseStateDirty_ = false;
+    }
+    uint32_t clearValue = 0;
+    glClearNamedBufferData(diffuseCellBuffer_, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &clearValue);
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    
+    const SPHDiffuseParameters& p = diffuseParameters_;
+    glm::vec3 invCellSize = glm::vec3(gridRes_) * (1.0f - 0.001f) / gridSize_;
+    float fullCellCount = std::pow(gridCellSize_ / (SPHConstants::PARTICLE_RADIUS * 2.0f), 3.0f);
+    // The wave crest potential comes from step 6, which PCISPH replaces
+    float waveCrestRate = passUsesPCISPH() ? 0.0f : p.waveCrestRate;
+    
+    glUseProgram(diffuseProgram_);
+    glUniform1ui(glGetUniformLocation(diffuseProgram_, "uParticleCount"), numParticles_);
+    glUniform1ui(glGetUniformLocation(diffuseProgram_, "uCapacity"), SPHConstants::DIFFUSE_PARTICLE_CAPACITY);
+    glUniform1f(glGetUniformLocation(diffuseProgram_, "uDT"), deltaTime);
+    glUniform1ui(glGetUniformLocation(diffuseProgram_, "uFrame"), diffuseFrame_++);
+    glUniform3fv(glGetUniformLocation(diffuseProgram_, "uGravity"), 1, &gravity_[0]);
+    glUniform3fv(glGetUniformLocation(diffuseProgram_, "uGridOrigin"), 1, &gridOrigin_[0]);
+    glUniform3fv(glGetUniformLocation(diffuseProgram_, "uGridSize"), 1, &gridSize_[0]);
+    glUniform3fv(glGetUniformLocation(diffuseProgram_, "uInvCellSize"), 1, &invCellSize[0]);
+    glUniform3iv(glGetUniformLocation(diffuseProgram_, "uGridRes"), 1, &gridRes_[0]);
+    glUniform2fv(glGetUniformLocation(diffuseProgram_, "uTrappedAirRange"), 1, &p.trappedAirRange[0]);
+    glUniform2fv(glGetUniformLocation(diffuseProgram_, "uWaveCrestRange"), 1, &p.waveCrestRange[0]);
+    glUniform2fv(glGetUniformLocation(diffuseProgram_, "uKineticEnergyRange"), 1, &p.kineticEnergyRange[0]);
+    glUniform1f(glGetUniformLocation(diffuseProgram_, "uTrappedAirRate"), p.trappedAirRate);
+    glUniform1f(glGetUniformLocation(diffuseProgram_, "uWaveCrestRate"), waveCrestRate);
+    glUniform2fv(glGetUniformLocation(diffuseProgram_, "uLifetimeRange"), 1, &p.lifetimeRange[0]);
+    glUniform1f(glGetUniformLocation(diffuseProgram_, "uSpawnRadius"), SPHConstants::PARTICLE_RADIUS);
+    glUniform1f(glGetUniformLocation(diffuseProgram_, "uSprayFill"), p.sprayFill);
+    glUniform1f(glGetUniformLocation(diffuseProgram_, "uBubbleFill"), p.bubbleFill);
+    glUniform1f(glGetUniformLocation(diffuseProgram_, "uFullCellCount"), fullCellCount);
+    glUniform1f(glGetUniformLocation(diffuseProgram_, "uBuoyancy"), p.buoyancy);
+    glUniform1f(glGetUniformLocation(diffuseProgram_, "uDrag"), std::min(std::max(p.drag, 0.0f), 1.0f));
+    
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, particleBuffers_[currentBuffer_]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 24, particleCountBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 32, diffusePotentialBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 33, diffuseParticleBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 34, diffuseStateBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 35, diffuseCellBuffer_);
+    
+    // Bin the fluid, spawn into the ring, then advect everything spawned so far
+    uint32_t fluidGroups = (numParticles_ + SPHConstants::DIFFUSE_BLOCK_SIZE - 1) / SPHConstants::DIFFUSE_BLOCK_SIZE;
+    glUniform1i(glGetUniformLocation(diffuseProgram_, "uPass"), 0);
+    glDispatchCompute(fluidGroups, 1, 1);
+    glUniform1i(glGetUniformLocation(diffuseProgram_, "uPass"), 1);
+    glDispatchCompute(fluidGroups, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    
+    glUniform1i(glGetUniformLocation(diffuseProgram_, "uPass"), 2);
+    glDispatchCompute(SPHConstants::DIFFUSE_PARTICLE_CAPACITY / SPHConstants::DIFFUSE_BLOCK_SIZE, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+}
+
+void SPHComputeSystem::buildNeighborLists() {
+    glm::vec3 invCellSize = glm::vec3(gridRes_) * (1.0f - 0.001f) / gridSize_;
+    float searchRadius = shaderParameters_.kernelRadius + SPHConstants::NEIGHBOR_SKIN;
+    int cellRange = static_cast<int>(std::ceil(searchRadius / gridCellSize_));
+    
+    glUseProgram(neighborListProgram_);
+    glUniform1ui(glGetUniformLocation(neighborListProgram_, "uListStride"), particleCapacity_);
+    glUniform1ui(glGetUniformLocation(neighborListProgram_, "uNeighborLimit"), neighborLimit_);
+    glUniform1f(glGetUniformLocation(neighborListProgram_, "uSearchRadius"), searchRadius);
+    glUniform1i(glGetUniformLocation(neighborListProgram_, "uCellRange"), cellRange);
+    glUniform3fv(glGetUniformLocation(neighborListProgram_, "uInvCellSize"), 1, &invCellSize[0]);
+    glUniform3fv(glGetUniformLocation(neighborListProgram_, "uGridOrigin"), 1, &gridOrigin_[0]);
+    glUniform3iv(glGetUniformLocation(neighborListProgram_, "uGridRes"), 1, &gridRes_[0]);
+    GLint phaseLoc = glGetUniformLocation(neighborListProgram_, "uListPhase");
+    
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, particleBuffers_[currentBuffer_]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, cellCountBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 13, rebuildFlagBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 14, sortedIndexBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 15, neighborCountBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 16, neighborListBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 17, referencePositionBuffer_);
+    
+    // Phase 0: bin particles by cell
+    glUniform1i(phaseLoc, 0);
+    dispatchParticles(64);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    
+    // Cell offsets over particle indices (cheap next to the per-particle work, so not flag-gated)
+    dispatchPrefixScan(cellCountBuffer_, cellStartBuffer_, cellCursorBuffer_, cellCount_);
+    
+    // Phase 1: index scatter, phase 2: neighbor gather
+    glUseProgram(neighborListProgram_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, cellCountBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, cellStartBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, cellCursorBuffer_);
+    
+    glUniform1i(phaseLoc, 1);
+    dispatchParticles(64);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    
+    glUniform1i(phaseLoc, 2);
+    dispatchParticles(64);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+void SPHComputeSystem::sortParticleIndices() {
+    // Step 3 bins the indices in place of the particles (SPH_INDEX_SORT)
+    glUseProgram(simStep3Program_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, particleBuffers_[currentBuffer_]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, cellCursorBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 14, sortedIndexBuffer_);
+#ifdef SPH_GPU_COUNTERS
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, cellCountBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, cellStartBuffer_);
+#endif
+    dispatchParticles(32);
+    if (!gatherPass_ || !gatherProgram_) return;
+    
+    // Step 1 only removed particles on this substep, so only now does the count shrink
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+    compactParticleCount();
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+    
+    // Gather into the implicit viscosity CG scratch (four vec4s per particle, rebuilt by
+    // every solve), then copy it back over the one particle buffer
+    glUseProgram(gatherProgram_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, particleBuffers_[currentBuffer_]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, viscositySolverBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 14, sortedIndexBuffer_);
+    bindViscosityWarmStart(gatherProgram_);
+    dispatchParticles(64);
+    
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    GLsizeiptr particleBytes = GLsizeiptr(numParticles_) * sizeof(SPHParticleCompute);
+    glCopyNamedBufferSubData(viscositySolverBuffer_, particleBuffers_[currentBuffer_], 0, 0, particleBytes);
+    if (passUsesImplicitViscosity()) {
+        glCopyNamedBufferSubData(viscosityWarmStartBuffers_[1 - currentBuffer_], viscosityWarmStartBuffers_[currentBuffer_], 0, 0,
+                                 GLsizeiptr(numParticles_) * sizeof(glm::vec4));
     }
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+void SPHComputeSystem::bindSoABuffers() {
+    if (particleLayout_ == SPHParticleLayout::AOS) return;
+    
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 10, soaPositionBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 11, soaVelocityBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 12, soaDensityPressureBuffer_);
 }
 
 void SPHComputeSystem::swapBuffers() {
@@ -663,66 +3831,67 @@ void SPHComputeSystem::swapBuffers() {
 }
 
 void SPHComputeSystem::render(const glm::mat4& view, const glm::mat4& projection) {
-    if (numParticles_ == 0) return;
+    // Draw the played frame, or the last published snapshot when another context is simulating
+    if (playbackBuffer_) {
+        renderBuffer_ = playbackBuffer_;
+        renderCount_ = playbackCount_;
+        renderCountBuffer_ = playbackCountBuffer_;
+    } else if (renderSnapshots_) {
+        acquireSnapshot();
+    } else {
+        renderBuffer_ = particleBuffers_[currentBuffer_];
+        renderCount_ = numParticles_;
+        renderCountBuffer_ = particleCountBuffer_;
+        if (renderLag_ > 0.0f && interpolateProgram_ && numParticles_ > 0) {
+            interpolateRenderParticles();
+            renderBuffer_ = interpolatedBuffer_;
+        }
+    }
+    renderFromStream_ = useRenderStream_ && renderBuffer_ == particleBuffers_[currentBuffer_] && renderStreamBuffer_ &&
+                        renderStreamCount_ == renderCount_ && renderStreamColorMode_ == colorMode_;
+    if (renderCount_ == 0) return;
     
-    // Don't bind framebuffer here - let the caller control which framebuffer is active
-    // The main rendering loop handles framebuffer management
+    // Don't bind framebuffer here - let the caller control which framebuffer is active.
+    // The screen-space pipeline draws into its own targets, then shades back into this one
+    GLint callerFramebuffer = 0;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &callerFramebuffer);
+    targetFramebuffer_ = static_cast<GLuint>(callerFramebuffer);
     
-    // Render particles first, then container
-    // This ensures particles are visible through the transparent container
+    // The transparent parts follow in renderTransparent
     renderParticles(view, projection);
+    cameraPosition_ = glm::vec3(glm::inverse(view)[3]);
     
-    // Then render the container if enabled (with transparency)
-    if (renderContainer_) {
-        renderGlassContainer(view, projection);
+    if (renderSnapshots_ && !playbackBuffer_) {
+        releaseSnapshot();
     }
 }
 
 void SPHComputeSystem::renderParticles(const glm::mat4& view, const glm::mat4& projection) {
-    if (numParticles_ == 0) return;
+    if (renderCount_ == 0) return;
     
-    // Debug output (increased frequency for debugging)
+    // Debug output from our own state only; querying GL here would stall the frame
     static int frameCount = 0;
-    bool debugFrame = (frameCount++ % 30 == 0); // More frequent debugging
-    if (debugFrame) {
-        std::cout << "=== SPH Particle Rendering Debug ===" << std::endl;
-        std::cout << "Rendering " << numParticles_ << " particles" << std::endl;
-        std::cout << "Current buffer: " << currentBuffer_ << std::endl;
-        std::cout << "Render program: " << renderProgram_ << std::endl;
-        std::cout << "Billboard VAO: " << billboardVAO_ << std::endl;
-        std::cout << "Billboard index buffer: " << billboardIndexBuffer_ << std::endl;
-        std::cout << "Point radius: " << (SPHConstants::KERNEL_RADIUS * 2.0f) << std::endl;
-        
-        // Check current framebuffer
-        GLint currentFBO;
-        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &currentFBO);
-        std::cout << "Current framebuffer: " << currentFBO << std::endl;
-        
-        // Check uniform locations
-        if (renderProgram_) {
-            std::cout << "Uniform locations: uVP=" << glGetUniformLocation(renderProgram_, "uVP") 
-                      << " uParticleCount=" << glGetUniformLocation(renderProgram_, "uParticleCount") << std::endl;
-        }
-    }
-    
-    // Temporarily use simple rendering to debug black particles
-    static bool useSimpleRendering = true; // Use simple rendering for debugging
-    
-    if (debugFrame) {
-        std::cout << "Using simple rendering: " << useSimpleRendering << std::endl;
+    if (frameCount++ % 60 == 0) {
+        WATERSIM_LOG_DEBUG(LogCategory::RENDER, "SPH particle rendering: " << renderCount_ << " particles, buffer "
+                  << currentBuffer_ << ", program " << renderPrograms_[colorMode_] << ", billboard VAO " << billboardVAO_
+                  << ", point radius " << (SPHConstants::KERNEL_RADIUS * 2.0f) << ", mode " << renderMode_);
     }
     
-    if (useSimpleRendering) {
-        renderParticlesAsPoints(view, projection);
-    } else {
+    if (renderMode_ == RENDER_SURFACE_MESH && surfaceSplatProgram_ && marchingCubesProgram_ && surfaceProgram_) {
+        extractSurfaceMesh();
+        renderSurfaceMesh(view, projection);
+    } else if (renderMode_ == RENDER_SCREEN_SPACE) {
         // Screen-space fluid rendering pipeline (matching )
         renderScreenSpaceFluid(view, projection);
+    } else {
+        renderParticlesAsPoints(view, projection);
     }
 }
 
 void SPHComputeSystem::renderParticlesAsPoints(const glm::mat4& view, const glm::mat4& projection) {
-    if (!renderProgram_ || numParticles_ == 0) {
-        std::cout << "WARNING: Cannot render particles - program:" << renderProgram_ << " particles:" << numParticles_ << std::endl;
+    GLuint renderProgram = renderPrograms_[colorMode_];
+    if (!renderProgram || renderCount_ == 0) {
+        WATERSIM_LOG_WARNING(LogCategory::RENDER, "Cannot render particles - program:" << renderProgram << " particles:" << renderCount_);
         return;
     }
     
@@ -734,37 +3903,39 @@ void SPHComputeSystem::renderParticlesAsPoints(const glm::mat4& view, const glm:
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
     
-    glUseProgram(renderProgram_);
-    
     // Set 
     glm::mat4 vp = projection * view;
     const float pointRadius = 0.5f; // Much larger fixed size for debugging
     
+    // Frustum only: this path draws into the caller's framebuffer, so there is no Hi-Z
+    bool culled = cullParticles(vp, pointRadius, false, false);
+    
+    glUseProgram(renderProgram);
+    
     // Set uniforms with error checking
-    GLint vpLoc = glGetUniformLocation(renderProgram_, "uVP");
-    GLint viewLoc = glGetUniformLocation(renderProgram_, "uView");
-    GLint projLoc = glGetUniformLocation(renderProgram_, "uProjection");
-    GLint radiusLoc = glGetUniformLocation(renderProgram_, "uPointRadius");
-    GLint countLoc = glGetUniformLocation(renderProgram_, "uParticleCount");
-    GLint colorLoc = glGetUniformLocation(renderProgram_, "uColorMode");
+    GLint vpLoc = glGetUniformLocation(renderProgram, "uVP");
+    GLint viewLoc = glGetUniformLocation(renderProgram, "uView");
+    GLint projLoc = glGetUniformLocation(renderProgram, "uProjection");
+    GLint radiusLoc = glGetUniformLocation(renderProgram, "uPointRadius");
+    GLint countLoc = glGetUniformLocation(renderProgram, "uParticleCount");
     
     if (vpLoc != -1) glUniformMatrix4fv(vpLoc, 1, GL_FALSE, &vp[0][0]);
     if (viewLoc != -1) glUniformMatrix4fv(viewLoc, 1, GL_FALSE, &view[0][0]);
     if (projLoc != -1) glUniformMatrix4fv(projLoc, 1, GL_FALSE, &projection[0][0]);
     if (radiusLoc != -1) glUniform1f(radiusLoc, pointRadius);
-    if (countLoc != -1) glUniform1ui(countLoc, numParticles_);
-    if (colorLoc != -1) glUniform1i(colorLoc, static_cast<int>(colorMode_));
+    if (countLoc != -1) glUniform1ui(countLoc, renderCount_);
     
     // Grid parameters are optional for basic rendering
-    GLint gridSizeLoc = glGetUniformLocation(renderProgram_, "uGridSize");
-    GLint gridOriginLoc = glGetUniformLocation(renderProgram_, "uGridOrigin");
-    GLint gridResLoc = glGetUniformLocation(renderProgram_, "uGridRes");
+    GLint gridSizeLoc = glGetUniformLocation(renderProgram, "uGridSize");
+    GLint gridOriginLoc = glGetUniformLocation(renderProgram, "uGridOrigin");
+    GLint gridResLoc = glGetUniformLocation(renderProgram, "uGridRes");
     if (gridSizeLoc != -1) glUniform3fv(gridSizeLoc, 1, &gridSize_[0]);
     if (gridOriginLoc != -1) glUniform3fv(gridOriginLoc, 1, &gridOrigin_[0]);
     if (gridResLoc != -1) glUniform3iv(gridResLoc, 1, &gridRes_[0]);
     
-    // Bind particle buffer as SSBO
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, particleBuffers_[currentBuffer_]);
+    // Bind particle buffer as SSBO; the live count record bounds the draw
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, renderBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 24, renderCountBuffer_);
     
     // Use billboard VAO like 
     glBindVertexArray(billboardVAO_);
@@ -774,19 +3945,20 @@ void SPHComputeSystem::renderParticlesAsPoints(const glm::mat4& view, const glm:
     static int testFrameCount = 0;
     if (testFrameCount++ % 90 == 0) {
         testMode = (testMode + 1) % 3;
-        std::cout << "Test mode: " << testMode << " (0=billboards, 1=points, 2=both)" << std::endl;
+        WATERSIM_LOG_DEBUG(LogCategory::RENDER, "Test mode: " << testMode << " (0=billboards, 1=points, 2=both)");
     }
     
     if (testMode == 0 || testMode == 2) {
-        // Render as indexed billboards exactly like : 6 indices per particle (2 triangles per quad)
-        uint32_t indexCount = 6 * numParticles_;
-        glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, nullptr);
+        // Vertex-pulled billboards: 6 vertices per particle (2 triangles per quad)
+        drawParticleBillboards(renderProgram, culled);
     }
     
     if (testMode == 1 || testMode == 2) {
         // Try simple point rendering
         glPointSize(10.0f); // Large points for visibility
-        glDrawArrays(GL_POINTS, 0, numParticles_);
+        glUniform1i(glGetUniformLocation(renderProgram, "uUseVisibleList"), 0);
+        bindRenderStream(renderProgram);
+        glDrawArrays(GL_POINTS, 0, renderCount_);
     }
     
     // Check for errors
@@ -794,15 +3966,12 @@ void SPHComputeSystem::renderParticlesAsPoints(const glm::mat4& view, const glm:
     if (err != GL_NO_ERROR) {
         static int errorCount = 0;
         if (errorCount++ < 3) {
-            std::cerr << "OpenGL error in billboard rendering: 0x" << std::hex << err << std::dec;
-            if (err == GL_INVALID_OPERATION) std::cerr << " (GL_INVALID_OPERATION)";
-            else if (err == GL_INVALID_VALUE) std::cerr << " (GL_INVALID_VALUE)";
-            else if (err == GL_INVALID_ENUM) std::cerr << " (GL_INVALID_ENUM)";
-            std::cerr << std::endl;
-            
-            // Additional debug info
-            std::cerr << "IndexCount: " << (6 * numParticles_) << ", NumParticles: " << numParticles_ << std::endl;
-            std::cerr << "VAO bound: " << billboardVAO_ << ", Buffer bound: " << particleBuffers_[currentBuffer_] << std::endl;
+            const char* errorName = err == GL_INVALID_OPERATION ? " (GL_INVALID_OPERATION)"
+                                  : err == GL_INVALID_VALUE ? " (GL_INVALID_VALUE)"
+                                  : err == GL_INVALID_ENUM ? " (GL_INVALID_ENUM)" : "";
+            WATERSIM_LOG_ERROR(LogCategory::RENDER, "OpenGL error in billboard rendering: 0x" << std::hex << err << std::dec
+                      << errorName << "\nIndexCount: " << (6 * renderCount_) << ", NumParticles: " << renderCount_
+                      << "\nVAO bound: " << billboardVAO_ << ", Buffer bound: " << renderBuffer_);
         }
     }
     
@@ -823,68 +3992,300 @@ void SPHComputeSystem::renderScreenSpaceFluid(const glm::mat4& view, const glm::
 void SPHComputeSystem::renderParticleDepth(const glm::mat4& view, const glm::mat4& projection) {
     if (!depthProgram_) return;
     
-    // Bind depth framebuffer
-    glBindFramebuffer(GL_FRAMEBUFFER, depthFBO_);
-    glViewport(0, 0, windowWidth_, windowHeight_);
+    glm::mat4 mvp = projection * view;
+    const float pointRadius = SPHConstants::KERNEL_RADIUS * 2.0f; // Larger for visibility
     
-    // Clear depth and color - use far depth value (1.0) for background
-    glClearColor(1.0f, 1.0f, 1.0f, 1.0f); // White background depth
-    glClearDepth(1.0f); // Clear to far plane
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    bool occlusion = useOcclusionCulling_ && hiZValid_;
+    bool culled = cullParticles(mvp, pointRadius, occlusion, useSurfaceSplatting_);
+    thicknessValid_ = culled && useSurfaceSplatting_ && thicknessProgram_;
     
-    // Enable depth testing
-    glEnable(GL_DEPTH_TEST);
-    glDepthMask(GL_TRUE);
+    // The motion vectors come from the depth pass's color, which only the triangles write
+    splatDepthActive_ = useComputeSplat_ && depthSplatProgram_ && splatDepthView_ && !motionVectors_;
+    if (splatDepthActive_) {
+        splatParticleDepth(view, projection, pointRadius, culled);
+    } else {
+        // Bind depth framebuffer
+        glBindFramebuffer(GL_FRAMEBUFFER, depthFBO_);
+        glViewport(0, 0, fluidWidth_, fluidHeight_);
+        
+        // Far depth and no motion where there is no fluid
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClearDepth(1.0f); // Clear to far plane
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        
+        // Enable depth testing
+        glEnable(GL_DEPTH_TEST);
+        glDepthMask(GL_TRUE);
+        
+        // Use depth rendering shader
+        glUseProgram(depthProgram_);
+        
+        static int debugCount = 0;
+        if (debugCount++ % 60 == 0) {
+            WATERSIM_LOG_DEBUG(LogCategory::RENDER, "SPH depth rendering: " << renderCount_ << " particles, point radius "
+                      << pointRadius << ", FBO " << depthFBO_ << ", VAO " << billboardVAO_);
+        }
+        
+        glUniformMatrix4fv(glGetUniformLocation(depthProgram_, "uMVP"), 1, GL_FALSE, &mvp[0][0]);
+        glUniformMatrix4fv(glGetUniformLocation(depthProgram_, "uView"), 1, GL_FALSE, &view[0][0]);
+        glUniformMatrix4fv(glGetUniformLocation(depthProgram_, "uProjection"), 1, GL_FALSE, &projection[0][0]);
+        glUniform1f(glGetUniformLocation(depthProgram_, "uPointRadius"), pointRadius);
+        glUniform1ui(glGetUniformLocation(depthProgram_, "uNumParticles"), renderCount_);
+        glUniform1i(glGetUniformLocation(depthProgram_, "uMotionVectors"), motionVectors_ ? 1 : 0);
+        if (motionVectors_) {
+            glUniformMatrix4fv(glGetUniformLocation(depthProgram_, "uMotionViewProjection"), 1, GL_FALSE, &motionViewProjection_[0][0]);
+            glUniformMatrix4fv(glGetUniformLocation(depthProgram_, "uPreviousViewProjection"), 1, GL_FALSE, &previousViewProjection_[0][0]);
+            glUniform1f(glGetUniformLocation(depthProgram_, "uFrameTime"), motionFrameTime_);
+        }
+        
+        // Bind particle buffer as SSBO (same as main rendering)
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, renderBuffer_);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 24, renderCountBuffer_);
+        
+        // Use billboard VAO (same approach as main rendering)
+        glBindVertexArray(billboardVAO_);
+        
+        // Vertex-pulled billboards like main rendering: 6 vertices per particle
+        drawParticleBillboards(depthProgram_, culled);
+        
+        // Check for OpenGL errors
+        GLenum err = glGetError();
+        if (err != GL_NO_ERROR && debugCount <= 5) {
+            WATERSIM_LOG_ERROR(LogCategory::RENDER, "OpenGL error in depth rendering: " << err);
+        }
+        
+        glBindVertexArray(0);
+    }
+    
+    // Next frame's occlusion test reads this frame's depth
+    if (useParticleCulling_ && useOcclusionCulling_) {
+        buildHiZ(mvp);
+    }
+    
+    if (thicknessValid_) {
+        renderParticleThickness(view, projection, pointRadius);
+    }
+}
+
+void SPHComputeSystem::splatParticleDepth(const glm::mat4& view, const glm::mat4& projection, float pointRadius, bool culled) {
+    // Far plane depth bits where there is no fluid
+    const float farDepth = 1.0f;
+    glClearTexImage(splatDepthTexture_, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, &farDepth);
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    
+    glUseProgram(depthSplatProgram_);
+    glUniformMatrix4fv(glGetUniformLocation(depthSplatProgram_, "uView"), 1, GL_FALSE, &view[0][0]);
+    glUniformMatrix4fv(glGetUniformLocation(depthSplatProgram_, "uProjection"), 1, GL_FALSE, &projection[0][0]);
+    glUniform1f(glGetUniformLocation(depthSplatProgram_, "uPointRadius"), pointRadius);
+    glUniform1ui(glGetUniformLocation(depthSplatProgram_, "uNumParticles"), renderCount_);
+    glUniform1i(glGetUniformLocation(depthSplatProgram_, "uUseVisibleList"), culled ? 1 : 0);
+    bindRenderStream(depthSplatProgram_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, renderBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 24, renderCountBuffer_);
+    if (culled) {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 29, visibleParticleBuffer_);
+    }
+    glBindImageTexture(0, splatDepthTexture_, 0, GL_FALSE, 0, GL_READ_WRITE, GL_R32UI);
     
-    // Use depth rendering shader
-    glUseProgram(depthProgram_);
+    // The culled count is only on the GPU; the threads past it return at once
+    glDispatchCompute((renderCount_ + 63) / 64, 1, 1);
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+}
+
+void SPHComputeSystem::renderParticleThickness(const glm::mat4& view, const glm::mat4& projection, float pointRadius) {
+    // Interior list from the last cull: additive sphere thickness, no depth test
+    glBindFramebuffer(GL_FRAMEBUFFER, thicknessFBO_);
+    glViewport(0, 0, std::max(fluidWidth_ / 2, 1), std::max(fluidHeight_ / 2, 1));
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glDisable(GL_DEPTH_TEST);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
     
-    // Set uniforms
     glm::mat4 mvp = projection * view;
-    const float pointRadius = SPHConstants::KERNEL_RADIUS * 2.0f; // Larger for visibility
+    glUseProgram(thicknessProgram_);
+    glUniformMatrix4fv(glGetUniformLocation(thicknessProgram_, "uMVP"), 1, GL_FALSE, &mvp[0][0]);
+    glUniformMatrix4fv(glGetUniformLocation(thicknessProgram_, "uView"), 1, GL_FALSE, &view[0][0]);
+    glUniformMatrix4fv(glGetUniformLocation(thicknessProgram_, "uProjection"), 1, GL_FALSE, &projection[0][0]);
+    glUniform1f(glGetUniformLocation(thicknessProgram_, "uPointRadius"), pointRadius);
+    glUniform1ui(glGetUniformLocation(thicknessProgram_, "uNumParticles"), renderCount_);
+    
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, renderBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 24, renderCountBuffer_);
+    glBindVertexArray(billboardVAO_);
+    drawParticleBillboards(thicknessProgram_, true, true);
+    glBindVertexArray(0);
+    
+    glDisable(GL_BLEND);
+    glEnable(GL_DEPTH_TEST);
+    glViewport(0, 0, fluidWidth_, fluidHeight_);
+}
+
+bool SPHComputeSystem::cullParticles(const glm::mat4& viewProjection, float radius, bool occlusion, bool classify) {
+    GPUMemoryScope memoryScope("SPH");
+    if (!useParticleCulling_ || !cullProgram_) return false;
+    
+    // Sized like the particle storage, doubling on demand (renderCount_ may be a snapshot's)
+    if (renderCount_ > visibleParticleCapacity_) {
+        uint32_t capacity = std::min(std::max(renderCount_, visibleParticleCapacity_ * 2), maxParticles_);
+        if (visibleParticleBuffer_) deleteBuffers(1, &visibleParticleBuffer_);
+        glCreateBuffers(1, &visibleParticleBuffer_);
+        bufferStorage(visibleParticleBuffer_, (8 + 2 * GLsizeiptr(capacity)) * sizeof(uint32_t), nullptr, GL_DYNAMIC_STORAGE_BIT);
+        visibleParticleCapacity_ = capacity;
+    }
     
-    static int debugCount = 0;
-    if (debugCount++ % 60 == 0) {
-        std::cout << "=== Depth Rendering Debug ===" << std::endl;
-        std::cout << "Particles: " << numParticles_ << ", Point radius: " << pointRadius << std::endl;
-        std::cout << "FBO: " << depthFBO_ << ", VAO: " << billboardVAO_ << std::endl;
+    // Frustum planes from the rows of the view-projection matrix (Gribb-Hartmann)
+    glm::mat4 rows = glm::transpose(viewProjection);
+    glm::vec4 planes[6] = { rows[3] + rows[0], rows[3] - rows[0], rows[3] + rows[1],
+                            rows[3] - rows[1], rows[3] + rows[2], rows[3] - rows[2] };
+    for (glm::vec4& plane : planes) {
+        plane /= glm::length(glm::vec3(plane));
     }
     
-    glUniformMatrix4fv(glGetUniformLocation(depthProgram_, "uMVP"), 1, GL_FALSE, &mvp[0][0]);
-    glUniformMatrix4fv(glGetUniformLocation(depthProgram_, "uView"), 1, GL_FALSE, &view[0][0]);
-    glUniformMatrix4fv(glGetUniformLocation(depthProgram_, "uProjection"), 1, GL_FALSE, &projection[0][0]);
-    glUniform1f(glGetUniformLocation(depthProgram_, "uPointRadius"), pointRadius);
-    glUniform1ui(glGetUniformLocation(depthProgram_, "uNumParticles"), numParticles_);
+    // Empty surface and interior DrawArraysIndirectCommands: vertex count, one instance
+    const uint32_t drawReset[8] = { 0, 1, 0, 0, 0, 1, 0, 0 };
+    glNamedBufferSubData(visibleParticleBuffer_, 0, sizeof(drawReset), drawReset);
+    
+    glUseProgram(cullProgram_);
+    glUniform1ui(glGetUniformLocation(cullProgram_, "uParticleCount"), renderCount_);
+    glUniform1f(glGetUniformLocation(cullProgram_, "uRadius"), radius);
+    glUniform4fv(glGetUniformLocation(cullProgram_, "uFrustumPlanes"), 6, &planes[0][0]);
+    glUniform1i(glGetUniformLocation(cullProgram_, "uOcclusion"), occlusion && hiZValid_ ? 1 : 0);
+    glUniform1i(glGetUniformLocation(cullProgram_, "uClassify"), classify ? 1 : 0);
+    glUniform1f(glGetUniformLocation(cullProgram_, "uSurfaceDensity"), surfaceDensityRatio_ * shaderParameters_.restDensity);
+    glUniform1ui(glGetUniformLocation(cullProgram_, "uListCapacity"), visibleParticleCapacity_);
+    if (occlusion && hiZValid_) {
+        glUniformMatrix4fv(glGetUniformLocation(cullProgram_, "uHiZViewProj"), 1, GL_FALSE, &hiZViewProjection_[0][0]);
+        glUniform2i(glGetUniformLocation(cullProgram_, "uHiZSize"), fluidWidth_, fluidHeight_);
+        glUniform1i(glGetUniformLocation(cullProgram_, "uHiZLevels"), hiZLevels_);
+        glBindTextureUnit(0, hiZTexture_);
+    }
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, renderBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 24, renderCountBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 29, visibleParticleBuffer_);
+    glDispatchCompute((renderCount_ + 255) / 256, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+    return true;
+}
+
+void SPHComputeSystem::drawParticleBillboards(GLuint program, bool culled, bool interior) {
+    glUniform1i(glGetUniformLocation(program, "uUseVisibleList"), culled ? 1 : 0);
+    bindRenderStream(program);
+    glUniform1ui(glGetUniformLocation(program, "uVisibleListOffset"), interior ? visibleParticleCapacity_ : 0);
+    if (culled) {
+        // The interior command follows the surface one
+        const GLintptr commandOffset = interior ? 4 * sizeof(uint32_t) : 0;
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 29, visibleParticleBuffer_);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, visibleParticleBuffer_);
+        glDrawArraysIndirect(GL_TRIANGLES, reinterpret_cast<const void*>(commandOffset));
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    } else {
+        glDrawArrays(GL_TRIANGLES, 0, 6 * renderCount_);
+    }
+}
+
+void SPHComputeSystem::bindRenderStream(GLuint program) {
+    glUniform1i(glGetUniformLocation(program, "uUseRenderStream"), renderFromStream_ ? 1 : 0);
+    if (renderFromStream_) {
+        glUniform3fv(glGetUniformLocation(program, "uStreamOrigin"), 1, &gridOrigin_[0]);
+        glUniform3fv(glGetUniformLocation(program, "uStreamExtent"), 1, &gridSize_[0]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 60, renderStreamBuffer_);
+    }
+}
+
+void SPHComputeSystem::interpolateRenderParticles() {
+    if (renderLagApplied_ && interpolatedBuffer_) return;
+    GPUMemoryScope memoryScope("SPH");
+    if (!interpolatedBuffer_) {
+        glCreateBuffers(1, &interpolatedBuffer_);
+        bufferStorage(interpolatedBuffer_, GLsizeiptr(particleCapacity_) * sizeof(SPHParticleCompute), nullptr, 0);
+    }
     
-    // Bind particle buffer as SSBO (same as main rendering)
+    glUseProgram(interpolateProgram_);
+    glUniform1f(glGetUniformLocation(interpolateProgram_, "uLag"), renderLag_);
+    glUniform3fv(glGetUniformLocation(interpolateProgram_, "uGridOrigin"), 1, &gridOrigin_[0]);
+    glUniform3fv(glGetUniformLocation(interpolateProgram_, "uGridSize"), 1, &gridSize_[0]);
     glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, particleBuffers_[currentBuffer_]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 24, particleCountBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 67, interpolatedBuffer_);
+    dispatchParticles(256);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    renderLagApplied_ = true;
+}
+
+void SPHComputeSystem::writeRenderStream() {
+    GPUMemoryScope memoryScope("SPH");
+    // Sized like the particle storage, which frees it when it grows
+    if (!renderStreamBuffer_) {
+        glCreateBuffers(1, &renderStreamBuffer_);
+        bufferStorage(renderStreamBuffer_, GLsizeiptr(particleCapacity_) * 2 * sizeof(uint32_t), nullptr, 0);
+    }
     
-    // Use billboard VAO (same approach as main rendering)
-    glBindVertexArray(billboardVAO_);
+    GLuint program = renderStreamPrograms_[colorMode_];
+    glUseProgram(program);
+    glUniform3fv(glGetUniformLocation(program, "uStreamOrigin"), 1, &gridOrigin_[0]);
+    glUniform3fv(glGetUniformLocation(program, "uStreamExtent"), 1, &gridSize_[0]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, particleBuffers_[currentBuffer_]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 24, particleCountBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 60, renderStreamBuffer_);
+    dispatchParticles(256);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
     
-    // Render as indexed billboards like main rendering: 6 indices per particle
-    uint32_t indexCount = 6 * numParticles_;
-    glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, nullptr);
+    renderStreamCount_ = numParticles_;
+    renderStreamColorMode_ = colorMode_;
+}
+
+void SPHComputeSystem::buildHiZ(const glm::mat4& viewProjection) {
+    GPUMemoryScope memoryScope("SPH screen-space");
+    if (!hiZProgram_) return;
     
-    // Check for OpenGL errors
-    GLenum err = glGetError();
-    if (err != GL_NO_ERROR && debugCount <= 5) {
-        std::cerr << "OpenGL error in depth rendering: " << err << std::endl;
+    // Full mip chain at the depth target size, recreated after a resize
+    if (!hiZTexture_) {
+        hiZLevels_ = 1;
+        while ((std::max(fluidWidth_, fluidHeight_) >> hiZLevels_) > 0) hiZLevels_++;
+        hiZTexture_ = RenderTargetPool::instance().acquire2D(GL_R32F, fluidWidth_, fluidHeight_, hiZLevels_);
+        glTextureParameteri(hiZTexture_, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTextureParameteri(hiZTexture_, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     }
     
-    glBindVertexArray(0);
+    glUseProgram(hiZProgram_);
+    glBindTextureUnit(0, particleDepthTexture());
+    for (int level = 0; level < hiZLevels_; level++) {
+        int width = std::max(fluidWidth_ >> level, 1);
+        int height = std::max(fluidHeight_ >> level, 1);
+        glUniform1i(glGetUniformLocation(hiZProgram_, "uFromDepth"), level == 0 ? 1 : 0);
+        if (level > 0) {
+            glBindImageTexture(0, hiZTexture_, level - 1, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+        }
+        glBindImageTexture(1, hiZTexture_, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+        glDispatchCompute((width + 15) / 16, (height + 15) / 16, 1);
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    }
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+    
+    hiZViewProjection_ = viewProjection;
+    hiZValid_ = true;
 }
 
 void SPHComputeSystem::applyCurvatureFlowSmoothing() {
+    if (smoothingMode_ == SMOOTH_CURVATURE_FLOW_COMPUTE && smoothComputeProgram_) {
+        applyCurvatureFlowCompute();
+        return;
+    }
+    if (smoothingMode_ == SMOOTH_BILATERAL && bilateralProgram_) {
+        applyBilateralSmoothing();
+        return;
+    }
     if (!smoothProgram_) return;
     
     glUseProgram(smoothProgram_);
     
     // Disable depth testing for fullscreen passes
     glDisable(GL_DEPTH_TEST);
+    glViewport(0, 0, fluidWidth_, fluidHeight_);
     
     // Set screen dimensions
-    glUniform2i(glGetUniformLocation(smoothProgram_, "uScreenSize"), windowWidth_, windowHeight_);
+    glUniform2i(glGetUniformLocation(smoothProgram_, "uScreenSize"), fluidWidth_, fluidHeight_);
     
     // Create a fullscreen quad VAO if we don't have one
     static GLuint fullscreenVAO = 0;
@@ -896,13 +4297,14 @@ void SPHComputeSystem::applyCurvatureFlowSmoothing() {
     }
     
     // Ping-pong between two smoothing framebuffers
-    GLuint inputTexture = depthTexture_;
+    GLuint inputTexture = particleDepthTexture();
     int outputBuffer = 0; // Start writing to buffer 0
     
     glBindVertexArray(fullscreenVAO);
     
-    // Apply 50 iterations of curvature flow smoothing 
-    for (int i = 0; i < curvatureFlowIterations_; ++i) {
+    // Apply 50 iterations of curvature flow smoothing, fewer under the frame budget
+    int flowIterations = static_cast<int>(std::lround(curvatureFlowIterations_ * curvatureFlowBudget_));
+    for (int i = 0; i < flowIterations; ++i) {
         // Bind output framebuffer
         glBindFramebuffer(GL_FRAMEBUFFER, smoothFBO_[outputBuffer]);
         glClear(GL_COLOR_BUFFER_BIT); // Clear the target buffer
@@ -927,9 +4329,65 @@ void SPHComputeSystem::applyCurvatureFlowSmoothing() {
     glEnable(GL_DEPTH_TEST);
 }
 
+void SPHComputeSystem::applyCurvatureFlowCompute() {
+    // Same ping-pong targets as the fragment path, but SMOOTH_ITERATIONS_PER_DISPATCH
+    // iterations per dispatch and no clears or framebuffer binds; zero iterations copies
+    glUseProgram(smoothComputeProgram_);
+    glUniform2i(glGetUniformLocation(smoothComputeProgram_, "uScreenSize"), fluidWidth_, fluidHeight_);
+    
+    GLuint inputTexture = particleDepthTexture();
+    int outputBuffer = 0;
+    int remaining = std::max(static_cast<int>(std::lround(curvatureFlowIterations_ * curvatureFlowBudget_)), 0);
+    do {
+        int iterations = std::min(remaining, SPHConstants::SMOOTH_ITERATIONS_PER_DISPATCH);
+        glUniform1i(glGetUniformLocation(smoothComputeProgram_, "uIterations"), iterations);
+        glBindTextureUnit(0, inputTexture);
+        glBindImageTexture(0, smoothTexture_[outputBuffer], 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+        glDispatchCompute((fluidWidth_ + 15) / 16, (fluidHeight_ + 15) / 16, 1);
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        
+        inputTexture = smoothTexture_[outputBuffer];
+        outputBuffer = 1 - outputBuffer;
+        remaining -= iterations;
+    } while (remaining > 0);
+    
+    finalSmoothedBuffer_ = 1 - outputBuffer;
+}
+
+void SPHComputeSystem::applyBilateralSmoothing() {
+    // Horizontal pass from the depth target into smoothTexture_[0], vertical into [1]
+    static GLuint fullscreenVAO = 0;
+    if (fullscreenVAO == 0) {
+        glGenVertexArrays(1, &fullscreenVAO);
+    }
+    
+    glUseProgram(bilateralProgram_);
+    glDisable(GL_DEPTH_TEST);
+    glViewport(0, 0, fluidWidth_, fluidHeight_);
+    glUniform1f(glGetUniformLocation(bilateralProgram_, "sigmaSpace"), bilateralSigmaSpace_);
+    glUniform1f(glGetUniformLocation(bilateralProgram_, "sigmaDepth"), bilateralSigmaDepth_);
+    glUniform2f(glGetUniformLocation(bilateralProgram_, "texelSize"), 1.0f / fluidWidth_, 1.0f / fluidHeight_);
+    glUniform1i(glGetUniformLocation(bilateralProgram_, "depthTexture"), 0);
+    glBindVertexArray(fullscreenVAO);
+    
+    GLuint inputs[2] = { particleDepthTexture(), smoothTexture_[0] };
+    const glm::vec2 directions[2] = { glm::vec2(1.0f, 0.0f), glm::vec2(0.0f, 1.0f) };
+    for (int pass = 0; pass < 2; pass++) {
+        glBindFramebuffer(GL_FRAMEBUFFER, smoothFBO_[pass]);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, inputs[pass]);
+        glUniform2fv(glGetUniformLocation(bilateralProgram_, "direction"), 1, &directions[pass][0]);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+    }
+    finalSmoothedBuffer_ = 1;
+    
+    glBindVertexArray(0);
+    glEnable(GL_DEPTH_TEST);
+}
+
 void SPHComputeSystem::renderFinalShading(const glm::mat4& view, const glm::mat4& projection) {
-    // Render final water surface to screen
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    // Render final water surface into the caller's target
+    glBindFramebuffer(GL_FRAMEBUFFER, targetFramebuffer_);
     glViewport(0, 0, windowWidth_, windowHeight_);
     
     // Enable blending for transparent water
@@ -937,14 +4395,23 @@ void SPHComputeSystem::renderFinalShading(const glm::mat4& view, const glm::mat4
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
     glDisable(GL_DEPTH_TEST);
     
-    if (finalProgram_) {
-        glUseProgram(finalProgram_);
+    // The variant without the thickness compiles its fetch out
+    if (GLuint finalProgram = finalPrograms_[thicknessValid_ ? 1 : 0]) {
+        glUseProgram(finalProgram);
         
         // Bind the final smoothed texture (stored during smoothing pass)
         glActiveTexture(GL_TEXTURE0);
         GLuint finalTexture = smoothTexture_[finalSmoothedBuffer_];
         glBindTexture(GL_TEXTURE_2D, finalTexture);
-        glUniform1i(glGetUniformLocation(finalProgram_, "uTexture"), 0);
+        glUniform1i(glGetUniformLocation(finalProgram, "uTexture"), 0);
+        
+        // Interior thickness from surface splatting
+        if (thicknessValid_) {
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, thicknessTexture_);
+            glUniform1i(glGetUniformLocation(finalProgram, "uThickness"), 1);
+            glActiveTexture(GL_TEXTURE0);
+        }
         
         // Render fullscreen quad
         static GLuint fullscreenVAO = 0;
@@ -952,7 +4419,9 @@ void SPHComputeSystem::renderFinalShading(const glm::mat4& view, const glm::mat4
             glGenVertexArrays(1, &fullscreenVAO);
         }
         glBindVertexArray(fullscreenVAO);
+        if (shadingRates_) shadingRates_->begin();
         glDrawArrays(GL_TRIANGLES, 0, 3);
+        if (shadingRates_) shadingRates_->end();
         glBindVertexArray(0);
     }
     
@@ -961,29 +4430,202 @@ void SPHComputeSystem::renderFinalShading(const glm::mat4& view, const glm::mat4
     glEnable(GL_DEPTH_TEST);
 }
 
-void SPHComputeSystem::renderGlassContainer(const glm::mat4& view, const glm::mat4& projection) {
+void SPHComputeSystem::ensureSurfaceVolume() {
+    GPUMemoryScope memoryScope("SPH");
+    // The cube cases only depend on the corner and edge numbering, so they are built once
+    if (!surfaceTableBuffer_) {
+        std::vector<uint32_t> table = buildMarchingCubesTable(surfaceTableStride_);
+        glCreateBuffers(1, &surfaceTableBuffer_);
+        bufferStorage(surfaceTableBuffer_, table.size() * sizeof(uint32_t), table.data(), 0);
+    }
+    if (!surfaceMeshBuffer_) {
+        const uint32_t drawReset[4] = { 0, 1, 0, 0 };
+        GLsizeiptr vertexBytes = GLsizeiptr(SPHConstants::SURFACE_MAX_TRIANGLES) * 3 * 2 * sizeof(glm::vec4);
+        glCreateBuffers(1, &surfaceMeshBuffer_);
+        bufferStorage(surfaceMeshBuffer_, sizeof(drawReset) + vertexBytes, nullptr, GL_DYNAMIC_STORAGE_BIT);
+        glNamedBufferSubData(surfaceMeshBuffer_, 0, sizeof(drawReset), drawReset);
+    }
+    
+    // Nodes span the grid plus a kernel radius on each side, so the surface closes along the
+    // walls; coarsened until every axis fits SURFACE_MAX_RESOLUTION
+    float voxelSize = SPHConstants::CELL_SIZE / surfaceResolution_;
+    glm::ivec3 volumeRes;
+    int padding = 0;
+    while (true) {
+        padding = static_cast<int>(std::ceil(shaderParameters_.kernelRadius / voxelSize));
+        volumeRes = glm::ivec3(glm::ceil(gridSize_ / voxelSize)) + 1 + 2 * padding;
+        if (glm::all(glm::lessThanEqual(volumeRes, glm::ivec3(SPHConstants::SURFACE_MAX_RESOLUTION)))) break;
+        voxelSize *= 1.25f;
+    }
+    surfaceVoxelSize_ = voxelSize;
+    surfaceVolumeOrigin_ = gridOrigin_ - glm::vec3(voxelSize * padding);
+    if (volumeRes == surfaceVolumeRes_) return;
+    
+    if (surfaceFieldTexture_) deleteTextures(1, &surfaceFieldTexture_);
+    if (surfaceTriangleCountBuffer_) deleteBuffers(1, &surfaceTriangleCountBuffer_);
+    if (surfaceTriangleOffsetBuffer_) deleteBuffers(1, &surfaceTriangleOffsetBuffer_);
+    if (surfaceScanBlockSumBuffer_) deleteBuffers(1, &surfaceScanBlockSumBuffer_);
+    
+    glCreateTextures(GL_TEXTURE_3D, 1, &surfaceFieldTexture_);
+    textureStorage3D(surfaceFieldTexture_, 1, GL_R32UI, volumeRes.x, volumeRes.y, volumeRes.z);
+    glTextureParameteri(surfaceFieldTexture_, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTextureParameteri(surfaceFieldTexture_, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    
+    // The per-cell counts are scanned by step 2, with block sums of their own: the shared
+    // ones are sized for the simulation grid
+    uint32_t cellCount = uint32_t(volumeRes.x - 1) * uint32_t(volumeRes.y - 1) * uint32_t(volumeRes.z - 1);
+    uint32_t blockCount = (cellCount + SPHConstants::SCAN_BLOCK_SIZE - 1) / SPHConstants::SCAN_BLOCK_SIZE;
+    glCreateBuffers(1, &surfaceTriangleCountBuffer_);
+    bufferStorage(surfaceTriangleCountBuffer_, cellCount * sizeof(uint32_t), nullptr, 0);
+    glCreateBuffers(1, &surfaceTriangleOffsetBuffer_);
+    bufferStorage(surfaceTriangleOffsetBuffer_, cellCount * sizeof(uint32_t), nullptr, 0);
+    glCreateBuffers(1, &surfaceScanBlockSumBuffer_);
+    bufferStorage(surfaceScanBlockSumBuffer_, blockCount * sizeof(uint32_t), nullptr, 0);
+    surfaceVolumeRes_ = volumeRes;
+    
+    std::cout << "SPH surface volume: " << volumeRes.x << "x" << volumeRes.y << "x" << volumeRes.z
+              << " nodes, voxel size " << voxelSize << std::endl;
+}
+
+void SPHComputeSystem::extractSurfaceMesh() {
+    ensureSurfaceVolume();
+    glm::ivec3 cellRes = surfaceVolumeRes_ - 1;
+    uint32_t cellCount = uint32_t(cellRes.x) * uint32_t(cellRes.y) * uint32_t(cellRes.z);
+    
+    // Kernel sum of a filled lattice at the particle spacing, the field value deep inside
+    const float h = shaderParameters_.kernelRadius;
+    const float spacing = SPHConstants::PARTICLE_RADIUS * 2.0f;
+    const int range = static_cast<int>(std::ceil(h / spacing));
+    float latticeSum = 0.0f;
+    for (int x = -range; x <= range; x++) {
+        for (int y = -range; y <= range; y++) {
+            for (int z = -range; z <= range; z++) {
+                float diff = h * h - glm::dot(glm::vec3(x, y, z) * spacing, glm::vec3(x, y, z) * spacing);
+                if (diff > 0.0f) latticeSum += diff * diff * diff;
+            }
+        }
+    }
+    
+    // Step 1: splat the particles into the cleared field
+    const uint32_t zero = 0;
+    glClearTexImage(surfaceFieldTexture_, 0, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+    glUseProgram(surfaceSplatProgram_);
+    glUniform1ui(glGetUniformLocation(surfaceSplatProgram_, "uParticleCount"), renderCount_);
+    glUniform3fv(glGetUniformLocation(surfaceSplatProgram_, "uVolumeOrigin"), 1, &surfaceVolumeOrigin_[0]);
+    glUniform1f(glGetUniformLocation(surfaceSplatProgram_, "uVoxelSize"), surfaceVoxelSize_);
+    glUniform3iv(glGetUniformLocation(surfaceSplatProgram_, "uVolumeRes"), 1, &surfaceVolumeRes_[0]);
+    glUniform1f(glGetUniformLocation(surfaceSplatProgram_, "uKernelRadius"), h);
+    glUniform1f(glGetUniformLocation(surfaceSplatProgram_, "uWeight"), 1.0f / latticeSum);
+    glUniform1f(glGetUniformLocation(surfaceSplatProgram_, "uFieldScale"), SPHConstants::SURFACE_FIELD_SCALE);
+    glBindImageTexture(0, surfaceFieldTexture_, 0, GL_TRUE, 0, GL_READ_WRITE, GL_R32UI);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, renderBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 24, renderCountBuffer_);
+    glDispatchCompute((renderCount_ + 255) / 256, 1, 1);
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+    
+    // Step 2: triangles per cell, scanned into each cell's first triangle
+    glUseProgram(marchingCubesProgram_);
+    glUniform3iv(glGetUniformLocation(marchingCubesProgram_, "uVolumeRes"), 1, &surfaceVolumeRes_[0]);
+    glUniform3fv(glGetUniformLocation(marchingCubesProgram_, "uVolumeOrigin"), 1, &surfaceVolumeOrigin_[0]);
+    glUniform1f(glGetUniformLocation(marchingCubesProgram_, "uVoxelSize"), surfaceVoxelSize_);
+    glUniform1f(glGetUniformLocation(marchingCubesProgram_, "uFieldScale"), SPHConstants::SURFACE_FIELD_SCALE);
+    glUniform1f(glGetUniformLocation(marchingCubesProgram_, "uIsoLevel"), surfaceIsoLevel_);
+    glUniform1ui(glGetUniformLocation(marchingCubesProgram_, "uTableStride"), surfaceTableStride_);
+    glUniform1ui(glGetUniformLocation(marchingCubesProgram_, "uMaxTriangles"), SPHConstants::SURFACE_MAX_TRIANGLES);
+    glUniform1i(glGetUniformLocation(marchingCubesProgram_, "uPass"), 0);
+    glBindTextureUnit(0, surfaceFieldTexture_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, surfaceTriangleCountBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 31, surfaceTableBuffer_);
+    glDispatchCompute((cellCount + 255) / 256, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    
+    dispatchPrefixScan(surfaceTriangleCountBuffer_, surfaceTriangleOffsetBuffer_, 0, cellCount, surfaceScanBlockSumBuffer_);
+    
+    // Step 3: write the compacted triangles and the indirect vertex count
+    glUseProgram(marchingCubesProgram_);
+    glUniform1i(glGetUniformLocation(marchingCubesProgram_, "uPass"), 1);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, surfaceTriangleOffsetBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 30, surfaceMeshBuffer_);
+    glDispatchCompute((cellCount + 255) / 256, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+    
+    surfaceMeshValid_ = true;
+}
+
+void SPHComputeSystem::renderSurfaceMesh(const glm::mat4& view, const glm::mat4& projection) {
+    if (!surfaceMeshValid_ || !surfaceProgram_) return;
+    
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LESS);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    
+    glm::mat4 vp = projection * view;
+    glm::vec3 viewPos = glm::vec3(glm::inverse(view)[3]);
+    const glm::vec3 lightPos(5.0f, 10.0f, 5.0f);
+    
+    glUseProgram(surfaceProgram_);
+    glUniformMatrix4fv(glGetUniformLocation(surfaceProgram_, "uVP"), 1, GL_FALSE, &vp[0][0]);
+    glUniform3fv(glGetUniformLocation(surfaceProgram_, "uViewPos"), 1, &viewPos[0]);
+    glUniform3fv(glGetUniformLocation(surfaceProgram_, "uLightPos"), 1, &lightPos[0]);
+    
+    // Attribute-less like the billboards; the vertex count comes from step 3
+    glBindVertexArray(billboardVAO_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 30, surfaceMeshBuffer_);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, surfaceMeshBuffer_);
+    glDrawArraysIndirect(GL_TRIANGLES, nullptr);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    glBindVertexArray(0);
+}
+
+void SPHComputeSystem::renderTransparent(const glm::mat4& view, const glm::mat4& projection) {
+    // Secondary particles live on the simulating context only, so snapshots skip them
+    if (useDiffuseParticles_ && !renderSnapshots_ && renderCount_ > 0) {
+        renderDiffuseParticles(view, projection);
+    }
+    if (renderContainer_) {
+        renderGlassContainer();
+    }
+}
+
+void SPHComputeSystem::renderDiffuseParticles(const glm::mat4& view, const glm::mat4& projection) {
+    if (!diffuseRenderProgram_ || !diffuseParticleBuffer_) return;
+    
+    // Soft disks over the fluid, depth tested by the transparent pass but not occluding each other
+    glm::mat4 vp = projection * view;
+    
+    glUseProgram(diffuseRenderProgram_);
+    glUniformMatrix4fv(glGetUniformLocation(diffuseRenderProgram_, "uVP"), 1, GL_FALSE, &vp[0][0]);
+    glUniformMatrix4fv(glGetUniformLocation(diffuseRenderProgram_, "uView"), 1, GL_FALSE, &view[0][0]);
+    glUniform1f(glGetUniformLocation(diffuseRenderProgram_, "uPointRadius"), SPHConstants::PARTICLE_RADIUS * 0.5f);
+    
+    // One instance per ring slot in use, counted on the GPU by the spawn pass
+    glBindVertexArray(billboardVAO_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 33, diffuseParticleBuffer_);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, diffuseStateBuffer_);
+    glDrawArraysIndirect(GL_TRIANGLE_STRIP, nullptr);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    glBindVertexArray(0);
+}
+
+void SPHComputeSystem::renderGlassContainer() {
     if (!containerShader_ || !renderContainer_) return;
     
+    // glass.vs takes the camera from the frame uniform block the main pass has filled
     glUseProgram(containerShader_);
     
-    // Set transformation matrices
-    glm::mat4 model = glm::mat4(1.0f);
-    glUniformMatrix4fv(glGetUniformLocation(containerShader_, "model"), 1, GL_FALSE, &model[0][0]);
-    glUniformMatrix4fv(glGetUniformLocation(containerShader_, "view"), 1, GL_FALSE, &view[0][0]);
-    glUniformMatrix4fv(glGetUniformLocation(containerShader_, "projection"), 1, GL_FALSE, &projection[0][0]);
-    
     // Set glass properties
     glUniform3f(glGetUniformLocation(containerShader_, "glassColor"), 0.9f, 0.95f, 1.0f);
     glUniform1f(glGetUniformLocation(containerShader_, "glassAlpha"), 0.2f);
     glUniform1f(glGetUniformLocation(containerShader_, "glassRefractionIndex"), 1.05f);
     
-    // Enable blending for transparency
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    
-    // Render container
+    // Render container, once per batched scene
     glBindVertexArray(containerVAO_);
-    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+    for (uint32_t scene = 0; scene < getSceneCount(); scene++) {
+        glm::mat4 model = glm::translate(glm::mat4(1.0f), getSceneOffset(scene));
+        glUniformMatrix4fv(glGetUniformLocation(containerShader_, "model"), 1, GL_FALSE, &model[0][0]);
+        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+    }
     glBindVertexArray(0);
 }
 
@@ -992,16 +4634,53 @@ void SPHComputeSystem::onWindowResize(int width, int height) {
     
     windowWidth_ = width;
     windowHeight_ = height;
+    recreateFramebuffers();
+}
+
+void SPHComputeSystem::setFluidRenderScale(float scale) {
+    scale = std::min(std::max(scale, 0.25f), 1.0f);
+    if (scale == fluidRenderScale_) return;
     
+    fluidRenderScale_ = scale;
+    if (depthFBO_) {
+        recreateFramebuffers();
+    }
+}
+
+void SPHComputeSystem::recreateFramebuffers() {
     // Recreate framebuffers with new size
+    releaseFramebuffers();
+    createFramebuffers();
+}
+
+void SPHComputeSystem::releaseFramebuffers() {
+    // Framebuffers first, so the pool gets its textures back unattached
+    RenderTargetPool& pool = RenderTargetPool::instance();
     if (depthFBO_) {
         glDeleteFramebuffers(1, &depthFBO_);
-        glDeleteTextures(1, &depthTexture_);
         glDeleteFramebuffers(2, smoothFBO_);
-        glDeleteTextures(2, smoothTexture_);
+        glDeleteFramebuffers(1, &thicknessFBO_);
+        depthFBO_ = 0;
+        smoothFBO_[0] = smoothFBO_[1] = 0;
+        thicknessFBO_ = 0;
     }
-    
-    createFramebuffers();
+    if (splatDepthView_) glDeleteTextures(1, &splatDepthView_);
+    pool.release(splatDepthTexture_);
+    pool.release(depthTexture_);
+    pool.release(motionTexture_);
+    pool.release(smoothTexture_[0]);
+    pool.release(smoothTexture_[1]);
+    pool.release(thicknessTexture_);
+    pool.release(hiZTexture_);
+    depthTexture_ = 0;
+    motionTexture_ = 0;
+    splatDepthTexture_ = 0;
+    splatDepthView_ = 0;
+    splatDepthActive_ = false;
+    smoothTexture_[0] = smoothTexture_[1] = 0;
+    thicknessTexture_ = 0;
+    hiZTexture_ = 0;
+    hiZValid_ = false;
 }
 
 }
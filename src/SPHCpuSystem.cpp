@@ -0,0 +1,436 @@
+#include "SPHCpuSystem.h"
+#include "JobSystem.h"
+#include <iostream>
+#include <algorithm>
+#include <glm/gtx/string_cast.hpp>
+
+namespace WaterSim {
+
+namespace {
+    // Partitioned passes cut the streams at page boundaries, so a page is touched by one
+    // worker and, with the set at capacity, by the one that first touched it
+    constexpr int STREAM_PAGE = 4096 / sizeof(float);
+}
+
+SPHCpuSystem::SPHCpuSystem()
+    : boxMin_(0.0f)
+    , boxMax_(0.0f)
+    , gravity_(0.0f, -9.81f, 0.0f)
+    , gridOrigin_(0.0f)
+    , gridSize_(0.0f)
+    , invCellSize_(0.0f)
+    , gridRes_(0)
+    , spherePosition_(0.0f)
+    , sphereImpulse_(0.0f)
+    , emitRandom_(12345u)
+{
+}
+
+bool SPHCpuSystem::initialize(uint32_t numParticles, const glm::vec3& boxMin, const glm::vec3& boxMax) {
+    maxParticles_ = ((std::max(numParticles, 1u) + 511) / 512) * 512;
+    boxMin_ = boxMin;
+    boxMax_ = boxMax;
+
+    // Same grid as the GPU pipeline, so cells and boundaries match between backends
+    gridSize_ = boxMax - boxMin;
+    gridOrigin_ = boxMin;
+    gridRes_ = glm::ivec3((gridSize_ / SPHConstants::CELL_SIZE) + 1.0f);
+    invCellSize_ = glm::vec3(gridRes_) * (1.0f - 0.001f) / gridSize_;
+    cellCount_ = static_cast<uint32_t>(gridRes_.x) * gridRes_.y * gridRes_.z;
+
+    cellCounts_.assign(cellCount_, 0);
+    cellStarts_.assign(cellCount_, 0);
+    cellCursors_.assign(cellCount_, 0);
+    activeCells_.reserve(std::min(cellCount_, maxParticles_));
+    resizeStreams(maxParticles_);
+
+    std::cout << "SPH CPU backend: " << maxParticles_ << " particle capacity, grid "
+              << gridRes_.x << "x" << gridRes_.y << "x" << gridRes_.z << std::endl;
+
+    reset();
+    return true;
+}
+
+void SPHCpuSystem::resizeStreams(uint32_t capacity) {
+    // Fresh, untouched allocations, zeroed by the partitions that will stream them so each
+    // page lands on its worker's node
+    std::initializer_list<FirstTouchVector<float>*> streams = {
+        &positionX_, &positionY_, &positionZ_, &velocityX_, &velocityY_, &velocityZ_,
+        &density_, &pressure_, &scratchPositionX_, &scratchPositionY_, &scratchPositionZ_,
+        &scratchVelocityX_, &scratchVelocityY_, &scratchVelocityZ_ };
+    for (FirstTouchVector<float>* stream : streams) {
+        stream->clear();
+        stream->shrink_to_fit();
+        stream->resize(capacity);
+    }
+    JobSystem::instance().parallelForPartitioned(0, static_cast<int>(capacity), STREAM_PAGE, [&](int first, int last) {
+        for (FirstTouchVector<float>* stream : streams) {
+            std::fill(stream->begin() + first, stream->begin() + last, 0.0f);
+        }
+    });
+    particleCell_.assign(capacity, 0);
+}
+
+void SPHCpuSystem::update(float deltaTime) {
+    const float dt = SPHConstants::DT;
+
+    accumulatedTime_ += deltaTime;
+    int substeps = 0;
+
+    while (accumulatedTime_ >= dt && substeps < maxSubsteps_) {
+        integrate(dt);
+        buildGrid();
+        computeDensityPressure();
+        computeForces(dt);
+
+        accumulatedTime_ -= dt;
+        substeps++;
+    }
+
+    if (accumulatedTime_ >= dt) {
+        accumulatedTime_ = std::fmod(accumulatedTime_, dt);
+    }
+    lastSubstepCount_ = substeps;
+}
+
+void SPHCpuSystem::reset() {
+    numParticles_ = 0;
+    accumulatedTime_ = 0.0f;
+
+    // Dam-break block, identical to SPHComputeSystem::reset
+    float spacing = SPHConstants::PARTICLE_RADIUS * 2.0f;
+    glm::vec3 fluidMin = gridOrigin_ + gridSize_ * 0.25f;
+    glm::vec3 fluidMax = gridOrigin_ + gridSize_ * 0.75f;
+    fluidMax.y = gridOrigin_.y + gridSize_.y * 0.5f;
+
+    float margin = SPHConstants::PARTICLE_RADIUS;
+    fluidMin = glm::max(fluidMin, boxMin_ + glm::vec3(margin));
+    fluidMax = glm::min(fluidMax, boxMax_ - glm::vec3(margin));
+
+    // Lattice coordinates stepped exactly as before, then the block filled in parallel in
+    // x, y, z order up to the capacity
+    std::vector<float> latticeX, latticeY, latticeZ;
+    for (float x = fluidMin.x; x <= fluidMax.x; x += spacing) latticeX.push_back(x);
+    for (float y = fluidMin.y; y <= fluidMax.y; y += spacing) latticeY.push_back(y);
+    for (float z = fluidMin.z; z <= fluidMax.z; z += spacing) latticeZ.push_back(z);
+
+    const size_t lattice = latticeX.size() * latticeY.size() * latticeZ.size();
+    std::vector<glm::vec3> positions(std::min<size_t>(lattice, maxParticles_));
+    const int ny = static_cast<int>(latticeY.size());
+    const int nz = static_cast<int>(latticeZ.size());
+    JobSystem::instance().parallelFor(0, static_cast<int>(positions.size()), 0, [&](int first, int last) {
+        for (int i = first; i < last; i++) {
+            positions[i] = glm::vec3(latticeX[i / (ny * nz)], latticeY[(i / nz) % ny], latticeZ[i % nz]);
+        }
+    });
+
+    addParticles(positions, std::vector<glm::vec3>(positions.size(), glm::vec3(0.0f)));
+    std::cout << "SPH CPU backend initialized with " << numParticles_ << " particles" << std::endl;
+}
+
+void SPHCpuSystem::addParticles(const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& velocities) {
+    if (positions.size() != velocities.size()) {
+        std::cerr << "Position and velocity arrays must have same size" << std::endl;
+        return;
+    }
+
+    uint32_t count = static_cast<uint32_t>(std::min<size_t>(positions.size(), maxParticles_ - numParticles_));
+    if (count < positions.size()) {
+        std::cerr << "Warning: Particle capacity reached, adding only " << count << " of " << positions.size() << std::endl;
+    }
+
+    const uint32_t base = numParticles_;
+    JobSystem::instance().parallelForPartitioned(0, static_cast<int>(count), STREAM_PAGE, [&](int first, int last) {
+        for (int i = first; i < last; i++) {
+            uint32_t id = base + i;
+            positionX_[id] = positions[i].x;
+            positionY_[id] = positions[i].y;
+            positionZ_[id] = positions[i].z;
+            velocityX_[id] = velocities[i].x;
+            velocityY_[id] = velocities[i].y;
+            velocityZ_[id] = velocities[i].z;
+            density_[id] = SPHConstants::REST_DENSITY;
+            pressure_[id] = 0.0f;
+        }
+    });
+    numParticles_ += count;
+}
+
+uint32_t SPHCpuSystem::emitStream(const glm::vec3& origin, const glm::vec3& velocity, float radius, uint32_t count) {
+    count = std::min(count, maxParticles_ - numParticles_);
+
+    // Orthonormal basis around the stream direction, as in sph_emit.cs
+    glm::vec3 axis = glm::length(velocity) > 0.0f ? glm::normalize(velocity) : glm::vec3(0.0f, -1.0f, 0.0f);
+    glm::vec3 helper = std::abs(axis.y) < 0.99f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+    glm::vec3 tangent = glm::normalize(glm::cross(helper, axis));
+    glm::vec3 bitangent = glm::cross(axis, tangent);
+
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+    std::vector<glm::vec3> positions(count);
+    for (uint32_t i = 0; i < count; i++) {
+        float r = radius * std::sqrt(uniform(emitRandom_));
+        float theta = 2.0f * SPHConstants::PI_VALUE * uniform(emitRandom_);
+        positions[i] = origin + r * (std::cos(theta) * tangent + std::sin(theta) * bitangent);
+    }
+
+    addParticles(positions, std::vector<glm::vec3>(count, velocity));
+    return count;
+}
+
+void SPHCpuSystem::applyImpulse(const glm::vec3& position, const glm::vec3& impulse, float radius) {
+    spherePosition_ = position;
+    sphereImpulse_ = impulse;
+    sphereRadius_ = radius;
+    sphereActive_ = true;
+}
+
+void SPHCpuSystem::getParticles(std::vector<SPHParticleCompute>& particles) const {
+    particles.resize(numParticles_);
+    for (uint32_t i = 0; i < numParticles_; i++) {
+        particles[i].position = glm::vec3(positionX_[i], positionY_[i], positionZ_[i]);
+        particles[i].density = density_[i];
+        particles[i].velocity = glm::vec3(velocityX_[i], velocityY_[i], velocityZ_[i]);
+        particles[i].pressure = pressure_[i];
+    }
+}
+
+void SPHCpuSystem::integrate(float dt) {
+    // Step 1: gravity, sphere impulse, explicit integration and wall response
+    const int count = static_cast<int>(numParticles_);
+    const float safeBounds = 0.5f;
+    const float wallDamping = 0.5f;
+    const glm::vec3 boundsL = gridOrigin_ + safeBounds;
+    const glm::vec3 boundsH = gridOrigin_ + gridSize_ - safeBounds;
+    const glm::vec3 gravityStep = gravity_ * dt;
+
+    JobSystem::instance().parallelForPartitioned(0, count, STREAM_PAGE, [&](int first, int last) {
+        for (int i = first; i < last; i++) {
+            glm::vec3 position(positionX_[i], positionY_[i], positionZ_[i]);
+            glm::vec3 velocity = glm::vec3(velocityX_[i], velocityY_[i], velocityZ_[i]) + gravityStep;
+
+            if (sphereActive_) {
+                glm::vec3 toSphere = spherePosition_ - position;
+                float distToSphere = glm::length(toSphere);
+                if (distToSphere <= sphereRadius_ && distToSphere > 0.001f) {
+                    float impulseStrength = 1.0f - distToSphere / sphereRadius_;
+                    velocity += sphereImpulse_ * (impulseStrength * impulseStrength) * dt;
+                }
+            }
+
+            position += velocity * dt;
+            for (int axis = 0; axis < 3; axis++) {
+                if (position[axis] < boundsL[axis]) { velocity[axis] *= -wallDamping; position[axis] = boundsL[axis]; }
+                if (position[axis] > boundsH[axis]) { velocity[axis] *= -wallDamping; position[axis] = boundsH[axis]; }
+            }
+
+            positionX_[i] = position.x;
+            positionY_[i] = position.y;
+            positionZ_[i] = position.z;
+            velocityX_[i] = velocity.x;
+            velocityY_[i] = velocity.y;
+            velocityZ_[i] = velocity.z;
+        }
+    });
+
+    sphereActive_ = false;
+    sphereImpulse_ = glm::vec3(0.0f);
+}
+
+void SPHCpuSystem::buildGrid() {
+    // Steps 2-3: counting sort. Cell ids are computed in parallel; counting, the scan and
+    // slot assignment are single passes over memory-bound arrays; the gather is parallel
+    const int count = static_cast<int>(numParticles_);
+
+    JobSystem::instance().parallelForPartitioned(0, count, STREAM_PAGE, [&](int first, int last) {
+        for (int i = first; i < last; i++) {
+            glm::ivec3 voxel = glm::ivec3(invCellSize_ * (glm::vec3(positionX_[i], positionY_[i], positionZ_[i]) - gridOrigin_));
+            voxel = glm::clamp(voxel, glm::ivec3(0), gridRes_ - 1);
+            particleCell_[i] = voxel.x + gridRes_.x * (voxel.y + gridRes_.y * voxel.z);
+        }
+    });
+
+    std::fill(cellCounts_.begin(), cellCounts_.end(), 0u);
+    for (int i = 0; i < count; i++) {
+        cellCounts_[particleCell_[i]]++;
+    }
+
+    activeCells_.clear();
+    uint32_t offset = 0;
+    for (uint32_t cell = 0; cell < cellCount_; cell++) {
+        cellStarts_[cell] = offset;
+        cellCursors_[cell] = offset;
+        if (cellCounts_[cell] > 0) {
+            activeCells_.push_back(cell);
+        }
+        offset += cellCounts_[cell];
+    }
+
+    // Reuse the cell id array for each particle's destination slot
+    for (int i = 0; i < count; i++) {
+        particleCell_[i] = cellCursors_[particleCell_[i]]++;
+    }
+
+    JobSystem::instance().parallelForPartitioned(0, count, STREAM_PAGE, [&](int first, int last) {
+        for (int i = first; i < last; i++) {
+            uint32_t slot = particleCell_[i];
+            scratchPositionX_[slot] = positionX_[i];
+            scratchPositionY_[slot] = positionY_[i];
+            scratchPositionZ_[slot] = positionZ_[i];
+            scratchVelocityX_[slot] = velocityX_[i];
+            scratchVelocityY_[slot] = velocityY_[i];
+            scratchVelocityZ_[slot] = velocityZ_[i];
+        }
+    });
+
+    positionX_.swap(scratchPositionX_);
+    positionY_.swap(scratchPositionY_);
+    positionZ_.swap(scratchPositionZ_);
+    velocityX_.swap(scratchVelocityX_);
+    velocityY_.swap(scratchVelocityY_);
+    velocityZ_.swap(scratchVelocityZ_);
+}
+
+void SPHCpuSystem::cellRange(int x, int y, int z, uint32_t& start, uint32_t& end) const {
+    // Cells x-1..x+1 of one row are adjacent in cell order, so the row is one range
+    start = end = 0;
+    if (y < 0 || y >= gridRes_.y || z < 0 || z >= gridRes_.z) return;
+
+    int xMin = std::max(x - 1, 0);
+    int xMax = std::min(x + 1, gridRes_.x - 1);
+    uint32_t rowBase = static_cast<uint32_t>(gridRes_.x) * (y + gridRes_.y * z);
+    start = cellStarts_[rowBase + xMin];
+    end = cellStarts_[rowBase + xMax] + cellCounts_[rowBase + xMax];
+}
+
+void SPHCpuSystem::computeDensityPressure() {
+    // Step 5: poly6 density and the same linear equation of state as sph_step5.cs
+    const float h2 = SPHConstants::H2;
+    const float* px = positionX_.data();
+    const float* py = positionY_.data();
+    const float* pz = positionZ_.data();
+    const int activeCount = static_cast<int>(activeCells_.size());
+
+    // Small batches of cells let idle workers steal, balancing dense and sparse regions
+    JobSystem::instance().parallelFor(0, activeCount, 16, [&](int first, int last) {
+        for (int c = first; c < last; c++) {
+            uint32_t cell = activeCells_[c];
+            int x = static_cast<int>(cell % gridRes_.x);
+            int y = static_cast<int>((cell / gridRes_.x) % gridRes_.y);
+            int z = static_cast<int>(cell / (gridRes_.x * gridRes_.y));
+
+            uint32_t rowStart[9], rowEnd[9];
+            for (int row = 0; row < 9; row++) {
+                cellRange(x, y + row % 3 - 1, z + row / 3 - 1, rowStart[row], rowEnd[row]);
+            }
+
+            for (uint32_t i = cellStarts_[cell]; i < cellStarts_[cell] + cellCounts_[cell]; i++) {
+                const float xi = px[i], yi = py[i], zi = pz[i];
+                float density = 0.0f;
+
+                for (int row = 0; row < 9; row++) {
+                    const int rowEndIndex = static_cast<int>(rowEnd[row]);
+                    #pragma omp simd reduction(+:density)
+                    for (int j = static_cast<int>(rowStart[row]); j < rowEndIndex; j++) {
+                        float dx = xi - px[j], dy = yi - py[j], dz = zi - pz[j];
+                        float r2 = dx * dx + dy * dy + dz * dz;
+                        float w = h2 - r2;
+                        density += r2 < h2 ? w * w * w : 0.0f;
+                    }
+                }
+
+                density *= SPHConstants::MASS * SPHConstants::POLY6_KERNEL_WEIGHT_CONST;
+                density_[i] = density;
+                pressure_[i] = SPHConstants::REST_PRESSURE + SPHConstants::STIFFNESS * (density - SPHConstants::REST_DENSITY);
+            }
+        }
+    });
+}
+
+void SPHCpuSystem::computeForces(float dt) {
+    // Step 6: spiky pressure and viscosity forces plus gravity, matching sph_step6.cs.
+    // New velocities go to the scratch streams so every particle reads the old ones.
+    const float h = SPHConstants::KERNEL_RADIUS;
+    const float h2 = SPHConstants::H2;
+    const float* px = positionX_.data();
+    const float* py = positionY_.data();
+    const float* pz = positionZ_.data();
+    const float* vx = velocityX_.data();
+    const float* vy = velocityY_.data();
+    const float* vz = velocityZ_.data();
+    const float* rho = density_.data();
+    const float* prs = pressure_.data();
+    const int activeCount = static_cast<int>(activeCells_.size());
+
+    JobSystem::instance().parallelFor(0, activeCount, 16, [&](int first, int last) {
+        for (int c = first; c < last; c++) {
+            uint32_t cell = activeCells_[c];
+            int x = static_cast<int>(cell % gridRes_.x);
+            int y = static_cast<int>((cell / gridRes_.x) % gridRes_.y);
+            int z = static_cast<int>(cell / (gridRes_.x * gridRes_.y));
+
+            uint32_t rowStart[9], rowEnd[9];
+            for (int row = 0; row < 9; row++) {
+                cellRange(x, y + row % 3 - 1, z + row / 3 - 1, rowStart[row], rowEnd[row]);
+            }
+
+            for (uint32_t i = cellStarts_[cell]; i < cellStarts_[cell] + cellCounts_[cell]; i++) {
+                const float xi = px[i], yi = py[i], zi = pz[i];
+                const float vxi = vx[i], vyi = vy[i], vzi = vz[i];
+                const float pi = prs[i];
+                float fpx = 0.0f, fpy = 0.0f, fpz = 0.0f;
+                float fvx = 0.0f, fvy = 0.0f, fvz = 0.0f;
+
+                for (int row = 0; row < 9; row++) {
+                    const int rowEndIndex = static_cast<int>(rowEnd[row]);
+                    #pragma omp simd reduction(+:fpx, fpy, fpz, fvx, fvy, fvz)
+                    for (int j = static_cast<int>(rowStart[row]); j < rowEndIndex; j++) {
+                        float dx = xi - px[j], dy = yi - py[j], dz = zi - pz[j];
+                        float r2 = dx * dx + dy * dy + dz * dz;
+
+                        // Masked instead of branching so the loop vectorizes; excludes self
+                        bool inside = r2 < h2 && r2 > 0.0001f * 0.0001f;
+                        float rLen = std::sqrt(r2);
+                        float invR = inside ? 1.0f / rLen : 0.0f;
+                        float invDensity = inside ? 1.0f / rho[j] : 0.0f;
+                        float hr = inside ? h - rLen : 0.0f;
+
+                        // forcePressure -= m (p_i + p_j) * spiky / (2 rho_j)
+                        float pressureScale = -SPHConstants::MASS * (pi + prs[j]) * SPHConstants::SPIKY_KERNEL_WEIGHT_CONST
+                                              * hr * hr * invR * 0.5f * invDensity;
+                        fpx += pressureScale * dx;
+                        fpy += pressureScale * dy;
+                        fpz += pressureScale * dz;
+
+                        float viscosityScale = SPHConstants::MASS * SPHConstants::VIS_KERNEL_WEIGHT_CONST * hr * invDensity;
+                        fvx += viscosityScale * (vx[j] - vxi);
+                        fvy += viscosityScale * (vy[j] - vyi);
+                        fvz += viscosityScale * (vz[j] - vzi);
+                    }
+                }
+
+                glm::vec3 velocity(vxi, vyi, vzi);
+                float densityI = rho[i];
+                if (densityI > 0.0f) {
+                    glm::vec3 totalForce = glm::vec3(fvx, fvy, fvz) * SPHConstants::VIS_COEFF + glm::vec3(fpx, fpy, fpz)
+                                           + gravity_ * densityI;
+                    velocity += totalForce / densityI * dt;
+                }
+
+                float speed = glm::length(velocity);
+                if (speed > velocityLimit_) {
+                    velocity *= velocityLimit_ / speed;
+                }
+
+                scratchVelocityX_[i] = velocity.x;
+                scratchVelocityY_[i] = velocity.y;
+                scratchVelocityZ_[i] = velocity.z;
+            }
+        }
+    });
+
+    velocityX_.swap(scratchVelocityX_);
+    velocityY_.swap(scratchVelocityY_);
+    velocityZ_.swap(scratchVelocityZ_);
+}
+
+} // namespace WaterSim
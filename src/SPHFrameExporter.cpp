@@ -0,0 +1,248 @@
+#include "SPHFrameExporter.h"
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+
+namespace WaterSim {
+
+namespace {
+    constexpr uint32_t FRAME_MAGIC = 0x454D5246u; // 'FRME'
+
+    void writeVarint(std::vector<uint8_t>& out, uint32_t value) {
+        while (value >= 0x80u) {
+            out.push_back(static_cast<uint8_t>(value | 0x80u));
+            value >>= 7;
+        }
+        out.push_back(static_cast<uint8_t>(value));
+    }
+}
+
+SPHFrameExporter::~SPHFrameExporter() {
+    close();
+}
+
+bool SPHFrameExporter::open(const std::string& path, uint32_t maxParticles, const glm::vec3& gridOrigin,
+                            const glm::vec3& gridSize, float velocityScale) {
+    close();
+
+    file_ = std::fopen(path.c_str(), "wb");
+    if (!file_) {
+        std::cerr << "ERROR: Failed to open particle export file " << path << std::endl;
+        return false;
+    }
+
+    std::memcpy(header_.magic, "WSPHSTRM", sizeof(header_.magic));
+    header_.version = 1;
+    header_.headerSize = sizeof(SPHStreamHeader);
+    for (int i = 0; i < 3; i++) {
+        header_.gridOrigin[i] = gridOrigin[i];
+        header_.gridSize[i] = gridSize[i];
+    }
+    header_.velocityScale = velocityScale;
+    std::fwrite(&header_, sizeof(header_), 1, file_);
+    fileOffset_ = sizeof(header_);
+
+    // Persistently mapped readback ring, as for the statistics readback
+    maxParticles_ = maxParticles;
+    // Each slot ends with room for the live count
+    GLsizeiptr slotSize = GLsizeiptr(maxParticles) * sizeof(SPHParticleCompute) + sizeof(uint32_t);
+    GLbitfield readbackFlags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    for (uint32_t i = 0; i < READBACK_SLOTS; i++) {
+        glCreateBuffers(1, &readbackBuffers_[i]);
+        glNamedBufferStorage(readbackBuffers_[i], slotSize, nullptr, readbackFlags);
+        readbackPointers_[i] = glMapNamedBufferRange(readbackBuffers_[i], 0, slotSize, readbackFlags);
+    }
+
+    nextSlot_ = 0;
+    capturedFrames_ = 0;
+    droppedFrames_ = 0;
+    writtenFrames_ = 0;
+    frameOffsets_.clear();
+    stopping_ = false;
+    writer_ = std::thread(&SPHFrameExporter::writerLoop, this);
+
+    std::cout << "Particle export started: " << path << std::endl;
+    return true;
+}
+
+void SPHFrameExporter::close() {
+    if (!file_) return;
+
+    // Drain the ring; blocking is acceptable when the export ends
+    for (uint32_t i = 0; i < READBACK_SLOTS; i++) {
+        uint32_t slot = (nextSlot_ + i) % READBACK_SLOTS;
+        if (readbackFences_[slot]) {
+            glClientWaitSync(readbackFences_[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+        }
+    }
+    poll();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_one();
+    writer_.join();
+
+    // Seek index and footer
+    SPHStreamFooter footer = {};
+    footer.indexOffset = fileOffset_;
+    footer.frameCount = static_cast<uint32_t>(frameOffsets_.size());
+    std::memcpy(footer.magic, "WSPHEND", sizeof("WSPHEND"));
+    if (!frameOffsets_.empty()) {
+        std::fwrite(frameOffsets_.data(), sizeof(uint64_t), frameOffsets_.size(), file_);
+    }
+    std::fwrite(&footer, sizeof(footer), 1, file_);
+    std::fclose(file_);
+    file_ = nullptr;
+
+    for (uint32_t i = 0; i < READBACK_SLOTS; i++) {
+        if (readbackFences_[i]) glDeleteSync(readbackFences_[i]);
+        if (readbackBuffers_[i]) glDeleteBuffers(1, &readbackBuffers_[i]);
+        readbackFences_[i] = 0;
+        readbackBuffers_[i] = 0;
+        readbackPointers_[i] = nullptr;
+    }
+    queue_.clear();
+    freeFrames_.clear();
+
+    std::cout << "Particle export finished: " << writtenFrames_ << " frames written, "
+              << droppedFrames_ << " dropped" << std::endl;
+}
+
+void SPHFrameExporter::capture(GLuint buffer, uint32_t count, double simulationTime, GLuint countBuffer) {
+    if (!file_) return;
+
+    uint32_t slot = nextSlot_;
+    if (readbackFences_[slot] || !readbackPointers_[slot]) {
+        droppedFrames_++; // Readback still in flight: skip rather than stall
+        return;
+    }
+
+    count = std::min(count, maxParticles_);
+    if (count > 0) {
+        glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+        glCopyNamedBufferSubData(buffer, readbackBuffers_[slot], 0, 0, GLsizeiptr(count) * sizeof(SPHParticleCompute));
+    }
+    if (countBuffer) {
+        glCopyNamedBufferSubData(countBuffer, readbackBuffers_[slot], SPHConstants::LIVE_COUNT_OFFSET,
+                                 GLintptr(maxParticles_) * sizeof(SPHParticleCompute), sizeof(uint32_t));
+    }
+    readbackHasLiveCount_[slot] = countBuffer != 0;
+    readbackFences_[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    readbackCounts_[slot] = count;
+    readbackTimes_[slot] = simulationTime;
+    readbackIndices_[slot] = capturedFrames_++;
+    nextSlot_ = (slot + 1) % READBACK_SLOTS;
+}
+
+void SPHFrameExporter::poll() {
+    if (!file_) return;
+
+    // Oldest first, so frames reach the writer in capture order
+    for (uint32_t i = 0; i < READBACK_SLOTS; i++) {
+        uint32_t slot = (nextSlot_ + i) % READBACK_SLOTS;
+        if (!readbackFences_[slot]) continue;
+
+        GLenum status = glClientWaitSync(readbackFences_[slot], 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) break;
+
+        glDeleteSync(readbackFences_[slot]);
+        readbackFences_[slot] = 0;
+
+        Frame frame;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (queue_.size() >= MAX_QUEUED_FRAMES) {
+                droppedFrames_++; // Writer is behind
+                continue;
+            }
+            if (!freeFrames_.empty()) {
+                frame = std::move(freeFrames_.back());
+                freeFrames_.pop_back();
+            }
+        }
+
+        frame.frameIndex = readbackIndices_[slot];
+        frame.simulationTime = readbackTimes_[slot];
+        uint32_t count = readbackCounts_[slot];
+        if (readbackHasLiveCount_[slot]) {
+            uint32_t live = 0;
+            std::memcpy(&live, static_cast<const char*>(readbackPointers_[slot]) + size_t(maxParticles_) * sizeof(SPHParticleCompute),
+                        sizeof(live));
+            count = std::min(count, live);
+        }
+        frame.particles.resize(count);
+        std::memcpy(frame.particles.data(), readbackPointers_[slot], count * sizeof(SPHParticleCompute));
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            queue_.push_back(std::move(frame));
+        }
+        wake_.notify_one();
+    }
+}
+
+void SPHFrameExporter::writerLoop() {
+    std::vector<uint8_t> payload;
+
+    while (true) {
+        Frame frame;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+            if (queue_.empty()) break;
+            frame = std::move(queue_.front());
+            queue_.pop_front();
+        }
+
+        encodeFrame(frame, payload);
+
+        SPHStreamFrameHeader frameHeader = {};
+        frameHeader.magic = FRAME_MAGIC;
+        frameHeader.frameIndex = frame.frameIndex;
+        frameHeader.particleCount = static_cast<uint32_t>(frame.particles.size());
+        frameHeader.simulationTime = frame.simulationTime;
+        frameHeader.payloadSize = payload.size();
+
+        frameOffsets_.push_back(fileOffset_);
+        std::fwrite(&frameHeader, sizeof(frameHeader), 1, file_);
+        std::fwrite(payload.data(), 1, payload.size(), file_);
+        fileOffset_ += sizeof(frameHeader) + payload.size();
+        writtenFrames_++;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        freeFrames_.push_back(std::move(frame));
+    }
+}
+
+void SPHFrameExporter::encodeFrame(const Frame& frame, std::vector<uint8_t>& payload) const {
+    // Channel-major: all x positions, then y, z, then the three velocity components
+    payload.clear();
+    payload.reserve(frame.particles.size() * 6 * 2);
+
+    glm::vec3 origin(header_.gridOrigin[0], header_.gridOrigin[1], header_.gridOrigin[2]);
+    glm::vec3 size(header_.gridSize[0], header_.gridSize[1], header_.gridSize[2]);
+    float velocityScale = header_.velocityScale > 0.0f ? header_.velocityScale : 1.0f;
+
+    for (int channel = 0; channel < 6; channel++) {
+        int32_t previous = 0;
+        for (const SPHParticleCompute& particle : frame.particles) {
+            int32_t quantized;
+            if (channel < 3) {
+                float normalized = (particle.position[channel] - origin[channel]) / size[channel];
+                quantized = static_cast<int32_t>(std::lround(glm::clamp(normalized, 0.0f, 1.0f) * 65535.0f));
+            } else {
+                float normalized = particle.velocity[channel - 3] / velocityScale;
+                quantized = static_cast<int32_t>(std::lround(glm::clamp(normalized, -1.0f, 1.0f) * 32767.0f));
+            }
+
+            int32_t delta = quantized - previous;
+            previous = quantized;
+            writeVarint(payload, (static_cast<uint32_t>(delta) << 1) ^ static_cast<uint32_t>(delta >> 31));
+        }
+    }
+}
+
+} // namespace WaterSim
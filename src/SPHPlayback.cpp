@@ -0,0 +1,460 @@
+#include "SPHPlayback.h"
+#include "GPUMemoryTracker.h"
+#include <iostream>
+#include <algorithm>
+#include <deque>
+#include <limits>
+#include <cstring>
+#include <cmath>
+
+namespace WaterSim {
+
+namespace {
+    constexpr uint32_t FRAME_MAGIC = 0x454D5246u; // 'FRME', as SPHFrameExporter writes it
+
+    // Long streams pass the 2 GB a long offset reaches on some platforms
+    bool seekFile(std::FILE* file, int64_t offset, int origin) {
+#ifdef _WIN32
+        return _fseeki64(file, offset, origin) == 0;
+#else
+        return fseeko(file, static_cast<off_t>(offset), origin) == 0;
+#endif
+    }
+
+    bool readVarint(const uint8_t*& cursor, const uint8_t* end, uint32_t& value) {
+        value = 0;
+        for (int shift = 0; shift < 35 && cursor < end; shift += 7) {
+            uint8_t byte = *cursor++;
+            value |= static_cast<uint32_t>(byte & 0x7Fu) << shift;
+            if (!(byte & 0x80u)) return true;
+        }
+        return false;
+    }
+}
+
+static_assert(SPHConstants::LIVE_COUNT_OFFSET == 3 * sizeof(uint32_t) && SPHConstants::COUNT_RECORD_SIZE == 4 * sizeof(uint32_t),
+              "The played count record is the dispatch record with the live count behind it");
+
+SPHPlayback::~SPHPlayback() {
+    close();
+}
+
+bool SPHPlayback::open(const std::string& path) {
+    close();
+
+    file_ = std::fopen(path.c_str(), "rb");
+    if (!file_) {
+        std::cerr << "ERROR: Failed to open SPH playback file " << path << std::endl;
+        return false;
+    }
+    if (!readIndex() || !allocateRing()) {
+        releaseRing();
+        std::fclose(file_);
+        file_ = nullptr;
+        keyframes_.clear();
+        return false;
+    }
+
+    for (uint32_t i = 0; i < RING_SLOTS; i++) {
+        states_[i] = SlotState::FREE;
+    }
+    shownSlot_ = -1;
+    playhead_ = getStartTime();
+    lateFrames_ = 0;
+    decodedFrames_ = 0;
+    failedFrames_ = 0;
+    plan_ = Plan();
+    plan_.direction = settings_.speed < 0.0f ? -1 : 1;
+    plan_.loop = settings_.loop;
+    plan_.readAhead = static_cast<uint32_t>(std::min<size_t>(std::max(settings_.readAhead, 1), keyframes_.size()));
+    stopping_ = false;
+    streamer_ = std::thread(&SPHPlayback::streamerLoop, this);
+
+    std::cout << "SPH playback: " << path << ", " << keyframes_.size() << " frames over "
+              << (getEndTime() - getStartTime()) << " s, up to " << maxParticles_ << " particles" << std::endl;
+    return true;
+}
+
+void SPHPlayback::close() {
+    if (!file_) return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    streamer_.join();
+
+    releaseRing();
+    std::fclose(file_);
+    file_ = nullptr;
+    keyframes_.clear();
+    maxParticles_ = 0;
+    shownSlot_ = -1;
+}
+
+bool SPHPlayback::readIndex() {
+    if (std::fread(&header_, sizeof(header_), 1, file_) != 1 ||
+        std::memcmp(header_.magic, "WSPHSTRM", sizeof(header_.magic)) != 0 || header_.version != 1) {
+        std::cerr << "ERROR: Not an SPH particle stream (--export)" << std::endl;
+        return false;
+    }
+    for (int i = 0; i < 3; i++) {
+        gridOrigin_[i] = header_.gridOrigin[i];
+        gridSize_[i] = header_.gridSize[i];
+    }
+
+    // The frame offset index the footer points at, written when the export was closed
+    SPHStreamFooter footer = {};
+    if (!seekFile(file_, -static_cast<int64_t>(sizeof(footer)), SEEK_END) ||
+        std::fread(&footer, sizeof(footer), 1, file_) != 1 ||
+        std::memcmp(footer.magic, "WSPHEND", sizeof("WSPHEND")) != 0) {
+        std::cerr << "ERROR: SPH particle stream has no frame index; was its export stopped?" << std::endl;
+        return false;
+    }
+    if (footer.frameCount == 0) {
+        std::cerr << "ERROR: SPH particle stream holds no frames" << std::endl;
+        return false;
+    }
+    std::vector<uint64_t> offsets(footer.frameCount);
+    if (!seekFile(file_, static_cast<int64_t>(footer.indexOffset), SEEK_SET) ||
+        std::fread(offsets.data(), sizeof(uint64_t), offsets.size(), file_) != offsets.size()) {
+        std::cerr << "ERROR: SPH particle stream frame index is truncated" << std::endl;
+        return false;
+    }
+
+    // Every frame is coded by itself, so each is a keyframe; its header gives the time.
+    // A reset during the export starts the recorded time over, which playback continues
+    keyframes_.resize(offsets.size());
+    maxParticles_ = 0;
+    double timeShift = 0.0;
+    for (size_t i = 0; i < offsets.size(); i++) {
+        SPHStreamFrameHeader frameHeader = {};
+        if (!seekFile(file_, static_cast<int64_t>(offsets[i]), SEEK_SET) ||
+            std::fread(&frameHeader, sizeof(frameHeader), 1, file_) != 1 || frameHeader.magic != FRAME_MAGIC) {
+            std::cerr << "ERROR: SPH particle stream frame " << i << " is damaged" << std::endl;
+            return false;
+        }
+        Keyframe& keyframe = keyframes_[i];
+        keyframe.offset = offsets[i];
+        keyframe.payloadSize = frameHeader.payloadSize;
+        keyframe.particleCount = frameHeader.particleCount;
+        keyframe.time = frameHeader.simulationTime + timeShift;
+        if (i > 0 && keyframe.time < keyframes_[i - 1].time) {
+            double spacing = i > 1 ? keyframes_[i - 1].time - keyframes_[i - 2].time : 1.0 / 60.0;
+            timeShift += keyframes_[i - 1].time + spacing - keyframe.time;
+            keyframe.time = keyframes_[i - 1].time + spacing;
+        }
+        maxParticles_ = std::max(maxParticles_, frameHeader.particleCount);
+    }
+    return true;
+}
+
+bool SPHPlayback::allocateRing() {
+    GPUMemoryScope memoryScope("SPH playback");
+    GLsizeiptr particleBytes = GLsizeiptr(std::max(maxParticles_, 1u)) * sizeof(SPHParticleCompute);
+    GLbitfield ringFlags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    for (uint32_t i = 0; i < RING_SLOTS; i++) {
+        glCreateBuffers(1, &particleBuffers_[i]);
+        glNamedBufferStorage(particleBuffers_[i], particleBytes, nullptr, ringFlags);
+        particlePointers_[i] = static_cast<SPHParticleCompute*>(
+            glMapNamedBufferRange(particleBuffers_[i], 0, particleBytes, ringFlags));
+        glCreateBuffers(1, &countBuffers_[i]);
+        glNamedBufferStorage(countBuffers_[i], SPHConstants::COUNT_RECORD_SIZE, nullptr, ringFlags);
+        countPointers_[i] = static_cast<uint32_t*>(
+            glMapNamedBufferRange(countBuffers_[i], 0, SPHConstants::COUNT_RECORD_SIZE, ringFlags));
+        if (!particlePointers_[i] || !countPointers_[i]) {
+            std::cerr << "ERROR: Failed to map the SPH playback ring" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+void SPHPlayback::releaseRing() {
+    for (uint32_t i = 0; i < RING_SLOTS; i++) {
+        if (fences_[i]) glDeleteSync(fences_[i]);
+        if (particlePointers_[i]) glUnmapNamedBuffer(particleBuffers_[i]);
+        if (countPointers_[i]) glUnmapNamedBuffer(countBuffers_[i]);
+        if (particleBuffers_[i]) glDeleteBuffers(1, &particleBuffers_[i]);
+        if (countBuffers_[i]) glDeleteBuffers(1, &countBuffers_[i]);
+        fences_[i] = 0;
+        particleBuffers_[i] = 0;
+        countBuffers_[i] = 0;
+        particlePointers_[i] = nullptr;
+        countPointers_[i] = nullptr;
+    }
+}
+
+uint32_t SPHPlayback::frameAt(double time) const {
+    auto next = std::upper_bound(keyframes_.begin(), keyframes_.end(), time,
+                                 [](double t, const Keyframe& keyframe) { return t < keyframe.time; });
+    return next == keyframes_.begin() ? 0u : static_cast<uint32_t>(next - keyframes_.begin() - 1);
+}
+
+int64_t SPHPlayback::stepsTo(uint32_t from, uint32_t to, const Plan& plan) const {
+    // Frames from one to the other in the playback direction; negative when behind, which
+    // a looping plan never is
+    int64_t steps = (static_cast<int64_t>(to) - static_cast<int64_t>(from)) * plan.direction;
+    if (plan.loop) {
+        int64_t frames = static_cast<int64_t>(keyframes_.size());
+        steps = ((steps % frames) + frames) % frames;
+    }
+    return steps;
+}
+
+void SPHPlayback::restartReading() {
+    // Decoded frames from before the restart are never shown
+    plan_.generation++;
+    for (uint32_t i = 0; i < RING_SLOTS; i++) {
+        if (states_[i] == SlotState::READY) states_[i] = SlotState::FREE;
+    }
+}
+
+void SPHPlayback::update(float deltaTime) {
+    if (!file_) return;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    Plan previous = plan_;
+
+    // Replaced frames the GPU has finished drawing go back to the streaming thread
+    for (uint32_t i = 0; i < RING_SLOTS; i++) {
+        if (states_[i] != SlotState::RETIRED) continue;
+        GLenum status = glClientWaitSync(fences_[i], 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) continue;
+        glDeleteSync(fences_[i]);
+        fences_[i] = 0;
+        states_[i] = SlotState::FREE;
+    }
+
+    // Advance the playhead, wrapping or holding at the ends
+    double start = getStartTime();
+    double duration = getEndTime() - start;
+    if (!settings_.paused) {
+        playhead_ += static_cast<double>(deltaTime) * settings_.speed;
+    }
+    if (settings_.loop && duration > 0.0) {
+        playhead_ = start + std::fmod(playhead_ - start, duration);
+        if (playhead_ < start) playhead_ += duration;
+    } else {
+        playhead_ = std::min(std::max(playhead_, start), getEndTime());
+    }
+    uint32_t target = frameAt(playhead_);
+
+    // The reading follows the playhead's direction and reads as far apart as it moves
+    int direction = settings_.speed < 0.0f ? -1 : 1;
+    if (direction != plan_.direction || settings_.loop != plan_.loop) {
+        plan_.direction = direction;
+        plan_.loop = settings_.loop;
+        restartReading();
+    } else {
+        int64_t advanced = stepsTo(plan_.wanted, target, plan_);
+        if (advanced > 0 && advanced < static_cast<int64_t>(keyframes_.size()) / 2) {
+            plan_.stride = static_cast<uint32_t>(advanced);
+        }
+    }
+    plan_.wanted = target;
+    plan_.readAhead = static_cast<uint32_t>(std::min<size_t>(std::max(settings_.readAhead, 1), keyframes_.size()));
+    int64_t window = static_cast<int64_t>(plan_.readAhead) * plan_.stride;
+
+    // Show the decoded frame nearest the playhead without passing it; frames still to come
+    // stay decoded
+    int best = -1;
+    int64_t bestBehind = std::numeric_limits<int64_t>::max();
+    if (shownSlot_ >= 0) {
+        int64_t behind = stepsTo(slotFrames_[shownSlot_], target, plan_);
+        if (behind >= 0) bestBehind = behind;
+    }
+    for (uint32_t i = 0; i < RING_SLOTS; i++) {
+        if (states_[i] != SlotState::READY) continue;
+        int64_t ahead = stepsTo(target, slotFrames_[i], plan_);
+        if (ahead > 0 && ahead < window) continue;
+        int64_t behind = stepsTo(slotFrames_[i], target, plan_);
+        if (behind >= 0 && behind < bestBehind) {
+            best = static_cast<int>(i);
+            bestBehind = behind;
+        }
+    }
+    if (best >= 0) {
+        if (shownSlot_ >= 0) {
+            states_[shownSlot_] = SlotState::RETIRED;
+            fences_[shownSlot_] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        }
+        states_[best] = SlotState::SHOWN;
+        shownSlot_ = best;
+    }
+
+    // The frames it passed are never drawn
+    for (uint32_t i = 0; i < RING_SLOTS; i++) {
+        if (states_[i] != SlotState::READY) continue;
+        int64_t ahead = stepsTo(target, slotFrames_[i], plan_);
+        if (ahead <= 0 || ahead >= window) states_[i] = SlotState::FREE;
+    }
+
+    if (shownSlot_ < 0 || slotFrames_[shownSlot_] != target) {
+        lateFrames_++;
+    }
+    if (plan_.wanted != previous.wanted || plan_.generation != previous.generation || plan_.stride != previous.stride ||
+        plan_.readAhead != previous.readAhead || best >= 0) {
+        wake_.notify_all();
+    }
+}
+
+void SPHPlayback::seek(uint32_t keyframe) {
+    if (!file_) return;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    keyframe = std::min(keyframe, getKeyframeCount() - 1);
+    playhead_ = keyframes_[keyframe].time;
+    plan_.wanted = keyframe;
+    restartReading();
+    wake_.notify_all();
+}
+
+void SPHPlayback::streamerLoop() {
+    std::deque<Chunk> chunks;           // Read ahead, in reading order
+    std::vector<Chunk> spare;           // Their payload storage, reused
+    std::vector<SPHParticleCompute> scratch;
+    uint64_t generation = std::numeric_limits<uint64_t>::max();
+    uint32_t cursor = 0;                // Next frame to read
+    bool exhausted = false;             // Read up to an end of a stream that does not loop
+    const uint32_t frames = getKeyframeCount();
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopping_) {
+        Plan plan = plan_;
+        int64_t window = static_cast<int64_t>(plan.readAhead) * plan.stride;
+
+        // Start over at the playhead after a restart, or once it overtook the reading
+        int64_t lead = stepsTo(plan.wanted, cursor, plan);
+        if (plan.generation != generation || (!exhausted && (lead < 0 || lead > window + plan.stride))) {
+            for (Chunk& chunk : chunks) spare.push_back(std::move(chunk));
+            chunks.clear();
+            generation = plan.generation;
+            cursor = plan.wanted;
+            exhausted = false;
+        }
+
+        // Drop what the playhead has passed
+        while (!chunks.empty()) {
+            int64_t ahead = stepsTo(plan.wanted, chunks.front().frame, plan);
+            if (ahead >= 0 && ahead < window) break;
+            spare.push_back(std::move(chunks.front()));
+            chunks.pop_front();
+        }
+
+        // Decode the nearest frame into a free slot, unless one already holds it
+        if (!chunks.empty()) {
+            uint32_t frame = chunks.front().frame;
+            int freeSlot = -1;
+            bool resident = false;
+            for (uint32_t i = 0; i < RING_SLOTS; i++) {
+                if (states_[i] == SlotState::FREE && freeSlot < 0) freeSlot = static_cast<int>(i);
+                resident |= (states_[i] == SlotState::READY || states_[i] == SlotState::SHOWN) && slotFrames_[i] == frame;
+            }
+            if (resident) {
+                spare.push_back(std::move(chunks.front()));
+                chunks.pop_front();
+                continue;
+            }
+            if (freeSlot >= 0) {
+                states_[freeSlot] = SlotState::DECODING;
+                slotFrames_[freeSlot] = frame;
+                slotGenerations_[freeSlot] = generation;
+                Chunk chunk = std::move(chunks.front());
+                chunks.pop_front();
+
+                lock.unlock();
+                bool decoded = decodeChunk(chunk, freeSlot, scratch);
+                lock.lock();
+
+                if (decoded) {
+                    decodedFrames_++;
+                } else {
+                    failedFrames_++;
+                }
+                slotCounts_[freeSlot] = std::min(keyframes_[frame].particleCount, maxParticles_);
+                states_[freeSlot] = decoded && slotGenerations_[freeSlot] == plan_.generation ? SlotState::READY : SlotState::FREE;
+                spare.push_back(std::move(chunk));
+                continue;
+            }
+        }
+
+        // Read the next frame ahead
+        if (!exhausted && chunks.size() < plan.readAhead && stepsTo(plan.wanted, cursor, plan) < window) {
+            Chunk chunk;
+            if (!spare.empty()) {
+                chunk = std::move(spare.back());
+                spare.pop_back();
+            }
+            uint32_t frame = cursor;
+            int64_t next = static_cast<int64_t>(cursor) + static_cast<int64_t>(plan.direction) * plan.stride;
+            if (plan.loop) {
+                next = ((next % frames) + frames) % frames;
+            } else if (next < 0 || next >= static_cast<int64_t>(frames)) {
+                exhausted = true;
+            }
+
+            lock.unlock();
+            bool read = readChunk(frame, chunk);
+            lock.lock();
+
+            if (!read) failedFrames_++;
+            if (read && plan_.generation == generation) {
+                chunks.push_back(std::move(chunk));
+            } else {
+                spare.push_back(std::move(chunk));
+            }
+            if (!exhausted) cursor = static_cast<uint32_t>(next);
+            continue;
+        }
+
+        // Nothing to do until the playhead moves or a slot frees up
+        wake_.wait(lock);
+    }
+}
+
+bool SPHPlayback::readChunk(uint32_t frame, Chunk& chunk) {
+    const Keyframe& keyframe = keyframes_[frame];
+    chunk.frame = frame;
+    chunk.payload.resize(static_cast<size_t>(keyframe.payloadSize));
+    return seekFile(file_, static_cast<int64_t>(keyframe.offset + sizeof(SPHStreamFrameHeader)), SEEK_SET) &&
+           std::fread(chunk.payload.data(), 1, chunk.payload.size(), file_) == chunk.payload.size();
+}
+
+bool SPHPlayback::decodeChunk(const Chunk& chunk, int slot, std::vector<SPHParticleCompute>& scratch) const {
+    // The inverse of SPHFrameExporter::encodeFrame: channel-major zigzag varint deltas of
+    // 16-bit positions in the grid box and velocities in the velocity scale
+    uint32_t count = std::min(keyframes_[chunk.frame].particleCount, maxParticles_);
+    scratch.resize(count);
+    for (SPHParticleCompute& particle : scratch) {
+        particle.density = SPHConstants::REST_DENSITY;
+        particle.pressure = 0.0f;
+    }
+
+    const uint8_t* cursor = chunk.payload.data();
+    const uint8_t* end = cursor + chunk.payload.size();
+    float velocityScale = header_.velocityScale > 0.0f ? header_.velocityScale : 1.0f;
+    for (int channel = 0; channel < 6; channel++) {
+        int32_t quantized = 0;
+        for (SPHParticleCompute& particle : scratch) {
+            uint32_t zigzag = 0;
+            if (!readVarint(cursor, end, zigzag)) return false;
+            quantized += static_cast<int32_t>((zigzag >> 1) ^ (~(zigzag & 1u) + 1u));
+            if (channel < 3) {
+                particle.position[channel] = gridOrigin_[channel] + static_cast<float>(quantized) / 65535.0f * gridSize_[channel];
+            } else {
+                particle.velocity[channel - 3] = static_cast<float>(quantized) / 32767.0f * velocityScale;
+            }
+        }
+    }
+
+    // One sequential copy: the ring is write-combined memory the channel-major decode would
+    // scatter into
+    std::memcpy(particlePointers_[slot], scratch.data(), count * sizeof(SPHParticleCompute));
+    const uint32_t record[4] = { (count + 31) / 32, 1, 1, count };
+    std::memcpy(countPointers_[slot], record, sizeof(record));
+    return true;
+}
+
+} // namespace WaterSim
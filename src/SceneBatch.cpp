@@ -0,0 +1,106 @@
+#include "../include/SceneBatch.h"
+#include <algorithm>
+
+namespace WaterSim {
+
+namespace {
+
+constexpr GLsizei VERTEX_FLOATS = 8;
+
+} // namespace
+
+SceneBatch::DrawList::~DrawList() {
+    if (commandBuffer_) glDeleteBuffers(1, &commandBuffer_);
+    if (recordBuffer_) glDeleteBuffers(1, &recordBuffer_);
+}
+
+void SceneBatch::DrawList::clear() {
+    dirty_ = dirty_ || !records_.empty();
+    meshes_.clear();
+    records_.clear();
+}
+
+void SceneBatch::DrawList::add(int mesh, const glm::mat4& model, const glm::vec4& material) {
+    meshes_.push_back(mesh);
+    records_.push_back({ model, material });
+    dirty_ = true;
+}
+
+SceneBatch::~SceneBatch() {
+    if (vao_) glDeleteVertexArrays(1, &vao_);
+    if (vertexBuffer_) glDeleteBuffers(1, &vertexBuffer_);
+    if (indexBuffer_) glDeleteBuffers(1, &indexBuffer_);
+}
+
+int SceneBatch::addMesh(const std::vector<float>& vertices, const std::vector<unsigned int>& indices) {
+    Mesh mesh;
+    mesh.firstIndex = static_cast<GLuint>(indices_.size());
+    mesh.indexCount = static_cast<GLuint>(indices.size());
+    mesh.baseVertex = static_cast<GLint>(vertices_.size() / VERTEX_FLOATS);
+    vertices_.insert(vertices_.end(), vertices.begin(), vertices.end());
+    indices_.insert(indices_.end(), indices.begin(), indices.end());
+    meshes_.push_back(mesh);
+    meshesDirty_ = true;
+    return static_cast<int>(meshes_.size()) - 1;
+}
+
+void SceneBatch::upload() {
+    // Meshes are added at startup, so a rebuild replaces the buffers outright
+    if (vertexBuffer_) glDeleteBuffers(1, &vertexBuffer_);
+    if (indexBuffer_) glDeleteBuffers(1, &indexBuffer_);
+    glCreateBuffers(1, &vertexBuffer_);
+    glNamedBufferStorage(vertexBuffer_, vertices_.size() * sizeof(float), vertices_.data(), 0);
+    glCreateBuffers(1, &indexBuffer_);
+    glNamedBufferStorage(indexBuffer_, indices_.size() * sizeof(unsigned int), indices_.data(), 0);
+
+    if (!vao_) {
+        glCreateVertexArrays(1, &vao_);
+        const GLint sizes[3] = {3, 3, 2};
+        const GLuint offsets[3] = {0, 3 * sizeof(float), 6 * sizeof(float)};
+        for (GLuint attribute = 0; attribute < 3; attribute++) {
+            glEnableVertexArrayAttrib(vao_, attribute);
+            glVertexArrayAttribFormat(vao_, attribute, sizes[attribute], GL_FLOAT, GL_FALSE, offsets[attribute]);
+            glVertexArrayAttribBinding(vao_, attribute, 0);
+        }
+    }
+    glVertexArrayVertexBuffer(vao_, 0, vertexBuffer_, 0, VERTEX_FLOATS * sizeof(float));
+    glVertexArrayElementBuffer(vao_, indexBuffer_);
+    meshesDirty_ = false;
+}
+
+void SceneBatch::upload(DrawList& list) const {
+    std::vector<DrawList::Command> commands;
+    commands.reserve(list.meshes_.size());
+    for (int mesh : list.meshes_) {
+        const Mesh& source = meshes_[mesh];
+        commands.push_back({ source.indexCount, 1, source.firstIndex, source.baseVertex, 0 });
+    }
+
+    if (list.records_.size() > list.capacity_) {
+        if (list.commandBuffer_) glDeleteBuffers(1, &list.commandBuffer_);
+        if (list.recordBuffer_) glDeleteBuffers(1, &list.recordBuffer_);
+        list.capacity_ = std::max<size_t>(list.records_.size(), 2 * list.capacity_);
+        glCreateBuffers(1, &list.commandBuffer_);
+        glNamedBufferStorage(list.commandBuffer_, list.capacity_ * sizeof(DrawList::Command), nullptr, GL_DYNAMIC_STORAGE_BIT);
+        glCreateBuffers(1, &list.recordBuffer_);
+        glNamedBufferStorage(list.recordBuffer_, list.capacity_ * sizeof(DrawList::Record), nullptr, GL_DYNAMIC_STORAGE_BIT);
+    }
+    glNamedBufferSubData(list.commandBuffer_, 0, commands.size() * sizeof(DrawList::Command), commands.data());
+    glNamedBufferSubData(list.recordBuffer_, 0, list.records_.size() * sizeof(DrawList::Record), list.records_.data());
+    list.dirty_ = false;
+}
+
+void SceneBatch::draw(DrawList& list) {
+    if (list.empty() || meshes_.empty()) return;
+    if (meshesDirty_) upload();
+    if (list.dirty_) upload(list);
+
+    glBindVertexArray(vao_);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, list.commandBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SCENE_DRAW_BINDING, list.recordBuffer_);
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, static_cast<GLsizei>(list.size()), 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    glBindVertexArray(0);
+}
+
+} // namespace WaterSim
@@ -0,0 +1,247 @@
+#include "../include/ShaderCompiler.h"
+#include "../include/InitShader.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+namespace WaterSim {
+
+ShaderCompiler& ShaderCompiler::instance() {
+    static ShaderCompiler compiler;
+    return compiler;
+}
+
+void ShaderCompiler::initialize() {
+    // 0xFFFFFFFF lets the driver pick the thread count
+    if (GLAD_GL_KHR_parallel_shader_compile) {
+        glMaxShaderCompilerThreadsKHR(0xFFFFFFFFu);
+        parallel_ = true;
+    } else if (GLAD_GL_ARB_parallel_shader_compile) {
+        glMaxShaderCompilerThreadsARB(0xFFFFFFFFu);
+        parallel_ = true;
+    }
+    std::cout << "Shader compilation: " << (parallel_ ? "parallel (driver threads)" : "one program per frame") << std::endl;
+}
+
+void ShaderCompiler::submit(const void* owner, const std::string& name, const std::vector<Stage>& stages,
+                            ReadyCallback onReady) {
+    Job job;
+    job.owner = owner;
+    job.name = name;
+    job.stages = stages;
+    job.onReady = std::move(onReady);
+    jobs_.push_back(std::move(job));
+    stats_.submitted++;
+    start(jobs_.back());
+}
+
+void ShaderCompiler::submit(const void* owner, const std::string& name, const char* vertexPath, const char* fragmentPath,
+                            ReadyCallback onReady) {
+    submit(owner, name, {{GL_VERTEX_SHADER, vertexPath, ""}, {GL_FRAGMENT_SHADER, fragmentPath, ""}}, std::move(onReady));
+}
+
+void ShaderCompiler::submitCompute(const void* owner, const std::string& name, const char* computePath,
+                                   const std::string& defines, ReadyCallback onReady) {
+    submit(owner, name, {{GL_COMPUTE_SHADER, computePath, defines}}, std::move(onReady));
+}
+
+void ShaderCompiler::cancel(const void* owner) {
+    for (Job& job : jobs_) {
+        if (job.owner == owner) {
+            release(job);
+        }
+    }
+    jobs_.erase(std::remove_if(jobs_.begin(), jobs_.end(), [owner](const Job& job) { return job.owner == owner; }),
+                jobs_.end());
+}
+
+void ShaderCompiler::start(Job& job) {
+    release(job);
+    job.sourceTimes = sourceTimes(job);
+
+    std::vector<std::string> sources;
+    for (const Stage& stage : job.stages) {
+        sources.push_back(InjectShaderDefines(ReadShaderSource(stage.path.c_str()), stage.defines));
+        if (sources.back().empty()) {
+            fail(job, "could not read " + stage.path);
+            return;
+        }
+    }
+
+    std::vector<ShaderStageSource> keyStages;
+    for (size_t i = 0; i < job.stages.size(); i++) {
+        keyStages.push_back({job.stages[i].type, &sources[i]});
+    }
+    job.cacheKey = ProgramCacheKey(keyStages);
+
+    if (GLuint cached = LoadCachedProgram(job.cacheKey, job.name.c_str())) {
+        job.state = State::IDLE;
+        stats_.cacheHits++;
+        stats_.completed++;
+        ReadyCallback onReady = job.onReady; // The callback may submit and move the job
+        onReady(cached);
+        return;
+    }
+
+    // All stages go to the driver before any status is asked for
+    for (size_t i = 0; i < job.stages.size(); i++) {
+        const char* code = sources[i].c_str();
+        GLuint shader = glCreateShader(job.stages[i].type);
+        glShaderSource(shader, 1, &code, NULL);
+        glCompileShader(shader);
+        job.shaders.push_back(shader);
+    }
+    job.state = State::COMPILING;
+}
+
+bool ShaderCompiler::advance(Job& job, bool block) {
+    // Completion queries never block; the status queries below would, if asked too early
+    if (job.state == State::COMPILING) {
+        if (parallel_ && !block) {
+            for (GLuint shader : job.shaders) {
+                GLint complete = GL_FALSE;
+                glGetShaderiv(shader, GL_COMPLETION_STATUS_KHR, &complete);
+                if (!complete) {
+                    return false;
+                }
+            }
+        }
+
+        for (size_t i = 0; i < job.shaders.size(); i++) {
+            GLint success;
+            glGetShaderiv(job.shaders[i], GL_COMPILE_STATUS, &success);
+            if (!success) {
+                GLchar infoLog[512];
+                glGetShaderInfoLog(job.shaders[i], 512, NULL, infoLog);
+                fail(job, "compilation failed for " + job.stages[i].path + "\nError details: " + infoLog);
+                return true;
+            }
+        }
+
+        job.program = glCreateProgram();
+        for (GLuint shader : job.shaders) {
+            glAttachShader(job.program, shader);
+        }
+        glProgramParameteri(job.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glLinkProgram(job.program);
+        job.state = State::LINKING;
+    }
+
+    if (job.state == State::LINKING) {
+        if (parallel_ && !block) {
+            GLint complete = GL_FALSE;
+            glGetProgramiv(job.program, GL_COMPLETION_STATUS_KHR, &complete);
+            if (!complete) {
+                return false;
+            }
+        }
+
+        GLint success;
+        glGetProgramiv(job.program, GL_LINK_STATUS, &success);
+        if (!success) {
+            GLchar infoLog[512];
+            glGetProgramInfoLog(job.program, 512, NULL, infoLog);
+            fail(job, std::string("linking failed\nLinking details: ") + infoLog);
+            return true;
+        }
+
+        StoreCachedProgram(job.cacheKey, job.program);
+        GLuint program = job.program;
+        job.program = 0;
+        release(job);
+        job.state = State::IDLE;
+        stats_.completed++;
+        std::cout << "Shader program ready: " << job.name << " (ID: " << program << ")" << std::endl;
+
+        ReadyCallback onReady = job.onReady;
+        onReady(program);
+        return true;
+    }
+    return false;
+}
+
+void ShaderCompiler::fail(Job& job, const std::string& message) {
+    std::cerr << "ERROR: Shader program " << job.name << ": " << message << std::endl;
+    release(job);
+    job.state = State::IDLE;
+    stats_.failed++;
+}
+
+void ShaderCompiler::release(Job& job) {
+    for (GLuint shader : job.shaders) {
+        glDeleteShader(shader);
+    }
+    job.shaders.clear();
+    if (job.program) {
+        glDeleteProgram(job.program);
+        job.program = 0;
+    }
+}
+
+void ShaderCompiler::poll() {
+    // Indices, not references: a callback may submit and grow jobs_
+    bool blocked = false;
+    for (size_t i = 0; i < jobs_.size(); i++) {
+        if (jobs_[i].state == State::IDLE) {
+            continue;
+        }
+        if (parallel_) {
+            advance(jobs_[i], false);
+        } else if (!blocked) {
+            advance(jobs_[i], true);
+            blocked = true;
+        }
+    }
+
+    if (hotReload_) {
+        checkSources();
+    }
+}
+
+void ShaderCompiler::finish(const void* owner) {
+    for (size_t i = 0; i < jobs_.size(); i++) {
+        if (jobs_[i].owner == owner && jobs_[i].state != State::IDLE) {
+            advance(jobs_[i], true);
+        }
+    }
+}
+
+int ShaderCompiler::getPendingCount() const {
+    return static_cast<int>(std::count_if(jobs_.begin(), jobs_.end(),
+                                          [](const Job& job) { return job.state != State::IDLE; }));
+}
+
+void ShaderCompiler::checkSources() {
+    double now = std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    if (now - lastSourceCheck_ < SOURCE_CHECK_INTERVAL) {
+        return;
+    }
+    lastSourceCheck_ = now;
+
+    for (size_t i = 0; i < jobs_.size(); i++) {
+        // A job still building picks the edit up after it finishes
+        if (jobs_[i].state != State::IDLE || sourceTimes(jobs_[i]) == jobs_[i].sourceTimes) {
+            continue;
+        }
+        std::cout << "Shader source changed, rebuilding: " << jobs_[i].name << std::endl;
+        stats_.reloads++;
+        start(jobs_[i]);
+    }
+}
+
+std::vector<std::filesystem::file_time_type> ShaderCompiler::sourceTimes(const Job& job) {
+    // Same lookup as ReadShaderSource: the working directory, then its parent
+    std::vector<std::filesystem::file_time_type> times;
+    for (const Stage& stage : job.stages) {
+        std::error_code error;
+        std::filesystem::path path = stage.path;
+        if (!std::filesystem::exists(path, error)) {
+            path = std::filesystem::path("..") / stage.path;
+        }
+        std::filesystem::file_time_type time = std::filesystem::last_write_time(path, error);
+        times.push_back(error ? std::filesystem::file_time_type::min() : time);
+    }
+    return times;
+}
+
+} // namespace WaterSim
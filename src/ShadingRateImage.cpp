@@ -0,0 +1,99 @@
+#include "../include/ShadingRateImage.h"
+#include "../include/Profiler.h"
+#include "../include/ShaderCompiler.h"
+#include <algorithm>
+#include <string>
+
+namespace WaterSim {
+
+namespace {
+
+// Palette of the hardware path, indexed by ShadingRateImage::Rate
+const GLenum RATE_PALETTE[ShadingRateImage::RATE_COUNT] = {
+    GL_SHADING_RATE_1_INVOCATION_PER_PIXEL_NV,
+    GL_SHADING_RATE_1_INVOCATION_PER_2X1_PIXELS_NV,
+    GL_SHADING_RATE_1_INVOCATION_PER_1X2_PIXELS_NV,
+    GL_SHADING_RATE_1_INVOCATION_PER_2X2_PIXELS_NV,
+    GL_SHADING_RATE_1_INVOCATION_PER_4X4_PIXELS_NV,
+};
+
+// Contrast threshold per unit of roughness: at water.fs's 0.05 the threshold is half again
+constexpr float ROUGHNESS_WIDENING = 10.0f;
+
+} // namespace
+
+ShadingRateImage::~ShadingRateImage() {
+    ShaderCompiler::instance().cancel(this);
+}
+
+bool ShadingRateImage::initialize(int width, int height) {
+    // The rate texel is one workgroup of shading_rate.cs, so only square texels of workgroup
+    // size are taken; anything else classifies 16-pixel tiles for the compute path alone
+    if (GLAD_GL_NV_shading_rate_image) {
+        GLint texelWidth = 0, texelHeight = 0, paletteSize = 0;
+        glGetIntegerv(GL_SHADING_RATE_IMAGE_TEXEL_WIDTH_NV, &texelWidth);
+        glGetIntegerv(GL_SHADING_RATE_IMAGE_TEXEL_HEIGHT_NV, &texelHeight);
+        glGetIntegerv(GL_SHADING_RATE_IMAGE_PALETTE_SIZE_NV, &paletteSize);
+        hardwareSupported_ = texelWidth == texelHeight && texelWidth >= 8 && texelWidth <= 32 &&
+                             paletteSize >= RATE_COUNT;
+        if (hardwareSupported_) {
+            tileSize_ = texelWidth;
+            glShadingRateImagePaletteNV(0, 0, RATE_COUNT, RATE_PALETTE);
+        }
+    }
+
+    resize(width, height);
+
+    std::string defines = "#define SHADING_RATE_TILE " + std::to_string(tileSize_) + "\n";
+    ShaderCompiler::instance().submitCompute(this, "shading rate", "shaders/shading_rate.cs", defines,
+                                             [this](GLuint program) { classifyProgram_.setId(program); });
+    return texture_.get() != 0;
+}
+
+void ShadingRateImage::resize(int width, int height) {
+    width = std::max(width, 1);
+    height = std::max(height, 1);
+    if (width == width_ && height == height_ && texture_.get() != 0) return;
+    width_ = width;
+    height_ = height;
+    createTexture();
+}
+
+void ShadingRateImage::createTexture() {
+    GPUMemoryScope memoryScope("Shading rate");
+    texture_.create(GL_TEXTURE_2D);
+    texture_.storage2D(1, GL_R8UI, (width_ + tileSize_ - 1) / tileSize_, (height_ + tileSize_ - 1) / tileSize_);
+    texture_.sampling(GL_NEAREST, GL_NEAREST, GL_CLAMP_TO_EDGE);
+    const GLubyte fullRate = RATE_1X1;
+    glClearTexImage(texture_.get(), 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, &fullRate);
+    built_ = false;
+}
+
+void ShadingRateImage::setEnabled(bool enabled) {
+    if (enabled == enabled_) return;
+    enabled_ = enabled;
+    // A classification from before the pause is stale
+    built_ = false;
+}
+
+void ShadingRateImage::build(GLuint sceneColor, GLuint sceneDepth) {
+    if (!enabled_ || !classifyProgram_.isValid() || sceneColor == 0) return;
+
+    ProfileScope scope("Shading rate");
+    classifyProgram_.use();
+    glBindTextureUnit(0, sceneColor);
+    glBindTextureUnit(1, sceneDepth);
+    glBindImageTexture(0, texture_.get(), 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R8UI);
+    classifyProgram_.setFloat("uContrastThreshold",
+                              settings_.contrastThreshold * (1.0f + ROUGHNESS_WIDENING * std::max(settings_.roughness, 0.0f)));
+    classifyProgram_.setBool("uDepthOfField", settings_.depthOfField && sceneDepth != 0);
+    classifyProgram_.setFloat("uFocusDistance", settings_.focusDistance);
+    classifyProgram_.setFloat("uFocusRange", std::max(settings_.focusRange, 1e-3f));
+    glDispatchCompute((width_ + tileSize_ - 1) / tileSize_, (height_ + tileSize_ - 1) / tileSize_, 1);
+
+    // The rasterizer reads the rate image as a texture fetch, the traced composite samples it
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+    built_ = true;
+}
+
+} // namespace WaterSim
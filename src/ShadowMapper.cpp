@@ -0,0 +1,350 @@
+#include "ShadowMapper.h"
+#include "Profiler.h"
+#include "ShaderCompiler.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
+#include <cmath>
+
+namespace WaterSim {
+
+namespace {
+
+// A cascade's center snaps to this many of its texels: any whole number keeps the edges
+// from swimming, and a coarse one keeps the static layer valid while the camera moves
+constexpr float SNAP_TEXELS = 64.0f;
+
+// Slice radii round up to this, so float noise in the fit does not redraw the static layer
+constexpr float RADIUS_QUANTUM = 0.25f;
+
+} // namespace
+
+ShadowMapper::~ShadowMapper() {
+    ShaderCompiler::instance().cancel(this);
+    release();
+    if (framebuffer_) glDeleteFramebuffers(1, &framebuffer_);
+    if (particleVAO_) glDeleteVertexArrays(1, &particleVAO_);
+}
+
+bool ShadowMapper::initialize() {
+    glCreateFramebuffers(1, &framebuffer_);
+    glNamedFramebufferDrawBuffer(framebuffer_, GL_NONE);
+    glNamedFramebufferReadBuffer(framebuffer_, GL_NONE);
+    glCreateVertexArrays(1, &particleVAO_);
+
+    GLfloat pointSizeRange[2] = {1.0f, 64.0f};
+    glGetFloatv(GL_ALIASED_POINT_SIZE_RANGE, pointSizeRange);
+    maxPointSize_ = std::max(pointSizeRange[1], 1.0f);
+
+    allocate();
+
+    ShaderCompiler& compiler = ShaderCompiler::instance();
+    compiler.submit(this, "shadow map",
+                    {{GL_VERTEX_SHADER, "shaders/shadow_map.vs", ""},
+                     {GL_FRAGMENT_SHADER, "shaders/shadow_map.fs", ""}},
+                    [this](GLuint program) { meshProgram_.setId(program); });
+    compiler.submit(this, "shadow map particles",
+                    {{GL_VERTEX_SHADER, "shaders/shadow_map.vs", "#define SHADOW_PARTICLES 1\n"},
+                     {GL_FRAGMENT_SHADER, "shaders/shadow_map.fs", "#define SHADOW_PARTICLES 1\n"}},
+                    [this](GLuint program) { particleProgram_.setId(program); });
+    compiler.submit(this, "shadow map batch",
+                    {{GL_VERTEX_SHADER, "shaders/shadow_map.vs", "#define SCENE_BATCH 1\n"},
+                     {GL_FRAGMENT_SHADER, "shaders/shadow_map.fs", ""}},
+                    [this](GLuint program) { batchProgram_.setId(program); });
+    return staticTexture_ != 0 && dynamicTexture_ != 0;
+}
+
+void ShadowMapper::allocate() {
+    GPUMemoryScope memoryScope("Shadows");
+    const GLfloat farDepth = 1.0f;
+    for (GLuint* texture : {&staticTexture_, &dynamicTexture_}) {
+        glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, texture);
+        textureStorage3D(*texture, 1, GL_DEPTH_COMPONENT32F, settings_.resolution, settings_.resolution, CASCADES, true);
+        // Linear filtering of a comparison is the hardware's 2x2 PCF
+        glTextureParameteri(*texture, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTextureParameteri(*texture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTextureParameteri(*texture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTextureParameteri(*texture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTextureParameteri(*texture, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTextureParameteri(*texture, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+        glClearTexImage(*texture, 0, GL_DEPTH_COMPONENT, GL_FLOAT, &farDepth);
+    }
+    allocatedResolution_ = settings_.resolution;
+    for (Cascade& cascade : cascades_) {
+        cascade.staticValid = false;
+        cascade.dynamicEmpty = true;
+    }
+}
+
+void ShadowMapper::release() {
+    if (staticTexture_) deleteTextures(1, &staticTexture_);
+    if (dynamicTexture_) deleteTextures(1, &dynamicTexture_);
+    staticTexture_ = 0;
+    dynamicTexture_ = 0;
+    allocatedResolution_ = 0;
+}
+
+void ShadowMapper::setSettings(const Settings& settings) {
+    settings_ = settings;
+    settings_.resolution = std::clamp(settings.resolution, 512, 4096);
+    settings_.maxDistance = std::max(settings.maxDistance, 1.0f);
+    settings_.splitLambda = std::clamp(settings.splitLambda, 0.0f, 1.0f);
+    settings_.staticOpacity = std::clamp(settings.staticOpacity, 0.0f, 1.0f);
+    if (allocatedResolution_ != 0 && allocatedResolution_ != settings_.resolution) {
+        release();
+        allocate();
+    }
+}
+
+void ShadowMapper::setLight(const glm::vec3& position, const glm::vec3& target) {
+    toLight_ = glm::normalize(position - target);
+    glm::vec3 up = std::abs(toLight_.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+    lightRotation_ = glm::mat3(glm::lookAt(glm::vec3(0.0f), -toLight_, up));
+    updateDepthRange();
+    staticDirty_ = true;
+}
+
+void ShadowMapper::setSceneBounds(const glm::vec3& boundsMin, const glm::vec3& boundsMax) {
+    if (boundsMin == boundsMin_ && boundsMax == boundsMax_) return;
+    boundsMin_ = boundsMin;
+    boundsMax_ = boundsMax;
+    updateDepthRange();
+    staticDirty_ = true;
+}
+
+void ShadowMapper::updateDepthRange() {
+    float minZ = 1e30f, maxZ = -1e30f;
+    for (int corner = 0; corner < 8; corner++) {
+        glm::vec3 point((corner & 1) ? boundsMax_.x : boundsMin_.x, (corner & 2) ? boundsMax_.y : boundsMin_.y,
+                        (corner & 4) ? boundsMax_.z : boundsMin_.z);
+        float z = (lightRotation_ * point).z;
+        minZ = std::min(minZ, z);
+        maxZ = std::max(maxZ, z);
+    }
+    // Casters in front of the near plane still land on it, through depth clamping
+    float margin = 0.5f + 0.01f * (maxZ - minZ);
+    depthNear_ = -maxZ - margin;
+    depthFar_ = -minZ + margin;
+}
+
+void ShadowMapper::beginFrame(const glm::mat4& view, float fovYDegrees, float aspect, float nearPlane, float farPlane) {
+    stats_.staticCascadesDrawn = 0;
+    stats_.dynamicCascadesDrawn = 0;
+
+    // Practical split scheme: a blend of logarithmic and uniform splits
+    float nearZ = std::max(nearPlane, 0.01f);
+    float farZ = std::max(std::min(farPlane, settings_.maxDistance), nearZ * 2.0f);
+    for (int i = 0; i <= CASCADES; i++) {
+        float t = static_cast<float>(i) / CASCADES;
+        float logSplit = nearZ * std::pow(farZ / nearZ, t);
+        float uniformSplit = nearZ + (farZ - nearZ) * t;
+        stats_.splits[i] = settings_.splitLambda * logSplit + (1.0f - settings_.splitLambda) * uniformSplit;
+    }
+
+    glm::mat4 inverseView = glm::inverse(view);
+    float tanY = std::tan(glm::radians(fovYDegrees) * 0.5f);
+    float tanX = tanY * aspect;
+    float resolution = static_cast<float>(settings_.resolution);
+    const glm::mat4 textureBias(0.5f, 0.0f, 0.0f, 0.0f,
+                                0.0f, 0.5f, 0.0f, 0.0f,
+                                0.0f, 0.0f, 0.5f, 0.0f,
+                                0.5f, 0.5f, 0.5f, 1.0f);
+
+    for (int c = 0; c < CASCADES; c++) {
+        Cascade& cascade = cascades_[c];
+
+        // Bounding sphere of the slice; its radius only depends on the split distances
+        glm::vec3 corners[8];
+        glm::vec3 center(0.0f);
+        for (int corner = 0; corner < 8; corner++) {
+            float depth = stats_.splits[c + (corner >> 2)];
+            glm::vec4 viewCorner((corner & 1) ? tanX * depth : -tanX * depth, (corner & 2) ? tanY * depth : -tanY * depth,
+                                 -depth, 1.0f);
+            corners[corner] = glm::vec3(inverseView * viewCorner);
+            center += corners[corner] / 8.0f;
+        }
+        float radius = 0.0f;
+        for (const glm::vec3& corner : corners) {
+            radius = std::max(radius, glm::length(corner - center));
+        }
+        radius = std::ceil(radius / RADIUS_QUANTUM) * RADIUS_QUANTUM;
+
+        // Nothing casts or receives here
+        glm::vec3 closest = glm::clamp(center, boundsMin_, boundsMax_);
+        cascade.active = glm::length(closest - center) <= radius;
+        if (!cascade.active) continue;
+
+        // Inflated by the most the snapping moves the center
+        cascade.halfSize = radius * (1.0f + 2.0f * SNAP_TEXELS / resolution);
+        cascade.texelWorld = 2.0f * cascade.halfSize / resolution;
+        float snapStep = cascade.texelWorld * SNAP_TEXELS;
+        glm::vec3 lightCenter = lightRotation_ * center;
+        glm::vec2 cells(std::floor(lightCenter.x / snapStep + 0.5f), std::floor(lightCenter.y / snapStep + 0.5f));
+        cascade.center = cells * snapStep;
+
+        glm::mat4 projection = glm::ortho(cascade.center.x - cascade.halfSize, cascade.center.x + cascade.halfSize,
+                                          cascade.center.y - cascade.halfSize, cascade.center.y + cascade.halfSize,
+                                          depthNear_, depthFar_);
+        cascade.lightSpace = projection * glm::mat4(lightRotation_);
+        cascade.texture = textureBias * cascade.lightSpace;
+
+        glm::ivec3 key(static_cast<int>(cells.x), static_cast<int>(cells.y), static_cast<int>(radius / RADIUS_QUANTUM));
+        if (key != cascade.key) {
+            cascade.key = key;
+            cascade.staticValid = false;
+        }
+    }
+}
+
+bool ShadowMapper::overlaps(const Cascade& cascade, const glm::vec3& center, float radius) const {
+    // Depth is clamped, so only the light's view plane culls
+    glm::vec3 lightCenter = lightRotation_ * center;
+    return std::abs(lightCenter.x - cascade.center.x) <= cascade.halfSize + radius &&
+           std::abs(lightCenter.y - cascade.center.y) <= cascade.halfSize + radius;
+}
+
+void ShadowMapper::buildBatch(const std::vector<Caster>& casters, SceneBatch::DrawList& list) const {
+    list.clear();
+    if (!batchReady()) return;
+    for (const Caster& caster : casters) {
+        if (caster.batchMesh >= 0) list.add(caster.batchMesh, caster.batchModel);
+    }
+}
+
+void ShadowMapper::drawCasters(const Cascade& cascade, const std::vector<Caster>& casters, SceneBatch::DrawList& batched) {
+    // The whole batch goes out if one of its casters reaches the cascade; the rest clip
+    bool drawBatch = false;
+    meshProgram_.use();
+    meshProgram_.setMat4("lightSpaceMatrix", cascade.lightSpace);
+    for (const Caster& caster : casters) {
+        if (!overlaps(cascade, caster.center, caster.radius)) continue;
+        if (caster.batchMesh >= 0 && batchReady()) {
+            drawBatch = true;
+            continue;
+        }
+        if (!caster.draw) continue;
+        meshProgram_.setMat4("model", caster.model);
+        caster.draw(meshProgram_);
+    }
+    if (drawBatch) {
+        batchProgram_.use();
+        batchProgram_.setMat4("lightSpaceMatrix", cascade.lightSpace);
+        sceneBatch_->draw(batched);
+    }
+}
+
+void ShadowMapper::drawParticles(const Cascade& cascade, const ParticleCasters& particles) const {
+    // Orthographic, so one point size fits every particle of the cascade
+    particleProgram_.use();
+    particleProgram_.setMat4("lightSpaceMatrix", cascade.lightSpace);
+    particleProgram_.setFloat("pointSize", std::clamp(2.0f * particles.radius / cascade.texelWorld, 1.0f, maxPointSize_));
+    glUniform1ui(particleProgram_.uniformLocation("uNumParticles"), particles.count);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, particles.particleBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 24, particles.countBuffer);
+    glBindVertexArray(particleVAO_);
+    glDrawArrays(GL_POINTS, 0, particles.count);
+    glBindVertexArray(0);
+}
+
+void ShadowMapper::render(const std::vector<Caster>& staticCasters, const std::vector<Caster>& dynamicCasters,
+                          const ParticleCasters& particles) {
+    if (!isActive()) return;
+
+    GLint previousFramebuffer = 0;
+    GLint previousViewport[4];
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+    glGetIntegerv(GL_VIEWPORT, previousViewport);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_);
+    glViewport(0, 0, settings_.resolution, settings_.resolution);
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LESS);
+    glDepthMask(GL_TRUE);
+    glClearDepth(1.0f);
+    glDisable(GL_BLEND);
+    glDisable(GL_CULL_FACE);        // The container is open and seen from inside
+    glEnable(GL_DEPTH_CLAMP);
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    glPolygonOffset(2.0f, 4.0f);    // Slope-scaled bias; receivers add a normal offset
+
+    bool redrawStatic = staticDirty_ || !settings_.cacheStatic;
+    if (redrawStatic) buildBatch(staticCasters, staticBatch_);
+    buildBatch(dynamicCasters, dynamicBatch_);
+    {
+        ProfileScope scope("Shadows: static");
+        for (int c = 0; c < CASCADES; c++) {
+            Cascade& cascade = cascades_[c];
+            if (!cascade.active || (cascade.staticValid && !redrawStatic)) continue;
+            glNamedFramebufferTextureLayer(framebuffer_, GL_DEPTH_ATTACHMENT, staticTexture_, 0, c);
+            glClear(GL_DEPTH_BUFFER_BIT);
+            drawCasters(cascade, staticCasters, staticBatch_);
+            cascade.staticValid = true;
+            stats_.staticCascadesDrawn++;
+            stats_.staticRedraws++;
+        }
+        staticDirty_ = false;
+    }
+
+    {
+        ProfileScope scope("Shadows: dynamic");
+        bool particlesReady = particleProgram_.isValid() && particles.particleBuffer != 0 && particles.count > 0;
+        glm::vec3 particleCenter = 0.5f * (particles.boundsMin + particles.boundsMax);
+        float particleRadius = 0.5f * glm::length(particles.boundsMax - particles.boundsMin) + particles.radius;
+        for (int c = 0; c < CASCADES; c++) {
+            Cascade& cascade = cascades_[c];
+            bool drawMeshes = false;
+            if (cascade.active) {
+                for (const Caster& caster : dynamicCasters) {
+                    drawMeshes = drawMeshes || overlaps(cascade, caster.center, caster.radius);
+                }
+            }
+            bool drawParticleCasters = cascade.active && particlesReady && overlaps(cascade, particleCenter, particleRadius);
+
+            // An empty layer stays valid for any frustum
+            if (!drawMeshes && !drawParticleCasters && cascade.dynamicEmpty) continue;
+            glNamedFramebufferTextureLayer(framebuffer_, GL_DEPTH_ATTACHMENT, dynamicTexture_, 0, c);
+            glClear(GL_DEPTH_BUFFER_BIT);
+            if (drawMeshes) drawCasters(cascade, dynamicCasters, dynamicBatch_);
+            if (drawParticleCasters) {
+                glEnable(GL_PROGRAM_POINT_SIZE);
+                drawParticles(cascade, particles);
+                glDisable(GL_PROGRAM_POINT_SIZE);
+            }
+            cascade.dynamicEmpty = !drawMeshes && !drawParticleCasters;
+            stats_.dynamicCascadesDrawn += cascade.dynamicEmpty ? 0 : 1;
+        }
+    }
+
+    glDisable(GL_POLYGON_OFFSET_FILL);
+    glDisable(GL_DEPTH_CLAMP);
+    glBindFramebuffer(GL_FRAMEBUFFER, static_cast<GLuint>(previousFramebuffer));
+    glViewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+
+    glBindTextureUnit(STATIC_TEXTURE_UNIT, staticTexture_);
+    glBindTextureUnit(DYNAMIC_TEXTURE_UNIT, dynamicTexture_);
+}
+
+void ShadowMapper::applyToReceiver(const GLShaderProgram& program) const {
+    if (!program.isValid()) return;
+    program.use();
+
+    // The samplers always point at the shadow units: two sampler types on one unit fail the draw
+    program.setInt("shadowStatic", STATIC_TEXTURE_UNIT);
+    program.setInt("shadowDynamic", DYNAMIC_TEXTURE_UNIT);
+    program.setBool("shadowsEnabled", isActive());
+    if (!isActive()) return;
+
+    // An inactive cascade maps everything to the origin, which no receiver counts as inside
+    glm::mat4 matrices[CASCADES];
+    float texelWorld[CASCADES];
+    for (int c = 0; c < CASCADES; c++) {
+        matrices[c] = cascades_[c].active ? cascades_[c].texture : glm::mat4(glm::vec4(0.0f), glm::vec4(0.0f),
+                                                                             glm::vec4(0.0f), glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+        texelWorld[c] = cascades_[c].texelWorld;
+    }
+    glUniformMatrix4fv(program.uniformLocation("shadowMatrices"), CASCADES, GL_FALSE, glm::value_ptr(matrices[0]));
+    glUniform1fv(program.uniformLocation("shadowTexelWorld"), CASCADES, texelWorld);
+    program.setFloat("shadowStaticOpacity", settings_.staticOpacity);
+}
+
+} // namespace WaterSim
@@ -0,0 +1,35 @@
+#include "../include/SimulationClock.h"
+#include <algorithm>
+#include <cmath>
+
+namespace WaterSim {
+
+void SimulationClock::setTickRate(float ticksPerSecond) {
+    tickRate_ = std::max(ticksPerSecond, 0.0f);
+    accumulator_ = 0.0f;
+}
+
+void SimulationClock::setMaxTicksPerFrame(int ticks) {
+    maxTicksPerFrame_ = std::max(ticks, 1);
+}
+
+int SimulationClock::advance(float frameTime) {
+    frameTime_ = std::max(frameTime, 0.0f);
+    if (tickRate_ <= 0.0f) return 1;
+
+    float tickTime = 1.0f / tickRate_;
+    accumulator_ += frameTime_;
+    int ticks = std::min(static_cast<int>(accumulator_ / tickTime), maxTicksPerFrame_);
+    accumulator_ -= ticks * tickTime;
+    if (ticks == maxTicksPerFrame_) {
+        // Past the cap the time is dropped, all but the fraction of a tick
+        accumulator_ = std::fmod(accumulator_, tickTime);
+    }
+    return ticks;
+}
+
+float SimulationClock::getAlpha() const {
+    return tickRate_ > 0.0f ? accumulator_ * tickRate_ : 1.0f;
+}
+
+} // namespace WaterSim
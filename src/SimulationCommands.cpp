@@ -0,0 +1,122 @@
+#include "SimulationCommands.h"
+
+namespace WaterSim {
+
+SimulationCommand SimulationCommand::ripple(const glm::vec3& position, float magnitude) {
+    SimulationCommand command;
+    command.type = Type::RIPPLE;
+    command.position = position;
+    command.magnitude = magnitude;
+    return command;
+}
+
+SimulationCommand SimulationCommand::directionalRipple(const glm::vec3& position, const glm::vec2& direction, float magnitude) {
+    SimulationCommand command;
+    command.type = Type::DIRECTIONAL_RIPPLE;
+    command.position = position;
+    command.vector = glm::vec3(direction.x, 0.0f, direction.y);
+    command.magnitude = magnitude;
+    return command;
+}
+
+SimulationCommand SimulationCommand::splash(const glm::vec3& position, float magnitude) {
+    SimulationCommand command;
+    command.type = Type::SPLASH;
+    command.position = position;
+    command.magnitude = magnitude;
+    return command;
+}
+
+SimulationCommand SimulationCommand::flowImpulse(const glm::vec3& position, const glm::vec2& impulse, float radius) {
+    SimulationCommand command;
+    command.type = Type::FLOW_IMPULSE;
+    command.position = position;
+    command.vector = glm::vec3(impulse.x, 0.0f, impulse.y);
+    command.magnitude = radius;
+    return command;
+}
+
+SimulationCommand SimulationCommand::impulse(const glm::vec3& position, const glm::vec3& impulse, float radius) {
+    SimulationCommand command;
+    command.type = Type::IMPULSE;
+    command.position = position;
+    command.vector = impulse;
+    command.magnitude = radius;
+    return command;
+}
+
+SimulationCommand SimulationCommand::fluidStream(const glm::vec3& origin, const glm::vec3& direction, float rate) {
+    SimulationCommand command;
+    command.type = Type::FLUID_STREAM;
+    command.position = origin;
+    command.vector = direction;
+    command.magnitude = rate;
+    return command;
+}
+
+SimulationCommand SimulationCommand::fluidVolume(const glm::vec3& minPos, const glm::vec3& maxPos) {
+    SimulationCommand command;
+    command.type = Type::FLUID_VOLUME;
+    command.position = minPos;
+    command.vector = maxPos;
+    return command;
+}
+
+SimulationCommand SimulationCommand::gravity(const glm::vec3& gravity) {
+    SimulationCommand command;
+    command.type = Type::GRAVITY;
+    command.vector = gravity;
+    return command;
+}
+
+SimulationCommand SimulationCommand::setParameter(Parameter parameter, float value) {
+    SimulationCommand command;
+    command.type = Type::PARAMETER;
+    command.parameter = parameter;
+    command.magnitude = value;
+    return command;
+}
+
+SimulationCommandQueue::SimulationCommandQueue() {
+    for (uint32_t i = 0; i < CAPACITY; i++) {
+        cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+bool SimulationCommandQueue::push(const SimulationCommand& command) {
+    uint32_t position = enqueuePosition_.load(std::memory_order_relaxed);
+    while (true) {
+        Cell& cell = cells_[position & (CAPACITY - 1)];
+        uint32_t sequence = cell.sequence.load(std::memory_order_acquire);
+        int32_t difference = static_cast<int32_t>(sequence - position);
+        if (difference == 0) {
+            // Free for this lap: claim it, or retry from where the winner left the position
+            if (enqueuePosition_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                cell.command = command;
+                cell.sequence.store(position + 1, std::memory_order_release);
+                return true;
+            }
+        } else if (difference < 0) {
+            // Still holding last lap's command: full
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        } else {
+            position = enqueuePosition_.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+bool SimulationCommandQueue::pop(SimulationCommand& command) {
+    // Single consumer, so the dequeue position needs no CAS
+    uint32_t position = dequeuePosition_.load(std::memory_order_relaxed);
+    Cell& cell = cells_[position & (CAPACITY - 1)];
+    uint32_t sequence = cell.sequence.load(std::memory_order_acquire);
+    if (static_cast<int32_t>(sequence - (position + 1)) < 0) return false;  // Empty, or not published yet
+
+    command = cell.command;
+    cell.sequence.store(position + CAPACITY, std::memory_order_release);
+    dequeuePosition_.store(position + 1, std::memory_order_relaxed);
+    return true;
+}
+
+} // namespace WaterSim
@@ -1,6 +1,13 @@
 #include "SimulationManager.h"
+#include "ComputeAutotuner.h"
+#include "GPUMemoryTracker.h"
+#include "ShadingRateImage.h"
+#include "TraceRecorder.h"
 #include <iostream>
+#include <algorithm>
+#include <cmath>
 #include <glad/glad.h>
+#include <GLFW/glfw3.h>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
@@ -16,6 +23,7 @@ SimulationManager::SimulationManager(const Config& config)
 
 SimulationManager::~SimulationManager() {
     cleanup();
+    evictStandby();
 }
 
 void SimulationManager::setSimulationType(SimulationType type) {
@@ -23,23 +31,120 @@ void SimulationManager::setSimulationType(SimulationType type) {
         return; // Already using this type
     }
     
-    // Cleanup current simulation
-    cleanup();
+    // Park the current simulation on standby, or clean it up when it cannot be kept
+    if (!parkCurrent()) {
+        cleanup();
+    }
     
     // Set new type
     currentType_ = type;
     
-    // Initialize new simulation
-    if (currentType_ != SimulationType::NONE) {
+    // Resume it from standby, or initialize it anew
+    if (currentType_ != SimulationType::NONE && !resumeStandby(currentType_)) {
         initialize();
     }
 }
 
+bool SimulationManager::parkCurrent() {
+    // A playback is only its open stream, read again from wherever it is resumed
+    if (!initialized_ || currentType_ == SimulationType::NONE || currentType_ == SimulationType::SPH_PLAYBACK ||
+        !config_.standby.enabled) {
+        return false;
+    }
+    size_t budget = static_cast<size_t>(std::max(config_.standby.budgetMB, 0)) << 20;
+    if (residentBytes_ > budget) {
+        return false;
+    }
+    
+    // The worker only runs the current simulation; resuming starts it again
+    stopSimulationThread();
+    
+    Standby parked;
+    parked.type = currentType_;
+    parked.waterSurface = std::move(waterSurface_);
+    parked.sphComputeSystem = std::move(sphComputeSystem_);
+    parked.sphCpuSystem = std::move(sphCpuSystem_);
+    parked.streamAccumulator = streamAccumulator_;
+    parked.bytes = residentBytes_;
+    standby_.push_back(std::move(parked));
+    streamAccumulator_ = 0.0f;
+    residentBytes_ = 0;
+    initialized_ = false;
+    std::cout << "Simulation parked on standby (" << (standby_.back().bytes >> 20) << " MB)" << std::endl;
+    
+    trimStandby();
+    return true;
+}
+
+bool SimulationManager::resumeStandby(SimulationType type) {
+    auto parked = std::find_if(standby_.begin(), standby_.end(),
+                               [type](const Standby& standby) { return standby.type == type; });
+    if (parked == standby_.end()) {
+        return false;
+    }
+    
+    waterSurface_ = std::move(parked->waterSurface);
+    sphComputeSystem_ = std::move(parked->sphComputeSystem);
+    sphCpuSystem_ = std::move(parked->sphCpuSystem);
+    streamAccumulator_ = parked->streamAccumulator;
+    residentBytes_ = parked->bytes;
+    standby_.erase(parked);
+    initialized_ = true;
+    std::cout << "Simulation resumed from standby" << std::endl;
+    
+    if (type == SimulationType::SPH_COMPUTE && sphComputeSystem_ && config_.sph.asyncSimulation &&
+        !startSimulationThread()) {
+        std::cerr << "WARNING: Asynchronous SPH unavailable, updating on the render thread" << std::endl;
+    }
+    return true;
+}
+
+void SimulationManager::trimStandby() {
+    if (!config_.standby.enabled) {
+        evictStandby();
+        return;
+    }
+    size_t budget = static_cast<size_t>(std::max(config_.standby.budgetMB, 0)) << 20;
+    while (!standby_.empty() && getStandbyBytes() > budget) {
+        std::cout << "Simulation evicted from standby: over its memory budget" << std::endl;
+        standby_.erase(standby_.begin());
+    }
+    
+    // Freed memory may not show up in the driver's figure at once, so pressure evicts them all
+    if (standby_.empty()) return;
+    GPUMemoryTracker::DriverMemory driver = GPUMemoryTracker::instance().queryDriverMemory();
+    size_t minFree = static_cast<size_t>(std::max(config_.standby.minFreeMB, 0)) << 20;
+    if (driver.source && driver.availableBytes < minFree) {
+        std::cout << "Simulations evicted from standby: " << (driver.availableBytes >> 20)
+                  << " MB of video memory free" << std::endl;
+        evictStandby();
+    }
+}
+
+void SimulationManager::evictStandby() {
+    standby_.clear();
+}
+
+size_t SimulationManager::getStandbyBytes() const {
+    size_t bytes = 0;
+    for (const Standby& standby : standby_) {
+        bytes += standby.bytes;
+    }
+    return bytes;
+}
+
+bool SimulationManager::isOnStandby(SimulationType type) const {
+    return std::any_of(standby_.begin(), standby_.end(),
+                       [type](const Standby& standby) { return standby.type == type; });
+}
+
 void SimulationManager::initialize() {
     if (initialized_) {
         cleanup();
     }
     
+    // What the initialization allocates is what the simulation holds on standby
+    size_t trackedBefore = GPUMemoryTracker::instance().getTotalBytes();
     switch (currentType_) {
         case SimulationType::REGULAR_WATER:
             initializeRegularWater();
@@ -47,10 +152,15 @@ void SimulationManager::initialize() {
         case SimulationType::SPH_COMPUTE:
             initializeSPHCompute();
             break;
+        case SimulationType::SPH_PLAYBACK:
+            initializePlayback();
+            break;
         case SimulationType::NONE:
         default:
             break;
     }
+    size_t trackedAfter = GPUMemoryTracker::instance().getTotalBytes();
+    residentBytes_ = trackedAfter > trackedBefore ? trackedAfter - trackedBefore : 0;
     
     initialized_ = true;
 }
@@ -67,28 +177,66 @@ void SimulationManager::cleanup() {
         case SimulationType::SPH_COMPUTE:
             cleanupSPHCompute();
             break;
+        case SimulationType::SPH_PLAYBACK:
+            cleanupPlayback();
+            break;
         case SimulationType::NONE:
         default:
             break;
     }
     
+    residentBytes_ = 0;
     initialized_ = false;
 }
 
 void SimulationManager::update(float deltaTime) {
+    executeCommands();
     if (!initialized_) {
         return;
     }
     
     switch (currentType_) {
         case SimulationType::REGULAR_WATER:
+            // The spray drains into the heightfield's deposits, which its update then applies
+            if (hybridSplashesActive()) {
+                HeightfieldWaves* heightfield = waterSurface_->getHeightfield();
+                SPHHeightfieldCoupling coupling;
+                coupling.heightTexture = heightfield->getHeightTexture();
+                coupling.depositBuffer = heightfield->getDepositBuffer();
+                coupling.resolution = heightfield->getResolution();
+                coupling.surfaceSize = heightfield->getSurfaceSize();
+                coupling.waterLevel = waterHeight_;
+                coupling.bandDepth = config_.water.hybridBandDepth;
+                coupling.depositScale = HeightfieldWaves::DEPOSIT_SCALE;
+                sphComputeSystem_->setHeightfieldCoupling(coupling);
+                sphComputeSystem_->update(deltaTime);
+            }
             if (waterSurface_) {
                 waterSurface_->update(deltaTime);
             }
             break;
         case SimulationType::SPH_COMPUTE:
-            if (sphComputeSystem_) {
+            if (sphComputeSystem_ && simulationThread_.joinable()) {
+                // Kick the next update; render() draws the last published snapshot meanwhile
+                synchronize();
+                {
+                    std::lock_guard<std::mutex> lock(simulationMutex_);
+                    pendingDeltaTime_ = deltaTime;
+                    simulationWorkPending_ = true;
+                }
+                simulationWake_.notify_all();
+            } else if (sphComputeSystem_) {
                 sphComputeSystem_->update(deltaTime);
+            } else if (sphCpuSystem_) {
+                sphCpuSystem_->update(deltaTime);
+            }
+            break;
+        case SimulationType::SPH_PLAYBACK:
+            // The stream stands in for the update; its frame is drawn until the next one lands
+            if (playback_ && sphComputeSystem_) {
+                playback_->update(deltaTime);
+                sphComputeSystem_->setPlaybackSource(playback_->getParticleBuffer(), playback_->getCountBuffer(),
+                                                     playback_->getParticleCount());
             }
             break;
         case SimulationType::NONE:
@@ -97,6 +245,12 @@ void SimulationManager::update(float deltaTime) {
     }
 }
 
+void SimulationManager::synchronize() {
+    if (!simulationThread_.joinable()) return;
+    std::unique_lock<std::mutex> lock(simulationMutex_);
+    simulationWake_.wait(lock, [this] { return !simulationWorkPending_; });
+}
+
 void SimulationManager::render(const glm::mat4& view, const glm::mat4& projection, 
                               unsigned int waterShader, bool rayTracingEnabled) {
     if (!initialized_) {
@@ -108,20 +262,26 @@ void SimulationManager::render(const glm::mat4& view, const glm::mat4& projectio
             if (waterSurface_) {
                 glUseProgram(waterShader);
                 
-                // Set transformation matrices
-                glUniformMatrix4fv(glGetUniformLocation(waterShader, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
-                glUniformMatrix4fv(glGetUniformLocation(waterShader, "view"), 1, GL_FALSE, glm::value_ptr(view));
-                
+                // Model matrix; view and projection are in the frame uniform block
                 glm::mat4 model = glm::mat4(1.0f);
                 model = glm::translate(model, glm::vec3(0.0f, waterHeight_, 0.0f));
                 glUniformMatrix4fv(glGetUniformLocation(waterShader, "model"), 1, GL_FALSE, glm::value_ptr(model));
                 
                 // Render water surface
+                waterSurface_->setCamera(view * model, projection);
+                if (shadingRates_) shadingRates_->begin();
                 waterSurface_->render(waterShader);
+                if (shadingRates_) shadingRates_->end();
+            }
+            if (hybridSplashesActive()) {
+                sphComputeSystem_->setShadingRateImage(shadingRates_);
+                sphComputeSystem_->render(view, projection);
             }
             break;
         case SimulationType::SPH_COMPUTE:
+        case SimulationType::SPH_PLAYBACK:
             if (sphComputeSystem_) {
+                sphComputeSystem_->setShadingRateImage(shadingRates_);
                 sphComputeSystem_->render(view, projection);
             }
             break;
@@ -132,35 +292,88 @@ void SimulationManager::render(const glm::mat4& view, const glm::mat4& projectio
 }
 
 void SimulationManager::addRipple(const glm::vec3& position, float magnitude) {
+    if (!acceptsInteraction()) return;
+    TraceRecorder::instance().instant("Ripple", magnitude);
+    logCommand(SimulationCommand::ripple(position, magnitude));
     if (currentType_ == SimulationType::REGULAR_WATER && waterSurface_) {
         waterSurface_->addRipple(position, magnitude);
     }
 }
 
 void SimulationManager::createSplash(const glm::vec3& position, float magnitude) {
+    if (!acceptsInteraction()) return;
+    TraceRecorder::instance().instant("Splash", magnitude);
+    logCommand(SimulationCommand::splash(position, magnitude));
     if (currentType_ == SimulationType::REGULAR_WATER && waterSurface_) {
         waterSurface_->createSplash(position, magnitude);
+        if (hybridSplashesActive()) {
+            emitHybridSplash(position, magnitude);
+        }
     }
 }
 
 void SimulationManager::addDirectionalRipple(const glm::vec3& position, const glm::vec2& direction, float magnitude) {
+    if (!acceptsInteraction()) return;
+    TraceRecorder::instance().instant("Directional ripple", magnitude);
+    logCommand(SimulationCommand::directionalRipple(position, direction, magnitude));
     if (currentType_ == SimulationType::REGULAR_WATER && waterSurface_) {
         waterSurface_->addDirectionalRipple(position, direction, magnitude);
     }
 }
 
 void SimulationManager::addWaterFlowImpulse(const glm::vec3& position, const glm::vec2& impulse, float radius) {
+    if (!acceptsInteraction()) return;
+    logCommand(SimulationCommand::flowImpulse(position, impulse, radius));
     if (currentType_ == SimulationType::REGULAR_WATER && waterSurface_) {
         waterSurface_->addImpulse(position, impulse, radius);
     }
 }
 
+void SimulationManager::setWaterHeight(float height) {
+    if (!acceptsInteraction()) return;
+    logCommand(SimulationCommand::setParameter(SimulationCommand::Parameter::WATER_HEIGHT, height));
+    waterHeight_ = height;
+}
+
+void SimulationManager::setRenderLag(float seconds) {
+    if (currentType_ == SimulationType::REGULAR_WATER && waterSurface_) {
+        waterSurface_->setRenderLag(seconds);
+    }
+    if (sphComputeSystem_ && !simulationThread_.joinable()) {
+        sphComputeSystem_->setRenderLag(seconds);
+    }
+}
+
+void SimulationManager::setWaterObstacle(const glm::vec3& center, float radius) {
+    if (currentType_ == SimulationType::REGULAR_WATER && waterSurface_) {
+        waterSurface_->setObstacle(center - glm::vec3(0.0f, waterHeight_, 0.0f), radius);
+    }
+}
+
 
 void SimulationManager::initializeRegularWater() {
     std::cout << "Initializing Regular Water Simulation..." << std::endl;
     
-    waterSurface_ = std::make_unique<WaterSurface>(100, 10.0f);
+    waterSurface_ = std::make_unique<WaterSurface>(config_.water.surfaceResolution, config_.water.surfaceSize);
+    waterSurface_->setCompactMesh(config_.water.compactMesh);
     waterSurface_->initialize();
+    waterSurface_->setGPUWaves(config_.water.gpuWaves);
+    waterSurface_->setAsyncUpdate(config_.water.asyncCpuWaves);
+    
+    OceanFFT::Settings ocean;
+    ocean.resolution = config_.water.oceanResolution;
+    ocean.patchSize = config_.water.oceanPatchSize;
+    ocean.spectrum = config_.water.oceanJonswap ? OceanFFT::Spectrum::JONSWAP : OceanFFT::Spectrum::PHILLIPS;
+    ocean.windSpeed = config_.water.oceanWindSpeed;
+    ocean.rmsHeight = config_.water.oceanRmsHeight;
+    ocean.choppiness = config_.water.oceanChoppiness;
+    waterSurface_->setOceanSettings(ocean);
+    waterSurface_->setOceanWaves(config_.water.oceanWaves);
+    waterSurface_->setHeightfieldWaves(config_.water.heightfieldWaves, config_.water.heightfieldResolution);
+    waterSurface_->setFlowMap(config_.water.flowMap, config_.water.flowMapResolution);
+    waterSurface_->setLODMesh(config_.water.lodMesh);
+    waterSurface_->setTessellation(config_.water.tessellation);
+    waterSurface_->setTessEdgePixels(config_.water.tessEdgePixels);
     waterSurface_->setColor(glm::vec3(0.05f, 0.3f, 0.5f)); // Deep blue color
     waterSurface_->setTransparency(0.9f); // High transparency
     waterSurface_->clearWaves(); // Start with no waves
@@ -183,11 +396,83 @@ void SimulationManager::initializeRegularWater() {
     crossWave.steepness = 0.1f;
     waterSurface_->addWave(crossWave);
     
+    // The batched CPU wave kernel against its scalar reference, well into the animation
+    float kernelDeviation = waterSurface_->validateWaveKernel(600.0f);
+    std::cout << "Wave kernel: " << WaveKernel::isaName(WaveKernel::activeIsa())
+              << ", max deviation from reference " << kernelDeviation << std::endl;
+    if (kernelDeviation > 1.0e-3f) {
+        std::cerr << "WARNING: Batched wave kernel deviates from the scalar reference by " << kernelDeviation << std::endl;
+    }
+    
+    if (config_.water.hybridSplashes) {
+        initializeHybridSplashes();
+    }
+    
     std::cout << "Regular Water Simulation initialized successfully!" << std::endl;
 }
 
+bool SimulationManager::hybridSplashesActive() const {
+    return currentType_ == SimulationType::REGULAR_WATER && sphComputeSystem_ && waterSurface_ &&
+           waterSurface_->getHeightfield();
+}
+
+void SimulationManager::initializeHybridSplashes() {
+    if (!waterSurface_->getHeightfield() || !config_.sph.useGPUAcceleration) {
+        std::cerr << "WARNING: Hybrid splashes need heightfield waves and GPU SPH, disabled" << std::endl;
+        return;
+    }
+    
+    // Spray box over the whole surface, from below the absorption band up into the air
+    float halfSize = 0.5f * config_.water.surfaceSize;
+    glm::vec3 boxMin(-halfSize, waterHeight_ - 2.0f, -halfSize);
+    glm::vec3 boxMax(halfSize, waterHeight_ + 6.0f, halfSize);
+    
+    sphComputeSystem_ = std::make_unique<SPHComputeSystem>();
+    sphComputeSystem_->setMaxSubsteps(config_.sph.maxSubstepsPerFrame);
+    sphComputeSystem_->setTimeStepLimits(config_.sph.timeStep, config_.sph.velocityLimit);
+    sphComputeSystem_->setBoundaryDamping(config_.sph.boundaryDamping);
+    sphComputeSystem_->initialize(static_cast<uint32_t>(std::max(config_.water.hybridMaxParticles, 1)), boxMin, boxMax);
+    sphComputeSystem_->clear();
+    waterSurface_->getHeightfield()->setDepositDepth(config_.water.hybridBandDepth);
+    std::cout << "Hybrid splashes: up to " << config_.water.hybridMaxParticles << " SPH spray particles" << std::endl;
+}
+
+void SimulationManager::emitHybridSplash(const glm::vec3& position, float magnitude) {
+    uint32_t count = static_cast<uint32_t>(std::max(magnitude, 0.0f) * static_cast<float>(config_.water.hybridSplashParticles));
+    if (count == 0) return;
+    
+    // A crown on a ring around the impact, thrown up and outward, leaving the surface
+    // just above the band so the particles are not absorbed on their first step
+    const float goldenAngle = 2.39996323f;
+    float ringRadius = 0.2f + 0.3f * std::sqrt(magnitude);
+    float upSpeed = 2.5f * std::sqrt(magnitude);
+    float spacing = SPHConstants::PARTICLE_RADIUS * 2.0f;
+    glm::vec2 center(position.x, position.z);
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> velocities;
+    positions.reserve(count);
+    velocities.reserve(count);
+    for (uint32_t i = 0; i < count; i++) {
+        float angle = goldenAngle * static_cast<float>(i);
+        float layer = static_cast<float>(i % 4);
+        glm::vec2 outward(std::cos(angle), std::sin(angle));
+        glm::vec2 xz = center + outward * (ringRadius + layer * spacing);
+        positions.push_back(glm::vec3(xz.x, waterHeight_ + spacing * (1.0f + layer), xz.y));
+        velocities.push_back(glm::vec3(outward.x, 0.0f, outward.y) * (0.5f * upSpeed) +
+                             glm::vec3(0.0f, upSpeed * (1.0f - 0.1f * layer), 0.0f));
+    }
+    sphComputeSystem_->addParticles(positions, velocities);
+    
+    // The crown's water leaves the surface, which it returns to through the deposits
+    float volume = static_cast<float>(count) * spacing * spacing * spacing;
+    waterSurface_->getHeightfield()->addVolume(center, ringRadius + 4.0f * spacing, -volume);
+}
+
 
 void SimulationManager::cleanupRegularWater() {
+    if (sphComputeSystem_) {
+        sphComputeSystem_.reset();
+    }
     if (waterSurface_) {
         std::cout << "Cleaning up Regular Water Simulation..." << std::endl;
         waterSurface_.reset();
@@ -195,26 +480,210 @@ void SimulationManager::cleanupRegularWater() {
 }
 
 void SimulationManager::applyImpulse(const glm::vec3& position, const glm::vec3& impulse, float radius) {
+    if (!acceptsInteraction()) return;
+    TraceRecorder::instance().instant("SPH impulse", glm::length(impulse));
+    logCommand(SimulationCommand::impulse(position, impulse, radius));
     if (currentType_ == SimulationType::SPH_COMPUTE && sphComputeSystem_) {
-        // SPH Compute system doesn't have impulse API yet, could be added
+        runSPHCommand([position, impulse, radius](SPHComputeSystem& system) {
+            system.applyImpulse(position, impulse, radius);
+        });
+    } else if (currentType_ == SimulationType::SPH_COMPUTE && sphCpuSystem_) {
+        sphCpuSystem_->applyImpulse(position, impulse, radius);
     }
 }
 
 void SimulationManager::addFluidStream(const glm::vec3& origin, const glm::vec3& direction, float rate) {
-    // Not implemented for SPH Compute yet
+    if (!acceptsInteraction()) return;
+    logCommand(SimulationCommand::fluidStream(origin, direction, rate));
+    if (currentType_ != SimulationType::SPH_COMPUTE && !hybridSplashesActive()) return;
+    if (!sphComputeSystem_ && !sphCpuSystem_) return;
+    if (glm::length(direction) <= 0.0f) return;
+    
+    // Rate is particles for this call; keep the fraction so low rates still emit
+    streamAccumulator_ += std::max(rate, 0.0f);
+    uint32_t count = static_cast<uint32_t>(streamAccumulator_);
+    if (count == 0) return;
+    streamAccumulator_ -= static_cast<float>(count);
+    
+    glm::vec3 velocity = glm::normalize(direction) * config_.sph.streamSpeed;
+    if (sphComputeSystem_ && simulationThread_.joinable()) {
+        // The worker owns the system's GL state; run the emission before its next update
+        float radius = config_.sph.streamRadius;
+        std::lock_guard<std::mutex> lock(simulationMutex_);
+        pendingCommands_.push_back([origin, velocity, radius, count](SPHComputeSystem& system) {
+            system.emitStream(origin, velocity, radius, count);
+        });
+    } else if (sphComputeSystem_) {
+        sphComputeSystem_->emitStream(origin, velocity, config_.sph.streamRadius, count);
+    } else {
+        sphCpuSystem_->emitStream(origin, velocity, config_.sph.streamRadius, count);
+    }
 }
 
 void SimulationManager::addFluidStream(const glm::vec3& origin, const glm::vec3& direction) {
-    // Not implemented for SPH Compute yet
+    addFluidStream(origin, direction, config_.sph.streamRate);
 }
 
 void SimulationManager::addFluidVolume(const glm::vec3& minPos, const glm::vec3& maxPos) {
-    // Not implemented for SPH Compute yet
+    if (!acceptsInteraction()) return;
+    logCommand(SimulationCommand::fluidVolume(minPos, maxPos));
+    if (currentType_ != SimulationType::SPH_COMPUTE || !sphComputeSystem_) return;
+    
+    // The lattice is generated on the GPU, so a volume costs no particle upload
+    SPHSeedVolume volume;
+    volume.minPos = minPos;
+    volume.maxPos = maxPos;
+    if (simulationThread_.joinable()) {
+        std::lock_guard<std::mutex> lock(simulationMutex_);
+        pendingCommands_.push_back([volume](SPHComputeSystem& system) {
+            system.seedVolume(volume);
+        });
+    } else {
+        sphComputeSystem_->seedVolume(volume);
+    }
+}
+
+void SimulationManager::runSPHCommand(const SPHCommand& command) {
+    if (simulationThread_.joinable()) {
+        std::lock_guard<std::mutex> lock(simulationMutex_);
+        pendingCommands_.push_back(command);
+    } else {
+        command(*sphComputeSystem_);
+    }
+}
+
+void SimulationManager::executeCommands() {
+    SimulationCommand command;
+    executingCommands_ = true;
+    while (commands_.pop(command)) {
+        executeCommand(command);
+    }
+    executingCommands_ = false;
+}
+
+void SimulationManager::executeCommand(const SimulationCommand& command) {
+    using Type = SimulationCommand::Type;
+    glm::vec2 planar(command.vector.x, command.vector.z);
+    switch (command.type) {
+        case Type::RIPPLE: addRipple(command.position, command.magnitude); break;
+        case Type::DIRECTIONAL_RIPPLE: addDirectionalRipple(command.position, planar, command.magnitude); break;
+        case Type::SPLASH: createSplash(command.position, command.magnitude); break;
+        case Type::FLOW_IMPULSE: addWaterFlowImpulse(command.position, planar, command.magnitude); break;
+        case Type::IMPULSE: applyImpulse(command.position, command.vector, command.magnitude); break;
+        case Type::FLUID_STREAM: addFluidStream(command.position, command.vector, command.magnitude); break;
+        case Type::FLUID_VOLUME: addFluidVolume(command.position, command.vector); break;
+        case Type::GRAVITY: {
+            logCommand(command);
+            glm::vec3 gravity = command.vector;
+            if (sphComputeSystem_) {
+                runSPHCommand([gravity](SPHComputeSystem& system) { system.setGravity(gravity); });
+            } else if (sphCpuSystem_) {
+                sphCpuSystem_->setGravity(gravity);
+            }
+            break;
+        }
+        case Type::PARAMETER: {
+            float value = command.magnitude;
+            switch (command.parameter) {
+                case SimulationCommand::Parameter::WATER_HEIGHT:
+                    setWaterHeight(value);
+                    break;
+                case SimulationCommand::Parameter::BOUNDARY_DAMPING:
+                    logCommand(command);
+                    if (sphComputeSystem_) {
+                        runSPHCommand([value](SPHComputeSystem& system) { system.setBoundaryDamping(value); });
+                    }
+                    break;
+                case SimulationCommand::Parameter::SPHERE_FRICTION:
+                    logCommand(command);
+                    if (sphComputeSystem_) {
+                        runSPHCommand([value](SPHComputeSystem& system) { system.setSphereFriction(value); });
+                    }
+                    break;
+            }
+            break;
+        }
+    }
+}
+
+bool SimulationManager::canKeyframe(std::string* reason) const {
+    const char* refusal = nullptr;
+    if (!initialized_ || currentType_ == SimulationType::NONE) {
+        refusal = "no simulation is running";
+    } else if (currentType_ == SimulationType::SPH_PLAYBACK) {
+        refusal = "a baked stream is playing";
+    } else if (simulationThread_.joinable()) {
+        refusal = "the SPH runs asynchronously";
+    } else if (sphCpuSystem_) {
+        refusal = "the SPH runs on the CPU";
+    } else if (sphComputeSystem_ && sphComputeSystem_->getRenderSnapshots()) {
+        refusal = "the SPH renders from snapshots";
+    }
+    if (refusal && reason) *reason = refusal;
+    return refusal == nullptr;
+}
+
+bool SimulationManager::captureKeyframe(Keyframe& keyframe, GLuint sphBuffer, GLintptr sphOffset, GLuint heightfieldTexture) {
+    if (!canKeyframe()) return false;
+    
+    keyframe.type = currentType_;
+    keyframe.waterHeight = waterHeight_;
+    keyframe.streamAccumulator = streamAccumulator_;
+    keyframe.sph = sphComputeSystem_ && sphComputeSystem_->captureKeyframe(sphBuffer, sphOffset, keyframe.sphState);
+    if (sphComputeSystem_ && !keyframe.sph) return false;
+    keyframe.surface = waterSurface_ != nullptr;
+    if (waterSurface_) {
+        keyframe.surfaceState = waterSurface_->getState();
+    }
+    HeightfieldWaves* heightfield = waterSurface_ ? waterSurface_->getHeightfield() : nullptr;
+    keyframe.heightfield = heightfield && heightfieldTexture;
+    if (keyframe.heightfield) {
+        heightfield->saveState(heightfieldTexture, keyframe.heightfieldAccumulator);
+    }
+    return true;
 }
 
+bool SimulationManager::restoreKeyframe(const Keyframe& keyframe, GLuint sphBuffer, GLintptr sphOffset, GLuint heightfieldTexture) {
+    if (!canKeyframe() || keyframe.type != currentType_ || keyframe.sph != (sphComputeSystem_ != nullptr) ||
+        keyframe.surface != (waterSurface_ != nullptr)) {
+        return false;
+    }
+    HeightfieldWaves* heightfield = waterSurface_ ? waterSurface_->getHeightfield() : nullptr;
+    if (keyframe.heightfield && !heightfield) return false;
+    
+    if (keyframe.sph && !sphComputeSystem_->restoreKeyframe(sphBuffer, sphOffset, keyframe.sphState)) {
+        return false;
+    }
+    waterHeight_ = keyframe.waterHeight;
+    streamAccumulator_ = keyframe.streamAccumulator;
+    if (waterSurface_) {
+        waterSurface_->setState(keyframe.surfaceState);
+    }
+    if (keyframe.heightfield) {
+        heightfield->restoreState(heightfieldTexture, keyframe.heightfieldAccumulator);
+    }
+    return true;
+}
 
 void SimulationManager::initializeSPHCompute() {
     std::cout << "Initializing SPH Compute Simulation" << std::endl;
+    if (config_.sph.useCUDA) {
+        std::cout << "Note: no CUDA SPH backend is built, using the OpenGL compute pipeline" << std::endl;
+    }
+    if (config_.sph.useOpenCL) {
+        std::cout << "Note: no OpenCL SPH backend is built, using the OpenGL compute pipeline" << std::endl;
+    }
+    
+    // Box bounds match the glass container (10x10x10, centered at origin)
+    if (!config_.sph.useGPUAcceleration) {
+        sphCpuSystem_ = std::make_unique<SPHCpuSystem>();
+        sphCpuSystem_->setMaxSubsteps(config_.sph.maxSubstepsPerFrame);
+        sphCpuSystem_->setVelocityLimit(config_.sph.velocityLimit);
+        sphCpuSystem_->initialize(static_cast<uint32_t>(std::max(config_.sph.maxParticles, 1)),
+                                  glm::vec3(-5.0f), glm::vec3(5.0f));
+        std::cout << "SPH CPU Simulation initialized with " << sphCpuSystem_->getParticleCount() << " particles" << std::endl;
+        return;
+    }
     
     sphComputeSystem_ = std::make_unique<SPHComputeSystem>();
     
@@ -224,18 +693,220 @@ void SimulationManager::initializeSPHCompute() {
     glm::vec3 boxMin(-5.0f, -5.0f, -5.0f);
     glm::vec3 boxMax(5.0f, 5.0f, 5.0f);
     
-    // Initialize with up to 100k particles
-    sphComputeSystem_->initialize(100000, boxMin, boxMax);
+    SPHParticleLayout layout = SPHParticleLayout::AOS;
+    if (config_.sph.useSoALayout) {
+        layout = config_.sph.halfPrecisionVelocity ? SPHParticleLayout::SOA_HALF_VELOCITY : SPHParticleLayout::SOA;
+    }
+    
+    sphComputeSystem_->setNeighborLimit(static_cast<uint32_t>(std::max(config_.sph.neighborLimit, 1)));
+    sphComputeSystem_->setUseNeighborLists(config_.sph.useNeighborLists);
+    sphComputeSystem_->setUseSparseDomain(config_.sph.useSparseDomain);
+    sphComputeSystem_->setUseHierarchicalGrid(config_.sph.useHierarchicalGrid);
+    sphComputeSystem_->setAdaptiveResolution(config_.sph.adaptiveResolution);
+    sphComputeSystem_->setAdaptiveMergeDensityRatio(config_.sph.adaptiveMergeDensityRatio);
+    sphComputeSystem_->setAdaptiveDetailDistance(config_.sph.adaptiveDetailDistance);
+    sphComputeSystem_->setNarrowBand(config_.sph.narrowBand);
+    sphComputeSystem_->setNarrowBandDepth(config_.sph.narrowBandDepth);
+    sphComputeSystem_->setUseMultirate(config_.sph.multirate);
+    sphComputeSystem_->setUseIndexSort(config_.sph.indexSort);
+    sphComputeSystem_->setUseMortonCells(config_.sph.mortonCells);
+    sphComputeSystem_->setUseTiledNeighborLoop(config_.sph.useTiledNeighborLoop);
+    sphComputeSystem_->setUseParticleSleeping(config_.sph.particleSleeping);
+    sphComputeSystem_->setDeterministic(config_.sph.deterministic);
+    sphComputeSystem_->setUseSubgroups(config_.sph.useSubgroups);
+    sphComputeSystem_->setAdaptiveTimeStep(config_.sph.adaptiveTimeStep);
+    sphComputeSystem_->setMaxSubsteps(config_.sph.maxSubstepsPerFrame);
+    sphComputeSystem_->setSubstepOverflow(config_.sph.carrySubstepOverflow ? SPHComputeSystem::OVERFLOW_CARRY
+                                                                           : SPHComputeSystem::OVERFLOW_DROP_TIME);
+    sphComputeSystem_->setTimeStepLimits(config_.sph.timeStep, config_.sph.velocityLimit);
+    sphComputeSystem_->setBoundaryDamping(config_.sph.boundaryDamping);
+    sphComputeSystem_->setSurfaceTension(config_.sph.surfaceTension);
+    sphComputeSystem_->setPressureSolver(config_.sph.usePCISPH ? SPHComputeSystem::PRESSURE_PCISPH
+                                                               : SPHComputeSystem::PRESSURE_WCSPH);
+    sphComputeSystem_->setPCISPHIterations(config_.sph.pcisphMinIterations, config_.sph.pcisphMaxIterations);
+    sphComputeSystem_->setPCISPHErrorThreshold(config_.sph.pcisphDensityErrorThreshold);
+    sphComputeSystem_->setImplicitViscosity(config_.sph.implicitViscosity);
+    sphComputeSystem_->setViscosityIterations(config_.sph.viscosityMaxIterations);
+    sphComputeSystem_->setViscosityTolerance(config_.sph.viscosityTolerance);
+    sphComputeSystem_->setStatisticsEnabled(config_.debug.showSPHDebug);
+    sphComputeSystem_->setFluidRenderScale(config_.sph.fluidRenderScale);
+    sphComputeSystem_->setUseDiffuseParticles(config_.sph.diffuseParticles);
+    sphComputeSystem_->setUseObstacleField(config_.sph.obstacleField);
+    sphComputeSystem_->setUseSphereCoupling(config_.sph.sphereCoupling);
+    sphComputeSystem_->setSphereFriction(config_.sph.sphereFriction);
+    
+    SPHShaderParameters shaderParameters;
+    shaderParameters.kernelTable = config_.sph.useKernelTable;
+    shaderParameters.taitEquation = config_.sph.useTaitEquation;
+    shaderParameters.taitExponent = static_cast<int>(std::lround(config_.sph.gamma));
+    shaderParameters.pressureLimit = config_.sph.pressureLimit;
+    if (config_.sph.workGroupSize > 0) {
+        shaderParameters.workGroupSize = config_.sph.workGroupSize;
+    }
+    sphComputeSystem_->setShaderParameters(shaderParameters);
+    
+    if (config_.sph.multiphase) {
+        SPHPhase water;
+        water.restDensity = shaderParameters.restDensity;
+        water.viscosity = shaderParameters.viscosity;
+        water.interfaceTension = config_.sph.interfaceTension;
+        SPHPhase second;
+        second.restDensity = config_.sph.secondPhaseRestDensity;
+        second.viscosity = config_.sph.secondPhaseViscosity;
+        second.interfaceTension = config_.sph.interfaceTension;
+        sphComputeSystem_->setPhases({ water, second });
+    }
+    
+    // Parameter sweep: one scene per stiffness / viscosity pair, each with the full particle budget
+    int stiffnessSteps = std::max(config_.sph.batchStiffnessSteps, 1);
+    int viscositySteps = std::max(config_.sph.batchViscositySteps, 1);
+    std::vector<SPHSceneParameters> scenes;
+    for (int i = 0; i < stiffnessSteps; i++) {
+        for (int j = 0; j < viscositySteps; j++) {
+            float s = stiffnessSteps > 1 ? float(i) / float(stiffnessSteps - 1) : 0.5f;
+            float v = viscositySteps > 1 ? float(j) / float(viscositySteps - 1) : 0.5f;
+            SPHSceneParameters scene;
+            scene.stiffness = shaderParameters.stiffness * glm::mix(config_.sph.batchStiffnessScale.x, config_.sph.batchStiffnessScale.y, s);
+            scene.viscosity = shaderParameters.viscosity * glm::mix(config_.sph.batchViscosityScale.x, config_.sph.batchViscosityScale.y, v);
+            scenes.push_back(scene);
+        }
+    }
+    sphComputeSystem_->setBatchScenes(scenes);
+    
+    uint32_t maxParticles = static_cast<uint32_t>(std::max(config_.sph.maxParticles, 1)) * sphComputeSystem_->getSceneCount();
+    sphComputeSystem_->initialize(maxParticles, boxMin, boxMax, layout);
+    
+    // Before the simulation thread starts: tuning runs passes on this context
+    if (config_.sph.workGroupSize <= 0 && config_.compute.autotune) {
+        ComputeAutotuner autotuner(config_.compute.autotuneCachePath);
+        sphComputeSystem_->autotuneWorkGroupSize(autotuner, config_.compute.autotuneRepetitions);
+    }
     
     std::cout << "SPH Compute Simulation initialized successfully!" << std::endl;
     std::cout << "Initial particles: " << sphComputeSystem_->getParticleCount() << std::endl;
+    
+    if (config_.sph.asyncSimulation && !startSimulationThread()) {
+        std::cerr << "WARNING: Asynchronous SPH unavailable, updating on the render thread" << std::endl;
+    }
+}
+
+bool SimulationManager::startSimulationThread() {
+    GLFWwindow* mainContext = glfwGetCurrentContext();
+    if (!mainContext) return false;
+    
+    // Hidden window whose context shares buffers, programs and sync objects with the main one
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    simulationContext_ = glfwCreateWindow(1, 1, "SPH Simulation", nullptr, mainContext);
+    glfwDefaultWindowHints();
+    if (!simulationContext_) return false;
+    
+    sphComputeSystem_->setRenderSnapshots(true);
+    glFinish(); // Buffers created here must be complete before the other context uses them
+    
+    stopSimulationThread_ = false;
+    simulationWorkPending_ = false;
+    simulationThread_ = std::thread(&SimulationManager::simulationThreadLoop, this);
+    std::cout << "SPH simulation running asynchronously on a shared context" << std::endl;
+    return true;
+}
+
+void SimulationManager::stopSimulationThread() {
+    if (simulationThread_.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(simulationMutex_);
+            stopSimulationThread_ = true;
+        }
+        simulationWake_.notify_all();
+        simulationThread_.join();
+    }
+    if (simulationContext_) {
+        glfwDestroyWindow(simulationContext_);
+        simulationContext_ = nullptr;
+    }
+    if (sphComputeSystem_) {
+        sphComputeSystem_->setRenderSnapshots(false);
+    }
+    pendingCommands_.clear();
+}
+
+void SimulationManager::simulationThreadLoop() {
+    glfwMakeContextCurrent(simulationContext_);
+    
+    std::vector<SPHCommand> commands;
+    while (true) {
+        float deltaTime = 0.0f;
+        {
+            std::unique_lock<std::mutex> lock(simulationMutex_);
+            simulationWake_.wait(lock, [this] { return simulationWorkPending_ || stopSimulationThread_; });
+            if (stopSimulationThread_) break;
+            commands.swap(pendingCommands_);
+            deltaTime = pendingDeltaTime_;
+        }
+        
+        for (SPHCommand& command : commands) {
+            command(*sphComputeSystem_);
+        }
+        commands.clear();
+        sphComputeSystem_->update(deltaTime);
+        glFlush();
+        
+        {
+            std::lock_guard<std::mutex> lock(simulationMutex_);
+            simulationWorkPending_ = false;
+        }
+        simulationWake_.notify_all();
+    }
+    
+    sphComputeSystem_->releaseContextResources();
+    glFinish();
+    glfwMakeContextCurrent(nullptr);
 }
 
 void SimulationManager::cleanupSPHCompute() {
+    stopSimulationThread();
     if (sphComputeSystem_) {
         std::cout << "Cleaning up SPH Compute Simulation..." << std::endl;
         sphComputeSystem_.reset();
     }
+    if (sphCpuSystem_) {
+        std::cout << "Cleaning up SPH CPU Simulation..." << std::endl;
+        sphCpuSystem_.reset();
+    }
+}
+
+void SimulationManager::initializePlayback() {
+    std::cout << "Initializing SPH Playback" << std::endl;
+    if (config_.playback.path.empty()) {
+        std::cerr << "ERROR: SPH playback needs a particle stream (--playback FILE)" << std::endl;
+        return;
+    }
+    playback_ = std::make_unique<SPHPlayback>();
+    SPHPlayback::Settings& settings = playback_->getSettings();
+    settings.speed = config_.playback.speed;
+    settings.loop = config_.playback.loop;
+    settings.readAhead = config_.playback.readAhead;
+    if (!playback_->open(config_.playback.path)) {
+        playback_.reset();
+        return;
+    }
+    
+    // Render-only system over the stream's box: it never updates and its own particles stay
+    // cleared, its storage growing only as far as the rendering needs
+    sphComputeSystem_ = std::make_unique<SPHComputeSystem>();
+    sphComputeSystem_->setFluidRenderScale(config_.sph.fluidRenderScale);
+    sphComputeSystem_->initialize(playback_->getMaxParticles(), playback_->getBoxMin(), playback_->getBoxMax());
+    sphComputeSystem_->clear();
+}
+
+void SimulationManager::cleanupPlayback() {
+    if (sphComputeSystem_) {
+        std::cout << "Cleaning up SPH Playback..." << std::endl;
+        sphComputeSystem_.reset();
+    }
+    playback_.reset();
 }
 
 } // namespace WaterSim
\ No newline at end of file
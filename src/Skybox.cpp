@@ -1,7 +1,14 @@
 #include "../include/Skybox.h"
+#include "../include/AssetPack.h"
 #include "../include/InitShader.h"
+#include "../include/DDSFile.h"
+#include "../include/MappedFile.h"
+#include "../include/UploadQueue.h"
 #include <iostream>
 #include <filesystem>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 
 // STB Image implementation - header only library
 #define STB_IMAGE_IMPLEMENTATION
@@ -9,6 +16,55 @@
 
 namespace WaterSim {
 
+namespace {
+
+// Layout of the prefiltered environment cache: this header, then every mip level's six
+// faces of RGBA16F texels, level 0 first
+struct EnvironmentCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t faceSize;
+    uint32_t levels;
+    uint32_t samples;
+    uint64_t sourceKey;
+    float irradianceSH[27];
+};
+
+constexpr uint32_t ENVIRONMENT_CACHE_VERSION = 1;
+
+// FNV-1a over the faces' paths, sizes and modification times, so editing one rebuilds the caches
+uint64_t facesKey(const std::vector<std::string>& faces) {
+    uint64_t key = 14695981039346656037ull;
+    auto hashBytes = [&key](const void* bytes, size_t size) {
+        for (size_t i = 0; i < size; i++) {
+            key = (key ^ static_cast<const unsigned char*>(bytes)[i]) * 1099511628211ull;
+        }
+    };
+    for (const std::string& face : faces) {
+        std::error_code error;
+        uint64_t fileSize = std::filesystem::file_size(face, error);
+        int64_t modified = static_cast<int64_t>(std::filesystem::last_write_time(face, error).time_since_epoch().count());
+        hashBytes(face.data(), face.size());
+        hashBytes(&fileSize, sizeof(fileSize));
+        hashBytes(&modified, sizeof(modified));
+    }
+    return key;
+}
+
+// Direction through a texel of a cube face, as cubeDirection in env_prefilter.cs
+glm::vec3 cubeDirection(int face, float s, float t) {
+    switch (face) {
+    case 0: return glm::vec3(1.0f, -t, -s);
+    case 1: return glm::vec3(-1.0f, -t, s);
+    case 2: return glm::vec3(s, 1.0f, t);
+    case 3: return glm::vec3(s, -1.0f, -t);
+    case 4: return glm::vec3(s, -t, 1.0f);
+    default: return glm::vec3(-s, -t, -1.0f);
+    }
+}
+
+} // namespace
+
 const float Skybox::skyboxVertices[] = {
     // positions   
     // back       
@@ -57,7 +113,12 @@ const float Skybox::skyboxVertices[] = {
      1.0f, -1.0f,  1.0f
 };
 
-Skybox::Skybox() : VAO(0), VBO(0), cubemapTexture(0), shaderProgram(0), loaded(false) {
+Skybox::Skybox() : VAO(0), VBO(0), cubemapTexture(0), shaderProgram(0),
+                   prefilteredTexture(0), prefilterShader(0), pendingTexture(0),
+                   nextFace(0), uploadedFaces(0), sourceSize(0), sourceKey(0), loaded(false), loading(false) {
+    for (glm::vec3& coefficient : irradianceSH) {
+        coefficient = glm::vec3(0.0f);
+    }
 }
 
 Skybox::~Skybox() {
@@ -96,53 +157,449 @@ void Skybox::loadCubemap(const std::vector<std::string>& faces) {
         return;
     }
     
-    glGenTextures(1, &cubemapTexture);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
+    // A load already in flight is dropped for the new faces
+    releaseDecodedFaces();
+    if (pendingTexture) {
+        glDeleteTextures(1, &pendingTexture);
+        pendingTexture = 0;
+    }
+    if (prefilteredTexture) {
+        glDeleteTextures(1, &prefilteredTexture);
+        prefilteredTexture = 0;
+    }
+    sourceFaces = faces;
+    sourceKey = facesKey(faces);
+    loaded = false;
+    createPlaceholder();
     
-    for (unsigned int i = 0; i < faces.size(); i++) {
-        int width, height, nrChannels;
-        
-        // Check if file exists
-        if (!std::filesystem::exists(faces[i])) {
-            std::cerr << "Skybox texture file not found: " << faces[i] << std::endl;
-            continue;
+    // The compressed faces skip decoding unless the prefiltered map must be rebuilt from them
+    if (unsigned int cached = readCompressedCache()) {
+        if (prefilterEnvironment(0)) {
+            std::cout << "Loaded compressed skybox from cache: " << compressedCachePath() << std::endl;
+            finishLoad(cached);
+            return;
         }
-        
-        unsigned char* data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
-        if (data) {
-            GLenum format = GL_RGB;
-            if (nrChannels == 1)
-                format = GL_RED;
-            else if (nrChannels == 3)
-                format = GL_RGB;
-            else if (nrChannels == 4)
-                format = GL_RGBA;
+        glDeleteTextures(1, &cached);
+    }
+    
+    // Decode the faces in parallel on the job pool; only the uploads need the context
+    decodedFaces.assign(faces.size(), DecodedFace());
+    decodeJobs = std::make_unique<JobSystem::TaskGroup>();
+    for (size_t i = 0; i < faces.size(); i++) {
+        decodeJobs->run([this, i]() {
+            DecodedFace& face = decodedFaces[i];
+            face.found = std::filesystem::exists(sourceFaces[i]);
             
-            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-            stbi_image_free(data);
-            std::cout << "Loaded skybox face: " << faces[i] << " (" << width << "x" << height << ")" << std::endl;
+            // A packed face was decoded at build time and goes up straight from the mapping
+            AssetPack::Texture packed;
+            const AssetPack& pack = AssetPack::instance();
+            if ((!face.found || !pack.getLooseOverride()) && pack.findTexture(sourceFaces[i], packed)) {
+                face.data = packed.pixels;
+                face.width = packed.width;
+                face.height = packed.height;
+                face.found = true;
+                face.packed = true;
+            } else if (face.found) {
+                int channels;
+                face.data = stbi_load(sourceFaces[i].c_str(), &face.width, &face.height, &channels, STBI_rgb_alpha);
+            }
+        });
+    }
+    nextFace = 0;
+    uploadedFaces = 0;
+    loading = true;
+}
+
+void Skybox::update() {
+    if (!loading || !decodeJobs->done()) {
+        return;
+    }
+    
+    UploadQueue& uploads = UploadQueue::instance();
+    if (nextFace == 0) {
+        glCreateTextures(GL_TEXTURE_CUBE_MAP, 1, &pendingTexture);
+    }
+    
+    // All six go to the upload thread at once, where the driver also encodes them; without
+    // it they go up here, one per call
+    int batch = uploads.isThreaded() ? 6 : 1;
+    for (int i = 0; i < batch && nextFace < 6; i++, nextFace++) {
+        DecodedFace& face = decodedFaces[nextFace];
+        if (!face.found) {
+            std::cerr << "Skybox texture file not found: " << sourceFaces[nextFace] << std::endl;
+        } else if (!face.data) {
+            std::cerr << "Failed to load skybox texture: " << sourceFaces[nextFace] << std::endl;
         } else {
-            std::cerr << "Failed to load skybox texture: " << faces[i] << std::endl;
-            stbi_image_free(data);
+            GLuint texture = pendingTexture;
+            GLenum target = GL_TEXTURE_CUBE_MAP_POSITIVE_X + nextFace;
+            int width = face.width, height = face.height;
+            faceUploads.push_back(uploads.submit("skybox face", face.data, size_t(width) * height * 4,
+                                                 [texture, target, width, height](const UploadQueue::Staging& staging) {
+                glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+                glTexImage2D(target, 0, FACE_FORMAT, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, staging.pixels());
+                glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+            }));
+            uploadedFaces++;
+            sourceSize = face.width;
+            std::cout << "Loaded skybox face: " << sourceFaces[nextFace] << " (" << face.width << "x" << face.height << ")" << std::endl;
         }
     }
+    if (nextFace < 6) {
+        return;
+    }
+    for (UploadQueue::Ticket ticket : faceUploads) {
+        if (!uploads.isComplete(ticket)) return;
+    }
+    for (UploadQueue::Ticket ticket : faceUploads) {
+        uploads.waitForUse(ticket);
+    }
+    faceUploads.clear();
     
+    // Rough reflections and ambient light come from a prefiltered copy, cached beside the faces
+    if (uploadedFaces == 6) {
+        glBindTexture(GL_TEXTURE_CUBE_MAP, pendingTexture);
+        GLint compressed = GL_FALSE;
+        glGetTexLevelParameteriv(GL_TEXTURE_CUBE_MAP_POSITIVE_X, 0, GL_TEXTURE_COMPRESSED, &compressed);
+        if (compressed) {
+            writeCompressedCache(pendingTexture);
+        } else {
+            std::cout << "Skybox faces kept uncompressed: the driver does not encode BC7" << std::endl;
+        }
+        
+        if (!prefilterEnvironment(0)) {
+            // Compressed faces cannot generate mips, so the prefilter reads an RGBA8 copy
+            int levels = 1;
+            while ((sourceSize >> levels) > 0) {
+                levels++;
+            }
+            unsigned int source;
+            glGenTextures(1, &source);
+            glBindTexture(GL_TEXTURE_CUBE_MAP, source);
+            glTexStorage2D(GL_TEXTURE_CUBE_MAP, levels, GL_RGBA8, sourceSize, sourceSize);
+            for (int face = 0; face < 6; face++) {
+                glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, 0, 0, sourceSize, sourceSize, GL_RGBA,
+                                GL_UNSIGNED_BYTE, decodedFaces[face].data);
+            }
+            glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+            prefilterEnvironment(source);
+            glDeleteTextures(1, &source);
+        }
+    } else {
+        std::cerr << "WARNING: Skybox is incomplete, environment prefilter skipped" << std::endl;
+    }
+    
+    releaseDecodedFaces();
+    unsigned int texture = pendingTexture;
+    pendingTexture = 0;
+    finishLoad(texture);
+}
+
+void Skybox::createPlaceholder() {
+    if (cubemapTexture) {
+        glDeleteTextures(1, &cubemapTexture);
+    }
+    
+    // A hazy sky blue, so reflections read as sky while the faces load
+    const unsigned char texel[4] = {150, 175, 205, 255};
+    glGenTextures(1, &cubemapTexture);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
+    for (int face = 0; face < 6; face++) {
+        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, texel);
+    }
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+}
+
+void Skybox::finishLoad(unsigned int texture) {
+    glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, 0);
     
+    if (cubemapTexture) {
+        glDeleteTextures(1, &cubemapTexture);
+    }
+    cubemapTexture = texture;
     loaded = true;
+    loading = false;
 }
 
-void Skybox::render(const glm::mat4& view, const glm::mat4& projection) {
-    if (!loaded || shaderProgram == 0) {
+void Skybox::releaseDecodedFaces() {
+    if (decodeJobs) {
+        decodeJobs->wait();
+        decodeJobs.reset();
+    }
+    // The upload thread reads the faces until their jobs are issued
+    for (UploadQueue::Ticket ticket : faceUploads) {
+        UploadQueue::instance().waitForUse(ticket);
+    }
+    faceUploads.clear();
+    for (DecodedFace& face : decodedFaces) {
+        if (!face.packed) {
+            stbi_image_free(const_cast<unsigned char*>(face.data));
+        }
+    }
+    decodedFaces.clear();
+    loading = false;
+}
+
+std::string Skybox::compressedCachePath() const {
+    return (std::filesystem::path(sourceFaces[0]).parent_path() / "skybox_bc7.dds").string();
+}
+
+unsigned int Skybox::readCompressedCache() {
+    DDSFile file;
+    if (!std::filesystem::exists(compressedCachePath()) || !file.open(compressedCachePath())) {
+        return 0; // No cache yet
+    }
+    const DDSFile::Description& description = file.getDescription();
+    if (!description.cubemap || description.internalFormat != FACE_FORMAT || description.userKey != sourceKey ||
+        description.width != description.height) {
+        return 0; // Stale; rebuilt and overwritten
+    }
+    sourceSize = description.width;
+    return file.upload();
+}
+
+void Skybox::writeCompressedCache(unsigned int texture) const {
+    DDSFile::Description description;
+    description.internalFormat = FACE_FORMAT;
+    description.width = sourceSize;
+    description.height = sourceSize;
+    description.cubemap = true;
+    description.userKey = sourceKey;
+    
+    glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+    GLint imageSize = 0;
+    glGetTexLevelParameteriv(GL_TEXTURE_CUBE_MAP_POSITIVE_X, 0, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &imageSize);
+    
+    DDSFile file;
+    if (!file.create(compressedCachePath(), description) || size_t(imageSize) != file.levelSize(0)) {
+        std::cerr << "WARNING: Failed to write compressed skybox cache " << compressedCachePath() << std::endl;
         return;
     }
     
-    // Change depth function so depth test passes when values are equal to depth buffer's content
-    glDepthFunc(GL_LEQUAL);
+    // The blocks are read back straight into the mapped pages
+    for (int face = 0; face < 6; face++) {
+        glGetCompressedTexImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, file.getLevel(face, 0));
+    }
+}
+
+std::string Skybox::prefilterCachePath() const {
+    return (std::filesystem::path(sourceFaces[0]).parent_path() / "environment_prefilter.cache").string();
+}
+
+bool Skybox::prefilterEnvironment(unsigned int source) {
+    std::string cachePath = prefilterCachePath();
+    
+    glGenTextures(1, &prefilteredTexture);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, prefilteredTexture);
+    glTexStorage2D(GL_TEXTURE_CUBE_MAP, PREFILTER_LEVELS, GL_RGBA16F, PREFILTER_SIZE, PREFILTER_SIZE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, PREFILTER_LEVELS - 1);
+    
+    // The small rough mips would show their face edges without filtering across them
+    glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+    
+    if (readPrefilterCache(cachePath, sourceKey)) {
+        std::cout << "Loaded prefiltered environment from cache: " << cachePath << std::endl;
+        return true;
+    }
+    
+    if (source && !prefilterShader) {
+        prefilterShader = InitComputeShader("shaders/env_prefilter.cs");
+    }
+    if (!source || !prefilterShader) {
+        if (source) {
+            std::cerr << "WARNING: Environment prefilter shader unavailable, materials keep the plain skybox" << std::endl;
+        }
+        glDeleteTextures(1, &prefilteredTexture);
+        prefilteredTexture = 0;
+        return false;
+    }
+    
+    // Each importance sample reads the source mip matching its solid angle; the source
+    // already carries its full chain
+    glUseProgram(prefilterShader);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, source);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glUniform1i(glGetUniformLocation(prefilterShader, "uSource"), 0);
+    glUniform1f(glGetUniformLocation(prefilterShader, "uSourceSize"), float(sourceSize));
+    glUniform1i(glGetUniformLocation(prefilterShader, "uSampleCount"), PREFILTER_SAMPLES);
+    for (int level = 0; level < PREFILTER_LEVELS; level++) {
+        int size = PREFILTER_SIZE >> level;
+        glBindImageTexture(0, prefilteredTexture, level, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+        glUniform1i(glGetUniformLocation(prefilterShader, "uFaceSize"), size);
+        glUniform1f(glGetUniformLocation(prefilterShader, "uRoughness"), float(level) / float(PREFILTER_LEVELS - 1));
+        glDispatchCompute((size + 7) / 8, (size + 7) / 8, 6);
+    }
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+    glUseProgram(0);
+    
+    projectIrradianceSH(source);
+    
+    writePrefilterCache(cachePath, sourceKey);
+    std::cout << "Prefiltered environment: " << PREFILTER_LEVELS << " GGX mips from " << PREFILTER_SIZE
+              << "x" << PREFILTER_SIZE << ", SH9 irradiance" << std::endl;
+    return true;
+}
+
+void Skybox::projectIrradianceSH(unsigned int source) {
+    // A small source mip is plenty for nine coefficients
+    int level = 0;
+    while ((sourceSize >> level) > SH_PROJECTION_SIZE) {
+        level++;
+    }
+    int size = std::max(sourceSize >> level, 1);
+    
+    std::vector<float> pixels(size_t(size) * size * 3);
+    glm::vec3 sh[9];
+    for (glm::vec3& coefficient : sh) {
+        coefficient = glm::vec3(0.0f);
+    }
+    float totalSolidAngle = 0.0f;
+    
+    glBindTexture(GL_TEXTURE_CUBE_MAP, source);
+    for (int face = 0; face < 6; face++) {
+        glGetTexImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, GL_RGB, GL_FLOAT, pixels.data());
+        for (int y = 0; y < size; y++) {
+            for (int x = 0; x < size; x++) {
+                float s = (x + 0.5f) / size * 2.0f - 1.0f;
+                float t = (y + 0.5f) / size * 2.0f - 1.0f;
+                float solidAngle = 4.0f / (size * size * std::pow(1.0f + s * s + t * t, 1.5f));
+                glm::vec3 n = glm::normalize(cubeDirection(face, s, t));
+                const float* p = &pixels[(size_t(y) * size + x) * 3];
+                glm::vec3 color = glm::vec3(p[0], p[1], p[2]) * solidAngle;
+                
+                sh[0] += color * 0.282095f;
+                sh[1] += color * (0.488603f * n.y);
+                sh[2] += color * (0.488603f * n.z);
+                sh[3] += color * (0.488603f * n.x);
+                sh[4] += color * (1.092548f * n.x * n.y);
+                sh[5] += color * (1.092548f * n.y * n.z);
+                sh[6] += color * (0.315392f * (3.0f * n.z * n.z - 1.0f));
+                sh[7] += color * (1.092548f * n.x * n.z);
+                sh[8] += color * (0.546274f * (n.x * n.x - n.y * n.y));
+                totalSolidAngle += solidAngle;
+            }
+        }
+    }
+    
+    // Texel solid angles renormalised to the sphere; the clamped cosine's bands over pi
+    const float bandFactors[9] = {1.0f, 2.0f / 3.0f, 2.0f / 3.0f, 2.0f / 3.0f, 0.25f, 0.25f, 0.25f, 0.25f, 0.25f};
+    float normalisation = 4.0f * 3.14159265f / totalSolidAngle;
+    for (int i = 0; i < 9; i++) {
+        irradianceSH[i] = sh[i] * (normalisation * bandFactors[i]);
+    }
+}
+
+bool Skybox::readPrefilterCache(const std::string& cachePath, uint64_t sourceKey) {
+    MappedFile file;
+    if (!file.openRead(cachePath)) {
+        return false; // No cache yet
+    }
+    
+    EnvironmentCacheHeader header;
+    if (file.size() < sizeof(header)) {
+        return false;
+    }
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (std::memcmp(header.magic, "WENVPREF", sizeof(header.magic)) != 0 || header.version != ENVIRONMENT_CACHE_VERSION ||
+        header.faceSize != PREFILTER_SIZE || header.levels != PREFILTER_LEVELS || header.samples != PREFILTER_SAMPLES ||
+        header.sourceKey != sourceKey) {
+        return false; // Stale; rebuilt and overwritten
+    }
+    
+    size_t dataBytes = 0;
+    for (int level = 0; level < PREFILTER_LEVELS; level++) {
+        size_t size = PREFILTER_SIZE >> level;
+        dataBytes += 6 * size * size * 4 * sizeof(uint16_t);
+    }
+    if (sizeof(header) + dataBytes > file.size()) {
+        std::cerr << "WARNING: Prefiltered environment cache " << cachePath << " is truncated" << std::endl;
+        return false;
+    }
+    
+    const char* texels = static_cast<const char*>(file.data()) + sizeof(header);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, prefilteredTexture);
+    for (int level = 0; level < PREFILTER_LEVELS; level++) {
+        int size = PREFILTER_SIZE >> level;
+        for (int face = 0; face < 6; face++) {
+            glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, 0, 0, size, size, GL_RGBA, GL_HALF_FLOAT, texels);
+            texels += size_t(size) * size * 4 * sizeof(uint16_t);
+        }
+    }
+    for (int i = 0; i < 9; i++) {
+        irradianceSH[i] = glm::vec3(header.irradianceSH[i * 3], header.irradianceSH[i * 3 + 1], header.irradianceSH[i * 3 + 2]);
+    }
+    return true;
+}
+
+void Skybox::writePrefilterCache(const std::string& cachePath, uint64_t sourceKey) const {
+    size_t dataBytes = 0;
+    for (int level = 0; level < PREFILTER_LEVELS; level++) {
+        size_t size = PREFILTER_SIZE >> level;
+        dataBytes += 6 * size * size * 4 * sizeof(uint16_t);
+    }
+    
+    MappedFile file;
+    if (!file.create(cachePath, sizeof(EnvironmentCacheHeader) + dataBytes)) {
+        std::cerr << "WARNING: Failed to write prefiltered environment cache " << cachePath << std::endl;
+        return;
+    }
+    
+    EnvironmentCacheHeader header = {};
+    std::memcpy(header.magic, "WENVPREF", sizeof(header.magic));
+    header.version = ENVIRONMENT_CACHE_VERSION;
+    header.faceSize = PREFILTER_SIZE;
+    header.levels = PREFILTER_LEVELS;
+    header.samples = PREFILTER_SAMPLES;
+    header.sourceKey = sourceKey;
+    for (int i = 0; i < 9; i++) {
+        header.irradianceSH[i * 3] = irradianceSH[i].r;
+        header.irradianceSH[i * 3 + 1] = irradianceSH[i].g;
+        header.irradianceSH[i * 3 + 2] = irradianceSH[i].b;
+    }
+    std::memcpy(file.data(), &header, sizeof(header));
+    
+    // The mips are read back straight into the mapped pages
+    char* texels = static_cast<char*>(file.data()) + sizeof(header);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, prefilteredTexture);
+    for (int level = 0; level < PREFILTER_LEVELS; level++) {
+        int size = PREFILTER_SIZE >> level;
+        for (int face = 0; face < 6; face++) {
+            glGetTexImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, GL_RGBA, GL_HALF_FLOAT, texels);
+            texels += size_t(size) * size * 4 * sizeof(uint16_t);
+        }
+    }
+}
+
+void Skybox::setEnvironmentUniforms(const GLShaderProgram& program, int textureUnit) const {
+    program.setBool("environmentLighting", prefilteredTexture != 0);
+    if (!prefilteredTexture) {
+        return;
+    }
+    
+    glActiveTexture(GL_TEXTURE0 + textureUnit);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, prefilteredTexture);
+    program.setInt("prefilteredEnv", textureUnit);
+    program.setFloat("prefilteredMaxLod", getPrefilteredMaxLod());
+    program.setVec3Array("irradianceSH", irradianceSH, 9);
+}
+
+void Skybox::render(const glm::mat4& view, const glm::mat4& projection) {
+    if (cubemapTexture == 0 || shaderProgram == 0) {
+        return;
+    }
     
     glUseProgram(shaderProgram);
     
@@ -150,10 +607,23 @@ void Skybox::render(const glm::mat4& view, const glm::mat4& projection) {
     glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "view"), 1, GL_FALSE, glm::value_ptr(view));
     glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
     
+    renderWith(shaderProgram);
+}
+
+void Skybox::renderWith(unsigned int program) {
+    if (cubemapTexture == 0 || program == 0) {
+        return;
+    }
+    
+    // Change depth function so depth test passes when values are equal to depth buffer's content
+    glDepthFunc(GL_LEQUAL);
+    
+    glUseProgram(program);
+    
     // Bind skybox texture
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
-    glUniform1i(glGetUniformLocation(shaderProgram, "skybox"), 0);
+    glUniform1i(glGetUniformLocation(program, "skybox"), 0);
     
     // Render skybox cube
     glBindVertexArray(VAO);
@@ -198,6 +668,11 @@ unsigned int Skybox::loadTexture(const std::string& path) {
 }
 
 void Skybox::cleanup() {
+    releaseDecodedFaces();
+    if (pendingTexture) {
+        glDeleteTextures(1, &pendingTexture);
+        pendingTexture = 0;
+    }
     if (VAO) {
         glDeleteVertexArrays(1, &VAO);
         VAO = 0;
@@ -210,6 +685,14 @@ void Skybox::cleanup() {
         glDeleteTextures(1, &cubemapTexture);
         cubemapTexture = 0;
     }
+    if (prefilteredTexture) {
+        glDeleteTextures(1, &prefilteredTexture);
+        prefilteredTexture = 0;
+    }
+    if (prefilterShader) {
+        glDeleteProgram(prefilterShader);
+        prefilterShader = 0;
+    }
     if (shaderProgram) {
         glDeleteProgram(shaderProgram);
         shaderProgram = 0;
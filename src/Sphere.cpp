@@ -3,129 +3,237 @@
 #include <glm/gtc/constants.hpp>
 #include <iostream>
 #include <cmath>
+#include <algorithm>
+#include <map>
 
-Sphere::Sphere(float radius, int sectorCount, int stackCount)
-    : radius(radius), sectorCount(sectorCount), stackCount(stackCount),
+namespace {
+
+// A level's edges may cover about this many pixels before the next finer one is used
+constexpr float LOD_EDGE_PIXELS = 16.0f;
+
+// Icosahedron edge over its circumradius; every subdivision halves it
+constexpr float ICOSAHEDRON_EDGE = 1.0515f;
+
+// Geometry of every Sphere, created by the first initialize and deleted with the last sphere
+struct SharedSphereMesh {
+    GLuint vao = 0;
+    GLuint vbo = 0;
+    GLuint ebo = 0;
+    GLuint instanceBuffer = 0;  // MAX_OBJECTS own slots, then the renderInstanced range
+    GLsizei indexCount[Sphere::LOD_COUNT] = {};
+    GLsizeiptr firstIndex[Sphere::LOD_COUNT] = {};   // In indices
+    GLint baseVertex[Sphere::LOD_COUNT] = {};
+    bool slotUsed[Sphere::MAX_OBJECTS] = {};
+    int users = 0;
+};
+
+SharedSphereMesh sharedMesh;
+
+// The unit sphere of every level, built once: by Sphere::prepareLevels on a worker during
+// startup, or else by the first use on the context thread
+struct SphereLevel {
+    std::vector<float> vertices;
+    std::vector<unsigned int> indices;
+};
+SphereLevel builtLevels[Sphere::LOD_COUNT];
+bool levelsBuilt = false;
+
+// Unit icosphere with 8-float vertices (position, normal, uv). Triangles across the uv
+// seam get their own copies of the vertices on the far side, with u past 1
+void buildIcosphere(int subdivisions, std::vector<float>& vertices, std::vector<unsigned int>& indices) {
+    const float t = (1.0f + std::sqrt(5.0f)) * 0.5f;
+    std::vector<glm::vec3> points = {
+        {-1, t, 0}, {1, t, 0}, {-1, -t, 0}, {1, -t, 0},
+        {0, -1, t}, {0, 1, t}, {0, -1, -t}, {0, 1, -t},
+        {t, 0, -1}, {t, 0, 1}, {-t, 0, -1}, {-t, 0, 1}
+    };
+    for (glm::vec3& point : points) point = glm::normalize(point);
+    std::vector<unsigned int> faces = {
+        0, 11, 5, 0, 5, 1, 0, 1, 7, 0, 7, 10, 0, 10, 11,
+        1, 5, 9, 5, 11, 4, 11, 10, 2, 10, 7, 6, 7, 1, 8,
+        3, 9, 4, 3, 4, 2, 3, 2, 6, 3, 6, 8, 3, 8, 9,
+        4, 9, 5, 2, 4, 11, 6, 2, 10, 8, 6, 7, 9, 8, 1
+    };
+
+    for (int level = 0; level < subdivisions; level++) {
+        std::map<std::pair<unsigned int, unsigned int>, unsigned int> midpoints;
+        auto midpoint = [&](unsigned int a, unsigned int b) {
+            std::pair<unsigned int, unsigned int> key(std::min(a, b), std::max(a, b));
+            auto found = midpoints.find(key);
+            if (found != midpoints.end()) return found->second;
+            points.push_back(glm::normalize(points[a] + points[b]));
+            unsigned int index = static_cast<unsigned int>(points.size() - 1);
+            midpoints[key] = index;
+            return index;
+        };
+        std::vector<unsigned int> finer;
+        finer.reserve(faces.size() * 4);
+        for (size_t i = 0; i < faces.size(); i += 3) {
+            unsigned int a = faces[i], b = faces[i + 1], c = faces[i + 2];
+            unsigned int ab = midpoint(a, b), bc = midpoint(b, c), ca = midpoint(c, a);
+            finer.insert(finer.end(), { a, ab, ca, b, bc, ab, c, ca, bc, ab, bc, ca });
+        }
+        faces.swap(finer);
+    }
+
+    std::vector<glm::vec2> uvs(points.size());
+    for (size_t i = 0; i < points.size(); i++) {
+        uvs[i] = glm::vec2(0.5f + std::atan2(points[i].z, points[i].x) / glm::two_pi<float>(),
+                           std::acos(glm::clamp(points[i].y, -1.0f, 1.0f)) / glm::pi<float>());
+    }
+    std::map<unsigned int, unsigned int> wrapped;
+    for (size_t i = 0; i < faces.size(); i += 3) {
+        float maxU = std::max(uvs[faces[i]].x, std::max(uvs[faces[i + 1]].x, uvs[faces[i + 2]].x));
+        for (size_t k = i; k < i + 3; k++) {
+            if (maxU - uvs[faces[k]].x < 0.5f) continue;
+            auto found = wrapped.find(faces[k]);
+            if (found == wrapped.end()) {
+                points.push_back(points[faces[k]]);
+                uvs.push_back(uvs[faces[k]] + glm::vec2(1.0f, 0.0f));
+                found = wrapped.emplace(faces[k], static_cast<unsigned int>(points.size() - 1)).first;
+            }
+            faces[k] = found->second;
+        }
+    }
+
+    vertices.clear();
+    vertices.reserve(points.size() * 8);
+    for (size_t i = 0; i < points.size(); i++) {
+        const glm::vec3& p = points[i];
+        vertices.insert(vertices.end(), { p.x, p.y, p.z, p.x, p.y, p.z, uvs[i].x, uvs[i].y });
+    }
+    indices = faces;
+}
+
+void createSharedMesh() {
+    Sphere::prepareLevels();
+    std::vector<float> vertices;
+    std::vector<unsigned int> indices;
+    for (int lod = 0; lod < Sphere::LOD_COUNT; lod++) {
+        const std::vector<float>& levelVertices = builtLevels[lod].vertices;
+        const std::vector<unsigned int>& levelIndices = builtLevels[lod].indices;
+        sharedMesh.firstIndex[lod] = static_cast<GLsizeiptr>(indices.size());
+        sharedMesh.indexCount[lod] = static_cast<GLsizei>(levelIndices.size());
+        sharedMesh.baseVertex[lod] = static_cast<GLint>(vertices.size() / 8);
+        vertices.insert(vertices.end(), levelVertices.begin(), levelVertices.end());
+        indices.insert(indices.end(), levelIndices.begin(), levelIndices.end());
+    }
+
+    glCreateBuffers(1, &sharedMesh.vbo);
+    glNamedBufferStorage(sharedMesh.vbo, vertices.size() * sizeof(float), vertices.data(), 0);
+    glCreateBuffers(1, &sharedMesh.ebo);
+    glNamedBufferStorage(sharedMesh.ebo, indices.size() * sizeof(unsigned int), indices.data(), 0);
+    glCreateBuffers(1, &sharedMesh.instanceBuffer);
+    glNamedBufferStorage(sharedMesh.instanceBuffer, (Sphere::MAX_OBJECTS + Sphere::MAX_INSTANCES) * sizeof(glm::vec4),
+                         nullptr, GL_DYNAMIC_STORAGE_BIT);
+
+    glCreateVertexArrays(1, &sharedMesh.vao);
+    glVertexArrayVertexBuffer(sharedMesh.vao, 0, sharedMesh.vbo, 0, 8 * sizeof(float));
+    glVertexArrayVertexBuffer(sharedMesh.vao, 1, sharedMesh.instanceBuffer, 0, sizeof(glm::vec4));
+    glVertexArrayBindingDivisor(sharedMesh.vao, 1, 1);
+    glVertexArrayElementBuffer(sharedMesh.vao, sharedMesh.ebo);
+    
+    // Position, normal, texture coordinates, then the instance's centre offset and radius
+    const GLint sizes[3] = { 3, 3, 2 };
+    const GLuint offsets[3] = { 0, 3 * sizeof(float), 6 * sizeof(float) };
+    for (GLuint attribute = 0; attribute < 3; attribute++) {
+        glEnableVertexArrayAttrib(sharedMesh.vao, attribute);
+        glVertexArrayAttribFormat(sharedMesh.vao, attribute, sizes[attribute], GL_FLOAT, GL_FALSE, offsets[attribute]);
+        glVertexArrayAttribBinding(sharedMesh.vao, attribute, 0);
+    }
+    glEnableVertexArrayAttrib(sharedMesh.vao, 3);
+    glVertexArrayAttribFormat(sharedMesh.vao, 3, 4, GL_FLOAT, GL_FALSE, 0);
+    glVertexArrayAttribBinding(sharedMesh.vao, 3, 1);
+}
+
+void deleteSharedMesh() {
+    glDeleteVertexArrays(1, &sharedMesh.vao);
+    glDeleteBuffers(1, &sharedMesh.vbo);
+    glDeleteBuffers(1, &sharedMesh.ebo);
+    glDeleteBuffers(1, &sharedMesh.instanceBuffer);
+    sharedMesh = SharedSphereMesh();
+}
+
+void drawLevel(int lod, GLsizei instances, GLuint baseInstance) {
+    glBindVertexArray(sharedMesh.vao);
+    glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, sharedMesh.indexCount[lod], GL_UNSIGNED_INT,
+                                                  (void*)(sharedMesh.firstIndex[lod] * sizeof(unsigned int)),
+                                                  instances, sharedMesh.baseVertex[lod], baseInstance);
+    glBindVertexArray(0);
+}
+
+} // namespace
+
+Sphere::Sphere(float radius)
+    : radius(radius), lod(LOD_COUNT - 1), instanceSlot(-1),
       position(0.0f), velocity(0.0f), acceleration(0.0f),
       mass(1.0f), drag(0.1f), useGravity(false),
       sphereColor(0.3f, 0.7f, 0.9f), dragged(false) {
 }
 
 Sphere::~Sphere() {
-    glDeleteVertexArrays(1, &VAO);
-    glDeleteBuffers(1, &VBO);
-    glDeleteBuffers(1, &EBO);
+    if (instanceSlot < 0) return;
+    sharedMesh.slotUsed[instanceSlot] = false;
+    if (--sharedMesh.users == 0) {
+        deleteSharedMesh();
+    }
 }
 
 void Sphere::initialize() {
-    buildVertices();
-    
-    // Create and bind VAO and VBO
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glGenBuffers(1, &EBO);
-    
-    glBindVertexArray(VAO);
-    
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
-    
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
-    
-    // Position attribute
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    
-    // Normal attribute
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-    
-    // Texture coordinate attribute
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-    glEnableVertexAttribArray(2);
-    
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
-}
-
-void Sphere::buildVertices() {
-    vertices.clear();
-    indices.clear();
-    
-    std::vector<float> unitCircleVertices = getUnitCircleVertices();
-    
-    // Generate vertices for sphere using spherical coordinates
-    for (int i = 0; i <= stackCount; ++i) {
-        // Latitude (stack)
-        float stackAngle = glm::pi<float>() / 2 - i * glm::pi<float>() / stackCount; // Starting from 90 degrees to -90 degrees
-        float xy = radius * cosf(stackAngle);
-        float z = radius * sinf(stackAngle);
-        
-        // Save vertex data for current stack
-        for (int j = 0; j <= sectorCount; ++j) {
-            // Longitude (sector)
-            float sectorAngle = j * 2 * glm::pi<float>() / sectorCount; // Starting from 0 to 360 degrees
-            
-            // Vertex position
-            float x = xy * cosf(sectorAngle);
-            float y = xy * sinf(sectorAngle);
-            
-            // Position
-            vertices.push_back(x);
-            vertices.push_back(y);
-            vertices.push_back(z);
-            
-            // Normal (normalized position)
-            float nx = x / radius;
-            float ny = y / radius;
-            float nz = z / radius;
-            vertices.push_back(nx);
-            vertices.push_back(ny);
-            vertices.push_back(nz);
-            
-            // Texture coordinates
-            float s = (float)j / sectorCount;
-            float t = (float)i / stackCount;
-            vertices.push_back(s);
-            vertices.push_back(t);
+    if (instanceSlot >= 0) return;
+    if (sharedMesh.users == 0) {
+        createSharedMesh();
+    }
+    for (int slot = 0; slot < MAX_OBJECTS; slot++) {
+        if (!sharedMesh.slotUsed[slot]) {
+            instanceSlot = slot;
+            break;
         }
     }
+    if (instanceSlot < 0) {
+        std::cerr << "ERROR: More than " << MAX_OBJECTS << " spheres" << std::endl;
+        return;
+    }
+    sharedMesh.slotUsed[instanceSlot] = true;
+    sharedMesh.users++;
     
-    // Generate indices for sphere
-    for (int i = 0; i < stackCount; ++i) {
-        int k1 = i * (sectorCount + 1);
-        int k2 = k1 + sectorCount + 1;
-        
-        for (int j = 0; j < sectorCount; ++j, ++k1, ++k2) {
-            // 2 triangles per sector excluding first and last stacks
-            if (i != 0) {
-                indices.push_back(k1);
-                indices.push_back(k2);
-                indices.push_back(k1 + 1);
-            }
-            
-            if (i != (stackCount - 1)) {
-                indices.push_back(k1 + 1);
-                indices.push_back(k2);
-                indices.push_back(k2 + 1);
-            }
-        }
+    // The model matrix places the sphere, so its own instance only scales
+    glm::vec4 instance(0.0f, 0.0f, 0.0f, radius);
+    glNamedBufferSubData(sharedMesh.instanceBuffer, instanceSlot * sizeof(glm::vec4), sizeof(glm::vec4), &instance);
+}
+
+void Sphere::prepareLevels() {
+    if (levelsBuilt) return;
+    for (int lod = 0; lod < LOD_COUNT; lod++) {
+        buildIcosphere(lod + 1, builtLevels[lod].vertices, builtLevels[lod].indices);
     }
+    levelsBuilt = true;
 }
 
-std::vector<float> Sphere::getUnitCircleVertices() {
-    const float PI = glm::pi<float>();
-    float sectorStep = 2 * PI / sectorCount;
-    
-    std::vector<float> unitCircleVertices;
-    for (int i = 0; i <= sectorCount; ++i) {
-        float sectorAngle = i * sectorStep;
-        unitCircleVertices.push_back(cos(sectorAngle)); // x
-        unitCircleVertices.push_back(sin(sectorAngle)); // y
+void Sphere::buildLevel(int level, std::vector<float>& vertices, std::vector<unsigned int>& indices) {
+    prepareLevels();
+    const SphereLevel& built = builtLevels[std::min(std::max(level, 0), LOD_COUNT - 1)];
+    vertices = built.vertices;
+    indices = built.indices;
+}
+
+float Sphere::focalLength(int viewportHeight, float fovYDegrees) {
+    return 0.5f * static_cast<float>(viewportHeight) / std::tan(glm::radians(fovYDegrees) * 0.5f);
+}
+
+int Sphere::selectLOD(float projectedRadiusPixels) {
+    float edgePixels = ICOSAHEDRON_EDGE * 0.5f * projectedRadiusPixels;   // Of level 0 (1 subdivision)
+    int level = 0;
+    while (level < LOD_COUNT - 1 && edgePixels > LOD_EDGE_PIXELS) {
+        edgePixels *= 0.5f;
+        level++;
     }
-    
-    return unitCircleVertices;
+    return level;
+}
+
+int Sphere::lodFor(const glm::vec3& eye, float focalPixels) const {
+    float distance = std::max(glm::length(position - eye) - radius, radius * 0.1f);
+    return selectLOD(radius * focalPixels / distance);
 }
 
 void Sphere::applyForce(const glm::vec3& force) {
@@ -162,14 +270,24 @@ void Sphere::update(float deltaTime) {
 }
 
 void Sphere::render(unsigned int shaderProgram) {
-    glBindVertexArray(VAO);
+    render(shaderProgram, lod);
+}
+
+void Sphere::render(unsigned int shaderProgram, int level) {
+    if (instanceSlot < 0) return;
     
     // Set uniforms for sphere properties
     GLint colorLoc = glGetUniformLocation(shaderProgram, "sphereColor");
     glUniform3fv(colorLoc, 1, glm::value_ptr(sphereColor));
     
-    // Draw sphere
-    glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+    drawLevel(std::min(std::max(level, 0), LOD_COUNT - 1), 1, static_cast<GLuint>(instanceSlot));
+}
+
+void Sphere::renderInstanced(unsigned int shaderProgram, const std::vector<glm::vec4>& instances, int lod) {
+    if (sharedMesh.users == 0 || instances.empty()) return;
+    glUseProgram(shaderProgram);
     
-    glBindVertexArray(0);
-} 
\ No newline at end of file
+    GLsizei count = static_cast<GLsizei>(std::min<size_t>(instances.size(), MAX_INSTANCES));
+    glNamedBufferSubData(sharedMesh.instanceBuffer, MAX_OBJECTS * sizeof(glm::vec4), count * sizeof(glm::vec4), instances.data());
+    drawLevel(std::min(std::max(lod, 0), LOD_COUNT - 1), count, MAX_OBJECTS);
+}
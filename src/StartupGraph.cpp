@@ -0,0 +1,103 @@
+#include "../include/StartupGraph.h"
+#include "../include/JobSystem.h"
+#include "../include/TraceRecorder.h"
+#include <iostream>
+#include <thread>
+
+namespace WaterSim {
+
+int StartupGraph::add(const std::string& name, Task prepare, Task upload, const std::vector<int>& dependencies) {
+    auto node = std::make_unique<Node>();
+    node->name = name;
+    node->prepare = std::move(prepare);
+    node->upload = std::move(upload);
+    int id = static_cast<int>(nodes_.size());
+    for (int dependency : dependencies) {
+        if (dependency >= 0 && dependency < id) {
+            node->dependencies.push_back(dependency);
+        } else {
+            std::cerr << "WARNING: Startup task '" << name << "' ignores unknown dependency " << dependency << std::endl;
+        }
+    }
+    nodes_.push_back(std::move(node));
+    return id;
+}
+
+bool StartupGraph::ready(const Node& node) const {
+    for (int dependency : node.dependencies) {
+        if (nodes_[dependency]->state != State::COMPLETE) return false;
+    }
+    return true;
+}
+
+void StartupGraph::run() {
+    TraceRecorder& trace = TraceRecorder::instance();
+    int64_t start = TraceRecorder::now();
+    JobSystem& jobs = JobSystem::instance();
+    JobSystem::TaskGroup group;
+
+    size_t complete = 0;
+    while (complete < nodes_.size()) {
+        bool progressed = false;
+        for (auto& pointer : nodes_) {
+            Node& node = *pointer;
+            if (node.state == State::WAITING && ready(node)) {
+                if (node.prepare) {
+                    node.state = State::PREPARING;
+                    group.run([&node, &trace]() {
+                        int64_t begin = TraceRecorder::now();
+                        node.prepare();
+                        int64_t end = TraceRecorder::now();
+                        trace.slice(node.name.c_str(), begin, end);
+                        node.prepareMs = float(end - begin) * 1e-6f;
+                        node.prepared.store(true, std::memory_order_release);
+                    });
+                } else {
+                    node.state = State::PREPARED;
+                }
+                progressed = true;
+            }
+            if (node.state == State::PREPARING && node.prepared.load(std::memory_order_acquire)) {
+                node.state = State::PREPARED;
+            }
+            if (node.state == State::PREPARED) {
+                if (node.upload) {
+                    int64_t begin = TraceRecorder::now();
+                    node.upload();
+                    int64_t end = TraceRecorder::now();
+                    trace.slice(node.name.c_str(), begin, end);
+                    node.uploadMs = float(end - begin) * 1e-6f;
+                }
+                node.state = State::COMPLETE;
+                complete++;
+                progressed = true;
+            }
+        }
+        if (progressed) continue;
+
+        // Nothing to upload yet: lend this thread to the CPU parts, or give up on a graph
+        // that can make no more progress
+        bool preparing = false;
+        for (const auto& node : nodes_) {
+            preparing = preparing || node->state == State::PREPARING;
+        }
+        if (!preparing) {
+            std::cerr << "ERROR: Startup graph stalled with " << nodes_.size() - complete << " tasks left" << std::endl;
+            break;
+        }
+        if (!jobs.runPending()) {
+            std::this_thread::yield();
+        }
+    }
+    group.wait();
+
+    elapsedMs_ = float(TraceRecorder::now() - start) * 1e-6f;
+    float cpuMs = 0.0f;
+    for (const auto& node : nodes_) {
+        cpuMs += node->prepareMs + node->uploadMs;
+    }
+    std::cout << "Startup: " << nodes_.size() << " tasks in " << elapsedMs_ << " ms (" << cpuMs << " ms of work, "
+              << jobs.getWorkerCount() << " workers)" << std::endl;
+}
+
+} // namespace WaterSim
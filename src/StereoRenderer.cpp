@@ -0,0 +1,118 @@
+#include "../include/StereoRenderer.h"
+#include "../include/GPUMemoryTracker.h"
+#include "../include/RenderTargetPool.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace WaterSim {
+
+StereoRenderer::~StereoRenderer() {
+    release();
+}
+
+bool StereoRenderer::initialize() {
+    supported_ = false;
+    if (!GLAD_GL_OVR_multiview2) {
+        std::cout << "Stereo rendering unavailable: no GL_OVR_multiview2" << std::endl;
+        return false;
+    }
+    GLint maxViews = 0;
+    glGetIntegerv(GL_MAX_VIEWS_OVR, &maxViews);
+    supported_ = maxViews >= EYE_COUNT;
+    if (!supported_) {
+        std::cout << "Stereo rendering unavailable: " << maxViews << " multiview views" << std::endl;
+    }
+    return supported_;
+}
+
+void StereoRenderer::setCamera(const glm::mat4& view, float fovDegrees, float aspect, float nearPlane, float farPlane) {
+    float top = nearPlane * std::tan(glm::radians(fovDegrees) * 0.5f);
+    float right = top * aspect;
+    float convergence = std::max(settings_.convergence, nearPlane);
+
+    for (int eye = 0; eye < EYE_COUNT; eye++) {
+        // Left eye at -separation/2 along the camera's x; its frustum shifts the other way,
+        // so both meet on the plane at the convergence distance
+        float eyeX = (eye == 0 ? -0.5f : 0.5f) * settings_.eyeSeparation;
+        float shift = eyeX * nearPlane / convergence;
+        views_[eye] = glm::translate(glm::mat4(1.0f), glm::vec3(-eyeX, 0.0f, 0.0f)) * view;
+        projections_[eye] = glm::frustum(-right - shift, right - shift, -top, top, nearPlane, farPlane);
+    }
+}
+
+void StereoRenderer::begin(int windowWidth, int windowHeight, const glm::vec4& clearColor) {
+    int eyeWidth = std::max(windowWidth / EYE_COUNT, 1);
+    int eyeHeight = std::max(windowHeight, 1);
+    if (eyeWidth != eyeWidth_ || eyeHeight != eyeHeight_ || multiviewFBO_ == 0) {
+        allocate(eyeWidth, eyeHeight);
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, multiviewFBO_);
+    glViewport(0, 0, eyeWidth_, eyeHeight_);
+    glClearNamedFramebufferfv(multiviewFBO_, GL_COLOR, 0, &clearColor[0]);
+    const GLfloat farDepth = 1.0f;
+    glClearNamedFramebufferfv(multiviewFBO_, GL_DEPTH, 0, &farDepth);
+}
+
+void StereoRenderer::resolve(GLuint framebuffer) {
+    for (int eye = 0; eye < EYE_COUNT; eye++) {
+        int x = eye * eyeWidth_;
+        glBlitNamedFramebuffer(eyeFBOs_[eye], framebuffer,
+                               0, 0, eyeWidth_, eyeHeight_,
+                               x, 0, x + eyeWidth_, eyeHeight_,
+                               GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+}
+
+void StereoRenderer::allocate(int eyeWidth, int eyeHeight) {
+    release();
+    GPUMemoryScope memoryScope("Stereo");
+    eyeWidth_ = eyeWidth;
+    eyeHeight_ = eyeHeight;
+
+    RenderTargetDesc desc;
+    desc.target = GL_TEXTURE_2D_ARRAY;
+    desc.width = eyeWidth;
+    desc.height = eyeHeight;
+    desc.layers = EYE_COUNT;
+    desc.internalFormat = GL_RGBA16F;
+    colorArray_ = RenderTargetPool::instance().acquire(desc);
+    desc.internalFormat = GL_DEPTH_COMPONENT24;
+    depthArray_ = RenderTargetPool::instance().acquire(desc);
+
+    // Multiview attachment has no DSA entry point
+    glGenFramebuffers(1, &multiviewFBO_);
+    glBindFramebuffer(GL_FRAMEBUFFER, multiviewFBO_);
+    glFramebufferTextureMultiviewOVR(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, colorArray_, 0, 0, EYE_COUNT);
+    glFramebufferTextureMultiviewOVR(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthArray_, 0, 0, EYE_COUNT);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "Stereo multiview framebuffer is not complete!" << std::endl;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    glCreateFramebuffers(EYE_COUNT, eyeFBOs_);
+    for (int eye = 0; eye < EYE_COUNT; eye++) {
+        glNamedFramebufferTextureLayer(eyeFBOs_[eye], GL_COLOR_ATTACHMENT0, colorArray_, 0, eye);
+        glNamedFramebufferTextureLayer(eyeFBOs_[eye], GL_DEPTH_ATTACHMENT, depthArray_, 0, eye);
+        glNamedFramebufferReadBuffer(eyeFBOs_[eye], GL_COLOR_ATTACHMENT0);
+    }
+}
+
+void StereoRenderer::release() {
+    if (multiviewFBO_) glDeleteFramebuffers(1, &multiviewFBO_);
+    if (eyeFBOs_[0]) glDeleteFramebuffers(EYE_COUNT, eyeFBOs_);
+    multiviewFBO_ = 0;
+    eyeFBOs_[0] = eyeFBOs_[1] = 0;
+
+    RenderTargetPool::instance().release(colorArray_);
+    RenderTargetPool::instance().release(depthArray_);
+    colorArray_ = 0;
+    depthArray_ = 0;
+    eyeWidth_ = 0;
+    eyeHeight_ = 0;
+}
+
+} // namespace WaterSim
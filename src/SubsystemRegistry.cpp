@@ -0,0 +1,70 @@
+#include "../include/SubsystemRegistry.h"
+#include <chrono>
+#include <iostream>
+
+namespace WaterSim {
+
+int SubsystemRegistry::add(Subsystem subsystem) {
+    Entry entry;
+    entry.subsystem = std::move(subsystem);
+    entries_.push_back(std::move(entry));
+    return static_cast<int>(entries_.size()) - 1;
+}
+
+void SubsystemRegistry::use(int id) {
+    if (id < 0 || id >= static_cast<int>(entries_.size())) return;
+    Entry& entry = entries_[id];
+    entry.lastUse = frame_;
+    if (entry.resident) return;
+
+    auto start = std::chrono::steady_clock::now();
+    entry.subsystem.create();
+    entry.createMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    entry.resident = true;
+    entry.creations++;
+    std::cout << entry.subsystem.name << " created on first use (" << entry.createMs << " ms)" << std::endl;
+}
+
+bool SubsystemRegistry::isResident(int id) const {
+    return id >= 0 && id < static_cast<int>(entries_.size()) && entries_[id].resident;
+}
+
+void SubsystemRegistry::endFrame() {
+    for (Entry& entry : entries_) {
+        int idle = entry.subsystem.idleFrames;
+        if (entry.resident && idle > 0 && frame_ - entry.lastUse >= static_cast<uint64_t>(idle)) {
+            std::cout << entry.subsystem.name << " released after " << idle << " frames unused" << std::endl;
+            entry.subsystem.release();
+            entry.resident = false;
+        }
+    }
+    frame_++;
+}
+
+void SubsystemRegistry::release(int id) {
+    if (!isResident(id)) return;
+    entries_[id].subsystem.release();
+    entries_[id].resident = false;
+}
+
+void SubsystemRegistry::releaseAll() {
+    for (int id = 0; id < static_cast<int>(entries_.size()); id++) {
+        release(id);
+    }
+}
+
+std::vector<SubsystemRegistry::Status> SubsystemRegistry::getStatus() const {
+    std::vector<Status> status;
+    for (const Entry& entry : entries_) {
+        Status subsystem;
+        subsystem.name = entry.subsystem.name;
+        subsystem.resident = entry.resident;
+        subsystem.idleFrames = entry.resident ? static_cast<int>(frame_ - entry.lastUse) : 0;
+        subsystem.creations = entry.creations;
+        subsystem.createMs = entry.createMs;
+        status.push_back(subsystem);
+    }
+    return status;
+}
+
+} // namespace WaterSim
@@ -0,0 +1,129 @@
+#include "../include/TemporalUpscaler.h"
+#include "../include/GPUMemoryTracker.h"
+#include "../include/Profiler.h"
+#include "../include/ShaderCompiler.h"
+#include <algorithm>
+#include <cmath>
+
+namespace WaterSim {
+
+namespace {
+
+constexpr int RESOLVE_GROUP_SIZE = 8;   // taa_resolve.cs
+
+// Radical inverse of the index in the base: the Halton sequence, in [0, 1)
+float halton(unsigned int index, unsigned int base) {
+    float result = 0.0f;
+    float fraction = 1.0f;
+    while (index > 0) {
+        fraction /= static_cast<float>(base);
+        result += fraction * static_cast<float>(index % base);
+        index /= base;
+    }
+    return result;
+}
+
+} // namespace
+
+TemporalUpscaler::~TemporalUpscaler() {
+    ShaderCompiler::instance().cancel(this);
+}
+
+bool TemporalUpscaler::initialize(int outputWidth, int outputHeight) {
+    resize(outputWidth, outputHeight);
+    ShaderCompiler::instance().submitCompute(this, "temporal upscale", "shaders/taa_resolve.cs", "",
+                                             [this](GLuint program) { resolveProgram_.setId(program); });
+    return history_[0].get() != 0;
+}
+
+void TemporalUpscaler::resize(int outputWidth, int outputHeight) {
+    outputWidth = std::max(outputWidth, 1);
+    outputHeight = std::max(outputHeight, 1);
+    if (outputWidth == outputWidth_ && outputHeight == outputHeight_ && history_[0].get() != 0) return;
+    outputWidth_ = outputWidth;
+    outputHeight_ = outputHeight;
+    createHistory();
+}
+
+void TemporalUpscaler::createHistory() {
+    GPUMemoryScope memoryScope("Temporal upscale");
+    for (GLTexture& history : history_) {
+        history.create(GL_TEXTURE_2D);
+        history.storage2D(1, GL_RGBA16F, outputWidth_, outputHeight_);
+        history.sampling(GL_LINEAR, GL_LINEAR, GL_CLAMP_TO_EDGE);
+    }
+    historyValid_ = false;
+}
+
+void TemporalUpscaler::setSettings(const Settings& settings) {
+    Settings clamped = settings;
+    clamped.renderScale = std::clamp(settings.renderScale, 0.5f, 1.0f);
+    clamped.feedback = std::clamp(settings.feedback, 0.0f, 0.98f);
+    // A new render size leaves the history's texels where they were; only the weights change
+    settings_ = clamped;
+}
+
+glm::ivec2 TemporalUpscaler::getRenderSize() const {
+    if (!isReady()) return glm::ivec2(outputWidth_, outputHeight_);
+    return glm::max(glm::ivec2(glm::round(glm::vec2(outputWidth_, outputHeight_) * settings_.renderScale)), glm::ivec2(1));
+}
+
+glm::vec2 TemporalUpscaler::beginFrame(const glm::mat4& view, const glm::mat4& projection) {
+    glm::mat4 viewProjection = projection * view;
+    previousViewProjection_ = historyValid_ ? viewProjection_ : viewProjection;
+    viewProjection_ = viewProjection;
+
+    if (!isReady()) {
+        jitter_ = glm::vec2(0.0f);
+        return jitter_;
+    }
+    // Centered on the texel; index 0 of the sequence is the origin, so it starts at 1
+    unsigned int phase = frameIndex_++ % JITTER_PHASES + 1;
+    jitter_ = glm::vec2(halton(phase, 2), halton(phase, 3)) - 0.5f;
+    return jitter_;
+}
+
+GLuint TemporalUpscaler::resolve(const Inputs& inputs) {
+    if (!isReady() || inputs.color == 0 || inputs.depth == 0) return 0;
+
+    ProfileScope scope("Temporal upscale");
+    glm::ivec2 renderSize = getRenderSize();
+    int target = historyIndex_ ^ 1;
+    bool fluid = inputs.fluidDepth != 0 && inputs.fluidMotion != 0;
+
+    resolveProgram_.use();
+    glBindTextureUnit(0, inputs.color);
+    glBindTextureUnit(1, inputs.depth);
+    glBindTextureUnit(2, fluid ? inputs.fluidDepth : 0);
+    glBindTextureUnit(3, fluid ? inputs.fluidMotion : 0);
+    glBindTextureUnit(4, history_[historyIndex_].get());
+    glBindImageTexture(0, history_[target].get(), 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+
+    resolveProgram_.setVec2("uRenderSize", glm::vec2(renderSize));
+    resolveProgram_.setVec2("uOutputSize", glm::vec2(outputWidth_, outputHeight_));
+    resolveProgram_.setVec2("uJitter", jitter_);
+    resolveProgram_.setMat4("uInverseViewProjection", glm::inverse(viewProjection_));
+    resolveProgram_.setMat4("uPreviousViewProjection", previousViewProjection_);
+    resolveProgram_.setFloat("uFeedback", settings_.feedback);
+    resolveProgram_.setFloat("uVarianceGamma", settings_.varianceGamma);
+    resolveProgram_.setBool("uHistoryValid", historyValid_);
+    resolveProgram_.setBool("uFluidMotion", fluid);
+    resolveProgram_.setVec4("uSphere", inputs.sphere);
+    resolveProgram_.setVec3("uPreviousSphereCenter", inputs.previousSphereCenter);
+    glDispatchCompute((outputWidth_ + RESOLVE_GROUP_SIZE - 1) / RESOLVE_GROUP_SIZE,
+                      (outputHeight_ + RESOLVE_GROUP_SIZE - 1) / RESOLVE_GROUP_SIZE, 1);
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+    // Render-sized inputs are pooled at that size; the history is read and written whole
+    GPUMemoryTracker& tracker = GPUMemoryTracker::instance();
+    size_t read = tracker.getTextureBytes(inputs.color) + tracker.getTextureBytes(inputs.depth) +
+                  tracker.getTextureBytes(history_[historyIndex_].get());
+    if (fluid) read += tracker.getTextureBytes(inputs.fluidDepth) + tracker.getTextureBytes(inputs.fluidMotion);
+    tracker.addTraffic("Temporal upscale", read, tracker.getTextureBytes(history_[target].get()));
+
+    historyIndex_ = target;
+    historyValid_ = true;
+    return history_[target].get();
+}
+
+} // namespace WaterSim
@@ -0,0 +1,403 @@
+#include "TraceRecorder.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+
+namespace WaterSim {
+
+namespace {
+
+const std::chrono::steady_clock::time_point g_epoch = std::chrono::steady_clock::now();
+
+bool endsWith(const std::string& text, const std::string& suffix) {
+    return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+std::string escapeJSON(const char* text) {
+    std::string escaped;
+    for (const char* c = text; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            escaped += '\\';
+            escaped += *c;
+        } else if (static_cast<unsigned char>(*c) < 0x20) {
+            char code[8];
+            std::snprintf(code, sizeof(code), "\\u%04x", *c);
+            escaped += code;
+        } else {
+            escaped += *c;
+        }
+    }
+    return escaped;
+}
+
+// Minimal protobuf writer for the few Perfetto messages the trace needs
+class ProtoWriter {
+public:
+    void varint(uint32_t field, uint64_t value) {
+        tag(field, 0);
+        rawVarint(value);
+    }
+    void fixed64(uint32_t field, double value) {
+        tag(field, 1);
+        uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        for (int i = 0; i < 8; i++) {
+            bytes_.push_back(static_cast<char>(bits >> (8 * i)));
+        }
+    }
+    void string(uint32_t field, const std::string& value) {
+        tag(field, 2);
+        rawVarint(value.size());
+        bytes_ += value;
+    }
+    void message(uint32_t field, const ProtoWriter& nested) { string(field, nested.bytes_); }
+    const std::string& bytes() const { return bytes_; }
+
+private:
+    void tag(uint32_t field, uint32_t wireType) { rawVarint((uint64_t(field) << 3) | wireType); }
+    void rawVarint(uint64_t value) {
+        while (value >= 0x80) {
+            bytes_.push_back(static_cast<char>((value & 0x7F) | 0x80));
+            value >>= 7;
+        }
+        bytes_.push_back(static_cast<char>(value));
+    }
+
+    std::string bytes_;
+};
+
+// Field numbers of perfetto/protos/perfetto/trace
+namespace Perfetto {
+constexpr uint32_t TRACE_PACKET = 1;
+constexpr uint32_t PACKET_TIMESTAMP = 8;
+constexpr uint32_t PACKET_SEQUENCE_ID = 10;
+constexpr uint32_t PACKET_TRACK_EVENT = 11;
+constexpr uint32_t PACKET_SEQUENCE_FLAGS = 13;
+constexpr uint32_t PACKET_TRACK_DESCRIPTOR = 60;
+constexpr uint32_t TRACK_UUID = 1;
+constexpr uint32_t TRACK_NAME = 2;
+constexpr uint32_t TRACK_PROCESS = 3;
+constexpr uint32_t TRACK_THREAD = 4;
+constexpr uint32_t TRACK_PARENT_UUID = 5;
+constexpr uint32_t TRACK_COUNTER = 8;
+constexpr uint32_t PROCESS_PID = 1;
+constexpr uint32_t PROCESS_NAME = 6;
+constexpr uint32_t THREAD_PID = 1;
+constexpr uint32_t THREAD_TID = 2;
+constexpr uint32_t THREAD_NAME = 5;
+constexpr uint32_t EVENT_TYPE = 9;
+constexpr uint32_t EVENT_TRACK_UUID = 11;
+constexpr uint32_t EVENT_NAME = 23;
+constexpr uint32_t EVENT_DOUBLE_COUNTER_VALUE = 44;
+constexpr uint64_t TYPE_SLICE_BEGIN = 1;
+constexpr uint64_t TYPE_SLICE_END = 2;
+constexpr uint64_t TYPE_INSTANT = 3;
+constexpr uint64_t TYPE_COUNTER = 4;
+constexpr uint64_t SEQ_INCREMENTAL_STATE_CLEARED = 1;
+} // namespace Perfetto
+
+constexpr uint32_t TRACE_PID = 1;
+
+} // namespace
+
+TraceRecorder& TraceRecorder::instance() {
+    static TraceRecorder recorder;
+    return recorder;
+}
+
+int64_t TraceRecorder::now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - g_epoch).count();
+}
+
+TraceRecorder::ThreadRing& TraceRecorder::threadRing() {
+    thread_local ThreadRing* ring = nullptr;
+    if (!ring) {
+        std::lock_guard<std::mutex> lock(ringsMutex_);
+        rings_.push_back(std::make_unique<ThreadRing>());
+        ring = rings_.back().get();
+        ring->threadId = static_cast<uint32_t>(rings_.size());
+        ring->threadName = "Thread " + std::to_string(ring->threadId);
+    }
+    return *ring;
+}
+
+void TraceRecorder::setThreadName(const std::string& name) {
+    ThreadRing& ring = threadRing();
+    std::lock_guard<std::mutex> lock(ringsMutex_);
+    ring.threadName = name;
+}
+
+void TraceRecorder::record(EventType type, const char* name, int64_t timestamp, int64_t duration, double value) {
+    if (!isEnabled()) return;
+
+    // Only this thread writes the ring: fill the slot, then publish it
+    ThreadRing& ring = threadRing();
+    uint64_t head = ring.head.load(std::memory_order_relaxed);
+    Event& event = ring.events[head % RING_EVENTS];
+    std::strncpy(event.name, name, NAME_LENGTH - 1);
+    event.name[NAME_LENGTH - 1] = '\0';
+    event.type = type;
+    event.timestamp = timestamp;
+    event.duration = duration;
+    event.value = value;
+    ring.head.store(head + 1, std::memory_order_release);
+}
+
+void TraceRecorder::slice(const char* name, int64_t startNs, int64_t endNs) {
+    record(EventType::SLICE, name, startNs, endNs - startNs, 0.0);
+}
+
+void TraceRecorder::gpuSlice(const char* name, int64_t startNs, int64_t endNs) {
+    record(EventType::GPU_SLICE, name, startNs, endNs - startNs, 0.0);
+}
+
+void TraceRecorder::counter(const char* name, double value) {
+    record(EventType::COUNTER, name, now(), 0, value);
+}
+
+void TraceRecorder::instant(const char* name, double value) {
+    record(EventType::INSTANT, name, now(), 0, value);
+}
+
+void TraceRecorder::message(const char* name, const char* text) {
+    if (!isEnabled()) return;
+
+    uint64_t index;
+    {
+        std::lock_guard<std::mutex> lock(messagesMutex_);
+        index = messageCount_++;
+        messages_[index % MESSAGE_RING] = text;
+    }
+    record(EventType::MESSAGE, name, now(), 0, static_cast<double>(index));
+}
+
+std::vector<TraceRecorder::Snapshot> TraceRecorder::snapshot(int64_t sinceNs) {
+    std::lock_guard<std::mutex> lock(ringsMutex_);
+    std::vector<Snapshot> threads;
+    for (const auto& ring : rings_) {
+        uint64_t head = ring->head.load(std::memory_order_acquire);
+        uint64_t first = head > RING_EVENTS ? head - RING_EVENTS : 0;
+        Snapshot thread{ ring->threadId, ring->threadName, {}, {} };
+        thread.events.reserve(static_cast<size_t>(head - first));
+        for (uint64_t i = first; i < head; i++) {
+            thread.events.push_back(ring->events[i % RING_EVENTS]);
+        }
+
+        // The writer may have lapped the oldest slots while they were copied; a slot is
+        // intact only if it is newer than the one the writer is on, minus a full ring
+        uint64_t after = ring->head.load(std::memory_order_acquire);
+        uint64_t intact = after + 1 > RING_EVENTS ? after + 1 - RING_EVENTS : 0;
+        if (intact > first) {
+            size_t lost = static_cast<size_t>(std::min<uint64_t>(intact - first, thread.events.size()));
+            thread.events.erase(thread.events.begin(), thread.events.begin() + lost);
+        }
+        thread.events.erase(std::remove_if(thread.events.begin(), thread.events.end(), [sinceNs](const Event& event) {
+            return event.timestamp + event.duration < sinceNs;
+        }), thread.events.end());
+        threads.push_back(std::move(thread));
+    }
+
+    // The text of the messages still in their ring; an older one keeps only its name
+    std::lock_guard<std::mutex> messagesLock(messagesMutex_);
+    for (Snapshot& thread : threads) {
+        for (const Event& event : thread.events) {
+            if (event.type != EventType::MESSAGE) continue;
+            uint64_t index = static_cast<uint64_t>(event.value);
+            if (index + MESSAGE_RING >= messageCount_) {
+                thread.messages[index] = messages_[index % MESSAGE_RING];
+            }
+        }
+    }
+    return threads;
+}
+
+bool TraceRecorder::save(const std::string& path, int64_t sinceNs) {
+    std::vector<Snapshot> threads = snapshot(sinceNs);
+    bool perfetto = endsWith(path, ".pftrace") || endsWith(path, ".perfetto-trace");
+    bool written = perfetto ? writePerfetto(path, threads) : writeJSON(path, threads);
+    if (written) {
+        size_t events = 0;
+        for (const Snapshot& thread : threads) events += thread.events.size();
+        std::cout << "Trace: " << events << " events from " << threads.size() << " threads written to " << path << std::endl;
+    } else {
+        std::cerr << "Could not write trace " << path << std::endl;
+    }
+    return written;
+}
+
+bool TraceRecorder::writeJSON(const std::string& path, const std::vector<Snapshot>& threads) const {
+    std::ofstream file(path);
+    if (!file) return false;
+
+    // Timestamps in microseconds; the GPU gets tid 0
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    file << "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":" << TRACE_PID << ",\"args\":{\"name\":\"WaterSimulation\"}},\n";
+    file << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":" << TRACE_PID << ",\"tid\":0,\"args\":{\"name\":\"GPU\"}}";
+    char number[64];
+    auto micros = [&number](int64_t ns) {
+        std::snprintf(number, sizeof(number), "%.3f", ns / 1000.0);
+        return std::string(number);
+    };
+    for (const Snapshot& thread : threads) {
+        file << ",\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":" << TRACE_PID << ",\"tid\":" << thread.threadId
+             << ",\"args\":{\"name\":\"" << escapeJSON(thread.threadName.c_str()) << "\"}}";
+        for (const Event& event : thread.events) {
+            std::string name = escapeJSON(event.name);
+            file << ",\n{\"name\":\"" << name << "\",\"pid\":" << TRACE_PID << ",\"ts\":" << micros(event.timestamp);
+            switch (event.type) {
+                case EventType::SLICE:
+                    file << ",\"ph\":\"X\",\"tid\":" << thread.threadId << ",\"dur\":" << micros(event.duration) << "}";
+                    break;
+                case EventType::GPU_SLICE:
+                    file << ",\"ph\":\"X\",\"tid\":0,\"dur\":" << micros(event.duration) << "}";
+                    break;
+                case EventType::COUNTER:
+                    file << ",\"ph\":\"C\",\"tid\":" << thread.threadId << ",\"args\":{\"value\":" << event.value << "}}";
+                    break;
+                case EventType::INSTANT:
+                    file << ",\"ph\":\"i\",\"s\":\"p\",\"tid\":" << thread.threadId << ",\"args\":{\"value\":" << event.value << "}}";
+                    break;
+                case EventType::MESSAGE: {
+                    auto text = thread.messages.find(static_cast<uint64_t>(event.value));
+                    file << ",\"ph\":\"i\",\"s\":\"p\",\"tid\":" << thread.threadId << ",\"args\":{\"message\":\""
+                         << (text != thread.messages.end() ? escapeJSON(text->second.c_str()) : std::string()) << "\"}}";
+                    break;
+                }
+            }
+        }
+    }
+    file << "\n]}\n";
+    return static_cast<bool>(file);
+}
+
+bool TraceRecorder::writePerfetto(const std::string& path, const std::vector<Snapshot>& threads) const {
+    std::ofstream file(path, std::ios::binary);
+    if (!file) return false;
+
+    // Track uuids: the process, the GPU under it, a thread track per ring, a counter track
+    // per counter name
+    const uint64_t processUuid = 1;
+    const uint64_t gpuUuid = 2;
+    auto threadUuid = [](uint32_t threadId) { return 0x100ull + threadId; };
+    std::map<std::string, uint64_t> counterUuids;
+
+    bool firstPacket = true;
+    auto writePacket = [&](ProtoWriter& packet) {
+        packet.varint(Perfetto::PACKET_SEQUENCE_ID, 1);
+        if (firstPacket) {
+            packet.varint(Perfetto::PACKET_SEQUENCE_FLAGS, Perfetto::SEQ_INCREMENTAL_STATE_CLEARED);
+            firstPacket = false;
+        }
+        ProtoWriter trace;
+        trace.message(Perfetto::TRACE_PACKET, packet);
+        file.write(trace.bytes().data(), static_cast<std::streamsize>(trace.bytes().size()));
+    };
+    auto describeTrack = [&](uint64_t uuid, const std::string& name, uint64_t parent, bool counter) {
+        ProtoWriter track;
+        track.varint(Perfetto::TRACK_UUID, uuid);
+        track.string(Perfetto::TRACK_NAME, name);
+        if (parent) track.varint(Perfetto::TRACK_PARENT_UUID, parent);
+        if (counter) track.message(Perfetto::TRACK_COUNTER, ProtoWriter());
+        ProtoWriter packet;
+        packet.message(Perfetto::PACKET_TRACK_DESCRIPTOR, track);
+        writePacket(packet);
+    };
+    auto writeEvent = [&](int64_t timestamp, uint64_t type, uint64_t track, const char* name, const double* value) {
+        ProtoWriter event;
+        event.varint(Perfetto::EVENT_TYPE, type);
+        event.varint(Perfetto::EVENT_TRACK_UUID, track);
+        if (name) event.string(Perfetto::EVENT_NAME, name);
+        if (value) event.fixed64(Perfetto::EVENT_DOUBLE_COUNTER_VALUE, *value);
+        ProtoWriter packet;
+        packet.varint(Perfetto::PACKET_TIMESTAMP, static_cast<uint64_t>(std::max<int64_t>(timestamp, 0)));
+        packet.message(Perfetto::PACKET_TRACK_EVENT, event);
+        writePacket(packet);
+    };
+
+    {
+        ProtoWriter process;
+        process.varint(Perfetto::PROCESS_PID, TRACE_PID);
+        process.string(Perfetto::PROCESS_NAME, "WaterSimulation");
+        ProtoWriter track;
+        track.varint(Perfetto::TRACK_UUID, processUuid);
+        track.message(Perfetto::TRACK_PROCESS, process);
+        ProtoWriter packet;
+        packet.message(Perfetto::PACKET_TRACK_DESCRIPTOR, track);
+        writePacket(packet);
+    }
+    describeTrack(gpuUuid, "GPU", processUuid, false);
+    for (const Snapshot& thread : threads) {
+        ProtoWriter descriptor;
+        descriptor.varint(Perfetto::THREAD_PID, TRACE_PID);
+        descriptor.varint(Perfetto::THREAD_TID, thread.threadId + 1);
+        descriptor.string(Perfetto::THREAD_NAME, thread.threadName);
+        ProtoWriter track;
+        track.varint(Perfetto::TRACK_UUID, threadUuid(thread.threadId));
+        track.message(Perfetto::TRACK_THREAD, descriptor);
+        ProtoWriter packet;
+        packet.message(Perfetto::PACKET_TRACK_DESCRIPTOR, track);
+        writePacket(packet);
+        for (const Event& event : thread.events) {
+            if (event.type == EventType::COUNTER && !counterUuids.count(event.name)) {
+                uint64_t uuid = 0x10000ull + counterUuids.size();
+                counterUuids[event.name] = uuid;
+                describeTrack(uuid, event.name, processUuid, true);
+            }
+        }
+    }
+
+    // Slices are recorded as they end, children first; as begin/end pairs they go out in
+    // time order, an enclosing slice's begin before and its end after those it contains
+    struct Ordered {
+        int64_t timestamp;
+        int kind;           // Ends, then begins, then the rest at equal times
+        int64_t order;      // Begins: longest first; ends: latest begun first
+        uint64_t type;
+        uint64_t track;
+        const Event* event;
+        const char* name;   // The message text in place of the event's name
+    };
+    std::vector<Ordered> ordered;
+    for (const Snapshot& thread : threads) {
+        for (const Event& event : thread.events) {
+            switch (event.type) {
+                case EventType::SLICE:
+                case EventType::GPU_SLICE: {
+                    uint64_t track = event.type == EventType::GPU_SLICE ? gpuUuid : threadUuid(thread.threadId);
+                    ordered.push_back({ event.timestamp, 1, -event.duration, Perfetto::TYPE_SLICE_BEGIN, track, &event, event.name });
+                    ordered.push_back({ event.timestamp + event.duration, 0, -event.timestamp, Perfetto::TYPE_SLICE_END, track, &event, nullptr });
+                    break;
+                }
+                case EventType::COUNTER:
+                    ordered.push_back({ event.timestamp, 2, 0, Perfetto::TYPE_COUNTER, counterUuids[event.name], &event, nullptr });
+                    break;
+                case EventType::INSTANT:
+                    ordered.push_back({ event.timestamp, 2, 0, Perfetto::TYPE_INSTANT, threadUuid(thread.threadId), &event, event.name });
+                    break;
+                case EventType::MESSAGE: {
+                    auto text = thread.messages.find(static_cast<uint64_t>(event.value));
+                    const char* name = text != thread.messages.end() ? text->second.c_str() : event.name;
+                    ordered.push_back({ event.timestamp, 2, 0, Perfetto::TYPE_INSTANT, threadUuid(thread.threadId), &event, name });
+                    break;
+                }
+            }
+        }
+    }
+    std::stable_sort(ordered.begin(), ordered.end(), [](const Ordered& a, const Ordered& b) {
+        if (a.timestamp != b.timestamp) return a.timestamp < b.timestamp;
+        if (a.kind != b.kind) return a.kind < b.kind;
+        return a.order < b.order;
+    });
+    for (const Ordered& entry : ordered) {
+        const char* name = entry.name;
+        const double* value = entry.type == Perfetto::TYPE_COUNTER ? &entry.event->value : nullptr;
+        writeEvent(entry.timestamp, entry.type, entry.track, name, value);
+    }
+    return static_cast<bool>(file);
+}
+
+} // namespace WaterSim
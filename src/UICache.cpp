@@ -0,0 +1,61 @@
+#include "../include/UICache.h"
+#include <imgui.h>
+#include <imgui_internal.h>
+#include <cmath>
+
+namespace WaterSim {
+
+namespace {
+    constexpr int SETTLE_FRAMES = 2;    // Builds after a change, for hovers and auto-sized windows
+}
+
+void UICache::watch(float value, float threshold) {
+    size_t index = watchIndex_++;
+    if (index >= current_.size()) {
+        current_.push_back(value);
+        built_.push_back(value);
+        watchChanged_ = true;
+        return;
+    }
+    current_[index] = value;
+    if (std::fabs(value - built_[index]) > threshold) {
+        watchChanged_ = true;
+    }
+}
+
+bool UICache::inputPending() const {
+    // The GLFW backend's callbacks queue every mouse, key and focus event here until the
+    // next NewFrame trickles them into the IO state
+    const ImGuiContext* context = ImGui::GetCurrentContext();
+    if (!context) return false;
+    const ImGuiIO& io = ImGui::GetIO();
+    return context->InputEventsQueue.Size > 0 || context->ActiveId != 0 || io.WantTextInput;
+}
+
+bool UICache::beginFrame(float deltaTime) {
+    sinceBuild_ += deltaTime;
+    bool changed = invalidated_ || watchChanged_ || inputPending();
+    bool due = settings_.refreshHz > 0.0f && sinceBuild_ >= 1.0f / settings_.refreshHz;
+    bool rebuild = !settings_.enabled || !hasDrawData_ || changed || due || settleFrames_ > 0;
+    watchIndex_ = 0;
+    watchChanged_ = false;
+
+    if (!rebuild) {
+        stats_.replays++;
+        return false;
+    }
+    if (changed) {
+        settleFrames_ = SETTLE_FRAMES;
+    } else if (settleFrames_ > 0) {
+        settleFrames_--;
+    }
+    built_ = current_;
+    invalidated_ = false;
+    hasDrawData_ = true;
+    buildInterval_ = sinceBuild_;
+    sinceBuild_ = 0.0f;
+    stats_.rebuilds++;
+    return true;
+}
+
+} // namespace WaterSim
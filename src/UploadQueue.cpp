@@ -0,0 +1,277 @@
+#include "../include/UploadQueue.h"
+#include <GLFW/glfw3.h>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace WaterSim {
+
+namespace {
+    constexpr size_t STAGING_ALIGNMENT = 256;   // Keeps every job's rows aligned for any unpack alignment
+}
+
+UploadQueue& UploadQueue::instance() {
+    static UploadQueue queue;
+    return queue;
+}
+
+UploadQueue::~UploadQueue() {
+    // The contexts are gone at exit; stop() is the orderly way out
+    if (thread_.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        wake_.notify_all();
+        thread_.join();
+    }
+}
+
+bool UploadQueue::start(size_t stagingBytes) {
+    if (thread_.joinable()) return true;
+    GLFWwindow* mainContext = glfwGetCurrentContext();
+    if (!mainContext) return false;
+
+    // Hidden window whose context shares textures, buffers and sync objects with the main one
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    context_ = glfwCreateWindow(1, 1, "Uploads", nullptr, mainContext);
+    glfwDefaultWindowHints();
+    if (!context_) {
+        std::cerr << "WARNING: No shared context for uploads, they run on the render thread" << std::endl;
+        return false;
+    }
+
+    ringSize_ = (stagingBytes + STAGING_ALIGNMENT - 1) / STAGING_ALIGNMENT * STAGING_ALIGNMENT;
+    stop_ = false;
+    thread_ = std::thread(&UploadQueue::threadLoop, this);
+    std::cout << "Uploads on a shared context, " << (ringSize_ >> 20) << " MB staging ring" << std::endl;
+    return true;
+}
+
+void UploadQueue::stop() {
+    if (thread_.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        wake_.notify_all();
+        thread_.join();
+    }
+    if (context_) {
+        glfwDestroyWindow(context_);
+        context_ = nullptr;
+    }
+
+    // Tickets nobody waited on
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& pair : tickets_) {
+        if (pair.second.fence) {
+            glDeleteSync(pair.second.fence);
+        }
+    }
+    tickets_.clear();
+}
+
+UploadQueue::Ticket UploadQueue::submit(const std::string& name, const void* data, size_t bytes, Command command) {
+    Job job;
+    job.name = name;
+    job.data = data;
+    job.bytes = bytes;
+    job.command = std::move(command);
+    return enqueue(std::move(job));
+}
+
+UploadQueue::Ticket UploadQueue::submit(const std::string& name, std::vector<unsigned char> bytes, Command command) {
+    Job job;
+    job.name = name;
+    job.owned = std::move(bytes);
+    job.data = job.owned.data();
+    job.bytes = job.owned.size();
+    job.command = std::move(command);
+    return enqueue(std::move(job));
+}
+
+UploadQueue::Ticket UploadQueue::enqueue(Job job) {
+    if (!thread_.joinable()) {
+        // Here and now, from client memory
+        Staging staging;
+        staging.data = job.data;
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        job.command(staging);
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.submitted++;
+        stats_.completed++;
+        stats_.bytes += job.bytes;
+        return 0;
+    }
+
+    // Objects the caller just created must reach the driver before the other context uses them
+    glFlush();
+    Ticket ticket;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ticket = nextTicket_++;
+        job.ticket = ticket;
+        tickets_[ticket] = Issued();
+        jobs_.push_back(std::move(job));
+        stats_.submitted++;
+    }
+    wake_.notify_one();
+    return ticket;
+}
+
+UploadQueue::Ticket UploadQueue::uploadTexture(GLuint texture, int layer, int width, int height, GLenum format,
+                                               GLenum type, const void* data, size_t bytes, bool generateMipmaps) {
+    return submit("texture", data, bytes, [=](const Staging& staging) {
+        GLint target = 0;
+        glGetTextureParameteriv(texture, GL_TEXTURE_TARGET, &target);
+        if (target == GL_TEXTURE_2D) {
+            glTextureSubImage2D(texture, 0, 0, 0, width, height, format, type, staging.pixels());
+        } else {
+            glTextureSubImage3D(texture, 0, 0, 0, layer, width, height, 1, format, type, staging.pixels());
+        }
+        if (generateMipmaps) {
+            glGenerateTextureMipmap(texture);
+        }
+    });
+}
+
+UploadQueue::Ticket UploadQueue::uploadBuffer(GLuint buffer, GLintptr offset, const void* data, size_t bytes) {
+    return submit("buffer", data, bytes, [=](const Staging& staging) {
+        if (staging.buffer) {
+            glCopyNamedBufferSubData(staging.buffer, buffer, staging.offset, offset, GLsizeiptr(bytes));
+        } else {
+            glNamedBufferSubData(buffer, offset, GLsizeiptr(bytes), staging.data);
+        }
+    });
+}
+
+bool UploadQueue::isComplete(Ticket ticket) {
+    if (ticket == 0) return true;
+    GLsync fence;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = tickets_.find(ticket);
+        if (it == tickets_.end()) return true;
+        if (!it->second.done) return false;
+        fence = it->second.fence;
+    }
+    // The upload thread flushed after fencing, so polling needs no flush of its own
+    GLenum status = glClientWaitSync(fence, 0, 0);
+    return status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED;
+}
+
+void UploadQueue::waitForUse(Ticket ticket) {
+    if (ticket == 0) return;
+    GLsync fence;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        auto it = tickets_.find(ticket);
+        if (it == tickets_.end()) return;
+        issued_.wait(lock, [this, ticket] { return tickets_[ticket].done; });
+        fence = tickets_[ticket].fence;
+        tickets_.erase(ticket);
+    }
+    glWaitSync(fence, 0, GL_TIMEOUT_IGNORED);
+    glDeleteSync(fence);
+}
+
+UploadQueue::Stats UploadQueue::getStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+int UploadQueue::getPendingCount() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return static_cast<int>(jobs_.size());
+}
+
+UploadQueue::Staging UploadQueue::stage(const Job& job) {
+    Staging staging;
+    staging.data = job.data;
+    if (!ringMapping_ || job.bytes == 0 || job.bytes > ringSize_) {
+        return staging;
+    }
+
+    // Next in the ring, wrapping to the start when the tail is too short; regions come back
+    // in order, so only the oldest few can overlap
+    size_t size = (job.bytes + STAGING_ALIGNMENT - 1) / STAGING_ALIGNMENT * STAGING_ALIGNMENT;
+    if (ringCursor_ + size > ringSize_) {
+        ringCursor_ = 0;
+    }
+    size_t begin = ringCursor_, end = ringCursor_ + size;
+    while (!regions_.empty() && regions_.front().begin < end && begin < regions_.front().end) {
+        glClientWaitSync(regions_.front().fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+        glDeleteSync(regions_.front().fence);
+        regions_.pop_front();
+    }
+
+    std::memcpy(ringMapping_ + begin, job.data, job.bytes);
+    ringCursor_ = end;
+    staging.buffer = ringBuffer_;
+    staging.offset = GLintptr(begin);
+    return staging;
+}
+
+void UploadQueue::threadLoop() {
+    glfwMakeContextCurrent(context_);
+
+    // Coherent, so the copies need no flush before the commands read them
+    const GLbitfield mapFlags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glCreateBuffers(1, &ringBuffer_);
+    glNamedBufferStorage(ringBuffer_, GLsizeiptr(ringSize_), nullptr, mapFlags);
+    ringMapping_ = static_cast<unsigned char*>(glMapNamedBufferRange(ringBuffer_, 0, GLsizeiptr(ringSize_), mapFlags));
+    if (!ringMapping_) {
+        std::cerr << "WARNING: Upload staging ring unavailable, uploads read client memory" << std::endl;
+    }
+
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [this] { return stop_ || !jobs_.empty(); });
+            if (jobs_.empty()) break;
+            job = std::move(jobs_.front());
+            jobs_.pop_front();
+        }
+
+        Staging staging = stage(job);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging.buffer);
+        job.command(staging);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        if (staging.buffer) {
+            regions_.push_back({ size_t(staging.offset), size_t(staging.offset) +
+                                 (job.bytes + STAGING_ALIGNMENT - 1) / STAGING_ALIGNMENT * STAGING_ALIGNMENT,
+                                 glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0) });
+        }
+        glFlush();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            Issued& issued = tickets_[job.ticket];
+            issued.done = true;
+            issued.fence = fence;
+            stats_.completed++;
+            stats_.bytes += job.bytes;
+            stats_.unstaged += staging.buffer ? 0 : 1;
+        }
+        issued_.notify_all();
+    }
+
+    for (Region& region : regions_) {
+        glDeleteSync(region.fence);
+    }
+    regions_.clear();
+    glUnmapNamedBuffer(ringBuffer_);
+    glDeleteBuffers(1, &ringBuffer_);
+    ringBuffer_ = 0;
+    ringMapping_ = nullptr;
+    glFinish();
+    glfwMakeContextCurrent(nullptr);
+}
+
+} // namespace WaterSim
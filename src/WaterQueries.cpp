@@ -0,0 +1,137 @@
+#include "../include/WaterQueries.h"
+#include "../include/GPUMemoryTracker.h"
+#include "../include/Profiler.h"
+#include "../include/SPHComputeSystem.h"
+#include "../include/ShaderCompiler.h"
+#include "../include/WaveState.h"
+#include <algorithm>
+#include <cstring>
+
+namespace WaterSim {
+
+namespace {
+    constexpr uint32_t GROUP_SIZE = 64;     // water_query.cs and sph_query.cs
+    constexpr GLsizeiptr BATCH_BYTES = WaterQueries::MAX_POINTS * sizeof(WaterQueryResult);
+}
+
+static_assert(sizeof(WaterQueryResult) == 2 * sizeof(glm::vec4), "WaterQueryResult must match the shaders' two vec4s");
+
+WaterQueries::~WaterQueries() {
+    ShaderCompiler::instance().cancel(this);
+    for (Slot& slot : slots_) {
+        if (slot.fence) glDeleteSync(slot.fence);
+    }
+    if (readbackBuffer_) {
+        glUnmapNamedBuffer(readbackBuffer_);
+        glDeleteBuffers(1, &readbackBuffer_);
+    }
+    if (pointBuffer_) glDeleteBuffers(1, &pointBuffer_);
+    if (resultBuffer_) glDeleteBuffers(1, &resultBuffer_);
+}
+
+bool WaterQueries::initialize() {
+    GPUMemoryScope memoryScope("Water queries");
+    glCreateBuffers(1, &pointBuffer_);
+    glNamedBufferStorage(pointBuffer_, MAX_POINTS * sizeof(glm::vec4), nullptr, GL_DYNAMIC_STORAGE_BIT);
+    glCreateBuffers(1, &resultBuffer_);
+    glNamedBufferStorage(resultBuffer_, BATCH_BYTES, nullptr, 0);
+
+    GLbitfield readbackFlags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glCreateBuffers(1, &readbackBuffer_);
+    glNamedBufferStorage(readbackBuffer_, READBACK_FRAMES * BATCH_BYTES, nullptr, readbackFlags);
+    readbackResults_ = static_cast<const WaterQueryResult*>(
+        glMapNamedBufferRange(readbackBuffer_, 0, READBACK_FRAMES * BATCH_BYTES, readbackFlags));
+
+    ShaderCompiler::instance().submitCompute(this, "water queries", "shaders/water_query.cs", "",
+                                             [this](GLuint program) { program_.setId(program); });
+    points_.reserve(MAX_POINTS);
+    return readbackResults_ != nullptr;
+}
+
+void WaterQueries::beginFrame() {
+    // Oldest slot first; a zero-timeout wait only polls the fence
+    for (uint32_t i = 0; i < READBACK_FRAMES; i++) {
+        uint32_t index = (writeIndex_ + i) % READBACK_FRAMES;
+        Slot& slot = slots_[index];
+        if (!slot.fence) continue;
+        GLenum status = glClientWaitSync(slot.fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) break;
+        glDeleteSync(slot.fence);
+        slot.fence = nullptr;
+
+        const WaterQueryResult* batch = readbackResults_ + index * MAX_POINTS;
+        latest_.assign(batch, batch + slot.count);
+        latestFrame_ = slot.frame;
+    }
+
+    points_.clear();
+    frame_++;
+}
+
+WaterQueries::Ticket WaterQueries::submit(const glm::vec3* points, uint32_t count) {
+    Ticket ticket;
+    ticket.first = static_cast<uint32_t>(points_.size());
+    ticket.count = std::min(count, MAX_POINTS - ticket.first);
+    for (uint32_t i = 0; i < ticket.count; i++) {
+        points_.emplace_back(points[i], 1.0f);
+    }
+    return ticket;
+}
+
+bool WaterQueries::beginDispatch() {
+    // The GPU is a whole ring behind: this frame goes without
+    if (points_.empty() || !readbackResults_ || slots_[writeIndex_].fence) return false;
+    glNamedBufferSubData(pointBuffer_, 0, points_.size() * sizeof(glm::vec4), points_.data());
+    return true;
+}
+
+void WaterQueries::endDispatch() {
+    Slot& slot = slots_[writeIndex_];
+    slot.count = static_cast<uint32_t>(points_.size());
+    slot.frame = frame_;
+
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glCopyNamedBufferSubData(resultBuffer_, readbackBuffer_, 0, writeIndex_ * BATCH_BYTES,
+                             slot.count * sizeof(WaterQueryResult));
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    writeIndex_ = (writeIndex_ + 1) % READBACK_FRAMES;
+}
+
+void WaterQueries::dispatch(const WaveState& waves, float waterLevel) {
+    if (!program_.isValid() || !waves.isValid() || !beginDispatch()) return;
+
+    ProfileScope scope("Water queries");
+    program_.use();
+    program_.setFloat("uSize", waves.getSize());
+    program_.setFloat("uWaterLevel", waterLevel);
+    program_.setInt("uCount", static_cast<int>(points_.size()));
+    glBindTextureUnit(0, waves.getHeightTexture());
+    glBindTextureUnit(1, waves.getNormalTexture());
+    glBindTextureUnit(2, waves.getVelocityTexture());
+    program_.setInt("uWaveHeight", 0);
+    program_.setInt("uWaveNormal", 1);
+    program_.setInt("uWaveVelocity", 2);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, pointBuffer_);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, resultBuffer_);
+    glDispatchCompute((static_cast<uint32_t>(points_.size()) + GROUP_SIZE - 1) / GROUP_SIZE, 1, 1);
+    glUseProgram(0);
+
+    endDispatch();
+}
+
+void WaterQueries::dispatch(SPHComputeSystem& sph) {
+    if (!beginDispatch()) return;
+
+    ProfileScope scope("Water queries");
+    if (sph.dispatchWaterQuery(pointBuffer_, resultBuffer_, static_cast<uint32_t>(points_.size()))) {
+        endDispatch();
+    }
+}
+
+bool WaterQueries::getResults(const Ticket& ticket, WaterQueryResult* results) const {
+    if (ticket.count == 0 || latestFrame_ == 0 || ticket.first + ticket.count > latest_.size()) return false;
+    std::memcpy(results, latest_.data() + ticket.first, ticket.count * sizeof(WaterQueryResult));
+    return true;
+}
+
+} // namespace WaterSim
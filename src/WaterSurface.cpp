@@ -4,16 +4,17 @@
 #include <iostream>
 #include <algorithm>
 #include <cmath>
-#include <chrono>
-#include <random>
-#include <omp.h>
+#include <atomic>
+#include "../include/JobSystem.h"
+#include <cstdint>
+#include <cstring>
 
 // Static variable to track time since app start
 static float g_totalTime = 0.0f;
 
 WaterSurface::WaterSurface(int resolution, float size) 
-    : resolution(resolution), size(size), waterColor(0.2f, 0.6f, 0.8f), transparency(0.7f),
-      flowVelocity(0.0f, 0.0f), flowOffset(0.0f), foamBuffersInitialized(false) {
+    : VAO(0), VBO(0), EBO(0), resolution(resolution), size(size), waterColor(0.2f, 0.6f, 0.8f), transparency(0.7f),
+      flowVelocity(0.0f, 0.0f), flowOffset(0.0f), vertexRing(nullptr), vertexSlot(0), waveUBO(0), gpuWaves(false), oceanWaves(false), heightfieldWaves(false) {
     
     // Initialize default wave
     WaveParam defaultWave;
@@ -23,52 +24,549 @@ WaterSurface::WaterSurface(int resolution, float size)
     defaultWave.speed = 1.0f;
     defaultWave.steepness = 0.5f;
     waves.push_back(defaultWave);
+    
+    // Sized once, so the per-update rebuilds reuse their storage
+    rippleField.terms.reserve(MAX_RIPPLES);
+    rippleField.binStart.reserve(RIPPLE_BINS * RIPPLE_BINS + 1);
+    rippleBinFill.reserve(RIPPLE_BINS * RIPPLE_BINS);
+}
+
+int WaterSurface::FlowImpulsePool::add() {
+    if (count < MAX_FLOW_IMPULSES) return count++;
+    return static_cast<int>(std::max_element(time.begin(), time.end()) - time.begin());
+}
+
+void WaterSurface::FlowImpulsePool::remove(int slot) {
+    int last = --count;
+    positionX[slot] = positionX[last];
+    positionZ[slot] = positionZ[last];
+    velocityX[slot] = velocityX[last];
+    velocityZ[slot] = velocityZ[last];
+    radius[slot] = radius[last];
+    strength[slot] = strength[last];
+    time[slot] = time[last];
+}
+
+int WaterSurface::RipplePool::add() {
+    if (count < MAX_RIPPLES) return count++;
+    return static_cast<int>(std::max_element(time.begin(), time.end()) - time.begin());
+}
+
+void WaterSurface::RipplePool::remove(int slot) {
+    int last = --count;
+    centerX[slot] = centerX[last];
+    centerZ[slot] = centerZ[last];
+    amplitude[slot] = amplitude[last];
+    radius[slot] = radius[last];
+    speed[slot] = speed[last];
+    decay[slot] = decay[last];
+    time[slot] = time[last];
+    directionX[slot] = directionX[last];
+    directionZ[slot] = directionZ[last];
+    directional[slot] = directional[last];
+}
+
+void WaterSurface::addRippleToPool(const glm::vec2& center, float amplitude, float radius, float speed, float decay,
+                                   const glm::vec2& direction, bool directional) {
+    int slot = ripples.add();
+    ripples.centerX[slot] = center.x;
+    ripples.centerZ[slot] = center.y;
+    ripples.amplitude[slot] = amplitude;
+    ripples.radius[slot] = radius;
+    ripples.speed[slot] = speed;
+    ripples.decay[slot] = decay;
+    ripples.time[slot] = 0.0f;
+    ripples.directionX[slot] = direction.x;
+    ripples.directionZ[slot] = direction.y;
+    ripples.directional[slot] = directional ? 1 : 0;
 }
 
 WaterSurface::~WaterSurface() {
-    // Clean up OpenGL objects
-    glDeleteVertexArrays(1, &VAO);
-    glDeleteBuffers(1, &VBO);
-    glDeleteBuffers(1, &EBO);
+    setAsyncUpdate(false);
     
-    // Clean up foam buffers
-    if (foamBuffersInitialized) {
-        glDeleteVertexArrays(1, &foamVAO);
-        glDeleteBuffers(1, &foamVBO);
+    // Clean up OpenGL objects
+    destroyGridBuffers();
+    if (waveUBO) glDeleteBuffers(1, &waveUBO);
+    if (lodVAO) glDeleteVertexArrays(1, &lodVAO);
+    if (lodVBO) glDeleteBuffers(1, &lodVBO);
+    if (lodEBO) glDeleteBuffers(1, &lodEBO);
+    if (lodInstanceVBO) glDeleteBuffers(1, &lodInstanceVBO);
+    if (tessVAO) glDeleteVertexArrays(1, &tessVAO);
+    if (tessVBO) glDeleteBuffers(1, &tessVBO);
+    if (tessEBO) glDeleteBuffers(1, &tessEBO);
+}
+
+// Octahedral unit normal in two snorm16 components, folded around the y (up) axis
+static void packVertex(const float* position, const float* normal, float* out) {
+    float l1 = std::abs(normal[0]) + std::abs(normal[1]) + std::abs(normal[2]);
+    float u = normal[0] / l1;
+    float v = normal[2] / l1;
+    if (normal[1] < 0.0f) {
+        float foldedU = (1.0f - std::abs(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+        float foldedV = (1.0f - std::abs(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+        u = foldedU;
+        v = foldedV;
     }
+    
+    int16_t encoded[2] = {
+        static_cast<int16_t>(std::lround(glm::clamp(u, -1.0f, 1.0f) * 32767.0f)),
+        static_cast<int16_t>(std::lround(glm::clamp(v, -1.0f, 1.0f) * 32767.0f))
+    };
+    out[0] = position[0];
+    out[1] = position[1];
+    out[2] = position[2];
+    std::memcpy(&out[3], encoded, sizeof(encoded));
 }
 
 void WaterSurface::initialize() {
     generateMesh();
     generateIndices();
+    createGridBuffers();
     
-    // Create and bind VAO and VBO
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glGenBuffers(1, &EBO);
+    // Wave parameter block
+    glCreateBuffers(1, &waveUBO);
+    glNamedBufferStorage(waveUBO, sizeof(WaveBlock), nullptr, GL_DYNAMIC_STORAGE_BIT);
     
-    glBindVertexArray(VAO);
+    generateLODMesh();
+    generateTessellationPatches();
     
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_DYNAMIC_DRAW);
+    foam = std::make_unique<FoamParticles>();
+    if (!foam->initialize(FOAM_CAPACITY)) {
+        std::cerr << "ERROR: GPU foam unavailable, splashes will not foam" << std::endl;
+        foam.reset();
+    }
+}
+
+void WaterSurface::setCompactMesh(bool enable) {
+    if (enable == compactMesh) return;
+    finishSurfaceJob();
+    compactMesh = enable;
     
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+    // Before initialize the choice just shapes the first build
+    if (VAO) {
+        destroyGridBuffers();
+        generateMesh();
+        generateIndices();
+        createGridBuffers();
+    }
+}
+
+void WaterSurface::destroyGridBuffers() {
+    finishSurfaceJob();
+    for (int i = 0; i < VERTEX_RING_SLOTS; i++) {
+        if (vertexFences[i]) glDeleteSync(vertexFences[i]);
+        vertexFences[i] = 0;
+    }
+    if (vertexRing) glUnmapNamedBuffer(VBO);
+    vertexRing = nullptr;
+    if (VAO) glDeleteVertexArrays(1, &VAO);
+    if (VBO) glDeleteBuffers(1, &VBO);
+    if (EBO) glDeleteBuffers(1, &EBO);
+    VAO = VBO = EBO = 0;
+}
+
+void WaterSurface::createGridBuffers() {
+    // Immutable buffers and the vertex layout, all set up without binding
+    glCreateVertexArrays(1, &VAO);
+    glCreateBuffers(1, &VBO);
+    glCreateBuffers(1, &EBO);
+    
+    // Vertex ring: VERTEX_RING_SLOTS copies of the mesh in persistently mapped memory. The
+    // CPU path writes each frame's vertices into the next slot and render() picks it with
+    // a base vertex, so the slots the GPU may still be reading are never touched
+    GLsizeiptr slotSize = vertices.size() * sizeof(float);
+    GLbitfield ringFlags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glNamedBufferStorage(VBO, VERTEX_RING_SLOTS * slotSize, nullptr, ringFlags);
+    vertexRing = static_cast<float*>(glMapNamedBufferRange(VBO, 0, VERTEX_RING_SLOTS * slotSize, ringFlags));
+    if (vertexRing) {
+        // Texture coordinates never change, so every slot starts as the flat grid
+        for (int i = 0; i < VERTEX_RING_SLOTS; i++) {
+            std::copy(vertices.begin(), vertices.end(), vertexRing + i * vertices.size());
+            tileDisplaced[i].assign(RIPPLE_BINS * RIPPLE_BINS, 0);
+        }
+    } else {
+        std::cerr << "ERROR: Failed to map water surface vertex ring!" << std::endl;
+    }
+    
+    // 16-bit indices whenever one slot of the grid fits below the restart index
+    indexType = (compactMesh && resolution * resolution < 0xFFFF) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    if (indexType == GL_UNSIGNED_SHORT) {
+        std::vector<uint16_t> shortIndices(indices.begin(), indices.end());
+        glNamedBufferStorage(EBO, shortIndices.size() * sizeof(uint16_t), shortIndices.data(), 0);
+    } else {
+        glNamedBufferStorage(EBO, indices.size() * sizeof(unsigned int), indices.data(), 0);
+    }
+    glVertexArrayElementBuffer(VAO, EBO);
+    
+    GLsizei stride = vertexFloats * sizeof(float);
+    glVertexArrayVertexBuffer(VAO, 0, VBO, 0, stride);
+    auto attribute = [this](GLuint index, GLint components, GLenum type, GLboolean normalized, GLuint offset) {
+        glEnableVertexArrayAttrib(VAO, index);
+        glVertexArrayAttribFormat(VAO, index, components, type, normalized, offset);
+        glVertexArrayAttribBinding(VAO, index, 0);
+    };
     
     // Position attribute
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
+    attribute(0, 3, GL_FLOAT, GL_FALSE, 0);
+    
+    if (compactMesh) {
+        // Octahedral normal; water.vs and gbuffer.vs decode it and derive the texture coordinates
+        attribute(1, 2, GL_SHORT, GL_TRUE, 3 * sizeof(float));
+    } else {
+        // Normal attribute
+        attribute(1, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float));
+        
+        // Texture coordinate attribute
+        attribute(2, 2, GL_FLOAT, GL_FALSE, 6 * sizeof(float));
+    }
+}
+
+void WaterSurface::generateTessellationPatches() {
+    // Flat corners over the surface; water.tcs reads position only
+    std::vector<float> corners;
+    float halfSize = size / 2.0f;
+    float patchSize = size / TESS_PATCH_RESOLUTION;
+    for (int z = 0; z <= TESS_PATCH_RESOLUTION; z++) {
+        for (int x = 0; x <= TESS_PATCH_RESOLUTION; x++) {
+            corners.push_back(-halfSize + x * patchSize);
+            corners.push_back(0.0f);
+            corners.push_back(-halfSize + z * patchSize);
+        }
+    }
+    
+    // Corners in the (u, v) order (0, 0), (1, 0), (1, 1), (0, 1) with u along x, v along z
+    std::vector<unsigned int> patchIndices;
+    int row = TESS_PATCH_RESOLUTION + 1;
+    for (int z = 0; z < TESS_PATCH_RESOLUTION; z++) {
+        for (int x = 0; x < TESS_PATCH_RESOLUTION; x++) {
+            unsigned int corner = z * row + x;
+            unsigned int patch[4] = { corner, corner + 1, corner + row + 1, corner + row };
+            patchIndices.insert(patchIndices.end(), patch, patch + 4);
+        }
+    }
+    tessIndexCount = static_cast<int>(patchIndices.size());
     
-    // Normal attribute
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
+    glCreateVertexArrays(1, &tessVAO);
+    glCreateBuffers(1, &tessVBO);
+    glCreateBuffers(1, &tessEBO);
     
-    // Texture coordinate attribute
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-    glEnableVertexAttribArray(2);
+    glNamedBufferStorage(tessVBO, corners.size() * sizeof(float), corners.data(), 0);
+    glNamedBufferStorage(tessEBO, patchIndices.size() * sizeof(unsigned int), patchIndices.data(), 0);
+    glVertexArrayVertexBuffer(tessVAO, 0, tessVBO, 0, 3 * sizeof(float));
+    glVertexArrayElementBuffer(tessVAO, tessEBO);
+    glEnableVertexArrayAttrib(tessVAO, 0);
+    glVertexArrayAttribFormat(tessVAO, 0, 3, GL_FLOAT, GL_FALSE, 0);
+    glVertexArrayAttribBinding(tessVAO, 0, 0);
+}
+
+void WaterSurface::displacementBounds(glm::vec2& horizontal, float& height) const {
+    // How far the displacement can move the surface from the flat grid
+    horizontal = glm::vec2(0.0f);
+    height = 0.2f; // Flow and micro detail
+    int waveCount = oceanWaves ? 0 : std::min(static_cast<int>(waves.size()), MAX_GPU_WAVES);
+    for (int i = 0; i < waveCount; i++) {
+        height += std::abs(waves[i].amplitude);
+        horizontal += glm::vec2(std::abs(waves[i].amplitude * waves[i].steepness * 2.0f));
+    }
+    if (oceanWaves) {
+        height += 4.0f * oceanSettings.rmsHeight;
+        horizontal += glm::vec2(4.0f * oceanSettings.rmsHeight * oceanSettings.choppiness);
+    }
+    for (const auto& ripple : rippleField.terms) {
+        height += std::abs(ripple.amplitude);
+    }
+    if (heightfieldWaves) {
+        height += 1.0f;
+    }
+}
+
+void WaterSurface::generateLODMesh() {
+    // Levels so the finest quads are half the uniform grid's step
+    float finestQuad = 0.5f * size / (float)(resolution - 1);
+    float leafTarget = finestQuad * LOD_PATCH_RESOLUTION;
+    lodLevels = 1;
+    while (lodLevels < MAX_LOD_LEVELS && size / (1 << (lodLevels - 1)) > leafTarget) {
+        lodLevels++;
+    }
     
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
+    // A level's range must be about eight of its nodes for neighbours to differ by at most
+    // one level and meet fully morphed
+    float leafSize = size / (1 << (lodLevels - 1));
+    lodFinestRange = 8.0f * leafSize;
+    
+    // Unit patch: positions 0-1 in x and z, in the vertex layout of the uniform grid
+    std::vector<float> patchVertices;
+    for (int z = 0; z <= LOD_PATCH_RESOLUTION; z++) {
+        for (int x = 0; x <= LOD_PATCH_RESOLUTION; x++) {
+            float u = (float)x / LOD_PATCH_RESOLUTION;
+            float v = (float)z / LOD_PATCH_RESOLUTION;
+            float vertex[8] = { u, 0.0f, v, 0.0f, 1.0f, 0.0f, u, v };
+            patchVertices.insert(patchVertices.end(), vertex, vertex + 8);
+        }
+    }
+    std::vector<unsigned int> patchIndices;
+    int row = LOD_PATCH_RESOLUTION + 1;
+    for (int z = 0; z < LOD_PATCH_RESOLUTION; z++) {
+        for (int x = 0; x < LOD_PATCH_RESOLUTION; x++) {
+            unsigned int topLeft = z * row + x;
+            unsigned int bottomLeft = topLeft + row;
+            unsigned int quad[6] = { topLeft, bottomLeft, topLeft + 1, topLeft + 1, bottomLeft, bottomLeft + 1 };
+            patchIndices.insert(patchIndices.end(), quad, quad + 6);
+        }
+    }
+    lodIndexCount = static_cast<int>(patchIndices.size());
+    
+    glCreateVertexArrays(1, &lodVAO);
+    glCreateBuffers(1, &lodVBO);
+    glCreateBuffers(1, &lodEBO);
+    
+    glNamedBufferStorage(lodVBO, patchVertices.size() * sizeof(float), patchVertices.data(), 0);
+    glNamedBufferStorage(lodEBO, patchIndices.size() * sizeof(unsigned int), patchIndices.data(), 0);
+    glVertexArrayVertexBuffer(lodVAO, 0, lodVBO, 0, 8 * sizeof(float));
+    glVertexArrayElementBuffer(lodVAO, lodEBO);
+    
+    for (int attribute = 0; attribute < 3; attribute++) {
+        static const int components[3] = { 3, 3, 2 };
+        static const int offsets[3] = { 0, 3, 6 };
+        glEnableVertexArrayAttrib(lodVAO, attribute);
+        glVertexArrayAttribFormat(lodVAO, attribute, components[attribute], GL_FLOAT, GL_FALSE, offsets[attribute] * sizeof(float));
+        glVertexArrayAttribBinding(lodVAO, attribute, 0);
+    }
+    
+    // Patch placement, one per instance from binding 1; setCamera allocates the buffer
+    glEnableVertexArrayAttrib(lodVAO, 3);
+    glVertexArrayAttribFormat(lodVAO, 3, 4, GL_FLOAT, GL_FALSE, 0);
+    glVertexArrayAttribBinding(lodVAO, 3, 1);
+    glVertexArrayBindingDivisor(lodVAO, 1, 1);
+}
+
+void WaterSurface::setCamera(const glm::mat4& modelView, const glm::mat4& projection) {
+    lodCamera = glm::vec3(glm::inverse(modelView)[3]);
+    lodViewProjection = projection * modelView;
+    lodCameraValid = true;
+}
+
+void WaterSurface::selectLODPatches() {
+    lodPatches.clear();
+    
+    // Frustum planes (Gribb and Hartmann) in surface coordinates, pointing inwards
+    glm::vec4 planes[6];
+    glm::mat4 m = glm::transpose(lodViewProjection);
+    for (int i = 0; i < 3; i++) {
+        planes[2 * i] = m[3] + m[i];
+        planes[2 * i + 1] = m[3] - m[i];
+    }
+    
+    glm::vec2 horizontalBound;
+    float heightBound;
+    displacementBounds(horizontalBound, heightBound);
+    
+    float halfSize = size / 2.0f;
+    selectLODNode(glm::vec2(-halfSize), size, lodLevels - 1, planes, horizontalBound, heightBound);
+}
+
+void WaterSurface::selectLODNode(const glm::vec2& origin, float nodeSize, int level, const glm::vec4* planes,
+                                 const glm::vec2& horizontalBound, float heightBound) {
+    glm::vec3 boundsMin(origin.x - horizontalBound.x, -heightBound, origin.y - horizontalBound.y);
+    glm::vec3 boundsMax(origin.x + nodeSize + horizontalBound.x, heightBound, origin.y + nodeSize + horizontalBound.y);
+    for (int i = 0; i < 6; i++) {
+        glm::vec3 normal(planes[i]);
+        glm::vec3 farthest(normal.x > 0.0f ? boundsMax.x : boundsMin.x,
+                           normal.y > 0.0f ? boundsMax.y : boundsMin.y,
+                           normal.z > 0.0f ? boundsMax.z : boundsMin.z);
+        if (glm::dot(normal, farthest) + planes[i].w < 0.0f) return;
+    }
+    
+    // Split while the next finer level's range reaches into the node; children outside it
+    // are drawn at that level fully morphed, which matches this level's grid
+    float finerRange = level > 0 ? lodFinestRange * (1 << (level - 1)) : 0.0f;
+    glm::vec3 closest = glm::clamp(lodCamera, boundsMin, boundsMax);
+    if (level == 0 || glm::length(closest - lodCamera) > finerRange) {
+        lodPatches.push_back(glm::vec4(origin, nodeSize, static_cast<float>(level)));
+        return;
+    }
+    
+    float childSize = nodeSize * 0.5f;
+    for (int child = 0; child < 4; child++) {
+        glm::vec2 childOrigin = origin + childSize * glm::vec2(child & 1, child >> 1);
+        selectLODNode(childOrigin, childSize, level - 1, planes, horizontalBound, heightBound);
+    }
+}
+
+void WaterSurface::setGPUWaves(bool enable) {
+    if (enable == gpuWaves) return;
+    gpuWaves = enable;
+    
+    // The vertex shader displaces the flat grid, so drop the last CPU displacement
+    if (gpuWaves) {
+        uploadFlatGrid();
+    }
+}
+
+void WaterSurface::setOceanWaves(bool enable) {
+    if (enable == oceanWaves) return;
+    
+    if (enable && !ocean) {
+        ocean = std::make_unique<OceanFFT>();
+        if (!ocean->initialize(oceanSettings)) {
+            std::cerr << "ERROR: FFT ocean unavailable, keeping Gerstner waves" << std::endl;
+            ocean.reset();
+            return;
+        }
+    }
+    oceanWaves = enable;
+    
+    // Like GPU waves, the ocean displaces the flat grid in water.vs
+    if (oceanWaves) {
+        uploadFlatGrid();
+    }
+}
+
+void WaterSurface::setOceanSettings(const OceanFFT::Settings& settings) {
+    oceanSettings = settings;
+    if (ocean) {
+        ocean->setSettings(settings);
+        oceanSettings = ocean->getSettings();
+    }
+}
+
+void WaterSurface::setHeightfieldWaves(bool enable, int heightfieldResolution) {
+    if (enable == heightfieldWaves) return;
+    
+    if (enable && !heightfield) {
+        heightfield = std::make_unique<HeightfieldWaves>();
+        if (!heightfield->initialize(heightfieldResolution, size)) {
+            std::cerr << "ERROR: Heightfield ripples unavailable, keeping analytic ripples" << std::endl;
+            heightfield.reset();
+            return;
+        }
+    }
+    heightfieldWaves = enable;
+    
+    // Start the new mode calm rather than mixing in the other mode's disturbances
+    ripples.clear();
+    buildRippleBins();
+    if (heightfield) {
+        heightfield->clear();
+    }
+}
+
+void WaterSurface::setFlowMap(bool enable, int flowMapResolution) {
+    if (enable == flowMapEnabled) return;
+    
+    if (enable && !flowMap) {
+        flowMap = std::make_unique<FlowMap>();
+        if (!flowMap->initialize(flowMapResolution, size)) {
+            std::cerr << "ERROR: Flow map unavailable, keeping the uniform flow" << std::endl;
+            flowMap.reset();
+            return;
+        }
+    }
+    flowMapEnabled = enable;
+    if (flowMap) {
+        flowMap->setBaseVelocity(flowVelocity);
+        flowMap->clear();
+    }
+    if (foam) {
+        foam->setFlowMap(enable ? flowMap->getVelocityTexture() : 0, size);
+    }
+}
+
+void WaterSurface::setObstacle(const glm::vec3& center, float radius) {
+    if (!heightfield) return;
+    
+    // Cross-section of the sphere with the water plane
+    float waterlineSq = radius * radius - center.y * center.y;
+    heightfield->setObstacle(glm::vec2(center.x, center.z), waterlineSq > 0.0f ? std::sqrt(waterlineSq) : 0.0f);
+}
+
+void WaterSurface::uploadFlatGrid() {
+    finishSurfaceJob();
+    float* slot = acquireVertexSlot();
+    if (slot) {
+        std::copy(vertices.begin(), vertices.end(), slot);
+        tileDisplaced[vertexSlot].assign(RIPPLE_BINS * RIPPLE_BINS, 0);
+    }
+}
+
+float* WaterSurface::acquireVertexSlot() {
+    int slot = (vertexSlot + 1) % VERTEX_RING_SLOTS;
+    float* slotVertices = waitForVertexSlot(slot);
+    if (slotVertices) {
+        vertexSlot = slot;
+    }
+    return slotVertices;
+}
+
+float* WaterSurface::waitForVertexSlot(int slot) {
+    if (!vertexRing) return nullptr;
+    
+    // Three slots in flight: the slot coming round again was last drawn two frames ago,
+    // so this wait almost never blocks
+    GLsync& fence = vertexFences[slot];
+    if (fence) {
+        GLenum status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+        if (status == GL_TIMEOUT_EXPIRED || status == GL_WAIT_FAILED) {
+            std::cerr << "ERROR: Timed out waiting for water surface vertex slot" << std::endl;
+            return nullptr;
+        }
+        glDeleteSync(fence);
+        fence = 0;
+    }
+    
+    return vertexRing + static_cast<size_t>(slot) * vertices.size();
+}
+
+void WaterSurface::setRenderLag(float seconds) {
+    // Rewritten every frame, since a frame between ticks runs no update to write the block;
+    // once more when the lag goes back to zero
+    bool lagged = seconds > 0.0f || renderLag > 0.0f;
+    renderLag = std::max(seconds, 0.0f);
+    if (lagged) {
+        updateWaveBlock(g_totalTime - renderLag);
+    }
+    if (heightfieldWaves) {
+        heightfield->setRenderLag(renderLag);
+    }
+}
+
+void WaterSurface::updateWaveBlock(float time) {
+    WaveBlock block = {};
+    
+    // The ocean replaces the Gerstner waves, so only the ripples are passed on
+    int waveCount = oceanWaves ? 0 : std::min(static_cast<int>(waves.size()), MAX_GPU_WAVES);
+    for (int i = 0; i < waveCount; i++) {
+        const auto& wave = waves[i];
+        block.waves[2 * i] = glm::vec4(wave.direction, wave.amplitude, wave.wavelength);
+        block.waves[2 * i + 1] = glm::vec4(wave.speed, wave.steepness, 0.0f, 0.0f);
+    }
+    
+    // Decay and travel were evaluated once per ripple by buildRippleBins; past the block's
+    // capacity the newest ripples go, found by age since pool slots are unordered
+    int rippleCount = std::min(static_cast<int>(rippleField.terms.size()), MAX_GPU_RIPPLES);
+    std::array<int, MAX_RIPPLES> newest;
+    for (int i = 0; i < ripples.count; i++) {
+        newest[i] = i;
+    }
+    if (ripples.count > rippleCount) {
+        std::nth_element(newest.begin(), newest.begin() + rippleCount, newest.begin() + ripples.count,
+                         [&](int a, int b) { return ripples.time[a] < ripples.time[b]; });
+    }
+    for (int i = 0; i < rippleCount; i++) {
+        const auto& ripple = rippleField.terms[newest[i]];
+        block.ripples[2 * i] = glm::vec4(ripple.center, ripple.amplitude, ripple.radius);
+        block.ripples[2 * i + 1] = glm::vec4(ripple.direction, ripple.travelled, ripple.isDirectional ? 1.0f : 0.0f);
+        block.rippleAges[i / 4][i % 4] = ripples.time[newest[i]];
+    }
+    
+    block.counts = glm::ivec4(waveCount, rippleCount, 0, 0);
+    block.timing = glm::vec4(time, size / (float)(resolution - 1), 0.0f, 0.0f);
+    
+    glNamedBufferSubData(waveUBO, 0, sizeof(WaveBlock), &block);
+}
+
+void WaterSurface::bindWaveParameters() const {
+    glBindBufferBase(GL_UNIFORM_BUFFER, 1, waveUBO);
 }
 
 void WaterSurface::generateMesh() {
@@ -97,11 +595,49 @@ void WaterSurface::generateMesh() {
             vertices.push_back((float)z / (resolution - 1));
         }
     }
+    
+    // Vertex range of each tile along a grid axis, binned as rippleHeight bins positions
+    float binSize = size / RIPPLE_BINS;
+    tileVertexStart.assign(RIPPLE_BINS + 1, resolution);
+    for (int i = resolution - 1; i >= 0; i--) {
+        float position = -halfSize + i * step;
+        int bin = std::min(static_cast<int>((position + halfSize) / binSize), RIPPLE_BINS - 1);
+        tileVertexStart[bin] = i;
+    }
+    for (int bin = RIPPLE_BINS - 1; bin >= 0; bin--) {
+        tileVertexStart[bin] = std::min(tileVertexStart[bin], tileVertexStart[bin + 1]);
+    }
+    
+    vertexFloats = 8;
+    if (compactMesh) {
+        std::vector<float> packed(static_cast<size_t>(resolution) * resolution * 4);
+        for (size_t i = 0; i < packed.size() / 4; i++) {
+            packVertex(&vertices[i * 8], &vertices[i * 8 + 3], &packed[i * 4]);
+        }
+        vertices.swap(packed);
+        vertexFloats = 4;
+    }
 }
 
 void WaterSurface::generateIndices() {
     indices.clear();
     
+    // Compact grid: one strip per row of each band; a band's row fits the post-transform
+    // cache, so the next row reuses it
+    if (compactMesh) {
+        for (int band = 0; band < resolution - 1; band += STRIP_BAND_QUADS) {
+            int bandEnd = std::min(band + STRIP_BAND_QUADS, resolution - 1);
+            for (int z = 0; z < resolution - 1; z++) {
+                for (int x = band; x <= bandEnd; x++) {
+                    indices.push_back(z * resolution + x);
+                    indices.push_back((z + 1) * resolution + x);
+                }
+                indices.push_back(0xFFFFFFFFu); // Restart, 0xFFFF once narrowed to 16 bits
+            }
+        }
+        return;
+    }
+    
     for (int z = 0; z < resolution - 1; z++) {
         for (int x = 0; x < resolution - 1; x++) {
             unsigned int topLeft = z * resolution + x;
@@ -122,125 +658,225 @@ void WaterSurface::generateIndices() {
     }
 }
 
-glm::vec3 WaterSurface::calculateGerstnerWave(float x, float z, float time) {
-    glm::vec3 result(x, 0.0f, z);
-    glm::vec3 normal(0.0f, 1.0f, 0.0f);
+WaterSurface::WaveSample WaterSurface::sampleWaves(float x, float z, float time) const {
+    // Displacement P(x, z) and its analytic partial derivatives dP/dx and dP/dz
+    glm::vec3 position(x, 0.0f, z);
+    glm::vec3 dPdx(1.0f, 0.0f, 0.0f);
+    glm::vec3 dPdz(0.0f, 0.0f, 1.0f);
     
-    // Optimize calculation by batching wave calculations
-    // Pre-calculate wave phase and amplitude for each wave once
-    const int maxWaves = waves.size();
-    if (maxWaves > 0) {
-        // Use stack memory for faster access
-        const int MAX_WAVES = 16; // Reasonable limit for most use cases
-        float phases[MAX_WAVES];
-        float sinValues[MAX_WAVES];
-        float cosValues[MAX_WAVES];
-        glm::vec2 directions[MAX_WAVES];
-        float amplitudes[MAX_WAVES];
-        float steepnesses[MAX_WAVES];
-        float waveNumbers[MAX_WAVES];
+    const int MAX_WAVES = 16; // Reasonable limit for most use cases
+    int waveCount = std::min(static_cast<int>(waves.size()), MAX_WAVES);
+    for (int i = 0; i < waveCount; i++) {
+        const auto& wave = waves[i];
         
-        int activeWaves = 0;
-        
-        // Pre-compute values for each wave to avoid redundant calculations
-        for (int i = 0; i < std::min(maxWaves, MAX_WAVES); i++) {
-            const auto& wave = waves[i];
-            
-            // Skip waves with zero amplitude
-            if (std::abs(wave.amplitude) < 0.001f) {
-                continue;
-            }
-            
-            // Wave parameters
-            directions[activeWaves] = glm::normalize(wave.direction);
-            amplitudes[activeWaves] = wave.amplitude;
-            steepnesses[activeWaves] = wave.steepness;
-            
-            // Calculate wave number and phase constant
-            float k = 2.0f * glm::pi<float>() / wave.wavelength;
-            waveNumbers[activeWaves] = k;
-            
-            float w = sqrt(9.8f * k);  // Angular frequency
-            
-            // Compute phase
-            float dotProduct = directions[activeWaves].x * x + directions[activeWaves].y * z;
-            phases[activeWaves] = k * dotProduct - wave.speed * w * time;
-            
-            // Precalculate trig functions (expensive operations)
-            sinValues[activeWaves] = sin(phases[activeWaves]);
-            cosValues[activeWaves] = cos(phases[activeWaves]);
-            
-            activeWaves++;
+        // Skip waves with zero amplitude
+        if (std::abs(wave.amplitude) < 0.001f) {
+            continue;
         }
         
-        // Apply all waves at once using the pre-calculated values
-        for (int i = 0; i < activeWaves; i++) {
-            float A = amplitudes[i];
-            float S = steepnesses[i];
-            float k = waveNumbers[i];
-            float sinPhase = sinValues[i];
-            float cosPhase = cosValues[i];
-            glm::vec2 D = directions[i];
-            
-            // Modified Gerstner wave formula for better horizontal/vertical balance
-            float horizontalScale = S * 2.0f; // Amplify horizontal motion
-            result.x += D.x * A * horizontalScale * cosPhase;
-            result.y += A * sinPhase;
-            result.z += D.y * A * horizontalScale * cosPhase;
-            
-            // Update normal (consistent with modified displacement)
-            normal.x -= D.x * k * A * horizontalScale * cosPhase;
-            normal.y -= S * k * A * sinPhase;
-            normal.z -= D.y * k * A * horizontalScale * cosPhase;
-        }
+        glm::vec2 D = glm::normalize(wave.direction);
+        float A = wave.amplitude;
+        float k = 2.0f * glm::pi<float>() / wave.wavelength;
+        float w = sqrt(9.8f * k);  // Angular frequency
+        float phase = k * (D.x * x + D.y * z) - wave.speed * w * time;
+        
+        // One sin/cos pair per wave serves the position and both derivatives
+        float sinPhase = sin(phase);
+        float cosPhase = cos(phase);
+        
+        // Modified Gerstner wave formula for better horizontal/vertical balance
+        float horizontalScale = wave.steepness * 2.0f; // Amplify horizontal motion
+        position.x += D.x * A * horizontalScale * cosPhase;
+        position.y += A * sinPhase;
+        position.z += D.y * A * horizontalScale * cosPhase;
+        
+        // d(phase)/dx = k D.x, d(phase)/dz = k D.y
+        float horizontalSlope = A * horizontalScale * k * sinPhase;
+        float verticalSlope = A * k * cosPhase;
+        dPdx -= glm::vec3(D.x * D.x * horizontalSlope, -D.x * verticalSlope, D.x * D.y * horizontalSlope);
+        dPdz -= glm::vec3(D.x * D.y * horizontalSlope, -D.y * verticalSlope, D.y * D.y * horizontalSlope);
     }
     
     // Add ripples
-    result.y += rippleHeight(x, z, time);
+    glm::vec2 rippleGradient(0.0f);
+    position.y += rippleHeight(x, z, rippleGradient);
+    dPdx.y += rippleGradient.x;
+    dPdz.y += rippleGradient.y;
+    
+    WaveSample sample;
+    sample.position = position;
+    sample.normal = glm::normalize(glm::cross(dPdz, dPdx));
+    sample.tangent = glm::normalize(dPdx);
+    return sample;
+}
+
+void WaterSurface::buildRippleBins() {
+    rippleField.terms.resize(ripples.count);
+    for (int i = 0; i < ripples.count; i++) {
+        RippleTerm& term = rippleField.terms[i];
+        term.center = glm::vec2(ripples.centerX[i], ripples.centerZ[i]);
+        term.amplitude = ripples.amplitude[i] * exp(-ripples.decay[i] * ripples.time[i]);
+        term.radius = ripples.radius[i];
+        term.frequency = glm::pi<float>() / ripples.radius[i];
+        term.travelled = ripples.speed[i] * ripples.time[i];
+        term.direction = glm::vec2(ripples.directionX[i], ripples.directionZ[i]);
+        term.isDirectional = ripples.directional[i] != 0;
+    }
     
-    // Store normalized normal
-    normal = glm::normalize(normal);
+    float halfSize = size / 2.0f;
+    float binSize = size / RIPPLE_BINS;
     
-    return result;
+    // Calls visit(bin) for every bin the ripple's wave front can reach
+    auto forEachBin = [&](const RippleTerm& term, auto&& visit) {
+        glm::vec2 boundsMin, boundsMax;
+        if (term.isDirectional) {
+            // Front between travelled and travelled + radius ahead, radius / 2 to each side
+            glm::vec2 side = 0.5f * term.radius * glm::vec2(term.direction.y, -term.direction.x);
+            glm::vec2 nearCenter = term.center + term.travelled * term.direction;
+            glm::vec2 farCenter = nearCenter + term.radius * term.direction;
+            boundsMin = glm::min(glm::min(nearCenter - side, nearCenter + side), glm::min(farCenter - side, farCenter + side));
+            boundsMax = glm::max(glm::max(nearCenter - side, nearCenter + side), glm::max(farCenter - side, farCenter + side));
+        } else {
+            float outer = term.travelled + term.radius;
+            boundsMin = term.center - glm::vec2(outer);
+            boundsMax = term.center + glm::vec2(outer);
+        }
+        if (boundsMax.x < -halfSize || boundsMax.y < -halfSize || boundsMin.x > halfSize || boundsMin.y > halfSize) {
+            return;
+        }
+        
+        glm::ivec2 first = glm::clamp(glm::ivec2(glm::floor((boundsMin + halfSize) / binSize)), 0, RIPPLE_BINS - 1);
+        glm::ivec2 last = glm::clamp(glm::ivec2(glm::floor((boundsMax + halfSize) / binSize)), 0, RIPPLE_BINS - 1);
+        for (int bz = first.y; bz <= last.y; bz++) {
+            for (int bx = first.x; bx <= last.x; bx++) {
+                // Bins wholly inside the ring's hole (every corner closer than the front) are skipped
+                if (!term.isDirectional) {
+                    glm::vec2 binMin = glm::vec2(bx, bz) * binSize - halfSize;
+                    glm::vec2 farthest = glm::max(glm::abs(binMin - term.center), glm::abs(binMin + binSize - term.center));
+                    if (glm::length(farthest) < term.travelled) continue;
+                }
+                visit(bz * RIPPLE_BINS + bx);
+            }
+        }
+    };
+    
+    rippleField.binStart.assign(RIPPLE_BINS * RIPPLE_BINS + 1, 0);
+    for (const auto& term : rippleField.terms) {
+        forEachBin(term, [&](int bin) { rippleField.binStart[bin + 1]++; });
+    }
+    for (int bin = 0; bin < RIPPLE_BINS * RIPPLE_BINS; bin++) {
+        rippleField.binStart[bin + 1] += rippleField.binStart[bin];
+    }
+    
+    rippleField.binEntries.resize(rippleField.binStart.back());
+    rippleBinFill.assign(rippleField.binStart.begin(), rippleField.binStart.end() - 1);
+    for (int i = 0; i < static_cast<int>(rippleField.terms.size()); i++) {
+        forEachBin(rippleField.terms[i], [&](int bin) { rippleField.binEntries[rippleBinFill[bin]++] = i; });
+    }
 }
 
-float WaterSurface::rippleHeight(float x, float z, float time) {
+float WaterSurface::rippleHeight(const RippleField& field, float x, float z, glm::vec2& gradient) const {
     float height = 0.0f;
+    gradient = glm::vec2(0.0f);
+    if (field.terms.empty()) return height;
     
-    for (auto& ripple : ripples) {
+    auto addRipple = [&](const RippleTerm& ripple) {
         float dx = x - ripple.center.x;
         float dz = z - ripple.center.y;
+        float amplitude = ripple.amplitude;
+        float frequency = ripple.frequency;
         
         if (ripple.isDirectional) {
             // Directional wave propagation
             float distanceInDirection = dx * ripple.direction.x + dz * ripple.direction.y;
-            float perpendicularDistance = abs(dx * ripple.direction.y - dz * ripple.direction.x);
+            float perpendicular = dx * ripple.direction.y - dz * ripple.direction.x;
+            float perpendicularDistance = abs(perpendicular);
             
             // Wave front position
-            float waveDistance = distanceInDirection - ripple.speed * ripple.time;
+            float waveDistance = distanceInDirection - ripple.travelled;
             
             // Apply wave only in forward direction and within perpendicular bounds
             if (waveDistance >= 0 && waveDistance <= ripple.radius && perpendicularDistance < ripple.radius * 0.5f) {
-                float factor = sin(waveDistance * (glm::pi<float>() / ripple.radius));
+                float factor = sin(waveDistance * frequency);
                 float perpFactor = exp(-perpendicularDistance * 2.0f / ripple.radius); // Falloff perpendicular to direction
-                float amplitude = ripple.amplitude * exp(-ripple.decay * ripple.time);
                 height += factor * amplitude * perpFactor;
+                
+                float side = perpendicular < 0.0f ? -1.0f : 1.0f;
+                glm::vec2 perpendicularGradient = side * glm::vec2(ripple.direction.y, -ripple.direction.x);
+                gradient += amplitude * perpFactor * (frequency * std::cos(waveDistance * frequency) * ripple.direction -
+                                                      factor * 2.0f / ripple.radius * perpendicularGradient);
             }
         } else {
             // Radial wave propagation (original behavior)
             float distance = sqrt(dx*dx + dz*dz);
-            float waveDistance = distance - ripple.speed * ripple.time;
+            float waveDistance = distance - ripple.travelled;
             if (waveDistance >= 0 && waveDistance <= ripple.radius) {
-                float factor = sin(waveDistance * (glm::pi<float>() / ripple.radius));
-                float amplitude = ripple.amplitude * exp(-ripple.decay * ripple.time);
+                float factor = sin(waveDistance * frequency);
                 height += factor * amplitude;
+                if (distance > 0.0f) {
+                    gradient += amplitude * frequency * std::cos(waveDistance * frequency) * glm::vec2(dx, dz) / distance;
+                }
             }
         }
+    };
+    
+    // Points off the binned surface see every ripple
+    float halfSize = size / 2.0f;
+    if (x < -halfSize || x > halfSize || z < -halfSize || z > halfSize) {
+        for (const auto& ripple : field.terms) {
+            addRipple(ripple);
+        }
+        return height;
+    }
+    
+    float binSize = size / RIPPLE_BINS;
+    int bx = std::min(static_cast<int>((x + halfSize) / binSize), RIPPLE_BINS - 1);
+    int bz = std::min(static_cast<int>((z + halfSize) / binSize), RIPPLE_BINS - 1);
+    int bin = bz * RIPPLE_BINS + bx;
+    for (int i = field.binStart[bin]; i < field.binStart[bin + 1]; i++) {
+        addRipple(field.terms[field.binEntries[i]]);
     }
     
     return height;
 }
 
+void WaterSurface::buildWaveSoA(float time, WaveKernel::WaveSoA& soa) const {
+    // Same waves and per-wave terms as sampleWaves
+    soa.clear();
+    int waveCount = std::min(static_cast<int>(waves.size()), MAX_GPU_WAVES);
+    for (int i = 0; i < waveCount; i++) {
+        const auto& wave = waves[i];
+        if (std::abs(wave.amplitude) < 0.001f) {
+            continue;
+        }
+        
+        glm::vec2 D = glm::normalize(wave.direction);
+        float k = 2.0f * glm::pi<float>() / wave.wavelength;
+        float w = sqrt(9.8f * k);
+        soa.add(D.x, D.y, k, wave.amplitude, wave.amplitude * wave.steepness * 2.0f, wave.speed * w * time);
+    }
+}
+
+float WaterSurface::validateWaveKernel(float time) const {
+    WaveKernel::WaveSoA soa;
+    buildWaveSoA(time, soa);
+    float halfSize = size / 2.0f;
+    float step = size / (float)(resolution - 1);
+    
+    std::vector<float> batched(resolution * 6);
+    std::vector<float> reference(resolution * 6);
+    float maxDeviation = 0.0f;
+    for (int z = 0; z < resolution; z++) {
+        float zPos = -halfSize + z * step;
+        WaveKernel::evaluateRow(soa, -halfSize, step, zPos, resolution, nullptr, batched.data(), 6);
+        WaveKernel::evaluateRowReference(soa, -halfSize, step, zPos, resolution, nullptr, reference.data(), 6);
+        for (size_t i = 0; i < batched.size(); i++) {
+            maxDeviation = std::max(maxDeviation, std::abs(batched[i] - reference[i]));
+        }
+    }
+    return maxDeviation;
+}
+
 void WaterSurface::update(float deltaTime) {
     // Accumulate time for wave animation
     g_totalTime += deltaTime;
@@ -251,147 +887,408 @@ void WaterSurface::update(float deltaTime) {
     // Update flow impulses and dampen flow velocity
     flowVelocity *= 0.98f; // Gradual damping
     
-    for (auto it = flowImpulses.begin(); it != flowImpulses.end();) {
-        it->time += deltaTime;
-        it->strength = std::max(0.0f, 1.0f - it->time * 2.0f); // Decay over 0.5 seconds
+    for (int i = 0; i < flowImpulses.count;) {
+        flowImpulses.time[i] += deltaTime;
+        flowImpulses.strength[i] = std::max(0.0f, 1.0f - flowImpulses.time[i] * 2.0f); // Decay over 0.5 seconds
         
-        if (it->strength <= 0.0f) {
-            it = flowImpulses.erase(it);
+        if (flowImpulses.strength[i] <= 0.0f) {
+            flowImpulses.remove(i); // The last impulse moved into slot i is visited next
         } else {
-            ++it;
+            ++i;
         }
     }
     
     // Update ripples
-    for (auto it = ripples.begin(); it != ripples.end();) {
-        it->time += deltaTime;
+    for (int i = 0; i < ripples.count;) {
+        ripples.time[i] += deltaTime;
         
         // Remove ripples that have decayed too much
-        if (it->time > 5.0f) {
-            it = ripples.erase(it);
+        if (ripples.time[i] > 5.0f) {
+            ripples.remove(i);
         } else {
-            ++it;
+            ++i;
+        }
+    }
+    
+    buildRippleBins();
+    
+    if (heightfieldWaves) {
+        heightfield->update(deltaTime);
+    }
+    
+    // The field swaps textures every step, so the foam is handed the newest
+    if (flowMapEnabled) {
+        flowMap->setBaseVelocity(flowVelocity);
+        flowMap->update(deltaTime);
+        if (foam) {
+            foam->setFlowMap(flowMap->getVelocityTexture(), size);
         }
     }
     
     // Update foam particles
     updateFoam(deltaTime);
     
-    // Update vertex positions and normals based on Gerstner waves
-    std::vector<float> updatedVertices = vertices;
-    float halfSize = size / 2.0f;
-    float step = size / (float)(resolution - 1);
     float time = g_totalTime; // Use our accumulated time instead of glfwGetTime()
+    updateWaveBlock(time);
+    
+    // FFT ocean: the transforms run on the GPU and water.vs samples their textures
+    if (oceanWaves) {
+        ocean->update(time);
+        return;
+    }
+    
+    // GPU waves: the vertex shader evaluates the same waves, nothing else to upload
+    if (gpuWaves) {
+        return;
+    }
+    
+    // Pipelined: publish the slot the worker wrote during the last frame, then hand it the next
+    if (asyncUpdate) {
+        finishSurfaceJob();
+        buildWaveSoA(time, surfaceJob.waves);
+        const auto& drawn = tileDisplaced[vertexSlot];
+        if (surfaceJob.waves.size() == 0 && rippleField.terms.empty() &&
+            std::find(drawn.begin(), drawn.end(), 1) == drawn.end()) {
+            lastUpdatedTiles = 0;
+            return;
+        }
+        
+        int slot = (vertexSlot + 1) % VERTEX_RING_SLOTS;
+        float* slotVertices = waitForVertexSlot(slot);
+        if (!slotVertices) {
+            return;
+        }
+        surfaceJob.ripples = rippleField;
+        surfaceJob.vertices = slotVertices;
+        surfaceJob.slot = slot;
+        {
+            std::lock_guard<std::mutex> lock(surfaceMutex);
+            surfaceJobQueued = true;
+        }
+        surfaceWake.notify_one();
+        return;
+    }
+    
+    // Calm and already flat in the slot being drawn: nothing to write
+    buildWaveSoA(time, waveSoA);
+    const auto& drawn = tileDisplaced[vertexSlot];
+    if (waveSoA.size() == 0 && rippleField.terms.empty() && std::find(drawn.begin(), drawn.end(), 1) == drawn.end()) {
+        lastUpdatedTiles = 0;
+        return;
+    }
+    
+    // Straight into the next slot of the vertex ring
+    float* slotVertices = acquireVertexSlot();
+    if (!slotVertices) {
+        return;
+    }
+    lastUpdatedTiles = writeSurface(slotVertices, vertexSlot, waveSoA, rippleField);
+}
 
-    // Use parallel processing if available (OpenMP)
-    #pragma omp parallel for collapse(2) if(resolution > 50)
-    for (int z = 0; z < resolution; z++) {
-        for (int x = 0; x < resolution; x++) {
-            int vertexIndex = (z * resolution + x) * 8;
-            
-            float xPos = -halfSize + x * step;
-            float zPos = -halfSize + z * step;
-            
-            // Calculate new position with Gerstner waves - this is the performance-critical part
-            glm::vec3 newPos = calculateGerstnerWave(xPos, zPos, time);
-            
-            // Update position
-            updatedVertices[vertexIndex] = newPos.x;
-            updatedVertices[vertexIndex + 1] = newPos.y;
-            updatedVertices[vertexIndex + 2] = newPos.z;
+int WaterSurface::writeSurface(float* slotVertices, int slot, const WaveKernel::WaveSoA& soa, const RippleField& field) {
+    // Update vertex positions and normals based on Gerstner waves, a row at a time
+    bool calm = soa.size() == 0;
+    bool hasRipples = !field.terms.empty();
+    auto& displaced = tileDisplaced[slot];
+    const int tileCount = RIPPLE_BINS * RIPPLE_BINS;
+    std::atomic<int> updatedTiles{0};
+    rowArena.reset();
+
+    // Row bands or tiles spread over the shared job pool; small grids stay on this thread.
+    // The bands are weighted to each worker's core and stay with it frame to frame.
+    WaterSim::JobSystem& jobs = WaterSim::JobSystem::instance();
+    const RippleField* rowField = hasRipples ? &field : nullptr;
+    if (!calm) {
+        jobs.parallelForPartitioned(0, resolution, resolution > 50 ? 8 : resolution, [&](int firstRow, int lastRow) {
+            // Ripples stay scalar; their heights and gradients join the batched waves per row
+            float* rippleData = hasRipples ? rowArena.allocate<float>(3 * resolution) : nullptr;
             
-            // Calculate normal by using cross product of adjacent vertices
-            // Optimize: Calculate normals using finite differences
-            // This avoids redundant wave calculations for neighboring vertices
-            glm::vec3 dx, dz;
+            // The compact grid is packed from a full-precision row
+            float* rowData = compactMesh ? rowArena.allocate<float>(6 * resolution) : nullptr;
             
-            // Use central differences when possible for better accuracy
-            if (x > 0 && x < resolution - 1) {
-                float prevX = -halfSize + (x - 1) * step;
-                float nextX = -halfSize + (x + 1) * step;
-                glm::vec3 prevPos = calculateGerstnerWave(prevX, zPos, time);
-                glm::vec3 nextPos = calculateGerstnerWave(nextX, zPos, time);
-                dx = (nextPos - prevPos) * 0.5f; // Central difference
-            } else if (x < resolution - 1) {
-                float nextX = -halfSize + (x + 1) * step;
-                glm::vec3 nextPos = calculateGerstnerWave(nextX, zPos, time);
-                dx = nextPos - newPos;
-            } else {
-                float prevX = -halfSize + (x - 1) * step;
-                glm::vec3 prevPos = calculateGerstnerWave(prevX, zPos, time);
-                dx = newPos - prevPos;
+            for (int z = firstRow; z < lastRow; z++) {
+                writeVertexRow(slotVertices, z, 0, resolution, soa, rowField, rippleData, rowData);
             }
+        });
+    } else {
+        // Only ripples: tiles they reach, and tiles this slot still holds displaced
+        jobs.parallelFor(0, tileCount, resolution > 50 ? 4 : tileCount, [&](int firstTile, int lastTile) {
+            float* rippleData = rowArena.allocate<float>(3 * resolution);
+            float* rowData = compactMesh ? rowArena.allocate<float>(6 * resolution) : nullptr;
+            int written = 0;
             
-            if (z > 0 && z < resolution - 1) {
-                float prevZ = -halfSize + (z - 1) * step;
-                float nextZ = -halfSize + (z + 1) * step;
-                glm::vec3 prevPos = calculateGerstnerWave(xPos, prevZ, time);
-                glm::vec3 nextPos = calculateGerstnerWave(xPos, nextZ, time);
-                dz = (nextPos - prevPos) * 0.5f; // Central difference
-            } else if (z < resolution - 1) {
-                float nextZ = -halfSize + (z + 1) * step;
-                glm::vec3 nextPos = calculateGerstnerWave(xPos, nextZ, time);
-                dz = nextPos - newPos;
-            } else {
-                float prevZ = -halfSize + (z - 1) * step;
-                glm::vec3 prevPos = calculateGerstnerWave(xPos, prevZ, time);
-                dz = newPos - prevPos;
+            for (int tile = firstTile; tile < lastTile; tile++) {
+                bool active = field.binStart[tile + 1] > field.binStart[tile];
+                if (!active && !displaced[tile]) continue;
+                
+                int first = tileVertexStart[tile % RIPPLE_BINS];
+                int last = tileVertexStart[tile % RIPPLE_BINS + 1];
+                for (int z = tileVertexStart[tile / RIPPLE_BINS]; z < tileVertexStart[tile / RIPPLE_BINS + 1]; z++) {
+                    if (active) {
+                        writeVertexRow(slotVertices, z, first, last, soa, &field, rippleData, rowData);
+                    } else {
+                        size_t offset = (static_cast<size_t>(z) * resolution + first) * vertexFloats;
+                        std::copy(vertices.begin() + offset, vertices.begin() + offset + (last - first) * vertexFloats,
+                                  slotVertices + offset);
+                    }
+                }
+                displaced[tile] = active ? 1 : 0;
+                written++;
             }
-            
-            glm::vec3 normal = glm::normalize(glm::cross(dz, dx));
-            
-            // Update normal
-            updatedVertices[vertexIndex + 3] = normal.x;
-            updatedVertices[vertexIndex + 4] = normal.y;
-            updatedVertices[vertexIndex + 5] = normal.z;
+            updatedTiles += written;
+        });
+    }
+    
+    if (!calm) {
+        std::fill(displaced.begin(), displaced.end(), 1);
+        updatedTiles = tileCount;
+    }
+    return updatedTiles.load();
+}
+
+void WaterSurface::setAsyncUpdate(bool enable) {
+    if (enable == asyncUpdate) return;
+    asyncUpdate = enable;
+    
+    if (asyncUpdate) {
+        stopSurfaceWorker = false;
+        surfaceWorker = std::thread(&WaterSurface::surfaceWorkerLoop, this);
+    } else {
+        finishSurfaceJob();
+        {
+            std::lock_guard<std::mutex> lock(surfaceMutex);
+            stopSurfaceWorker = true;
+        }
+        surfaceWake.notify_one();
+        if (surfaceWorker.joinable()) surfaceWorker.join();
+    }
+}
+
+void WaterSurface::surfaceWorkerLoop() {
+    std::unique_lock<std::mutex> lock(surfaceMutex);
+    while (true) {
+        surfaceWake.wait(lock, [this] { return surfaceJobQueued || stopSurfaceWorker; });
+        if (stopSurfaceWorker) break;
+        
+        // Mapped memory only: the render thread keeps every GL call
+        lock.unlock();
+        surfaceJob.updatedTiles = writeSurface(surfaceJob.vertices, surfaceJob.slot, surfaceJob.waves, surfaceJob.ripples);
+        lock.lock();
+        
+        surfaceJobQueued = false;
+        surfaceJobDone = true;
+        surfaceWake.notify_all();
+    }
+}
+
+void WaterSurface::finishSurfaceJob() {
+    std::unique_lock<std::mutex> lock(surfaceMutex);
+    surfaceWake.wait(lock, [this] { return !surfaceJobQueued; });
+    if (surfaceJobDone) {
+        vertexSlot = surfaceJob.slot;
+        lastUpdatedTiles = surfaceJob.updatedTiles;
+        surfaceJobDone = false;
+    }
+}
+
+void WaterSurface::writeVertexRow(float* slotVertices, int z, int first, int last, const WaveKernel::WaveSoA& soa,
+                                  const RippleField* field, float* rippleData, float* rowData) const {
+    float halfSize = size / 2.0f;
+    float step = size / (float)(resolution - 1);
+    float zPos = -halfSize + z * step;
+    float x0 = -halfSize + first * step;
+    int count = last - first;
+    
+    WaveKernel::RippleRow rippleRow = {};
+    if (field) {
+        for (int x = 0; x < count; x++) {
+            glm::vec2 gradient;
+            rippleData[x] = rippleHeight(*field, -halfSize + (first + x) * step, zPos, gradient);
+            rippleData[resolution + x] = gradient.x;
+            rippleData[2 * resolution + x] = gradient.y;
         }
+        rippleRow = { rippleData, rippleData + resolution, rippleData + 2 * resolution };
     }
     
-    // Update VBO with new vertex data - use GL_DYNAMIC_DRAW for better performance
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, updatedVertices.size() * sizeof(float), updatedVertices.data());
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    // Positions and normals straight into the interleaved vertices of the row
+    float* rowVertices = slotVertices + (static_cast<size_t>(z) * resolution + first) * vertexFloats;
+    if (compactMesh) {
+        WaveKernel::evaluateRow(soa, x0, step, zPos, count, field ? &rippleRow : nullptr, rowData, 6);
+        for (int x = 0; x < count; x++) {
+            packVertex(&rowData[x * 6], &rowData[x * 6 + 3], rowVertices + x * 4);
+        }
+    } else {
+        WaveKernel::evaluateRow(soa, x0, step, zPos, count, field ? &rippleRow : nullptr, rowVertices, 8);
+    }
 }
 
-void WaterSurface::render(unsigned int shaderProgram) {
+WaterSurfaceGeometry WaterSurface::getGeometry() const {
+    WaterSurfaceGeometry geometry;
+    geometry.vao = VAO;
+    geometry.indexCount = getVertexCount();
+    geometry.baseVertex = getBaseVertex();
+    geometry.primitive = getPrimitiveMode();
+    geometry.indexType = indexType;
+    geometry.packedVertices = compactMesh;
+    geometry.size = size;
+    geometry.flatGrid = gpuWaves && !oceanWaves;
+    if (oceanWaves) {
+        geometry.oceanDisplacement = ocean->getDisplacementTexture();
+        geometry.oceanNormalFoam = ocean->getNormalFoamTexture();
+        geometry.oceanPatchSize = ocean->getPatchSize();
+    }
+    if (heightfieldWaves) {
+        geometry.heightfield = heightfield->getRenderHeightTexture();
+    }
+    return geometry;
+}
+
+void WaterSurface::bindDisplacement(unsigned int shaderProgram) const {
     // Set flow uniforms
     glUniform2fv(glGetUniformLocation(shaderProgram, "flowVelocity"), 1, glm::value_ptr(flowVelocity));
-    glUniform1f(glGetUniformLocation(shaderProgram, "flowOffset"), flowOffset);
+    glUniform1f(glGetUniformLocation(shaderProgram, "flowOffset"), flowOffset - renderLag);
+    glUniform1i(glGetUniformLocation(shaderProgram, "gpuWaves"), gpuWaves ? 1 : 0);
+    glUniform1i(glGetUniformLocation(shaderProgram, "oceanWaves"), oceanWaves ? 1 : 0);
+    bindWaveParameters();
+    
+    // Ocean textures after the units main.cpp binds for the water shader (0-5)
+    if (oceanWaves) {
+        glActiveTexture(GL_TEXTURE6);
+        glBindTexture(GL_TEXTURE_2D, ocean->getDisplacementTexture());
+        glUniform1i(glGetUniformLocation(shaderProgram, "oceanDisplacement"), 6);
+        glActiveTexture(GL_TEXTURE7);
+        glBindTexture(GL_TEXTURE_2D, ocean->getNormalFoamTexture());
+        glUniform1i(glGetUniformLocation(shaderProgram, "oceanNormalFoam"), 7);
+        glActiveTexture(GL_TEXTURE0);
+        glUniform1f(glGetUniformLocation(shaderProgram, "oceanPatchSize"), ocean->getPatchSize());
+    }
+    
+    glUniform1i(glGetUniformLocation(shaderProgram, "heightfieldWaves"), heightfieldWaves ? 1 : 0);
+    if (heightfieldWaves) {
+        glActiveTexture(GL_TEXTURE8);
+        glBindTexture(GL_TEXTURE_2D, heightfield->getRenderHeightTexture());
+        glUniform1i(glGetUniformLocation(shaderProgram, "heightfield"), 8);
+        glActiveTexture(GL_TEXTURE0);
+        glUniform1f(glGetUniformLocation(shaderProgram, "heightfieldSize"), size);
+    }
+    
+    // Past the environment (9) and caustic map (10) units of the water shaders
+    glUniform1i(glGetUniformLocation(shaderProgram, "flowMapEnabled"), flowMapEnabled ? 1 : 0);
+    if (flowMapEnabled) {
+        glActiveTexture(GL_TEXTURE11);
+        glBindTexture(GL_TEXTURE_2D, flowMap->getVelocityTexture());
+        glUniform1i(glGetUniformLocation(shaderProgram, "flowMap"), 11);
+        glActiveTexture(GL_TEXTURE0);
+        glUniform1f(glGetUniformLocation(shaderProgram, "flowMapSize"), size);
+    }
+}
+
+void WaterSurface::render(unsigned int shaderProgram) {
+    bindDisplacement(shaderProgram);
+    
+    // Tessellation: the TCS splits each patch edge to the target length on screen
+    if (isTessellationActive()) {
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        glm::vec2 horizontalBound;
+        float heightBound;
+        displacementBounds(horizontalBound, heightBound);
+        
+        // Steeper Gerstner waves get finer edges; the ocean has no single steepness
+        float steepness = 1.0f;
+        if (!oceanWaves) {
+            steepness = 0.0f;
+            int waveCount = std::min(static_cast<int>(waves.size()), MAX_GPU_WAVES);
+            for (int i = 0; i < waveCount; i++) {
+                steepness += std::abs(waves[i].amplitude) * 2.0f * glm::pi<float>() / waves[i].wavelength;
+            }
+        }
+        float detailScale = glm::mix(0.5f, 1.5f, std::min(steepness, 1.0f));
+        
+        GLint maxLevel;
+        glGetIntegerv(GL_MAX_TESS_GEN_LEVEL, &maxLevel);
+        glUniform1i(glGetUniformLocation(shaderProgram, "lodMesh"), 0);
+        glUniform1i(glGetUniformLocation(shaderProgram, "packedVertices"), 0);
+        glUniform1f(glGetUniformLocation(shaderProgram, "surfaceSize"), size);
+        glUniform2f(glGetUniformLocation(shaderProgram, "viewportSize"), (float)viewport[2], (float)viewport[3]);
+        glUniform1f(glGetUniformLocation(shaderProgram, "tessEdgePixels"), tessEdgePixels);
+        glUniform1f(glGetUniformLocation(shaderProgram, "tessMaxLevel"), (float)std::min(maxLevel, 64));
+        glUniform1f(glGetUniformLocation(shaderProgram, "tessDetailScale"), detailScale);
+        glUniform3f(glGetUniformLocation(shaderProgram, "tessBounds"), horizontalBound.x, heightBound, horizontalBound.y);
+        
+        glPatchParameteri(GL_PATCH_VERTICES, 4);
+        glBindVertexArray(tessVAO);
+        glDrawElements(GL_PATCHES, tessIndexCount, GL_UNSIGNED_INT, 0);
+        glBindVertexArray(0);
+        return;
+    }
+    
+    // LOD mesh: the patches this camera needs, one instance each
+    bool lodActive = isLODMeshActive() && lodCameraValid;
+    glUniform1i(glGetUniformLocation(shaderProgram, "lodMesh"), lodActive ? 1 : 0);
+    glUniform1i(glGetUniformLocation(shaderProgram, "packedVertices"), (compactMesh && !lodActive) ? 1 : 0);
+    glUniform1f(glGetUniformLocation(shaderProgram, "surfaceSize"), size);
+    if (lodActive) {
+        selectLODPatches();
+        glUniform3fv(glGetUniformLocation(shaderProgram, "lodCamera"), 1, glm::value_ptr(lodCamera));
+        glUniform1f(glGetUniformLocation(shaderProgram, "lodFinestRange"), lodFinestRange);
+        glUniform1f(glGetUniformLocation(shaderProgram, "lodPatchResolution"), (float)LOD_PATCH_RESOLUTION);
+        
+        // The instance buffer is immutable: reallocated, at twice the need, only to grow
+        if (lodPatches.size() > lodInstanceCapacity) {
+            if (lodInstanceVBO) glDeleteBuffers(1, &lodInstanceVBO);
+            lodInstanceCapacity = std::max<size_t>(lodPatches.size() * 2, 64);
+            glCreateBuffers(1, &lodInstanceVBO);
+            glNamedBufferStorage(lodInstanceVBO, lodInstanceCapacity * sizeof(glm::vec4), nullptr, GL_DYNAMIC_STORAGE_BIT);
+            glVertexArrayVertexBuffer(lodVAO, 1, lodInstanceVBO, 0, sizeof(glm::vec4));
+        }
+        if (!lodPatches.empty()) {
+            glNamedBufferSubData(lodInstanceVBO, 0, lodPatches.size() * sizeof(glm::vec4), lodPatches.data());
+        }
+        
+        glBindVertexArray(lodVAO);
+        glDrawElementsInstanced(GL_TRIANGLES, lodIndexCount, GL_UNSIGNED_INT, 0, static_cast<GLsizei>(lodPatches.size()));
+        glBindVertexArray(0);
+        return;
+    }
     
     glBindVertexArray(VAO);
     
-    // Draw water surface
-    glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+    // Draw water surface from the newest slot of the vertex ring
+    if (compactMesh) {
+        glEnable(GL_PRIMITIVE_RESTART_FIXED_INDEX);
+    }
+    glDrawElementsBaseVertex(getPrimitiveMode(), indices.size(), indexType, 0, getBaseVertex());
+    glDisable(GL_PRIMITIVE_RESTART_FIXED_INDEX);
     
     glBindVertexArray(0);
+    
+    // Covers every draw from this slot so far, since commands complete in order
+    if (vertexFences[vertexSlot]) glDeleteSync(vertexFences[vertexSlot]);
+    vertexFences[vertexSlot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
 }
 
 void WaterSurface::addRipple(const glm::vec3& position, float magnitude) {
-    Ripple ripple;
-    ripple.center = glm::vec2(position.x, position.z);
-    ripple.amplitude = magnitude * 0.3f; // Slightly higher amplitude
-    ripple.radius = 2.5f; // Larger initial radius
-    ripple.speed = 2.0f; // Higher speed
-    ripple.decay = 1.5f; // Slower decay
-    ripple.time = 0.0f;
-    ripple.direction = glm::vec2(0.0f, 0.0f); // Radial wave
-    ripple.isDirectional = false;
+    // A poke the width of the analytic ring front
+    if (heightfieldWaves) {
+        heightfield->addStamp(glm::vec2(position.x, position.z), 0.5f, -magnitude * 0.3f);
+        return;
+    }
     
-    ripples.push_back(ripple);
+    // Slightly higher amplitude, larger initial radius, higher speed, slower decay; radial
+    addRippleToPool(glm::vec2(position.x, position.z), magnitude * 0.3f, 2.5f, 2.0f, 1.5f, glm::vec2(0.0f), false);
+    buildRippleBins();
 }
 
 void WaterSurface::addDirectionalRipple(const glm::vec3& position, const glm::vec2& direction, float magnitude) {
-    Ripple ripple;
-    ripple.center = glm::vec2(position.x, position.z);
-    ripple.amplitude = magnitude * 0.4f;
-    ripple.radius = 3.0f;
-    ripple.speed = 2.5f;
-    ripple.decay = 1.2f;
-    ripple.time = 0.0f;
-    ripple.direction = glm::normalize(direction);
-    ripple.isDirectional = true;
+    // A bow wave pushed ahead of the moving point
+    if (heightfieldWaves) {
+        heightfield->addStamp(glm::vec2(position.x, position.z), 0.6f, magnitude * 0.4f, direction);
+        return;
+    }
     
-    ripples.push_back(ripple);
+    addRippleToPool(glm::vec2(position.x, position.z), magnitude * 0.4f, 3.0f, 2.5f, 1.2f, glm::normalize(direction), true);
+    buildRippleBins();
 }
 
 void WaterSurface::createSplash(const glm::vec3& position, float magnitude) {
@@ -399,18 +1296,20 @@ void WaterSurface::createSplash(const glm::vec3& position, float magnitude) {
     // Scale magnitude to be more proportional to impact speed - much higher for gravity drops
     float scaledMagnitude = std::min(magnitude * 0.25f, 1.2f); // Much higher scaling and maximum
     
-    for (int i = 0; i < 3; i++) {
-        Ripple ripple;
-        ripple.center = glm::vec2(position.x, position.z);
-        ripple.amplitude = scaledMagnitude * (1.0f - 0.1f * i); // Less falloff for stronger waves
-        ripple.radius = 2.0f + i * 1.5f + scaledMagnitude * 0.8f; // Larger initial radius
-        ripple.speed = 2.5f + i * 0.4f + scaledMagnitude * 0.3f;  // Higher speed
-        ripple.decay = 1.8f - i * 0.1f;  // Slower decay for longer lasting waves
-        ripple.time = 0.0f;
-        ripple.direction = glm::vec2(0.0f, 0.0f); // Radial waves for splash
-        ripple.isDirectional = false;
-        
-        ripples.push_back(ripple);
+    // One crater the size of the splash; the wave equation spreads it into rings
+    if (heightfieldWaves) {
+        heightfield->addStamp(glm::vec2(position.x, position.z), 0.4f + scaledMagnitude * 0.3f, -scaledMagnitude * 0.5f);
+    } else {
+        for (int i = 0; i < 3; i++) {
+            float amplitude = scaledMagnitude * (1.0f - 0.1f * i); // Less falloff for stronger waves
+            float radius = 2.0f + i * 1.5f + scaledMagnitude * 0.8f; // Larger initial radius
+            float speed = 2.5f + i * 0.4f + scaledMagnitude * 0.3f;  // Higher speed
+            float decay = 1.8f - i * 0.1f;  // Slower decay for longer lasting waves
+            
+            // Radial waves for splash
+            addRippleToPool(glm::vec2(position.x, position.z), amplitude, radius, speed, decay, glm::vec2(0.0f), false);
+        }
+        buildRippleBins();
     }
     
     // Generate foam for splashes
@@ -421,124 +1320,64 @@ void WaterSurface::createSplash(const glm::vec3& position, float magnitude) {
 }
 
 void WaterSurface::addImpulse(const glm::vec3& position, const glm::vec2& impulse, float radius) {
-    FlowImpulse flowImpulse;
-    flowImpulse.position = glm::vec2(position.x, position.z);
-    flowImpulse.velocity = impulse;
-    flowImpulse.radius = radius;
-    flowImpulse.strength = 1.0f;
-    flowImpulse.time = 0.0f;
-    
-    flowImpulses.push_back(flowImpulse);
+    int slot = flowImpulses.add();
+    flowImpulses.positionX[slot] = position.x;
+    flowImpulses.positionZ[slot] = position.z;
+    flowImpulses.velocityX[slot] = impulse.x;
+    flowImpulses.velocityZ[slot] = impulse.y;
+    flowImpulses.radius[slot] = radius;
+    flowImpulses.strength[slot] = 1.0f;
+    flowImpulses.time[slot] = 0.0f;
+    if (flowMapEnabled) {
+        flowMap->addImpulse(glm::vec2(position.x, position.z), impulse, radius);
+    }
     
     // Also temporarily affect the global flow
     flowVelocity += impulse * 0.1f;
 }
 
+WaterSurface::State WaterSurface::getState() const {
+    State state;
+    state.time = g_totalTime;
+    state.flowOffset = flowOffset;
+    state.flowVelocity = flowVelocity;
+    state.flowImpulses = flowImpulses;
+    state.ripples = ripples;
+    return state;
+}
+
+void WaterSurface::setState(const State& state) {
+    g_totalTime = state.time;
+    flowOffset = state.flowOffset;
+    flowVelocity = state.flowVelocity;
+    flowImpulses = state.flowImpulses;
+    ripples = state.ripples;
+    if (flowMapEnabled) {
+        flowMap->setBaseVelocity(flowVelocity);
+        flowMap->clear();
+    }
+}
+
 void WaterSurface::generateFoam(const glm::vec3& position, float intensity, int count) {
-    std::mt19937 rng(std::chrono::steady_clock::now().time_since_epoch().count());
-    std::uniform_real_distribution<float> angleDist(0.0f, 2.0f * glm::pi<float>());
-    std::uniform_real_distribution<float> speedDist(0.5f, 2.0f);
-    std::uniform_real_distribution<float> sizeDist(0.02f, 0.08f);
-    std::uniform_real_distribution<float> lifeDist(1.0f, 3.0f);
-    
-    for (int i = 0; i < count; i++) {
-        FoamParticle foam;
-        
-        // Random position around the impact point
-        float angle = angleDist(rng);
-        float speed = speedDist(rng) * intensity;
-        
-        foam.position = position;
-        foam.position.x += cos(angle) * 0.1f;
-        foam.position.z += sin(angle) * 0.1f;
-        
-        // Random velocity with upward bias
-        foam.velocity.x = cos(angle) * speed;
-        foam.velocity.y = 0.5f + speedDist(rng) * 0.5f * intensity;
-        foam.velocity.z = sin(angle) * speed;
-        
-        // Random lifetime and size
-        foam.maxLifetime = lifeDist(rng);
-        foam.lifetime = foam.maxLifetime;
-        foam.size = sizeDist(rng) * (1.0f + intensity * 0.5f);
-        
-        foamParticles.push_back(foam);
+    if (foam) {
+        foam->emit(position, intensity, count);
     }
 }
 
 void WaterSurface::updateFoam(float deltaTime) {
-    // Update existing foam particles
-    for (auto it = foamParticles.begin(); it != foamParticles.end();) {
-        // Update lifetime
-        it->lifetime -= deltaTime;
-        
-        if (it->lifetime <= 0.0f) {
-            it = foamParticles.erase(it);
-            continue;
-        }
-        
-        // Apply physics
-        it->velocity.y -= 9.81f * deltaTime * 0.1f; // Light gravity
-        it->position += it->velocity * deltaTime;
-        
-        // Apply drag
-        it->velocity *= (1.0f - deltaTime * 2.0f);
-        
-        // Fade size based on lifetime
-        float lifetimeRatio = it->lifetime / it->maxLifetime;
-        it->size *= (0.95f + lifetimeRatio * 0.05f);
-        
-        ++it;
+    if (foam) {
+        foam->update(deltaTime);
     }
 }
 
-void WaterSurface::renderFoam(unsigned int foamShader, const glm::mat4& view, const glm::mat4& projection) {
-    if (foamParticles.empty()) return;
-    
-    // Initialize foam buffers if not already done
-    if (!foamBuffersInitialized) {
-        // Create a simple quad for billboarded particles
-        float quadVertices[] = {
-            -0.5f, -0.5f, 0.0f,
-             0.5f, -0.5f, 0.0f,
-             0.5f,  0.5f, 0.0f,
-            -0.5f,  0.5f, 0.0f
-        };
-        
-        glGenVertexArrays(1, &foamVAO);
-        glGenBuffers(1, &foamVBO);
-        
-        glBindVertexArray(foamVAO);
-        glBindBuffer(GL_ARRAY_BUFFER, foamVBO);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), quadVertices, GL_STATIC_DRAW);
-        
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-        glEnableVertexAttribArray(0);
-        
-        glBindVertexArray(0);
-        foamBuffersInitialized = true;
+void WaterSurface::setFoamWaveSurface(GLuint heightTexture, GLuint velocityTexture, float stateSize) {
+    if (foam) {
+        foam->setWaveSurface(heightTexture, velocityTexture, stateSize);
     }
-    
-    // Enable blending for foam
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    glDepthMask(GL_FALSE); // Don't write to depth buffer for transparent particles
-    
-    glUseProgram(foamShader);
-    glUniformMatrix4fv(glGetUniformLocation(foamShader, "view"), 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(glGetUniformLocation(foamShader, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
-    
-    glBindVertexArray(foamVAO);
-    
-    // Render each foam particle
-    for (const auto& foam : foamParticles) {
-        glUniform3fv(glGetUniformLocation(foamShader, "foamPosition"), 1, glm::value_ptr(foam.position));
-        glUniform1f(glGetUniformLocation(foamShader, "foamSize"), foam.size);
-        glUniform1f(glGetUniformLocation(foamShader, "foamLifetime"), foam.lifetime / foam.maxLifetime);
-        
-        glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+}
+
+void WaterSurface::renderFoam(unsigned int foamShader) {
+    if (foam) {
+        foam->render(foamShader);
     }
-    
-    glBindVertexArray(0);
-    glDepthMask(GL_TRUE);
-} 
\ No newline at end of file
+}
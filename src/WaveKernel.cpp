@@ -0,0 +1,366 @@
+#include "WaveKernel.h"
+#include <cmath>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define WAVE_KERNEL_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define WAVE_KERNEL_AVX2_TARGET
+#else
+#define WAVE_KERNEL_AVX2_TARGET __attribute__((target("avx2,fma")))
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define WAVE_KERNEL_NEON
+#include <arm_neon.h>
+#endif
+
+namespace WaveKernel {
+
+void WaveSoA::clear() {
+    dirX.clear();
+    dirZ.clear();
+    k.clear();
+    amplitude.clear();
+    horizontal.clear();
+    phaseOffset.clear();
+}
+
+void WaveSoA::add(float directionX, float directionZ, float waveNumber, float waveAmplitude,
+                  float horizontalAmplitude, float offset) {
+    dirX.push_back(directionX);
+    dirZ.push_back(directionZ);
+    k.push_back(waveNumber);
+    amplitude.push_back(waveAmplitude);
+    horizontal.push_back(horizontalAmplitude);
+    phaseOffset.push_back(offset);
+}
+
+namespace {
+
+// sin/cos approximation shared by the SIMD kernels: reduce to [-pi/4, pi/4] around the
+// nearest multiple of pi/2 (two-part constant), minimax polynomials there, then pick and
+// negate by quadrant. Absolute error is within a few float ulps for the phases we see.
+constexpr float TWO_OVER_PI = 0.636619772f;
+constexpr float PI_OVER_2_HI = 1.57079637f;
+constexpr float PI_OVER_2_LO = -4.37113883e-8f;
+constexpr float SIN_C1 = -1.66666546e-1f;
+constexpr float SIN_C2 = 8.33216087e-3f;
+constexpr float SIN_C3 = -1.95152959e-4f;
+constexpr float COS_C1 = 4.16666456e-2f;
+constexpr float COS_C2 = -1.38873163e-3f;
+constexpr float COS_C3 = 2.44331571e-5f;
+
+// Displacement and derivatives of one vertex, accumulated wave by wave
+struct PointState {
+    float px, py, pz;
+    float dxx, dxy, dxz;   // dP/dx
+    float dzx, dzy, dzz;   // dP/dz
+};
+
+void writeVertex(const PointState& p, float* out) {
+    // normal = cross(dP/dz, dP/dx), as WaterSurface::sampleWaves
+    float nx = p.dzy * p.dxz - p.dzz * p.dxy;
+    float ny = p.dzz * p.dxx - p.dzx * p.dxz;
+    float nz = p.dzx * p.dxy - p.dzy * p.dxx;
+    float invLength = 1.0f / std::sqrt(nx * nx + ny * ny + nz * nz);
+    out[0] = p.px;
+    out[1] = p.py;
+    out[2] = p.pz;
+    out[3] = nx * invLength;
+    out[4] = ny * invLength;
+    out[5] = nz * invLength;
+}
+
+void evaluatePointsReference(const WaveSoA& waves, float x0, float dx, float z, int first, int count,
+                             const RippleRow* ripples, float* out, int stride) {
+    const size_t waveCount = waves.size();
+    for (int i = first; i < count; i++) {
+        float x = x0 + dx * static_cast<float>(i);
+        PointState p = { x, 0.0f, z, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f };
+
+        for (size_t w = 0; w < waveCount; w++) {
+            float Dx = waves.dirX[w];
+            float Dz = waves.dirZ[w];
+            float k = waves.k[w];
+            float phase = k * (Dx * x + Dz * z) - waves.phaseOffset[w];
+            float sinPhase = std::sin(phase);
+            float cosPhase = std::cos(phase);
+
+            float H = waves.horizontal[w];
+            float A = waves.amplitude[w];
+            p.px += Dx * H * cosPhase;
+            p.py += A * sinPhase;
+            p.pz += Dz * H * cosPhase;
+
+            float horizontalSlope = H * k * sinPhase;
+            float verticalSlope = A * k * cosPhase;
+            p.dxx -= Dx * Dx * horizontalSlope;
+            p.dxy += Dx * verticalSlope;
+            p.dxz -= Dx * Dz * horizontalSlope;
+            p.dzx -= Dx * Dz * horizontalSlope;
+            p.dzy += Dz * verticalSlope;
+            p.dzz -= Dz * Dz * horizontalSlope;
+        }
+
+        if (ripples) {
+            p.py += ripples->height[i];
+            p.dxy += ripples->gradientX[i];
+            p.dzy += ripples->gradientZ[i];
+        }
+        writeVertex(p, out + static_cast<size_t>(i) * stride);
+    }
+}
+
+#ifdef WAVE_KERNEL_X86
+constexpr int AVX2_LANES = 8;
+
+WAVE_KERNEL_AVX2_TARGET
+inline void sinCosAVX2(__m256 x, __m256& sinOut, __m256& cosOut) {
+    __m256 q = _mm256_round_ps(_mm256_mul_ps(x, _mm256_set1_ps(TWO_OVER_PI)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256 r = _mm256_fnmadd_ps(q, _mm256_set1_ps(PI_OVER_2_HI), x);
+    r = _mm256_fnmadd_ps(q, _mm256_set1_ps(PI_OVER_2_LO), r);
+    __m256 r2 = _mm256_mul_ps(r, r);
+
+    __m256 sinPoly = _mm256_fmadd_ps(r2, _mm256_set1_ps(SIN_C3), _mm256_set1_ps(SIN_C2));
+    sinPoly = _mm256_fmadd_ps(r2, sinPoly, _mm256_set1_ps(SIN_C1));
+    __m256 sinR = _mm256_fmadd_ps(_mm256_mul_ps(r, r2), sinPoly, r);
+
+    __m256 cosPoly = _mm256_fmadd_ps(r2, _mm256_set1_ps(COS_C3), _mm256_set1_ps(COS_C2));
+    cosPoly = _mm256_fmadd_ps(r2, cosPoly, _mm256_set1_ps(COS_C1));
+    __m256 cosR = _mm256_fmadd_ps(_mm256_mul_ps(r2, r2), cosPoly, _mm256_fnmadd_ps(_mm256_set1_ps(0.5f), r2, _mm256_set1_ps(1.0f)));
+
+    // Odd quadrants swap sin and cos; quadrants 2-3 negate sin, 1-2 negate cos
+    __m256i quadrant = _mm256_cvtps_epi32(q);
+    __m256 swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(quadrant, _mm256_set1_epi32(1)), _mm256_set1_epi32(1)));
+    __m256 sinSign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(quadrant, _mm256_set1_epi32(2)), 30));
+    __m256 cosSign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(_mm256_add_epi32(quadrant, _mm256_set1_epi32(1)), _mm256_set1_epi32(2)), 30));
+    sinOut = _mm256_xor_ps(_mm256_blendv_ps(sinR, cosR, swap), sinSign);
+    cosOut = _mm256_xor_ps(_mm256_blendv_ps(cosR, sinR, swap), cosSign);
+}
+
+WAVE_KERNEL_AVX2_TARGET
+void evaluateRowAVX2(const WaveSoA& waves, float x0, float dx, float z, int count,
+                     const RippleRow* ripples, float* out, int stride) {
+    const size_t waveCount = waves.size();
+    const __m256 laneOffsets = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+    const __m256 vz = _mm256_set1_ps(z);
+    alignas(32) float lanes[9][AVX2_LANES];
+
+    int i = 0;
+    for (; i + AVX2_LANES <= count; i += AVX2_LANES) {
+        __m256 x = _mm256_fmadd_ps(_mm256_add_ps(_mm256_set1_ps(static_cast<float>(i)), laneOffsets), _mm256_set1_ps(dx), _mm256_set1_ps(x0));
+        __m256 px = x, py = _mm256_setzero_ps(), pz = vz;
+        __m256 dxx = _mm256_set1_ps(1.0f), dxy = _mm256_setzero_ps(), dxz = _mm256_setzero_ps();
+        __m256 dzy = _mm256_setzero_ps(), dzz = _mm256_set1_ps(1.0f);
+
+        for (size_t w = 0; w < waveCount; w++) {
+            __m256 Dx = _mm256_set1_ps(waves.dirX[w]);
+            __m256 Dz = _mm256_set1_ps(waves.dirZ[w]);
+            __m256 k = _mm256_set1_ps(waves.k[w]);
+            __m256 phase = _mm256_fmsub_ps(k, _mm256_fmadd_ps(Dx, x, _mm256_mul_ps(Dz, vz)), _mm256_set1_ps(waves.phaseOffset[w]));
+            __m256 sinPhase, cosPhase;
+            sinCosAVX2(phase, sinPhase, cosPhase);
+
+            __m256 H = _mm256_set1_ps(waves.horizontal[w]);
+            __m256 A = _mm256_set1_ps(waves.amplitude[w]);
+            __m256 horizontalCos = _mm256_mul_ps(H, cosPhase);
+            px = _mm256_fmadd_ps(Dx, horizontalCos, px);
+            py = _mm256_fmadd_ps(A, sinPhase, py);
+            pz = _mm256_fmadd_ps(Dz, horizontalCos, pz);
+
+            __m256 horizontalSlope = _mm256_mul_ps(_mm256_mul_ps(H, k), sinPhase);
+            __m256 verticalSlope = _mm256_mul_ps(_mm256_mul_ps(A, k), cosPhase);
+            dxx = _mm256_fnmadd_ps(_mm256_mul_ps(Dx, Dx), horizontalSlope, dxx);
+            dxy = _mm256_fmadd_ps(Dx, verticalSlope, dxy);
+            dxz = _mm256_fnmadd_ps(_mm256_mul_ps(Dx, Dz), horizontalSlope, dxz);
+            dzy = _mm256_fmadd_ps(Dz, verticalSlope, dzy);
+            dzz = _mm256_fnmadd_ps(_mm256_mul_ps(Dz, Dz), horizontalSlope, dzz);
+        }
+
+        if (ripples) {
+            py = _mm256_add_ps(py, _mm256_loadu_ps(ripples->height + i));
+            dxy = _mm256_add_ps(dxy, _mm256_loadu_ps(ripples->gradientX + i));
+            dzy = _mm256_add_ps(dzy, _mm256_loadu_ps(ripples->gradientZ + i));
+        }
+
+        // dP/dz has the same x component as dP/dx has z
+        _mm256_store_ps(lanes[0], px);
+        _mm256_store_ps(lanes[1], py);
+        _mm256_store_ps(lanes[2], pz);
+        _mm256_store_ps(lanes[3], dxx);
+        _mm256_store_ps(lanes[4], dxy);
+        _mm256_store_ps(lanes[5], dxz);
+        _mm256_store_ps(lanes[6], dxz);
+        _mm256_store_ps(lanes[7], dzy);
+        _mm256_store_ps(lanes[8], dzz);
+        for (int lane = 0; lane < AVX2_LANES; lane++) {
+            PointState p = { lanes[0][lane], lanes[1][lane], lanes[2][lane],
+                             lanes[3][lane], lanes[4][lane], lanes[5][lane],
+                             lanes[6][lane], lanes[7][lane], lanes[8][lane] };
+            writeVertex(p, out + static_cast<size_t>(i + lane) * stride);
+        }
+    }
+
+    evaluatePointsReference(waves, x0, dx, z, i, count, ripples, out, stride);
+}
+
+bool cpuHasAVX2() {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return false;
+    __cpuid(info, 1);
+    bool fma = (info[2] & (1 << 12)) != 0;
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    if (!fma || !osxsave || (_xgetbv(0) & 0x6) != 0x6) return false; // OS saves the YMM state
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+}
+#endif
+
+#ifdef WAVE_KERNEL_NEON
+constexpr int NEON_LANES = 4;
+
+inline void sinCosNEON(float32x4_t x, float32x4_t& sinOut, float32x4_t& cosOut) {
+    float32x4_t q = vrndnq_f32(vmulq_n_f32(x, TWO_OVER_PI));
+    float32x4_t r = vmlsq_n_f32(x, q, PI_OVER_2_HI);
+    r = vmlsq_n_f32(r, q, PI_OVER_2_LO);
+    float32x4_t r2 = vmulq_f32(r, r);
+
+    float32x4_t sinPoly = vmlaq_n_f32(vdupq_n_f32(SIN_C2), r2, SIN_C3);
+    sinPoly = vmlaq_f32(vdupq_n_f32(SIN_C1), r2, sinPoly);
+    float32x4_t sinR = vmlaq_f32(r, vmulq_f32(r, r2), sinPoly);
+
+    float32x4_t cosPoly = vmlaq_n_f32(vdupq_n_f32(COS_C2), r2, COS_C3);
+    cosPoly = vmlaq_f32(vdupq_n_f32(COS_C1), r2, cosPoly);
+    float32x4_t cosR = vmlaq_f32(vmlsq_n_f32(vdupq_n_f32(1.0f), r2, 0.5f), vmulq_f32(r2, r2), cosPoly);
+
+    // Odd quadrants swap sin and cos; quadrants 2-3 negate sin, 1-2 negate cos
+    int32x4_t quadrant = vcvtq_s32_f32(q);
+    uint32x4_t swap = vceqq_s32(vandq_s32(quadrant, vdupq_n_s32(1)), vdupq_n_s32(1));
+    uint32x4_t sinSign = vreinterpretq_u32_s32(vshlq_n_s32(vandq_s32(quadrant, vdupq_n_s32(2)), 30));
+    uint32x4_t cosSign = vreinterpretq_u32_s32(vshlq_n_s32(vandq_s32(vaddq_s32(quadrant, vdupq_n_s32(1)), vdupq_n_s32(2)), 30));
+    sinOut = vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(vbslq_f32(swap, cosR, sinR)), sinSign));
+    cosOut = vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(vbslq_f32(swap, sinR, cosR)), cosSign));
+}
+
+void evaluateRowNEON(const WaveSoA& waves, float x0, float dx, float z, int count,
+                     const RippleRow* ripples, float* out, int stride) {
+    const size_t waveCount = waves.size();
+    const float laneOffsetValues[NEON_LANES] = { 0.0f, 1.0f, 2.0f, 3.0f };
+    const float32x4_t laneOffsets = vld1q_f32(laneOffsetValues);
+    const float32x4_t vz = vdupq_n_f32(z);
+    float lanes[9][NEON_LANES];
+
+    int i = 0;
+    for (; i + NEON_LANES <= count; i += NEON_LANES) {
+        float32x4_t x = vmlaq_n_f32(vdupq_n_f32(x0), vaddq_f32(vdupq_n_f32(static_cast<float>(i)), laneOffsets), dx);
+        float32x4_t px = x, py = vdupq_n_f32(0.0f), pz = vz;
+        float32x4_t dxx = vdupq_n_f32(1.0f), dxy = vdupq_n_f32(0.0f), dxz = vdupq_n_f32(0.0f);
+        float32x4_t dzy = vdupq_n_f32(0.0f), dzz = vdupq_n_f32(1.0f);
+
+        for (size_t w = 0; w < waveCount; w++) {
+            float Dx = waves.dirX[w];
+            float Dz = waves.dirZ[w];
+            float k = waves.k[w];
+            float32x4_t phase = vsubq_f32(vmulq_n_f32(vmlaq_n_f32(vmulq_n_f32(vz, Dz), x, Dx), k), vdupq_n_f32(waves.phaseOffset[w]));
+            float32x4_t sinPhase, cosPhase;
+            sinCosNEON(phase, sinPhase, cosPhase);
+
+            float H = waves.horizontal[w];
+            float A = waves.amplitude[w];
+            px = vmlaq_n_f32(px, cosPhase, Dx * H);
+            py = vmlaq_n_f32(py, sinPhase, A);
+            pz = vmlaq_n_f32(pz, cosPhase, Dz * H);
+
+            dxx = vmlsq_n_f32(dxx, sinPhase, Dx * Dx * H * k);
+            dxy = vmlaq_n_f32(dxy, cosPhase, Dx * A * k);
+            dxz = vmlsq_n_f32(dxz, sinPhase, Dx * Dz * H * k);
+            dzy = vmlaq_n_f32(dzy, cosPhase, Dz * A * k);
+            dzz = vmlsq_n_f32(dzz, sinPhase, Dz * Dz * H * k);
+        }
+
+        if (ripples) {
+            py = vaddq_f32(py, vld1q_f32(ripples->height + i));
+            dxy = vaddq_f32(dxy, vld1q_f32(ripples->gradientX + i));
+            dzy = vaddq_f32(dzy, vld1q_f32(ripples->gradientZ + i));
+        }
+
+        // dP/dz has the same x component as dP/dx has z
+        vst1q_f32(lanes[0], px);
+        vst1q_f32(lanes[1], py);
+        vst1q_f32(lanes[2], pz);
+        vst1q_f32(lanes[3], dxx);
+        vst1q_f32(lanes[4], dxy);
+        vst1q_f32(lanes[5], dxz);
+        vst1q_f32(lanes[6], dxz);
+        vst1q_f32(lanes[7], dzy);
+        vst1q_f32(lanes[8], dzz);
+        for (int lane = 0; lane < NEON_LANES; lane++) {
+            PointState p = { lanes[0][lane], lanes[1][lane], lanes[2][lane],
+                             lanes[3][lane], lanes[4][lane], lanes[5][lane],
+                             lanes[6][lane], lanes[7][lane], lanes[8][lane] };
+            writeVertex(p, out + static_cast<size_t>(i + lane) * stride);
+        }
+    }
+
+    evaluatePointsReference(waves, x0, dx, z, i, count, ripples, out, stride);
+}
+#endif
+
+Isa detectIsa() {
+#if defined(WAVE_KERNEL_X86)
+    return cpuHasAVX2() ? Isa::AVX2 : Isa::Scalar;
+#elif defined(WAVE_KERNEL_NEON)
+    return Isa::NEON; // Baseline on AArch64
+#else
+    return Isa::Scalar;
+#endif
+}
+
+} // namespace
+
+Isa activeIsa() {
+    static const Isa isa = detectIsa();
+    return isa;
+}
+
+const char* isaName(Isa isa) {
+    switch (isa) {
+        case Isa::AVX2: return "AVX2";
+        case Isa::NEON: return "NEON";
+        case Isa::Scalar:
+        default: return "scalar";
+    }
+}
+
+void evaluateRow(const WaveSoA& waves, float x0, float dx, float z, int count,
+                 const RippleRow* ripples, float* out, int stride) {
+    switch (activeIsa()) {
+#ifdef WAVE_KERNEL_X86
+        case Isa::AVX2:
+            evaluateRowAVX2(waves, x0, dx, z, count, ripples, out, stride);
+            return;
+#endif
+#ifdef WAVE_KERNEL_NEON
+        case Isa::NEON:
+            evaluateRowNEON(waves, x0, dx, z, count, ripples, out, stride);
+            return;
+#endif
+        default:
+            evaluatePointsReference(waves, x0, dx, z, 0, count, ripples, out, stride);
+            return;
+    }
+}
+
+void evaluateRowReference(const WaveSoA& waves, float x0, float dx, float z, int count,
+                          const RippleRow* ripples, float* out, int stride) {
+    evaluatePointsReference(waves, x0, dx, z, 0, count, ripples, out, stride);
+}
+
+} // namespace WaveKernel
@@ -0,0 +1,59 @@
+#include "../include/WaveState.h"
+#include "../include/GPUMemoryTracker.h"
+#include "../include/ShaderCompiler.h"
+#include "../include/WaterSurface.h"
+
+namespace WaterSim {
+
+namespace {
+    constexpr int GROUP_SIZE = 16;      // wave_state.cs, in x and y
+    constexpr int FLOW_MAP_UNIT = 0;
+}
+
+WaveState::~WaveState() {
+    ShaderCompiler::instance().cancel(this);
+}
+
+void WaveState::initialize() {
+    GPUMemoryScope memoryScope("Waves");
+    height_.create(GL_TEXTURE_2D);
+    height_.storage2D(1, GL_RGBA32F, RESOLUTION, RESOLUTION);
+    height_.sampling(GL_LINEAR, GL_LINEAR, GL_CLAMP_TO_EDGE);
+    for (GLTexture* texture : { &normal_, &velocity_ }) {
+        texture->create(GL_TEXTURE_2D);
+        texture->storage2D(1, GL_RGBA16F, RESOLUTION, RESOLUTION);
+        texture->sampling(GL_LINEAR, GL_LINEAR, GL_CLAMP_TO_EDGE);
+    }
+
+    ShaderCompiler::instance().submitCompute(this, "wave state", "shaders/wave_state.cs", "",
+                                             [this](GLuint program) { program_.setId(program); });
+}
+
+void WaveState::update(WaterSurface& surface, float deltaTime) {
+    if (!isReady()) return;
+
+    // The first update has no previous heights to take the velocities from
+    size_ = surface.getSize();
+    program_.use();
+    program_.setFloat("uSize", size_);
+    program_.setFloat("uInverseDeltaTime", valid_ && deltaTime > 0.0f ? 1.0f / deltaTime : 0.0f);
+    FlowMap* flowMap = surface.getFlowMap();
+    program_.setBool("uFlowMapEnabled", flowMap != nullptr);
+    if (flowMap) {
+        glBindTextureUnit(FLOW_MAP_UNIT, flowMap->getVelocityTexture());
+        program_.setInt("uFlowMap", FLOW_MAP_UNIT);
+    }
+    surface.bindWaveParameters();
+
+    glBindImageTexture(0, height_.get(), 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+    glBindImageTexture(1, normal_.get(), 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+    glBindImageTexture(2, velocity_.get(), 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+    glDispatchCompute((RESOLUTION + GROUP_SIZE - 1) / GROUP_SIZE, (RESOLUTION + GROUP_SIZE - 1) / GROUP_SIZE, 1);
+
+    // Sampled by the passes that follow, read back as images by the next update
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    glUseProgram(0);
+    valid_ = true;
+}
+
+} // namespace WaterSim
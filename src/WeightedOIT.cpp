@@ -0,0 +1,58 @@
+#include "WeightedOIT.h"
+#include "ShaderCompiler.h"
+
+namespace WaterSim {
+
+WeightedOIT::~WeightedOIT() {
+    ShaderCompiler::instance().cancel(this);
+    if (vao_) glDeleteVertexArrays(1, &vao_);
+}
+
+void WeightedOIT::initialize() {
+    glCreateVertexArrays(1, &vao_);
+    ShaderCompiler::instance().submit(this, "OIT composite", "shaders/oit_composite.vs", "shaders/oit_composite.fs",
+                                      [this](GLuint program) { compositeProgram_.setId(program); });
+}
+
+void WeightedOIT::beginAccumulation() const {
+    const GLfloat noColor[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    const GLfloat fullyRevealed[4] = {1.0f, 0.0f, 0.0f, 0.0f};
+    glClearBufferfv(GL_COLOR, 0, noColor);
+    glClearBufferfv(GL_COLOR, 1, fullyRevealed);
+
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LESS);
+    glDepthMask(GL_FALSE);
+    glDisable(GL_CULL_FACE);    // Both sides of the glass are layers
+    glEnable(GL_BLEND);
+    glBlendFunci(0, GL_ONE, GL_ONE);
+    glBlendFunci(1, GL_ZERO, GL_ONE_MINUS_SRC_COLOR);
+}
+
+void WeightedOIT::endAccumulation() const {
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glDepthMask(GL_TRUE);
+}
+
+void WeightedOIT::composite(GLuint accumTexture, GLuint revealageTexture) const {
+    if (!isReady()) return;
+
+    // Source alpha is the revealage: the opaque color keeps that much
+    glDisable(GL_DEPTH_TEST);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE_MINUS_SRC_ALPHA, GL_SRC_ALPHA);
+
+    compositeProgram_.use();
+    glBindTextureUnit(0, accumTexture);
+    glBindTextureUnit(1, revealageTexture);
+    compositeProgram_.setInt("accumTexture", 0);
+    compositeProgram_.setInt("revealageTexture", 1);
+    glBindVertexArray(vao_);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glEnable(GL_DEPTH_TEST);
+}
+
+} // namespace WaterSim
@@ -15,21 +15,68 @@
 #include <cmath>
 #include <random>
 #include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <cstring>
+#include <cfloat>
+#include <cstdio>
+#include <filesystem>
+#include <thread>
 
 #include "../include/InitShader.h"
+#include "../include/ShaderCompiler.h"
 #include "../include/Camera.h"
 #include "../include/WaterSurface.h"
 #include "../include/Sphere.h"
 #include "../include/GlassContainer.h"
-#include "../include/Framebuffer.h"
-#include "../include/HeightMapTexture.h"
 #include "../include/ReflectionRenderer.h"
+#include "../include/ReflectionProbe.h"
 #include "../include/PostProcessManager.h"
 #include "../include/RayTracingManager.h"
 #include "../include/Config.h"
+#include "../include/ConfigFile.h"
 #include "../include/SimulationManager.h"
 #include "../include/MainMenu.h"
 #include "../include/Skybox.h"
+#include "../include/JobSystem.h"
+#include "../include/FrameGraph.h"
+#include "../include/MappedFile.h"
+#include "../include/ResourceManager.h"
+#include "../include/RenderTargetPool.h"
+#include "../include/GPUMemoryTracker.h"
+#include "../include/FrameArena.h"
+#include "../include/StereoRenderer.h"
+#include "../include/BindlessTextures.h"
+#include "../include/SceneBatch.h"
+#include "../include/ClusteredLights.h"
+#include "../include/ShadingRateImage.h"
+#include "../include/RasterCaustics.h"
+#include "../include/FroxelVolumetrics.h"
+#include "../include/WaveState.h"
+#include "../include/WaterQueries.h"
+#include "../include/FluidQueries.h"
+#include "../include/SubsystemRegistry.h"
+#include "../include/StartupGraph.h"
+#include "../include/UploadQueue.h"
+#include "../include/UICache.h"
+#include "../include/TemporalUpscaler.h"
+#include "../include/FrameCapture.h"
+#include "../include/RemoteControl.h"
+#include "../include/Benchmark.h"
+#include "../include/AssetPack.h"
+#include "../include/CommandRecording.h"
+#include "../include/FlightRecorder.h"
+#include "../include/Profiler.h"
+#include "../include/TraceRecorder.h"
+#include "../include/Logger.h"
+#include "../include/FramePacer.h"
+#include "../include/SimulationClock.h"
+#include "../include/GPUPicker.h"
+#include "../include/ShadowMapper.h"
+#include "../include/WeightedOIT.h"
+#include "../include/RigidBodySystem.h"
+#include "../include/RewindTimeline.h"
+#include "../include/FrameBudget.h"
 
 
 // Function prototypes
@@ -38,16 +85,55 @@ void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void mouse_button_callback(GLFWwindow* window, int button, int action, int mods);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void processInput(GLFWwindow* window, float deltaTime);
-void renderUI(float deltaTime);
+void resolvePendingPick();
+void applyBenchmarkEvent(const WaterSim::BenchmarkEvent& event);
+void applyRemoteCommand(GLFWwindow* window, const WaterSim::RemoteCommand& command);
+void applyConfigChanges(const WaterSim::ConfigChanges& changes);
+WaterSim::RewindTimeline::Settings rewindSettings();
+WaterSim::FlightRecorder::Settings spikeTraceSettings();
+void recordFlightFrame(float frameTime);
+void registerLazySubsystems();
+void addFrameBudgetKnobs();
+void applyFrameBudgetSettings();
+void applySimulationClockSettings();
+void renderUI(float deltaTime, float fps);
+void renderProfilerPanel();
+#ifdef SPH_GPU_COUNTERS
+void renderSPHCounters(const WaterSim::SPHCounters& counters);
+#endif
 float calculateFPS(float deltaTime);
+bool parseCommandLine(int argc, char** argv);
+int runHeadless();
+bool startReplay(WaterSim::SimulationManager& manager, WaterSim::SimulationType requiredType);
+float beginSessionTick(WaterSim::SimulationManager& manager, float tickTime);
+void endSessionTick(float updateTime);
+void stopSessionRecording(WaterSim::SimulationManager& manager, const char* reason);
 unsigned int loadSkybox(std::vector<std::string> faces);
 unsigned int createDummyTexture();
-unsigned int createCausticTexture(int size);
-unsigned int createTileTexture(int size);
-unsigned int createSteelTexture(int size);
-void enableAnisotropicFiltering();
+void buildWaterVolume(std::vector<float>& vertices, std::vector<unsigned int>& indices);
+std::vector<unsigned char> generateCausticPixels(int size);
+std::vector<unsigned char> generateTilePixels(int size);
+std::vector<unsigned char> generateSteelPixels(int size);
+unsigned int createTextureFromPixels(const std::vector<unsigned char>& data, int size, WaterSim::UploadQueue::Ticket& upload);
+unsigned int createProceduralTextureStorage(int size);
+unsigned int generateProceduralTextureGPU(const char* defines, int size);
+unsigned int readProceduralTextureCache(const char* name, int size);
+void writeProceduralTextureCache(const char* name, int size, GLuint texture);
+void enableAnisotropicFiltering(GLuint texture);
 void renderScene(const Camera& camera, float waterLevel, bool isReflection, bool isRefraction);
-void updateWaveSimulation(float deltaTime, float time);
+void renderSceneLayered(const Camera& camera, float waterLevel);
+void renderProbeFace(float waterLevel);
+void setPlanarSphereUniforms(const WaterSim::GLShaderProgram& shader);
+void bindMaterialTexture(const WaterSim::GLShaderProgram& shader, const char* name, GLenum target, GLuint texture, int unit);
+void updatePoolLights();
+void renderShadows(WaterSim::SPHComputeSystem* sphSystem);
+void renderDepthPrepass();
+void updateFrameUniforms(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& viewPos, float time,
+                         const glm::mat4* eyeViews = nullptr, const glm::mat4* eyeProjections = nullptr);
+void updateWaveSimulation(float deltaTime);
+void addWaveState(WaterSurfaceGeometry& geometry);
+void validateMainShaders();
+void renderShaderLoadingScreen();
 
 // OpenGL debug callback
 void APIENTRY debugCallback(GLenum source, GLenum type, GLuint id, GLenum severity,
@@ -104,6 +190,11 @@ const float DRAG_VELOCITY_SAMPLE_TIME = 0.05f; // Sample every 50ms
 
 // Configuration
 WaterSim::Config config;
+// --config FILE (or ./watersim.json) and --preset NAME, reloaded when the file changes
+WaterSim::ConfigFile configFile;
+
+// Scripted, recorded run from --benchmark; input is ignored while it drives the frame
+WaterSim::Benchmark* benchmark = nullptr;
 
 // Objects
 Sphere* sphere = nullptr;
@@ -116,16 +207,110 @@ WaterSim::MainMenu* mainMenu = nullptr;
 
 // Advanced rendering systems
 ReflectionRenderer* reflectionRenderer = nullptr;
+WaterSim::ReflectionProbe* reflectionProbe = nullptr;   // Far field of the water reflection, a face at a time
 PostProcessManager* postProcessManager = nullptr;
-HeightMapTexture* waveHeightMap = nullptr;
-Framebuffer* mainSceneFBO = nullptr;
-WaterSim::RayTracingManager* rayTracingManager = nullptr;
+WaterSim::WaveState* waveState = nullptr;   // Wave height, normal and velocity textures, once per frame
+WaterSim::WaterQueries* waterQueries = nullptr;   // Batched water height and buoyancy queries of the floating objects
+WaterSim::FluidQueries* fluidQueries = nullptr;   // Batched spatial queries over the SPH grid
+
+// Fluid sensor of the SPH panel: a box in fractions of the simulation box, and the density
+// at its centre
+glm::vec3 fluidSensorMin(0.4f, 0.0f, 0.4f);
+glm::vec3 fluidSensorMax(0.6f, 0.25f, 0.6f);
+WaterSim::FluidQueries::Ticket fluidSensorTicket;
+WaterSim::RayTracingManager* rayTracingManager = nullptr;    // While resident in subsystems
+WaterSim::FrameGraph* frameGraph = nullptr;   // Rebuilt every frame; owns the transient targets
+WaterSim::GPUPicker* gpuPicker = nullptr;     // Depth under the cursor, and the frame's inverse matrices
+WaterSim::ShadowMapper* shadowMapper = nullptr;
+WaterSim::WeightedOIT* weightedOIT = nullptr;   // Glass, water volume, foam and SPH spray, in any order
+WaterSim::RigidBodySystem* rigidBodies = nullptr; // Debris spheres and boxes, on the GPU
+WaterSim::RewindTimeline* rewindTimeline = nullptr; // Simulation keyframes for scrubbing back
+WaterSim::CommandRecorder* commandRecorder = nullptr; // --record: the session's commands, tick by tick
+WaterSim::CommandReplay* commandReplay = nullptr;     // --replay: a recorded session run again
+WaterSim::FlightRecorder flightRecorder;        // Saves the trace around frame spikes
+WaterSim::FrameBudget* frameBudget = nullptr;   // Sheds subsystem quality to hold the frame time
 
 // Shader programs
-GLuint waterShader = 0;
-GLuint glassShader = 0;
-GLuint sphereShader = 0;
-GLuint foamShader = 0;
+WaterSim::GLShaderProgram waterShader;
+WaterSim::GLShaderProgram glassShader;
+WaterSim::GLShaderProgram sphereShader;
+WaterSim::GLShaderProgram foamShader;
+WaterSim::GLShaderProgram waterTessShader; // Tessellated water surface, optional
+WaterSim::GLShaderProgram spherePlanarShader; // Sphere into both planar targets in one layered pass, optional
+WaterSim::GLShaderProgram waterVolumeShader; // water.fs into the transparent pass
+WaterSim::GLShaderProgram rigidBodyShader; // Every rigid body in one instanced draw, shaded by sphere.fs
+// Depth prepass: the opaque programs' vertex stages with depth_only.fs
+WaterSim::GLShaderProgram sphereDepthShader;
+WaterSim::GLShaderProgram rigidBodyDepthShader;
+
+// Both eyes of the opaque scene in one multiview pass, by the STEREO_MULTIVIEW variants
+WaterSim::StereoRenderer* stereoRenderer = nullptr;
+// Resident handles of the static material textures, where the driver has them
+WaterSim::BindlessTextures* bindlessTextures = nullptr;
+// Static meshes for the multi-drawn passes: the container, and the sphere at each level
+WaterSim::SceneBatch* sceneBatch = nullptr;
+int containerBatchMesh = -1;
+int sphereBatchMeshes[Sphere::LOD_COUNT] = {};
+// Dynamic lights of the water, sphere, glass and SPH shading, and the settings they were
+// last built from
+WaterSim::ClusteredLights* clusteredLights = nullptr;
+WaterSim::Config::Lighting builtPoolLights;
+// Per-tile shading rates of the water and fluid passes, classified from the last frame
+WaterSim::ShadingRateImage* shadingRateImage = nullptr;
+
+// Floor caustics of the raster water, splatted from the frame's waves; while resident
+WaterSim::RasterCaustics* rasterCaustics = nullptr;
+// Light shafts in the water of the raster path, lit on froxels and applied in post-processing
+WaterSim::FroxelVolumetrics* froxelVolumetrics = nullptr;
+
+// The ray tracer and the raster caustics, created on first use and released when idle
+WaterSim::SubsystemRegistry subsystems;
+int rayTracingSubsystem = -1;
+int rasterCausticsSubsystem = -1;
+
+// What the ray tracer was set to, carried over to the next one after a release
+struct RayTracingState {
+    bool saved = false;
+    WaterSim::RayTracingFeatures features;
+    float frameBudgetMs = 0.0f;
+    float budgetScale = 1.0f;
+} rayTracingState;
+// Jittered scene at a fraction of the window, resolved up to it against the last frames; the
+// size the scene's targets were last sized to, zero to resize them next frame
+WaterSim::TemporalUpscaler* temporalUpscaler = nullptr;
+glm::ivec2 sceneRenderSize(0);
+glm::vec3 previousSphereCenter(0.0f);
+WaterSim::GLShaderProgram sphereStereoShader;
+WaterSim::GLShaderProgram rigidBodyStereoShader;
+WaterSim::GLShaderProgram waterStereoShader;
+WaterSim::GLShaderProgram skyboxStereoShader;
+
+// Recording of the post-processed frames, read back asynchronously
+WaterSim::FrameCapture* frameCapture = nullptr;
+// Streaming server (--serve): the client's commands, and the stream through frameCapture
+WaterSim::RemoteControl* remoteControl = nullptr;
+std::vector<WaterSim::RemoteCommand> remoteCommands;
+
+// Camera and light of the pass being drawn, the std140 FrameUniforms block of the water,
+// sphere, glass and foam shaders. Written once per pass instead of per program
+struct FrameBlock {
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::vec3 viewPos;
+    float time;
+    glm::vec3 lightPos;
+    float padding0;
+    glm::vec3 lightColor;
+    float padding1;
+    glm::mat4 eyeView[WaterSim::StereoRenderer::EYE_COUNT];         // Read by the stereo variants
+    glm::mat4 eyeProjection[WaterSim::StereoRenderer::EYE_COUNT];
+};
+const GLuint FRAME_UNIFORM_BINDING = 2; // 0 and 1 are SPHParameters and WaveParameters
+GLuint frameUBO = 0;
+
+// Redundant-call filter for the main scene passes, and its tally for the last frame
+WaterSim::GLStateCache glState;
+WaterSim::GLStateCache::Counters lastFrameStateCalls;
 
 // Textures
 GLuint skyboxTexture = 0;
@@ -133,6 +318,9 @@ GLuint causticTexture = 0;
 GLuint tileTexture = 0;
 GLuint steelTexture = 0;
 
+// The resource manager owns the procedural textures; these handles keep them resident
+std::vector<WaterSim::ResourceManager::Handle> sceneTextureHandles;
+
 // Mouse interaction
 bool isDraggingSphere = false;
 bool isRightMousePressed = false; // Track right mouse button state
@@ -140,8 +328,14 @@ bool isRightMousePressed = false; // Track right mouse button state
 // Sphere appearance settings (global so they can be shared)
 bool enableSphereReflections = true;
 float sphereReflectivity = 0.95f;
+float sphereRoughness = 0.1f;   // GGX roughness of the sphere's sky reflection
 glm::vec3 lastMouseWorldPos(0.0f);
 
+// A left press waits for the first pick captured after it; released by then, it is a click
+bool pickPending = false;
+bool pickReleased = false;
+uint64_t pickPendingFrame = 0;
+
 // Ray tracing state
 bool rayTracingEnabled = false;
 int rayTracingQuality = 0; // OFF by default
@@ -165,7 +359,39 @@ const float RIPPLE_CHARGE_RATE = 0.5f; // How fast ripple magnitude increases pe
 bool sprayParticles = false;
 float particleEmissionRate = 50.0f;
 
-int main() {
+// Profiler window; the profiler only times frames while it is open
+bool showProfiler = false;
+WaterSim::UICache uiCache;
+
+// Frames in flight, frame-rate cap and input latency of the interactive loop
+WaterSim::FramePacer framePacer;
+
+// Fixed simulation ticks the renderers interpolate between
+WaterSim::SimulationClock simulationClock;
+
+int main(int argc, char** argv) {
+    if (!parseCommandLine(argc, argv)) {
+        return -1;
+    }
+    WaterSim::TraceRecorder::instance().setEnabled(config.trace.enabled);
+    WaterSim::TraceRecorder::instance().setThreadName("Main");
+    WaterSim::Logger::instance().setEnabled(config.debug.enableLogging);
+    WaterSim::AssetPack::instance().setLooseOverride(config.assets.looseOverride);
+    if (!config.assets.pack.empty()) {
+        WaterSim::AssetPack::instance().open(config.assets.pack);
+    }
+    if (config.headless.enabled) {
+        return runHeadless();
+    }
+    if (!config.benchmark.scenario.empty()) {
+        benchmark = new WaterSim::Benchmark(*WaterSim::Benchmark::findScenario(config.benchmark.scenario),
+                                            config.benchmark.frames);
+        benchmark->configure(config);
+    }
+    
+    SCR_WIDTH = config.display.width;
+    SCR_HEIGHT = config.display.height;
+    
     // Initialize GLFW for Windows with maximum GPU utilization
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
@@ -175,22 +401,37 @@ int main() {
     glfwWindowHint(GLFW_RESIZABLE, GL_TRUE);
     glfwWindowHint(GLFW_DOUBLEBUFFER, GLFW_TRUE);
     glfwWindowHint(GLFW_CONTEXT_DEBUG, GLFW_TRUE); // Enable debug context
+    if (benchmark && config.benchmark.hiddenWindow) {
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    }
+    // A server has no one to show the window to; EGL needs no display server on NVIDIA
+    if (config.server.port > 0) {
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        if (config.server.eglContext) {
+            glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_EGL_CONTEXT_API);
+        }
+        if (config.pacing.frameRateCap <= 0.0f) {
+            config.pacing.frameRateCap = static_cast<float>(config.capture.frameRate);
+        }
+    }
     
     // Create window
-    GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Water Simulation", NULL, NULL);
+    GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, config.display.title.c_str(), NULL, NULL);
     if (window == NULL) {
         std::cout << "Failed to create GLFW window" << std::endl;
         glfwTerminate();
         return -1;
     }
     glfwMakeContextCurrent(window);
-    glfwSwapInterval(0);
+    glfwSwapInterval(config.display.vsync && !benchmark ? 1 : 0);
     
-    // Set callbacks
+    // Set callbacks; a benchmark takes no mouse input
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-    glfwSetCursorPosCallback(window, mouse_callback);
-    glfwSetMouseButtonCallback(window, mouse_button_callback);
-    glfwSetScrollCallback(window, scroll_callback);
+    if (!benchmark) {
+        glfwSetCursorPosCallback(window, mouse_callback);
+        glfwSetMouseButtonCallback(window, mouse_button_callback);
+        glfwSetScrollCallback(window, scroll_callback);
+    }
     
     // Capture mouse
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
@@ -201,6 +442,9 @@ int main() {
         return -1;
     }
     
+    // The trace gets the GPU passes too, from the profiler's timestamps
+    WaterSim::Profiler::instance().setTracing(config.trace.enabled);
+    
     // Print OpenGL info
     std::cout << "OpenGL version: " << glGetString(GL_VERSION) << std::endl;
     std::cout << "GLSL version: " << glGetString(GL_SHADING_LANGUAGE_VERSION) << std::endl;
@@ -253,698 +497,1566 @@ int main() {
     ImGui_ImplGlfw_InitForOpenGL(window, true);
     ImGui_ImplOpenGL3_Init("#version 460 core");
     
-    // Initialize shaders
+    // Initialize shaders. The main programs build asynchronously while the rest of the scene
+    // loads, and the loop shows their progress until the required ones are ready
     std::cout << "Initializing shaders..." << std::endl;
     checkGLError("before shader initialization");
     
-    waterShader = InitShader("shaders/water.vs", "shaders/water.fs");
-    checkGLError("water shader initialization");
-    
-    glassShader = InitShader("shaders/glass.vs", "shaders/glass.fs");
-    checkGLError("glass shader initialization");
-    
-    sphereShader = InitShader("shaders/sphere.vs", "shaders/sphere.fs");
-    checkGLError("sphere shader initialization");
-    
-    foamShader = InitShader("shaders/foam.vs", "shaders/foam.fs");
-    checkGLError("foam shader initialization");
-    
-    // Check if shaders were successfully created
-    if (waterShader == 0) {
-        std::cerr << "ERROR: Failed to create water shader program!" << std::endl;
-        glfwTerminate();
-        return -1;
-    }
-    if (glassShader == 0) {
-        std::cerr << "ERROR: Failed to create glass shader program!" << std::endl;
-        glfwTerminate();
-        return -1;
-    }
-    if (sphereShader == 0) {
-        std::cerr << "ERROR: Failed to create sphere shader program!" << std::endl;
-        glfwTerminate();
-        return -1;
-    }
-    if (foamShader == 0) {
-        std::cerr << "ERROR: Failed to create foam shader program!" << std::endl;
-        glfwTerminate();
-        return -1;
-    }
-    
-    std::cout << "All main shaders initialized successfully." << std::endl;
-    
-    // Validate shader programs
-    GLint validateStatus;
-    GLchar infoLog[512];
-    
-    // Validate water shader
-    glValidateProgram(waterShader);
-    glGetProgramiv(waterShader, GL_VALIDATE_STATUS, &validateStatus);
-    if (validateStatus != GL_TRUE) {
-        glGetProgramInfoLog(waterShader, 512, NULL, infoLog);
-        std::cerr << "Water shader validation failed: " << infoLog << std::endl;
+    WaterSim::ShaderCompiler& shaderCompiler = WaterSim::ShaderCompiler::instance();
+    shaderCompiler.initialize();
+    WaterSim::ResourceManager::instance().initialize();
+    if (config.uploads.thread) {
+        WaterSim::UploadQueue::instance().start(size_t(std::max(config.uploads.stagingMB, 1)) << 20);
     }
+    auto assignProgram = [](WaterSim::GLShaderProgram& target) {
+        return [&target](GLuint program) { target.setId(program); };
+    };
     
-    // Validate glass shader
-    glValidateProgram(glassShader);
-    glGetProgramiv(glassShader, GL_VALIDATE_STATUS, &validateStatus);
-    if (validateStatus != GL_TRUE) {
-        glGetProgramInfoLog(glassShader, 512, NULL, infoLog);
-        std::cerr << "Glass shader validation failed: " << infoLog << std::endl;
+    // Optional: the static material textures through resident handles; without them the
+    // water, sphere and glass programs sample bound units
+    bindlessTextures = new WaterSim::BindlessTextures();
+    if (config.display.bindlessTextures) {
+        bindlessTextures->initialize();
     }
-    
-    // Validate sphere shader
-    glValidateProgram(sphereShader);
-    glGetProgramiv(sphereShader, GL_VALIDATE_STATUS, &validateStatus);
-    if (validateStatus != GL_TRUE) {
-        glGetProgramInfoLog(sphereShader, 512, NULL, infoLog);
-        std::cerr << "Sphere shader validation failed: " << infoLog << std::endl;
+    const std::string materialDefines = bindlessTextures->isSupported() ? "#define BINDLESS_TEXTURES 1\n" : "";
+    
+    // Water and sphere receive shadows and the dynamic lights: caustic_shadow.fs and
+    // clustered_lights.fs link in as further fragment stages
+    shaderCompiler.submit(nullptr, "water",
+                          {{GL_VERTEX_SHADER, "shaders/water.vs", ""},
+                           {GL_FRAGMENT_SHADER, "shaders/water.fs", materialDefines},
+                           {GL_FRAGMENT_SHADER, "shaders/clustered_lights.fs", ""},
+                           {GL_FRAGMENT_SHADER, "shaders/caustic_shadow.fs", ""}},
+                          assignProgram(waterShader));
+    
+    // The transparent draws write through oit.fs
+    shaderCompiler.submit(nullptr, "glass",
+                          {{GL_VERTEX_SHADER, "shaders/glass.vs", ""},
+                           {GL_FRAGMENT_SHADER, "shaders/glass.fs", materialDefines},
+                           {GL_FRAGMENT_SHADER, "shaders/clustered_lights.fs", ""},
+                           {GL_FRAGMENT_SHADER, "shaders/oit.fs", ""}},
+                          assignProgram(glassShader));
+    shaderCompiler.submit(nullptr, "water volume",
+                          {{GL_VERTEX_SHADER, "shaders/water.vs", "#define WATER_VOLUME 1\n"},
+                           {GL_FRAGMENT_SHADER, "shaders/water.fs", "#define OIT_PASS 1\n" + materialDefines},
+                           {GL_FRAGMENT_SHADER, "shaders/clustered_lights.fs", ""},
+                           {GL_FRAGMENT_SHADER, "shaders/caustic_shadow.fs", ""},
+                           {GL_FRAGMENT_SHADER, "shaders/oit.fs", ""}},
+                          assignProgram(waterVolumeShader));
+    shaderCompiler.submit(nullptr, "sphere",
+                          {{GL_VERTEX_SHADER, "shaders/sphere.vs", ""},
+                           {GL_FRAGMENT_SHADER, "shaders/sphere.fs", materialDefines},
+                           {GL_FRAGMENT_SHADER, "shaders/clustered_lights.fs", ""},
+                           {GL_FRAGMENT_SHADER, "shaders/caustic_shadow.fs", ""}},
+                          assignProgram(sphereShader));
+    shaderCompiler.submit(nullptr, "rigid bodies",
+                          {{GL_VERTEX_SHADER, "shaders/rigid_body.vs", ""},
+                           {GL_FRAGMENT_SHADER, "shaders/sphere.fs", materialDefines},
+                           {GL_FRAGMENT_SHADER, "shaders/clustered_lights.fs", ""},
+                           {GL_FRAGMENT_SHADER, "shaders/caustic_shadow.fs", ""}},
+                          assignProgram(rigidBodyShader));
+    shaderCompiler.submit(nullptr, "foam",
+                          {{GL_VERTEX_SHADER, "shaders/foam.vs", ""},
+                           {GL_FRAGMENT_SHADER, "shaders/foam.fs", ""},
+                           {GL_FRAGMENT_SHADER, "shaders/oit.fs", ""}},
+                          assignProgram(foamShader));
+    
+    // Optional: layered rendering of the planar targets; without it each target gets its own pass
+    shaderCompiler.submit(nullptr, "planar layered",
+                          {{GL_VERTEX_SHADER, "shaders/planar_layered.vs", ""},
+                           {GL_GEOMETRY_SHADER, "shaders/planar_layered.gs", ""},
+                           {GL_FRAGMENT_SHADER, "shaders/sphere.fs", materialDefines},
+                           {GL_FRAGMENT_SHADER, "shaders/clustered_lights.fs", ""},
+                           {GL_FRAGMENT_SHADER, "shaders/caustic_shadow.fs", ""}},
+                          assignProgram(spherePlanarShader));
+    
+    // Optional: tessellated water; water.vs doubles as the evaluation stage
+    shaderCompiler.submit(nullptr, "water tessellation",
+                          {{GL_VERTEX_SHADER, "shaders/water_tess.vs", ""},
+                           {GL_TESS_CONTROL_SHADER, "shaders/water.tcs", ""},
+                           {GL_TESS_EVALUATION_SHADER, "shaders/water.vs", "#define WATER_TESSELLATION 1\n"},
+                           {GL_FRAGMENT_SHADER, "shaders/water.fs", materialDefines},
+                           {GL_FRAGMENT_SHADER, "shaders/clustered_lights.fs", ""},
+                           {GL_FRAGMENT_SHADER, "shaders/caustic_shadow.fs", ""}},
+                          assignProgram(waterTessShader));
+    
+    // Optional: depth prepass programs; without them the scene pass shades with depth writes
+    shaderCompiler.submit(nullptr, "sphere depth",
+                          {{GL_VERTEX_SHADER, "shaders/sphere.vs", ""},
+                           {GL_FRAGMENT_SHADER, "shaders/depth_only.fs", ""}},
+                          assignProgram(sphereDepthShader));
+    shaderCompiler.submit(nullptr, "rigid body depth",
+                          {{GL_VERTEX_SHADER, "shaders/rigid_body.vs", ""},
+                           {GL_FRAGMENT_SHADER, "shaders/depth_only.fs", ""}},
+                          assignProgram(rigidBodyDepthShader));
+    
+    // Optional: the stereo variants, where the driver has multiview; without them stereo
+    // stays off
+    stereoRenderer = new WaterSim::StereoRenderer();
+    stereoRenderer->setSettings({ config.stereo.eyeSeparation, config.stereo.convergence });
+    if (stereoRenderer->initialize()) {
+        const std::string multiview = "#define STEREO_MULTIVIEW 1\n";
+        shaderCompiler.submit(nullptr, "sphere stereo",
+                              {{GL_VERTEX_SHADER, "shaders/sphere.vs", multiview},
+                               {GL_FRAGMENT_SHADER, "shaders/sphere.fs", materialDefines},
+                               {GL_FRAGMENT_SHADER, "shaders/clustered_lights.fs", ""},
+                               {GL_FRAGMENT_SHADER, "shaders/caustic_shadow.fs", ""}},
+                              assignProgram(sphereStereoShader));
+        shaderCompiler.submit(nullptr, "rigid bodies stereo",
+                              {{GL_VERTEX_SHADER, "shaders/rigid_body.vs", multiview},
+                               {GL_FRAGMENT_SHADER, "shaders/sphere.fs", materialDefines},
+                               {GL_FRAGMENT_SHADER, "shaders/clustered_lights.fs", ""},
+                               {GL_FRAGMENT_SHADER, "shaders/caustic_shadow.fs", ""}},
+                              assignProgram(rigidBodyStereoShader));
+        shaderCompiler.submit(nullptr, "water stereo",
+                              {{GL_VERTEX_SHADER, "shaders/water.vs", multiview},
+                               {GL_FRAGMENT_SHADER, "shaders/water.fs", materialDefines},
+                               {GL_FRAGMENT_SHADER, "shaders/clustered_lights.fs", ""},
+                               {GL_FRAGMENT_SHADER, "shaders/caustic_shadow.fs", ""}},
+                              assignProgram(waterStereoShader));
+        shaderCompiler.submit(nullptr, "skybox stereo",
+                              {{GL_VERTEX_SHADER, "shaders/skybox.vs", multiview},
+                               {GL_FRAGMENT_SHADER, "shaders/skybox.fs", ""}},
+                              assignProgram(skyboxStereoShader));
     }
+    checkGLError("main shader submission");
+    
+    // Frame uniform block, bound once for every program that declares it
+    glGenBuffers(1, &frameUBO);
+    glBindBuffer(GL_UNIFORM_BUFFER, frameUBO);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameBlock), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_UNIFORM_BINDING, frameUBO);
+    
+    // The startup scene as a task graph: the CPU parts (pixels, meshes) run on the job pool
+    // and the uploads here, on the context thread, as their inputs arrive
+    WaterSim::StartupGraph startup;
+    
+    // Sphere levels, container and water volume meshes
+    startup.add("Sphere levels", []() { Sphere::prepareLevels(); }, []() {
+        sphere = new Sphere(1.0f);
+        sphere->initialize();
+        sphere->setPosition(glm::vec3(0.0f, 3.0f, 0.0f));
+        sphere->setColor(glm::vec3(0.3f, 0.7f, 0.9f));
+        sphere->setMass(2.0f);
+    });
+    container = new GlassContainer(10.0f, 10.0f, 10.0f);
+    startup.add("Container mesh", []() { container->prepareMesh(); }, []() { container->initialize(); });
+    
+    // Water volume geometry for inside the container
+    GLuint waterVolumeVAO = 0, waterVolumeVBO = 0, waterVolumeEBO = 0;
+    std::vector<float> waterVolumeVertices;
+    std::vector<unsigned int> waterVolumeIndices;
+    startup.add("Water volume mesh", [&]() { buildWaterVolume(waterVolumeVertices, waterVolumeIndices); }, [&]() {
+        glGenVertexArrays(1, &waterVolumeVAO);
+        glGenBuffers(1, &waterVolumeVBO);
+        glGenBuffers(1, &waterVolumeEBO);
+        
+        glBindVertexArray(waterVolumeVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, waterVolumeVBO);
+        glBufferData(GL_ARRAY_BUFFER, waterVolumeVertices.size() * sizeof(float), waterVolumeVertices.data(), GL_STATIC_DRAW);
+        
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, waterVolumeEBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, waterVolumeIndices.size() * sizeof(unsigned int), waterVolumeIndices.data(), GL_STATIC_DRAW);
+        
+        // Position attribute
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(0);
+        // Normal attribute
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
+        glEnableVertexAttribArray(1);
+        // Texture attribute
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
+        glEnableVertexAttribArray(2);
+        
+        glBindVertexArray(0);
+    });
     
-    // Initialize skybox
-    skybox = new WaterSim::Skybox();
-    skybox->initialize();
-    
-    // Load skybox textures with proper paths and correct order
-    std::vector<std::string> skyboxFaces = {
-        "textures/skybox/px.png", // positive X (right)
-        "textures/skybox/nx.png", // negative X (left)
-        "textures/skybox/py.png", // positive Y (top)
-        "textures/skybox/ny.png", // negative Y (bottom)
-        "textures/skybox/pz.png", // positive Z (front)
-        "textures/skybox/nz.png"  // negative Z (back)
+    // The skybox decodes its faces on the pool itself and streams them in from the loop
+    startup.add("Skybox", nullptr, []() {
+        skybox = new WaterSim::Skybox();
+        skybox->initialize();
+        
+        // Load skybox textures with proper paths and correct order
+        std::vector<std::string> skyboxFaces = {
+            "textures/skybox/px.png", // positive X (right)
+            "textures/skybox/nx.png", // negative X (left)
+            "textures/skybox/py.png", // positive Y (top)
+            "textures/skybox/ny.png", // negative Y (bottom)
+            "textures/skybox/pz.png", // positive Z (front)
+            "textures/skybox/nz.png"  // negative Z (back)
+        };
+        skybox->loadCubemap(skyboxFaces);
+        skyboxTexture = skybox->getCubemapTexture();
+    });
+    
+    // Procedural textures come from their caches when those match. Otherwise caustic and tile
+    // generate on the GPU and steel on the job pool
+    const int proceduralSize = 512;
+    bool causticGenerated = false, tileGenerated = false, steelGenerated = false;
+    int proceduralTask = startup.add("Procedural textures", nullptr, [&]() {
+        causticTexture = readProceduralTextureCache("caustic", proceduralSize);
+        tileTexture = readProceduralTextureCache("tile", proceduralSize);
+        steelTexture = readProceduralTextureCache("steel", proceduralSize);
+        causticGenerated = !causticTexture;
+        tileGenerated = !tileTexture;
+        steelGenerated = !steelTexture;
+        if (causticGenerated) {
+            causticTexture = generateProceduralTextureGPU("#define PROCEDURAL_CAUSTIC\n", proceduralSize);
+        }
+        if (tileGenerated) {
+            tileTexture = generateProceduralTextureGPU("#define PROCEDURAL_TILE\n", proceduralSize);
+        }
+    });
+    
+    // The CPU generators remain for steel, whose random sequence has no GPU twin, and as the
+    // fallback when the compute shader is unavailable; their texels go up on the upload thread
+    std::vector<unsigned char> causticPixels, tilePixels, steelPixels;
+    WaterSim::UploadQueue::Ticket textureUploads[3] = {};
+    auto addProceduralPixels = [&](const char* name, unsigned int& texture, std::vector<unsigned char>& pixels,
+                                   std::vector<unsigned char> (*generate)(int), WaterSim::UploadQueue::Ticket& upload) {
+        return startup.add(std::string(name) + " pixels",
+                           [&texture, &pixels, generate, proceduralSize]() {
+                               if (!texture) pixels = generate(proceduralSize);
+                           },
+                           [&texture, &pixels, &upload, proceduralSize]() {
+                               if (!texture) texture = createTextureFromPixels(pixels, proceduralSize, upload);
+                           },
+                           { proceduralTask });
     };
-    skybox->loadCubemap(skyboxFaces);
-    skyboxTexture = skybox->getCubemapTexture();
-    
-    // Generate a caustic texture for underwater lighting effects
-    causticTexture = createCausticTexture(512);
-    
-    // Generate a tile texture for the pool
-    tileTexture = createTileTexture(512);
-    
-    // Generate steel texture for the sphere
-    steelTexture = createSteelTexture(512);
-    
-    // Initialize simulation objects
-    sphere = new Sphere(1.0f);
-    sphere->initialize();
-    sphere->setPosition(glm::vec3(0.0f, 3.0f, 0.0f));
-    sphere->setColor(glm::vec3(0.3f, 0.7f, 0.9f));
-    sphere->setMass(2.0f);
+    int causticTask = addProceduralPixels("caustic", causticTexture, causticPixels, generateCausticPixels, textureUploads[0]);
+    int tileTask = addProceduralPixels("tile", tileTexture, tilePixels, generateTilePixels, textureUploads[1]);
+    int steelTask = addProceduralPixels("steel", steelTexture, steelPixels, generateSteelPixels, textureUploads[2]);
+    
+    // Last, so the uploads overlap the other tasks. The next start reads all three back from
+    // their caches instead of generating them
+    startup.add("Scene textures", nullptr, [&]() {
+        for (WaterSim::UploadQueue::Ticket upload : textureUploads) {
+            WaterSim::UploadQueue::instance().waitForUse(upload);
+        }
+        if (causticGenerated) writeProceduralTextureCache("caustic", proceduralSize, causticTexture);
+        if (tileGenerated) writeProceduralTextureCache("tile", proceduralSize, tileTexture);
+        if (steelGenerated) writeProceduralTextureCache("steel", proceduralSize, steelTexture);
+        WaterSim::ResourceManager& resources = WaterSim::ResourceManager::instance();
+        sceneTextureHandles.push_back(resources.adoptTexture("caustic", causticTexture));
+        sceneTextureHandles.push_back(resources.adoptTexture("tile", tileTexture));
+        sceneTextureHandles.push_back(resources.adoptTexture("steel", steelTexture));
+    }, { causticTask, tileTask, steelTask });
     
-    container = new GlassContainer(10.0f, 10.0f, 10.0f);
-    container->initialize();
+    startup.run();
     
     // Initialize simulation manager and main menu
     simulationManager = new WaterSim::SimulationManager(config);
     mainMenu = new WaterSim::MainMenu();
+    rewindTimeline = new WaterSim::RewindTimeline(*simulationManager);
+    rewindTimeline->setSettings(rewindSettings());
+    flightRecorder.setSettings(spikeTraceSettings());
     
     // Create advanced rendering systems
     reflectionRenderer = new ReflectionRenderer(SCR_WIDTH, SCR_HEIGHT);
+    reflectionProbe = new WaterSim::ReflectionProbe();
     postProcessManager = new PostProcessManager(SCR_WIDTH, SCR_HEIGHT);
-    rayTracingManager = new WaterSim::RayTracingManager(config);
-    rayTracingManager->initialize(SCR_WIDTH, SCR_HEIGHT);
-    waveHeightMap = new HeightMapTexture(256, 256);
-    mainSceneFBO = new Framebuffer(SCR_WIDTH, SCR_HEIGHT, FRAMEBUFFER_COLOR_DEPTH);
+    shadingRateImage = new WaterSim::ShadingRateImage();
+    shadingRateImage->initialize(SCR_WIDTH, SCR_HEIGHT);
+    registerLazySubsystems();
+    temporalUpscaler = new WaterSim::TemporalUpscaler();
+    temporalUpscaler->initialize(SCR_WIDTH, SCR_HEIGHT);
+    waveState = new WaterSim::WaveState();
+    waveState->initialize();
+    waterQueries = new WaterSim::WaterQueries();
+    waterQueries->initialize();
+    fluidQueries = new WaterSim::FluidQueries();
+    fluidQueries->initialize();
+    bindlessTextures->setTexture(WaterSim::BindlessTextures::CAUSTIC, causticTexture);
+    bindlessTextures->setTexture(WaterSim::BindlessTextures::TILE, tileTexture);
+    bindlessTextures->setTexture(WaterSim::BindlessTextures::WAVE_HEIGHT_MAP, waveState->getHeightTexture());
+    bindlessTextures->setTexture(WaterSim::BindlessTextures::SPHERE, steelTexture);
+    frameGraph = new WaterSim::FrameGraph();
+    gpuPicker = new WaterSim::GPUPicker();
+    gpuPicker->initialize();
+    
+    // Shadows of the fixed light over the container and what it holds
+    shadowMapper = new WaterSim::ShadowMapper();
+    shadowMapper->initialize();
+    sceneBatch = new WaterSim::SceneBatch();
+    containerBatchMesh = sceneBatch->addMesh(container->getVertices(), container->getIndices());
+    for (int level = 0; level < Sphere::LOD_COUNT; level++) {
+        std::vector<float> vertices;
+        std::vector<unsigned int> indices;
+        Sphere::buildLevel(level, vertices, indices);
+        sphereBatchMeshes[level] = sceneBatch->addMesh(vertices, indices);
+    }
+    shadowMapper->setSceneBatch(sceneBatch);
+    clusteredLights = new WaterSim::ClusteredLights();
+    clusteredLights->initialize();
+    builtPoolLights.poolLights = -1;
+    shadowMapper->setLight(glm::vec3(5.0f, 10.0f, 5.0f), glm::vec3(0.0f));
+    froxelVolumetrics = new WaterSim::FroxelVolumetrics();
+    froxelVolumetrics->initialize();
+    weightedOIT = new WaterSim::WeightedOIT();
+    weightedOIT->initialize();
+    rigidBodies = new WaterSim::RigidBodySystem();
+    {
+        glm::vec3 halfSize(container->getWidth() * 0.5f, container->getHeight() * 0.5f, container->getDepth() * 0.5f);
+        shadowMapper->setSceneBounds(container->getPosition() - halfSize, container->getPosition() + halfSize + glm::vec3(0.0f, 1.0f, 0.0f));
+        rigidBodies->setBounds(container->getPosition() - halfSize, container->getPosition() + halfSize);
+    }
+    rigidBodies->initialize();
     
     // Initialize simulation parameters
     simulationManager->setWaterHeight(0.0f);
     
-    // Create water volume geometry for inside the container
-    GLuint waterVolumeVAO, waterVolumeVBO, waterVolumeEBO;
-    glGenVertexArrays(1, &waterVolumeVAO);
-    glGenBuffers(1, &waterVolumeVBO);
-    glGenBuffers(1, &waterVolumeEBO);
+    // Recording from the first frame when asked for on the command line
+    frameCapture = new WaterSim::FrameCapture();
+    if (!config.capture.outputPath.empty()) {
+        frameCapture->start(config.capture.outputPath, SCR_WIDTH, SCR_HEIGHT, config.capture.frameRate, config.capture.hardwareEncode);
+    }
     
-    // Water volume vertices - simple box
-    float waterHalfWidth = 5.0f - 0.05f; // Slightly smaller than container
-    float waterDepth = 5.0f - 0.05f; // Slightly smaller than container
-    std::vector<float> waterVolumeVertices = {
-        // Positions           // Normals           // TexCoords
-        // Bottom face (floor level is at -5.0f)
-        -waterHalfWidth, FLOOR_LEVEL, -waterDepth,  0.0f, 1.0f, 0.0f,  0.0f, 0.0f,
-         waterHalfWidth, FLOOR_LEVEL, -waterDepth,  0.0f, 1.0f, 0.0f,  1.0f, 0.0f,
-         waterHalfWidth, FLOOR_LEVEL,  waterDepth,  0.0f, 1.0f, 0.0f,  1.0f, 1.0f,
-        -waterHalfWidth, FLOOR_LEVEL,  waterDepth,  0.0f, 1.0f, 0.0f,  0.0f, 1.0f,
-        
-        // Top face (will be adjusted to water height in render loop)
-        -waterHalfWidth,  0.0f, -waterDepth,  0.0f, 1.0f, 0.0f,  0.0f, 0.0f,
-         waterHalfWidth,  0.0f, -waterDepth,  0.0f, 1.0f, 0.0f,  1.0f, 0.0f,
-         waterHalfWidth,  0.0f,  waterDepth,  0.0f, 1.0f, 0.0f,  1.0f, 1.0f,
-        -waterHalfWidth,  0.0f,  waterDepth,  0.0f, 1.0f, 0.0f,  0.0f, 1.0f,
-    };
+    // A server skips the menu; the client picks the simulation
+    if (config.server.port > 0 || config.server.controlPort > 0) {
+        remoteControl = new WaterSim::RemoteControl();
+        WaterSim::RemoteControl::Settings controlSettings;
+        controlSettings.bindAddress = config.server.bindAddress;
+        controlSettings.token = config.server.token;
+        controlSettings.controllerTimeout = config.server.controllerTimeout;
+        if (!remoteControl->open(config.server.port > 0 ? config.server.port : config.server.controlPort, controlSettings)) {
+            glfwTerminate();
+            return -1;
+        }
+    }
+    if (config.server.port > 0) {
+        mainMenu->setMenuActive(false);
+        simulationManager->setSimulationType(WaterSim::SimulationType::REGULAR_WATER);
+    }
     
-    // The y-coordinates will be adjusted based on water height in the render loop
-    std::vector<unsigned int> waterVolumeIndices = {
-        0, 1, 5, 0, 5, 4, // Back face
-        1, 2, 6, 1, 6, 5, // Right face
-        2, 3, 7, 2, 7, 6, // Front face
-        3, 0, 4, 3, 4, 7, // Left face
-        4, 5, 6, 4, 6, 7, // Top face
-        0, 1, 2, 0, 2, 3  // Bottom face
-    };
+    // A baked playback starts directly, for installations that run unattended
+    if (!config.playback.path.empty() && config.server.port <= 0) {
+        mainMenu->setMenuActive(false);
+        simulationManager->setSimulationType(WaterSim::SimulationType::SPH_PLAYBACK);
+    }
     
-    glBindVertexArray(waterVolumeVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, waterVolumeVBO);
-    glBufferData(GL_ARRAY_BUFFER, waterVolumeVertices.size() * sizeof(float), waterVolumeVertices.data(), GL_DYNAMIC_DRAW);
+    // A benchmark starts its simulation directly and times every frame-graph pass
+    if (benchmark) {
+        const WaterSim::BenchmarkScenario& scenario = benchmark->getScenario();
+        std::cout << "Benchmark '" << scenario.name << "': " << scenario.description << std::endl;
+        mainMenu->setMenuActive(false);
+        simulationManager->setSimulationType(scenario.simulation);
+        frameGraph->setTiming(true);
+        if (scenario.rayTracing) {
+            rayTracingEnabled = true;
+            rayTracingQuality = static_cast<int>(WaterSim::RayTracingQuality::MEDIUM);
+            if (rayTracingManager) {
+                rayTracingManager->setQuality(WaterSim::RayTracingQuality::MEDIUM);
+            }
+        }
+    }
     
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, waterVolumeEBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, waterVolumeIndices.size() * sizeof(unsigned int), waterVolumeIndices.data(), GL_STATIC_DRAW);
+    // A replay starts the recorded simulation directly; from then on only the recording
+    // drives it, until it runs out
+    if (!config.recording.replayPath.empty()) {
+        if (!startReplay(*simulationManager, WaterSim::SimulationType::NONE)) {
+            glfwTerminate();
+            return -1;
+        }
+        mainMenu->setMenuActive(false);
+    }
+    if (!config.recording.outputPath.empty()) {
+        commandRecorder = new WaterSim::CommandRecorder();
+    }
     
-    // Position attribute
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    // Normal attribute
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-    // Texture attribute
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-    glEnableVertexAttribArray(2);
+    frameBudget = new WaterSim::FrameBudget();
+    addFrameBudgetKnobs();
+    applyFrameBudgetSettings();
+    applySimulationClockSettings();
     
-    glBindVertexArray(0);
 
     // Main render loop
+    bool mainShadersReady = false;
     while (!glfwWindowShouldClose(window)) {
+        // Wait out the frames in flight and the cap first, so the frame's time and input
+        // are as fresh as they can be
+        framePacer.setMaxFramesInFlight(config.pacing.maxFramesInFlight);
+        framePacer.setFrameRateCap(benchmark ? 0.0f : config.pacing.frameRateCap);
+        framePacer.beginFrame();
+        
         // Calculate delta time
         float currentFrame = static_cast<float>(glfwGetTime());
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
         
+        // Startup's long frames are expected; the flight recorder watches from the first
+        // frame with the scene's shaders on
+        if (mainShadersReady) {
+            recordFlightFrame(deltaTime);
+        }
+        
+        WaterSim::Profiler::instance().beginFrame();
+        
+        // A benchmark steps its own clock, whatever the frame really took
+        if (benchmark) {
+            benchmark->beginFrame();
+            deltaTime = benchmark->getFrameTime();
+            currentFrame = benchmark->getTime();
+        }
+        
         // Calculate FPS
         float fps = calculateFPS(deltaTime);
         
-        // Process input
-        processInput(window, deltaTime);
+        // Programs finish on the driver's threads; hot-reloaded ones swap in here too
+        shaderCompiler.poll();
         
-        // Update physics and objects
-        sphere->setUseGravity(useGravity);
-        if (useGravity) {
-            sphere->applyGravity(gravity);
+        // The skybox streams in a face per frame behind its placeholder
+        skybox->update();
+        WaterSim::ResourceManager::instance().update();
+        skyboxTexture = skybox->getCubemapTexture();
+        bindlessTextures->setTexture(WaterSim::BindlessTextures::SKYBOX, skyboxTexture);
+        if (!mainShadersReady) {
+            bool built = waterShader.isValid() && glassShader.isValid() && sphereShader.isValid() && foamShader.isValid();
+            if (!built) {
+                if (shaderCompiler.getPendingCount() == 0) {
+                    std::cerr << "ERROR: Failed to create the main shader programs!" << std::endl;
+                    break;
+                }
+                renderShaderLoadingScreen();
+                glfwSwapBuffers(window);
+                glfwPollEvents();
+                continue;
+            }
+            mainShadersReady = true;
+            validateMainShaders();
+            std::cout << "All main shaders initialized successfully." << std::endl;
         }
-        sphere->update(deltaTime);
         
-        // Handle menu interactions and simulation selection
-        if (mainMenu->hasSelectionChanged()) {
-            WaterSim::SimulationType selectedType = mainMenu->getSelectedSimulation();
-            simulationManager->setSimulationType(selectedType);
-            mainMenu->clearSelectionChanged();
+        // Process input, or the benchmark's camera path and interactions in its place
+        if (benchmark) {
+            benchmark->poseCamera(camera);
+            for (const WaterSim::BenchmarkEvent& event : benchmark->getDueEvents()) {
+                applyBenchmarkEvent(event);
+            }
+        } else {
+            if (config.pacing.lateInputSampling) {
+                glfwPollEvents();
+            }
+            framePacer.markInputSampled();
+            processInput(window, deltaTime);
+            resolvePendingPick();
         }
         
-        // Check sphere collision with water and create interactions
-        glm::vec3 spherePos = sphere->getPosition();
-        float sphereRadius = sphere->getRadius();
-        
-        // Different collision detection based on simulation type
-        bool isBelowWater = false;
-        static bool wasBelowWater = false;
+        // The streaming client's input comes in beside the (hidden) window's
+        if (remoteControl) {
+            remoteCommands.clear();
+            remoteControl->poll(remoteCommands);
+            for (const WaterSim::RemoteCommand& command : remoteCommands) {
+                applyRemoteCommand(window, command);
+            }
+        }
         
-        if (simulationManager->isRegularWaterActive()) {
-            float waterHeight = simulationManager->getWaterHeight();
-            isBelowWater = spherePos.y - sphereRadius <= waterHeight;
-        } else if (simulationManager->isSPHComputeActive()) {
-            // For SPH, check if sphere is in the container bounds where particles exist
-            float containerBottom = -4.5f;  // SPH particle container bottom
-            float containerTop = -1.0f;     // SPH particle container top
-            isBelowWater = (spherePos.y - sphereRadius <= containerTop && spherePos.y + sphereRadius >= containerBottom);
+        // A saved config file comes into effect between frames
+        WaterSim::ConfigChanges configChanges;
+        if (configFile.poll(config, configChanges)) {
+            applyConfigChanges(configChanges);
         }
         
-        if (isBelowWater && !wasBelowWater && sphere->getVelocity().y < -0.5f) {
-            // Create interaction based on simulation type
-            float interactionMagnitude = std::abs(sphere->getVelocity().y);
-            
+        // The floating objects submit their water queries while they update
+        waterQueries->beginFrame();
+        fluidQueries->beginFrame();
+        
+        // Scrubbing the rewind timeline holds the simulation and the sphere where it was sought
+        if (rewindTimeline->isPaused()) {
+            previousSphereCenter = sphere->getPosition();
+        } else {
+            // Update physics and objects
+            sphere->setUseGravity(useGravity);
+            if (useGravity) {
+                sphere->applyGravity(gravity);
+            }
+            previousSphereCenter = sphere->getPosition();
+            sphere->update(deltaTime);
+        
+            // Handle menu interactions and simulation selection
+            if (mainMenu->hasSelectionChanged()) {
+                WaterSim::SimulationType selectedType = mainMenu->getSelectedSimulation();
+                simulationManager->setSimulationType(selectedType);
+                mainMenu->clearSelectionChanged();
+            }
+        
+            // Check sphere collision with water and create interactions
+            glm::vec3 spherePos = sphere->getPosition();
+            float sphereRadius = sphere->getRadius();
+        
+            // Two-way SPH coupling: the fluid force comes back from the GPU a frame or two late
+            // and replaces the approximate drag and impulses below
+            WaterSim::SPHComputeSystem* coupledSPH = simulationManager->isSPHComputeActive() ?
+                                                     simulationManager->getSPHComputeSystem() : nullptr;
+            bool sphereCoupled = coupledSPH && coupledSPH->getUseSphereCoupling();
+            if (sphereCoupled) {
+                coupledSPH->setCoupledSphere(spherePos, sphere->getVelocity(), sphereRadius);
+                sphere->applyForce(coupledSPH->getSphereForce());
+            }
+        
+            // The water under the sphere's bottom, from the batched queries a frame or two
+            // back; until they land, the flat water level and the SPH container's range
+            WaterSim::WaterQueryResult sphereWater;
+            sphereWater.height = simulationManager->getWaterHeight();
+            bool sphereWaterQueried = waterQueries->getResults(waterQueries->submit(spherePos - glm::vec3(0.0f, sphereRadius, 0.0f)), &sphereWater);
+        
+            // Different collision detection based on simulation type
+            bool isBelowWater = false;
+            static bool wasBelowWater = false;
+        
             if (simulationManager->isRegularWaterActive()) {
-                simulationManager->createSplash(spherePos, interactionMagnitude);
+                isBelowWater = spherePos.y - sphereRadius <= sphereWater.height;
+                simulationManager->setWaterObstacle(spherePos, sphereRadius);
+            } else if (simulationManager->isSPHComputeActive() && sphereWaterQueried) {
+                isBelowWater = sphereWater.fraction > 0.0f;
             } else if (simulationManager->isSPHComputeActive()) {
-                // Enhanced collision for SPH particles
-                glm::vec3 impulse = sphere->getVelocity() * 10.0f;  // Strong impulse for visible effect
-                float impulseRadius = sphereRadius * 4.0f;  // Large interaction radius
-                simulationManager->applyImpulse(spherePos, impulse, impulseRadius);
-                
-                std::cout << "SPH Sphere collision! Pos: (" << spherePos.x << ", " << spherePos.y << ", " << spherePos.z 
-                          << ") Impulse magnitude: " << glm::length(impulse) << std::endl;
+                // For SPH, check if sphere is in the container bounds where particles exist
+                float containerBottom = -4.5f;  // SPH particle container bottom
+                float containerTop = -1.0f;     // SPH particle container top
+                isBelowWater = (spherePos.y - sphereRadius <= containerTop && spherePos.y + sphereRadius >= containerBottom);
             }
-        }
-        wasBelowWater = isBelowWater;
         
-        // Apply physics and interaction when sphere is in water
-        if (isBelowWater) {
-            glm::vec3 velocity = sphere->getVelocity();
+            if (isBelowWater && !wasBelowWater && sphere->getVelocity().y < -0.5f && !sphereCoupled) {
+                // Create interaction based on simulation type
+                float interactionMagnitude = std::abs(sphere->getVelocity().y);
             
-            if (simulationManager->isRegularWaterActive()) {
-                // Regular water physics
-                float waterHeight = simulationManager->getWaterHeight();
-                float submergedDepth = std::min(waterHeight - (spherePos.y - sphereRadius), 2.0f * sphereRadius);
-                float submergedRatio = submergedDepth / (2.0f * sphereRadius);
-                float dragFactor = 2.0f * submergedRatio;
-                sphere->applyForce(-velocity * dragFactor);
+                if (simulationManager->isRegularWaterActive()) {
+                    simulationManager->createSplash(spherePos, interactionMagnitude);
+                } else if (simulationManager->isSPHComputeActive()) {
+                    // Enhanced collision for SPH particles
+                    glm::vec3 impulse = sphere->getVelocity() * 10.0f;  // Strong impulse for visible effect
+                    float impulseRadius = sphereRadius * 4.0f;  // Large interaction radius
+                    simulationManager->applyImpulse(spherePos, impulse, impulseRadius);
                 
-                // Add continuous water flow when sphere is moving underwater
-                float lateralSpeed = glm::length(glm::vec2(velocity.x, velocity.z));
-                if (lateralSpeed > 0.2f && submergedRatio > 0.5f) {
-                    glm::vec2 lateralVelocity(velocity.x, velocity.z);
-                    simulationManager->addWaterFlowImpulse(spherePos, lateralVelocity * 0.3f, sphereRadius * 1.5f);
+                    WATERSIM_LOG_DEBUG(WaterSim::LogCategory::SPH, "SPH Sphere collision! Pos: (" << spherePos.x << ", " << spherePos.y << ", " << spherePos.z
+                              << ") Impulse magnitude: " << glm::length(impulse));
                 }
-            } else if (simulationManager->isSPHComputeActive()) {
-                // SPH particle physics
-                float dragFactor = 1.0f;  // SPH particle resistance
-                sphere->applyForce(-velocity * dragFactor);
+            }
+            wasBelowWater = isBelowWater;
+        
+            // Apply physics and interaction when sphere is in water
+            if (isBelowWater && !sphereCoupled) {
+                glm::vec3 velocity = sphere->getVelocity();
+            
+                if (simulationManager->isRegularWaterActive()) {
+                    // Regular water physics, against the wave surface under the sphere
+                    float submergedDepth = std::min(sphereWater.height - (spherePos.y - sphereRadius), 2.0f * sphereRadius);
+                    float submergedRatio = submergedDepth / (2.0f * sphereRadius);
+                    float dragFactor = 2.0f * submergedRatio;
+                    sphere->applyForce(-velocity * dragFactor);
                 
-                // Use SPH gravity instead of regular gravity
-                glm::vec3 sphGravity(0.0f, -9.81f, 0.0f);  // Use SPH physics gravity
-                sphere->applyForce(sphGravity * sphere->getMass());
+                    // Add continuous water flow when sphere is moving underwater
+                    float lateralSpeed = glm::length(glm::vec2(velocity.x, velocity.z));
+                    if (lateralSpeed > 0.2f && submergedRatio > 0.5f) {
+                        glm::vec2 lateralVelocity(velocity.x, velocity.z);
+                        simulationManager->addWaterFlowImpulse(spherePos, lateralVelocity * 0.3f, sphereRadius * 1.5f);
+                    }
+                } else if (simulationManager->isSPHComputeActive()) {
+                    // SPH particle physics
+                    float dragFactor = 1.0f;  // SPH particle resistance
+                    sphere->applyForce(-velocity * dragFactor);
+                
+                    // Use SPH gravity instead of regular gravity
+                    glm::vec3 sphGravity(0.0f, -9.81f, 0.0f);  // Use SPH physics gravity
+                    sphere->applyForce(sphGravity * sphere->getMass());
                 
-                // Continuous particle interaction
-                if (glm::length(velocity) > 0.1f) {
-                    static int frameCounter = 0;
-                    if (frameCounter++ % 5 == 0) {  // More frequent interaction
-                        glm::vec3 continuousImpulse = velocity * 2.0f;
-                        simulationManager->applyImpulse(spherePos, continuousImpulse, sphereRadius * 3.0f);
+                    // Continuous particle interaction
+                    if (glm::length(velocity) > 0.1f) {
+                        static int frameCounter = 0;
+                        if (frameCounter++ % 5 == 0) {  // More frequent interaction
+                            glm::vec3 continuousImpulse = velocity * 2.0f;
+                            simulationManager->applyImpulse(spherePos, continuousImpulse, sphereRadius * 3.0f);
+                        }
                     }
                 }
             }
-        }
-        // ÖNEMLİ
-        // HATIRLA: The actual floor is at y=-5, not y=0 
-        // Check collision with the container floor
-        if (spherePos.y - sphereRadius <= FLOOR_LEVEL + 0.001f) {
-            // Stop vertical movement and apply a small bounce
-            glm::vec3 vel = sphere->getVelocity();
-            if (vel.y < 0) {
-                // Bounce with reduced energy
-                vel.y = -vel.y * 0.3f; // 30% of energy preserved in bounce
+            // ÖNEMLİ
+            // HATIRLA: The actual floor is at y=-5, not y=0 
+            // Check collision with the container floor
+            if (spherePos.y - sphereRadius <= FLOOR_LEVEL + 0.001f) {
+                // Stop vertical movement and apply a small bounce
+                glm::vec3 vel = sphere->getVelocity();
+                if (vel.y < 0) {
+                    // Bounce with reduced energy
+                    vel.y = -vel.y * 0.3f; // 30% of energy preserved in bounce
                 
-                // If velocity is very low, just stop
-                if (std::abs(vel.y) < 0.1f) {
-                    vel.y = 0;
+                    // If velocity is very low, just stop
+                    if (std::abs(vel.y) < 0.1f) {
+                        vel.y = 0;
+                    }
+                
+                    // Reset position to be exactly on the floor
+                    spherePos.y = FLOOR_LEVEL + sphereRadius + 0.001f;
+                    sphere->setPosition(spherePos);
+                    sphere->setVelocity(vel);
                 }
+            }
+        
+            // The simulation runs in fixed ticks, none or several this frame; the rewind
+            // timeline records each tick as a frame of its own
+            int ticks = simulationClock.advance(deltaTime);
+            float tickTime = simulationClock.getTickTime();
+            for (int tick = 0; tick < ticks; tick++) {
+                // A replay runs its ticks at their recorded dt; a recording logs each one
+                float updateTime = beginSessionTick(*simulationManager, tickTime);
                 
-                // Reset position to be exactly on the floor
-                spherePos.y = FLOOR_LEVEL + sphereRadius + 0.001f;
-                sphere->setPosition(spherePos);
-                sphere->setVelocity(vel);
+                // Rigid bodies step on the GPU with the fluid's impulses of the last SPH update, and
+                // this update's SPH step 1 collides with them where they are now
+                {
+                    WaterSim::ProfileScope scope("Rigid bodies");
+                    rigidBodies->setGrid(coupledSPH);
+                    rigidBodies->update(updateTime, useGravity ? glm::vec3(0.0f, -gravity, 0.0f) : glm::vec3(0.0f));
+                    if (coupledSPH) {
+                        coupledSPH->setRigidBodies(rigidBodies->getFluidCoupling());
+                    }
+                }
+            
+                // Update simulation manager
+                {
+                    WaterSim::ProfileScope scope("Simulation update");
+                    simulationManager->update(updateTime);
+                }
+            
+                // The interactions before the update, with the sphere it ran with; the spray below
+                // goes into the next tick's
+                WaterSim::RewindTimeline::Sphere rewindSphere;
+                rewindSphere.position = sphere->getPosition();
+                rewindSphere.velocity = sphere->getVelocity();
+                rewindSphere.radius = sphere->getRadius();
+                rewindTimeline->record(updateTime, rewindSphere);
+                endSessionTick(updateTime);
+            
+                // Handle simulation-specific interactions
+                if (simulationManager->isSPHComputeActive() && sprayParticles) {
+                    glm::vec3 streamOrigin(0.0f, 3.0f, 0.0f);
+                    glm::vec3 streamDirection(0.0f, -1.0f, 0.1f);
+                    simulationManager->addFluidStream(streamOrigin, streamDirection, particleEmissionRate * updateTime);
+                }
             }
         }
         
-        // Update simulation manager
-        simulationManager->update(deltaTime);
-        
-        // Handle simulation-specific interactions
-        if (simulationManager->isSPHComputeActive() && sprayParticles) {
-            glm::vec3 streamOrigin(0.0f, 3.0f, 0.0f);
-            glm::vec3 streamDirection(0.0f, -1.0f, 0.1f);
-            simulationManager->addFluidStream(streamOrigin, streamDirection, particleEmissionRate * deltaTime);
+        // The renderers draw between the last two ticks; a paused rewind shows its frame as is
+        if (rewindTimeline->isPaused()) {
+            simulationClock.reset();
+            simulationManager->setRenderLag(0.0f);
+        } else {
+            simulationManager->setRenderLag(simulationClock.getRenderLag());
         }
         
         // === ADVANCED RENDERING PIPELINE ===
         
         // 1. UPDATE GPU WAVE SIMULATION (if compute shader available)
-        updateWaveSimulation(deltaTime, currentFrame);
+        {
+            WaterSim::ProfileScope scope("Wave simulation");
+            updateWaveSimulation(deltaTime);
+        }
+        
+        // The frame's water queries, against the wave state just updated or the fluid
+        if (simulationManager->isRegularWaterActive()) {
+            waterQueries->dispatch(*waveState, simulationManager->getWaterHeight());
+        } else if (simulationManager->isSPHComputeActive()) {
+            WaterSim::SPHComputeSystem& fluid = *simulationManager->getSPHComputeSystem();
+            waterQueries->dispatch(fluid);
+            
+            glm::vec3 boxMin = fluid.getBoxMin();
+            glm::vec3 boxSize = fluid.getBoxMax() - boxMin;
+            glm::vec3 sensorMin = boxMin + boxSize * glm::min(fluidSensorMin, fluidSensorMax);
+            glm::vec3 sensorMax = boxMin + boxSize * glm::max(fluidSensorMin, fluidSensorMax);
+            WaterSim::FluidQuery sensor[2] = { WaterSim::FluidQuery::box(sensorMin, sensorMax),
+                                               WaterSim::FluidQuery::density((sensorMin + sensorMax) * 0.5f) };
+            fluidSensorTicket = fluidQueries->submit(sensor, 2);
+            fluidQueries->dispatch(fluid);
+        }
         
         // Get water height from simulation manager for rendering
         float currentWaterHeight = simulationManager->getWaterHeight();
         
-        // Only do reflection/refraction passes for regular water surface
-        if (simulationManager->isRegularWaterActive()) {
-            // 2. RENDER REFLECTION PASS
-            reflectionRenderer->beginReflectionRender(camera, currentWaterHeight);
-            renderScene(camera, currentWaterHeight, true, false); // Render scene for reflection
-            reflectionRenderer->endReflectionRender();
-            
-            // 3. RENDER REFRACTION PASS  
-            reflectionRenderer->beginRefractionRender(camera, currentWaterHeight);
-            renderScene(camera, currentWaterHeight, false, true); // Render scene for refraction
-            reflectionRenderer->endRefractionRender();
+        // 2. BUILD THE FRAME GRAPH
+        // Passes declare what they read and write; the graph culls the ones whose output
+        // nothing reads (reflection and refraction outside regular water, ray tracing when
+        // off), shares transient targets with disjoint lifetimes and inserts the barriers
+        using WaterSim::FrameGraph;
+        using WaterSim::FrameGraphAccess;
+        frameGraph->reset();
+        if (rayTracingEnabled) {
+            subsystems.use(rayTracingSubsystem);
         }
         
-        // 4. RENDER MAIN SCENE TO FRAMEBUFFER
-        mainSceneFBO->bind();
-        glClearColor(0.1f, 0.1f, 0.2f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        const bool regularWater = simulationManager->isRegularWaterActive();
+        WaterSim::SPHComputeSystem* sphSystem = simulationManager->isSPHRenderActive() ? simulationManager->getSPHComputeSystem() : nullptr;
+        
+        // Temporal upscaling renders the scene smaller through a jittered projection. The
+        // stereo eyes would each need their own history, so they render at the window size
+        WaterSim::TemporalUpscaler::Settings upscaleSettings = temporalUpscaler->getSettings();
+        upscaleSettings.renderScale = config.display.renderScale;
+        upscaleSettings.feedback = config.display.temporalFeedback;
+        temporalUpscaler->setSettings(upscaleSettings);
+        const bool temporalUpscale = config.display.temporalUpscale && temporalUpscaler->isReady() && !config.stereo.enabled;
+        const glm::ivec2 renderSize = temporalUpscale ? temporalUpscaler->getRenderSize() : glm::ivec2(SCR_WIDTH, SCR_HEIGHT);
+        if (renderSize != sceneRenderSize) {
+            if (rayTracingManager) {
+                rayTracingManager->resize(renderSize.x, renderSize.y);
+            }
+            shadingRateImage->resize(renderSize.x, renderSize.y);
+            sceneRenderSize = renderSize;
+        }
         
-        // Create transformation matrices
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+        // Camera matrices of the main passes
+        const float aspect = (float)SCR_WIDTH / (float)SCR_HEIGHT;
         glm::mat4 view = camera.GetViewMatrix();
+        glm::mat4 unjitteredProjection = camera.GetProjectionMatrix(aspect, 0.1f, 100.0f, false);
+        if (temporalUpscale) {
+            camera.SetJitter(temporalUpscaler->beginFrame(view, unjitteredProjection), glm::vec2(renderSize));
+        } else {
+            camera.ProjectionJitter = glm::vec2(0.0f);
+            temporalUpscaler->resetHistory();
+        }
+        glm::mat4 projection = camera.GetProjectionMatrix(aspect, 0.1f, 100.0f);
         
-        // Render skybox first (early z-test rejection)
-        if (skybox && skybox->isLoaded()) {
-            skybox->render(view, projection);
+        // The matrices the cursor is unprojected with until next frame, and its depth read
+        // back after the opaque scene
+        gpuPicker->beginFrame(view, unjitteredProjection, camera.Position, SCR_WIDTH, SCR_HEIGHT);
+        if (!benchmark) {
+            double cursorX, cursorY;
+            glfwGetCursorPos(window, &cursorX, &cursorY);
+            gpuPicker->request(glm::vec2(static_cast<float>(cursorX), static_cast<float>(cursorY)));
         }
         
-        // First render the sphere
-        if (isShaderProgramValid(sphereShader)) {
-            glUseProgram(sphereShader);
-            
-            // Set sphere shader uniforms
-            glUniformMatrix4fv(glGetUniformLocation(sphereShader, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
-            glUniformMatrix4fv(glGetUniformLocation(sphereShader, "view"), 1, GL_FALSE, glm::value_ptr(view));
+        // Cascades fitted to this frame's camera; the shadow pass redraws only what moved
+        WaterSim::ShadowMapper::Settings shadowSettings = shadowMapper->getSettings();
+        shadowSettings.enabled = config.shadows.enabled;
+        shadowSettings.resolution = config.shadows.resolution;
+        shadowSettings.maxDistance = config.shadows.maxDistance;
+        shadowSettings.cacheStatic = config.shadows.cacheStatic;
+        shadowMapper->setSettings(shadowSettings);
+        shadowMapper->beginFrame(view, camera.Zoom, (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
         
-            glm::mat4 model = glm::mat4(1.0f);
-            model = glm::translate(model, sphere->getPosition());
-            glUniformMatrix4fv(glGetUniformLocation(sphereShader, "model"), 1, GL_FALSE, glm::value_ptr(model));
-            
-            // Set lighting uniforms
-            glUniform3f(glGetUniformLocation(sphereShader, "viewPos"), camera.Position.x, camera.Position.y, camera.Position.z);
-            glUniform3f(glGetUniformLocation(sphereShader, "lightPos"), 5.0f, 10.0f, 5.0f);
-            glUniform3f(glGetUniformLocation(sphereShader, "lightColor"), 1.0f, 1.0f, 1.0f);
-            glUniform1f(glGetUniformLocation(sphereShader, "ambientStrength"), 0.1f);
-            glUniform1f(glGetUniformLocation(sphereShader, "specularStrength"), 0.8f); // Moderate for realistic metal
-            glUniform1f(glGetUniformLocation(sphereShader, "shininess"), 128.0f); // High but not excessive for metal
-            
-            // Enable texture for steel appearance
-            glUniform1i(glGetUniformLocation(sphereShader, "useTexture"), 1);
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, steelTexture);
-            glUniform1i(glGetUniformLocation(sphereShader, "sphereTexture"), 0);
-            
-            // Enable reflections for mirror-like appearance
-            glUniform1i(glGetUniformLocation(sphereShader, "enableReflections"), enableSphereReflections ? 1 : 0);
-            glUniform1f(glGetUniformLocation(sphereShader, "reflectivity"), sphereReflectivity);
-            
-            // Bind skybox for environment reflections
-            glActiveTexture(GL_TEXTURE1);
-            glBindTexture(GL_TEXTURE_CUBE_MAP, skyboxTexture);
-            glUniform1i(glGetUniformLocation(sphereShader, "skybox"), 1);
+        // Light lists of this frame's froxels, for every pass that shades
+        updatePoolLights();
+        clusteredLights->update(view, projection, 0.1f, 100.0f);
+        
+        // The sphere's detail follows its size on screen; the shadow casters reuse it
+        sphere->setLOD(sphere->lodFor(camera.Position, Sphere::focalLength(SCR_HEIGHT, camera.Zoom)));
+        
+        // Stereo: the eyes side by side, half the window each, from one multiview scene pass.
+        // The SPH fluid's screen-space pipeline and the tessellated surface are mono only, so
+        // either falls back to mono
+        WaterSurface* stereoSurface = simulationManager->getWaterSurface();
+        const bool stereoActive = config.stereo.enabled && stereoRenderer->isSupported() &&
+            !simulationManager->isSPHRenderActive() &&
+            !(stereoSurface && stereoSurface->isTessellationActive()) &&
+            sphereStereoShader.isValid() && rigidBodyStereoShader.isValid() &&
+            waterStereoShader.isValid() && skyboxStereoShader.isValid();
+        if (stereoActive) {
+            stereoRenderer->setSettings({ config.stereo.eyeSeparation, config.stereo.convergence });
+            stereoRenderer->setCamera(view, camera.Zoom, (float)(SCR_WIDTH / 2) / (float)SCR_HEIGHT, 0.1f, 100.0f);
+        }
+        
+        // Shading rates from the last frame's scene; the window-sized rate image does not
+        // fit the stereo eyes, so they shade every pixel
+        WaterSim::ShadingRateImage::Settings rateSettings = shadingRateImage->getSettings();
+        rateSettings.contrastThreshold = config.display.shadingRateContrast;
+        rateSettings.depthOfField = postProcessManager->isDOFEnabled();
+        rateSettings.focusDistance = postProcessManager->getFocusDistance();
+        rateSettings.focusRange = postProcessManager->getFocusRange();
+        shadingRateImage->setSettings(rateSettings);
+        shadingRateImage->setEnabled(config.display.variableRateShading);
+        const WaterSim::ShadingRateImage* sceneRates = stereoActive ? nullptr : shadingRateImage;
+        
+        // The scene's targets at the render size; the backbuffer and what is drawn over the
+        // post-processed frame at the window's
+        const WaterSim::FrameGraphTextureDesc screenColorDesc{ renderSize.x, renderSize.y, GL_RGBA16F };
+        const WaterSim::FrameGraphTextureDesc screenDepthDesc{ renderSize.x, renderSize.y, GL_DEPTH_COMPONENT24 };
+        const WaterSim::FrameGraphTextureDesc windowColorDesc{ (int)SCR_WIDTH, (int)SCR_HEIGHT, GL_RGBA16F };
+        
+        FrameGraph::Resource sceneColor = frameGraph->createTexture("Scene", screenColorDesc);
+        FrameGraph::Resource sceneDepth = frameGraph->createTexture("Scene depth", screenDepthDesc);
+        FrameGraph::Resource backbuffer = frameGraph->importTexture("Backbuffer", 0, windowColorDesc);
+        
+        // The fluid's targets follow the scene's; its depth pass splats the particles' motion
+        // for the resolve
+        if (WaterSim::SPHComputeSystem* fluid = simulationManager->getSPHComputeSystem()) {
+            fluid->onWindowResize(renderSize.x, renderSize.y);
+            fluid->setMotionVectors(temporalUpscale, temporalUpscaler->getViewProjection(),
+                                    temporalUpscaler->getPreviousViewProjection(), deltaTime);
+        }
+        
+        // The planar targets persist between their rate-limited refreshes, so they are imported
+        FrameGraph::Resource reflectionColor = FrameGraph::INVALID_RESOURCE;
+        FrameGraph::Resource refractionColor = FrameGraph::INVALID_RESOURCE;
+        FrameGraph::Resource probeColor = FrameGraph::INVALID_RESOURCE;
+        if (regularWater) {
+            // The probe sits over the middle of the water, its box the container with the
+            // open top raised far enough that rays out of it reach the sky unprojected
+            glm::vec3 containerHalfSize(container->getWidth() * 0.5f, container->getHeight() * 0.5f, container->getDepth() * 0.5f);
+            glm::vec3 probeBoxMin = container->getPosition() - containerHalfSize;
+            glm::vec3 probeBoxMax = container->getPosition() + containerHalfSize + glm::vec3(0.0f, 100.0f, 0.0f);
+            glm::vec3 probePosition(container->getPosition().x, currentWaterHeight + 1.0f, container->getPosition().z);
+            reflectionProbe->beginFrame(probePosition, probeBoxMin, probeBoxMax, sphere->getPosition(), skyboxTexture);
+            if (reflectionProbe->getTexture() != 0) {
+                probeColor = frameGraph->importTexture("Reflection probe", reflectionProbe->getTexture(),
+                    { reflectionProbe->getResolution(), reflectionProbe->getResolution(), GL_RGBA16F });
+            }
             
-            // Render sphere
-            sphere->render(sphereShader);
+            // With the probe holding the far field, the planar reflection draws the near field only
+            bool probeActive = reflectionProbe->getSettings().enabled && reflectionProbe->isValid();
+            reflectionRenderer->setNearFieldDistance(probeActive ? reflectionProbe->getSettings().farDistance : 0.0f);
+            reflectionRenderer->setLayeredRendering(reflectionRenderer->isLayeredRendering() && spherePlanarShader.isValid());
+            reflectionRenderer->beginFrame(camera, currentWaterHeight, sphere->getPosition());
+            reflectionColor = frameGraph->importTexture("Reflection", reflectionRenderer->getReflectionTexture(),
+                { reflectionRenderer->getTargetWidth(PLANAR_REFLECTION), reflectionRenderer->getTargetHeight(PLANAR_REFLECTION), GL_RGBA16F });
+            refractionColor = frameGraph->importTexture("Refraction", reflectionRenderer->getRefractionTexture(),
+                { reflectionRenderer->getTargetWidth(PLANAR_REFRACTION), reflectionRenderer->getTargetHeight(PLANAR_REFRACTION), GL_RGBA16F });
         }
         
-        // Render water simulation through simulation manager
-        if (simulationManager->getCurrentType() != WaterSim::SimulationType::NONE) {
-            // Only set up water shader for regular water surface
-            if (simulationManager->isRegularWaterActive() && isShaderProgramValid(waterShader)) {
-                // Set common shader uniforms for water rendering
-                glUseProgram(waterShader);
-                
-                // Set lighting uniforms
-                glUniform3f(glGetUniformLocation(waterShader, "viewPos"), camera.Position.x, camera.Position.y, camera.Position.z);
-                glUniform3f(glGetUniformLocation(waterShader, "lightPos"), 5.0f, 10.0f, 5.0f);
-                glUniform3f(glGetUniformLocation(waterShader, "lightColor"), 1.0f, 1.0f, 1.0f);
-                glUniform1f(glGetUniformLocation(waterShader, "ambientStrength"), 0.1f);
-                glUniform1f(glGetUniformLocation(waterShader, "specularStrength"), 0.5f);
-                glUniform1f(glGetUniformLocation(waterShader, "shininess"), 64.0f);
-                
-                // Set time for water animation and caustics
-                glUniform1f(glGetUniformLocation(waterShader, "time"), currentFrame);
-                // Check if any waves have non-zero amplitude
-                bool hasActiveWaves = false;
-                WaterSurface* waterSurface = simulationManager->getWaterSurface();
-                if (waterSurface) {
-                    for (const auto& wave : waterSurface->getWaves()) {
-                        if (std::abs(wave.amplitude) > 0.001f) {
-                            hasActiveWaves = true;
-                            break;
-                        }
+        // The SPH fluid's smoothed depth, drawn by its own pipeline in the scene pass
+        FrameGraph::Resource fluidDepth = FrameGraph::INVALID_RESOURCE;
+        if (sphSystem && sphSystem->getSmoothedDepthTexture() != 0) {
+            fluidDepth = frameGraph->importTexture("Fluid depth", sphSystem->getSmoothedDepthTexture(), screenColorDesc);
+        }
+        
+        // Ray tracing integration: the regular water grid, or the SPH fluid's own surface
+        const bool rayTraceWater = rayTracingEnabled && rayTracingManager && !stereoActive &&
+            ((regularWater && simulationManager->getWaterSurface()) ||
+             (sphSystem && (sphSystem->getSmoothedDepthTexture() != 0 || sphSystem->getSurfaceMeshBuffer() != 0)));
+        FrameGraph::Resource rayTraced = FrameGraph::INVALID_RESOURCE;
+        if (rayTracingManager) {
+            rayTraced = frameGraph->importTexture("Ray traced", rayTracingManager->getRayTracedTexture(), screenColorDesc);
+        }
+        
+        // 2. SHADOWS: the cached container layers that moved, the sphere and fluid every frame.
+        // The maps persist between frames, so they are imported
+        const WaterSim::FrameGraphTextureDesc shadowDesc{ shadowMapper->getSettings().resolution,
+                                                          shadowMapper->getSettings().resolution, GL_DEPTH_COMPONENT32F };
+        FrameGraph::Resource shadowStatic = frameGraph->importTexture("Shadow static", shadowMapper->getStaticTexture(), shadowDesc);
+        FrameGraph::Resource shadowDynamic = frameGraph->importTexture("Shadow dynamic", shadowMapper->getDynamicTexture(), shadowDesc);
+        frameGraph->addPass("Shadows",
+            [&](FrameGraph::Builder& builder) {
+                builder.write(shadowStatic, FrameGraphAccess::RENDERED);
+                builder.write(shadowDynamic, FrameGraphAccess::RENDERED);
+            },
+            [&](const FrameGraph::PassResources&) {
+                renderShadows(sphSystem);
+            });
+        
+        // Floor caustics of the raster water, on the frames the map redraws; the ray tracer
+        // has its own. The map persists between redraws, so it is imported
+        const bool rasterFloorCaustics = config.caustics.raster && regularWater && !rayTraceWater &&
+                                         simulationManager->getWaterSurface();
+        if (rasterFloorCaustics) {
+            subsystems.use(rasterCausticsSubsystem);
+        }
+        if (rasterCaustics) {
+            WaterSim::RasterCaustics::Settings causticSettings = rasterCaustics->getSettings();
+            causticSettings.enabled = config.caustics.raster;
+            causticSettings.resolution = config.caustics.resolution;
+            causticSettings.interval = config.caustics.interval;
+            rasterCaustics->setSettings(causticSettings);
+        }
+        FrameGraph::Resource causticMap = FrameGraph::INVALID_RESOURCE;
+        if (rasterCaustics && rasterCaustics->beginFrame(rasterFloorCaustics)) {
+            int causticSize = rasterCaustics->getResolution();
+            causticMap = frameGraph->importTexture("Caustic map", rasterCaustics->getTexture(),
+                                                   { causticSize, causticSize, GL_R16F });
+            frameGraph->addPass("Raster caustics",
+                [&](FrameGraph::Builder& builder) {
+                    builder.write(causticMap, FrameGraphAccess::RENDERED);
+                },
+                [&](const FrameGraph::PassResources&) {
+                    WaterSurfaceGeometry geometry = simulationManager->getWaterSurface()->getGeometry();
+                    addWaveState(geometry);
+                    // The shadows' light, from (5, 10, 5) toward the origin
+                    rasterCaustics->draw(geometry, glm::vec3(-5.0f, -10.0f, -5.0f), config.physics.floorLevel);
+                });
+        }
+        
+        // Light scattered in the water toward the camera, through the shadows and the floor
+        // caustics. The froxels persist for the reprojection, so they are imported
+        WaterSim::FroxelVolumetrics::Settings volumetricSettings = froxelVolumetrics->getSettings();
+        volumetricSettings.enabled = config.volumetrics.enabled;
+        volumetricSettings.maxDistance = config.volumetrics.maxDistance;
+        volumetricSettings.scattering = config.volumetrics.scattering;
+        volumetricSettings.absorption = config.volumetrics.absorption;
+        volumetricSettings.anisotropy = config.volumetrics.anisotropy;
+        volumetricSettings.intensity = config.volumetrics.intensity;
+        volumetricSettings.temporalBlend = config.volumetrics.temporalBlend;
+        froxelVolumetrics->setSettings(volumetricSettings);
+        FrameGraph::Resource froxels = FrameGraph::INVALID_RESOURCE;
+        if (config.volumetrics.enabled && regularWater && froxelVolumetrics->isReady()) {
+            froxels = frameGraph->importTexture("Froxels", froxelVolumetrics->getTexture(),
+                                                { WaterSim::FroxelVolumetrics::WIDTH, WaterSim::FroxelVolumetrics::HEIGHT, GL_RGBA16F });
+            frameGraph->addPass("Volumetrics",
+                [&](FrameGraph::Builder& builder) {
+                    builder.read(shadowStatic);
+                    builder.read(shadowDynamic);
+                    builder.read(causticMap);
+                    builder.write(froxels, FrameGraphAccess::IMAGE);
+                },
+                [&](const FrameGraph::PassResources&) {
+                    WaterSim::FroxelVolumetrics::Frame frame;
+                    frame.view = view;
+                    frame.projection = unjitteredProjection;
+                    frame.lightDirection = glm::vec3(-5.0f, -10.0f, -5.0f);
+                    glm::vec3 halfSize(container->getWidth() * 0.5f, container->getHeight() * 0.5f, container->getDepth() * 0.5f);
+                    frame.waterMin = container->getPosition() - halfSize;
+                    frame.waterMax = container->getPosition() + halfSize;
+                    frame.waterMax.y = std::min(frame.waterMax.y, currentWaterHeight);
+                    if (rasterCaustics && rasterCaustics->isDrawn()) {
+                        frame.causticMap = rasterCaustics->getTexture();
+                        frame.causticExtent = rasterCaustics->getExtent();
                     }
-                    
-                    // Set water color and transparency
-                    glm::vec3 waterColor = waterSurface->getColor();
-                    float transparency = waterSurface->getTransparency();
-                    glUniform3f(glGetUniformLocation(waterShader, "waterColor"), waterColor.r, waterColor.g, waterColor.b);
-                    glUniform1f(glGetUniformLocation(waterShader, "transparency"), transparency);
+                    frame.floorLevel = config.physics.floorLevel;
+                    froxelVolumetrics->update(frame, *shadowMapper);
+                    glState.invalidate();
+                });
+        } else {
+            froxelVolumetrics->resetHistory();
+        }
+        
+        // 3. REFLECTION PROBE FACE, on the frames one is stale, ahead of the planar passes
+        if (regularWater && reflectionProbe->needsUpdate()) {
+            frameGraph->addPass("Reflection probe",
+                [&](FrameGraph::Builder& builder) {
+                    builder.read(shadowStatic);
+                    builder.read(shadowDynamic);
+                    builder.write(probeColor, FrameGraphAccess::RENDERED);
+                },
+                [&](const FrameGraph::PassResources&) {
+                    reflectionProbe->beginFaceRender();
+                    renderProbeFace(currentWaterHeight);
+                    reflectionProbe->endFaceRender();
+                });
+        }
+        
+        // REFLECTION AND REFRACTION PASSES, only on the frames their targets refresh
+        if (regularWater && reflectionRenderer->isLayeredUpdate()) {
+            frameGraph->addPass("Planar layered",
+                [&](FrameGraph::Builder& builder) {
+                    builder.read(shadowStatic);
+                    builder.read(shadowDynamic);
+                    builder.write(reflectionColor, FrameGraphAccess::RENDERED);
+                    builder.write(refractionColor, FrameGraphAccess::RENDERED);
+                },
+                [&](const FrameGraph::PassResources&) {
+                    reflectionRenderer->beginLayeredRender(camera, currentWaterHeight);
+                    renderSceneLayered(camera, currentWaterHeight);
+                    reflectionRenderer->endLayeredRender();
+                });
+        } else if (regularWater) {
+            if (reflectionRenderer->needsUpdate(PLANAR_REFLECTION)) {
+                frameGraph->addPass("Reflection",
+                    [&](FrameGraph::Builder& builder) {
+                        builder.read(shadowStatic);
+                        builder.read(shadowDynamic);
+                        builder.write(reflectionColor, FrameGraphAccess::RENDERED);
+                    },
+                    [&](const FrameGraph::PassResources&) {
+                        reflectionRenderer->beginReflectionRender(camera, currentWaterHeight);
+                        renderScene(camera, currentWaterHeight, true, false);
+                        reflectionRenderer->endReflectionRender();
+                    });
+            }
+            
+            if (reflectionRenderer->needsUpdate(PLANAR_REFRACTION)) {
+                frameGraph->addPass("Refraction",
+                    [&](FrameGraph::Builder& builder) {
+                        builder.read(shadowStatic);
+                        builder.read(shadowDynamic);
+                        builder.write(refractionColor, FrameGraphAccess::RENDERED);
+                    },
+                    [&](const FrameGraph::PassResources&) {
+                        reflectionRenderer->beginRefractionRender(camera, currentWaterHeight);
+                        renderScene(camera, currentWaterHeight, false, true);
+                        reflectionRenderer->endRefractionRender();
+                    });
+            }
+        }
+        
+        // 5. OPAQUE SCENE: skybox, sphere and the active simulation
+        frameGraph->addPass("Scene",
+            [&](FrameGraph::Builder& builder) {
+                builder.write(sceneColor);
+                builder.write(sceneDepth);
+                builder.read(shadowStatic);
+                builder.read(shadowDynamic);
+                if (regularWater) {
+                    builder.read(reflectionColor);
+                    builder.read(refractionColor);
+                    builder.read(probeColor);
+                    builder.read(causticMap);
                 }
+                builder.write(fluidDepth, FrameGraphAccess::RENDERED);
+            },
+            [&](const FrameGraph::PassResources& resources) {
+                glClearColor(0.1f, 0.1f, 0.2f, 1.0f);
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
                 
-                // Only enable micro-waves if we have active waves or if explicitly enabled
-                bool shouldEnableMicroWaves = hasActiveWaves && enableMicroWaves;
-                glUniform1i(glGetUniformLocation(waterShader, "enableMicroWaves"), shouldEnableMicroWaves);
-                
-                // Set skybox texture
-                glActiveTexture(GL_TEXTURE0);
-                glBindTexture(GL_TEXTURE_CUBE_MAP, skyboxTexture);
-                glUniform1i(glGetUniformLocation(waterShader, "skybox"), 0);
+                // The passes above set GL directly; from here the main passes go through glState
+                lastFrameStateCalls = glState.getCounters();
+                glState.resetCounters();
+                glState.invalidate();
                 
-                // Set reflection and refraction textures
-                glActiveTexture(GL_TEXTURE1);
-                glBindTexture(GL_TEXTURE_2D, reflectionRenderer->getReflectionTexture());
-                glUniform1i(glGetUniformLocation(waterShader, "reflectionTexture"), 1);
+                updateFrameUniforms(view, projection, camera.Position, currentFrame);
                 
-                glActiveTexture(GL_TEXTURE2);
-                glBindTexture(GL_TEXTURE_2D, reflectionRenderer->getRefractionTexture());
-                glUniform1i(glGetUniformLocation(waterShader, "refractionTexture"), 2);
+                // Stereo draws the same calls with the multiview variants into both eyes, then
+                // lays the eyes out in the scene target
+                const WaterSim::GLShaderProgram& sceneSphereShader = stereoActive ? sphereStereoShader : sphereShader;
+                const WaterSim::GLShaderProgram& sceneRigidBodyShader = stereoActive ? rigidBodyStereoShader : rigidBodyShader;
+                if (stereoActive) {
+                    stereoRenderer->begin(SCR_WIDTH, SCR_HEIGHT, glm::vec4(0.1f, 0.1f, 0.2f, 1.0f));
+                    updateFrameUniforms(view, projection, camera.Position, currentFrame,
+                                        stereoRenderer->getViews(), stereoRenderer->getProjections());
+                }
                 
-                // Bind caustic texture
-                glActiveTexture(GL_TEXTURE3);
-                glBindTexture(GL_TEXTURE_2D, causticTexture);
-                glUniform1i(glGetUniformLocation(waterShader, "causticTex"), 3);
+                // Depth prepass: the opaque surfaces' depth alone, then their shading tests
+                // equal-or-less without writing, so each pixel is shaded once. Both programs
+                // of everything drawn must be ready, or a surface would go without depth. Its
+                // programs are mono, so stereo goes without
+                bool bodiesReady = rigidBodies->getBodyCount() == 0 ||
+                                   (isShaderProgramValid(rigidBodyShader) && isShaderProgramValid(rigidBodyDepthShader));
+                if (config.display.depthPrepass && !stereoActive && isShaderProgramValid(sphereShader) &&
+                    isShaderProgramValid(sphereDepthShader) && bodiesReady) {
+                    renderDepthPrepass();
+                    glState.depthFunc(GL_LEQUAL);
+                    glState.depthMask(false);
+                }
                 
-                // Bind tile texture
-                glActiveTexture(GL_TEXTURE4);
-                glBindTexture(GL_TEXTURE_2D, tileTexture);
-                glUniform1i(glGetUniformLocation(waterShader, "tileTexture"), 4);
+                // First render the sphere
+                if (isShaderProgramValid(sceneSphereShader)) {
+                    glState.useProgram(sceneSphereShader);
+                    
+                    // Set sphere shader uniforms (camera and light are in the frame block)
+                    glm::mat4 model = glm::mat4(1.0f);
+                    model = glm::translate(model, sphere->getPosition());
+                    sceneSphereShader.setMat4("model", model);
+                    
+                    // Set lighting uniforms
+                    sceneSphereShader.setFloat("ambientStrength", 0.1f);
+                    sceneSphereShader.setFloat("specularStrength", 0.8f); // Moderate for realistic metal
+                    sceneSphereShader.setFloat("shininess", 128.0f); // High but not excessive for metal
+                    
+                    // Enable texture for steel appearance
+                    sceneSphereShader.setInt("useTexture", 1);
+                    bindMaterialTexture(sceneSphereShader, "sphereTexture", GL_TEXTURE_2D, steelTexture, 0);
+                    
+                    // Enable reflections for mirror-like appearance
+                    sceneSphereShader.setInt("enableReflections", enableSphereReflections ? 1 : 0);
+                    sceneSphereShader.setFloat("reflectivity", sphereReflectivity);
+                    
+                    // Bind skybox for environment reflections
+                    bindMaterialTexture(sceneSphereShader, "skybox", GL_TEXTURE_CUBE_MAP, skyboxTexture, 1);
+                    sceneSphereShader.setFloat("roughness", sphereRoughness);
+                    skybox->setEnvironmentUniforms(sceneSphereShader, 2);
+                    glState.invalidateTextures();
+                    
+                    // Render sphere
+                    sphere->render(sceneSphereShader);
+                    glState.invalidateVertexArray();
+                }
                 
-                // Bind wave height map texture
-                glActiveTexture(GL_TEXTURE5);
-                waveHeightMap->bind(5);
-                glUniform1i(glGetUniformLocation(waterShader, "waveHeightMap"), 5);
+                // All the rigid bodies, with the sphere's lighting and a painted finish
+                if (rigidBodies->getBodyCount() > 0 && isShaderProgramValid(sceneRigidBodyShader)) {
+                    glState.useProgram(sceneRigidBodyShader);
+                    sceneRigidBodyShader.setFloat("ambientStrength", 0.2f);
+                    sceneRigidBodyShader.setFloat("specularStrength", 0.3f);
+                    sceneRigidBodyShader.setFloat("shininess", 32.0f);
+                    sceneRigidBodyShader.setInt("useTexture", 0);
+                    sceneRigidBodyShader.setVec3("sphereColor", glm::vec3(0.72f, 0.52f, 0.32f));
+                    sceneRigidBodyShader.setInt("enableReflections", 0);
+                    sceneRigidBodyShader.setInt("sphereTexture", 0);  // Unsampled, but kept off the cube map's unit
+                    sceneRigidBodyShader.setInt("skybox", 1);
+                    skybox->setEnvironmentUniforms(sceneRigidBodyShader, 2);
+                    glState.invalidateTextures();
+                    
+                    rigidBodies->render(sceneRigidBodyShader);
+                    glState.invalidate();
+                }
+                glState.depthFunc(GL_LESS);
+                glState.depthMask(true);
                 
-                // Render through simulation manager for regular water
-                simulationManager->render(view, projection, waterShader, rayTracingEnabled);
+                // The skybox after the opaque surfaces: at depth 1 with GL_LEQUAL, only the sky
+                // they leave uncovered is shaded. The water blends over it, so it follows
+                if (skybox && stereoActive) {
+                    skybox->renderWith(skyboxStereoShader);
+                    glState.invalidate();
+                } else if (skybox) {
+                    skybox->render(view, projection);
+                    glState.invalidate();
+                }
                 
-                // Render foam particles if regular water is active
-                if (isShaderProgramValid(foamShader)) {
-                    WaterSurface* waterSurface = simulationManager->getWaterSurface();
-                    if (waterSurface) {
-                        waterSurface->renderFoam(foamShader, view, projection);
+                // Render water simulation through simulation manager
+                if (simulationManager->getCurrentType() != WaterSim::SimulationType::NONE) {
+                    // Only set up water shader for regular water surface
+                    if (simulationManager->isRegularWaterActive() && isShaderProgramValid(waterShader)) {
+                        // The tessellated program when the surface draws patches
+                        WaterSurface* waterSurface = simulationManager->getWaterSurface();
+                        const WaterSim::GLShaderProgram* surfaceShader = stereoActive ? &waterStereoShader : &waterShader;
+                        if (!stereoActive && waterSurface && waterSurface->isTessellationActive()) {
+                            if (isShaderProgramValid(waterTessShader)) {
+                                surfaceShader = &waterTessShader;
+                            } else {
+                                waterSurface->setTessellation(false);
+                            }
+                        }
+                        
+                        // Set common shader uniforms for water rendering
+                        glState.useProgram(*surfaceShader);
+                        
+                        // Set lighting uniforms
+                        surfaceShader->setFloat("ambientStrength", 0.1f);
+                        surfaceShader->setFloat("specularStrength", 0.5f);
+                        surfaceShader->setFloat("shininess", 64.0f);
+                        
+                        // Check if any waves have non-zero amplitude
+                        bool hasActiveWaves = false;
+                        if (waterSurface) {
+                            for (const auto& wave : waterSurface->getWaves()) {
+                                if (std::abs(wave.amplitude) > 0.001f) {
+                                    hasActiveWaves = true;
+                                    break;
+                                }
+                            }
+                            
+                            // Set water color and transparency
+                            glm::vec3 waterColor = waterSurface->getColor();
+                            float transparency = waterSurface->getTransparency();
+                            surfaceShader->setVec3("waterColor", waterColor);
+                            surfaceShader->setFloat("transparency", transparency);
+                        }
+                        
+                        // Only enable micro-waves if we have active waves or if explicitly enabled
+                        bool shouldEnableMicroWaves = hasActiveWaves && enableMicroWaves;
+                        surfaceShader->setInt("enableMicroWaves", shouldEnableMicroWaves);
+                        
+                        // Set skybox texture
+                        bindMaterialTexture(*surfaceShader, "skybox", GL_TEXTURE_CUBE_MAP, skyboxTexture, 0);
+                        skybox->setEnvironmentUniforms(*surfaceShader, 9); // Past the surface's own units 6-8
+                        reflectionProbe->setUniforms(*surfaceShader, 11); // Past the caustic map, short of the shadows
+                        if (rasterCaustics) {
+                            rasterCaustics->applyToReceiver(*surfaceShader, 10);
+                        } else {
+                            surfaceShader->setBool("causticMapEnabled", false);
+                        }
+                        glState.invalidateTextures();
+                        
+                        // Set reflection and refraction textures; the reflection is reprojected
+                        // from its last refresh
+                        glState.bindTexture(1, GL_TEXTURE_2D, resources.getTexture(reflectionColor));
+                        surfaceShader->setInt("reflectionTexture", 1);
+                        
+                        glState.bindTexture(2, GL_TEXTURE_2D, resources.getTexture(refractionColor));
+                        surfaceShader->setInt("refractionTexture", 2);
+                        surfaceShader->setMat4("reflectionViewProjection", reflectionRenderer->getViewProjection(PLANAR_REFLECTION));
+                        
+                        // Bind caustic texture
+                        bindMaterialTexture(*surfaceShader, "causticTex", GL_TEXTURE_2D, causticTexture, 3);
+                        
+                        // Bind tile texture
+                        bindMaterialTexture(*surfaceShader, "tileTexture", GL_TEXTURE_2D, tileTexture, 4);
+                        
+                        // Bind wave height map texture
+                        bindMaterialTexture(*surfaceShader, "waveHeightMap", GL_TEXTURE_2D, waveState->getHeightTexture(), 5);
+                        
+                        // Render through simulation manager for regular water; its foam is transparent
+                        simulationManager->setShadingRateImage(sceneRates);
+                        simulationManager->render(view, projection, *surfaceShader, rayTracingEnabled);
+                        simulationManager->setShadingRateImage(nullptr);
+                        glState.invalidate();
                     }
                 }
-            } else if (simulationManager->isSPHComputeActive()) {
-                // Render SPH particles with their own rendering pipeline
-                simulationManager->render(view, projection, 0, false);
-            }
+                
+                // SPH particles with their own rendering pipeline, over the sky
+                if (simulationManager->isSPHRenderActive()) {
+                    simulationManager->setShadingRateImage(sceneRates);
+                    simulationManager->render(view, projection, 0, false);
+                    simulationManager->setShadingRateImage(nullptr);
+                    glState.invalidate();
+                }
+                
+                // Both eyes into the scene target; the passes after it see one side-by-side frame
+                if (stereoActive) {
+                    stereoRenderer->resolve(resources.getFramebuffer());
+                    glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
+                    updateFrameUniforms(view, projection, camera.Position, currentFrame);
+                    glState.invalidate();
+                }
+            });
+        
+        // The depth under the cursor, before the transparent pass; lands a frame or two later.
+        // A side-by-side stereo frame does not unproject through the mono camera
+        if (!stereoActive) {
+            frameGraph->addPass("Picking",
+                [&](FrameGraph::Builder& builder) {
+                    builder.read(sceneDepth);
+                    builder.setSideEffect();
+                },
+                [&](const FrameGraph::PassResources& resources) {
+                    gpuPicker->capture(resources.getTexture(sceneDepth), renderSize);
+                });
         }
         
-        // Ray tracing integration for regular water surface
-        if (rayTracingEnabled && rayTracingManager && simulationManager->isRegularWaterActive()) {
-            WaterSurface* waterSurface = simulationManager->getWaterSurface();
-            if (waterSurface) {
-                // Get water surface geometry data for ray tracing
-                GLuint waterVAO = waterSurface->getVAO();
-                int waterVertexCount = waterSurface->getVertexCount();
+        // 6. RAY TRACING of the water surface into the tracer's own output
+        frameGraph->addPass("Ray tracing",
+            [&](FrameGraph::Builder& builder) {
+                builder.read(fluidDepth);
+                builder.write(rayTraced, FrameGraphAccess::IMAGE);
+            },
+            [&](const FrameGraph::PassResources&) {
+                if (regularWater) {
+                    WaterSurface* waterSurface = simulationManager->getWaterSurface();
+                    
+                    // The surface's own grid and textures, with this frame's wave state
+                    WaterSurfaceGeometry geometry = waterSurface->getGeometry();
+                    addWaveState(geometry);
+                    rayTracingManager->setWaterSurface(geometry);
+                } else if (sphSystem->getSmoothedDepthTexture() != 0) {
+                    // The screen-space pipeline's smoothed depth from the scene pass
+                    rayTracingManager->setFluidDepthSurface(sphSystem->getSmoothedDepthTexture());
+                } else {
+                    // The marching cubes mesh of the scene pass
+                    rayTracingManager->setFluidMeshSurface(sphSystem->getSurfaceMeshBuffer());
+                }
                 
-                // Set water geometry for G-buffer rendering
-                rayTracingManager->setWaterGeometry(waterVAO, waterVertexCount);
+                // Off-screen geometry the reflections can still hit: the container and sphere
+                glm::vec3 containerHalfSize(container->getWidth() * 0.5f, container->getHeight() * 0.5f, container->getDepth() * 0.5f);
+                rayTracingManager->setSceneProxies(container->getPosition() - containerHalfSize, container->getPosition() + containerHalfSize,
+                                                   sphere->getPosition(), sphere->getRadius(), sphere->getColor());
+                rayTracingManager->setEnvironmentMap(skybox->getPrefilteredTexture() ? skybox->getPrefilteredTexture() : skyboxTexture);
+                rayTracingManager->setShadingRateImage(shadingRateImage->getTexture(), shadingRateImage->getTileSize());
                 
                 // Perform ray traced water rendering
                 glm::vec3 lightPos(5.0f, 10.0f, 5.0f);
                 rayTracingManager->renderWaterRayTraced(view, projection, camera.Position, lightPos);
-                
-                // Restore OpenGL state after ray tracing
-                glBindFramebuffer(GL_FRAMEBUFFER, 0); // Ensure main framebuffer is bound
-                glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT); // Restore viewport
-                glUseProgram(0); // Clear shader program
-                glBindVertexArray(0); // Clear VAO binding
-                
-                // Restore depth and blending state for normal rendering
-                glEnable(GL_DEPTH_TEST);
-                glDepthFunc(GL_LESS);
-                glDepthMask(GL_TRUE);
-                glEnable(GL_BLEND);
-                glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-                
-                // Reset texture bindings that might be affected by compute shaders
-                for (int i = 0; i < 8; ++i) {
-                    glActiveTexture(GL_TEXTURE0 + i);
-                    glBindTexture(GL_TEXTURE_2D, 0);
-                    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+            });
+        
+        // 7. TRANSPARENT SCENE: the glass, water volume, foam and SPH spray accumulated in
+        // any order and resolved over the opaque scene. The ray traced water goes over it in
+        // the final composite
+        const WaterSim::FrameGraphTextureDesc oitAccumDesc{ renderSize.x, renderSize.y, WaterSim::WeightedOIT::ACCUM_FORMAT };
+        const WaterSim::FrameGraphTextureDesc oitRevealageDesc{ renderSize.x, renderSize.y, WaterSim::WeightedOIT::REVEALAGE_FORMAT };
+        FrameGraph::Resource oitAccum = frameGraph->createTexture("OIT accum", oitAccumDesc);
+        FrameGraph::Resource oitRevealage = frameGraph->createTexture("OIT revealage", oitRevealageDesc);
+        
+        frameGraph->addPass("Transparent",
+            [&](FrameGraph::Builder& builder) {
+                builder.write(oitAccum);
+                builder.write(oitRevealage);
+                builder.read(sceneDepth, FrameGraphAccess::ATTACHMENT);
+                builder.read(shadowStatic);
+                builder.read(shadowDynamic);
+                if (regularWater) {
+                    builder.read(reflectionColor);
+                    builder.read(refractionColor);
+                    builder.read(causticMap);
                 }
-                glActiveTexture(GL_TEXTURE0); // Reset to texture unit 0
+            },
+            [&](const FrameGraph::PassResources& resources) {
+                // Depth tested, not written, and additive: the draws below need no order
+                weightedOIT->beginAccumulation();
+                glState.invalidate();
                 
-                // Blend ray tracing effects over the existing scene
-                GLuint rayTracedTexture = rayTracingManager->getRayTracedTexture();
-                if (rayTracedTexture != 0) {
-                    // Enable alpha blending for ray traced effects
-                    glEnable(GL_BLEND);
-                    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA); // Alpha blending
-                    glDisable(GL_DEPTH_TEST);
+                // Stereo draws the transparent scene once per eye, into its half of the targets
+                int eyePasses = stereoActive ? WaterSim::StereoRenderer::EYE_COUNT : 1;
+                for (int eye = 0; eye < eyePasses; eye++) {
+                    glm::mat4 passView = view;
+                    glm::mat4 passProjection = projection;
+                    if (stereoActive) {
+                        passView = stereoRenderer->getView(eye);
+                        passProjection = stereoRenderer->getProjection(eye);
+                        glViewport(eye * stereoRenderer->getEyeWidth(), 0, stereoRenderer->getEyeWidth(), stereoRenderer->getEyeHeight());
+                        updateFrameUniforms(passView, passProjection, camera.Position, currentFrame);
+                    }
                     
-                    // Apply ray traced effects as enhancement over existing scene
-                    postProcessManager->applyPostProcessing(rayTracedTexture);
+                    if (isShaderProgramValid(glassShader)) {
+                        glState.useProgram(glassShader);
                     
-                    glDisable(GL_BLEND);
-                    glEnable(GL_DEPTH_TEST);
+                        // Set glass shader uniforms (camera and light are in the frame block)
+                        glm::mat4 model = glm::mat4(1.0f);
+                        glassShader.setMat4("model", model);
                     
-                    static int debugFrame = 0;
-                    debugFrame++;
-                    if (debugFrame == 1 || debugFrame % 60 == 0) {
-                        std::cout << "Ray traced water enhanced: " << rayTracedTexture << std::endl;
+                        // Set skybox texture for glass shader
+                        bindMaterialTexture(glassShader, "skybox", GL_TEXTURE_CUBE_MAP, skyboxTexture, 0);
+                        skybox->setEnvironmentUniforms(glassShader, 1);
+                        glState.invalidateTextures();
+                    
+                        // Set lighting uniforms
+                        glassShader.setFloat("ambientStrength", 0.2f);
+                        glassShader.setFloat("specularStrength", 0.5f);
+                        glassShader.setFloat("shininess", 32.0f);
+                    
+                        // Set glass properties - increase transparency
+                        glassShader.setFloat("glassTransparency", 0.15f); // More transparent
+                        glassShader.setVec3("glassColor", glm::vec3(0.95f, 0.95f, 1.0f)); // Slightly bluer
+                        glassShader.setFloat("glassRefractionIndex", 1.05f); // Less refraction
+                    
+                        container->render(glassShader);
+                        glState.invalidateVertexArray();
+                    }
+                    
+                    // Render water volume only if regular water is active
+                    if (simulationManager->isRegularWaterActive() && isShaderProgramValid(waterVolumeShader)) {
+                        glState.useProgram(waterVolumeShader);
+                        glState.bindVertexArray(waterVolumeVAO);
+                    
+                        // The top follows the water height and the surface's displacement in water.vs
+                        glm::mat4 model = glm::mat4(1.0f);
+                        waterVolumeShader.setMat4("model", model);
+                        waterVolumeShader.setFloat("volumeHeight", simulationManager->getWaterHeight());
+                        WaterSurface* waterSurface = simulationManager->getWaterSurface();
+                        if (waterSurface) {
+                            waterSurface->bindDisplacement(waterVolumeShader);
+                        }
+                    
+                        // Set skybox texture
+                        bindMaterialTexture(waterVolumeShader, "skybox", GL_TEXTURE_CUBE_MAP, skyboxTexture, 0);
+                        skybox->setEnvironmentUniforms(waterVolumeShader, 9);
+                        reflectionProbe->setUniforms(waterVolumeShader, 11);
+                        if (rasterCaustics) {
+                            rasterCaustics->applyToReceiver(waterVolumeShader, 10);
+                        } else {
+                            waterVolumeShader.setBool("causticMapEnabled", false);
+                        }
+                        glState.invalidateTextures();
+                    
+                        // The surface pass's screen textures; the glass pass reuses unit 1 in between
+                        glState.bindTexture(1, GL_TEXTURE_2D, resources.getTexture(reflectionColor));
+                        waterVolumeShader.setInt("reflectionTexture", 1);
+                        glState.bindTexture(2, GL_TEXTURE_2D, resources.getTexture(refractionColor));
+                        waterVolumeShader.setInt("refractionTexture", 2);
+                        waterVolumeShader.setMat4("reflectionViewProjection", reflectionRenderer->getViewProjection(PLANAR_REFLECTION));
+                        bindMaterialTexture(waterVolumeShader, "waveHeightMap", GL_TEXTURE_2D, waveState->getHeightTexture(), 5);
+                    
+                        // Check if any waves have non-zero amplitude for volume rendering
+                        bool hasActiveWavesForVolume = false;
+                        if (waterSurface) {
+                            for (const auto& wave : waterSurface->getWaves()) {
+                                if (std::abs(wave.amplitude) > 0.001f) {
+                                    hasActiveWavesForVolume = true;
+                                    break;
+                                }
+                            }
+                        }
+                    
+                        // Only enable micro-waves if we have active waves or if explicitly enabled
+                        bool shouldEnableMicroWavesForVolume = hasActiveWavesForVolume && enableMicroWaves;
+                        waterVolumeShader.setInt("enableMicroWaves", shouldEnableMicroWavesForVolume);
+                    
+                        // Set water properties - make water volume more visible but still transparent
+                        glm::vec3 waterColor(0.05f, 0.3f, 0.5f); // Default water color
+                        float transparency = 0.9f; // Default transparency
+                        if (waterSurface) {
+                            waterColor = waterSurface->getColor();
+                            transparency = waterSurface->getTransparency();
+                        }
+                        glm::vec3 volumeColor = waterColor * 0.9f; // Slightly less saturated for better transparency
+                        float volumeTransparency = std::min(transparency * 2.0f, 0.95f); // Higher transparency
+                    
+                        waterVolumeShader.setVec3("waterColor", volumeColor);
+                        waterVolumeShader.setFloat("transparency", volumeTransparency);
+                    
+                        // Set additional lighting parameters for crystal clear water
+                        waterVolumeShader.setFloat("ambientStrength", 0.2f); // Lower ambient for clearer water
+                        waterVolumeShader.setFloat("specularStrength", 0.4f); // Moderate specular for realistic water
+                    
+                        // Bind caustic texture
+                        bindMaterialTexture(waterVolumeShader, "causticTex", GL_TEXTURE_2D, causticTexture, 3);
+                    
+                        // Bind tile texture
+                        bindMaterialTexture(waterVolumeShader, "tileTexture", GL_TEXTURE_2D, tileTexture, 4);
+                    
+                        // Draw the water volume, its near side only
+                        glState.setEnabled(GL_CULL_FACE, true);
+                        glDrawElements(GL_TRIANGLES, waterVolumeIndices.size(), GL_UNSIGNED_INT, 0);
+                        glState.setEnabled(GL_CULL_FACE, false);
+                    
+                        glState.bindVertexArray(0);
+                    }
+                    
+                    // Foam over the regular water, and the SPH system's spray and container
+                    if (simulationManager->isRegularWaterActive() && isShaderProgramValid(foamShader)) {
+                        WaterSurface* waterSurface = simulationManager->getWaterSurface();
+                        if (waterSurface) {
+                            waterSurface->renderFoam(foamShader);
+                        }
+                    }
+                    if (sphSystem) {
+                        sphSystem->renderTransparent(passView, passProjection);
                     }
                 }
-            }
-        }
-        
-        // Disable depth writing for transparent glass
-        glDepthMask(GL_FALSE);
-        
-        // Enable proper culling and blending for the glass
-        glDisable(GL_CULL_FACE);  // Don't cull faces for glass to see both sides
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);  // Standard transparency blending
+                if (stereoActive) {
+                    glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
+                    updateFrameUniforms(view, projection, camera.Position, currentFrame);
+                }
+                
+                weightedOIT->endAccumulation();
+                glState.invalidate();
+            });
         
-        // Render the glass container last
-        if (isShaderProgramValid(glassShader)) {
-            // Debug output for glass rendering when ray tracing is enabled
-            static int frameCount = 0;
-            frameCount++;
-            if (rayTracingEnabled && (frameCount == 1 || frameCount % 60 == 0)) {
-                std::cout << "Rendering glass container with ray tracing enabled (frame " << frameCount << ")" << std::endl;
-            }
-            
-            glUseProgram(glassShader);
-            
-            // Set glass shader uniforms
-            glUniformMatrix4fv(glGetUniformLocation(glassShader, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
-            glUniformMatrix4fv(glGetUniformLocation(glassShader, "view"), 1, GL_FALSE, glm::value_ptr(view));
+        frameGraph->addPass("Transparent resolve",
+            [&](FrameGraph::Builder& builder) {
+                builder.read(sceneColor, FrameGraphAccess::ATTACHMENT);
+                builder.write(sceneColor);
+                builder.read(oitAccum);
+                builder.read(oitRevealage);
+            },
+            [&](const FrameGraph::PassResources& resources) {
+                weightedOIT->composite(resources.getTexture(oitAccum), resources.getTexture(oitRevealage));
+                glState.invalidate();
+            });
         
-            glm::mat4 model = glm::mat4(1.0f);
-            model = glm::translate(model, glm::vec3(0.0f, 0.0f, 0.0f));
-            glUniformMatrix4fv(glGetUniformLocation(glassShader, "model"), 1, GL_FALSE, glm::value_ptr(model));
-            
-            // Set skybox texture for glass shader
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_CUBE_MAP, skyboxTexture);
-            glUniform1i(glGetUniformLocation(glassShader, "skybox"), 0);
-            
-            // Set lighting uniforms
-            glUniform3f(glGetUniformLocation(glassShader, "viewPos"), camera.Position.x, camera.Position.y, camera.Position.z);
-            glUniform3f(glGetUniformLocation(glassShader, "lightPos"), 5.0f, 10.0f, 5.0f);
-            glUniform3f(glGetUniformLocation(glassShader, "lightColor"), 1.0f, 1.0f, 1.0f);
-            glUniform1f(glGetUniformLocation(glassShader, "ambientStrength"), 0.2f);
-            glUniform1f(glGetUniformLocation(glassShader, "specularStrength"), 0.5f);
-            glUniform1f(glGetUniformLocation(glassShader, "shininess"), 32.0f);
-            
-            // Set glass properties - increase transparency
-            glUniform1f(glGetUniformLocation(glassShader, "glassTransparency"), 0.15f); // More transparent
-            glUniform3f(glGetUniformLocation(glassShader, "glassColor"), 0.95f, 0.95f, 1.0f); // Slightly bluer
-            glUniform1f(glGetUniformLocation(glassShader, "glassRefractionIndex"), 1.05f); // Less refraction
-            
-            // Render container
-            container->render(glassShader);
+        // The finished scene's tiles classified into the next frame's shading rates
+        if (shadingRateImage->isEnabled()) {
+            frameGraph->addPass("Shading rate",
+                [&](FrameGraph::Builder& builder) {
+                    builder.read(sceneColor);
+                    builder.read(sceneDepth);
+                    builder.setSideEffect();
+                },
+                [&](const FrameGraph::PassResources& resources) {
+                    shadingRateImage->build(resources.getTexture(sceneColor), resources.getTexture(sceneDepth));
+                    glState.invalidate();
+                });
         }
         
-        // Re-enable depth writing and culling for solid objects
-        glDepthMask(GL_TRUE);
-        glEnable(GL_CULL_FACE);
-        
-        // Render water volume only if regular water is active
-        if (simulationManager->isRegularWaterActive() && isShaderProgramValid(waterShader)) {
-            glUseProgram(waterShader);
-            glBindVertexArray(waterVolumeVAO);
-            
-            // Update water volume top vertices based on current water height
-            std::vector<float> updatedVertices = waterVolumeVertices;
-            // Set Y position for top vertices (indices 4-7)
-            float waterHeight = simulationManager->getWaterHeight();
-            for (int i = 4; i < 8; i++) {
-                updatedVertices[i * 8 + 1] = waterHeight; // Y coordinate
-            }
-            
-            // Update the VBO
-            glBindBuffer(GL_ARRAY_BUFFER, waterVolumeVBO);
-            glBufferSubData(GL_ARRAY_BUFFER, 0, updatedVertices.size() * sizeof(float), updatedVertices.data());
-            
-            // Apply same uniforms as water surface
-            glUniformMatrix4fv(glGetUniformLocation(waterShader, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
-            glUniformMatrix4fv(glGetUniformLocation(waterShader, "view"), 1, GL_FALSE, glm::value_ptr(view));
-            
-            glm::mat4 model = glm::mat4(1.0f);
-            glUniformMatrix4fv(glGetUniformLocation(waterShader, "model"), 1, GL_FALSE, glm::value_ptr(model));
-            
-            // Set skybox texture
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_CUBE_MAP, skyboxTexture);
-            glUniform1i(glGetUniformLocation(waterShader, "skybox"), 0);
-            
-            // Check if any waves have non-zero amplitude for volume rendering
-            bool hasActiveWavesForVolume = false;
-            WaterSurface* waterSurface = simulationManager->getWaterSurface();
-            if (waterSurface) {
-                for (const auto& wave : waterSurface->getWaves()) {
-                    if (std::abs(wave.amplitude) > 0.001f) {
-                        hasActiveWavesForVolume = true;
-                        break;
+        // 8. POST-PROCESSING of the scene into the backbuffer, upscaled first into the
+        // window-sized history when the scene rendered jittered. The history persists between
+        // frames and alternates, so the resolve runs inside the pass that reads it
+        frameGraph->addPass("Post-process",
+            [&](FrameGraph::Builder& builder) {
+                builder.read(sceneColor);
+                builder.read(sceneDepth);
+                builder.read(froxels);
+                if (rayTraceWater) {
+                    builder.read(rayTraced);
+                }
+                if (temporalUpscale) {
+                    builder.read(fluidDepth);
+                }
+                builder.write(backbuffer);
+                builder.setSideEffect();
+            },
+            [&](const FrameGraph::PassResources& resources) {
+                GLuint color = resources.getTexture(sceneColor);
+                if (temporalUpscale) {
+                    WaterSim::TemporalUpscaler::Inputs inputs;
+                    inputs.color = color;
+                    inputs.depth = resources.getTexture(sceneDepth);
+                    if (sphSystem && sphSystem->getSmoothedDepthTexture() != 0) {
+                        inputs.fluidDepth = sphSystem->getSmoothedDepthTexture();
+                        inputs.fluidMotion = sphSystem->getMotionTexture();
                     }
+                    inputs.sphere = glm::vec4(sphere->getPosition(), sphere->getRadius());
+                    inputs.previousSphereCenter = previousSphereCenter;
+                    GLuint upscaled = temporalUpscaler->resolve(inputs);
+                    if (upscaled != 0) color = upscaled;
+                    glState.invalidate();
                 }
-            }
-            
-            // Only enable micro-waves if we have active waves or if explicitly enabled
-            bool shouldEnableMicroWavesForVolume = hasActiveWavesForVolume && enableMicroWaves;
-            glUniform1i(glGetUniformLocation(waterShader, "enableMicroWaves"), shouldEnableMicroWavesForVolume);
-            
-            // Set water properties - make water volume more visible but still transparent
-            glm::vec3 waterColor(0.05f, 0.3f, 0.5f); // Default water color
-            float transparency = 0.9f; // Default transparency
-            if (waterSurface) {
-                waterColor = waterSurface->getColor();
-                transparency = waterSurface->getTransparency();
-            }
-            glm::vec3 volumeColor = waterColor * 0.9f; // Slightly less saturated for better transparency
-            float volumeTransparency = std::min(transparency * 2.0f, 0.95f); // Higher transparency
-            
-            glUniform3f(glGetUniformLocation(waterShader, "waterColor"), volumeColor.r, volumeColor.g, volumeColor.b);
-            glUniform1f(glGetUniformLocation(waterShader, "transparency"), volumeTransparency);
-            
-            // Set additional lighting parameters for crystal clear water
-            glUniform1f(glGetUniformLocation(waterShader, "ambientStrength"), 0.2f); // Lower ambient for clearer water
-            glUniform1f(glGetUniformLocation(waterShader, "specularStrength"), 0.4f); // Moderate specular for realistic water
-            
-            // Add time for water animation and caustics
-            glUniform1f(glGetUniformLocation(waterShader, "time"), currentFrame);
-            
-            // Bind caustic texture
-            glActiveTexture(GL_TEXTURE3);
-            glBindTexture(GL_TEXTURE_2D, causticTexture);
-            glUniform1i(glGetUniformLocation(waterShader, "causticTex"), 3);
-            
-            // Bind tile texture
-            glActiveTexture(GL_TEXTURE4);
-            glBindTexture(GL_TEXTURE_2D, tileTexture);
-            glUniform1i(glGetUniformLocation(waterShader, "tileTexture"), 4);
-            
-            // Draw the water volume
-            glDrawElements(GL_TRIANGLES, waterVolumeIndices.size(), GL_UNSIGNED_INT, 0);
-            
-            glBindVertexArray(0);
-        }
+                postProcessManager->setVolumetricFroxels(froxels != FrameGraph::INVALID_RESOURCE ? froxelVolumetrics->getTexture() : 0,
+                                                         WaterSim::FroxelVolumetrics::NEAR_DEPTH,
+                                                         froxelVolumetrics->getSettings().maxDistance);
+                GLuint rayTracedColor = rayTraceWater && rayTracingManager->getRayTracedTexture() != 0
+                                        ? resources.getTexture(rayTraced) : 0;
+                postProcessManager->applyPostProcessing(color, resources.getTexture(sceneDepth), rayTracedColor);
+            });
         
-        // Note: Sphere and container are already rendered above, no need to render again
-        
-        // Unbind main scene framebuffer
-        mainSceneFBO->unbind();
-        
-        // 5. COMPOSITE RAY TRACED RESULTS
-        if (rayTracingEnabled && rayTracingManager) {
-            // The ray traced results are already available in the ray tracing manager
-            // They will be composited during post-processing or directly rendered
+        // Recorded before the UI is drawn over the frame; the readback completes frames later
+        if (frameCapture->isRecording()) {
+            frameGraph->addPass("Capture",
+                [&](FrameGraph::Builder& builder) {
+                    builder.read(backbuffer, FrameGraphAccess::ATTACHMENT);
+                    builder.setSideEffect();
+                },
+                [&](const FrameGraph::PassResources&) {
+                    glReadBuffer(GL_BACK);
+                    frameCapture->capture(SCR_WIDTH, SCR_HEIGHT);
+                });
         }
         
-        // 6. APPLY POST-PROCESSING EFFECTS
-        // Note: Don't clear here! We want to render the post-processed scene
-        
-        // Apply post-processing to the main scene
-        postProcessManager->applyPostProcessing(
-            mainSceneFBO->getColorTexture(),
-            mainSceneFBO->getDepthTexture()
-        );
-        
-        // Start the Dear ImGui frame
-        ImGui_ImplOpenGL3_NewFrame();
-        ImGui_ImplGlfw_NewFrame();
-        ImGui::NewFrame();
+        // 9. USER INTERFACE
+        frameGraph->addPass("UI",
+            [&](FrameGraph::Builder& builder) {
+                builder.write(backbuffer);
+                builder.setSideEffect();
+            },
+            [&](const FrameGraph::PassResources&) {
+                // The panels are rebuilt on input and a few times a second; other frames
+                // draw the last build again
+                uiCache.setSettings({ config.ui.cache, config.ui.refreshHz });
+                uiCache.watch(static_cast<float>(SCR_WIDTH));
+                uiCache.watch(static_cast<float>(SCR_HEIGHT));
+                uiCache.watch(mainMenu->isMenuActive() ? 1.0f : 0.0f);
+                uiCache.watch(static_cast<float>(simulationManager->getCurrentType()));
+                uiCache.watch(showProfiler ? 1.0f : 0.0f);
+                if (uiCache.beginFrame(deltaTime)) {
+                    // Start the Dear ImGui frame
+                    ImGui_ImplOpenGL3_NewFrame();
+                    ImGui_ImplGlfw_NewFrame();
+                    ImGui::NewFrame();
+                    
+                    // Render ImGui UI
+                    mainMenu->render();
+                    simulationManager->synchronize(); // The UI reads and edits SPH state directly
+                    renderUI(uiCache.getBuildInterval(), fps);
+                    if (showProfiler) {
+                        renderProfilerPanel();
+                    }
+                    ImGui::Render();
+                }
+                
+                // Render ImGui
+                ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+            });
         
-        // Render ImGui UI
-        mainMenu->render();
-        renderUI(deltaTime);
+        frameGraph->compile();
+        frameGraph->execute();
+        frameBudget->update(*frameGraph);
+        subsystems.endFrame();
+        WaterSim::Profiler::instance().endFrame();
         
-        // Render ImGui
-        ImGui::Render();
-        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        if (benchmark) {
+            uint32_t particles = sphSystem ? sphSystem->getParticleCount() : 0;
+            benchmark->endFrame(frameGraph->getFrame(), particles, WaterSim::Benchmark::sampleMemory(*frameGraph));
+            benchmark->recordPassTimings(frameGraph->getTimedFrame(), frameGraph->getPassTimings());
+            if (benchmark->isFinished()) {
+                glfwSetWindowShouldClose(window, GLFW_TRUE);
+            }
+        }
         
-        // Swap buffers and poll events
+        // Swap buffers and poll events; sampled late, the events wait for the next frame
         glfwSwapBuffers(window);
-        glfwPollEvents();
+        framePacer.endFrame();
+        WaterSim::RenderTargetPool::instance().endFrame();
+        WaterSim::GPUMemoryTracker::instance().endFrame();
+        WaterSim::FrameArena::instance().reset();
+        frameCapture->poll();
+        if (benchmark || !config.pacing.lateInputSampling) {
+            glfwPollEvents();
+        }
+    }
+    
+    // The last frames' timings land once the GPU is done with them
+    bool benchmarkWritten = true;
+    if (benchmark) {
+        glFinish();
+        while (frameGraph->readBackTimings()) {
+            benchmark->recordPassTimings(frameGraph->getTimedFrame(), frameGraph->getPassTimings());
+        }
+        std::string outputPath = config.benchmark.outputPath.empty() ?
+                                 "benchmark_" + benchmark->getScenario().name : config.benchmark.outputPath;
+        std::string renderer = std::string(reinterpret_cast<const char*>(glGetString(GL_RENDERER))) + " / " +
+                               reinterpret_cast<const char*>(glGetString(GL_VERSION));
+        benchmarkWritten = benchmark->writeResults(outputPath, renderer);
+        delete benchmark;
+        benchmark = nullptr;
     }
     
     // Cleanup
+    if (!config.trace.outputPath.empty()) {
+        WaterSim::TraceRecorder::instance().save(config.trace.outputPath);
+    }
+    flightRecorder.wait();
+    WaterSim::Profiler::instance().shutdown();
+    framePacer.shutdown();
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
@@ -952,13 +2064,33 @@ int main() {
     delete sphere;
     delete container;
     delete skybox;
+    delete frameBudget;
+    stopSessionRecording(*simulationManager, nullptr);
+    delete rewindTimeline;
     delete simulationManager;
     delete mainMenu;
     delete reflectionRenderer;
+    delete reflectionProbe;
     delete postProcessManager;
-    delete rayTracingManager;
-    delete waveHeightMap;
-    delete mainSceneFBO;
+    subsystems.releaseAll();
+    delete waveState;
+    delete waterQueries;
+    delete fluidQueries;
+    delete frameGraph;
+    delete gpuPicker;
+    delete shadowMapper;
+    delete sceneBatch;
+    delete clusteredLights;
+    delete shadingRateImage;
+    delete rasterCaustics;
+    delete froxelVolumetrics;
+    delete temporalUpscaler;
+    delete weightedOIT;
+    delete rigidBodies;
+    delete stereoRenderer;
+    delete bindlessTextures;
+    delete frameCapture;    // Drains the readbacks while the context is alive
+    delete remoteControl;
     
     // Cleanup water volume
     glDeleteVertexArrays(1, &waterVolumeVAO);
@@ -966,18 +2098,393 @@ int main() {
     glDeleteBuffers(1, &waterVolumeEBO);
     
     // Cleanup shaders
-    if (waterShader) glDeleteProgram(waterShader);
-    if (glassShader) glDeleteProgram(glassShader);
-    if (sphereShader) glDeleteProgram(sphereShader);
-    if (foamShader) glDeleteProgram(foamShader);
+    waterShader.cleanup();
+    glassShader.cleanup();
+    sphereShader.cleanup();
+    foamShader.cleanup();
+    waterTessShader.cleanup();
+    spherePlanarShader.cleanup();
+    rigidBodyShader.cleanup();
+    sphereDepthShader.cleanup();
+    rigidBodyDepthShader.cleanup();
+    sphereStereoShader.cleanup();
+    rigidBodyStereoShader.cleanup();
+    waterStereoShader.cleanup();
+    skyboxStereoShader.cleanup();
+    if (frameUBO) glDeleteBuffers(1, &frameUBO);
     
     // Cleanup textures
     if (skyboxTexture) glDeleteTextures(1, &skyboxTexture);
-    if (causticTexture) glDeleteTextures(1, &causticTexture);
-    if (tileTexture) glDeleteTextures(1, &tileTexture);
-    if (steelTexture) glDeleteTextures(1, &steelTexture);
+    sceneTextureHandles.clear();
+    WaterSim::ResourceManager::instance().clear();
+    WaterSim::RenderTargetPool::instance().clear();
+    WaterSim::UploadQueue::instance().stop();
     
     glfwTerminate();
+    WaterSim::Logger::instance().shutdown();
+    return benchmarkWritten ? 0 : 1;
+}
+
+bool parseCommandLine(int argc, char** argv) {
+    // The config file and preset first, so that every other argument overrides them
+    std::string configPath;
+    std::string preset;
+    for (int i = 1; i + 1 < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--config") {
+            configPath = argv[++i];
+        } else if (arg == "--preset") {
+            preset = argv[++i];
+        }
+    }
+    if (!preset.empty() && !WaterSim::ConfigFile::findPreset(preset)) {
+        std::cerr << "Unknown preset: " << preset << std::endl;
+        for (const WaterSim::ConfigFile::Preset& known : WaterSim::ConfigFile::getPresets()) {
+            std::cerr << "  " << known.name << ": " << known.description << std::endl;
+        }
+        return false;
+    }
+    std::error_code error;
+    if (configPath.empty() && std::filesystem::exists("watersim.json", error)) {
+        configPath = "watersim.json";
+    }
+    if ((!configPath.empty() || !preset.empty()) && !configFile.load(configPath, config, preset)) {
+        return false;
+    }
+    
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        
+        if (arg == "--headless") {
+            config.headless.enabled = true;
+        } else if (arg == "--cpu") {
+            config.sph.useGPUAcceleration = false;
+        } else if (arg == "--frames" && hasValue) {
+            config.headless.frames = std::max(std::atoi(argv[++i]), 1);
+        } else if (arg == "--seconds" && hasValue) {
+            config.headless.seconds = static_cast<float>(std::atof(argv[++i]));
+        } else if (arg == "--restore" && hasValue) {
+            config.headless.restorePath = argv[++i];
+        } else if (arg == "--checkpoint" && hasValue) {
+            config.headless.checkpointPath = argv[++i];
+        } else if (arg == "--export" && hasValue) {
+            config.headless.exportPath = argv[++i];
+        } else if (arg == "--export-interval" && hasValue) {
+            config.headless.exportInterval = std::max(std::atoi(argv[++i]), 1);
+        } else if (arg == "--cache" && hasValue) {
+            config.headless.cachePath = argv[++i];
+        } else if (arg == "--cache-surface") {
+            config.headless.cacheSurface = true;
+        } else if (arg == "--cache-interval" && hasValue) {
+            config.headless.cacheInterval = std::max(std::atoi(argv[++i]), 1);
+        } else if (arg == "--benchmark-kernels" && hasValue) {
+            config.headless.kernelBenchmarkRepetitions = std::max(std::atoi(argv[++i]), 1);
+        } else if (arg == "--deterministic") {
+            config.sph.deterministic = true;
+        } else if (arg == "--frame-time" && hasValue) {
+            config.headless.frameTime = std::max(static_cast<float>(std::atof(argv[++i])), 1.0e-5f);
+        } else if (arg == "--benchmark" && hasValue) {
+            config.benchmark.scenario = argv[++i];
+            if (!WaterSim::Benchmark::findScenario(config.benchmark.scenario)) {
+                std::cerr << "Unknown benchmark scenario: " << config.benchmark.scenario << std::endl;
+                for (const WaterSim::BenchmarkScenario& scenario : WaterSim::Benchmark::getScenarios()) {
+                    std::cerr << "  " << scenario.name << ": " << scenario.description << std::endl;
+                }
+                return false;
+            }
+        } else if (arg == "--benchmark-frames" && hasValue) {
+            config.benchmark.frames = std::max(std::atoi(argv[++i]), 1);
+        } else if (arg == "--benchmark-output" && hasValue) {
+            config.benchmark.outputPath = argv[++i];
+        } else if (arg == "--benchmark-hidden") {
+            config.benchmark.hiddenWindow = true;
+        } else if (arg == "--trace" && hasValue) {
+            config.trace.outputPath = argv[++i];
+        } else if (arg == "--no-trace") {
+            config.trace.enabled = false;
+        } else if (arg == "--log") {
+            config.debug.enableLogging = true;
+        } else if (arg == "--stereo") {
+            config.stereo.enabled = true;
+        } else if (arg == "--record" && hasValue) {
+            config.recording.outputPath = argv[++i];
+        } else if (arg == "--replay" && hasValue) {
+            config.recording.replayPath = argv[++i];
+        } else if (arg == "--capture" && hasValue) {
+            config.capture.outputPath = argv[++i];
+        } else if (arg == "--capture-png") {
+            config.capture.hardwareEncode = false;
+        } else if (arg == "--serve" && hasValue) {
+            config.server.port = std::atoi(argv[++i]);
+            if (config.server.port <= 0 || config.server.port > 65535) {
+                std::cerr << "Invalid control port: " << argv[i] << std::endl;
+                return false;
+            }
+        } else if (arg == "--control" && hasValue) {
+            config.server.controlPort = std::atoi(argv[++i]);
+            if (config.server.controlPort <= 0 || config.server.controlPort > 65535) {
+                std::cerr << "Invalid control port: " << argv[i] << std::endl;
+                return false;
+            }
+        } else if (arg == "--playback" && hasValue) {
+            config.playback.path = argv[++i];
+        } else if (arg == "--playback-speed" && hasValue) {
+            config.playback.speed = static_cast<float>(std::atof(argv[++i]));
+        } else if (arg == "--playback-once") {
+            config.playback.loop = false;
+        } else if (arg == "--serve-glx") {
+            config.server.eglContext = false;
+        } else if (arg == "--serve-bind" && hasValue) {
+            config.server.bindAddress = argv[++i];
+        } else if (arg == "--serve-token" && hasValue) {
+            config.server.token = argv[++i];
+        } else if ((arg == "--config" || arg == "--preset") && hasValue) {
+            i++;    // Applied above
+        } else {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            std::cerr << "Usage: WaterSimulation [--config FILE] [--preset NAME] [--headless [--frames N | --seconds S] [--frame-time DT]"
+                      << " [--restore FILE] [--checkpoint FILE] [--export FILE [--export-interval N]]"
+                      << " [--cache BASE [--cache-surface] [--cache-interval N]]"
+                      << " [--benchmark-kernels N]] [--benchmark SCENARIO [--benchmark-frames N]"
+                      << " [--benchmark-output BASE] [--benchmark-hidden]] [--trace FILE | --no-trace] [--record FILE | --replay FILE] [--log] [--stereo] [--capture BASE [--capture-png]] [--serve PORT [--serve-glx] | --control PORT] [--serve-bind ADDRESS] [--serve-token TOKEN] [--playback FILE [--playback-speed X] [--playback-once]] [--deterministic] [--cpu]" << std::endl;
+            return false;
+        }
+    }
+    if (!config.recording.outputPath.empty() && !config.recording.replayPath.empty()) {
+        std::cerr << "--record and --replay cannot be combined" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Opens config.recording.replayPath and starts its simulation, fed from then on only by the
+// recording. A required type other than NONE refuses recordings of any other
+bool startReplay(WaterSim::SimulationManager& manager, WaterSim::SimulationType requiredType) {
+    commandReplay = new WaterSim::CommandReplay();
+    if (!commandReplay->open(config.recording.replayPath)) {
+        stopSessionRecording(manager, nullptr);
+        return false;
+    }
+    WaterSim::SimulationType type = static_cast<WaterSim::SimulationType>(commandReplay->getSimulationType());
+    if (requiredType != WaterSim::SimulationType::NONE && type != requiredType) {
+        std::cerr << "This mode cannot replay a recording of another simulation" << std::endl;
+        stopSessionRecording(manager, nullptr);
+        return false;
+    }
+    if (commandReplay->wasDeterministic() != config.sph.deterministic) {
+        std::cout << "Note: the session was recorded with sph.deterministic " << (commandReplay->wasDeterministic() ? "on" : "off")
+                  << "; the replay may drift from it" << std::endl;
+    }
+    manager.setSimulationType(type);
+    manager.setReplaying(true);
+    return true;
+}
+
+// Session recording and replay (CommandRecording.h) around each simulation update, in the
+// interactive loop and headless alike. A recording opens at the first update of a simulation
+float beginSessionTick(WaterSim::SimulationManager& manager, float tickTime) {
+    if (commandRecorder) {
+        WaterSim::SimulationType type = manager.getCurrentType();
+        if (!commandRecorder->isOpen() && type != WaterSim::SimulationType::NONE) {
+            if (commandRecorder->open(config.recording.outputPath, static_cast<uint32_t>(type), config.sph.deterministic)) {
+                manager.setRecordingLog(commandRecorder->getLog());
+            } else {
+                stopSessionRecording(manager, nullptr);
+            }
+        } else if (commandRecorder->isOpen() && static_cast<uint32_t>(type) != commandRecorder->getSimulationType()) {
+            stopSessionRecording(manager, "the simulation was switched");
+        }
+    }
+    
+    if (!commandReplay) return tickTime;
+    if (static_cast<uint32_t>(manager.getCurrentType()) != commandReplay->getSimulationType()) {
+        stopSessionRecording(manager, "the simulation was switched");
+        return tickTime;
+    }
+    if (commandReplay->isFinished()) {
+        std::cout << "Replay finished after " << commandReplay->getTickCount() << " ticks; interaction is live again" << std::endl;
+        stopSessionRecording(manager, nullptr);
+        return tickTime;
+    }
+    return commandReplay->nextTick(manager.getCommandQueue());
+}
+
+void endSessionTick(float updateTime) {
+    if (commandRecorder && commandRecorder->isOpen()) {
+        commandRecorder->endTick(updateTime);
+    }
+}
+
+// Ends the recording and the replay, for good: a reason says why early
+void stopSessionRecording(WaterSim::SimulationManager& manager, const char* reason) {
+    if (reason && (commandRecorder || commandReplay)) {
+        std::cout << (commandRecorder ? "Command recording" : "Replay") << " stopped: " << reason << std::endl;
+    }
+    manager.setRecordingLog(nullptr);
+    manager.setReplaying(false);
+    delete commandRecorder;
+    commandRecorder = nullptr;
+    delete commandReplay;
+    commandReplay = nullptr;
+}
+
+int runHeadless() {
+    std::cout << "Headless SPH run: " << (config.sph.useGPUAcceleration ? "GL compute" : "CPU") << " backend" << std::endl;
+    
+    // The GL backend still needs a context; a hidden window has no swapchain to present.
+    // The CPU backend runs without any GL or window at all.
+    GLFWwindow* window = nullptr;
+    if (config.sph.useGPUAcceleration) {
+        glfwInit();
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        
+        window = glfwCreateWindow(1, 1, "Water Simulation (headless)", NULL, NULL);
+        if (window == NULL) {
+            std::cout << "Failed to create hidden GLFW window" << std::endl;
+            glfwTerminate();
+            return -1;
+        }
+        glfwMakeContextCurrent(window);
+        
+        if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+            std::cout << "Failed to initialize GLAD" << std::endl;
+            glfwTerminate();
+            return -1;
+        }
+        std::cout << "Renderer: " << glGetString(GL_RENDERER) << std::endl;
+        WaterSim::ShaderCompiler::instance().initialize();
+    }
+    
+    int frames = 0;
+    double elapsedSeconds = 0.0;
+    uint32_t particleCount = 0;
+    {
+        WaterSim::SimulationManager manager(config);
+        manager.setSimulationType(WaterSim::SimulationType::SPH_COMPUTE);
+        
+        // A replay runs its recorded ticks, all of them unless told fewer; only SPH sessions
+        // replay here, as the water surface needs the renderer's context
+        int frameLimit = config.headless.frames;
+        if (!config.recording.replayPath.empty()) {
+            if (!startReplay(manager, WaterSim::SimulationType::SPH_COMPUTE)) {
+                manager.cleanup();
+                if (window) {
+                    glfwDestroyWindow(window);
+                    glfwTerminate();
+                }
+                return -1;
+            }
+            frameLimit = static_cast<int>(commandReplay->getTickCount());
+        }
+        if (!config.recording.outputPath.empty()) {
+            commandRecorder = new WaterSim::CommandRecorder();
+        }
+        
+        WaterSim::SPHComputeSystem* sphComputeSystem = manager.getSPHComputeSystem();
+        bool wantsCheckpoint = !config.headless.restorePath.empty() || !config.headless.checkpointPath.empty();
+        if (wantsCheckpoint && !sphComputeSystem) {
+            std::cerr << "Checkpoints require the GL compute backend" << std::endl;
+        }
+        if ((!config.headless.exportPath.empty() || !config.headless.cachePath.empty()) && !sphComputeSystem) {
+            std::cerr << "Particle export requires the GL compute backend" << std::endl;
+        }
+        if (sphComputeSystem && !config.headless.restorePath.empty() &&
+            !sphComputeSystem->loadCheckpoint(config.headless.restorePath)) {
+            manager.cleanup();
+            if (window) {
+                glfwDestroyWindow(window);
+                glfwTerminate();
+            }
+            return -1;
+        }
+        if (sphComputeSystem && !config.headless.exportPath.empty()) {
+            sphComputeSystem->startExport(config.headless.exportPath, config.headless.exportInterval);
+        }
+        if (sphComputeSystem && !config.headless.cachePath.empty()) {
+            sphComputeSystem->startCache(config.headless.cachePath, config.headless.cacheSurface, config.headless.cacheInterval);
+        }
+        
+        auto start = std::chrono::steady_clock::now();
+        while (true) {
+            if (config.headless.seconds > 0.0f) {
+                if (elapsedSeconds >= config.headless.seconds) break;
+            } else if (frames >= frameLimit) {
+                break;
+            }
+            
+            // An offline cache keeps every frame: the loop waits for the writer rather than
+            // the simulation step for the disk
+            while (sphComputeSystem && sphComputeSystem->isCacheBackedUp()) {
+                sphComputeSystem->pollCache();
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            float updateTime = beginSessionTick(manager, config.headless.frameTime);
+            manager.update(updateTime);
+            endSessionTick(updateTime);
+            frames++;
+            
+            if (window) {
+                glfwPollEvents();
+            }
+            elapsedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+        
+        // Wait for the queued GPU work, so the timing covers the simulation itself
+        if (window) {
+            glFinish();
+            elapsedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+        
+        if (sphComputeSystem) {
+            sphComputeSystem->stopExport();
+            sphComputeSystem->stopCache();
+        }
+        
+        // Kernel comparison on the settled state, after the timed run
+        if (sphComputeSystem && config.headless.kernelBenchmarkRepetitions > 0) {
+            WaterSim::SPHKernelBenchmark benchmark = sphComputeSystem->benchmarkKernels(config.headless.kernelBenchmarkRepetitions);
+            if (benchmark.valid) {
+                std::cout << "Kernel benchmark (" << config.headless.kernelBenchmarkRepetitions << " repetitions, "
+                          << sphComputeSystem->getParticleCount() << " particles):" << std::endl;
+                std::cout << "  step 5: analytic " << benchmark.analyticDensityMs << " ms, table " << benchmark.tableDensityMs
+                          << " ms, density error " << benchmark.densityError << " (max " << benchmark.maxDensityError << ")" << std::endl;
+                std::cout << "  step 6: analytic " << benchmark.analyticForceMs << " ms, table " << benchmark.tableForceMs
+                          << " ms, acceleration error " << benchmark.accelerationError << std::endl;
+            }
+        }
+        if (sphComputeSystem && !config.headless.checkpointPath.empty()) {
+            sphComputeSystem->saveCheckpoint(config.headless.checkpointPath);
+        }
+        
+        if (sphComputeSystem && sphComputeSystem->getDeterministic()) {
+            std::cout << "Deterministic state hash: 0x" << std::hex << std::setw(16) << std::setfill('0')
+                      << sphComputeSystem->computeStateHash() << std::dec << std::setfill(' ') << std::endl;
+        }
+        
+        if (sphComputeSystem) {
+            particleCount = sphComputeSystem->getParticleCount();
+        } else if (manager.getSPHCpuSystem()) {
+            particleCount = manager.getSPHCpuSystem()->getParticleCount();
+        }
+        stopSessionRecording(manager, nullptr);
+    }
+    
+    std::cout << "Headless run finished: " << frames << " updates, " << frames * config.headless.frameTime
+              << " s simulated in " << elapsedSeconds << " s (" << (frames > 0 ? elapsedSeconds * 1000.0 / frames : 0.0)
+              << " ms/update), " << particleCount << " particles" << std::endl;
+    if (!config.trace.outputPath.empty()) {
+        WaterSim::TraceRecorder::instance().save(config.trace.outputPath);
+    }
+    
+    if (window) {
+        glfwDestroyWindow(window);
+        glfwTerminate();
+    }
+    WaterSim::Logger::instance().shutdown();
     return 0;
 }
 
@@ -1075,6 +2582,311 @@ void processInput(GLFWwindow* window, float deltaTime) {
     }
 }
 
+// One scripted interaction of the running benchmark
+void applyBenchmarkEvent(const WaterSim::BenchmarkEvent& event) {
+    switch (event.action) {
+        case WaterSim::BenchmarkAction::RIPPLE:
+            simulationManager->addRipple(event.position, event.magnitude);
+            break;
+        case WaterSim::BenchmarkAction::SPLASH:
+            simulationManager->createSplash(event.position, event.magnitude);
+            break;
+        case WaterSim::BenchmarkAction::SPHERE_DROP:
+            // The loop's own collision handling makes the splash or impulse where it lands
+            useGravity = true;
+            sphere->setPosition(event.position);
+            sphere->setVelocity(glm::vec3(0.0f));
+            break;
+        case WaterSim::BenchmarkAction::FLUID_STREAM:
+            simulationManager->addFluidStream(event.position, event.direction, event.magnitude);
+            break;
+    }
+}
+
+void applyRemoteCommand(GLFWwindow* window, const WaterSim::RemoteCommand& command) {
+    switch (command.type) {
+        case WaterSim::RemoteCommand::Type::HELLO: {
+            if (command.port == 0) break;   // Control only
+            
+            // A requested size takes effect once the resize lands; frames before it are dropped.
+            // RemoteControl bounds it already; the viewport limit may be tighter
+            GLint maxViewport[2] = { WaterSim::RemoteCommand::MAX_STREAM_SIZE, WaterSim::RemoteCommand::MAX_STREAM_SIZE };
+            glGetIntegerv(GL_MAX_VIEWPORT_DIMS, maxViewport);
+            int width = command.width > 0 ? command.width : static_cast<int>(SCR_WIDTH);
+            int height = command.height > 0 ? command.height : static_cast<int>(SCR_HEIGHT);
+            width = std::min(width, std::min(static_cast<int>(maxViewport[0]), WaterSim::RemoteCommand::MAX_STREAM_SIZE));
+            height = std::min(height, std::min(static_cast<int>(maxViewport[1]), WaterSim::RemoteCommand::MAX_STREAM_SIZE));
+            if (width != static_cast<int>(SCR_WIDTH) || height != static_cast<int>(SCR_HEIGHT)) {
+                glfwSetWindowSize(window, width, height);
+            }
+            std::string url = "rtp://" + command.client + ":" + std::to_string(command.port);
+            frameCapture->startStream(url, width, height, config.capture.frameRate);
+            break;
+        }
+        case WaterSim::RemoteCommand::Type::BYE:
+            if (frameCapture->isStreaming()) frameCapture->stop();
+            break;
+        case WaterSim::RemoteCommand::Type::SIMULATE:
+            simulationManager->getCommandQueue().push(command.simulation);
+            break;
+        case WaterSim::RemoteCommand::Type::CAMERA:
+            camera.SetMode(FREE_CAMERA);
+            camera.Position = command.position;
+            camera.Yaw = command.vector.x;
+            camera.Pitch = glm::clamp(command.vector.y, -89.0f, 89.0f);
+            if (command.vector.z > 0.0f) camera.SetZoom(command.vector.z);
+            camera.updateCameraVectors();
+            break;
+        case WaterSim::RemoteCommand::Type::SIMULATION:
+            simulationManager->setSimulationType(command.sph ? WaterSim::SimulationType::SPH_COMPUTE :
+                                                               WaterSim::SimulationType::REGULAR_WATER);
+            break;
+    }
+}
+
+// Acts on the fields a config reload changed; the live ones not listed here are read every frame
+void applyConfigChanges(const WaterSim::ConfigChanges& changes) {
+    // Edited from outside the panels, so they show the new values at once
+    uiCache.invalidate();
+    if (changes.has("display.vsync") && !benchmark) {
+        glfwSwapInterval(config.display.vsync ? 1 : 0);
+    }
+    if (changes.has("debug.enableLogging")) {
+        WaterSim::Logger::instance().setEnabled(config.debug.enableLogging);
+    }
+    WaterSim::SimulationCommandQueue& commands = simulationManager->getCommandQueue();
+    if (changes.has("sph.boundaryDamping")) {
+        commands.push(WaterSim::SimulationCommand::setParameter(WaterSim::SimulationCommand::Parameter::BOUNDARY_DAMPING,
+                                                                config.sph.boundaryDamping));
+    }
+    if (changes.has("sph.sphereFriction")) {
+        commands.push(WaterSim::SimulationCommand::setParameter(WaterSim::SimulationCommand::Parameter::SPHERE_FRICTION,
+                                                                config.sph.sphereFriction));
+    }
+    if (changes.has("rewind.enabled") || changes.has("rewind.keyframeInterval") || changes.has("rewind.budgetMB")) {
+        rewindTimeline->setSettings(rewindSettings());
+    }
+    flightRecorder.setSettings(spikeTraceSettings());
+    if (changes.has("budget.enabled") || changes.has("budget.targetMs")) {
+        applyFrameBudgetSettings();
+    }
+    if (changes.has("physics.tickRate") || changes.has("physics.maxTicksPerFrame")) {
+        applySimulationClockSettings();
+    }
+    if (changes.has("standby.enabled") || changes.has("standby.budgetMB") || changes.has("standby.minFreeMB")) {
+        simulationManager->trimStandby();
+    }
+    
+    // A parked simulation would come back with the settings it was parked under
+    bool simulationSettings = std::any_of(changes.keys.begin(), changes.keys.end(), [](const std::string& key) {
+        return key.rfind("water.", 0) == 0 || key.rfind("sph.", 0) == 0;
+    });
+    if (changes.simulation || simulationSettings) {
+        simulationManager->evictStandby();
+    }
+    if (changes.simulation) {
+        simulationManager->initialize();
+    }
+    if (changes.targets) {
+        sceneRenderSize = glm::ivec2(0);    // The tracer's targets, at the next frame's render size
+    }
+}
+
+WaterSim::FlightRecorder::Settings spikeTraceSettings() {
+    WaterSim::FlightRecorder::Settings settings;
+    settings.enabled = config.spikeTrace.enabled;
+    settings.thresholdMs = config.spikeTrace.thresholdMs;
+    settings.contextSeconds = config.spikeTrace.contextSeconds;
+    settings.afterSeconds = config.spikeTrace.afterSeconds;
+    settings.cooldownSeconds = config.spikeTrace.cooldownSeconds;
+    settings.maxTraces = config.spikeTrace.maxTraces;
+    settings.directory = config.spikeTrace.directory;
+    return settings;
+}
+
+// The last frame's time and counters for the flight recorder; the uploads and shader
+// builds as this frame's share of their running totals
+void recordFlightFrame(float frameTime) {
+    static WaterSim::UploadQueue::Stats lastUploads;
+    static int lastBuilds = 0;
+    WaterSim::UploadQueue::Stats uploads = WaterSim::UploadQueue::instance().getStats();
+    int builds = WaterSim::ShaderCompiler::instance().getStats().completed;
+    const WaterSim::FramePacer::Stats& pacing = framePacer.getStats();
+    
+    WaterSim::FlightRecorder::Counters counters;
+    counters.framePasses = frameGraph ? frameGraph->getStats().passes - frameGraph->getStats().culledPasses : 0;
+    counters.uploads = uploads.submitted - lastUploads.submitted;
+    counters.uploadKB = (uploads.bytes - lastUploads.bytes) / 1024.0;
+    counters.shaderBuilds = builds - lastBuilds;
+    counters.pacingWaitMs = pacing.gpuWaitMs + pacing.limiterWaitMs;
+    flightRecorder.recordFrame(frameTime * 1000.0f, counters);
+    lastUploads = uploads;
+    lastBuilds = builds;
+}
+
+WaterSim::RewindTimeline::Settings rewindSettings() {
+    WaterSim::RewindTimeline::Settings settings;
+    settings.enabled = config.rewind.enabled;
+    settings.keyframeInterval = config.rewind.keyframeInterval;
+    settings.budgetBytes = size_t(std::max(config.rewind.budgetMB, 1)) << 20;
+    return settings;
+}
+
+// The governor's knobs, cheapest to give up first. Each level's cost is relative to the full
+// setting's, in the passes it is measured by; the scene pass draws much more than the SPH
+// smoothing, so fewer iterations save only part of it
+void registerLazySubsystems() {
+    // Without lazy creation both come up now and stay
+    int releaseFrames = config.subsystems.lazy ? std::max(config.subsystems.releaseFrames, 0) : 0;
+    
+    // The ray tracer compiles its programs and allocates its traced targets on creation; it
+    // starts at the resolution the scene renders at, with the settings the last one had
+    WaterSim::SubsystemRegistry::Subsystem rayTracing;
+    rayTracing.name = "Ray tracing";
+    rayTracing.idleFrames = releaseFrames;
+    rayTracing.create = []() {
+        rayTracingManager = new WaterSim::RayTracingManager(config);
+        rayTracingManager->initialize(SCR_WIDTH, SCR_HEIGHT);
+        if (sceneRenderSize != glm::ivec2(0)) {
+            rayTracingManager->resize(sceneRenderSize.x, sceneRenderSize.y);
+        }
+        if (rayTracingState.saved) {
+            rayTracingManager->setFeatures(rayTracingState.features);
+            rayTracingManager->setFrameBudget(rayTracingState.frameBudgetMs);
+        }
+        rayTracingManager->setBudgetScale(rayTracingState.budgetScale);
+        rayTracingManager->setQuality(rayTracingEnabled ? static_cast<WaterSim::RayTracingQuality>(rayTracingQuality)
+                                                        : WaterSim::RayTracingQuality::OFF);
+    };
+    rayTracing.release = []() {
+        rayTracingState.saved = true;
+        rayTracingState.features = rayTracingManager->getFeatures();
+        rayTracingState.frameBudgetMs = rayTracingManager->getFrameBudget();
+        rayTracingState.budgetScale = rayTracingManager->getBudgetScale();
+        delete rayTracingManager;
+        rayTracingManager = nullptr;
+    };
+    rayTracingSubsystem = subsystems.add(rayTracing);
+    
+    // The raster caustics' program arrives through the ShaderCompiler
+    WaterSim::SubsystemRegistry::Subsystem caustics;
+    caustics.name = "Raster caustics";
+    caustics.idleFrames = releaseFrames;
+    caustics.create = []() {
+        rasterCaustics = new WaterSim::RasterCaustics();
+        rasterCaustics->initialize();
+    };
+    caustics.release = []() {
+        delete rasterCaustics;
+        rasterCaustics = nullptr;
+    };
+    rasterCausticsSubsystem = subsystems.add(caustics);
+    
+    if (!config.subsystems.lazy) {
+        subsystems.use(rayTracingSubsystem);
+        subsystems.use(rasterCausticsSubsystem);
+    }
+}
+
+void addFrameBudgetKnobs() {
+    WaterSim::FrameBudget::Knob bloom;
+    bloom.name = "Bloom";
+    bloom.levels = { "On", "Off" };
+    bloom.relativeCost = { 1.0f, 0.6f };
+    bloom.priority = 0;
+    bloom.passes = { "Post-process" };
+    bloom.apply = [](int level) { postProcessManager->setBloomAllowed(level == 0); };
+    bloom.active = []() { return postProcessManager->isBloomEnabled(); };
+    frameBudget->addKnob(bloom);
+    
+    static const float FLOW_FRACTIONS[] = { 1.0f, 0.5f, 0.25f };
+    WaterSim::FrameBudget::Knob curvatureFlow;
+    curvatureFlow.name = "Curvature flow";
+    curvatureFlow.levels = { "All iterations", "1/2", "1/4" };
+    curvatureFlow.relativeCost = { 1.0f, 0.8f, 0.7f };
+    curvatureFlow.priority = 1;
+    curvatureFlow.passes = { "Scene" };
+    curvatureFlow.apply = [](int level) {
+        if (WaterSim::SPHComputeSystem* sph = simulationManager->getSPHComputeSystem()) {
+            sph->setCurvatureFlowBudget(FLOW_FRACTIONS[level]);
+        }
+    };
+    curvatureFlow.active = []() {
+        WaterSim::SPHComputeSystem* sph = simulationManager->isSPHComputeActive() ? simulationManager->getSPHComputeSystem() : nullptr;
+        return sph && !simulationManager->isAsyncSimulation() &&
+               sph->getRenderMode() == WaterSim::SPHComputeSystem::RENDER_SCREEN_SPACE;
+    };
+    frameBudget->addKnob(curvatureFlow);
+    
+    // Refreshed every few times the settings' interval, then also at half resolution
+    static const int REFLECTION_INTERVALS[] = { 1, 2, 4, 4 };
+    static const float REFLECTION_RESOLUTIONS[] = { 1.0f, 1.0f, 1.0f, 0.5f };
+    WaterSim::FrameBudget::Knob reflections;
+    reflections.name = "Planar reflections";
+    reflections.levels = { "Full", "2x interval", "4x interval", "4x interval, 1/2 resolution" };
+    reflections.relativeCost = { 1.0f, 0.5f, 0.25f, 0.1f };
+    reflections.priority = 2;
+    reflections.passes = { "Planar layered", "Reflection", "Refraction" };
+    reflections.apply = [](int level) {
+        reflectionRenderer->setBudget(REFLECTION_INTERVALS[level], REFLECTION_RESOLUTIONS[level]);
+    };
+    reflections.active = []() { return simulationManager->isRegularWaterActive(); };
+    frameBudget->addKnob(reflections);
+    
+    // Reflections, refraction and caustics all trace at this resolution
+    static const float RAY_TRACING_SCALES[] = { 1.0f, 0.75f, 0.5f };
+    WaterSim::FrameBudget::Knob rayTracing;
+    rayTracing.name = "Ray tracing";
+    rayTracing.levels = { "Full", "3/4 resolution", "1/2 resolution" };
+    rayTracing.relativeCost = { 1.0f, 0.5625f, 0.25f };
+    rayTracing.priority = 3;
+    rayTracing.passes = { "Ray tracing" };
+    rayTracing.apply = [](int level) {
+        rayTracingState.budgetScale = RAY_TRACING_SCALES[level];
+        if (rayTracingManager) rayTracingManager->setBudgetScale(RAY_TRACING_SCALES[level]);
+    };
+    rayTracing.active = []() {
+        return rayTracingEnabled && rayTracingManager && rayTracingManager->getQuality() != WaterSim::RayTracingQuality::OFF;
+    };
+    frameBudget->addKnob(rayTracing);
+    
+    // Last: fewer substeps slow the simulation below real time. The simulation runs outside
+    // the frame graph, so it is measured by its own timer
+    static const float SUBSTEP_FRACTIONS[] = { 1.0f, 0.75f, 0.5f };
+    WaterSim::FrameBudget::Knob substeps;
+    substeps.name = "SPH substeps";
+    substeps.levels = { "All", "3/4", "1/2" };
+    substeps.relativeCost = { 1.0f, 0.75f, 0.5f };
+    substeps.priority = 4;
+    substeps.measure = []() { return simulationManager->getSPHComputeSystem()->getSimulationTimeMs(); };
+    substeps.apply = [](int level) {
+        if (WaterSim::SPHComputeSystem* sph = simulationManager->getSPHComputeSystem()) {
+            sph->setSubstepBudget(SUBSTEP_FRACTIONS[level]);
+        }
+    };
+    substeps.active = []() {
+        return simulationManager->isSPHComputeActive() && simulationManager->getSPHComputeSystem() &&
+               !simulationManager->isAsyncSimulation();
+    };
+    frameBudget->addKnob(substeps);
+}
+
+// A benchmark ticks in lockstep with its fixed frame time, so float error never adds or
+// drops a tick
+void applySimulationClockSettings() {
+    simulationClock.setTickRate(benchmark ? 0.0f : config.physics.tickRate);
+    simulationClock.setMaxTicksPerFrame(config.physics.maxTicksPerFrame);
+}
+
+// A benchmark measures the configured quality, so it runs ungoverned
+void applyFrameBudgetSettings() {
+    WaterSim::FrameBudget::Settings settings = frameBudget->getSettings();
+    settings.enabled = config.budget.enabled && !benchmark;
+    settings.targetMs = config.budget.targetMs;
+    frameBudget->setSettings(settings);
+    frameGraph->setTiming(benchmark || settings.enabled);
+}
+
 void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
     // Ignore minimized windows
     if (width == 0 || height == 0) return;
@@ -1084,52 +2896,76 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
     glViewport(0, 0, width, height);
     
     // Update all framebuffers that depend on window size
+    // The frame graph's targets follow the sizes passes declare each frame
     if (reflectionRenderer) {
-        delete reflectionRenderer;
-        reflectionRenderer = new ReflectionRenderer(width, height);
+        reflectionRenderer->resize(width, height);
     }
     
     if (postProcessManager) {
-        delete postProcessManager;
-        postProcessManager = new PostProcessManager(width, height);
-    }
-    
-    if (mainSceneFBO) {
-        delete mainSceneFBO;
-        mainSceneFBO = new Framebuffer(width, height, FRAMEBUFFER_COLOR_DEPTH);
+        postProcessManager->resize(width, height);
     }
     
     if (rayTracingManager) {
         rayTracingManager->resize(width, height);
     }
     
+    if (temporalUpscaler) {
+        temporalUpscaler->resize(width, height);    // The render size follows next frame
+    }
+    sceneRenderSize = glm::ivec2(0);
+    
     // Update camera aspect ratio
     lastX = width / 2.0f;
     lastY = height / 2.0f;
 }
 
-// Function to convert screen coordinates to world coordinates
+// The point at depth along the view ray under a cursor, through the last frame's cached
+// inverse matrices (the frame on screen)
 glm::vec3 screenToWorld(float screenX, float screenY, float depth) {
-    // Normalize screen coordinates to NDC
-    float x = (2.0f * screenX) / SCR_WIDTH - 1.0f;
-    float y = 1.0f - (2.0f * screenY) / SCR_HEIGHT;
-    
-    // Create NDC coordinates
-    glm::vec4 rayClip(x, y, -1.0f, 1.0f);
-    
-    // Convert to eye space
-    glm::mat4 invProj = glm::inverse(glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f));
-    glm::vec4 rayEye = invProj * rayClip;
-    rayEye = glm::vec4(rayEye.x, rayEye.y, -1.0f, 0.0f);
+    return gpuPicker->pointAtDistance(glm::vec2(screenX, screenY), depth);
+}
+
+// A press's pick, once it has landed: the sphere if the surface hit is the sphere's, the
+// water if it lies over the container, else nothing
+void resolvePendingPick() {
+    if (!pickPending || !gpuPicker->hasResultSince(pickPendingFrame)) return;
+    const WaterSim::PickResult& pick = gpuPicker->getLatest();
+    bool released = pickReleased;
+    pickPending = false;
+    pickReleased = false;
+    if (!pick.hit) return;
+    
+    glm::vec3 spherePos = sphere->getPosition();
+    if (glm::length(pick.position - spherePos) < sphere->getRadius() * 1.1f) {
+        if (released) return; // Clicked, not dragged
+        isDraggingSphere = true;
+        sphere->setDragged(true);
+        
+        // Dragged in the plane through its center, facing the camera
+        float depth = glm::length(camera.Position - spherePos);
+        lastMouseWorldPos = screenToWorld(pick.cursor.x, pick.cursor.y, depth);
+        
+        // Reset velocity tracking
+        previousSpherePos = spherePos;
+        dragVelocityTrackTime = 0.0f;
+        return;
+    }
     
-    // Convert to world space
-    glm::mat4 invView = glm::inverse(camera.GetViewMatrix());
-    glm::vec4 rayWorld = invView * rayEye;
-    glm::vec3 rayDirection = glm::normalize(glm::vec3(rayWorld));
+    float containerHalfWidth = container->getWidth() / 2.0f;
+    float containerHalfDepth = container->getDepth() / 2.0f;
+    if (std::abs(pick.position.x) >= containerHalfWidth || std::abs(pick.position.z) >= containerHalfDepth) return;
     
-    // Calculate point at given depth from camera
-    return camera.Position + rayDirection * depth;
-} 
+    // Exactly where the surface was hit; a click lets its ripple go at once
+    ripplePosition = pick.position;
+    WaterSim::SimulationCommandQueue& commands = simulationManager->getCommandQueue();
+    commands.push(WaterSim::SimulationCommand::ripple(ripplePosition, 0.1f));
+    if (released) {
+        commands.push(WaterSim::SimulationCommand::ripple(ripplePosition, 0.1f));
+    } else {
+        isCreatingRipple = true;
+        rippleHoldTime = 0.0f;
+    }
+}
 
 void mouse_callback(GLFWwindow* window, double xposIn, double yposIn) {
     float xpos = static_cast<float>(xposIn);
@@ -1210,20 +3046,23 @@ void mouse_callback(GLFWwindow* window, double xposIn, double yposIn) {
                 if (rippleTimer > 0.1f) { // Create ripple every 100ms
                     // Create directional wave based on movement direction
                     glm::vec2 moveDirection = glm::normalize(glm::vec2(instantVelocity.x, instantVelocity.z));
-                    simulationManager->addDirectionalRipple(ripplePos, moveDirection, rippleMagnitude);
+                    simulationManager->getCommandQueue().push(
+                        WaterSim::SimulationCommand::directionalRipple(ripplePos, moveDirection, rippleMagnitude));
                     rippleTimer = 0.0f;
                 }
                 
                 // Add water flow impulse based on sphere movement
                 glm::vec2 lateralVelocity(instantVelocity.x, instantVelocity.z);
-                simulationManager->addWaterFlowImpulse(sphere->getPosition(), lateralVelocity * 0.5f, sphereRadius * 2.5f);
+                simulationManager->getCommandQueue().push(
+                    WaterSim::SimulationCommand::flowImpulse(sphere->getPosition(), lateralVelocity * 0.5f, sphereRadius * 2.5f));
                 
                 // Create splash effect for high speeds
                 if (lateralSpeed > 5.0f) { // Higher threshold for splashes
                     static float splashTimer = 0.0f;
                     splashTimer += deltaTime;
                     if (splashTimer > 0.3f) { // Less frequent splashes
-                        simulationManager->createSplash(ripplePos, lateralSpeed * 0.15f);
+                        simulationManager->getCommandQueue().push(
+                            WaterSim::SimulationCommand::splash(ripplePos, lateralSpeed * 0.15f));
                         splashTimer = 0.0f;
                     }
                 }
@@ -1243,104 +3082,28 @@ void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
     if (io.WantCaptureMouse)
         return;
     
-    // Get the current cursor position
-    double xpos, ypos;
-    glfwGetCursorPos(window, &xpos, &ypos);
-    
     if (button == GLFW_MOUSE_BUTTON_LEFT) {
         if (action == GLFW_PRESS) {
-            // Cast a ray into the scene to identify what was clicked
-            // Use an initial depth point to check if we're over water
-            float rayDepth = 20.0f; // Initial depth to test intersection
-            glm::vec3 worldPos = screenToWorld(static_cast<float>(xpos), static_cast<float>(ypos), rayDepth);
-            
-            // Calculate ray from camera to worldPos
-            glm::vec3 rayDir = glm::normalize(worldPos - camera.Position);
+            // What is under the cursor comes back from the depth buffer a frame or two on
+            pickPending = true;
+            pickReleased = false;
+            pickPendingFrame = gpuPicker->getFrame() + 1;
+        } else if (action == GLFW_RELEASE) {
+            if (pickPending) {
+                pickReleased = true;
+            }
             
-            // Define water plane (at current water height, with normal pointing up)
-            float waterHeight = simulationManager->getWaterHeight();
-            glm::vec3 waterPoint(0.0f, waterHeight, 0.0f);
-            glm::vec3 waterNormal(0.0f, 1.0f, 0.0f);
+            // If we were creating a ripple, create the final interaction with the accumulated magnitude
+            if (isCreatingRipple) {
+                float rippleMagnitude = 0.1f + rippleHoldTime * RIPPLE_CHARGE_RATE;
+                simulationManager->getCommandQueue().push(WaterSim::SimulationCommand::ripple(ripplePosition, rippleMagnitude));
+                isCreatingRipple = false;
+            }
             
-            // Calculate if and where ray intersects water plane
-            float denom = glm::dot(waterNormal, rayDir);
-            if (std::abs(denom) > 0.0001f) { // Avoid division by zero
-                // Calculate the distance along ray to hit water plane
-                float t = glm::dot(waterPoint - camera.Position, waterNormal) / denom;
-                
-                if (t > 0.0f) { // Check if water is in front of camera
-                    // Calculate exact intersection point
-                    glm::vec3 waterIntersect = camera.Position + rayDir * t;
-                    
-                    // Check if intersection is within the container bounds
-                    float containerHalfWidth = container->getWidth() / 2.0f;
-                    float containerHalfDepth = container->getDepth() / 2.0f;
-                    
-                    if (std::abs(waterIntersect.x) < containerHalfWidth && 
-                        std::abs(waterIntersect.z) < containerHalfDepth) {
-                        
-                        // Check if we're clicking the water or trying to grab the sphere
-                        // Sphere selection has priority if close enough to click point
-                        glm::vec3 spherePos = sphere->getPosition();
-                        float distToSphere = glm::length(glm::vec2(waterIntersect.x - spherePos.x, 
-                                                                  waterIntersect.z - spherePos.z));
-                        
-                        if (distToSphere < sphere->getRadius() * 1.5f) {
-                            // Close enough to grab the sphere
-                            isDraggingSphere = true;
-                            sphere->setDragged(true);
-                            
-                            // Store initial world position for dragging
-                            float depth = glm::length(camera.Position - sphere->getPosition());
-                            lastMouseWorldPos = screenToWorld(static_cast<float>(xpos), static_cast<float>(ypos), depth);
-                            
-                            // Reset velocity tracking
-                            previousSpherePos = sphere->getPosition();
-                            dragVelocityTrackTime = 0.0f;
-                        } else {
-                            // Start creating a ripple at the intersection point
-                            isCreatingRipple = true;
-                            rippleHoldTime = 0.0f;
-                            ripplePosition = waterIntersect;
-                            
-                            // Create an initial small interaction
-                            simulationManager->addRipple(waterIntersect, 0.1f);
-                        }
-                    }
-                }
-            }
-            
-            // If we didn't click water or sphere above, check for direct sphere click
-            if (!isDraggingSphere && !isCreatingRipple) {
-                // Try raycast against sphere for direct selection
-                // Simple implementation: if cursor is "close enough" to sphere on screen, select it
-                float depth = glm::length(camera.Position - sphere->getPosition());
-                glm::vec3 sphereScreenPos = sphere->getPosition();
-                worldPos = screenToWorld(static_cast<float>(xpos), static_cast<float>(ypos), depth);
-                
-                float distToSphere = glm::length(worldPos - sphere->getPosition());
-                if (distToSphere < sphere->getRadius() * 1.5f) {
-                    isDraggingSphere = true;
-                    sphere->setDragged(true);
-                    lastMouseWorldPos = worldPos;
-                    
-                    // Reset velocity tracking
-                    previousSpherePos = sphere->getPosition();
-                    dragVelocityTrackTime = 0.0f;
-                }
-            }
-        } else if (action == GLFW_RELEASE) {
-            // If we were creating a ripple, create the final interaction with the accumulated magnitude
-            if (isCreatingRipple) {
-                float rippleMagnitude = 0.1f + rippleHoldTime * RIPPLE_CHARGE_RATE;
-                simulationManager->addRipple(ripplePosition, rippleMagnitude);
-                isCreatingRipple = false;
-            }
-            
-            if (isDraggingSphere) {
-                // Calculate final velocity based on recent movement
-                glm::vec3 currentPos = sphere->getPosition();
-                glm::vec3 dragVelocity = (currentPos - previousSpherePos) / std::max(dragVelocityTrackTime, 0.016f);
+            if (isDraggingSphere) {
+                // Calculate final velocity based on recent movement
+                glm::vec3 currentPos = sphere->getPosition();
+                glm::vec3 dragVelocity = (currentPos - previousSpherePos) / std::max(dragVelocityTrackTime, 0.016f);
                 
                 // Apply some dampening to make it more realistic
                 dragVelocity *= 0.5f;
@@ -1379,12 +3142,240 @@ float calculateFPS(float deltaTime) {
     return fps;
 }
 
-void renderUI(float deltaTime) {
+// deltaTime is the time since the UI was last built, which with the UICache is most often
+// several frames
+void renderUI(float deltaTime, float fps) {
     // Create a window
     ImGui::Begin("Water Simulation Controls");
     
     // FPS counter
-    ImGui::Text("FPS: %.1f", calculateFPS(deltaTime));
+    ImGui::Text("FPS: %.1f", fps);
+    const WaterSim::UICache::Stats& uiStats = uiCache.getStats();
+    ImGui::Text("UI: %d builds, %d replays", uiStats.rebuilds, uiStats.replays);
+    ImGui::Text("GL state calls: %llu issued, %llu skipped",
+                (unsigned long long)lastFrameStateCalls.issued, (unsigned long long)lastFrameStateCalls.skipped);
+    if (frameGraph) {
+        const WaterSim::FrameGraph::Stats& graphStats = frameGraph->getStats();
+        ImGui::Text("Frame graph: %d of %d passes, %d targets in %d textures (%.1f MB)",
+                    graphStats.passes - graphStats.culledPasses, graphStats.passes,
+                    graphStats.transientTextures, graphStats.physicalTextures,
+                    graphStats.pooledBytes / (1024.0 * 1024.0));
+    }
+    const WaterSim::RenderTargetPool::Stats& targetStats = WaterSim::RenderTargetPool::instance().getStats();
+    ImGui::Text("Render targets: %d live (%.1f MB), %d idle (%.1f MB), %d allocated, %d reused",
+                targetStats.liveTextures, targetStats.liveBytes / (1024.0 * 1024.0),
+                targetStats.freeTextures + targetStats.fencedTextures, targetStats.idleBytes / (1024.0 * 1024.0),
+                targetStats.allocations, targetStats.reuses);
+    
+    // Tracked allocations against the driver's own numbers, and last frame's pass traffic
+    WaterSim::GPUMemoryTracker& memoryTracker = WaterSim::GPUMemoryTracker::instance();
+    ImGui::Text("GPU memory: %.1f MB tracked", memoryTracker.getTotalBytes() / (1024.0 * 1024.0));
+    if (ImGui::TreeNode("GPU Memory")) {
+        const double MB = 1024.0 * 1024.0;
+        WaterSim::GPUMemoryTracker::DriverMemory driver = memoryTracker.queryDriverMemory();
+        if (driver.source) {
+            if (driver.dedicatedBytes > 0) {
+                ImGui::Text("%s: %.0f of %.0f MB free, %d evictions (%.1f MB)", driver.source, driver.availableBytes / MB,
+                            driver.dedicatedBytes / MB, driver.evictions, driver.evictedBytes / MB);
+            } else {
+                ImGui::Text("%s: %.0f MB free for textures", driver.source, driver.availableBytes / MB);
+            }
+        } else {
+            ImGui::TextDisabled("No driver memory query (GL_NVX_gpu_memory_info, GL_ATI_meminfo)");
+        }
+        
+        for (const WaterSim::GPUMemoryTracker::Subsystem& subsystem : memoryTracker.getSubsystems()) {
+            ImGui::Text("%-26s %7.1f MB  (%d buffers %.1f MB, %d textures %.1f MB)", subsystem.name.c_str(),
+                        (subsystem.bufferBytes + subsystem.textureBytes) / MB, subsystem.buffers, subsystem.bufferBytes / MB,
+                        subsystem.textures, subsystem.textureBytes / MB);
+        }
+        WaterSim::ResourceManager::Stats assetStats = WaterSim::ResourceManager::instance().getStats();
+        ImGui::Text("%-26s %7.1f MB  (%d textures)", "Assets (resource manager)", assetStats.residentBytes / MB,
+                    assetStats.textures);
+        WaterSim::UploadQueue& uploadQueue = WaterSim::UploadQueue::instance();
+        WaterSim::UploadQueue::Stats uploadStats = uploadQueue.getStats();
+        ImGui::Text("%-26s %7.1f MB  (%d jobs, %d queued, %d past the ring)",
+                    uploadQueue.isThreaded() ? "Uploads (upload thread)" : "Uploads (render thread)",
+                    uploadStats.bytes / MB, uploadStats.completed, uploadQueue.getPendingCount(), uploadStats.unstaged);
+        
+        const std::vector<WaterSim::GPUMemoryTracker::PassTraffic>& traffic = memoryTracker.getLastFrameTraffic();
+        if (!traffic.empty() && ImGui::TreeNode("Pass Traffic (estimated)")) {
+            size_t totalRead = 0, totalWritten = 0;
+            for (const WaterSim::GPUMemoryTracker::PassTraffic& pass : traffic) {
+                ImGui::Text("%-26s %3dx  read %7.1f MB  write %7.1f MB", pass.name.c_str(), pass.runs,
+                            pass.readBytes / MB, pass.writtenBytes / MB);
+                totalRead += pass.readBytes;
+                totalWritten += pass.writtenBytes;
+            }
+            ImGui::Text("Frame: read %.1f MB, write %.1f MB", totalRead / MB, totalWritten / MB);
+            ImGui::TreePop();
+        }
+        ImGui::TreePop();
+    }
+    
+    // Recording: NVENC through ffmpeg where available, else a PNG sequence
+    if (frameCapture) {
+        static char captureBase[256] = "capture";
+        if (frameCapture->isRecording()) {
+            ImGui::Text("Recording %s (%s): %u frames, %u dropped", frameCapture->getBasePath().c_str(),
+                        frameCapture->getEncoderName(), frameCapture->getWrittenFrames(), frameCapture->getDroppedFrames());
+            if (ImGui::Button("Stop Recording")) {
+                frameCapture->stop();
+            }
+        } else {
+            ImGui::InputText("Capture Path", captureBase, sizeof(captureBase));
+            ImGui::Checkbox("Hardware Encode", &config.capture.hardwareEncode);
+            ImGui::SameLine();
+            if (ImGui::Button("Record")) {
+                frameCapture->start(captureBase, SCR_WIDTH, SCR_HEIGHT, config.capture.frameRate, config.capture.hardwareEncode);
+            }
+        }
+    }
+    // Rewind: scrubbing pauses the simulation at the frame, resuming drops the frames after it
+    if (ImGui::TreeNode("Rewind")) {
+        if (ImGui::Checkbox("Record", &config.rewind.enabled)) {
+            rewindTimeline->setSettings(rewindSettings());
+        }
+        ImGui::SameLine();
+        if (ImGui::SliderInt("Keyframe Interval", &config.rewind.keyframeInterval, 1, 120)) {
+            rewindTimeline->setSettings(rewindSettings());
+        }
+        if (ImGui::SliderInt("Budget (MB)", &config.rewind.budgetMB, 16, 2048)) {
+            rewindTimeline->setSettings(rewindSettings());
+        }
+        
+        WaterSim::RewindTimeline::Stats rewindStats = rewindTimeline->getStats();
+        if (rewindTimeline->hasFrames()) {
+            int frame = rewindStats.currentFrame;
+            if (ImGui::SliderInt("Frame", &frame, rewindStats.firstFrame, rewindStats.lastFrame)) {
+                WaterSim::RewindTimeline::Sphere rewindSphere;
+                stopSessionRecording(*simulationManager, "the rewind restores a state the session did not reach by its commands");
+                if (rewindTimeline->seek(frame, rewindSphere)) {
+                    sphere->setPosition(rewindSphere.position);
+                    sphere->setVelocity(rewindSphere.velocity);
+                }
+            }
+            if (rewindTimeline->isPaused()) {
+                if (ImGui::Button("Resume From Here")) {
+                    rewindTimeline->resume();
+                }
+            } else if (ImGui::Button("Pause")) {
+                rewindTimeline->pause();
+            }
+            ImGui::SameLine();
+            ImGui::Text("%d keyframes, %.1f MB, %d frames", rewindStats.keyframes,
+                        rewindStats.keyframeBytes / (1024.0 * 1024.0), rewindStats.lastFrame - rewindStats.firstFrame + 1);
+        }
+        if (!rewindTimeline->getStatus().empty()) {
+            ImGui::TextDisabled("%s", rewindTimeline->getStatus().c_str());
+        }
+        ImGui::TreePop();
+    }
+    
+    // Session recording (--record) and replay (--replay) of the simulation commands
+    if ((commandRecorder || commandReplay) && ImGui::TreeNode("Session Recording")) {
+        if (commandRecorder) {
+            ImGui::Text("Recording: %u ticks, %u commands, %.1f KB", commandRecorder->getTickCount(),
+                        commandRecorder->getCommandCount(), commandRecorder->getBytesWritten() / 1024.0);
+        } else {
+            ImGui::Text("Replaying: tick %u of %u", commandReplay->getCurrentTick(), commandReplay->getTickCount());
+        }
+        if (ImGui::Button("Stop")) {
+            stopSessionRecording(*simulationManager, "by the user");
+        }
+        ImGui::TreePop();
+    }
+    
+    // Warm standby: the simulations kept resident while another runs
+    if (ImGui::TreeNode("Standby")) {
+        bool standbyChanged = ImGui::Checkbox("Keep inactive simulations", &config.standby.enabled);
+        standbyChanged |= ImGui::SliderInt("Budget (MB)##standby", &config.standby.budgetMB, 0, 4096);
+        standbyChanged |= ImGui::SliderInt("Evict below free (MB)", &config.standby.minFreeMB, 0, 2048);
+        if (standbyChanged) {
+            simulationManager->trimStandby();
+        }
+        ImGui::Text("Regular water %s, SPH %s, %.1f MB",
+                    simulationManager->isOnStandby(WaterSim::SimulationType::REGULAR_WATER) ? "parked" : "-",
+                    simulationManager->isOnStandby(WaterSim::SimulationType::SPH_COMPUTE) ? "parked" : "-",
+                    simulationManager->getStandbyBytes() / (1024.0 * 1024.0));
+        if (ImGui::Button("Evict")) {
+            simulationManager->evictStandby();
+        }
+        ImGui::TreePop();
+    }
+    
+    if (!configFile.getPath().empty() || !configFile.getPreset().empty()) {
+        ImGui::Text("Config: %s%s%s, %d reloads", configFile.getPath().empty() ? "-" : configFile.getPath().c_str(),
+                    configFile.getPreset().empty() ? "" : ", preset ", configFile.getPreset().c_str(), configFile.getReloads());
+    }
+    if (ImGui::Checkbox("Profiler", &showProfiler)) {
+        WaterSim::Profiler::instance().setEnabled(showProfiler);
+    }
+    ImGui::SameLine();
+    if (ImGui::Checkbox("Debug Logging", &config.debug.enableLogging)) {
+        WaterSim::Logger::instance().setEnabled(config.debug.enableLogging);
+    }
+    
+    // Frame pacing and the input latency it buys
+    const WaterSim::FramePacer::Stats& pacing = framePacer.getStats();
+    ImGui::Text("Input to display: %.1f ms (mean %.1f, max %.1f)", pacing.latencyMs, pacing.averageLatencyMs, pacing.maxLatencyMs);
+    if (ImGui::TreeNode("Frame Pacing")) {
+        ImGui::SliderInt("Frames in flight", &config.pacing.maxFramesInFlight, 1, WaterSim::FramePacer::MAX_FRAMES_IN_FLIGHT);
+        ImGui::SliderFloat("Frame rate cap", &config.pacing.frameRateCap, 0.0f, 360.0f,
+                           config.pacing.frameRateCap > 0.0f ? "%.0f fps" : "Off");
+        ImGui::Checkbox("Late input sampling", &config.pacing.lateInputSampling);
+        if (ImGui::SliderFloat("Simulation tick rate", &config.physics.tickRate, 0.0f, 240.0f,
+                               config.physics.tickRate > 0.0f ? "%.0f Hz" : "Every frame")) {
+            applySimulationClockSettings();
+        }
+        ImGui::Text("Tick %.0f%% of the way to the next", simulationClock.getAlpha() * 100.0f);
+        ImGui::Text("Waited %.2f ms for the GPU (%d in flight), %.2f ms for the cap",
+                    pacing.gpuWaitMs, pacing.framesInFlight, pacing.limiterWaitMs);
+        
+        const std::deque<float>& history = framePacer.getLatencyHistory();
+        std::vector<float> latencies(history.begin(), history.end());
+        if (!latencies.empty()) {
+            ImGui::PlotLines("Latency (ms)", latencies.data(), static_cast<int>(latencies.size()), 0, nullptr,
+                             0.0f, std::max(static_cast<float>(pacing.maxLatencyMs) * 1.25f, 1.0f), ImVec2(0, 50));
+        }
+        ImGui::TreePop();
+    }
+    
+    // Frame budget: the governor's knobs and the level each is at
+    if (ImGui::TreeNode("Frame Budget")) {
+        bool budgetChanged = ImGui::Checkbox("Govern frame time", &config.budget.enabled);
+        budgetChanged |= ImGui::SliderFloat("Target (ms)", &config.budget.targetMs, 4.0f, 50.0f, "%.1f");
+        if (budgetChanged) {
+            applyFrameBudgetSettings();
+        }
+        if (benchmark) {
+            ImGui::TextDisabled("Off during a benchmark");
+        } else if (frameBudget->getSettings().enabled) {
+            ImGui::Text("GPU frame: %.2f ms of %.1f", frameBudget->getFrameMs(), frameBudget->getSettings().targetMs);
+            for (const WaterSim::FrameBudget::KnobStatus& knob : frameBudget->getStatus()) {
+                if (knob.active) {
+                    ImGui::Text("%-20s %-28s %5.2f ms (full %.2f)", knob.name.c_str(), knob.level.c_str(),
+                                knob.measuredMs, knob.fullMs);
+                } else {
+                    ImGui::TextDisabled("%-20s inactive", knob.name.c_str());
+                }
+            }
+        }
+        ImGui::TreePop();
+    }
+    
+    // Subsystems created on first use: which are resident, and what creating them cost
+    if (ImGui::TreeNode("Lazy Subsystems")) {
+        for (const WaterSim::SubsystemRegistry::Status& status : subsystems.getStatus()) {
+            if (status.resident) {
+                ImGui::Text("%-16s resident, idle %d frames (created %dx, %.0f ms)", status.name.c_str(),
+                            status.idleFrames, status.creations, status.createMs);
+            } else {
+                ImGui::TextDisabled("%-16s released (created %dx)", status.name.c_str(), status.creations);
+            }
+        }
+        ImGui::TreePop();
+    }
     
     // Camera position
     ImGui::Text("Camera Position: (%.1f, %.1f, %.1f)", camera.Position.x, camera.Position.y, camera.Position.z);
@@ -1447,11 +3438,13 @@ void renderUI(float deltaTime) {
     ImGui::Text("Sphere Settings");
     ImGui::Text("Position: (%.1f, %.1f, %.1f)", 
                 sphere->getPosition().x, sphere->getPosition().y, sphere->getPosition().z);
+    ImGui::Text("Detail Level: %d of %d", sphere->getLOD() + 1, Sphere::LOD_COUNT);
     
     // Sphere appearance
     ImGui::Checkbox("Mirror Reflections", &enableSphereReflections);
     if (enableSphereReflections) {
         ImGui::SliderFloat("Reflectivity", &sphereReflectivity, 0.0f, 1.0f);
+        ImGui::SliderFloat("Roughness", &sphereRoughness, 0.0f, 1.0f);
     }
     
     // Gravity toggle
@@ -1555,6 +3548,9 @@ void renderUI(float deltaTime) {
         case WaterSim::SimulationType::SPH_COMPUTE:
             currentTypeName = "SPH Fluid Simulation";
             break;
+        case WaterSim::SimulationType::SPH_PLAYBACK:
+            currentTypeName = "SPH Playback";
+            break;
         case WaterSim::SimulationType::NONE:
         default:
             currentTypeName = "None Selected";
@@ -1563,6 +3559,27 @@ void renderUI(float deltaTime) {
     ImGui::Text("Current: %s", currentTypeName);
     ImGui::Text("Press ESC to open the main menu to switch simulations");
     
+    // Baked playback: transport, and seeking by keyframe
+    if (WaterSim::SPHPlayback* playback = simulationManager->isSPHPlaybackActive() ? simulationManager->getPlayback() : nullptr) {
+        ImGui::Separator();
+        ImGui::Text("SPH Playback");
+        WaterSim::SPHPlayback::Settings& settings = playback->getSettings();
+        ImGui::Text("Frame %u / %u, %.2f s of %.2f s", playback->getCurrentKeyframe() + 1, playback->getKeyframeCount(),
+                    playback->getPlayhead() - playback->getStartTime(), playback->getEndTime() - playback->getStartTime());
+        ImGui::Text("Particles: %u", playback->getParticleCount());
+        ImGui::Checkbox("Paused", &settings.paused);
+        ImGui::SameLine();
+        ImGui::Checkbox("Loop", &settings.loop);
+        ImGui::SliderFloat("Speed", &settings.speed, -4.0f, 4.0f, "%.2fx");
+        ImGui::SliderInt("Read Ahead", &settings.readAhead, 1, 32);
+        int keyframe = static_cast<int>(playback->getCurrentKeyframe());
+        if (ImGui::SliderInt("Keyframe", &keyframe, 0, static_cast<int>(playback->getKeyframeCount()) - 1)) {
+            playback->seek(static_cast<uint32_t>(keyframe));
+        }
+        ImGui::Text("Decoded: %u, late: %u, failed: %u", playback->getDecodedFrames(), playback->getLateFrames(),
+                    playback->getFailedFrames());
+    }
+    
     // SPH-specific controls
     if (simulationManager->isSPHComputeActive()) {
         ImGui::Separator();
@@ -1613,25 +3630,260 @@ void renderUI(float deltaTime) {
                     if (ImGui::Button("Zero Gravity")) {
                         sphComputeSystem->setGravity(glm::vec3(0.0f, 0.0f, 0.0f));
                     }
+                    
+                    // Uploaded with the next substep's parameter block, no recompile
+                    float boundaryDamping = sphComputeSystem->getBoundaryDamping();
+                    if (ImGui::SliderFloat("Boundary Damping", &boundaryDamping, 0.0f, 1.0f)) {
+                        sphComputeSystem->setBoundaryDamping(boundaryDamping);
+                    }
+                    float surfaceTension = sphComputeSystem->getSurfaceTension();
+                    if (ImGui::SliderFloat("Surface Tension", &surfaceTension, 0.0f, 5.0f, "%.4f", ImGuiSliderFlags_Logarithmic)) {
+                        sphComputeSystem->setSurfaceTension(surfaceTension);
+                    }
+                    
+                    // Multiphase table (uniform block, no recompile while the phase count holds)
+                    std::vector<WaterSim::SPHPhase> phases = sphComputeSystem->getPhases();
+                    if (phases.size() > 1) {
+                        bool phasesChanged = false;
+                        for (size_t i = 0; i < phases.size(); i++) {
+                            ImGui::PushID(static_cast<int>(i));
+                            ImGui::Text("Phase %zu:", i);
+                            phasesChanged |= ImGui::SliderFloat("Rest Density", &phases[i].restDensity, 100.0f, 2000.0f, "%.0f");
+                            phasesChanged |= ImGui::SliderFloat("Viscosity", &phases[i].viscosity, 0.0f, 1.0f, "%.3f");
+                            phasesChanged |= ImGui::SliderFloat("Interface Tension", &phases[i].interfaceTension, 0.0f, 5.0f, "%.3f", ImGuiSliderFlags_Logarithmic);
+                            ImGui::PopID();
+                        }
+                        if (phasesChanged) {
+                            sphComputeSystem->setPhases(phases);
+                        }
+                        int emitPhase = static_cast<int>(sphComputeSystem->getEmitPhase());
+                        if (ImGui::SliderInt("Emit Phase", &emitPhase, 0, static_cast<int>(phases.size()) - 1)) {
+                            sphComputeSystem->setEmitPhase(static_cast<uint32_t>(emitPhase));
+                        }
+                    }
+                    
+                    // Fluid parameters are compiled into the shaders, so apply on release only
+                    WaterSim::SPHShaderParameters fluid = sphComputeSystem->getShaderParameters();
+                    bool fluidChanged = false;
+                    ImGui::Text("Fluid (recompiles shaders):");
+                    ImGui::SliderFloat("Kernel Radius", &fluid.kernelRadius, WaterSim::SPHConstants::PARTICLE_RADIUS, WaterSim::SPHConstants::CELL_SIZE, "%.4f");
+                    fluidChanged |= ImGui::IsItemDeactivatedAfterEdit();
+                    ImGui::SliderFloat("Particle Mass", &fluid.mass, 0.001f, 0.1f, "%.4f");
+                    fluidChanged |= ImGui::IsItemDeactivatedAfterEdit();
+                    ImGui::SliderFloat("Stiffness", &fluid.stiffness, 10.0f, 2000.0f, "%.0f");
+                    fluidChanged |= ImGui::IsItemDeactivatedAfterEdit();
+                    ImGui::SliderFloat("Viscosity", &fluid.viscosity, 0.0f, 0.5f, "%.3f");
+                    fluidChanged |= ImGui::IsItemDeactivatedAfterEdit();
+                    fluidChanged |= ImGui::Checkbox("Tait Equation", &fluid.taitEquation);
+                    if (fluid.taitEquation) {
+                        ImGui::SameLine();
+                        ImGui::SetNextItemWidth(80.0f);
+                        ImGui::SliderInt("Exponent", &fluid.taitExponent, 1, 15);
+                        fluidChanged |= ImGui::IsItemDeactivatedAfterEdit();
+                    }
+                    ImGui::SliderFloat("Pressure Limit", &fluid.pressureLimit, 1000.0f, 200000.0f, "%.0f", ImGuiSliderFlags_Logarithmic);
+                    fluidChanged |= ImGui::IsItemDeactivatedAfterEdit();
+                    const char* workGroupSizes[] = { "32", "64", "256" };
+                    const uint32_t workGroupValues[] = { 32, 64, 256 };
+                    int workGroupIndex = fluid.workGroupSize == 32 ? 0 : (fluid.workGroupSize == 256 ? 2 : 1);
+                    if (ImGui::Combo("Workgroup Size", &workGroupIndex, workGroupSizes, 3)) {
+                        fluid.workGroupSize = workGroupValues[workGroupIndex];
+                        fluidChanged = true;
+                    }
+                    if (fluidChanged) {
+                        sphComputeSystem->setShaderParameters(fluid);
+                    }
+                    if (ImGui::Button("Default Fluid")) {
+                        sphComputeSystem->setShaderParameters(WaterSim::SPHShaderParameters());
+                    }
                 }
                 
                 // Rendering options
                 if (ImGui::CollapsingHeader("Rendering Options")) {
                     static int colorMode = 0;
-                    const char* colorModes[] = { "Normal", "Velocity", "Density", "Pressure" };
-                    if (ImGui::Combo("Color Mode", &colorMode, colorModes, 4)) {
+                    const char* colorModes[] = { "Normal", "Velocity", "Density", "Pressure", "Phase" };
+                    if (ImGui::Combo("Color Mode", &colorMode, colorModes, 5)) {
                         sphComputeSystem->setColorMode(static_cast<WaterSim::SPHComputeSystem::ColorMode>(colorMode));
                     }
                     
-                    static bool useFilteredViscosity = true;
+                    int renderMode = static_cast<int>(sphComputeSystem->getRenderMode());
+                    const char* renderModes[] = { "Particles", "Screen-Space Fluid", "Surface Mesh" };
+                    if (ImGui::Combo("Render Mode", &renderMode, renderModes, 3)) {
+                        sphComputeSystem->setRenderMode(static_cast<WaterSim::SPHComputeSystem::RenderMode>(renderMode));
+                    }
+                    int surfaceResolution = sphComputeSystem->getSurfaceResolution();
+                    if (ImGui::SliderInt("Surface Nodes per Cell", &surfaceResolution, 1, 4)) {
+                        sphComputeSystem->setSurfaceResolution(surfaceResolution);
+                    }
+                    float surfaceIsoLevel = sphComputeSystem->getSurfaceIsoLevel();
+                    if (ImGui::SliderFloat("Surface Iso Level", &surfaceIsoLevel, 0.1f, 1.0f)) {
+                        sphComputeSystem->setSurfaceIsoLevel(surfaceIsoLevel);
+                    }
+                    
+                    bool diffuseParticles = sphComputeSystem->getUseDiffuseParticles();
+                    if (ImGui::Checkbox("Spray, Foam and Bubbles", &diffuseParticles)) {
+                        sphComputeSystem->setUseDiffuseParticles(diffuseParticles);
+                    }
+                    if (diffuseParticles) {
+                        WaterSim::SPHDiffuseParameters diffuse = sphComputeSystem->getDiffuseParameters();
+                        bool changed = false;
+                        changed |= ImGui::SliderFloat2("Trapped Air Range", &diffuse.trappedAirRange[0], 0.0f, 20.0f);
+                        changed |= ImGui::SliderFloat2("Wave Crest Range", &diffuse.waveCrestRange[0], 0.0f, 10.0f);
+                        changed |= ImGui::SliderFloat2("Kinetic Energy Range", &diffuse.kineticEnergyRange[0], 0.0f, 20.0f);
+                        changed |= ImGui::SliderFloat("Trapped Air Rate", &diffuse.trappedAirRate, 0.0f, 200.0f);
+                        changed |= ImGui::SliderFloat("Wave Crest Rate", &diffuse.waveCrestRate, 0.0f, 200.0f);
+                        changed |= ImGui::SliderFloat2("Diffuse Lifetime", &diffuse.lifetimeRange[0], 0.1f, 10.0f);
+                        changed |= ImGui::SliderFloat("Bubble Buoyancy", &diffuse.buoyancy, 0.0f, 10.0f);
+                        changed |= ImGui::SliderFloat("Bubble Drag", &diffuse.drag, 0.0f, 1.0f);
+                        if (changed) {
+                            sphComputeSystem->setDiffuseParameters(diffuse);
+                        }
+                    }
+                    
+                    static bool useFilteredViscosity = false;
                     if (ImGui::Checkbox("Filtered Viscosity", &useFilteredViscosity)) {
                         sphComputeSystem->setUseFilteredViscosity(useFilteredViscosity);
                     }
                     
+                    float fluidRenderScale = sphComputeSystem->getFluidRenderScale();
+                    if (ImGui::SliderFloat("Fluid Render Scale", &fluidRenderScale, 0.25f, 1.0f)) {
+                        sphComputeSystem->setFluidRenderScale(fluidRenderScale);
+                    }
+                    
+                    int smoothingMode = static_cast<int>(sphComputeSystem->getSmoothingMode());
+                    const char* smoothingModes[] = { "Curvature Flow (Fragment)", "Curvature Flow (Compute)", "Bilateral" };
+                    if (ImGui::Combo("Depth Smoothing", &smoothingMode, smoothingModes, 3)) {
+                        sphComputeSystem->setSmoothingMode(static_cast<WaterSim::SPHComputeSystem::SmoothingMode>(smoothingMode));
+                    }
+                    
                     static int curvatureFlowIterations = 50;
                     if (ImGui::SliderInt("Curvature Flow Iterations", &curvatureFlowIterations, 0, 100)) {
                         sphComputeSystem->setCurvatureFlowIterations(curvatureFlowIterations);
                     }
+                    
+                    bool particleCulling = sphComputeSystem->getUseParticleCulling();
+                    if (ImGui::Checkbox("GPU Particle Culling", &particleCulling)) {
+                        sphComputeSystem->setUseParticleCulling(particleCulling);
+                    }
+                    bool renderStream = sphComputeSystem->getUseRenderStream();
+                    if (ImGui::Checkbox("Quantized Render Stream", &renderStream)) {
+                        sphComputeSystem->setUseRenderStream(renderStream);
+                    }
+                    bool occlusionCulling = sphComputeSystem->getUseOcclusionCulling();
+                    if (ImGui::Checkbox("Hi-Z Occlusion Culling", &occlusionCulling)) {
+                        sphComputeSystem->setUseOcclusionCulling(occlusionCulling);
+                    }
+                    bool surfaceSplatting = sphComputeSystem->getUseSurfaceSplatting();
+                    if (ImGui::Checkbox("Splat Surface Particles Only", &surfaceSplatting)) {
+                        sphComputeSystem->setUseSurfaceSplatting(surfaceSplatting);
+                    }
+                    float surfaceRatio = sphComputeSystem->getSurfaceDensityRatio();
+                    if (ImGui::SliderFloat("Surface Density Ratio", &surfaceRatio, 0.5f, 1.0f)) {
+                        sphComputeSystem->setSurfaceDensityRatio(surfaceRatio);
+                    }
+                    bool computeSplat = sphComputeSystem->getUseComputeSplat();
+                    if (ImGui::Checkbox("Compute Depth Splatting", &computeSplat)) {
+                        sphComputeSystem->setUseComputeSplat(computeSplat);
+                    }
+                }
+                
+                // Time stepping
+                if (ImGui::CollapsingHeader("Time Stepping")) {
+                    bool adaptive = sphComputeSystem->getAdaptiveTimeStep();
+                    if (ImGui::Checkbox("Adaptive (CFL) Time Step", &adaptive)) {
+                        sphComputeSystem->setAdaptiveTimeStep(adaptive);
+                    }
+                    int pressureSolver = static_cast<int>(sphComputeSystem->getPressureSolver());
+                    const char* pressureSolvers[] = { "WCSPH", "PCISPH" };
+                    if (ImGui::Combo("Pressure Solver", &pressureSolver, pressureSolvers, 2)) {
+                        sphComputeSystem->setPressureSolver(static_cast<WaterSim::SPHComputeSystem::PressureSolver>(pressureSolver));
+                    }
+                    bool implicitViscosity = sphComputeSystem->getImplicitViscosity();
+                    if (ImGui::Checkbox("Implicit Viscosity", &implicitViscosity)) {
+                        sphComputeSystem->setImplicitViscosity(implicitViscosity);
+                    }
+                    ImGui::Text("dt: %.5f s, substeps: %d", sphComputeSystem->getTimeStep(), sphComputeSystem->getLastSubstepCount());
+                    
+                    bool statistics = sphComputeSystem->getStatisticsEnabled();
+                    if (ImGui::Checkbox("GPU Statistics", &statistics)) {
+                        sphComputeSystem->setStatisticsEnabled(statistics);
+                    }
+                    const WaterSim::SPHStatistics& stats = sphComputeSystem->getStatistics();
+                    ImGui::Text("Speed min/max/mean: %.2f / %.2f / %.2f m/s", stats.minSpeed, stats.maxSpeed, stats.meanSpeed);
+                    ImGui::Text("Density min/max/mean: %.0f / %.0f / %.0f", stats.minDensity, stats.maxDensity, stats.meanDensity);
+#ifdef SPH_GPU_COUNTERS
+                    ImGui::Checkbox("GPU Counters", &config.debug.showSPHDebug);
+                    if (config.debug.showSPHDebug) {
+                        renderSPHCounters(sphComputeSystem->getCounters());
+                    }
+#endif
+                }
+                
+                // Neighbor search options
+                if (ImGui::CollapsingHeader("Neighbor Search")) {
+                    int sortMode = static_cast<int>(sphComputeSystem->getSortMode());
+                    const char* sortModes[] = { "Atomic Scatter", "Morton Radix Sort" };
+                    if (ImGui::Combo("Particle Sort", &sortMode, sortModes, 2)) {
+                        sphComputeSystem->setSortMode(static_cast<WaterSim::SPHComputeSystem::SortMode>(sortMode));
+                    }
+                    bool deterministic = sphComputeSystem->getDeterministic();
+                    if (ImGui::Checkbox("Deterministic (stable sort, fixed dt)", &deterministic)) {
+                        sphComputeSystem->setDeterministic(deterministic);
+                    }
+                    bool fusedGridClear = sphComputeSystem->getUseFusedGridClear();
+                    if (ImGui::Checkbox("Fused Grid Clear", &fusedGridClear)) {
+                        sphComputeSystem->setUseFusedGridClear(fusedGridClear);
+                    }
+                    bool useNeighborLists = sphComputeSystem->getUseNeighborLists();
+                    if (ImGui::Checkbox("Verlet Neighbor Lists", &useNeighborLists)) {
+                        sphComputeSystem->setUseNeighborLists(useNeighborLists);
+                    }
+                    bool tiledNeighborLoop = sphComputeSystem->getUseTiledNeighborLoop();
+                    if (ImGui::Checkbox("Shared-Memory Tiled Neighbor Loop", &tiledNeighborLoop)) {
+                        sphComputeSystem->setUseTiledNeighborLoop(tiledNeighborLoop);
+                    }
+                    if (tiledNeighborLoop) {
+                        bool particleSleeping = sphComputeSystem->getUseParticleSleeping();
+                        if (ImGui::Checkbox("Particle Sleeping", &particleSleeping)) {
+                            sphComputeSystem->setUseParticleSleeping(particleSleeping);
+                        }
+                        if (particleSleeping) {
+                            float sleepVelocity = sphComputeSystem->getSleepVelocity();
+                            float sleepDensityChange = sphComputeSystem->getSleepDensityChange();
+                            int sleepSubsteps = sphComputeSystem->getSleepSubsteps();
+                            bool changed = ImGui::SliderFloat("Sleep Velocity", &sleepVelocity, 0.001f, 0.5f, "%.3f m/s");
+                            changed |= ImGui::SliderFloat("Sleep Density Change", &sleepDensityChange, 0.00001f, 0.01f, "%.5f");
+                            changed |= ImGui::SliderInt("Sleep Substeps", &sleepSubsteps, 1, 200);
+                            if (changed) {
+                                sphComputeSystem->setSleepThresholds(sleepVelocity, sleepDensityChange, sleepSubsteps);
+                            }
+                        }
+                    }
+                    bool multirate = sphComputeSystem->getUseMultirate();
+                    if (ImGui::Checkbox("Multirate Time Levels", &multirate)) {
+                        sphComputeSystem->setUseMultirate(multirate);
+                    }
+                    if (sphComputeSystem->getAdaptiveResolution()) {
+                        float mergeRatio = sphComputeSystem->getAdaptiveMergeDensityRatio();
+                        if (ImGui::SliderFloat("Merge Density Ratio", &mergeRatio, 0.9f, 1.2f)) {
+                            sphComputeSystem->setAdaptiveMergeDensityRatio(mergeRatio);
+                        }
+                        float detailDistance = sphComputeSystem->getAdaptiveDetailDistance();
+                        if (ImGui::SliderFloat("Detail Distance", &detailDistance, 0.0f, 20.0f, "%.1f m")) {
+                            sphComputeSystem->setAdaptiveDetailDistance(detailDistance);
+                        }
+                    }
+                    if (sphComputeSystem->getNarrowBand()) {
+                        float bandDepth = sphComputeSystem->getNarrowBandDepth();
+                        if (ImGui::SliderFloat("Band Depth", &bandDepth, 1.0f, 8.0f, "%.1f kernel radii")) {
+                            sphComputeSystem->setNarrowBandDepth(bandDepth);
+                        }
+                    }
+                    WaterSim::SPHShaderParameters kernelParameters = sphComputeSystem->getShaderParameters();
+                    if (ImGui::Checkbox("Tabulated Kernels", &kernelParameters.kernelTable)) {
+                        sphComputeSystem->setShaderParameters(kernelParameters);
+                    }
+                    ImGui::Text("Simulation GPU time: %.2f ms", sphComputeSystem->getSimulationTimeMs());
                 }
                 
                 // Gravity controls
@@ -1690,6 +3942,89 @@ void renderUI(float deltaTime) {
                         ImGui::SliderFloat("Stream Rate", &streamRate, 1.0f, 50.0f, "%.1f particles/sec");
                         simulationManager->addFluidStream(glm::vec3(0.0f, 3.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f), streamRate * deltaTime);
                     }
+                    
+                    // Drain in one floor corner: removed particles free their slots for the stream
+                    bool floorDrain = sphComputeSystem->getSinkCount() > 0;
+                    if (ImGui::Checkbox("Floor Drain", &floorDrain)) {
+                        sphComputeSystem->clearSinks();
+                        if (floorDrain) {
+                            glm::vec3 boxMin = sphComputeSystem->getBoxMin();
+                            glm::vec3 boxSize = sphComputeSystem->getBoxMax() - boxMin;
+                            sphComputeSystem->addSink(boxMin - glm::vec3(1.0f),
+                                                      boxMin + boxSize * glm::vec3(0.25f, 0.1f, 0.25f));
+                        }
+                    }
+                    ImGui::Text("Removed particles: %llu",
+                                static_cast<unsigned long long>(sphComputeSystem->getRemovedParticleCount()));
+                }
+                
+                // Static colliders baked into the step 1 distance field
+                if (ImGui::CollapsingHeader("Obstacles")) {
+                    bool obstacleField = sphComputeSystem->getUseObstacleField();
+                    if (ImGui::Checkbox("Distance Field Collisions", &obstacleField)) {
+                        sphComputeSystem->setUseObstacleField(obstacleField);
+                    }
+                    
+                    // A sphere resting on the floor and a pillar off to one side
+                    bool obstacles = sphComputeSystem->getObstacleCount() > 0;
+                    if (ImGui::Checkbox("Sphere and Pillar", &obstacles)) {
+                        sphComputeSystem->clearObstacles();
+                        if (obstacles) {
+                            glm::vec3 boxMin = sphComputeSystem->getBoxMin();
+                            glm::vec3 boxSize = sphComputeSystem->getBoxMax() - boxMin;
+                            float radius = 0.15f * std::min(boxSize.x, boxSize.z);
+                            sphComputeSystem->addObstacleSphere(boxMin + boxSize * glm::vec3(0.5f, 0.0f, 0.5f) +
+                                                                glm::vec3(0.0f, radius, 0.0f), radius);
+                            sphComputeSystem->addObstacleBox(boxMin + boxSize * glm::vec3(0.7f, 0.0f, 0.2f),
+                                                             boxMin + boxSize * glm::vec3(0.8f, 0.6f, 0.3f));
+                        }
+                    }
+                    ImGui::Text("Obstacles: %zu", sphComputeSystem->getObstacleCount());
+                }
+                
+                // Batched parameter sweep (sph.batchStiffnessSteps / batchViscositySteps)
+                if (!sphComputeSystem->getSceneParameters().empty() && ImGui::CollapsingHeader("Batched Scenes")) {
+                    const std::vector<WaterSim::SPHSceneParameters>& scenes = sphComputeSystem->getSceneParameters();
+                    for (uint32_t i = 0; i < scenes.size(); i++) {
+                        WaterSim::SPHSceneParameters scene = scenes[i];
+                        ImGui::PushID(static_cast<int>(i));
+                        ImGui::Text("Scene %u (x + %.1f)", i, sphComputeSystem->getSceneOffset(i).x);
+                        bool changed = ImGui::SliderFloat("Stiffness", &scene.stiffness, 10.0f, 2000.0f, "%.0f");
+                        changed |= ImGui::SliderFloat("Viscosity", &scene.viscosity, 0.001f, 0.5f, "%.3f");
+                        if (changed) {
+                            sphComputeSystem->setSceneParameters(i, scene);
+                        }
+                        ImGui::PopID();
+                    }
+                }
+                
+                // A level sensor over the FluidQueries, a frame or two behind
+                if (ImGui::CollapsingHeader("Fluid Sensor")) {
+                    ImGui::SliderFloat3("Sensor Min (fraction)", &fluidSensorMin[0], 0.0f, 1.0f);
+                    ImGui::SliderFloat3("Sensor Max (fraction)", &fluidSensorMax[0], 0.0f, 1.0f);
+                    WaterSim::FluidQueryResult sensor[2];
+                    if (fluidQueries->getResults(fluidSensorTicket, sensor)) {
+                        ImGui::Text("Box: %u particles, %.2f kg, %.0f%% full", sensor[0].count, sensor[0].mass, sensor[0].fill * 100.0f);
+                        ImGui::Text("Mean velocity: (%.2f, %.2f, %.2f)", sensor[0].velocity.x, sensor[0].velocity.y, sensor[0].velocity.z);
+                        ImGui::Text("Density at centre: %.1f kg/m^3", sensor[1].density);
+                        ImGui::Text("%llu frames old", static_cast<unsigned long long>(fluidQueries->getResultAge()));
+                    } else {
+                        ImGui::TextDisabled("Waiting for results");
+                    }
+                }
+                
+                if (ImGui::CollapsingHeader("Sphere Coupling")) {
+                    bool sphereCoupling = sphComputeSystem->getUseSphereCoupling();
+                    if (ImGui::Checkbox("Two-Way Sphere Coupling", &sphereCoupling)) {
+                        sphComputeSystem->setUseSphereCoupling(sphereCoupling);
+                    }
+                    float sphereFriction = sphComputeSystem->getSphereFriction();
+                    if (ImGui::SliderFloat("Sphere Friction", &sphereFriction, 0.0f, 1.0f)) {
+                        sphComputeSystem->setSphereFriction(sphereFriction);
+                    }
+                    glm::vec3 sphereForce = sphComputeSystem->getSphereForce();
+                    ImGui::Text("Fluid force: (%.2f, %.2f, %.2f) N from %u contacts", sphereForce.x, sphereForce.y,
+                                sphereForce.z, sphComputeSystem->getSphereContacts());
                 }
             }
         }
@@ -1698,12 +4033,33 @@ void renderUI(float deltaTime) {
     ImGui::Separator();
     ImGui::Text("Advanced Rendering");
     
+    // Edited shaders rebuild in the background and swap in once they link
+    WaterSim::ShaderCompiler& shaderCompiler = WaterSim::ShaderCompiler::instance();
+    bool hotReload = shaderCompiler.isHotReloadEnabled();
+    if (ImGui::Checkbox("Hot-Reload Shaders", &hotReload)) {
+        shaderCompiler.setHotReload(hotReload);
+    }
+    const WaterSim::ShaderCompiler::Stats& compilerStats = shaderCompiler.getStats();
+    ImGui::Text("Shaders: %d ready (%d cached), %d failed, %d building, %d reloads",
+                compilerStats.completed, compilerStats.cacheHits, compilerStats.failed,
+                shaderCompiler.getPendingCount(), compilerStats.reloads);
+    
+    WaterSim::ResourceManager& resources = WaterSim::ResourceManager::instance();
+    WaterSim::ResourceManager::Stats resourceStats = resources.getStats();
+    int budgetMB = static_cast<int>(resourceStats.budgetBytes >> 20);
+    if (ImGui::SliderInt("Resource Budget (MB, 0 = none)", &budgetMB, 0, 8192)) {
+        resources.setBudget(size_t(budgetMB) << 20);
+    }
+    ImGui::Text("Resources: %d textures, %d programs, %.1f MB resident, %d loading, %d evictions",
+                resourceStats.textures, resourceStats.programs, resourceStats.residentBytes / (1024.0 * 1024.0),
+                resourceStats.pending, resourceStats.evictions);
+    
     // Post-processing effects
     static bool bloomEnabled = true;
     static bool dofEnabled = false;
-    static bool volumetricEnabled = true;
     static float bloomThreshold = 1.0f;
     static float bloomIntensity = 0.5f;
+    static float bloomRadius = 1.0f;
     static float focusDistance = 10.0f;
     static float focusRange = 5.0f;
     
@@ -1715,9 +4071,7 @@ void renderUI(float deltaTime) {
         if (postProcessManager) postProcessManager->setDOFEnabled(dofEnabled);
     }
     
-    if (ImGui::Checkbox("Enable Volumetric Lighting", &volumetricEnabled)) {
-        if (postProcessManager) postProcessManager->setVolumetricLightingEnabled(volumetricEnabled);
-    }
+    ImGui::Checkbox("Enable Volumetric Lighting", &config.volumetrics.enabled);
     
     if (bloomEnabled) {
         if (ImGui::SliderFloat("Bloom Threshold", &bloomThreshold, 0.0f, 3.0f)) {
@@ -1726,6 +4080,21 @@ void renderUI(float deltaTime) {
         if (ImGui::SliderFloat("Bloom Intensity", &bloomIntensity, 0.0f, 2.0f)) {
             if (postProcessManager) postProcessManager->setBloomParams(bloomThreshold, bloomIntensity);
         }
+        if (ImGui::SliderFloat("Bloom Radius", &bloomRadius, 0.5f, 3.0f)) {
+            if (postProcessManager) postProcessManager->setBloomRadius(bloomRadius);
+        }
+        if (postProcessManager) {
+            ImGui::Text("Bloom chain: %d levels", postProcessManager->getBloomLevelCount());
+        }
+    }
+    
+    if (config.volumetrics.enabled) {
+        ImGui::SliderFloat("Scattering", &config.volumetrics.scattering, 0.0f, 0.2f, "%.3f");
+        ImGui::SliderFloat("Absorption", &config.volumetrics.absorption, 0.0f, 0.5f, "%.3f");
+        ImGui::SliderFloat("Anisotropy", &config.volumetrics.anisotropy, -0.9f, 0.9f);
+        ImGui::SliderFloat("Shaft Intensity", &config.volumetrics.intensity, 0.0f, 4.0f);
+        ImGui::SliderFloat("Froxel Distance", &config.volumetrics.maxDistance, 5.0f, 100.0f, "%.0f");
+        ImGui::SliderFloat("Froxel History", &config.volumetrics.temporalBlend, 0.0f, 0.98f);
     }
     
     if (dofEnabled) {
@@ -1737,12 +4106,182 @@ void renderUI(float deltaTime) {
         }
     }
     
+    // Floating debris: spheres and boxes dropped over the container
+    if (rigidBodies && ImGui::TreeNode("Rigid Bodies")) {
+        static int spawnCount = 64;
+        static float boxFraction = 0.5f;
+        static float bodyDensity = 500.0f;
+        static std::mt19937 spawnRandom(7);
+        ImGui::Text("Bodies: %u / %u", rigidBodies->getBodyCount(), WaterSim::RigidBodySystem::CAPACITY);
+        ImGui::SliderInt("Spawn Count", &spawnCount, 1, 256);
+        ImGui::SliderFloat("Boxes", &boxFraction, 0.0f, 1.0f);
+        ImGui::SliderFloat("Density", &bodyDensity, 100.0f, 2000.0f, "%.0f kg/m^3");
+        if (ImGui::Button("Drop Debris")) {
+            glm::vec3 halfSize(container->getWidth() * 0.4f, 0.0f, container->getDepth() * 0.4f);
+            std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+            float maxSize = rigidBodies->getMaxBodySize();
+            for (int i = 0; i < spawnCount; i++) {
+                glm::vec3 position = container->getPosition() +
+                                     glm::vec3((2.0f * unit(spawnRandom) - 1.0f) * halfSize.x,
+                                               container->getHeight() * (0.1f + 0.3f * unit(spawnRandom)),
+                                               (2.0f * unit(spawnRandom) - 1.0f) * halfSize.z);
+                bool box = unit(spawnRandom) < boxFraction;
+                glm::vec3 size = box ? glm::vec3(0.3f + 0.3f * unit(spawnRandom), 0.2f + 0.3f * unit(spawnRandom),
+                                                 0.3f + 0.3f * unit(spawnRandom)) * maxSize
+                                     : glm::vec3((0.4f + 0.6f * unit(spawnRandom)) * maxSize);
+                rigidBodies->addBody(box ? WaterSim::RigidBodySystem::Shape::BOX : WaterSim::RigidBodySystem::Shape::SPHERE,
+                                     position, size, bodyDensity);
+            }
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Clear Bodies")) {
+            rigidBodies->clear();
+        }
+        
+        WaterSim::RigidBodySystem::Settings bodySettings = rigidBodies->getSettings();
+        bool bodiesChanged = ImGui::SliderInt("Substeps", &bodySettings.substeps, 1, 8);
+        bodiesChanged |= ImGui::SliderFloat("Restitution", &bodySettings.restitution, 0.0f, 1.0f);
+        bodiesChanged |= ImGui::SliderFloat("Contact Friction", &bodySettings.friction, 0.0f, 1.0f);
+        bodiesChanged |= ImGui::SliderFloat("Fluid Friction", &bodySettings.fluidFriction, 0.0f, 1.0f);
+        if (bodiesChanged) {
+            rigidBodies->setSettings(bodySettings);
+        }
+        ImGui::TreePop();
+    }
+    
+    // Opaque depth first, so the sphere, the bodies and the sky shade each pixel once
+    ImGui::Checkbox("Depth Prepass", &config.display.depthPrepass);
+    
+    // Flat and defocused tiles of the water and fluid shaded at a half or quarter rate
+    ImGui::Checkbox("Variable Rate Shading", &config.display.variableRateShading);
+    if (config.display.variableRateShading && shadingRateImage) {
+        ImGui::SliderFloat("Rate Contrast", &config.display.shadingRateContrast, 0.005f, 0.2f, "%.3f");
+        ImGui::Text(shadingRateImage->isHardwareSupported() ? "Rasterizer rates and coarse traced composite"
+                                                            : "Coarse traced composite only (no NV_shading_rate_image)");
+    }
+    
+    // The scene at a fraction of the window, reconstructed against the jittered last frames
+    ImGui::Checkbox("Temporal Upscale", &config.display.temporalUpscale);
+    if (config.display.temporalUpscale) {
+        ImGui::SliderFloat("Render Scale", &config.display.renderScale, 0.5f, 1.0f, "%.2f");
+        ImGui::SliderFloat("History Feedback", &config.display.temporalFeedback, 0.5f, 0.98f, "%.2f");
+        if (config.stereo.enabled) {
+            ImGui::TextDisabled("Window size while stereo is on");
+        }
+    }
+    
+    // Both eyes side by side for a head-mounted display, from one multiview scene pass
+    if (stereoRenderer && stereoRenderer->isSupported()) {
+        ImGui::Checkbox("Stereo (Side by Side)", &config.stereo.enabled);
+        if (config.stereo.enabled) {
+            ImGui::SliderFloat("Eye Separation", &config.stereo.eyeSeparation, 0.0f, 0.2f);
+            ImGui::SliderFloat("Convergence", &config.stereo.convergence, 1.0f, 50.0f);
+            if (simulationManager->isSPHRenderActive()) {
+                ImGui::TextDisabled("Mono while SPH runs: its fluid pipeline is mono only");
+            }
+        }
+    } else {
+        ImGui::TextDisabled("Stereo: no GL_OVR_multiview2");
+    }
+    
+    // Cascaded shadows of the light, with the container's layers cached
+    if (shadowMapper && ImGui::TreeNode("Shadows")) {
+        static const int resolutions[] = { 1024, 2048, 4096 };
+        static const char* resolutionNames[] = { "1024", "2048", "4096" };
+        int resolutionIndex = config.shadows.resolution <= 1024 ? 0 : (config.shadows.resolution <= 2048 ? 1 : 2);
+        ImGui::Checkbox("Enable Shadows", &config.shadows.enabled);
+        if (ImGui::Combo("Cascade Resolution", &resolutionIndex, resolutionNames, 3)) {
+            config.shadows.resolution = resolutions[resolutionIndex];
+        }
+        ImGui::SliderFloat("Shadow Distance", &config.shadows.maxDistance, 5.0f, 100.0f, "%.0f");
+        ImGui::Checkbox("Cache Static Casters", &config.shadows.cacheStatic);
+        
+        const WaterSim::ShadowMapper::Stats& shadowStats = shadowMapper->getStats();
+        ImGui::Text("Splits: %.1f / %.1f / %.1f / %.1f", shadowStats.splits[0], shadowStats.splits[1],
+                    shadowStats.splits[2], shadowStats.splits[3]);
+        ImGui::Text("Cascades drawn: %d static, %d dynamic (%llu static redraws)", shadowStats.staticCascadesDrawn,
+                    shadowStats.dynamicCascadesDrawn, static_cast<unsigned long long>(shadowStats.staticRedraws));
+        ImGui::TreePop();
+    }
+    
+    // Floor caustics of the raster water, from the waves
+    if (ImGui::TreeNode("Raster Caustics")) {
+        ImGui::Checkbox("From the waves", &config.caustics.raster);
+        ImGui::SliderInt("Map Resolution", &config.caustics.resolution, 64, 1024);
+        ImGui::SliderInt("Redraw Every (frames)", &config.caustics.interval, 1, 4);
+        if (rayTracingEnabled) {
+            ImGui::TextDisabled("The ray tracer draws its own caustics");
+        }
+        ImGui::TreePop();
+    }
+    
+    // Clustered spotlights on the pool floor
+    if (clusteredLights && ImGui::TreeNode("Pool Lights")) {
+        ImGui::SliderInt("Lights", &config.lighting.poolLights, 0, WaterSim::ClusteredLights::MAX_LIGHTS);
+        ImGui::SliderFloat("Intensity", &config.lighting.poolLightIntensity, 0.0f, 20.0f);
+        ImGui::SliderFloat("Range", &config.lighting.poolLightRange, 1.0f, 20.0f);
+        ImGui::ColorEdit3("Color", &config.lighting.poolLightColor[0]);
+        ImGui::TreePop();
+    }
+    
+    // Planar reflection and refraction targets: resolution and refresh rate
+    if (reflectionRenderer && ImGui::TreeNode("Planar Reflections")) {
+        static const float scales[] = { 1.0f, 0.5f, 0.25f };
+        static const char* scaleNames[] = { "Full", "Half", "Quarter" };
+        bool layered = reflectionRenderer->isLayeredRendering();
+        
+        ImGui::BeginDisabled(!spherePlanarShader.isValid());
+        if (ImGui::Checkbox("Single Layered Pass", &layered)) {
+            reflectionRenderer->setLayeredRendering(layered);
+        }
+        ImGui::EndDisabled();
+        
+        const char* targetNames[] = { "Reflection", "Refraction" };
+        for (int i = 0; i < (layered ? 1 : PLANAR_TARGET_COUNT); i++) {
+            ReflectionRenderer::TargetSettings& targetSettings = reflectionRenderer->getSettings(static_cast<PlanarTarget>(i));
+            ImGui::PushID(i);
+            ImGui::Text("%s: %dx%d", layered ? "Both targets" : targetNames[i],
+                        reflectionRenderer->getTargetWidth(static_cast<PlanarTarget>(i)),
+                        reflectionRenderer->getTargetHeight(static_cast<PlanarTarget>(i)));
+            int scaleIndex = targetSettings.resolutionScale > 0.75f ? 0 : (targetSettings.resolutionScale > 0.375f ? 1 : 2);
+            if (ImGui::Combo("Resolution", &scaleIndex, scaleNames, 3)) {
+                targetSettings.resolutionScale = scales[scaleIndex];
+            }
+            ImGui::SliderInt("Refresh Every N Frames", &targetSettings.updateInterval, 1, 8);
+            ImGui::PopID();
+        }
+        
+        ReflectionRenderer::UpdateThresholds& thresholds = reflectionRenderer->getThresholds();
+        ImGui::SliderFloat("Camera Move Threshold", &thresholds.cameraDistance, 0.0f, 1.0f);
+        ImGui::SliderFloat("Camera Turn Threshold (deg)", &thresholds.cameraAngle, 0.0f, 10.0f);
+        ImGui::SliderFloat("Sphere Move Threshold", &thresholds.sphereDistance, 0.0f, 0.5f);
+        ImGui::TreePop();
+    }
+    
+    // Box-projected far-field probe behind the planar reflection
+    if (reflectionProbe && ImGui::TreeNode("Reflection Probe")) {
+        WaterSim::ReflectionProbe::Settings& probeSettings = reflectionProbe->getSettings();
+        ImGui::Checkbox("Enabled", &probeSettings.enabled);
+        static const int resolutions[] = { 64, 128, 256 };
+        static const char* resolutionNames[] = { "64", "128", "256" };
+        int resolutionIndex = probeSettings.resolution <= 64 ? 0 : (probeSettings.resolution <= 128 ? 1 : 2);
+        if (ImGui::Combo("Face Resolution", &resolutionIndex, resolutionNames, 3)) {
+            probeSettings.resolution = resolutions[resolutionIndex];
+        }
+        ImGui::Checkbox("Continuous Round Robin", &probeSettings.continuous);
+        ImGui::SliderFloat("Probe Sphere Threshold", &probeSettings.sphereThreshold, 0.0f, 0.5f);
+        ImGui::SliderFloat("Planar Up To", &probeSettings.nearDistance, 1.0f, 30.0f);
+        ImGui::SliderFloat("Probe From", &probeSettings.farDistance, probeSettings.nearDistance, 50.0f);
+        ImGui::Text("%s, %d face this frame", reflectionProbe->isValid() ? "Valid" : "Filling", reflectionProbe->getFacesUpdated());
+        ImGui::TreePop();
+    }
+    
     // Ray Tracing Controls
     ImGui::Separator();
     ImGui::Text("Real-Time Ray Tracing");
     
     // Use global ray tracing variables
-    const char* qualityItems[] = { "OFF", "LOW", "MEDIUM", "HIGH", "ULTRA" };
+    const char* qualityItems[] = { "OFF", "LOW", "MEDIUM", "HIGH", "ULTRA", "CHECKERBOARD", "INTERLEAVED 2x2" };
     
     if (ImGui::Checkbox("Enable Ray Tracing", &rayTracingEnabled)) {
         if (rayTracingManager) {
@@ -1766,18 +4305,47 @@ void renderUI(float deltaTime) {
             std::cout << "Ray tracing quality changed to: " << rayTracingQuality << " (" << qualityItems[rayTracingQuality] << ")" << std::endl;
         }
         
+        // Dynamic resolution: trace at whatever resolution holds the GPU budget
+        static bool dynamicResolution = false;
+        static float frameBudgetMs = 4.0f;
+        if (ImGui::Checkbox("Dynamic Resolution", &dynamicResolution)) {
+            rayTracingManager->setFrameBudget(dynamicResolution ? frameBudgetMs : 0.0f);
+        }
+        if (dynamicResolution) {
+            if (ImGui::SliderFloat("GPU Budget (ms)", &frameBudgetMs, 0.5f, 16.0f, "%.1f")) {
+                rayTracingManager->setFrameBudget(frameBudgetMs);
+            }
+            ImGui::Text("Traced at %.0f%% resolution", rayTracingManager->getResolutionScale() * 100.0f);
+        }
+        
         // Ray tracing features
-        static bool reflections = true, refractions = true, caustics = true;
+        static bool reflections = true, refractions = true, caustics = true, temporalDenoise = true, fusedKernel = false,
+                    compactGBuffer = true, causticMap = true;
+        static int causticMapInterval = 4;
+        static int upsampler = static_cast<int>(WaterSim::RayTracingUpsampler::EDGE_AWARE);
+        static const char* upsamplers[] = { "Bilinear", "Edge-Aware (EASU + RCAS)" };
         static float reflectionStrength = 1.0f, refractionStrength = 1.0f, causticStrength = 1.0f;
         
         if (ImGui::TreeNode("Ray Tracing Features")) {
             if (ImGui::Checkbox("Reflections", &reflections) ||
                 ImGui::Checkbox("Refractions", &refractions) ||
-                ImGui::Checkbox("Caustics", &caustics)) {
+                ImGui::Checkbox("Caustics", &caustics) ||
+                ImGui::Checkbox("Temporal Denoising", &temporalDenoise) ||
+                ImGui::Checkbox("Fused Kernel (caustics every 2nd frame)", &fusedKernel) ||
+                ImGui::Checkbox("Compact G-Buffer", &compactGBuffer) ||
+                ImGui::Combo("Upsampler", &upsampler, upsamplers, 2) ||
+                ImGui::Checkbox("Floor Caustic Map", &causticMap) ||
+                (causticMap && ImGui::SliderInt("Caustic Map Refresh (frames)", &causticMapInterval, 0, 16))) {
                 WaterSim::RayTracingFeatures features;
                 features.reflections = reflections;
                 features.refractions = refractions;
                 features.caustics = caustics;
+                features.temporalDenoise = temporalDenoise;
+                features.fusedKernel = fusedKernel;
+                features.compactGBuffer = compactGBuffer;
+                features.upsampler = static_cast<WaterSim::RayTracingUpsampler>(upsampler);
+                features.causticMap = causticMap;
+                features.causticMapInterval = causticMapInterval;
                 rayTracingManager->setFeatures(features);
             }
             
@@ -1787,8 +4355,16 @@ void renderUI(float deltaTime) {
             
             // Performance info
             ImGui::Separator();
-            ImGui::Text("Performance: %.2f ms/frame", rayTracingManager->getLastFrameTime());
+            ImGui::Text("Performance: %.2f ms/frame (GPU)", rayTracingManager->getLastFrameTime());
             ImGui::Text("Rays/sec: %d", rayTracingManager->getRaysPerSecond());
+            if (rayTracingManager->getQuality() == WaterSim::RayTracingQuality::ULTRA) {
+                ImGui::Text("Adaptive rays: %d extra over %d pixels", rayTracingManager->getAdaptiveSamples(),
+                            rayTracingManager->getAdaptiveTexels());
+            }
+            for (int pass = 0; pass < static_cast<int>(WaterSim::RayTracingPass::COUNT); pass++) {
+                WaterSim::RayTracingPass rtPass = static_cast<WaterSim::RayTracingPass>(pass);
+                ImGui::Text("  %s: %.3f ms", WaterSim::RayTracingManager::getPassName(rtPass), rayTracingManager->getPassTime(rtPass));
+            }
             
             ImGui::TreePop();
         }
@@ -1806,9 +4382,121 @@ void renderUI(float deltaTime) {
         // Micro-wave toggle
         ImGui::Checkbox("Enable Micro Detail", &enableMicroWaves);
         
-        // List all current waves
         WaterSurface* waterSurface = simulationManager->getWaterSurface();
         if (waterSurface) {
+            bool gpuWaves = waterSurface->getGPUWaves();
+            if (ImGui::Checkbox("GPU Waves (vertex shader)", &gpuWaves)) {
+                waterSurface->setGPUWaves(gpuWaves);
+            }
+            if (!waterSurface->getGPUWaves() && !waterSurface->getOceanWaves()) {
+                bool asyncUpdate = waterSurface->getAsyncUpdate();
+                if (ImGui::Checkbox("Pipelined CPU Waves (worker thread)", &asyncUpdate)) {
+                    waterSurface->setAsyncUpdate(asyncUpdate);
+                }
+                ImGui::Text("CPU mesh: %d / %d tiles updated", waterSurface->getLastUpdatedTiles(),
+                            waterSurface->getTileCount());
+            }
+            
+            bool tessellation = waterSurface->getTessellation();
+            if (ImGui::Checkbox("Hardware Tessellation", &tessellation)) {
+                waterSurface->setTessellation(tessellation && waterTessShader.isValid());
+            }
+            if (waterSurface->getTessellation()) {
+                float edgePixels = waterSurface->getTessEdgePixels();
+                if (ImGui::SliderFloat("Tessellation Edge (px)", &edgePixels, 2.0f, 32.0f)) {
+                    waterSurface->setTessEdgePixels(edgePixels);
+                }
+            }
+            
+            bool compactMesh = waterSurface->getCompactMesh();
+            if (ImGui::Checkbox("Compact Mesh (strips, packed vertices)", &compactMesh)) {
+                waterSurface->setCompactMesh(compactMesh);
+            }
+            
+            bool lodMesh = waterSurface->getLODMesh();
+            if (ImGui::Checkbox("LOD Mesh (camera-centred patches)", &lodMesh)) {
+                waterSurface->setLODMesh(lodMesh);
+            }
+            if (waterSurface->isLODMeshActive()) {
+                int patchVertices = (WaterSurface::LOD_PATCH_RESOLUTION + 1) * (WaterSurface::LOD_PATCH_RESOLUTION + 1);
+                ImGui::Text("LOD: %d patches, %d levels, %d vertices", waterSurface->getLODPatchCount(),
+                            waterSurface->getLODLevels(), waterSurface->getLODPatchCount() * patchVertices);
+            }
+            
+            bool heightfieldWaves = waterSurface->getHeightfieldWaves();
+            if (ImGui::Checkbox("Heightfield Ripples (wave equation)", &heightfieldWaves)) {
+                waterSurface->setHeightfieldWaves(heightfieldWaves, config.water.heightfieldResolution);
+            }
+            HeightfieldWaves* heightfield = waterSurface->getHeightfield();
+            if (heightfield) {
+                float waveSpeed = heightfield->getWaveSpeed();
+                if (ImGui::SliderFloat("Ripple Wave Speed", &waveSpeed, 0.2f, 4.0f)) {
+                    heightfield->setWaveSpeed(waveSpeed);
+                }
+                float damping = heightfield->getDamping();
+                if (ImGui::SliderFloat("Ripple Damping", &damping, 0.0f, 0.05f, "%.4f")) {
+                    heightfield->setDamping(damping);
+                }
+                if (ImGui::Button("Calm Ripples")) {
+                    heightfield->clear();
+                }
+            }
+            
+            bool flowMapEnabled = waterSurface->getFlowMapEnabled();
+            if (ImGui::Checkbox("Flow Map (GPU surface currents)", &flowMapEnabled)) {
+                waterSurface->setFlowMap(flowMapEnabled, config.water.flowMapResolution);
+            }
+            FlowMap* flowMap = waterSurface->getFlowMap();
+            if (flowMap) {
+                float relaxation = flowMap->getRelaxation();
+                if (ImGui::SliderFloat("Current Relaxation (1/s)", &relaxation, 0.1f, 10.0f, "%.2f")) {
+                    flowMap->setRelaxation(relaxation);
+                }
+                if (ImGui::Button("Calm Currents")) {
+                    flowMap->clear();
+                }
+            }
+            
+            bool oceanWaves = waterSurface->getOceanWaves();
+            if (ImGui::Checkbox("FFT Ocean", &oceanWaves)) {
+                waterSurface->setOceanWaves(oceanWaves);
+            }
+            if (waterSurface->getOceanWaves() && ImGui::TreeNode("Ocean Spectrum")) {
+                OceanFFT::Settings ocean = waterSurface->getOceanSettings();
+                bool changed = false;
+                
+                const char* resolutions[] = { "256", "512", "1024" };
+                int resolutionIndex = ocean.resolution >= 1024 ? 2 : (ocean.resolution >= 512 ? 1 : 0);
+                if (ImGui::Combo("Resolution", &resolutionIndex, resolutions, 3)) {
+                    ocean.resolution = 256 << resolutionIndex;
+                    changed = true;
+                }
+                int spectrum = ocean.spectrum == OceanFFT::Spectrum::JONSWAP ? 1 : 0;
+                if (ImGui::Combo("Spectrum", &spectrum, "Phillips\0JONSWAP\0")) {
+                    ocean.spectrum = spectrum == 1 ? OceanFFT::Spectrum::JONSWAP : OceanFFT::Spectrum::PHILLIPS;
+                    changed = true;
+                }
+                float windAngle = glm::degrees(std::atan2(ocean.windDirection.y, ocean.windDirection.x));
+                if (ImGui::SliderFloat("Wind Direction", &windAngle, -180.0f, 180.0f, "%.0f deg")) {
+                    ocean.windDirection = glm::vec2(std::cos(glm::radians(windAngle)), std::sin(glm::radians(windAngle)));
+                    changed = true;
+                }
+                changed |= ImGui::SliderFloat("Wind Speed", &ocean.windSpeed, 1.0f, 30.0f, "%.1f m/s");
+                if (ocean.spectrum == OceanFFT::Spectrum::JONSWAP) {
+                    changed |= ImGui::SliderFloat("Fetch", &ocean.fetch, 1000.0f, 500000.0f, "%.0f m", ImGuiSliderFlags_Logarithmic);
+                }
+                changed |= ImGui::SliderFloat("Patch Size", &ocean.patchSize, 4.0f, 256.0f, "%.0f", ImGuiSliderFlags_Logarithmic);
+                changed |= ImGui::SliderFloat("RMS Height", &ocean.rmsHeight, 0.0f, 0.5f);
+                changed |= ImGui::SliderFloat("Choppiness", &ocean.choppiness, 0.0f, 3.0f);
+                changed |= ImGui::SliderFloat("Foam Threshold", &ocean.foamThreshold, 0.0f, 1.5f);
+                changed |= ImGui::SliderFloat("Foam Decay", &ocean.foamDecay, 0.0f, 0.99f);
+                if (changed) {
+                    waterSurface->setOceanSettings(ocean);
+                }
+                ImGui::TreePop();
+            }
+            
+            // List all current waves
             auto& waves = waterSurface->getWaves();
             for (size_t i = 0; i < waves.size(); i++) {
                 ImGui::PushID(static_cast<int>(i));
@@ -1857,6 +4545,265 @@ void renderUI(float deltaTime) {
     
 }
 
+// Frame history as bars (click one to inspect it), then the timeline of the inspected
+// frame: a row per nesting level of every CPU track and of the GPU, and the markers'
+// times next to their average and worst over the history
+void renderProfilerPanel() {
+    WaterSim::Profiler& profiler = WaterSim::Profiler::instance();
+    ImGui::SetNextWindowSize(ImVec2(720, 520), ImGuiCond_FirstUseEver);
+    if (!ImGui::Begin("Profiler", &showProfiler)) {
+        ImGui::End();
+        return;
+    }
+    if (!showProfiler) {
+        profiler.setEnabled(false);
+        ImGui::End();
+        return;
+    }
+    
+    static bool showGPU = true;
+    static uint64_t selectedFrame = 0;   // 0 follows the newest frame
+    bool paused = profiler.isPaused();
+    if (ImGui::Checkbox("Pause", &paused)) {
+        profiler.setPaused(paused);
+        if (!paused) selectedFrame = 0;
+    }
+    ImGui::SameLine();
+    ImGui::Checkbox("GPU times in history", &showGPU);
+    
+    // The trace holds the last events of every thread, recorded whether or not this is open
+    WaterSim::TraceRecorder& trace = WaterSim::TraceRecorder::instance();
+    if (trace.isEnabled()) {
+        if (ImGui::Button("Save trace (Chrome JSON)")) {
+            trace.save(config.trace.outputPath.empty() ? "watersim_trace.json" : config.trace.outputPath);
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Save trace (Perfetto)")) {
+            trace.save("watersim_trace.pftrace");
+        }
+        
+        // Frames past the threshold save the trace around them by themselves
+        bool spikeChanged = ImGui::Checkbox("Save spikes", &config.spikeTrace.enabled);
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(160.0f);
+        spikeChanged |= ImGui::SliderFloat("Threshold (ms)", &config.spikeTrace.thresholdMs, 20.0f, 200.0f, "%.0f");
+        if (spikeChanged) {
+            flightRecorder.setSettings(spikeTraceSettings());
+        }
+        const WaterSim::FlightRecorder::Stats& spikes = flightRecorder.getStats();
+        ImGui::SameLine();
+        ImGui::Text("%d spikes, worst %.0f ms, %d saved", spikes.spikes, spikes.worstMs, spikes.saved);
+        if (!spikes.lastPath.empty()) {
+            ImGui::TextDisabled("Last: %s", spikes.lastPath.c_str());
+        }
+    }
+    
+    const std::deque<WaterSim::Profiler::Frame>& history = profiler.getHistory();
+    if (history.empty()) {
+        ImGui::Text("Waiting for the first timed frames...");
+        ImGui::End();
+        return;
+    }
+    
+    // History bars, scaled to the slowest frame but at least 33 ms so a smooth run reads flat
+    auto frameMs = [](const WaterSim::Profiler::Frame& frame) { return showGPU ? frame.gpuMs : frame.cpuMs; };
+    double scaleMs = 33.3;
+    for (const auto& frame : history) scaleMs = std::max(scaleMs, frameMs(frame));
+    
+    ImDrawList* drawList = ImGui::GetWindowDrawList();
+    ImVec2 origin = ImGui::GetCursorScreenPos();
+    ImVec2 graphSize(ImGui::GetContentRegionAvail().x, 80.0f);
+    ImGui::InvisibleButton("##history", graphSize);
+    bool graphHovered = ImGui::IsItemHovered();
+    drawList->AddRectFilled(origin, ImVec2(origin.x + graphSize.x, origin.y + graphSize.y), IM_COL32(20, 20, 24, 255));
+    float barWidth = graphSize.x / float(WaterSim::Profiler::HISTORY_FRAMES);
+    const WaterSim::Profiler::Frame* inspected = &history.back();
+    for (size_t i = 0; i < history.size(); i++) {
+        const auto& frame = history[i];
+        float x0 = origin.x + graphSize.x - float(history.size() - i) * barWidth;
+        float height = float(std::max(frameMs(frame), 0.0) / scaleMs) * graphSize.y;
+        bool selected = frame.index == selectedFrame;
+        if (selected) inspected = &frame;
+        ImU32 color = selected ? IM_COL32(255, 200, 60, 255) :
+                      frameMs(frame) > 16.7 ? IM_COL32(220, 80, 60, 255) : IM_COL32(90, 170, 90, 255);
+        drawList->AddRectFilled(ImVec2(x0, origin.y + graphSize.y - height), ImVec2(x0 + std::max(barWidth - 1.0f, 1.0f), origin.y + graphSize.y), color);
+        
+        float mouseX = ImGui::GetIO().MousePos.x;
+        if (graphHovered && mouseX >= x0 && mouseX < x0 + barWidth) {
+            ImGui::SetTooltip("Frame %llu: CPU %.2f ms, GPU %.2f ms", (unsigned long long)frame.index, frame.cpuMs, frame.gpuMs);
+            if (ImGui::IsMouseClicked(0)) {
+                selectedFrame = frame.index;
+                profiler.setPaused(true);
+            }
+        }
+    }
+    float budgetY = origin.y + graphSize.y - float(16.7 / scaleMs) * graphSize.y;
+    drawList->AddLine(ImVec2(origin.x, budgetY), ImVec2(origin.x + graphSize.x, budgetY), IM_COL32(255, 255, 255, 80));
+    
+    ImGui::Text("Frame %llu: CPU %.2f ms, GPU %.2f ms", (unsigned long long)inspected->index, inspected->cpuMs, inspected->gpuMs);
+    
+    // Timeline rows: each CPU track's levels, then the GPU's (frame thread markers only)
+    std::vector<std::string> tracks = profiler.getTrackNames();
+    struct Row { std::string label; int track; int depth; bool gpu; };
+    std::vector<Row> rows;
+    int trackCount = std::max(static_cast<int>(tracks.size()), 1);
+    std::vector<int> trackDepth(trackCount, 0);
+    for (const auto& marker : inspected->markers) {
+        if (marker.track < trackCount) trackDepth[marker.track] = std::max(trackDepth[marker.track], marker.depth + 1);
+    }
+    for (int track = 0; track < trackCount; track++) {
+        for (int depth = 0; depth < trackDepth[track]; depth++) {
+            rows.push_back({ (track < static_cast<int>(tracks.size()) ? tracks[track] : "Frame") + " CPU", track, depth, false });
+        }
+    }
+    for (int depth = 0; depth < trackDepth[0]; depth++) {
+        rows.push_back({ "GPU", 0, depth, true });
+    }
+    
+    const float rowHeight = ImGui::GetTextLineHeight() + 4.0f;
+    const float labelWidth = 110.0f;
+    double spanMs = std::max(std::max(inspected->cpuMs, inspected->gpuMs), 0.001);
+    ImVec2 timelineOrigin = ImGui::GetCursorScreenPos();
+    ImVec2 timelineSize(ImGui::GetContentRegionAvail().x, rowHeight * std::max<size_t>(rows.size(), 1));
+    ImGui::InvisibleButton("##timeline", timelineSize);
+    bool timelineHovered = ImGui::IsItemHovered();
+    float barsWidth = timelineSize.x - labelWidth;
+    ImVec2 mouse = ImGui::GetIO().MousePos;
+    
+    for (size_t row = 0; row < rows.size(); row++) {
+        float y0 = timelineOrigin.y + row * rowHeight;
+        if (rows[row].depth == 0) {
+            drawList->AddText(ImVec2(timelineOrigin.x, y0 + 2.0f), IM_COL32(200, 200, 200, 255), rows[row].label.c_str());
+        }
+        for (const auto& marker : inspected->markers) {
+            if (marker.track != rows[row].track || marker.depth != rows[row].depth) continue;
+            double start = rows[row].gpu ? marker.gpuStartMs : marker.cpuStartMs;
+            double end = rows[row].gpu ? marker.gpuEndMs : marker.cpuEndMs;
+            if (start < 0.0 || end < start) continue;
+            
+            float x0 = timelineOrigin.x + labelWidth + float(start / spanMs) * barsWidth;
+            float x1 = std::max(timelineOrigin.x + labelWidth + float(end / spanMs) * barsWidth, x0 + 1.0f);
+            ImVec2 rectMin(x0, y0 + 1.0f), rectMax(x1, y0 + rowHeight - 1.0f);
+            ImU32 hue = static_cast<ImU32>(std::hash<std::string>()(marker.name));
+            ImU32 color = IM_COL32(80 + (hue & 0x7F), 80 + ((hue >> 8) & 0x7F), 80 + ((hue >> 16) & 0x7F), 255);
+            drawList->AddRectFilled(rectMin, rectMax, color);
+            drawList->PushClipRect(rectMin, rectMax, true);
+            drawList->AddText(ImVec2(x0 + 2.0f, y0 + 2.0f), IM_COL32(0, 0, 0, 255), marker.name.c_str());
+            drawList->PopClipRect();
+            
+            if (timelineHovered && mouse.x >= rectMin.x && mouse.x < rectMax.x && mouse.y >= rectMin.y && mouse.y < rectMax.y) {
+                ImGui::SetTooltip("%s\n%s %.3f ms at %.3f ms", marker.name.c_str(), rows[row].gpu ? "GPU" : "CPU", end - start, start);
+            }
+        }
+    }
+    
+    // Per marker: this frame, and the mean and worst of the same name over the history
+    if (ImGui::BeginTable("##markers", 6, ImGuiTableFlags_RowBg | ImGuiTableFlags_Borders | ImGuiTableFlags_ScrollY)) {
+        ImGui::TableSetupColumn("Marker");
+        ImGui::TableSetupColumn("CPU ms");
+        ImGui::TableSetupColumn("GPU ms");
+        ImGui::TableSetupColumn("GPU mean");
+        ImGui::TableSetupColumn("GPU max");
+        ImGui::TableSetupColumn("CPU max");
+        ImGui::TableHeadersRow();
+        for (const auto& marker : inspected->markers) {
+            double gpuSum = 0.0, gpuMax = 0.0, cpuMax = 0.0;
+            int gpuCount = 0;
+            for (const auto& frame : history) {
+                for (const auto& other : frame.markers) {
+                    if (other.name != marker.name || other.track != marker.track) continue;
+                    cpuMax = std::max(cpuMax, other.cpuEndMs - other.cpuStartMs);
+                    if (other.gpuStartMs >= 0.0) {
+                        double ms = other.gpuEndMs - other.gpuStartMs;
+                        gpuSum += ms;
+                        gpuMax = std::max(gpuMax, ms);
+                        gpuCount++;
+                    }
+                }
+            }
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::Text("%*s%s", marker.depth * 2, "", marker.name.c_str());
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", marker.cpuEndMs - marker.cpuStartMs);
+            ImGui::TableNextColumn();
+            if (marker.gpuStartMs >= 0.0) {
+                ImGui::Text("%.3f", marker.gpuEndMs - marker.gpuStartMs);
+            } else {
+                ImGui::TextDisabled("-");
+            }
+            ImGui::TableNextColumn();
+            if (gpuCount > 0) {
+                ImGui::Text("%.3f", gpuSum / gpuCount);
+            } else {
+                ImGui::TextDisabled("-");
+            }
+            ImGui::TableNextColumn();
+            if (gpuCount > 0) {
+                ImGui::Text("%.3f", gpuMax);
+            } else {
+                ImGui::TextDisabled("-");
+            }
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", cpuMax);
+        }
+        ImGui::EndTable();
+    }
+    
+    ImGui::End();
+}
+
+#ifdef SPH_GPU_COUNTERS
+void renderSPHCounters(const WaterSim::SPHCounters& counters) {
+    using WaterSim::SPHCounters;
+    
+    // Failures first: any of these means particles went missing from the neighbor search
+    const ImVec4 alert(1.0f, 0.4f, 0.3f, 1.0f);
+    auto failure = [&](const char* label, uint32_t count) {
+        if (count > 0) {
+            ImGui::TextColored(alert, "%s: %u", label, count);
+        } else {
+            ImGui::Text("%s: 0", label);
+        }
+    };
+    if (counters.gridCounted) {
+        failure("Out of grid", counters.outOfGrid);
+        failure("Dropped sort writes", counters.droppedWrites);
+        char overfull[64];
+        std::snprintf(overfull, sizeof(overfull), "Cells over %u particles", SPHCounters::CELL_LIMIT);
+        failure(overfull, counters.overfullCells);
+        ImGui::Text("Cell occupancy max/mean: %u / %.1f (%u cells)", counters.maxCellOccupancy,
+                    counters.occupiedCells > 0 ? float(counters.cellParticles) / counters.occupiedCells : 0.0f,
+                    counters.occupiedCells);
+    } else {
+        ImGui::TextDisabled("Grid counters need the atomic scatter sort");
+    }
+    
+    float sampled = static_cast<float>(std::max(counters.sampledParticles, 1u));
+    ImGui::Text("Visited max/mean: %u / %.1f, neighbors max/mean: %u / %.1f", counters.maxCandidates,
+                counters.candidateSum / sampled, counters.maxNeighbors, counters.neighborSum / sampled);
+    
+    float candidates[SPHCounters::BINS];
+    float neighbors[SPHCounters::BINS];
+    for (uint32_t i = 0; i < SPHCounters::BINS; i++) {
+        candidates[i] = static_cast<float>(counters.candidateHistogram[i]);
+        neighbors[i] = static_cast<float>(counters.neighborHistogram[i]);
+    }
+    char label[64];
+    std::snprintf(label, sizeof(label), "%u per bar", SPHCounters::BIN_WIDTH);
+    ImGui::PlotHistogram("Visited", candidates, SPHCounters::BINS, 0, label, 0.0f, FLT_MAX, ImVec2(0, 60));
+    ImGui::PlotHistogram("Neighbors", neighbors, SPHCounters::BINS, 0, label, 0.0f, FLT_MAX, ImVec2(0, 60));
+    
+    // Fullest cell over the last frames, against the packed-count limit
+    static float occupancy[120] = {};
+    static int occupancyOffset = 0;
+    occupancy[occupancyOffset] = static_cast<float>(counters.maxCellOccupancy);
+    occupancyOffset = (occupancyOffset + 1) % 120;
+    ImGui::PlotLines("Max cell", occupancy, 120, occupancyOffset, nullptr, 0.0f,
+                     static_cast<float>(SPHCounters::CELL_LIMIT), ImVec2(0, 60));
+}
+#endif
+
 // Create a more detailed environment map for better reflections
 unsigned int loadSkybox(std::vector<std::string> faces) {
     unsigned int textureID;
@@ -1954,185 +4901,229 @@ unsigned int createDummyTexture() {
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    enableAnisotropicFiltering();
+    enableAnisotropicFiltering(textureID);
     
     return textureID;
 }
 
-// Replace the createCausticTexture function with this improved version
-unsigned int createCausticTexture(int size) {
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_2D, textureID);
+// Caustic pattern as RGBA8 pixels; the noise layers fill in parallel on the job pool
+// Water volume box, static: water.vs (WATER_VOLUME) lifts the top vertices, at y = 0,
+// to the water height and the surface displacement, so the top face is a grid and the
+// walls are split along their top edge to follow the waves
+void buildWaterVolume(std::vector<float>& waterVolumeVertices, std::vector<unsigned int>& waterVolumeIndices) {
+    const int WATER_VOLUME_SEGMENTS = 64;
+    float waterHalfWidth = 5.0f - 0.05f; // Slightly smaller than container
+    float waterDepth = 5.0f - 0.05f; // Slightly smaller than container
+    auto addVolumeVertex = [&](float u, float v, float y) {
+        // Position, normal (up, as the surface), texture coordinates
+        float vertex[8] = { -waterHalfWidth + 2.0f * waterHalfWidth * u, y, -waterDepth + 2.0f * waterDepth * v,
+                            0.0f, 1.0f, 0.0f, u, v };
+        waterVolumeVertices.insert(waterVolumeVertices.end(), vertex, vertex + 8);
+    };
+    
+    // Top grid, row-major from (-x, -z)
+    const int topRow = WATER_VOLUME_SEGMENTS + 1;
+    for (int j = 0; j <= WATER_VOLUME_SEGMENTS; j++) {
+        for (int i = 0; i <= WATER_VOLUME_SEGMENTS; i++) {
+            addVolumeVertex(float(i) / WATER_VOLUME_SEGMENTS, float(j) / WATER_VOLUME_SEGMENTS, 0.0f);
+        }
+    }
+    for (int j = 0; j < WATER_VOLUME_SEGMENTS; j++) {
+        for (int i = 0; i < WATER_VOLUME_SEGMENTS; i++) {
+            unsigned int c00 = j * topRow + i;
+            unsigned int c10 = c00 + 1;
+            unsigned int c01 = c00 + topRow;
+            unsigned int c11 = c01 + 1;
+            waterVolumeIndices.insert(waterVolumeIndices.end(), { c00, c10, c11, c00, c11, c01 });
+        }
+    }
+    
+    // Walls: the top grid's edge, walked back (-z), right, front, left, over floor vertices
+    std::vector<unsigned int> topEdge;
+    for (int i = 0; i < WATER_VOLUME_SEGMENTS; i++) topEdge.push_back(i);
+    for (int j = 0; j < WATER_VOLUME_SEGMENTS; j++) topEdge.push_back(j * topRow + WATER_VOLUME_SEGMENTS);
+    for (int i = WATER_VOLUME_SEGMENTS; i > 0; i--) topEdge.push_back(WATER_VOLUME_SEGMENTS * topRow + i);
+    for (int j = WATER_VOLUME_SEGMENTS; j > 0; j--) topEdge.push_back(j * topRow);
+    unsigned int floorFirst = static_cast<unsigned int>(waterVolumeVertices.size() / 8);
+    for (unsigned int top : topEdge) {
+        const float* topVertex = &waterVolumeVertices[top * 8];
+        addVolumeVertex(topVertex[6], topVertex[7], FLOOR_LEVEL);
+    }
+    unsigned int edgeCount = static_cast<unsigned int>(topEdge.size());
+    for (unsigned int k = 0; k < edgeCount; k++) {
+        unsigned int next = (k + 1) % edgeCount;
+        waterVolumeIndices.insert(waterVolumeIndices.end(), { floorFirst + k, floorFirst + next, topEdge[next],
+                                                             floorFirst + k, topEdge[next], topEdge[k] });
+    }
     
+    // Floor from the wall corners
+    unsigned int floorCorners[4];
+    for (int c = 0; c < 4; c++) floorCorners[c] = floorFirst + c * WATER_VOLUME_SEGMENTS;
+    waterVolumeIndices.insert(waterVolumeIndices.end(), { floorCorners[0], floorCorners[1], floorCorners[2],
+                                                         floorCorners[0], floorCorners[2], floorCorners[3] });
+}
+
+std::vector<unsigned char> generateCausticPixels(int size) {
     // Create a high-contrast caustic texture with strong light patterns
     std::vector<unsigned char> data(size * size * 4);
     
-    // Use better randomization for the noise functions
-    std::mt19937 rng(42); // Fixed seed for reproducibility
-    std::uniform_real_distribution<float> dist(0.0f, 1.0f);
-    
     // Generate multiple layers of noise to create a more natural caustic
     std::vector<std::vector<float>> noise1(size, std::vector<float>(size, 0.0f));
     std::vector<std::vector<float>> noise2(size, std::vector<float>(size, 0.0f));
     std::vector<std::vector<float>> noise3(size, std::vector<float>(size, 0.0f));
     
+    // The layers are independent, and the combine pass continues after the last of them
+    WaterSim::JobSystem& jobs = WaterSim::JobSystem::instance();
+    WaterSim::JobSystem::TaskGroup layers;
+    
     // First layer - large scale features
-    for (int y = 0; y < size; y++) {
-        for (int x = 0; x < size; x++) {
-            float nx = (float)x / size * 4.0f;
-            float ny = (float)y / size * 4.0f;
-            
-            float val = 0.5f + 0.5f * sin(nx * 3.14159f) * sin(ny * 3.14159f);
-            noise1[y][x] = val;
-        }
-    }
+    layers.run([&]() {
+        jobs.parallelFor(0, size, 0, [&](int first, int last) {
+            for (int y = first; y < last; y++) {
+                for (int x = 0; x < size; x++) {
+                    float nx = (float)x / size * 4.0f;
+                    float ny = (float)y / size * 4.0f;
+                    
+                    float val = 0.5f + 0.5f * sin(nx * 3.14159f) * sin(ny * 3.14159f);
+                    noise1[y][x] = val;
+                }
+            }
+        });
+    });
     
     // Second layer - medium scale features
-    for (int y = 0; y < size; y++) {
-        for (int x = 0; x < size; x++) {
-            float nx = (float)x / size * 8.0f;
-            float ny = (float)y / size * 8.0f;
-            
-            float val = 0.5f + 0.5f * sin(nx * 3.14159f + 0.5f) * sin(ny * 3.14159f + 1.5f);
-            noise2[y][x] = val;
-        }
-    }
+    layers.run([&]() {
+        jobs.parallelFor(0, size, 0, [&](int first, int last) {
+            for (int y = first; y < last; y++) {
+                for (int x = 0; x < size; x++) {
+                    float nx = (float)x / size * 8.0f;
+                    float ny = (float)y / size * 8.0f;
+                    
+                    float val = 0.5f + 0.5f * sin(nx * 3.14159f + 0.5f) * sin(ny * 3.14159f + 1.5f);
+                    noise2[y][x] = val;
+                }
+            }
+        });
+    });
     
     // Third layer - small scale features
-    for (int y = 0; y < size; y++) {
-        for (int x = 0; x < size; x++) {
-            float nx = (float)x / size * 16.0f;
-            float ny = (float)y / size * 16.0f;
-            
-            float val = 0.5f + 0.5f * sin(nx * 3.14159f + 1.0f) * sin(ny * 3.14159f + 2.0f);
-            noise3[y][x] = val;
-        }
-    }
+    layers.run([&]() {
+        jobs.parallelFor(0, size, 0, [&](int first, int last) {
+            for (int y = first; y < last; y++) {
+                for (int x = 0; x < size; x++) {
+                    float nx = (float)x / size * 16.0f;
+                    float ny = (float)y / size * 16.0f;
+                    
+                    float val = 0.5f + 0.5f * sin(nx * 3.14159f + 1.0f) * sin(ny * 3.14159f + 2.0f);
+                    noise3[y][x] = val;
+                }
+            }
+        });
+    });
     
     // Combine the noise layers and apply contrast enhancement
-    for (int y = 0; y < size; y++) {
-        for (int x = 0; x < size; x++) {
-            // Combine noise layers with weights
-            float combinedNoise = noise1[y][x] * 0.5f + noise2[y][x] * 0.3f + noise3[y][x] * 0.2f;
-            
-            // Apply distortion to create more realistic caustic patterns
-            float distX = 0.05f * sin(noise2[y][x] * 10.0f);
-            float distY = 0.05f * sin(noise1[y][x] * 10.0f);
-            
-            int sampleX = std::min(size - 1, std::max(0, x + (int)(distX * size)));
-            int sampleY = std::min(size - 1, std::max(0, y + (int)(distY * size)));
-            
-            float distortedNoise = noise1[sampleY][sampleX] * 0.6f + noise3[sampleY][sampleX] * 0.4f;
-            
-            // Create sharpened caustic-like effect
-            float caustic = std::pow(distortedNoise, 4.0f); // Sharpen the effect
-            
-            // Add random sharp caustic edges
-            float sharpEdge = 0.0f;
-            if (caustic > 0.5f && caustic < 0.55f)
-                sharpEdge = 0.5f;
-            
-            caustic = std::min(1.0f, caustic + sharpEdge);
-            
-            // Store in texture with bluish tint for underwater effect
-            int idx = (y * size + x) * 4;
-            data[idx] = (unsigned char)(std::min(caustic * 180.0f, 255.0f)); // R - less red
-            data[idx + 1] = (unsigned char)(std::min(caustic * 230.0f, 255.0f)); // G - more green
-            data[idx + 2] = (unsigned char)(std::min(caustic * 255.0f, 255.0f)); // B - most blue
-            data[idx + 3] = 255; // Alpha
-        }
-    }
-    
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, data.data());
-    glGenerateMipmap(GL_TEXTURE_2D);
-    
-    // Set texture parameters
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    enableAnisotropicFiltering();
+    layers.then([&]() {
+        jobs.parallelFor(0, size, 0, [&](int first, int last) {
+            for (int y = first; y < last; y++) {
+                for (int x = 0; x < size; x++) {
+                    // Combine noise layers with weights
+                    float combinedNoise = noise1[y][x] * 0.5f + noise2[y][x] * 0.3f + noise3[y][x] * 0.2f;
+                    
+                    // Apply distortion to create more realistic caustic patterns
+                    float distX = 0.05f * sin(noise2[y][x] * 10.0f);
+                    float distY = 0.05f * sin(noise1[y][x] * 10.0f);
+                    
+                    int sampleX = std::min(size - 1, std::max(0, x + (int)(distX * size)));
+                    int sampleY = std::min(size - 1, std::max(0, y + (int)(distY * size)));
+                    
+                    float distortedNoise = noise1[sampleY][sampleX] * 0.6f + noise3[sampleY][sampleX] * 0.4f;
+                    
+                    // Create sharpened caustic-like effect
+                    float caustic = std::pow(distortedNoise, 4.0f); // Sharpen the effect
+                    
+                    // Add random sharp caustic edges
+                    float sharpEdge = 0.0f;
+                    if (caustic > 0.5f && caustic < 0.55f)
+                        sharpEdge = 0.5f;
+                    
+                    caustic = std::min(1.0f, caustic + sharpEdge);
+                    
+                    // Store in texture with bluish tint for underwater effect
+                    int idx = (y * size + x) * 4;
+                    data[idx] = (unsigned char)(std::min(caustic * 180.0f, 255.0f)); // R - less red
+                    data[idx + 1] = (unsigned char)(std::min(caustic * 230.0f, 255.0f)); // G - more green
+                    data[idx + 2] = (unsigned char)(std::min(caustic * 255.0f, 255.0f)); // B - most blue
+                    data[idx + 3] = 255; // Alpha
+                }
+            }
+        });
+    });
+    layers.wait();
     
-    return textureID;
+    return data;
 }
 
-// TODO: Add this function after the createCausticTexture function
-unsigned int createTileTexture(int size) {
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_2D, textureID);
-    
+// Pool tiles as RGBA8 pixels (white tiles with dark grout), rows in parallel
+std::vector<unsigned char> generateTilePixels(int size) {
     // Create procedural tile texture (white tiles with dark grout)
     std::vector<unsigned char> data(size * size * 4);
     
     int tileSize = size / 16;
     int groutWidth = tileSize / 8;
     
-    for (int y = 0; y < size; y++) {
-        for (int x = 0; x < size; x++) {
-            int idx = (y * size + x) * 4;
-            
-            // Calculate tile grid position
-            int gridX = x % tileSize;
-            int gridY = y % tileSize;
-            
-            // Determine if we're in a grout line
-            bool inGrout = (gridX < groutWidth || gridX >= tileSize - groutWidth || 
-                            gridY < groutWidth || gridY >= tileSize - groutWidth);
-            
-            // Slightly vary the tile color and grout color
-            float noise = (float)((x * 17 + y * 29) % 10) / 100.0f;
-            
-            if (inGrout) {
-                // Dark grout color
-                data[idx] = 80 + (int)(noise * 20);
-                data[idx + 1] = 80 + (int)(noise * 20);
-                data[idx + 2] = 80 + (int)(noise * 20);
-            } else {
-                // White tile with slight variation
-                data[idx] = 240 + (int)(noise * 15);
-                data[idx + 1] = 240 + (int)(noise * 15);
-                data[idx + 2] = 240 + (int)(noise * 15);
-            }
-            
-            // Add a subtle highlight to the tiles
-            if (!inGrout) {
-                // Calculate distance from tile center
-                float tileU = (float)(gridX - tileSize/2) / (tileSize/2);
-                float tileV = (float)(gridY - tileSize/2) / (tileSize/2);
-                float dist = sqrt(tileU*tileU + tileV*tileV);
+    WaterSim::JobSystem::instance().parallelFor(0, size, 0, [&](int first, int last) {
+        for (int y = first; y < last; y++) {
+            for (int x = 0; x < size; x++) {
+                int idx = (y * size + x) * 4;
+                
+                // Calculate tile grid position
+                int gridX = x % tileSize;
+                int gridY = y % tileSize;
+                
+                // Determine if we're in a grout line
+                bool inGrout = (gridX < groutWidth || gridX >= tileSize - groutWidth || 
+                                gridY < groutWidth || gridY >= tileSize - groutWidth);
                 
-                // Add highlight based on distance from center
-                float highlight = std::max(0.0f, 1.0f - dist*1.2f);
-                data[idx] = std::min(255, data[idx] + (int)(highlight * 15));
-                data[idx + 1] = std::min(255, data[idx + 1] + (int)(highlight * 15));
-                data[idx + 2] = std::min(255, data[idx + 2] + (int)(highlight * 15));
+                // Slightly vary the tile color and grout color
+                float noise = (float)((x * 17 + y * 29) % 10) / 100.0f;
+                
+                if (inGrout) {
+                    // Dark grout color
+                    data[idx] = 80 + (int)(noise * 20);
+                    data[idx + 1] = 80 + (int)(noise * 20);
+                    data[idx + 2] = 80 + (int)(noise * 20);
+                } else {
+                    // White tile with slight variation
+                    data[idx] = 240 + (int)(noise * 15);
+                    data[idx + 1] = 240 + (int)(noise * 15);
+                    data[idx + 2] = 240 + (int)(noise * 15);
+                }
+                
+                // Add a subtle highlight to the tiles
+                if (!inGrout) {
+                    // Calculate distance from tile center
+                    float tileU = (float)(gridX - tileSize/2) / (tileSize/2);
+                    float tileV = (float)(gridY - tileSize/2) / (tileSize/2);
+                    float dist = sqrt(tileU*tileU + tileV*tileV);
+                    
+                    // Add highlight based on distance from center
+                    float highlight = std::max(0.0f, 1.0f - dist*1.2f);
+                    data[idx] = std::min(255, data[idx] + (int)(highlight * 15));
+                    data[idx + 1] = std::min(255, data[idx + 1] + (int)(highlight * 15));
+                    data[idx + 2] = std::min(255, data[idx + 2] + (int)(highlight * 15));
+                }
+                
+                data[idx + 3] = 255; // Alpha
             }
-            
-            data[idx + 3] = 255; // Alpha
         }
-    }
+    });
     
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, data.data());
-    glGenerateMipmap(GL_TEXTURE_2D);
-    
-    // Set texture parameters
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    enableAnisotropicFiltering();
-    
-    return textureID;
+    return data;
 }
 
-// Create a realistic steel/metal texture with reflective properties
-unsigned int createSteelTexture(int size) {
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_2D, textureID);
-    
+// Brushed steel as RGBA8 pixels. The scratches draw from the same sequence as the base
+// noise, so this one stays serial and overlaps the other textures as a task instead
+std::vector<unsigned char> generateSteelPixels(int size) {
     // Create a procedural steel texture with brushed metal appearance
     std::vector<unsigned char> data(size * size * 4);
     
@@ -2196,21 +5187,183 @@ unsigned int createSteelTexture(int size) {
         }
     }
     
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, data.data());
-    glGenerateMipmap(GL_TEXTURE_2D);
+    return data;
+}
+
+// Uploads generated RGBA8 pixels as a repeating, mipmapped texture
+// The texels and mip chain go up through the UploadQueue: data must outlive the upload, which
+// is waited on before the texture is first read
+unsigned int createTextureFromPixels(const std::vector<unsigned char>& data, int size, WaterSim::UploadQueue::Ticket& upload) {
+    unsigned int textureID = createProceduralTextureStorage(size);
+    upload = WaterSim::UploadQueue::instance().uploadTexture(textureID, 0, size, size, GL_RGBA, GL_UNSIGNED_BYTE,
+                                                             data.data(), data.size(), true);
+    return textureID;
+}
+
+// Immutable RGBA8 storage with a full mip chain and the procedural textures' sampling; nothing
+// is bound, so callers fill it by name
+unsigned int createProceduralTextureStorage(int size) {
+    int levels = 1;
+    while ((size >> levels) > 0) {
+        levels++;
+    }
     
-    // Set texture parameters for metallic appearance
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    enableAnisotropicFiltering();
+    unsigned int textureID;
+    glCreateTextures(GL_TEXTURE_2D, 1, &textureID);
+    glTextureStorage2D(textureID, levels, GL_RGBA8, size, size);
+    
+    // Set texture parameters
+    glTextureParameteri(textureID, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTextureParameteri(textureID, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTextureParameteri(textureID, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTextureParameteri(textureID, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    enableAnisotropicFiltering(textureID);
+    
+    return textureID;
+}
+
+// Caustic or tile pattern from shaders/procedural_texture.cs; 0 if the shader is unavailable.
+// The dispatch is queued and returns at once, so the GPU fills it while startup continues
+unsigned int generateProceduralTextureGPU(const char* defines, int size) {
+    GLuint program = InitComputeShader("shaders/procedural_texture.cs", defines);
+    if (!program) {
+        std::cerr << "WARNING: Procedural texture shader unavailable, generating on the CPU" << std::endl;
+        return 0;
+    }
+    
+    unsigned int textureID = createProceduralTextureStorage(size);
+    glUseProgram(program);
+    glUniform1i(glGetUniformLocation(program, "uSize"), size);
+    glBindImageTexture(0, textureID, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+    glDispatchCompute((size + 7) / 8, (size + 7) / 8, 1);
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+    glGenerateTextureMipmap(textureID);
+    glUseProgram(0);
+    
+    // Deleting after the dispatch is safe, the driver keeps the program until it finishes
+    glDeleteProgram(program);
+    return textureID;
+}
+
+// Cache of a procedural texture: header, then every mip level as tightly packed RGBA8
+struct ProceduralTextureCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t size;
+    uint32_t levels;
+    uint32_t reserved;
+    uint64_t sourceKey;
+};
+
+// Bump when a CPU generator changes; edits to the compute shader change the key by themselves
+constexpr uint32_t PROCEDURAL_TEXTURE_CACHE_VERSION = 1;
+
+static std::string proceduralTextureCachePath(const char* name) {
+    return std::string("textures/") + name + "_procedural.cache";
+}
+
+static uint64_t proceduralTextureKey(const char* name) {
+    // FNV-1a over the texture's name and the generator shader's source
+    uint64_t key = 14695981039346656037ull;
+    auto hashBytes = [&key](const void* bytes, size_t size) {
+        for (size_t i = 0; i < size; i++) {
+            key = (key ^ static_cast<const unsigned char*>(bytes)[i]) * 1099511628211ull;
+        }
+    };
+    std::string source = ReadShaderSource("shaders/procedural_texture.cs");
+    hashBytes(name, strlen(name));
+    hashBytes(source.data(), source.size());
+    return key;
+}
+
+static size_t proceduralTextureLevelBytes(int size, int level) {
+    size_t levelSize = std::max(size >> level, 1);
+    return levelSize * levelSize * 4;
+}
+
+unsigned int readProceduralTextureCache(const char* name, int size) {
+    std::string cachePath = proceduralTextureCachePath(name);
+    WaterSim::MappedFile file;
+    if (!file.openRead(cachePath)) {
+        return 0; // No cache yet
+    }
+    
+    ProceduralTextureCacheHeader header;
+    if (file.size() < sizeof(header)) {
+        return 0;
+    }
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (std::memcmp(header.magic, "WPROCTEX", sizeof(header.magic)) != 0 ||
+        header.version != PROCEDURAL_TEXTURE_CACHE_VERSION || header.size != uint32_t(size) ||
+        header.sourceKey != proceduralTextureKey(name)) {
+        return 0; // Stale; regenerated and overwritten
+    }
+    
+    size_t dataBytes = 0;
+    for (uint32_t level = 0; level < header.levels; level++) {
+        dataBytes += proceduralTextureLevelBytes(size, level);
+    }
+    if (sizeof(header) + dataBytes > file.size()) {
+        std::cerr << "WARNING: Procedural texture cache " << cachePath << " is truncated" << std::endl;
+        return 0;
+    }
     
+    unsigned int textureID = createProceduralTextureStorage(size);
+    GLint levels = 0;
+    glGetTextureParameteriv(textureID, GL_TEXTURE_IMMUTABLE_LEVELS, &levels);
+    if (header.levels != uint32_t(levels)) {
+        glDeleteTextures(1, &textureID);
+        return 0;
+    }
+    
+    // Every level is stored, so nothing is filtered down at load
+    const char* texels = static_cast<const char*>(file.data()) + sizeof(header);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    for (int level = 0; level < levels; level++) {
+        int levelSize = std::max(size >> level, 1);
+        glTextureSubImage2D(textureID, level, 0, 0, levelSize, levelSize, GL_RGBA, GL_UNSIGNED_BYTE, texels);
+        texels += proceduralTextureLevelBytes(size, level);
+    }
+    std::cout << "Loaded procedural texture from cache: " << cachePath << std::endl;
     return textureID;
 }
 
+void writeProceduralTextureCache(const char* name, int size, GLuint texture) {
+    std::string cachePath = proceduralTextureCachePath(name);
+    GLint levels = 0;
+    glGetTextureParameteriv(texture, GL_TEXTURE_IMMUTABLE_LEVELS, &levels);
+    
+    size_t dataBytes = 0;
+    for (int level = 0; level < levels; level++) {
+        dataBytes += proceduralTextureLevelBytes(size, level);
+    }
+    
+    WaterSim::MappedFile file;
+    if (!file.create(cachePath, sizeof(ProceduralTextureCacheHeader) + dataBytes)) {
+        std::cerr << "WARNING: Failed to write procedural texture cache " << cachePath << std::endl;
+        return;
+    }
+    
+    ProceduralTextureCacheHeader header = {};
+    std::memcpy(header.magic, "WPROCTEX", sizeof(header.magic));
+    header.version = PROCEDURAL_TEXTURE_CACHE_VERSION;
+    header.size = uint32_t(size);
+    header.levels = uint32_t(levels);
+    header.sourceKey = proceduralTextureKey(name);
+    std::memcpy(file.data(), &header, sizeof(header));
+    
+    // The mips are read back straight into the mapped pages
+    char* texels = static_cast<char*>(file.data()) + sizeof(header);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    for (int level = 0; level < levels; level++) {
+        glGetTextureImage(texture, level, GL_RGBA, GL_UNSIGNED_BYTE,
+                          static_cast<GLsizei>(proceduralTextureLevelBytes(size, level)), texels);
+        texels += proceduralTextureLevelBytes(size, level);
+    }
+}
+
 // Helper function to enable anisotropic filtering
-void enableAnisotropicFiltering() {
+void enableAnisotropicFiltering(GLuint texture) {
     static bool checkedSupport = false;
     static bool hasAnisotropic = false;
     
@@ -2229,7 +5382,7 @@ void enableAnisotropicFiltering() {
     if (hasAnisotropic) {
         float maxAnisotropy;
         glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &maxAnisotropy);
-        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, maxAnisotropy);
+        glTextureParameterf(texture, GL_TEXTURE_MAX_ANISOTROPY_EXT, maxAnisotropy);
     }
 }
 
@@ -2239,6 +5392,11 @@ void APIENTRY debugCallback(GLenum source, GLenum type, GLuint id, GLenum severi
     // Ignore non-significant error/warning codes but log performance issues
     if (id == 131169 || id == 131185 || id == 131218 || id == 131204) return;
     
+    // Into the trace as well, so a saved spike shows what the driver said around it
+    if (type != GL_DEBUG_TYPE_PUSH_GROUP && type != GL_DEBUG_TYPE_POP_GROUP) {
+        WaterSim::TraceRecorder::instance().message("GL debug", message);
+    }
+    
     // Always log shader compilation/linking errors
     if (source == GL_DEBUG_SOURCE_SHADER_COMPILER || 
         std::string(message).find("shader") != std::string::npos ||
@@ -2292,56 +5450,77 @@ void APIENTRY debugCallback(GLenum source, GLenum type, GLuint id, GLenum severi
 }
 
 // Render scene function for reflection/refraction passes and main rendering
+void validateMainShaders() {
+    GLint validateStatus;
+    GLchar infoLog[512];
+    
+    // Validate water shader
+    glValidateProgram(waterShader);
+    glGetProgramiv(waterShader, GL_VALIDATE_STATUS, &validateStatus);
+    if (validateStatus != GL_TRUE) {
+        glGetProgramInfoLog(waterShader, 512, NULL, infoLog);
+        std::cerr << "Water shader validation failed: " << infoLog << std::endl;
+    }
+    
+    // Validate glass shader
+    glValidateProgram(glassShader);
+    glGetProgramiv(glassShader, GL_VALIDATE_STATUS, &validateStatus);
+    if (validateStatus != GL_TRUE) {
+        glGetProgramInfoLog(glassShader, 512, NULL, infoLog);
+        std::cerr << "Glass shader validation failed: " << infoLog << std::endl;
+    }
+    
+    // Validate sphere shader
+    glValidateProgram(sphereShader);
+    glGetProgramiv(sphereShader, GL_VALIDATE_STATUS, &validateStatus);
+    if (validateStatus != GL_TRUE) {
+        glGetProgramInfoLog(sphereShader, 512, NULL, infoLog);
+        std::cerr << "Sphere shader validation failed: " << infoLog << std::endl;
+    }
+}
+
+// Shown by the main loop while the required programs are still building
+void renderShaderLoadingScreen() {
+    // Its own ImGui frame replaces the cached draw data
+    uiCache.invalidate();
+    const WaterSim::ShaderCompiler::Stats& stats = WaterSim::ShaderCompiler::instance().getStats();
+    int done = stats.completed + stats.failed;
+    
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
+    glClearColor(0.1f, 0.1f, 0.2f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    
+    ImGui_ImplOpenGL3_NewFrame();
+    ImGui_ImplGlfw_NewFrame();
+    ImGui::NewFrame();
+    
+    ImGui::SetNextWindowPos(ImVec2(SCR_WIDTH * 0.5f, SCR_HEIGHT * 0.5f), ImGuiCond_Always, ImVec2(0.5f, 0.5f));
+    ImGui::Begin("Loading", nullptr, ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_AlwaysAutoResize);
+    ImGui::Text("Compiling shaders...");
+    ImGui::ProgressBar(stats.submitted > 0 ? float(done) / float(stats.submitted) : 0.0f, ImVec2(240.0f, 0.0f));
+    ImGui::Text("%d of %d programs", done, stats.submitted);
+    ImGui::End();
+    
+    ImGui::Render();
+    ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+}
+
 void renderScene(const Camera& camera, float waterLevel, bool isReflection, bool isRefraction) {
-    // Create transformation matrices
-    glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-    glm::mat4 view = camera.GetViewMatrix();
+    // The target's camera, mirrored across the water plane for the reflection
+    glm::mat4 projection = reflectionRenderer->getProjection(camera);
+    glm::mat4 view = reflectionRenderer->getTargetView(isReflection ? PLANAR_REFLECTION : PLANAR_REFRACTION, camera, waterLevel);
     
-    // Apply reflection transformation if needed
+    // Reverse winding order for reflection
     if (isReflection) {
-        // Reflect camera position and view direction across water plane
-        glm::mat4 reflectionMatrix = glm::scale(glm::mat4(1.0f), glm::vec3(1.0f, -1.0f, 1.0f));
-        reflectionMatrix = glm::translate(reflectionMatrix, glm::vec3(0.0f, 2.0f * waterLevel, 0.0f));
-        view = view * reflectionMatrix;
-        
-        // Reverse winding order for reflection
         glFrontFace(GL_CW);
     }
+    updateFrameUniforms(view, projection, camera.Position, static_cast<float>(glfwGetTime()));
     
     // Render sphere
     if (isShaderProgramValid(sphereShader)) {
         glUseProgram(sphereShader);
-        
-        // Set sphere shader uniforms
-        glUniformMatrix4fv(glGetUniformLocation(sphereShader, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
-        glUniformMatrix4fv(glGetUniformLocation(sphereShader, "view"), 1, GL_FALSE, glm::value_ptr(view));
-    
-        glm::mat4 model = glm::mat4(1.0f);
-        model = glm::translate(model, sphere->getPosition());
-        glUniformMatrix4fv(glGetUniformLocation(sphereShader, "model"), 1, GL_FALSE, glm::value_ptr(model));
-        
-        // Set lighting uniforms
-        glUniform3f(glGetUniformLocation(sphereShader, "viewPos"), camera.Position.x, camera.Position.y, camera.Position.z);
-        glUniform3f(glGetUniformLocation(sphereShader, "lightPos"), 5.0f, 10.0f, 5.0f);
-        glUniform3f(glGetUniformLocation(sphereShader, "lightColor"), 1.0f, 1.0f, 1.0f);
-        glUniform1f(glGetUniformLocation(sphereShader, "ambientStrength"), 0.1f);
-        glUniform1f(glGetUniformLocation(sphereShader, "specularStrength"), 0.8f); // Moderate for realistic metal
-        glUniform1f(glGetUniformLocation(sphereShader, "shininess"), 128.0f); // High but not excessive for metal
-        
-        // Enable texture for steel appearance
-        glUniform1i(glGetUniformLocation(sphereShader, "useTexture"), 1);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, steelTexture);
-        glUniform1i(glGetUniformLocation(sphereShader, "sphereTexture"), 0);
-        
-        // Enable reflections for mirror-like appearance
-        glUniform1i(glGetUniformLocation(sphereShader, "enableReflections"), enableSphereReflections ? 1 : 0);
-        glUniform1f(glGetUniformLocation(sphereShader, "reflectivity"), sphereReflectivity);
-        
-        // Bind skybox for environment reflections
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, skyboxTexture);
-        glUniform1i(glGetUniformLocation(sphereShader, "skybox"), 1);
+        setPlanarSphereUniforms(sphereShader);
         
         // Only render sphere if not doing water passes or if sphere is above/below water appropriately
         bool shouldRenderSphere = true;
@@ -2354,7 +5533,9 @@ void renderScene(const Camera& camera, float waterLevel, bool isReflection, bool
         }
         
         if (shouldRenderSphere) {
-            sphere->render(sphereShader);
+            PlanarTarget target = isReflection ? PLANAR_REFLECTION : PLANAR_REFRACTION;
+            float focal = Sphere::focalLength(reflectionRenderer->getTargetHeight(target), camera.Zoom);
+            sphere->render(sphereShader, sphere->lodFor(camera.Position, focal));
         }
     }
     
@@ -2366,76 +5547,229 @@ void renderScene(const Camera& camera, float waterLevel, bool isReflection, bool
     }
 }
 
-// Update wave simulation using GPU compute shaders
-void updateWaveSimulation(float deltaTime, float time) {
-    #ifdef GL_COMPUTE_SHADER
-    // This will be enabled when GLAD is updated with compute shader support
-    
-    // Get wave parameters from water surface (if regular water is active)
-    if (!simulationManager->isRegularWaterActive()) return;
-    
-    WaterSurface* waterSurface = simulationManager->getWaterSurface();
-    if (!waterSurface) return;
-    
-    auto& waves = waterSurface->getWaves();
-    if (waves.empty()) return;
-    
-    // TODO: Load compute shader if not already loaded
-    static GLuint waveComputeShader = 0;
-    if (waveComputeShader == 0) {
-        // Load compute shader when available
-        // waveComputeShader = InitShader("shaders/wave_compute.cs", GL_COMPUTE_SHADER);
-        return;
+// One face of the reflection probe from its centre: the sky, and the sphere while it is above
+// the water (the probe only sees the water's upper side)
+void renderProbeFace(float waterLevel) {
+    glm::mat4 view = reflectionProbe->getFaceView();
+    glm::mat4 projection = reflectionProbe->getFaceProjection();
+    updateFrameUniforms(view, projection, glm::vec3(glm::inverse(view)[3]), static_cast<float>(glfwGetTime()));
+    
+    if (skybox) {
+        skybox->render(view, projection);
     }
     
-    // Dispatch compute shader
-    glUseProgram(waveComputeShader);
+    if (isShaderProgramValid(sphereShader) && sphere->getPosition().y > waterLevel) {
+        glUseProgram(sphereShader);
+        setPlanarSphereUniforms(sphereShader);
+        float focal = Sphere::focalLength(reflectionProbe->getResolution(), 90.0f);
+        sphere->render(sphereShader, sphere->lodFor(glm::vec3(glm::inverse(view)[3]), focal));
+    }
+}
+
+// Both planar targets in one draw: planar_layered.gs sends each triangle to the layer of
+// each target, through that target's camera and clip plane
+void renderSceneLayered(const Camera& camera, float waterLevel) {
+    // sphere.fs only reads the camera position and light of the frame block
+    updateFrameUniforms(camera.GetViewMatrix(), reflectionRenderer->getProjection(camera), camera.Position, static_cast<float>(glfwGetTime()));
+    
+    glUseProgram(spherePlanarShader);
+    setPlanarSphereUniforms(spherePlanarShader);
+    
+    // The sphere appears in the reflection above the water, in the refraction below
+    glm::mat4 projection = reflectionRenderer->getProjection(camera);
+    glm::mat4 viewProjections[PLANAR_TARGET_COUNT];
+    glm::vec4 clipPlanes[PLANAR_TARGET_COUNT];
+    GLint enabled[PLANAR_TARGET_COUNT];
+    for (int layer = 0; layer < PLANAR_TARGET_COUNT; layer++) {
+        PlanarTarget target = static_cast<PlanarTarget>(layer);
+        viewProjections[layer] = projection * reflectionRenderer->getTargetView(target, camera, waterLevel);
+        clipPlanes[layer] = reflectionRenderer->getClipPlane(target, waterLevel);
+        enabled[layer] = target == PLANAR_REFLECTION ? sphere->getPosition().y > waterLevel
+                                                     : sphere->getPosition().y < waterLevel;
+    }
+    glUniformMatrix4fv(spherePlanarShader.uniformLocation("layerViewProjection"), PLANAR_TARGET_COUNT, GL_FALSE, glm::value_ptr(viewProjections[0]));
+    glUniform4fv(spherePlanarShader.uniformLocation("layerClipPlane"), PLANAR_TARGET_COUNT, glm::value_ptr(clipPlanes[0]));
+    glUniform1iv(spherePlanarShader.uniformLocation("layerEnabled"), PLANAR_TARGET_COUNT, enabled);
     
-    // Set uniforms
-    glUniform1f(glGetUniformLocation(waveComputeShader, "time"), time);
-    glUniform1i(glGetUniformLocation(waveComputeShader, "waveCount"), static_cast<int>(std::min(waves.size(), static_cast<size_t>(16))));
-    glUniform2f(glGetUniformLocation(waveComputeShader, "textureSize"), 256.0f, 256.0f);
-    glUniform1f(glGetUniformLocation(waveComputeShader, "worldSize"), 10.0f);
+    // Both targets share a resolution
+    float focal = Sphere::focalLength(reflectionRenderer->getTargetHeight(PLANAR_REFLECTION), camera.Zoom);
+    sphere->render(spherePlanarShader, sphere->lodFor(camera.Position, focal));
+}
+
+// Depth of the opaque surfaces of the scene pass, the sphere and the rigid bodies. The
+// water surface blends over the sky and what lies below it, and the glass container is
+// drawn in the transparent pass, so neither belongs here
+void renderDepthPrepass() {
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glState.setEnabled(GL_DEPTH_TEST, true);
+    glState.depthFunc(GL_LESS);
+    glState.depthMask(true);
+    
+    glState.useProgram(sphereDepthShader);
+    sphereDepthShader.setMat4("model", glm::translate(glm::mat4(1.0f), sphere->getPosition()));
+    sphere->render(sphereDepthShader);
+    
+    if (rigidBodies->getBodyCount() > 0) {
+        rigidBodies->render(rigidBodyDepthShader);
+    }
     
-    // Set wave parameters
-    for (int i = 0; i < static_cast<int>(std::min(waves.size(), static_cast<size_t>(16))); i++) {
-        // Set wave parameters as uniform arrays
-        // This would be implemented when compute shaders are available
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    glState.invalidate();
+}
+
+// Casters of the shadow maps: the container is static and cached, the sphere and SPH
+// particles dynamic. Then the shadow uniforms of every program linking caustic_shadow.fs
+void renderShadows(WaterSim::SPHComputeSystem* sphSystem) {
+    std::vector<WaterSim::ShadowMapper::Caster> staticCasters(1);
+    glm::vec3 containerHalfSize(container->getWidth() * 0.5f, container->getHeight() * 0.5f, container->getDepth() * 0.5f);
+    staticCasters[0].center = container->getPosition();
+    staticCasters[0].radius = glm::length(containerHalfSize);
+    staticCasters[0].draw = [](const WaterSim::GLShaderProgram& program) { container->render(program); };
+    staticCasters[0].batchMesh = containerBatchMesh;
+    
+    std::vector<WaterSim::ShadowMapper::Caster> dynamicCasters(1);
+    dynamicCasters[0].center = sphere->getPosition();
+    dynamicCasters[0].radius = sphere->getRadius();
+    dynamicCasters[0].model = glm::translate(glm::mat4(1.0f), sphere->getPosition());
+    dynamicCasters[0].draw = [](const WaterSim::GLShaderProgram& program) { sphere->render(program); };
+    // The batch's unit sphere takes the radius the shared instance buffer would
+    dynamicCasters[0].batchMesh = sphereBatchMeshes[sphere->getLOD()];
+    dynamicCasters[0].batchModel = glm::scale(dynamicCasters[0].model, glm::vec3(sphere->getRadius()));
+    
+    WaterSim::ShadowMapper::ParticleCasters particles;
+    if (sphSystem) {
+        particles.particleBuffer = sphSystem->getRenderParticleBuffer();
+        particles.countBuffer = sphSystem->getRenderCountBuffer();
+        particles.count = sphSystem->getRenderParticleCount();
+        particles.radius = WaterSim::SPHConstants::KERNEL_RADIUS;
+        particles.boundsMin = container->getPosition() - containerHalfSize;
+        particles.boundsMax = container->getPosition() + containerHalfSize;
     }
     
-    // Bind wave height texture as image
-    glBindImageTexture(0, waveHeightMap->getTextureID(), 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+    shadowMapper->render(staticCasters, dynamicCasters, particles);
+    for (const WaterSim::GLShaderProgram* receiver : {&waterShader, &waterTessShader, &waterVolumeShader, &sphereShader, &spherePlanarShader,
+                                                            &rigidBodyShader, &sphereStereoShader, &rigidBodyStereoShader,
+                                                            &waterStereoShader}) {
+        shadowMapper->applyToReceiver(*receiver);
+    }
+    glUseProgram(0);
+}
+
+// Model and material of the sphere in the planar passes
+void setPlanarSphereUniforms(const WaterSim::GLShaderProgram& shader) {
+    // Set sphere shader uniforms (camera and light are in the frame block)
+    glm::mat4 model = glm::mat4(1.0f);
+    model = glm::translate(model, sphere->getPosition());
+    shader.setMat4("model", model);
+    
+    // Set lighting uniforms
+    shader.setFloat("ambientStrength", 0.1f);
+    shader.setFloat("specularStrength", 0.8f); // Moderate for realistic metal
+    shader.setFloat("shininess", 128.0f); // High but not excessive for metal
+    
+    // Enable texture for steel appearance
+    shader.setInt("useTexture", 1);
+    if (!bindlessTextures->isSupported()) {
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, steelTexture);
+        shader.setInt("sphereTexture", 0);
+    }
     
-    // Dispatch compute threads
-    glDispatchCompute(16, 16, 1); // 256x256 texture with 16x16 local groups
+    // Enable reflections for mirror-like appearance
+    shader.setInt("enableReflections", enableSphereReflections ? 1 : 0);
+    shader.setFloat("reflectivity", sphereReflectivity);
     
-    // Memory barrier
-    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    // Bind skybox for environment reflections
+    if (!bindlessTextures->isSupported()) {
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, skyboxTexture);
+        shader.setInt("skybox", 1);
+    }
+    shader.setFloat("roughness", sphereRoughness);
+    skybox->setEnvironmentUniforms(shader, 2);
+}
+
+// A static material texture of the water, sphere and glass programs: already resident in
+// their MaterialTextures block when bindless, otherwise bound to the unit
+void bindMaterialTexture(const WaterSim::GLShaderProgram& shader, const char* name, GLenum target, GLuint texture, int unit) {
+    if (bindlessTextures->isSupported()) {
+        return;
+    }
+    glState.bindTexture(unit, target, texture);
+    shader.setInt(name, unit);
+}
+
+// The pool lights of the config, rebuilt when it changes: spotlights spread over the
+// floor in a golden-angle spiral, each aimed up and a little toward the middle
+void updatePoolLights() {
+    const WaterSim::Config::Lighting& lighting = config.lighting;
+    if (lighting.poolLights == builtPoolLights.poolLights && lighting.poolLightIntensity == builtPoolLights.poolLightIntensity &&
+        lighting.poolLightRange == builtPoolLights.poolLightRange && lighting.poolLightColor == builtPoolLights.poolLightColor) {
+        return;
+    }
+    builtPoolLights = lighting;
+    
+    std::vector<WaterSim::ClusteredLights::Light> lights(std::max(lighting.poolLights, 0));
+    float floorRadius = 0.4f * std::min(container->getWidth(), container->getDepth());
+    for (size_t i = 0; i < lights.size(); i++) {
+        float radius = floorRadius * std::sqrt((i + 0.5f) / lights.size());
+        float angle = 2.39996323f * i;
+        glm::vec3 position(radius * std::cos(angle), FLOOR_LEVEL + 0.1f, radius * std::sin(angle));
+        lights[i].position = position;
+        lights[i].direction = glm::normalize(glm::vec3(-0.2f * position.x, 1.0f, -0.2f * position.z));
+        lights[i].range = lighting.poolLightRange;
+        lights[i].color = lighting.poolLightColor;
+        lights[i].intensity = lighting.poolLightIntensity;
+        lights[i].outerAngle = 35.0f;
+        lights[i].innerAngle = 25.0f;
+    }
+    clusteredLights->setLights(lights);
+}
+
+// Camera and light of the next pass for every program with the FrameUniforms block
+// The eyes default to the mono camera, so a stereo variant drawn outside the stereo pass
+// still sees one
+void updateFrameUniforms(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& viewPos, float time,
+                         const glm::mat4* eyeViews, const glm::mat4* eyeProjections) {
+    FrameBlock block = {};
+    block.view = view;
+    block.projection = projection;
+    for (int eye = 0; eye < WaterSim::StereoRenderer::EYE_COUNT; eye++) {
+        block.eyeView[eye] = eyeViews ? eyeViews[eye] : view;
+        block.eyeProjection[eye] = eyeProjections ? eyeProjections[eye] : projection;
+    }
+    block.viewPos = viewPos;
+    block.time = time;
+    block.lightPos = glm::vec3(5.0f, 10.0f, 5.0f);
+    block.lightColor = glm::vec3(1.0f);
+    
+    glBindBuffer(GL_UNIFORM_BUFFER, frameUBO);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameBlock), &block);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+// Update the GPU wave state every consumer samples: the ray tracing and caustic passes, the
+// water shaders and the foam
+void updateWaveSimulation(float deltaTime) {
+    if (!simulationManager->isRegularWaterActive()) {
+        waveState->invalidate();
+        return;
+    }
     
-    #else
-    // Placeholder implementation - update wave height map on CPU
-    static std::vector<float> heights(256 * 256, 0.0f);
+    WaterSurface* waterSurface = simulationManager->getWaterSurface();
+    if (!waterSurface) return;
     
-    // Simple CPU-based wave calculation for demonstration
-    for (int y = 0; y < 256; y++) {
-        for (int x = 0; x < 256; x++) {
-            float worldX = (x / 256.0f - 0.5f) * 10.0f;
-            float worldZ = (y / 256.0f - 0.5f) * 10.0f;
-            
-            float height = 0.0f;
-            auto& waves = waterSurface->getWaves();
-            for (const auto& wave : waves) {
-                float k = 2.0f * 3.14159f / wave.wavelength;
-                float w = sqrt(9.8f * k);
-                float phase = k * (wave.direction.x * worldX + wave.direction.y * worldZ) - w * wave.speed * time;
-                height += wave.amplitude * sin(phase);
-            }
-            
-            heights[y * 256 + x] = height;
-        }
+    waveState->update(*waterSurface, deltaTime);
+    if (waveState->isValid()) {
+        waterSurface->setFoamWaveSurface(waveState->getHeightTexture(), waveState->getVelocityTexture(), waveState->getSize());
     }
-    
-    // Update height map texture
-    waveHeightMap->updateHeightMap(heights);
-    #endif
+}
+
+// The frame's wave state in a surface's geometry, for the passes that draw it; none before
+// the first update
+void addWaveState(WaterSurfaceGeometry& geometry) {
+    if (!waveState->isValid()) return;
+    geometry.waveHeightMap = waveState->getHeightTexture();
+    geometry.waveNormalMap = waveState->getNormalTexture();
+    geometry.waveHeightMapSize = waveState->getSize();
 }
\ No newline at end of file
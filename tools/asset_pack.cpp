@@ -0,0 +1,122 @@
+// Builds the asset pack the application maps at startup (AssetPack.h):
+//   asset_pack OUTPUT ROOT PATH...
+// Each PATH is relative to ROOT and keeps that name in the pack. Images (.png, .jpg, .tga,
+// .bmp) are decoded to RGBA8 here so the application uploads them as they lie; everything
+// else is stored as it is.
+
+#include "../include/AssetPack.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "../include/stb_image.h"
+
+using namespace WaterSim::AssetPackFormat;
+
+namespace {
+
+struct Asset {
+    std::string path;
+    std::vector<unsigned char> bytes;
+    uint32_t kind = RAW;
+    uint32_t width = 0, height = 0;
+};
+
+bool isImage(const std::string& path) {
+    std::string extension = path.substr(path.find_last_of('.') + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return std::tolower(c); });
+    return extension == "png" || extension == "jpg" || extension == "tga" || extension == "bmp";
+}
+
+bool loadAsset(const std::string& root, Asset& asset) {
+    std::string fullPath = root + "/" + asset.path;
+    if (isImage(asset.path)) {
+        int width, height, channels;
+        unsigned char* pixels = stbi_load(fullPath.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+        if (!pixels) return false;
+        asset.bytes.assign(pixels, pixels + size_t(width) * height * 4);
+        stbi_image_free(pixels);
+        asset.kind = TEXTURE_RGBA8;
+        asset.width = static_cast<uint32_t>(width);
+        asset.height = static_cast<uint32_t>(height);
+        return true;
+    }
+    std::ifstream file(fullPath, std::ios::binary);
+    if (!file) return false;
+    asset.bytes.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return true;
+}
+
+uint64_t alignUp(uint64_t offset) {
+    return (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::cerr << "usage: asset_pack OUTPUT ROOT PATH..." << std::endl;
+        return 1;
+    }
+    
+    std::vector<Asset> assets;
+    for (int i = 3; i < argc; i++) {
+        Asset asset;
+        asset.path = argv[i];
+        if (!loadAsset(argv[2], asset)) {
+            std::cerr << "asset_pack: cannot read " << argv[2] << "/" << asset.path << std::endl;
+            return 1;
+        }
+        assets.push_back(std::move(asset));
+    }
+    
+    // Header, entries and paths up front; the blobs follow on page boundaries
+    Header header;
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.entryCount = static_cast<uint32_t>(assets.size());
+    
+    std::vector<Entry> entries(assets.size());
+    uint64_t offset = sizeof(Header) + entries.size() * sizeof(Entry);
+    for (size_t i = 0; i < assets.size(); i++) {
+        entries[i].pathOffset = static_cast<uint32_t>(offset);
+        entries[i].pathLength = static_cast<uint32_t>(assets[i].path.size());
+        offset += assets[i].path.size();
+    }
+    for (size_t i = 0; i < assets.size(); i++) {
+        offset = alignUp(offset);
+        entries[i].dataOffset = offset;
+        entries[i].dataSize = assets[i].bytes.size();
+        entries[i].kind = assets[i].kind;
+        entries[i].width = assets[i].width;
+        entries[i].height = assets[i].height;
+        entries[i].reserved = 0;
+        offset += assets[i].bytes.size();
+    }
+    
+    std::ofstream output(argv[1], std::ios::binary | std::ios::trunc);
+    output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    output.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(Entry));
+    for (const Asset& asset : assets) {
+        output.write(asset.path.data(), asset.path.size());
+    }
+    for (size_t i = 0; i < assets.size(); i++) {
+        uint64_t position = static_cast<uint64_t>(output.tellp());
+        std::vector<char> padding(entries[i].dataOffset - position, 0);
+        output.write(padding.data(), padding.size());
+        output.write(reinterpret_cast<const char*>(assets[i].bytes.data()), assets[i].bytes.size());
+    }
+    if (!output) {
+        std::cerr << "asset_pack: cannot write " << argv[1] << std::endl;
+        return 1;
+    }
+    
+    std::cout << "asset_pack: " << assets.size() << " assets, " << offset << " bytes into " << argv[1] << std::endl;
+    return 0;
+}